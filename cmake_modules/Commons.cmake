@@ -44,6 +44,10 @@ macro(add_dependent_packages_for_redex)
     find_package(ZLIB REQUIRED)
     print_dirs("${ZLIB_INCLUDE_DIRS}" "ZLIB_INCLUDE_DIRS")
     print_dirs("${ZLIB_LIBRARIES}" "ZLIB_LIBRARIES")
+
+    find_package(LibLZMA REQUIRED)
+    print_dirs("${LIBLZMA_INCLUDE_DIRS}" "LIBLZMA_INCLUDE_DIRS")
+    print_dirs("${LIBLZMA_LIBRARIES}" "LIBLZMA_LIBRARIES")
 endmacro()
 
 function(set_link_whole target_name lib_name)
@@ -33,7 +33,7 @@ Locator::make(uint32_t str, uint32_t dex, uint32_t cls)
 }
 
 uint32_t
-Locator::encode(char buf[encoded_max]) noexcept
+Locator::encode(char buf[encoded_max]) const noexcept
 {
   uint64_t value = strnr << clsnr_bits;
   value = (value | clsnr) << dexnr_bits;
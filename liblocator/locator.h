@@ -99,7 +99,7 @@ class Locator {
   // Estimating six bits per byte is conservative enough.
   constexpr static const uint32_t encoded_max = (bits + 5) / 6 + 1;
 
-  uint32_t encode(char buf[encoded_max]) noexcept;
+  uint32_t encode(char buf[encoded_max]) const noexcept;
 
   static inline Locator decodeBackward(const char* endpos) noexcept;
 
@@ -0,0 +1,569 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "AbstractDomain.h"
+#include "Debug.h"
+#include "PatriciaTreeMap.h"
+
+namespace aae_impl {
+
+template <typename Variable, typename Domain, size_t N>
+class MapValue;
+
+class value_is_bottom {};
+
+} // namespace aae_impl
+
+/*
+ * An abstract environment that keeps up to N bindings in a sorted array stored
+ * inline, and switches to a Patricia tree once it grows past that.
+ *
+ * Most of the environments manipulated by an intraprocedural analysis only
+ * bind a handful of registers, and they are copied on every edge of the CFG.
+ * Copying a small environment is then a plain copy of its bindings, without any
+ * allocation, and the lattice operations are merges of two sorted arrays. Large
+ * environments retain the cheap copies and the sharing of Patricia trees. An
+ * environment that has been promoted to a tree stays a tree, except when it's
+ * the result of a join or widening with a small environment, which is always
+ * small.
+ *
+ * As in PatriciaTreeMapAbstractEnvironment, we do not explicitly represent
+ * bindings of a variable to the Top element. The variables must be integers or
+ * pointers (see PatriciaTreeMap.h). See HashedAbstractEnvironment.h for more
+ * details about abstract environments.
+ */
+template <typename Variable, typename Domain, size_t N = 8>
+class AdaptiveAbstractEnvironment final
+    : public AbstractDomainScaffolding<
+          aae_impl::MapValue<Variable, Domain, N>,
+          AdaptiveAbstractEnvironment<Variable, Domain, N>> {
+ public:
+  using Value = aae_impl::MapValue<Variable, Domain, N>;
+
+  using AbstractValueKind = typename AbstractValue<Value>::Kind;
+
+  /*
+   * The default constructor produces the Top value.
+   */
+  AdaptiveAbstractEnvironment()
+      : AbstractDomainScaffolding<Value, AdaptiveAbstractEnvironment>() {}
+
+  AdaptiveAbstractEnvironment(AbstractValueKind kind)
+      : AbstractDomainScaffolding<Value, AdaptiveAbstractEnvironment>(kind) {}
+
+  AdaptiveAbstractEnvironment(
+      std::initializer_list<std::pair<Variable, Domain>> l) {
+    for (const auto& p : l) {
+      if (p.second.is_bottom()) {
+        this->set_to_bottom();
+        return;
+      }
+      this->get_value()->insert_binding(p.first, p.second);
+    }
+    this->normalize();
+  }
+
+  size_t size() const {
+    assert(this->kind() == AbstractValueKind::Value);
+    return this->get_value()->size();
+  }
+
+  /*
+   * The bindings are not enumerated in any particular order.
+   */
+  const Value& bindings() const {
+    assert(this->kind() == AbstractValueKind::Value);
+    return *this->get_value();
+  }
+
+  Domain get(const Variable& variable) const {
+    if (this->is_bottom()) {
+      return Domain::bottom();
+    }
+    return this->get_value()->at(variable);
+  }
+
+  AdaptiveAbstractEnvironment& set(const Variable& variable,
+                                   const Domain& value) {
+    if (this->is_bottom()) {
+      return *this;
+    }
+    if (value.is_bottom()) {
+      this->set_to_bottom();
+      return *this;
+    }
+    this->get_value()->insert_binding(variable, value);
+    this->normalize();
+    return *this;
+  }
+
+  AdaptiveAbstractEnvironment& update(
+      const Variable& variable,
+      std::function<Domain(const Domain&)> operation) {
+    if (this->is_bottom()) {
+      return *this;
+    }
+    return set(variable, operation(this->get_value()->at(variable)));
+  }
+
+  /*
+   * Returns whether the bindings are stored in a Patricia tree (for test use).
+   */
+  bool is_promoted() const { return this->get_value()->is_promoted(); }
+
+  static AdaptiveAbstractEnvironment bottom() {
+    return AdaptiveAbstractEnvironment(AbstractValueKind::Bottom);
+  }
+
+  static AdaptiveAbstractEnvironment top() {
+    return AdaptiveAbstractEnvironment(AbstractValueKind::Top);
+  }
+
+  std::string str() const;
+};
+
+template <typename Variable, typename Domain, size_t N>
+inline std::ostream& operator<<(
+    std::ostream& o, const AdaptiveAbstractEnvironment<Variable, Domain, N>& e) {
+  using AbstractValueKind =
+      typename AdaptiveAbstractEnvironment<Variable, Domain,
+                                           N>::AbstractValueKind;
+  switch (e.kind()) {
+  case AbstractValueKind::Bottom: {
+    o << "_|_";
+    break;
+  }
+  case AbstractValueKind::Top: {
+    o << "T";
+    break;
+  }
+  case AbstractValueKind::Value: {
+    o << "[#" << e.size() << "]";
+    o << "{";
+    auto& bindings = e.bindings();
+    for (auto it = bindings.begin(); it != bindings.end();) {
+      o << it->first << " -> " << it->second;
+      ++it;
+      if (it != bindings.end()) {
+        o << ", ";
+      }
+    }
+    o << "}";
+    break;
+  }
+  }
+  return o;
+}
+
+template <typename Variable, typename Domain, size_t N>
+inline std::string AdaptiveAbstractEnvironment<Variable, Domain, N>::str()
+    const {
+  std::ostringstream ss;
+  ss << *this;
+  return ss.str();
+}
+
+namespace aae_impl {
+
+/*
+ * The definition of an element of an adaptive abstract environment. The
+ * bindings are either held by the first `m_size` slots of `m_small`, sorted by
+ * variable, or by `m_map` when it's not empty, in which case `m_size` is zero.
+ * Neither of them ever contains bindings to Top or Bottom. The Meet and
+ * Narrowing operations abort and return Kind::Bottom whenever a binding with
+ * Bottom is about to be created.
+ */
+template <typename Variable, typename Domain, size_t N>
+class MapValue final : public AbstractValue<MapValue<Variable, Domain, N>> {
+ public:
+  using Kind = typename AbstractValue<MapValue<Variable, Domain, N>>::Kind;
+
+  using Binding = std::pair<Variable, Domain>;
+
+  struct ValueInterface {
+    using type = Domain;
+
+    static type default_value() { return type::top(); }
+
+    static bool is_default_value(const type& x) { return x.is_top(); }
+
+    static bool equals(const type& x, const type& y) { return x.equals(y); }
+
+    static bool leq(const type& x, const type& y) { return x.leq(y); }
+  };
+
+  using Map = PatriciaTreeMap<Variable, ValueInterface>;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Binding;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Binding*;
+    using reference = const Binding&;
+
+    const Binding& operator*() const {
+      return m_binding != nullptr ? *m_binding : *m_map_iterator;
+    }
+
+    const Binding* operator->() const { return &**this; }
+
+    const_iterator& operator++() {
+      if (m_binding != nullptr) {
+        ++m_binding;
+      } else {
+        ++m_map_iterator;
+      }
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      auto result = *this;
+      ++(*this);
+      return result;
+    }
+
+    bool operator==(const const_iterator& that) const {
+      return m_binding == that.m_binding &&
+             m_map_iterator == that.m_map_iterator;
+    }
+
+    bool operator!=(const const_iterator& that) const {
+      return !(*this == that);
+    }
+
+   private:
+    explicit const_iterator(const Binding* binding) : m_binding(binding) {}
+
+    explicit const_iterator(typename Map::iterator it)
+        : m_binding(nullptr), m_map_iterator(std::move(it)) {}
+
+    // Null when iterating over the Patricia tree.
+    const Binding* m_binding;
+    // The dereference operator of PatriciaTreeIterator isn't const.
+    mutable typename Map::iterator m_map_iterator;
+
+    friend class MapValue;
+  };
+
+  MapValue() = default;
+
+  // Only the slots that are in use are copied.
+  MapValue(const MapValue& other) : m_size(other.m_size), m_map(other.m_map) {
+    std::copy_n(other.m_small.begin(), m_size, m_small.begin());
+  }
+
+  MapValue& operator=(const MapValue& other) {
+    if (this != &other) {
+      std::copy_n(other.m_small.begin(), other.m_size, m_small.begin());
+      m_size = other.m_size;
+      m_map = other.m_map;
+    }
+    return *this;
+  }
+
+  void clear() override {
+    m_size = 0;
+    m_map.clear();
+  }
+
+  Kind kind() const override {
+    // If there are no bindings, then all variables are implicitly bound to
+    // Top, i.e., the abstract environment itself is Top.
+    return (m_size == 0 && m_map.is_empty()) ? Kind::Top : Kind::Value;
+  }
+
+  bool is_promoted() const { return !m_map.is_empty(); }
+
+  size_t size() const { return is_promoted() ? m_map.size() : m_size; }
+
+  const_iterator begin() const {
+    return is_promoted() ? const_iterator(m_map.begin())
+                         : const_iterator(m_small.data());
+  }
+
+  const_iterator end() const {
+    return is_promoted() ? const_iterator(m_map.end())
+                         : const_iterator(m_small.data() + m_size);
+  }
+
+  Domain at(const Variable& variable) const {
+    if (is_promoted()) {
+      return m_map.at(variable);
+    }
+    auto it = find(variable);
+    return it == nullptr ? Domain::top() : it->second;
+  }
+
+  bool leq(const MapValue& other) const override {
+    if (is_promoted() && other.is_promoted()) {
+      return m_map.leq(other.m_map);
+    }
+    // A variable that is not bound in this environment is bound to Top, so
+    // every binding of the other environment must have a smaller counterpart.
+    for (const auto& binding : other) {
+      if (!at(binding.first).leq(binding.second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool equals(const MapValue& other) const override {
+    if (is_promoted() && other.is_promoted()) {
+      return m_map.equals(other.m_map);
+    }
+    if (size() != other.size()) {
+      return false;
+    }
+    for (const auto& binding : other) {
+      if (!at(binding.first).equals(binding.second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Kind join_with(const MapValue& other) override {
+    return join_like_operation(
+        other,
+        [](const Domain& x, const Domain& y) { return x.join(y); },
+        JOIN_ID);
+  }
+
+  Kind widen_with(const MapValue& other) override {
+    return join_like_operation(
+        other,
+        [](const Domain& x, const Domain& y) { return x.join(y); },
+        WIDEN_ID);
+  }
+
+  Kind meet_with(const MapValue& other) override {
+    return meet_like_operation(
+        other,
+        [](const Domain& x, const Domain& y) { return x.meet(y); },
+        MEET_ID);
+  }
+
+  Kind narrow_with(const MapValue& other) override {
+    return meet_like_operation(
+        other,
+        [](const Domain& x, const Domain& y) { return x.meet(y); },
+        NARROW_ID);
+  }
+
+ private:
+  using Operation = std::function<Domain(const Domain&, const Domain&)>;
+
+  static bool precedes(const Binding& binding, const Variable& variable) {
+    return std::less<Variable>()(binding.first, variable);
+  }
+
+  const Binding* find(const Variable& variable) const {
+    auto end = m_small.begin() + m_size;
+    auto it = std::lower_bound(m_small.begin(), end, variable, precedes);
+    return (it != end && it->first == variable) ? &*it : nullptr;
+  }
+
+  void insert_binding(const Variable& variable, const Domain& value) {
+    assert(!value.is_bottom());
+    if (is_promoted()) {
+      m_map.insert_or_assign(variable, value);
+      return;
+    }
+    auto end = m_small.begin() + m_size;
+    auto it = std::lower_bound(m_small.begin(), end, variable, precedes);
+    if (it != end && it->first == variable) {
+      if (value.is_top()) {
+        std::move(it + 1, end, it);
+        --m_size;
+      } else {
+        it->second = value;
+      }
+      return;
+    }
+    if (value.is_top()) {
+      return;
+    }
+    if (m_size == N) {
+      promote();
+      m_map.insert_or_assign(variable, value);
+      return;
+    }
+    std::move_backward(it, end, end + 1);
+    *it = Binding(variable, value);
+    ++m_size;
+  }
+
+  void promote() {
+    Map map;
+    for (size_t i = 0; i < m_size; ++i) {
+      map.insert_or_assign(m_small[i].first, m_small[i].second);
+    }
+    m_map = std::move(map);
+    m_size = 0;
+  }
+
+  // The ids under which the results of the lattice operations on the
+  // underlying maps are memoized (see PatriciaTreeMap::union_with()).
+  static constexpr size_t JOIN_ID = 1;
+  static constexpr size_t WIDEN_ID = 2;
+  static constexpr size_t MEET_ID = 3;
+  static constexpr size_t NARROW_ID = 4;
+
+  // The result of a join only binds the variables that are bound in both
+  // operands, hence it's small as soon as one of them is.
+  Kind join_like_operation(const MapValue& other,
+                           const Operation& operation,
+                           size_t memoization_id) {
+    if (is_promoted() && other.is_promoted()) {
+      m_map.intersection_with(operation, other.m_map, memoization_id);
+      return kind();
+    }
+    if (is_promoted()) {
+      size_t k = 0;
+      for (size_t j = 0; j < other.m_size; ++j) {
+        const auto& binding = other.m_small[j];
+        Domain result = operation(m_map.at(binding.first), binding.second);
+        if (!result.is_top()) {
+          m_small[k++] = Binding(binding.first, std::move(result));
+        }
+      }
+      m_map.clear();
+      m_size = k;
+      return kind();
+    }
+    // Since at most one binding is written per binding of this environment
+    // that has been read, the result can be built in place.
+    size_t k = 0;
+    if (other.is_promoted()) {
+      for (size_t i = 0; i < m_size; ++i) {
+        Domain result =
+            operation(m_small[i].second, other.m_map.at(m_small[i].first));
+        if (!result.is_top()) {
+          m_small[k++] = Binding(m_small[i].first, std::move(result));
+        }
+      }
+    } else {
+      size_t i = 0, j = 0;
+      while (i < m_size && j < other.m_size) {
+        const auto& x = m_small[i];
+        const auto& y = other.m_small[j];
+        if (precedes(x, y.first)) {
+          ++i;
+        } else if (precedes(y, x.first)) {
+          ++j;
+        } else {
+          Domain result = operation(x.second, y.second);
+          if (!result.is_top()) {
+            m_small[k++] = Binding(x.first, std::move(result));
+          }
+          ++i;
+          ++j;
+        }
+      }
+    }
+    m_size = k;
+    return kind();
+  }
+
+  Kind meet_like_operation(const MapValue& other,
+                           const Operation& operation,
+                           size_t memoization_id) {
+    if (!is_promoted() && !other.is_promoted()) {
+      return merge_small(other, operation);
+    }
+    if (!is_promoted()) {
+      promote();
+    }
+    const Map* other_map = &other.m_map;
+    Map promoted_other;
+    if (!other.is_promoted()) {
+      for (const auto& binding : other) {
+        promoted_other.insert_or_assign(binding.first, binding.second);
+      }
+      other_map = &promoted_other;
+    }
+    try {
+      m_map.union_with(
+          [&operation](const Domain& x, const Domain& y) {
+            Domain result = operation(x, y);
+            if (result.is_bottom()) {
+              throw value_is_bottom();
+            }
+            return result;
+          },
+          *other_map,
+          memoization_id);
+      return kind();
+    } catch (const value_is_bottom&) {
+      clear();
+      return Kind::Bottom;
+    }
+  }
+
+  // Computes the union of two small environments, which may no longer fit in
+  // the inline array.
+  Kind merge_small(const MapValue& other, const Operation& operation) {
+    std::vector<Binding> bindings;
+    bindings.reserve(m_size + other.m_size);
+    size_t i = 0, j = 0;
+    while (i < m_size || j < other.m_size) {
+      if (j == other.m_size ||
+          (i < m_size && precedes(m_small[i], other.m_small[j].first))) {
+        bindings.push_back(m_small[i++]);
+      } else if (i == m_size || precedes(other.m_small[j], m_small[i].first)) {
+        bindings.push_back(other.m_small[j++]);
+      } else {
+        Domain result = operation(m_small[i].second, other.m_small[j].second);
+        if (result.is_bottom()) {
+          clear();
+          return Kind::Bottom;
+        }
+        if (!result.is_top()) {
+          bindings.emplace_back(m_small[i].first, std::move(result));
+        }
+        ++i;
+        ++j;
+      }
+    }
+    if (bindings.size() <= N) {
+      std::move(bindings.begin(), bindings.end(), m_small.begin());
+      m_size = bindings.size();
+    } else {
+      m_size = 0;
+      for (const auto& binding : bindings) {
+        m_map.insert_or_assign(binding.first, binding.second);
+      }
+    }
+    return kind();
+  }
+
+  std::array<Binding, N> m_small;
+  size_t m_size{0};
+  Map m_map;
+
+  template <typename T1, typename T2, size_t T3>
+  friend class ::AdaptiveAbstractEnvironment;
+};
+
+} // namespace aae_impl
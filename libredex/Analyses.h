@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include "AnalysisManager.h"
+#include "CallGraph.h"
+#include "ClassHierarchy.h"
+#include "DexUtil.h"
+#include "ReverseRefIndex.h"
+#include "StaticRefIndex.h"
+#include "TypeSystem.h"
+
+/*
+ * The whole-program analyses that can be requested from the AnalysisManager.
+ * They depend on the classes in the stores and on their hierarchy, but not
+ * on the code of the methods, so passes that only rewrite code can preserve
+ * them.
+ */
+
+/*
+ * The class hierarchy of all the classes in the stores.
+ */
+struct ClassHierarchyAnalysis {
+  using Result = ClassHierarchy;
+  static Result run(DexStoresVector& stores) {
+    return build_type_hierarchy(build_class_scope(stores));
+  }
+};
+
+/*
+ * The TypeSystem of all the classes in the stores. It also depends on the
+ * virtual methods of the classes.
+ */
+struct TypeSystemAnalysis {
+  using Result = TypeSystem;
+  static Result run(DexStoresVector& stores) {
+    return TypeSystem(build_class_scope(stores));
+  }
+};
+
+/*
+ * The call graph of all the methods in the stores, with or without the
+ * calls to virtual methods that have a single definition. Unlike the
+ * analyses above it depends on the code, and its edges point at invoke
+ * instructions, so only a pass that leaves every invoke alone may preserve
+ * it.
+ */
+template <bool include_virtuals>
+struct CallGraphAnalysis {
+  using Result = call_graph::Graph;
+  static Result run(DexStoresVector& stores) {
+    return call_graph::Graph(build_class_scope(stores), include_virtuals);
+  }
+};
+
+/*
+ * The StaticRefIndex of all the code in the stores. It holds iterators into
+ * the code, so only a pass that removes no instruction (and no method with
+ * code) may preserve it.
+ */
+struct StaticRefsAnalysis {
+  using Result = StaticRefIndex;
+  static Result run(DexStoresVector& stores) {
+    return StaticRefIndex(build_class_scope(stores));
+  }
+};
+
+/*
+ * The ReverseRefIndex of all the code in the stores. It points at
+ * instructions, so only a pass that doesn't change the references of the code
+ * (or that updates the index itself) may preserve it.
+ */
+struct ReverseRefsAnalysis {
+  using Result = ReverseRefIndex;
+  static Result run(DexStoresVector& stores) {
+    return ReverseRefIndex(build_class_scope(stores));
+  }
+};
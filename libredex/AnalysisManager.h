@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <memory>
+#include <typeindex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "DexStore.h"
+
+/*
+ * The set of analyses that a pass leaves valid. See Pass::preserved_analyses().
+ */
+class PreservedAnalyses {
+ public:
+  template <typename Analysis>
+  void preserve() {
+    m_preserved.emplace(typeid(Analysis));
+  }
+
+  void preserve_all() { m_all = true; }
+
+  template <typename Analysis>
+  bool preserves() const {
+    return preserves(typeid(Analysis));
+  }
+
+  bool preserves(std::type_index analysis) const {
+    return m_all || m_preserved.count(analysis) > 0;
+  }
+
+ private:
+  bool m_all{false};
+  std::unordered_set<std::type_index> m_preserved;
+};
+
+/*
+ * Caches the results of whole-program analyses across passes, so that passes
+ * that need the same structure (e.g. the class hierarchy) don't all build it
+ * again. An analysis is a type that provides:
+ *
+ *   using Result = ...;
+ *   static Result run(DexStoresVector& stores);
+ *
+ * Results are computed lazily, on the first request following their
+ * invalidation. The PassManager invalidates, after each pass, every analysis
+ * that the pass doesn't declare as preserved.
+ *
+ * The references returned by get() are only valid until the analysis is
+ * invalidated, i.e. they must not be kept across passes.
+ */
+class AnalysisManager {
+ public:
+  template <typename Analysis>
+  const typename Analysis::Result& get(DexStoresVector& stores) {
+    return get_mutable<Analysis>(stores);
+  }
+
+  /*
+   * Same as get(), for a pass that keeps the result current itself as it
+   * edits the program, so that it can preserve the analysis.
+   */
+  template <typename Analysis>
+  typename Analysis::Result& get_mutable(DexStoresVector& stores) {
+    using Result = typename Analysis::Result;
+    auto& cached = m_results[typeid(Analysis)];
+    if (cached == nullptr) {
+      cached = std::make_shared<Result>(Analysis::run(stores));
+    }
+    return *std::static_pointer_cast<Result>(cached);
+  }
+
+  template <typename Analysis>
+  bool is_cached() const {
+    return m_results.count(typeid(Analysis)) > 0;
+  }
+
+  template <typename Analysis>
+  void invalidate() {
+    m_results.erase(typeid(Analysis));
+  }
+
+  /*
+   * Drop the results of all the analyses that aren't preserved.
+   */
+  void invalidate(const PreservedAnalyses& preserved) {
+    for (auto it = m_results.begin(); it != m_results.end();) {
+      if (preserved.preserves(it->first)) {
+        ++it;
+      } else {
+        it = m_results.erase(it);
+      }
+    }
+  }
+
+  void clear() { m_results.clear(); }
+
+ private:
+  std::unordered_map<std::type_index, std::shared_ptr<void>> m_results;
+};
@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Debug.h"
+
+/*
+ * A thread-safe bump-pointer arena for objects that live as long as the arena
+ * itself, like the entities interned by RedexContext.
+ *
+ * Memory is carved out of large chunks with a single atomic add, so there is
+ * no per-object allocator header and, in the common case, no lock. Memory is
+ * only released when the arena is destroyed, and the arena never runs
+ * destructors: whoever places objects into it is responsible for destroying
+ * them before the arena goes away.
+ */
+class Arena {
+ public:
+  static constexpr size_t ALIGNMENT = alignof(void*);
+
+  explicit Arena(size_t chunk_size = 1 << 20) : m_chunk_size(chunk_size) {
+    new_chunk(nullptr, 0);
+  }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  /*
+   * Returns uninitialized storage for `size` bytes, aligned to ALIGNMENT.
+   * This operation is always thread-safe.
+   */
+  void* allocate(size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    while (true) {
+      Chunk* chunk = m_current.load(std::memory_order_acquire);
+      size_t offset = chunk->used.fetch_add(size, std::memory_order_relaxed);
+      if (offset + size <= chunk->size) {
+        return chunk->data.get() + offset;
+      }
+      new_chunk(chunk, size);
+    }
+  }
+
+  /*
+   * Typed version of allocate(), for use with placement new.
+   */
+  template <class T>
+  void* allocate() {
+    static_assert(alignof(T) <= ALIGNMENT, "Arena alignment is too small");
+    return allocate(sizeof(T));
+  }
+
+  /*
+   * Total number of bytes reserved from the system allocator.
+   */
+  size_t reserved_bytes() {
+    std::lock_guard<std::mutex> guard(m_chunks_lock);
+    size_t total = 0;
+    for (const auto& chunk : m_chunks) {
+      total += chunk->size;
+    }
+    return total;
+  }
+
+ private:
+  struct Chunk {
+    explicit Chunk(size_t size) : data(new char[size]), size(size) {}
+    std::unique_ptr<char[]> data;
+    const size_t size;
+    std::atomic<size_t> used{0};
+  };
+
+  // Replace `full` with a fresh chunk big enough for `min_size`, unless
+  // another thread already did.
+  void new_chunk(Chunk* full, size_t min_size) {
+    std::lock_guard<std::mutex> guard(m_chunks_lock);
+    if (m_current.load(std::memory_order_relaxed) != full) {
+      return;
+    }
+    m_chunks.emplace_back(new Chunk(std::max(m_chunk_size, min_size)));
+    m_current.store(m_chunks.back().get(), std::memory_order_release);
+  }
+
+  const size_t m_chunk_size;
+  std::atomic<Chunk*> m_current{nullptr};
+  std::mutex m_chunks_lock;
+  std::vector<std::unique_ptr<Chunk>> m_chunks;
+};
@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "BinaryMappingFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include "Debug.h"
+
+namespace binary_mapping {
+
+namespace {
+
+const uint32_t kMagic = 0x6d786472; // "rdxm"
+const uint16_t kVersion = 1;
+
+struct SegmentHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t kind;
+  uint32_t signature;
+  uint32_t count;
+  uint32_t strings_size;
+};
+
+constexpr size_t kRecordWords = 3;
+
+bool keyed_by_num(Kind kind) {
+  return kind == Kind::METHOD_MAPPING || kind == Kind::CLASS_MAPPING;
+}
+
+size_t align4(size_t size) { return (size + 3) & ~3; }
+
+} // namespace
+
+uint32_t Writer::intern(const std::string& str) {
+  auto it = m_string_offsets.find(str);
+  if (it != m_string_offsets.end()) {
+    return it->second;
+  }
+  uint32_t offset = m_strings.size();
+  m_strings.append(str.c_str(), str.size() + 1);
+  m_string_offsets.emplace(str, offset);
+  return offset;
+}
+
+void Writer::add(uint32_t num,
+                 const std::string& str0,
+                 const std::string& str1) {
+  m_records.push_back({num, intern(str0), intern(str1)});
+}
+
+void Writer::append_to(const std::string& filename) const {
+  std::vector<uint32_t> sorted(m_records.size());
+  std::iota(sorted.begin(), sorted.end(), 0);
+  if (keyed_by_num(m_kind)) {
+    std::stable_sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+      return m_records[a].num < m_records[b].num;
+    });
+  } else {
+    const char* strings = m_strings.data();
+    std::stable_sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+      return strcmp(strings + m_records[a].str0,
+                    strings + m_records[b].str0) < 0;
+    });
+  }
+
+  SegmentHeader header;
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.kind = static_cast<uint16_t>(m_kind);
+  header.signature = m_signature;
+  header.count = m_records.size();
+  header.strings_size = align4(m_strings.size());
+
+  FILE* fd = fopen(filename.c_str(), "ab");
+  always_assert_log(fd, "Can't open binary mapping file %s: %s\n",
+                    filename.c_str(), strerror(errno));
+  fwrite(&header, sizeof(header), 1, fd);
+  fwrite(sorted.data(), sizeof(uint32_t), sorted.size(), fd);
+  fwrite(m_records.data(), sizeof(RawRecord), m_records.size(), fd);
+  fwrite(m_strings.data(), 1, m_strings.size(), fd);
+  static const char padding[4] = {};
+  fwrite(padding, 1, header.strings_size - m_strings.size(), fd);
+  always_assert_log(!ferror(fd), "Failed writing binary mapping file %s\n",
+                    filename.c_str());
+  fclose(fd);
+}
+
+Record Reader::Segment::record(uint32_t i) const {
+  const uint32_t* raw = records + i * kRecordWords;
+  return Record{raw[0], strings + raw[1], strings + raw[2]};
+}
+
+Reader::Reader(const std::string& filename) {
+  m_file.open(filename, boost::iostreams::mapped_file::readonly);
+  always_assert_log(m_file.is_open(), "Can't open binary mapping file %s\n",
+                    filename.c_str());
+  const char* cur = m_file.const_data();
+  const char* end = cur + m_file.size();
+  while (cur < end) {
+    SegmentHeader header;
+    always_assert_log((size_t)(end - cur) >= sizeof(header),
+                      "Truncated binary mapping file %s\n", filename.c_str());
+    memcpy(&header, cur, sizeof(header));
+    always_assert_log(header.magic == kMagic && header.version == kVersion,
+                      "Bad binary mapping file %s\n", filename.c_str());
+    size_t size = sizeof(header) +
+                  header.count * (1 + kRecordWords) * sizeof(uint32_t) +
+                  header.strings_size;
+    always_assert_log((size_t)(end - cur) >= size,
+                      "Truncated binary mapping file %s\n", filename.c_str());
+    Segment segment;
+    segment.kind = static_cast<Kind>(header.kind);
+    segment.signature = header.signature;
+    segment.count = header.count;
+    segment.sorted = reinterpret_cast<const uint32_t*>(cur + sizeof(header));
+    segment.records = segment.sorted + header.count;
+    segment.strings =
+        reinterpret_cast<const char*>(segment.records +
+                                      header.count * kRecordWords);
+    m_segments.push_back(segment);
+    cur += size;
+  }
+}
+
+bool Reader::find(Kind kind,
+                  uint32_t signature,
+                  uint32_t num,
+                  Record* out) const {
+  for (const auto& segment : m_segments) {
+    if (segment.kind != kind || segment.signature != signature) {
+      continue;
+    }
+    auto it = std::lower_bound(
+        segment.sorted, segment.sorted + segment.count, num,
+        [&](uint32_t i, uint32_t n) { return segment.record(i).num < n; });
+    if (it != segment.sorted + segment.count &&
+        segment.record(*it).num == num) {
+      *out = segment.record(*it);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Reader::find(Kind kind, const char* key, Record* out) const {
+  for (const auto& segment : m_segments) {
+    if (segment.kind != kind) {
+      continue;
+    }
+    auto it = std::lower_bound(
+        segment.sorted, segment.sorted + segment.count, key,
+        [&](uint32_t i, const char* k) {
+          return strcmp(segment.record(i).str0, k) < 0;
+        });
+    if (it != segment.sorted + segment.count &&
+        strcmp(segment.record(*it).str0, key) == 0) {
+      *out = segment.record(*it);
+      return true;
+    }
+  }
+  return false;
+}
+
+void Reader::write_text(FILE* fd) const {
+  for (const auto& segment : m_segments) {
+    for (uint32_t i = 0; i < segment.count; ++i) {
+      auto record = segment.record(i);
+      switch (segment.kind) {
+      case Kind::METHOD_MAPPING:
+        fprintf(fd, "%u %u %s %s\n", record.num, segment.signature,
+                record.str0, record.str1);
+        break;
+      case Kind::CLASS_MAPPING:
+        fprintf(fd, "%u %u %s\n", record.num, segment.signature, record.str0);
+        break;
+      case Kind::PG_MAPPING:
+        fprintf(fd, "%s\n", record.str1);
+        break;
+      case Kind::BYTECODE_OFFSETS:
+        fprintf(fd, "%u %s\n", record.num, record.str0);
+        break;
+      }
+    }
+  }
+}
+
+} // namespace binary_mapping
@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * A binary alternative to the text symbol files DexOutput writes (method and
+ * class id maps, the proguard map and the bytecode offset map), which can be
+ * looked up through mmap without parsing, and converted back to the exact
+ * text.
+ *
+ * Like the text files, the file is appended to once per dex: it is a series
+ * of self-contained segments. Each segment is
+ *
+ *   header   { magic, version, kind, dex signature, count, strings size }
+ *   sorted   uint32_t[count], record indices in lookup key order
+ *   records  { num, str0, str1 }[count], in the order the text file has them
+ *   strings  NUL-terminated, deduplicated, each referenced by its offset
+ *
+ * padded to 4 bytes. What num, str0 and str1 mean depends on the kind.
+ */
+namespace binary_mapping {
+
+enum class Kind : uint16_t {
+  // num: method or class index; str0: method name, or class name; str1:
+  // the method's class. Keyed by num.
+  METHOD_MAPPING = 1,
+  CLASS_MAPPING = 2,
+  // str0: the obfuscated class descriptor, or member as Lcls;.name:type;
+  // str1: the text line. Keyed by str0.
+  PG_MAPPING = 3,
+  // num: the offset; str0: the method name. Keyed by str0.
+  BYTECODE_OFFSETS = 4,
+};
+
+struct Record {
+  uint32_t num;
+  const char* str0;
+  const char* str1;
+};
+
+class Writer {
+ public:
+  Writer(Kind kind, uint32_t signature) : m_kind(kind), m_signature(signature) {}
+
+  void add(uint32_t num, const std::string& str0, const std::string& str1 = "");
+
+  // Appends this dex's segment.
+  void append_to(const std::string& filename) const;
+
+ private:
+  struct RawRecord {
+    uint32_t num;
+    uint32_t str0;
+    uint32_t str1;
+  };
+
+  uint32_t intern(const std::string& str);
+
+  Kind m_kind;
+  uint32_t m_signature;
+  std::vector<RawRecord> m_records;
+  std::string m_strings;
+  std::unordered_map<std::string, uint32_t> m_string_offsets;
+};
+
+class Reader {
+ public:
+  explicit Reader(const std::string& filename);
+
+  struct Segment {
+    Kind kind;
+    uint32_t signature;
+    uint32_t count;
+    const uint32_t* sorted;
+    const uint32_t* records;
+    const char* strings;
+
+    Record record(uint32_t i) const;
+  };
+
+  const std::vector<Segment>& segments() const { return m_segments; }
+
+  // METHOD_MAPPING and CLASS_MAPPING: the record of the method or class with
+  // the given index in the dex with the given signature.
+  bool find(Kind kind, uint32_t signature, uint32_t num, Record* out) const;
+
+  // PG_MAPPING and BYTECODE_OFFSETS: the first record with the given key.
+  bool find(Kind kind, const char* key, Record* out) const;
+
+  // Writes the text file DexOutput would have written.
+  void write_text(FILE* fd) const;
+
+ private:
+  boost::iostreams::mapped_file m_file;
+  std::vector<Segment> m_segments;
+};
+
+} // namespace binary_mapping
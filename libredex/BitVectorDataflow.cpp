@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "BitVectorDataflow.h"
+
+#include <algorithm>
+
+namespace bitvector_dataflow {
+
+GenKillAnalysis::GenKillAnalysis(const ControlFlowGraph& cfg,
+                                 size_t num_bits,
+                                 Direction direction,
+                                 Meet meet)
+    : m_cfg(cfg), m_num_bits(num_bits), m_direction(direction), m_meet(meet) {
+  size_t num_blocks = cfg.blocks().size();
+  m_gen.resize(num_blocks, BitVector(num_bits));
+  m_kill.resize(num_blocks, BitVector(num_bits));
+}
+
+void GenKillAnalysis::run(const BitVector& boundary) {
+  always_assert(boundary.size() == m_num_bits);
+  bool forwards = m_direction == Direction::Forwards;
+  bool is_union = m_meet == Meet::Union;
+
+  // Before anything flows in, a state is the identity of the meet.
+  BitVector identity(m_num_bits);
+  if (!is_union) {
+    identity.set();
+  }
+  size_t num_blocks = m_gen.size();
+  m_entry_states.assign(num_blocks, identity);
+  m_exit_states.assign(num_blocks, identity);
+  // The states that the meet produces, and those that the transfer function
+  // produces from them.
+  auto& met = forwards ? m_entry_states : m_exit_states;
+  auto& transferred = forwards ? m_exit_states : m_entry_states;
+
+  std::vector<Block*> order = m_cfg.postorder();
+  if (forwards) {
+    std::reverse(order.begin(), order.end());
+  }
+  // Blocks that can't be reached from the entry keep their initial states.
+  BitVector reachable(num_blocks);
+  for (Block* block : order) {
+    reachable.set(block->id());
+  }
+  BitVector dirty(reachable);
+
+  BitVector state(m_num_bits);
+  while (dirty.any()) {
+    for (Block* block : order) {
+      auto id = block->id();
+      if (!dirty.test(id)) {
+        continue;
+      }
+      dirty.reset(id);
+
+      const auto& in_edges = forwards ? block->preds() : block->succs();
+      bool at_boundary =
+          forwards ? block == m_cfg.entry_block() : in_edges.empty();
+      state = at_boundary ? boundary : identity;
+      for (const auto& e : in_edges) {
+        const auto& other = transferred[(forwards ? e->src() : e->target())
+                                            ->id()];
+        if (is_union) {
+          state |= other;
+        } else {
+          state &= other;
+        }
+      }
+      met[id] = state;
+
+      state -= m_kill[id];
+      state |= m_gen[id];
+      if (state == transferred[id]) {
+        continue;
+      }
+      transferred[id].swap(state);
+      for (const auto& e : forwards ? block->succs() : block->preds()) {
+        auto next = (forwards ? e->target() : e->src())->id();
+        if (reachable.test(next)) {
+          dirty.set(next);
+        }
+      }
+    }
+  }
+}
+
+RegisterLiveness::RegisterLiveness(const ControlFlowGraph& cfg,
+                                   size_t num_regs)
+    : m_analysis(cfg, num_regs, Direction::Backwards, Meet::Union) {
+  for (Block* block : cfg.blocks()) {
+    auto& gen = m_analysis.gen(block);
+    auto& kill = m_analysis.kill(block);
+    for (auto it = block->rbegin(); it != block->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      auto insn = it->insn;
+      if (insn->dests_size()) {
+        kill.set(insn->dest());
+        if (insn->dest_is_wide()) {
+          kill.set(insn->dest() + 1);
+        }
+      }
+      transfer(insn, &gen);
+    }
+  }
+  m_analysis.run(BitVector(num_regs));
+}
+
+void RegisterLiveness::transfer(const IRInstruction* insn, BitVector* live) {
+  if (insn->dests_size()) {
+    live->reset(insn->dest());
+    if (insn->dest_is_wide()) {
+      live->reset(insn->dest() + 1);
+    }
+  }
+  for (size_t i = 0; i < insn->srcs_size(); ++i) {
+    live->set(insn->src(i));
+    if (insn->src_is_wide(i)) {
+      live->set(insn->src(i) + 1);
+    }
+  }
+}
+
+} // namespace bitvector_dataflow
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <boost/dynamic_bitset.hpp>
+#include <vector>
+
+#include "ControlFlow.h"
+
+/*
+ * A solver for the classic gen/kill dataflow problems, such as liveness,
+ * reaching definitions or available expressions, where the facts are the bits
+ * of a fixed-size bit vector and every block transforms its input with
+ *
+ *   output = gen | (input & ~kill)
+ *
+ * The states are dense bit vectors, one pair per block, so the transfer
+ * functions and the meet work a machine word at a time. Blocks are visited in
+ * reverse postorder for forwards problems and in postorder for backwards
+ * ones, which for most CFGs reaches the fixpoint in a couple of sweeps, and
+ * only blocks whose inputs changed are visited again.
+ *
+ * Clients fill in the gen and kill sets of each block, run the analysis, and
+ * then step through the instructions of a block from the state at its boundary
+ * if they need per-instruction results, e.g.
+ *
+ *   GenKillAnalysis analysis(cfg, num_bits, Direction::Forwards, Meet::Union);
+ *   for (Block* block : cfg.blocks()) {
+ *     compute_gen_kill(block, &analysis.gen(block), &analysis.kill(block));
+ *   }
+ *   analysis.run(BitVector(num_bits));
+ */
+namespace bitvector_dataflow {
+
+using BitVector = boost::dynamic_bitset<>;
+
+enum class Direction { Forwards, Backwards };
+
+enum class Meet { Union, Intersection };
+
+class GenKillAnalysis {
+ public:
+  GenKillAnalysis(const ControlFlowGraph& cfg,
+                  size_t num_bits,
+                  Direction direction,
+                  Meet meet);
+
+  BitVector& gen(const Block* block) { return m_gen.at(block->id()); }
+  BitVector& kill(const Block* block) { return m_kill.at(block->id()); }
+
+  /*
+   * Computes the fixpoint. The boundary state holds at the start of the entry
+   * block for a forwards problem, and at the end of the blocks without
+   * successors for a backwards one.
+   */
+  void run(const BitVector& boundary);
+
+  /*
+   * The states at the start and at the end of a block, in program order
+   * whatever the direction of the analysis: for liveness, the entry state of a
+   * block holds the registers live into it.
+   */
+  const BitVector& get_entry_state_at(const Block* block) const {
+    return m_entry_states.at(block->id());
+  }
+  const BitVector& get_exit_state_at(const Block* block) const {
+    return m_exit_states.at(block->id());
+  }
+
+ private:
+  const ControlFlowGraph& m_cfg;
+  const size_t m_num_bits;
+  const Direction m_direction;
+  const Meet m_meet;
+  std::vector<BitVector> m_gen;
+  std::vector<BitVector> m_kill;
+  std::vector<BitVector> m_entry_states;
+  std::vector<BitVector> m_exit_states;
+};
+
+/*
+ * The registers live at the boundaries of each block. A wide operand vN uses
+ * or defines both vN and vN+1.
+ */
+class RegisterLiveness final {
+ public:
+  RegisterLiveness(const ControlFlowGraph& cfg, size_t num_regs);
+
+  const BitVector& live_in(const Block* block) const {
+    return m_analysis.get_entry_state_at(block);
+  }
+  const BitVector& live_out(const Block* block) const {
+    return m_analysis.get_exit_state_at(block);
+  }
+
+  /*
+   * Steps backwards over `insn`, turning the registers live after it into the
+   * registers live before it.
+   */
+  static void transfer(const IRInstruction* insn, BitVector* live);
+
+ private:
+  GenKillAnalysis m_analysis;
+};
+
+} // namespace bitvector_dataflow
@@ -0,0 +1,29 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/*
+ * The size of a cache line on the machines we run on.
+ *
+ * State that different threads write to concurrently, like the slots of a
+ * concurrent container or the states of the workers of a work queue, is kept
+ * at least this many bytes apart. Otherwise the writes of one thread keep
+ * invalidating the cache line the other threads are reading (false sharing).
+ * C++14 doesn't honor over-alignment on the heap, so rather than aligning
+ * such state, we pad it with a whole line, which keeps neighbors apart
+ * wherever the allocator puts them.
+ */
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+struct CacheLinePadding {
+  char bytes[CACHE_LINE_SIZE];
+};
@@ -9,70 +9,210 @@
 
 #include "CallGraph.h"
 
+#include "DexUtil.h"
 #include "VirtualScope.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace call_graph {
 
-Edge::Edge(DexMethod* caller, DexMethod* callee, IRList::iterator invoke_it)
-    : m_caller(caller), m_callee(callee), m_invoke_it(invoke_it) {}
+namespace {
 
-Graph::Graph(const Scope& scope, bool include_virtuals) {
-  MethodRefCache resolved_refs;
-  auto resolver = [&](DexMethodRef* method, MethodSearch search) {
-    return resolve_method(method, search, resolved_refs);
-  };
+struct CallSite {
+  DexMethod* callee;
+  IRInstruction* invoke;
+  // An invoke-virtual that goes to every override of callee.
+  bool dispatch;
+};
+
+// Sorts the edges by key, keeping their order otherwise, and returns the
+// offsets of each key's edges.
+template <typename T, typename Key>
+std::vector<uint32_t> counting_sort(size_t num_keys,
+                                    std::vector<T>* items,
+                                    Key key) {
+  std::vector<uint32_t> offsets(num_keys + 1, 0);
+  for (const auto& item : *items) {
+    ++offsets[key(item) + 1];
+  }
+  for (size_t i = 0; i < num_keys; ++i) {
+    offsets[i + 1] += offsets[i];
+  }
+  auto next = offsets;
+  std::vector<T> sorted(items->size(), items->front());
+  for (const auto& item : *items) {
+    sorted[next[key(item)]++] = item;
+  }
+  items->swap(sorted);
+  return offsets;
+}
+
+} // namespace
+
+constexpr uint32_t Graph::kEntry;
+
+Graph::Graph(const Scope& scope,
+             bool include_virtuals,
+             bool expand_virtual_dispatch)
+    : m_callers_indexed(new std::once_flag) {
+  std::shared_ptr<const ClassScopes> class_scopes;
+  if (include_virtuals || expand_virtual_dispatch) {
+    class_scopes = get_class_scopes(scope);
+  }
   auto non_virtual_vec =
-      include_virtuals ? devirtualize(scope) : std::vector<DexMethod*>();
+      include_virtuals ? devirtualize(class_scopes->get_signature_map())
+                       : std::vector<DexMethod*>();
   auto non_virtual = std::unordered_set<const DexMethod*>(
       non_virtual_vec.begin(), non_virtual_vec.end());
   auto is_definitely_virtual = [&](const DexMethod* method) {
     return method->is_virtual() && non_virtual.count(method) == 0;
   };
-  walk::code(scope, [&](DexMethod* caller, IRCode& code) {
-    for (auto& mie : InstructionIterable(code)) {
+
+  std::vector<DexMethod*> callers;
+  walk::code(scope, [&](DexMethod* caller, IRCode&) {
+    callers.push_back(caller);
+  });
+  std::vector<std::vector<CallSite>> call_sites(callers.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    for (auto& mie : InstructionIterable(callers[i]->get_code())) {
       auto insn = mie.insn;
-      if (is_invoke(insn->opcode())) {
-        auto callee = resolver(insn->get_method(), opcode_to_search(insn));
-        if (callee == nullptr || is_definitely_virtual(callee)) {
-          continue;
+      if (!is_invoke(insn->opcode())) {
+        continue;
+      }
+      auto callee =
+          resolve_method_cached(insn->get_method(), opcode_to_search(insn));
+      if (callee == nullptr) {
+        continue;
+      }
+      if (is_definitely_virtual(callee)) {
+        if (expand_virtual_dispatch && is_invoke_virtual(insn->opcode())) {
+          call_sites[i].push_back({callee, insn, true});
+        }
+        continue;
+      }
+      if (callee->is_concrete()) {
+        call_sites[i].push_back({callee, insn, false});
+      }
+    }
+  });
+  for (size_t i = 0; i < callers.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  // Where each method dispatched to may end up: the concrete methods of its
+  // virtual scope that are defined in subclasses of its class.
+  std::unordered_map<const DexMethod*, std::vector<DexMethod*>> dispatch;
+  if (expand_virtual_dispatch) {
+    for (const auto& sites : call_sites) {
+      for (const auto& site : sites) {
+        if (site.dispatch) {
+          dispatch.emplace(site.callee, std::vector<DexMethod*>());
         }
+      }
+    }
+    std::unordered_map<const DexMethod*, const VirtualScope*> scope_of;
+    class_scopes->walk_virtual_scopes(
+        [&](const DexType*, const VirtualScope* vscope) {
+          for (const auto& vmeth : vscope->methods) {
+            if (dispatch.count(vmeth.first)) {
+              scope_of.emplace(vmeth.first, vscope);
+            }
+          }
+        });
+    auto dispatch_wq = workqueue_foreach<DexMethod*>([&](DexMethod* callee) {
+      auto& targets = dispatch.at(callee);
+      auto it = scope_of.find(callee);
+      if (it == scope_of.end()) {
         if (callee->is_concrete()) {
-          add_edge(caller, callee, code.iterator_to(mie));
+          targets.push_back(callee);
+        }
+        return;
+      }
+      for (const auto& vmeth : it->second->methods) {
+        auto target = vmeth.first;
+        if (target->is_concrete() &&
+            (target == callee ||
+             check_cast(target->get_class(), callee->get_class()))) {
+          targets.push_back(target);
         }
       }
+    });
+    for (const auto& pair : dispatch) {
+      dispatch_wq.add_item(const_cast<DexMethod*>(pair.first));
     }
-  });
+    dispatch_wq.run_all();
+  }
+
+  // Only the methods with edges are nodes. They are numbered in the order
+  // of the walk, so the graph doesn't depend on the scheduling.
+  m_methods.push_back(nullptr);
+  m_ids.emplace(nullptr, kEntry);
+  auto node_id = [&](DexMethod* m) {
+    auto it = m_ids.emplace(m, m_methods.size());
+    if (it.second) {
+      m_methods.push_back(m);
+    }
+    return it.first->second;
+  };
+  for (size_t i = 0; i < callers.size(); ++i) {
+    for (const auto& site : call_sites[i]) {
+      auto caller = node_id(callers[i]);
+      if (!site.dispatch) {
+        m_edges.emplace_back(caller, node_id(site.callee), site.invoke);
+        continue;
+      }
+      for (auto target : dispatch.at(site.callee)) {
+        m_edges.emplace_back(caller, node_id(target), site.invoke);
+      }
+    }
+    std::vector<CallSite>().swap(call_sites[i]);
+  }
 
   // Add edges from the single "ghost" entry node to all the 'real' entry
   // nodes in the graph. We consider a node to be a potential entry point if
   // it is virtual or if it is marked by a Proguard keep rule.
-  for (auto& pair : m_nodes) {
-    auto method = pair.first;
+  for (uint32_t id = 1; id < m_methods.size(); ++id) {
+    auto method = m_methods[id];
     if (is_definitely_virtual(method) || root(method)) {
-      auto edge = std::make_shared<Edge>(
-          nullptr, const_cast<DexMethod*>(method), IRList::iterator());
-      m_entry.m_successors.emplace_back(edge);
-      pair.second.m_predecessors.emplace_back(edge);
+      m_edges.emplace_back(kEntry, id, nullptr);
     }
   }
+
+  if (m_edges.empty()) {
+    m_callee_offsets.assign(m_methods.size() + 1, 0);
+    return;
+  }
+  m_callee_offsets = counting_sort(m_methods.size(), &m_edges,
+                                   [](const Edge& e) { return e.caller(); });
 }
 
-Node& Graph::make_node(DexMethod* m) {
-  auto it = m_nodes.find(m);
-  if (it != m_nodes.end()) {
-    return it->second;
+Edges Graph::callees(uint32_t id) const {
+  Edges edges;
+  edges.reserve(m_callee_offsets[id + 1] - m_callee_offsets[id]);
+  for (auto i = m_callee_offsets[id]; i < m_callee_offsets[id + 1]; ++i) {
+    edges.push_back(&m_edges[i]);
+  }
+  return edges;
+}
+
+void Graph::index_callers() const {
+  m_caller_edges.reserve(m_edges.size());
+  for (const auto& edge : m_edges) {
+    m_caller_edges.push_back(&edge);
+  }
+  if (m_caller_edges.empty()) {
+    m_caller_offsets.assign(m_methods.size() + 1, 0);
+    return;
   }
-  m_nodes.emplace(m, Node(m));
-  return m_nodes.at(m);
+  m_caller_offsets = counting_sort(m_methods.size(), &m_caller_edges,
+                                   [](EdgeId e) { return e->callee(); });
 }
 
-void Graph::add_edge(DexMethod* caller,
-                     DexMethod* callee,
-                     IRList::iterator invoke_it) {
-  auto edge = std::make_shared<Edge>(caller, callee, invoke_it);
-  make_node(caller).m_successors.emplace_back(edge);
-  make_node(callee).m_predecessors.emplace_back(edge);
+Edges Graph::callers(uint32_t id) const {
+  std::call_once(*m_callers_indexed, [this] { index_callers(); });
+  return Edges(m_caller_edges.begin() + m_caller_offsets[id],
+               m_caller_edges.begin() + m_caller_offsets[id + 1]);
 }
 
 } // namespace call_graph
@@ -9,6 +9,8 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include "DexClass.h"
@@ -24,7 +26,13 @@
  * invoke instruction refers to.  That means only invoke-static and
  * invoke-direct calls, as well as invoke-virtual calls that refer
  * unambiguously to a single method. This keeps the graph smallish and easier
- * to analyze.
+ * to analyze. Optionally, an invoke-virtual of a method that may be
+ * overridden gets an edge to every override it may dispatch to.
+ *
+ * The graph is built in parallel, one caller per task, and stored compactly:
+ * methods are numbered, and the edges are one array sorted by caller with
+ * the offsets of each caller's edges (CSR). The edges into each method are
+ * indexed the same way, the first time they are asked for.
  *
  * TODO: Once we have points-to information, we should expand the callgraph to
  * include invoke-virtuals that refer to sets of methods.
@@ -34,93 +42,96 @@ namespace call_graph {
 
 class Edge {
  public:
-  Edge(DexMethod* caller, DexMethod* callee, IRList::iterator invoke_it);
-  IRList::iterator invoke_iterator() const { return m_invoke_it; }
-  DexMethod* caller() const { return m_caller; }
-  DexMethod* callee() const { return m_callee; }
+  Edge(uint32_t caller, uint32_t callee, IRInstruction* invoke)
+      : m_caller(caller), m_callee(callee), m_invoke(invoke) {}
+  // The ids of the methods, see Graph::method().
+  uint32_t caller() const { return m_caller; }
+  uint32_t callee() const { return m_callee; }
+  // nullptr for the edges out of the ghost entry node.
+  IRInstruction* invoke_insn() const { return m_invoke; }
 
  private:
-  DexMethod* m_caller;
-  DexMethod* m_callee;
-  IRList::iterator m_invoke_it;
+  uint32_t m_caller;
+  uint32_t m_callee;
+  IRInstruction* m_invoke;
 };
 
-using Edges = std::vector<std::shared_ptr<Edge>>;
-
-class Node {
- public:
-  /* implicit */ Node(DexMethod* m): m_method(m) {}
-  DexMethod* method() const { return m_method; }
-  bool operator==(const Node& that) const { return method() == that.method(); }
-  const Edges& callers() const { return m_predecessors; }
-  const Edges& callees() const { return m_successors; }
-
- private:
-  DexMethod* m_method;
-  Edges m_predecessors;
-  Edges m_successors;
-
-  friend class Graph;
-};
+using EdgeId = const Edge*;
+using Edges = std::vector<EdgeId>;
 
 class Graph {
  public:
-  explicit Graph(const Scope&, bool include_virtuals = false);
-
-  const Node& entry() const { return m_entry; }
-
-  const Node& node(const DexMethod* m) const {
-    if (m == nullptr) {
-      return m_entry;
-    }
-    return m_nodes.at(const_cast<DexMethod*>(m));
+  /*
+   * include_virtuals adds the calls to virtual methods that no other method
+   * overrides. expand_virtual_dispatch adds, for the invoke-virtuals of
+   * methods that may be overridden, an edge to every concrete method of the
+   * virtual scope the call may dispatch to; invoke-interfaces are left out.
+   */
+  explicit Graph(const Scope&,
+                 bool include_virtuals = false,
+                 bool expand_virtual_dispatch = false);
+
+  // The ghost entry node, whose method is nullptr, has id 0.
+  static constexpr uint32_t kEntry = 0;
+
+  size_t num_nodes() const { return m_methods.size(); }
+  size_t num_edges() const { return m_edges.size(); }
+
+  DexMethod* method(uint32_t id) const { return m_methods[id]; }
+
+  bool has_node(const DexMethod* m) const { return m_ids.count(m) != 0; }
+
+  // nullptr is the entry node.
+  uint32_t id(const DexMethod* m) const {
+    auto it = m_ids.find(m);
+    always_assert_log(it != m_ids.end(), "%s is not in the call graph",
+                      SHOW(m));
+    return it->second;
   }
 
- private:
-  Node& make_node(DexMethod*);
+  Edges callees(uint32_t id) const;
 
-  void add_edge(DexMethod* caller,
-                DexMethod* callee,
-                IRList::iterator invoke_it);
+  // Safe to call from several threads.
+  Edges callers(uint32_t id) const;
 
-  Node m_entry = Node(nullptr);
-  std::unordered_map<DexMethod*, Node> m_nodes;
+ private:
+  void index_callers() const;
+
+  std::vector<DexMethod*> m_methods;
+  std::unordered_map<const DexMethod*, uint32_t> m_ids;
+  // Sorted by caller; the edges of caller id are
+  // [m_callee_offsets[id], m_callee_offsets[id + 1]).
+  std::vector<Edge> m_edges;
+  std::vector<uint32_t> m_callee_offsets;
+  // The reverse index, built by the first callers().
+  std::unique_ptr<std::once_flag> m_callers_indexed;
+  mutable std::vector<EdgeId> m_caller_edges;
+  mutable std::vector<uint32_t> m_caller_offsets;
 };
 
 class GraphInterface : public FixpointIteratorGraphSpec<GraphInterface> {
  public:
   using Graph = call_graph::Graph;
   using NodeId = DexMethod*;
-  using EdgeId = std::shared_ptr<Edge>;
+  using EdgeId = call_graph::EdgeId;
 
   ~GraphInterface() = delete;
 
   static const NodeId entry(const Graph& graph) {
-    return graph.entry().method();
+    return graph.method(Graph::kEntry);
   }
   static std::vector<EdgeId> predecessors(const Graph& graph, const NodeId& m) {
-    return graph.node(m).callers();
+    return graph.callers(graph.id(m));
   }
   static std::vector<EdgeId> successors(const Graph& graph, const NodeId& m) {
-    return graph.node(m).callees();
+    return graph.callees(graph.id(m));
   }
   static const NodeId source(const Graph& graph, const EdgeId& e) {
-    return graph.node(e->caller()).method();
+    return graph.method(e->caller());
   }
   static const NodeId target(const Graph& graph, const EdgeId& e) {
-    return graph.node(e->callee()).method();
+    return graph.method(e->callee());
   }
 };
 
 } // namespace call_graph
-
-namespace std {
-
-template <>
-struct hash<call_graph::Node> {
-  size_t operator()(const call_graph::Node& node) const {
-    return reinterpret_cast<size_t>(node.method());
-  }
-};
-
-} // namespace std
@@ -12,6 +12,7 @@
 #include "DexUtil.h"
 #include "Timer.h"
 #include "Resolver.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -41,28 +42,54 @@ DexMethod* check_dmethods(const DexString* name,
   return nullptr;
 }
 
-/**
- * Creates an entry from a parent to a child class.
+/*
+ * The hierarchy and the interface map are built by shards, each of which owns
+ * the entries of the types that hash to it. The threads building the shards
+ * never write to the same map, and merging them only moves the sets.
  */
-void build_class_hierarchy(ClassHierarchy& hierarchy, const DexClass* cls) {
-  // ensure an entry for the DexClass is created
-  hierarchy[cls->get_type()];
-  auto type = cls->get_type();
-  const auto super = cls->get_super_class();
-  if (super != nullptr) {
-    hierarchy[super].insert(type);
-  } else {
-    always_assert_log(cls->get_type() == get_object_type(),
-                      SHOW(cls->get_type()));
+using TypeSetMap = std::unordered_map<const DexType*, TypeSet>;
+
+// Below this many items per shard, spreading the work over threads costs
+// more than it saves.
+constexpr size_t MIN_ITEMS_PER_SHARD = 1024;
+
+size_t num_shards_for(size_t num_items) {
+  return std::max<size_t>(
+      1,
+      std::min<size_t>(default_workqueue_threads(),
+                       num_items / MIN_ITEMS_PER_SHARD));
+}
+
+size_t shard_of(const DexType* type, size_t num_shards) {
+  return std::hash<const DexType*>()(type) % num_shards;
+}
+
+void for_each_shard(size_t num_shards, const std::function<void(size_t)>& fn) {
+  if (num_shards == 1) {
+    fn(0);
+    return;
+  }
+  auto wq = workqueue_foreach<size_t>(fn, num_shards);
+  for (size_t shard = 0; shard < num_shards; ++shard) {
+    wq.add_item(shard);
   }
+  wq.run_all();
 }
 
-void build_external_hierarchy(ClassHierarchy& hierarchy) {
-  g_redex->walk_type_class(
-      [&](const DexType* type, const DexClass* cls) {
-        if (!cls->is_external() || is_interface(cls)) return;
-        build_class_hierarchy(hierarchy, cls);
-      });
+TypeSetMap merge_shards(std::vector<TypeSetMap>& shards) {
+  size_t size = 0;
+  for (const auto& shard : shards) {
+    size += shard.size();
+  }
+  TypeSetMap merged;
+  merged.reserve(size);
+  for (auto& shard : shards) {
+    for (auto& entry : shard) {
+      merged.emplace(entry.first, std::move(entry.second));
+    }
+    shard.clear();
+  }
+  return merged;
 }
 
 // Find all the interfaces that extend 'intf'
@@ -93,44 +120,100 @@ void gather_intf_extenders(const Scope& scope,
   }
 }
 
-void build_interface_map(InterfaceMap& interfaces,
-                         const ClassHierarchy& hierarchy,
-                         const DexClass* current,
-                         const TypeSet& implementors) {
+// The interfaces `current` implements, directly or through the interfaces it
+// implements, as far as they are known.
+void gather_interfaces(const DexClass* current,
+                       std::vector<const DexType*>& interfaces) {
   for (const auto& intf : current->get_interfaces()->get_type_list()) {
-    interfaces[intf].insert(implementors.begin(), implementors.end());
+    interfaces.push_back(intf);
     const auto intf_cls = type_class(intf);
     if (intf_cls == nullptr) continue;
-    build_interface_map(interfaces, hierarchy, intf_cls, implementors);
+    gather_interfaces(intf_cls, interfaces);
   }
 }
 
 }
 
 ClassHierarchy build_type_hierarchy(const Scope& scope) {
-  ClassHierarchy hierarchy;
-  // build the type hierarchy
+  std::vector<const DexClass*> classes;
+  auto add_class = [&](const DexClass* cls) {
+    if (cls->get_super_class() == nullptr) {
+      always_assert_log(cls->get_type() == get_object_type(),
+                        SHOW(cls->get_type()));
+    }
+    classes.push_back(cls);
+  };
   for (const auto& cls : scope) {
     if (is_interface(cls)) continue;
-    build_class_hierarchy(hierarchy, cls);
+    add_class(cls);
   }
-  build_external_hierarchy(hierarchy);
-  return hierarchy;
+  g_redex->walk_type_class(
+      [&](const DexType* type, const DexClass* cls) {
+        if (!cls->is_external() || is_interface(cls)) return;
+        add_class(cls);
+      });
+
+  auto num_shards = num_shards_for(classes.size());
+  std::vector<ClassHierarchy> shards(num_shards);
+  for_each_shard(num_shards, [&](size_t shard) {
+    auto& hierarchy = shards[shard];
+    for (const auto& cls : classes) {
+      // ensure an entry for the DexClass is created
+      auto type = cls->get_type();
+      if (shard_of(type, num_shards) == shard) {
+        hierarchy[type];
+      }
+      const auto super = cls->get_super_class();
+      if (super != nullptr && shard_of(super, num_shards) == shard) {
+        hierarchy[super].insert(type);
+      }
+    }
+  });
+  return merge_shards(shards);
 }
 
 InterfaceMap build_interface_map(const ClassHierarchy& hierarchy) {
-  InterfaceMap interfaces;
-  // build the type hierarchy
+  // Only the classes that list interfaces add to the map: the interfaces of
+  // a superclass are accounted for by the superclass, whose implementors
+  // include its children.
+  std::vector<const DexClass*> classes;
   for (const auto& cls_it : hierarchy) {
     const auto cls = type_class(cls_it.first);
     if (cls == nullptr) continue;
     if (is_interface(cls)) continue;
-    TypeSet implementors;
-    get_all_children(hierarchy, cls->get_type(), implementors);
-    implementors.insert(cls->get_type());
-    build_interface_map(interfaces, hierarchy, cls, implementors);
+    if (cls->get_interfaces()->get_type_list().empty()) continue;
+    classes.push_back(cls);
   }
-  return interfaces;
+
+  // First find the implementors and the interfaces of each class...
+  std::vector<std::vector<const DexType*>> implementors(classes.size());
+  std::vector<std::vector<const DexType*>> interfaces(classes.size());
+  auto num_shards = num_shards_for(classes.size());
+  for_each_shard(num_shards, [&](size_t shard) {
+    for (size_t i = shard; i < classes.size(); i += num_shards) {
+      auto cls = classes[i];
+      TypeSet children;
+      get_all_children(hierarchy, cls->get_type(), children);
+      implementors[i].assign(children.begin(), children.end());
+      implementors[i].push_back(cls->get_type());
+      gather_interfaces(cls, interfaces[i]);
+    }
+  });
+
+  // ... then file them under the interfaces, each shard taking its share of
+  // the interfaces.
+  std::vector<InterfaceMap> shards(num_shards);
+  for_each_shard(num_shards, [&](size_t shard) {
+    auto& interface_map = shards[shard];
+    for (size_t i = 0; i < classes.size(); ++i) {
+      for (const auto& intf : interfaces[i]) {
+        if (shard_of(intf, num_shards) != shard) continue;
+        interface_map[intf].insert(implementors[i].begin(),
+                                   implementors[i].end());
+      }
+    }
+  });
+  return merge_shards(shards);
 }
 
 void get_all_children(
@@ -26,6 +26,10 @@ using ClassHierarchy = std::unordered_map<const DexType*, TypeSet>;
  * The walk stops once a DexClass is not found.
  * If all the code is known all classes will root to java.lang.Object.
  * If not some hierarchies will be "unknown" (not completed)
+ * Large scopes are split over the WorkQueue threads. A pass should rather get
+ * the hierarchy of the whole program from the AnalysisManager (see
+ * ClassHierarchyAnalysis), which builds it once for all the passes that
+ * preserve it.
  */
 ClassHierarchy build_type_hierarchy(const Scope& scope);
 
@@ -60,6 +64,8 @@ using InterfaceMap = std::unordered_map<const DexType*, TypeSet>;
  * other interfaces that relationship is lost (unknown) so this builds a map
  * that is correct for all interfaces that have a DexClass and stops at that
  * interface otherwise.
+ * Like build_type_hierarchy(), it splits large hierarchies over the WorkQueue
+ * threads.
  */
 InterfaceMap build_interface_map(const ClassHierarchy& hierarchy);
 
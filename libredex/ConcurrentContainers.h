@@ -9,20 +9,38 @@
 
 #pragma once
 
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
+#include <memory>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include <boost/thread.hpp>
 
+#include "CacheLine.h"
 #include "Debug.h"
 
-// Forward declaration.
 namespace cc_impl {
 
+/*
+ * A slot of a concurrent container: a container and the lock that guards it.
+ * Threads working on neighboring slots don't contend for the same cache
+ * lines.
+ */
+template <typename Container>
+struct Slot {
+  boost::mutex lock;
+  Container container;
+  CacheLinePadding padding;
+};
+
+// Forward declaration.
 template <typename Container, typename Iterator, size_t n_slots>
 class ConcurrentContainerIterator;
 
@@ -38,7 +56,7 @@ class ConcurrentContainerIterator;
  * reasonable performance in practice. A high number of slots may help reduce
  * thread contention at the expense of a larger memory footprint. It is advised
  * to use a prime number for `n_slots`, so as to ensure a more even spread of
- * elements across slots.
+ * elements across slots. Each slot takes up at least a cache line of its own.
  *
  * There are two major modes in which a concurrent container is thread-safe:
  *  - Read only: multiple threads access the contents of the container but do
@@ -59,7 +77,7 @@ class ConcurrentContainer {
                                            n_slots>;
 
   using const_iterator =
-      cc_impl::ConcurrentContainerIterator<Container,
+      cc_impl::ConcurrentContainerIterator<const Container,
                                            typename Container::const_iterator,
                                            n_slots>;
 
@@ -70,12 +88,14 @@ class ConcurrentContainer {
    * modified will result in undefined behavior.
    */
 
-  iterator begin() { return iterator(&m_slots[0], 0, m_slots[0].begin()); }
+  iterator begin() {
+    return iterator(&m_slots[0], 0, m_slots[0].container.begin());
+  }
 
   iterator end() { return iterator(&m_slots[0]); }
 
   const_iterator begin() const {
-    return const_iterator(&m_slots[0], 0, m_slots[0].begin());
+    return const_iterator(&m_slots[0], 0, m_slots[0].container.begin());
   }
 
   const_iterator end() const { return const_iterator(&m_slots[0]); }
@@ -86,13 +106,13 @@ class ConcurrentContainer {
 
   iterator find(const Key& key) {
     size_t slot = Hash()(key) % n_slots;
-    return iterator(&m_slots[0], slot, m_slots[slot].find(key));
+    return iterator(&m_slots[0], slot, m_slots[slot].container.find(key));
   }
 
   size_t size() const {
     size_t s = 0;
     for (size_t slot = 0; slot < n_slots; ++slot) {
-      s += m_slots[slot].size();
+      s += m_slots[slot].container.size();
     }
     return s;
   }
@@ -101,14 +121,14 @@ class ConcurrentContainer {
     size_t slot_capacity = capacity / n_slots;
     if (slot_capacity > 0) {
       for (size_t i = 0; i < n_slots; ++i) {
-        m_slots[i].reserve(slot_capacity);
+        m_slots[i].container.reserve(slot_capacity);
       }
     }
   }
 
   void clear() {
     for (size_t slot = 0; slot < n_slots; ++slot) {
-      m_slots[slot].clear();
+      m_slots[slot].container.clear();
     }
   }
 
@@ -117,8 +137,27 @@ class ConcurrentContainer {
    */
   size_t count(const Key& key) {
     size_t slot = Hash()(key) % n_slots;
-    boost::lock_guard<boost::mutex> lock(m_locks[slot]);
-    return m_slots[slot].count(key);
+    boost::lock_guard<boost::mutex> lock(m_slots[slot].lock);
+    return m_slots[slot].container.count(key);
+  }
+
+  /*
+   * The slot that holds `key`. Operations on many keys at once can group the
+   * keys by slot, and then lock each slot only once with with_slot().
+   */
+  static size_t slot(const Key& key) { return Hash()(key) % n_slots; }
+
+  static constexpr size_t num_slots() { return n_slots; }
+
+  /*
+   * Calls `fn` on the container of `slot` while holding its lock. `fn` must
+   * only look up and insert keys that belong to that slot.
+   * This operation is always thread-safe.
+   */
+  template <typename Fn>
+  void with_slot(size_t slot, const Fn& fn) {
+    boost::lock_guard<boost::mutex> lock(m_slots[slot].lock);
+    fn(m_slots[slot].container);
   }
 
   /*
@@ -126,21 +165,20 @@ class ConcurrentContainer {
    */
   size_t erase(const Key& key) {
     size_t slot = Hash()(key) % n_slots;
-    boost::lock_guard<boost::mutex> lock(m_locks[slot]);
-    return m_slots[slot].erase(key);
+    boost::lock_guard<boost::mutex> lock(m_slots[slot].lock);
+    return m_slots[slot].container.erase(key);
   }
 
  protected:
   // Only derived classes may be instantiated.
   ConcurrentContainer() = default;
 
-  Container& get_container(size_t slot) { return m_slots[slot]; }
+  Container& get_container(size_t slot) { return m_slots[slot].container; }
 
-  boost::mutex& get_lock(size_t slot) { return m_locks[slot]; }
+  boost::mutex& get_lock(size_t slot) { return m_slots[slot].lock; }
 
  private:
-  boost::mutex m_locks[n_slots];
-  Container m_slots[n_slots];
+  cc_impl::Slot<Container> m_slots[n_slots];
 };
 
 template <typename Key,
@@ -175,6 +213,40 @@ class ConcurrentMap final
     }
   }
 
+  /*
+   * Returns the value bound to `key`, or `default_value` if there is none.
+   * This operation is always thread-safe.
+   */
+  Value get(const Key& key, Value default_value) {
+    size_t slot = Hash()(key) % n_slots;
+    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    auto& map = this->get_container(slot);
+    auto it = map.find(key);
+    return it == map.end() ? default_value : it->second;
+  }
+
+  /*
+   * Returns the value bound to `key`. If there is none, inserts the entry
+   * returned by `make_entry()` and returns its value. The key of that entry
+   * must be equal to `key`; this lets the stored key differ from the one used
+   * for the lookup, e.g. to point into the newly created value. `make_entry`
+   * runs at most once, while the slot is locked.
+   * This operation is always thread-safe.
+   */
+  template <typename EntryFn>
+  Value get_or_insert(const Key& key, const EntryFn& make_entry) {
+    size_t slot = Hash()(key) % n_slots;
+    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    auto& map = this->get_container(slot);
+    auto it = map.find(key);
+    if (it != map.end()) {
+      return it->second;
+    }
+    auto entry = make_entry();
+    assert(Equal()(entry.first, key));
+    return map.emplace(std::move(entry)).first->second;
+  }
+
   /*
    * This operation atomically modifies an entry in the map. If the entry
    * doesn't exist, it is created. The third argument of the updater function is
@@ -225,6 +297,280 @@ class ConcurrentSet final
   }
 };
 
+/*
+ * A map for read-mostly workloads such as memoization, where lookups must not
+ * wait for the insertions that other threads keep making. Unlike the
+ * containers above, lookups take no lock and are thread-safe at any time,
+ * including while other threads insert or update entries. Writers still lock
+ * the slot of their key.
+ *
+ * Each slot is a chained hash table whose bucket heads are atomic. A new
+ * entry is fully built before it is published at the head of its bucket, and
+ * entries are never unlinked, so a reader walking a chain only ever sees
+ * complete entries. When a slot grows, the chains are rebuilt into a new
+ * bucket array and the old one is kept alive, since readers may still be
+ * walking it. Likewise, update() never modifies a value in place: it
+ * publishes an updated copy, and keeps the old value alive. All of these are
+ * only freed by clear() and the destructor. In exchange, the pointers that
+ * find() returns stay valid until then.
+ *
+ * Entries can't be erased, and the values must be copy-constructible.
+ */
+template <typename Key,
+          typename Value,
+          size_t n_slots = 31,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class ReadMostlyConcurrentMap final {
+ public:
+  static_assert(n_slots > 0, "The concurrent container has no slots");
+
+  ReadMostlyConcurrentMap() = default;
+
+  ReadMostlyConcurrentMap(const ReadMostlyConcurrentMap&) = delete;
+  ReadMostlyConcurrentMap& operator=(const ReadMostlyConcurrentMap&) = delete;
+
+  /*
+   * Returns the value bound to `key`, or nullptr if there is none.
+   * This operation is always thread-safe and never blocks.
+   */
+  const Value* find(const Key& key) const {
+    size_t hash = Hash()(key);
+    auto entry = m_slots[hash % n_slots].find(key, hash);
+    return entry == nullptr ? nullptr
+                            : entry->value.load(std::memory_order_acquire);
+  }
+
+  /*
+   * This operation is always thread-safe and never blocks.
+   */
+  size_t count(const Key& key) const { return find(key) == nullptr ? 0 : 1; }
+
+  /*
+   * Returns the value bound to `key`, or `default_value` if there is none.
+   * This operation is always thread-safe and never blocks.
+   */
+  Value get(const Key& key, Value default_value) const {
+    auto value = find(key);
+    return value == nullptr ? default_value : *value;
+  }
+
+  /*
+   * The Boolean return value denotes whether the insertion took place.
+   * This operation is always thread-safe.
+   */
+  bool insert(const std::pair<Key, Value>& entry) {
+    size_t hash = Hash()(entry.first);
+    auto& slot = m_slots[hash % n_slots];
+    boost::lock_guard<boost::mutex> lock(slot.lock);
+    if (slot.find(entry.first, hash) != nullptr) {
+      return false;
+    }
+    slot.add(entry.first, hash, slot.make_value(entry.second));
+    return true;
+  }
+
+  /*
+   * Returns the value bound to `key`. If there is none, binds the value that
+   * `make_value()` returns and returns it. `make_value` runs at most once,
+   * while the slot is locked. The lookup only takes the lock if the key isn't
+   * there yet.
+   * This operation is always thread-safe.
+   */
+  template <typename ValueFn>
+  const Value& get_or_insert(const Key& key, const ValueFn& make_value) {
+    auto value = find(key);
+    if (value != nullptr) {
+      return *value;
+    }
+    size_t hash = Hash()(key);
+    auto& slot = m_slots[hash % n_slots];
+    boost::lock_guard<boost::mutex> lock(slot.lock);
+    auto entry = slot.find(key, hash);
+    if (entry != nullptr) {
+      return *entry->value.load(std::memory_order_relaxed);
+    }
+    value = slot.make_value(make_value());
+    slot.add(key, hash, value);
+    return *value;
+  }
+
+  /*
+   * This operation atomically modifies an entry in the map. If the entry
+   * doesn't exist, it is created. The third argument of the updater function is
+   * a Boolean flag denoting whether the entry exists or not. The updater
+   * modifies a copy of the value, which then replaces it, so that concurrent
+   * readers see either the old or the new value in full.
+   * This operation is always thread-safe.
+   */
+  void update(const Key& key,
+              const std::function<void(const Key&, Value&, bool)>& updater) {
+    size_t hash = Hash()(key);
+    auto& slot = m_slots[hash % n_slots];
+    boost::lock_guard<boost::mutex> lock(slot.lock);
+    auto entry = slot.find(key, hash);
+    if (entry == nullptr) {
+      Value value = Value();
+      updater(key, value, false);
+      slot.add(key, hash, slot.make_value(std::move(value)));
+      return;
+    }
+    Value value = *entry->value.load(std::memory_order_relaxed);
+    updater(entry->key, value, true);
+    entry->value.store(slot.make_value(std::move(value)),
+                       std::memory_order_release);
+  }
+
+  /*
+   * The number of entries, which is only exact when no thread is writing.
+   */
+  size_t size() const {
+    size_t s = 0;
+    for (const auto& slot : m_slots) {
+      s += slot.size.load(std::memory_order_relaxed);
+    }
+    return s;
+  }
+
+  /*
+   * Calls `fn(key, value)` on every entry. Must not be called while other
+   * threads insert or update entries.
+   */
+  template <typename Fn>
+  void for_each(const Fn& fn) const {
+    for (const auto& slot : m_slots) {
+      for (const auto& entry : slot.entries) {
+        fn(entry.key, *entry.value.load(std::memory_order_acquire));
+      }
+    }
+  }
+
+  /*
+   * Frees all the entries, as well as the values that updates replaced. This
+   * invalidates the pointers returned by find(), and isn't thread-safe.
+   */
+  void clear() {
+    for (auto& slot : m_slots) {
+      slot.clear();
+    }
+  }
+
+ private:
+  struct Entry {
+    Entry(const Key& key, size_t hash, const Value* value)
+        : key(key), hash(hash), value(value) {}
+    const Key key;
+    const size_t hash;
+    std::atomic<const Value*> value;
+  };
+
+  // Never modified once published, so that readers can walk the chains.
+  struct Node {
+    Entry* entry;
+    Node* next;
+  };
+
+  struct Buckets {
+    explicit Buckets(size_t size)
+        : heads(new std::atomic<Node*>[size]), size(size) {
+      for (size_t i = 0; i < size; ++i) {
+        heads[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+    std::unique_ptr<std::atomic<Node*>[]> heads;
+    const size_t size;
+  };
+
+  struct Slot {
+    static constexpr size_t INITIAL_BUCKETS = 8;
+
+    // Guards everything below against concurrent writers.
+    boost::mutex lock;
+    std::atomic<Buckets*> buckets{nullptr};
+    std::atomic<size_t> size{0};
+    // Stable storage for the entries, the nodes of the chains, and the
+    // values. The nodes and bucket arrays of the chains that were rebuilt
+    // stay here too, since readers may still be walking them.
+    std::deque<Entry> entries;
+    std::deque<Node> nodes;
+    std::vector<std::unique_ptr<Buckets>> all_buckets;
+    std::vector<std::unique_ptr<const Value>> values;
+    // Readers of a slot don't share cache lines with writers of the next.
+    CacheLinePadding padding;
+
+    static size_t bucket_of(size_t hash, const Buckets* b) {
+      return (hash / n_slots) % b->size;
+    }
+
+    const Entry* find(const Key& key, size_t hash) const {
+      auto b = buckets.load(std::memory_order_acquire);
+      if (b == nullptr) {
+        return nullptr;
+      }
+      auto node = b->heads[bucket_of(hash, b)].load(std::memory_order_acquire);
+      for (; node != nullptr; node = node->next) {
+        if (node->entry->hash == hash && Equal()(node->entry->key, key)) {
+          return node->entry;
+        }
+      }
+      return nullptr;
+    }
+
+    Entry* find(const Key& key, size_t hash) {
+      return const_cast<Entry*>(
+          static_cast<const Slot*>(this)->find(key, hash));
+    }
+
+    // Must hold the lock.
+    template <typename V>
+    const Value* make_value(V&& value) {
+      values.emplace_back(new Value(std::forward<V>(value)));
+      return values.back().get();
+    }
+
+    // Must hold the lock.
+    void link(Buckets* b, Entry* entry) {
+      auto& head = b->heads[bucket_of(entry->hash, b)];
+      nodes.push_back(Node{entry, head.load(std::memory_order_relaxed)});
+      head.store(&nodes.back(), std::memory_order_release);
+    }
+
+    // Must hold the lock, and the key must not be in the slot yet.
+    void add(const Key& key, size_t hash, const Value* value) {
+      auto b = buckets.load(std::memory_order_relaxed);
+      if (b == nullptr || entries.size() >= b->size) {
+        // Keep the load factor at most one. The new array is only published
+        // once all the chains are rebuilt in it.
+        size_t num_buckets = INITIAL_BUCKETS;
+        if (b != nullptr) {
+          num_buckets = b->size * 2;
+        }
+        auto bigger = std::make_unique<Buckets>(num_buckets);
+        for (auto& entry : entries) {
+          link(bigger.get(), &entry);
+        }
+        b = bigger.get();
+        all_buckets.push_back(std::move(bigger));
+        buckets.store(b, std::memory_order_release);
+      }
+      entries.emplace_back(key, hash, value);
+      link(b, &entries.back());
+      size.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void clear() {
+      buckets.store(nullptr, std::memory_order_relaxed);
+      size.store(0, std::memory_order_relaxed);
+      entries.clear();
+      nodes.clear();
+      all_buckets.clear();
+      values.clear();
+    }
+  };
+
+  Slot m_slots[n_slots];
+};
+
 namespace cc_impl {
 
 template <typename Container, typename Iterator, size_t n_slots>
@@ -232,14 +578,19 @@ class ConcurrentContainerIterator final
     : public std::iterator<std::forward_iterator_tag,
                            typename Iterator::value_type> {
  public:
-  explicit ConcurrentContainerIterator(Container* slots)
+  using SlotType = typename std::conditional<
+      std::is_const<Container>::value,
+      const Slot<typename std::remove_const<Container>::type>,
+      Slot<Container>>::type;
+
+  explicit ConcurrentContainerIterator(SlotType* slots)
       : m_slots(slots),
         m_slot(n_slots - 1),
-        m_position(m_slots[n_slots - 1].end()) {
+        m_position(m_slots[n_slots - 1].container.end()) {
     skip_empty_slots();
   }
 
-  ConcurrentContainerIterator(Container* slots,
+  ConcurrentContainerIterator(SlotType* slots,
                               size_t slot,
                               const Iterator& position)
       : m_slots(slots), m_slot(slot), m_position(position) {
@@ -247,7 +598,7 @@ class ConcurrentContainerIterator final
   }
 
   ConcurrentContainerIterator& operator++() {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[n_slots - 1].container.end());
     ++m_position;
     skip_empty_slots();
     return *this;
@@ -269,23 +620,24 @@ class ConcurrentContainerIterator final
   }
 
   typename Iterator::reference operator*() {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[n_slots - 1].container.end());
     return *m_position;
   }
 
   typename Iterator::pointer operator->() {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[n_slots - 1].container.end());
     return m_position.operator->();
   }
 
  private:
   void skip_empty_slots() {
-    while (m_position == m_slots[m_slot].end() && m_slot < n_slots - 1) {
-      m_position = m_slots[++m_slot].begin();
+    while (m_position == m_slots[m_slot].container.end() &&
+           m_slot < n_slots - 1) {
+      m_position = m_slots[++m_slot].container.begin();
     }
   }
 
-  Container* m_slots;
+  SlotType* m_slots;
   size_t m_slot;
   Iterator m_position;
 };
@@ -16,6 +16,8 @@
 
 #include "Debug.h"
 #include "DexClass.h"
+#include "RedexResources.h"
+#include "WorkQueue.h"
 
 ConfigFiles::ConfigFiles(const Json::Value& config) :
     m_proguard_map(
@@ -24,7 +26,9 @@ ConfigFiles::ConfigFiles(const Json::Value& config) :
       config.get("coldstart_classes", "").asString()),
     m_coldstart_method_filename(
       config.get("coldstart_methods", "").asString()),
-    m_printseeds(config.get("printseeds", "").asString())
+    m_printseeds(config.get("printseeds", "").asString()),
+    m_resource_scan_cache_filename(
+      config.get("resource_scan_cache", "").asString())
 {
   auto no_optimizations_anno = config["no_optimizations_annotations"];
   if (no_optimizations_anno != Json::nullValue) {
@@ -36,6 +40,16 @@ ConfigFiles::ConfigFiles(const Json::Value& config) :
   }
 }
 
+ConfigFiles::~ConfigFiles() {}
+
+ResourceScanCache& ConfigFiles::get_resource_scan_cache() {
+  if (m_resource_scan_cache == nullptr) {
+    m_resource_scan_cache =
+        std::make_unique<ResourceScanCache>(m_resource_scan_cache_filename);
+  }
+  return *m_resource_scan_cache;
+}
+
 /**
  * Read an interdex list file and return as a vector of appropriately-formatted
  * classname strings.
@@ -82,3 +96,55 @@ std::vector<std::string> ConfigFiles::load_coldstart_methods() {
   }
   return coldstart_methods;
 }
+
+namespace {
+
+/*
+ * Looks up each of `names` in parallel with `get`, and maps each of the
+ * non-null results to the position of its first occurrence.
+ */
+template <typename T, typename Get>
+std::unordered_map<const T*, size_t> rank_by_position(
+    const std::vector<std::string>& names, Get get) {
+  std::vector<const T*> resolved(names.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) { resolved[i] = get(names[i]); });
+  for (size_t i = 0; i < names.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  std::unordered_map<const T*, size_t> ranks;
+  for (size_t i = 0; i < resolved.size(); ++i) {
+    if (resolved[i] != nullptr) {
+      ranks.emplace(resolved[i], i);
+    }
+  }
+  return ranks;
+}
+
+} // namespace
+
+void ConfigFiles::load_coldstart_ranks() {
+  m_coldstart_class_ranks = rank_by_position<DexType>(
+      get_coldstart_classes(),
+      [](const std::string& name) { return DexType::get_type(name.c_str()); });
+  m_coldstart_method_ranks = rank_by_position<DexMethodRef>(
+      get_coldstart_methods(), [](const std::string& name) -> DexMethodRef* {
+        // Entries are "LFoo;.bar:(I)V", or "LFoo;.bar(I)V" in older lists.
+        // The list is user input, so skip what isn't a method descriptor
+        // rather than fail to parse it.
+        auto dot = name.find('.');
+        auto lparen = name.find('(', dot);
+        auto rparen = name.find(')', lparen);
+        if (dot == std::string::npos || lparen == std::string::npos ||
+            rparen == std::string::npos || rparen + 1 == name.size()) {
+          return nullptr;
+        }
+        if (name[lparen - 1] == ':') {
+          return DexMethod::get_method(name);
+        }
+        return DexMethod::get_method(name.substr(0, lparen) + ':' +
+                                     name.substr(lparen));
+      });
+  m_coldstart_ranks_loaded = true;
+}
@@ -12,6 +12,8 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <json/json.h>
@@ -20,11 +22,13 @@
 #include "ProguardMap.h"
 
 class DexType;
+class ResourceScanCache;
 using MethodTuple = std::tuple<DexString*, DexString*, DexString*>;
 using MethodMap = std::map<MethodTuple, DexClass*>;
 
 struct ConfigFiles {
   ConfigFiles(const Json::Value& config);
+  ~ConfigFiles();
 
   const std::vector<std::string>& get_coldstart_classes() {
     if (m_coldstart_classes.size() == 0) {
@@ -40,6 +44,31 @@ struct ConfigFiles {
     return m_coldstart_methods;
   }
 
+  /*
+   * The types and methods of the coldstart lists that exist, each mapped to
+   * its position in its list. They're looked up in parallel the first time
+   * either is asked for, so they keep referring to the same classes and
+   * methods if those get renamed later.
+   */
+  const std::unordered_map<const DexType*, size_t>& get_coldstart_class_ranks() {
+    if (!m_coldstart_ranks_loaded) {
+      load_coldstart_ranks();
+    }
+    return m_coldstart_class_ranks;
+  }
+
+  const std::unordered_map<const DexMethodRef*, size_t>&
+  get_coldstart_method_ranks() {
+    if (!m_coldstart_ranks_loaded) {
+      load_coldstart_ranks();
+    }
+    return m_coldstart_method_ranks;
+  }
+
+  bool is_coldstart(const DexClass* cls) {
+    return get_coldstart_class_ranks().count(cls->get_type()) != 0;
+  }
+
   const std::unordered_set<DexType*> get_no_optimizations_annos() const {
     return m_no_optimizations_annos;
   }
@@ -70,12 +99,16 @@ struct ConfigFiles {
     return m_printseeds;
   }
 
+  // Shared by everything that looks for classes in the APK's resources.
+  ResourceScanCache& get_resource_scan_cache();
+
  public:
   std::string outdir;
 
  private:
   std::vector<std::string> load_coldstart_classes();
   std::vector<std::string> load_coldstart_methods();
+  void load_coldstart_ranks();
 
  private:
   bool m_move_map{false};
@@ -85,7 +118,12 @@ struct ConfigFiles {
   std::string m_coldstart_method_filename;
   std::vector<std::string> m_coldstart_classes;
   std::vector<std::string> m_coldstart_methods;
+  bool m_coldstart_ranks_loaded{false};
+  std::unordered_map<const DexType*, size_t> m_coldstart_class_ranks;
+  std::unordered_map<const DexMethodRef*, size_t> m_coldstart_method_ranks;
   std::string m_printseeds; // Filename to dump computed seeds.
+  std::string m_resource_scan_cache_filename;
+  std::unique_ptr<ResourceScanCache> m_resource_scan_cache;
 
   // global no optimizations annotations
   std::unordered_set<DexType*> m_no_optimizations_annos;
@@ -175,8 +175,16 @@ void ControlFlowGraph::find_block_boundaries(IRList* ir,
       // If there is a consecutive list of MFLOW_TARGETs, put them all in the
       // same basic block. Being parsimonious in the number of BBs we generate
       // is a significant performance win for our analyses.
+      // The cases of a switch that share a target come in a row, so look
+      // their switch up once per run.
+      MethodItemEntry* src = nullptr;
+      std::vector<Block*>* targets = nullptr;
       do {
-        branch_to_targets[next->target->src].push_back(block);
+        if (next->target->src != src) {
+          src = next->target->src;
+          targets = &branch_to_targets[src];
+        }
+        targets->push_back(block);
       } while (++next != ir->end() && next->type == MFLOW_TARGET);
       // for the next iteration of the for loop, we want `it` to point to the
       // last of the series of MFLOW_TARGET mies. Since `next` is currently
@@ -200,9 +208,9 @@ void ControlFlowGraph::find_block_boundaries(IRList* ir,
 
 void ControlFlowGraph::connect_blocks(BranchToTargets& branch_to_targets) {
   // Link the blocks together with edges
-  for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it) {
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
     // Set outgoing edge if last MIE falls through
-    Block* b = it->second;
+    Block* b = &m_blocks[i];
     auto lastmei = b->rbegin();
     bool fallthrough = true;
     if (lastmei->type == MFLOW_OPCODE) {
@@ -218,9 +226,8 @@ void ControlFlowGraph::connect_blocks(BranchToTargets& branch_to_targets) {
       }
     }
 
-    auto next = std::next(it);
-    Block* next_b = next->second;
-    if (fallthrough && next != m_blocks.end()) {
+    if (fallthrough && i + 1 < m_blocks.size()) {
+      Block* next_b = &m_blocks[i + 1];
       TRACE(CFG,
             5,
             "setting default successor %d -> %d\n",
@@ -252,7 +259,7 @@ void ControlFlowGraph::add_catch_edges(TryEnds& try_ends,
     always_assert(bid > 0);
     --bid;
     while (true) {
-      Block* block = m_blocks.at(bid);
+      Block* block = &m_blocks.at(bid);
       if (ends_with_may_throw(block)) {
         for (auto mei = try_end->catch_start; mei != nullptr;
              mei = mei->centry->next) {
@@ -279,8 +286,8 @@ void ControlFlowGraph::remove_unreachable_succ_edges() {
   // Remove edges between unreachable blocks and their succ blocks.
   std::unordered_set<Block*> visited;
   transform::visit(m_entry_block, visited);
-  for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it) {
-    Block* b = it->second;
+  for (auto& block : m_blocks) {
+    Block* b = &block;
     if (visited.find(b) != visited.end()) {
       continue;
     }
@@ -298,8 +305,8 @@ void ControlFlowGraph::remove_unreachable_succ_edges() {
 void ControlFlowGraph::fill_blocks(IRList* ir, Boundaries& boundaries) {
   always_assert(m_editable);
   // fill the blocks between their boundaries
-  for (const auto& entry : m_blocks) {
-    Block* b = entry.second;
+  for (auto& block : m_blocks) {
+    Block* b = &block;
     b->m_entries.splice_selection(b->m_entries.end(),
                                   *ir,
                                   boundaries.at(b).first,
@@ -311,11 +318,10 @@ void ControlFlowGraph::fill_blocks(IRList* ir, Boundaries& boundaries) {
 void ControlFlowGraph::add_fallthrough_gotos() {
   always_assert(m_editable);
   // Assumption: m_blocks is still in original execution order.
-  for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it) {
-    Block* b = it->second;
-    auto next = std::next(it);
-    Block* next_b = next->second;
-    if (next != m_blocks.end() && !b->succs().empty() &&
+  for (size_t i = 0; i + 1 < m_blocks.size(); ++i) {
+    Block* b = &m_blocks[i];
+    Block* next_b = &m_blocks[i + 1];
+    if (!b->succs().empty() &&
         b->rbegin()->branchingness() == opcode::BRANCH_NONE) {
       MethodItemEntry* fallthrough_goto =
           new MethodItemEntry(new IRInstruction(OPCODE_GOTO));
@@ -329,8 +335,8 @@ void ControlFlowGraph::add_fallthrough_gotos() {
 
 void ControlFlowGraph::sanity_check() {
   always_assert(m_editable);
-  for (const auto& entry : m_blocks) {
-    Block* b = entry.second;
+  for (auto& block : m_blocks) {
+    Block* b = &block;
     if (!b->m_succs.empty()) {
       always_assert_log(b->m_entries.rbegin()->branchingness() !=
                             opcode::BRANCH_NONE,
@@ -342,8 +348,8 @@ void ControlFlowGraph::sanity_check() {
 
 // remove any MFLOW_TARGETs that don't have a corresponding branch
 void ControlFlowGraph::clean_dangling_targets() {
-  for (const auto& entry : m_blocks) {
-    Block* b = entry.second;
+  for (auto& block : m_blocks) {
+    Block* b = &block;
 
     // find all branch instructions in all predecessors
     std::unordered_set<MethodItemEntry*> branches;
@@ -431,8 +437,8 @@ void ControlFlowGraph::remove_fallthrough_gotos(
 // remove all TRY START and ENDs because we may reorder the blocks
 void ControlFlowGraph::remove_try_markers() {
   always_assert(m_editable);
-  for (const auto& entry : m_blocks) {
-    Block* b = entry.second;
+  for (auto& block : m_blocks) {
+    Block* b = &block;
     b->m_entries.remove_and_dispose_if(
         [b](const MethodItemEntry& mie) {
           if (mie.type == MFLOW_TRY) {
@@ -457,8 +463,8 @@ IRList* ControlFlowGraph::linearize() {
   IRList* result = new IRList;
 
   TRACE(CFG, 5, "before linearize:\n");
-  for (const auto& entry : m_blocks) {
-    Block* b = entry.second;
+  for (auto& block : m_blocks) {
+    Block* b = &block;
     TRACE(CFG, 5, "%s", SHOW(&(b->m_entries)));
   }
 
@@ -498,25 +504,17 @@ IRList* ControlFlowGraph::linearize() {
 std::vector<Block*> ControlFlowGraph::blocks() const {
   std::vector<Block*> result;
   result.reserve(m_blocks.size());
-  for (const auto& entry : m_blocks) {
-    Block* b = entry.second;
-    result.emplace_back(b);
+  for (const auto& block : m_blocks) {
+    result.emplace_back(const_cast<Block*>(&block));
   }
   return result;
 }
 
-ControlFlowGraph::~ControlFlowGraph() {
-  for (const auto& entry : m_blocks) {
-    Block* b = entry.second;
-    delete b;
-  }
-}
-
 Block* ControlFlowGraph::create_block() {
   size_t id = m_blocks.size();
-  Block* b = new Block(this, id);
-  m_blocks.emplace(id, b);
-  return b;
+  ++m_version;
+  m_blocks.emplace_back(this, id);
+  return &m_blocks.back();
 }
 
 void ControlFlowGraph::calculate_exit_block() {
@@ -536,21 +534,24 @@ void ControlFlowGraph::calculate_exit_block() {
 }
 
 void ControlFlowGraph::add_edge(Block* p, Block* s, EdgeType type) {
-  auto edge = std::make_shared<Edge>(p, s, type);
+  ++m_version;
+  m_edges.emplace_back(p, s, type);
+  Edge* edge = &m_edges.back();
   p->m_succs.emplace_back(edge);
   s->m_preds.emplace_back(edge);
 }
 
 void ControlFlowGraph::remove_all_edges(Block* p, Block* s) {
+  ++m_version;
   p->m_succs.erase(std::remove_if(p->m_succs.begin(),
                                   p->m_succs.end(),
-                                  [&](const std::shared_ptr<Edge>& e) {
+                                  [&](const Edge* e) {
                                     return e->target() == s;
                                   }),
                    p->succs().end());
   s->m_preds.erase(std::remove_if(s->m_preds.begin(),
                                   s->m_preds.end(),
-                                  [&](const std::shared_ptr<Edge>& e) {
+                                  [&](const Edge* e) {
                                     return e->src() == p;
                                   }),
                    s->preds().end());
@@ -668,8 +669,8 @@ std::vector<Block*> postorder_sort(const std::vector<Block*>& cfg) {
 
 Block* ControlFlowGraph::find_block_that_ends_here(
     const IRList::iterator& loc) const {
-  for (const auto& entry : m_blocks) {
-    Block* b = entry.second;
+  for (const auto& block : m_blocks) {
+    Block* b = const_cast<Block*>(&block);
     if (b->end() == loc) {
       return b;
     }
@@ -677,80 +678,187 @@ Block* ControlFlowGraph::find_block_that_ends_here(
   return nullptr;
 }
 
-Block* ControlFlowGraph::idom_intersect(
-    const std::unordered_map<Block*, DominatorInfo>& postorder_dominator,
-    Block* block1,
-    Block* block2) const {
-  auto finger1 = block1;
-  auto finger2 = block2;
-  while (finger1 != finger2) {
-    while (postorder_dominator.at(finger1).postorder <
-           postorder_dominator.at(finger2).postorder) {
-      finger1 = postorder_dominator.at(finger1).dom;
-    }
-    while (postorder_dominator.at(finger2).postorder <
-           postorder_dominator.at(finger1).postorder) {
-      finger2 = postorder_dominator.at(finger2).dom;
-    }
-  }
-  return finger1;
-}
+namespace cfg {
+
+constexpr uint32_t DominatorTree::UNREACHABLE;
 
 // Finding immediate dominator for each blocks in ControlFlowGraph.
 // Theory from:
 //    K. D. Cooper et.al. A Simple, Fast Dominance Algorithm.
-std::unordered_map<Block*, DominatorInfo>
-ControlFlowGraph::immediate_dominators() const {
-  // Get postorder of blocks and create map of block to postorder number.
-  std::unordered_map<Block*, DominatorInfo> postorder_dominator;
-  auto postorder_blocks = postorder_sort(blocks());
-  for (size_t i = 0; i < postorder_blocks.size(); ++i) {
-    postorder_dominator[postorder_blocks[i]].postorder = i;
-  }
-
-  // Initialize immediate dominators. Having value as nullptr means it has
-  // not been processed yet.
-  for (Block* block : blocks()) {
-    if (block->preds().size() == 0) {
-      // Entry block's immediate dominator is itself.
-      postorder_dominator[block].dom = block;
-    } else {
-      postorder_dominator[block].dom = nullptr;
+DominatorTree::DominatorTree(const ControlFlowGraph& cfg,
+                             Block* root,
+                             bool post)
+    : m_root(root) {
+  // Block ids are dense, since blocks are never removed from the graph.
+  size_t num_blocks = cfg.blocks().size();
+  m_idom.resize(num_blocks, nullptr);
+  m_postorder.resize(num_blocks, UNREACHABLE);
+  m_children.resize(num_blocks);
+  m_tree_begin.resize(num_blocks, UNREACHABLE);
+  m_tree_end.resize(num_blocks, UNREACHABLE);
+  m_frontiers.resize(num_blocks);
+
+  auto next = [post](const Edge* e) { return post ? e->src() : e->target(); };
+  auto prev = [post](const Edge* e) { return post ? e->target() : e->src(); };
+  auto out_edges = [post](const Block* b) -> const std::vector<Edge*>& {
+    return post ? b->preds() : b->succs();
+  };
+  auto in_edges = [post](const Block* b) -> const std::vector<Edge*>& {
+    return post ? b->succs() : b->preds();
+  };
+
+  // Number the reachable blocks in postorder, without recursing.
+  std::vector<Block*> postorder_blocks;
+  {
+    std::vector<bool> visited(num_blocks, false);
+    std::vector<std::pair<Block*, size_t>> stack;
+    visited[root->id()] = true;
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+      auto& top = stack.back();
+      const auto& edges = out_edges(top.first);
+      if (top.second < edges.size()) {
+        Block* b = next(edges[top.second++]);
+        if (!visited[b->id()]) {
+          visited[b->id()] = true;
+          stack.emplace_back(b, 0);
+        }
+        continue;
+      }
+      m_postorder[top.first->id()] = postorder_blocks.size();
+      postorder_blocks.push_back(top.first);
+      stack.pop_back();
     }
   }
 
+  auto intersect = [this](Block* finger1, Block* finger2) {
+    while (finger1 != finger2) {
+      while (m_postorder[finger1->id()] < m_postorder[finger2->id()]) {
+        finger1 = m_idom[finger1->id()];
+      }
+      while (m_postorder[finger2->id()] < m_postorder[finger1->id()]) {
+        finger2 = m_idom[finger2->id()];
+      }
+    }
+    return finger1;
+  };
+
+  // Having nullptr as immediate dominator means the block has not been
+  // processed yet.
+  m_idom[root->id()] = root;
   bool changed = true;
   while (changed) {
     changed = false;
     // Traverse block in reverse postorder.
     for (auto rit = postorder_blocks.rbegin(); rit != postorder_blocks.rend();
          ++rit) {
-      Block* ordered_block = *rit;
-      if (ordered_block->preds().size() == 0) {
+      Block* block = *rit;
+      if (block == root) {
         continue;
       }
       Block* new_idom = nullptr;
-      // Pick one random processed block as starting point.
-      for (auto& pred : ordered_block->preds()) {
-        if (postorder_dominator[pred->src()].dom != nullptr) {
-          new_idom = pred->src();
-          break;
+      for (const auto& e : in_edges(block)) {
+        Block* pred = prev(e);
+        if (m_idom[pred->id()] == nullptr) {
+          continue;
         }
+        new_idom = new_idom == nullptr ? pred : intersect(new_idom, pred);
       }
       always_assert(new_idom != nullptr);
-      for (auto& pred : ordered_block->preds()) {
-        if (pred->src() != new_idom &&
-            postorder_dominator[pred->src()].dom != nullptr) {
-          new_idom = idom_intersect(postorder_dominator, new_idom, pred->src());
-        }
-      }
-      if (postorder_dominator[ordered_block].dom != new_idom) {
-        postorder_dominator[ordered_block].dom = new_idom;
+      if (m_idom[block->id()] != new_idom) {
+        m_idom[block->id()] = new_idom;
         changed = true;
       }
     }
   }
-  return postorder_dominator;
+
+  for (Block* block : postorder_blocks) {
+    if (block != root) {
+      m_children[m_idom[block->id()]->id()].push_back(block);
+    }
+  }
+
+  // Number the tree depth-first, so that a block's subtree is the interval
+  // between its entry and its exit.
+  {
+    uint32_t counter = 0;
+    std::vector<std::pair<Block*, size_t>> stack;
+    m_tree_begin[root->id()] = counter++;
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+      auto& top = stack.back();
+      const auto& children = m_children[top.first->id()];
+      if (top.second < children.size()) {
+        Block* child = children[top.second++];
+        m_tree_begin[child->id()] = counter++;
+        stack.emplace_back(child, 0);
+        continue;
+      }
+      m_tree_end[top.first->id()] = counter++;
+      stack.pop_back();
+    }
+  }
+
+  // The frontiers, as described in the same paper: a join point is in the
+  // frontier of every block between each of its predecessors and its
+  // immediate dominator. The root has no immediate dominator to stop at, and
+  // is in the frontier of every block on the way to it.
+  for (Block* block : postorder_blocks) {
+    Block* stop = block == root ? nullptr : m_idom[block->id()];
+    for (const auto& e : in_edges(block)) {
+      Block* runner = prev(e);
+      if (!is_reachable(runner)) {
+        continue;
+      }
+      while (runner != stop) {
+        auto& frontier = m_frontiers[runner->id()];
+        // Another predecessor's walk may have come this way already.
+        if (!frontier.empty() && frontier.back() == block) {
+          break;
+        }
+        frontier.push_back(block);
+        runner = runner == root ? nullptr : m_idom[runner->id()];
+      }
+    }
+  }
+}
+
+Block* DominatorTree::common_dominator(const Block* a, const Block* b) const {
+  auto finger = const_cast<Block*>(a);
+  while (!dominates(finger, b)) {
+    finger = m_idom[finger->id()];
+  }
+  return finger;
+}
+
+} // namespace cfg
+
+const DominatorTree& ControlFlowGraph::dominators() const {
+  if (m_dominators_version != m_version) {
+    m_dominators = std::make_unique<DominatorTree>(
+        *this, const_cast<Block*>(entry_block()), /* post */ false);
+    m_dominators_version = m_version;
+  }
+  return *m_dominators;
+}
+
+const DominatorTree& ControlFlowGraph::post_dominators() const {
+  always_assert_log(m_exit_block != nullptr,
+                    "Post-dominators need an exit block");
+  if (m_post_dominators_version != m_version) {
+    m_post_dominators =
+        std::make_unique<DominatorTree>(*this, m_exit_block, /* post */ true);
+    m_post_dominators_version = m_version;
+  }
+  return *m_post_dominators;
+}
+
+const std::vector<Block*>& ControlFlowGraph::postorder() const {
+  if (m_postorder_version != m_version) {
+    m_postorder = postorder_sort(blocks());
+    m_postorder_version = m_version;
+  }
+  return m_postorder;
 }
 
 void ControlFlowGraph::remove_succ_edges(Block* b) {
@@ -9,10 +9,14 @@
 
 #pragma once
 
+#include <deque>
+#include <limits>
+#include <memory>
 #include <utility>
 
 #include "FixpointIterators.h"
 #include "IRCode.h"
+#include "ObjectCensus.h"
 
 /**
  * A Control Flow Graph is a directed graph of Basic Blocks.
@@ -27,6 +31,10 @@
  * An editable CFG's blocks each own a small IRList (with MethodItemEntries
  * taken from IRCode)
  *
+ * Blocks and edges are owned by the graph and stored contiguously, in creation
+ * order; a block's id is its index. Blocks refer to their edges through plain
+ * `cfg::Edge*` handles, which stay valid for the lifetime of the graph.
+ *
  * TODO: Add useful CFG editing methods
  * TODO: phase out edits to the IRCode and move them all to the editable CFG
  * TODO: remove non-editable CFG option
@@ -43,7 +51,7 @@ void replace_block(IRCode*, Block*, Block*);
 
 namespace cfg {
 
-class Edge final {
+class Edge final : public census::Counted<census::CFG_EDGE> {
   Block* m_src;
   Block* m_target;
   EdgeType m_type;
@@ -66,18 +74,14 @@ class Edge final {
 
 // A piece of "straight-line" code. Targets are only at the beginning of a block
 // and branches (throws, gotos, switches, etc) are only at the end of a block.
-class Block {
+class Block : public census::Counted<census::CFG_BLOCK> {
  public:
   explicit Block(const ControlFlowGraph* parent, size_t id)
       : m_id(id), m_parent(parent) {}
 
   size_t id() const { return m_id; }
-  const std::vector<std::shared_ptr<cfg::Edge>>& preds() const {
-    return m_preds;
-  }
-  const std::vector<std::shared_ptr<cfg::Edge>>& succs() const {
-    return m_succs;
-  }
+  const std::vector<cfg::Edge*>& preds() const { return m_preds; }
+  const std::vector<cfg::Edge*>& succs() const { return m_succs; }
   IRList::iterator begin();
   IRList::iterator end();
   IRList::reverse_iterator rbegin() {
@@ -117,8 +121,8 @@ class Block {
   IRList::iterator m_begin;
   IRList::iterator m_end;
 
-  std::vector<std::shared_ptr<cfg::Edge>> m_preds;
-  std::vector<std::shared_ptr<cfg::Edge>> m_succs;
+  std::vector<cfg::Edge*> m_preds;
+  std::vector<cfg::Edge*> m_succs;
 
   // This is the successor taken in the
   // non-exception, if false, or switch default situations
@@ -131,11 +135,77 @@ class Block {
   const ControlFlowGraph* m_parent = nullptr;
 };
 
-struct DominatorInfo {
-  Block* dom;
-  size_t postorder;
+namespace cfg {
+
+/*
+ * The dominator tree of the blocks of a CFG that are reachable from a root
+ * block. For the post-dominator tree, the root is the exit block and edges
+ * are followed backwards.
+ *
+ * Everything is kept in arrays indexed by block id. Each block also gets the
+ * interval of its subtree in a depth-first numbering of the tree, so that
+ * `dominates` is answered in constant time.
+ *
+ * The tree is a snapshot: it must not be used after the graph changes. Use
+ * ControlFlowGraph::dominators() and post_dominators() to get a tree that is
+ * cached until then.
+ */
+class DominatorTree final {
+ public:
+  DominatorTree(const ControlFlowGraph& cfg, Block* root, bool post);
+
+  Block* root() const { return m_root; }
+
+  // Whether `b` is reachable from the root. Unreachable blocks are not part
+  // of the tree, and no queries below may be made about them.
+  bool is_reachable(const Block* b) const {
+    return m_postorder.at(b->id()) != UNREACHABLE;
+  }
+
+  // The immediate dominator of `b`. The root is its own immediate dominator.
+  Block* idom(const Block* b) const { return m_idom.at(b->id()); }
+
+  // The blocks whose immediate dominator is `b`, except `b` itself.
+  const std::vector<Block*>& children(const Block* b) const {
+    return m_children.at(b->id());
+  }
+
+  // Whether every path from the root to `b` goes through `a`. Every block
+  // dominates itself.
+  bool dominates(const Block* a, const Block* b) const {
+    auto ia = a->id();
+    auto ib = b->id();
+    return m_tree_begin[ia] <= m_tree_begin[ib] &&
+           m_tree_end[ib] <= m_tree_end[ia];
+  }
+
+  // The closest block that dominates both `a` and `b`.
+  Block* common_dominator(const Block* a, const Block* b) const;
+
+  // The dominance frontier of `b`: the blocks that `b` doesn't strictly
+  // dominate, but that have a predecessor `b` dominates.
+  const std::vector<Block*>& frontier(const Block* b) const {
+    return m_frontiers.at(b->id());
+  }
+
+ private:
+  static constexpr uint32_t UNREACHABLE =
+      std::numeric_limits<uint32_t>::max();
+
+  Block* m_root;
+  std::vector<Block*> m_idom;
+  // Postorder number of each block in a depth-first search from the root.
+  std::vector<uint32_t> m_postorder;
+  std::vector<std::vector<Block*>> m_children;
+  // A block's subtree covers [m_tree_begin, m_tree_end] in a depth-first
+  // numbering of the tree.
+  std::vector<uint32_t> m_tree_begin;
+  std::vector<uint32_t> m_tree_end;
+  std::vector<std::vector<Block*>> m_frontiers;
 };
 
+} // namespace cfg
+
 class ControlFlowGraph {
 
  public:
@@ -148,7 +218,7 @@ class ControlFlowGraph {
    */
   ControlFlowGraph(IRList* ir,
                    bool editable = false);
-  ~ControlFlowGraph();
+  ~ControlFlowGraph() = default;
 
   /*
    * convert from the graph representation to a list of MethodItemEntries
@@ -179,14 +249,21 @@ class ControlFlowGraph {
 
   Block* find_block_that_ends_here(const IRList::iterator& loc) const;
 
-  // Find a common dominator block that is closest to both block.
-  Block* idom_intersect(
-      const std::unordered_map<Block*, DominatorInfo>& postorder_dominator,
-      Block* block1,
-      Block* block2) const;
+  // The dominator tree of the blocks reachable from the entry block.
+  // Computed once and then cached until the graph changes.
+  const cfg::DominatorTree& dominators() const;
+
+  // The post-dominator tree, rooted at the exit block, which must have been
+  // set (see `calculate_exit_block`). Cached like `dominators`.
+  const cfg::DominatorTree& post_dominators() const;
+
+  // The blocks in postorder (see `postorder_sort`). Computed once and then
+  // cached until the graph changes.
+  const std::vector<Block*>& postorder() const;
 
-  // Finding immediate dominator for each blocks in ControlFlowGraph.
-  std::unordered_map<Block*, DominatorInfo> immediate_dominators() const;
+  // Bumped by every change to the graph's blocks or edges, so that results
+  // computed from the graph can tell whether they are still current.
+  size_t version() const { return m_version; }
 
   void remove_succ_edges(Block* b);
 
@@ -201,7 +278,10 @@ class ControlFlowGraph {
   using Boundaries =
       std::unordered_map<Block*,
                          std::pair<IRList::iterator, IRList::iterator>>;
-  using Blocks = std::map<size_t, Block*>;
+  // Deques rather than vectors so that Block* and Edge* stay valid as the
+  // graph grows; both are indexed by creation order.
+  using Blocks = std::deque<Block>;
+  using Edges = std::deque<cfg::Edge>;
 
   // Find block boundaries in IRCode and create the blocks
   // For use by the constructor. You probably don't want to call this from
@@ -257,9 +337,21 @@ class ControlFlowGraph {
   void remove_all_edges(Block* pred, Block* succ);
 
   Blocks m_blocks;
+  // Removed edges are unlinked from their blocks but stay here until the
+  // graph is destroyed.
+  Edges m_edges;
   Block* m_entry_block{nullptr};
   Block* m_exit_block{nullptr};
   bool m_editable;
+  size_t m_version{0};
+
+  static constexpr size_t NOT_COMPUTED = std::numeric_limits<size_t>::max();
+  mutable std::vector<Block*> m_postorder;
+  mutable size_t m_postorder_version{NOT_COMPUTED};
+  mutable std::unique_ptr<cfg::DominatorTree> m_dominators;
+  mutable size_t m_dominators_version{NOT_COMPUTED};
+  mutable std::unique_ptr<cfg::DominatorTree> m_post_dominators;
+  mutable size_t m_post_dominators_version{NOT_COMPUTED};
 };
 
 namespace cfg {
@@ -271,7 +363,7 @@ class GraphInterface : public FixpointIteratorGraphSpec<GraphInterface> {
  public:
   using Graph = ControlFlowGraph;
   using NodeId = Block*;
-  using EdgeId = std::shared_ptr<cfg::Edge>;
+  using EdgeId = cfg::Edge*;
   static NodeId entry(const Graph& graph) {
     return const_cast<NodeId>(graph.entry_block());
   }
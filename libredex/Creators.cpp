@@ -672,3 +672,37 @@ DexMethod* MethodCreator::make_static_from(DexString* name,
   target_cls->add_method(smeth);
   return smeth;
 }
+
+size_t MethodRefBatch::add(DexType* cls,
+                           std::string name,
+                           DexType* rtype,
+                           std::deque<DexType*> args) {
+  m_entries.push_back(
+      Entry{cls, std::move(name), rtype, std::move(args)});
+  return m_entries.size() - 1;
+}
+
+std::vector<DexMethodRef*> MethodRefBatch::create() {
+  std::vector<std::pair<const char*, uint32_t>> names;
+  names.reserve(m_entries.size());
+  for (const auto& entry : m_entries) {
+    names.emplace_back(entry.name.c_str(),
+                       length_of_utf8_string(entry.name.c_str()));
+  }
+  auto dnames = g_redex->make_strings(names);
+
+  std::map<std::pair<DexType*, std::deque<DexType*>>, DexProto*> protos;
+  std::vector<DexMethodSpec> specs;
+  specs.reserve(m_entries.size());
+  for (size_t i = 0; i < m_entries.size(); ++i) {
+    auto& entry = m_entries[i];
+    auto& proto = protos[std::make_pair(entry.rtype, entry.args)];
+    if (proto == nullptr) {
+      proto = DexProto::make_proto(
+          entry.rtype, DexTypeList::make_type_list(std::move(entry.args)));
+    }
+    specs.emplace_back(entry.cls, dnames[i], proto);
+  }
+  m_entries.clear();
+  return g_redex->make_methods(specs);
+}
@@ -9,6 +9,9 @@
 
 #pragma once
 
+#include <deque>
+#include <map>
+#include <string>
 #include <vector>
 #include <unordered_map>
 
@@ -477,6 +480,43 @@ struct MethodCreator {
   friend struct MethodBlock;
 };
 
+/**
+ * Declares many methods at once, e.g. the stubs a pass synthesizes. The
+ * names, protos and method references of a whole batch are interned
+ * together, locking each shard of the global tables once rather than once
+ * per entity, and methods that share a proto build it once.
+ * create() returns references, which are then made concrete as usual (e.g.
+ * with MethodCreator). A batch isn't thread-safe, but parallel walkers can
+ * each fill their own.
+ */
+class MethodRefBatch {
+ public:
+  /**
+   * Queue a method and return its index among the results of create().
+   */
+  size_t add(DexType* cls,
+             std::string name,
+             DexType* rtype,
+             std::deque<DexType*> args);
+
+  size_t size() const { return m_entries.size(); }
+
+  /**
+   * Return the references to all the queued methods, in the order they were
+   * added, and empty the batch.
+   */
+  std::vector<DexMethodRef*> create();
+
+ private:
+  struct Entry {
+    DexType* cls;
+    std::string name;
+    DexType* rtype;
+    std::deque<DexType*> args;
+  };
+  std::vector<Entry> m_entries;
+};
+
 /**
  * Create a DexClass.
  * Once create is called this creator should not be used any longer.
@@ -18,9 +18,12 @@ std::unique_ptr<std::unordered_map<IRInstruction*, T>> forwards_dataflow(
     const T& entry_value) {
   std::vector<T> block_outs(blocks.size(), bottom);
   std::deque<Block*> work_list(blocks.begin(), blocks.end());
+  // Indexed by block id, to keep the work list free of duplicates.
+  std::vector<bool> in_work_list(blocks.size(), true);
   while (!work_list.empty()) {
     auto block = work_list.front();
     work_list.pop_front();
+    in_work_list[block->id()] = false;
     auto insn_in = bottom;
     if (block->id() == 0) {
       insn_in = entry_value;
@@ -37,9 +40,10 @@ std::unique_ptr<std::unordered_map<IRInstruction*, T>> forwards_dataflow(
     if (insn_in != block_outs[block->id()]) {
       block_outs[block->id()] = std::move(insn_in);
       for (auto& succ : block->succs()) {
-        if (std::find(work_list.begin(), work_list.end(), succ->target()) ==
-            work_list.end()) {
-          work_list.push_back(succ->target());
+        auto target = succ->target();
+        if (!in_work_list[target->id()]) {
+          in_work_list[target->id()] = true;
+          work_list.push_back(target);
         }
       }
     }
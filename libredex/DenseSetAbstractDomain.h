@@ -0,0 +1,249 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "PowersetAbstractDomain.h"
+
+namespace dsad_impl {
+
+/*
+ * The definition of an abstract value belonging to an abstract domain: a set
+ * of small integers stored as a bit vector, one bit per possible element.
+ *
+ * Compared with SparseSetValue, membership tests and updates are a single bit
+ * operation, and the lattice operations work a whole machine word at a time
+ * over contiguous memory (which compilers readily vectorize). The price is
+ * that iterating over the elements is linear in the capacity rather than in
+ * the number of elements, so this suits sets that are dense relative to their
+ * capacity, such as the live registers of a method.
+ *
+ * Elements are enumerated in increasing order.
+ */
+class DenseSetValue final
+    : public PowersetImplementation<uint16_t,
+                                    const DenseSetValue&,
+                                    DenseSetValue> {
+  using Word = uint64_t;
+  static constexpr size_t BITS_PER_WORD = 64;
+
+ public:
+  using Kind = typename AbstractValue<DenseSetValue>::Kind;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = uint16_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const uint16_t*;
+    using reference = uint16_t;
+
+    uint16_t operator*() const {
+      return m_index * BITS_PER_WORD + __builtin_ctzll(m_bits);
+    }
+
+    const_iterator& operator++() {
+      // Clear the lowest set bit.
+      m_bits &= m_bits - 1;
+      skip_empty_words();
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      auto result = *this;
+      ++(*this);
+      return result;
+    }
+
+    bool operator==(const const_iterator& that) const {
+      return m_index == that.m_index && m_bits == that.m_bits;
+    }
+
+    bool operator!=(const const_iterator& that) const {
+      return !(*this == that);
+    }
+
+   private:
+    const_iterator(const std::vector<Word>& words, size_t index)
+        : m_words(&words),
+          m_index(index),
+          m_bits(index < words.size() ? words[index] : 0) {
+      skip_empty_words();
+    }
+
+    void skip_empty_words() {
+      while (m_bits == 0 && m_index < m_words->size()) {
+        if (++m_index < m_words->size()) {
+          m_bits = (*m_words)[m_index];
+        }
+      }
+    }
+
+    const std::vector<Word>* m_words;
+    size_t m_index;
+    // The bits of the current word that haven't been visited yet.
+    Word m_bits;
+
+    friend class DenseSetValue;
+  };
+
+  DenseSetValue() = default;
+
+  // Constructor that sets the maximum number of elements this set can hold.
+  DenseSetValue(uint16_t max_size)
+      : m_capacity(max_size),
+        m_words((max_size + BITS_PER_WORD - 1) / BITS_PER_WORD) {}
+
+  void clear() override { std::fill(m_words.begin(), m_words.end(), 0); }
+
+  const DenseSetValue& elements() const override { return *this; }
+
+  // Returning a vector that contains all the elements in the set.
+  // (for test use)
+  std::vector<uint16_t> vals() const {
+    return std::vector<uint16_t>(begin(), end());
+  }
+
+  Kind kind() const override { return Kind::Value; }
+
+  bool contains(const uint16_t& candidate) const override {
+    return candidate < m_capacity &&
+           (m_words[candidate / BITS_PER_WORD] & bit(candidate)) != 0;
+  }
+
+  bool leq(const DenseSetValue& other) const override {
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      if (m_words[i] & ~other.word(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool equals(const DenseSetValue& other) const override {
+    auto n = std::max(m_words.size(), other.m_words.size());
+    for (size_t i = 0; i < n; ++i) {
+      if (word(i) != other.word(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void add(const uint16_t& elem) override {
+    if (elem < m_capacity) {
+      m_words[elem / BITS_PER_WORD] |= bit(elem);
+    }
+  }
+
+  void remove(const uint16_t& elem) override {
+    if (elem < m_capacity) {
+      m_words[elem / BITS_PER_WORD] &= ~bit(elem);
+    }
+  }
+
+  const_iterator begin() const { return const_iterator(m_words, 0); }
+
+  const_iterator end() const {
+    return const_iterator(m_words, m_words.size());
+  }
+
+  Kind join_with(const DenseSetValue& other) override {
+    if (other.m_capacity > m_capacity) {
+      m_words.resize(other.m_words.size(), 0);
+      m_capacity = other.m_capacity;
+    }
+    for (size_t i = 0; i < other.m_words.size(); ++i) {
+      m_words[i] |= other.m_words[i];
+    }
+    return Kind::Value;
+  }
+
+  Kind widen_with(const DenseSetValue& other) override {
+    return join_with(other);
+  }
+
+  Kind meet_with(const DenseSetValue& other) override {
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      m_words[i] &= other.word(i);
+    }
+    return Kind::Value;
+  }
+
+  Kind narrow_with(const DenseSetValue& other) override {
+    return meet_with(other);
+  }
+
+  size_t size() const override {
+    size_t n = 0;
+    for (auto w : m_words) {
+      n += __builtin_popcountll(w);
+    }
+    return n;
+  }
+
+ private:
+  static Word bit(uint16_t elem) {
+    return Word(1) << (elem % BITS_PER_WORD);
+  }
+
+  // Words past the end of the vector are treated as empty, so that sets of
+  // different capacities can be compared.
+  Word word(size_t i) const { return i < m_words.size() ? m_words[i] : 0; }
+
+  uint16_t m_capacity{0};
+  std::vector<Word> m_words;
+};
+
+} // namespace dsad_impl
+
+/*
+ * An implementation of abstract domain using a dense bit vector, built with
+ * the AbstractDomainScaffolding template. It is a drop-in replacement for
+ * SparseSetAbstractDomain.
+ */
+class DenseSetAbstractDomain final
+    : public PowersetAbstractDomain<uint16_t,
+                                    dsad_impl::DenseSetValue,
+                                    const dsad_impl::DenseSetValue&,
+                                    DenseSetAbstractDomain> {
+ public:
+  using Value = dsad_impl::DenseSetValue;
+
+  using AbstractValueKind = typename AbstractValue<Value>::Kind;
+
+  DenseSetAbstractDomain()
+      : PowersetAbstractDomain<uint16_t,
+                               Value,
+                               const Value&,
+                               DenseSetAbstractDomain>() {}
+
+  DenseSetAbstractDomain(AbstractValueKind kind)
+      : PowersetAbstractDomain<uint16_t,
+                               Value,
+                               const Value&,
+                               DenseSetAbstractDomain>(kind) {}
+
+  explicit DenseSetAbstractDomain(uint16_t max_size) {
+    this->set_to_value(Value(max_size));
+  }
+
+  static DenseSetAbstractDomain bottom() {
+    return DenseSetAbstractDomain(AbstractValueKind::Bottom);
+  }
+
+  static DenseSetAbstractDomain top() {
+    return DenseSetAbstractDomain(AbstractValueKind::Top);
+  }
+};
@@ -9,6 +9,9 @@
 
 #include "DexClass.h"
 #include "DexAnnotation.h"
+
+#include <mutex>
+
 #include "Debug.h"
 #include "DexIdx.h"
 #include "DexOutput.h"
@@ -90,7 +93,300 @@ void DexEncodedValueAnnotation::gather_methods(
   }
 }
 
+namespace {
+
+union Ref {
+  DexString* string;
+  DexType* type;
+  DexFieldRef* field;
+  DexMethodRef* method;
+};
+
+} // namespace
+
+/*
+ * The elements of an annotation that hasn't been decoded: the element count
+ * and the elements as encoded in the dex they were read from, and what the
+ * encoding refers to, in the order the references appear in it. The indices
+ * in the encoding are those of the original dex, and only the order of the
+ * references is used afterwards.
+ */
+struct DexAnnotation::Undecoded {
+  std::vector<uint8_t> elements;
+  std::vector<Ref> refs;
+};
+
+namespace {
+
+// Decoding on demand only needs to exclude another thread decoding the same
+// annotation, so a small set of striped locks is plenty.
+constexpr size_t DECODE_LOCK_STRIPES = 127;
+std::mutex s_decode_locks[DECODE_LOCK_STRIPES];
+
+std::mutex& decode_lock(const DexAnnotation* anno) {
+  return s_decode_locks[std::hash<const DexAnnotation*>()(anno) %
+                        DECODE_LOCK_STRIPES];
+}
+
+template <class Visitor>
+void walk_encoded_elements(const uint8_t*& encdata,
+                           uint32_t count,
+                           Visitor& visitor);
+
+/*
+ * Walks an encoded value, handing the visitor its references and its arrays
+ * and annotations as they come, and the bytes of everything else, which
+ * doesn't depend on the dex the value is in.
+ */
+template <class Visitor>
+void walk_encoded_value(const uint8_t*& encdata, Visitor& visitor) {
+  const uint8_t* begin = encdata;
+  uint8_t evhdr = *encdata++;
+  auto evt = (DexEncodedValueTypes)DEVT_HDR_TYPE(evhdr);
+  uint8_t evarg = DEVT_HDR_ARG(evhdr);
+  switch (evt) {
+  case DEVT_BYTE:
+  case DEVT_SHORT:
+  case DEVT_CHAR:
+  case DEVT_INT:
+  case DEVT_LONG:
+  case DEVT_FLOAT:
+  case DEVT_DOUBLE:
+    encdata += evarg + 1;
+    visitor.bytes(begin, encdata);
+    return;
+  case DEVT_NULL:
+  case DEVT_BOOLEAN:
+    visitor.bytes(begin, encdata);
+    return;
+  case DEVT_STRING:
+  case DEVT_TYPE:
+  case DEVT_FIELD:
+  case DEVT_ENUM:
+  case DEVT_METHOD:
+    visitor.ref(evt, (uint32_t)read_evarg(encdata, evarg));
+    return;
+  case DEVT_ARRAY: {
+    uint32_t size = read_uleb128(&encdata);
+    visitor.array(size);
+    for (uint32_t i = 0; i < size; i++) {
+      walk_encoded_value(encdata, visitor);
+    }
+    return;
+  }
+  case DEVT_ANNOTATION: {
+    uint32_t tidx = read_uleb128(&encdata);
+    uint32_t count = read_uleb128(&encdata);
+    visitor.annotation(tidx, count);
+    walk_encoded_elements(encdata, count, visitor);
+    return;
+  }
+  }
+  always_assert_log(false, "Bogus annotation");
+}
+
+template <class Visitor>
+void walk_encoded_elements(const uint8_t*& encdata,
+                           uint32_t count,
+                           Visitor& visitor) {
+  for (uint32_t i = 0; i < count; i++) {
+    visitor.name(read_uleb128(&encdata));
+    walk_encoded_value(encdata, visitor);
+  }
+}
+
+// Collects the references of encoded elements as they are loaded.
+class RefCollector {
+  DexIdx* m_idx;
+  std::vector<Ref>& m_refs;
+
+  Ref& push(const void* ptr, const char* what) {
+    always_assert_log(ptr != nullptr, "Invalid %s idx in annotation element",
+                      what);
+    m_refs.emplace_back();
+    return m_refs.back();
+  }
+
+ public:
+  RefCollector(DexIdx* idx, std::vector<Ref>& refs)
+      : m_idx(idx), m_refs(refs) {}
+
+  void bytes(const uint8_t*, const uint8_t*) {}
+  void ref(DexEncodedValueTypes evt, uint32_t evidx) {
+    switch (evt) {
+    case DEVT_STRING: {
+      auto string = m_idx->get_stringidx(evidx);
+      push(string, "string").string = string;
+      return;
+    }
+    case DEVT_TYPE: {
+      auto type = m_idx->get_typeidx(evidx);
+      push(type, "type").type = type;
+      return;
+    }
+    case DEVT_FIELD:
+    case DEVT_ENUM: {
+      auto field = m_idx->get_fieldidx(evidx);
+      push(field, "field").field = field;
+      return;
+    }
+    default: {
+      auto method = m_idx->get_methodidx(evidx);
+      push(method, "method").method = method;
+      return;
+    }
+    }
+  }
+  void array(uint32_t) {}
+  void annotation(uint32_t tidx, uint32_t) {
+    auto type = m_idx->get_typeidx(tidx);
+    push(type, "type").type = type;
+  }
+  void name(uint32_t sidx) {
+    auto string = m_idx->get_stringidx(sidx);
+    push(string, "string").string = string;
+  }
+};
+
+// Gathers the references of undecoded elements into the lists that are set.
+class RefGatherer {
+  const Ref* m_next;
+
+ public:
+  std::vector<DexString*>* strings{nullptr};
+  std::vector<DexType*>* types{nullptr};
+  std::vector<DexFieldRef*>* fields{nullptr};
+  std::vector<DexMethodRef*>* methods{nullptr};
+
+  explicit RefGatherer(const Ref* refs) : m_next(refs) {}
+
+  void bytes(const uint8_t*, const uint8_t*) {}
+  void ref(DexEncodedValueTypes evt, uint32_t) {
+    const auto& ref = *m_next++;
+    switch (evt) {
+    case DEVT_STRING:
+      if (strings) strings->push_back(ref.string);
+      return;
+    case DEVT_TYPE:
+      if (types) types->push_back(ref.type);
+      return;
+    case DEVT_FIELD:
+    case DEVT_ENUM:
+      if (fields) fields->push_back(ref.field);
+      return;
+    default:
+      if (methods) methods->push_back(ref.method);
+      return;
+    }
+  }
+  void array(uint32_t) {}
+  void annotation(uint32_t, uint32_t) {
+    const auto& ref = *m_next++;
+    if (types) types->push_back(ref.type);
+  }
+  void name(uint32_t) {
+    const auto& ref = *m_next++;
+    if (strings) strings->push_back(ref.string);
+  }
+};
+
+void uleb_append(std::vector<uint8_t>& bytes, uint32_t v) {
+  uint8_t tarray[5];
+  uint8_t* pend = write_uleb128(tarray, v);
+  bytes.insert(bytes.end(), tarray, pend);
+}
+
+// Writes undecoded elements out for a new dex, renumbering the references.
+class RefRenumberer {
+  const Ref* m_next;
+  DexOutputIdx* m_dodx;
+  std::vector<uint8_t>& m_out;
+
+ public:
+  RefRenumberer(const Ref* refs, DexOutputIdx* dodx, std::vector<uint8_t>& out)
+      : m_next(refs), m_dodx(dodx), m_out(out) {}
+
+  void bytes(const uint8_t* begin, const uint8_t* end) {
+    m_out.insert(m_out.end(), begin, end);
+  }
+  void ref(DexEncodedValueTypes evt, uint32_t) {
+    const auto& ref = *m_next++;
+    uint32_t idx;
+    switch (evt) {
+    case DEVT_STRING:
+      idx = m_dodx->stringidx(ref.string);
+      break;
+    case DEVT_TYPE:
+      idx = m_dodx->typeidx(ref.type);
+      break;
+    case DEVT_FIELD:
+    case DEVT_ENUM:
+      idx = m_dodx->fieldidx(ref.field);
+      break;
+    default:
+      idx = m_dodx->methodidx(ref.method);
+      break;
+    }
+    uint8_t buffer[5];
+    uint8_t* pend = buffer;
+    type_encoder(pend, evt, idx);
+    m_out.insert(m_out.end(), buffer, pend);
+  }
+  void array(uint32_t size) {
+    m_out.push_back(DEVT_HDR_TYPE(DEVT_ARRAY));
+    uleb_append(m_out, size);
+  }
+  void annotation(uint32_t, uint32_t count) {
+    m_out.push_back(DEVT_HDR_TYPE(DEVT_ANNOTATION));
+    uleb_append(m_out, m_dodx->typeidx((*m_next++).type));
+    uleb_append(m_out, count);
+  }
+  void name(uint32_t) {
+    uleb_append(m_out, m_dodx->stringidx((*m_next++).string));
+  }
+};
+
+template <class Visitor>
+void walk_undecoded(const std::vector<uint8_t>& elements, Visitor& visitor) {
+  const uint8_t* encdata = elements.data();
+  uint32_t count = read_uleb128(&encdata);
+  walk_encoded_elements(encdata, count, visitor);
+}
+
+} // namespace
+
+DexAnnotation::DexAnnotation(DexType* type, DexAnnotationVisibility viz)
+    : Gatherable(), m_type(type), m_viz(viz) {}
+
+DexAnnotation::DexAnnotation(const DexAnnotation& that)
+    : Gatherable(),
+      m_anno_elems(that.anno_elems()),
+      m_type(that.m_type),
+      m_viz(that.m_viz) {}
+
+DexAnnotation::~DexAnnotation() {}
+
+template <class Fn>
+bool DexAnnotation::with_undecoded(const Fn& fn) const {
+  if (!m_decode_pending.load(std::memory_order_acquire)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(decode_lock(this));
+  if (!m_decode_pending.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  fn(*m_undecoded);
+  return true;
+}
+
 void DexAnnotation::gather_strings(std::vector<DexString*>& lstring) const {
+  if (with_undecoded([&](const Undecoded& undecoded) {
+        RefGatherer gatherer(undecoded.refs.data());
+        gatherer.strings = &lstring;
+        walk_undecoded(undecoded.elements, gatherer);
+      })) {
+    return;
+  }
   for (auto const& anno : m_anno_elems) {
     lstring.push_back(anno.string);
     anno.encoded_value->gather_strings(lstring);
@@ -99,18 +395,39 @@ void DexAnnotation::gather_strings(std::vector<DexString*>& lstring) const {
 
 void DexAnnotation::gather_types(std::vector<DexType*>& ltype) const {
   ltype.push_back(m_type);
+  if (with_undecoded([&](const Undecoded& undecoded) {
+        RefGatherer gatherer(undecoded.refs.data());
+        gatherer.types = &ltype;
+        walk_undecoded(undecoded.elements, gatherer);
+      })) {
+    return;
+  }
   for (auto const& anno : m_anno_elems) {
     anno.encoded_value->gather_types(ltype);
   }
 }
 
 void DexAnnotation::gather_fields(std::vector<DexFieldRef*>& lfield) const {
+  if (with_undecoded([&](const Undecoded& undecoded) {
+        RefGatherer gatherer(undecoded.refs.data());
+        gatherer.fields = &lfield;
+        walk_undecoded(undecoded.elements, gatherer);
+      })) {
+    return;
+  }
   for (auto const& anno : m_anno_elems) {
     anno.encoded_value->gather_fields(lfield);
   }
 }
 
 void DexAnnotation::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
+  if (with_undecoded([&](const Undecoded& undecoded) {
+        RefGatherer gatherer(undecoded.refs.data());
+        gatherer.methods = &lmethod;
+        walk_undecoded(undecoded.elements, gatherer);
+      })) {
+    return;
+  }
   for (auto const& anno : m_anno_elems) {
     anno.encoded_value->gather_methods(lmethod);
   }
@@ -312,27 +629,73 @@ void DexEncodedValueAnnotation::encode(DexOutputIdx* dodx, uint8_t*& encdata) {
   }
 }
 
-static DexAnnotationElement get_annotation_element(DexIdx* idx,
-                                                   const uint8_t*& encdata) {
+namespace {
+
+// Where the decoder gets what encoded values refer to: from the indices, in
+// the dex being loaded.
+class IdxRefs {
+  DexIdx* m_idx;
+
+ public:
+  explicit IdxRefs(DexIdx* idx) : m_idx(idx) {}
+  DexString* string(uint32_t sidx) { return m_idx->get_stringidx(sidx); }
+  DexType* type(uint32_t tidx) { return m_idx->get_typeidx(tidx); }
+  DexFieldRef* field(uint32_t fidx) { return m_idx->get_fieldidx(fidx); }
+  DexMethodRef* method(uint32_t midx) { return m_idx->get_methodidx(midx); }
+};
+
+// Or in turn from the references of undecoded elements, ignoring the
+// indices, which belong to a dex that is gone.
+class UndecodedRefs {
+  const Ref* m_next;
+
+ public:
+  explicit UndecodedRefs(const Ref* refs) : m_next(refs) {}
+  DexString* string(uint32_t) { return (*m_next++).string; }
+  DexType* type(uint32_t) { return (*m_next++).type; }
+  DexFieldRef* field(uint32_t) { return (*m_next++).field; }
+  DexMethodRef* method(uint32_t) { return (*m_next++).method; }
+};
+
+// DexEncodedValue only lets its subclasses make plain values.
+class PrimitiveValue : public DexEncodedValue {
+ public:
+  PrimitiveValue(DexEncodedValueTypes type, uint64_t value)
+      : DexEncodedValue(type, value) {}
+};
+
+template <class Refs>
+DexEncodedValue* decode_value(Refs& refs, const uint8_t*& encdata);
+
+template <class Refs>
+DexAnnotationElement decode_element(Refs& refs, const uint8_t*& encdata) {
   uint32_t sidx = read_uleb128(&encdata);
-  DexString* name = idx->get_stringidx(sidx);
+  DexString* name = refs.string(sidx);
   always_assert_log(name != nullptr,
                     "Invalid string idx in annotation element");
-  DexEncodedValue* dev = DexEncodedValue::get_encoded_value(idx, encdata);
+  DexEncodedValue* dev = decode_value(refs, encdata);
   return DexAnnotationElement(name, dev);
 }
 
-DexEncodedValueArray* get_encoded_value_array(DexIdx* idx,
-                                              const uint8_t*& encdata) {
+template <class Refs>
+DexEncodedValueArray* decode_array(Refs& refs, const uint8_t*& encdata) {
   uint32_t size = read_uleb128(&encdata);
   auto *evlist = new std::deque<DexEncodedValue*>();
   for (uint32_t i = 0; i < size; i++) {
-    DexEncodedValue* adev = DexEncodedValue::get_encoded_value(idx, encdata);
+    DexEncodedValue* adev = decode_value(refs, encdata);
     evlist->push_back(adev);
   }
   return new DexEncodedValueArray(evlist);
 }
 
+} // namespace
+
+DexEncodedValueArray* get_encoded_value_array(DexIdx* idx,
+                                              const uint8_t*& encdata) {
+  IdxRefs refs(idx);
+  return decode_array(refs, encdata);
+}
+
 bool DexEncodedValue::is_evtype_primitive() const {
   switch (m_evtype) {
   case DEVT_BYTE:
@@ -397,6 +760,14 @@ DexEncodedValue* DexEncodedValue::zero_for_type(DexType* type) {
 
 DexEncodedValue* DexEncodedValue::get_encoded_value(DexIdx* idx,
                                                     const uint8_t*& encdata) {
+  IdxRefs refs(idx);
+  return decode_value(refs, encdata);
+}
+
+namespace {
+
+template <class Refs>
+DexEncodedValue* decode_value(Refs& refs, const uint8_t*& encdata) {
   uint8_t evhdr = *encdata++;
   DexEncodedValueTypes evt = (DexEncodedValueTypes)DEVT_HDR_TYPE(evhdr);
   uint8_t evarg = DEVT_HDR_ARG(evhdr);
@@ -405,20 +776,20 @@ DexEncodedValue* DexEncodedValue::get_encoded_value(DexIdx* idx,
   case DEVT_INT:
   case DEVT_LONG: {
     uint64_t v = read_evarg(encdata, evarg, true /* sign_extend */);
-    return new DexEncodedValue(evt, v);
+    return new PrimitiveValue(evt, v);
   }
   case DEVT_BYTE:
   case DEVT_CHAR: {
     uint64_t v = read_evarg(encdata, evarg, false /* sign_extend */);
-    return new DexEncodedValue(evt, v);
+    return new PrimitiveValue(evt, v);
   }
   case DEVT_FLOAT: {
     uint64_t v = read_evarg(encdata, evarg, false) << ((3 - evarg) * 8);
-    return new DexEncodedValue(evt, v);
+    return new PrimitiveValue(evt, v);
   }
   case DEVT_DOUBLE: {
     uint64_t v = read_evarg(encdata, evarg, false) << ((7 - evarg) * 8);
-    return new DexEncodedValue(evt, v);
+    return new PrimitiveValue(evt, v);
   }
   case DEVT_NULL:
     return new DexEncodedValueBit(evt, false);
@@ -426,14 +797,14 @@ DexEncodedValue* DexEncodedValue::get_encoded_value(DexIdx* idx,
     return new DexEncodedValueBit(evt, evarg > 0);
   case DEVT_STRING: {
     uint32_t evidx = (uint32_t)read_evarg(encdata, evarg);
-    DexString* evstring = idx->get_stringidx(evidx);
+    DexString* evstring = refs.string(evidx);
     always_assert_log(evstring != nullptr,
                       "Invalid string idx in annotation element");
     return new DexEncodedValueString(evstring);
   }
   case DEVT_TYPE: {
     uint32_t evidx = (uint32_t)read_evarg(encdata, evarg);
-    DexType* evtype = idx->get_typeidx(evidx);
+    DexType* evtype = refs.type(evidx);
     always_assert_log(evtype != nullptr,
                       "Invalid type idx in annotation element");
     return new DexEncodedValueType(evtype);
@@ -441,29 +812,29 @@ DexEncodedValue* DexEncodedValue::get_encoded_value(DexIdx* idx,
   case DEVT_FIELD:
   case DEVT_ENUM: {
     uint32_t evidx = (uint32_t)read_evarg(encdata, evarg);
-    DexFieldRef* evfield = idx->get_fieldidx(evidx);
+    DexFieldRef* evfield = refs.field(evidx);
     always_assert_log(evfield != nullptr,
                       "Invalid field idx in annotation element");
     return new DexEncodedValueField(evt, evfield);
   }
   case DEVT_METHOD: {
     uint32_t evidx = (uint32_t)read_evarg(encdata, evarg);
-    DexMethodRef* evmethod = idx->get_methodidx(evidx);
+    DexMethodRef* evmethod = refs.method(evidx);
     always_assert_log(evmethod != nullptr,
                       "Invalid method idx in annotation element");
     return new DexEncodedValueMethod(evmethod);
   }
   case DEVT_ARRAY:
-    return get_encoded_value_array(idx, encdata);
+    return decode_array(refs, encdata);
   case DEVT_ANNOTATION: {
     EncodedAnnotations* eanno = new EncodedAnnotations();
     uint32_t tidx = read_uleb128(&encdata);
     uint32_t count = read_uleb128(&encdata);
-    DexType* type = idx->get_typeidx(tidx);
+    DexType* type = refs.type(tidx);
     always_assert_log(type != nullptr,
                       "Invalid DEVT_ANNOTATION within annotation type");
     for (uint32_t i = 0; i < count; i++) {
-      DexAnnotationElement dae = get_annotation_element(idx, encdata);
+      DexAnnotationElement dae = decode_element(refs, encdata);
       eanno->push_back(dae);
     }
     return new DexEncodedValueAnnotation(type, eanno);
@@ -472,24 +843,48 @@ DexEncodedValue* DexEncodedValue::get_encoded_value(DexIdx* idx,
   always_assert_log(false, "Bogus annotation");
 }
 
+} // namespace
+
 DexAnnotation* DexAnnotation::get_annotation(DexIdx* idx, uint32_t anno_off) {
   if (anno_off == 0) return nullptr;
   const uint8_t* encdata = idx->get_uleb_data(anno_off);
   uint8_t viz = *encdata++;
   always_assert_log(viz <= DAV_SYSTEM, "Invalid annotation visibility %d", viz);
   uint32_t tidx = read_uleb128(&encdata);
-  uint32_t count = read_uleb128(&encdata);
   DexType* type = idx->get_typeidx(tidx);
   always_assert_log(type != nullptr, "Invalid annotation type");
   DexAnnotation* anno = new DexAnnotation(type, (DexAnnotationVisibility)viz);
+  const uint8_t* elements = encdata;
+  uint32_t count = read_uleb128(&encdata);
+  if (count == 0) {
+    return anno;
+  }
+  std::unique_ptr<Undecoded> undecoded(new Undecoded());
+  RefCollector collector(idx, undecoded->refs);
+  walk_encoded_elements(encdata, count, collector);
+  undecoded->elements.assign(elements, encdata);
+  anno->m_undecoded = std::move(undecoded);
+  anno->m_decode_pending.store(true, std::memory_order_relaxed);
+  return anno;
+}
+
+void DexAnnotation::decode() const {
+  std::lock_guard<std::mutex> guard(decode_lock(this));
+  if (!m_decode_pending.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const uint8_t* encdata = m_undecoded->elements.data();
+  UndecodedRefs refs(m_undecoded->refs.data());
+  uint32_t count = read_uleb128(&encdata);
   for (uint32_t i = 0; i < count; i++) {
-    DexAnnotationElement dae = get_annotation_element(idx, encdata);
-    anno->m_anno_elems.push_back(dae);
+    m_anno_elems.push_back(decode_element(refs, encdata));
   }
-  return anno;
+  m_undecoded.reset();
+  m_decode_pending.store(false, std::memory_order_release);
 }
 
 void DexAnnotation::add_element(const char* key, DexEncodedValue* value) {
+  anno_elems();
   m_anno_elems.emplace_back(DexString::make_string(key), value);
 }
 
@@ -630,8 +1025,8 @@ void DexAnnotationDirectory::gather_annotations(
 void DexAnnotationDirectory::vencode(
     DexOutputIdx* dodx,
     std::vector<uint32_t>& annodirout,
-    std::map<ParamAnnotations*, uint32_t>& xrefmap,
-    std::map<DexAnnotationSet*, uint32_t>& asetmap) {
+    const std::unordered_map<ParamAnnotations*, uint32_t>& xrefmap,
+    const std::unordered_map<DexAnnotationSet*, uint32_t>& asetmap) {
   uint32_t classoff = 0;
   uint32_t cntaf = 0;
   uint32_t cntam = 0;
@@ -640,7 +1035,7 @@ void DexAnnotationDirectory::vencode(
     always_assert_log(asetmap.count(m_class) != 0,
                       "Uninitialized aset %p '%s'",
                       m_class, show(m_class).c_str());
-    classoff = asetmap[m_class];
+    classoff = asetmap.at(m_class);
   }
   if (m_field) {
     cntaf = (uint32_t) m_field->size();
@@ -667,7 +1062,7 @@ void DexAnnotationDirectory::vencode(
       always_assert_log(asetmap.count(das) != 0,
                         "Uninitialized aset %p '%s'",
                         das, show(das).c_str());
-      annodirout.push_back(asetmap[das]);
+      annodirout.push_back(asetmap.at(das));
     }
   }
   if (m_method) {
@@ -680,7 +1075,7 @@ void DexAnnotationDirectory::vencode(
       always_assert_log(asetmap.count(das) != 0,
                         "Uninitialized aset %p '%s'",
                         das, show(das).c_str());
-      annodirout.push_back(asetmap[das]);
+      annodirout.push_back(asetmap.at(das));
     }
   }
   if (m_method_param) {
@@ -692,7 +1087,7 @@ void DexAnnotationDirectory::vencode(
       annodirout.push_back(dodx->methodidx(p.first));
       always_assert_log(
           xrefmap.count(pa) != 0, "Uninitialized ParamAnnotations %p", pa);
-      annodirout.push_back(xrefmap[pa]);
+      annodirout.push_back(xrefmap.at(pa));
     }
   }
 }
@@ -703,9 +1098,10 @@ void DexAnnotationSet::gather_annotations(std::vector<DexAnnotation*>& list) {
   }
 }
 
-void DexAnnotationSet::vencode(DexOutputIdx* dodx,
-                               std::vector<uint32_t>& asetout,
-                               std::map<DexAnnotation*, uint32_t>& annoout) {
+void DexAnnotationSet::vencode(
+    DexOutputIdx* dodx,
+    std::vector<uint32_t>& asetout,
+    const std::unordered_map<DexAnnotation*, uint32_t>& annoout) {
   asetout.push_back((uint32_t)m_annotations.size());
   std::sort(
       m_annotations.begin(), m_annotations.end(), type_annotation_compare);
@@ -714,21 +1110,22 @@ void DexAnnotationSet::vencode(DexOutputIdx* dodx,
                       "Uninitialized annotation %p '%s', bailing\n",
                       anno,
                       show(anno).c_str());
-    asetout.push_back(annoout[anno]);
-  }
-}
-
-static void uleb_append(std::vector<uint8_t>& bytes, uint32_t v) {
-  uint8_t tarray[5];
-  uint8_t* pend = write_uleb128(tarray, v);
-  for (uint8_t* p = tarray; p < pend; p++) {
-    bytes.push_back(*p);
+    asetout.push_back(annoout.at(anno));
   }
 }
 
 void DexAnnotation::vencode(DexOutputIdx* dodx, std::vector<uint8_t>& bytes) {
   bytes.push_back(m_viz);
   uleb_append(bytes, dodx->typeidx(m_type));
+  if (with_undecoded([&](const Undecoded& undecoded) {
+        const uint8_t* encdata = undecoded.elements.data();
+        uint32_t count = read_uleb128(&encdata);
+        uleb_append(bytes, count);
+        RefRenumberer renumberer(undecoded.refs.data(), dodx, bytes);
+        walk_encoded_elements(encdata, count, renumberer);
+      })) {
+    return;
+  }
   uleb_append(bytes, (uint32_t) m_anno_elems.size());
   for (auto elem : m_anno_elems) {
     DexString* string = elem.string;
@@ -9,11 +9,14 @@
 
 #pragma once
 
+#include <atomic>
 #include <boost/functional/hash.hpp>
 #include <deque>
 #include <list>
 #include <map>
+#include <memory>
 #include <sstream>
+#include <unordered_map>
 
 #include "Gatherable.h"
 #include "Show.h"
@@ -331,14 +334,35 @@ class DexEncodedValueAnnotation : public DexEncodedValue {
   std::string show_deobfuscated() const override;
 };
 
+/*
+ * Annotations read from a dex aren't decoded right away: their elements are
+ * kept as the encoded bytes of the dex, along with what those bytes refer to,
+ * until something asks for them with anno_elems() or add_element(). Until
+ * then, the references are gathered from that list, and the elements are
+ * written out by copying the bytes and renumbering the references. Most
+ * annotations are never looked at by any pass, so they never get decoded.
+ */
 class DexAnnotation : public Gatherable {
-  EncodedAnnotations m_anno_elems;
+  struct Undecoded;
+
+  mutable EncodedAnnotations m_anno_elems;
   DexType* m_type;
   DexAnnotationVisibility m_viz;
+  mutable std::unique_ptr<Undecoded> m_undecoded;
+  mutable std::atomic<bool> m_decode_pending{false};
+
+  void decode() const;
+  // Calls fn on the undecoded elements if they haven't been decoded yet,
+  // returning whether it did.
+  template <class Fn>
+  bool with_undecoded(const Fn& fn) const;
 
  public:
-  DexAnnotation(DexType* type, DexAnnotationVisibility viz)
-      : Gatherable(), m_type(type), m_viz(viz) {}
+  DexAnnotation(DexType* type, DexAnnotationVisibility viz);
+  // Copies the elements, decoding those of `that` first. Like the elements,
+  // the encoded values are shared with `that`.
+  DexAnnotation(const DexAnnotation& that);
+  ~DexAnnotation();
 
   static DexAnnotation* get_annotation(DexIdx* idx, uint32_t anno_off);
   void gather_types(std::vector<DexType*>& ltype) const override;
@@ -346,7 +370,15 @@ class DexAnnotation : public Gatherable {
   void gather_methods(std::vector<DexMethodRef*>& lmethod) const override;
   void gather_strings(std::vector<DexString*>& lstring) const override;
 
-  const EncodedAnnotations& anno_elems() const { return m_anno_elems; }
+  const EncodedAnnotations& anno_elems() const {
+    if (m_decode_pending.load(std::memory_order_acquire)) {
+      decode();
+    }
+    return m_anno_elems;
+  }
+  bool is_decode_pending() const {
+    return m_decode_pending.load(std::memory_order_acquire);
+  }
   void set_type(DexType* type) { m_type = type; }
   DexType* type() const { return m_type; }
   DexAnnotationVisibility viz() const { return m_viz; }
@@ -393,7 +425,7 @@ class DexAnnotationSet : public Gatherable {
   }
   void vencode(DexOutputIdx* dodx,
                std::vector<uint32_t>& asetout,
-               std::map<DexAnnotation*, uint32_t>& annoout);
+               const std::unordered_map<DexAnnotation*, uint32_t>& annoout);
   void gather_annotations(std::vector<DexAnnotation*>& alist);
 };
 
@@ -470,8 +502,8 @@ class DexAnnotationDirectory {
   void gather_xrefs(std::vector<ParamAnnotations*>& xrefs);
   void vencode(DexOutputIdx* dodx,
                std::vector<uint32_t>& annodirout,
-               std::map<ParamAnnotations*, uint32_t>& xrefmap,
-               std::map<DexAnnotationSet*, uint32_t>& asetmap);
+               const std::unordered_map<ParamAnnotations*, uint32_t>& xrefmap,
+               const std::unordered_map<DexAnnotationSet*, uint32_t>& asetmap);
 
   friend std::string show(const DexAnnotationDirectory*);
 };
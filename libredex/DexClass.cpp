@@ -38,8 +38,8 @@ uint32_t DexString::length() const {
 
 int DexTypeList::encode(DexOutputIdx* dodx, uint32_t* output) {
   uint16_t* typep = (uint16_t*)(output + 1);
-  *output = (uint32_t) m_list.size();
-  for (auto const& type : m_list) {
+  *output = m_size;
+  for (auto const& type : get_type_list()) {
     *typep++ = dodx->typeidx(type);
   }
   return (int) (((uint8_t*)typep) - (uint8_t*)output);
@@ -136,8 +136,107 @@ static std::vector<DexDebugEntry> eval_debug_instructions(
   return entries;
 }
 
+namespace {
+
+/*
+ * Walks an encoded debug_info_item, handing `visitor` every field in order:
+ * the header and opcode operands as plain integers, and the string and type
+ * indices as the entities they stand for. Returns the end of the item.
+ */
+template <typename Visitor>
+const uint8_t* walk_encoded_debug_item(DexIdx* idx,
+                                       const uint8_t* encdata,
+                                       Visitor& visitor) {
+  auto string = [&]() {
+    visitor.string(decode_noindexable_string(idx, encdata));
+  };
+  auto type = [&]() { visitor.type(decode_noindexable_type(idx, encdata)); };
+  visitor.uleb(read_uleb128(&encdata)); // line_start
+  uint32_t paramcount = read_uleb128(&encdata);
+  visitor.uleb(paramcount);
+  while (paramcount--) {
+    string();
+  }
+  while (true) {
+    uint8_t opcode = *encdata++;
+    visitor.opcode(opcode);
+    switch (opcode) {
+    case DBG_END_SEQUENCE:
+      return encdata;
+    case DBG_ADVANCE_PC:
+    case DBG_END_LOCAL:
+    case DBG_RESTART_LOCAL:
+      visitor.uleb(read_uleb128(&encdata));
+      break;
+    case DBG_ADVANCE_LINE:
+      visitor.sleb(read_sleb128(&encdata));
+      break;
+    case DBG_START_LOCAL:
+    case DBG_START_LOCAL_EXTENDED:
+      visitor.uleb(read_uleb128(&encdata));
+      string();
+      type();
+      if (opcode == DBG_START_LOCAL_EXTENDED) {
+        string();
+      }
+      break;
+    case DBG_SET_FILE:
+      string();
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+struct DebugItemSkipper {
+  void uleb(uint32_t) {}
+  void sleb(int32_t) {}
+  void opcode(uint8_t) {}
+  void string(DexString*) {}
+  void type(DexType*) {}
+};
+
+struct DebugItemGatherer {
+  std::vector<DexString*>* strings;
+  std::vector<DexType*>* types;
+  void uleb(uint32_t) {}
+  void sleb(int32_t) {}
+  void opcode(uint8_t) {}
+  void string(DexString* str) {
+    if (strings && str) strings->push_back(str);
+  }
+  void type(DexType* t) {
+    if (types && t) types->push_back(t);
+  }
+};
+
+// Writes the item out again as it was, only with the indices of the output.
+struct DebugItemWriter {
+  DexOutputIdx* dodx;
+  uint8_t* out;
+  void uleb(uint32_t v) { out = write_uleb128(out, v); }
+  void sleb(int32_t v) { out = write_sleb128(out, v); }
+  void opcode(uint8_t op) { *out++ = op; }
+  void string(DexString* str) {
+    out = write_uleb128p1(out, str ? dodx->stringidx(str) : DEX_NO_INDEX);
+  }
+  void type(DexType* t) {
+    out = write_uleb128p1(out, t ? dodx->typeidx(t) : DEX_NO_INDEX);
+  }
+};
+
+} // namespace
+
 DexDebugItem::DexDebugItem(DexIdx* idx, uint32_t offset) {
-  const uint8_t* encdata = idx->get_uleb_data(offset);
+  decode(idx, idx->get_uleb_data(offset));
+}
+
+DexDebugItem::DexDebugItem(std::vector<uint8_t> encoded,
+                           std::shared_ptr<DexIdx> idx)
+    : m_encoded(std::move(encoded)), m_idx(std::move(idx)) {}
+
+void DexDebugItem::decode(DexIdx* idx, const uint8_t* encdata) {
   uint32_t line_start = read_uleb128(&encdata);
   uint32_t paramcount = read_uleb128(&encdata);
   while (paramcount--) {
@@ -153,8 +252,22 @@ DexDebugItem::DexDebugItem(DexIdx* idx, uint32_t offset) {
   m_dbg_entries = eval_debug_instructions(this, insns, line_start);
 }
 
-uint32_t DexDebugItem::get_line_start() const {
-  for (auto& entry : m_dbg_entries) {
+void DexDebugItem::ensure_decoded() {
+  if (is_decoded()) {
+    return;
+  }
+  std::call_once(m_decoded, [this]() {
+    decode(m_idx.get(), m_encoded.data());
+    std::vector<uint8_t>().swap(m_encoded);
+    m_idx.reset();
+    if (m_method) {
+      bind_positions(m_method, m_file);
+    }
+  });
+}
+
+uint32_t DexDebugItem::get_line_start() {
+  for (auto& entry : get_entries()) {
     switch (entry.type) {
       case DexDebugEntryType::Position: {
         return entry.pos->line;
@@ -167,7 +280,11 @@ uint32_t DexDebugItem::get_line_start() const {
 }
 
 DexDebugItem::DexDebugItem(const DexDebugItem& that)
-    : m_param_names(that.m_param_names) {
+    : m_param_names(that.m_param_names),
+      m_encoded(that.m_encoded),
+      m_idx(that.m_idx),
+      m_method(that.m_method),
+      m_file(that.m_file) {
   std::unordered_map<DexPosition*, DexPosition*> pos_map;
   for (auto& entry : that.m_dbg_entries) {
     switch (entry.type) {
@@ -188,6 +305,19 @@ DexDebugItem::DexDebugItem(const DexDebugItem& that)
 std::unique_ptr<DexDebugItem> DexDebugItem::get_dex_debug(DexIdx* idx,
                                                           uint32_t offset) {
   if (offset == 0) return nullptr;
+  switch (RedexContext::debug_info_loading()) {
+  case RedexContext::DebugInfoLoading::Drop:
+    return nullptr;
+  case RedexContext::DebugInfoLoading::Defer: {
+    auto begin = idx->get_uleb_data(offset);
+    DebugItemSkipper skipper;
+    auto end = walk_encoded_debug_item(idx, begin, skipper);
+    return std::unique_ptr<DexDebugItem>(new DexDebugItem(
+        std::vector<uint8_t>(begin, end), idx->shared_from_this()));
+  }
+  case RedexContext::DebugInfoLoading::Decode:
+    break;
+  }
   return std::unique_ptr<DexDebugItem>(new DexDebugItem(idx, offset));
 }
 
@@ -276,6 +406,15 @@ std::vector<std::unique_ptr<DexDebugInstruction>> generate_debug_instructions(
 
 int DexDebugItem::encode(DexOutputIdx* dodx, PositionMapper* pos_mapper,
     uint8_t* output) {
+  if (!is_decoded() && m_file != nullptr && pos_mapper->keeps_lines()) {
+    // Nothing about the positions changes, so the item can be copied through
+    // as it was loaded. (Positions without a file are dropped by the
+    // encoding below, which needs them decoded.)
+    DebugItemWriter writer{dodx, output};
+    walk_encoded_debug_item(m_idx.get(), m_encoded.data(), writer);
+    return (int) (writer.out - output);
+  }
+  ensure_decoded();
   uint8_t* encdata = output;
   uint32_t line_start{0};
   auto dbgops =
@@ -298,6 +437,11 @@ int DexDebugItem::encode(DexOutputIdx* dodx, PositionMapper* pos_mapper,
 }
 
 void DexDebugItem::bind_positions(DexMethod* method, DexString* file) {
+  if (!is_decoded()) {
+    m_method = method;
+    m_file = file;
+    return;
+  }
   for (auto& entry : m_dbg_entries) {
     switch (entry.type) {
     case DexDebugEntryType::Position:
@@ -310,12 +454,22 @@ void DexDebugItem::bind_positions(DexMethod* method, DexString* file) {
 }
 
 void DexDebugItem::gather_types(std::vector<DexType*>& ltype) const {
+  if (!is_decoded()) {
+    DebugItemGatherer gatherer{nullptr, &ltype};
+    walk_encoded_debug_item(m_idx.get(), m_encoded.data(), gatherer);
+    return;
+  }
   for (auto& entry : m_dbg_entries) {
     entry.gather_types(ltype);
   }
 }
 
 void DexDebugItem::gather_strings(std::vector<DexString*>& lstring) const {
+  if (!is_decoded()) {
+    DebugItemGatherer gatherer{&lstring, nullptr};
+    walk_encoded_debug_item(m_idx.get(), m_encoded.data(), gatherer);
+    return;
+  }
   for (auto p : m_param_names) {
     if (p) lstring.push_back(p);
   }
@@ -465,6 +619,10 @@ DexMethod::DexMethod(DexType* type, DexString* name, DexProto* proto)
 DexMethod::~DexMethod() = default;
 
 void DexMethod::set_code(std::unique_ptr<IRCode> code) {
+  if (m_balloon_pending) {
+    m_dex_code.reset();
+    m_balloon_pending = false;
+  }
   m_code = std::move(code);
 }
 
@@ -472,6 +630,35 @@ void DexMethod::balloon() {
   assert(m_code == nullptr);
   m_code = std::make_unique<IRCode>(this);
   m_dex_code.reset();
+  m_balloon_pending = false;
+}
+
+void DexMethod::defer_balloon() {
+  assert(m_code == nullptr);
+  if (m_dex_code) {
+    m_balloon_pending = true;
+  }
+}
+
+namespace {
+
+// Ballooning on demand only needs to exclude another thread ballooning the
+// same method, so a small set of striped locks is plenty.
+constexpr size_t BALLOON_LOCK_STRIPES = 127;
+std::mutex s_balloon_locks[BALLOON_LOCK_STRIPES];
+
+} // namespace
+
+void DexMethod::balloon_on_demand() {
+  auto& lock = s_balloon_locks[std::hash<DexMethod*>()(this) %
+                               BALLOON_LOCK_STRIPES];
+  std::lock_guard<std::mutex> guard(lock);
+  if (!m_balloon_pending.load(std::memory_order_relaxed)) {
+    return;
+  }
+  m_code = std::make_unique<IRCode>(this);
+  m_dex_code.reset();
+  m_balloon_pending.store(false, std::memory_order_release);
 }
 
 void DexMethod::sync() {
@@ -564,6 +751,32 @@ void DexClass::remove_method(const DexMethod* m) {
   assert(erased);
 }
 
+namespace {
+
+template <class Member>
+size_t remove_members(std::vector<Member*>& members,
+                      const std::unordered_set<const Member*>& to_remove) {
+  auto size = members.size();
+  members.erase(std::remove_if(members.begin(),
+                               members.end(),
+                               [&](const Member* m) {
+                                 return to_remove.count(m) != 0;
+                               }),
+                members.end());
+  return size - members.size();
+}
+
+} // namespace
+
+size_t DexClass::remove_methods(
+    const std::unordered_set<const DexMethod*>& methods) {
+  if (methods.empty()) {
+    return 0;
+  }
+  return remove_members(m_dmethods, methods) +
+         remove_members(m_vmethods, methods);
+}
+
 void DexMethod::become_virtual() {
   assert(!m_virtual);
   m_virtual = true;
@@ -587,6 +800,10 @@ void DexMethod::make_concrete(DexAccessFlags access,
                               std::unique_ptr<IRCode> dc,
                               bool is_virtual) {
   m_access = access;
+  if (m_balloon_pending) {
+    m_dex_code.reset();
+    m_balloon_pending = false;
+  }
   m_code = std::move(dc);
   m_concrete = true;
   m_virtual = is_virtual;
@@ -600,6 +817,10 @@ void DexMethod::make_concrete(DexAccessFlags access,
 void DexMethod::make_non_concrete() {
   m_access = static_cast<DexAccessFlags>(0);
   m_concrete = false;
+  if (m_balloon_pending) {
+    m_dex_code.reset();
+    m_balloon_pending = false;
+  }
   m_code.reset();
   m_virtual = false;
   m_param_anno.clear();
@@ -672,7 +893,10 @@ void DexClass::load_class_data_item(DexIdx* idx,
   }
 }
 
-std::unique_ptr<IRCode> DexMethod::release_code() { return std::move(m_code); }
+std::unique_ptr<IRCode> DexMethod::release_code() {
+  get_code();
+  return std::move(m_code);
+}
 
 void DexClass::add_method(DexMethod* m) {
   always_assert_log(m->is_concrete() || m->is_external(),
@@ -711,6 +935,13 @@ void DexClass::remove_field(const DexField* f) {
   assert(erase);
 }
 
+size_t DexClass::remove_fields(
+    const std::unordered_set<const DexField*>& fields) {
+  if (fields.empty()) {
+    return 0;
+  }
+  return remove_members(m_sfields, fields) + remove_members(m_ifields, fields);
+}
 
 void DexClass::sort_fields() {
   auto& sfields = this->get_sfields();
@@ -956,9 +1187,8 @@ DexClass::DexClass(DexIdx* idx,
 }
 
 void DexTypeList::gather_types(std::vector<DexType*>& ltype) const {
-  for (auto const& type : m_list) {
-    ltype.push_back(type);
-  }
+  auto types = get_type_list();
+  ltype.insert(ltype.end(), types.begin(), types.end());
 }
 
 static DexString* make_shorty(DexType* rtype, DexTypeList* args) {
@@ -1098,6 +1328,7 @@ void DexField::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
 void DexMethod::gather_types(std::vector<DexType*>& ltype) const {
   // We handle m_spec.cls and proto in the first-layer gather.
   if (m_code) m_code->gather_types(ltype);
+  if (is_balloon_pending()) m_dex_code->gather_types(ltype);
   if (m_anno) m_anno->gather_types(ltype);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1111,6 +1342,7 @@ void DexMethod::gather_types(std::vector<DexType*>& ltype) const {
 void DexMethod::gather_strings(std::vector<DexString*>& lstring) const {
   // We handle m_name and proto in the first-layer gather.
   if (m_code) m_code->gather_strings(lstring);
+  if (is_balloon_pending()) m_dex_code->gather_strings(lstring);
   if (m_anno) m_anno->gather_strings(lstring);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1123,6 +1355,7 @@ void DexMethod::gather_strings(std::vector<DexString*>& lstring) const {
 
 void DexMethod::gather_fields(std::vector<DexFieldRef*>& lfield) const {
   if (m_code) m_code->gather_fields(lfield);
+  if (is_balloon_pending()) m_dex_code->gather_fields(lfield);
   if (m_anno) m_anno->gather_fields(lfield);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1135,6 +1368,7 @@ void DexMethod::gather_fields(std::vector<DexFieldRef*>& lfield) const {
 
 void DexMethod::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
   if (m_code) m_code->gather_methods(lmethod);
+  if (is_balloon_pending()) m_dex_code->gather_methods(lmethod);
   if (m_anno) m_anno->gather_methods(lmethod);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1165,3 +1399,35 @@ uint32_t DexCode::size() const {
   }
   return size;
 }
+
+void DexCode::gather_types(std::vector<DexType*>& ltype) const {
+  for (auto const& insn : get_instructions()) {
+    insn->gather_types(ltype);
+  }
+  for (auto const& dextry : m_tries) {
+    for (auto const& cit : dextry->m_catches) {
+      if (cit.first != nullptr) {
+        ltype.push_back(cit.first);
+      }
+    }
+  }
+}
+
+void DexCode::gather_strings(std::vector<DexString*>& lstring) const {
+  for (auto const& insn : get_instructions()) {
+    insn->gather_strings(lstring);
+  }
+  if (m_dbg) m_dbg->gather_strings(lstring);
+}
+
+void DexCode::gather_fields(std::vector<DexFieldRef*>& lfield) const {
+  for (auto const& insn : get_instructions()) {
+    insn->gather_fields(lfield);
+  }
+}
+
+void DexCode::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
+  for (auto const& insn : get_instructions()) {
+    insn->gather_methods(lmethod);
+  }
+}
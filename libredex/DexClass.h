@@ -9,15 +9,21 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <functional>
 #include <initializer_list>
+#include <iterator>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <unordered_set>
 
 #include "DexAccess.h"
 #include "DexAnnotation.h"
@@ -26,6 +32,7 @@
 #include "DexIdx.h"
 #include "DexInstruction.h"
 #include "DexPosition.h"
+#include "ObjectCensus.h"
 #include "RedexContext.h"
 #include "ReferencedState.h"
 #include "Show.h"
@@ -65,11 +72,12 @@ std::string proguard_name(const DexClass* cls);
 std::string proguard_name(const DexMethodRef* method);
 std::string proguard_name(const DexFieldRef* field);
 
-class DexString {
+class DexString : public census::Counted<census::DEX_STRING> {
   friend struct RedexContext;
 
   std::string m_storage;
   uint32_t m_utfsize;
+  uint32_t m_id{0};
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   DexString(std::string nstr, uint32_t utfsize) :
@@ -79,6 +87,9 @@ class DexString {
  public:
   uint32_t size() const { return static_cast<uint32_t>(m_storage.size()); }
 
+  // Dense among the DexStrings, see IdTable.h.
+  uint32_t id() const { return m_id; }
+
   // UTF-aware length
   uint32_t length() const;
 
@@ -128,29 +139,40 @@ class DexString {
   }
 };
 
-/* Non-optimizing DexSpec compliant ordering */
+/* DexSpec compliant ordering */
 inline bool compare_dexstrings(const DexString* a, const DexString* b) {
   if (a == nullptr) {
     return b != nullptr;
   } else if (b == nullptr) {
     return false;
   }
-  if (a->is_simple() && b->is_simple())
-    return (strcmp(a->c_str(), b->c_str()) < 0);
-  /*
-   * Bother, need to do code-point character-by-character
-   * comparison.
-   */
   const char* sa = a->c_str();
   const char* sb = b->c_str();
-  /* Equivalence test first, so we don't worry about walking
-   * off the end.
+  auto size = std::min(a->size(), b->size());
+  // The terminating NUL sorts the shorter of two ASCII strings first.
+  if (a->is_simple() && b->is_simple()) {
+    return memcmp(sa, sb, size + 1) < 0;
+  }
+  /*
+   * Bother, need to do code-point character-by-character
+   * comparison, but only from where the strings start to differ.
    */
-  if (strcmp(sa, sb) == 0) return false;
-  if (strlen(sa) == 0) {
+  size_t i = mismatch_index(sa, sb, size + 1);
+  if (i > size) return false;
+  // Back up to the first byte of the code point.
+  auto is_continuation = [](char c) {
+    return (static_cast<uint8_t>(c) & 0xc0) == 0x80;
+  };
+  while (i > 0 && (is_continuation(sa[i]) || is_continuation(sb[i]))) {
+    --i;
+  }
+  sa += i;
+  sb += i;
+  /* Don't walk off the end, nor take the end for an encoded U+0000. */
+  if (*sa == '\0') {
     return true;
   }
-  if (strlen(sb) == 0) {
+  if (*sb == '\0') {
     return false;
   }
   while (1) {
@@ -171,10 +193,11 @@ struct dexstrings_comparator {
   }
 };
 
-class DexType {
+class DexType : public census::Counted<census::DEX_TYPE> {
   friend struct RedexContext;
 
   DexString* m_name;
+  uint32_t m_id{0};
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   DexType(DexString* dstring) {
@@ -182,6 +205,9 @@ class DexType {
   }
 
  public:
+  // Dense among the DexTypes, see IdTable.h.
+  uint32_t id() const { return m_id; }
+
   // DexType retrieval/creation
 
   // If the DexType exists, return it, otherwise create it and return it.
@@ -254,6 +280,7 @@ class DexFieldRef {
   DexFieldSpec m_spec;
   bool m_concrete;
   bool m_external;
+  uint32_t m_id{0};
 
   ~DexFieldRef() {}
   DexFieldRef(DexType* container, DexString* name, DexType* type) {
@@ -274,6 +301,9 @@ class DexFieldRef {
    const char* c_str() const { return get_name()->c_str(); }
    DexType* get_type() const { return m_spec.type; }
 
+   // Dense among the field references, see IdTable.h.
+   uint32_t id() const { return m_id; }
+
    void gather_types_shallow(std::vector<DexType*>& ltype) const;
    void gather_strings_shallow(std::vector<DexString*>& lstring) const;
 
@@ -417,14 +447,73 @@ struct dexfields_comparator {
 class DexTypeList {
   friend struct RedexContext;
 
-  std::deque<DexType*> m_list;
+  // The types are stored right after the object, in the RedexContext arena,
+  // so a list takes a single allocation whatever its size.
+  size_t m_hash;
+  uint32_t m_size;
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
-  DexTypeList(std::deque<DexType*>&& p) {
-    m_list = std::move(p);
+  DexTypeList(DexType* const* types, uint32_t size, size_t hash)
+      : m_hash(hash), m_size(size) {
+    std::copy(types, types + size, storage());
+  }
+
+  DexTypeList(const DexTypeList&) = delete;
+  DexTypeList& operator=(const DexTypeList&) = delete;
+
+  DexType** storage() { return reinterpret_cast<DexType**>(this + 1); }
+  DexType* const* storage() const {
+    return reinterpret_cast<DexType* const*>(this + 1);
   }
 
  public:
+  /*
+   * A read-only view of the types of a list. It converts to a std::deque for
+   * the callers that edit a copy to make a new list.
+   */
+  class Types {
+    DexType* const* m_begin;
+    uint32_t m_size;
+
+   public:
+    using value_type = DexType*;
+    using const_iterator = DexType* const*;
+    using iterator = const_iterator;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    using reverse_iterator = const_reverse_iterator;
+    using size_type = size_t;
+
+    Types(DexType* const* begin, uint32_t size)
+        : m_begin(begin), m_size(size) {}
+
+    const_iterator begin() const { return m_begin; }
+    const_iterator end() const { return m_begin + m_size; }
+    const_reverse_iterator rbegin() const {
+      return const_reverse_iterator(end());
+    }
+    const_reverse_iterator rend() const {
+      return const_reverse_iterator(begin());
+    }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    DexType* operator[](size_t i) const { return m_begin[i]; }
+    DexType* at(size_t i) const {
+      always_assert_log(i < m_size, "Type list index %zu out of range", i);
+      return m_begin[i];
+    }
+    DexType* front() const { return at(0); }
+    DexType* back() const { return at(m_size - 1); }
+
+    operator std::deque<DexType*>() const {
+      return std::deque<DexType*>(begin(), end());
+    }
+
+    friend bool operator==(const Types& a, const Types& b) {
+      return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+    }
+    friend bool operator!=(const Types& a, const Types& b) { return !(a == b); }
+  };
+
   // DexTypeList retrieval/creation
 
   // If the DexTypeList exists, return it, otherwise create it and return it.
@@ -439,11 +528,9 @@ class DexTypeList {
   }
 
  public:
-  const std::deque<DexType*>& get_type_list() const { return m_list; }
+  Types get_type_list() const { return Types(storage(), m_size); }
 
-  size_t size() const {
-    return get_type_list().size();
-  }
+  size_t size() const { return m_size; }
 
   /**
    * Returns size of the encoded typelist in bytes, input
@@ -452,11 +539,13 @@ class DexTypeList {
   int encode(DexOutputIdx* dodx, uint32_t* output);
 
   friend bool operator<(const DexTypeList& a, const DexTypeList& b) {
-    auto ita = a.m_list.begin();
-    auto itb = b.m_list.begin();
+    auto ita = a.storage();
+    auto itb = b.storage();
+    auto enda = ita + a.m_size;
+    auto endb = itb + b.m_size;
     while (1) {
-      if (itb == b.m_list.end()) return false;
-      if (ita == a.m_list.end()) return true;
+      if (itb == endb) return false;
+      if (ita == enda) return true;
       if (*ita != *itb) {
         const DexType* ta = *ita;
         const DexType* tb = *itb;
@@ -485,7 +574,7 @@ struct dextypelists_comparator {
   }
 };
 
-class DexProto {
+class DexProto : public census::Counted<census::DEX_PROTO> {
   friend struct RedexContext;
 
   DexTypeList* m_args;
@@ -586,7 +675,19 @@ struct DexDebugEntry final {
 class DexDebugItem {
   std::vector<DexString*> m_param_names;
   std::vector<DexDebugEntry> m_dbg_entries;
+  // While decoding is deferred (see RedexContext::DebugInfoLoading), the
+  // encoded item and the DexIdx its string and type indices refer to.
+  std::vector<uint8_t> m_encoded;
+  std::shared_ptr<DexIdx> m_idx;
+  // What bind_positions() was called with, to bind the positions with once
+  // they are decoded.
+  DexMethod* m_method{nullptr};
+  DexString* m_file{nullptr};
+  std::once_flag m_decoded;
   DexDebugItem(DexIdx* idx, uint32_t offset);
+  DexDebugItem(std::vector<uint8_t> encoded, std::shared_ptr<DexIdx> idx);
+  void decode(DexIdx* idx, const uint8_t* encdata);
+  void ensure_decoded();
 
  public:
   DexDebugItem() = default;
@@ -595,14 +696,25 @@ class DexDebugItem {
                                                      uint32_t offset);
 
  public:
-  std::vector<DexDebugEntry>& get_entries() { return m_dbg_entries; }
+  std::vector<DexDebugEntry>& get_entries() {
+    ensure_decoded();
+    return m_dbg_entries;
+  }
   void set_entries(std::vector<DexDebugEntry> dbg_entries) {
+    ensure_decoded();
     m_dbg_entries.swap(dbg_entries);
   }
-  uint32_t get_line_start() const;
-  std::vector<DexString*>& get_param_names() { return m_param_names; }
-  void remove_parameter_names() { m_param_names.clear(); };
+  uint32_t get_line_start();
+  std::vector<DexString*>& get_param_names() {
+    ensure_decoded();
+    return m_param_names;
+  }
+  void remove_parameter_names() {
+    ensure_decoded();
+    m_param_names.clear();
+  };
   void bind_positions(DexMethod* method, DexString* file);
+  bool is_decoded() const { return m_idx == nullptr; }
 
   /* Returns number of bytes encoded, *output has no alignment requirements */
   int encode(DexOutputIdx* dodx, PositionMapper* pos_mapper, uint8_t* output);
@@ -706,6 +818,11 @@ class DexCode {
    */
   uint32_t size() const;
 
+  void gather_types(std::vector<DexType*>& ltype) const;
+  void gather_strings(std::vector<DexString*>& lstring) const;
+  void gather_fields(std::vector<DexFieldRef*>& lfield) const;
+  void gather_methods(std::vector<DexMethodRef*>& lmethod) const;
+
   friend std::string show(const DexCode*);
 };
 
@@ -732,6 +849,7 @@ class DexMethodRef {
   DexMethodSpec m_spec;
   bool m_concrete;
   bool m_external;
+  uint32_t m_id{0};
 
   ~DexMethodRef() {}
   DexMethodRef(DexType* type, DexString* name, DexProto* proto) :
@@ -750,6 +868,9 @@ class DexMethodRef {
    const char* c_str() const { return get_name()->c_str(); }
    DexProto* get_proto() const { return m_spec.proto; }
 
+   // Dense among the method references, see IdTable.h.
+   uint32_t id() const { return m_id; }
+
    void gather_types_shallow(std::vector<DexType*>& ltype) const;
    void gather_strings_shallow(std::vector<DexString*>& lstring) const;
 
@@ -765,6 +886,8 @@ class DexMethod : public DexMethodRef {
   DexAnnotationSet* m_anno;
   std::unique_ptr<DexCode> m_dex_code;
   std::unique_ptr<IRCode> m_code;
+  // Set while m_dex_code is waiting to be ballooned on first get_code().
+  std::atomic<bool> m_balloon_pending{false};
   DexAccessFlags m_access;
   bool m_virtual;
   ParamAnnotations m_param_anno;
@@ -850,8 +973,15 @@ class DexMethod : public DexMethodRef {
   DexAnnotationSet* get_anno_set() { return m_anno; }
   const DexCode* get_dex_code() const { return m_dex_code.get(); }
   DexCode* get_dex_code() { return m_dex_code.get(); }
-  IRCode* get_code() { return m_code.get(); }
-  const IRCode* get_code() const { return m_code.get(); }
+  IRCode* get_code() {
+    if (m_balloon_pending.load(std::memory_order_acquire)) {
+      balloon_on_demand();
+    }
+    return m_code.get();
+  }
+  const IRCode* get_code() const {
+    return const_cast<DexMethod*>(this)->get_code();
+  }
   std::unique_ptr<IRCode> release_code();
   bool is_virtual() const { return m_virtual; }
   DexAccessFlags get_access() const {
@@ -906,6 +1036,7 @@ class DexMethod : public DexMethodRef {
   }
   void set_dex_code(std::unique_ptr<DexCode> code) {
     m_dex_code = std::move(code);
+    m_balloon_pending = false;
   }
   void set_code(std::unique_ptr<IRCode> code);
 
@@ -950,9 +1081,21 @@ class DexMethod : public DexMethodRef {
    *
    * Most operations can and should use IRCode. Optimizations should never
    * have to call sync().
+   *
+   * defer_balloon() leaves the DexCode in place and converts it the first time
+   * get_code() is called, from whichever thread gets there first. A method
+   * whose code is never looked at keeps its original DexCode, which the
+   * output phase then writes out as-is.
    */
   void balloon();
+  void defer_balloon();
+  bool is_balloon_pending() const {
+    return m_balloon_pending.load(std::memory_order_acquire);
+  }
   void sync();
+
+ private:
+  void balloon_on_demand();
 };
 
 using dexcode_to_offset = std::unordered_map<DexCode*, uint32_t>;
@@ -1028,6 +1171,9 @@ class DexClass {
   void add_method(DexMethod* m);
   // Removes the method from this class
   void remove_method(const DexMethod* m);
+  // Removes all the given methods that are in this class at once, compacting
+  // each method list a single time. Returns the number of methods removed.
+  size_t remove_methods(const std::unordered_set<const DexMethod*>& methods);
   const std::vector<DexField*>& get_sfields() const { return m_sfields; }
   std::vector<DexField*>& get_sfields() { assert(!m_external); return m_sfields; }
   const std::vector<DexField*>& get_ifields() const { return m_ifields; }
@@ -1035,6 +1181,9 @@ class DexClass {
   void add_field(DexField* f);
   // Removes the field from this class
   void remove_field(const DexField* f);
+  // Removes all the given fields that are in this class at once, compacting
+  // each field list a single time. Returns the number of fields removed.
+  size_t remove_fields(const std::unordered_set<const DexField*>& fields);
   DexField* find_field(const char* name, const DexType* field_type) const;
 
   DexAnnotationDirectory* get_annotation_directory();
@@ -13,6 +13,7 @@
 
 #include "DexDefs.h"
 #include "Gatherable.h"
+#include "ObjectCensus.h"
 #include "Util.h"
 
 class DexIdx;
@@ -20,7 +21,9 @@ class DexOutputIdx;
 class DexString;
 class DexType;
 
-class DexDebugInstruction : public Gatherable {
+class DexDebugInstruction
+    : public Gatherable,
+      public census::Counted<census::DEX_DEBUG_INSTRUCTION> {
  private:
   union {
     uint32_t m_uvalue;
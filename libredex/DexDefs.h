@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "Debug.h"
 #include "Util.h"
@@ -215,11 +216,51 @@ inline uint32_t mutf8_next_code_point(const char*& s) {
   always_assert_log(false, "Invalid size encoding mutf8 string");
 }
 
+/*
+ * The number of leading ASCII bytes among the first `size` bytes of `s`.
+ * Nearly all the strings of an app are pure ASCII, so this looks at eight
+ * bytes at a time.
+ */
+inline size_t ascii_prefix_length(const char* s, size_t size) {
+  const uint64_t high_bits = 0x8080808080808080ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, s + i, sizeof(word));
+    if (word & high_bits) break;
+  }
+  while (i < size && !(static_cast<uint8_t>(s[i]) & 0x80)) {
+    ++i;
+  }
+  return i;
+}
+
+/*
+ * The index of the first of the `size` bytes at which `a` and `b` differ, or
+ * `size` if they don't. Looks at eight bytes at a time.
+ */
+inline size_t mismatch_index(const char* a, const char* b, size_t size) {
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word_a, word_b;
+    memcpy(&word_a, a + i, sizeof(word_a));
+    memcpy(&word_b, b + i, sizeof(word_b));
+    if (word_a != word_b) break;
+  }
+  while (i < size && a[i] == b[i]) {
+    ++i;
+  }
+  return i;
+}
+
 inline uint32_t length_of_utf8_string(const char* s) {
   if (s == nullptr) {
     return 0;
   }
-  uint32_t len = 0;
+  // Each ASCII byte is a code point of its own.
+  auto ascii = ascii_prefix_length(s, strlen(s));
+  uint32_t len = ascii;
+  s += ascii;
   while (*s != '\0') {
     ++len;
     mutf8_next_code_point(s);
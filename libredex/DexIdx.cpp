@@ -9,6 +9,7 @@
 
 #include "DexIdx.h"
 
+#include <algorithm>
 #include <sstream>
 
 #include "DexClass.h"
@@ -19,26 +20,26 @@
     #TYPE " section offset out of range");                              \
   m_##TYPE##_ids = (dex_##TYPE##_id*)(m_dexbase + dh->TYPE##_ids_off);  \
   m_##TYPE##_ids_size = dh->TYPE##_ids_size;                            \
-  m_##TYPE##_cache = (CACHETYPE*)calloc(dh->TYPE##_ids_size, sizeof(CACHETYPE))
+  m_##TYPE##_cache = new CACHETYPE[dh->TYPE##_ids_size]()
 
 DexIdx::DexIdx(const dex_header* dh) {
   m_dexbase = (const uint8_t*)dh;
   INIT_DMAP_ID(string, DexString*);
   INIT_DMAP_ID(type, DexType*);
-  INIT_DMAP_ID(field, DexFieldRef*);
-  INIT_DMAP_ID(method, DexMethodRef*);
-  INIT_DMAP_ID(proto, DexProto*);
+  INIT_DMAP_ID(field, std::atomic<DexFieldRef*>);
+  INIT_DMAP_ID(method, std::atomic<DexMethodRef*>);
+  INIT_DMAP_ID(proto, std::atomic<DexProto*>);
 }
 
 DexIdx::~DexIdx() {
-  free(m_string_cache);
-  free(m_type_cache);
-  free(m_field_cache);
-  free(m_method_cache);
-  free(m_proto_cache);
+  delete[] m_string_cache;
+  delete[] m_type_cache;
+  delete[] m_field_cache;
+  delete[] m_method_cache;
+  delete[] m_proto_cache;
 }
 
-DexString* DexIdx::get_stringidx_fromdex(uint32_t stridx) {
+const char* DexIdx::get_string_data(uint32_t stridx, uint32_t* utfsize) const {
   assert(stridx < m_string_ids_size);
   uint32_t stroff = m_string_ids[stridx].offset;
   always_assert_log(
@@ -46,15 +47,42 @@ DexString* DexIdx::get_stringidx_fromdex(uint32_t stridx) {
     "String data offset out of range");
   const uint8_t* dstr = m_dexbase + stroff;
   /* Strip off uleb128 size encoding */
-  int utfsize = read_uleb128(&dstr);
-  return DexString::make_string((const char*)dstr, utfsize);
+  *utfsize = read_uleb128(&dstr);
+  return (const char*)dstr;
 }
 
-DexType* DexIdx::get_typeidx_fromdex(uint32_t typeidx) {
-  assert(typeidx < m_type_ids_size);
-  uint32_t stridx = m_type_ids[typeidx].string_idx;
-  DexString* dexstr = get_stringidx(stridx);
-  return DexType::make_type(dexstr);
+void DexIdx::load_strings_and_types(const std::vector<DexIdx*>& idxs) {
+  std::vector<std::pair<const char*, uint32_t>> strs;
+  for (auto idx : idxs) {
+    for (uint32_t i = 0; i < idx->m_string_ids_size; i++) {
+      uint32_t utfsize;
+      auto data = idx->get_string_data(i, &utfsize);
+      strs.emplace_back(data, utfsize);
+    }
+  }
+  auto strings = g_redex->make_strings(strs);
+  auto string_it = strings.begin();
+  for (auto idx : idxs) {
+    std::copy(string_it, string_it + idx->m_string_ids_size,
+              idx->m_string_cache);
+    string_it += idx->m_string_ids_size;
+  }
+
+  std::vector<DexString*> names;
+  for (auto idx : idxs) {
+    for (uint32_t i = 0; i < idx->m_type_ids_size; i++) {
+      uint32_t stridx = idx->m_type_ids[i].string_idx;
+      always_assert_log(stridx < idx->m_string_ids_size,
+                        "Type name index out of range");
+      names.push_back(idx->m_string_cache[stridx]);
+    }
+  }
+  auto types = g_redex->make_types(names);
+  auto type_it = types.begin();
+  for (auto idx : idxs) {
+    std::copy(type_it, type_it + idx->m_type_ids_size, idx->m_type_cache);
+    type_it += idx->m_type_ids_size;
+  }
 }
 
 DexFieldRef* DexIdx::get_fieldidx_fromdex(uint32_t fidx) {
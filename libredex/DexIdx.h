@@ -10,7 +10,10 @@
 #pragma once
 
 #include <assert.h>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "DexDefs.h"
 
@@ -21,7 +24,13 @@ class DexFieldRef;
 class DexMethodRef;
 class DexProto;
 
-class DexIdx {
+/*
+ * Debug items whose decoding is deferred hold on to the DexIdx of their dex,
+ * after the dex itself is unmapped. Only get_stringidx() and get_typeidx(),
+ * which just read the tables filled by load_strings_and_types(), may be
+ * used then.
+ */
+class DexIdx : public std::enable_shared_from_this<DexIdx> {
  private:
   const uint8_t* m_dexbase;
 
@@ -36,26 +45,47 @@ class DexIdx {
   dex_proto_id* m_proto_ids;
   uint32_t m_proto_ids_size;
 
+  // The string and type caches are filled in bulk by
+  // load_strings_and_types(), and only read after that. The others are
+  // filled lazily, by whichever thread parsing a class gets there first.
   DexString** m_string_cache;
   DexType** m_type_cache;
-  DexFieldRef** m_field_cache;
-  DexMethodRef** m_method_cache;
-  DexProto** m_proto_cache;
+  std::atomic<DexFieldRef*>* m_field_cache;
+  std::atomic<DexMethodRef*>* m_method_cache;
+  std::atomic<DexProto*>* m_proto_cache;
 
-  DexType* get_typeidx_fromdex(uint32_t typeidx);
-  DexString* get_stringidx_fromdex(uint32_t stridx);
+  const char* get_string_data(uint32_t stridx, uint32_t* utfsize) const;
   DexFieldRef* get_fieldidx_fromdex(uint32_t fidx);
   DexMethodRef* get_methodidx_fromdex(uint32_t midx);
   DexProto* get_protoidx_fromdex(uint32_t pidx);
 
+  template <typename T>
+  T* get_cached(std::atomic<T*>* cache,
+                uint32_t idx,
+                T* (DexIdx::*fromdex)(uint32_t)) {
+    T* value = cache[idx].load(std::memory_order_acquire);
+    if (value == nullptr) {
+      // Interning makes a race here harmless: both threads get the same ref.
+      value = (this->*fromdex)(idx);
+      cache[idx].store(value, std::memory_order_release);
+    }
+    assert(value);
+    return value;
+  }
+
  public:
   explicit DexIdx(const dex_header* dh);
   ~DexIdx();
 
+  /*
+   * Interns the strings and types of all the dexes, all at once, through
+   * RedexContext::make_strings() and make_types(). This must be done before
+   * any class is parsed from them.
+   */
+  static void load_strings_and_types(const std::vector<DexIdx*>& idxs);
+
   DexString* get_stringidx(uint32_t stridx) {
-    if (m_string_cache[stridx] == nullptr) {
-      m_string_cache[stridx] = get_stringidx_fromdex(stridx);
-    }
+    assert(stridx < m_string_ids_size);
     assert(m_string_cache[stridx]);
     return m_string_cache[stridx];
   }
@@ -69,35 +99,21 @@ class DexIdx {
     if (typeidx == DEX_NO_INDEX) {
       return nullptr;
     }
-    if (m_type_cache[typeidx] == nullptr) {
-      m_type_cache[typeidx] = get_typeidx_fromdex(typeidx);
-    }
+    assert(typeidx < m_type_ids_size);
     assert(m_type_cache[typeidx]);
     return m_type_cache[typeidx];
   }
 
   DexFieldRef* get_fieldidx(uint32_t fidx) {
-    if (m_field_cache[fidx] == nullptr) {
-      m_field_cache[fidx] = get_fieldidx_fromdex(fidx);
-    }
-    assert(m_field_cache[fidx]);
-    return m_field_cache[fidx];
+    return get_cached(m_field_cache, fidx, &DexIdx::get_fieldidx_fromdex);
   }
 
   DexMethodRef* get_methodidx(uint32_t midx) {
-    if (m_method_cache[midx] == nullptr) {
-      m_method_cache[midx] = get_methodidx_fromdex(midx);
-    }
-    assert(m_method_cache[midx]);
-    return m_method_cache[midx];
+    return get_cached(m_method_cache, midx, &DexIdx::get_methodidx_fromdex);
   }
 
   DexProto* get_protoidx(uint32_t pidx) {
-    if (m_proto_cache[pidx] == nullptr) {
-      m_proto_cache[pidx] = get_protoidx_fromdex(pidx);
-    }
-    assert(m_proto_cache[pidx]);
-    return m_proto_cache[pidx];
+    return get_cached(m_proto_cache, pidx, &DexIdx::get_protoidx_fromdex);
   }
 
   const uint32_t* get_uint_data(uint32_t offset) {
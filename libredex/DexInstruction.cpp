@@ -733,13 +733,6 @@ void DexOpcodeData::encode(DexOutputIdx* dodx, uint16_t*& insns) {
   insns += m_data_count;
 }
 
-void DexInstruction::encode(DexOutputIdx* dodx, uint16_t*& insns) {
-  encode_opcode(dodx, insns);
-  encode_args(insns);
-}
-
-uint16_t DexInstruction::size() const { return m_count + 1; }
-
 DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
                                                  const uint16_t** insns_ptr) {
   auto& insns = *insns_ptr;
@@ -1105,6 +1098,7 @@ bool DexInstruction::operator==(const DexInstruction& that) const {
   }
   switch (m_ref_type) {
   case REF_NONE:
+  case REF_DATA:
     return true;
   case REF_STRING: {
     auto this_ = static_cast<const DexOpcodeString*>(this);
@@ -33,7 +33,8 @@ class DexInstruction : public Gatherable {
     REF_STRING,
     REF_TYPE,
     REF_FIELD,
-    REF_METHOD
+    REF_METHOD,
+    REF_DATA
   } m_ref_type{REF_NONE};
 
  private:
@@ -84,8 +85,16 @@ class DexInstruction : public Gatherable {
                                           const uint16_t** insns_ptr);
   /* Creates the right subclass of DexInstruction for the given opcode */
   static DexInstruction* make_instruction(DexOpcode);
-  virtual void encode(DexOutputIdx* dodx, uint16_t*& insns);
-  virtual uint16_t size() const;
+
+  /*
+   * Writes the instruction at `insns` and advances it past the instruction.
+   * This and size() run for every instruction of every dex written, so they
+   * dispatch on the kind of reference the instruction holds instead of
+   * through a virtual call, and the common ref-less instructions are encoded
+   * inline.
+   */
+  void encode(DexOutputIdx* dodx, uint16_t*& insns);
+  uint16_t size() const;
   virtual DexInstruction* clone() const { return new DexInstruction(*this); }
   bool operator==(const DexInstruction&) const;
 
@@ -143,8 +152,8 @@ class DexOpcodeString : public DexInstruction {
   DexString* m_string;
 
  public:
-  virtual uint16_t size() const;
-  virtual void encode(DexOutputIdx* dodx, uint16_t*& insns);
+  uint16_t size() const;
+  void encode(DexOutputIdx* dodx, uint16_t*& insns);
   virtual void gather_strings(std::vector<DexString*>& lstring) const;
   virtual DexOpcodeString* clone() const { return new DexOpcodeString(*this); }
 
@@ -165,8 +174,8 @@ class DexOpcodeType : public DexInstruction {
   DexType* m_type;
 
  public:
-  virtual uint16_t size() const;
-  virtual void encode(DexOutputIdx* dodx, uint16_t*& insns);
+  uint16_t size() const;
+  void encode(DexOutputIdx* dodx, uint16_t*& insns);
   virtual void gather_types(std::vector<DexType*>& ltype) const;
   virtual DexOpcodeType* clone() const { return new DexOpcodeType(*this); }
 
@@ -191,8 +200,8 @@ class DexOpcodeField : public DexInstruction {
   DexFieldRef* m_field;
 
  public:
-  virtual uint16_t size() const;
-  virtual void encode(DexOutputIdx* dodx, uint16_t*& insns);
+  uint16_t size() const;
+  void encode(DexOutputIdx* dodx, uint16_t*& insns);
   virtual void gather_fields(std::vector<DexFieldRef*>& lfield) const;
   virtual DexOpcodeField* clone() const { return new DexOpcodeField(*this); }
 
@@ -211,8 +220,8 @@ class DexOpcodeMethod : public DexInstruction {
   DexMethodRef* m_method;
 
  public:
-  virtual uint16_t size() const;
-  virtual void encode(DexOutputIdx* dodx, uint16_t*& insns);
+  uint16_t size() const;
+  void encode(DexOutputIdx* dodx, uint16_t*& insns);
   virtual void gather_methods(std::vector<DexMethodRef*>& lmethod) const;
   virtual DexOpcodeMethod* clone() const { return new DexOpcodeMethod(*this); }
 
@@ -234,14 +243,15 @@ class DexOpcodeData : public DexInstruction {
 
  public:
   // This size refers to the whole instruction, not just the data portion
-  virtual uint16_t size() const;
-  virtual void encode(DexOutputIdx* dodx, uint16_t*& insns);
+  uint16_t size() const;
+  void encode(DexOutputIdx* dodx, uint16_t*& insns);
   virtual DexOpcodeData* clone() const { return new DexOpcodeData(*this); }
 
   DexOpcodeData(const uint16_t* opcodes, int count)
       : DexInstruction(opcodes, 0),
         m_data_count(count),
         m_data(new uint16_t[count]) {
+    m_ref_type = REF_DATA;
     opcodes++;
     memcpy(m_data, opcodes, count * sizeof(uint16_t));
   }
@@ -261,11 +271,53 @@ class DexOpcodeData : public DexInstruction {
 
   ~DexOpcodeData() { delete[] m_data; }
 
-  const uint16_t* data() { return m_data; }
+  const uint16_t* data() const { return m_data; }
   // This size refers to just the length of the data array
-  const uint16_t data_size() { return m_data_count; }
+  const uint16_t data_size() const { return m_data_count; }
 };
 
+inline void DexInstruction::encode(DexOutputIdx* dodx, uint16_t*& insns) {
+  switch (m_ref_type) {
+  case REF_NONE:
+    encode_opcode(dodx, insns);
+    encode_args(insns);
+    return;
+  case REF_STRING:
+    static_cast<DexOpcodeString*>(this)->encode(dodx, insns);
+    return;
+  case REF_TYPE:
+    static_cast<DexOpcodeType*>(this)->encode(dodx, insns);
+    return;
+  case REF_FIELD:
+    static_cast<DexOpcodeField*>(this)->encode(dodx, insns);
+    return;
+  case REF_METHOD:
+    static_cast<DexOpcodeMethod*>(this)->encode(dodx, insns);
+    return;
+  case REF_DATA:
+    static_cast<DexOpcodeData*>(this)->encode(dodx, insns);
+    return;
+  }
+}
+
+inline uint16_t DexInstruction::size() const {
+  switch (m_ref_type) {
+  case REF_NONE:
+    return m_count + 1;
+  case REF_STRING:
+    return static_cast<const DexOpcodeString*>(this)->size();
+  case REF_TYPE:
+    return static_cast<const DexOpcodeType*>(this)->size();
+  case REF_FIELD:
+    return static_cast<const DexOpcodeField*>(this)->size();
+  case REF_METHOD:
+    return static_cast<const DexOpcodeMethod*>(this)->size();
+  case REF_DATA:
+    return static_cast<const DexOpcodeData*>(this)->size();
+  }
+  not_reached();
+}
+
 /**
  * Return a copy of the instruction passed in.
  */
@@ -7,36 +7,65 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <boost/filesystem.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
 
 #include "DexLoader.h"
 #include "DexDefs.h"
 #include "DexAccess.h"
 #include "IRCode.h"
+#include "Timer.h"
 #include "Trace.h"
 #include "Walkers.h"
 #include "WorkQueue.h"
+#include "ZipArchive.h"
+#include "ZipFormat.h"
 
 #include <exception>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 
 class DexLoader {
-  DexIdx* m_idx;
+  std::shared_ptr<DexIdx> m_idx;
+  const dex_header* m_header{nullptr};
   const dex_class_def* m_class_defs;
-  DexClasses* m_classes;
+  DexClasses m_classes;
   boost::iostreams::mapped_file m_file;
+  // When the dex is an entry of an archive: the archive, and the inflated
+  // dex unless it is stored (suitably aligned) in the archive's mapping.
+  std::unique_ptr<zip::Reader> m_archive;
+  std::vector<uint8_t> m_contents;
+  const char* m_data{nullptr};
+  size_t m_size{0};
   std::string m_dex_location;
 
  public:
   explicit DexLoader(const char* location) : m_dex_location(location) {}
+  // Reads the dex out of a buffer owned by the caller instead.
+  DexLoader(const uint8_t* data, size_t size, const std::string& location)
+      : m_data(reinterpret_cast<const char*>(data)),
+        m_size(size),
+        m_dex_location(location) {}
   ~DexLoader() {
-    if (m_idx) delete m_idx;
     if (m_file.is_open()) m_file.close();
   }
   DexClasses load_dex(const char* location, dex_stats_t* stats);
+
+  // The steps of load_dex(), for loading many dexes at once: open_dex() maps
+  // the file and checks its header, then the strings and types of the dexes
+  // are interned together, after which the classes can be loaded in any
+  // order, and then finish_dex() hands them over.
+  size_t open_dex();
+  DexIdx* get_idx() { return m_idx.get(); }
   void load_dex_class(int num);
+  DexClasses finish_dex(dex_stats_t* stats);
+
   void gather_input_stats(dex_stats_t* stats, const dex_header* dh);
+
+ private:
+  void map_dex();
+  void map_dex_in_archive(const std::string& archive, const std::string& entry);
 };
 
 static void validate_dex_header(const dex_header* dh, size_t dexsize) {
@@ -95,7 +124,7 @@ void DexLoader::gather_input_stats(dex_stats_t* stats, const dex_header* dh) {
   std::set<DexTypeList*, dextypelists_comparator> type_lists;
   std::unordered_set<uint32_t> anno_offsets;
   for (uint32_t cidx = 0; cidx < dh->class_defs_size; ++cidx) {
-    auto* clz = m_classes->at(cidx);
+    auto* clz = m_classes.at(cidx);
     auto* class_def = &m_class_defs[cidx];
     auto anno_off = class_def->annotations_off;
     if (anno_off) {
@@ -168,63 +197,148 @@ void DexLoader::gather_input_stats(dex_stats_t* stats, const dex_header* dh) {
 
 void DexLoader::load_dex_class(int num) {
   const dex_class_def* cdef = m_class_defs + num;
-  DexClass* dc = new DexClass(m_idx, cdef, m_dex_location);
-  m_classes->at(num) = dc;
+  DexClass* dc = new DexClass(m_idx.get(), cdef, m_dex_location);
+  m_classes.at(num) = dc;
 }
 
-DexClasses DexLoader::load_dex(const char* location, dex_stats_t* stats) {
+static void throw_if_any(const std::vector<std::exception_ptr>& exceptions) {
+  if (!exceptions.empty()) {
+    // At least one of the workers raised an exception
+    aggregate_exception ae(exceptions);
+    throw ae;
+  }
+}
+
+void DexLoader::map_dex() {
+  if (m_data != nullptr) {
+    return;
+  }
+  auto bang = m_dex_location.rfind('!');
+  if (bang != std::string::npos) {
+    auto archive = m_dex_location.substr(0, bang);
+    if (boost::filesystem::is_regular_file(archive)) {
+      map_dex_in_archive(archive, m_dex_location.substr(bang + 1));
+      return;
+    }
+  }
+  const char* location = m_dex_location.c_str();
   m_file.open(location, boost::iostreams::mapped_file::readonly);
   if (!m_file.is_open()) {
     fprintf(stderr, "error: cannot create memory-mapped file: %s\n", location);
     exit(EXIT_FAILURE);
   }
-  auto dh = reinterpret_cast<const dex_header*>(m_file.const_data());
-  validate_dex_header(dh, m_file.size());
-  if (dh->class_defs_size == 0) {
+  m_data = m_file.const_data();
+  m_size = m_file.size();
+}
+
+void DexLoader::map_dex_in_archive(const std::string& archive,
+                                   const std::string& entry_name) {
+  m_archive.reset(new zip::Reader(archive));
+  for (const auto& entry : m_archive->entries()) {
+    if (entry.name != entry_name) {
+      continue;
+    }
+    m_size = entry.ucomp_size;
+    if (entry.method == kCompMethodStore &&
+        reinterpret_cast<uintptr_t>(entry.data) % 4 == 0) {
+      // Stored and aligned, as zipalign leaves it: read it in place.
+      m_data = reinterpret_cast<const char*>(entry.data);
+    } else {
+      m_contents.resize(m_size);
+      m_archive->extract(entry, m_contents.data());
+      m_data = reinterpret_cast<const char*>(m_contents.data());
+    }
+    return;
+  }
+  fprintf(stderr, "error: no entry %s in %s\n", entry_name.c_str(),
+          archive.c_str());
+  exit(EXIT_FAILURE);
+}
+
+size_t DexLoader::open_dex() {
+  map_dex();
+  always_assert_log(reinterpret_cast<uintptr_t>(m_data) % 4 == 0,
+                    "%s is not 4-byte aligned\n", m_dex_location.c_str());
+  m_header = reinterpret_cast<const dex_header*>(m_data);
+  validate_dex_header(m_header, m_size);
+  if (m_header->class_defs_size == 0) {
+    return 0;
+  }
+  m_idx = std::make_shared<DexIdx>(m_header);
+  auto off = (uint64_t)m_header->class_defs_off;
+  auto limit = off + m_header->class_defs_size * sizeof(dex_class_def);
+  always_assert_log(off < m_size, "class_defs_off out of range");
+  always_assert_log(limit <= m_size, "invalid class_defs_size");
+  m_class_defs = reinterpret_cast<const dex_class_def*>(m_data + off);
+  m_classes.resize(m_header->class_defs_size);
+  return m_header->class_defs_size;
+}
+
+DexClasses DexLoader::finish_dex(dex_stats_t* stats) {
+  if (m_classes.empty()) {
+    return DexClasses(0);
+  }
+  gather_input_stats(stats, m_header);
+  return std::move(m_classes);
+}
+
+DexClasses DexLoader::load_dex(const char* location, dex_stats_t* stats) {
+  auto num_classes = open_dex();
+  if (num_classes == 0) {
     return DexClasses(0);
   }
-  m_idx = new DexIdx(dh);
-  auto off = (uint64_t)dh->class_defs_off;
-  auto limit = off + dh->class_defs_size * sizeof(dex_class_def);
-  always_assert_log(off < m_file.size(), "class_defs_off out of range");
-  always_assert_log(limit <= m_file.size(), "invalid class_defs_size");
-  m_class_defs =
-      reinterpret_cast<const dex_class_def*>(m_file.const_data() + off);
-  DexClasses classes(dh->class_defs_size);
-  m_classes = &classes;
-
-  auto lwork = new class_load_work[dh->class_defs_size];
+  DexIdx::load_strings_and_types({m_idx.get()});
+
+  auto lwork = new class_load_work[num_classes];
   auto wq =
       workqueue_mapreduce<class_load_work*, std::vector<std::exception_ptr>>(
         class_work, exc_reducer);
-  for (uint32_t i = 0; i < dh->class_defs_size; i++) {
+  for (uint32_t i = 0; i < num_classes; i++) {
     lwork[i].dl = this;
     lwork[i].num = i;
     wq.add_item(&lwork[i]);
   }
   const auto exceptions = wq.run_all();
   delete[] lwork;
+  throw_if_any(exceptions);
 
-  if (!exceptions.empty()) {
-    // At least one of the workers raised an exception
-    aggregate_exception ae(exceptions);
-    throw ae;
-  }
+  return finish_dex(stats);
+}
 
-  gather_input_stats(stats, dh);
+// Most methods are a handful of instructions, for which a queue item each
+// costs about as much as the ballooning itself.
+static constexpr size_t BALLOON_BATCH_CODE_UNITS = 4096;
 
-  return classes;
-}
+using BalloonBatch = std::vector<DexMethod*>;
 
-static void mt_balloon(DexMethod* method) { method->balloon(); }
+static void mt_balloon(const BalloonBatch* batch) {
+  for (auto* method : *batch) {
+    method->balloon();
+  }
+}
 
 static void balloon_all(const Scope& scope) {
-  auto wq = workqueue_foreach<DexMethod*>(mt_balloon);
+  // Consecutive methods, in the order they were loaded, go in the same batch
+  // until it holds enough code, so that each worker goes through code that
+  // was read and allocated together.
+  std::vector<BalloonBatch> batches(1);
+  size_t batch_code_units = 0;
   walk::methods(scope, [&](DexMethod* m) {
-    if (m->get_dex_code()) {
-      wq.add_item(m);
+    auto* code = m->get_dex_code();
+    if (!code) {
+      return;
+    }
+    if (batch_code_units >= BALLOON_BATCH_CODE_UNITS) {
+      batches.emplace_back();
+      batch_code_units = 0;
     }
+    batches.back().push_back(m);
+    batch_code_units += code->size();
   });
+  auto wq = workqueue_foreach<const BalloonBatch*>(mt_balloon);
+  for (const auto& batch : batches) {
+    wq.add_item(&batch);
+  }
   wq.run_all();
 }
 
@@ -233,16 +347,127 @@ DexClasses load_classes_from_dex(const char* location, bool balloon) {
   return load_classes_from_dex(location, &stats, balloon);
 }
 
+static void defer_balloon_all(const DexClasses& classes) {
+  // Most methods are ballooned by the first pass that looks at them; the
+  // ones nobody touches are written back out without ever being converted.
+  walk::methods(classes, [](DexMethod* m) { m->defer_balloon(); });
+}
+
 DexClasses load_classes_from_dex(const char* location,
                                  dex_stats_t* stats,
                                  bool balloon) {
   TRACE(MAIN, 1, "Loading classes from dex from %s\n", location);
+  Timeline::Span span(std::string("Load dex ") + location);
   DexLoader dl(location);
   auto classes = dl.load_dex(location, stats);
   if (balloon) {
-    balloon_all(classes);
+    defer_balloon_all(classes);
   }
   return classes;
 }
 
+DexClasses load_classes_from_dex(const uint8_t* data,
+                                 size_t size,
+                                 const std::string& location,
+                                 bool balloon) {
+  dex_stats_t stats;
+  return load_classes_from_dex(data, size, location, &stats, balloon);
+}
+
+DexClasses load_classes_from_dex(const uint8_t* data,
+                                 size_t size,
+                                 const std::string& location,
+                                 dex_stats_t* stats,
+                                 bool balloon) {
+  TRACE(MAIN, 1, "Loading classes from dex in memory as %s\n",
+        location.c_str());
+  Timeline::Span span("Load dex " + location);
+  DexLoader dl(data, size, location);
+  auto classes = dl.load_dex(location.c_str(), stats);
+  if (balloon) {
+    defer_balloon_all(classes);
+  }
+  return classes;
+}
+
+std::vector<DexClasses> load_classes_from_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon) {
+  Timeline::Span span("Load dexes");
+  std::vector<std::unique_ptr<DexLoader>> loaders;
+  for (const auto& location : locations) {
+    TRACE(MAIN, 1, "Loading classes from dex from %s\n", location.c_str());
+    loaders.emplace_back(new DexLoader(location.c_str()));
+  }
+
+  // Mapping the files and checking their headers is quick for each dex, but
+  // done one by one it costs more than loading the classes of a small dex.
+  std::vector<size_t> num_classes(loaders.size());
+  {
+    auto wq = workqueue_mapreduce<size_t, std::vector<std::exception_ptr>>(
+        [&](size_t i) -> std::vector<std::exception_ptr> {
+          try {
+            num_classes[i] = loaders[i]->open_dex();
+            return {};
+          } catch (const std::exception& exc) {
+            TRACE(MAIN, 1, "Worker throw the exception:%s\n", exc.what());
+            return {std::current_exception()};
+          }
+        },
+        exc_reducer);
+    for (size_t i = 0; i < loaders.size(); i++) {
+      wq.add_item(i);
+    }
+    throw_if_any(wq.run_all());
+  }
+
+  std::vector<DexIdx*> idxs;
+  for (auto& loader : loaders) {
+    if (loader->get_idx()) {
+      idxs.push_back(loader->get_idx());
+    }
+  }
+  DexIdx::load_strings_and_types(idxs);
+
+  // Then the classes of all the dexes go on the one pool. Every class still
+  // lands at its own index in its own dex, so the order doesn't depend on
+  // the scheduling, and publishing a class that is already defined by
+  // another dex still throws malformed_dex.
+  std::vector<class_load_work> lwork;
+  for (size_t i = 0; i < loaders.size(); i++) {
+    for (size_t num = 0; num < num_classes[i]; num++) {
+      lwork.push_back({loaders[i].get(), static_cast<int>(num)});
+    }
+  }
+  {
+    auto wq =
+        workqueue_mapreduce<class_load_work*, std::vector<std::exception_ptr>>(
+            class_work, exc_reducer);
+    for (auto& work : lwork) {
+      wq.add_item(&work);
+    }
+    throw_if_any(wq.run_all());
+  }
+
+  std::vector<DexClasses> dexen(loaders.size());
+  stats->assign(loaders.size(), dex_stats_t());
+  {
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      dexen[i] = loaders[i]->finish_dex(&stats->at(i));
+      loaders[i].reset();
+    });
+    for (size_t i = 0; i < loaders.size(); i++) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  }
+  if (balloon) {
+    for (auto& classes : dexen) {
+      defer_balloon_all(classes);
+    }
+  }
+  return dexen;
+}
+
 void balloon_for_test(const Scope& scope) { balloon_all(scope); }
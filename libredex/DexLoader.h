@@ -14,7 +14,36 @@
 #include "DexDefs.h"
 #include "DexUtil.h"
 
+/*
+ * A location is the path of a dex file, or "<archive>!<entry>" for a dex
+ * inside an APK or jar, which is then read out of the archive directly.
+ */
 DexClasses load_classes_from_dex(const char* location, bool balloon = true);
 DexClasses load_classes_from_dex(const char* location, dex_stats_t* stats, bool balloon = true);
 
+/*
+ * Loads a dex out of a 4-byte aligned buffer, e.g. one decompressed in
+ * memory, with the location naming it in its classes and in errors. The
+ * classes copy what they need, so the buffer only has to outlive the call.
+ */
+DexClasses load_classes_from_dex(const uint8_t* data,
+                                 size_t size,
+                                 const std::string& location,
+                                 bool balloon = true);
+DexClasses load_classes_from_dex(const uint8_t* data,
+                                 size_t size,
+                                 const std::string& location,
+                                 dex_stats_t* stats,
+                                 bool balloon = true);
+
+/*
+ * Loads the classes of all the dexes together, on one pool, rather than
+ * one dex after the other. The result and the stats are in the order of the
+ * locations, with each dex's classes in the order of its class defs.
+ */
+std::vector<DexClasses> load_classes_from_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon = true);
+
 void balloon_for_test(const Scope& scope);
@@ -12,12 +12,17 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <list>
+#include <queue>
 #include <stdlib.h>
 #include <unordered_set>
 #include <functional>
 #include <exception>
 #include <assert.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
 #ifdef _MSC_VER
 // TODO: Rewrite open/write/close with C/C++ standards. But it works for now.
 #include <io.h>
@@ -31,14 +36,18 @@
 #define O_WRONLY _O_WRONLY
 #endif
 
+#include "BinaryMappingFile.h"
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexOutput.h"
 #include "DexUtil.h"
 #include "IRCode.h"
+#include "PageAccounting.h"
 #include "Pass.h"
 #include "Resolver.h"
 #include "Sha1.h"
+#include "Show.h"
+#include "Timer.h"
 #include "Trace.h"
 #include "Walkers.h"
 #include "WorkQueue.h"
@@ -81,7 +90,8 @@ class CustomSort {
     }
 };
 
-GatheredTypes::GatheredTypes(DexClasses* classes)
+GatheredTypes::GatheredTypes(DexClasses* classes,
+                             const ClassRefsMap* class_refs)
   : m_classes(classes)
 {
   // ensure that the string id table contains the empty string, which is used
@@ -93,7 +103,11 @@ GatheredTypes::GatheredTypes(DexClasses* classes)
   build_cls_map();
   build_method_map();
 
-  gather_components();
+  if (class_refs != nullptr) {
+    gather_components(*class_refs);
+  } else {
+    gather_components(gather_class_refs(*classes));
+  }
 }
 
 std::unordered_set<DexString*> GatheredTypes::index_type_names() {
@@ -139,6 +153,119 @@ void GatheredTypes::sort_dexmethod_emitlist_cls_order(
   );
 }
 
+std::vector<DexString*> GatheredTypes::get_profile_order_dexstring_emitlist() {
+  return get_dexstring_emitlist(CustomSort<DexString, cmp_dstring>(
+        m_profile_strings,
+        compare_dexstrings));
+}
+
+void GatheredTypes::set_method_profile(const MethodProfileOrder& profile) {
+  std::vector<std::pair<unsigned int, const DexMethod*>> profiled;
+  for (auto const& m : get_dexmethod_emitlist()) {
+    auto it = profile.find(m->get_deobfuscated_name());
+    if (it != profile.end()) {
+      m_methods_in_profile_order[m] = it->second;
+      profiled.emplace_back(it->second, m);
+    }
+  }
+  std::sort(profiled.begin(), profiled.end());
+  unsigned int index = 0;
+  for (auto const& p : profiled) {
+    std::vector<DexString*> method_strings;
+    p.second->gather_strings(method_strings);
+    for (auto const& s : method_strings) {
+      if (!m_profile_strings.count(s)) {
+        m_profile_strings[s] = index++;
+      }
+    }
+  }
+  TRACE(CUSTOMSORT, 1, "found %lu profiled methods using %u strings\n",
+        profiled.size(), index);
+}
+
+std::vector<DexString*> GatheredTypes::get_coldstart_order_dexstring_emitlist() {
+  return get_dexstring_emitlist(CustomSort<DexString, cmp_dstring>(
+        m_coldstart_strings,
+        compare_dexstrings));
+}
+
+void GatheredTypes::set_coldstart_classes(
+    const ColdstartClassOrder& coldstart_classes) {
+  std::vector<std::pair<unsigned int, const DexClass*>> coldstart;
+  for (auto const& cls : *m_classes) {
+    auto it = coldstart_classes.find(cls->get_deobfuscated_name());
+    if (it != coldstart_classes.end()) {
+      coldstart.emplace_back(it->second, cls);
+    }
+  }
+  std::sort(coldstart.begin(), coldstart.end());
+  for (size_t i = 0; i < coldstart.size(); ++i) {
+    m_coldstart_classes.emplace(coldstart[i].second, i);
+  }
+  // Group the strings by the first class that uses them. Within a class, the
+  // type names come first, as they are resolved when the class is loaded.
+  unsigned int index = 0;
+  auto add = [&](const DexString* s) {
+    if (!m_coldstart_strings.count(s)) {
+      m_coldstart_strings[s] = index++;
+    }
+  };
+  for (auto const& p : coldstart) {
+    std::vector<DexType*> cls_types;
+    p.second->gather_types(cls_types);
+    for (auto const& t : cls_types) {
+      add(t->get_name());
+    }
+    std::vector<DexString*> cls_strings;
+    p.second->gather_strings(cls_strings);
+    for (auto const& s : cls_strings) {
+      add(s);
+    }
+  }
+  TRACE(CUSTOMSORT, 1, "found %lu coldstart classes using %u strings\n",
+        coldstart.size(), index);
+}
+
+void GatheredTypes::sort_dexmethod_emitlist_profile_order(
+    std::vector<DexMethod*>& lmeth) {
+  // Methods that are not in the profile keep their relative order.
+  std::stable_sort(lmeth.begin(), lmeth.end(),
+    [&](const DexMethod* a, const DexMethod* b) {
+      auto a_it = m_methods_in_profile_order.find(a);
+      auto b_it = m_methods_in_profile_order.find(b);
+      if (a_it == m_methods_in_profile_order.end()) {
+        return false;
+      }
+      return b_it == m_methods_in_profile_order.end() ||
+             a_it->second < b_it->second;
+    }
+  );
+}
+
+std::vector<DexClass*> GatheredTypes::get_profile_order_class_emitlist() {
+  // A class goes where its first profiled method goes.
+  std::unordered_map<const DexClass*, unsigned int> first_use;
+  for (auto const& it : m_methods_in_profile_order) {
+    auto cls = type_class(it.first->get_class());
+    auto result = first_use.emplace(cls, it.second);
+    if (!result.second && it.second < result.first->second) {
+      result.first->second = it.second;
+    }
+  }
+  std::vector<DexClass*> classes(m_classes->begin(), m_classes->end());
+  std::stable_sort(classes.begin(), classes.end(),
+    [&](const DexClass* a, const DexClass* b) {
+      auto a_it = first_use.find(a);
+      auto b_it = first_use.find(b);
+      if (a_it == first_use.end()) {
+        return false;
+      }
+      return b_it == first_use.end() || a_it->second < b_it->second;
+    }
+  );
+  return classes;
+}
+
 void GatheredTypes::sort_dexmethod_emitlist_clinit_order(
     std::vector<DexMethod*>& lmeth) {
   std::stable_sort(lmeth.begin(), lmeth.end(),
@@ -171,8 +298,65 @@ DexOutputIdx* GatheredTypes::get_dodx(const uint8_t* base) {
   return new DexOutputIdx(string, type, proto, field, method, base);
 }
 
+namespace {
+
+/*
+ * compare_dexstrings decodes the strings code point by code point as soon as
+ * one of them isn't pure ASCII. To avoid that on most comparisons, strings
+ * are sorted by a key made of their first eight bytes, big-endian and
+ * zero-padded, and only fall back to compare_dexstrings when the keys tie.
+ * MUTF-8 byte order agrees with code point order, and the strings never
+ * contain a zero byte, so differing keys order the strings the same way
+ * compare_dexstrings does. The exception is U+0000, encoded as C0 80, which
+ * sorts below every other code point; the key is cut off at a C0 byte so that
+ * it still compares correctly.
+ */
+uint64_t string_sort_prefix(const DexString* str) {
+  auto pos = reinterpret_cast<const uint8_t*>(str->c_str());
+  uint64_t prefix = 0;
+  for (size_t i = 0; i < sizeof(prefix); ++i) {
+    prefix <<= 8;
+    if (*pos != 0 && *pos != 0xc0) {
+      prefix |= *pos++;
+    }
+  }
+  return prefix;
+}
+
+/*
+ * Sorts the items by the name that get_name() returns, in compare_dexstrings
+ * order, using the sort keys above.
+ */
+template <class T, class GetName>
+void sort_by_dexstring(std::vector<T*>& items, GetName get_name) {
+  std::vector<std::pair<uint64_t, T*>> keyed;
+  keyed.reserve(items.size());
+  for (auto item : items) {
+    keyed.emplace_back(string_sort_prefix(get_name(item)), item);
+  }
+  sort_in_parallel(
+      keyed.begin(),
+      keyed.end(),
+      [&get_name](const std::pair<uint64_t, T*>& a,
+                  const std::pair<uint64_t, T*>& b) {
+        if (a.first != b.first) {
+          return a.first < b.first;
+        }
+        return compare_dexstrings(get_name(a.second), get_name(b.second));
+      });
+  for (size_t i = 0; i < keyed.size(); ++i) {
+    items[i] = keyed[i].second;
+  }
+}
+
+} // namespace
+
 dexstring_to_idx* GatheredTypes::get_string_index(cmp_dstring cmp) {
-  std::sort(m_lstring.begin(), m_lstring.end(), cmp);
+  if (cmp == compare_dexstrings) {
+    sort_by_dexstring(m_lstring, [](const DexString* s) { return s; });
+  } else {
+    sort_in_parallel(m_lstring.begin(), m_lstring.end(), cmp);
+  }
   dexstring_to_idx* sidx = new dexstring_to_idx();
   uint32_t idx = 0;
   for (auto it = m_lstring.begin(); it != m_lstring.end(); it++) {
@@ -182,7 +366,11 @@ dexstring_to_idx* GatheredTypes::get_string_index(cmp_dstring cmp) {
 }
 
 dextype_to_idx* GatheredTypes::get_type_index(cmp_dtype cmp) {
-  std::sort(m_ltype.begin(), m_ltype.end(), cmp);
+  if (cmp == compare_dextypes) {
+    sort_by_dexstring(m_ltype, [](const DexType* t) { return t->get_name(); });
+  } else {
+    sort_in_parallel(m_ltype.begin(), m_ltype.end(), cmp);
+  }
   dextype_to_idx* sidx = new dextype_to_idx();
   uint32_t idx = 0;
   for (auto it = m_ltype.begin(); it != m_ltype.end(); it++) {
@@ -192,7 +380,7 @@ dextype_to_idx* GatheredTypes::get_type_index(cmp_dtype cmp) {
 }
 
 dexfield_to_idx* GatheredTypes::get_field_index(cmp_dfield cmp) {
-  std::sort(m_lfield.begin(), m_lfield.end(), cmp);
+  sort_in_parallel(m_lfield.begin(), m_lfield.end(), cmp);
   dexfield_to_idx* sidx = new dexfield_to_idx();
   uint32_t idx = 0;
   for (auto it = m_lfield.begin(); it != m_lfield.end(); it++) {
@@ -202,7 +390,7 @@ dexfield_to_idx* GatheredTypes::get_field_index(cmp_dfield cmp) {
 }
 
 dexmethod_to_idx* GatheredTypes::get_method_index(cmp_dmethod cmp) {
-  std::sort(m_lmethod.begin(), m_lmethod.end(), cmp);
+  sort_in_parallel(m_lmethod.begin(), m_lmethod.end(), cmp);
   dexmethod_to_idx* sidx = new dexmethod_to_idx();
   uint32_t idx = 0;
   for (auto it = m_lmethod.begin(); it != m_lmethod.end(); it++) {
@@ -218,7 +406,7 @@ dexproto_to_idx* GatheredTypes::get_proto_index(cmp_dproto cmp) {
   }
   std::sort(protos.begin(), protos.end());
   protos.erase(std::unique(protos.begin(), protos.end()), protos.end());
-  std::sort(protos.begin(), protos.end(), cmp);
+  sort_in_parallel(protos.begin(), protos.end(), cmp);
   dexproto_to_idx* sidx = new dexproto_to_idx();
   uint32_t idx = 0;
   for (auto const& proto : protos) {
@@ -309,46 +497,114 @@ void GatheredTypes::build_method_map() {
   }
 }
 
-void GatheredTypes::gather_components() {
-  // Gather references reachable from each class.
-  for (auto const& cls : *m_classes) {
-    cls->gather_strings(m_lstring);
-    cls->gather_types(m_ltype);
-    cls->gather_fields(m_lfield);
-    cls->gather_methods(m_lmethod);
-  }
+ClassRefs::ClassRefs(const DexClass* cls) {
+  // Gather references reachable from the class.
+  cls->gather_strings(strings);
+  cls->gather_types(types);
+  cls->gather_fields(fields);
+  cls->gather_methods(methods);
 
   // Remove duplicates to speed up the later loops.
-  sort_unique(m_lstring);
-  sort_unique(m_ltype);
+  sort_unique(strings);
+  sort_unique(types);
 
   // Gather types and strings needed for field and method refs.
-  sort_unique(m_lmethod);
-  for (auto meth : m_lmethod) {
-    meth->gather_types_shallow(m_ltype);
-    meth->gather_strings_shallow(m_lstring);
+  sort_unique(methods);
+  for (auto meth : methods) {
+    meth->gather_types_shallow(types);
+    meth->gather_strings_shallow(strings);
   }
 
-  sort_unique(m_lfield);
-  for (auto field : m_lfield) {
-    field->gather_types_shallow(m_ltype);
-    field->gather_strings_shallow(m_lstring);
+  sort_unique(fields);
+  for (auto field : fields) {
+    field->gather_types_shallow(types);
+    field->gather_strings_shallow(strings);
   }
 
   // Gather strings needed for each type.
-  sort_unique(m_ltype);
-  for (auto type : m_ltype) {
-    if (type) m_lstring.push_back(type->get_name());
+  sort_unique(types);
+  for (auto type : types) {
+    if (type) strings.push_back(type->get_name());
   }
 
-  sort_unique(m_lstring);
+  sort_unique(strings);
+}
+
+ClassRefsMap gather_class_refs(const std::vector<DexClass*>& classes) {
+  std::vector<std::unique_ptr<ClassRefs>> refs(classes.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    refs[i] = std::make_unique<ClassRefs>(classes[i]);
+  });
+  for (size_t i = 0; i < classes.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  ClassRefsMap map;
+  map.reserve(classes.size());
+  for (size_t i = 0; i < classes.size(); ++i) {
+    map.emplace(classes[i], std::move(*refs[i]));
+  }
+  return map;
+}
+
+namespace {
+
+// K-way merge of the sorted and deduplicated lists of the classes with the
+// ones already in out, which ends up sorted and deduplicated too.
+template <typename T>
+void merge_class_refs(const DexClasses& classes,
+                      const ClassRefsMap& class_refs,
+                      std::vector<T>& out,
+                      std::vector<T> ClassRefs::*list) {
+  using Iterator = typename std::vector<T>::const_iterator;
+  using Cursor = std::pair<Iterator, Iterator>;
+  auto after = [](const Cursor& a, const Cursor& b) {
+    return std::less<T>()(*b.first, *a.first);
+  };
+  std::priority_queue<Cursor, std::vector<Cursor>, decltype(after)> heap(
+      after);
+  sort_unique(out);
+  size_t size = out.size();
+  if (!out.empty()) {
+    heap.emplace(out.cbegin(), out.cend());
+  }
+  for (auto const& cls : classes) {
+    const auto& refs = class_refs.at(cls).*list;
+    if (!refs.empty()) {
+      size += refs.size();
+      heap.emplace(refs.cbegin(), refs.cend());
+    }
+  }
+  std::vector<T> merged;
+  merged.reserve(size);
+  while (!heap.empty()) {
+    auto cursor = heap.top();
+    heap.pop();
+    if (merged.empty() || merged.back() != *cursor.first) {
+      merged.push_back(*cursor.first);
+    }
+    if (++cursor.first != cursor.second) {
+      heap.push(cursor);
+    }
+  }
+  out = std::move(merged);
+}
+
+} // namespace
+
+void GatheredTypes::gather_components(const ClassRefsMap& class_refs) {
+  merge_class_refs(*m_classes, class_refs, m_lstring, &ClassRefs::strings);
+  merge_class_refs(*m_classes, class_refs, m_ltype, &ClassRefs::types);
+  merge_class_refs(*m_classes, class_refs, m_lfield, &ClassRefs::fields);
+  merge_class_refs(*m_classes, class_refs, m_lmethod, &ClassRefs::methods);
 }
 
 constexpr uint32_t k_max_dex_size = 16 * 1024 * 1024;
-typedef std::map<DexAnnotation*, uint32_t> annomap_t;
-typedef std::map<DexAnnotationSet*, uint32_t> asetmap_t;
-typedef std::map<ParamAnnotations*, uint32_t> xrefmap_t;
-typedef std::map<DexAnnotationDirectory*, uint32_t> adirmap_t;
+constexpr uint32_t k_page_size = 4096;
+typedef std::unordered_map<DexAnnotation*, uint32_t> annomap_t;
+typedef std::unordered_map<DexAnnotationSet*, uint32_t> asetmap_t;
+typedef std::unordered_map<ParamAnnotations*, uint32_t> xrefmap_t;
+typedef std::unordered_map<DexAnnotationDirectory*, uint32_t> adirmap_t;
 
 class DexOutput {
 public:
@@ -366,13 +622,26 @@ public:
   std::string m_class_mapping_filename;
   std::string m_pg_mapping_filename;
   std::string m_bytecode_offset_filename;
+  std::string m_page_report_filename;
+  const DexOutputProfile* m_profile;
+  bool m_binary_symbol_files;
   std::unordered_map<DexTypeList*, uint32_t> m_tl_emit_offsets;
   std::vector<std::pair<DexCode*, dex_code_item*>> m_code_item_emits;
   std::vector<std::pair<std::string, uint32_t>> m_method_bytecode_offsets;
   std::unordered_map<DexClass*, uint32_t> m_cdi_offsets;
+  // Only kept for the page report.
+  std::unordered_map<const DexClass*, uint32_t> m_cdi_sizes;
+  std::unordered_map<const DexMethod*, std::pair<uint32_t, uint32_t>>
+      m_code_item_extents;
+  std::unordered_map<uint32_t, uint32_t> m_static_value_sizes;
+  std::unordered_map<const DexClass*, std::pair<uint32_t, uint32_t>>
+      m_annotation_dir_extents;
   std::unordered_map<DexClass*, uint32_t> m_static_values;
   dex_header hdr;
   std::vector<dex_map_item> m_map_items;
+  // Positions of the code release_memory() freed, for write_symbol_files() to
+  // hand to the PositionMapper.
+  std::vector<std::unique_ptr<DexPosition>> m_released_positions;
   LocatorIndex* m_locator_index;
   ConfigFiles& m_config_files;
 
@@ -383,7 +652,7 @@ public:
   void generate_field_data();
   void generate_method_data();
   void generate_class_data();
-  void generate_class_data_items();
+  void generate_class_data_items(const std::vector<SortMode>& code_mode);
 
   // Sort code according to a sequence of sorting modes, ordered by precedence.
   // e.g. passing {SortMode::CLINIT_FIRST, SortMode::CLASS_ORDER} means that
@@ -409,9 +678,16 @@ public:
   void generate_map();
   void finalize_header();
   void init_header_offsets();
-  void write_symbol_files();
   void align_output() { m_offset = (m_offset + 3) & ~3; }
+  bool coldstart_class_data_first() const {
+    return m_profile != nullptr && m_profile->coldstart_class_data_first;
+  }
+  std::vector<DexClass*> get_class_data_emitlist();
   void emit_locator(Locator locator);
+  void write_page_report();
+  void align_hot_strings(
+      const std::vector<DexString*>& string_order,
+      const std::vector<std::unique_ptr<Locator>>& locators);
   std::unique_ptr<Locator> locator_for_descriptor(
     const std::unordered_set<DexString*>& type_names,
     DexString* descriptor);
@@ -427,10 +703,38 @@ public:
     const std::string& method_mapping_path,
     const std::string& class_mapping_path,
     const std::string& pg_mapping_path,
-    const std::string& bytecode_offset_path);
+    const std::string& bytecode_offset_path,
+    const std::string& page_report_path = "",
+    const DexOutputProfile* profile = nullptr,
+    bool binary_symbol_files = false,
+    const ClassRefsMap* class_refs = nullptr);
   ~DexOutput();
   void prepare(SortMode string_mode, const std::vector<SortMode>& code_mode);
   void write();
+
+  /*
+   * prepare() and write() split into the steps that only touch this dex and
+   * the ones that use state shared between dexes, so several dexes can be
+   * written at once. The line numbers handed out by the PositionMapper
+   * depend on the order in which debug items are encoded, and the symbol
+   * files are appended to, so those two steps must run one dex at a time, in
+   * dex order. Everything else can run concurrently.
+   */
+  void prepare_independent(SortMode string_mode,
+                           const std::vector<SortMode>& code_mode);
+  void prepare_debug_items();
+  void finish_prepare();
+  void write_dex_file();
+  void copy_dex_to(std::vector<uint8_t>* contents);
+  void write_symbol_files();
+
+  /*
+   * Once the dex is written, frees everything write_symbol_files() doesn't
+   * need: the output buffer, the index tables but the method one, and the
+   * code, debug info and annotations of the dex's classes. Only touches this
+   * dex, so dexes can release concurrently.
+   */
+  void release_memory();
 };
 
 DexOutput::DexOutput(
@@ -443,14 +747,24 @@ DexOutput::DexOutput(
   const std::string& method_mapping_filename,
   const std::string& class_mapping_filename,
   const std::string& pg_mapping_filename,
-  const std::string& bytecode_offset_filename)
+  const std::string& bytecode_offset_filename,
+  const std::string& page_report_filename,
+  const DexOutputProfile* profile,
+  bool binary_symbol_files,
+  const ClassRefsMap* class_refs)
     : m_config_files(config_files)
 {
   m_classes = classes;
-  m_output = (uint8_t*)malloc(k_max_dex_size);
-  memset(m_output, 0, k_max_dex_size);
+  // calloc hands back demand-zero pages for a buffer this large, so only the
+  // pages the dex actually fills get committed, and there's no memset.
+  m_output = (uint8_t*)calloc(k_max_dex_size, 1);
+  always_assert_log(m_output != nullptr, "Can't allocate dex output buffer");
   m_offset = 0;
-  m_gtypes = new GatheredTypes(classes);
+  m_gtypes = new GatheredTypes(classes, class_refs);
+  if (profile != nullptr) {
+    m_gtypes->set_method_profile(profile->methods);
+    m_gtypes->set_coldstart_classes(profile->coldstart_classes);
+  }
   dodx = m_gtypes->get_dodx(m_output);
   m_filename = path;
   m_pos_mapper = pos_mapper,
@@ -458,6 +772,9 @@ DexOutput::DexOutput(
   m_class_mapping_filename = class_mapping_filename;
   m_pg_mapping_filename = pg_mapping_filename;
   m_bytecode_offset_filename = bytecode_offset_filename;
+  m_page_report_filename = page_report_filename;
+  m_profile = profile;
+  m_binary_symbol_files = binary_symbol_files;
   m_dex_number = dex_number;
   m_locator_index = locator_index;
 }
@@ -479,6 +796,47 @@ void DexOutput::insert_map_item(uint16_t maptype,
   m_map_items.emplace_back(item);
 }
 
+static uint32_t locator_entry_size(const Locator& locator) {
+  char buf[Locator::encoded_max];
+  size_t locator_length = locator.encode(buf);
+  return uleb128_encoding_size((uint32_t) locator_length) + locator_length + 1;
+}
+
+/*
+ * The strings used by the coldstart classes lead the string data. Each page
+ * of them that startup touches is a page fault, so start the section on a
+ * page boundary when that makes them span fewer pages. The padding between
+ * sections is zeros, which the calloc'd buffer already holds.
+ */
+void DexOutput::align_hot_strings(
+    const std::vector<DexString*>& string_order,
+    const std::vector<std::unique_ptr<Locator>>& locators) {
+  auto num_hot = std::min(m_gtypes->num_coldstart_strings(),
+                          string_order.size());
+  uint32_t hot_size = 0;
+  for (size_t i = 0; i < num_hot; ++i) {
+    if (locators[i]) {
+      hot_size += locator_entry_size(*locators[i]);
+    }
+    hot_size += string_order[i]->get_entry_size();
+  }
+  if (hot_size == 0) {
+    return;
+  }
+  auto pages_from = [&](uint32_t offset) {
+    return (offset % k_page_size + hot_size + k_page_size - 1) / k_page_size;
+  };
+  if (pages_from(m_offset) > pages_from(0)) {
+    auto padding = k_page_size - m_offset % k_page_size;
+    TRACE(CUSTOMSORT, 2, "padding %u bytes before the string data\n",
+          padding);
+    m_offset += padding;
+  }
+  m_stats.num_hot_string_pages = pages_from(m_offset);
+  TRACE(CUSTOMSORT, 1, "%lu coldstart strings of %u bytes span %d pages\n",
+        num_hot, hot_size, m_stats.num_hot_string_pages);
+}
+
 void DexOutput::emit_locator(Locator locator) {
   char buf[Locator::encoded_max];
   size_t locator_length = locator.encode(buf);
@@ -495,11 +853,11 @@ DexOutput::locator_for_descriptor(
 {
   LocatorIndex* locator_index = m_locator_index;
   if (locator_index != nullptr) {
-    auto locator_it = locator_index->find(descriptor);
-    if (locator_it != locator_index->end()) {
+    auto locator = locator_index->find(descriptor);
+    if (locator) {
       // This string is the name of a type we define in one of our
       // dex files.
-      return std::unique_ptr<Locator>(new Locator(locator_it->second));
+      return locator;
     }
 
     if (type_names.count(descriptor)) {
@@ -510,9 +868,9 @@ DexOutput::locator_for_descriptor(
         while (*s == '[') ++s;
         DexString* elementDescriptor = DexString::get_string(s);
         if (elementDescriptor != nullptr) {
-          locator_it = locator_index->find(elementDescriptor);
-          if (locator_it != locator_index->end()) {
-            return std::unique_ptr<Locator>(new Locator(locator_it->second));
+          locator = locator_index->find(elementDescriptor);
+          if (locator) {
+            return locator;
           }
         }
       }
@@ -528,6 +886,7 @@ DexOutput::locator_for_descriptor(
 }
 
 void DexOutput::generate_string_data(SortMode mode) {
+  Timeline::Span span("DexOutput::generate_string_data");
   /*
    * This is a index to position within the string data.  There
    * is no specific ordering specified here for the dex spec.
@@ -543,28 +902,44 @@ void DexOutput::generate_string_data(SortMode mode) {
   } else if (mode == SortMode::CLASS_STRINGS) {
     TRACE(CUSTOMSORT, 2, "using class names pack for string pool sorting\n");
     string_order = m_gtypes->keep_cls_strings_together_emitlist();
+  } else if (mode == SortMode::METHOD_PROFILE) {
+    TRACE(CUSTOMSORT, 2, "using method profile for string pool sorting\n");
+    string_order = m_gtypes->get_profile_order_dexstring_emitlist();
+  } else if (mode == SortMode::COLDSTART_PAGES) {
+    TRACE(CUSTOMSORT, 2, "using coldstart pages for string pool sorting\n");
+    string_order = m_gtypes->get_coldstart_order_dexstring_emitlist();
   } else {
     TRACE(CUSTOMSORT, 2, "using default string pool sorting\n");
     string_order = m_gtypes->get_dexstring_emitlist();
   }
   dex_string_id* stringids = (dex_string_id*)(m_output + hdr.string_ids_off);
 
-  std::unordered_set<DexString*> type_names = m_gtypes->index_type_names();
   unsigned locator_size = 0;
 
   // If we're generating locator strings, we need to include them in
-  // the total count of strings in this section.
+  // the total count of strings in this section. Look them up once, the
+  // count, the alignment and the emission all need them.
   size_t nrstr = string_order.size();
-  for (DexString* str : string_order) {
-    if (locator_for_descriptor(type_names, str)) {
-      nrstr += 1;
+  std::vector<std::unique_ptr<Locator>> locators(string_order.size());
+  if (m_locator_index != nullptr) {
+    std::unordered_set<DexString*> type_names = m_gtypes->index_type_names();
+    for (size_t i = 0; i < string_order.size(); ++i) {
+      locators[i] = locator_for_descriptor(type_names, string_order[i]);
+      if (locators[i]) {
+        nrstr += 1;
+      }
     }
   }
 
+  if (mode == SortMode::COLDSTART_PAGES) {
+    align_hot_strings(string_order, locators);
+  }
+
   insert_map_item(TYPE_STRING_DATA_ITEM, (uint32_t) nrstr, m_offset);
-  for (DexString* str : string_order) {
+  for (size_t i = 0; i < string_order.size(); ++i) {
+    DexString* str = string_order[i];
     // Emit lookup acceleration string if requested
-    std::unique_ptr<Locator> locator = locator_for_descriptor(type_names, str);
+    const auto& locator = locators[i];
     if (locator) {
       unsigned orig_offset = m_offset;
       emit_locator(*locator);
@@ -717,7 +1092,8 @@ void DexOutput::generate_class_data() {
   }
 }
 
-void DexOutput::generate_class_data_items() {
+void DexOutput::generate_class_data_items(
+    const std::vector<SortMode>& code_mode) {
   /*
    * First generate a dexcode_to_offset needed for the encoding
    * of class_data_items
@@ -728,41 +1104,171 @@ void DexOutput::generate_class_data_items() {
     uint32_t offset = (uint32_t) (((uint8_t*)it.second) - m_output);
     dco[it.first] = offset;
   }
-  for (uint32_t i = 0; i < hdr.class_defs_size; i++) {
-    DexClass* clz = m_classes->at(i);
+  // The class data items are only reached through the class defs, so they can
+  // follow the code instead of the class def order.
+  std::vector<DexClass*> classes;
+  if (std::find(code_mode.begin(), code_mode.end(),
+                SortMode::METHOD_PROFILE) != code_mode.end()) {
+    classes = m_gtypes->get_profile_order_class_emitlist();
+  } else {
+    classes.assign(m_classes->begin(), m_classes->end());
+  }
+  if (coldstart_class_data_first()) {
+    m_gtypes->sort_coldstart_first(classes, [](DexClass* cls) { return cls; });
+  }
+  uint32_t hot_size = 0;
+  for (DexClass* clz : classes) {
     if (!clz->has_class_data()) continue;
     /* No alignment constraints for this data */
     int size = clz->encode(dodx, dco, m_output + m_offset);
     m_cdi_offsets[clz] = m_offset;
+    m_cdi_sizes[clz] = size;
     m_offset += size;
+    if (m_gtypes->is_coldstart_class(clz)) {
+      hot_size += size;
+    }
   }
   insert_map_item(TYPE_CLASS_DATA_ITEM, (uint32_t) m_cdi_offsets.size(), cdi_start);
+  if (coldstart_class_data_first() && hot_size > 0) {
+    m_stats.num_hot_class_data_pages =
+        (cdi_start % k_page_size + hot_size + k_page_size - 1) / k_page_size;
+    TRACE(CUSTOMSORT, 1,
+          "class data of the coldstart classes: %u bytes over %d pages\n",
+          hot_size, m_stats.num_hot_class_data_pages);
+  }
+}
+
+/*
+ * The order in which the static values and annotations of the classes are
+ * emitted. Neither is reached but through the class defs, so with
+ * coldstart_class_data_first, those of the coldstart classes lead.
+ */
+std::vector<DexClass*> DexOutput::get_class_data_emitlist() {
+  std::vector<DexClass*> classes(m_classes->begin(), m_classes->end());
+  if (coldstart_class_data_first()) {
+    m_gtypes->sort_coldstart_first(classes, [](DexClass* cls) { return cls; });
+  }
+  return classes;
 }
 
-static void sync_all(const Scope& scope) {
+/**
+ * When things move around in redex, we might find ourselves in a situation
+ * where a regular OPCODE_CONST_STRING is now referring to a jumbo string,
+ * or vice versea. This fixup ensures that all const string opcodes agree
+ * with the jumbo-ness of their stridx.
+ */
+static void fix_method_jumbos(DexMethod* method, const DexOutputIdx* dodx) {
+  if (method->is_balloon_pending()) {
+    // Flipping the opcode would change the instruction's size, which the
+    // branch offsets in the original DexCode don't account for. Let the IR
+    // path re-lay the method out if any string changed jumbo-ness.
+    auto dex_code = method->get_dex_code();
+    bool mismatch = false;
+    for (auto insn : dex_code->get_instructions()) {
+      auto op = insn->opcode();
+      if (op != DOPCODE_CONST_STRING && op != DOPCODE_CONST_STRING_JUMBO) {
+        continue;
+      }
+      auto str = static_cast<DexOpcodeString*>(insn)->get_string();
+      bool jumbo = ((dodx->stringidx(str) >> 16) != 0);
+      if (jumbo != (op == DOPCODE_CONST_STRING_JUMBO)) {
+        mismatch = true;
+        break;
+      }
+    }
+    if (!mismatch) {
+      return;
+    }
+  }
+  auto code = method->get_code();
+  if (!code) return; // nothing to do for native methods
+
+  for (auto& mie : *code) {
+    if (mie.type != MFLOW_DEX_OPCODE) {
+      continue;
+    }
+    auto insn = mie.dex_insn;
+    auto op = insn->opcode();
+    if (op != DOPCODE_CONST_STRING && op != DOPCODE_CONST_STRING_JUMBO) {
+      continue;
+    }
+
+    auto str = static_cast<DexOpcodeString*>(insn)->get_string();
+    uint32_t stridx = dodx->stringidx(str);
+    bool jumbo = ((stridx >> 16) != 0);
+
+    if (jumbo) {
+      insn->set_opcode(DOPCODE_CONST_STRING_JUMBO);
+    } else if (!jumbo) {
+      insn->set_opcode(DOPCODE_CONST_STRING);
+    }
+  }
+}
+
+/*
+ * Fixes up the jumbo-ness of the const-strings of the method, which may
+ * balloon it, and then syncs it if it was ballooned. Only methods that were
+ * ballooned need syncing. The rest still hold the DexCode they were loaded
+ * with, and since nothing looked at them, it can be written out unchanged.
+ */
+static void sync_method(DexMethod* m, const DexOutputIdx* dodx) {
+  fix_method_jumbos(m, dodx);
+  if (m->is_balloon_pending() || m->get_code() == nullptr) {
+    return;
+  }
+  TRACE(MTRANS, 2, "Syncing %s\n", SHOW(m));
+  m->sync();
+}
+
+/*
+ * Both steps are done in a single parallel pass over the methods, since the
+ * string indices are known by the time the code items are generated.
+ */
+static void sync_all(const Scope& scope, const DexOutputIdx* dodx) {
   constexpr bool serial = false; // for debugging
-  auto wq = workqueue_foreach<DexMethod*>([](DexMethod* m){m->sync();});
-  walk::code(scope,
-            [](DexMethod*) { return true; },
-            [&](DexMethod* m, IRCode&) {
-              if (serial) {
-                TRACE(MTRANS, 2, "Syncing %s\n", SHOW(m));
-                m->sync();
-              } else {
-                wq.add_item(m);
-              }
-            });
+  auto wq = workqueue_foreach<DexMethod*>(
+      [dodx](DexMethod* m) { sync_method(m, dodx); });
+  walk::methods(scope, [&](DexMethod* m) {
+    if (serial) {
+      sync_method(m, dodx);
+    } else {
+      wq.add_item(m);
+    }
+  });
   wq.run_all();
 }
 
+/*
+ * An upper bound on the number of bytes DexCode::encode() writes for `code`.
+ */
+static size_t max_code_item_size(const DexCode* code) {
+  constexpr size_t max_uleb128_size = 5;
+  size_t size = sizeof(dex_code_item);
+  for (auto const& insn : code->get_instructions()) {
+    size += insn->size() * sizeof(uint16_t);
+  }
+  auto const& tries = code->get_tries();
+  if (!tries.empty()) {
+    // Padding, the try items, and the handler list size.
+    size += sizeof(uint16_t) + tries.size() * sizeof(dex_tries_item) +
+            max_uleb128_size;
+    for (auto const& dextry : tries) {
+      size += max_uleb128_size +
+              dextry->m_catches.size() * 2 * max_uleb128_size;
+    }
+  }
+  return size;
+}
+
 void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
+  Timeline::Span span("DexOutput::generate_code_items");
   /*
    * Optimization note:  We should pass a sort routine to the
    * emitlist to optimize pagecache efficiency.
    */
   align_output();
   uint32_t ci_start = m_offset;
-  sync_all(*m_classes);
+  sync_all(*m_classes, dodx);
 
   // Get all methods.
   std::vector<DexMethod*> lmeth = m_gtypes->get_dexmethod_emitlist();
@@ -780,6 +1286,11 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
         m_gtypes->sort_dexmethod_emitlist_clinit_order(lmeth);
         break;
 
+      case SortMode::METHOD_PROFILE:
+        TRACE(CUSTOMSORT, 2, "using method profile for bytecode sorting\n");
+        m_gtypes->sort_dexmethod_emitlist_profile_order(lmeth);
+        break;
+
       case SortMode::CLASS_STRINGS:
         TRACE(CUSTOMSORT, 2, "Unsupport bytecode sorting method SortMode::CLASS_STRINGS");
         break;
@@ -789,24 +1300,65 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
         break;
     }
   }
+  std::vector<DexMethod*> emit_methods;
   for (DexMethod* meth : lmeth) {
     if (meth->get_access() & (ACC_ABSTRACT | ACC_NATIVE)) {
       // There is no code item for ABSTRACT or NATIVE methods.
       continue;
     }
     TRACE(CUSTOMSORT, 3, "method emit %s %s\n", SHOW(meth->get_class()), SHOW(meth));
-    DexCode* code = meth->get_dex_code();
     always_assert_log(
-        meth->is_concrete() && code != nullptr,
+        meth->is_concrete() && meth->get_dex_code() != nullptr,
         "Undefined method in generate_code_items()\n\t prototype: %s\n", SHOW(meth));
+    emit_methods.push_back(meth);
+  }
+
+  /*
+   * The encoded size of a code item depends on the uleb128 width of the type
+   * indices in its handlers, so we can't lay the items out without encoding
+   * them. Encode each one into its own scratch buffer in parallel, assign the
+   * offsets serially, then copy the items into place in parallel. The output
+   * is byte-for-byte what encoding them one after another would give.
+   */
+  std::vector<std::vector<uint32_t>> encoded(emit_methods.size());
+  std::vector<uint32_t> sizes(emit_methods.size());
+  auto encode_wq = workqueue_foreach<size_t>([&](size_t i) {
+    DexCode* code = emit_methods[i]->get_dex_code();
+    size_t capacity = max_code_item_size(code);
+    // Zero-filled, so alignment padding matches the zeroed output buffer.
+    encoded[i].resize((capacity + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+    sizes[i] = code->encode(dodx, encoded[i].data());
+    always_assert(sizes[i] <= capacity);
+  });
+  for (size_t i = 0; i < emit_methods.size(); ++i) {
+    encode_wq.add_item(i);
+  }
+  encode_wq.run_all();
+
+  std::vector<uint32_t> offsets(emit_methods.size());
+  for (size_t i = 0; i < emit_methods.size(); ++i) {
+    DexMethod* meth = emit_methods[i];
+    DexCode* code = meth->get_dex_code();
     align_output();
-    int size = code->encode(dodx, (uint32_t*)(m_output + m_offset));
+    offsets[i] = m_offset;
     m_method_bytecode_offsets.emplace_back(meth->get_name()->c_str(), m_offset);
     m_code_item_emits.emplace_back(code,
                                    (dex_code_item*)(m_output + m_offset));
-    m_offset += size;
+    m_code_item_extents.emplace(meth, std::make_pair(m_offset, sizes[i]));
+    m_offset += sizes[i];
     m_stats.num_instructions += code->get_instructions().size();
   }
+  always_assert_log(m_offset <= k_max_dex_size,
+                    "Code items overflow the output buffer");
+
+  auto copy_wq = workqueue_foreach<size_t>([&](size_t i) {
+    memcpy(m_output + offsets[i], encoded[i].data(), sizes[i]);
+    std::vector<uint32_t>().swap(encoded[i]);
+  });
+  for (size_t i = 0; i < emit_methods.size(); ++i) {
+    copy_wq.add_item(i);
+  }
+  copy_wq.run_all();
   insert_map_item(TYPE_CODE_ITEM, (uint32_t) m_code_item_emits.size(), ci_start);
 }
 
@@ -816,8 +1368,7 @@ void DexOutput::generate_static_values() {
                      uint32_t,
                      boost::hash<DexEncodedValueArray>>
       enc_arrays;
-  for (uint32_t i = 0; i < hdr.class_defs_size; i++) {
-    DexClass* clz = m_classes->at(i);
+  for (DexClass* clz : get_class_data_emitlist()) {
     // Fields need to be sorted otherwise static values may end up out of order
     auto& sfields = clz->get_sfields();
     std::sort(sfields.begin(), sfields.end(), compare_dexfields);
@@ -834,6 +1385,7 @@ void DexOutput::generate_static_values() {
       deva->encode(dodx, output);
       enc_arrays.emplace(std::move(*deva.release()), m_offset);
       m_static_values[clz] = m_offset;
+      m_static_value_sizes[m_offset] = output - outputsv;
       m_offset += output - outputsv;
       m_stats.num_static_values++;
     }
@@ -848,25 +1400,70 @@ static bool annotation_cmp(const DexAnnotationDirectory* a,
   return (a->viz_score() < b->viz_score());
 }
 
+namespace {
+
+/*
+ * Encoded annotation items are deduplicated by content. Hashing the encoded
+ * bytes is much cheaper than the lexicographic compares of an ordered map.
+ */
+template <typename Unit>
+using EncodedItemOffsets =
+    std::unordered_map<std::vector<Unit>, uint32_t,
+                       boost::hash<std::vector<Unit>>>;
+
+/*
+ * Returns the items of `list` that aren't in `seen` yet, each once, in order
+ * of first appearance, so the emitted layout matches a serial walk.
+ */
+template <typename T, typename Map>
+std::vector<T*> unseen_items(const std::vector<T*>& list, const Map& seen) {
+  std::vector<T*> result;
+  std::unordered_set<T*> queued;
+  for (auto item : list) {
+    if (!seen.count(item) && queued.insert(item).second) {
+      result.push_back(item);
+    }
+  }
+  return result;
+}
+
+/*
+ * Runs `encode(i)` for each i in [0, count) on the thread pool.
+ */
+void encode_in_parallel(size_t count,
+                        const std::function<void(size_t)>& encode) {
+  auto wq = workqueue_foreach<size_t>(encode);
+  for (size_t i = 0; i < count; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+}
+
+} // namespace
+
 void DexOutput::unique_annotations(annomap_t& annomap,
                                    std::vector<DexAnnotation*>& annolist) {
   int annocnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint8_t>, uint32_t> annotation_byte_offsets;
-  for (auto anno : annolist) {
-    if (annomap.count(anno)) continue;
-    std::vector<uint8_t> annotation_bytes;
-    anno->vencode(dodx, annotation_bytes);
-    if (annotation_byte_offsets.count(annotation_bytes)) {
-      annomap[anno] = annotation_byte_offsets[annotation_bytes];
+  auto annos = unseen_items(annolist, annomap);
+  std::vector<std::vector<uint8_t>> encoded(annos.size());
+  encode_in_parallel(annos.size(), [&](size_t i) {
+    annos[i]->vencode(dodx, encoded[i]);
+  });
+  EncodedItemOffsets<uint8_t> annotation_byte_offsets;
+  for (size_t i = 0; i < annos.size(); ++i) {
+    auto anno = annos[i];
+    auto emplaced =
+        annotation_byte_offsets.emplace(std::move(encoded[i]), m_offset);
+    if (!emplaced.second) {
+      annomap[anno] = emplaced.first->second;
       continue;
     }
-    /* Insert new annotation in tracking structs */
-    annotation_byte_offsets[annotation_bytes] = m_offset;
     annomap[anno] = m_offset;
     /* Not a dupe, encode... */
+    auto& annotation_bytes = emplaced.first->first;
     uint8_t* annoout = (uint8_t*)(m_output + m_offset);
-    memcpy(annoout, &annotation_bytes[0], annotation_bytes.size());
+    memcpy(annoout, annotation_bytes.data(), annotation_bytes.size());
     m_offset += annotation_bytes.size();
     annocnt++;
   }
@@ -881,21 +1478,24 @@ void DexOutput::unique_asets(annomap_t& annomap,
                              std::vector<DexAnnotationSet*>& asetlist) {
   int asetcnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> aset_offsets;
-  for (auto aset : asetlist) {
-    if (asetmap.count(aset)) continue;
-    std::vector<uint32_t> aset_bytes;
-    aset->vencode(dodx, aset_bytes, annomap);
-    if (aset_offsets.count(aset_bytes)) {
-      asetmap[aset] = aset_offsets[aset_bytes];
+  auto asets = unseen_items(asetlist, asetmap);
+  std::vector<std::vector<uint32_t>> encoded(asets.size());
+  encode_in_parallel(asets.size(), [&](size_t i) {
+    asets[i]->vencode(dodx, encoded[i], annomap);
+  });
+  EncodedItemOffsets<uint32_t> aset_offsets;
+  for (size_t i = 0; i < asets.size(); ++i) {
+    auto aset = asets[i];
+    auto emplaced = aset_offsets.emplace(std::move(encoded[i]), m_offset);
+    if (!emplaced.second) {
+      asetmap[aset] = emplaced.first->second;
       continue;
     }
-    /* Insert new aset in tracking structs */
-    aset_offsets[aset_bytes] = m_offset;
     asetmap[aset] = m_offset;
     /* Not a dupe, encode... */
+    auto& aset_bytes = emplaced.first->first;
     uint8_t* asetout = (uint8_t*)(m_output + m_offset);
-    memcpy(asetout, &aset_bytes[0], aset_bytes.size() * sizeof(uint32_t));
+    memcpy(asetout, aset_bytes.data(), aset_bytes.size() * sizeof(uint32_t));
     m_offset += aset_bytes.size() * sizeof(uint32_t);
     asetcnt++;
   }
@@ -909,7 +1509,7 @@ void DexOutput::unique_xrefs(asetmap_t& asetmap,
                              std::vector<ParamAnnotations*>& xreflist) {
   int xrefcnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> xref_offsets;
+  EncodedItemOffsets<uint32_t> xref_offsets;
   for (auto xref : xreflist) {
     if (xrefmap.count(xref)) continue;
     std::vector<uint32_t> xref_bytes;
@@ -920,17 +1520,17 @@ void DexOutput::unique_xrefs(asetmap_t& asetmap,
                         "Uninitialized aset %p '%s'", das, SHOW(das));
       xref_bytes.push_back(asetmap[das]);
     }
-    if (xref_offsets.count(xref_bytes)) {
-      xrefmap[xref] = xref_offsets[xref_bytes];
+    auto emplaced = xref_offsets.emplace(std::move(xref_bytes), m_offset);
+    if (!emplaced.second) {
+      xrefmap[xref] = emplaced.first->second;
       continue;
     }
-    /* Insert new xref in tracking structs */
-    xref_offsets[xref_bytes] = m_offset;
     xrefmap[xref] = m_offset;
     /* Not a dupe, encode... */
+    auto& encoded = emplaced.first->first;
     uint8_t* xrefout = (uint8_t*)(m_output + m_offset);
-    memcpy(xrefout, &xref_bytes[0], xref_bytes.size() * sizeof(uint32_t));
-    m_offset += xref_bytes.size() * sizeof(uint32_t);
+    memcpy(xrefout, encoded.data(), encoded.size() * sizeof(uint32_t));
+    m_offset += encoded.size() * sizeof(uint32_t);
     xrefcnt++;
   }
   if (xrefcnt) {
@@ -944,21 +1544,24 @@ void DexOutput::unique_adirs(asetmap_t& asetmap,
                              std::vector<DexAnnotationDirectory*>& adirlist) {
   int adircnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> adir_offsets;
-  for (auto adir : adirlist) {
-    if (adirmap.count(adir)) continue;
-    std::vector<uint32_t> adir_bytes;
-    adir->vencode(dodx, adir_bytes, xrefmap, asetmap);
-    if (adir_offsets.count(adir_bytes)) {
-      adirmap[adir] = adir_offsets[adir_bytes];
+  auto adirs = unseen_items(adirlist, adirmap);
+  std::vector<std::vector<uint32_t>> encoded(adirs.size());
+  encode_in_parallel(adirs.size(), [&](size_t i) {
+    adirs[i]->vencode(dodx, encoded[i], xrefmap, asetmap);
+  });
+  EncodedItemOffsets<uint32_t> adir_offsets;
+  for (size_t i = 0; i < adirs.size(); ++i) {
+    auto adir = adirs[i];
+    auto emplaced = adir_offsets.emplace(std::move(encoded[i]), m_offset);
+    if (!emplaced.second) {
+      adirmap[adir] = emplaced.first->second;
       continue;
     }
-    /* Insert new adir in tracking structs */
-    adir_offsets[adir_bytes] = m_offset;
     adirmap[adir] = m_offset;
     /* Not a dupe, encode... */
+    auto& adir_bytes = emplaced.first->first;
     uint8_t* adirout = (uint8_t*)(m_output + m_offset);
-    memcpy(adirout, &adir_bytes[0], adir_bytes.size() * sizeof(uint32_t));
+    memcpy(adirout, adir_bytes.data(), adir_bytes.size() * sizeof(uint32_t));
     m_offset += adir_bytes.size() * sizeof(uint32_t);
     adircnt++;
   }
@@ -968,6 +1571,7 @@ void DexOutput::unique_adirs(asetmap_t& asetmap,
 }
 
 void DexOutput::generate_annotations() {
+  Timeline::Span span("DexOutput::generate_annotations");
   /*
    * There are five phases to generating annotations:
    * 1) Emit annotations
@@ -998,6 +1602,13 @@ void DexOutput::generate_annotations() {
     }
   }
   std::sort(lad.begin(), lad.end(), annotation_cmp);
+  if (coldstart_class_data_first()) {
+    // The annotations the coldstart classes use are emitted first, in each of
+    // the four sections.
+    m_gtypes->sort_coldstart_first(lad, [&](DexAnnotationDirectory* ad) {
+      return m_classes->at(ad_to_classnum[ad]);
+    });
+  }
   std::vector<DexAnnotation*> annolist;
   std::vector<DexAnnotationSet*> asetlist;
   std::vector<ParamAnnotations*> xreflist;
@@ -1015,22 +1626,56 @@ void DexOutput::generate_annotations() {
     int class_num = ad_to_classnum[ad];
     dex_class_def* cdefs = (dex_class_def*)(m_output + hdr.class_defs_off);
     cdefs[class_num].annotations_off = adirmap[ad];
+    m_annotation_dir_extents[m_classes->at(class_num)] =
+        std::make_pair(adirmap[ad], (uint32_t)ad->annodir_size());
     delete ad;
   }
 }
 
+namespace {
+
+// An encoded debug info item in the output buffer, compared by its bytes.
+struct EncodedDebugItem {
+  const uint8_t* data;
+  uint32_t size;
+
+  bool operator==(const EncodedDebugItem& other) const {
+    return size == other.size && memcmp(data, other.data, size) == 0;
+  }
+};
+
+struct EncodedDebugItemHash {
+  size_t operator()(const EncodedDebugItem& item) const {
+    return boost::hash_range(item.data, item.data + item.size);
+  }
+};
+
+} // namespace
+
 void DexOutput::generate_debug_items() {
   uint32_t dbg_start = m_offset;
   int dbgcount = 0;
+  // Code items whose debug info encodes to the same bytes share one item,
+  // which is common once line numbers are all that is left of it.
+  std::unordered_map<EncodedDebugItem, uint32_t, EncodedDebugItemHash>
+      item_offsets;
   for (auto& it : m_code_item_emits) {
     DexCode* dc = it.first;
     dex_code_item* dci = it.second;
     auto dbg = dc->get_debug_item();
     if (dbg == nullptr) continue;
-    dbgcount++;
-    // No align requirement for debug items.
+    // No align requirement for debug items. The encoding has to go through
+    // the position mapper in order, so it's only the result we share.
     int size = dbg->encode(dodx, m_pos_mapper, m_output + m_offset);
-    dci->debug_info_off = m_offset;
+    EncodedDebugItem item{m_output + m_offset, static_cast<uint32_t>(size)};
+    auto inserted = item_offsets.emplace(item, m_offset);
+    dci->debug_info_off = inserted.first->second;
+    if (!inserted.second) {
+      memset(m_output + m_offset, 0, size);
+      m_stats.num_shared_debug_items++;
+      continue;
+    }
+    dbgcount++;
     m_offset += size;
   }
   insert_map_item(TYPE_DEBUG_INFO_ITEM, dbgcount, dbg_start);
@@ -1049,42 +1694,6 @@ void DexOutput::generate_map() {
   m_offset += ((uint8_t*)map) - ((uint8_t*)mapout);
 }
 
-/**
- * When things move around in redex, we might find ourselves in a situation
- * where a regular OPCODE_CONST_STRING is now referring to a jumbo string,
- * or vice versea. This fixup ensures that all const string opcodes agree
- * with the jumbo-ness of their stridx.
- */
-static void fix_method_jumbos(DexMethod* method, const DexOutputIdx* dodx) {
-  auto code = method->get_code();
-  if (!code) return; // nothing to do for native methods
-
-  for (auto& mie : *code) {
-    if (mie.type != MFLOW_DEX_OPCODE) {
-      continue;
-    }
-    auto insn = mie.dex_insn;
-    auto op = insn->opcode();
-    if (op != DOPCODE_CONST_STRING && op != DOPCODE_CONST_STRING_JUMBO) {
-      continue;
-    }
-
-    auto str = static_cast<DexOpcodeString*>(insn)->get_string();
-    uint32_t stridx = dodx->stringidx(str);
-    bool jumbo = ((stridx >> 16) != 0);
-
-    if (jumbo) {
-      insn->set_opcode(DOPCODE_CONST_STRING_JUMBO);
-    } else if (!jumbo) {
-      insn->set_opcode(DOPCODE_CONST_STRING);
-    }
-  }
-}
-
-static void fix_jumbos(DexClasses* classes, DexOutputIdx* dodx) {
-  walk::methods(*classes, [&](DexMethod* m) { fix_method_jumbos(m, dodx); });
-}
-
 void DexOutput::init_header_offsets() {
   memcpy(hdr.magic, DEX_HEADER_DEXMAGIC, sizeof(hdr.magic));
   insert_map_item(TYPE_HEADER_ITEM, 1, 0);
@@ -1153,13 +1762,25 @@ namespace {
 void write_method_mapping(
   const std::string& filename,
   const DexOutputIdx* dodx,
-  uint8_t* dex_signature
+  uint8_t* dex_signature,
+  bool binary
 ) {
   if (filename.empty()) return;
-  FILE* fd = fopen(filename.c_str(), "a");
-  assert_log(fd, "Can't open method mapping file %s: %s\n",
-             filename.c_str(),
-             strerror(errno));
+  //
+  // Turns out, the checksum can change on-device. (damn you dexopt)
+  // The signature, however, is never recomputed. Let's log the top 4 bytes,
+  // in little-endian (since that's faster to compute on-device).
+  //
+  uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
+  binary_mapping::Writer writer(binary_mapping::Kind::METHOD_MAPPING,
+                                signature);
+  FILE* fd = nullptr;
+  if (!binary) {
+    fd = fopen(filename.c_str(), "a");
+    assert_log(fd, "Can't open method mapping file %s: %s\n",
+               filename.c_str(),
+               strerror(errno));
+  }
   for (auto& it : dodx->method_to_idx()) {
     auto method = it.first;
     auto idx = it.second;
@@ -1205,30 +1826,38 @@ void write_method_mapping(
     auto end = deobf_method.rfind(':');
     auto deobf_method_name = deobf_method.substr(begin, end-begin);
 
-    //
-    // Turns out, the checksum can change on-device. (damn you dexopt)
-    // The signature, however, is never recomputed. Let's log the top 4 bytes,
-    // in little-endian (since that's faster to compute on-device).
-    //
-    uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
-
+    if (binary) {
+      writer.add(idx, deobf_method_name, deobf_class);
+      continue;
+    }
     fprintf(fd, "%u %u %s %s\n",
             idx,
             signature,
             deobf_method_name.c_str(),
             deobf_class.c_str());
   }
-  fclose(fd);
+  if (binary) {
+    writer.append_to(filename);
+  } else {
+    fclose(fd);
+  }
 }
 
 void write_class_mapping(
   const std::string& filename,
   DexClasses* classes,
   const size_t class_defs_size,
-  uint8_t* dex_signature
+  uint8_t* dex_signature,
+  bool binary
 ) {
   if (filename.empty()) return;
-  FILE* fd = fopen(filename.c_str(), "a");
+  //
+  // See write_method_mapping above for why checksum is insufficient.
+  //
+  uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
+  binary_mapping::Writer writer(binary_mapping::Kind::CLASS_MAPPING,
+                                signature);
+  FILE* fd = binary ? nullptr : fopen(filename.c_str(), "a");
 
   for (uint32_t idx = 0; idx < class_defs_size; idx++) {
 
@@ -1241,14 +1870,18 @@ void write_class_mapping(
       return proguard_name(cls);
     }();
 
-    //
-    // See write_method_mapping above for why checksum is insufficient.
-    //
-    uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
-    fprintf(fd, "%u %u %s\n", idx, signature, deobf_class.c_str());
+    if (binary) {
+      writer.add(idx, deobf_class);
+    } else {
+      fprintf(fd, "%u %u %s\n", idx, signature, deobf_class.c_str());
+    }
   }
 
-  fclose(fd);
+  if (binary) {
+    writer.append_to(filename);
+  } else {
+    fclose(fd);
+  }
 }
 
 const char* deobf_primitive(char type) {
@@ -1277,16 +1910,19 @@ const char* deobf_primitive(char type) {
   }
 }
 
-void write_pg_mapping(const std::string& filename, DexClasses* classes) {
-  if (filename.empty()) return;
+std::string deobf_class(DexClass* cls) {
+  if (cls) {
+    auto deobname = cls->get_deobfuscated_name();
+    if (!deobname.empty()) return deobname;
+  }
+  return proguard_name(cls);
+}
 
-  auto deobf_class = [&](DexClass* cls) {
-    if (cls) {
-      auto deobname = cls->get_deobfuscated_name();
-      if (!deobname.empty()) return deobname;
-    }
-    return proguard_name(cls);
-  };
+void write_pg_mapping(const std::string& filename,
+                      DexClasses* classes,
+                      uint8_t* dex_signature,
+                      bool binary) {
+  if (filename.empty()) return;
 
   auto deobf_type = [&](DexType* type) {
     if (type) {
@@ -1380,38 +2016,105 @@ void write_pg_mapping(const std::string& filename, DexClasses* classes) {
     return proguard_name(field);
   };
 
-  std::ofstream ofs(filename.c_str(), std::ofstream::out | std::ofstream::app);
-
-  for (auto cls : *classes) {
-    auto deobf_cls = deobf_class(cls);
-    ofs << JavaNameUtil::internal_to_external(deobf_cls) << " -> "
-        << JavaNameUtil::internal_to_external(cls->get_type()->c_str())
-        << ":" << std::endl;
+  // The lines of each class are formatted in parallel, and then written out
+  // in order. The binary map is keyed by the obfuscated class or member, and
+  // holds the text lines.
+  struct Line {
+    std::string key;
+    std::string text;
+  };
+  std::vector<std::vector<Line>> class_lines(classes->size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto cls = classes->at(i);
+    auto& lines = class_lines[i];
+    auto add = [&](const auto* item, std::string text) {
+      lines.push_back({binary ? show(item) : "", std::move(text)});
+    };
+    add(cls->get_type(),
+        JavaNameUtil::internal_to_external(deobf_class(cls)) + " -> " +
+            JavaNameUtil::internal_to_external(cls->get_type()->c_str()) +
+            ":");
     for (auto field : cls->get_ifields()) {
-      auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      add(field, "    " + deobf_field(field) + " -> " + field->c_str());
     }
     for (auto field : cls->get_sfields()) {
-      auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      add(field, "    " + deobf_field(field) + " -> " + field->c_str());
     }
     for (auto meth : cls->get_dmethods()) {
-      auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      add(meth, "    " + deobf_meth(meth) + " -> " + meth->c_str());
     }
     for (auto meth : cls->get_vmethods()) {
-      auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      add(meth, "    " + deobf_meth(meth) + " -> " + meth->c_str());
+    }
+  });
+  for (size_t i = 0; i < classes->size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  if (binary) {
+    binary_mapping::Writer writer(binary_mapping::Kind::PG_MAPPING,
+                                  *reinterpret_cast<uint32_t*>(dex_signature));
+    for (const auto& lines : class_lines) {
+      for (const auto& line : lines) {
+        writer.add(0, line.key, line.text);
+      }
+    }
+    writer.append_to(filename);
+    return;
+  }
+  std::string text;
+  for (const auto& lines : class_lines) {
+    for (const auto& line : lines) {
+      text += line.text;
+      text += '\n';
     }
   }
+  std::ofstream ofs(filename.c_str(), std::ofstream::out | std::ofstream::app);
+  ofs.write(text.data(), text.size());
+}
+
+/*
+ * The ProGuard map to merge the class names into, if the output map is to be
+ * merged: with the default "merge" strategy, a non-empty input map, and text
+ * symbol files. Otherwise each dex appends its classes to the output map.
+ */
+std::string pg_mapping_to_merge(const Json::Value& json_cfg) {
+  if (json_cfg.get("proguard_map_output", "").asString().empty() ||
+      json_cfg.get("proguard_map_output_strategy", "merge").asString() !=
+          "merge" ||
+      json_cfg.get("symbol_file_format", "text").asString() != "text") {
+    return "";
+  }
+  auto pg_map = json_cfg.get("proguard_map", "").asString();
+  boost::system::error_code ec;
+  // If -dontobfuscate is set, ProGuard doesn't write a map, but buck creates
+  // an empty one.
+  if (pg_map.empty() || boost::filesystem::file_size(pg_map, ec) == 0 || ec) {
+    return "";
+  }
+  return pg_map;
 }
 
 void write_bytecode_offset_mapping(
   const std::string& filename,
-  const std::vector<std::pair<std::string, uint32_t>>& method_offsets
+  const std::vector<std::pair<std::string, uint32_t>>& method_offsets,
+  uint8_t* dex_signature,
+  bool binary
 ) {
   if (filename.empty()) { return; }
 
+  if (binary) {
+    binary_mapping::Writer writer(
+        binary_mapping::Kind::BYTECODE_OFFSETS,
+        *reinterpret_cast<uint32_t*>(dex_signature));
+    for (const auto& item : method_offsets) {
+      writer.add(item.second, item.first);
+    }
+    writer.append_to(filename);
+    return;
+  }
+
   auto fd = fopen(filename.c_str(), "a");
   assert_log(fd, "Can't open bytecode offset file %s: %s\n",
              filename.c_str(),
@@ -1426,62 +2129,292 @@ void write_bytecode_offset_mapping(
 
 } // namespace
 
+void write_merged_pg_mapping(const DexStoresVector& stores,
+                             ConfigFiles& cfg,
+                             const Json::Value& json_cfg) {
+  auto pg_map = pg_mapping_to_merge(json_cfg);
+  if (pg_map.empty()) {
+    return;
+  }
+  Timer t("Writing merged proguard map");
+  // The original name and the output name of each class, in output order.
+  std::vector<std::pair<std::string, std::string>> class_names;
+  for (auto& store : stores) {
+    for (auto& dex : store.get_dexen()) {
+      for (auto cls : dex) {
+        class_names.emplace_back(
+            JavaNameUtil::internal_to_external(deobf_class(cls)),
+            JavaNameUtil::internal_to_external(cls->get_type()->c_str()));
+      }
+    }
+  }
+  std::unordered_map<std::string, size_t> class_idx;
+  for (size_t i = 0; i < class_names.size(); ++i) {
+    class_idx.emplace(class_names[i].first, i);
+  }
+  std::vector<bool> written(class_names.size());
+
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(pg_map);
+  } catch (const std::exception&) {
+    always_assert_log(false, "Can't open proguard map: %s\n", pg_map.c_str());
+  }
+  auto filename =
+      cfg.metafile(json_cfg.get("proguard_map_output", "").asString());
+  std::ofstream ofs(filename.c_str(), std::ofstream::out | std::ofstream::trunc);
+  // Copy the input map a line at a time, giving each class line of a class
+  // that was written its output name. Member lines are kept as they are.
+  const char* p = file.data();
+  const char* end = p + file.size();
+  while (p < end) {
+    auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    auto next = eol ? eol + 1 : end;
+    auto line_end = eol ? eol : end;
+    while (line_end > p && isspace(static_cast<unsigned char>(line_end[-1]))) {
+      --line_end;
+    }
+    std::string line(p, line_end);
+    p = next;
+    if (!line.empty() && line[0] != ' ' && line[0] != '#' &&
+        line.back() == ':') {
+      auto arrow = line.rfind(" -> ");
+      if (arrow != std::string::npos) {
+        auto it = class_idx.find(line.substr(0, arrow));
+        if (it != class_idx.end()) {
+          written[it->second] = true;
+          ofs << it->first << " -> " << class_names[it->second].second << ":\n";
+          continue;
+        }
+      }
+    }
+    ofs << line << '\n';
+  }
+  // Then the classes the input map doesn't have, e.g. the ones redex created.
+  for (size_t i = 0; i < class_names.size(); ++i) {
+    if (!written[i]) {
+      ofs << class_names[i].first << " -> " << class_names[i].second << ":\n";
+    }
+  }
+}
+
 void DexOutput::write_symbol_files() {
+  Timeline::Span span("DexOutput::write_symbol_files");
+  if (!m_released_positions.empty()) {
+    m_pos_mapper->keep_positions(std::move(m_released_positions));
+    m_released_positions.clear();
+  }
   write_method_mapping(
     m_method_mapping_filename,
     dodx,
-    hdr.signature
+    hdr.signature,
+    m_binary_symbol_files
   );
   write_class_mapping(
     m_class_mapping_filename,
     m_classes,
     hdr.class_defs_size,
-    hdr.signature
+    hdr.signature,
+    m_binary_symbol_files
   );
   write_pg_mapping(
     m_pg_mapping_filename,
-    m_classes
+    m_classes,
+    hdr.signature,
+    m_binary_symbol_files
   );
   write_bytecode_offset_mapping(
     m_bytecode_offset_filename,
-    m_method_bytecode_offsets
+    m_method_bytecode_offsets,
+    hdr.signature,
+    m_binary_symbol_files
   );
+  write_page_report();
+}
+
+/*
+ * Reports how many pages of each section the coldstart classes and methods
+ * touch. A class that is listed, or that has a listed method, touches its
+ * class def and class data; a listed method touches its code item.
+ */
+void DexOutput::write_page_report() {
+  if (m_page_report_filename.empty() || m_profile == nullptr) {
+    return;
+  }
+  PageAccounter accounter;
+  add_dex_sections(accounter, m_map_items.data(), m_map_items.size(),
+                   m_offset);
+  for (uint32_t i = 0; i < hdr.class_defs_size; i++) {
+    DexClass* clz = m_classes->at(i);
+    bool touched =
+        m_profile->coldstart_classes.count(clz->get_deobfuscated_name());
+    auto touch_method = [&](const DexMethod* meth) {
+      if (!m_profile->methods.count(meth->get_deobfuscated_name())) {
+        return;
+      }
+      touched = true;
+      auto it = m_code_item_extents.find(meth);
+      if (it != m_code_item_extents.end()) {
+        accounter.touch(it->second.first, it->second.second);
+      }
+    };
+    for (const auto* meth : clz->get_dmethods()) {
+      touch_method(meth);
+    }
+    for (const auto* meth : clz->get_vmethods()) {
+      touch_method(meth);
+    }
+    if (!touched) {
+      continue;
+    }
+    accounter.touch(hdr.class_defs_off + i * sizeof(dex_class_def),
+                    sizeof(dex_class_def));
+    auto it = m_cdi_sizes.find(clz);
+    if (it != m_cdi_sizes.end()) {
+      accounter.touch(m_cdi_offsets.at(clz), it->second);
+    }
+    auto sv_it = m_static_values.find(clz);
+    if (sv_it != m_static_values.end()) {
+      accounter.touch(sv_it->second, m_static_value_sizes.at(sv_it->second));
+    }
+    auto ad_it = m_annotation_dir_extents.find(clz);
+    if (ad_it != m_annotation_dir_extents.end()) {
+      accounter.touch(ad_it->second.first, ad_it->second.second);
+    }
+  }
+
+  auto fd = fopen(m_page_report_filename.c_str(), "a");
+  assert_log(fd, "Can't open page report file %s: %s\n",
+             m_page_report_filename.c_str(),
+             strerror(errno));
+  accounter.print(fd, m_filename);
+  fprintf(fd, "\n");
+  fclose(fd);
 }
 
 void DexOutput::prepare(SortMode string_mode, const std::vector<SortMode>& code_mode) {
-  fix_jumbos(m_classes, dodx);
+  prepare_independent(string_mode, code_mode);
+  prepare_debug_items();
+  finish_prepare();
+}
+
+void DexOutput::prepare_independent(SortMode string_mode,
+                                    const std::vector<SortMode>& code_mode) {
+  Timeline::Span span("DexOutput::prepare_independent");
   init_header_offsets();
   generate_static_values();
   generate_typelist_data();
   generate_string_data(string_mode);
   generate_code_items(code_mode);
-  generate_class_data_items();
+  generate_class_data_items(code_mode);
   generate_type_data();
   generate_proto_data();
   generate_field_data();
   generate_method_data();
   generate_class_data();
   generate_annotations();
+}
+
+void DexOutput::prepare_debug_items() {
+  Timeline::Span span("DexOutput::prepare_debug_items");
   generate_debug_items();
+}
+
+void DexOutput::finish_prepare() {
+  Timeline::Span span("DexOutput::finish_prepare");
   generate_map();
   align_output();
+  always_assert_log(m_offset <= k_max_dex_size,
+                    "Dex %s overflows the output buffer", m_filename);
   finalize_header();
 }
 
 void DexOutput::write() {
+  write_dex_file();
+  write_symbol_files();
+}
+
+void DexOutput::write_dex_file() {
+  Timeline::Span span("DexOutput::write_dex_file");
   struct stat st;
   int fd = open(m_filename, O_CREAT | O_TRUNC | O_WRONLY, 0660);
   if (fd == -1) {
     perror("Error writing dex");
     return;
   }
-  ::write(fd, m_output, m_offset);
+  const uint8_t* data = m_output;
+  size_t remaining = m_offset;
+  while (remaining > 0) {
+    auto written = ::write(fd, data, remaining);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("Error writing dex");
+      close(fd);
+      return;
+    }
+    data += written;
+    remaining -= written;
+  }
   if (0 == fstat(fd, &st)) {
     m_stats.num_bytes = st.st_size;
   }
   close(fd);
+}
 
-  write_symbol_files();
+void DexOutput::copy_dex_to(std::vector<uint8_t>* contents) {
+  contents->assign(m_output, m_output + m_offset);
+  m_stats.num_bytes = m_offset;
+}
+
+void DexOutput::release_memory() {
+  Timeline::Span span("DexOutput::release_memory");
+  free(m_output);
+  m_output = nullptr;
+  delete m_gtypes;
+  m_gtypes = nullptr;
+  dodx->release_all_but_methods();
+  decltype(m_tl_emit_offsets)().swap(m_tl_emit_offsets);
+  decltype(m_code_item_emits)().swap(m_code_item_emits);
+  // m_static_values stays for the page report.
+
+  auto release_method = [&](DexMethod* meth) {
+    auto dex_code = meth->get_dex_code();
+    auto dbg = dex_code ? dex_code->get_debug_item() : nullptr;
+    // Debug info that was never decoded holds no positions.
+    if (dbg != nullptr && dbg->is_decoded()) {
+      for (auto& entry : dbg->get_entries()) {
+        if (entry.type == DexDebugEntryType::Position) {
+          m_released_positions.emplace_back(std::move(entry.pos));
+        }
+      }
+    }
+    meth->set_code(nullptr);
+    meth->set_dex_code(nullptr);
+    meth->clear_annotations();
+    if (auto param_anno = meth->get_param_anno()) {
+      for (auto& pair : *param_anno) {
+        delete pair.second;
+      }
+      param_anno->clear();
+    }
+  };
+  for (auto clz : *m_classes) {
+    for (auto meth : clz->get_dmethods()) {
+      release_method(meth);
+    }
+    for (auto meth : clz->get_vmethods()) {
+      release_method(meth);
+    }
+    for (auto field : clz->get_sfields()) {
+      field->clear_annotations();
+    }
+    for (auto field : clz->get_ifields()) {
+      field->clear_annotations();
+    }
+    clz->clear_annotations();
+  }
 }
 
 static SortMode make_sort_bytecode(const std::string& sort_bytecode) {
@@ -1489,40 +2422,66 @@ static SortMode make_sort_bytecode(const std::string& sort_bytecode) {
     return SortMode::CLASS_ORDER;
   } else if (sort_bytecode == "clinit_order") {
     return SortMode::CLINIT_FIRST;
+  } else if (sort_bytecode == "method_profile") {
+    return SortMode::METHOD_PROFILE;
   } else {
     return SortMode::DEFAULT;
   }
 }
 
-dex_stats_t
-write_classes_to_dex(
-  std::string filename,
-  DexClasses* classes,
-  LocatorIndex* locator_index,
-  size_t dex_number,
-  ConfigFiles& cfg,
-  const Json::Value& json_cfg,
-  PositionMapper* pos_mapper)
-{
-  auto method_mapping_filename = cfg.metafile(
+namespace {
+
+struct DexOutputSettings {
+  std::string method_mapping_filename;
+  std::string class_mapping_filename;
+  std::string pg_mapping_filename;
+  std::string bytecode_offset_filename;
+  std::string page_report_filename;
+  bool binary_symbol_files{false};
+  bool release_memory{false};
+  SortMode string_sort_mode{SortMode::DEFAULT};
+  std::vector<SortMode> code_sort_mode;
+  DexOutputProfile profile;
+};
+
+DexOutputSettings make_output_settings(ConfigFiles& cfg,
+                                       const Json::Value& json_cfg) {
+  DexOutputSettings settings;
+  settings.method_mapping_filename = cfg.metafile(
     json_cfg.get("method_mapping", "").asString());
-  auto class_mapping_filename = cfg.metafile(
+  settings.class_mapping_filename = cfg.metafile(
     json_cfg.get("class_mapping", "").asString());
-  auto pg_mapping_filename = cfg.metafile(
-    json_cfg.get("proguard_map_output", "").asString());
-  auto bytecode_offset_filename = cfg.metafile(
+  // A merged map is written once all the dexes are; see
+  // write_merged_pg_mapping().
+  if (pg_mapping_to_merge(json_cfg).empty()) {
+    settings.pg_mapping_filename = cfg.metafile(
+      json_cfg.get("proguard_map_output", "").asString());
+  }
+  settings.bytecode_offset_filename = cfg.metafile(
     json_cfg.get("bytecode_offset_map", "").asString());
+  settings.page_report_filename = cfg.metafile(
+    json_cfg.get("page_access_report", "").asString());
+  // "binary" writes the four files above as binary_mapping segments instead
+  // of text; see BinaryMappingFile.h.
+  settings.binary_symbol_files =
+      json_cfg.get("symbol_file_format", "text").asString() == "binary";
+  // For builds that are short of memory; see write_classes_to_dexes().
+  settings.release_memory =
+      json_cfg.get("release_memory_after_output", false).asBool();
 
   auto sort_strings = json_cfg.get("string_sort_mode", "").asString();
-  SortMode string_sort_mode = SortMode::DEFAULT;
   if (sort_strings == "class_strings") {
-    string_sort_mode = SortMode::CLASS_STRINGS;
+    settings.string_sort_mode = SortMode::CLASS_STRINGS;
   } else if (sort_strings == "class_order") {
-    string_sort_mode = SortMode::CLASS_ORDER;
+    settings.string_sort_mode = SortMode::CLASS_ORDER;
+  } else if (sort_strings == "method_profile") {
+    settings.string_sort_mode = SortMode::METHOD_PROFILE;
+  } else if (sort_strings == "coldstart_pages") {
+    settings.string_sort_mode = SortMode::COLDSTART_PAGES;
   }
 
   auto sort_bytecode_cfg = json_cfg.get("bytecode_sort_mode", Json::Value());
-  std::vector<SortMode> code_sort_mode;
+  auto& code_sort_mode = settings.code_sort_mode;
 
   if (sort_bytecode_cfg.isString()) {
     code_sort_mode.push_back(make_sort_bytecode(sort_bytecode_cfg.asString()));
@@ -1535,51 +2494,206 @@ write_classes_to_dex(
     code_sort_mode.push_back(SortMode::DEFAULT);
   }
 
-  DexOutput dout = DexOutput(
+  // See DexOutputProfile; the classes come from the coldstart class list.
+  settings.profile.coldstart_class_data_first =
+      json_cfg.get("coldstart_class_data_first", false).asBool();
+
+  // The profile is the coldstart method list, which is given in first
+  // execution order. Load it here rather than in the dex outputs, since those
+  // are prepared concurrently. The page report traces both lists.
+  bool page_report = !settings.page_report_filename.empty();
+  if (page_report || settings.string_sort_mode == SortMode::METHOD_PROFILE ||
+      std::find(code_sort_mode.begin(), code_sort_mode.end(),
+                SortMode::METHOD_PROFILE) != code_sort_mode.end()) {
+    auto& pg_map = cfg.get_proguard_map();
+    unsigned int index = 0;
+    for (auto const& method : cfg.get_coldstart_methods()) {
+      settings.profile.methods.emplace(pg_map.deobfuscate_method(method),
+                                       index++);
+    }
+  }
+  if (page_report || settings.string_sort_mode == SortMode::COLDSTART_PAGES ||
+      settings.profile.coldstart_class_data_first) {
+    auto& pg_map = cfg.get_proguard_map();
+    unsigned int index = 0;
+    for (auto const& cls : cfg.get_coldstart_classes()) {
+      settings.profile.coldstart_classes.emplace(pg_map.deobfuscate_class(cls),
+                                                 index++);
+    }
+  }
+  return settings;
+}
+
+std::unique_ptr<DexOutput> make_dex_output(const std::string& filename,
+                                           DexClasses* classes,
+                                           LocatorIndex* locator_index,
+                                           size_t dex_number,
+                                           ConfigFiles& cfg,
+                                           PositionMapper* pos_mapper,
+                                           const DexOutputSettings& settings,
+                                           const ClassRefsMap* class_refs) {
+  return std::make_unique<DexOutput>(
     filename.c_str(),
     classes,
     locator_index,
     dex_number,
     cfg,
     pos_mapper,
-    method_mapping_filename,
-    class_mapping_filename,
-    pg_mapping_filename,
-    bytecode_offset_filename);
+    settings.method_mapping_filename,
+    settings.class_mapping_filename,
+    settings.pg_mapping_filename,
+    settings.bytecode_offset_filename,
+    settings.page_report_filename,
+    &settings.profile,
+    settings.binary_symbol_files,
+    class_refs);
+}
 
-  dout.prepare(string_sort_mode, code_sort_mode);
-  dout.write();
-  return dout.m_stats;
+} // namespace
+
+dex_stats_t
+write_classes_to_dex(
+  std::string filename,
+  DexClasses* classes,
+  LocatorIndex* locator_index,
+  size_t dex_number,
+  ConfigFiles& cfg,
+  const Json::Value& json_cfg,
+  PositionMapper* pos_mapper)
+{
+  auto settings = make_output_settings(cfg, json_cfg);
+  auto dout = make_dex_output(filename, classes, locator_index, dex_number,
+                              cfg, pos_mapper, settings, nullptr);
+  dout->prepare(settings.string_sort_mode, settings.code_sort_mode);
+  dout->write_dex_file();
+  if (settings.release_memory) {
+    dout->release_memory();
+  }
+  dout->write_symbol_files();
+  return dout->m_stats;
 }
 
-LocatorIndex
-make_locator_index(DexStoresVector& stores)
+std::vector<dex_stats_t>
+write_classes_to_dexes(
+  const std::vector<DexOutputJob>& jobs,
+  LocatorIndex* locator_index,
+  ConfigFiles& cfg,
+  const Json::Value& json_cfg,
+  PositionMapper* pos_mapper)
 {
-  LocatorIndex index;
+  auto settings = make_output_settings(cfg, json_cfg);
+  // Summarize the refs of the classes of all the dexes at once, so the work
+  // is spread evenly over the threads however the classes are split up.
+  std::vector<DexClass*> all_classes;
+  for (auto& job : jobs) {
+    all_classes.insert(
+        all_classes.end(), job.classes->begin(), job.classes->end());
+  }
+  auto class_refs = gather_class_refs(all_classes);
+
+  std::vector<std::unique_ptr<DexOutput>> outputs(jobs.size());
+  auto prepare_wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto& job = jobs[i];
+    outputs[i] = make_dex_output(job.filename, job.classes, locator_index,
+                                 job.dex_number, cfg, pos_mapper, settings,
+                                 &class_refs);
+    outputs[i]->prepare_independent(settings.string_sort_mode,
+                                    settings.code_sort_mode);
+  });
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    prepare_wq.add_item(i);
+  }
+  prepare_wq.run_all();
+  class_refs.clear();
+
+  for (auto& dout : outputs) {
+    dout->prepare_debug_items();
+  }
 
+  auto write_wq = workqueue_foreach<size_t>([&](size_t i) {
+    outputs[i]->finish_prepare();
+    if (jobs[i].contents != nullptr) {
+      outputs[i]->copy_dex_to(jobs[i].contents);
+    } else {
+      outputs[i]->write_dex_file();
+    }
+    if (settings.release_memory) {
+      outputs[i]->release_memory();
+    }
+  });
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    write_wq.add_item(i);
+  }
+  write_wq.run_all();
+
+  std::vector<dex_stats_t> stats;
+  for (auto& dout : outputs) {
+    dout->write_symbol_files();
+    stats.push_back(dout->m_stats);
+    dout.reset();
+  }
+  return stats;
+}
+
+LocatorIndex::LocatorIndex(DexStoresVector& stores) {
+  // Give the classes of each dex a contiguous range of ids, so the dexes can
+  // fill in their entries independently.
+  struct DexRange {
+    const DexClasses* classes;
+    uint32_t strnr;
+    uint32_t dexnr;
+    size_t base;
+  };
+  std::vector<DexRange> ranges;
+  size_t num_classes = 0;
   for (uint32_t strnr = 0; strnr < stores.size(); strnr++) {
     DexClassesVector& dexen = stores[strnr].get_dexen();
     uint32_t dexnr = 1; // Zero is reserved for Android classes
     for (auto dexit = dexen.begin(); dexit != dexen.end(); ++dexit, ++dexnr) {
-      const DexClasses& classes = *dexit;
-      uint32_t clsnr = 0;
-      for (auto clsit = classes.begin();
-           clsit != classes.end();
-           ++clsit, ++clsnr)
-      {
-        DexString* clsname = (*clsit)->get_type()->get_name();
-        bool inserted = index.insert(
-          std::make_pair(clsname, Locator::make(
-            strnr,
-            dexnr,
-            clsnr)))
-          .second;
-        // We shouldn't see the same class defined in two dexen
-        assert(inserted);
-        (void) inserted; // Shut up compiler when defined(NDEBUG)
+      if (!dexit->empty()) {
+        // Throws if the numbering doesn't fit the locator encoding.
+        Locator::make(strnr, dexnr, dexit->size() - 1);
       }
+      ranges.push_back({&*dexit, strnr, dexnr, num_classes});
+      num_classes += dexit->size();
     }
   }
 
-  return index;
+  m_entries.resize(num_classes);
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    const auto& range = ranges[i];
+    uint32_t clsnr = 0;
+    for (auto cls : *range.classes) {
+      m_entries[range.base + clsnr] = {
+          cls->get_type()->get_name(), range.strnr, range.dexnr, clsnr};
+      ++clsnr;
+    }
+  });
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  std::sort(m_entries.begin(),
+            m_entries.end(),
+            [](const Entry& a, const Entry& b) { return a.name < b.name; });
+  for (size_t i = 1; i < m_entries.size(); ++i) {
+    // We shouldn't see the same class defined in two dexen
+    always_assert_log(m_entries[i - 1].name != m_entries[i].name,
+                      "%s is defined in more than one dex",
+                      m_entries[i].name->c_str());
+  }
+}
+
+std::unique_ptr<Locator> LocatorIndex::find(const DexString* name) const {
+  auto it = std::lower_bound(
+      m_entries.begin(),
+      m_entries.end(),
+      name,
+      [](const Entry& e, const DexString* name) { return e.name < name; });
+  if (it == m_entries.end() || it->name != name) {
+    return nullptr;
+  }
+  return std::unique_ptr<Locator>(
+      new Locator(Locator::make(it->strnr, it->dexnr, it->clsnr)));
 }
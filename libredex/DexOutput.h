@@ -9,7 +9,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "ConfigFiles.h"
 #include "DexClass.h"
@@ -27,16 +30,61 @@ typedef std::unordered_map<DexProto*, uint32_t> dexproto_to_idx;
 typedef std::unordered_map<DexFieldRef*, uint32_t> dexfield_to_idx;
 typedef std::unordered_map<DexMethodRef*, uint32_t> dexmethod_to_idx;
 
-using LocatorIndex = std::unordered_map<DexString*, Locator>;
-LocatorIndex make_locator_index(DexStoresVector& stores);
+/*
+ * The locator of every class defined in the stores, for the class-locator
+ * strings. It's built once, in parallel, and shared by all the dexes being
+ * written. The classes are numbered densely in store, dex and class order,
+ * and the index is an array of them sorted by name, so a lookup is a binary
+ * search over a contiguous array instead of a hash of a DexString pointer.
+ */
+class LocatorIndex {
+ public:
+  explicit LocatorIndex(DexStoresVector& stores);
+
+  // Returns null if no class with this name is defined in the stores.
+  std::unique_ptr<Locator> find(const DexString* name) const;
+
+  size_t size() const { return m_entries.size(); }
+
+ private:
+  struct Entry {
+    const DexString* name;
+    uint32_t strnr;
+    uint32_t dexnr;
+    uint32_t clsnr;
+  };
+  std::vector<Entry> m_entries;
+};
 
 enum class SortMode {
   CLASS_ORDER,
   CLASS_STRINGS,
   CLINIT_FIRST,
+  METHOD_PROFILE,
+  COLDSTART_PAGES,
   DEFAULT
 };
 
+/*
+ * The position of each method in the order of first execution, keyed by the
+ * deobfuscated name of the method.
+ */
+using MethodProfileOrder = std::unordered_map<std::string, unsigned int>;
+
+/*
+ * The position of each class in the coldstart class list, keyed by the
+ * deobfuscated name of the class.
+ */
+using ColdstartClassOrder = std::unordered_map<std::string, unsigned int>;
+
+struct DexOutputProfile {
+  MethodProfileOrder methods;
+  ColdstartClassOrder coldstart_classes;
+  // Whether the class data, static values and annotations of the coldstart
+  // classes lead their sections, so that loading them faults in few pages.
+  bool coldstart_class_data_first{false};
+};
+
 class DexOutputIdx {
  private:
   dexstring_to_idx* m_string;
@@ -69,6 +117,21 @@ class DexOutputIdx {
     delete m_method;
   }
 
+  /*
+   * Frees every table but the method one, which is all the symbol files
+   * still need once the dex is written.
+   */
+  void release_all_but_methods() {
+    delete m_string;
+    delete m_type;
+    delete m_proto;
+    delete m_field;
+    m_string = new dexstring_to_idx();
+    m_type = new dextype_to_idx();
+    m_proto = new dexproto_to_idx();
+    m_field = new dexfield_to_idx();
+  }
+
   dextype_to_idx& type_to_idx() const { return *m_type; }
   dexproto_to_idx& proto_to_idx() const { return *m_proto; }
   dexfield_to_idx& field_to_idx() const { return *m_field; }
@@ -100,18 +163,80 @@ dex_stats_t write_classes_to_dex(
   const Json::Value& json_cfg,
   PositionMapper* line_mapper);
 
+struct DexOutputJob {
+  std::string filename;
+  DexClasses* classes;
+  size_t dex_number;
+  // When set, the dex is kept here instead of being written to filename,
+  // which then only names it (in the symbol files and reports).
+  std::vector<uint8_t>* contents{nullptr};
+};
+
+/*
+ * Writes all of `jobs` concurrently. The dex files, symbol files, line number
+ * map and the returned stats (one per job, in order) are identical to calling
+ * write_classes_to_dex() on each job in turn. Every dex being written holds
+ * its output buffer until the end, so this trades memory for wall time.
+ *
+ * With "release_memory_after_output" set in `json_cfg`, either function frees
+ * each dex's buffer, index tables, and its classes' code, debug info and
+ * annotations as soon as the dex is written, keeping only the names the
+ * symbol files need. The classes can't be written again afterwards.
+ */
+std::vector<dex_stats_t> write_classes_to_dexes(
+  const std::vector<DexOutputJob>& jobs,
+  LocatorIndex* locator_index /* nullable */,
+  ConfigFiles& cfg,
+  const Json::Value& json_cfg,
+  PositionMapper* line_mapper);
+
+/*
+ * With the default "merge" proguard_map_output_strategy and a non-empty input
+ * ProGuard map, the functions above leave "proguard_map_output" alone, and
+ * this writes it once all the dexes are written: the input map, with the
+ * output name of each class in `stores` on its class line, followed by a
+ * class line for each class in `stores` that the input map doesn't have.
+ * The input map is streamed rather than loaded. Otherwise this does nothing.
+ */
+void write_merged_pg_mapping(const DexStoresVector& stores,
+                             ConfigFiles& cfg,
+                             const Json::Value& json_cfg);
+
 typedef bool (*cmp_dstring)(const DexString*, const DexString*);
 typedef bool (*cmp_dtype)(const DexType*, const DexType*);
 typedef bool (*cmp_dproto)(const DexProto*, const DexProto*);
 typedef bool (*cmp_dfield)(const DexFieldRef*, const DexFieldRef*);
 typedef bool (*cmp_dmethod)(const DexMethodRef*, const DexMethodRef*);
 
+/*
+ * The share of a single class in the lists that GatheredTypes gathers: the
+ * strings, types, fields and methods reachable from the class, including the
+ * types and strings needed by the field and method refs and the names of the
+ * types. Each list is sorted and deduplicated. Summaries of different classes
+ * don't depend on each other, so they're computed in parallel.
+ */
+struct ClassRefs {
+  std::vector<DexString*> strings;
+  std::vector<DexType*> types;
+  std::vector<DexFieldRef*> fields;
+  std::vector<DexMethodRef*> methods;
+
+  explicit ClassRefs(const DexClass* cls);
+};
+
+using ClassRefsMap = std::unordered_map<const DexClass*, ClassRefs>;
+
+/*
+ * Summarize the refs of each of the classes, in parallel.
+ */
+ClassRefsMap gather_class_refs(const std::vector<DexClass*>& classes);
+
 /*
  * This API gathers all of the data referred to by a set of DexClasses in
  * preparation for emitting a dex file and provides the symbol tables in indexed
  * form for encoding.
  *
- * The gather algorithm implemented in gather_components() traverses the tree of
+ * The gather algorithm implemented in ClassRefs traverses the tree of
  * DexFoo objects rooted at each DexClass.  The individual gather methods,
  * gather_{strings,types,fields,methods}, (see Gatherable.h and DexClass.h) find
  * references to each type, respectively, that the object needs.
@@ -145,8 +270,12 @@ class GatheredTypes {
   std::unordered_map<const DexString*, unsigned int> m_cls_load_strings;
   std::unordered_map<const DexString*, unsigned int> m_cls_strings;
   std::unordered_map<const DexMethod*, unsigned int> m_methods_in_cls_order;
+  std::unordered_map<const DexMethod*, unsigned int> m_methods_in_profile_order;
+  std::unordered_map<const DexString*, unsigned int> m_profile_strings;
+  std::unordered_map<const DexString*, unsigned int> m_coldstart_strings;
+  std::unordered_map<const DexClass*, unsigned int> m_coldstart_classes;
 
-  void gather_components();
+  void gather_components(const ClassRefsMap& class_refs);
   dexstring_to_idx* get_string_index(cmp_dstring cmp = compare_dexstrings);
   dextype_to_idx* get_type_index(cmp_dtype cmp = compare_dextypes);
   dexproto_to_idx* get_proto_index(cmp_dproto cmp = compare_dexprotos);
@@ -158,12 +287,20 @@ class GatheredTypes {
   void build_method_map();
 
  public:
-  GatheredTypes(DexClasses* classes);
+  // The refs of the classes are summarized on the fly unless class_refs,
+  // which must then cover all the classes, is given.
+  GatheredTypes(DexClasses* classes,
+                const ClassRefsMap* class_refs = nullptr);
   DexOutputIdx* get_dodx(const uint8_t* base);
   template <class T = decltype(compare_dexstrings)>
   std::vector<DexString*> get_dexstring_emitlist(T cmp = compare_dexstrings);
   std::vector<DexString*> get_cls_order_dexstring_emitlist();
   std::vector<DexString*> keep_cls_strings_together_emitlist();
+  std::vector<DexString*> get_profile_order_dexstring_emitlist();
+  std::vector<DexString*> get_coldstart_order_dexstring_emitlist();
+  // The number of strings at the front of the coldstart order emitlist that
+  // the coldstart classes use.
+  size_t num_coldstart_strings() const { return m_coldstart_strings.size(); }
   std::vector<DexMethod*> get_dexmethod_emitlist();
 
   void gather_class(int num);
@@ -171,6 +308,26 @@ class GatheredTypes {
   void sort_dexmethod_emitlist_default_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_cls_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_clinit_order(std::vector<DexMethod*>& lmeth);
+  void sort_dexmethod_emitlist_profile_order(std::vector<DexMethod*>& lmeth);
+
+  /*
+   * Profiled methods come first, in the order in which they first ran, and
+   * so do the strings they refer to and the classes that define them.
+   */
+  void set_method_profile(const MethodProfileOrder& profile);
+  void set_coldstart_classes(const ColdstartClassOrder& coldstart_classes);
+  std::vector<DexClass*> get_profile_order_class_emitlist();
+
+  /*
+   * Moves the items of the coldstart classes to the front, in coldstart
+   * order; the other items keep their relative order. class_of maps an item
+   * to the class it belongs to.
+   */
+  template <class T, class ClassOf>
+  void sort_coldstart_first(std::vector<T>& items, ClassOf class_of);
+  bool is_coldstart_class(const DexClass* cls) const {
+    return m_coldstart_classes.count(cls);
+  }
 
   std::unordered_set<DexString*> index_type_names();
 };
@@ -181,3 +338,16 @@ std::vector<DexString*> GatheredTypes::get_dexstring_emitlist(T cmp) {
   std::sort(strlist.begin(), strlist.end(), std::cref(cmp));
   return strlist;
 }
+
+template <class T, class ClassOf>
+void GatheredTypes::sort_coldstart_first(std::vector<T>& items,
+                                         ClassOf class_of) {
+  std::stable_sort(items.begin(), items.end(), [&](const T& a, const T& b) {
+    auto a_it = m_coldstart_classes.find(class_of(a));
+    auto b_it = m_coldstart_classes.find(class_of(b));
+    if (a_it == m_coldstart_classes.end()) {
+      return false;
+    }
+    return b_it == m_coldstart_classes.end() || a_it->second < b_it->second;
+  });
+}
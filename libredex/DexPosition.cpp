@@ -7,6 +7,7 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <json/json.h>
@@ -14,6 +15,7 @@
 #include "DexClass.h"
 #include "DexPosition.h"
 #include "DexUtil.h"
+#include "WorkQueue.h"
 
 DexPosition::DexPosition(uint32_t line) : line(line), parent(nullptr) {}
 
@@ -30,21 +32,66 @@ bool DexPosition::operator==(const DexPosition& that) const {
            *parent == *that.parent));
 }
 
+bool RealPositionMapper::find_registered(DexPosition* pos,
+                                         uint32_t* index) const {
+  // A copied position carries the index of its original along, so check
+  // the index actually refers to this one.
+  if (pos->mapper_index == 0 || pos->mapper_index > m_registered.size() ||
+      m_registered[pos->mapper_index - 1] != pos) {
+    return false;
+  }
+  *index = pos->mapper_index - 1;
+  return true;
+}
+
 void RealPositionMapper::register_position(DexPosition* pos) {
-  m_pos_line_map[pos] = -1;
+  uint32_t index;
+  if (find_registered(pos, &index)) {
+    m_registered_lines[index] = -1;
+    return;
+  }
+  m_registered.push_back(pos);
+  m_registered_lines.push_back(-1);
+  pos->mapper_index = m_registered.size();
 }
 
 uint32_t RealPositionMapper::get_line(DexPosition* pos) {
-  return m_pos_line_map.at(pos) + 1;
+  uint32_t index;
+  if (!find_registered(pos, &index)) {
+    throw std::out_of_range("Position was not registered");
+  }
+  return m_registered_lines[index] + 1;
 }
 
 uint32_t RealPositionMapper::position_to_line(DexPosition* pos) {
-  auto idx = m_positions.size();
+  uint32_t index;
+  if (!find_registered(pos, &index)) {
+    register_position(pos);
+    index = m_registered.size() - 1;
+  }
+  m_registered_lines[index] = m_positions.size();
   m_positions.emplace_back(pos);
-  m_pos_line_map[pos] = idx;
   return get_line(pos);
 }
 
+void RealPositionMapper::emit_unemitted_positions() {
+  // to ensure that the line numbers in the Dex are as compact as possible,
+  // we put the emitted positions at the start of the list and rest at the end
+  for (size_t i = 0; i < m_registered.size(); i++) {
+    if (m_registered_lines[i] == -1) {
+      m_registered_lines[i] = m_positions.size();
+      m_positions.emplace_back(m_registered[i]);
+    }
+  }
+}
+
+void RealPositionMapper::keep_positions(
+    std::vector<std::unique_ptr<DexPosition>> positions) {
+  m_kept_positions.insert(m_kept_positions.end(),
+                          std::make_move_iterator(positions.begin()),
+                          std::make_move_iterator(positions.end()));
+}
+
 void RealPositionMapper::write_map() {
   if (m_filename != "") {
     write_map_v1();
@@ -54,17 +101,73 @@ void RealPositionMapper::write_map() {
   }
 }
 
-void RealPositionMapper::write_map_v1() {
-  // to ensure that the line numbers in the Dex are as compact as possible,
-  // we put the emitted positions at the start of the list and rest at the end
-  for (auto item : m_pos_line_map) {
-    auto line = item.second;
-    if (line == -1) {
-      auto idx = m_positions.size();
-      m_positions.emplace_back(item.first);
-      m_pos_line_map[item.first] = idx;
+namespace {
+
+// The records are serialized in batches of this many positions, each batch
+// in parallel chunks, and written out before the next one is started.
+constexpr size_t POSITION_BATCH = 1 << 18;
+constexpr size_t POSITION_CHUNK = 4096;
+
+void write_uint32(std::ofstream& ofs, uint32_t value) {
+  ofs.write((const char*)&value, sizeof(value));
+}
+
+void write_header(std::ofstream& ofs, uint32_t version) {
+  write_uint32(ofs, 0xfaceb000); // serves as endianess check
+  write_uint32(ofs, version);
+}
+
+void write_string(std::ofstream& ofs, const char* str, uint32_t size) {
+  write_uint32(ofs, size);
+  ofs.write(str, size);
+}
+
+/*
+ * Writes the count of the positions and then their records, of `Words`
+ * uint32s each, as filled in by `fill(pos, record)`. Runs `fill` on many
+ * positions at once.
+ */
+template <size_t Words, typename Fill>
+void write_position_records(std::ofstream& ofs,
+                            const std::vector<DexPosition*>& positions,
+                            const Fill& fill) {
+  write_uint32(ofs, positions.size());
+  std::vector<uint32_t> buffer(std::min(positions.size(), POSITION_BATCH) *
+                               Words);
+  for (size_t begin = 0; begin < positions.size(); begin += POSITION_BATCH) {
+    auto end = std::min(begin + POSITION_BATCH, positions.size());
+    auto wq = workqueue_foreach<size_t>([&](size_t chunk) {
+      auto chunk_end = std::min(chunk + POSITION_CHUNK, end);
+      for (size_t i = chunk; i < chunk_end; ++i) {
+        fill(positions[i], &buffer[(i - begin) * Words]);
+      }
+    });
+    for (size_t chunk = begin; chunk < end; chunk += POSITION_CHUNK) {
+      wq.add_item(chunk);
     }
+    wq.run_all();
+    ofs.write((const char*)buffer.data(),
+              (end - begin) * Words * sizeof(uint32_t));
   }
+}
+
+} // namespace
+
+uint32_t RealPositionMapper::get_parent_line(DexPosition* pos) const {
+  if (pos->parent == nullptr) {
+    return 0;
+  }
+  uint32_t index;
+  if (!find_registered(pos->parent, &index)) {
+    std::cerr << "Parent position " << show(pos->parent) << " of "
+              << show(pos) << " was not registered" << std::endl;
+    return 0;
+  }
+  return m_registered_lines[index] + 1;
+}
+
+void RealPositionMapper::write_map_v1() {
+  emit_unemitted_positions();
   /*
    * Map file layout:
    * 0xfaceb000 (magic number)
@@ -78,57 +181,31 @@ void RealPositionMapper::write_map_v1() {
    * string_length (4 bytes)
    * char[string_length]
    */
-  std::stringstream pos_out;
   std::unordered_map<DexString*, uint32_t> string_ids;
   std::vector<DexString*> string_pool;
-
   for (auto pos : m_positions) {
-    uint32_t parent_line = 0;
-    try {
-      parent_line = pos->parent == nullptr ? 0 : get_line(pos->parent);
-    } catch (std::out_of_range& e) {
-      std::cerr << "Parent position " << show(pos->parent) << " of "
-                << show(pos) << " was not registered" << std::endl;
-    }
-    if (string_ids.find(pos->file) == string_ids.end()) {
-      string_ids[pos->file] = string_pool.size();
+    if (string_ids.emplace(pos->file, string_pool.size()).second) {
       string_pool.push_back(pos->file);
     }
-    auto string_id = string_ids[pos->file];
-    pos_out.write((const char*)&string_id, sizeof(string_id));
-    pos_out.write((const char*)&pos->line, sizeof(pos->line));
-    pos_out.write((const char*)&parent_line, sizeof(parent_line));
   }
 
   std::ofstream ofs(m_filename.c_str(),
                     std::ofstream::out | std::ofstream::trunc);
-  uint32_t magic = 0xfaceb000; // serves as endianess check
-  ofs.write((const char*)&magic, sizeof(magic));
-  uint32_t version = 1;
-  ofs.write((const char*)&version, sizeof(version));
-  uint32_t spool_count = string_pool.size();
-  ofs.write((const char*)&spool_count, sizeof(spool_count));
+  write_header(ofs, 1);
+  write_uint32(ofs, string_pool.size());
   for (auto s : string_pool) {
-    uint32_t ssize = s->size();
-    ofs.write((const char*)&ssize, sizeof(ssize));
-    ofs << s->c_str();
+    write_string(ofs, s->c_str(), s->size());
   }
-  uint32_t pos_count = m_positions.size();
-  ofs.write((const char*)&pos_count, sizeof(pos_count));
-  ofs << pos_out.str();
+  write_position_records<3>(
+      ofs, m_positions, [&](DexPosition* pos, uint32_t* record) {
+        record[0] = string_ids.at(pos->file);
+        record[1] = pos->line;
+        record[2] = get_parent_line(pos);
+      });
 }
 
 void RealPositionMapper::write_map_v2() {
-  // to ensure that the line numbers in the Dex are as compact as possible,
-  // we put the emitted positions at the start of the list and rest at the end
-  for (auto item : m_pos_line_map) {
-    auto line = item.second;
-    if (line == -1) {
-      auto idx = m_positions.size();
-      m_positions.emplace_back(item.first);
-      m_pos_line_map[item.first] = idx;
-    }
-  }
+  emit_unemitted_positions();
   /*
    * Map file layout:
    * 0xfaceb000 (magic number)
@@ -142,61 +219,60 @@ void RealPositionMapper::write_map_v2() {
    * string_length (4 bytes)
    * char[string_length]
    */
-  std::stringstream pos_out;
+  // The pool is shared by the class, method and file names. Only the
+  // first position of each method and file goes through the text.
   std::unordered_map<std::string, uint32_t> string_ids;
   std::vector<std::string> string_pool;
+  std::unordered_map<const DexMethod*, std::pair<uint32_t, uint32_t>>
+      method_ids;
+  std::unordered_map<const DexString*, uint32_t> file_ids;
 
-  auto id_of_string = [&](const std::string& s) -> uint32_t {
-    if (string_ids.find(s) == string_ids.end()) {
-      string_ids[s] = string_pool.size();
-      string_pool.push_back(s);
+  auto id_of_string = [&](std::string s) -> uint32_t {
+    auto it = string_ids.find(s);
+    if (it == string_ids.end()) {
+      it = string_ids.emplace(s, string_pool.size()).first;
+      string_pool.push_back(std::move(s));
     }
-    return string_ids.at(s);
+    return it->second;
   };
 
   for (auto pos : m_positions) {
-    uint32_t parent_line = 0;
-    try {
-      parent_line = pos->parent == nullptr ? 0 : get_line(pos->parent);
-    } catch (std::out_of_range& e) {
-      std::cerr << "Parent position " << show(pos->parent) << " of "
-                << show(pos) << " was not registered" << std::endl;
+    if (!method_ids.count(pos->method)) {
+      // of the form "class_name.method_name:(arg_types)return_type"
+      auto full_method_name = pos->method->get_deobfuscated_name();
+      // strip out the args and return type
+      auto qualified_method_name =
+          full_method_name.substr(0, full_method_name.find(":"));
+      auto class_name = JavaNameUtil::internal_to_external(
+          qualified_method_name.substr(0, qualified_method_name.rfind(".")));
+      auto method_name =
+          qualified_method_name.substr(qualified_method_name.rfind(".") + 1);
+      auto class_id = id_of_string(class_name);
+      auto method_id = id_of_string(method_name);
+      method_ids.emplace(pos->method, std::make_pair(class_id, method_id));
+    }
+    if (!file_ids.count(pos->file)) {
+      file_ids.emplace(pos->file, id_of_string(pos->file->str()));
     }
-    // of the form "class_name.method_name:(arg_types)return_type"
-    auto full_method_name = pos->method->get_deobfuscated_name();
-    // strip out the args and return type
-    auto qualified_method_name =
-      full_method_name.substr(0, full_method_name.find(":"));
-    auto class_name = JavaNameUtil::internal_to_external(
-        qualified_method_name.substr(0, qualified_method_name.rfind(".")));
-    auto method_name =
-        qualified_method_name.substr(qualified_method_name.rfind(".") + 1);
-    auto class_id = id_of_string(class_name);
-    auto method_id = id_of_string(method_name);
-    auto file_id = id_of_string(pos->file->c_str());
-    pos_out.write((const char*)&class_id, sizeof(class_id));
-    pos_out.write((const char*)&method_id, sizeof(method_id));
-    pos_out.write((const char*)&file_id, sizeof(file_id));
-    pos_out.write((const char*)&pos->line, sizeof(pos->line));
-    pos_out.write((const char*)&parent_line, sizeof(parent_line));
   }
+  string_ids.clear();
 
   std::ofstream ofs(m_filename_v2.c_str(),
                     std::ofstream::out | std::ofstream::trunc);
-  uint32_t magic = 0xfaceb000; // serves as endianess check
-  ofs.write((const char*)&magic, sizeof(magic));
-  uint32_t version = 2;
-  ofs.write((const char*)&version, sizeof(version));
-  uint32_t spool_count = string_pool.size();
-  ofs.write((const char*)&spool_count, sizeof(spool_count));
-  for (auto s : string_pool) {
-    uint32_t ssize = s.size();
-    ofs.write((const char*)&ssize, sizeof(ssize));
-    ofs << s;
+  write_header(ofs, 2);
+  write_uint32(ofs, string_pool.size());
+  for (const auto& s : string_pool) {
+    write_string(ofs, s.c_str(), s.size());
   }
-  uint32_t pos_count = m_positions.size();
-  ofs.write((const char*)&pos_count, sizeof(pos_count));
-  ofs << pos_out.str();
+  write_position_records<5>(
+      ofs, m_positions, [&](DexPosition* pos, uint32_t* record) {
+        const auto& ids = method_ids.at(pos->method);
+        record[0] = ids.first;
+        record[1] = ids.second;
+        record[2] = file_ids.at(pos->file);
+        record[3] = pos->line;
+        record[4] = get_parent_line(pos);
+      });
 }
 
 PositionMapper* PositionMapper::make(const std::string& map_filename,
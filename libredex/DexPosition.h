@@ -10,19 +10,26 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "ObjectCensus.h"
+
 class DexClass;
 class DexMethod;
 class DexString;
 class DexDebugItem;
 
-struct DexPosition final {
+struct DexPosition final
+    : public census::Counted<census::DEX_POSITION> {
   DexMethod* method{nullptr};
   DexString* file{nullptr};
   uint32_t line;
+  // Only for RealPositionMapper, which keeps its per-position data in vectors
+  // indexed by this. It fits in what would otherwise be padding.
+  uint32_t mapper_index{0};
   // when a function gets inlined for the first time, all its DexPositions will
   // have the DexPosition of the callsite as their parent.
   DexPosition* parent;
@@ -39,6 +46,12 @@ class PositionMapper {
   virtual uint32_t position_to_line(DexPosition*) = 0;
   virtual void register_position(DexPosition* pos) = 0;
   virtual void write_map() = 0;
+  // Takes over positions whose code is being freed before write_map(), so the
+  // ones the map refers to stay valid.
+  virtual void keep_positions(std::vector<std::unique_ptr<DexPosition>>) {}
+  // Whether every position keeps its line; encoded debug info can then be
+  // written out again without decoding it.
+  virtual bool keeps_lines() const { return false; }
   static PositionMapper* make(const std::string& map_filename,
                               const std::string& map_filename_v2);
 };
@@ -53,10 +66,21 @@ class PositionMapper {
 class RealPositionMapper : public PositionMapper {
   std::string m_filename;
   std::string m_filename_v2;
+  // The positions in the order they are emitted in the map.
   std::vector<DexPosition*> m_positions;
-  std::unordered_map<DexPosition*, int64_t> m_pos_line_map;
+  // The registered positions, in the order they were registered, and where
+  // each of them is in m_positions (or -1 until it is emitted).
+  std::vector<DexPosition*> m_registered;
+  std::vector<int64_t> m_registered_lines;
+  // Positions handed over by keep_positions().
+  std::vector<std::unique_ptr<DexPosition>> m_kept_positions;
  protected:
+  // The index of the position in m_registered, if it was registered.
+  bool find_registered(DexPosition*, uint32_t* index) const;
   uint32_t get_line(DexPosition*);
+  // The line of the position's parent, or 0 if it has none.
+  uint32_t get_parent_line(DexPosition*) const;
+  void emit_unemitted_positions();
   void write_map_v1();
   void write_map_v2();
  public:
@@ -67,6 +91,8 @@ class RealPositionMapper : public PositionMapper {
   virtual uint32_t position_to_line(DexPosition*);
   virtual void register_position(DexPosition* pos);
   virtual void write_map();
+  virtual void keep_positions(
+      std::vector<std::unique_ptr<DexPosition>> positions);
 };
 
 class NoopPositionMapper : public PositionMapper {
@@ -77,4 +103,5 @@ class NoopPositionMapper : public PositionMapper {
   }
   virtual void register_position(DexPosition* pos) {}
   virtual void write_map() {}
+  virtual bool keeps_lines() const { return true; }
 };
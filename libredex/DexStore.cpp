@@ -51,24 +51,31 @@ void DexMetadata::parse(const std::string& path) {
 }
 
 XStoreRefs::XStoreRefs(const DexStoresVector& stores) {
-  m_xstores.push_back(std::unordered_set<const DexType*>());
-  for (const auto& cls : stores[0].get_dexen()[0]) {
-    m_xstores.back().insert(cls->get_type());
+  size_t num_classes = 0;
+  for (const auto& store : stores) {
+    for (const auto& classes : store.get_dexen()) {
+      num_classes += classes.size();
+    }
   }
+  m_type_to_store.reserve(num_classes);
+  // A type defined in several stores belongs to the first one.
+  auto add_classes = [this](const DexClasses& classes) {
+    for (const auto& cls : classes) {
+      m_type_to_store.emplace(cls->get_type(), m_num_stores);
+    }
+  };
+  add_classes(stores[0].get_dexen()[0]);
+  ++m_num_stores;
   if (stores[0].get_dexen().size() > 1) {
-    m_xstores.push_back(std::unordered_set<const DexType*>());
     for (size_t i = 1; i < stores[0].get_dexen().size(); i++) {
-      for (const auto& cls : stores[0].get_dexen()[i]) {
-        m_xstores.back().insert(cls->get_type());
-      }
+      add_classes(stores[0].get_dexen()[i]);
     }
+    ++m_num_stores;
   }
   for (size_t i = 1; i < stores.size(); i++) {
-    m_xstores.push_back(std::unordered_set<const DexType*>());
     for (const auto& classes : stores[i].get_dexen()) {
-      for (const auto& cls : classes) {
-        m_xstores.back().insert(cls->get_type());
-      }
+      add_classes(classes);
     }
+    ++m_num_stores;
   }
 }
@@ -12,6 +12,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <vector>
+#include <unordered_map>
 #include <unordered_set>
 #include "DexClass.h"
 
@@ -44,6 +45,7 @@ class DexStore {
   DexStore(const std::string name);
   DexStore(const DexStore&) = delete;
   DexStore(DexStore&&) = default;
+  DexStore& operator=(DexStore&&) = default;
 
   std::string get_name() const;
   std::vector<DexClasses>& get_dexen();
@@ -111,10 +113,11 @@ public:
 class XStoreRefs {
  private:
   /**
-   * Set of classes in each logical store. A primary DEX goes in its own
-   * bucket (first element in the array).
+   * The logical store of each class. A primary DEX goes in its own store
+   * (index 0), ahead of the other DEXes of the root store.
    */
-  std::vector<std::unordered_set<const DexType*>> m_xstores;
+  std::unordered_map<const DexType*, size_t> m_type_to_store;
+  size_t m_num_stores{0};
 
  public:
   explicit XStoreRefs(const DexStoresVector& stores);
@@ -125,10 +128,10 @@ class XStoreRefs {
    * api.
    */
   size_t get_store_idx(const DexType* type) const {
-    for (size_t store_idx = 0; store_idx < m_xstores.size(); store_idx++) {
-      if (m_xstores[store_idx].count(type) > 0) return store_idx;
-    }
-    always_assert_log(false, "type %s not in the current APK", SHOW(type));
+    auto it = m_type_to_store.find(type);
+    always_assert_log(it != m_type_to_store.end(),
+                      "type %s not in the current APK", SHOW(type));
+    return it->second;
   }
 
   /**
@@ -152,11 +155,22 @@ class XStoreRefs {
     if (type_class_internal(type) == nullptr) return false;
     // Temporary HACK: optimizations may leave references to dead classes and
     // if we just call get_store_idx() - as we should - the assert will fire...
-    size_t type_store_idx = 0;
-    for (; type_store_idx < m_xstores.size(); type_store_idx++) {
-      if (m_xstores[type_store_idx].count(type) > 0) break;
-    }
+    auto it = m_type_to_store.find(type);
+    size_t type_store_idx =
+        it != m_type_to_store.end() ? it->second : m_num_stores;
     return type_store_idx > store_idx;
   }
 
+  /**
+   * Whether any of 'types' can't be moved in the DexStore identified by
+   * 'store_idx', e.g. when checking all the types a method refers to.
+   */
+  template <class Types>
+  bool illegal_refs(size_t store_idx, const Types& types) const {
+    for (const auto& type : types) {
+      if (illegal_ref(store_idx, type)) return true;
+    }
+    return false;
+  }
+
 };
@@ -12,6 +12,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/regex.hpp>
 #include <deque>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "Debug.h"
@@ -371,12 +372,16 @@ void load_root_dexen(
   // Sort all discovered dex files
   std::sort(dexen.begin(), dexen.end(), dex_comparator);
   // Load all discovered dex files
+  std::vector<std::string> locations;
   for (const auto& dex : dexen) {
     if (verbose) {
       TRACE(MAIN, 1, "Loading %s\n", dex.string().c_str());
     }
-    // N.B. throaway stats for now
-    DexClasses classes = load_classes_from_dex(dex.string().c_str(), balloon);
+    locations.push_back(dex.string());
+  }
+  // N.B. throaway stats for now
+  std::vector<dex_stats_t> stats;
+  for (auto& classes : load_classes_from_dexes(locations, &stats, balloon)) {
     store.add_classes(std::move(classes));
   }
 }
@@ -411,6 +416,9 @@ dex_stats_t&
   lhs.num_type_lists += rhs.num_type_lists;
   lhs.num_bytes += rhs.num_bytes;
   lhs.num_instructions += rhs.num_instructions;
+  lhs.num_hot_string_pages += rhs.num_hot_string_pages;
+  lhs.num_hot_class_data_pages += rhs.num_hot_class_data_pages;
+  lhs.num_shared_debug_items += rhs.num_shared_debug_items;
   return lhs;
 }
 
@@ -424,6 +432,45 @@ void relocate_method(DexMethod* method, DexType* to_type) {
   to_cls->add_method(method);
 }
 
+namespace {
+
+template <class Member>
+size_t remove_members_by_class(
+    const std::vector<Member*>& members,
+    const std::function<size_t(DexClass*,
+                               const std::unordered_set<const Member*>&)>&
+        remove) {
+  std::unordered_map<DexClass*, std::unordered_set<const Member*>> by_class;
+  for (auto m : members) {
+    auto cls = type_class(m->get_class());
+    always_assert(cls != nullptr);
+    by_class[cls].insert(m);
+  }
+  size_t removed = 0;
+  for (const auto& pair : by_class) {
+    removed += remove(pair.first, pair.second);
+  }
+  return removed;
+}
+
+} // namespace
+
+size_t remove_methods(const std::vector<DexMethod*>& methods) {
+  return remove_members_by_class<DexMethod>(
+      methods,
+      [](DexClass* cls, const std::unordered_set<const DexMethod*>& ms) {
+        return cls->remove_methods(ms);
+      });
+}
+
+size_t remove_fields(const std::vector<DexField*>& fields) {
+  return remove_members_by_class<DexField>(
+      fields,
+      [](DexClass* cls, const std::unordered_set<const DexField*>& fs) {
+        return cls->remove_fields(fs);
+      });
+}
+
 void change_visibility(DexMethod* method) {
   auto code = method->get_code();
   always_assert(code != nullptr);
@@ -238,6 +238,19 @@ void relocate_method(DexMethod* method, DexType* to_type);
  */
 bool relocate_method_if_no_changes(DexMethod* method, DexType* to_type);
 
+/**
+ * Removes the methods from their classes. The member lists of each class are
+ * compacted only once, however many of its methods go, which keeps removing
+ * thousands of methods from a big class linear. Returns the number of methods
+ * removed; methods that aren't in their class anymore are skipped.
+ */
+size_t remove_methods(const std::vector<DexMethod*>& methods);
+
+/**
+ * Same as remove_methods(), for fields.
+ */
+size_t remove_fields(const std::vector<DexField*>& fields);
+
 /**
  * Merge the 2 visibility access flags. Return the most permissive visibility.
  */
@@ -366,6 +379,14 @@ struct dex_stats_t {
   int num_type_lists = 0;
   int num_bytes = 0;
   int num_instructions = 0;
+  // The pages spanned by the strings of the coldstart classes, with
+  // string_sort_mode "coldstart_pages".
+  int num_hot_string_pages = 0;
+  // The pages spanned by the class data items of the coldstart classes, with
+  // coldstart_class_data_first.
+  int num_hot_class_data_pages = 0;
+  // The code items that point to a debug info item encoded for another one.
+  int num_shared_debug_items = 0;
 };
 
 dex_stats_t&
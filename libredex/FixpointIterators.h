@@ -13,6 +13,7 @@
 #include <cstddef>
 #include <functional>
 #include <mutex>
+#include <queue>
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
@@ -83,8 +84,29 @@ class MonotonicFixpointIteratorContext final {
 
   template <typename T1, typename T2, typename T3>
   friend class MonotonicFixpointIterator;
+  template <typename T1, typename T2, typename T3>
+  friend class ParallelMonotonicFixpointIterator;
 };
 
+/*
+ * The order in which the nodes of the control-flow graph are visited by the
+ * fixpoint iterator.
+ *
+ *  - Recursive: Bourdoncle's recursive iteration strategy. Every node of an
+ *    SCC is reanalyzed on each iteration over the SCC, whether or not its
+ *    inputs have changed.
+ *
+ *  - Worklist: a chaotic iteration driven by a worklist prioritized by the
+ *    position of the nodes in the weak topological ordering. A node is only
+ *    reanalyzed when the exit state of one of its predecessors has changed,
+ *    which saves a lot of work on large SCCs (e.g., loops containing big
+ *    switches) where most nodes stabilize long before the SCC head does.
+ *    Widening is performed at SCC heads only, exactly as in the recursive
+ *    strategy. Since the smallest position is always popped first, an inner
+ *    SCC is stabilized before the nodes that follow it are visited.
+ */
+enum class FixpointIterationStrategy { Recursive, Worklist };
+
 template <typename Derived>
 class FixpointIteratorGraphSpec {
 
@@ -133,7 +155,8 @@ class FixpointIteratorGraphSpec {
  *  logic programs. Journal of Logic Programming, 13(2—3):103—179, 1992.
  *
  * The recursive iteration strategy is described in Bourdoncle's paper on weak
- * topological orderings.
+ * topological orderings. A worklist-based strategy is also available (see
+ * FixpointIterationStrategy above).
  *
  * The fixpoint iterator is thread safe.
  */
@@ -160,9 +183,22 @@ class MonotonicFixpointIterator {
    * When the number of nodes in the CFG is known, it's better to provide it to
    * the constructor, so as to prevent unnecessary resizing of the underlying
    * hashtables during the iteration.
+   *
+   * With the worklist strategy, the entry states of nodes that are not SCC
+   * heads can be left out of the hashtable by setting `store_entry_states` to
+   * false. They are then recomputed from the exit states of the predecessors
+   * whenever get_entry_state_at() is called, which is a good trade-off for
+   * analyses that only query a few entry states, if any.
    */
-  MonotonicFixpointIterator(const Graph& graph, size_t cfg_size_hint = 4)
+  MonotonicFixpointIterator(
+      const Graph& graph,
+      size_t cfg_size_hint = 4,
+      FixpointIterationStrategy strategy = FixpointIterationStrategy::Recursive,
+      bool store_entry_states = true)
       : m_graph(graph),
+        m_strategy(strategy),
+        m_store_entry_states(store_entry_states ||
+                             strategy == FixpointIterationStrategy::Recursive),
         m_wto(GraphInterface::entry(graph),
               [=, &graph](const NodeId& x) {
                 std::vector<EdgeId> succ_edges =
@@ -177,7 +213,14 @@ class MonotonicFixpointIterator {
                 return succ_nodes;
               }),
         m_entry_states(cfg_size_hint),
-        m_exit_states(cfg_size_hint) {}
+        m_exit_states(cfg_size_hint) {
+    if (m_strategy == FixpointIterationStrategy::Worklist) {
+      m_positions.reserve(cfg_size_hint);
+      for (const WtoComponent<NodeId>& component : m_wto) {
+        number_component(component);
+      }
+    }
+  }
 
   /*
    * This method implements the semantic transformer for each node in the
@@ -241,6 +284,13 @@ class MonotonicFixpointIterator {
     std::lock_guard<std::recursive_mutex> guard(m_lock);
     clear();
     Context context(init);
+    if (m_strategy == FixpointIterationStrategy::Worklist) {
+      if (!m_store_entry_states) {
+        m_init = init;
+      }
+      run_worklist(&context);
+      return;
+    }
     for (const WtoComponent<NodeId>& component : m_wto) {
       analyze_component(&context, component);
     }
@@ -252,7 +302,19 @@ class MonotonicFixpointIterator {
   Domain get_entry_state_at(const NodeId& node) const {
     std::lock_guard<std::recursive_mutex> guard(m_lock);
     auto it = m_entry_states.find(node);
-    return (it == m_entry_states.end()) ? Domain::bottom() : it->second;
+    if (it != m_entry_states.end()) {
+      return it->second;
+    }
+    if (m_store_entry_states || m_exit_states.count(node) == 0) {
+      // The node hasn't been reached by the iteration.
+      return Domain::bottom();
+    }
+    // The entry state of a node that is not an SCC head wasn't stored. Since
+    // the node is reanalyzed whenever one of its predecessors changes, its
+    // entry state is precisely the join of their final exit states.
+    Domain entry_state;
+    compute_entry_state(m_init, node, &entry_state);
+    return entry_state;
   }
 
   /*
@@ -286,10 +348,16 @@ class MonotonicFixpointIterator {
 
   void compute_entry_state(Context* context,
                            const NodeId& node,
-                           Domain* placeholder) {
+                           Domain* placeholder) const {
+    compute_entry_state(context->get_initial_value(), node, placeholder);
+  }
+
+  void compute_entry_state(const Domain& init,
+                           const NodeId& node,
+                           Domain* placeholder) const {
     placeholder->set_to_bottom();
     if (node == GraphInterface::entry(m_graph)) {
-      placeholder->join_with(context->get_initial_value());
+      placeholder->join_with(init);
     }
     for (EdgeId edge : GraphInterface::predecessors(m_graph, node)) {
       placeholder->join_with(analyze_edge(
@@ -355,11 +423,105 @@ class MonotonicFixpointIterator {
     }
   }
 
+  /*
+   * Assigns to each node its position in the weak topological ordering. For an
+   * SCC head, we also record the position that follows the last node of the
+   * SCC, so that the nested SCCs can be identified.
+   */
+  void number_component(const WtoComponent<NodeId>& component) {
+    uint32_t position = m_nodes.size();
+    m_positions.emplace(component.head_node(), position);
+    m_nodes.push_back(component.head_node());
+    m_scc_ends.push_back(0);
+    if (component.is_scc()) {
+      for (const auto& subcomponent : component) {
+        number_component(subcomponent);
+      }
+      m_scc_ends[position] = m_nodes.size();
+    }
+  }
+
+  bool is_scc_head(uint32_t position) const {
+    return m_scc_ends[position] != 0;
+  }
+
+  void run_worklist(Context* context) {
+    using Worklist = std::priority_queue<uint32_t,
+                                         std::vector<uint32_t>,
+                                         std::greater<uint32_t>>;
+    Worklist worklist;
+    std::vector<bool> queued(m_nodes.size(), false);
+    worklist.push(0);
+    queued[0] = true;
+    while (!worklist.empty()) {
+      uint32_t position = worklist.top();
+      worklist.pop();
+      queued[position] = false;
+      const NodeId& node = m_nodes[position];
+      Domain entry_state;
+      compute_entry_state(context, node, &entry_state);
+      if (is_scc_head(position)) {
+        auto it = m_entry_states.find(node);
+        if (it == m_entry_states.end()) {
+          context->reset_local_iteration_count_for(node);
+          m_entry_states.emplace(node, entry_state);
+        } else {
+          Domain* current_state = &it->second;
+          if (entry_state.leq(*current_state)) {
+            // The iteration sequence has converged at this head. Unlike the
+            // recursive strategy, we can't refine the current state with the
+            // new one, as this would reschedule the whole SCC.
+            continue;
+          }
+          extrapolate(*context, node, current_state, entry_state);
+          context->increase_iteration_count_for(node);
+          // The SCCs nested in this one start a new local stabilization loop,
+          // as they would in the recursive strategy.
+          for (uint32_t p = position + 1; p < m_scc_ends[position]; ++p) {
+            if (is_scc_head(p)) {
+              context->reset_local_iteration_count_for(m_nodes[p]);
+            }
+          }
+          entry_state = *current_state;
+        }
+      } else if (m_store_entry_states) {
+        m_entry_states[node] = entry_state;
+      }
+      analyze_node(node, &entry_state);
+      auto it = m_exit_states.find(node);
+      if (it != m_exit_states.end()) {
+        if (entry_state.equals(it->second)) {
+          // Nothing has changed for the successors.
+          continue;
+        }
+        it->second = std::move(entry_state);
+      } else {
+        m_exit_states.emplace(node, std::move(entry_state));
+      }
+      for (EdgeId edge : GraphInterface::successors(m_graph, node)) {
+        auto succ = m_positions.find(GraphInterface::target(m_graph, edge));
+        if (succ != m_positions.end() && !queued[succ->second]) {
+          worklist.push(succ->second);
+          queued[succ->second] = true;
+        }
+      }
+    }
+  }
+
   mutable std::recursive_mutex m_lock;
   const Graph& m_graph;
+  const FixpointIterationStrategy m_strategy;
+  const bool m_store_entry_states;
   WeakTopologicalOrdering<NodeId, NodeHash> m_wto;
   std::unordered_map<NodeId, Domain, NodeHash> m_entry_states;
   std::unordered_map<NodeId, Domain, NodeHash> m_exit_states;
+  // The following fields are only used by the worklist strategy.
+  std::unordered_map<NodeId, uint32_t, NodeHash> m_positions;
+  std::vector<NodeId> m_nodes;
+  std::vector<uint32_t> m_scc_ends;
+  // The initial value of the last run, which is needed to recompute the entry
+  // state of the root when entry states aren't stored.
+  Domain m_init;
 };
 
 template <typename GraphInterface>
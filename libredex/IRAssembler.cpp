@@ -322,7 +322,7 @@ std::unique_ptr<IRCode> ircode_from_s_expr(const s_expr& e) {
   always_assert_log(insns_expr.size() > 0, "Empty instruction list?! %s");
   LabelDefs label_defs;
   LabelRefs label_refs;
-  uint16_t max_reg;
+  uint16_t max_reg{0};
 
   for (size_t i = 0; i < insns_expr.size(); ++i) {
     std::string keyword;
@@ -10,6 +10,7 @@
 #include "IRCode.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/bimap/bimap.hpp>
 #include <boost/bimap/unordered_set_of.hpp>
 #include <boost/numeric/conversion/cast.hpp>
@@ -149,20 +150,25 @@ bool encode_offset(IRList* ir,
   return true;
 }
 
-static bool multi_target_compare_index(const BranchTarget* a,
-                                       const BranchTarget* b) {
-  return (a->index < b->index);
-}
+namespace {
 
-static bool multi_contains_gaps(const std::vector<BranchTarget*>& targets) {
-  int32_t key = targets.front()->index;
-  for (auto target : targets) {
-    if (target->index != key) return true;
+// A case of a switch being emitted: its key and the address it jumps to.
+struct SwitchCase {
+  int32_t key;
+  uint32_t addr;
+};
+
+bool multi_contains_gaps(const std::vector<SwitchCase>& cases) {
+  int32_t key = cases.front().key;
+  for (const auto& c : cases) {
+    if (c.key != key) return true;
     key++;
   }
   return false;
 }
 
+} // namespace
+
 static void insert_multi_branch_target(IRList* ir,
                                        int32_t index,
                                        MethodItemEntry* target,
@@ -532,6 +538,11 @@ IRList* deep_copy_ir_list(IRList* old_ir_list) {
 
 } // namespace
 
+size_t IRCode::fresh_epoch() {
+  static std::atomic<size_t> s_next_base{1};
+  return s_next_base.fetch_add(1, std::memory_order_relaxed) << 32;
+}
+
 IRCode::IRCode(): m_ir_list(new IRList()) {}
 
 IRCode::~IRCode() {
@@ -549,11 +560,14 @@ IRCode::IRCode(DexMethod* method): m_ir_list(new IRList()) {
 
 IRCode::IRCode(DexMethod* method, size_t temp_regs)
     : m_ir_list(new IRList()) {
-  always_assert(method->get_dex_code() == nullptr);
+  always_assert(method->get_dex_code() == nullptr ||
+                method->is_balloon_pending());
   generate_load_params(method, temp_regs, this);
 }
 
 IRCode::IRCode(const IRCode& code) {
+  always_assert_log(!code.editable_cfg_built(),
+                    "Code held by an editable CFG must be linearized first");
   IRList* old_ir_list = code.m_ir_list;
   m_ir_list = deep_copy_ir_list(old_ir_list);
   m_registers_size = code.m_registers_size;
@@ -563,13 +577,27 @@ IRCode::IRCode(const IRCode& code) {
 }
 
 void IRCode::build_cfg(bool editable) {
+  if (!editable && m_cfg && !m_cfg->editable() && m_cfg_epoch == m_epoch &&
+      m_cfg_version == m_cfg->version()) {
+    return;
+  }
+  if (editable && editable_cfg_built()) {
+    return;
+  }
   clear_cfg();
   m_cfg = std::make_unique<ControlFlowGraph>(m_ir_list, editable);
+  m_cfg_epoch = m_epoch;
+  m_cfg_version = m_cfg->version();
+}
+
+bool IRCode::editable_cfg_built() const {
+  return m_cfg && m_cfg->editable();
 }
 
 void IRCode::clear_cfg() {
   if (m_cfg && m_cfg->editable()) {
     m_ir_list = m_cfg->linearize();
+    mark_modified();
   }
 
   m_cfg.reset();
@@ -584,6 +612,56 @@ void IRCode::clear_cfg() {
   }
 }
 
+const opcode::OpcodeClasses& IRCode::opcode_classes() {
+  // An editable CFG owns the instructions, and edits to it don't go through
+  // the methods that bump m_epoch.
+  bool editable = m_cfg && m_cfg->editable();
+  if (!editable && m_opcode_classes_valid &&
+      m_opcode_classes_epoch == m_epoch) {
+    return m_opcode_classes;
+  }
+  m_opcode_classes.reset();
+  auto add = [this](const MethodItemEntry& mie) {
+    m_opcode_classes.set(
+        static_cast<size_t>(opcode::opcode_class(mie.insn->opcode())));
+  };
+  if (editable) {
+    for (auto* block : m_cfg->blocks()) {
+      for (const auto& mie : InstructionIterable(block)) {
+        add(mie);
+      }
+    }
+  } else {
+    for (const auto& mie : InstructionIterable(m_ir_list)) {
+      add(mie);
+    }
+  }
+  m_opcode_classes_valid = !editable;
+  m_opcode_classes_epoch = m_epoch;
+  return m_opcode_classes;
+}
+
+const InstructionSnapshot& IRCode::instruction_snapshot() {
+  // As in opcode_classes(), edits to an editable CFG don't bump m_epoch.
+  bool editable = m_cfg && m_cfg->editable();
+  if (m_snapshot == nullptr) {
+    m_snapshot = std::make_unique<InstructionSnapshot>();
+  } else if (!editable && m_snapshot_valid && m_snapshot_epoch == m_epoch) {
+    return *m_snapshot;
+  }
+  if (editable) {
+    m_snapshot->clear();
+    for (auto* block : m_cfg->blocks()) {
+      m_snapshot->append(*block);
+    }
+  } else {
+    m_snapshot->assign(*m_ir_list);
+  }
+  m_snapshot_valid = !editable;
+  m_snapshot_epoch = m_epoch;
+  return *m_snapshot;
+}
+
 namespace {
 
 using RegMap = transform::RegMap;
@@ -612,7 +690,7 @@ uint16_t calc_outs_size(const IRCode* code) {
 }
 
 void calculate_ins_size(const DexMethod* method, DexCode* dex_code) {
-  auto& args_list = method->get_proto()->get_args()->get_type_list();
+  const auto& args_list = method->get_proto()->get_args()->get_type_list();
   uint16_t ins_size{0};
   if (!is_static(method)) {
     ++ins_size;
@@ -718,6 +796,7 @@ std::unique_ptr<DexCode> IRCode::sync(const DexMethod* method) {
 
 bool IRCode::try_sync(DexCode* code) {
   std::unordered_map<MethodItemEntry*, uint32_t> entry_to_addr;
+  entry_to_addr.reserve(m_ir_list->size());
   uint32_t addr = 0;
   // Step 1, regenerate opcode list for the method, and
   // and calculate the opcode entries address offsets.
@@ -740,8 +819,11 @@ bool IRCode::try_sync(DexCode* code) {
   // we have reached the fixed point.
   TRACE(MTRANS, 5, "Recalculating branches\n");
   std::vector<MethodItemEntry*> multi_branches;
-  std::unordered_map<MethodItemEntry*, std::vector<BranchTarget*>> multis;
-  std::unordered_map<BranchTarget*, uint32_t> multi_targets;
+  // The case table of every switch. The cases of a switch that share a
+  // target come in a row, so the table is looked up once per run.
+  std::unordered_map<MethodItemEntry*, std::vector<SwitchCase>> multis;
+  MethodItemEntry* multi_src = nullptr;
+  std::vector<SwitchCase>* multi_cases = nullptr;
   bool needs_resync = false;
   for (auto miter = m_ir_list->begin(); miter != m_ir_list->end(); ++miter) {
     MethodItemEntry* mentry = &*miter;
@@ -757,8 +839,11 @@ bool IRCode::try_sync(DexCode* code) {
     if (mentry->type == MFLOW_TARGET) {
       BranchTarget* bt = mentry->target;
       if (bt->type == BRANCH_MULTI) {
-        multis[bt->src].push_back(bt);
-        multi_targets[bt] = entry_to_addr.at(mentry);
+        if (bt->src != multi_src) {
+          multi_src = bt->src;
+          multi_cases = &multis[multi_src];
+        }
+        multi_cases->push_back({bt->index, entry_to_addr.at(mentry)});
         // We can't fix the primary switch opcodes address until we emit
         // the fopcode, which comes later.
       } else if (bt->type == BRANCH_SIMPLE &&
@@ -817,22 +902,27 @@ bool IRCode::try_sync(DexCode* code) {
   TRACE(MTRANS, 5, "Emitting multi-branches\n");
   // Step 3, generate multi-branch fopcodes
   for (auto multiopcode : multi_branches) {
-    auto& targets = multis[multiopcode];
+    auto& cases = multis[multiopcode];
     auto multi_insn = multiopcode->dex_insn;
-    std::sort(targets.begin(), targets.end(), multi_target_compare_index);
-    always_assert_log(!targets.empty(), "need to have targets");
-    if (multi_contains_gaps(targets)) {
+    auto multi_addr = entry_to_addr.at(multiopcode);
+    std::sort(cases.begin(),
+              cases.end(),
+              [](const SwitchCase& a, const SwitchCase& b) {
+                return a.key < b.key;
+              });
+    always_assert_log(!cases.empty(), "need to have targets");
+    if (multi_contains_gaps(cases)) {
       // Emit sparse.
-      const size_t count = (targets.size() * 4) + 2;
+      const size_t count = (cases.size() * 4) + 2;
       auto sparse_payload = std::make_unique<uint16_t[]>(count);
       sparse_payload[0] = FOPCODE_SPARSE_SWITCH;
-      sparse_payload[1] = targets.size();
+      sparse_payload[1] = cases.size();
       uint32_t* spkeys = (uint32_t*)&sparse_payload[2];
       uint32_t* sptargets =
-          (uint32_t*)&sparse_payload[2 + (targets.size() * 2)];
-      for (BranchTarget* target : targets) {
-        *spkeys++ = target->index;
-        *sptargets++ = multi_targets[target] - entry_to_addr.at(multiopcode);
+          (uint32_t*)&sparse_payload[2 + (cases.size() * 2)];
+      for (const auto& c : cases) {
+        *spkeys++ = c.key;
+        *sptargets++ = c.addr - multi_addr;
       }
       // Emit align nop
       if (addr & 1) {
@@ -846,19 +936,19 @@ bool IRCode::try_sync(DexCode* code) {
       opout.push_back(fop);
       // re-write the source opcode with the address of the
       // fopcode, increment the address of the fopcode.
-      multi_insn->set_offset(addr - entry_to_addr.at(multiopcode));
+      multi_insn->set_offset(addr - multi_addr);
       multi_insn->set_opcode(DOPCODE_SPARSE_SWITCH);
       addr += count;
     } else {
       // Emit packed.
-      const size_t count = (targets.size() * 2) + 4;
+      const size_t count = (cases.size() * 2) + 4;
       auto packed_payload = std::make_unique<uint16_t[]>(count);
       packed_payload[0] = FOPCODE_PACKED_SWITCH;
-      packed_payload[1] = targets.size();
+      packed_payload[1] = cases.size();
       uint32_t* psdata = (uint32_t*)&packed_payload[2];
-      *psdata++ = targets.front()->index;
-      for (BranchTarget* target : targets) {
-        *psdata++ = multi_targets[target] - entry_to_addr.at(multiopcode);
+      *psdata++ = cases.front().key;
+      for (const auto& c : cases) {
+        *psdata++ = c.addr - multi_addr;
       }
       // Emit align nop
       if (addr & 1) {
@@ -872,7 +962,7 @@ bool IRCode::try_sync(DexCode* code) {
       opout.push_back(fop);
       // re-write the source opcode with the address of the
       // fopcode, increment the address of the fopcode.
-      multi_insn->set_offset(addr - entry_to_addr.at(multiopcode));
+      multi_insn->set_offset(addr - multi_addr);
       multi_insn->set_opcode(DOPCODE_PACKED_SWITCH);
       addr += count;
     }
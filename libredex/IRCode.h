@@ -10,6 +10,7 @@
 #pragma once
 
 #include <atomic>
+#include <iosfwd>
 #include <mutex>
 #include <set>
 #include <unordered_map>
@@ -31,8 +32,26 @@ class IRCode {
    */
   bool try_sync(DexCode*);
 
+  // The initial epoch of a new IRCode. Epochs are drawn from disjoint ranges
+  // of 2^32 values, one per IRCode.
+  static size_t fresh_epoch();
+
   IRList* m_ir_list;
   std::unique_ptr<ControlFlowGraph> m_cfg;
+  // Bumped on every change to m_ir_list; m_cfg is reused by build_cfg() only
+  // while this and the graph's own version match what they were when it was
+  // built.
+  size_t m_epoch{fresh_epoch()};
+  size_t m_cfg_epoch{0};
+  size_t m_cfg_version{0};
+  // Summary of the opcodes in m_ir_list, valid while m_epoch is unchanged.
+  opcode::OpcodeClasses m_opcode_classes;
+  bool m_opcode_classes_valid{false};
+  size_t m_opcode_classes_epoch{0};
+  // Likewise for the instruction snapshot.
+  std::unique_ptr<InstructionSnapshot> m_snapshot;
+  bool m_snapshot_valid{false};
+  size_t m_snapshot_epoch{0};
 
   uint16_t m_registers_size{0};
   // TODO(jezng): we shouldn't be storing / exposing the DexDebugItem... just
@@ -43,12 +62,14 @@ class IRCode {
   IRList::iterator make_if_block(IRList::iterator cur,
                                  IRInstruction* insn,
                                  IRList::iterator* if_block) {
+    mark_modified();
     return m_ir_list->make_if_block(cur, insn, if_block);
   }
   IRList::iterator make_if_else_block(IRList::iterator cur,
                                       IRInstruction* insn,
                                       IRList::iterator* if_block,
                                       IRList::iterator* else_block) {
+    mark_modified();
     return m_ir_list->make_if_else_block(cur, insn, if_block, else_block);
   }
   IRList::iterator make_switch_block(
@@ -56,6 +77,7 @@ class IRCode {
       IRInstruction* insn,
       IRList::iterator* default_block,
       std::map<SwitchIndices, IRList::iterator>& cases) {
+    mark_modified();
     return m_ir_list->make_switch_block(cur, insn, default_block, cases);
   }
 
@@ -90,7 +112,10 @@ class IRCode {
 
   uint16_t get_registers_size() const { return m_registers_size; }
 
-  void set_registers_size(uint16_t sz) { m_registers_size = sz; }
+  void set_registers_size(uint16_t sz) {
+    mark_modified();
+    m_registers_size = sz;
+  }
 
   uint16_t allocate_temp() { return m_registers_size++; }
 
@@ -139,8 +164,31 @@ class IRCode {
   //    MethodItemEntries taken from IRCode)
   // Changes to an editable CFG are reflected in IRCode after `clear_cfg` is
   // called
+  //
+  // A non editable CFG is kept until the code changes, so asking for one
+  // again (say, in the next pass) returns the existing graph, along with its
+  // cached postorder and dominators. The IRCode methods below that change the
+  // code invalidate it; code that edits entries in place through iterators in
+  // a way that could change the graph must call `mark_modified` itself.
+  //
+  // An editable CFG holds the code until `clear_cfg` is called, so asking for
+  // one again returns the existing graph as it was left. While it exists the
+  // instruction list is empty, and only the CFG may be used.
   void build_cfg(bool editable = false);
 
+  bool editable_cfg_built() const;
+
+  // Invalidate the cached CFG after editing this code's MethodItemEntries
+  // directly, e.g. retargeting a branch or dropping a try marker.
+  void mark_modified() { ++m_epoch; }
+
+  // Changes whenever this code is changed through the methods of IRCode, or
+  // marked modified. No two IRCode instances start from the same epoch, so
+  // remembering the epoch of a method's code is enough to tell later whether
+  // it was changed or replaced (see DexMethod::set_code). Instructions edited
+  // in place, e.g. through IRInstruction::set_src, don't change it.
+  size_t epoch() const { return m_epoch; }
+
   // if the cfg was editable, linearize it back into m_ir_list
   void clear_cfg();
 
@@ -149,12 +197,14 @@ class IRCode {
 
   /* Passes memory ownership of "from" to callee.  It will delete it. */
   void replace_opcode(IRInstruction* from, IRInstruction* to) {
+    mark_modified();
     m_ir_list->replace_opcode(from, to);
   }
 
   /* Passes memory ownership of "from" to callee.  It will delete it. */
   void replace_opcode(IRInstruction* to_delete,
                       std::vector<IRInstruction*> replacements) {
+    mark_modified();
     m_ir_list->replace_opcode(to_delete, replacements);
   }
 
@@ -163,22 +213,28 @@ class IRCode {
    * to appease the compiler in various scenarios of unreachable code.
    */
   void replace_opcode_with_infinite_loop(IRInstruction* from) {
+    mark_modified();
     m_ir_list->replace_opcode_with_infinite_loop(from);
   }
 
   /* Like replace_opcode, but both :from and :to must be branch opcodes.
    * :to will end up jumping to the same destination as :from. */
   void replace_branch(IRInstruction* from, IRInstruction* to) {
+    mark_modified();
     m_ir_list->replace_branch(from, to);
   }
 
   template <class... Args>
   void push_back(Args&&... args) {
+    mark_modified();
     m_ir_list->push_back(*(new MethodItemEntry(std::forward<Args>(args)...)));
   }
 
   /* Passes memory ownership of "mie" to callee. */
-  void push_back(MethodItemEntry& mie) { m_ir_list->push_back(mie); }
+  void push_back(MethodItemEntry& mie) {
+    mark_modified();
+    m_ir_list->push_back(mie);
+  }
 
   /*
    * Insert after instruction :position.
@@ -190,22 +246,26 @@ class IRCode {
    */
   void insert_after(IRInstruction* position,
                     const std::vector<IRInstruction*>& opcodes) {
+    mark_modified();
     m_ir_list->insert_after(position, opcodes);
   }
 
   IRList::iterator insert_before(const IRList::iterator& position,
                                  MethodItemEntry& mie) {
+    mark_modified();
     return m_ir_list->insert_before(position, mie);
   }
 
   IRList::iterator insert_after(const IRList::iterator& position,
                                 MethodItemEntry& mie) {
+    mark_modified();
     return m_ir_list->insert_after(position, mie);
   }
 
   template <class... Args>
   IRList::iterator insert_before(const IRList::iterator& position,
                                  Args&&... args) {
+    mark_modified();
     return m_ir_list->insert_before(
         position, *(new MethodItemEntry(std::forward<Args>(args)...)));
   }
@@ -214,6 +274,7 @@ class IRCode {
   IRList::iterator insert_after(const IRList::iterator& position,
                                 Args&&... args) {
     always_assert(position != m_ir_list->end());
+    mark_modified();
     return m_ir_list->insert_after(
         position, *(new MethodItemEntry(std::forward<Args>(args)...)));
   }
@@ -221,7 +282,10 @@ class IRCode {
   /* DEPRECATED! Use the version below that passes in the iterator instead,
    * which is O(1) instead of O(n). */
   /* Memory ownership of "insn" passes to callee, it will delete it. */
-  void remove_opcode(IRInstruction* insn) { m_ir_list->remove_opcode(insn); }
+  void remove_opcode(IRInstruction* insn) {
+    mark_modified();
+    m_ir_list->remove_opcode(insn);
+  }
 
   /*
    * Remove the instruction that :it points to.
@@ -230,11 +294,13 @@ class IRCode {
    * remove both that instruction and the move-result-pseudo that follows.
    */
   void remove_opcode(const IRList::iterator& it) {
+    mark_modified();
     m_ir_list->remove_opcode(it);
   }
 
   /* This method will delete the switch case where insn resides. */
   void remove_switch_case(IRInstruction* insn) {
+    mark_modified();
     m_ir_list->remove_switch_case(insn);
   }
 
@@ -249,6 +315,29 @@ class IRCode {
    */
   size_t count_opcodes() const { return m_ir_list->count_opcodes(); }
 
+  /*
+   * Returns the classes of the opcodes that occur in this code. The summary
+   * is computed on first use and kept until the code changes, so passes that
+   * only care about a few opcodes can cheaply skip most methods.
+   */
+  const opcode::OpcodeClasses& opcode_classes();
+
+  bool has_opcode_class(opcode::OpcodeClass opcode_class) {
+    return opcode_classes().test(static_cast<size_t>(opcode_class));
+  }
+
+  /*
+   * Returns the instructions of this code as an InstructionSnapshot, for
+   * analyses that only read them. Like opcode_classes(), it is built on first
+   * use and kept until the code changes; it costs about ten bytes per
+   * instruction while kept. Code that rewrites an instruction's opcode in
+   * place must call mark_modified() for the snapshot to see it.
+   *
+   * The returned reference is only good until the next call, since that may
+   * rebuild the snapshot.
+   */
+  const InstructionSnapshot& instruction_snapshot();
+
   IRList::iterator begin() { return m_ir_list->begin(); }
   IRList::iterator end() { return m_ir_list->end(); }
   IRList::const_iterator begin() const { return m_ir_list->begin(); }
@@ -258,8 +347,12 @@ class IRCode {
   IRList::reverse_iterator rbegin() { return m_ir_list->rbegin(); }
   IRList::reverse_iterator rend() { return m_ir_list->rend(); }
 
-  IRList::iterator erase(IRList::iterator it) { return m_ir_list->erase(it); }
+  IRList::iterator erase(IRList::iterator it) {
+    mark_modified();
+    return m_ir_list->erase(it);
+  }
   IRList::iterator erase_and_dispose(IRList::iterator it) {
+    mark_modified();
     return m_ir_list->erase_and_dispose(it);
   }
 
@@ -268,6 +361,7 @@ class IRCode {
   }
 
   friend std::string show(const IRCode*);
+  friend void show_to(std::ostream&, const IRCode*);
 
   friend class MethodSplicer;
 };
@@ -9,6 +9,8 @@
 
 #include "IRInstruction.h"
 
+#include <boost/functional/hash.hpp>
+
 #include "DexClass.h"
 #include "DexUtil.h"
 
@@ -25,7 +27,54 @@ DexOpcode convert_3to2addr(DexOpcode op) {
 }
 
 IRInstruction::IRInstruction(IROpcode op) : m_opcode(op) {
-  m_srcs.resize(opcode_impl::min_srcs_size(op));
+  resize_srcs(opcode_impl::min_srcs_size(op));
+}
+
+IRInstruction::IRInstruction(const IRInstruction& that)
+    : m_opcode(that.m_opcode), m_dest(that.m_dest), m_literal(that.m_literal) {
+  resize_srcs(that.m_num_srcs);
+  std::copy(that.srcs_data(), that.srcs_data() + m_num_srcs, srcs_data());
+}
+
+IRInstruction& IRInstruction::operator=(const IRInstruction& that) {
+  if (this != &that) {
+    m_opcode = that.m_opcode;
+    m_dest = that.m_dest;
+    m_literal = that.m_literal;
+    resize_srcs(that.m_num_srcs);
+    std::copy(that.srcs_data(), that.srcs_data() + m_num_srcs, srcs_data());
+  }
+  return *this;
+}
+
+IRInstruction::~IRInstruction() {
+  if (srcs_on_heap()) {
+    delete[] m_heap_srcs;
+  }
+}
+
+void IRInstruction::resize_srcs(size_t count) {
+  always_assert(count <= std::numeric_limits<uint16_t>::max());
+  if (count == m_num_srcs) {
+    return;
+  }
+  size_t keep = std::min<size_t>(count, m_num_srcs);
+  if (count > MAX_INLINE_SRCS) {
+    auto fresh = new uint16_t[count]();
+    std::copy(srcs_data(), srcs_data() + keep, fresh);
+    if (srcs_on_heap()) {
+      delete[] m_heap_srcs;
+    }
+    m_heap_srcs = fresh;
+  } else if (srcs_on_heap()) {
+    uint16_t* heap = m_heap_srcs;
+    std::copy(heap, heap + keep, m_inline_srcs);
+    std::fill(m_inline_srcs + keep, m_inline_srcs + count, 0);
+    delete[] heap;
+  } else {
+    std::fill(m_inline_srcs + keep, m_inline_srcs + count, 0);
+  }
+  m_num_srcs = count;
 }
 
 // Structural equality of opcodes except branches offsets are ignored
@@ -33,7 +82,8 @@ IRInstruction::IRInstruction(IROpcode op) : m_opcode(op) {
 bool IRInstruction::operator==(const IRInstruction& that) const {
   return m_opcode == that.m_opcode &&
     m_string == that.m_string && // just test one member of the union
-    m_srcs == that.m_srcs &&
+    m_num_srcs == that.m_num_srcs &&
+    std::equal(srcs_data(), srcs_data() + m_num_srcs, that.srcs_data()) &&
     m_dest == that.m_dest &&
     m_literal == that.m_literal;
 }
@@ -170,7 +220,7 @@ bool IRInstruction::src_is_wide(size_t i) const {
 
 void IRInstruction::normalize_registers() {
   if (is_invoke(opcode())) {
-    auto& args = get_method()->get_proto()->get_args()->get_type_list();
+    const auto& args = get_method()->get_proto()->get_args()->get_type_list();
     size_t old_srcs_idx{0};
     size_t srcs_idx{0};
     if (m_opcode != OPCODE_INVOKE_STATIC) {
@@ -194,7 +244,7 @@ void IRInstruction::normalize_registers() {
 
 void IRInstruction::denormalize_registers() {
   if (is_invoke(m_opcode)) {
-    auto& args = get_method()->get_proto()->get_args()->get_type_list();
+    const auto& args = get_method()->get_proto()->get_args()->get_type_list();
     std::vector<uint16_t> srcs;
     size_t args_idx {0};
     size_t srcs_idx {0};
@@ -210,7 +260,8 @@ void IRInstruction::denormalize_registers() {
       }
     }
     if (has_wide) {
-      m_srcs = srcs;
+      resize_srcs(srcs.size());
+      std::copy(srcs.begin(), srcs.end(), srcs_data());
     }
   }
 }
@@ -257,44 +308,41 @@ bool needs_range_conversion(const IRInstruction* insn) {
 }
 
 uint64_t IRInstruction::hash() {
-  std::vector<uint64_t> bits;
-  bits.push_back(opcode());
+  // Combine the fields in order, so that e.g. swapping the sources of an
+  // instruction changes its hash.
+  size_t result = 0;
+  boost::hash_combine(result, opcode());
 
   for (size_t i = 0; i < srcs_size(); i++) {
-    bits.push_back(src(i));
+    boost::hash_combine(result, src(i));
   }
 
   if (dests_size() > 0) {
-    bits.push_back(dest());
+    boost::hash_combine(result, dest());
   }
 
   if (has_data()) {
     size_t size = get_data()->data_size();
     const auto& data = get_data()->data();
     for (size_t i = 0; i < size; i++) {
-      bits.push_back(data[i]);
+      boost::hash_combine(result, data[i]);
     }
   }
 
   if (has_type()) {
-    bits.push_back(reinterpret_cast<uint64_t>(get_type()));
+    boost::hash_combine(result, get_type());
   }
   if (has_field()) {
-    bits.push_back(reinterpret_cast<uint64_t>(get_field()));
+    boost::hash_combine(result, get_field());
   }
   if (has_method()) {
-    bits.push_back(reinterpret_cast<uint64_t>(get_method()));
+    boost::hash_combine(result, get_method());
   }
   if (has_string()) {
-    bits.push_back(reinterpret_cast<uint64_t>(get_string()));
+    boost::hash_combine(result, get_string());
   }
   if (has_literal()) {
-    bits.push_back(get_literal());
-  }
-
-  uint64_t result = 0;
-  for (uint64_t elem : bits) {
-    result ^= elem;
+    boost::hash_combine(result, get_literal());
   }
   return result;
 }
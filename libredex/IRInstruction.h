@@ -9,7 +9,11 @@
 
 #pragma once
 
+#include <boost/range/iterator_range.hpp>
+
 #include "DexInstruction.h"
+#include "ObjectCensus.h"
+#include "SlabPool.h"
 
 /*
  * Our IR is very similar to the Dalvik instruction set, but with a few tweaks
@@ -106,9 +110,21 @@
  *   B2: <catches exceptions from B1>
  *     invoke-static {v0} LQux;.a(LFoo;)V
  */
-class IRInstruction final {
+class IRInstruction final
+    : public census::Counted<census::IR_INSTRUCTION> {
  public:
   explicit IRInstruction(IROpcode op);
+  IRInstruction(const IRInstruction&);
+  IRInstruction& operator=(const IRInstruction&);
+  ~IRInstruction();
+
+  // There are tens of millions of these live at once; see SlabPool.h.
+  static void* operator new(size_t size) {
+    return SlabPool<IRInstruction>::allocate(size);
+  }
+  static void operator delete(void* ptr, size_t size) {
+    SlabPool<IRInstruction>::deallocate(ptr, size);
+  }
 
   /*
    * Ensures that wide registers only have their first register referenced
@@ -152,7 +168,7 @@ class IRInstruction final {
    */
   size_t dests_size() const { return opcode_impl::dests_size(m_opcode); }
 
-  size_t srcs_size() const { return m_srcs.size(); }
+  size_t srcs_size() const { return m_num_srcs; }
 
   bool has_move_result_pseudo() const {
     return opcode_impl::has_move_result_pseudo(m_opcode);
@@ -195,9 +211,15 @@ class IRInstruction final {
     always_assert_log(dests_size(), "No dest for %s", SHOW(m_opcode));
     return m_dest;
   }
-  uint16_t src(size_t i) const { return m_srcs.at(i); }
-  const std::vector<uint16_t>& srcs() const { return m_srcs; }
-  uint16_t arg_word_count() const { return m_srcs.size(); }
+  uint16_t src(size_t i) const {
+    always_assert_log(i < m_num_srcs, "No src %lu for %s", i, SHOW(m_opcode));
+    return srcs_data()[i];
+  }
+  boost::iterator_range<const uint16_t*> srcs() const {
+    auto data = srcs_data();
+    return boost::make_iterator_range(data, data + m_num_srcs);
+  }
+  uint16_t arg_word_count() const { return m_num_srcs; }
 
   /*
    * Setters for logical parts of the instruction.
@@ -212,11 +234,12 @@ class IRInstruction final {
     return this;
   }
   IRInstruction* set_src(size_t i, uint16_t vreg) {
-    m_srcs.at(i) = vreg;
+    always_assert_log(i < m_num_srcs, "No src %lu for %s", i, SHOW(m_opcode));
+    srcs_data()[i] = vreg;
     return this;
   }
   IRInstruction* set_arg_word_count(uint16_t count) {
-    m_srcs.resize(count);
+    resize_srcs(count);
     return this;
   }
 
@@ -318,9 +341,31 @@ class IRInstruction final {
   uint64_t hash();
 
  private:
+  /*
+   * Source registers are stored inline unless there are more than
+   * MAX_INLINE_SRCS of them, which only happens for range instructions. Eight
+   * registers take up the same 16 bytes that the overflow pointer needs
+   * anyway.
+   */
+  static constexpr size_t MAX_INLINE_SRCS = 8;
+
+  bool srcs_on_heap() const { return m_num_srcs > MAX_INLINE_SRCS; }
+  const uint16_t* srcs_data() const {
+    return srcs_on_heap() ? m_heap_srcs : m_inline_srcs;
+  }
+  uint16_t* srcs_data() {
+    return srcs_on_heap() ? m_heap_srcs : m_inline_srcs;
+  }
+  // Like std::vector::resize: existing sources are kept, new ones are zero.
+  void resize_srcs(size_t count);
+
   IROpcode m_opcode;
-  std::vector<uint16_t> m_srcs;
+  uint16_t m_num_srcs{0};
   uint16_t m_dest{0};
+  union {
+    uint16_t m_inline_srcs[MAX_INLINE_SRCS]{};
+    uint16_t* m_heap_srcs;
+  };
   union {
     // Zero-initialize this union with the uint64_t member instead of a
     // pointer-type member so that it works properly even on 32-bit machines
@@ -15,6 +15,8 @@
 #include "DexClass.h"
 #include "DexDebugInstruction.h"
 #include "IRInstruction.h"
+#include "ObjectCensus.h"
+#include "SlabPool.h"
 
 struct MethodItemEntry;
 
@@ -69,6 +71,15 @@ struct BranchTarget {
   BranchTarget(MethodItemEntry* src) : type(BRANCH_SIMPLE), src(src) {}
   BranchTarget(MethodItemEntry* src, int32_t index)
       : type(BRANCH_MULTI), src(src), index(index) {}
+
+  // Every case of a switch has one, and generated switches can have
+  // thousands of cases; see SlabPool.h.
+  static void* operator new(size_t size) {
+    return SlabPool<BranchTarget>::allocate(size);
+  }
+  static void operator delete(void* ptr, size_t size) {
+    SlabPool<BranchTarget>::deallocate(ptr, size);
+  }
 };
 
 /*
@@ -104,7 +115,8 @@ enum MethodItemType {
   MFLOW_FALLTHROUGH,
 };
 
-struct MethodItemEntry {
+struct MethodItemEntry
+    : public census::Counted<census::METHOD_ITEM_ENTRY> {
   boost::intrusive::list_member_hook<> list_hook_;
   MethodItemType type;
 
@@ -120,6 +132,15 @@ struct MethodItemEntry {
     std::unique_ptr<DexPosition> pos;
   };
   MethodItemEntry(const MethodItemEntry&);
+
+  // Like IRInstructions, these are allocated in huge numbers; see SlabPool.h.
+  static void* operator new(size_t size) {
+    return SlabPool<MethodItemEntry>::allocate(size);
+  }
+  static void operator delete(void* ptr, size_t size) {
+    SlabPool<MethodItemEntry>::deallocate(ptr, size);
+  }
+
   explicit MethodItemEntry(DexInstruction* dex_insn) {
     this->type = MFLOW_DEX_OPCODE;
     this->dex_insn = dex_insn;
@@ -421,6 +442,65 @@ class InstructionIterable {
   bool structural_equals(const InstructionIterable& other);
 };
 
+/*
+ * The instructions of a list copied into one array, with their opcodes in
+ * another, in list order. Walking it reads both arrays front to back instead
+ * of visiting every MethodItemEntry and then its IRInstruction, which makes a
+ * difference in analyses that walk the same unchanged code repeatedly.
+ *
+ * It is a read-only view: it isn't updated when the list changes, and the
+ * instructions it points at belong to the list. See
+ * IRCode::instruction_snapshot() for one that is kept up to date.
+ */
+class InstructionSnapshot {
+ public:
+  InstructionSnapshot() = default;
+
+  /*
+   * Takes the instructions of `mentry_list`, anything InstructionIterable
+   * accepts. Reuses the arrays, so a snapshot rebuilt for the same code
+   * doesn't allocate.
+   */
+  template <typename T>
+  void assign(T& mentry_list) {
+    clear();
+    append(mentry_list);
+  }
+
+  void clear() {
+    m_insns.clear();
+    m_opcodes.clear();
+  }
+
+  template <typename T>
+  void append(T& mentry_list) {
+    for (const auto& mie : InstructionIterable(mentry_list)) {
+      m_insns.push_back(mie.insn);
+      m_opcodes.push_back(mie.insn->opcode());
+    }
+  }
+
+  size_t size() const { return m_insns.size(); }
+  bool empty() const { return m_insns.empty(); }
+
+  const IRInstruction* insn(size_t i) const { return m_insns[i]; }
+  IROpcode opcode(size_t i) const { return m_opcodes[i]; }
+
+  const std::vector<IRInstruction*>& instructions() const { return m_insns; }
+  const std::vector<IROpcode>& opcodes() const { return m_opcodes; }
+
+  std::vector<IRInstruction*>::const_iterator begin() const {
+    return m_insns.begin();
+  }
+  std::vector<IRInstruction*>::const_iterator end() const {
+    return m_insns.end();
+  }
+
+ private:
+  std::vector<IRInstruction*> m_insns;
+  std::vector<IROpcode> m_opcodes;
+};
+
 IRInstruction* primary_instruction_of_move_result_pseudo(IRList::iterator it);
 
 IRInstruction* move_result_pseudo_of(IRList::iterator it);
@@ -959,6 +959,38 @@ Branchingness branchingness(IROpcode op) {
   }
 }
 
+OpcodeClass opcode_class(IROpcode op) {
+  if (op >= OPCODE_IGET && op <= OPCODE_IGET_SHORT) {
+    return OpcodeClass::IGET;
+  }
+  if (op >= OPCODE_IPUT && op <= OPCODE_IPUT_SHORT) {
+    return OpcodeClass::IPUT;
+  }
+  if (op >= OPCODE_SGET && op <= OPCODE_SGET_SHORT) {
+    return OpcodeClass::SGET;
+  }
+  if (op >= OPCODE_SPUT && op <= OPCODE_SPUT_SHORT) {
+    return OpcodeClass::SPUT;
+  }
+  if (op >= OPCODE_INVOKE_VIRTUAL && op <= OPCODE_INVOKE_INTERFACE) {
+    return OpcodeClass::INVOKE;
+  }
+  switch (op) {
+  case OPCODE_CONST_STRING:
+    return OpcodeClass::CONST_STRING;
+  case OPCODE_CONST_CLASS:
+    return OpcodeClass::CONST_CLASS;
+  case OPCODE_CHECK_CAST:
+    return OpcodeClass::CHECK_CAST;
+  case OPCODE_INSTANCE_OF:
+    return OpcodeClass::INSTANCE_OF;
+  case OPCODE_NEW_INSTANCE:
+    return OpcodeClass::NEW_INSTANCE;
+  default:
+    return OpcodeClass::OTHER;
+  }
+}
+
 bool has_range_form(IROpcode op) {
   switch (op) {
   case OPCODE_INVOKE_DIRECT:
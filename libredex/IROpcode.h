@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <bitset>
 #include <cstdint>
 #include <string>
 
@@ -270,6 +271,33 @@ enum Branchingness {
 
 Branchingness branchingness(IROpcode op);
 
+/*
+ * Coarse classes of opcodes, used to summarize which kinds of instructions a
+ * method contains (see IRCode::opcode_classes). Passes that rewrite an opcode
+ * in place keep it within its class, e.g. invoke-virtual to invoke-static, so
+ * such rewrites never make a summary stale.
+ */
+enum class OpcodeClass : uint8_t {
+  CONST_STRING,
+  CONST_CLASS,
+  CHECK_CAST,
+  INSTANCE_OF,
+  NEW_INSTANCE,
+  IGET,
+  IPUT,
+  SGET,
+  SPUT,
+  INVOKE,
+  OTHER,
+};
+
+constexpr size_t NUM_OPCODE_CLASSES =
+    static_cast<size_t>(OpcodeClass::OTHER) + 1;
+
+using OpcodeClasses = std::bitset<NUM_OPCODE_CLASSES>;
+
+OpcodeClass opcode_class(IROpcode op);
+
 } // namespace opcode
 
 /*
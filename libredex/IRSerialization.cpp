@@ -0,0 +1,794 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "IRSerialization.h"
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "Creators.h"
+#include "Debug.h"
+#include "DexAnnotation.h"
+#include "DexDebugInstruction.h"
+#include "DexPosition.h"
+
+namespace ir_serialization {
+
+namespace {
+
+// Bumped whenever the layout of a record changes.
+constexpr uint32_t VERSION = 2;
+
+// What a record holds, written right after its version.
+enum RecordKind : uint32_t {
+  RECORD_CODE = 0,
+  RECORD_CLASS = 1,
+};
+
+void append_uleb(std::vector<uint8_t>* out, uint32_t v) {
+  uint8_t buf[5];
+  auto end = write_uleb128(buf, v);
+  out->insert(out->end(), buf, end);
+}
+
+/*
+ * A record is its version, then its kind, then a table of the strings it
+ * refers to, in the order of their first use, then the body. Within the body, strings are
+ * indices into that table, plus one so that zero can stand for null. Types
+ * are their descriptors, fields and methods the types and strings that make
+ * up their specs. Entries refer to each other by their position in the list.
+ */
+class RecordWriter {
+ public:
+  void write_code(const IRCode& code);
+  void write_class(const DexClass& cls);
+
+  void finish(RecordKind kind, std::vector<uint8_t>* out) const {
+    append_uleb(out, VERSION);
+    append_uleb(out, kind);
+    append_uleb(out, m_strings.size());
+    for (auto str : m_strings) {
+      append_uleb(out, str->size());
+      out->insert(out->end(), str->c_str(), str->c_str() + str->size());
+    }
+    out->insert(out->end(), m_body.begin(), m_body.end());
+  }
+
+ private:
+  void uleb(uint32_t v) { append_uleb(&m_body, v); }
+
+  // Zigzag-encoded, so that small negative values stay short.
+  void zigzag(int32_t v) {
+    uleb((static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31));
+  }
+
+  void u64(uint64_t v) {
+    for (size_t i = 0; i < 8; ++i) {
+      m_body.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+  }
+
+  void string(const DexString* str) {
+    if (str == nullptr) {
+      uleb(0);
+      return;
+    }
+    auto it = m_string_ids.emplace(str, m_strings.size()).first;
+    if (it->second == m_strings.size()) {
+      m_strings.push_back(str);
+    }
+    uleb(it->second + 1);
+  }
+
+  // For names that needn't be interned, such as deobfuscated ones.
+  void raw(const std::string& str) {
+    uleb(str.size());
+    m_body.insert(m_body.end(), str.begin(), str.end());
+  }
+
+  void type(const DexType* type) {
+    string(type == nullptr ? nullptr : type->get_name());
+  }
+
+  void proto(const DexProto* proto) {
+    type(proto->get_rtype());
+    const auto& args = proto->get_args()->get_type_list();
+    uleb(args.size());
+    for (auto arg : args) {
+      type(arg);
+    }
+  }
+
+  void field(const DexFieldRef* field) {
+    type(field->get_class());
+    string(field->get_name());
+    type(field->get_type());
+  }
+
+  // A null method is written as a null class.
+  void method(const DexMethodRef* method) {
+    if (method == nullptr) {
+      type(nullptr);
+      return;
+    }
+    type(method->get_class());
+    string(method->get_name());
+    proto(method->get_proto());
+  }
+
+  void write_insn(const IRInstruction* insn);
+  void write_debug(const DexDebugInstruction& dbg);
+  void write_value(const DexEncodedValue* value);
+
+  std::vector<uint8_t> m_body;
+  std::unordered_map<const DexString*, uint32_t> m_string_ids;
+  std::vector<const DexString*> m_strings;
+};
+
+void RecordWriter::write_code(const IRCode& code) {
+  uleb(code.get_registers_size());
+  auto dbg = const_cast<DexDebugItem*>(code.get_debug_item());
+  if (dbg == nullptr) {
+    uleb(0);
+  } else {
+    const auto& param_names = dbg->get_param_names();
+    uleb(param_names.size() + 1);
+    for (auto name : param_names) {
+      string(name);
+    }
+  }
+
+  std::unordered_map<const MethodItemEntry*, uint32_t> entry_ids;
+  std::unordered_map<const DexPosition*, uint32_t> position_ids;
+  for (const auto& mie : code) {
+    entry_ids.emplace(&mie, entry_ids.size());
+    if (mie.type == MFLOW_POSITION) {
+      position_ids.emplace(mie.pos.get(), position_ids.size());
+    }
+  }
+  uleb(entry_ids.size());
+  for (const auto& mie : code) {
+    uleb(mie.type);
+    switch (mie.type) {
+    case MFLOW_TRY:
+      uleb(mie.tentry->type);
+      uleb(entry_ids.at(mie.tentry->catch_start));
+      break;
+    case MFLOW_CATCH:
+      type(mie.centry->catch_type);
+      uleb(mie.centry->next ? entry_ids.at(mie.centry->next) + 1 : 0);
+      break;
+    case MFLOW_OPCODE:
+      write_insn(mie.insn);
+      break;
+    case MFLOW_TARGET:
+      uleb(mie.target->type);
+      uleb(entry_ids.at(mie.target->src));
+      if (mie.target->type == BRANCH_MULTI) {
+        zigzag(mie.target->index);
+      }
+      break;
+    case MFLOW_DEBUG:
+      write_debug(*mie.dbgop);
+      break;
+    case MFLOW_POSITION: {
+      const auto& pos = *mie.pos;
+      method(pos.method);
+      string(pos.file);
+      uleb(pos.line);
+      // As in copies of IRCode, parents that aren't in this code (which
+      // can only be dangling) are dropped.
+      auto parent = pos.parent == nullptr ? position_ids.end()
+                                          : position_ids.find(pos.parent);
+      uleb(parent == position_ids.end() ? 0 : parent->second + 1);
+      break;
+    }
+    case MFLOW_FALLTHROUGH:
+      break;
+    case MFLOW_DEX_OPCODE:
+      always_assert_log(false, "DexInstruction not expected here!");
+    }
+  }
+}
+
+void RecordWriter::write_insn(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  uleb(op);
+  if (insn->dests_size()) {
+    uleb(insn->dest());
+  }
+  uleb(insn->srcs_size());
+  for (auto src : insn->srcs()) {
+    uleb(src);
+  }
+  switch (opcode::ref(op)) {
+  case opcode::Ref::None:
+    break;
+  case opcode::Ref::Literal:
+    u64(insn->get_literal());
+    break;
+  case opcode::Ref::String:
+    string(insn->get_string());
+    break;
+  case opcode::Ref::Type:
+    type(insn->get_type());
+    break;
+  case opcode::Ref::Field:
+    field(insn->get_field());
+    break;
+  case opcode::Ref::Method:
+    method(insn->get_method());
+    break;
+  case opcode::Ref::Data: {
+    auto data = insn->get_data();
+    uleb(data->data_size());
+    uleb(data->opcode());
+    for (size_t i = 0; i < data->data_size(); ++i) {
+      uleb(data->data()[i]);
+    }
+    break;
+  }
+  }
+}
+
+void RecordWriter::write_debug(const DexDebugInstruction& dbg) {
+  uleb(dbg.opcode());
+  switch (dbg.opcode()) {
+  case DBG_SET_FILE:
+    string(static_cast<const DexDebugOpcodeSetFile&>(dbg).file());
+    break;
+  case DBG_START_LOCAL:
+  case DBG_START_LOCAL_EXTENDED: {
+    const auto& start = static_cast<const DexDebugOpcodeStartLocal&>(dbg);
+    uleb(start.uvalue());
+    string(start.name());
+    type(start.type());
+    string(start.sig());
+    break;
+  }
+  default:
+    // Signed values round-trip through their bits.
+    uleb(dbg.uvalue());
+    break;
+  }
+}
+
+/*
+ * Members are written in the order the class holds them, each by its name
+ * and type, since the class is implied. Annotations aren't written.
+ */
+void RecordWriter::write_class(const DexClass& cls) {
+  always_assert_log(!cls.is_external(), "Unexpected external class %s",
+                    SHOW(&cls));
+  type(cls.get_type());
+  uleb(cls.get_access());
+  type(cls.get_super_class());
+  const auto& interfaces = cls.get_interfaces()->get_type_list();
+  uleb(interfaces.size());
+  for (auto intf : interfaces) {
+    type(intf);
+  }
+  string(cls.get_source_file());
+  raw(cls.get_deobfuscated_name());
+
+  for (auto fields : {&cls.get_sfields(), &cls.get_ifields()}) {
+    uleb(fields->size());
+    for (auto field : *fields) {
+      string(field->get_name());
+      type(field->get_type());
+      uleb(field->get_access());
+      raw(field->get_deobfuscated_name());
+      if (fields == &cls.get_sfields()) {
+        write_value(field->get_static_value());
+      }
+    }
+  }
+  for (auto methods : {&cls.get_dmethods(), &cls.get_vmethods()}) {
+    uleb(methods->size());
+    for (auto method : *methods) {
+      string(method->get_name());
+      proto(method->get_proto());
+      uleb(method->get_access());
+      raw(method->get_deobfuscated_name());
+      auto code = method->get_code();
+      uleb(code != nullptr);
+      if (code != nullptr) {
+        write_code(*code);
+      }
+    }
+  }
+}
+
+// Zero stands for no value; otherwise the value type comes first, plus one.
+void RecordWriter::write_value(const DexEncodedValue* value) {
+  if (value == nullptr) {
+    uleb(0);
+    return;
+  }
+  auto evtype = value->evtype();
+  uleb(evtype + 1);
+  switch (evtype) {
+  case DEVT_BYTE:
+  case DEVT_SHORT:
+  case DEVT_CHAR:
+  case DEVT_INT:
+  case DEVT_LONG:
+  case DEVT_FLOAT:
+  case DEVT_DOUBLE:
+  case DEVT_BOOLEAN:
+    u64(value->value());
+    break;
+  case DEVT_NULL:
+    break;
+  case DEVT_STRING:
+    string(static_cast<const DexEncodedValueString*>(value)->string());
+    break;
+  case DEVT_TYPE:
+    type(static_cast<const DexEncodedValueType*>(value)->type());
+    break;
+  case DEVT_FIELD:
+  case DEVT_ENUM:
+    field(static_cast<const DexEncodedValueField*>(value)->field());
+    break;
+  case DEVT_METHOD:
+    method(static_cast<const DexEncodedValueMethod*>(value)->method());
+    break;
+  case DEVT_ARRAY: {
+    auto array = static_cast<const DexEncodedValueArray*>(value);
+    uleb(array->is_static_val());
+    uleb(array->evalues()->size());
+    for (auto element : *array->evalues()) {
+      write_value(element);
+    }
+    break;
+  }
+  case DEVT_ANNOTATION:
+    always_assert_log(false, "Annotation values are not supported");
+  }
+}
+
+class RecordReader {
+ public:
+  RecordReader(const uint8_t* data, size_t size)
+      : m_ptr(data), m_end(data + size) {}
+
+  std::unique_ptr<IRCode> read_code_record();
+  DexClass* read_class_record();
+
+ private:
+  void read_header(RecordKind kind);
+  std::unique_ptr<IRCode> read_code();
+  DexClass* read_class();
+  DexEncodedValue* read_value();
+
+  void check(bool ok) const {
+    always_assert_log(ok, "Malformed IR record");
+  }
+
+  uint32_t uleb() {
+    uint32_t result = 0;
+    for (uint32_t shift = 0;; shift += 7) {
+      check(m_ptr < m_end && shift < 35);
+      uint8_t byte = *m_ptr++;
+      result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return result;
+      }
+    }
+  }
+
+  int32_t zigzag() {
+    auto v = uleb();
+    return static_cast<int32_t>((v >> 1) ^ (~(v & 1) + 1));
+  }
+
+  uint64_t u64() {
+    check(m_end - m_ptr >= 8);
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; ++i) {
+      v |= static_cast<uint64_t>(*m_ptr++) << (8 * i);
+    }
+    return v;
+  }
+
+  DexString* string() {
+    auto id = uleb();
+    if (id == 0) {
+      return nullptr;
+    }
+    check(id <= m_strings.size());
+    return m_strings[id - 1];
+  }
+
+  std::string raw() {
+    auto size = uleb();
+    check(static_cast<size_t>(m_end - m_ptr) >= size);
+    std::string str(reinterpret_cast<const char*>(m_ptr), size);
+    m_ptr += size;
+    return str;
+  }
+
+  DexType* type() {
+    auto name = string();
+    return name == nullptr ? nullptr : DexType::make_type(name);
+  }
+
+  DexProto* proto() {
+    auto rtype = type();
+    check(rtype != nullptr);
+    std::deque<DexType*> args(uleb());
+    for (auto& arg : args) {
+      arg = type();
+      check(arg != nullptr);
+    }
+    return DexProto::make_proto(rtype,
+                                DexTypeList::make_type_list(std::move(args)));
+  }
+
+  DexFieldRef* field() {
+    auto cls = type();
+    auto name = string();
+    auto field_type = type();
+    check(cls != nullptr && name != nullptr && field_type != nullptr);
+    return DexField::make_field(cls, name, field_type);
+  }
+
+  DexMethodRef* method() {
+    auto cls = type();
+    if (cls == nullptr) {
+      return nullptr;
+    }
+    auto name = string();
+    check(name != nullptr);
+    return DexMethod::make_method(cls, name, proto());
+  }
+
+  IRInstruction* read_insn();
+  std::unique_ptr<DexDebugInstruction> read_debug();
+
+  const uint8_t* m_ptr;
+  const uint8_t* const m_end;
+  std::vector<DexString*> m_strings;
+};
+
+void RecordReader::read_header(RecordKind kind) {
+  always_assert_log(uleb() == VERSION, "Unsupported IR record version");
+  always_assert_log(uleb() == kind, "Unexpected kind of IR record");
+  m_strings.resize(uleb());
+  for (auto& str : m_strings) {
+    str = DexString::make_string(raw());
+  }
+}
+
+std::unique_ptr<IRCode> RecordReader::read_code_record() {
+  read_header(RECORD_CODE);
+  auto code = read_code();
+  check(m_ptr == m_end);
+  return code;
+}
+
+DexClass* RecordReader::read_class_record() {
+  read_header(RECORD_CLASS);
+  auto cls = read_class();
+  check(m_ptr == m_end);
+  return cls;
+}
+
+std::unique_ptr<IRCode> RecordReader::read_code() {
+  auto code = std::make_unique<IRCode>();
+  code->set_registers_size(uleb());
+  auto num_param_names = uleb();
+  if (num_param_names != 0) {
+    auto dbg = std::make_unique<DexDebugItem>();
+    auto& param_names = dbg->get_param_names();
+    for (size_t i = 0; i + 1 < num_param_names; ++i) {
+      param_names.push_back(string());
+    }
+    code->set_debug_item(std::move(dbg));
+  }
+
+  // Entries may refer to entries that come after them, so those references
+  // are filled in once all the entries exist.
+  std::vector<MethodItemEntry*> entries(uleb());
+  std::vector<std::pair<MethodItemEntry*, uint32_t>> links;
+  // TryEntry insists on its catch, so it is only created once that exists.
+  std::vector<std::pair<MethodItemEntry*, TryEntryType>> tries;
+  std::vector<DexPosition*> positions;
+  std::vector<std::pair<DexPosition*, uint32_t>> parents;
+  for (auto& mie : entries) {
+    mie = new MethodItemEntry();
+    mie->type = static_cast<MethodItemType>(uleb());
+    switch (mie->type) {
+    case MFLOW_TRY: {
+      auto try_type = static_cast<TryEntryType>(uleb());
+      check(try_type == TRY_START || try_type == TRY_END);
+      tries.emplace_back(mie, try_type);
+      links.emplace_back(mie, uleb());
+      break;
+    }
+    case MFLOW_CATCH:
+      mie->centry = new CatchEntry(type());
+      links.emplace_back(mie, uleb());
+      break;
+    case MFLOW_OPCODE:
+      mie->insn = read_insn();
+      break;
+    case MFLOW_TARGET: {
+      auto target = new BranchTarget();
+      mie->target = target;
+      target->type = static_cast<BranchTargetType>(uleb());
+      check(target->type == BRANCH_SIMPLE || target->type == BRANCH_MULTI);
+      links.emplace_back(mie, uleb());
+      if (target->type == BRANCH_MULTI) {
+        target->index = zigzag();
+      }
+      break;
+    }
+    case MFLOW_DEBUG:
+      new (&mie->dbgop) std::unique_ptr<DexDebugInstruction>(read_debug());
+      break;
+    case MFLOW_POSITION: {
+      auto method = static_cast<DexMethod*>(this->method());
+      auto file = string();
+      auto pos = std::make_unique<DexPosition>(uleb());
+      pos->method = method;
+      pos->file = file;
+      positions.push_back(pos.get());
+      parents.emplace_back(pos.get(), uleb());
+      new (&mie->pos) std::unique_ptr<DexPosition>(std::move(pos));
+      break;
+    }
+    case MFLOW_FALLTHROUGH:
+      break;
+    default:
+      check(false);
+    }
+    code->push_back(*mie);
+  }
+
+  auto entry = [&](uint32_t id) {
+    check(id < entries.size());
+    return entries[id];
+  };
+  auto try_type = tries.begin();
+  for (const auto& link : links) {
+    auto mie = link.first;
+    auto id = link.second;
+    switch (mie->type) {
+    case MFLOW_TRY:
+      always_assert(try_type->first == mie);
+      mie->tentry = new TryEntry((try_type++)->second, entry(id));
+      break;
+    case MFLOW_CATCH:
+      mie->centry->next = id == 0 ? nullptr : entry(id - 1);
+      break;
+    case MFLOW_TARGET:
+      mie->target->src = entry(id);
+      break;
+    default:
+      not_reached();
+    }
+  }
+  for (const auto& pos_and_parent : parents) {
+    auto id = pos_and_parent.second;
+    if (id != 0) {
+      check(id <= positions.size());
+      pos_and_parent.first->parent = positions[id - 1];
+    }
+  }
+  return code;
+}
+
+DexClass* RecordReader::read_class() {
+  auto self = type();
+  check(self != nullptr);
+  ClassCreator creator(self);
+  creator.set_access(static_cast<DexAccessFlags>(uleb()));
+  creator.set_super(type());
+  for (auto num_interfaces = uleb(); num_interfaces > 0; --num_interfaces) {
+    auto intf = type();
+    check(intf != nullptr);
+    creator.add_interface(intf);
+  }
+  auto source_file = string();
+  auto deobfuscated_name = raw();
+
+  for (bool is_static : {true, false}) {
+    for (auto num_fields = uleb(); num_fields > 0; --num_fields) {
+      auto name = string();
+      auto field_type = type();
+      check(name != nullptr && field_type != nullptr);
+      auto field = static_cast<DexField*>(
+          DexField::make_field(self, name, field_type));
+      auto access = static_cast<DexAccessFlags>(uleb());
+      field->set_deobfuscated_name(raw());
+      field->make_concrete(access, is_static ? read_value() : nullptr);
+      creator.add_field(field);
+    }
+  }
+  for (bool is_virtual : {false, true}) {
+    for (auto num_methods = uleb(); num_methods > 0; --num_methods) {
+      auto name = string();
+      check(name != nullptr);
+      auto method =
+          static_cast<DexMethod*>(DexMethod::make_method(self, name, proto()));
+      auto access = static_cast<DexAccessFlags>(uleb());
+      method->set_deobfuscated_name(raw());
+      std::unique_ptr<IRCode> code;
+      if (uleb() != 0) {
+        code = read_code();
+      }
+      method->make_concrete(access, std::move(code), is_virtual);
+      creator.add_method(method);
+    }
+  }
+
+  auto cls = creator.create();
+  cls->set_source_file(source_file);
+  cls->set_deobfuscated_name(deobfuscated_name);
+  return cls;
+}
+
+DexEncodedValue* RecordReader::read_value() {
+  auto tag = uleb();
+  if (tag == 0) {
+    return nullptr;
+  }
+  auto evtype = static_cast<DexEncodedValueTypes>(tag - 1);
+  switch (evtype) {
+  case DEVT_BYTE:
+  case DEVT_SHORT:
+  case DEVT_CHAR:
+  case DEVT_INT:
+  case DEVT_LONG:
+  case DEVT_FLOAT:
+  case DEVT_DOUBLE:
+  case DEVT_BOOLEAN: {
+    // The only way to make a primitive value from outside.
+    DexType* types[] = {get_byte_type(),   get_short_type(),
+                        get_char_type(),   get_int_type(),
+                        get_long_type(),   get_float_type(),
+                        get_double_type(), get_boolean_type()};
+    DexEncodedValue* value = nullptr;
+    for (auto primitive : types) {
+      auto zero = DexEncodedValue::zero_for_type(primitive);
+      if (zero->evtype() == evtype) {
+        value = zero;
+        break;
+      }
+      delete zero;
+    }
+    value->value(u64());
+    return value;
+  }
+  case DEVT_NULL:
+    return new DexEncodedValueBit(DEVT_NULL, false);
+  case DEVT_STRING: {
+    auto str = string();
+    check(str != nullptr);
+    return new DexEncodedValueString(str);
+  }
+  case DEVT_TYPE: {
+    auto value_type = type();
+    check(value_type != nullptr);
+    return new DexEncodedValueType(value_type);
+  }
+  case DEVT_FIELD:
+  case DEVT_ENUM:
+    return new DexEncodedValueField(evtype, field());
+  case DEVT_METHOD: {
+    auto value_method = method();
+    check(value_method != nullptr);
+    return new DexEncodedValueMethod(value_method);
+  }
+  case DEVT_ARRAY: {
+    bool is_static_val = uleb() != 0;
+    auto elements = new std::deque<DexEncodedValue*>(uleb());
+    for (auto& element : *elements) {
+      element = read_value();
+      check(element != nullptr);
+    }
+    return new DexEncodedValueArray(elements, is_static_val);
+  }
+  default:
+    check(false);
+    not_reached();
+  }
+}
+
+IRInstruction* RecordReader::read_insn() {
+  auto op = static_cast<IROpcode>(uleb());
+  auto insn = new IRInstruction(op);
+  if (insn->dests_size()) {
+    insn->set_dest(uleb());
+  }
+  insn->set_arg_word_count(uleb());
+  for (size_t i = 0; i < insn->srcs_size(); ++i) {
+    insn->set_src(i, uleb());
+  }
+  switch (opcode::ref(op)) {
+  case opcode::Ref::None:
+    break;
+  case opcode::Ref::Literal:
+    insn->set_literal(u64());
+    break;
+  case opcode::Ref::String:
+    insn->set_string(string());
+    break;
+  case opcode::Ref::Type:
+    insn->set_type(type());
+    break;
+  case opcode::Ref::Field:
+    insn->set_field(field());
+    break;
+  case opcode::Ref::Method: {
+    auto method = this->method();
+    check(method != nullptr);
+    insn->set_method(method);
+    break;
+  }
+  case opcode::Ref::Data: {
+    // The opcode of the payload comes first.
+    std::vector<uint16_t> words(uleb() + 1);
+    for (auto& word : words) {
+      word = uleb();
+    }
+    insn->set_data(new DexOpcodeData(words.data(), words.size() - 1));
+    break;
+  }
+  }
+  return insn;
+}
+
+std::unique_ptr<DexDebugInstruction> RecordReader::read_debug() {
+  auto op = static_cast<DexDebugItemOpcode>(uleb());
+  switch (op) {
+  case DBG_SET_FILE:
+    return std::make_unique<DexDebugOpcodeSetFile>(string());
+  case DBG_START_LOCAL:
+  case DBG_START_LOCAL_EXTENDED: {
+    auto reg = uleb();
+    auto name = string();
+    auto local_type = type();
+    auto sig = string();
+    return std::make_unique<DexDebugOpcodeStartLocal>(
+        reg, name, local_type, sig);
+  }
+  case DBG_ADVANCE_LINE:
+    return std::make_unique<DexDebugInstruction>(
+        op, static_cast<int32_t>(uleb()));
+  default:
+    return std::make_unique<DexDebugInstruction>(op, uleb());
+  }
+}
+
+} // namespace
+
+void serialize(const IRCode& code, std::vector<uint8_t>* out) {
+  RecordWriter writer;
+  writer.write_code(code);
+  writer.finish(RECORD_CODE, out);
+}
+
+void serialize(const DexClass& cls, std::vector<uint8_t>* out) {
+  RecordWriter writer;
+  writer.write_class(cls);
+  writer.finish(RECORD_CLASS, out);
+}
+
+std::unique_ptr<IRCode> deserialize(const uint8_t* data, size_t size) {
+  return RecordReader(data, size).read_code_record();
+}
+
+DexClass* deserialize_class(const uint8_t* data, size_t size) {
+  return RecordReader(data, size).read_class_record();
+}
+
+} // namespace ir_serialization
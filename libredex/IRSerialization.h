@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "IRCode.h"
+
+/*
+ * A compact binary form of IRCode and of the classes that hold it, for moving
+ * method bodies between processes, for caching them and for test fixtures.
+ *
+ * A code record holds everything in the code's instruction list (instructions
+ * and their payloads, branch targets, try and catch markers, debug
+ * instructions and positions, including the parents of inlined positions),
+ * its registers size and its parameter names. The CFG, if any, isn't part of
+ * it: an editable CFG must be cleared first. A class record holds the class's
+ * declaration and those of its fields and methods, with static values and
+ * method code, but not annotations.
+ *
+ * Strings, types, fields and methods are written by name rather than by
+ * address, so a record can be read by any process that has loaded the same
+ * program, not only by the one that wrote it. The encoding is deterministic:
+ * equal code gives equal bytes. Each record starts with a format version, and
+ * records of another version are rejected rather than misread.
+ */
+namespace ir_serialization {
+
+/*
+ * Appends a record of `code` to `out`.
+ */
+void serialize(const IRCode& code, std::vector<uint8_t>* out);
+
+/*
+ * Reads back a record written by serialize(). The strings, types, fields and
+ * methods it refers to are created if they don't exist yet.
+ */
+std::unique_ptr<IRCode> deserialize(const uint8_t* data, size_t size);
+
+/*
+ * Appends a record of `cls`, which must not be external, to `out`.
+ */
+void serialize(const DexClass& cls, std::vector<uint8_t>* out);
+
+/*
+ * Creates the class held by a record written by serialize(), which must not
+ * exist yet, and returns it.
+ */
+DexClass* deserialize_class(const uint8_t* data, size_t size);
+
+} // namespace ir_serialization
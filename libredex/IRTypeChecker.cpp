@@ -19,6 +19,7 @@
 #include <unordered_map>
 #include <utility>
 
+#include "ConstantAbstractDomain.h"
 #include "ControlFlow.h"
 #include "Debug.h"
 #include "DexAccess.h"
@@ -30,6 +31,7 @@
 #include "IROpcode.h"
 #include "Match.h"
 #include "PatriciaTreeMapAbstractEnvironment.h"
+#include "ReducedProductAbstractDomain.h"
 #include "Show.h"
 
 std::ostream& operator<<(std::ostream& output, const IRType& type) {
@@ -146,9 +148,74 @@ using register_t = uint32_t;
 constexpr register_t RESULT_REGISTER =
     std::numeric_limits<register_t>::max() - 1;
 
-using TypeEnvironment =
+using BasicTypeEnvironment =
     PatriciaTreeMapAbstractEnvironment<register_t, TypeDomain>;
 
+using DexTypeDomain = ConstantAbstractDomain<const DexType*>;
+
+using DexTypeEnvironment =
+    PatriciaTreeMapAbstractEnvironment<register_t, DexTypeDomain>;
+
+/*
+ * Along with the type of every register, we keep track of the Dex type of the
+ * references whose type is fixed by the instruction that defines them (e.g.,
+ * the return type of a method or the type of a field). Two different Dex types
+ * join into Top; we don't compute common superclasses. Setting the type of a
+ * register forgets its Dex type, so that the Dex type is only known where the
+ * transfer function states it explicitly. The two components are independent
+ * and hence, there is no reduction. The Dex types are only inferred on demand,
+ * the second component stays Top otherwise and costs next to nothing.
+ */
+class TypeEnvironment final
+    : public ReducedProductAbstractDomain<TypeEnvironment,
+                                          BasicTypeEnvironment,
+                                          DexTypeEnvironment> {
+ public:
+  using ReducedProductAbstractDomain::ReducedProductAbstractDomain;
+
+  // Some older compilers complain that the class is not default constructible.
+  TypeEnvironment() = default;
+
+  static TypeEnvironment top() { return TypeEnvironment(); }
+
+  static TypeEnvironment bottom() {
+    TypeEnvironment env;
+    env.set_to_bottom();
+    return env;
+  }
+
+  static void reduce_product(
+      std::tuple<BasicTypeEnvironment, DexTypeEnvironment>& /* product */) {}
+
+  TypeDomain get_type(register_t reg) const { return get<0>().get(reg); }
+
+  const DexType* get_dex_type(register_t reg) const {
+    auto type = get<1>().get(reg).get_constant();
+    return type ? *type : nullptr;
+  }
+
+  void set_type(register_t reg, const TypeDomain& type) {
+    apply<0>([reg, &type](BasicTypeEnvironment* env) { env->set(reg, type); });
+    // Unless Dex types are inferred, there is nothing to forget.
+    if (!get<1>().is_top()) {
+      apply<1>([reg](DexTypeEnvironment* env) {
+        env->set(reg, DexTypeDomain::top());
+      });
+    }
+  }
+
+  void update_type(register_t reg,
+                   const std::function<TypeDomain(const TypeDomain&)>& f) {
+    apply<0>([reg, &f](BasicTypeEnvironment* env) { env->update(reg, f); });
+  }
+
+  void set_dex_type(register_t reg, const DexType* type) {
+    apply<1>([reg, type](DexTypeEnvironment* env) {
+      env->set(reg, DexTypeDomain(type));
+    });
+  }
+};
+
 // We abort the type checking process at the first error encountered.
 class TypeCheckingException final : public std::runtime_error {
  public:
@@ -163,11 +230,13 @@ class TypeInference final
 
   TypeInference(const ControlFlowGraph& cfg,
                 bool enable_polymorphic_constants,
-                bool verify_moves)
+                bool verify_moves,
+                bool infer_dex_types)
       : MonotonicFixpointIterator(cfg, cfg.blocks().size()),
         m_cfg(cfg),
         m_enable_polymorphic_constants(enable_polymorphic_constants),
         m_verify_moves(verify_moves),
+        m_infer_dex_types(infer_dex_types),
         m_inference(true) {}
 
   void run(DexMethod* dex_method) {
@@ -187,15 +256,19 @@ class TypeInference final
       IRInstruction* insn = mie.insn;
       switch (insn->opcode()) {
       case IOPCODE_LOAD_PARAM_OBJECT: {
+        const DexType* type;
         if (first_param && !is_static(dex_method)) {
           // If the method is not static, the first parameter corresponds to
           // `this`.
           first_param = false;
+          type = dex_method->get_class();
         } else {
           // This is a regular parameter of the method.
-          always_assert(sig_it++ != signature.end());
+          always_assert(sig_it != signature.end());
+          type = *sig_it++;
         }
         set_reference(&init_state, insn->dest());
+        set_dex_type(&init_state, insn->dest(), type);
         break;
       }
       case IOPCODE_LOAD_PARAM: {
@@ -226,10 +299,34 @@ class TypeInference final
     }
   done:
     MonotonicFixpointIterator::run(init_state);
-    populate_type_environments();
-    // We turn off the type inference mode. All subsequent calls to
-    // analyze_instruction will perform type checking.
-    m_inference = false;
+  }
+
+  // Type-checks every instruction against the environment that holds before
+  // it. Instead of storing the environment of every instruction, we replay the
+  // inference within each block to step from one instruction to the next. The
+  // last instruction checked is stored in `insn`, so that the caller can tell
+  // which one was ill-typed when a TypeCheckingException is thrown.
+  void check_instructions(IRInstruction** insn) {
+    for (Block* block : m_cfg.blocks()) {
+      TypeEnvironment current_state = get_entry_state_at(block);
+      for (auto& mie : InstructionIterable(block)) {
+        *insn = mie.insn;
+        m_inference = false;
+        analyze_instruction(mie.insn, &current_state);
+        m_inference = true;
+        analyze_instruction(mie.insn, &current_state);
+      }
+    }
+  }
+
+  // The environments of all the instructions are only computed when they're
+  // queried, which the type checker itself doesn't need.
+  const std::unordered_map<IRInstruction*, TypeEnvironment>& type_envs() {
+    if (!m_type_envs_valid) {
+      populate_type_environments();
+      m_type_envs_valid = true;
+    }
+    return m_type_envs;
   }
 
   void analyze_node(const NodeId& node,
@@ -273,44 +370,56 @@ class TypeInference final
     }
     case OPCODE_MOVE: {
       assume_scalar(current_state, insn->src(0), /* in_move */ true);
-      set_type(current_state, insn->dest(), current_state->get(insn->src(0)));
+      set_type(
+          current_state, insn->dest(), current_state->get_type(insn->src(0)));
       break;
     }
     case OPCODE_MOVE_OBJECT: {
       assume_reference(current_state, insn->src(0), /* in_move */ true);
-      set_type(current_state, insn->dest(), current_state->get(insn->src(0)));
+      set_type(
+          current_state, insn->dest(), current_state->get_type(insn->src(0)));
+      set_dex_type(current_state,
+                   insn->dest(),
+                   current_state->get_dex_type(insn->src(0)));
       break;
     }
     case OPCODE_MOVE_WIDE: {
       assume_wide_scalar(current_state, insn->src(0));
-      set_type(current_state, insn->dest(), current_state->get(insn->src(0)));
+      set_type(
+          current_state, insn->dest(), current_state->get_type(insn->src(0)));
       set_type(current_state,
                insn->dest() + 1,
-               current_state->get(insn->src(0) + 1));
+               current_state->get_type(insn->src(0) + 1));
       break;
     }
     case IOPCODE_MOVE_RESULT_PSEUDO:
     case OPCODE_MOVE_RESULT: {
       assume_scalar(current_state, RESULT_REGISTER);
-      set_type(
-          current_state, insn->dest(), current_state->get(RESULT_REGISTER));
+      set_type(current_state,
+               insn->dest(),
+               current_state->get_type(RESULT_REGISTER));
       break;
     }
     case IOPCODE_MOVE_RESULT_PSEUDO_OBJECT:
     case OPCODE_MOVE_RESULT_OBJECT: {
       assume_reference(current_state, RESULT_REGISTER);
-      set_type(
-          current_state, insn->dest(), current_state->get(RESULT_REGISTER));
+      set_type(current_state,
+               insn->dest(),
+               current_state->get_type(RESULT_REGISTER));
+      set_dex_type(current_state,
+                   insn->dest(),
+                   current_state->get_dex_type(RESULT_REGISTER));
       break;
     }
     case IOPCODE_MOVE_RESULT_PSEUDO_WIDE:
     case OPCODE_MOVE_RESULT_WIDE: {
       assume_wide_scalar(current_state, RESULT_REGISTER);
-      set_type(
-          current_state, insn->dest(), current_state->get(RESULT_REGISTER));
+      set_type(current_state,
+               insn->dest(),
+               current_state->get_type(RESULT_REGISTER));
       set_type(current_state,
                insn->dest() + 1,
-               current_state->get(RESULT_REGISTER + 1));
+               current_state->get_type(RESULT_REGISTER + 1));
       break;
     }
     case OPCODE_MOVE_EXCEPTION: {
@@ -345,9 +454,14 @@ class TypeInference final
       set_type(current_state, insn->dest() + 1, TypeDomain(CONST2));
       break;
     }
-    case OPCODE_CONST_STRING:
+    case OPCODE_CONST_STRING: {
+      set_reference(current_state, RESULT_REGISTER);
+      set_dex_type(current_state, RESULT_REGISTER, get_string_type());
+      break;
+    }
     case OPCODE_CONST_CLASS: {
       set_reference(current_state, RESULT_REGISTER);
+      set_dex_type(current_state, RESULT_REGISTER, get_class_type());
       break;
     }
     case OPCODE_MONITOR_ENTER:
@@ -358,6 +472,7 @@ class TypeInference final
     case OPCODE_CHECK_CAST: {
       assume_reference(current_state, insn->src(0));
       set_reference(current_state, RESULT_REGISTER);
+      set_dex_type(current_state, RESULT_REGISTER, insn->get_type());
       break;
     }
     case OPCODE_INSTANCE_OF:
@@ -368,11 +483,13 @@ class TypeInference final
     }
     case OPCODE_NEW_INSTANCE: {
       set_reference(current_state, RESULT_REGISTER);
+      set_dex_type(current_state, RESULT_REGISTER, insn->get_type());
       break;
     }
     case OPCODE_NEW_ARRAY: {
       assume_integer(current_state, insn->src(0));
       set_reference(current_state, RESULT_REGISTER);
+      set_dex_type(current_state, RESULT_REGISTER, insn->get_type());
       break;
     }
     case OPCODE_FILLED_NEW_ARRAY: {
@@ -476,7 +593,15 @@ class TypeInference final
     case OPCODE_AGET_OBJECT: {
       assume_reference(current_state, insn->src(0));
       assume_integer(current_state, insn->src(1));
+      const DexType* array_type = current_state->get_dex_type(insn->src(0));
       set_reference(current_state, RESULT_REGISTER);
+      if (array_type != nullptr && is_array(array_type)) {
+        // The component type is the array type minus one dimension. We only
+        // look it up, the code must already refer to it if it's used.
+        set_dex_type(current_state,
+                     RESULT_REGISTER,
+                     DexType::get_type(array_type->get_name()->c_str() + 1));
+      }
       break;
     }
     case OPCODE_APUT: {
@@ -537,6 +662,8 @@ class TypeInference final
     case OPCODE_IGET_OBJECT: {
       assume_reference(current_state, insn->src(0));
       set_reference(current_state, RESULT_REGISTER);
+      set_dex_type(
+          current_state, RESULT_REGISTER, insn->get_field()->get_type());
       break;
     }
     case OPCODE_IPUT: {
@@ -594,6 +721,8 @@ class TypeInference final
     }
     case OPCODE_SGET_OBJECT: {
       set_reference(current_state, RESULT_REGISTER);
+      set_dex_type(
+          current_state, RESULT_REGISTER, insn->get_field()->get_type());
       break;
     }
     case OPCODE_SPUT: {
@@ -661,6 +790,7 @@ class TypeInference final
       }
       if (is_object(return_type)) {
         set_reference(current_state, RESULT_REGISTER);
+        set_dex_type(current_state, RESULT_REGISTER, return_type);
         break;
       }
       if (is_integer(return_type)) {
@@ -865,19 +995,22 @@ class TypeInference final
     }
   }
 
-  void print(std::ostream& output) const {
+  void print(std::ostream& output) {
+    const auto& envs = type_envs();
     for (Block* block : m_cfg.blocks()) {
       for (auto& mie : InstructionIterable(block)) {
         IRInstruction* insn = mie.insn;
-        auto it = m_type_envs.find(insn);
-        always_assert(it != m_type_envs.end());
-        output << SHOW(insn) << " -- " << it->second << std::endl;
+        auto it = envs.find(insn);
+        always_assert(it != envs.end());
+        show_to(output, insn);
+        output << " -- " << it->second.get<0>() << std::endl;
       }
     }
   }
 
  private:
   void populate_type_environments() {
+    m_inference = true;
     // We reserve enough space for the map in order to avoid repeated rehashing
     // during the computation.
     m_type_envs.reserve(m_cfg.blocks().size() * 16);
@@ -895,52 +1028,62 @@ class TypeInference final
                 register_t reg,
                 const TypeDomain& type) const {
     if (m_inference) {
-      state->set(reg, type);
+      state->set_type(reg, type);
+    }
+  }
+
+  // The Dex type is only recorded when it's known; the register otherwise
+  // keeps the Top Dex type given to it by set_type().
+  void set_dex_type(TypeEnvironment* state,
+                    register_t reg,
+                    const DexType* type) const {
+    if (m_inference && m_infer_dex_types && type != nullptr) {
+      state->set_dex_type(reg, type);
     }
   }
 
   void set_integer(TypeEnvironment* state, register_t reg) const {
     if (m_inference) {
-      state->set(reg, TypeDomain(INT));
+      state->set_type(reg, TypeDomain(INT));
     }
   }
 
   void set_float(TypeEnvironment* state, register_t reg) const {
     if (m_inference) {
-      state->set(reg, TypeDomain(FLOAT));
+      state->set_type(reg, TypeDomain(FLOAT));
     }
   }
 
   void set_scalar(TypeEnvironment* state, register_t reg) const {
     if (m_inference) {
-      state->set(reg, TypeDomain(SCALAR));
+      state->set_type(reg, TypeDomain(SCALAR));
     }
   }
 
   void set_reference(TypeEnvironment* state, register_t reg) const {
     if (m_inference) {
-      state->set(reg, TypeDomain(REFERENCE));
+      state->set_type(reg, TypeDomain(REFERENCE));
     }
   }
 
   void set_long(TypeEnvironment* state, register_t reg) const {
     if (m_inference) {
-      state->set(reg, TypeDomain(LONG1));
-      state->set(reg + 1, TypeDomain(LONG2));
+      state->set_type(reg, TypeDomain(LONG1));
+      state->set_type(reg + 1, TypeDomain(LONG2));
     }
   }
 
   void set_double(TypeEnvironment* state, register_t reg) const {
     if (m_inference) {
-      state->set(reg, TypeDomain(DOUBLE1));
-      state->set(reg + 1, TypeDomain(DOUBLE2));
+      state->set_type(reg, TypeDomain(DOUBLE1));
+      state->set_type(reg + 1, TypeDomain(DOUBLE2));
     }
   }
 
   void set_wide_scalar(TypeEnvironment* state, register_t reg) const {
     if (m_inference) {
-      state->set(reg, TypeDomain(SCALAR1));
-      state->set(reg + 1, TypeDomain(SCALAR2));
+      state->set_type(reg, TypeDomain(SCALAR1));
+      state->set_type(reg + 1, TypeDomain(SCALAR2));
     }
   }
 
@@ -966,7 +1109,7 @@ class TypeInference final
                    IRType expected,
                    bool ignore_top = false) const {
     if (m_inference) {
-      state->update(reg, [this, expected](const TypeDomain& type) {
+      state->update_type(reg, [this, expected](const TypeDomain& type) {
         return refine_type(
             type, expected, /* const_type */ CONST, /* scalar_type */ SCALAR);
       });
@@ -975,7 +1118,7 @@ class TypeInference final
         // There's nothing to do for unreachable code.
         return;
       }
-      IRType actual = state->get(reg).element();
+      IRType actual = state->get_type(reg).element();
       if (ignore_top && actual == TOP) {
         return;
       }
@@ -988,13 +1131,13 @@ class TypeInference final
                         IRType expected1,
                         IRType expected2) const {
     if (m_inference) {
-      state->update(reg, [this, expected1](const TypeDomain& type) {
+      state->update_type(reg, [this, expected1](const TypeDomain& type) {
         return refine_type(type,
                            expected1,
                            /* const_type */ CONST1,
                            /* scalar_type */ SCALAR1);
       });
-      state->update(reg + 1, [this, expected2](const TypeDomain& type) {
+      state->update_type(reg + 1, [this, expected2](const TypeDomain& type) {
         return refine_type(type,
                            expected2,
                            /* const_type */ CONST2,
@@ -1005,8 +1148,8 @@ class TypeInference final
         // There's nothing to do for unreachable code.
         return;
       }
-      IRType actual1 = state->get(reg).element();
-      IRType actual2 = state->get(reg + 1).element();
+      IRType actual1 = state->get_type(reg).element();
+      IRType actual2 = state->get_type(reg + 1).element();
       check_wide_type_match(reg,
                             actual1,
                             actual2,
@@ -1064,7 +1207,7 @@ class TypeInference final
       // There's nothing to do for unreachable code.
       return;
     }
-    IRType t = state->get(reg).element();
+    IRType t = state->get_type(reg).element();
     if (t == SCALAR) {
       // We can't say anything conclusive about a register that has SCALAR type,
       // so we just bail out.
@@ -1096,8 +1239,8 @@ class TypeInference final
       // There's nothing to do for unreachable code.
       return;
     }
-    IRType t1 = state->get(reg1).element();
-    IRType t2 = state->get(reg2).element();
+    IRType t1 = state->get_type(reg1).element();
+    IRType t2 = state->get_type(reg2).element();
     if (!((TypeDomain(t1).leq(TypeDomain(REFERENCE)) &&
            TypeDomain(t2).leq(TypeDomain(REFERENCE))) ||
           (TypeDomain(t1).leq(TypeDomain(SCALAR)) &&
@@ -1177,7 +1320,9 @@ class TypeInference final
   const ControlFlowGraph& m_cfg;
   bool m_enable_polymorphic_constants;
   bool m_verify_moves;
+  bool m_infer_dex_types;
   bool m_inference;
+  bool m_type_envs_valid{false};
   std::unordered_map<IRInstruction*, TypeEnvironment> m_type_envs;
 
   friend class ::IRTypeChecker;
@@ -1288,6 +1433,7 @@ IRTypeChecker::IRTypeChecker(DexMethod* dex_method)
       m_complete(false),
       m_enable_polymorphic_constants(false),
       m_verify_moves(false),
+      m_infer_dex_types(false),
       m_good(true),
       m_what("OK") {}
 
@@ -1316,42 +1462,49 @@ void IRTypeChecker::run() {
   // We then infer types for all the registers used in the method.
   code->build_cfg();
   const ControlFlowGraph& cfg = code->cfg();
-  m_type_inference = std::make_unique<irtc_impl::TypeInference>(
-      cfg, m_enable_polymorphic_constants, m_verify_moves);
+  m_type_inference =
+      std::make_unique<irtc_impl::TypeInference>(cfg,
+                                                 m_enable_polymorphic_constants,
+                                                 m_verify_moves,
+                                                 m_infer_dex_types);
   m_type_inference->run(m_dex_method);
 
   // Finally, we use the inferred types to type-check each instruction in the
   // method. We stop at the first type error encountered.
-  auto& type_envs = m_type_inference->m_type_envs;
-  for (const MethodItemEntry& mie : InstructionIterable(code)) {
-    IRInstruction* insn = mie.insn;
-    try {
-      auto it = type_envs.find(insn);
-      always_assert(it != type_envs.end());
-      m_type_inference->analyze_instruction(insn, &it->second);
-    } catch (const irtc_impl::TypeCheckingException& e) {
-      m_good = false;
-      std::ostringstream out;
-      out << "Type error in method " << m_dex_method->get_deobfuscated_name()
-          << " at instruction '" << SHOW(insn) << "' for " << e.what();
-      m_what = out.str();
-      m_complete = true;
-      return;
-    }
+  IRInstruction* insn = nullptr;
+  try {
+    m_type_inference->check_instructions(&insn);
+  } catch (const irtc_impl::TypeCheckingException& e) {
+    m_good = false;
+    std::ostringstream out;
+    out << "Type error in method " << m_dex_method->get_deobfuscated_name()
+        << " at instruction '" << SHOW(insn) << "' for " << e.what();
+    m_what = out.str();
   }
   m_complete = true;
 }
 
 IRType IRTypeChecker::get_type(IRInstruction* insn, uint16_t reg) const {
   check_completion();
-  auto& type_envs = m_type_inference->m_type_envs;
+  const auto& type_envs = m_type_inference->type_envs();
   auto it = type_envs.find(insn);
   if (it == type_envs.end()) {
     // The instruction doesn't belong to this method. We treat this as
     // unreachable code and return BOTTOM.
     return BOTTOM;
   }
-  return it->second.get(reg).element();
+  return it->second.get_type(reg).element();
+}
+
+const DexType* IRTypeChecker::get_dex_type(IRInstruction* insn,
+                                           uint16_t reg) const {
+  check_completion();
+  const auto& type_envs = m_type_inference->type_envs();
+  auto it = type_envs.find(insn);
+  if (it == type_envs.end()) {
+    return nullptr;
+  }
+  return it->second.get_dex_type(reg);
 }
 
 std::ostream& operator<<(std::ostream& output, const IRTypeChecker& checker) {
@@ -195,6 +195,17 @@ class IRTypeChecker final {
     }
   }
 
+  /*
+   * Also infer the Dex type of references, see get_dex_type(). This is off by
+   * default, since verification doesn't need it.
+   */
+  void infer_dex_types() {
+    if (!m_complete) {
+      // We can only set this parameter before running the type checker.
+      m_infer_dex_types = true;
+    }
+  }
+
   void run();
 
   bool good() const {
@@ -228,6 +239,23 @@ class IRTypeChecker final {
    */
   IRType get_type(IRInstruction* insn, uint16_t reg) const;
 
+  /*
+   * Returns the Dex type of the reference held by a register before the given
+   * instruction, or nullptr if it isn't known or infer_dex_types() wasn't
+   * called. The Dex type is known when all
+   * the definitions that reach the instruction agree on it, e.g.:
+   *
+   *   invoke-virtual {v1}, LFoo;.bar:()LBar;
+   *   move-result-object v0
+   *   check-cast v0, LBar;  --> v0 has Dex type LBar;
+   *
+   * The analysis doesn't merge distinct types into a common supertype, and a
+   * register holding null has no Dex type. This is computed by the same
+   * fixpoint iteration as the types of the registers, so that clients like
+   * RedundantCheckCastRemover can query both without running another analysis.
+   */
+  const DexType* get_dex_type(IRInstruction* insn, uint16_t reg) const;
+
  private:
   void check_completion() const {
     always_assert_log(m_complete,
@@ -239,6 +267,7 @@ class IRTypeChecker final {
   bool m_complete;
   bool m_enable_polymorphic_constants;
   bool m_verify_moves;
+  bool m_infer_dex_types;
   bool m_good;
   std::string m_what;
   std::unique_ptr<irtc_impl::TypeInference> m_type_inference;
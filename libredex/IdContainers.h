@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "RedexContext.h"
+
+/*
+ * Sets and maps of interned entities (DexString, DexType, DexFieldRef and
+ * DexMethodRef) that are indexed by the entities' dense ids instead of
+ * hashing their pointers: a set is a bitset, a map a vector. They pay off
+ * when a good part of all the entities of a kind ends up in them, e.g. the
+ * visited sets of a whole-program walk.
+ *
+ * Iteration goes in the order of the ids, which differs from run to run, so
+ * it must not decide anything that shows up in the output.
+ */
+
+template <typename T>
+class IdSet {
+ public:
+  // Return whether the entity wasn't in the set yet.
+  bool insert(const T* entity) {
+    auto id = entity->id();
+    if (id / 64 >= m_words.size()) {
+      m_words.resize(id / 64 + 1);
+    }
+    auto& word = m_words[id / 64];
+    uint64_t bit = uint64_t(1) << (id % 64);
+    if (word & bit) {
+      return false;
+    }
+    word |= bit;
+    ++m_size;
+    return true;
+  }
+
+  size_t erase(const T* entity) {
+    auto id = entity->id();
+    if (!contains_id(id)) {
+      return 0;
+    }
+    m_words[id / 64] &= ~(uint64_t(1) << (id % 64));
+    --m_size;
+    return 1;
+  }
+
+  size_t count(const T* entity) const { return contains_id(entity->id()); }
+
+  size_t size() const { return m_size; }
+
+  bool empty() const { return m_size == 0; }
+
+  void clear() {
+    m_words.clear();
+    m_size = 0;
+  }
+
+  template <typename Fn>
+  void for_each(const Fn& fn) const {
+    const auto& table = g_redex->ids<T>();
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      for (auto word = m_words[i]; word != 0; word &= word - 1) {
+        fn(table.get(i * 64 + __builtin_ctzll(word)));
+      }
+    }
+  }
+
+  bool operator==(const IdSet& that) const {
+    if (m_size != that.m_size) {
+      return false;
+    }
+    auto n = std::min(m_words.size(), that.m_words.size());
+    return std::equal(m_words.begin(), m_words.begin() + n,
+                      that.m_words.begin());
+  }
+
+ private:
+  bool contains_id(uint32_t id) const {
+    return id / 64 < m_words.size() &&
+           (m_words[id / 64] >> (id % 64) & 1);
+  }
+
+  std::vector<uint64_t> m_words;
+  size_t m_size{0};
+};
+
+/*
+ * A map whose values live in a vector indexed by the keys' ids. Mapping a
+ * few entities with large ids costs as much memory as mapping all of them,
+ * so keep it for the dense cases.
+ */
+template <typename T, typename Value>
+class IdMap {
+ public:
+  // Default-constructs the value of a key that isn't in the map yet.
+  Value& operator[](const T* key) {
+    auto id = key->id();
+    if (id >= m_values.size()) {
+      m_values.resize(id + 1);
+    }
+    m_keys.insert(key);
+    return m_values[id];
+  }
+
+  // The value of the key, or nullptr if it isn't in the map.
+  const Value* find(const T* key) const {
+    return m_keys.count(key) ? &m_values[key->id()] : nullptr;
+  }
+
+  Value* find(const T* key) {
+    return m_keys.count(key) ? &m_values[key->id()] : nullptr;
+  }
+
+  size_t count(const T* key) const { return m_keys.count(key); }
+
+  size_t erase(const T* key) {
+    if (!m_keys.erase(key)) {
+      return 0;
+    }
+    m_values[key->id()] = Value();
+    return 1;
+  }
+
+  size_t size() const { return m_keys.size(); }
+
+  bool empty() const { return m_keys.empty(); }
+
+  // Calls fn(key, value) for each entry.
+  template <typename Fn>
+  void for_each(const Fn& fn) const {
+    m_keys.for_each([&](T* key) { fn(key, m_values[key->id()]); });
+  }
+
+ private:
+  IdSet<T> m_keys;
+  std::vector<Value> m_values;
+};
+
+/*
+ * An IdSet that many threads can insert into without taking a lock. The
+ * bits are allocated in chunks, as the ids of the entities created in the
+ * meantime show up, in the same way as IdTable does.
+ */
+template <typename T>
+class ConcurrentIdSet {
+ public:
+  ConcurrentIdSet() {
+    for (auto& chunk : m_chunks) {
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ConcurrentIdSet(const ConcurrentIdSet&) = delete;
+  ConcurrentIdSet& operator=(const ConcurrentIdSet&) = delete;
+
+  ~ConcurrentIdSet() {
+    for (auto& chunk : m_chunks) {
+      delete[] chunk.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Return whether the entity wasn't in the set yet.
+  bool insert(const T* entity) {
+    auto id = entity->id();
+    auto& slot = m_chunks[id / CHUNK_BITS];
+    auto chunk = slot.load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+      auto fresh = new std::atomic<uint64_t>[CHUNK_WORDS]();
+      if (slot.compare_exchange_strong(chunk, fresh)) {
+        chunk = fresh;
+      } else {
+        delete[] fresh;
+      }
+    }
+    uint64_t bit = uint64_t(1) << (id % 64);
+    auto old = chunk[id % CHUNK_BITS / 64].fetch_or(bit);
+    return !(old & bit);
+  }
+
+  size_t count(const T* entity) const {
+    auto id = entity->id();
+    auto chunk = m_chunks[id / CHUNK_BITS].load(std::memory_order_acquire);
+    return chunk != nullptr &&
+           (chunk[id % CHUNK_BITS / 64].load() >> (id % 64) & 1);
+  }
+
+  // Not to be run while other threads insert.
+  template <typename Fn>
+  void for_each(const Fn& fn) const {
+    const auto& table = g_redex->ids<T>();
+    for (size_t c = 0; c < MAX_CHUNKS; ++c) {
+      auto chunk = m_chunks[c].load(std::memory_order_acquire);
+      if (chunk == nullptr) {
+        continue;
+      }
+      for (size_t i = 0; i < CHUNK_WORDS; ++i) {
+        for (auto word = chunk[i].load(); word != 0; word &= word - 1) {
+          fn(table.get(c * CHUNK_BITS + i * 64 + __builtin_ctzll(word)));
+        }
+      }
+    }
+  }
+
+ private:
+  static constexpr uint32_t CHUNK_BITS = 1 << 16;
+  static constexpr uint32_t CHUNK_WORDS = CHUNK_BITS / 64;
+  static constexpr uint32_t MAX_CHUNKS = 1 << 12;
+
+  std::atomic<std::atomic<uint64_t>*> m_chunks[MAX_CHUNKS];
+};
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "Debug.h"
+
+/*
+ * Hands out the dense ids of one kind of interned entity, 0, 1, 2, ... in
+ * the order they are created, and finds the entity of an id. Adding is
+ * thread-safe and takes no lock.
+ *
+ * Since the entities are created in parallel (e.g. while loading the dexes),
+ * an id says nothing about an entity that is stable from one run to the
+ * next. Don't let the order of the ids leak into the output.
+ */
+template <typename T>
+class IdTable {
+ public:
+  IdTable() {
+    for (auto& chunk : m_chunks) {
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  IdTable(const IdTable&) = delete;
+  IdTable& operator=(const IdTable&) = delete;
+
+  ~IdTable() {
+    for (auto& chunk : m_chunks) {
+      delete[] chunk.load(std::memory_order_relaxed);
+    }
+  }
+
+  uint32_t add(T* entity) {
+    uint32_t id = m_size.fetch_add(1, std::memory_order_relaxed);
+    always_assert_log(id < MAX_CHUNKS * CHUNK_SIZE, "Too many ids");
+    auto& slot = m_chunks[id / CHUNK_SIZE];
+    auto chunk = slot.load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+      auto fresh = new std::atomic<T*>[CHUNK_SIZE]();
+      if (slot.compare_exchange_strong(chunk, fresh)) {
+        chunk = fresh;
+      } else {
+        delete[] fresh;
+      }
+    }
+    chunk[id % CHUNK_SIZE].store(entity, std::memory_order_release);
+    return id;
+  }
+
+  // The entity of an id that was handed out.
+  T* get(uint32_t id) const {
+    auto chunk = m_chunks[id / CHUNK_SIZE].load(std::memory_order_acquire);
+    return chunk[id % CHUNK_SIZE].load(std::memory_order_acquire);
+  }
+
+  // One more than the largest id handed out so far.
+  uint32_t size() const { return m_size.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr uint32_t CHUNK_SIZE = 1 << 16;
+  static constexpr uint32_t MAX_CHUNKS = 1 << 12;
+
+  std::atomic<uint32_t> m_size{0};
+  std::atomic<std::atomic<T*>*> m_chunks[MAX_CHUNKS];
+};
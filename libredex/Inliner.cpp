@@ -14,11 +14,17 @@
 #include "Resolver.h"
 #include "Transform.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
 const size_t CODE_SIZE_2_CALLERS = 7;
 const size_t CODE_SIZE_3_CALLERS = 5;
+// The largest callee with several callers that's inlined into hot methods.
+const size_t CODE_SIZE_HOT_CALLERS = 32;
+// An invoke and its move-result take up to this many code units, so a callee
+// no larger doesn't grow its callers.
+const size_t CODE_UNITS_NOT_GROWING = 4;
 
 // the max number of callers we care to track explicitly, after that we
 // group all callees/callers count in the same bucket
@@ -171,12 +177,16 @@ MultiMethodInliner::MultiMethodInliner(
 }
 
 void MultiMethodInliner::inline_methods() {
+  if (m_config.parallel) {
+    inline_methods_in_parallel();
+    return;
+  }
   // we want to inline bottom up, so as a first step we identify all the
   // top level callers, then we recurse into all inlinable callees until we
   // hit a leaf and we start inlining from there
   for (auto it : caller_callee) {
     auto caller = it.first;
-    TraceContext context(caller->get_deobfuscated_name());
+    TraceContext context(caller);
     // if the caller is not a top level keep going, it will be traversed
     // when inlining a top level caller
     if (callee_caller.find(caller) != callee_caller.end()) continue;
@@ -213,6 +223,95 @@ void MultiMethodInliner::caller_inline(
   inline_callees(caller, nonrecursive_callees);
 }
 
+void MultiMethodInliner::inline_methods_in_parallel() {
+  // Same traversal as in inline_methods(), except that every caller is
+  // visited only once.
+  std::unordered_map<DexMethod*, size_t> levels;
+  std::unordered_map<DexMethod*, std::vector<DexMethod*>> dag;
+  for (auto it : caller_callee) {
+    auto caller = it.first;
+    if (callee_caller.find(caller) != callee_caller.end()) continue;
+    std::unordered_set<DexMethod*> visited;
+    visited.insert(caller);
+    compute_level(caller, it.second, visited, levels, dag);
+  }
+
+  size_t num_levels = 0;
+  for (const auto& it : levels) {
+    num_levels = std::max(num_levels, it.second);
+  }
+  // Levels start at 1, level 0 being the methods that don't call any
+  // candidate.
+  std::vector<std::vector<DexMethod*>> callers_by_level(num_levels + 1);
+  for (const auto& it : dag) {
+    callers_by_level[levels.at(it.first)].push_back(it.first);
+  }
+  for (size_t level = 1; level <= num_levels; ++level) {
+    auto& callers = callers_by_level[level];
+    TRACE(MMINL, 2, "inlining into %ld callers at level %ld\n",
+          callers.size(), level);
+    // The callees of these callers are at lower levels, so they are not
+    // modified while they're being inlined.
+    auto wq = workqueue_foreach<DexMethod*>([&](DexMethod* caller) {
+      TraceContext context(caller);
+      inline_callees(caller, dag.at(caller));
+    });
+    for (auto caller : callers) {
+      wq.add_item(caller);
+    }
+    wq.run_all();
+
+    // change_visibility() rewrites the member references of the callee, so
+    // it has to wait until no other caller is reading the callee anymore.
+    // The visibility changes don't affect whether the other callees of the
+    // level can be inlined.
+    std::vector<DexMethod*> callees(m_deferred_visibility_changes.begin(),
+                                    m_deferred_visibility_changes.end());
+    std::sort(callees.begin(), callees.end(), compare_dexmethods);
+    for (auto callee : callees) {
+      change_visibility(callee);
+      invalidate_callee_summary(callee);
+    }
+    m_deferred_visibility_changes.clear();
+  }
+}
+
+size_t MultiMethodInliner::compute_level(
+    DexMethod* caller,
+    const std::vector<DexMethod*>& callees,
+    std::unordered_set<DexMethod*>& visited,
+    std::unordered_map<DexMethod*, size_t>& levels,
+    std::unordered_map<DexMethod*, std::vector<DexMethod*>>& dag) {
+  auto& nonrecursive_callees = dag[caller];
+  nonrecursive_callees.reserve(callees.size());
+  size_t level = 0;
+  for (auto callee : callees) {
+    // if the call chain hits a call loop, ignore and keep going
+    if (visited.count(callee) > 0) {
+      info.recursive++;
+      continue;
+    }
+    nonrecursive_callees.push_back(callee);
+
+    size_t callee_level = 0;
+    auto maybe_level = levels.find(callee);
+    if (maybe_level != levels.end()) {
+      callee_level = maybe_level->second;
+    } else {
+      auto maybe_caller = caller_callee.find(callee);
+      if (maybe_caller != caller_callee.end()) {
+        visited.insert(callee);
+        callee_level = compute_level(
+            callee, maybe_caller->second, visited, levels, dag);
+        visited.erase(callee);
+      }
+    }
+    level = std::max(level, callee_level);
+  }
+  levels[caller] = level + 1;
+  return level + 1;
+}
+
 void MultiMethodInliner::inline_callees(
     DexMethod* caller, const std::vector<DexMethod*>& callees) {
   size_t found = 0;
@@ -256,14 +355,33 @@ void MultiMethodInliner::inline_callees(
         callee->get_code()->get_registers_size());
     inliner::inline_method(caller->get_code(), callee->get_code(), insn);
     TRACE(INL, 2, "caller: %s\tcallee: %s\n", SHOW(caller), SHOW(callee));
-    estimated_insn_size += callee->get_code()->sum_opcode_sizes();
+    const auto& summary = get_callee_summary(callee);
+    estimated_insn_size += summary.code_units;
+    info.code_units_inlined += summary.code_units;
+    if (m_config.hot_methods.count(caller)) {
+      info.hot_calls_inlined++;
+    }
     TRACE(MMINL,
           6,
           "checking visibility usage of members in %s\n",
           SHOW(callee));
-    change_visibility(callee);
     info.calls_inlined++;
-    inlined.insert(callee);
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_make_static.insert(summary.make_static.begin(),
+                           summary.make_static.end());
+      inlined.insert(callee);
+      if (m_config.parallel) {
+        m_deferred_visibility_changes.insert(callee);
+        continue;
+      }
+    }
+    change_visibility(callee);
+    // change_visibility() rewrites the member references of the callee.
+    invalidate_callee_summary(callee);
+  }
+  if (!inlinables.empty()) {
+    invalidate_callee_summary(caller);
   }
 }
 
@@ -273,23 +391,61 @@ void MultiMethodInliner::inline_callees(
 bool MultiMethodInliner::is_inlinable(const DexMethod* caller,
                                       const DexMethod* callee,
                                       size_t estimated_insn_size) {
+  const auto& summary = get_callee_summary(callee);
   // don't inline cross store references
-  if (cross_store_reference(callee)) {
+  if (summary.cross_store) {
+    info.cross_store++;
     return false;
   }
   if (is_blacklisted(callee)) return false;
   if (caller_is_blacklisted(caller)) return false;
-  if (has_external_catch(callee)) return false;
-  if (cannot_inline_opcodes(caller, callee)) {
+  if (summary.external_catch) return false;
+  auto rejection = caller->get_class() == callee->get_class()
+                       ? summary.same_class_rejection
+                       : summary.other_class_rejection;
+  if (rejection != nullptr) {
+    (info.*rejection)++;
+    return false;
+  }
+  if (caller_too_large(
+          caller->get_class(), estimated_insn_size, summary.code_units)) {
     return false;
   }
-  if (caller_too_large(caller->get_class(), estimated_insn_size, callee)) {
+  if (grows_cold_caller(caller, callee, summary.code_units)) {
     return false;
   }
 
   return true;
 }
 
+const MultiMethodInliner::CalleeSummary&
+MultiMethodInliner::get_callee_summary(const DexMethod* callee) {
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto it = m_callee_summaries.find(callee);
+    if (it != m_callee_summaries.end()) {
+      return it->second;
+    }
+  }
+  // In parallel mode, the callers of a callee may compute its summary
+  // concurrently, but they'll all get the same one. References to the
+  // elements of the map remain valid as it grows, and no summary is dropped
+  // while it may be in use: the summaries of the callees of a level are only
+  // invalidated once it has been processed.
+  CalleeSummary summary;
+  summary.code_units = callee->get_code()->sum_opcode_sizes();
+  summary.cross_store = cross_store_reference(callee);
+  summary.external_catch = has_external_catch(callee);
+  check_opcodes(callee, &summary);
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_callee_summaries.emplace(callee, std::move(summary)).first->second;
+}
+
+void MultiMethodInliner::invalidate_callee_summary(const DexMethod* method) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_callee_summaries.erase(method);
+}
+
 /**
  * Return whether the method or any of its ancestors are in the blacklist.
  * Typically used to prevent inlining / deletion of methods that are called
@@ -313,7 +469,7 @@ bool MultiMethodInliner::is_blacklisted(const DexMethod* callee) {
 
 bool MultiMethodInliner::caller_too_large(DexType* caller_type,
                                           size_t estimated_insn_size,
-                                          const DexMethod* callee) {
+                                          size_t callee_code_units) {
   if (!m_config.enforce_method_size_limit) {
     return false;
   }
@@ -325,8 +481,7 @@ bool MultiMethodInliner::caller_too_large(DexType* caller_type,
   // INSTRUCTION_BUFFER is added because the final method size is often larger
   // than our estimate -- during the sync phase, we may have to pick larger
   // branch opcodes to encode large jumps.
-  auto insns_size = callee->get_code()->sum_opcode_sizes();
-  if (estimated_insn_size + insns_size >
+  if (estimated_insn_size + callee_code_units >
       MAX_INSTRUCTION_SIZE - INSTRUCTION_BUFFER) {
     info.caller_too_large++;
     return true;
@@ -334,6 +489,23 @@ bool MultiMethodInliner::caller_too_large(DexType* caller_type,
   return false;
 }
 
+bool MultiMethodInliner::grows_cold_caller(const DexMethod* caller,
+                                           const DexMethod* callee,
+                                           size_t callee_code_units) {
+  if (m_config.hot_methods.empty() || m_config.hot_methods.count(caller) ||
+      callee_code_units <= CODE_UNITS_NOT_GROWING) {
+    return false;
+  }
+  // A callee with a single call site is deleted once inlined, so the code
+  // doesn't grow overall.
+  auto it = callee_caller.find(const_cast<DexMethod*>(callee));
+  if (it != callee_caller.end() && it->second.size() == 1) {
+    return false;
+  }
+  info.cold_caller++;
+  return true;
+}
+
 bool MultiMethodInliner::caller_is_blacklisted(const DexMethod* caller) {
   auto cls = caller->get_class();
   if (m_config.caller_black_list.count(cls)) {
@@ -361,31 +533,56 @@ bool MultiMethodInliner::has_external_catch(const DexMethod* callee) {
 
 /**
  * Analyze opcodes in the callee to see if they are problematic for inlining.
+ * The callee is rejected for the first problematic opcode, as if it was only
+ * analyzed for a given caller.
  */
-bool MultiMethodInliner::cannot_inline_opcodes(const DexMethod* caller,
-                                               const DexMethod* callee) {
+void MultiMethodInliner::check_opcodes(const DexMethod* callee,
+                                       CalleeSummary* summary) {
+  auto reject_same_class = [summary](Counter reason) {
+    if (summary->same_class_rejection == nullptr) {
+      summary->same_class_rejection = reason;
+    }
+  };
+  auto reject_other_class = [summary](Counter reason) {
+    if (summary->other_class_rejection == nullptr) {
+      summary->other_class_rejection = reason;
+    }
+  };
   int ret_count = 0;
   for (auto& mie : InstructionIterable(callee->get_code())) {
     auto insn = mie.insn;
-    if (create_vmethod(insn)) return true;
-    if (nonrelocatable_invoke_super(insn, callee, caller)) return true;
-    if (unknown_virtual(insn, callee, caller)) return true;
-    if (unknown_field(insn, callee, caller)) return true;
+    Counter reason = nullptr;
+    if (create_vmethod(insn, &reason, &summary->make_static)) {
+      reject_same_class(reason);
+      reject_other_class(reason);
+    }
+    // if the caller and callee are in the same class, we don't have to worry
+    // about invoke supers, or unknown virtuals and fields -- private /
+    // protected members will remain accessible
+    if (nonrelocatable_invoke_super(insn)) {
+      reject_other_class(&InliningInfo::invoke_super);
+    }
+    if (unknown_virtual(insn, &reason) || unknown_field(insn, &reason)) {
+      reject_other_class(reason);
+    }
     if (!m_config.throws_inline && insn->opcode() == OPCODE_THROW) {
-      info.throws++;
-      return true;
+      reject_same_class(&InliningInfo::throws);
+      reject_other_class(&InliningInfo::throws);
     }
     if (is_return(insn->opcode())) ret_count++;
+    if (summary->same_class_rejection != nullptr &&
+        summary->other_class_rejection != nullptr) {
+      return;
+    }
   }
   // no callees that have more than a return statement (normally one, the
   // way dx generates code).
   // That allows us to make a simple inline strategy where we don't have to
   // worry about creating branches from the multiple returns to the main code
   if (ret_count > 1) {
-    info.multi_ret++;
-    return true;
+    reject_same_class(&InliningInfo::multi_ret);
+    reject_other_class(&InliningInfo::multi_ret);
   }
-  return false;
 }
 
 /**
@@ -395,27 +592,30 @@ bool MultiMethodInliner::cannot_inline_opcodes(const DexMethod* caller,
  * referenced by a callee is visible and accessible in the caller context.
  * This step would not be needed if we changed all private instance to static.
  */
-bool MultiMethodInliner::create_vmethod(IRInstruction* insn) {
+bool MultiMethodInliner::create_vmethod(
+    IRInstruction* insn,
+    Counter* reason,
+    std::vector<DexMethod*>* make_static) {
   auto opcode = insn->opcode();
   if (opcode == OPCODE_INVOKE_DIRECT) {
     auto method = resolver(insn->get_method(), MethodSearch::Direct);
     if (method == nullptr) {
-      info.need_vmethod++;
+      *reason = &InliningInfo::need_vmethod;
       return true;
     }
     always_assert(method->is_def());
     if (is_init(method)) {
       if (!method->is_concrete() && !is_public(method)) {
-        info.non_pub_ctor++;
+        *reason = &InliningInfo::non_pub_ctor;
         return true;
       }
       // concrete ctors we can handle because they stay invoke_direct
       return false;
     }
     if (!is_native(method) && !keep(method)) {
-      m_make_static.insert(method);
+      make_static->push_back(method);
     } else {
-      info.need_vmethod++;
+      *reason = &InliningInfo::need_vmethod;
       return true;
     }
   }
@@ -424,20 +624,11 @@ bool MultiMethodInliner::create_vmethod(IRInstruction* insn) {
 
 /**
  * Return true if a callee contains an invoke super to a different method
- * in the hierarchy, and the callee and caller are in different classes.
+ * in the hierarchy.
  * Inlining an invoke_super off its class hierarchy would break the verifier.
  */
-bool MultiMethodInliner::nonrelocatable_invoke_super(IRInstruction* insn,
-                                                     const DexMethod* callee,
-                                                     const DexMethod* caller) {
-  if (insn->opcode() == OPCODE_INVOKE_SUPER) {
-    if (callee->get_class() == caller->get_class()) {
-      return false;
-    }
-    info.invoke_super++;
-    return true;
-  }
-  return false;
+bool MultiMethodInliner::nonrelocatable_invoke_super(IRInstruction* insn) {
+  return insn->opcode() == OPCODE_INVOKE_SUPER;
 }
 
 /**
@@ -449,14 +640,7 @@ bool MultiMethodInliner::nonrelocatable_invoke_super(IRInstruction* insn,
  */
 
 bool MultiMethodInliner::unknown_virtual(IRInstruction* insn,
-                                         const DexMethod* callee,
-                                         const DexMethod* caller) {
-  // if the caller and callee are in the same class, we don't have to worry
-  // about unknown virtuals -- private / protected methods will remain
-  // accessible
-  if (caller->get_class() == callee->get_class()) {
-    return false;
-  }
+                                         Counter* reason) {
   if (insn->opcode() == OPCODE_INVOKE_VIRTUAL) {
     auto method = insn->get_method();
     auto res_method = resolver(method, MethodSearch::Virtual);
@@ -478,11 +662,11 @@ bool MultiMethodInliner::unknown_virtual(IRInstruction* insn,
       }
       if (type_ok(type)) return false;
       if (method_ok(type, method)) return false;
-      info.escaped_virtual++;
+      *reason = &InliningInfo::escaped_virtual;
       return true;
     }
     if (res_method->is_external() && !is_public(res_method)) {
-      info.non_pub_virtual++;
+      *reason = &InliningInfo::non_pub_virtual;
       return true;
     }
   }
@@ -496,25 +680,17 @@ bool MultiMethodInliner::unknown_virtual(IRInstruction* insn,
  * But we need to make all fields public across the hierarchy and for fields
  * we don't know we have no idea whether the field was public or not anyway.
  */
-bool MultiMethodInliner::unknown_field(IRInstruction* insn,
-                                       const DexMethod* callee,
-                                       const DexMethod* caller) {
-  // if the caller and callee are in the same class, we don't have to worry
-  // about unknown fields -- private / protected fields will remain
-  // accessible
-  if (caller->get_class() == callee->get_class()) {
-    return false;
-  }
+bool MultiMethodInliner::unknown_field(IRInstruction* insn, Counter* reason) {
   if (is_ifield_op(insn->opcode()) || is_sfield_op(insn->opcode())) {
     auto ref = insn->get_field();
     DexField* field = resolve_field(ref, is_sfield_op(insn->opcode())
         ? FieldSearch::Static : FieldSearch::Instance);
     if (field == nullptr) {
-      info.escaped_field++;
+      *reason = &InliningInfo::escaped_field;
       return true;
     }
     if (!field->is_concrete() && !is_public(field)) {
-      info.non_pub_field++;
+      *reason = &InliningInfo::non_pub_field;
       return true;
     }
   }
@@ -527,33 +703,26 @@ bool MultiMethodInliner::cross_store_reference(const DexMethod* callee) {
     auto insn = mie.insn;
     if (insn->has_type()) {
       if (xstores.illegal_ref(store_idx, insn->get_type())) {
-        info.cross_store++;
         return true;
       }
     } else if (insn->has_method()) {
       auto meth = insn->get_method();
       if (xstores.illegal_ref(store_idx, meth->get_class())) {
-        info.cross_store++;
         return true;
       }
       auto proto = meth->get_proto();
       if (xstores.illegal_ref(store_idx, proto->get_rtype())) {
-        info.cross_store++;
         return true;
       }
       auto args = proto->get_args();
       if (args == nullptr) continue;
-      for (const auto& arg : args->get_type_list()) {
-        if (xstores.illegal_ref(store_idx, arg)) {
-          info.cross_store++;
-          return true;
-        }
+      if (xstores.illegal_refs(store_idx, args->get_type_list())) {
+        return true;
       }
     } else if (insn->has_field()) {
       auto field = insn->get_field();
       if (xstores.illegal_ref(store_idx, field->get_class()) ||
           xstores.illegal_ref(store_idx, field->get_type())) {
-        info.cross_store++;
         return true;
       }
     }
@@ -601,11 +770,13 @@ void select_inlinable(
     const std::unordered_set<DexMethod*>& methods,
     MethodRefCache& resolved_refs,
     std::unordered_set<DexMethod*>* inlinable,
-    bool multiple_callers) {
+    bool multiple_callers,
+    const std::unordered_set<const DexMethod*>* hot_methods) {
   std::unordered_map<DexMethod*, int> calls;
   for (const auto& method : methods) {
     calls[method] = 0;
   }
+  std::unordered_set<DexMethod*> called_from_hot;
   // count call sites for each method
   walk::opcodes(scope, [](DexMethod* meth) { return true; },
       [&](DexMethod* meth, IRInstruction* insn) {
@@ -615,6 +786,9 @@ void select_inlinable(
           if (callee != nullptr && callee->is_concrete()
               && methods.count(callee) > 0) {
             calls[callee]++;
+            if (hot_methods != nullptr && hot_methods->count(meth)) {
+              called_from_hot.insert(callee);
+            }
           }
         }
       });
@@ -646,6 +820,11 @@ void select_inlinable(
       }
     }
   }
+  for (auto callee : called_from_hot) {
+    if (callee->get_code()->count_opcodes() <= CODE_SIZE_HOT_CALLERS) {
+      inlinable->insert(callee);
+    }
+  }
 }
 
 namespace {
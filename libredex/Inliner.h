@@ -9,8 +9,10 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <map>
+#include <mutex>
 #include <set>
 #include <vector>
 
@@ -64,11 +66,53 @@ class MultiMethodInliner {
   struct Config {
     bool throws_inline;
     bool enforce_method_size_limit{true};
+    // Inline into independent callers concurrently. The resolver must then
+    // be safe to call from multiple threads.
+    bool parallel{false};
     std::unordered_set<DexType*> black_list;
     std::unordered_set<DexType*> caller_black_list;
     std::unordered_set<DexType*> whitelist_no_method_limit;
+    // Profile-guided mode, on when this isn't empty: the methods that run
+    // at startup. Callees with several call sites are then only inlined into
+    // these, unless inlining them doesn't grow the caller.
+    std::unordered_set<const DexMethod*> hot_methods;
   };
 
+  /**
+   * Info about inlining. The counters are updated concurrently in parallel
+   * mode.
+   */
+  struct InliningInfo {
+    std::atomic<size_t> calls_inlined{0};
+    std::atomic<size_t> recursive{0};
+    std::atomic<size_t> not_found{0};
+    std::atomic<size_t> blacklisted{0};
+    std::atomic<size_t> throws{0};
+    std::atomic<size_t> multi_ret{0};
+    std::atomic<size_t> need_vmethod{0};
+    std::atomic<size_t> invoke_super{0};
+    std::atomic<size_t> write_over_ins{0};
+    std::atomic<size_t> escaped_virtual{0};
+    std::atomic<size_t> non_pub_virtual{0};
+    std::atomic<size_t> escaped_field{0};
+    std::atomic<size_t> non_pub_field{0};
+    std::atomic<size_t> non_pub_ctor{0};
+    std::atomic<size_t> cross_store{0};
+    std::atomic<size_t> caller_too_large{0};
+    std::atomic<size_t> cold_caller{0};
+    // The code units of the callees inlined: the growth of the code before
+    // the inlined methods are deleted.
+    std::atomic<size_t> code_units_inlined{0};
+    // In profile-guided mode, the calls inlined into hot methods: the calls
+    // no longer made at startup.
+    std::atomic<size_t> hot_calls_inlined{0};
+  };
+
+  /**
+   * Designates the counter of a reason why a callee can't be inlined.
+   */
+  using Counter = std::atomic<size_t> InliningInfo::*;
+
   MultiMethodInliner(
       const std::vector<DexClass*>& scope,
       DexStoresVector& stores,
@@ -109,6 +153,44 @@ class MultiMethodInliner {
       const std::vector<DexMethod*>& callees,
       std::unordered_set<DexMethod*>& visited);
 
+  /**
+   * Parallel version of inline_methods(). Each caller is assigned a level,
+   * one more than the highest level of its callees, after the call cycles
+   * have been broken as in caller_inline(). The callers of a level are
+   * mutually independent, so they are processed concurrently, one level
+   * after the other.
+   */
+  void inline_methods_in_parallel();
+
+  /**
+   * Compute the level of a caller and of all the callers reachable from it,
+   * and record the callees that remain once the call cycles are broken.
+   */
+  size_t compute_level(
+      DexMethod* caller,
+      const std::vector<DexMethod*>& callees,
+      std::unordered_set<DexMethod*>& visited,
+      std::unordered_map<DexMethod*, size_t>& levels,
+      std::unordered_map<DexMethod*, std::vector<DexMethod*>>& dag);
+
+  /**
+   * The facts about a callee that determine whether it can be inlined and
+   * don't depend on the caller, gathered in a single pass over its code.
+   */
+  struct CalleeSummary {
+    size_t code_units{0};
+    bool cross_store{false};
+    bool external_catch{false};
+    // The first reason why the opcodes of the callee prevent inlining it
+    // into a caller of the same class, or of another class, or nullptr if
+    // there's none.
+    Counter same_class_rejection{nullptr};
+    Counter other_class_rejection{nullptr};
+    // The direct methods called by the callee that have to be made static
+    // once it's inlined.
+    std::vector<DexMethod*> make_static;
+  };
+
   /**
    * Return true if the callee is inlinable into the caller.
    * The predicates below define the constraint for inlining.
@@ -117,6 +199,17 @@ class MultiMethodInliner {
                     const DexMethod* callee,
                     size_t estimated_insn_size);
 
+  /**
+   * Return the summary of the callee, computing it unless it's cached.
+   * Popular callees are considered for inlining once per call site.
+   */
+  const CalleeSummary& get_callee_summary(const DexMethod* callee);
+
+  /**
+   * Drop the cached summary of a method whose code has changed.
+   */
+  void invalidate_callee_summary(const DexMethod* method);
+
   /**
    * Return true if the method is related to enum (java.lang.Enum and derived).
    * Cannot inline enum methods because they can be called by code we do
@@ -133,26 +226,29 @@ class MultiMethodInliner {
   bool has_external_catch(const DexMethod* callee);
 
   /**
-   * Return true if the callee contains certain opcodes that are difficult
-   * or impossible to inline.
-   * Some of the opcodes are defined by the methods below.
+   * Record in the summary the opcodes of the callee that are difficult or
+   * impossible to inline.
+   * Some of the opcodes are defined by the methods below, which set `reason`
+   * when they return true.
    */
-  bool cannot_inline_opcodes(const DexMethod* caller, const DexMethod* callee);
+  void check_opcodes(const DexMethod* callee, CalleeSummary* summary);
 
   /**
    * Return true if inlining would require a method called from the callee
    * (candidate) to turn into a virtual method (e.g. private to public).
+   * The private methods that can be made static instead are added to
+   * `make_static`.
    */
-  bool create_vmethod(IRInstruction* insn);
+  bool create_vmethod(IRInstruction* insn,
+                      Counter* reason,
+                      std::vector<DexMethod*>* make_static);
 
   /**
    * Return true if a callee contains an invoke super to a different method
-   * in the hierarchy, and the callee and caller are in different classes.
-   * invoke-super can only exist within the class the call lives in.
+   * in the hierarchy. invoke-super can only exist within the class the call
+   * lives in, so the callee can only be inlined into the same class.
    */
-  bool nonrelocatable_invoke_super(IRInstruction* insn,
-                                   const DexMethod* callee,
-                                   const DexMethod* caller);
+  bool nonrelocatable_invoke_super(IRInstruction* insn);
 
   /**
    * Return true if a callee overrides one of the input registers.
@@ -166,20 +262,18 @@ class MultiMethodInliner {
    * We cannot determine the visibility of the method invoked and thus
    * we cannot inline as we could cause a verification error if the method
    * was package/protected and we move the call out of context.
+   * This doesn't matter if the caller is in the same class as the callee.
    */
-  bool unknown_virtual(IRInstruction* insn,
-                       const DexMethod* caller,
-                       const DexMethod* callee);
+  bool unknown_virtual(IRInstruction* insn, Counter* reason);
 
   /**
    * Return true if the callee contains a call to an unknown field.
    * We cannot determine the visibility of the field accessed and thus
    * we cannot inline as we could cause a verification error if the field
    * was package/protected and we move the access out of context.
+   * This doesn't matter if the caller is in the same class as the callee.
    */
-  bool unknown_field(IRInstruction* insn,
-                     const DexMethod* callee,
-                     const DexMethod* caller);
+  bool unknown_field(IRInstruction* insn, Counter* reason);
 
   /**
    * Return true if a caller is in a DEX in a store and any opcode in callee
@@ -197,7 +291,16 @@ class MultiMethodInliner {
    */
   bool caller_too_large(DexType* caller_type,
                         size_t estimated_insn_size,
-                        const DexMethod* callee);
+                        size_t callee_code_units);
+
+  /**
+   * In profile-guided mode, return true if the caller isn't hot and
+   * inlining would grow it while leaving the callee in place for its other
+   * call sites.
+   */
+  bool grows_cold_caller(const DexMethod* caller,
+                         const DexMethod* callee,
+                         size_t callee_code_units);
 
   /**
    * Staticize required methods (stored in `m_make_static`) and update
@@ -235,27 +338,6 @@ class MultiMethodInliner {
       caller_callee;
 
  private:
-  /**
-   * Info about inlining.
-   */
-  struct InliningInfo {
-    size_t calls_inlined{0};
-    size_t recursive{0};
-    size_t not_found{0};
-    size_t blacklisted{0};
-    size_t throws{0};
-    size_t multi_ret{0};
-    size_t need_vmethod{0};
-    size_t invoke_super{0};
-    size_t write_over_ins{0};
-    size_t escaped_virtual{0};
-    size_t non_pub_virtual{0};
-    size_t escaped_field{0};
-    size_t non_pub_field{0};
-    size_t non_pub_ctor{0};
-    size_t cross_store{0};
-    size_t caller_too_large{0};
-  };
   InliningInfo info;
 
   const std::vector<DexClass*>& m_scope;
@@ -264,6 +346,22 @@ class MultiMethodInliner {
 
   std::unordered_set<DexMethod*> m_make_static;
 
+  /**
+   * Callees whose visibility must be changed once the current level of
+   * callers has been inlined into (parallel mode only).
+   */
+  std::unordered_set<DexMethod*> m_deferred_visibility_changes;
+
+  /**
+   * Cached callee summaries, keyed by callee.
+   */
+  std::unordered_map<const DexMethod*, CalleeSummary> m_callee_summaries;
+
+  /**
+   * Guards the containers above and `inlined` in parallel mode.
+   */
+  std::mutex m_mutex;
+
  public:
   const InliningInfo& get_info() {
     return info;
@@ -272,10 +370,13 @@ class MultiMethodInliner {
 
 /**
  * Add the single-callsite methods to the inlinable set.
+ * With `hot_methods`, also add the small methods called from any of them,
+ * however many call sites they have.
  */
 void select_inlinable(
     const Scope& scope,
     const std::unordered_set<DexMethod*>& methods,
     MethodRefCache& resolved_refs,
     std::unordered_set<DexMethod*>* inlinable,
-    bool multiple_callee = false);
+    bool multiple_callee = false,
+    const std::unordered_set<const DexMethod*>* hot_methods = nullptr);
@@ -145,7 +145,7 @@ static void check_load_params(DexMethod* method) {
   if (param_ops.empty()) {
     return;
   }
-  auto& args_list = method->get_proto()->get_args()->get_type_list();
+  const auto& args_list = method->get_proto()->get_args()->get_type_list();
   auto it = param_ops.begin();
   auto end = param_ops.end();
   uint16_t next_ins = it->insn->dest();
@@ -7,9 +7,17 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <boost/filesystem.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
 
+#include <atomic>
 #include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <zlib.h>
 
@@ -23,7 +31,12 @@
 #include "Creators.h"
 #include "DexClass.h"
 #include "JarLoader.h"
+#include "Sha1.h"
+#include "Timer.h"
+#include "Trace.h"
 #include "Util.h"
+#include "WorkQueue.h"
+#include "ZipFormat.h"
 
 /******************
  * Begin Class Loading code.
@@ -148,56 +161,93 @@ static void skip_attributes(uint8_t* &buffer) {
   }
 }
 #define MAX_CLASS_NAMELEN (8 * 1024)
-static DexType *make_dextype_from_cref(std::vector<cp_entry> &cpool,
-                                       uint16_t cref) {
-  char nbuffer[MAX_CLASS_NAMELEN];
-  if (cpool[cref].tag != CP_CONST_CLASS) {
-    fprintf(stderr, "Non-class ref in get_class_name, Bailing\n");
-    return nullptr;
-  }
-  uint16_t utf8ref = cpool[cref].s0;
+
+static bool extract_utf8(const std::vector<cp_entry>& cpool,
+                         uint16_t utf8ref,
+                         std::string& out) {
   const cp_entry &utf8cpe = cpool[utf8ref];
   if (utf8cpe.tag != CP_CONST_UTF8) {
-    fprintf(stderr, "Non-utf8 ref in get_utf8, Bailing\n");
-    return nullptr;
+    fprintf(stderr, "Non-utf8 ref in get_utf8, bailing\n");
+    return false;
   }
-  if (utf8cpe.len > (MAX_CLASS_NAMELEN + 3)) {
-    fprintf(stderr, "classname is greater than max, bailing");
-    return nullptr;
+  if (utf8cpe.len > (MAX_CLASS_NAMELEN - 1)) {
+    fprintf(stderr, "Name is greater (%hu) than max (%u), bailing\n",
+            utf8cpe.len, MAX_CLASS_NAMELEN);
+    return false;
   }
-  nbuffer[0] = 'L';
-  memcpy(nbuffer+1, utf8cpe.data, utf8cpe.len);
-  nbuffer[1+utf8cpe.len] = ';';
-  nbuffer[2+utf8cpe.len] = '\0';
-  return DexType::make_type(nbuffer);
+  out.assign(reinterpret_cast<const char*>(utf8cpe.data), utf8cpe.len);
+  return true;
 }
 
-static bool extract_utf8(std::vector<cp_entry> &cpool, uint16_t utf8ref,
-                         char *out, uint32_t size) {
-  const cp_entry &utf8cpe = cpool[utf8ref];
-  if (utf8cpe.tag != CP_CONST_UTF8) {
-    fprintf(stderr, "Non-utf8 ref in get_utf8, bailing\n");
+static bool extract_class_descriptor(const std::vector<cp_entry>& cpool,
+                                     uint16_t cref,
+                                     std::string& out) {
+  if (cpool[cref].tag != CP_CONST_CLASS) {
+    fprintf(stderr, "Non-class ref in get_class_name, Bailing\n");
     return false;
   }
-  if (utf8cpe.len > (size - 1)) {
-    fprintf(stderr, "Name is greater (%hu) than max (%u), bailing\n", utf8cpe.len, size);
+  std::string name;
+  if (!extract_utf8(cpool, cpool[cref].s0, name)) {
     return false;
   }
-  memcpy(out, utf8cpe.data, utf8cpe.len);
-  out[utf8cpe.len] = '\0';
+  out.reserve(name.size() + 2);
+  out = "L";
+  out += name;
+  out += ';';
   return true;
 }
 
-static DexField *make_dexfield(std::vector<cp_entry> &cpool,
-                               DexType *self, cp_field_info &finfo) {
-  char dbuffer[MAX_CLASS_NAMELEN];
-  char nbuffer[MAX_CLASS_NAMELEN];
-  if (!extract_utf8(cpool, finfo.nameNdx, nbuffer, MAX_CLASS_NAMELEN) ||
-     !extract_utf8(cpool, finfo.descNdx, dbuffer, MAX_CLASS_NAMELEN)) {
-    return nullptr;
-  }
-  DexString *name = DexString::make_string(nbuffer);
-  DexType *desc = DexType::make_type(dbuffer);
+namespace {
+
+struct ParsedMember {
+  std::string name;
+  std::string desc;
+  uint16_t aflags;
+  // The member's attributes in the class file; null when read from a cache.
+  uint8_t* attrs;
+};
+
+/*
+ * A class file on its way to becoming a DexClass. Loading a jar runs in
+ * phases so the bulk of the work can be spread over the thread pool:
+ *
+ *   1. parse_class_file: turn the class file into names and descriptors,
+ *      without touching any Dex objects (parallel), or read the same thing
+ *      back from a jar cache
+ *   2. duplicate classes are dropped, first one wins (serial, entry order)
+ *   3. resolve_class: make the types, fields and methods (parallel)
+ *   4. publish_class: create the DexClass, run attribute hooks (serial,
+ *      entry order)
+ *
+ * Nothing is published until phase 4, so type_class() is never read while
+ * another thread might be writing to the class table, and the result is
+ * the same as loading the entries one at a time.
+ */
+struct ParsedClass {
+  // Inflated class file, or null if it's read straight from the jar mapping.
+  std::unique_ptr<uint8_t[]> storage;
+  uint8_t* buffer{nullptr};
+  std::vector<cp_entry> cpool;
+
+  std::string self;
+  std::string super; // empty if there is none
+  uint16_t aflags{0};
+  std::vector<std::string> interfaces;
+  std::vector<ParsedMember> fields;
+  std::vector<ParsedMember> methods;
+
+  DexType* self_type{nullptr};
+  DexType* super_type{nullptr};
+  std::vector<DexType*> interface_types;
+  std::vector<DexField*> dex_fields;
+  std::vector<DexMethod*> dex_methods;
+};
+
+} // namespace
+
+static DexField *make_dexfield(DexType *self, const ParsedMember& finfo) {
+  DexString *name = DexString::make_string(finfo.name);
+  DexType *desc = DexType::make_type(finfo.desc.c_str());
   DexField *field =
       static_cast<DexField*>(DexField::make_field(self, name, desc));
   field->set_access((DexAccessFlags)finfo.aflags);
@@ -305,16 +355,10 @@ static DexTypeList *extract_arguments(const char* &buf) {
   return DexTypeList::make_type_list(std::move(args));
 }
 
-static DexMethod *make_dexmethod(std::vector<cp_entry> &cpool,
-                               DexType *self, cp_method_info &finfo) {
-  char dbuffer[MAX_CLASS_NAMELEN];
-  char nbuffer[MAX_CLASS_NAMELEN];
-  if (!extract_utf8(cpool, finfo.nameNdx, nbuffer, MAX_CLASS_NAMELEN) ||
-     !extract_utf8(cpool, finfo.descNdx, dbuffer, MAX_CLASS_NAMELEN)) {
-    return nullptr;
-  }
-  DexString *name = DexString::make_string(nbuffer);
-  const char *ptr = dbuffer;
+static DexMethod *make_dexmethod(DexType *self, const ParsedMember& finfo) {
+  const char* nbuffer = finfo.name.c_str();
+  DexString *name = DexString::make_string(finfo.name);
+  const char *ptr = finfo.desc.c_str();
   DexTypeList *tlist = extract_arguments(ptr);
   if (tlist == nullptr)
     return nullptr;
@@ -344,9 +388,26 @@ static DexMethod *make_dexmethod(std::vector<cp_entry> &cpool,
   return method;
 }
 
-static bool parse_class(uint8_t* buffer,
-                        Scope* classes,
-                        attribute_hook_t attr_hook) {
+static bool parse_members(ParsedClass& pc, std::vector<ParsedMember>& out) {
+  uint8_t*& buffer = pc.buffer;
+  uint16_t count = read16(buffer);
+  out.resize(count);
+  for (auto& member : out) {
+    member.aflags = read16(buffer);
+    uint16_t nameNdx = read16(buffer);
+    uint16_t descNdx = read16(buffer);
+    member.attrs = buffer;
+    skip_attributes(buffer);
+    if (!extract_utf8(pc.cpool, nameNdx, member.name) ||
+        !extract_utf8(pc.cpool, descNdx, member.desc)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool parse_class_file(ParsedClass& pc) {
+  uint8_t*& buffer = pc.buffer;
   uint32_t magic = read32(buffer);
   uint16_t vminor DEBUG_ONLY = read16(buffer);
   uint16_t vmajor DEBUG_ONLY = read16(buffer);
@@ -355,7 +416,7 @@ static bool parse_class(uint8_t* buffer,
     fprintf(stderr, "Bad class magic %08x, Bailing\n", magic);
     return false;
   }
-  std::vector<cp_entry> cpool;
+  auto& cpool = pc.cpool;
   cpool.resize(cp_count);
   /* The zero'th entry is always empty.  Java is annoying. */
   for (int i=1; i<cp_count; i++) {
@@ -367,43 +428,72 @@ static bool parse_class(uint8_t* buffer,
       i++;
     }
   }
-  uint16_t aflags = read16(buffer);
+  pc.aflags = read16(buffer);
   uint16_t clazz = read16(buffer);
   uint16_t super = read16(buffer);
   uint16_t ifcount = read16(buffer);
-  DexType *self = make_dextype_from_cref(cpool, clazz);
-  if (type_class(self)) {
-    return true;
+  if (!extract_class_descriptor(cpool, clazz, pc.self)) {
+    return false;
   }
-  ClassCreator cc(self);
-  cc.set_external();
-  if (super != 0) {
-    DexType *sclazz = make_dextype_from_cref(cpool, super);
-    cc.set_super(sclazz);
+  if (super != 0 && !extract_class_descriptor(cpool, super, pc.super)) {
+    return false;
   }
-  cc.set_access((DexAccessFlags)aflags);
-  if (ifcount) {
-    for (int i=0; i < ifcount; i++) {
-      uint16_t iface = read16(buffer);
-      DexType *iftype = make_dextype_from_cref(cpool, iface);
-      cc.add_interface(iftype);
+  pc.interfaces.resize(ifcount);
+  for (auto& iface : pc.interfaces) {
+    if (!extract_class_descriptor(cpool, read16(buffer), iface)) {
+      return false;
     }
   }
-  uint16_t fcount = read16(buffer);
+  return parse_members(pc, pc.fields) && parse_members(pc, pc.methods);
+}
+
+static bool resolve_class(ParsedClass& pc) {
+  if (!pc.super.empty()) {
+    pc.super_type = DexType::make_type(pc.super.c_str());
+  }
+  for (auto& iface : pc.interfaces) {
+    pc.interface_types.push_back(DexType::make_type(iface.c_str()));
+  }
+  for (auto& finfo : pc.fields) {
+    pc.dex_fields.push_back(make_dexfield(pc.self_type, finfo));
+  }
+  for (auto& minfo : pc.methods) {
+    DexMethod* method = make_dexmethod(pc.self_type, minfo);
+    if (method == nullptr)
+      return false;
+    pc.dex_methods.push_back(method);
+  }
+  return true;
+}
+
+static void publish_class(ParsedClass& pc,
+                          Scope* classes,
+                          attribute_hook_t attr_hook) {
+  auto& cpool = pc.cpool;
+  ClassCreator cc(pc.self_type);
+  cc.set_external();
+  if (pc.super_type != nullptr) {
+    cc.set_super(pc.super_type);
+  }
+  cc.set_access((DexAccessFlags)pc.aflags);
+  for (auto iftype : pc.interface_types) {
+    cc.add_interface(iftype);
+  }
 
   auto invoke_attr_hook = [&](
       boost::variant<DexField*, DexMethod*> field_or_method, uint8_t* attrPtr) {
     if (attr_hook == nullptr) {
       return;
     }
+    always_assert_log(attrPtr != nullptr,
+                      "attribute hooks need the original class file");
     uint16_t attributes_count = read16(attrPtr);
     for (uint16_t j = 0; j < attributes_count; j++) {
       uint16_t attribute_name_index = read16(attrPtr);
       uint32_t attribute_length = read32(attrPtr);
-      char attribute_name[MAX_CLASS_NAMELEN];
-      if (extract_utf8(
-              cpool, attribute_name_index, attribute_name, MAX_CLASS_NAMELEN)) {
-        attr_hook(field_or_method, attribute_name, attrPtr);
+      std::string attribute_name;
+      if (extract_utf8(cpool, attribute_name_index, attribute_name)) {
+        attr_hook(field_or_method, attribute_name.c_str(), attrPtr);
       } else {
         always_assert_log(
             false,
@@ -414,36 +504,13 @@ static bool parse_class(uint8_t* buffer,
     }
   };
 
-  for (int i=0; i < fcount; i++) {
-    cp_field_info cpfield;
-    cpfield.aflags = read16(buffer);
-    cpfield.nameNdx = read16(buffer);
-    cpfield.descNdx = read16(buffer);
-    uint8_t* attrPtr = buffer;
-    skip_attributes(buffer);
-    DexField *field = make_dexfield(cpool, self, cpfield);
-    if (field == nullptr)
-      return false;
-    cc.add_field(field);
-    invoke_attr_hook({field}, attrPtr);
-  }
-
-  uint16_t mcount = read16(buffer);
-  if (mcount) {
-    for (int i=0; i < mcount; i++) {
-      cp_method_info cpmethod;
-      cpmethod.aflags = read16(buffer);
-      cpmethod.nameNdx = read16(buffer);
-      cpmethod.descNdx = read16(buffer);
-
-      uint8_t* attrPtr = buffer;
-      skip_attributes(buffer);
-      DexMethod *method = make_dexmethod(cpool, self, cpmethod);
-      if (method == nullptr)
-        return false;
-      cc.add_method(method);
-      invoke_attr_hook({method}, attrPtr);
-    }
+  for (size_t i = 0; i < pc.dex_fields.size(); ++i) {
+    cc.add_field(pc.dex_fields[i]);
+    invoke_attr_hook({pc.dex_fields[i]}, pc.fields[i].attrs);
+  }
+  for (size_t i = 0; i < pc.dex_methods.size(); ++i) {
+    cc.add_method(pc.dex_methods[i]);
+    invoke_attr_hook({pc.dex_methods[i]}, pc.methods[i].attrs);
   }
   DexClass *dc = cc.create();
   if (classes != nullptr) {
@@ -478,7 +545,6 @@ static bool parse_class(uint8_t* buffer,
   }
 
 #endif
-  return true;
 }
 
 /******************
@@ -487,71 +553,6 @@ static bool parse_class(uint8_t* buffer,
  */
 
 namespace {
-static const int kSignatureSize = 4;
-
-/* CDFile
- * Central directory file header entry structures.
- */
-static const uint16_t kCompMethodDeflate (8);
-static const uint8_t kCDFile[] = {'P', 'K', 0x01, 0x02};
-
-PACKED(struct pk_cd_file {
-  uint32_t signature;
-  uint16_t vmade;
-  uint16_t vextract;
-  uint16_t flags;
-  uint16_t comp_method;
-  uint16_t mod_time;
-  uint16_t mod_date;
-  uint32_t crc32;
-  uint32_t comp_size;
-  uint32_t ucomp_size;
-  uint16_t fname_len;
-  uint16_t extra_len;
-  uint16_t comment_len;
-  uint16_t diskno;
-  uint16_t interal_attr;
-  uint32_t external_attr;
-  uint32_t disk_offset;
-});
-
-/* CDirEnd:
- * End of central directory record structures.
- */
-static const int kMaxCDirEndSearch = 100;
-static const uint8_t kCDirEnd[] = {'P', 'K', 0x05, 0x06};
-
-PACKED(struct pk_cdir_end {
-  uint32_t signature;
-  uint16_t diskno;
-  uint16_t cd_diskno;
-  uint16_t cd_disk_entries;
-  uint16_t cd_entries;
-  uint32_t cd_size;
-  uint32_t cd_disk_offset;
-  uint16_t comment_len;
-});
-
-/* LFile:
- * Local file header structures.
- * (Yes, this made more sense in the world of floppies and tapes.)
- */
-static const uint8_t kLFile[] = {'P', 'K', 0x03, 0x04};
-
-PACKED(struct pk_lfile {
-  uint32_t signature;
-  uint16_t vextract;
-  uint16_t flags;
-  uint16_t comp_method;
-  uint16_t mod_time;
-  uint16_t mod_date;
-  uint32_t crc32;
-  uint32_t comp_size;
-  uint32_t ucomp_size;
-  uint16_t fname_len;
-  uint16_t extra_len;
-});
-
 struct jar_entry {
   struct pk_cd_file cd_entry;
   uint8_t *filename;
@@ -654,9 +655,15 @@ static int jar_uncompress(Bytef *dest, uLongf *destLen, const Bytef *source,
   return err;
 }
 
-static bool decompress_class(jar_entry &file, const uint8_t *mapping,
-                             uint8_t *outbuffer, ssize_t bufsize) {
-  if (file.cd_entry.comp_method != kCompMethodDeflate) {
+/*
+ * Points pc.buffer at the contents of the class file in `file`. Stored
+ * entries are parsed in place from the jar mapping; deflated ones are
+ * inflated into a buffer of exactly their uncompressed size.
+ */
+static bool extract_class(jar_entry &file, const uint8_t *mapping,
+                          ParsedClass& pc) {
+  if (file.cd_entry.comp_method != kCompMethodDeflate &&
+      file.cd_entry.comp_method != kCompMethodStore) {
     fprintf(stderr, "Unknown compression method %d, Bailing\n",
             file.cd_entry.comp_method);
     return false;
@@ -688,8 +695,14 @@ static bool decompress_class(jar_entry &file, const uint8_t *mapping,
   }
   lfile += pkf.fname_len;
   lfile += pkf.extra_len;
-  uLongf dlen = bufsize;
-  int zlibrv = jar_uncompress(outbuffer, &dlen, lfile, pkf.comp_size);
+  if (pkf.comp_method == kCompMethodStore) {
+    // The class file parsers only ever read through this pointer.
+    pc.buffer = const_cast<uint8_t*>(lfile);
+    return true;
+  }
+  pc.storage.reset(new uint8_t[pkf.ucomp_size]);
+  uLongf dlen = pkf.ucomp_size;
+  int zlibrv = jar_uncompress(pc.storage.get(), &dlen, lfile, pkf.comp_size);
   if (zlibrv != Z_OK) {
     fprintf(stderr, "uncompress failed with code %d, Bailing\n", zlibrv);
     return false;
@@ -698,20 +711,35 @@ static bool decompress_class(jar_entry &file, const uint8_t *mapping,
     fprintf(stderr, "mis-match on uncompressed size, Bailing\n");
     return false;
   }
+  pc.buffer = pc.storage.get();
   return true;
 }
 
-static const int kStartBufferSize = 128 * 1024;
+/*
+ * Runs `fn(i)` for each i in [0, count) on the thread pool and returns
+ * whether all of them succeeded.
+ */
+static bool run_in_parallel(size_t count,
+                            const std::function<bool(size_t)>& fn) {
+  std::atomic<bool> ok{true};
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    if (!fn(i)) {
+      ok = false;
+    }
+  });
+  for (size_t i = 0; i < count; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  return ok;
+}
 
-static bool process_jar_entries(std::vector<jar_entry>& files,
-                                const uint8_t* mapping,
-                                Scope* classes,
-                                attribute_hook_t attr_hook) {
-  ssize_t bufsize = kStartBufferSize;
-  uint8_t *outbuffer = (uint8_t*)malloc(bufsize);
+static bool parse_jar_entries(std::vector<jar_entry>& files,
+                              const uint8_t* mapping,
+                              std::vector<ParsedClass>& parsed) {
   static char classEndString[] = ".class";
   static size_t classEndStringLen = strlen(classEndString);
-  init_basic_types();
+  std::vector<jar_entry*> class_files;
   for (auto &file : files) {
     if (file.cd_entry.ucomp_size == 0)
       continue;
@@ -723,33 +751,50 @@ static bool process_jar_entries(std::vector<jar_entry>& files,
       (file.cd_entry.fname_len - classEndStringLen);
     if (memcmp(endcomp, classEndString, classEndStringLen) != 0)
       continue;
+    class_files.push_back(&file);
+  }
 
-    // Resize output if necessary.
-    if (bufsize < file.cd_entry.ucomp_size) {
-      while(bufsize < file.cd_entry.ucomp_size)
-        bufsize *= 2;
-      free(outbuffer);
-      outbuffer = (uint8_t*)malloc(bufsize);
-    }
+  parsed.resize(class_files.size());
+  return run_in_parallel(class_files.size(), [&](size_t i) {
+    return extract_class(*class_files[i], mapping, parsed[i]) &&
+           parse_class_file(parsed[i]);
+  });
+}
 
-    if (!decompress_class(file, mapping, outbuffer, bufsize)) {
-      free(outbuffer);
-      return false;
-    }
+static bool load_parsed_classes(std::vector<ParsedClass>& parsed,
+                                Scope* classes,
+                                attribute_hook_t attr_hook) {
+  init_basic_types();
+  run_in_parallel(parsed.size(), [&](size_t i) {
+    parsed[i].self_type = DexType::make_type(parsed[i].self.c_str());
+    return true;
+  });
 
-    if (!parse_class(outbuffer, classes, attr_hook)) {
-      free(outbuffer);
-      return false;
+  // Classes we already know about, including ones defined earlier in this
+  // jar, are skipped.
+  std::vector<ParsedClass*> fresh;
+  std::unordered_set<DexType*> seen;
+  for (auto& pc : parsed) {
+    if (type_class(pc.self_type) || !seen.insert(pc.self_type).second) {
+      continue;
     }
+    fresh.push_back(&pc);
+  }
+
+  if (!run_in_parallel(fresh.size(),
+                       [&](size_t i) { return resolve_class(*fresh[i]); })) {
+    return false;
+  }
+
+  for (auto pc : fresh) {
+    publish_class(*pc, classes, attr_hook);
   }
-  free(outbuffer);
   return true;
 }
 
-static bool process_jar(const uint8_t* mapping,
-                        ssize_t size,
-                        Scope* classes,
-                        attribute_hook_t attr_hook) {
+static bool parse_jar(const uint8_t* mapping,
+                      ssize_t size,
+                      std::vector<ParsedClass>& parsed) {
   pk_cdir_end pce;
   std::vector<jar_entry> files;
   if (!find_central_directory(mapping, size, pce))
@@ -758,15 +803,13 @@ static bool process_jar(const uint8_t* mapping,
     return false;
   if (!get_jar_entries(mapping, pce, files))
     return false;
-  if (!process_jar_entries(files, mapping, classes, attr_hook)) {
-    return false;
-  }
-  return true;
+  return parse_jar_entries(files, mapping, parsed);
 }
 
 bool load_jar_file(const char* location,
                    Scope* classes,
                    attribute_hook_t attr_hook) {
+  Timeline::Span span(std::string("Load jar ") + location);
   boost::iostreams::mapped_file file;
   file.open(location, boost::iostreams::mapped_file::readonly);
   if (!file.is_open()) {
@@ -775,13 +818,372 @@ bool load_jar_file(const char* location,
   }
 
   auto mapping = reinterpret_cast<const uint8_t*>(file.const_data());
-  if (!process_jar(mapping, file.size(), classes, attr_hook)) {
+  std::vector<ParsedClass> parsed;
+  if (!parse_jar(mapping, file.size(), parsed) ||
+      !load_parsed_classes(parsed, classes, attr_hook)) {
     fprintf(stderr, "error: cannot process jar: %s\n", location);
     return false;
   }
   return true;
 }
 
+/******************
+ * Begin jar cache code.
+ *
+ * The cache holds exactly what phase 1 of loading produces: for every class
+ * file in the jar, the descriptors of the class, its supertypes, fields and
+ * methods. All of it is plain strings, so it doesn't depend on whatever else
+ * has been loaded, and reading it back skips inflating and parsing the class
+ * files. The layout, in native-endian 32-bit words, is:
+ *
+ *   magic, version, string count, class count
+ *   strings: length, bytes, NUL, padded to a word
+ *   classes: self, super (or kNoString), access, interface count,
+ *            interfaces..., field count, (name, desc, access)...,
+ *            method count, (name, desc, access)...
+ *
+ * Every string is stored as an index into the string table.
+ */
+
+namespace {
+
+constexpr uint32_t kJarCacheMagic = 0x4a584452; // "RDXJ"
+constexpr uint32_t kJarCacheVersion = 1;
+constexpr uint32_t kNoString = 0xffffffff;
+
+class JarCacheWriter {
+ public:
+  void add_class(const ParsedClass& pc) {
+    ++m_class_count;
+    m_words.push_back(string_idx(pc.self));
+    m_words.push_back(pc.super.empty() ? kNoString : string_idx(pc.super));
+    m_words.push_back(pc.aflags);
+    m_words.push_back(pc.interfaces.size());
+    for (auto& iface : pc.interfaces) {
+      m_words.push_back(string_idx(iface));
+    }
+    add_members(pc.fields);
+    add_members(pc.methods);
+  }
+
+  bool write(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    uint32_t header[] = {kJarCacheMagic, kJarCacheVersion,
+                         (uint32_t)m_strings.size(), m_class_count};
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (auto str : m_strings) {
+      uint32_t len = str->size();
+      out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+      out.write(str->c_str(), len + 1);
+      static const char padding[sizeof(uint32_t)] = {};
+      out.write(padding, (sizeof(uint32_t) - (len + 1) % sizeof(uint32_t)) %
+                             sizeof(uint32_t));
+    }
+    out.write(reinterpret_cast<const char*>(m_words.data()),
+              m_words.size() * sizeof(uint32_t));
+    return out.good();
+  }
+
+ private:
+  uint32_t string_idx(const std::string& str) {
+    auto it = m_string_ids.emplace(str, m_strings.size());
+    if (it.second) {
+      m_strings.push_back(&it.first->first);
+    }
+    return it.first->second;
+  }
+
+  void add_members(const std::vector<ParsedMember>& members) {
+    m_words.push_back(members.size());
+    for (auto& member : members) {
+      m_words.push_back(string_idx(member.name));
+      m_words.push_back(string_idx(member.desc));
+      m_words.push_back(member.aflags);
+    }
+  }
+
+  std::unordered_map<std::string, uint32_t> m_string_ids;
+  std::vector<const std::string*> m_strings;
+  std::vector<uint32_t> m_words;
+  uint32_t m_class_count{0};
+};
+
+/*
+ * Reads a cache back, checking every read against the end of the file so a
+ * truncated or corrupt cache is rejected rather than trusted.
+ */
+class JarCacheReader {
+ public:
+  JarCacheReader(const char* data, size_t size)
+      : m_pos(data), m_end(data + size) {}
+
+  bool read(std::vector<ParsedClass>& parsed) {
+    uint32_t magic, version, string_count, class_count;
+    if (!word(magic) || magic != kJarCacheMagic || !word(version) ||
+        version != kJarCacheVersion || !word(string_count) ||
+        !word(class_count)) {
+      return false;
+    }
+    m_strings.resize(string_count);
+    for (auto& str : m_strings) {
+      uint32_t len;
+      if (!word(len) || (size_t)(m_end - m_pos) < len + 1) {
+        return false;
+      }
+      str = m_pos;
+      m_lengths.push_back(len);
+      m_pos += (len + 1 + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+    }
+    parsed.resize(class_count);
+    for (auto& pc : parsed) {
+      uint32_t super, aflags, ifcount;
+      if (!string(pc.self) || !word(super) || !word(aflags) ||
+          !word(ifcount)) {
+        return false;
+      }
+      if (super != kNoString && !string_at(super, pc.super)) {
+        return false;
+      }
+      pc.aflags = aflags;
+      pc.interfaces.resize(ifcount);
+      for (auto& iface : pc.interfaces) {
+        if (!string(iface)) {
+          return false;
+        }
+      }
+      if (!members(pc.fields) || !members(pc.methods)) {
+        return false;
+      }
+    }
+    return m_pos == m_end;
+  }
+
+ private:
+  bool word(uint32_t& out) {
+    if ((size_t)(m_end - m_pos) < sizeof(uint32_t)) {
+      return false;
+    }
+    memcpy(&out, m_pos, sizeof(uint32_t));
+    m_pos += sizeof(uint32_t);
+    return true;
+  }
+
+  bool string_at(uint32_t idx, std::string& out) {
+    if (idx >= m_strings.size()) {
+      return false;
+    }
+    out.assign(m_strings[idx], m_lengths[idx]);
+    return true;
+  }
+
+  bool string(std::string& out) {
+    uint32_t idx;
+    return word(idx) && string_at(idx, out);
+  }
+
+  bool members(std::vector<ParsedMember>& out) {
+    uint32_t count;
+    if (!word(count)) {
+      return false;
+    }
+    out.resize(count);
+    for (auto& member : out) {
+      uint32_t aflags;
+      if (!string(member.name) || !string(member.desc) || !word(aflags)) {
+        return false;
+      }
+      member.aflags = aflags;
+      member.attrs = nullptr;
+    }
+    return true;
+  }
+
+  const char* m_pos;
+  const char* m_end;
+  std::vector<const char*> m_strings;
+  std::vector<uint32_t> m_lengths;
+};
+
+std::string jar_cache_path(const std::string& cache_dir,
+                           const uint8_t* mapping,
+                           size_t size) {
+  Sha1Context context;
+  unsigned char digest[20];
+  sha1_init(&context);
+  sha1_update(&context, mapping, size);
+  sha1_final(digest, &context);
+  std::ostringstream path;
+  path << cache_dir << "/";
+  for (auto byte : digest) {
+    path << std::hex << std::setw(2) << std::setfill('0') << (int)byte;
+  }
+  path << ".jarcache";
+  return path.str();
+}
+
+bool read_jar_cache(const std::string& path,
+                    std::vector<ParsedClass>& parsed) {
+  if (!boost::filesystem::exists(path)) {
+    return false;
+  }
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(path);
+  } catch (const std::exception&) {
+    return false;
+  }
+  if (!file.is_open()) {
+    return false;
+  }
+  JarCacheReader reader(file.data(), file.size());
+  if (!reader.read(parsed)) {
+    parsed.clear();
+    return false;
+  }
+  return true;
+}
+
+void write_jar_cache(const std::string& cache_dir,
+                     const std::string& path,
+                     const std::vector<ParsedClass>& parsed) {
+  JarCacheWriter writer;
+  for (auto& pc : parsed) {
+    writer.add_class(pc);
+  }
+  // Write to a private name and rename into place, so concurrent runs never
+  // see a partially written cache.
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(cache_dir, ec);
+  auto tmp_path = path + boost::filesystem::unique_path(".%%%%%%%%").string();
+  if (!writer.write(tmp_path)) {
+    fprintf(stderr, "warning: cannot write jar cache %s\n", tmp_path.c_str());
+    boost::filesystem::remove(tmp_path, ec);
+    return;
+  }
+  boost::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    fprintf(stderr, "warning: cannot write jar cache %s\n", path.c_str());
+    boost::filesystem::remove(tmp_path, ec);
+  }
+}
+
+} // namespace
+
+/*
+ * Leaves only what a jar cache holds of the classes, so they no longer refer
+ * to the class files or to the jar they came from.
+ */
+static void drop_class_files(std::vector<ParsedClass>& parsed) {
+  for (auto& pc : parsed) {
+    pc.storage.reset();
+    pc.buffer = nullptr;
+    pc.cpool.clear();
+    for (auto& member : pc.fields) {
+      member.attrs = nullptr;
+    }
+    for (auto& member : pc.methods) {
+      member.attrs = nullptr;
+    }
+  }
+}
+
+/*
+ * Parses the jar at `location` into `parsed`, going through the jar cache in
+ * `cache_dir`. The classes don't refer to the jar file once parsed.
+ */
+static bool parse_jar_file_cached(const char* location,
+                                  const std::string& cache_dir,
+                                  std::vector<ParsedClass>& parsed) {
+  boost::iostreams::mapped_file file;
+  file.open(location, boost::iostreams::mapped_file::readonly);
+  if (!file.is_open()) {
+    fprintf(stderr, "error: cannot open jar file: %s\n", location);
+    return false;
+  }
+
+  auto mapping = reinterpret_cast<const uint8_t*>(file.const_data());
+  auto cache_path = jar_cache_path(cache_dir, mapping, file.size());
+  if (read_jar_cache(cache_path, parsed)) {
+    TRACE(MAIN, 2, "Loaded %s from %s\n", location, cache_path.c_str());
+    return true;
+  }
+  if (!parse_jar(mapping, file.size(), parsed)) {
+    fprintf(stderr, "error: cannot process jar: %s\n", location);
+    return false;
+  }
+  write_jar_cache(cache_dir, cache_path, parsed);
+  drop_class_files(parsed);
+  return true;
+}
+
+bool load_jar_file_cached(const char* location,
+                          const std::string& cache_dir,
+                          Scope* classes) {
+  Timeline::Span span(std::string("Load jar ") + location);
+  std::vector<ParsedClass> parsed;
+  if (!parse_jar_file_cached(location, cache_dir, parsed)) {
+    return false;
+  }
+  if (!load_parsed_classes(parsed, classes, nullptr)) {
+    fprintf(stderr, "error: cannot process jar: %s\n", location);
+    return false;
+  }
+  return true;
+}
+
+struct ParsedJar::Classes {
+  std::vector<ParsedClass> parsed;
+};
+
+ParsedJar::ParsedJar(const char* location)
+    : m_location(location), m_classes(new Classes()) {}
+
+ParsedJar::~ParsedJar() {}
+
+std::unique_ptr<ParsedJar> ParsedJar::parse(const char* location,
+                                            const std::string& cache_dir) {
+  Timeline::Span span(std::string("Parse jar ") + location);
+  std::unique_ptr<ParsedJar> jar(new ParsedJar(location));
+  auto& parsed = jar->m_classes->parsed;
+  if (!cache_dir.empty()) {
+    if (!parse_jar_file_cached(location, cache_dir, parsed)) {
+      return nullptr;
+    }
+    return jar;
+  }
+
+  boost::iostreams::mapped_file file;
+  file.open(location, boost::iostreams::mapped_file::readonly);
+  if (!file.is_open()) {
+    fprintf(stderr, "error: cannot open jar file: %s\n", location);
+    return nullptr;
+  }
+  auto mapping = reinterpret_cast<const uint8_t*>(file.const_data());
+  if (!parse_jar(mapping, file.size(), parsed)) {
+    fprintf(stderr, "error: cannot process jar: %s\n", location);
+    return nullptr;
+  }
+  drop_class_files(parsed);
+  return jar;
+}
+
+bool ParsedJar::load(Scope* classes) {
+  Timeline::Span span(std::string("Load jar ") + m_location);
+  // Drop whatever an earlier load into another context made.
+  for (auto& pc : m_classes->parsed) {
+    pc.self_type = nullptr;
+    pc.super_type = nullptr;
+    pc.interface_types.clear();
+    pc.dex_fields.clear();
+    pc.dex_methods.clear();
+  }
+  if (!load_parsed_classes(m_classes->parsed, classes, nullptr)) {
+    fprintf(stderr, "error: cannot process jar: %s\n", m_location.c_str());
+    return false;
+  }
+  return true;
+}
+
 //#define LOCAL_MAIN
 #ifdef LOCAL_MAIN
 int main(int argc, char *argv[]) {
@@ -15,6 +15,8 @@ class DexMethod;
 #include "boost/variant.hpp"
 
 #include <functional>
+#include <memory>
+#include <string>
 
 namespace JarLoaderUtil {
 uint32_t read32(uint8_t*& buffer);
@@ -29,3 +31,44 @@ using attribute_hook_t =
 bool load_jar_file(const char* location,
                    Scope* classes = nullptr,
                    attribute_hook_t = nullptr);
+
+/*
+ * Like load_jar_file, but keeps the parsed form of the jar in `cache_dir`,
+ * keyed by the SHA-1 of the jar's contents, and loads from there when the
+ * same jar is seen again. Attribute hooks need the original class files, so
+ * there is no hook parameter.
+ */
+bool load_jar_file_cached(const char* location,
+                          const std::string& cache_dir,
+                          Scope* classes = nullptr);
+
+/*
+ * A jar parsed ahead of time: the descriptors of its classes and members, as
+ * a jar cache holds them, without any Dex objects. load() makes the classes
+ * in the current RedexContext exactly as load_jar_file would, so a process
+ * that creates several contexts (e.g. by forking one per job) reads and
+ * parses each jar only once. Nothing refers back to the jar file itself.
+ */
+class ParsedJar {
+ public:
+  ~ParsedJar();
+
+  /*
+   * Returns null if the jar can't be read. With a non-empty `cache_dir`, the
+   * jar cache is used as in load_jar_file_cached.
+   */
+  static std::unique_ptr<ParsedJar> parse(const char* location,
+                                          const std::string& cache_dir = "");
+
+  bool load(Scope* classes = nullptr);
+
+  const std::string& location() const { return m_location; }
+
+ private:
+  struct Classes;
+
+  explicit ParsedJar(const char* location);
+
+  std::string m_location;
+  std::unique_ptr<Classes> m_classes;
+};
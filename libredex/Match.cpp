@@ -49,7 +49,8 @@ match_t<IRInstruction> return_void() {
     [](const IRInstruction* insn) {
       auto opcode = insn->opcode();
       return opcode == OPCODE_RETURN_VOID;
-    }
+    },
+    make_opcode_set({OPCODE_RETURN_VOID})
   };
 }
 
@@ -84,7 +85,8 @@ match_t<IRInstruction> const_string() {
     [](const IRInstruction* insn) {
       auto opcode = insn->opcode();
       return opcode == OPCODE_CONST_STRING;
-    }
+    },
+    make_opcode_set({OPCODE_CONST_STRING})
   };
 }
 
@@ -92,7 +94,10 @@ match_t<IRInstruction> move_result_pseudo() {
   return {
     [](const IRInstruction* insn) {
       return opcode::is_move_result_pseudo(insn->opcode());
-    }
+    },
+    make_opcode_set({IOPCODE_MOVE_RESULT_PSEUDO,
+                     IOPCODE_MOVE_RESULT_PSEUDO_OBJECT,
+                     IOPCODE_MOVE_RESULT_PSEUDO_WIDE})
   };
 }
 
@@ -106,7 +111,8 @@ match_t<IRInstruction> throwex() {
     [](const IRInstruction* insn) {
       auto opcode = insn->opcode();
       return opcode == OPCODE_THROW;
-    }
+    },
+    make_opcode_set({OPCODE_THROW})
   };
 }
 
@@ -10,8 +10,10 @@
 #pragma once
 
 #include <algorithm>
+#include <bitset>
 #include <functional>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "DexClass.h"
@@ -61,6 +63,61 @@ inline bool has_code(const DexMethodRef* meth) {
 
 namespace m {
 
+/**
+ * The set of opcodes an instruction match can possibly accept. Walkers test it
+ * before calling into the match, so that most instructions are rejected by a
+ * single bit test. Matches over other types leave it full.
+ */
+using opcode_set = std::bitset<IOPCODE_MOVE_RESULT_PSEUDO_WIDE + 1>;
+
+inline opcode_set all_opcodes() { return opcode_set().set(); }
+
+inline opcode_set make_opcode_set(std::initializer_list<IROpcode> opcodes) {
+  opcode_set set;
+  for (auto opcode : opcodes) {
+    set.set(opcode);
+  }
+  return set;
+}
+
+/** The classes of the opcodes in the set. */
+inline opcode::OpcodeClasses opcode_classes_of(const opcode_set& opcodes) {
+  opcode::OpcodeClasses classes;
+  for (size_t op = 0; op < opcodes.size(); ++op) {
+    if (opcodes.test(op)) {
+      classes.set(static_cast<size_t>(
+          opcode::opcode_class(static_cast<IROpcode>(op))));
+    }
+  }
+  return classes;
+}
+
+template <typename P, size_t... Is>
+std::vector<opcode::OpcodeClasses> required_opcode_classes(
+    const P& p, std::index_sequence<Is...>) {
+  return {opcode_classes_of(std::get<Is>(p).opcodes)...};
+}
+
+/**
+ * For each match of the sequence `p`, the classes of the opcodes it accepts.
+ * Code can only contain the sequence if it has an opcode of each of them.
+ */
+template <typename P>
+std::vector<opcode::OpcodeClasses> required_opcode_classes(const P& p) {
+  return required_opcode_classes(
+      p, std::make_index_sequence<std::tuple_size<P>::value>());
+}
+
+inline bool may_contain(IRCode& code,
+                        const std::vector<opcode::OpcodeClasses>& required) {
+  const auto& classes = code.opcode_classes();
+  return std::all_of(required.begin(),
+                     required.end(),
+                     [&](const opcode::OpcodeClasses& needed) {
+                       return (needed & classes).any();
+                     });
+}
+
 // N.B. recursive template for matching opcode pattern against insn sequence
 template<typename T, typename N>
 struct insns_matcher {
@@ -69,8 +126,9 @@ struct insns_matcher {
     const std::vector<IRInstruction*>& insns,
     const T& t) {
     const auto& insn = insns.at(at);
-    typename std::tuple_element<N::value, T>::type insn_match = std::get<N::value>(t);
-    return insn_match.matches(insn) &&
+    const auto& insn_match = std::get<N::value>(t);
+    return insn_match.opcodes.test(insn->opcode()) &&
+        insn_match.matches(insn) &&
         insns_matcher<T, std::integral_constant<size_t, N::value+1> >::matches_at(at+1, insns, t);
   }
 };
@@ -93,8 +151,12 @@ void find_matches(const std::vector<IRInstruction*>& insns,
                   std::vector<std::vector<IRInstruction*>>& matches) {
   // No way to match if we have fewer insns than N
   if (insns.size() >= N) {
+    const auto& first_opcodes = std::get<0>(p).opcodes;
     // Try to match starting at i
     for (size_t i = 0; i <= insns.size() - N; ++i) {
+      if (!first_opcodes.test(insns[i]->opcode())) {
+        continue;
+      }
       if (m::insns_matcher<P, std::integral_constant<size_t, 0>>::matches_at(
               i, insns, p)) {
         matches.emplace_back();
@@ -119,6 +181,7 @@ struct match_t;
 template <typename T, typename P>
 struct match_t<T, P, 0> {
   bool (*fn)(const T*);
+  opcode_set opcodes = all_opcodes();
   bool matches(const T* t) const {
     return fn(t);
   }
@@ -130,6 +193,7 @@ struct match_t<T, P, 1> {
   using P0_t = typename std::tuple_element<0, P>::type;
   bool (*fn)(const T*, const P0_t& p0);
   P0_t p0;
+  opcode_set opcodes = all_opcodes();
   bool matches(const T* t) const {
     return fn(t, p0);
   }
@@ -143,6 +207,7 @@ struct match_t<T, P, 2> {
   bool (*fn)(const T*, const P0_t& p0, const P1_t& p1);
   P0_t p0;
   P1_t p1;
+  opcode_set opcodes = all_opcodes();
   bool matches(const T* t) const {
     return fn(t, p0, p1);
   }
@@ -166,7 +231,8 @@ match_t<T, std::tuple<match_t<T, P0>, match_t<T, P1> > >
     [](const T* t, const match_t<T, P0>& p0, const match_t<T, P1>& p1) {
       return p0.matches(t) || p1.matches(t); },
     p0,
-    p1 };
+    p1,
+    p0.opcodes | p1.opcodes };
 }
 
 /** Match two subordinate matches whose logical and is true */
@@ -177,7 +243,8 @@ match_t<T, std::tuple<match_t<T, P0>, match_t<T, P1> > >
     [](const T* t, const match_t<T, P0>& p0, const match_t<T, P1>& p1) {
       return p0.matches(t) && p1.matches(t); },
     p0,
-    p1 };
+    p1,
+    p0.opcodes & p1.opcodes };
 }
 
 /** Match two subordinate matches whose logical xor is true */
@@ -188,7 +255,8 @@ match_t<T, std::tuple<match_t<T, P0>, match_t<T, P1> > >
     [](const T* t, const match_t<T, P0>& p0, const match_t<T, P1>& p1) {
       return p0.matches(t) ^ p1.matches(t); },
     p0,
-    p1 };
+    p1,
+    p0.opcodes | p1.opcodes };
 }
 
 /** Match any T (always matches) */
@@ -283,7 +351,8 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P> > >
         return false;
       }
     },
-    p
+    p,
+    p.opcodes & make_opcode_set({OPCODE_NEW_INSTANCE})
   };
 }
 
@@ -306,7 +375,8 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P> > >
         return false;
       }
     },
-    p
+    p,
+    p.opcodes & make_opcode_set({OPCODE_INVOKE_DIRECT})
   };
 }
 
@@ -326,7 +396,8 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P> > >
         return false;
       }
     },
-    p
+    p,
+    p.opcodes & make_opcode_set({OPCODE_INVOKE_STATIC})
   };
 }
 
@@ -341,7 +412,12 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P> > >
     [](const IRInstruction* insn, const match_t<IRInstruction, P>& p) {
       return is_invoke(insn->opcode()) && p.matches(insn);
     },
-    p
+    p,
+    p.opcodes & make_opcode_set({OPCODE_INVOKE_VIRTUAL,
+                                 OPCODE_INVOKE_SUPER,
+                                 OPCODE_INVOKE_DIRECT,
+                                 OPCODE_INVOKE_STATIC,
+                                 OPCODE_INVOKE_INTERFACE})
   };
 }
 
@@ -361,7 +437,8 @@ inline match_t<IRInstruction, std::tuple<IROpcode>> is_opcode(IROpcode opcode) {
   return {[](const IRInstruction* insn, const IROpcode& opcode) {
             return insn->opcode() == opcode;
           },
-          opcode};
+          opcode,
+          make_opcode_set({opcode})};
 }
 
 /** Matchers that map from IRInstruction -> other types */
@@ -9,6 +9,8 @@
 
 #include "MethodDevirtualizer.h"
 
+#include <algorithm>
+
 #include "Mutators.h"
 #include "Resolver.h"
 #include "VirtualScope.h"
@@ -52,12 +54,18 @@ void patch_call_site(DexMethod* callee,
   method_inst->set_method(callee);
 }
 
+/*
+ * Rewrites all the calls to `drop_this_methods` and `keep_this_methods` in one
+ * parallel walk. The calls to the former lose their `this` argument.
+ */
 void fix_call_sites(const std::vector<DexClass*>& scope,
-                    const std::unordered_set<DexMethod*>& target_methods,
-                    DevirtualizerMetrics& metrics,
-                    bool drop_this = false) {
-  const auto fixer = [&target_methods, drop_this](std::nullptr_t,
-                                                  DexMethod* m) -> CallCounter {
+                    const std::unordered_set<DexMethod*>& drop_this_methods,
+                    const std::unordered_set<DexMethod*>& keep_this_methods,
+                    DevirtualizerMetrics& metrics) {
+  if (drop_this_methods.empty() && keep_this_methods.empty()) {
+    return;
+  }
+  const auto fixer = [&](std::nullptr_t, DexMethod* m) -> CallCounter {
     CallCounter call_counter;
     IRCode* code = m->get_code();
     if (code == nullptr) {
@@ -70,9 +78,24 @@ void fix_call_sites(const std::vector<DexClass*>& scope,
         continue;
       }
 
-      MethodSearch type = drop_this ? MethodSearch::Any : MethodSearch::Virtual;
-      auto method = resolve_method(insn->get_method(), type);
-      if (method == nullptr || !target_methods.count(method)) {
+      DexMethod* method = nullptr;
+      bool drop_this = false;
+      if (!drop_this_methods.empty()) {
+        auto resolved =
+            resolve_method_cached(insn->get_method(), MethodSearch::Any);
+        if (resolved != nullptr && drop_this_methods.count(resolved)) {
+          method = resolved;
+          drop_this = true;
+        }
+      }
+      if (method == nullptr && !keep_this_methods.empty()) {
+        auto resolved =
+            resolve_method_cached(insn->get_method(), MethodSearch::Virtual);
+        if (resolved != nullptr && keep_this_methods.count(resolved)) {
+          method = resolved;
+        }
+      }
+      if (method == nullptr) {
         continue;
       }
 
@@ -95,12 +118,7 @@ void fix_call_sites(const std::vector<DexClass*>& scope,
       walk::parallel::reduce_methods<std::nullptr_t, CallCounter, Scope>(
           scope,
           fixer,
-          [](CallCounter a, CallCounter b) -> CallCounter {
-            a.virtuals += b.virtuals;
-            a.supers += b.supers;
-            a.directs += b.directs;
-            return a;
-          },
+          CallCounter::plus,
           [](int) { return nullptr; });
 
   metrics.num_virtual_calls += call_counter.virtuals;
@@ -108,9 +126,15 @@ void fix_call_sites(const std::vector<DexClass*>& scope,
   metrics.num_direct_calls += call_counter.directs;
 }
 
+/*
+ * Turns the methods static in a deterministic order, since clashing names
+ * get renamed.
+ */
 void make_methods_static(const std::unordered_set<DexMethod*>& methods,
                          bool keep_this) {
-  for (auto method : methods) {
+  std::vector<DexMethod*> sorted(methods.begin(), methods.end());
+  std::sort(sorted.begin(), sorted.end(), compare_dexmethods);
+  for (auto method : sorted) {
     TRACE(VIRT,
           2,
           "Staticized method: %s, keep this: %d\n",
@@ -158,8 +182,8 @@ std::vector<DexMethod*> get_devirtualizable_vmethods(
 std::vector<DexMethod*> get_devirtualizable_vmethods(
     const std::vector<DexClass*>& scope,
     const std::vector<DexMethod*>& targets) {
-  ClassHierarchy class_hierarchy = build_type_hierarchy(scope);
-  auto signature_map = build_signature_map(class_hierarchy);
+  auto class_scopes = get_class_scopes(scope);
+  const auto& signature_map = class_scopes->get_signature_map();
 
   std::vector<DexMethod*> res;
   for (const auto m : targets) {
@@ -221,22 +245,20 @@ void MethodDevirtualizer::verify_and_split(
   }
 }
 
-void MethodDevirtualizer::staticize_methods_not_using_this(
+void MethodDevirtualizer::staticize_methods(
     const std::vector<DexClass*>& scope,
-    const std::unordered_set<DexMethod*>& methods) {
-  fix_call_sites(scope, methods, m_metrics, true /* drop_this */);
-  make_methods_static(methods, false);
-  TRACE(VIRT, 1, "Staticized %lu methods not using this\n", methods.size());
-  m_metrics.num_methods_not_using_this += methods.size();
-}
-
-void MethodDevirtualizer::staticize_methods_using_this(
-    const std::vector<DexClass*>& scope,
-    const std::unordered_set<DexMethod*>& methods) {
-  fix_call_sites(scope, methods, m_metrics, false /* drop_this */);
-  make_methods_static(methods, true);
-  TRACE(VIRT, 1, "Staticized %lu methods using this\n", methods.size());
-  m_metrics.num_methods_using_this += methods.size();
+    const std::unordered_set<DexMethod*>& using_this,
+    const std::unordered_set<DexMethod*>& not_using_this) {
+  fix_call_sites(scope, not_using_this, using_this, m_metrics);
+  make_methods_static(not_using_this, false);
+  make_methods_static(using_this, true);
+  // The staticized methods no longer resolve as they did.
+  invalidate_resolution_caches();
+  TRACE(VIRT, 1, "Staticized %lu methods not using this\n",
+        not_using_this.size());
+  TRACE(VIRT, 1, "Staticized %lu methods using this\n", using_this.size());
+  m_metrics.num_methods_not_using_this += not_using_this.size();
+  m_metrics.num_methods_using_this += using_this.size();
 }
 
 DevirtualizerMetrics MethodDevirtualizer::devirtualize_methods(
@@ -251,13 +273,13 @@ DevirtualizerMetrics MethodDevirtualizer::devirtualize_methods(
         using_this.size(),
         not_using_this.size());
 
-  if (m_config.vmethods_not_using_this) {
-    staticize_methods_not_using_this(scope, not_using_this);
+  if (!m_config.vmethods_not_using_this) {
+    not_using_this.clear();
   }
-
-  if (m_config.vmethods_using_this) {
-    staticize_methods_using_this(scope, using_this);
+  if (!m_config.vmethods_using_this) {
+    using_this.clear();
   }
+  staticize_methods(scope, using_this, not_using_this);
 
   auto dmethods = get_devirtualizable_dmethods(scope, target_classes);
   using_this.clear();
@@ -269,13 +291,13 @@ DevirtualizerMetrics MethodDevirtualizer::devirtualize_methods(
         using_this.size(),
         not_using_this.size());
 
-  if (m_config.dmethods_not_using_this) {
-    staticize_methods_not_using_this(scope, not_using_this);
+  if (!m_config.dmethods_not_using_this) {
+    not_using_this.clear();
   }
-
-  if (m_config.dmethods_using_this) {
-    staticize_methods_using_this(scope, using_this);
+  if (!m_config.dmethods_using_this) {
+    using_this.clear();
   }
+  staticize_methods(scope, using_this, not_using_this);
 
   return m_metrics;
 }
@@ -287,13 +309,13 @@ DevirtualizerMetrics MethodDevirtualizer::devirtualize_vmethods(
   std::unordered_set<DexMethod*> using_this, not_using_this;
   verify_and_split(candidates, using_this, not_using_this);
 
-  if (m_config.vmethods_using_this) {
-    staticize_methods_using_this(scope, using_this);
+  if (!m_config.vmethods_not_using_this) {
+    not_using_this.clear();
   }
-
-  if (m_config.vmethods_not_using_this) {
-    staticize_methods_not_using_this(scope, not_using_this);
+  if (!m_config.vmethods_using_this) {
+    using_this.clear();
   }
+  staticize_methods(scope, using_this, not_using_this);
 
   return m_metrics;
 }
@@ -71,13 +71,12 @@ class MethodDevirtualizer {
 
   void reset_metrics() { m_metrics = DevirtualizerMetrics(); }
 
-  void staticize_methods_using_this(
-      const std::vector<DexClass*>& scope,
-      const std::unordered_set<DexMethod*>& methods);
-
-  void staticize_methods_not_using_this(
-      const std::vector<DexClass*>& scope,
-      const std::unordered_set<DexMethod*>& methods);
+  // Rewrites the calls to all the methods in a single walk over the code,
+  // then makes the methods static, keeping `this` as an argument of those
+  // that use it.
+  void staticize_methods(const std::vector<DexClass*>& scope,
+                         const std::unordered_set<DexMethod*>& using_this,
+                         const std::unordered_set<DexMethod*>& not_using_this);
 
   void verify_and_split(const std::vector<DexMethod*>& candidates,
                         std::unordered_set<DexMethod*>& using_this,
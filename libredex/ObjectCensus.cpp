@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ObjectCensus.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace census {
+
+namespace {
+
+struct Registry {
+  std::mutex lock;
+  std::vector<std::unique_ptr<detail::ThreadCounts>> threads;
+};
+
+// Never destroyed, as objects may still die during static destruction.
+Registry& registry() {
+  static auto s_registry = new Registry();
+  return *s_registry;
+}
+
+} // namespace
+
+const char* kind_name(Kind kind) {
+  switch (kind) {
+  case IR_INSTRUCTION:
+    return "ir_instructions";
+  case METHOD_ITEM_ENTRY:
+    return "method_item_entries";
+  case DEX_POSITION:
+    return "positions";
+  case DEX_DEBUG_INSTRUCTION:
+    return "debug_instructions";
+  case DEX_STRING:
+    return "strings";
+  case DEX_TYPE:
+    return "types";
+  case DEX_PROTO:
+    return "protos";
+  case CFG_BLOCK:
+    return "cfg_blocks";
+  case CFG_EDGE:
+    return "cfg_edges";
+  case KIND_COUNT:
+    break;
+  }
+  return "unknown";
+}
+
+Counts sample() {
+  Counts counts{};
+  auto& reg = registry();
+  std::lock_guard<std::mutex> guard(reg.lock);
+  for (const auto& thread : reg.threads) {
+    for (size_t i = 0; i < KIND_COUNT; ++i) {
+      counts[i] += (*thread)[i].load(std::memory_order_relaxed);
+    }
+  }
+  return counts;
+}
+
+namespace detail {
+
+ThreadCounts* make_thread_counts() {
+  auto counts = std::make_unique<ThreadCounts>();
+  for (auto& counter : *counts) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+  auto ret = counts.get();
+  auto& reg = registry();
+  std::lock_guard<std::mutex> guard(reg.lock);
+  reg.threads.push_back(std::move(counts));
+  return ret;
+}
+
+} // namespace detail
+
+} // namespace census
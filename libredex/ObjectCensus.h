@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Counts of the live IR and RedexContext objects, to tell how much of what a
+ * pass leaves behind is IR. A class takes part by deriving from
+ * census::Counted<kind>, whose constructors and destructor adjust a counter
+ * of the current thread, so counting never contends.
+ *
+ * Objects often die on another thread than the one that made them, which
+ * takes that thread's counter below zero: only the sum over all threads,
+ * which sample() takes, means anything.
+ */
+namespace census {
+
+enum Kind : size_t {
+  IR_INSTRUCTION,
+  METHOD_ITEM_ENTRY,
+  DEX_POSITION,
+  DEX_DEBUG_INSTRUCTION,
+  DEX_STRING,
+  DEX_TYPE,
+  DEX_PROTO,
+  CFG_BLOCK,
+  CFG_EDGE,
+  KIND_COUNT,
+};
+
+// As it appears in the pass stats.
+const char* kind_name(Kind kind);
+
+using Counts = std::array<int64_t, KIND_COUNT>;
+
+// The live objects of each kind.
+Counts sample();
+
+namespace detail {
+
+using ThreadCounts = std::array<std::atomic<int64_t>, KIND_COUNT>;
+
+// Kept alive after the thread exits, for sample() to still count.
+ThreadCounts* make_thread_counts();
+
+inline void add(Kind kind, int64_t delta) {
+  static thread_local ThreadCounts* s_counts = make_thread_counts();
+  // Only this thread writes its counters, so there is no need for a
+  // read-modify-write; they are atomic for sample() to read them.
+  auto& counter = (*s_counts)[kind];
+  counter.store(counter.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+}
+
+} // namespace detail
+
+template <Kind kKind>
+class Counted {
+ protected:
+  Counted() { detail::add(kKind, 1); }
+  Counted(const Counted&) : Counted() {}
+  Counted& operator=(const Counted&) { return *this; }
+  ~Counted() { detail::add(kKind, -1); }
+};
+
+} // namespace census
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "PageAccounting.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "Debug.h"
+
+PageAccounter::PageAccounter(uint32_t page_size) : m_page_size(page_size) {
+  always_assert(page_size != 0);
+}
+
+void PageAccounter::add_section(const std::string& name,
+                                uint32_t offset,
+                                uint32_t size) {
+  if (size == 0) {
+    return;
+  }
+  Section section;
+  section.name = name;
+  section.offset = offset;
+  section.size = size;
+  section.first_page = offset / m_page_size;
+  auto last_page = (offset + size - 1) / m_page_size;
+  section.touched.resize(last_page - section.first_page + 1);
+
+  auto it = std::upper_bound(
+      m_sections.begin(), m_sections.end(), offset,
+      [](uint32_t off, const Section& s) { return off < s.offset; });
+  always_assert_log(it == m_sections.end() || offset + size <= it->offset,
+                    "Section %s overlaps %s", name.c_str(), it->name.c_str());
+  always_assert_log(
+      it == m_sections.begin() ||
+          std::prev(it)->offset + std::prev(it)->size <= offset,
+      "Section %s overlaps %s", name.c_str(), std::prev(it)->name.c_str());
+  m_sections.insert(it, std::move(section));
+}
+
+void PageAccounter::touch(uint32_t offset, uint32_t size) {
+  if (size == 0) {
+    return;
+  }
+  auto end = offset + size;
+  // Start at the last section beginning at or before offset, which is the
+  // only one before offset that can reach into the range.
+  auto it = std::upper_bound(
+      m_sections.begin(), m_sections.end(), offset,
+      [](uint32_t off, const Section& s) { return off < s.offset; });
+  if (it != m_sections.begin()) {
+    --it;
+  }
+  for (; it != m_sections.end() && it->offset < end; ++it) {
+    auto begin = std::max(offset, it->offset);
+    auto clipped_end = std::min(end, it->offset + it->size);
+    if (begin >= clipped_end) {
+      continue;
+    }
+    auto first = begin / m_page_size - it->first_page;
+    auto last = (clipped_end - 1) / m_page_size - it->first_page;
+    for (auto page = first; page <= last; ++page) {
+      it->touched[page] = true;
+    }
+  }
+}
+
+std::vector<PageAccounter::SectionPages> PageAccounter::report() const {
+  std::vector<SectionPages> ret;
+  ret.reserve(m_sections.size());
+  for (const auto& section : m_sections) {
+    ret.push_back(SectionPages{
+        section.name, section.offset, section.size,
+        static_cast<uint32_t>(section.touched.size()),
+        static_cast<uint32_t>(std::count(
+            section.touched.begin(), section.touched.end(), true))});
+  }
+  return ret;
+}
+
+void PageAccounter::print(FILE* fd, const std::string& title) const {
+  fprintf(fd, "%s\n", title.c_str());
+  fprintf(fd, "%-28s %8s %8s %8s\n", "Section", "Offset", "Pages", "Touched");
+  uint32_t total_pages = 0;
+  uint32_t total_touched = 0;
+  for (const auto& section : report()) {
+    fprintf(fd, "%-28s %08x %8u %8u\n", section.name.c_str(), section.offset,
+            section.pages, section.touched_pages);
+    total_pages += section.pages;
+    total_touched += section.touched_pages;
+  }
+  fprintf(fd, "%-28s %8s %8u %8u\n", "Total", "", total_pages, total_touched);
+}
+
+const char* dex_section_name(uint16_t type) {
+  switch (type) {
+  case TYPE_HEADER_ITEM:
+    return "header_item";
+  case TYPE_STRING_ID_ITEM:
+    return "string_id_item";
+  case TYPE_TYPE_ID_ITEM:
+    return "type_id_item";
+  case TYPE_PROTO_ID_ITEM:
+    return "proto_id_item";
+  case TYPE_FIELD_ID_ITEM:
+    return "field_id_item";
+  case TYPE_METHOD_ID_ITEM:
+    return "method_id_item";
+  case TYPE_CLASS_DEF_ITEM:
+    return "class_def_item";
+  case TYPE_MAP_LIST:
+    return "map_list";
+  case TYPE_TYPE_LIST:
+    return "type_list";
+  case TYPE_ANNOTATION_SET_REF_LIST:
+    return "annotation_set_ref_list";
+  case TYPE_ANNOTATION_SET_ITEM:
+    return "annotation_set_item";
+  case TYPE_CLASS_DATA_ITEM:
+    return "class_data_item";
+  case TYPE_CODE_ITEM:
+    return "code_item";
+  case TYPE_STRING_DATA_ITEM:
+    return "string_data_item";
+  case TYPE_DEBUG_INFO_ITEM:
+    return "debug_info_item";
+  case TYPE_ANNOTATION_ITEM:
+    return "annotation_item";
+  case TYPE_ENCODED_ARRAY_ITEM:
+    return "encoded_array_item";
+  case TYPE_ANNOTATIONS_DIR_ITEM:
+    return "annotations_directory_item";
+  default:
+    return "unknown";
+  }
+}
+
+void add_dex_sections(PageAccounter& accounter,
+                      const dex_map_item* maps,
+                      uint32_t count,
+                      uint32_t file_size) {
+  std::vector<const dex_map_item*> sorted;
+  sorted.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    sorted.push_back(&maps[i]);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const dex_map_item* a, const dex_map_item* b) {
+              return a->offset < b->offset;
+            });
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    auto begin = sorted[i]->offset;
+    auto end = i + 1 < sorted.size() ? sorted[i + 1]->offset : file_size;
+    always_assert(begin <= end);
+    accounter.add_section(dex_section_name(sorted[i]->type), begin,
+                          end - begin);
+  }
+}
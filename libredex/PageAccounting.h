@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "DexDefs.h"
+
+/*
+ * Counts how many pages of each section of a file get touched by an access
+ * trace, e.g. how many pages of a dex's code items the coldstart classes pull
+ * in. Comparing the counts before and after a layout change (interdex order,
+ * code item order, ...) measures its effect on startup page faults directly.
+ *
+ * Sections are named byte ranges of the file and may be added in any order,
+ * but must not overlap. Touches outside every section are ignored.
+ */
+class PageAccounter {
+ public:
+  static constexpr uint32_t kDefaultPageSize = 4096;
+
+  struct SectionPages {
+    std::string name;
+    uint32_t offset;
+    uint32_t size;
+    // Pages the section spans, and how many of those got touched. A page
+    // shared by two sections is counted in both.
+    uint32_t pages;
+    uint32_t touched_pages;
+  };
+
+  explicit PageAccounter(uint32_t page_size = kDefaultPageSize);
+
+  void add_section(const std::string& name, uint32_t offset, uint32_t size);
+
+  // Records a read of [offset, offset + size).
+  void touch(uint32_t offset, uint32_t size);
+
+  // The sections in file order.
+  std::vector<SectionPages> report() const;
+
+  // A table of report(), with totals, headed by title.
+  void print(FILE* fd, const std::string& title) const;
+
+ private:
+  struct Section {
+    std::string name;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t first_page;
+    std::vector<bool> touched;
+  };
+
+  uint32_t m_page_size;
+  // Sorted by offset.
+  std::vector<Section> m_sections;
+};
+
+/*
+ * Adds one section per map item of a dex of file_size bytes, named after the
+ * item type. Map items only carry item counts, so each section is taken to
+ * extend to the start of the next.
+ */
+void add_dex_sections(PageAccounter& accounter,
+                      const dex_map_item* maps,
+                      uint32_t count,
+                      uint32_t file_size);
+
+const char* dex_section_name(uint16_t type);
@@ -0,0 +1,398 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "AbstractDomain.h"
+#include "Debug.h"
+#include "FixpointIterators.h"
+#include "WeakTopologicalOrdering.h"
+#include "WorkQueue.h"
+
+/*
+ * The direction in which the abstract states flow between the strongly
+ * connected components of the graph.
+ *
+ *  - TopDown: the entry state of a node is computed from the exit states of
+ *    its predecessors, and the initial value is supplied at the root. For a
+ *    call graph, callers are analyzed before their callees (e.g., propagation
+ *    of constant arguments).
+ *
+ *  - BottomUp: the entry state of a node is computed from the exit states of
+ *    its successors, and the initial value is supplied at the nodes that have
+ *    no successors. For a call graph, callees are analyzed before their
+ *    callers (e.g., computation of method summaries).
+ *
+ * In both cases, only the nodes reachable from the root are analyzed.
+ */
+enum class SccOrder { TopDown, BottomUp };
+
+/*
+ * A fixpoint iterator with the same interface as MonotonicFixpointIterator,
+ * meant for graphs that are large and mostly acyclic, such as call graphs.
+ *
+ * The graph is first condensed into its strongly connected components. An SCC
+ * is analyzed as soon as all the SCCs it depends on have been analyzed, so
+ * that independent SCCs are processed in parallel on a work-stealing queue.
+ * Within an SCC, the nodes are analyzed sequentially using Bourdoncle's
+ * recursive iteration strategy over the weak topological ordering of the SCC.
+ * Hence analyze_node() and analyze_edge() may be called concurrently on
+ * different nodes and must be thread safe.
+ *
+ * Running the iterator is not reentrant, but the states may be queried from
+ * any thread once run() has returned.
+ */
+template <typename GraphInterface,
+          typename Domain,
+          typename NodeHash = std::hash<typename GraphInterface::NodeId>>
+class ParallelMonotonicFixpointIterator {
+ public:
+  using Graph = typename GraphInterface::Graph;
+  using NodeId = typename GraphInterface::NodeId;
+  using EdgeId = typename GraphInterface::EdgeId;
+  using Context = MonotonicFixpointIteratorContext<NodeId, Domain, NodeHash>;
+
+  virtual ~ParallelMonotonicFixpointIterator() {
+    static_assert(std::is_base_of<AbstractDomain<Domain>, Domain>::value,
+                  "Domain does not inherit from AbstractDomain");
+    static_assert(
+        std::is_base_of<FixpointIteratorGraphSpec<GraphInterface>,
+                        GraphInterface>::value,
+        "GraphInterface does not inherit from FixpointIteratorGraphSpec");
+  }
+
+  ParallelMonotonicFixpointIterator(
+      const Graph& graph,
+      SccOrder order = SccOrder::TopDown,
+      size_t num_threads = default_workqueue_threads())
+      : m_graph(graph), m_order(order), m_num_threads(num_threads) {
+    always_assert(num_threads >= 1);
+    condense();
+  }
+
+  /*
+   * See MonotonicFixpointIterator::analyze_node().
+   */
+  virtual void analyze_node(const NodeId& node,
+                            Domain* current_state) const = 0;
+
+  /*
+   * See MonotonicFixpointIterator::analyze_edge(). In the bottom-up order,
+   * `exit_state_at_source` is the exit state at the target of the edge.
+   */
+  virtual Domain analyze_edge(const EdgeId& edge,
+                              const Domain& exit_state_at_source) const = 0;
+
+  /*
+   * See MonotonicFixpointIterator::extrapolate(). The context is local to the
+   * SCC being analyzed.
+   */
+  virtual void extrapolate(const Context& context,
+                           const NodeId& node,
+                           Domain* current_state,
+                           const Domain& new_state) const {
+    if (context.get_local_iterations_for(node) == 0) {
+      current_state->join_with(new_state);
+    } else {
+      current_state->widen_with(new_state);
+    }
+  }
+
+  void run(const Domain& init) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    size_t num_sccs = m_scc_members.size();
+    m_entry_states.assign(m_nodes.size(), Domain::bottom());
+    m_exit_states.assign(m_nodes.size(), Domain::bottom());
+    m_analyzed.assign(m_nodes.size(), 0);
+    std::unique_ptr<std::atomic<uint32_t>[]> pending(
+        new std::atomic<uint32_t>[num_sccs]);
+    for (size_t scc = 0; scc < num_sccs; ++scc) {
+      pending[scc].store(m_scc_num_dependencies[scc]);
+    }
+
+    WorkQueue<uint32_t, std::nullptr_t, std::nullptr_t>* queue_ptr = nullptr;
+    auto queue = workqueue_foreach<uint32_t>(
+        [&](uint32_t scc) {
+          analyze_scc(init, scc);
+          for (uint32_t dependent : m_scc_dependents[scc]) {
+            // The release semantics of the decrement publish the states of
+            // this SCC to whichever thread goes on to analyze the dependent.
+            if (pending[dependent].fetch_sub(1, std::memory_order_acq_rel) ==
+                1) {
+              queue_ptr->add_item(dependent);
+            }
+          }
+        },
+        m_num_threads);
+    queue_ptr = &queue;
+    for (uint32_t scc = 0; scc < num_sccs; ++scc) {
+      if (m_scc_num_dependencies[scc] == 0) {
+        queue.add_item(scc);
+      }
+    }
+    queue.run_all();
+  }
+
+  Domain get_entry_state_at(const NodeId& node) const {
+    auto it = m_index.find(node);
+    if (it == m_index.end() || !m_analyzed[it->second]) {
+      return Domain::bottom();
+    }
+    return m_entry_states[it->second];
+  }
+
+  Domain get_exit_state_at(const NodeId& node) const {
+    auto it = m_index.find(node);
+    if (it == m_index.end() || !m_analyzed[it->second]) {
+      return Domain::bottom();
+    }
+    return m_exit_states[it->second];
+  }
+
+  size_t num_sccs() const { return m_scc_members.size(); }
+
+ private:
+  /*
+   * The nodes whose exit states flow into the given node, and the nodes that
+   * the exit state of the given node flows into.
+   */
+  std::vector<EdgeId> incoming_edges(const NodeId& node) const {
+    return m_order == SccOrder::TopDown
+               ? GraphInterface::predecessors(m_graph, node)
+               : GraphInterface::successors(m_graph, node);
+  }
+
+  std::vector<EdgeId> outgoing_edges(const NodeId& node) const {
+    return m_order == SccOrder::TopDown
+               ? GraphInterface::successors(m_graph, node)
+               : GraphInterface::predecessors(m_graph, node);
+  }
+
+  NodeId incoming_node(const EdgeId& edge) const {
+    return m_order == SccOrder::TopDown ? GraphInterface::source(m_graph, edge)
+                                        : GraphInterface::target(m_graph, edge);
+  }
+
+  NodeId outgoing_node(const EdgeId& edge) const {
+    return m_order == SccOrder::TopDown ? GraphInterface::target(m_graph, edge)
+                                        : GraphInterface::source(m_graph, edge);
+  }
+
+  /*
+   * Numbers the nodes reachable from the root and computes their SCCs using
+   * an iterative version of Tarjan's algorithm (call graphs can be too deep
+   * for a recursive one), followed by the dependencies between the SCCs.
+   */
+  void condense() {
+    struct Frame {
+      uint32_t node;
+      std::vector<EdgeId> succs;
+      size_t next_succ;
+    };
+    std::vector<uint32_t> lowlink;
+    std::vector<uint32_t> dfn;
+    std::vector<char> on_stack;
+    std::vector<uint32_t> stack;
+    std::vector<Frame> call_stack;
+
+    auto visit = [&](const NodeId& node) {
+      uint32_t idx = m_nodes.size();
+      m_index.emplace(node, idx);
+      m_nodes.push_back(node);
+      dfn.push_back(idx);
+      lowlink.push_back(idx);
+      on_stack.push_back(1);
+      stack.push_back(idx);
+      call_stack.push_back(
+          Frame{idx, GraphInterface::successors(m_graph, node), 0});
+    };
+
+    visit(GraphInterface::entry(m_graph));
+    while (!call_stack.empty()) {
+      auto& frame = call_stack.back();
+      if (frame.next_succ < frame.succs.size()) {
+        NodeId succ =
+            GraphInterface::target(m_graph, frame.succs[frame.next_succ++]);
+        auto it = m_index.find(succ);
+        if (it == m_index.end()) {
+          // `frame` is invalidated by the push.
+          visit(succ);
+        } else if (on_stack[it->second]) {
+          lowlink[frame.node] = std::min(lowlink[frame.node], dfn[it->second]);
+        }
+        continue;
+      }
+      uint32_t node = frame.node;
+      call_stack.pop_back();
+      if (!call_stack.empty()) {
+        auto& parent = call_stack.back().node;
+        lowlink[parent] = std::min(lowlink[parent], lowlink[node]);
+      }
+      if (lowlink[node] == dfn[node]) {
+        uint32_t scc = m_scc_members.size();
+        m_scc_members.emplace_back();
+        uint32_t member;
+        do {
+          member = stack.back();
+          stack.pop_back();
+          on_stack[member] = 0;
+          m_scc_members[scc].push_back(member);
+        } while (member != node);
+      }
+    }
+
+    m_scc_of.resize(m_nodes.size());
+    for (uint32_t scc = 0; scc < m_scc_members.size(); ++scc) {
+      for (uint32_t member : m_scc_members[scc]) {
+        m_scc_of[member] = scc;
+      }
+    }
+    m_scc_dependents.resize(m_scc_members.size());
+    m_scc_num_dependencies.assign(m_scc_members.size(), 0);
+    for (uint32_t scc = 0; scc < m_scc_members.size(); ++scc) {
+      auto& dependents = m_scc_dependents[scc];
+      for (uint32_t member : m_scc_members[scc]) {
+        for (const EdgeId& edge : outgoing_edges(m_nodes[member])) {
+          auto it = m_index.find(outgoing_node(edge));
+          // In the bottom-up order, the callers of a node may be unreachable.
+          if (it != m_index.end() && m_scc_of[it->second] != scc) {
+            dependents.push_back(m_scc_of[it->second]);
+          }
+        }
+      }
+      std::sort(dependents.begin(), dependents.end());
+      dependents.erase(std::unique(dependents.begin(), dependents.end()),
+                       dependents.end());
+      for (uint32_t dependent : dependents) {
+        ++m_scc_num_dependencies[dependent];
+      }
+    }
+  }
+
+  bool is_initial_node(const NodeId& node) const {
+    return m_order == SccOrder::TopDown
+               ? node == GraphInterface::entry(m_graph)
+               : GraphInterface::successors(m_graph, node).empty();
+  }
+
+  void compute_entry_state(const Domain& init,
+                           uint32_t idx,
+                           Domain* placeholder) const {
+    const NodeId& node = m_nodes[idx];
+    placeholder->set_to_bottom();
+    if (is_initial_node(node)) {
+      placeholder->join_with(init);
+    }
+    for (const EdgeId& edge : incoming_edges(node)) {
+      auto it = m_index.find(incoming_node(edge));
+      // Nodes that haven't been analyzed yet are at _|_, as are unreachable
+      // ones (see MonotonicFixpointIterator::get_exit_state_at()).
+      if (it != m_index.end() && m_analyzed[it->second]) {
+        placeholder->join_with(analyze_edge(edge, m_exit_states[it->second]));
+      }
+    }
+  }
+
+  void analyze_vertex(const Domain& init, uint32_t idx) {
+    Domain& entry_state = m_entry_states[idx];
+    compute_entry_state(init, idx, &entry_state);
+    Domain& exit_state = m_exit_states[idx];
+    exit_state = entry_state;
+    analyze_node(m_nodes[idx], &exit_state);
+    m_analyzed[idx] = 1;
+  }
+
+  void analyze_scc(const Domain& init, uint32_t scc) {
+    const auto& members = m_scc_members[scc];
+    if (members.size() == 1 && !has_self_loop(members[0])) {
+      analyze_vertex(init, members[0]);
+      return;
+    }
+    WeakTopologicalOrdering<NodeId, NodeHash> wto(
+        m_nodes[members[0]], [this, scc](const NodeId& node) {
+          std::vector<NodeId> succs;
+          for (const EdgeId& edge : outgoing_edges(node)) {
+            NodeId succ = outgoing_node(edge);
+            auto it = m_index.find(succ);
+            if (it != m_index.end() && m_scc_of[it->second] == scc) {
+              succs.push_back(succ);
+            }
+          }
+          return succs;
+        });
+    Context context(init);
+    for (const WtoComponent<NodeId>& component : wto) {
+      analyze_component(&context, component);
+    }
+  }
+
+  bool has_self_loop(uint32_t idx) const {
+    for (const EdgeId& edge : outgoing_edges(m_nodes[idx])) {
+      if (outgoing_node(edge) == m_nodes[idx]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void analyze_component(Context* context,
+                         const WtoComponent<NodeId>& component) {
+    uint32_t idx = m_index.at(component.head_node());
+    if (component.is_vertex()) {
+      analyze_vertex(context->get_initial_value(), idx);
+      return;
+    }
+    // This is the same as MonotonicFixpointIterator::analyze_scc().
+    bool iterate = true;
+    for (context->reset_local_iteration_count_for(component.head_node());
+         iterate;
+         context->increase_iteration_count_for(component.head_node())) {
+      analyze_vertex(context->get_initial_value(), idx);
+      for (const auto& subcomponent : component) {
+        analyze_component(context, subcomponent);
+      }
+      Domain* current_state = &m_entry_states[idx];
+      Domain new_state;
+      compute_entry_state(context->get_initial_value(), idx, &new_state);
+      if (new_state.leq(*current_state)) {
+        *current_state = std::move(new_state);
+        iterate = false;
+      } else {
+        extrapolate(*context, component.head_node(), current_state, new_state);
+      }
+    }
+  }
+
+  std::mutex m_lock;
+  const Graph& m_graph;
+  const SccOrder m_order;
+  const size_t m_num_threads;
+  // The reachable nodes, numbered in DFS order, and their SCCs. An SCC
+  // depends on another one if a state flows from the latter into the former.
+  std::unordered_map<NodeId, uint32_t, NodeHash> m_index;
+  std::vector<NodeId> m_nodes;
+  std::vector<uint32_t> m_scc_of;
+  std::vector<std::vector<uint32_t>> m_scc_members;
+  std::vector<std::vector<uint32_t>> m_scc_dependents;
+  std::vector<uint32_t> m_scc_num_dependencies;
+  // Each slot is only written by the thread that analyzes the SCC of the
+  // node. We don't use a vector<bool> for m_analyzed, since its elements
+  // aren't distinct memory locations.
+  std::vector<Domain> m_entry_states;
+  std::vector<Domain> m_exit_states;
+  std::vector<char> m_analyzed;
+};
@@ -15,9 +15,11 @@
 #include <iostream>
 #include <algorithm>
 
+#include "AnalysisManager.h"
 #include "DexStore.h"
 #include "ConfigFiles.h"
 #include "PassRegistry.h"
+#include "TimeBudget.h"
 
 class PassManager;
 
@@ -138,6 +140,23 @@ class PassConfig {
     param = m_config.get(name, dflt);
   }
 
+  /*
+   * The budget set by "time_budget_ms" and "method_time_budget_ms". Passes
+   * that don't look it up ignore them.
+   */
+  TimeBudget get_time_budget() const {
+    int64_t pass_ms;
+    int64_t method_ms;
+    get("time_budget_ms", 0, pass_ms);
+    get("method_time_budget_ms", 0, method_ms);
+    always_assert_log(pass_ms >= 0 && method_ms >= 0,
+                      "Time budgets can't be negative");
+    TimeBudget budget;
+    budget.pass_ms = static_cast<uint64_t>(pass_ms);
+    budget.method_ms = static_cast<uint64_t>(method_ms);
+    return budget;
+  }
+
  private:
   Json::Value m_config;
 };
@@ -166,6 +185,43 @@ class Pass {
   virtual void eval_pass(DexStoresVector& stores, ConfigFiles& cfg, PassManager& mgr) {};
   virtual void run_pass(DexStoresVector& stores, ConfigFiles& cfg, PassManager& mgr) = 0;
 
+  /**
+   * Declare the analyses (see Analyses.h) whose results are still valid after
+   * run_pass. All the others are invalidated. By default nothing is preserved.
+   */
+  virtual void preserved_analyses(PreservedAnalyses&) const {}
+
+  /**
+   * Declare that run_pass rewrites the code of each method on its own, looking
+   * at nothing else that another method's rewrite could change, and adds,
+   * removes or changes nothing but method code. Its results must then go
+   * through the PassManager's metrics, since the PassManager may run it in
+   * worker processes that each see only a share of the classes (see
+   * "sharded_passes").
+   */
+  virtual bool is_method_local() const { return false; }
+
+  /*
+   * Declare that run_pass works on the code through editable CFGs (see
+   * IRCode::build_cfg) and copes with finding them already built. The
+   * editable CFGs it leaves behind are then kept for the next pass that
+   * declares this too, instead of being linearized back into the
+   * instruction lists and rebuilt. The PassManager linearizes them before
+   * any other pass runs.
+   */
+  virtual bool is_editable_cfg_friendly() const { return false; }
+
+  /*
+   * Declare that run_pass only reads and changes the classes of the stores
+   * it is given, and works just as well when given a single store, which
+   * then comes first even if it isn't the root store. The PassManager may
+   * then run it on each store separately, on several stores at once (see
+   * "parallel_store_passes"). Its results must go through the PassManager's
+   * metrics, and it must not use the PassManager's analyses. A pass that is
+   * method-local is store-local too.
+   */
+  virtual bool is_store_local() const { return is_method_local(); }
+
  private:
   std::string m_name;
 };
@@ -10,13 +10,25 @@
 #include "PassManager.h"
 
 #include <cstdio>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
 #if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
 #include <signal.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #endif
 #include <unordered_set>
 
+#include <boost/functional/hash.hpp>
+
+#include "ConcurrentContainers.h"
 #include "ConfigFiles.h"
 #include "Debug.h"
 #include "DexClass.h"
@@ -26,14 +38,19 @@
 #include "InstructionLowering.h"
 #include "InterDex.h"
 #include "IRCode.h"
+#include "IRSerialization.h"
 #include "IRTypeChecker.h"
 #include "PrintSeeds.h"
 #include "ProguardMatcher.h"
 #include "ProguardPrintConfiguration.h"
 #include "ProguardReporting.h"
 #include "ReachableClasses.h"
+#include "Resolver.h"
+#include "SlowestMethods.h"
+#include "ThreadPool.h"
 #include "Timer.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 redex::ProguardConfiguration empty_pg_config() {
   redex::ProguardConfiguration pg_config;
@@ -82,12 +99,80 @@ void PassManager::init(const Json::Value& config) {
   }
 }
 
+namespace {
+
+/*
+ * A fingerprint of everything IRTypeChecker reads: the method's signature and
+ * access flags, and its code, including the types of the fields and methods
+ * it refers to. The epoch of IRCode isn't enough to tell whether a method
+ * needs to be checked again, since passes commonly edit instructions in place
+ * (e.g. renaming their registers) without bumping it.
+ */
+uint64_t type_checker_fingerprint(DexMethod* dex_method) {
+  const IRCode* code = dex_method->get_code();
+  size_t hash = 0;
+  boost::hash_combine(hash, dex_method->get_access());
+  boost::hash_combine(hash, dex_method->get_proto());
+  boost::hash_combine(hash, code->get_registers_size());
+  // Within a run, entries are identified by their address.
+  for (const auto& mie : *code) {
+    boost::hash_combine(hash, mie.type);
+    switch (mie.type) {
+    case MFLOW_OPCODE: {
+      IRInstruction* insn = mie.insn;
+      boost::hash_combine(hash, &mie);
+      boost::hash_combine(hash, insn->hash());
+      if (insn->has_field()) {
+        boost::hash_combine(hash, insn->get_field()->get_type());
+      }
+      if (insn->has_method()) {
+        boost::hash_combine(hash, insn->get_method()->get_proto());
+      }
+      break;
+    }
+    case MFLOW_TARGET:
+      boost::hash_combine(hash, mie.target->type);
+      boost::hash_combine(hash, mie.target->index);
+      boost::hash_combine(hash, mie.target->src);
+      break;
+    case MFLOW_TRY:
+      boost::hash_combine(hash, mie.tentry->type);
+      boost::hash_combine(hash, mie.tentry->catch_start);
+      break;
+    case MFLOW_CATCH:
+      boost::hash_combine(hash, &mie);
+      boost::hash_combine(hash, mie.centry->catch_type);
+      boost::hash_combine(hash, mie.centry->next);
+      break;
+    case MFLOW_DEX_OPCODE:
+    case MFLOW_DEBUG:
+    case MFLOW_POSITION:
+    case MFLOW_FALLTHROUGH:
+      break;
+    }
+  }
+  return hash;
+}
+
+} // namespace
+
 void PassManager::run_type_checker(const Scope& scope,
                                    bool polymorphic_constants,
                                    bool verify_moves) {
   TRACE(PM, 1, "Running IRTypeChecker...\n");
   Timer t("IRTypeChecker");
-  walk::parallel::methods(scope, [=](DexMethod* dex_method) {
+  std::atomic<size_t> skipped{0};
+  walk::parallel::methods(scope, [&](DexMethod* dex_method) {
+    if (dex_method->get_code() == nullptr) {
+      return;
+    }
+    // Methods that haven't changed since they last passed don't need to be
+    // checked again.
+    auto fingerprint = type_checker_fingerprint(dex_method);
+    if (m_type_checked_methods.get(dex_method, 0) == fingerprint) {
+      ++skipped;
+      return;
+    }
     IRTypeChecker checker(dex_method);
     if (polymorphic_constants) {
       checker.enable_polymorphic_constants();
@@ -103,10 +188,16 @@ void PassManager::run_type_checker(const Scope& scope,
       fprintf(stderr, "Code:\n%s\n", SHOW(dex_method->get_code()));
       exit(EXIT_FAILURE);
     }
+    m_type_checked_methods.update(
+        dex_method, [fingerprint](const DexMethod*, uint64_t& value, bool) {
+          value = fingerprint;
+        });
   });
+  TRACE(PM, 1, "Skipped %lu unchanged methods\n", skipped.load());
 }
 
 const std::string PASS_ORDER_KEY = "pass_order";
+const std::string METHODS_CHANGED_KEY = "methods_changed";
 
 /*
  * Appends the PID of the current process to :cmd and invokes it.
@@ -144,20 +235,875 @@ pid_t kill_and_wait(pid_t pid, int sig) {
 #endif
 }
 
+/*
+ * Defined by util/MallocDebug.cpp when redex is linked against it, to report
+ * how many allocations have been made so far.
+ */
+#ifdef __GNUC__
+extern "C" size_t redex_malloc_count() __attribute__((weak));
+#else
+static size_t (*redex_malloc_count)() = nullptr;
+#endif
+
+/*
+ * Defined by util/MallocProfiler.cpp when redex is linked against it, to
+ * attribute the allocations it samples to the pass that is running.
+ */
+#ifdef __GNUC__
+extern "C" void redex_malloc_profile_phase(const char* name)
+    __attribute__((weak));
+#else
+static void (*redex_malloc_profile_phase)(const char*) = nullptr;
+#endif
+
+namespace {
+
+// A null name means that no pass is running.
+void set_malloc_profile_phase(const char* name) {
+  if (redex_malloc_profile_phase != nullptr) {
+    redex_malloc_profile_phase(name);
+  }
+}
+
+#ifdef __linux__
+// Reads a "<key>: <n> kB" line from /proc/self/status.
+int64_t read_proc_status_kb(const char* key) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  auto key_len = strlen(key);
+  while (std::getline(status, line)) {
+    if (line.compare(0, key_len, key) == 0 && line[key_len] == ':') {
+      return std::stoll(line.substr(key_len + 1));
+    }
+  }
+  return 0;
+}
+#endif
+
+struct ResourceSnapshot {
+  std::chrono::steady_clock::time_point wall;
+  double cpu_secs{0};
+  int64_t rss_kb{0};
+  int64_t allocations{-1};
+
+  static ResourceSnapshot take() {
+    ResourceSnapshot snapshot;
+    snapshot.wall = std::chrono::steady_clock::now();
+#ifdef _POSIX_VERSION
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    snapshot.cpu_secs = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+#ifdef __linux__
+    snapshot.rss_kb = read_proc_status_kb("VmRSS");
+#endif
+    if (redex_malloc_count != nullptr) {
+      snapshot.allocations = redex_malloc_count();
+    }
+    return snapshot;
+  }
+};
+
+// Resets the process's peak RSS to its current RSS, so the peak measured
+// afterwards belongs to the pass that is about to run. Linux only; elsewhere
+// the peak is the process-wide high-water mark.
+void reset_peak_rss() {
+#ifdef __linux__
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+#endif
+}
+
+int64_t peak_rss_kb() {
+#ifdef __linux__
+  return read_proc_status_kb("VmHWM");
+#elif defined(_POSIX_VERSION)
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // ru_maxrss is in bytes on macOS.
+  return usage.ru_maxrss / 1024;
+#else
+  return 0;
+#endif
+}
+
+/*
+ * The epochs of the code of every method in the program, used to tell which
+ * methods a pass changed. Methods whose code hasn't been ballooned yet are
+ * left out rather than forcing them to balloon.
+ */
+using CodeEpochs = ConcurrentMap<const DexMethod*, size_t>;
+// No IRCode has epoch 0.
+constexpr size_t kNoCode = 0;
+
+void record_code_epochs(const Scope& scope, CodeEpochs& epochs) {
+  walk::parallel::methods(scope, [&](DexMethod* method) {
+    if (method->is_balloon_pending()) {
+      return;
+    }
+    auto code = method->get_code();
+    epochs.insert({method, code ? code->epoch() : kNoCode});
+  });
+}
+
+// Methods added, removed, or whose code was changed or replaced.
+size_t count_methods_changed(CodeEpochs& before, const Scope& scope) {
+  std::atomic<size_t> changed{0};
+  std::atomic<size_t> still_present{0};
+  constexpr size_t kMissing = std::numeric_limits<size_t>::max();
+  walk::parallel::methods(scope, [&](DexMethod* method) {
+    if (method->is_balloon_pending()) {
+      return;
+    }
+    auto code = method->get_code();
+    size_t epoch = code ? code->epoch() : kNoCode;
+    size_t old_epoch = before.get(method, kMissing);
+    if (old_epoch != kMissing) {
+      ++still_present;
+    }
+    if (old_epoch != epoch) {
+      ++changed;
+    }
+  });
+  return changed + (before.size() - still_present);
+}
+
+/*
+ * Records how the work queues of a pass spread their work, as metrics.
+ * Metrics are ints, so times are in milliseconds and counts saturate.
+ */
+void set_workqueue_metrics(const WorkQueueStats& stats,
+                           std::unordered_map<std::string, int>& metrics) {
+  if (stats.runs == 0) {
+    return;
+  }
+  auto set = [&metrics](const char* key, int64_t value) {
+    metrics[key] = static_cast<int>(
+        std::min<int64_t>(value, std::numeric_limits<int>::max()));
+  };
+  set("workqueue_runs", stats.runs);
+  set("workqueue_tasks", stats.tasks);
+  set("workqueue_busiest_worker_tasks", stats.busiest_worker_tasks);
+  set("workqueue_steal_attempts", stats.steal_attempts);
+  set("workqueue_steals", stats.steals);
+  set("workqueue_busy_ms", stats.busy_us / 1000);
+  set("workqueue_idle_ms", stats.idle_us / 1000);
+  set("workqueue_tail_ms", stats.tail_us / 1000);
+}
+
+} // namespace
+
+void PassManager::write_pass_stats(const std::string& path) const {
+  Json::Value all(Json::arrayValue);
+  for (const auto& pass_info : m_pass_info) {
+    const auto& usage = pass_info.usage;
+    Json::Value pass;
+    pass["name"] = pass_info.name;
+    pass["wall_secs"] = usage.wall_secs;
+    pass["cpu_secs"] = usage.cpu_secs;
+    pass["rss_delta_kb"] = Json::Int64(usage.rss_delta_kb);
+    pass["peak_rss_kb"] = Json::Int64(usage.peak_rss_kb);
+    if (usage.allocations >= 0) {
+      pass["allocations"] = Json::Int64(usage.allocations);
+    }
+    pass["methods_touched"] = Json::UInt64(usage.methods_touched);
+    Json::Value live(Json::objectValue);
+    for (size_t k = 0; k < census::KIND_COUNT; ++k) {
+      live[census::kind_name(static_cast<census::Kind>(k))] =
+          Json::Int64(usage.live_objects[k]);
+    }
+    pass["live_objects"] = live;
+    Json::Value slowest(Json::arrayValue);
+    for (const auto& method_and_secs : pass_info.slowest_methods) {
+      Json::Value method;
+      method["method"] = method_and_secs.first;
+      method["secs"] = method_and_secs.second;
+      slowest.append(method);
+    }
+    pass["slowest_methods"] = slowest;
+    all.append(pass);
+  }
+  std::ofstream out(path);
+  Json::StyledStreamWriter writer;
+  writer.write(out, all);
+}
+
+void PassManager::linearize_editable_cfgs(DexStoresVector& stores) {
+  if (!m_editable_cfgs_may_exist) {
+    return;
+  }
+  Timer t("Linearizing editable CFGs");
+  DexStoreClassesIterator it(stores);
+  walk::parallel::code(build_class_scope(it), [](DexMethod*, IRCode& code) {
+    if (code.editable_cfg_built()) {
+      code.clear_cfg();
+    }
+  });
+  m_editable_cfgs_may_exist = false;
+}
+
+thread_local PassManager::PassInfo* PassManager::t_store_pass_info{nullptr};
+
+namespace {
+
+/*
+ * Groups the stores into waves that can run at the same time: a store comes
+ * after the root store and the stores it depends on.
+ */
+std::vector<std::vector<size_t>> store_waves(const DexStoresVector& stores) {
+  std::unordered_map<std::string, size_t> index_of;
+  std::vector<size_t> wave_of(stores.size(), 0);
+  std::vector<std::vector<size_t>> waves;
+  for (size_t s = 0; s < stores.size(); ++s) {
+    if (s > 0) {
+      wave_of[s] = wave_of[0] + 1;
+      for (const auto& dep : stores[s].get_dependencies()) {
+        auto it = index_of.find(dep);
+        if (it != index_of.end()) {
+          wave_of[s] = std::max(wave_of[s], wave_of[it->second] + 1);
+        }
+      }
+    }
+    index_of.emplace(stores[s].get_name(), s);
+    if (wave_of[s] >= waves.size()) {
+      waves.resize(wave_of[s] + 1);
+    }
+    waves[wave_of[s]].push_back(s);
+  }
+  return waves;
+}
+
+} // namespace
+
+void PassManager::run_store_local_passes(size_t begin,
+                                         size_t end,
+                                         DexStoresVector& stores,
+                                         ConfigFiles& cfg) {
+  linearize_editable_cfgs(stores);
+  std::string names;
+  for (size_t i = begin; i < end; ++i) {
+    names += (i > begin ? ", " : "") + m_activated_passes[i]->name();
+  }
+  TRACE(PM, 1, "Running %s over %lu stores...\n", names.c_str(),
+        stores.size());
+  Timer t(names + " (run over stores)");
+
+  // Each store runs all the passes in turn, in a DexStoresVector of its own,
+  // so that it can go on to the next pass while the others are still busy.
+  // The metrics of each store's run of each pass are summed up afterwards.
+  std::vector<std::vector<PassInfo>> store_infos(stores.size());
+  auto run_store = [&](size_t s) {
+    DexStoresVector single;
+    single.push_back(std::move(stores[s]));
+    DexStoreClassesIterator it(single);
+    auto& infos = store_infos[s];
+    infos.reserve(end - begin);
+    bool editable_cfgs_may_exist = false;
+    for (size_t i = begin; i < end; ++i) {
+      Pass* pass = m_activated_passes[i];
+      if (editable_cfgs_may_exist && !pass->is_editable_cfg_friendly()) {
+        walk::parallel::code(build_class_scope(it),
+                             [](DexMethod*, IRCode& code) {
+                               if (code.editable_cfg_built()) {
+                                 code.clear_cfg();
+                               }
+                             });
+        editable_cfgs_may_exist = false;
+      }
+      infos.push_back(m_pass_info[i]);
+      infos.back().metrics.clear();
+      t_store_pass_info = &infos.back();
+      CodeEpochs epochs_before;
+      record_code_epochs(build_class_scope(it), epochs_before);
+      invalidate_resolution_caches();
+      pass->run_pass(single, cfg, *this);
+      editable_cfgs_may_exist |= pass->is_editable_cfg_friendly();
+      infos.back().metrics[METHODS_CHANGED_KEY] =
+          count_methods_changed(epochs_before, build_class_scope(it));
+      t_store_pass_info = nullptr;
+    }
+    stores[s] = std::move(single[0]);
+  };
+  // The stores run the passes concurrently, so their allocations are only
+  // attributed to the group.
+  set_malloc_profile_phase(names.c_str());
+  for (const auto& wave : store_waves(stores)) {
+    auto wq = workqueue_foreach<size_t>(run_store);
+    for (auto s : wave) {
+      wq.add_item(s);
+    }
+    wq.run_all();
+  }
+  set_malloc_profile_phase(nullptr);
+
+  for (size_t i = begin; i < end; ++i) {
+    auto& info = m_pass_info[i];
+    for (const auto& infos : store_infos) {
+      for (const auto& pair : infos[i - begin].metrics) {
+        info.metrics[pair.first] += pair.second;
+      }
+    }
+    info.usage.methods_touched = info.metrics[METHODS_CHANGED_KEY];
+    TRACE(PM, 1, "%s changed %d methods\n", info.name.c_str(),
+          info.metrics[METHODS_CHANGED_KEY]);
+    m_editable_cfgs_may_exist |=
+        m_activated_passes[i]->is_editable_cfg_friendly();
+  }
+  // The passes must not use the analyses, but may have invalidated them.
+  m_analyses.clear();
+}
+
+void PassManager::run_pass(size_t i,
+                           DexStoresVector& stores,
+                           ConfigFiles& cfg,
+                           bool collect_pass_stats) {
+  Pass* pass = m_activated_passes[i];
+  if (!pass->is_editable_cfg_friendly()) {
+    linearize_editable_cfgs(stores);
+  }
+  TRACE(PM, 1, "Running %s...\n", pass->name().c_str());
+  Timer t(pass->name() + " (run)");
+  m_current_pass_info = &m_pass_info[i];
+  DexStoreClassesIterator it(stores);
+  CodeEpochs epochs_before;
+  record_code_epochs(build_class_scope(it), epochs_before);
+  ResourceSnapshot before;
+  WorkQueueStats workqueue_before;
+  if (collect_pass_stats) {
+    reset_peak_rss();
+    before = ResourceSnapshot::take();
+    workqueue_before = WorkQueueStats::snapshot();
+    SlowestMethods::start(m_slowest_methods_count);
+  }
+  // Whatever ran before may have changed the hierarchy or the members of
+  // classes.
+  invalidate_resolution_caches();
+  set_malloc_profile_phase(pass->name().c_str());
+  pass->run_pass(stores, cfg, *this);
+  set_malloc_profile_phase(nullptr);
+  // The code edited through an editable CFG only counts as changed once it
+  // is linearized, so the methods such a pass changed are only counted when
+  // it linearizes them itself.
+  m_editable_cfgs_may_exist |= pass->is_editable_cfg_friendly();
+  {
+    PreservedAnalyses preserved;
+    pass->preserved_analyses(preserved);
+    m_analyses.invalidate(preserved);
+  }
+  if (collect_pass_stats) {
+    m_pass_info[i].slowest_methods = SlowestMethods::stop();
+    set_workqueue_metrics(WorkQueueStats::snapshot() - workqueue_before,
+                          m_pass_info[i].metrics);
+    auto after = ResourceSnapshot::take();
+    auto& usage = m_pass_info[i].usage;
+    usage.wall_secs =
+        std::chrono::duration<double>(after.wall - before.wall).count();
+    usage.cpu_secs = after.cpu_secs - before.cpu_secs;
+    usage.rss_delta_kb = after.rss_kb - before.rss_kb;
+    usage.peak_rss_kb = peak_rss_kb();
+    if (after.allocations >= 0) {
+      usage.allocations = after.allocations - before.allocations;
+    }
+    usage.live_objects = census::sample();
+  }
+  auto methods_changed =
+      count_methods_changed(epochs_before, build_class_scope(it));
+  m_pass_info[i].metrics[METHODS_CHANGED_KEY] = methods_changed;
+  m_pass_info[i].usage.methods_touched = methods_changed;
+  TRACE(PM, 1, "%s changed %lu methods\n", pass->name().c_str(),
+        methods_changed);
+  m_current_pass_info = nullptr;
+}
+
+namespace {
+
+using ClassRange = std::pair<size_t, size_t>;
+
+/*
+ * Splits the classes into at most `num_shards` contiguous ranges with about
+ * the same number of methods each.
+ */
+std::vector<ClassRange> split_classes(const Scope& scope, size_t num_shards) {
+  auto weight = [](const DexClass* cls) {
+    return cls->get_dmethods().size() + cls->get_vmethods().size() + 1;
+  };
+  size_t total = 0;
+  for (auto cls : scope) {
+    total += weight(cls);
+  }
+  std::vector<ClassRange> shards;
+  size_t begin = 0;
+  size_t so_far = 0;
+  for (size_t i = 0; i < scope.size(); ++i) {
+    so_far += weight(scope[i]);
+    if (shards.size() + 1 < num_shards &&
+        so_far * num_shards >= total * (shards.size() + 1)) {
+      shards.emplace_back(begin, i + 1);
+      begin = i + 1;
+    }
+  }
+  if (begin < scope.size()) {
+    shards.emplace_back(begin, scope.size());
+  }
+  return shards;
+}
+
+// The methods of a range of classes, in the order that the worker and the
+// parent number them by.
+std::vector<DexMethod*> methods_of(const Scope& scope, const ClassRange& range) {
+  std::vector<DexMethod*> methods;
+  for (size_t i = range.first; i < range.second; ++i) {
+    for (auto method : scope[i]->get_dmethods()) {
+      methods.push_back(method);
+    }
+    for (auto method : scope[i]->get_vmethods()) {
+      methods.push_back(method);
+    }
+  }
+  return methods;
+}
+
+// The serialized code of each method; empty for methods without code.
+std::vector<std::vector<uint8_t>> serialize_code(
+    const std::vector<DexMethod*>& methods) {
+  std::vector<std::vector<uint8_t>> records(methods.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto code = methods[i]->get_code();
+    if (code != nullptr) {
+      // Fallthrough entries only exist for the sake of a CFG.
+      code->clear_cfg();
+      ir_serialization::serialize(*code, &records[i]);
+    }
+  });
+  for (size_t i = 0; i < methods.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  return records;
+}
+
+void append_u32(std::vector<uint8_t>* out, uint32_t v) {
+  for (size_t i = 0; i < 4; ++i) {
+    out->push_back(static_cast<uint8_t>(v >> (8 * i)));
+  }
+}
+
+uint32_t read_u32(const std::vector<uint8_t>& in, size_t* offset) {
+  always_assert_log(in.size() - *offset >= 4, "Truncated shard result");
+  uint32_t v = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    v |= static_cast<uint32_t>(in[(*offset)++]) << (8 * i);
+  }
+  return v;
+}
+
+#ifdef _POSIX_VERSION
+void write_all(int fd, const std::vector<uint8_t>& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    auto n = write(fd, data.data() + written, data.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    always_assert_log(n > 0, "Failed to write shard result: %s",
+                      strerror(errno));
+    written += n;
+  }
+}
+
+std::vector<uint8_t> read_all(int fd) {
+  std::vector<uint8_t> data;
+  uint8_t buf[64 * 1024];
+  while (true) {
+    auto n = read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    always_assert_log(n >= 0, "Failed to read shard result: %s",
+                      strerror(errno));
+    if (n == 0) {
+      return data;
+    }
+    data.insert(data.end(), buf, buf + n);
+  }
+}
+#endif
+
+} // namespace
+
+/*
+ * Each worker is a fork of this process, so it starts from exactly the same
+ * program. It drops the classes outside its share from the stores, which is
+ * all that a method-local pass looks at, runs the passes, and sends back a
+ * report of their metrics and costs, followed by the code of the methods
+ * whose code changed, as records of IRSerialization.h numbered by their
+ * position in methods_of(). Everything it changed in its own copy of the
+ * program is then discarded with it.
+ *
+ * The code a method ends up with only depends on its code before, whichever
+ * worker handles it and however many there are, so the output is the same as
+ * running the passes in this process. Metrics are summed over the workers.
+ */
+void PassManager::run_sharded_passes(size_t begin,
+                                     size_t end,
+                                     size_t num_workers,
+                                     DexStoresVector& stores,
+                                     ConfigFiles& cfg,
+                                     bool collect_pass_stats) {
+  std::string names;
+  for (size_t i = begin; i < end; ++i) {
+    names += (i == begin ? "" : ", ") + m_activated_passes[i]->name();
+  }
+  // The code goes to and from the workers as instruction lists anyway.
+  linearize_editable_cfgs(stores);
+  Scope scope = build_class_scope(stores);
+  auto shards = split_classes(scope, num_workers);
+#ifdef _POSIX_VERSION
+  if (shards.size() <= 1) {
+    for (size_t i = begin; i < end; ++i) {
+      run_pass(i, stores, cfg, collect_pass_stats);
+    }
+    return;
+  }
+  Timer t("Sharded " + names + " (run)");
+  TRACE(PM, 1, "Running %s in %lu worker processes...\n", names.c_str(),
+        shards.size());
+  // Only the calling thread survives a fork.
+  ThreadPool::get().join_workers();
+  fflush(stdout);
+  fflush(stderr);
+  std::vector<pid_t> pids;
+  std::vector<int> result_fds;
+  for (const auto& shard : shards) {
+    int fds[2];
+    always_assert_log(pipe(fds) == 0, "pipe failed: %s", strerror(errno));
+    auto pid = fork();
+    always_assert_log(pid != -1, "Failed to fork");
+    if (pid != 0) {
+      close(fds[1]);
+      pids.push_back(pid);
+      result_fds.push_back(fds[0]);
+      continue;
+    }
+
+    close(fds[0]);
+    for (auto fd : result_fds) {
+      close(fd);
+    }
+    int status = 0;
+    try {
+      set_num_threads_override(
+          std::max(1u, default_workqueue_threads() / (unsigned)shards.size()));
+      size_t index = 0;
+      for (auto& store : stores) {
+        for (auto& dex : store.get_dexen()) {
+          DexClasses kept;
+          for (auto cls : dex) {
+            if (index >= shard.first && index < shard.second) {
+              kept.push_back(cls);
+            }
+            ++index;
+          }
+          dex = std::move(kept);
+        }
+      }
+      // Only report what this worker's passes add.
+      for (size_t i = begin; i < end; ++i) {
+        m_pass_info[i].metrics.clear();
+      }
+      auto methods = methods_of(scope, shard);
+      auto records_before = serialize_code(methods);
+      for (size_t i = begin; i < end; ++i) {
+        run_pass(i, stores, cfg, collect_pass_stats);
+      }
+      always_assert_log(methods_of(scope, shard) == methods,
+                        "A method-local pass added or removed methods");
+      auto records_after = serialize_code(methods);
+
+      Json::Value report;
+      report["regalloc_has_run"] = m_regalloc_has_run.load();
+      Json::Value passes(Json::arrayValue);
+      for (size_t i = begin; i < end; ++i) {
+        const auto& info = m_pass_info[i];
+        Json::Value pass;
+        for (const auto& metric : info.metrics) {
+          pass["metrics"][metric.first] = metric.second;
+        }
+        pass["wall_secs"] = info.usage.wall_secs;
+        pass["cpu_secs"] = info.usage.cpu_secs;
+        pass["rss_delta_kb"] = Json::Int64(info.usage.rss_delta_kb);
+        pass["peak_rss_kb"] = Json::Int64(info.usage.peak_rss_kb);
+        pass["allocations"] = Json::Int64(info.usage.allocations);
+        for (const auto& method_and_secs : info.slowest_methods) {
+          Json::Value method;
+          method["method"] = method_and_secs.first;
+          method["secs"] = method_and_secs.second;
+          pass["slowest_methods"].append(method);
+        }
+        passes.append(pass);
+      }
+      report["passes"] = passes;
+      auto json = Json::FastWriter().write(report);
+
+      std::vector<uint8_t> result;
+      append_u32(&result, json.size());
+      result.insert(result.end(), json.begin(), json.end());
+      for (size_t i = 0; i < methods.size(); ++i) {
+        always_assert_log(records_after[i].empty() == records_before[i].empty(),
+                          "A method-local pass added or removed code");
+        if (records_after[i] != records_before[i]) {
+          append_u32(&result, i);
+          append_u32(&result, records_after[i].size());
+          result.insert(result.end(), records_after[i].begin(),
+                        records_after[i].end());
+        }
+      }
+      write_all(fds[1], result);
+    } catch (const std::exception& e) {
+      fprintf(stderr, "Worker for classes [%lu, %lu) failed: %s\n",
+              shard.first, shard.second, e.what());
+      status = 1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    // The rest of this process belongs to the parent: leave without running
+    // any destructors or exit handlers.
+    _exit(status);
+  }
+
+  std::vector<std::pair<DexMethod*, std::vector<uint8_t>>> changed;
+  for (size_t w = 0; w < shards.size(); ++w) {
+    auto result = read_all(result_fds[w]);
+    close(result_fds[w]);
+    int status;
+    while (waitpid(pids[w], &status, 0) == -1 && errno == EINTR) {
+    }
+    always_assert_log(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                      "Worker for classes [%lu, %lu) of %s failed",
+                      shards[w].first, shards[w].second, names.c_str());
+
+    size_t offset = 0;
+    auto json_size = read_u32(result, &offset);
+    always_assert_log(result.size() - offset >= json_size,
+                      "Truncated shard result");
+    Json::Value report;
+    std::istringstream(std::string(result.begin() + offset,
+                                   result.begin() + offset + json_size)) >>
+        report;
+    offset += json_size;
+    if (report["regalloc_has_run"].asBool()) {
+      m_regalloc_has_run = true;
+    }
+    for (size_t i = begin; i < end; ++i) {
+      const auto& pass = report["passes"][Json::ArrayIndex(i - begin)];
+      auto& info = m_pass_info[i];
+      const auto& metrics = pass["metrics"];
+      for (const auto& key : metrics.getMemberNames()) {
+        if (key != PASS_ORDER_KEY) {
+          info.metrics[key] += metrics[key].asInt();
+        }
+      }
+      auto& usage = info.usage;
+      usage.wall_secs = std::max(usage.wall_secs, pass["wall_secs"].asDouble());
+      usage.cpu_secs += pass["cpu_secs"].asDouble();
+      usage.rss_delta_kb += pass["rss_delta_kb"].asInt64();
+      usage.peak_rss_kb =
+          std::max(usage.peak_rss_kb, pass["peak_rss_kb"].asInt64());
+      auto allocations = pass["allocations"].asInt64();
+      if (allocations >= 0) {
+        usage.allocations = std::max<int64_t>(usage.allocations, 0) +
+                            allocations;
+      }
+      usage.methods_touched = info.metrics[METHODS_CHANGED_KEY];
+      for (const auto& method : pass["slowest_methods"]) {
+        info.slowest_methods.emplace_back(method["method"].asString(),
+                                          method["secs"].asDouble());
+      }
+      SlowestMethods::truncate(info.slowest_methods, m_slowest_methods_count);
+    }
+
+    auto methods = methods_of(scope, shards[w]);
+    while (offset < result.size()) {
+      auto index = read_u32(result, &offset);
+      auto size = read_u32(result, &offset);
+      always_assert_log(index < methods.size() &&
+                            result.size() - offset >= size,
+                        "Malformed shard result");
+      changed.emplace_back(methods[index],
+                           std::vector<uint8_t>(result.begin() + offset,
+                                                result.begin() + offset + size));
+      offset += size;
+    }
+  }
+
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    const auto& record = changed[i].second;
+    changed[i].first->set_code(
+        ir_serialization::deserialize(record.data(), record.size()));
+  });
+  for (size_t i = 0; i < changed.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  TRACE(PM, 1, "%s changed %lu methods\n", names.c_str(), changed.size());
+  // What the workers had alive is gone with them; what counts is the code
+  // taken back.
+  auto live_objects = census::sample();
+  for (size_t i = begin; i < end; ++i) {
+    m_pass_info[i].usage.live_objects = live_objects;
+    PreservedAnalyses preserved;
+    m_activated_passes[i]->preserved_analyses(preserved);
+    m_analyses.invalidate(preserved);
+  }
+  invalidate_resolution_caches();
+#else
+  fprintf(stderr, "Sharded passes need fork(); running %s in process\n",
+          names.c_str());
+  for (size_t i = begin; i < end; ++i) {
+    run_pass(i, stores, cfg, collect_pass_stats);
+  }
+#endif
+}
+
+/*
+ * "bisect": {"prefix": N, "command": "..."} looks for the pass the output
+ * starts to fail from, like test/bisect-passes.py, but without running the
+ * loading and the first N passes again for each try. Each try is a fork of
+ * this process after the first N passes that runs only some of the passes
+ * after them, the ones before a given pass, then goes on to write its
+ * output and exit. The command then runs on that output, and the output
+ * counts as failing when the command or the try itself fails. The passes in
+ * "always_run" run in every try.
+ *
+ * Once done, this process runs all the passes as usual.
+ */
+bool PassManager::bisect_passes(size_t begin) {
+#ifdef _POSIX_VERSION
+  const auto& bisect = m_config["bisect"];
+  auto command = bisect.get("command", "").asString();
+  always_assert_log(!command.empty(), "\"bisect\" needs a \"command\"");
+  std::unordered_set<std::string> always_run{"ReBindRefsPass",
+                                             "InterDexPass"};
+  if (bisect.isMember("always_run")) {
+    always_run.clear();
+    for (const auto& name : bisect["always_run"]) {
+      always_run.insert(name.asString());
+    }
+  }
+  std::vector<size_t> candidates;
+  for (size_t i = begin; i < m_activated_passes.size(); ++i) {
+    if (!always_run.count(m_activated_passes[i]->name())) {
+      candidates.push_back(i);
+    }
+  }
+
+  // Whether the output passes the command when only the first `num`
+  // candidates run; unset in the process of the try itself.
+  auto passes_with = [&](size_t num) -> boost::optional<bool> {
+    fprintf(stderr, "Bisecting: trying the first %lu of %lu passes\n", num,
+            candidates.size());
+    // Only the calling thread survives a fork.
+    ThreadPool::get().join_workers();
+    fflush(stdout);
+    fflush(stderr);
+    auto pid = fork();
+    always_assert_log(pid != -1, "Failed to fork");
+    if (pid == 0) {
+      std::vector<Pass*> passes(m_activated_passes.begin(),
+                                m_activated_passes.begin() + begin);
+      std::vector<PassInfo> infos(m_pass_info.begin(),
+                                  m_pass_info.begin() + begin);
+      for (size_t i = begin, c = 0; i < m_activated_passes.size(); ++i) {
+        if (c < candidates.size() && candidates[c] == i && c++ >= num) {
+          continue;
+        }
+        passes.push_back(m_activated_passes[i]);
+        infos.push_back(m_pass_info[i]);
+      }
+      m_activated_passes = std::move(passes);
+      m_pass_info = std::move(infos);
+      m_bisection_trial = true;
+      return boost::none;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      return false;
+    }
+    return std::system(command.c_str()) == 0;
+  };
+
+  auto good = passes_with(0);
+  if (!good) {
+    return true;
+  }
+  if (!*good) {
+    fprintf(stderr, "Bisecting: the output fails without any of the passes\n");
+    return false;
+  }
+  good = passes_with(candidates.size());
+  if (!good) {
+    return true;
+  }
+  if (*good) {
+    fprintf(stderr, "Bisecting: the output doesn't fail\n");
+    return false;
+  }
+  // The output passes with the first `lo` candidates and fails with the
+  // first `hi`.
+  size_t lo = 0;
+  size_t hi = candidates.size();
+  while (hi - lo > 1) {
+    auto mid = lo + (hi - lo) / 2;
+    good = passes_with(mid);
+    if (!good) {
+      return true;
+    }
+    (*good ? lo : hi) = mid;
+  }
+  m_bisected_pass = m_pass_info[candidates[lo]].name;
+  fprintf(stderr, "Bisecting: the output fails from %s on\n",
+          m_bisected_pass.c_str());
+  return false;
+#else
+  fprintf(stderr, "Bisecting passes needs fork(); running them as usual\n");
+  return false;
+#endif
+}
+
 void PassManager::run_passes(DexStoresVector& stores,
                              const Scope& external_classes,
                              ConfigFiles& cfg) {
+  // "threads": {"count": N, "cpus": "0-15,32-47"} sets the threads of the
+  // passes. REDEX_THREADS and REDEX_CPUS do the same for the whole run.
+  auto threads_config = m_config.get("threads", Json::Value());
+  if (threads_config.isMember("cpus")) {
+    ThreadPool::get().pin_to_cpus(
+        ThreadPool::parse_cpu_list(threads_config["cpus"].asString()));
+  }
+  if (threads_config.isMember("count")) {
+    set_num_threads_override(threads_config["count"].asUInt());
+  }
+
   DexStoreClassesIterator it(stores);
   Scope scope = build_class_scope(it);
   {
     Timer t("Initializing reachable classes");
-    init_reachable_classes(
-        scope, m_config, m_pg_config, cfg.get_no_optimizations_annos());
+    init_reachable_classes(scope,
+                           m_config,
+                           m_pg_config,
+                           cfg.get_no_optimizations_annos(),
+                           &cfg.get_resource_scan_cache());
   }
   {
     Timer t("Processing proguard rules");
-    process_proguard_rules(
-        cfg.get_proguard_map(), scope, external_classes, &m_pg_config);
+    process_proguard_rules(cfg.get_proguard_map(),
+                           scope,
+                           external_classes,
+                           &m_pg_config,
+                           m_config.get("proguard_cache_dir", "").asString());
   }
   char* seeds_output_file = std::getenv("REDEX_SEEDS_FILE");
   if (seeds_output_file) {
@@ -224,27 +1170,91 @@ void PassManager::run_passes(DexStoresVector& stores,
     trigger_passes.insert(trigger_pass.asString());
   }
 
+  auto pass_stats_output =
+      cfg.metafile(m_config.get("pass_stats_output", "").asString());
+  bool collect_pass_stats = !pass_stats_output.empty();
+  // The slowest methods of each pass, when it collects pass stats.
+  m_slowest_methods_count =
+      m_config.get("pass_stats_slowest_methods", 10).asUInt();
+
+  // Runs of method-local passes are spread over this many worker processes.
+  size_t shard_workers =
+      m_config["sharded_passes"].get("workers", 0).asUInt();
+  // Otherwise runs of store-local passes go over the stores concurrently.
+  bool parallel_stores = stores.size() > 1 &&
+                         m_config.get("parallel_store_passes", true).asBool();
+  // The passes before this one run before "bisect" starts to fork.
+  bool bisect = m_config.isMember("bisect");
+  size_t bisect_prefix = std::min<size_t>(
+      m_config["bisect"].get("prefix", 0).asUInt(), m_activated_passes.size());
+
   for (size_t i = 0; i < m_activated_passes.size(); ++i) {
+    if (bisect && i == bisect_prefix) {
+      bisect = false;
+      if (bisect_passes(i) && i == m_activated_passes.size()) {
+        // This try runs none of the passes after the prefix.
+        break;
+      }
+    }
+    // Runs of passes don't go past the start of the bisection.
+    size_t limit = bisect ? bisect_prefix : m_activated_passes.size();
     Pass* pass = m_activated_passes[i];
-    TRACE(PM, 1, "Running %s...\n", pass->name().c_str());
-    Timer t(pass->name() + " (run)");
-    m_current_pass_info = &m_pass_info[i];
-    bool run_profiler{m_profiler_info && m_profiler_info->pass == pass};
-    pid_t profiler{-1};
-    if (run_profiler) {
-      fprintf(stderr, "Running profiler...\n");
-      profiler = spawn_profiler(m_profiler_info->command);
-    }
-    pass->run_pass(stores, cfg, *this);
-    if (run_profiler) {
-      fprintf(stderr, "Waiting for profiler to finish...\n");
-      kill_and_wait(profiler, SIGINT);
-    }
-    if (run_after_each_pass || trigger_passes.count(pass->name()) > 0) {
+    bool run_type_checker_now =
+        run_after_each_pass || trigger_passes.count(pass->name()) > 0;
+    size_t end = i;
+    while (end < limit &&
+           m_activated_passes[end]->is_method_local() &&
+           !(m_profiler_info &&
+             m_profiler_info->pass == m_activated_passes[end])) {
+      ++end;
+    }
+    size_t store_end = i;
+    while (store_end < limit &&
+           m_activated_passes[store_end]->is_store_local() &&
+           !(m_profiler_info &&
+             m_profiler_info->pass == m_activated_passes[store_end])) {
+      ++store_end;
+    }
+    if (shard_workers > 1 && end > i) {
+      run_sharded_passes(
+          i, end, shard_workers, stores, cfg, collect_pass_stats);
+      for (size_t j = i + 1; j < end; ++j) {
+        run_type_checker_now |=
+            trigger_passes.count(m_activated_passes[j]->name()) > 0;
+      }
+      i = end - 1;
+    } else if (parallel_stores && store_end > i) {
+      run_store_local_passes(i, store_end, stores, cfg);
+      for (size_t j = i + 1; j < store_end; ++j) {
+        run_type_checker_now |=
+            trigger_passes.count(m_activated_passes[j]->name()) > 0;
+      }
+      i = store_end - 1;
+    } else {
+      bool run_profiler{m_profiler_info && m_profiler_info->pass == pass};
+      pid_t profiler{-1};
+      if (run_profiler) {
+        fprintf(stderr, "Running profiler...\n");
+        profiler = spawn_profiler(m_profiler_info->command);
+      }
+      run_pass(i, stores, cfg, collect_pass_stats);
+      if (run_profiler) {
+        fprintf(stderr, "Waiting for profiler to finish...\n");
+        kill_and_wait(profiler, SIGINT);
+      }
+    }
+    if (run_type_checker_now) {
       scope = build_class_scope(it);
       run_type_checker(scope, polymorphic_constants, verify_moves);
     }
-    m_current_pass_info = nullptr;
+  }
+
+  m_analyses.clear();
+  // The output is written from the instruction lists.
+  linearize_editable_cfgs(stores);
+
+  if (collect_pass_stats) {
+    write_pass_stats(pass_stats_output);
   }
 
   // Always run the type checker before generating the optimized dex code.
@@ -281,17 +1291,19 @@ void PassManager::activate_pass(const char* name, const Json::Value& cfg) {
 }
 
 void PassManager::incr_metric(const std::string& key, int value) {
-  always_assert_log(m_current_pass_info != nullptr, "No current pass!");
-  (m_current_pass_info->metrics)[key] += value;
+  auto info = current_pass_info();
+  always_assert_log(info != nullptr, "No current pass!");
+  (info->metrics)[key] += value;
 }
 
 void PassManager::set_metric(const std::string& key, int value) {
-  always_assert_log(m_current_pass_info != nullptr, "No current pass!");
-  (m_current_pass_info->metrics)[key] = value;
+  auto info = current_pass_info();
+  always_assert_log(info != nullptr, "No current pass!");
+  (info->metrics)[key] = value;
 }
 
 int PassManager::get_metric(const std::string& key) {
-  return (m_current_pass_info->metrics)[key];
+  return (current_pass_info()->metrics)[key];
 }
 
 const std::vector<PassManager::PassInfo>& PassManager::get_pass_info() const {
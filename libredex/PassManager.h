@@ -9,9 +9,13 @@
 
 #pragma once
 
+#include "AnalysisManager.h"
+#include "ConcurrentContainers.h"
+#include "ObjectCensus.h"
 #include "Pass.h"
 #include "ProguardConfiguration.h"
 
+#include <atomic>
 #include <boost/optional.hpp>
 #include <json/json.h>
 #include <string>
@@ -30,6 +34,18 @@ class PassManager {
               const Json::Value& config = Json::Value(Json::objectValue),
               bool verify_none_mode = false);
 
+  // What a run of a pass cost. Only measured when "pass_stats_output" is set.
+  struct ResourceUsage {
+    double wall_secs{0};
+    double cpu_secs{0}; // user + system, summed over all threads
+    int64_t rss_delta_kb{0};
+    int64_t peak_rss_kb{0};
+    int64_t allocations{-1}; // -1 unless built with the counting allocator
+    size_t methods_touched{0};
+    // The IR objects still alive once the pass is done, to tie the RSS to.
+    census::Counts live_objects{};
+  };
+
   struct PassInfo {
     const Pass* pass;
     size_t order; // zero-based
@@ -37,6 +53,10 @@ class PassManager {
     size_t total_repeat;
     std::string name;
     std::unordered_map<std::string, int> metrics;
+    ResourceUsage usage;
+    // The slowest methods walked during the pass, slowest first, with the
+    // seconds each took.
+    std::vector<std::pair<std::string, double>> slowest_methods;
   };
 
   void run_passes(DexStoresVector&,
@@ -61,24 +81,73 @@ class PassManager {
   // do not use ProGuard configuration keep rules.
   void set_testing_mode() { m_testing_mode = true; }
 
-  const PassInfo* get_current_pass_info() const { return m_current_pass_info; }
+  const PassInfo* get_current_pass_info() const {
+    return t_store_pass_info ? t_store_pass_info : m_current_pass_info;
+  }
+
+  // The analyses cached across passes.
+  AnalysisManager& analyses() { return m_analyses; }
 
   void record_running_regalloc() {
     m_regalloc_has_run = true;
   }
 
   bool regalloc_has_run() {
-    return m_regalloc_has_run;
+    return m_regalloc_has_run.load();
   }
 
+  // Whether this process is a trial of "bisect": it should write its output
+  // and exit.
+  bool is_bisection_trial() const { return m_bisection_trial; }
+
+  // The pass "bisect" found the output to fail from on, if it did.
+  const std::string& get_bisected_pass() const { return m_bisected_pass; }
+
  private:
   void activate_pass(const char* name, const Json::Value& cfg);
 
   void init(const Json::Value& config);
 
-  static void run_type_checker(const Scope& scope,
-                               bool polymorphic_constants,
-                               bool verify_moves);
+  void write_pass_stats(const std::string& path) const;
+
+  // Runs m_activated_passes[i], recording the methods it changed and, if
+  // asked to, what it cost.
+  void run_pass(size_t i,
+                DexStoresVector& stores,
+                ConfigFiles& cfg,
+                bool collect_pass_stats);
+
+  // Runs the method-local passes [begin, end) in worker processes that each
+  // take a share of the classes, then takes back the code they changed.
+  void run_sharded_passes(size_t begin,
+                          size_t end,
+                          size_t num_workers,
+                          DexStoresVector& stores,
+                          ConfigFiles& cfg,
+                          bool collect_pass_stats);
+
+  // Runs the store-local passes [begin, end) on each store separately, the
+  // stores that don't depend on one another concurrently.
+  void run_store_local_passes(size_t begin,
+                              size_t end,
+                              DexStoresVector& stores,
+                              ConfigFiles& cfg);
+
+  // The pass whose metrics incr_metric() and friends update.
+  PassInfo* current_pass_info() const {
+    return t_store_pass_info ? t_store_pass_info : m_current_pass_info;
+  }
+
+  // Bisects the passes from `begin` on in forks of this process. Returns
+  // whether this process is one of those, with the passes it tries.
+  bool bisect_passes(size_t begin);
+
+  // Linearizes the editable CFGs the passes left behind, if they may have.
+  void linearize_editable_cfgs(DexStoresVector& stores);
+
+  void run_type_checker(const Scope& scope,
+                        bool polymorphic_constants,
+                        bool verify_moves);
 
   Json::Value m_config;
   std::vector<Pass*> m_registered_passes;
@@ -87,11 +156,27 @@ class PassManager {
   // Per-pass information and metrics
   std::vector<PassManager::PassInfo> m_pass_info;
   PassInfo* m_current_pass_info;
+  // While run_store_local_passes() runs a pass on a store on this thread, the
+  // PassInfo that collects the metrics of that run.
+  static thread_local PassInfo* t_store_pass_info;
 
   redex::ProguardConfiguration m_pg_config;
   bool m_testing_mode;
   bool m_verify_none_mode;
-  bool m_regalloc_has_run = false;
+  std::atomic<bool> m_regalloc_has_run{false};
+  // Whether a pass that keeps editable CFGs ran since they were last all
+  // linearized.
+  bool m_editable_cfgs_may_exist{false};
+  bool m_bisection_trial{false};
+  std::string m_bisected_pass;
+  // How many of the slowest methods of each pass go into the pass stats.
+  size_t m_slowest_methods_count{0};
+
+  AnalysisManager m_analyses;
+
+  // The methods that passed the type checker, with a fingerprint of their
+  // code at the time.
+  ConcurrentMap<const DexMethod*, uint64_t> m_type_checked_methods;
 
   struct ProfilerInfo {
     std::string command;
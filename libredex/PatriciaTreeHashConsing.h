@@ -0,0 +1,193 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/*
+ * Optional hash-consing of the nodes of Patricia trees (see PatriciaTreeSet.h
+ * and PatriciaTreeMap.h).
+ *
+ * Patricia trees already share the subtrees that an operation leaves
+ * unchanged, but two equal trees that have been built independently are
+ * distinct objects. When hash-consing is enabled, every node is looked up in a
+ * global table before being created, so that equal trees are represented by
+ * the same object. This saves memory in analyses that manipulate many similar
+ * sets or environments. It also lets the tree operations stop as soon as the
+ * operands are physically equal, and makes the results of union and
+ * intersection worth memoizing, since the same pair of operands keeps showing
+ * up during a fixpoint iteration.
+ *
+ * Hash-consing is a global setting that can be changed at any time. Trees
+ * built while it's disabled are never unified, so the two kinds of trees can
+ * be freely mixed.
+ */
+namespace pt_util {
+
+inline std::atomic<bool>& hash_consing_flag() {
+  static std::atomic<bool> s_enabled{false};
+  return s_enabled;
+}
+
+inline bool is_hash_consing_enabled() {
+  return hash_consing_flag().load(std::memory_order_relaxed);
+}
+
+/*
+ * A concurrent table that holds the hash-consed nodes of one type of Patricia
+ * tree. The table doesn't keep the nodes alive: dead entries are purged
+ * lazily, whenever a bucket they belong to is visited and when a shard has
+ * grown enough since it was last swept.
+ */
+template <typename Node>
+class HashConsingTable final {
+ public:
+  static HashConsingTable& get() {
+    // Intentionally leaked, since nodes may be destroyed during static
+    // destruction.
+    static auto* s_table = new HashConsingTable();
+    return *s_table;
+  }
+
+  /*
+   * Returns the node of the table with the given hash code that satisfies
+   * `matches`, or else the node built by `make`, which is then added to the
+   * table. In order to bound the cost of a lookup, the new node isn't added
+   * if there are already too many nodes with the same hash code, which
+   * `make` is told about by its argument.
+   */
+  std::shared_ptr<Node> intern(
+      size_t hash,
+      const std::function<bool(const Node&)>& matches,
+      const std::function<std::shared_ptr<Node>(bool interned)>& make) {
+    auto& shard = m_shards[hash % NUM_SHARDS];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto range = shard.nodes.equal_range(hash);
+    size_t collisions = 0;
+    for (auto it = range.first; it != range.second;) {
+      auto node = it->second.lock();
+      if (node == nullptr) {
+        it = shard.nodes.erase(it);
+        continue;
+      }
+      if (matches(*node)) {
+        return node;
+      }
+      ++collisions;
+      ++it;
+    }
+    bool interned = collisions < MAX_COLLISIONS;
+    auto node = make(interned);
+    if (interned) {
+      shard.nodes.emplace(hash, node);
+      if (shard.nodes.size() >= shard.next_sweep) {
+        sweep(&shard);
+      }
+    }
+    return node;
+  }
+
+ private:
+  static constexpr size_t NUM_SHARDS = 64;
+  static constexpr size_t MAX_COLLISIONS = 8;
+  static constexpr size_t MIN_SWEEP_SIZE = 1024;
+
+  struct Shard {
+    std::mutex lock;
+    std::unordered_multimap<size_t, std::weak_ptr<Node>> nodes;
+    size_t next_sweep{MIN_SWEEP_SIZE};
+  };
+
+  static void sweep(Shard* shard) {
+    for (auto it = shard->nodes.begin(); it != shard->nodes.end();) {
+      if (it->second.expired()) {
+        it = shard->nodes.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    shard->next_sweep = std::max(MIN_SWEEP_SIZE, 2 * shard->nodes.size());
+  }
+
+  std::array<Shard, NUM_SHARDS> m_shards;
+};
+
+/*
+ * A small direct-mapped cache of the results of binary operations on
+ * hash-consed trees. Each thread has its own cache, so no synchronization is
+ * needed. The entries keep their operands alive, which guarantees that the
+ * address of a node in the cache can't be reused for another node.
+ */
+template <typename Node>
+class OperationCache final {
+ public:
+  using Tree = std::shared_ptr<Node>;
+
+  static OperationCache& get() {
+    static thread_local OperationCache s_cache;
+    return s_cache;
+  }
+
+  /*
+   * Returns the cached result of applying operation `op` to `s` and `t`, or
+   * else the result of `compute`, which is then cached. An `op` of zero
+   * denotes an operation that can't be memoized.
+   */
+  Tree memoize(size_t op,
+               const Tree& s,
+               const Tree& t,
+               const std::function<Tree()>& compute) {
+    if (op == 0) {
+      return compute();
+    }
+    size_t seed = reinterpret_cast<uintptr_t>(s.get()) * 31 +
+                  reinterpret_cast<uintptr_t>(t.get());
+    seed ^= op * 0x9e3779b97f4a7c15ULL;
+    auto& entry = m_entries[(seed ^ (seed >> 17)) % CACHE_SIZE];
+    if (entry.op == op && entry.s == s && entry.t == t) {
+      return entry.result;
+    }
+    auto result = compute();
+    entry.op = op;
+    entry.s = s;
+    entry.t = t;
+    entry.result = result;
+    return result;
+  }
+
+ private:
+  static constexpr size_t CACHE_SIZE = 1024;
+
+  struct Entry {
+    size_t op{0};
+    Tree s;
+    Tree t;
+    Tree result;
+  };
+
+  std::array<Entry, CACHE_SIZE> m_entries;
+};
+
+} // namespace pt_util
+
+/*
+ * Enables or disables the hash-consing of Patricia-tree nodes. It only
+ * applies to the nodes created after the call.
+ */
+inline void set_patricia_tree_hash_consing(bool enabled) {
+  pt_util::hash_consing_flag().store(enabled);
+}
@@ -18,7 +18,10 @@
 #include <type_traits>
 #include <utility>
 
+#include <boost/functional/hash.hpp>
+
 #include "Debug.h"
+#include "PatriciaTreeHashConsing.h"
 #include "PatriciaTreeUtil.h"
 #include "Util.h"
 
@@ -66,13 +69,15 @@ template <typename IntegerType, typename Value>
 inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
     const CombiningFunction<typename Value::type>& combine,
     std::shared_ptr<PatriciaTree<IntegerType, Value>> s,
-    std::shared_ptr<PatriciaTree<IntegerType, Value>> t);
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> t,
+    size_t memoization_id);
 
 template <typename IntegerType, typename Value>
 inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     std::shared_ptr<PatriciaTree<IntegerType, Value>> s,
-    std::shared_ptr<PatriciaTree<IntegerType, Value>> t);
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> t,
+    size_t memoization_id);
 
 template <typename T>
 T snd(const T&, const T& second) {
@@ -224,31 +229,42 @@ class PatriciaTreeMap final {
     return *this;
   }
 
+  /*
+   * When hash-consing is enabled (see PatriciaTreeHashConsing.h), the results
+   * of union and intersection can be memoized. This requires `combine` to be a
+   * pure function, identified by a nonzero `memoization_id` that is distinct
+   * from the ids of all the other combining functions used on maps of this
+   * type. The default id of zero disables the memoization.
+   */
   PatriciaTreeMap& union_with(const combining_function& combine,
-                              const PatriciaTreeMap& other) {
-    m_tree =
-        ptmap_impl::merge<IntegerType, Value>(combine, m_tree, other.m_tree);
+                              const PatriciaTreeMap& other,
+                              size_t memoization_id = 0) {
+    m_tree = ptmap_impl::merge<IntegerType, Value>(
+        combine, m_tree, other.m_tree, memoization_id);
     return *this;
   }
 
   PatriciaTreeMap& intersection_with(const combining_function& combine,
-                                     const PatriciaTreeMap& other) {
+                                     const PatriciaTreeMap& other,
+                                     size_t memoization_id = 0) {
     m_tree = ptmap_impl::intersect<IntegerType, Value>(
-        combine, m_tree, other.m_tree);
+        combine, m_tree, other.m_tree, memoization_id);
     return *this;
   }
 
   PatriciaTreeMap get_union_with(const combining_function& combine,
-                                 const PatriciaTreeMap& other) const {
+                                 const PatriciaTreeMap& other,
+                                 size_t memoization_id = 0) const {
     auto result = *this;
-    result.union_with(combine, other);
+    result.union_with(combine, other, memoization_id);
     return result;
   }
 
   PatriciaTreeMap get_intersection_with(const combining_function& combine,
-                                        const PatriciaTreeMap& other) const {
+                                        const PatriciaTreeMap& other,
+                                        size_t memoization_id = 0) const {
     auto result = *this;
-    result.intersection_with(combine, other);
+    result.intersection_with(combine, other, memoization_id);
     return result;
   }
 
@@ -338,6 +354,14 @@ class PatriciaTree {
   virtual bool is_leaf() const = 0;
 
   bool is_branch() const { return !is_leaf(); }
+
+  // Hash-consed trees are equal if and only if they are the same object.
+  bool is_hash_consed() const { return m_hash_consed; }
+
+  void set_hash_consed() { m_hash_consed = true; }
+
+ private:
+  bool m_hash_consed{false};
 };
 
 template <typename IntegerType, typename Value>
@@ -395,6 +419,68 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType, Value> {
   friend class ptmap_impl::PatriciaTreeIterator;
 };
 
+// All the nodes are created by the following two functions, which take care of
+// hash-consing. A branch can only be hash-consed if both its subtrees are.
+// Since values aren't required to be hashable, leaves are hashed on their key
+// only; the hash-consing table bounds the number of values per key.
+template <typename IntegerType, typename Value>
+std::shared_ptr<PatriciaTreeLeaf<IntegerType, Value>> new_leaf(
+    IntegerType key, const typename Value::type& value) {
+  using Leaf = PatriciaTreeLeaf<IntegerType, Value>;
+  if (!is_hash_consing_enabled()) {
+    return std::make_shared<Leaf>(key, value);
+  }
+  return HashConsingTable<Leaf>::get().intern(
+      boost::hash<IntegerType>()(key),
+      [&](const Leaf& leaf) {
+        return leaf.key() == key && Value::equals(leaf.value(), value);
+      },
+      [&](bool interned) {
+        // Not using make_shared, so that the memory of a dead node is freed
+        // even though the table still holds a weak reference to it.
+        std::shared_ptr<Leaf> leaf(new Leaf(key, value));
+        if (interned) {
+          leaf->set_hash_consed();
+        }
+        return leaf;
+      });
+}
+
+template <typename IntegerType, typename Value>
+std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>> new_branch(
+    IntegerType prefix,
+    IntegerType branching_bit,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> left_tree,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> right_tree) {
+  using Branch = PatriciaTreeBranch<IntegerType, Value>;
+  if (!is_hash_consing_enabled() || !left_tree->is_hash_consed() ||
+      !right_tree->is_hash_consed()) {
+    return std::make_shared<Branch>(
+        prefix, branching_bit, left_tree, right_tree);
+  }
+  size_t hash = 0;
+  boost::hash_combine(hash, prefix);
+  boost::hash_combine(hash, branching_bit);
+  boost::hash_combine(hash, left_tree.get());
+  boost::hash_combine(hash, right_tree.get());
+  return HashConsingTable<Branch>::get().intern(
+      hash,
+      [&](const Branch& branch) {
+        return branch.prefix() == prefix &&
+               branch.branching_bit() == branching_bit &&
+               branch.left_tree() == left_tree &&
+               branch.right_tree() == right_tree;
+      },
+      [&](bool interned) {
+        std::shared_ptr<Branch> branch(
+            new Branch(prefix, branching_bit, left_tree, right_tree));
+        if (interned) {
+          branch->set_hash_consed();
+        }
+        return branch;
+      });
+}
+
 template <typename IntegerType, typename Value>
 std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>> join(
     IntegerType prefix0,
@@ -403,10 +489,10 @@ std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>> join(
     std::shared_ptr<PatriciaTree<IntegerType, Value>> tree1) {
   IntegerType m = get_branching_bit(prefix0, prefix1);
   if (is_zero_bit(prefix0, m)) {
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return new_branch<IntegerType, Value>(
         mask(prefix0, m), m, tree0, tree1);
   } else {
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return new_branch<IntegerType, Value>(
         mask(prefix0, m), m, tree1, tree0);
   }
 }
@@ -425,7 +511,7 @@ std::shared_ptr<PatriciaTree<IntegerType, Value>> make_branch(
   if (right_tree == nullptr) {
     return left_tree;
   }
-  return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+  return new_branch<IntegerType, Value>(
       prefix, branching_bit, left_tree, right_tree);
 }
 
@@ -527,6 +613,9 @@ inline bool equals(std::shared_ptr<PatriciaTree<IntegerType, Value>> tree1,
   if (tree2 == nullptr) {
     return false;
   }
+  if (tree1->is_hash_consed() && tree2->is_hash_consed()) {
+    return false;
+  }
   if (tree1->is_leaf()) {
     if (tree2->is_branch()) {
       return false;
@@ -605,13 +694,72 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> update(
   return join<IntegerType, Value>(key, new_leaf, branch->prefix(), branch);
 }
 
+// The union and intersection of two hash-consed branches are memoized when the
+// combining function has a memoization id. The operations on leaves are cheap
+// enough not to be worth caching.
+template <typename IntegerType, typename Value>
+inline bool is_memoizable(
+    size_t memoization_id,
+    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
+    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t) {
+  return memoization_id != 0 && s != nullptr && t != nullptr && s != t &&
+         s->is_branch() && t->is_branch() && s->is_hash_consed() &&
+         t->is_hash_consed();
+}
+
+template <typename IntegerType, typename Value>
+inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge_trees(
+    const ptmap_impl::CombiningFunction<typename Value::type>& combine,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> s,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> t,
+    size_t memoization_id);
+
+template <typename IntegerType, typename Value>
+inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect_trees(
+    const ptmap_impl::CombiningFunction<typename Value::type>& combine,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> s,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> t,
+    size_t memoization_id);
+
+template <typename IntegerType, typename Value>
+inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
+    const ptmap_impl::CombiningFunction<typename Value::type>& combine,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> s,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> t,
+    size_t memoization_id) {
+  if (!is_memoizable(memoization_id, s, t)) {
+    return merge_trees(combine, s, t, memoization_id);
+  }
+  // The same id may be used for a union and an intersection.
+  return OperationCache<PatriciaTree<IntegerType, Value>>::get().memoize(
+      2 * memoization_id, s, t, [&]() {
+        return merge_trees(combine, s, t, memoization_id);
+      });
+}
+
+template <typename IntegerType, typename Value>
+inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
+    const ptmap_impl::CombiningFunction<typename Value::type>& combine,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> s,
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> t,
+    size_t memoization_id) {
+  if (!is_memoizable(memoization_id, s, t)) {
+    return intersect_trees(combine, s, t, memoization_id);
+  }
+  return OperationCache<PatriciaTree<IntegerType, Value>>::get().memoize(
+      2 * memoization_id + 1, s, t, [&]() {
+        return intersect_trees(combine, s, t, memoization_id);
+      });
+}
+
 // We keep the notations of the paper so as to make the implementation easier
 // to follow.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
+inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge_trees(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     std::shared_ptr<PatriciaTree<IntegerType, Value>> s,
-    std::shared_ptr<PatriciaTree<IntegerType, Value>> t) {
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> t,
+    size_t memoization_id) {
   if (s == t) {
     // This conditional is what allows the union operation to complete in
     // sublinear time when the operands share some structure.
@@ -647,50 +795,50 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
   auto t1 = t_branch->right_tree();
   if (m == n && p == q) {
     // The two trees have the same prefix. We just merge the subtrees.
-    auto new_left = merge(combine, s0, t0);
-    auto new_right = merge(combine, s1, t1);
+    auto new_left = merge(combine, s0, t0, memoization_id);
+    auto new_right = merge(combine, s1, t1, memoization_id);
     if (new_left == s0 && new_right == s1) {
       return s;
     }
     if (new_left == t0 && new_right == t1) {
       return t;
     }
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return new_branch<IntegerType, Value>(
         p, m, new_left, new_right);
   }
   if (m < n && match_prefix(q, p, m)) {
     // q contains p. Merge t with a subtree of s.
     if (is_zero_bit(q, m)) {
-      auto new_left = merge(combine, s0, t);
+      auto new_left = merge(combine, s0, t, memoization_id);
       if (s0 == new_left) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return new_branch<IntegerType, Value>(
           p, m, new_left, s1);
     } else {
-      auto new_right = merge(combine, s1, t);
+      auto new_right = merge(combine, s1, t, memoization_id);
       if (s1 == new_right) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return new_branch<IntegerType, Value>(
           p, m, s0, new_right);
     }
   }
   if (m > n && match_prefix(p, q, n)) {
     // p contains q. Merge s with a subtree of t.
     if (is_zero_bit(p, n)) {
-      auto new_left = merge(combine, s, t0);
+      auto new_left = merge(combine, s, t0, memoization_id);
       if (t0 == new_left) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return new_branch<IntegerType, Value>(
           q, n, new_left, t1);
     } else {
-      auto new_right = merge(combine, s, t1);
+      auto new_right = merge(combine, s, t1, memoization_id);
       if (t1 == new_right) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return new_branch<IntegerType, Value>(
           q, n, t0, new_right);
     }
   }
@@ -709,8 +857,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_leaf(
     return nullptr;
   }
   if (!combined_value.equals(leaf->value())) {
-    return std::make_shared<PatriciaTreeLeaf<IntegerType, Value>>(
-        leaf->key(), combined_value);
+    return new_leaf<IntegerType, Value>(leaf->key(), combined_value);
   }
   return leaf;
 }
@@ -721,16 +868,21 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value) {
-  auto new_leaf = std::make_shared<PatriciaTreeLeaf<IntegerType, Value>>(
-      key, Value::default_value());
-  return combine_leaf(combine, value, new_leaf);
+  // This is combine_leaf() applied to a leaf bound to the default value,
+  // without creating that leaf.
+  auto combined_value = combine(Value::default_value(), value);
+  if (combined_value.is_top()) {
+    return nullptr;
+  }
+  return new_leaf<IntegerType, Value>(key, combined_value);
 }
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
+inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect_trees(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     std::shared_ptr<PatriciaTree<IntegerType, Value>> s,
-    std::shared_ptr<PatriciaTree<IntegerType, Value>> t) {
+    std::shared_ptr<PatriciaTree<IntegerType, Value>> t,
+    size_t memoization_id) {
   if (s == t) {
     // This conditional is what allows the intersection operation to complete in
     // sublinear time when the operands share some structure.
@@ -787,16 +939,19 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
           }
           always_assert_log(false, "Malformed Patricia tree.\n");
         },
-        intersect(combine, s0, t0),
-        intersect(combine, s1, t1));
+        intersect(combine, s0, t0, memoization_id),
+        intersect(combine, s1, t1, memoization_id),
+        /* memoization_id */ 0);
   }
   if (m < n && match_prefix(q, p, m)) {
     // q contains p. Intersect t with a subtree of s.
-    return intersect(combine, is_zero_bit(q, m) ? s0 : s1, t);
+    return intersect(
+        combine, is_zero_bit(q, m) ? s0 : s1, t, memoization_id);
   }
   if (m > n && match_prefix(p, q, n)) {
     // p contains q. Intersect s with a subtree of t.
-    return intersect(combine, s, is_zero_bit(p, n) ? t0 : t1);
+    return intersect(
+        combine, s, is_zero_bit(p, n) ? t0 : t1, memoization_id);
   }
   // The prefixes disagree.
   return nullptr;
@@ -232,22 +232,30 @@ class MapValue final : public AbstractValue<MapValue<Variable, Domain>> {
 
   Kind join_with(const MapValue& other) override {
     return join_like_operation(
-        other, [](const Domain& x, const Domain& y) { return x.join(y); });
+        other,
+        [](const Domain& x, const Domain& y) { return x.join(y); },
+        JOIN_ID);
   }
 
   Kind widen_with(const MapValue& other) override {
     return join_like_operation(
-        other, [](const Domain& x, const Domain& y) { return x.join(y); });
+        other,
+        [](const Domain& x, const Domain& y) { return x.join(y); },
+        WIDEN_ID);
   }
 
   Kind meet_with(const MapValue& other) override {
     return meet_like_operation(
-        other, [](const Domain& x, const Domain& y) { return x.meet(y); });
+        other,
+        [](const Domain& x, const Domain& y) { return x.meet(y); },
+        MEET_ID);
   }
 
   Kind narrow_with(const MapValue& other) override {
     return meet_like_operation(
-        other, [](const Domain& x, const Domain& y) { return x.meet(y); });
+        other,
+        [](const Domain& x, const Domain& y) { return x.meet(y); },
+        NARROW_ID);
   }
 
  private:
@@ -256,16 +264,25 @@ class MapValue final : public AbstractValue<MapValue<Variable, Domain>> {
     m_map.insert_or_assign(variable, value);
   }
 
+  // The ids under which the results of the lattice operations on the
+  // underlying maps are memoized (see PatriciaTreeMap::union_with()).
+  static constexpr size_t JOIN_ID = 1;
+  static constexpr size_t WIDEN_ID = 2;
+  static constexpr size_t MEET_ID = 3;
+  static constexpr size_t NARROW_ID = 4;
+
   Kind join_like_operation(
       const MapValue& other,
-      std::function<Domain(const Domain&, const Domain&)> operation) {
-    m_map.intersection_with(operation, other.m_map);
+      std::function<Domain(const Domain&, const Domain&)> operation,
+      size_t memoization_id) {
+    m_map.intersection_with(operation, other.m_map, memoization_id);
     return kind();
   }
 
   Kind meet_like_operation(
       const MapValue& other,
-      std::function<Domain(const Domain&, const Domain&)> operation) {
+      std::function<Domain(const Domain&, const Domain&)> operation,
+      size_t memoization_id) {
     try {
       m_map.union_with(
           [&operation](const Domain& x, const Domain& y) {
@@ -275,7 +292,8 @@ class MapValue final : public AbstractValue<MapValue<Variable, Domain>> {
             }
             return result;
           },
-          other.m_map);
+          other.m_map,
+          memoization_id);
       return kind();
     } catch (const value_is_bottom&) {
       clear();
@@ -22,6 +22,7 @@
 #include <boost/functional/hash.hpp>
 
 #include "Debug.h"
+#include "PatriciaTreeHashConsing.h"
 #include "PatriciaTreeUtil.h"
 #include "Util.h"
 
@@ -328,8 +329,14 @@ class PatriciaTree {
 
   void set_hash(size_t h) { m_hash = h; }
 
+  // Hash-consed trees are equal if and only if they are the same object.
+  bool is_hash_consed() const { return m_hash_consed; }
+
+  void set_hash_consed() { m_hash_consed = true; }
+
  private:
   size_t m_hash;
+  bool m_hash_consed{false};
 };
 
 // This defines an internal node of a Patricia tree. Patricia trees are
@@ -351,12 +358,20 @@ class PatriciaTreeBranch final : public PatriciaTree<IntegerType> {
         m_branching_bit(branching_bit),
         m_left_tree(left_tree),
         m_right_tree(right_tree) {
+    this->set_hash(compute_hash(
+        prefix, branching_bit, left_tree->hash(), right_tree->hash()));
+  }
+
+  static size_t compute_hash(IntegerType prefix,
+                             IntegerType branching_bit,
+                             size_t left_hash,
+                             size_t right_hash) {
     size_t seed = 0;
-    boost::hash_combine(seed, m_prefix);
-    boost::hash_combine(seed, m_branching_bit);
-    boost::hash_combine(seed, left_tree->hash());
-    boost::hash_combine(seed, right_tree->hash());
-    this->set_hash(seed);
+    boost::hash_combine(seed, prefix);
+    boost::hash_combine(seed, branching_bit);
+    boost::hash_combine(seed, left_hash);
+    boost::hash_combine(seed, right_hash);
+    return seed;
   }
 
   bool is_leaf() const override { return false; }
@@ -396,6 +411,59 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType> {
   IntegerType m_key;
 };
 
+// All the nodes are created by the following two functions, which take care of
+// hash-consing. A branch can only be hash-consed if both its subtrees are.
+template <typename IntegerType>
+std::shared_ptr<PatriciaTreeLeaf<IntegerType>> new_leaf(IntegerType key) {
+  using Leaf = PatriciaTreeLeaf<IntegerType>;
+  if (!is_hash_consing_enabled()) {
+    return std::make_shared<Leaf>(key);
+  }
+  return HashConsingTable<Leaf>::get().intern(
+      boost::hash<IntegerType>()(key),
+      [key](const Leaf& leaf) { return leaf.key() == key; },
+      [key](bool interned) {
+        // Not using make_shared, so that the memory of a dead node is freed
+        // even though the table still holds a weak reference to it.
+        std::shared_ptr<Leaf> leaf(new Leaf(key));
+        if (interned) {
+          leaf->set_hash_consed();
+        }
+        return leaf;
+      });
+}
+
+template <typename IntegerType>
+std::shared_ptr<PatriciaTreeBranch<IntegerType>> new_branch(
+    IntegerType prefix,
+    IntegerType branching_bit,
+    std::shared_ptr<PatriciaTree<IntegerType>> left_tree,
+    std::shared_ptr<PatriciaTree<IntegerType>> right_tree) {
+  using Branch = PatriciaTreeBranch<IntegerType>;
+  if (!is_hash_consing_enabled() || !left_tree->is_hash_consed() ||
+      !right_tree->is_hash_consed()) {
+    return std::make_shared<Branch>(
+        prefix, branching_bit, left_tree, right_tree);
+  }
+  return HashConsingTable<Branch>::get().intern(
+      Branch::compute_hash(
+          prefix, branching_bit, left_tree->hash(), right_tree->hash()),
+      [&](const Branch& branch) {
+        return branch.prefix() == prefix &&
+               branch.branching_bit() == branching_bit &&
+               branch.left_tree() == left_tree &&
+               branch.right_tree() == right_tree;
+      },
+      [&](bool interned) {
+        std::shared_ptr<Branch> branch(
+            new Branch(prefix, branching_bit, left_tree, right_tree));
+        if (interned) {
+          branch->set_hash_consed();
+        }
+        return branch;
+      });
+}
+
 template <typename IntegerType>
 std::shared_ptr<PatriciaTreeBranch<IntegerType>> join(
     IntegerType prefix0,
@@ -404,10 +472,10 @@ std::shared_ptr<PatriciaTreeBranch<IntegerType>> join(
     std::shared_ptr<PatriciaTree<IntegerType>> tree1) {
   IntegerType m = get_branching_bit(prefix0, prefix1);
   if (is_zero_bit(prefix0, m)) {
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return new_branch<IntegerType>(
         mask(prefix0, m), m, tree0, tree1);
   } else {
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return new_branch<IntegerType>(
         mask(prefix0, m), m, tree1, tree0);
   }
 }
@@ -426,7 +494,7 @@ std::shared_ptr<PatriciaTree<IntegerType>> make_branch(
   if (right_tree == nullptr) {
     return left_tree;
   }
-  return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+  return new_branch<IntegerType>(
       prefix, branching_bit, left_tree, right_tree);
 }
 
@@ -508,6 +576,9 @@ inline bool equals(std::shared_ptr<PatriciaTree<IntegerType>> tree1,
   if (tree2 == nullptr) {
     return false;
   }
+  if (tree1->is_hash_consed() && tree2->is_hash_consed()) {
+    return false;
+  }
   // Since the hash codes are readily available (they're computed when the trees
   // are constructed), we can use them to cut short the equality test.
   if (tree1->hash() != tree2->hash()) {
@@ -538,7 +609,7 @@ template <typename IntegerType>
 inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
     IntegerType key, std::shared_ptr<PatriciaTree<IntegerType>> tree) {
   if (tree == nullptr) {
-    return std::make_shared<PatriciaTreeLeaf<IntegerType>>(key);
+    return new_leaf<IntegerType>(key);
   }
   if (tree->is_leaf()) {
     auto leaf = std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree);
@@ -547,7 +618,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
     }
     return join<IntegerType>(
         key,
-        std::make_shared<PatriciaTreeLeaf<IntegerType>>(key),
+        new_leaf<IntegerType>(key),
         leaf->key(),
         leaf);
   }
@@ -558,7 +629,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
       if (new_left_tree == branch->left_tree()) {
         return branch;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           branch->prefix(),
           branch->branching_bit(),
           new_left_tree,
@@ -568,7 +639,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
       if (new_right_tree == branch->right_tree()) {
         return branch;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           branch->prefix(),
           branch->branching_bit(),
           branch->left_tree(),
@@ -576,7 +647,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
     }
   }
   return join<IntegerType>(key,
-                           std::make_shared<PatriciaTreeLeaf<IntegerType>>(key),
+                           new_leaf<IntegerType>(key),
                            branch->prefix(),
                            branch);
 }
@@ -644,10 +715,54 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> filter(
   }
 }
 
+// The union and intersection of two hash-consed branches are memoized. The
+// operations on leaves are cheap enough not to be worth caching.
+constexpr size_t UNION_OPERATION = 1;
+constexpr size_t INTERSECTION_OPERATION = 2;
+
+template <typename IntegerType>
+inline bool is_memoizable(const std::shared_ptr<PatriciaTree<IntegerType>>& s,
+                          const std::shared_ptr<PatriciaTree<IntegerType>>& t) {
+  return s != nullptr && t != nullptr && s != t && s->is_branch() &&
+         t->is_branch() && s->is_hash_consed() && t->is_hash_consed();
+}
+
+template <typename IntegerType>
+inline std::shared_ptr<PatriciaTree<IntegerType>> merge_trees(
+    std::shared_ptr<PatriciaTree<IntegerType>> s,
+    std::shared_ptr<PatriciaTree<IntegerType>> t);
+
+template <typename IntegerType>
+inline std::shared_ptr<PatriciaTree<IntegerType>> intersect_trees(
+    std::shared_ptr<PatriciaTree<IntegerType>> s,
+    std::shared_ptr<PatriciaTree<IntegerType>> t);
+
+template <typename IntegerType>
+inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
+    std::shared_ptr<PatriciaTree<IntegerType>> s,
+    std::shared_ptr<PatriciaTree<IntegerType>> t) {
+  if (!is_memoizable(s, t)) {
+    return merge_trees(s, t);
+  }
+  return OperationCache<PatriciaTree<IntegerType>>::get().memoize(
+      UNION_OPERATION, s, t, [&]() { return merge_trees(s, t); });
+}
+
+template <typename IntegerType>
+inline std::shared_ptr<PatriciaTree<IntegerType>> intersect(
+    std::shared_ptr<PatriciaTree<IntegerType>> s,
+    std::shared_ptr<PatriciaTree<IntegerType>> t) {
+  if (!is_memoizable(s, t)) {
+    return intersect_trees(s, t);
+  }
+  return OperationCache<PatriciaTree<IntegerType>>::get().memoize(
+      INTERSECTION_OPERATION, s, t, [&]() { return intersect_trees(s, t); });
+}
+
 // We keep the notations of the paper so as to make the implementation easier
 // to follow.
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
+inline std::shared_ptr<PatriciaTree<IntegerType>> merge_trees(
     std::shared_ptr<PatriciaTree<IntegerType>> s,
     std::shared_ptr<PatriciaTree<IntegerType>> t) {
   if (s == t) {
@@ -692,7 +807,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
     if (new_left == t0 && new_right == t1) {
       return t;
     }
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return new_branch<IntegerType>(
         p, m, new_left, new_right);
   }
   if (m < n && match_prefix(q, p, m)) {
@@ -702,14 +817,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
       if (s0 == new_left) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           p, m, new_left, s1);
     } else {
       auto new_right = merge(s1, t);
       if (s1 == new_right) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           p, m, s0, new_right);
     }
   }
@@ -720,14 +835,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
       if (t0 == new_left) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           q, n, new_left, t1);
     } else {
       auto new_right = merge(s, t1);
       if (t1 == new_right) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           q, n, t0, new_right);
     }
   }
@@ -736,7 +851,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> intersect(
+inline std::shared_ptr<PatriciaTree<IntegerType>> intersect_trees(
     std::shared_ptr<PatriciaTree<IntegerType>> s,
     std::shared_ptr<PatriciaTree<IntegerType>> t) {
   if (s == t) {
@@ -10,8 +10,12 @@
 #include "PointsToSemantics.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <deque>
+#include <fstream>
 #include <iomanip>
 #include <iterator>
 #include <limits>
@@ -41,9 +45,175 @@
 #include "PatriciaTreeSetAbstractDomain.h"
 #include "PointsToSemanticsUtils.h"
 #include "RedexContext.h"
+#include "Show.h"
 #include "Trace.h"
 #include "Walkers.h"
 
+namespace pts_impl {
+
+const uint32_t kCacheMagic = 0x70786472; // "rdxp"
+const uint32_t kCacheVersion = 1;
+
+/*
+ * The binary encoding is a sequence of 32-bit words, preceded by a table of
+ * the strings it refers to (type, field and method descriptors and string
+ * constants). A string is encoded as its index in the table, so each one is
+ * stored only once.
+ */
+class BinaryWriter {
+ public:
+  void write_u32(uint32_t word) { m_words.push_back(word); }
+
+  void write_u64(uint64_t word) {
+    write_u32(static_cast<uint32_t>(word));
+    write_u32(static_cast<uint32_t>(word >> 32));
+  }
+
+  void write_string(const std::string& str) {
+    auto status = m_string_ids.emplace(str, m_strings.size());
+    if (status.second) {
+      m_strings.push_back(&status.first->first);
+    }
+    write_u32(status.first->second);
+  }
+
+  // Writes the header and the string table, followed by the words written so
+  // far.
+  void write_to(FILE* fd) const {
+    uint32_t header[] = {kCacheMagic, kCacheVersion,
+                         static_cast<uint32_t>(m_strings.size())};
+    fwrite(header, sizeof(uint32_t), 3, fd);
+    static const char padding[4] = {};
+    for (const std::string* str : m_strings) {
+      uint32_t size = str->size();
+      fwrite(&size, sizeof(uint32_t), 1, fd);
+      fwrite(str->data(), 1, size, fd);
+      fwrite(padding, 1, (4 - size % 4) % 4, fd);
+    }
+    fwrite(m_words.data(), sizeof(uint32_t), m_words.size(), fd);
+  }
+
+ private:
+  std::vector<uint32_t> m_words;
+  std::unordered_map<std::string, uint32_t> m_string_ids;
+  std::vector<const std::string*> m_strings;
+};
+
+class BinaryReader {
+ public:
+  explicit BinaryReader(const std::string& buffer)
+      : m_cur(buffer.data()), m_end(buffer.data() + buffer.size()) {}
+
+  // Reads the header and the string table. Returns false if the buffer was
+  // not written by this version of BinaryWriter.
+  bool read_header() {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t string_count;
+    if (!read_u32(&magic) || magic != kCacheMagic || !read_u32(&version) ||
+        version != kCacheVersion || !read_u32(&string_count)) {
+      return false;
+    }
+    m_strings.reserve(string_count);
+    for (uint32_t i = 0; i < string_count; ++i) {
+      uint32_t size;
+      if (!read_u32(&size)) {
+        return false;
+      }
+      size_t padded_size = size + (4 - size % 4) % 4;
+      if ((size_t)(m_end - m_cur) < padded_size) {
+        return false;
+      }
+      m_strings.emplace_back(m_cur, size);
+      m_cur += padded_size;
+    }
+    return true;
+  }
+
+  bool at_end() const { return m_cur == m_end; }
+
+  bool read_u32(uint32_t* word) {
+    if ((size_t)(m_end - m_cur) < sizeof(uint32_t)) {
+      return false;
+    }
+    memcpy(word, m_cur, sizeof(uint32_t));
+    m_cur += sizeof(uint32_t);
+    return true;
+  }
+
+  bool read_u64(uint64_t* word) {
+    uint32_t low;
+    uint32_t high;
+    if (!read_u32(&low) || !read_u32(&high)) {
+      return false;
+    }
+    *word = (static_cast<uint64_t>(high) << 32) | low;
+    return true;
+  }
+
+  bool read_string(const std::string** str) {
+    uint32_t id;
+    if (!read_u32(&id) || id >= m_strings.size()) {
+      return false;
+    }
+    *str = &m_strings[id];
+    return true;
+  }
+
+ private:
+  const char* m_cur;
+  const char* m_end;
+  std::vector<std::string> m_strings;
+};
+
+void hash_type(const DexType* dex_type, size_t* hash) {
+  boost::hash_combine(*hash, dex_type->get_name()->str());
+}
+
+// Hashes the instruction by value. Unlike IRInstruction::hash(), which hashes
+// the pointers to the types, fields and methods it refers to, this is stable
+// across runs.
+void hash_insn(const IRInstruction* insn, size_t* hash) {
+  boost::hash_combine(*hash, insn->opcode());
+  for (size_t i = 0; i < insn->srcs_size(); ++i) {
+    boost::hash_combine(*hash, insn->src(i));
+  }
+  if (insn->dests_size() > 0) {
+    boost::hash_combine(*hash, insn->dest());
+  }
+  if (insn->has_literal()) {
+    boost::hash_combine(*hash, insn->get_literal());
+  }
+  if (insn->has_string()) {
+    boost::hash_combine(*hash, insn->get_string()->str());
+  }
+  if (insn->has_type()) {
+    hash_type(insn->get_type(), hash);
+  }
+  if (insn->has_field()) {
+    const DexFieldRef* dex_field = insn->get_field();
+    hash_type(dex_field->get_class(), hash);
+    boost::hash_combine(*hash, dex_field->get_name()->str());
+    hash_type(dex_field->get_type(), hash);
+  }
+  if (insn->has_method()) {
+    const DexMethodRef* dex_method = insn->get_method();
+    hash_type(dex_method->get_class(), hash);
+    boost::hash_combine(*hash, dex_method->get_name()->str());
+    const DexProto* proto = dex_method->get_proto();
+    hash_type(proto->get_rtype(), hash);
+    for (const DexType* arg : proto->get_args()->get_type_list()) {
+      hash_type(arg, hash);
+    }
+  }
+  if (insn->has_data()) {
+    const auto* data = insn->get_data();
+    boost::hash_range(*hash, data->data(), data->data() + data->data_size());
+  }
+}
+
+} // namespace pts_impl
+
 s_expr PointsToVariable::to_s_expr() const {
   return s_expr({s_expr("V"), s_expr(m_id)});
 }
@@ -57,6 +227,19 @@ boost::optional<PointsToVariable> PointsToVariable::from_s_expr(
   return {PointsToVariable(id)};
 }
 
+void PointsToVariable::write_binary(pts_impl::BinaryWriter* out) const {
+  out->write_u32(static_cast<uint32_t>(m_id));
+}
+
+boost::optional<PointsToVariable> PointsToVariable::read_binary(
+    pts_impl::BinaryReader* in) {
+  uint32_t id;
+  if (!in->read_u32(&id)) {
+    return {};
+  }
+  return {PointsToVariable(static_cast<int32_t>(id))};
+}
+
 size_t hash_value(const PointsToVariable& v) {
   boost::hash<int32_t> hasher;
   return hasher(v.m_id);
@@ -325,6 +508,117 @@ boost::optional<PointsToOperation> PointsToOperation::from_s_expr(
   }
 }
 
+void PointsToOperation::write_binary(pts_impl::BinaryWriter* out) const {
+  out->write_u32(kind);
+  switch (kind) {
+  case PTS_CONST_STRING: {
+    out->write_string(dex_string->str());
+    break;
+  }
+  case PTS_CONST_CLASS:
+  case PTS_NEW_OBJECT:
+  case PTS_CHECK_CAST: {
+    out->write_string(dex_type->get_name()->str());
+    break;
+  }
+  case PTS_GET_EXCEPTION:
+  case PTS_GET_CLASS:
+  case PTS_RETURN:
+  case PTS_DISJUNCTION: {
+    break;
+  }
+  case PTS_LOAD_PARAM: {
+    out->write_u32(static_cast<uint32_t>(parameter));
+    break;
+  }
+  case PTS_IGET:
+  case PTS_SGET:
+  case PTS_IPUT:
+  case PTS_SPUT: {
+    out->write_string(show(dex_field));
+    break;
+  }
+  case PTS_IGET_SPECIAL:
+  case PTS_IPUT_SPECIAL: {
+    out->write_u32(special_edge);
+    break;
+  }
+  case PTS_INVOKE_VIRTUAL:
+  case PTS_INVOKE_SUPER:
+  case PTS_INVOKE_DIRECT:
+  case PTS_INVOKE_INTERFACE:
+  case PTS_INVOKE_STATIC: {
+    out->write_string(show(dex_method));
+    break;
+  }
+  }
+}
+
+boost::optional<PointsToOperation> PointsToOperation::read_binary(
+    pts_impl::BinaryReader* in) {
+  uint32_t kind_word;
+  if (!in->read_u32(&kind_word) || kind_word > PTS_DISJUNCTION) {
+    return {};
+  }
+  auto op_kind = static_cast<PointsToOperationKind>(kind_word);
+  const std::string* str;
+  uint32_t word;
+  switch (op_kind) {
+  case PTS_CONST_STRING: {
+    if (!in->read_string(&str)) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, DexString::make_string(*str))};
+  }
+  case PTS_CONST_CLASS:
+  case PTS_NEW_OBJECT:
+  case PTS_CHECK_CAST: {
+    if (!in->read_string(&str)) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, DexType::make_type(str->c_str()))};
+  }
+  case PTS_GET_EXCEPTION:
+  case PTS_GET_CLASS:
+  case PTS_RETURN:
+  case PTS_DISJUNCTION: {
+    return {PointsToOperation(op_kind)};
+  }
+  case PTS_LOAD_PARAM: {
+    if (!in->read_u32(&word)) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, static_cast<size_t>(word))};
+  }
+  case PTS_IGET:
+  case PTS_SGET:
+  case PTS_IPUT:
+  case PTS_SPUT: {
+    if (!in->read_string(&str)) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, DexField::make_field(*str))};
+  }
+  case PTS_IGET_SPECIAL:
+  case PTS_IPUT_SPECIAL: {
+    if (!in->read_u32(&word) || word != PTS_ARRAY_ELEMENT) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, static_cast<SpecialPointsToEdge>(word))};
+  }
+  case PTS_INVOKE_VIRTUAL:
+  case PTS_INVOKE_SUPER:
+  case PTS_INVOKE_DIRECT:
+  case PTS_INVOKE_INTERFACE:
+  case PTS_INVOKE_STATIC: {
+    if (!in->read_string(&str)) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, DexMethod::make_method(*str))};
+  }
+  }
+}
+
 namespace pts_impl {
 
 // A wrapper for a set of variables. We use this structure for the generation of
@@ -516,6 +810,40 @@ boost::optional<PointsToAction> PointsToAction::from_s_expr(const s_expr& e) {
   return {PointsToAction(*operation_opt, arguments)};
 }
 
+void PointsToAction::write_binary(pts_impl::BinaryWriter* out) const {
+  m_operation.write_binary(out);
+  out->write_u32(m_arguments.size());
+  for (const auto& arg : m_arguments) {
+    out->write_u32(static_cast<uint32_t>(arg.first));
+    arg.second.write_binary(out);
+  }
+}
+
+boost::optional<PointsToAction> PointsToAction::read_binary(
+    pts_impl::BinaryReader* in) {
+  auto operation_opt = PointsToOperation::read_binary(in);
+  uint32_t arg_count;
+  if (!operation_opt || !in->read_u32(&arg_count)) {
+    return {};
+  }
+  std::vector<std::pair<int32_t, PointsToVariable>> arguments;
+  for (uint32_t i = 0; i < arg_count; ++i) {
+    uint32_t arg;
+    if (!in->read_u32(&arg)) {
+      return {};
+    }
+    auto var_opt = PointsToVariable::read_binary(in);
+    // The arguments were written in key order, without duplicates.
+    if (!var_opt ||
+        (!arguments.empty() &&
+         arguments.back().first >= static_cast<int32_t>(arg))) {
+      return {};
+    }
+    arguments.push_back({static_cast<int32_t>(arg), *var_opt});
+  }
+  return {PointsToAction(*operation_opt, arguments)};
+}
+
 namespace pts_impl {
 
 std::string special_edge_to_string(SpecialPointsToEdge e) {
@@ -1536,6 +1864,41 @@ boost::optional<PointsToMethodSemantics> PointsToMethodSemantics::from_s_expr(
   return boost::optional<PointsToMethodSemantics>(semantics);
 }
 
+void PointsToMethodSemantics::write_binary(pts_impl::BinaryWriter* out) const {
+  out->write_string(show(m_dex_method));
+  out->write_u32(m_kind);
+  out->write_u32(static_cast<uint32_t>(m_variable_counter));
+  out->write_u32(m_points_to_actions.size());
+  for (const auto& action : m_points_to_actions) {
+    action.write_binary(out);
+  }
+}
+
+boost::optional<PointsToMethodSemantics> PointsToMethodSemantics::read_binary(
+    pts_impl::BinaryReader* in) {
+  const std::string* dex_method_str;
+  uint32_t kind;
+  uint32_t var_counter;
+  uint32_t action_count;
+  if (!in->read_string(&dex_method_str) || !in->read_u32(&kind) ||
+      kind > PTS_STUB || !in->read_u32(&var_counter) ||
+      !in->read_u32(&action_count)) {
+    return {};
+  }
+  PointsToMethodSemantics semantics(DexMethod::make_method(*dex_method_str),
+                                    static_cast<MethodKind>(kind),
+                                    var_counter,
+                                    action_count);
+  for (uint32_t i = 0; i < action_count; ++i) {
+    auto action_opt = PointsToAction::read_binary(in);
+    if (!action_opt) {
+      return {};
+    }
+    semantics.add(*action_opt);
+  }
+  return boost::optional<PointsToMethodSemantics>(semantics);
+}
+
 std::ostream& operator<<(std::ostream& o, const PointsToMethodSemantics& s) {
   o << s.m_dex_method->get_class()->get_name()->str() << "#"
     << s.m_dex_method->get_name()->str() << ": "
@@ -1565,6 +1928,40 @@ std::ostream& operator<<(std::ostream& o, const PointsToMethodSemantics& s) {
 
 PointsToSemantics::PointsToSemantics(const Scope& scope, bool generate_stubs)
     : m_generate_stubs(generate_stubs), m_type_system(scope) {
+  generate(scope, Cache());
+}
+
+PointsToSemantics::PointsToSemantics(const Scope& scope,
+                                     const std::string& cache_file,
+                                     bool generate_stubs)
+    : m_generate_stubs(generate_stubs), m_type_system(scope) {
+  Cache cache;
+  std::ifstream file_input(cache_file, std::ios::binary);
+  if (file_input) {
+    std::string buffer((std::istreambuf_iterator<char>(file_input)),
+                       std::istreambuf_iterator<char>());
+    pts_impl::BinaryReader reader(buffer);
+    if (reader.read_header()) {
+      while (!reader.at_end()) {
+        uint64_t code_hash;
+        always_assert_log(reader.read_u64(&code_hash),
+                          "Truncated points-to cache %s\n",
+                          cache_file.c_str());
+        auto semantics_opt = PointsToMethodSemantics::read_binary(&reader);
+        always_assert_log(semantics_opt, "Corrupt points-to cache %s\n",
+                          cache_file.c_str());
+        cache.emplace(show(semantics_opt->get_method()),
+                      std::make_pair(code_hash, *semantics_opt));
+      }
+    } else {
+      TRACE(PTA, 1, "Ignoring outdated points-to cache %s\n",
+            cache_file.c_str());
+    }
+  }
+  generate(scope, cache);
+}
+
+void PointsToSemantics::generate(const Scope& scope, const Cache& cache) {
   // We size the hash table so as to fit all the methods in scope.
   size_t method_count = 0;
   for (DexClass* dex_class : scope) {
@@ -1572,10 +1969,11 @@ PointsToSemantics::PointsToSemantics(const Scope& scope, bool generate_stubs)
         dex_class->get_dmethods().size() + dex_class->get_vmethods().size();
   }
   m_method_semantics.reserve(method_count);
+  m_code_hashes.reserve(method_count);
 
-  // We initialize all entries in the hash table, which can then be concurrently
-  // accessed by the workers using the thread-safe find() operation of
-  // std::unordered_map.
+  // We initialize all entries in the hash tables, which can then be
+  // concurrently accessed by the workers using the thread-safe find()
+  // operation of std::unordered_map.
   for (DexClass* dex_class : scope) {
     for (DexMethod* dmethod : dex_class->get_dmethods()) {
       initialize_entry(dmethod);
@@ -1586,9 +1984,30 @@ PointsToSemantics::PointsToSemantics(const Scope& scope, bool generate_stubs)
   }
 
   // We generate a system of points-to actions for each Dex method in parallel.
-  walk::parallel::methods(scope, [this](DexMethod* dex_method) {
-    generate_points_to_actions(dex_method);
+  std::atomic<size_t> cache_hits{0};
+  walk::parallel::methods(scope, [&](DexMethod* dex_method) {
+    if (generate_points_to_actions(dex_method, cache)) {
+      ++cache_hits;
+    }
   });
+  if (!cache.empty()) {
+    TRACE(PTA, 1, "Reused the points-to actions of %lu out of %lu methods\n",
+          cache_hits.load(), m_code_hashes.size());
+  }
+}
+
+void PointsToSemantics::write_cache(const std::string& file_name) const {
+  pts_impl::BinaryWriter writer;
+  for (const auto& entry : m_code_hashes) {
+    writer.write_u64(entry.second);
+    m_method_semantics.at(entry.first).write_binary(&writer);
+  }
+  FILE* fd = fopen(file_name.c_str(), "wb");
+  always_assert_log(fd, "Can't open points-to cache %s: %s\n",
+                    file_name.c_str(), strerror(errno));
+  writer.write_to(fd);
+  always_assert_log(!ferror(fd) && fclose(fd) == 0,
+                    "Failed writing points-to cache %s\n", file_name.c_str());
 }
 
 void PointsToSemantics::load_stubs(const std::string& file_name) {
@@ -1652,9 +2071,73 @@ void PointsToSemantics::initialize_entry(DexMethod* dex_method) {
                                                    /* kind */ kind,
                                                    /* start_var_id */ 0,
                                                    /* size_hint */ 8));
+  if (dex_method->get_code() != nullptr) {
+    m_code_hashes.emplace(dex_method, 0);
+  }
 }
 
-void PointsToSemantics::generate_points_to_actions(DexMethod* dex_method) {
+uint64_t PointsToSemantics::code_hash(DexMethod* dex_method) const {
+  IRCode* code = dex_method->get_code();
+  // Branches and try regions refer to other entries, which we identify by
+  // their position in the list so that the hash doesn't depend on addresses.
+  std::unordered_map<const MethodItemEntry*, size_t> positions;
+  for (const auto& mie : *code) {
+    positions.emplace(&mie, positions.size());
+  }
+  size_t hash = 0;
+  boost::hash_combine(hash, m_generate_stubs);
+  boost::hash_combine(hash, dex_method->get_access());
+  for (const auto& mie : *code) {
+    switch (mie.type) {
+    case MFLOW_OPCODE: {
+      IRInstruction* insn = mie.insn;
+      boost::hash_combine(hash, mie.type);
+      pts_impl::hash_insn(insn, &hash);
+      if (insn->opcode() == OPCODE_NEW_INSTANCE) {
+        // The generator models exceptions differently, so the class
+        // hierarchy is part of what the semantics depend on.
+        boost::hash_combine(
+            hash,
+            m_type_system.is_subtype(m_utils.get_throwable_type(),
+                                     insn->get_type()));
+      }
+      break;
+    }
+    case MFLOW_TARGET: {
+      boost::hash_combine(hash, mie.type);
+      boost::hash_combine(hash, mie.target->type);
+      boost::hash_combine(hash, mie.target->index);
+      boost::hash_combine(hash, positions.at(mie.target->src));
+      break;
+    }
+    case MFLOW_TRY: {
+      boost::hash_combine(hash, mie.type);
+      boost::hash_combine(hash, mie.tentry->type);
+      boost::hash_combine(hash, positions.at(mie.tentry->catch_start));
+      break;
+    }
+    case MFLOW_CATCH: {
+      boost::hash_combine(hash, mie.type);
+      boost::hash_combine(hash, show(mie.centry->catch_type));
+      if (mie.centry->next != nullptr) {
+        boost::hash_combine(hash, positions.at(mie.centry->next));
+      }
+      break;
+    }
+    case MFLOW_DEX_OPCODE:
+    case MFLOW_DEBUG:
+    case MFLOW_POSITION:
+    case MFLOW_FALLTHROUGH:
+      // These don't affect the points-to actions (building the CFG may even
+      // add or remove fallthrough entries).
+      break;
+    }
+  }
+  return hash;
+}
+
+bool PointsToSemantics::generate_points_to_actions(DexMethod* dex_method,
+                                                   const Cache& cache) {
   // According to section [container.requirements.dataraces] of the C++ standard
   // definition document, the find() method of std::unordered_map is
   // thread-safe. Since this function operates on a single Dex method and the
@@ -1665,10 +2148,19 @@ void PointsToSemantics::generate_points_to_actions(DexMethod* dex_method) {
   always_assert(entry != m_method_semantics.end());
   PointsToMethodSemantics* semantics = &entry->second;
   if (semantics->kind() == default_method_kind()) {
+    uint64_t hash = code_hash(dex_method);
+    m_code_hashes.find(dex_method)->second = hash;
+    auto cached = cache.find(show(dex_method));
+    if (cached != cache.end() && cached->second.first == hash) {
+      *semantics = cached->second.second;
+      return true;
+    }
+    TRACE(PTA, 3, "No cached points-to actions for %s\n", SHOW(dex_method));
     pts_impl::PointsToActionGenerator generator(
         dex_method, semantics, m_type_system, m_utils);
     generator.run();
   }
+  return false;
 }
 
 std::ostream& operator<<(std::ostream& o, const PointsToSemantics& s) {
@@ -13,6 +13,7 @@
 #include <cstdint>
 #include <initializer_list>
 #include <ostream>
+#include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -97,6 +98,15 @@
 // Forward declaration.
 class PointsToSemantics;
 
+namespace pts_impl {
+
+// The binary encoding of the points-to semantics used by the cache (see
+// PointsToSemantics::write_cache()).
+class BinaryWriter;
+class BinaryReader;
+
+} // namespace pts_impl
+
 /*
  * A points-to variable denotes a set of abstract object instances. It is
  * uniquely identified by a positive number.
@@ -122,6 +132,11 @@ class PointsToVariable final {
 
   static boost::optional<PointsToVariable> from_s_expr(const s_expr& e);
 
+  void write_binary(pts_impl::BinaryWriter* out) const;
+
+  static boost::optional<PointsToVariable> read_binary(
+      pts_impl::BinaryReader* in);
+
  private:
   static constexpr int32_t null_var_id() { return -1; }
 
@@ -297,6 +312,11 @@ struct PointsToOperation {
   s_expr to_s_expr() const;
 
   static boost::optional<PointsToOperation> from_s_expr(const s_expr& e);
+
+  void write_binary(pts_impl::BinaryWriter* out) const;
+
+  static boost::optional<PointsToOperation> read_binary(
+      pts_impl::BinaryReader* in);
 };
 
 /*
@@ -396,6 +416,11 @@ class PointsToAction final {
 
   static boost::optional<PointsToAction> from_s_expr(const s_expr& e);
 
+  void write_binary(pts_impl::BinaryWriter* out) const;
+
+  static boost::optional<PointsToAction> read_binary(
+      pts_impl::BinaryReader* in);
+
  private:
   static constexpr int32_t lhs_key() { return -1; }
   static constexpr int32_t rhs_key() { return -2; }
@@ -479,6 +504,11 @@ class PointsToMethodSemantics {
 
   static boost::optional<PointsToMethodSemantics> from_s_expr(const s_expr& e);
 
+  void write_binary(pts_impl::BinaryWriter* out) const;
+
+  static boost::optional<PointsToMethodSemantics> read_binary(
+      pts_impl::BinaryReader* in);
+
  private:
   DexMethodRef* m_dex_method;
   MethodKind m_kind;
@@ -521,6 +551,22 @@ class PointsToSemantics final {
    */
   PointsToSemantics(const Scope& scope, bool generate_stubs = false);
 
+  /*
+   * Same as above, except that the methods whose code hasn't changed since the
+   * cache file was written (see write_cache()) take their points-to actions
+   * from the cache instead of having them generated again. A missing or
+   * outdated cache file is ignored.
+   */
+  PointsToSemantics(const Scope& scope,
+                    const std::string& cache_file,
+                    bool generate_stubs = false);
+
+  /*
+   * Stores the points-to actions of all methods with code in the scope into a
+   * binary file, keyed by a hash of the code they were generated from.
+   */
+  void write_cache(const std::string& file_name) const;
+
   /*
    * The stubs are stored in the specified text file as S-expressions. In case
    * of a collision between a method in the APK and a stub, the stub is
@@ -538,16 +584,30 @@ class PointsToSemantics final {
       DexMethodRef* dex_method);
 
  private:
+  // Method descriptor -> hash of its code and its semantics.
+  using Cache =
+      std::unordered_map<std::string,
+                         std::pair<uint64_t, PointsToMethodSemantics>>;
+
+  void generate(const Scope& scope, const Cache& cache);
+
   MethodKind default_method_kind() const;
-  
+
   void initialize_entry(DexMethod* dex_method);
 
-  void generate_points_to_actions(DexMethod* dex_method);
+  // A hash of everything the points-to actions of the method are generated
+  // from, stable across runs.
+  uint64_t code_hash(DexMethod* dex_method) const;
+
+  // Returns true if the points-to actions were taken from the cache.
+  bool generate_points_to_actions(DexMethod* dex_method, const Cache& cache);
 
   bool m_generate_stubs;
   TypeSystem m_type_system;
   PointsToSemanticsUtils m_utils;
   std::unordered_map<DexMethodRef*, PointsToMethodSemantics> m_method_semantics;
+  // The code hashes of the methods in m_method_semantics that have code.
+  std::unordered_map<DexMethodRef*, uint64_t> m_code_hashes;
 
   friend std::ostream& operator<<(std::ostream&, const PointsToSemantics&);
 };
@@ -0,0 +1,982 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "PointsToSolver.h"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+
+#include "Debug.h"
+#include "DexUtil.h"
+#include "Resolver.h"
+#include "Trace.h"
+#include "WorkQueue.h"
+
+namespace {
+
+constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+// The field key of the elements of all arrays
+constexpr uint32_t kArrayElement = 0;
+
+/*
+ * A set of abstract object ids. Points-to sets are usually small and sparse,
+ * so only the nonzero 64-bit words are stored, sorted by their index.
+ */
+class SparseBitSet {
+ public:
+  bool empty() const { return m_words.empty(); }
+
+  bool insert(uint32_t i) {
+    uint32_t index = i / kBitsPerWord;
+    uint64_t bit = 1ULL << (i % kBitsPerWord);
+    auto it = std::lower_bound(
+        m_words.begin(), m_words.end(), index,
+        [](const Word& w, uint32_t idx) { return w.first < idx; });
+    if (it != m_words.end() && it->first == index) {
+      if (it->second & bit) {
+        return false;
+      }
+      it->second |= bit;
+      return true;
+    }
+    m_words.insert(it, Word(index, bit));
+    return true;
+  }
+
+  // Returns true if this set changed.
+  bool union_with(const SparseBitSet& other) {
+    if (other.m_words.empty()) {
+      return false;
+    }
+    std::vector<Word> result;
+    result.reserve(m_words.size() + other.m_words.size());
+    bool changed = false;
+    auto it = m_words.begin();
+    auto other_it = other.m_words.begin();
+    while (it != m_words.end() || other_it != other.m_words.end()) {
+      if (other_it == other.m_words.end() ||
+          (it != m_words.end() && it->first < other_it->first)) {
+        result.push_back(*it++);
+      } else if (it == m_words.end() || other_it->first < it->first) {
+        result.push_back(*other_it++);
+        changed = true;
+      } else {
+        uint64_t bits = it->second | other_it->second;
+        changed |= bits != it->second;
+        result.emplace_back(it->first, bits);
+        ++it;
+        ++other_it;
+      }
+    }
+    if (changed) {
+      m_words = std::move(result);
+    }
+    return changed;
+  }
+
+  void intersect_with(const SparseBitSet& other) {
+    std::vector<Word> result;
+    auto other_it = other.m_words.begin();
+    for (const auto& word : m_words) {
+      while (other_it != other.m_words.end() && other_it->first < word.first) {
+        ++other_it;
+      }
+      if (other_it != other.m_words.end() && other_it->first == word.first) {
+        uint64_t bits = word.second & other_it->second;
+        if (bits != 0) {
+          result.emplace_back(word.first, bits);
+        }
+      }
+    }
+    m_words = std::move(result);
+  }
+
+  SparseBitSet difference(const SparseBitSet& other) const {
+    SparseBitSet result;
+    auto other_it = other.m_words.begin();
+    for (const auto& word : m_words) {
+      while (other_it != other.m_words.end() && other_it->first < word.first) {
+        ++other_it;
+      }
+      uint64_t bits = word.second;
+      if (other_it != other.m_words.end() && other_it->first == word.first) {
+        bits &= ~other_it->second;
+      }
+      if (bits != 0) {
+        result.m_words.emplace_back(word.first, bits);
+      }
+    }
+    return result;
+  }
+
+  bool operator==(const SparseBitSet& other) const {
+    return m_words == other.m_words;
+  }
+
+  template <typename F>
+  void for_each(F f) const {
+    for (const auto& word : m_words) {
+      for (uint64_t bits = word.second; bits != 0; bits &= bits - 1) {
+        f(word.first * kBitsPerWord + __builtin_ctzll(bits));
+      }
+    }
+  }
+
+ private:
+  static constexpr uint32_t kBitsPerWord = 64;
+  using Word = std::pair<uint32_t, uint64_t>;
+  std::vector<Word> m_words;
+};
+
+// dest = base.field
+struct Load {
+  uint32_t field;
+  uint32_t dest;
+};
+
+// base.field = src
+struct Store {
+  uint32_t field;
+  uint32_t src;
+};
+
+// dest = (type) base
+struct Cast {
+  DexType* type;
+  uint32_t dest;
+};
+
+/*
+ * A node of the constraint graph. Inclusion constraints are edges to the
+ * successors; the constraints that depend on the objects this node points to
+ * (field accesses and calls through it) are attached to it.
+ */
+struct Node {
+  SparseBitSet pts;
+  // The part of pts whose effects have already been propagated
+  SparseBitSet done;
+  std::vector<uint32_t> succs;
+  std::vector<Load> loads;
+  std::vector<Store> stores;
+  // dest = base.getClass()
+  std::vector<uint32_t> get_classes;
+  std::vector<Cast> casts;
+  // The virtual call sites with this node as the receiver
+  std::vector<uint32_t> calls;
+};
+
+using VariableNodes = std::
+    unordered_map<PointsToVariable, uint32_t, boost::hash<PointsToVariable>>;
+
+using VariableSets = std::unordered_map<PointsToVariable,
+                                        std::vector<uint32_t>,
+                                        boost::hash<PointsToVariable>>;
+
+struct MethodNodes {
+  uint32_t this_node;
+  uint32_t ret_node;
+  std::vector<uint32_t> formals;
+  VariableNodes variables;
+};
+
+struct CallSite {
+  DexMethodRef* caller;
+  size_t action_index;
+  DexMethodRef* callee;
+  std::vector<std::pair<size_t, uint32_t>> args;
+  uint32_t dest;
+  std::vector<DexMethodRef*> targets;
+};
+
+using MethodList =
+    std::vector<std::pair<DexMethodRef*, const PointsToMethodSemantics*>>;
+
+struct ComponentResult {
+  std::vector<PointsToObject> objects;
+  std::vector<std::pair<DexMethodRef*, VariableSets>> points_to_sets;
+  std::vector<std::tuple<DexMethodRef*, size_t, std::vector<DexMethodRef*>>>
+      callees;
+  size_t node_count{0};
+  size_t collapsed_count{0};
+};
+
+// The target of a call that doesn't depend on the receiver
+DexMethodRef* static_target(const PointsToOperation& op) {
+  MethodSearch search = op.kind == PTS_INVOKE_STATIC
+                            ? MethodSearch::Static
+                            : op.kind == PTS_INVOKE_DIRECT
+                                  ? MethodSearch::Direct
+                                  : MethodSearch::Virtual;
+  DexMethod* def = resolve_method_cached(op.dex_method, search);
+  return def != nullptr ? def : op.dex_method;
+}
+
+const DexFieldRef* field_definition(DexFieldRef* field) {
+  DexField* def = resolve_field_cached(field);
+  return def != nullptr ? def : field;
+}
+
+class ComponentSolver {
+ public:
+  explicit ComponentSolver(const MethodList& methods) : m_methods_list(methods) {
+    for (const auto& method : m_methods_list) {
+      auto& nodes = m_methods[method.first];
+      nodes.this_node = new_node();
+      nodes.ret_node = new_node();
+      nodes.variables.emplace(PointsToVariable::this_variable(),
+                              nodes.this_node);
+    }
+    for (const auto& method : m_methods_list) {
+      add_actions(method.first, *method.second);
+    }
+  }
+
+  void solve() {
+    while (!m_worklist.empty()) {
+      uint32_t n = m_worklist.front();
+      m_worklist.pop_front();
+      m_in_worklist[n] = false;
+      if (find(n) == n) {
+        process(n);
+      }
+    }
+  }
+
+  ComponentResult result() {
+    ComponentResult result;
+    result.objects = std::move(m_objects);
+    result.node_count = m_nodes.size();
+    result.collapsed_count = m_collapsed_count;
+    for (auto& entry : m_methods) {
+      VariableSets sets;
+      for (const auto& variable : entry.second.variables) {
+        auto& set = sets[variable.first];
+        m_nodes[find(variable.second)].pts.for_each(
+            [&set](uint32_t object) { set.push_back(object); });
+      }
+      result.points_to_sets.emplace_back(entry.first, std::move(sets));
+    }
+    for (auto& site : m_call_sites) {
+      result.callees.emplace_back(
+          site.caller, site.action_index, std::move(site.targets));
+    }
+    return result;
+  }
+
+ private:
+  uint32_t new_node() {
+    uint32_t n = m_nodes.size();
+    m_nodes.emplace_back();
+    m_parent.push_back(n);
+    m_in_worklist.push_back(false);
+    return n;
+  }
+
+  // The representative of the node, after cycles have been collapsed
+  uint32_t find(uint32_t n) {
+    while (m_parent[n] != n) {
+      m_parent[n] = m_parent[m_parent[n]];
+      n = m_parent[n];
+    }
+    return n;
+  }
+
+  void push(uint32_t n) {
+    if (!m_in_worklist[n]) {
+      m_in_worklist[n] = true;
+      m_worklist.push_back(n);
+    }
+  }
+
+  uint32_t variable(MethodNodes* nodes, const PointsToVariable& v) {
+    if (v == PointsToVariable::null_variable()) {
+      return kNone;
+    }
+    auto it = nodes->variables.find(v);
+    if (it != nodes->variables.end()) {
+      return it->second;
+    }
+    uint32_t n = new_node();
+    nodes->variables.emplace(v, n);
+    return n;
+  }
+
+  uint32_t formal(MethodNodes* nodes, size_t k) {
+    while (nodes->formals.size() <= k) {
+      nodes->formals.push_back(new_node());
+    }
+    return nodes->formals[k];
+  }
+
+  uint32_t field_key(DexFieldRef* field) {
+    auto status = m_field_keys.emplace(field_definition(field),
+                                       m_field_keys.size() + 1);
+    return status.first->second;
+  }
+
+  uint32_t static_field(DexFieldRef* field) {
+    auto key = field_key(field);
+    auto it = m_static_fields.find(key);
+    if (it != m_static_fields.end()) {
+      return it->second;
+    }
+    uint32_t n = new_node();
+    m_static_fields.emplace(key, n);
+    return n;
+  }
+
+  // The node holding the field of all the objects abstracted by `object`
+  uint32_t cell(uint32_t object, uint32_t field) {
+    uint64_t key = (static_cast<uint64_t>(object) << 32) | field;
+    auto it = m_cells.find(key);
+    if (it != m_cells.end()) {
+      return it->second;
+    }
+    uint32_t n = new_node();
+    m_cells.emplace(key, n);
+    return n;
+  }
+
+  uint32_t new_object(const PointsToObject& object) {
+    m_objects.push_back(object);
+    return m_objects.size() - 1;
+  }
+
+  uint32_t string_object(DexString* str) {
+    auto it = m_string_objects.find(str);
+    if (it != m_string_objects.end()) {
+      return it->second;
+    }
+    PointsToObject object;
+    object.kind = PointsToObject::STRING;
+    object.type = get_string_type();
+    object.string = str;
+    return m_string_objects[str] = new_object(object);
+  }
+
+  uint32_t class_object(DexType* type) {
+    auto it = m_class_objects.find(type);
+    if (it != m_class_objects.end()) {
+      return it->second;
+    }
+    PointsToObject object;
+    object.kind = PointsToObject::CLASS;
+    object.type = get_class_type();
+    object.class_type = type;
+    return m_class_objects[type] = new_object(object);
+  }
+
+  uint32_t exception_object() {
+    if (m_exception_object == kNone) {
+      PointsToObject object;
+      object.kind = PointsToObject::EXCEPTION;
+      m_exception_object = new_object(object);
+    }
+    return m_exception_object;
+  }
+
+  void add_object(uint32_t n, uint32_t object) {
+    n = find(n);
+    if (m_nodes[n].pts.insert(object)) {
+      push(n);
+    }
+  }
+
+  // Adds the constraint pts(dst) ⊇ pts(src).
+  void add_edge(uint32_t src, uint32_t dst) {
+    src = find(src);
+    dst = find(dst);
+    if (src == dst ||
+        !m_edges.insert((static_cast<uint64_t>(src) << 32) | dst).second) {
+      return;
+    }
+    m_nodes[src].succs.push_back(dst);
+    // Whatever isn't done yet will be propagated when src is processed.
+    if (m_nodes[dst].pts.union_with(m_nodes[src].done)) {
+      push(dst);
+    }
+  }
+
+  void bind(CallSite* site, DexMethodRef* target) {
+    if (std::find(site->targets.begin(), site->targets.end(), target) !=
+        site->targets.end()) {
+      return;
+    }
+    site->targets.push_back(target);
+    auto* nodes = &m_methods.at(target);
+    for (const auto& arg : site->args) {
+      add_edge(arg.second, formal(nodes, arg.first));
+    }
+    if (site->dest != kNone) {
+      add_edge(nodes->ret_node, site->dest);
+    }
+  }
+
+  void add_actions(DexMethodRef* dex_method,
+                   const PointsToMethodSemantics& semantics) {
+    auto* nodes = &m_methods.at(dex_method);
+    const auto& actions = semantics.get_points_to_actions();
+    for (size_t i = 0; i < actions.size(); ++i) {
+      const PointsToAction& action = actions[i];
+      const PointsToOperation& op = action.operation();
+      switch (op.kind) {
+      case PTS_CONST_STRING: {
+        add_object(variable(nodes, action.dest()),
+                   string_object(op.dex_string));
+        break;
+      }
+      case PTS_CONST_CLASS: {
+        add_object(variable(nodes, action.dest()), class_object(op.dex_type));
+        break;
+      }
+      case PTS_GET_EXCEPTION: {
+        add_object(variable(nodes, action.dest()), exception_object());
+        break;
+      }
+      case PTS_NEW_OBJECT: {
+        PointsToObject object;
+        object.kind = PointsToObject::ALLOCATION;
+        object.type = op.dex_type;
+        object.method = dex_method;
+        object.variable = action.dest();
+        add_object(variable(nodes, action.dest()), new_object(object));
+        break;
+      }
+      case PTS_LOAD_PARAM: {
+        add_edge(formal(nodes, op.parameter), variable(nodes, action.dest()));
+        break;
+      }
+      case PTS_GET_CLASS: {
+        uint32_t src = variable(nodes, action.src());
+        uint32_t dest = variable(nodes, action.dest());
+        if (src != kNone) {
+          m_nodes[src].get_classes.push_back(dest);
+        }
+        break;
+      }
+      case PTS_CHECK_CAST: {
+        uint32_t src = variable(nodes, action.src());
+        uint32_t dest = variable(nodes, action.dest());
+        if (src != kNone) {
+          m_nodes[src].casts.push_back({op.dex_type, dest});
+        }
+        break;
+      }
+      case PTS_IGET:
+      case PTS_IGET_SPECIAL: {
+        uint32_t base = variable(nodes, action.instance());
+        uint32_t field =
+            op.kind == PTS_IGET ? field_key(op.dex_field) : kArrayElement;
+        uint32_t dest = variable(nodes, action.dest());
+        if (base != kNone) {
+          m_nodes[base].loads.push_back({field, dest});
+        }
+        break;
+      }
+      case PTS_SGET: {
+        add_edge(static_field(op.dex_field), variable(nodes, action.dest()));
+        break;
+      }
+      case PTS_IPUT:
+      case PTS_IPUT_SPECIAL: {
+        uint32_t base = variable(nodes, action.lhs());
+        uint32_t field =
+            op.kind == PTS_IPUT ? field_key(op.dex_field) : kArrayElement;
+        uint32_t src = variable(nodes, action.rhs());
+        if (base != kNone && src != kNone) {
+          m_nodes[base].stores.push_back({field, src});
+        }
+        break;
+      }
+      case PTS_SPUT: {
+        uint32_t src = variable(nodes, action.rhs());
+        if (src != kNone) {
+          add_edge(src, static_field(op.dex_field));
+        }
+        break;
+      }
+      case PTS_INVOKE_VIRTUAL:
+      case PTS_INVOKE_SUPER:
+      case PTS_INVOKE_DIRECT:
+      case PTS_INVOKE_INTERFACE:
+      case PTS_INVOKE_STATIC: {
+        CallSite site;
+        site.caller = dex_method;
+        site.action_index = i;
+        site.callee = op.dex_method;
+        for (const auto& arg : action.get_arguments()) {
+          uint32_t n = variable(nodes, arg.second);
+          if (n != kNone) {
+            site.args.emplace_back(arg.first, n);
+          }
+        }
+        site.dest = action.has_dest() ? variable(nodes, action.dest()) : kNone;
+        uint32_t receiver = op.is_static_call()
+                                ? kNone
+                                : variable(nodes, action.instance());
+        uint32_t site_index = m_call_sites.size();
+        m_call_sites.push_back(std::move(site));
+        if (op.kind == PTS_INVOKE_VIRTUAL || op.kind == PTS_INVOKE_INTERFACE) {
+          if (receiver != kNone) {
+            m_nodes[receiver].calls.push_back(site_index);
+          }
+          break;
+        }
+        DexMethodRef* target = static_target(op);
+        if (m_methods.count(target)) {
+          bind(&m_call_sites[site_index], target);
+          if (receiver != kNone) {
+            add_edge(receiver, m_methods.at(target).this_node);
+          }
+        }
+        break;
+      }
+      case PTS_RETURN: {
+        uint32_t src = variable(nodes, action.src());
+        if (src != kNone) {
+          add_edge(src, nodes->ret_node);
+        }
+        break;
+      }
+      case PTS_DISJUNCTION: {
+        uint32_t dest = variable(nodes, action.dest());
+        for (const auto& arg : action.get_arguments()) {
+          uint32_t src = variable(nodes, arg.second);
+          if (src != kNone) {
+            add_edge(src, dest);
+          }
+        }
+        break;
+      }
+      }
+    }
+  }
+
+  // Binds the virtual call site to the method `object` dispatches to.
+  void dispatch(uint32_t site_index, uint32_t object) {
+    DexType* type = m_objects[object].type;
+    if (type == nullptr) {
+      return;
+    }
+    CallSite* site = &m_call_sites[site_index];
+    DexMethodRef* target = nullptr;
+    const DexClass* cls = type_class(type);
+    if (cls != nullptr) {
+      target = resolve_method(cls,
+                              site->callee->get_name(),
+                              site->callee->get_proto(),
+                              MethodSearch::Virtual);
+    }
+    if (target == nullptr || !m_methods.count(target)) {
+      // The receiver's class isn't known, but the callee may have a stub.
+      target = site->callee;
+      if (!m_methods.count(target)) {
+        return;
+      }
+    }
+    bind(site, target);
+    add_object(m_methods.at(target).this_node, object);
+  }
+
+  bool is_compatible(uint32_t object, DexType* type) {
+    DexType* object_type = m_objects[object].type;
+    // We can't filter objects whose class is unknown (exceptions, arrays,
+    // library classes).
+    return object_type == nullptr || type_class(object_type) == nullptr ||
+           check_cast(object_type, type);
+  }
+
+  void process(uint32_t n) {
+    SparseBitSet diff = m_nodes[n].pts.difference(m_nodes[n].done);
+    if (diff.empty()) {
+      return;
+    }
+    m_nodes[n].done = m_nodes[n].pts;
+
+    // Creating cells and binding calls adds nodes, which invalidates
+    // references into m_nodes, hence the indexes.
+    for (size_t i = 0; i < m_nodes[n].loads.size(); ++i) {
+      Load load = m_nodes[n].loads[i];
+      diff.for_each([&](uint32_t object) {
+        add_edge(cell(object, load.field), load.dest);
+      });
+    }
+    for (size_t i = 0; i < m_nodes[n].stores.size(); ++i) {
+      Store store = m_nodes[n].stores[i];
+      diff.for_each([&](uint32_t object) {
+        add_edge(store.src, cell(object, store.field));
+      });
+    }
+    for (size_t i = 0; i < m_nodes[n].get_classes.size(); ++i) {
+      uint32_t dest = m_nodes[n].get_classes[i];
+      diff.for_each([&](uint32_t object) {
+        add_object(dest, class_object(m_objects[object].type));
+      });
+    }
+    for (size_t i = 0; i < m_nodes[n].casts.size(); ++i) {
+      Cast cast = m_nodes[n].casts[i];
+      diff.for_each([&](uint32_t object) {
+        if (is_compatible(object, cast.type)) {
+          add_object(cast.dest, object);
+        }
+      });
+    }
+    for (size_t i = 0; i < m_nodes[n].calls.size(); ++i) {
+      uint32_t site = m_nodes[n].calls[i];
+      diff.for_each([&](uint32_t object) { dispatch(site, object); });
+    }
+
+    bool cycle_suspected = false;
+    for (uint32_t succ : m_nodes[n].succs) {
+      uint32_t s = find(succ);
+      if (s == n) {
+        continue;
+      }
+      Node& dst = m_nodes[s];
+      if (dst.pts.union_with(diff)) {
+        push(s);
+      }
+      // Lazy cycle detection: nodes on a cycle end up with the same points-to
+      // set, so we only look for a cycle through an edge once both ends are
+      // equal. Each edge is only checked once.
+      if (dst.pts == m_nodes[n].pts &&
+          m_checked_edges.insert((static_cast<uint64_t>(n) << 32) | s)
+              .second) {
+        cycle_suspected = true;
+      }
+    }
+    if (cycle_suspected) {
+      collapse_cycles(n);
+    }
+  }
+
+  // Collapses the strongly connected components of inclusion edges reachable
+  // from `start` into single nodes (iterative Tarjan).
+  void collapse_cycles(uint32_t start) {
+    // node -> (index, lowlink)
+    std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t>> info;
+    std::vector<uint32_t> stack;
+    std::unordered_set<uint32_t> on_stack;
+    std::vector<std::pair<uint32_t, size_t>> dfs;
+    std::vector<std::vector<uint32_t>> sccs;
+    auto visit = [&](uint32_t n) {
+      uint32_t index = info.size();
+      info.emplace(n, std::make_pair(index, index));
+      stack.push_back(n);
+      on_stack.insert(n);
+      dfs.emplace_back(n, 0);
+    };
+    visit(find(start));
+    while (!dfs.empty()) {
+      uint32_t n = dfs.back().first;
+      size_t pos = dfs.back().second;
+      if (pos < m_nodes[n].succs.size()) {
+        dfs.back().second++;
+        uint32_t s = find(m_nodes[n].succs[pos]);
+        if (s == n) {
+          continue;
+        }
+        auto it = info.find(s);
+        if (it == info.end()) {
+          visit(s);
+        } else if (on_stack.count(s)) {
+          auto& lowlink = info.at(n).second;
+          lowlink = std::min(lowlink, it->second.first);
+        }
+        continue;
+      }
+      dfs.pop_back();
+      const auto& n_info = info.at(n);
+      if (!dfs.empty()) {
+        auto& lowlink = info.at(dfs.back().first).second;
+        lowlink = std::min(lowlink, n_info.second);
+      }
+      if (n_info.first == n_info.second) {
+        std::vector<uint32_t> scc;
+        uint32_t m;
+        do {
+          m = stack.back();
+          stack.pop_back();
+          on_stack.erase(m);
+          scc.push_back(m);
+        } while (m != n);
+        if (scc.size() > 1) {
+          sccs.push_back(std::move(scc));
+        }
+      }
+    }
+    for (const auto& scc : sccs) {
+      uint32_t rep = scc[0];
+      for (size_t i = 1; i < scc.size(); ++i) {
+        merge(rep, scc[i]);
+      }
+      push(rep);
+    }
+  }
+
+  void merge(uint32_t rep, uint32_t n) {
+    m_parent[n] = rep;
+    ++m_collapsed_count;
+    Node& r = m_nodes[rep];
+    Node& other = m_nodes[n];
+    r.pts.union_with(other.pts);
+    // Whatever either node hasn't propagated yet has to go through all the
+    // constraints of the merged node.
+    r.done.intersect_with(other.done);
+    auto append = [](auto* to, auto* from) {
+      to->insert(to->end(), from->begin(), from->end());
+      std::remove_reference_t<decltype(*from)>().swap(*from);
+    };
+    append(&r.succs, &other.succs);
+    append(&r.loads, &other.loads);
+    append(&r.stores, &other.stores);
+    append(&r.get_classes, &other.get_classes);
+    append(&r.casts, &other.casts);
+    append(&r.calls, &other.calls);
+    other.pts = SparseBitSet();
+    other.done = SparseBitSet();
+  }
+
+  const MethodList& m_methods_list;
+  std::vector<Node> m_nodes;
+  std::vector<uint32_t> m_parent;
+  std::vector<bool> m_in_worklist;
+  std::deque<uint32_t> m_worklist;
+  std::unordered_set<uint64_t> m_edges;
+  std::unordered_set<uint64_t> m_checked_edges;
+  std::unordered_map<DexMethodRef*, MethodNodes> m_methods;
+  std::vector<CallSite> m_call_sites;
+  std::vector<PointsToObject> m_objects;
+  std::unordered_map<DexString*, uint32_t> m_string_objects;
+  std::unordered_map<DexType*, uint32_t> m_class_objects;
+  uint32_t m_exception_object{kNone};
+  std::unordered_map<const DexFieldRef*, uint32_t> m_field_keys;
+  std::unordered_map<uint32_t, uint32_t> m_static_fields;
+  std::unordered_map<uint64_t, uint32_t> m_cells;
+  size_t m_collapsed_count{0};
+};
+
+class UnionFind {
+ public:
+  uint32_t add() {
+    m_parent.push_back(m_parent.size());
+    return m_parent.size() - 1;
+  }
+
+  uint32_t find(uint32_t i) {
+    while (m_parent[i] != i) {
+      m_parent[i] = m_parent[m_parent[i]];
+      i = m_parent[i];
+    }
+    return i;
+  }
+
+  void unite(uint32_t i, uint32_t j) { m_parent[find(i)] = find(j); }
+
+ private:
+  std::vector<uint32_t> m_parent;
+};
+
+/*
+ * Partitions the methods so that no pointer can flow from one part to
+ * another. Methods are connected by the calls between them (virtual calls to
+ * all the methods with the same signature), and by the fields they access.
+ */
+std::vector<MethodList> weakly_connected_components(const MethodList& methods) {
+  UnionFind components;
+  std::unordered_map<DexMethodRef*, uint32_t> method_ids;
+  for (const auto& method : methods) {
+    method_ids.emplace(method.first, components.add());
+  }
+  std::unordered_map<std::pair<const DexString*, const DexProto*>,
+                     uint32_t,
+                     boost::hash<std::pair<const DexString*, const DexProto*>>>
+      signatures;
+  auto signature = [&](const DexMethodRef* m) {
+    auto key = std::make_pair(m->get_name(), m->get_proto());
+    auto it = signatures.find(key);
+    return it != signatures.end() ? it->second
+                                  : signatures[key] = components.add();
+  };
+  std::unordered_map<const DexFieldRef*, uint32_t> fields;
+  auto field = [&](DexFieldRef* f) {
+    auto key = field_definition(f);
+    auto it = fields.find(key);
+    return it != fields.end() ? it->second : fields[key] = components.add();
+  };
+  uint32_t array_element = components.add();
+
+  for (const auto& method : methods) {
+    uint32_t id = method_ids.at(method.first);
+    if (!method.first->is_def() ||
+        static_cast<DexMethod*>(method.first)->is_virtual()) {
+      // A possible target of virtual calls
+      components.unite(id, signature(method.first));
+    }
+    for (const auto& action : method.second->get_points_to_actions()) {
+      const auto& op = action.operation();
+      switch (op.kind) {
+      case PTS_INVOKE_VIRTUAL:
+      case PTS_INVOKE_INTERFACE:
+        components.unite(id, signature(op.dex_method));
+        break;
+      case PTS_INVOKE_SUPER:
+      case PTS_INVOKE_DIRECT:
+      case PTS_INVOKE_STATIC: {
+        auto it = method_ids.find(static_target(op));
+        if (it != method_ids.end()) {
+          components.unite(id, it->second);
+        }
+        break;
+      }
+      case PTS_IGET:
+      case PTS_SGET:
+      case PTS_IPUT:
+      case PTS_SPUT:
+        components.unite(id, field(op.dex_field));
+        break;
+      case PTS_IGET_SPECIAL:
+      case PTS_IPUT_SPECIAL:
+        components.unite(id, array_element);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  std::unordered_map<uint32_t, size_t> component_index;
+  std::vector<MethodList> result;
+  for (const auto& method : methods) {
+    uint32_t root = components.find(method_ids.at(method.first));
+    auto it = component_index.find(root);
+    if (it == component_index.end()) {
+      it = component_index.emplace(root, result.size()).first;
+      result.emplace_back();
+    }
+    result[it->second].push_back(method);
+  }
+  return result;
+}
+
+} // namespace
+
+PointsToSolver::PointsToSolver(PointsToSemantics& semantics) {
+  MethodList methods;
+  for (const auto& entry : semantics) {
+    if (!entry.second.get_points_to_actions().empty()) {
+      methods.emplace_back(entry.first, &entry.second);
+    }
+  }
+  auto components = weakly_connected_components(methods);
+  m_component_count = components.size();
+  // The largest components go first, so that they don't end up last on a
+  // single thread.
+  std::sort(components.begin(), components.end(),
+            [](const MethodList& a, const MethodList& b) {
+              return a.size() > b.size();
+            });
+
+  std::vector<ComponentResult> results(components.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    ComponentSolver solver(components[i]);
+    solver.solve();
+    results[i] = solver.result();
+  });
+  for (size_t i = 0; i < components.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  // Constants are abstracted by value, so the same constant may have been
+  // found in several components.
+  std::map<std::tuple<int,
+                      DexType*,
+                      DexMethodRef*,
+                      PointsToVariable,
+                      DexString*,
+                      DexType*>,
+           uint32_t>
+      object_ids;
+  size_t node_count = 0;
+  size_t collapsed_count = 0;
+  for (auto& result : results) {
+    node_count += result.node_count;
+    collapsed_count += result.collapsed_count;
+    std::vector<uint32_t> ids;
+    ids.reserve(result.objects.size());
+    for (const auto& object : result.objects) {
+      auto key = std::make_tuple(static_cast<int>(object.kind),
+                                 object.type,
+                                 object.method,
+                                 object.variable,
+                                 object.string,
+                                 object.class_type);
+      auto it = object_ids.find(key);
+      if (it == object_ids.end()) {
+        it = object_ids.emplace(key, m_objects.size()).first;
+        m_objects.push_back(object);
+      }
+      ids.push_back(it->second);
+    }
+    for (auto& entry : result.points_to_sets) {
+      for (auto& set : entry.second) {
+        for (auto& object : set.second) {
+          object = ids[object];
+        }
+      }
+      m_points_to_sets.emplace(entry.first, std::move(entry.second));
+    }
+    for (auto& entry : result.callees) {
+      m_callees[std::get<0>(entry)].emplace(std::get<1>(entry),
+                                            std::move(std::get<2>(entry)));
+    }
+  }
+  TRACE(PTA, 1,
+        "Solved %lu methods in %lu components: %lu nodes, %lu collapsed, "
+        "%lu abstract objects\n",
+        methods.size(), components.size(), node_count, collapsed_count,
+        m_objects.size());
+}
+
+std::vector<const PointsToObject*> PointsToSolver::get_points_to_set(
+    DexMethodRef* dex_method, const PointsToVariable& v) const {
+  std::vector<const PointsToObject*> result;
+  auto method_it = m_points_to_sets.find(dex_method);
+  if (method_it == m_points_to_sets.end()) {
+    return result;
+  }
+  auto it = method_it->second.find(v);
+  if (it == method_it->second.end()) {
+    return result;
+  }
+  for (uint32_t object : it->second) {
+    result.push_back(&m_objects[object]);
+  }
+  return result;
+}
+
+std::vector<DexMethodRef*> PointsToSolver::get_callees(
+    DexMethodRef* dex_method, size_t action_index) const {
+  auto method_it = m_callees.find(dex_method);
+  if (method_it == m_callees.end()) {
+    return {};
+  }
+  auto it = method_it->second.find(action_index);
+  if (it == method_it->second.end()) {
+    return {};
+  }
+  return it->second;
+}
@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include "DexClass.h"
+#include "PointsToSemantics.h"
+
+/*
+ * An abstract object instance, i.e., the set of all the concrete objects
+ * created at the same allocation site, or a constant.
+ */
+struct PointsToObject {
+  enum Kind {
+    // An object created by a PTS_NEW_OBJECT action
+    ALLOCATION,
+    // A string constant
+    STRING,
+    // The java.lang.Class object representing a type
+    CLASS,
+    // Any exception (see PTS_GET_EXCEPTION)
+    EXCEPTION,
+  };
+
+  Kind kind;
+  // The dynamic type of the object, or nullptr for exceptions, whose type is
+  // abstracted away.
+  DexType* type{nullptr};
+  // The allocation site of an ALLOCATION object
+  DexMethodRef* method{nullptr};
+  PointsToVariable variable;
+  // The value of a STRING object
+  DexString* string{nullptr};
+  // The type a CLASS object represents, or nullptr if unknown
+  DexType* class_type{nullptr};
+};
+
+/*
+ * This solves the systems of points-to actions of all the methods in a
+ * PointsToSemantics, computing for every points-to variable the set of
+ * abstract objects it may point to. The analysis is inclusion-based
+ * (Andersen-style), field-sensitive and context-insensitive. Virtual and
+ * interface calls are resolved on the fly, from the types of the objects the
+ * receiver points to.
+ *
+ * All methods with points-to actions are considered reachable. Parameters are
+ * only bound at the call sites that were found, so the parameters of entry
+ * points (and the results of calls to methods without points-to actions, like
+ * native methods or library code without stubs) point to nothing.
+ *
+ * The solver uses difference propagation on a constraint graph whose nodes
+ * hold sparse bitsets of abstract objects. Cycles of inclusion constraints
+ * are collapsed into a single node as they're found. The weakly connected
+ * components of the constraint graph can't exchange any pointers, so they're
+ * solved in parallel.
+ */
+class PointsToSolver final {
+ public:
+  explicit PointsToSolver(PointsToSemantics& semantics);
+
+  PointsToSolver(const PointsToSolver& other) = delete;
+
+  PointsToSolver& operator=(const PointsToSolver& other) = delete;
+
+  /*
+   * The abstract objects that a variable of the method may point to, in no
+   * particular order.
+   */
+  std::vector<const PointsToObject*> get_points_to_set(
+      DexMethodRef* dex_method, const PointsToVariable& v) const;
+
+  /*
+   * The methods that an invoke action of the method may call. The action is
+   * given by its index in get_points_to_actions().
+   */
+  std::vector<DexMethodRef*> get_callees(DexMethodRef* dex_method,
+                                         size_t action_index) const;
+
+  size_t component_count() const { return m_component_count; }
+
+ private:
+  using VariableMap =
+      std::unordered_map<PointsToVariable,
+                         std::vector<uint32_t>,
+                         boost::hash<PointsToVariable>>;
+
+  std::vector<PointsToObject> m_objects;
+  // Method -> variable -> indexes of the objects in m_objects
+  std::unordered_map<DexMethodRef*, VariableMap> m_points_to_sets;
+  // Method -> action index -> callees
+  std::unordered_map<DexMethodRef*,
+                     std::unordered_map<size_t, std::vector<DexMethodRef*>>>
+      m_callees;
+  size_t m_component_count{0};
+};
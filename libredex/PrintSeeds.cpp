@@ -56,17 +56,59 @@ void show_class(std::ostream& output,
                 const bool allowobfuscation_filter) {
   if (allowshrinking_filter) {
     if (allowshrinking(cls)) {
-      output << name << std::endl;
+      output << name << '\n';
     }
     return;
   }
   if (allowobfuscation_filter) {
     if (allowobfuscation(cls)) {
-      output << name << std::endl;
+      output << name << '\n';
     }
     return;
   }
-  output << name << std::endl;
+  output << name << '\n';
+}
+
+void print_class_seeds(std::ostream& output,
+                       const ProguardMap& pg_map,
+                       const DexClass* cls,
+                       const bool allowshrinking_filter,
+                       const bool allowobfuscation_filter) {
+  auto deob = cls->get_deobfuscated_name();
+  if (deob.empty()) {
+    std::cerr << "WARNING: this class has no deobu name: "
+              << cls->get_name()->c_str() << std::endl;
+    deob = cls->get_name()->c_str();
+  }
+  std::string name = redex::dexdump_name_to_dot_name(deob);
+  if (keep(cls)) {
+    show_class(
+        output, cls, name, allowshrinking_filter, allowobfuscation_filter);
+  }
+  print_field_seeds(output,
+                    pg_map,
+                    name,
+                    cls->get_ifields(),
+                    allowshrinking_filter,
+                    allowobfuscation_filter);
+  print_field_seeds(output,
+                    pg_map,
+                    name,
+                    cls->get_sfields(),
+                    allowshrinking_filter,
+                    allowobfuscation_filter);
+  print_method_seeds(output,
+                     pg_map,
+                     name,
+                     cls->get_dmethods(),
+                     allowshrinking_filter,
+                     allowobfuscation_filter);
+  print_method_seeds(output,
+                     pg_map,
+                     name,
+                     cls->get_vmethods(),
+                     allowshrinking_filter,
+                     allowobfuscation_filter);
 }
 
 // Print out the seeds computed in classes by Redex to the specified ostream.
@@ -76,41 +118,12 @@ void redex::print_seeds(std::ostream& output,
                         const Scope& classes,
                         const bool allowshrinking_filter,
                         const bool allowobfuscation_filter) {
-  for (const auto& cls : classes) {
-    auto deob = cls->get_deobfuscated_name();
-    if (deob.empty()) {
-      std::cerr << "WARNING: this class has no deobu name: "
-                << cls->get_name()->c_str() << std::endl;
-      deob = cls->get_name()->c_str();
-    }
-    std::string name = redex::dexdump_name_to_dot_name(deob);
-    if (keep(cls)) {
-      show_class(
-          output, cls, name, allowshrinking_filter, allowobfuscation_filter);
-    }
-    print_field_seeds(output,
-                      pg_map,
-                      name,
-                      cls->get_ifields(),
-                      allowshrinking_filter,
-                      allowobfuscation_filter);
-    print_field_seeds(output,
-                      pg_map,
-                      name,
-                      cls->get_sfields(),
-                      allowshrinking_filter,
-                      allowobfuscation_filter);
-    print_method_seeds(output,
-                       pg_map,
-                       name,
-                       cls->get_dmethods(),
-                       allowshrinking_filter,
-                       allowobfuscation_filter);
-    print_method_seeds(output,
-                       pg_map,
-                       name,
-                       cls->get_vmethods(),
-                       allowshrinking_filter,
-                       allowobfuscation_filter);
-  }
+  print_in_parallel(output, classes,
+                    [&](std::ostream& buffer, const DexClass* cls) {
+                      print_class_seeds(buffer,
+                                        pg_map,
+                                        cls,
+                                        allowshrinking_filter,
+                                        allowobfuscation_filter);
+                    });
 }
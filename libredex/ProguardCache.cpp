@@ -0,0 +1,347 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ProguardCache.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "Sha1.h"
+#include "Trace.h"
+
+namespace redex {
+
+namespace {
+
+// Bump this whenever the matching or the format of the cache changes.
+constexpr const char* CACHE_VERSION = "proguard-cache-v1";
+
+class Hasher {
+ public:
+  Hasher() { sha1_init(&m_context); }
+
+  void add(const std::string& str) {
+    add(str.size());
+    sha1_update(&m_context,
+                reinterpret_cast<const unsigned char*>(str.data()),
+                str.size());
+  }
+
+  void add(uint64_t value) {
+    sha1_update(&m_context,
+                reinterpret_cast<const unsigned char*>(&value),
+                sizeof(value));
+  }
+
+  void add(const DexType* type) {
+    add(type == nullptr ? std::string() : type->get_name()->str());
+  }
+
+  template <class DexMember>
+  void add_annotations(const DexMember* member) {
+    const auto* annos = member->get_anno_set();
+    if (annos == nullptr) {
+      add(uint64_t(0));
+      return;
+    }
+    add(annos->get_annotations().size());
+    for (const auto& anno : annos->get_annotations()) {
+      add(anno->type());
+    }
+  }
+
+  void add_member_spec(const MemberSpecification& spec) {
+    add(spec.requiredSetAccessFlags);
+    add(spec.requiredUnsetAccessFlags);
+    add(spec.annotationType);
+    add(spec.name);
+    add(spec.descriptor);
+    add(spec.mark_conditionally);
+  }
+
+  void add_rule(const KeepSpec& rule) {
+    add(rule.includedescriptorclasses);
+    add(rule.allowshrinking);
+    add(rule.allowoptimization);
+    add(rule.allowobfuscation);
+    add(rule.mark_classes);
+    add(rule.mark_conditionally);
+    const auto& spec = rule.class_spec;
+    add(spec.setAccessFlags);
+    add(spec.unsetAccessFlags);
+    add(spec.annotationType);
+    add(spec.className);
+    add(spec.extendsAnnotationType);
+    add(spec.extendsClassName);
+    add(spec.fieldSpecifications.size());
+    for (const auto& field_spec : spec.fieldSpecifications) {
+      add_member_spec(field_spec);
+    }
+    add(spec.methodSpecifications.size());
+    for (const auto& method_spec : spec.methodSpecifications) {
+      add_member_spec(method_spec);
+    }
+  }
+
+  void add_hierarchy(const DexClass* cls) {
+    add(cls->get_type());
+    add(cls->get_deobfuscated_name());
+    add(cls->get_access());
+    add(cls->is_external());
+    add(cls->get_super_class());
+    const auto& interfaces = cls->get_interfaces()->get_type_list();
+    add(interfaces.size());
+    for (const auto* intf : interfaces) {
+      add(intf);
+    }
+    add_annotations(cls);
+  }
+
+  void add_method(const DexMethod* method) {
+    add(method->get_name()->str());
+    add(method->get_deobfuscated_name());
+    add(method->get_access());
+    const auto* proto = method->get_proto();
+    add(proto->get_rtype());
+    const auto& args = proto->get_args()->get_type_list();
+    add(args.size());
+    for (const auto* arg : args) {
+      add(arg);
+    }
+    add_annotations(method);
+    // Whether a static initializer is kept depends on its code.
+    if (is_clinit(method) && method->get_code() != nullptr) {
+      for (const auto& mie : InstructionIterable(method->get_code())) {
+        add(uint64_t(mie.insn->opcode()));
+      }
+    }
+  }
+
+  void add_field(const DexField* field) {
+    add(field->get_name()->str());
+    add(field->get_deobfuscated_name());
+    add(field->get_access());
+    add(field->get_type());
+    add_annotations(field);
+  }
+
+  std::string hex() {
+    unsigned char digest[20];
+    sha1_final(digest, &m_context);
+    std::ostringstream ss;
+    for (auto byte : digest) {
+      ss << std::hex << std::setw(2) << std::setfill('0') << (int)byte;
+    }
+    return ss.str();
+  }
+
+ private:
+  Sha1Context m_context;
+};
+
+std::vector<const std::vector<KeepSpec>*> rule_lists(
+    const ProguardConfiguration& pg_config) {
+  return {&pg_config.whyareyoukeeping_rules,
+          &pg_config.keep_rules,
+          &pg_config.assumenosideeffects_rules};
+}
+
+// Calls fn on the state of the class and of each of its members, in the order
+// in which they are hashed into the key.
+template <typename Fn>
+void for_each_state(DexClass* cls, Fn fn) {
+  fn(cls->rstate);
+  for (auto* method : cls->get_dmethods()) {
+    fn(method->rstate);
+  }
+  for (auto* method : cls->get_vmethods()) {
+    fn(method->rstate);
+  }
+  for (auto* field : cls->get_sfields()) {
+    fn(field->rstate);
+  }
+  for (auto* field : cls->get_ifields()) {
+    fn(field->rstate);
+  }
+}
+
+std::string cache_path(const std::string& cache_dir, const std::string& key) {
+  return cache_dir + "/" + key + ".pgcache";
+}
+
+} // namespace
+
+std::string proguard_cache_key(const Scope& classes,
+                               const Scope& external_classes,
+                               const ProguardConfiguration& pg_config) {
+  Hasher hasher;
+  hasher.add(std::string(CACHE_VERSION));
+  for (const auto* rules : rule_lists(pg_config)) {
+    hasher.add(rules->size());
+    for (const auto& rule : *rules) {
+      hasher.add_rule(rule);
+    }
+  }
+  hasher.add(external_classes.size());
+  for (const auto* cls : external_classes) {
+    hasher.add_hierarchy(cls);
+  }
+  hasher.add(classes.size());
+  for (const auto* cls : classes) {
+    hasher.add_hierarchy(cls);
+    hasher.add(cls->get_dmethods().size());
+    for (const auto* method : cls->get_dmethods()) {
+      hasher.add_method(method);
+    }
+    hasher.add(cls->get_vmethods().size());
+    for (const auto* method : cls->get_vmethods()) {
+      hasher.add_method(method);
+    }
+    hasher.add(cls->get_sfields().size());
+    for (const auto* field : cls->get_sfields()) {
+      hasher.add_field(field);
+    }
+    hasher.add(cls->get_ifields().size());
+    for (const auto* field : cls->get_ifields()) {
+      hasher.add_field(field);
+    }
+  }
+  return hasher.hex();
+}
+
+bool load_proguard_cache(const std::string& cache_dir,
+                         const std::string& key,
+                         const Scope& classes,
+                         ProguardConfiguration* pg_config) {
+  std::ifstream in(cache_path(cache_dir, key));
+  std::string stored_key;
+  if (!(in >> stored_key) || stored_key != key) {
+    return false;
+  }
+  // Read everything before applying anything, so that a truncated entry
+  // leaves the classes untouched.
+  std::vector<unsigned long> counts;
+  std::vector<uint64_t> states;
+  size_t size;
+  if (!(in >> size)) {
+    return false;
+  }
+  counts.resize(size);
+  for (auto& count : counts) {
+    if (!(in >> count)) {
+      return false;
+    }
+  }
+  if (!(in >> size)) {
+    return false;
+  }
+  states.resize(size);
+  for (auto& state : states) {
+    if (!(in >> std::hex >> state >> std::dec)) {
+      return false;
+    }
+  }
+
+  size_t expected_counts = 0;
+  for (const auto* rules : rule_lists(*pg_config)) {
+    for (const auto& rule : *rules) {
+      expected_counts += 1 + rule.class_spec.fieldSpecifications.size() +
+                         rule.class_spec.methodSpecifications.size();
+    }
+  }
+  size_t expected_states = 0;
+  for (auto* cls : classes) {
+    for_each_state(cls, [&](ReferencedState&) { ++expected_states; });
+  }
+  if (counts.size() != expected_counts || states.size() != expected_states) {
+    return false;
+  }
+
+  auto count_it = counts.begin();
+  for (const auto* rules : rule_lists(*pg_config)) {
+    for (const auto& rule : *rules) {
+      rule.count = *count_it++;
+      for (const auto& field_spec : rule.class_spec.fieldSpecifications) {
+        field_spec.count = *count_it++;
+      }
+      for (const auto& method_spec : rule.class_spec.methodSpecifications) {
+        method_spec.count = *count_it++;
+      }
+    }
+  }
+  auto state_it = states.begin();
+  for (auto* cls : classes) {
+    for_each_state(cls, [&](ReferencedState& state) {
+      state.restore_proguard_state(*state_it++);
+    });
+  }
+  return true;
+}
+
+void save_proguard_cache(const std::string& cache_dir,
+                         const std::string& key,
+                         const Scope& classes,
+                         const ProguardConfiguration& pg_config) {
+  std::ostringstream out;
+  out << key << "\n";
+  std::vector<unsigned long> counts;
+  for (const auto* rules : rule_lists(pg_config)) {
+    for (const auto& rule : *rules) {
+      counts.push_back(rule.count);
+      for (const auto& field_spec : rule.class_spec.fieldSpecifications) {
+        counts.push_back(field_spec.count);
+      }
+      for (const auto& method_spec : rule.class_spec.methodSpecifications) {
+        counts.push_back(method_spec.count);
+      }
+    }
+  }
+  out << counts.size() << "\n";
+  for (auto count : counts) {
+    out << count << "\n";
+  }
+  std::vector<uint64_t> states;
+  for (auto* cls : classes) {
+    for_each_state(cls, [&](ReferencedState& state) {
+      states.push_back(state.proguard_state());
+    });
+  }
+  out << states.size() << "\n" << std::hex;
+  for (auto state : states) {
+    out << state << "\n";
+  }
+
+  // Write to a private name and rename into place, so concurrent runs never
+  // see a partially written cache.
+  auto path = cache_path(cache_dir, key);
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(cache_dir, ec);
+  auto tmp_path = path + boost::filesystem::unique_path(".%%%%%%%%").string();
+  {
+    std::ofstream file(tmp_path);
+    file << out.str();
+    if (!file) {
+      fprintf(stderr, "warning: cannot write ProGuard cache %s\n", path.c_str());
+      boost::filesystem::remove(tmp_path, ec);
+      return;
+    }
+  }
+  boost::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    fprintf(stderr, "warning: cannot write ProGuard cache %s\n", path.c_str());
+    boost::filesystem::remove(tmp_path, ec);
+  }
+}
+
+} // namespace redex
@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "DexClass.h"
+#include "ProguardConfiguration.h"
+
+namespace redex {
+
+/*
+ * Caches the outcome of matching the ProGuard rules, i.e. the keep state of
+ * every class and member and the match counts of the rules, across runs.
+ *
+ * The cache is keyed by a hash of the rules and of all the properties of the
+ * classes that rules can match on: names, access flags, annotations, the
+ * hierarchy (including the external classes), member names and types, and
+ * whether the static initializers are trivial.
+ */
+std::string proguard_cache_key(const Scope& classes,
+                               const Scope& external_classes,
+                               const ProguardConfiguration& pg_config);
+
+/*
+ * Restores the keep state of the classes and the counts of the rules from the
+ * cache entry for the key. Returns false, without changing anything, if there
+ * is no usable entry.
+ */
+bool load_proguard_cache(const std::string& cache_dir,
+                         const std::string& key,
+                         const Scope& classes,
+                         ProguardConfiguration* pg_config);
+
+void save_proguard_cache(const std::string& cache_dir,
+                         const std::string& key,
+                         const Scope& classes,
+                         const ProguardConfiguration& pg_config);
+
+} // namespace redex
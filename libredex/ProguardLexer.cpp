@@ -7,11 +7,10 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
 #include <cctype>
-#include <fstream>
-#include <iostream>
-#include <memory>
-#include <utility>
+#include <cstdio>
+#include <iterator>
 #include <vector>
 
 #include "Debug.h"
@@ -20,594 +19,647 @@
 namespace redex {
 namespace proguard_parser {
 
-bool is_deliminator(char ch) {
+namespace {
+
+/*
+ * The lexer reads the configuration in place: the tokens that carry a
+ * spelling point into the text instead of copying it, so lexing a merged
+ * configuration allocates nothing but the token vector.
+ */
+class Cursor {
+ public:
+  explicit Cursor(boost::string_ref text)
+      : m_cur(text.data()), m_end(text.data() + text.size()) {}
+
+  // The next character, or EOF, in the manner of istream::peek().
+  int peek() const {
+    return m_cur == m_end ? EOF : static_cast<unsigned char>(*m_cur);
+  }
+
+  char get() { return *m_cur++; }
+
+  const char* pos() const { return m_cur; }
+  void seek(const char* pos) { m_cur = pos; }
+
+  boost::string_ref since(const char* start) const {
+    return boost::string_ref(start, m_cur - start);
+  }
+
+ private:
+  const char* m_cur;
+  const char* m_end;
+};
+
+bool is_deliminator(int ch) {
   return isspace(ch) || ch == '{' || ch == '}' || ch == '(' || ch == ')' ||
-         ch == ',' || ch == ';' || ch == ':' ||
-         ch == EOF;
+         ch == ',' || ch == ';' || ch == ':' || ch == EOF;
 }
 
 // An identifier can refer to a class name, a field name or a package name.
-bool is_identifier_character(char ch) {
+bool is_identifier_character(int ch) {
   return isalnum(ch) || ch == '_' || ch == '$' || ch == '*' || ch == '.' ||
          ch == '\'' || ch == '[' || ch == ']' || ch == '<' || ch == '>' ||
          ch == '!' || ch == '?' || ch == '%';
 }
 
-bool is_identifier(string ident) {
-  for (const char& ch : ident) {
-    if (!is_identifier_character(ch)) {
-      return false;
-    }
-  }
-  return true;
+bool is_identifier(boost::string_ref ident) {
+  return std::all_of(ident.begin(), ident.end(), [](char ch) {
+    return is_identifier_character(static_cast<unsigned char>(ch));
+  });
 }
 
-void skip_whitespace(istream& config, unsigned int* line) {
-  char ch;
+void skip_whitespace(Cursor& config, unsigned int* line) {
   while (isspace(config.peek())) {
-    config.get(ch);
-    if (ch == '\n') {
+    if (config.get() == '\n') {
       (*line)++;
     }
   }
 }
 
-string read_path(istream& config, unsigned int* line) {
-  string path;
+// A path may be quoted; the quotes stay in the token and are dropped by
+// Token::str().
+bool is_empty_path(boost::string_ref path) {
+  return path.find_first_not_of('"') == boost::string_ref::npos;
+}
+
+boost::string_ref read_path(Cursor& config, unsigned int* line) {
   skip_whitespace(config, line);
   // Handle the case for optional filepath arguments by
   // returning an empty filepath.
   if (config.peek() == '-' || config.peek() == EOF) {
-    return "";
+    return boost::string_ref();
   }
+  auto start = config.pos();
   while (config.peek() != ':' && !isspace(config.peek()) &&
          config.peek() != EOF) {
-    char ch;
-    config.get(ch);
-    if (ch == '"') {
-      continue;
-    }
-    path += ch;
+    config.get();
   }
-  return path;
+  return config.since(start);
 }
 
-vector<pair<string, unsigned int>> read_paths(istream& config, unsigned int* line) {
-  vector<pair<string, unsigned int>> paths;
-  paths.push_back({read_path(config, line), *line});
+void read_paths(Cursor& config, unsigned int* line, vector<Token>* tokens) {
+  auto path = read_path(config, line);
+  tokens->emplace_back(token::filepath, *line, path);
   skip_whitespace(config, line);
   while (config.peek() == ':') {
-    char ch;
-    config.get(ch);
-    paths.push_back({read_path(config, line), *line});
+    config.get();
+    path = read_path(config, line);
+    tokens->emplace_back(token::filepath, *line, path);
     skip_whitespace(config, line);
   }
-  return paths;
 }
 
-bool is_version_character(char ch) { return ch == '.' || isdigit(ch); }
+bool is_version_character(int ch) { return ch == '.' || isdigit(ch); }
 
-string read_target_version(istream& config, unsigned int* line) {
-  string version;
+boost::string_ref read_target_version(Cursor& config, unsigned int* line) {
   skip_whitespace(config, line);
+  auto start = config.pos();
   while (is_version_character(config.peek())) {
-    char ch;
-    config.get(ch);
-    version += ch;
+    config.get();
   }
-  return version;
+  return config.since(start);
 }
 
-bool is_package_name_character(char ch) {
+bool is_package_name_character(int ch) {
   return isalnum(ch) || ch == '.' || ch == '\'' || ch == '_' || ch == '$';
 }
 
-string parse_package_name(istream& config, unsigned int* line) {
+boost::string_ref parse_package_name(Cursor& config, unsigned int* line) {
   skip_whitespace(config, line);
-  string package_name;
+  auto start = config.pos();
   while (is_package_name_character(config.peek())) {
-    char ch;
-    config.get(ch);
-    package_name += ch;
+    config.get();
   }
-  return package_name;
+  return config.since(start);
 }
 
-bool lex_filter(istream& config, string* filter, unsigned int* line) {
+bool lex_filter(Cursor& config, boost::string_ref* filter, unsigned int* line) {
   skip_whitespace(config, line);
   // Make sure we are not at the end of the file or the start of another
   // command when the argument is missing.
   if (config.peek() == EOF || config.peek() == '-') {
     return false;
   }
-  *filter = "";
+  auto start = config.pos();
   while (config.peek() != ',' && !isspace(config.peek()) &&
-         !(config.peek() == EOF)) {
-    char ch;
-    config.get(ch);
-    *filter += ch;
+         config.peek() != EOF) {
+    config.get();
   }
+  *filter = config.since(start);
   return true;
 }
 
-vector<string> lex_filter_list(istream& config, unsigned int* line) {
-  vector<string> filter_list;
-  string filter;
+// The filters all get the line the list ends on.
+void lex_filter_list(Cursor& config,
+                     unsigned int* line,
+                     vector<Token>* tokens) {
+  auto first = tokens->size();
+  boost::string_ref filter;
   bool ok = lex_filter(config, &filter, line);
   if (!ok) {
-    return filter_list;
+    return;
   }
-  filter_list.push_back(filter);
+  tokens->emplace_back(token::filter_pattern, *line, filter);
   skip_whitespace(config, line);
   while (ok && config.peek() == ',') {
     // Swallow up the comma.
-    char ch;
-    config.get(ch);
+    config.get();
     ok = lex_filter(config, &filter, line);
     if (ok) {
-      filter_list.push_back(filter);
+      tokens->emplace_back(token::filter_pattern, *line, filter);
       skip_whitespace(config, line);
     }
   }
-  return filter_list;
+  for (auto i = first; i < tokens->size(); ++i) {
+    (*tokens)[i].line = *line;
+  }
+}
+
+// What follows a command on its line, if anything the lexer reads.
+enum class Argument {
+  none,
+  optional_path,
+  paths,
+  target_version,
+  filters,
+  package_name,
+};
+
+struct CommandSpec {
+  const char* name;
+  token type;
+  Argument argument;
+};
+
+const CommandSpec s_commands[] = {
+    // Input/Output Options
+    {"include", token::include, Argument::optional_path},
+    {"basedirectory", token::basedirectory, Argument::optional_path},
+    {"injars", token::injars, Argument::paths},
+    {"outjars", token::outjars, Argument::paths},
+    {"libraryjars", token::libraryjars, Argument::paths},
+    {"printmapping", token::printmapping, Argument::optional_path},
+    {"printconfiguration",
+     token::printconfiguration,
+     Argument::optional_path},
+    {"printseeds", token::printseeds, Argument::optional_path},
+    {"target", token::target, Argument::target_version},
+
+    // Keep Options
+    {"keepdirectories", token::keepdirectories, Argument::paths},
+    {"keep", token::keep, Argument::none},
+    {"keepclassmembers", token::keepclassmembers, Argument::none},
+    {"keepclasseswithmembers", token::keepclasseswithmembers, Argument::none},
+    {"keepnames", token::keepnames, Argument::none},
+    {"keepclassmembernames", token::keepclassmembernames, Argument::none},
+    {"keepclasseswithmembernames",
+     token::keepclasseswithmembernames,
+     Argument::none},
+
+    // Shrinking Options
+    {"dontshrink", token::dontshrink, Argument::none},
+    {"printusage", token::printusage, Argument::optional_path},
+    {"whyareyoukeeping", token::whyareyoukeeping, Argument::none},
+
+    // Optimization Options
+    {"optimizations", token::optimizations, Argument::filters},
+    {"assumenosideeffects", token::assumenosideeffects, Argument::none},
+    {"allowaccessmodification",
+     token::allowaccessmodification_token,
+     Argument::none},
+    {"dontoptimize", token::dontoptimize, Argument::none},
+    {"optimizationpasses", token::optimizationpasses, Argument::none},
+    {"mergeinterfacesaggressively",
+     token::mergeinterfacesaggressively,
+     Argument::none},
+
+    // Obfusication Options
+    {"dontobfuscate", token::dontobfuscate, Argument::none},
+    {"repackageclasses", token::repackageclasses, Argument::package_name},
+    {"keepattributes", token::keepattributes, Argument::filters},
+    {"dontusemixedcaseclassnames",
+     token::dontusemixedcaseclassnames_token,
+     Argument::none},
+    {"dontskipnonpubliclibraryclasses",
+     token::dontskipnonpubliclibraryclasses,
+     Argument::none},
+    {"keeppackagenames", token::keeppackagenames, Argument::none},
+
+    // Preverification Options.
+    {"dontpreverify", token::dontpreverify_token, Argument::none},
+
+    // General Options
+    {"dontwarn", token::dontwarn, Argument::filters},
+    {"verbose", token::verbose_token, Argument::none},
+};
+
+struct KeywordSpec {
+  const char* name;
+  token type;
+};
+
+// "interface" is missing: after an @ it makes an annotation.
+const KeywordSpec s_keywords[] = {
+    {"includedescriptorclasses", token::includedescriptorclasses_token},
+    {"allowshrinking", token::allowshrinking_token},
+    {"allowoptimization", token::allowoptimization_token},
+    {"allowobfuscation", token::allowobfuscation_token},
+    {"class", token::classToken},
+    {"public", token::publicToken},
+    {"final", token::final},
+    {"abstract", token::abstract},
+    {"enum", token::enumToken},
+    {"private", token::privateToken},
+    {"protected", token::protectedToken},
+    {"static", token::staticToken},
+    {"volatile", token::volatileToken},
+    {"transient", token::transient},
+    {"synchronized", token::synchronized},
+    {"native", token::native},
+    {"strictfp", token::strictfp},
+    {"synthetic", token::synthetic},
+    {"bridge", token::bridge},
+    {"varargs", token::varargs},
+    {"extends", token::extends},
+    {"implements", token::implements},
+};
+
+void lex_command(Cursor& config, unsigned int* line, vector<Token>* tokens) {
+  auto start = config.pos();
+  while (!is_deliminator(config.peek())) {
+    config.get();
+  }
+  auto command = config.since(start);
+
+  auto spec = std::find_if(
+      std::begin(s_commands),
+      std::end(s_commands),
+      [&](const CommandSpec& spec) { return command == spec.name; });
+  if (spec == std::end(s_commands)) {
+    // Some other command.
+    tokens->emplace_back(token::command, *line, command);
+    return;
+  }
+  tokens->emplace_back(spec->type, *line);
+  switch (spec->argument) {
+  case Argument::none:
+    break;
+  case Argument::optional_path: {
+    auto path = read_path(config, line);
+    if (!is_empty_path(path)) {
+      tokens->emplace_back(token::filepath, *line, path);
+    }
+    break;
+  }
+  case Argument::paths:
+    read_paths(config, line, tokens);
+    break;
+  case Argument::target_version: {
+    auto version = read_target_version(config, line);
+    if (!version.empty()) {
+      tokens->emplace_back(token::target_version_token, *line, version);
+    }
+    break;
+  }
+  case Argument::filters:
+    lex_filter_list(config, line, tokens);
+    break;
+  case Argument::package_name: {
+    auto package_name = parse_package_name(config, line);
+    if (!package_name.empty()) {
+      tokens->emplace_back(token::identifier, *line, package_name);
+    }
+    break;
+  }
+  }
 }
 
-vector<unique_ptr<Token>> lex(istream& config) {
-  std::vector<unique_ptr<Token>> tokens;
+} // namespace
+
+vector<Token> lex(boost::string_ref text) {
+  std::vector<Token> tokens;
+  Cursor config(text);
 
   unsigned int line = 1;
-  char ch;
-  while (config.get(ch)) {
+  while (config.peek() != EOF) {
+    auto start = config.pos();
+    char ch = config.get();
 
     // Skip comments.
     if (ch == '#') {
-      string comment;
-      getline(config, comment);
+      while (config.peek() != EOF && config.get() != '\n') {
+      }
       line++;
       continue;
     }
 
     // Skip white space.
-    if (isspace(ch)) {
+    if (isspace(static_cast<unsigned char>(ch))) {
       if (ch == '\n') {
         line++;
       }
       continue;
     }
 
-    if (ch == '{') {
-      tokens.push_back(unique_ptr<Token>(new OpenCurlyBracket(line)));
+    switch (ch) {
+    case '{':
+      tokens.emplace_back(token::openCurlyBracket, line);
       continue;
-    }
-
-    if (ch == '}') {
-      tokens.push_back(unique_ptr<Token>(new CloseCurlyBracket(line)));
+    case '}':
+      tokens.emplace_back(token::closeCurlyBracket, line);
       continue;
-    }
-
-    if (ch == '(') {
-      tokens.push_back(unique_ptr<Token>(new OpenBracket(line)));
+    case '(':
+      tokens.emplace_back(token::openBracket, line);
       continue;
-    }
-
-    if (ch == ')') {
-      tokens.push_back(unique_ptr<Token>(new CloseBracket(line)));
+    case ')':
+      tokens.emplace_back(token::closeBracket, line);
       continue;
-    }
-
-    if (ch == ';') {
-      tokens.push_back(unique_ptr<Token>(new SemiColon(line)));
+    case ';':
+      tokens.emplace_back(token::semiColon, line);
       continue;
-    }
-
-    if (ch == ':') {
-      tokens.push_back(unique_ptr<Token>(new Colon(line)));
+    case ':':
+      tokens.emplace_back(token::colon, line);
       continue;
-    }
-
-    if (ch == ',') {
-      tokens.push_back(unique_ptr<Token>(new Comma(line)));
+    case ',':
+      tokens.emplace_back(token::comma, line);
       continue;
-    }
-
-    if (ch == '!') {
-      tokens.push_back(unique_ptr<Token>(new Not(line)));
+    case '!':
+      tokens.emplace_back(token::notToken, line);
       continue;
-    }
-
-    if (ch == '/') {
-      tokens.push_back(unique_ptr<Token>(new Slash(line)));
+    case '/':
+      tokens.emplace_back(token::slash, line);
       continue;
-    }
-
-    if (ch == '@') {
-      tokens.push_back(unique_ptr<Token>(new AnnotationApplication(line)));
+    case '@':
+      tokens.emplace_back(token::annotation_application, line);
+      continue;
+    case '-':
+      lex_command(config, &line, &tokens);
       continue;
+    default:
+      break;
     }
 
     if (ch == '[') {
-      // Consume any whitespace
-      while (isspace(config.peek())) {
-        char skip;
-        config.get(skip);
-        if (skip == '\n') {
-          line++;
-        }
-      }
-      // Check for closing brace.
+      // Look past any whitespace for the closing brace.
+      auto bracket_line = line;
+      skip_whitespace(config, &bracket_line);
       if (config.peek() == ']') {
-        config.get(ch);
-        tokens.push_back(unique_ptr<Token>(new ArrayType(line)));
+        config.get();
+        line = bracket_line;
+        tokens.emplace_back(token::arrayType, line);
         continue;
       }
       // Any token other than a ']' next is a bad token.
+      config.seek(start + 1);
     }
 
-    // Check for commands.
-    if (ch == '-') {
-      string command;
-      while (!is_deliminator(config.peek())) {
-        config.get(ch);
-        command += ch;
-      }
-
-      // Input/Output Options
-      if (command == "include") {
-        tokens.push_back(unique_ptr<Token>(new Include(line)));
-        string path = read_path(config, &line);
-        if (path != "") {
-          tokens.push_back(unique_ptr<Token>(new Filepath(line, path)));
-        }
-        continue;
-      }
-      if (command == "basedirectory") {
-        tokens.push_back(unique_ptr<Token>(new BaseDirectory(line)));
-        string path = read_path(config, &line);
-        if (path != "") {
-          tokens.push_back(unique_ptr<Token>(new Filepath(line, path)));
-        }
-        continue;
-      }
-      if (command == "injars") {
-        tokens.push_back(unique_ptr<Token>(new InJars(line)));
-        vector<pair<string, unsigned int>> paths = read_paths(config, &line);
-        for (const auto& path : paths) {
-          tokens.push_back(unique_ptr<Token>(new Filepath(path.second, path.first)));
-        }
-        continue;
-      }
-      if (command == "outjars") {
-        tokens.push_back(unique_ptr<Token>(new OutJars(line)));
-        vector<pair<string, unsigned int>> paths = read_paths(config, &line);
-        for (const auto& path : paths) {
-          tokens.push_back(unique_ptr<Token>(new Filepath(path.second, path.first)));
-        }
-        continue;
-      }
-      if (command == "libraryjars") {
-        tokens.push_back(unique_ptr<Token>(new LibraryJars(line)));
-        vector<pair<string, unsigned int>> paths = read_paths(config, &line);
-        for (const auto& path : paths) {
-          tokens.push_back(unique_ptr<Token>(new Filepath(path.second, path.first)));
-        }
-        continue;
-      }
-      if (command == "printmapping") {
-        tokens.push_back(unique_ptr<Token>(new PrintMapping(line)));
-        string path = read_path(config, &line);
-        if (path != "") {
-          tokens.push_back(unique_ptr<Token>(new Filepath(line, path)));
-        }
-        continue;
-      }
-      if (command == "printconfiguration") {
-        tokens.push_back(unique_ptr<Token>(new PrintConfiguration(line)));
-        string path = read_path(config, &line);
-        if (path != "") {
-          tokens.push_back(unique_ptr<Token>(new Filepath(line, path)));
-        }
-        continue;
-      }
-      if (command == "printseeds") {
-        tokens.push_back(unique_ptr<Token>(new PrintSeeds(line)));
-        string path = read_path(config, &line);
-        if (path != "") {
-          tokens.push_back(unique_ptr<Token>(new Filepath(line, path)));
-        }
-        continue;
-      }
-      if (command == "target") {
-        tokens.push_back(unique_ptr<Token>(new Target(line)));
-        string version = read_target_version(config, &line);
-        if (version != "") {
-          tokens.push_back(unique_ptr<Token>(new TargetVersion(line, version)));
-        }
-        continue;
-      }
-
-      // Keep Options
-      if (command == "keepdirectories") {
-        tokens.push_back(unique_ptr<Token>(new KeepDirectories(line)));
-        vector<pair<string, unsigned int>> paths = read_paths(config, &line);
-        for (const auto& path : paths) {
-          tokens.push_back(unique_ptr<Token>(new Filepath(path.second, path.first)));
-        }
-        continue;
-      }
-      if (command == "keep") {
-        tokens.push_back(unique_ptr<Token>(new Keep(line)));
-        continue;
-      }
-      if (command == "keepclassmembers") {
-        tokens.push_back(unique_ptr<Token>(new KeepClassMembers(line)));
-        continue;
-      }
-      if (command == "keepclasseswithmembers") {
-        tokens.push_back(unique_ptr<Token>(new KeepClassesWithMembers(line)));
-        continue;
-      }
-      if (command == "keepnames") {
-        tokens.push_back(unique_ptr<Token>(new KeepNames(line)));
-        continue;
-      }
-      if (command == "keepclassmembernames") {
-        tokens.push_back(unique_ptr<Token>(new KeepClassMemberNames(line)));
-        continue;
-      }
-      if (command == "keepclasseswithmembernames") {
-        tokens.push_back(
-            unique_ptr<Token>(new KeepClassesWithMemberNames(line)));
-        continue;
-      }
-
-      // Shrinking Options
-      if (command == "dontshrink") {
-        tokens.push_back(unique_ptr<Token>(new DontShrink(line)));
-        continue;
-      }
-      if (command == "printusage") {
-        tokens.push_back(unique_ptr<Token>(new PrintUsage(line)));
-        string path = read_path(config, &line);
-        if (path != "") {
-          tokens.push_back(unique_ptr<Token>(new Filepath(line, path)));
-        }
-        continue;
-      }
-      if (command == "whyareyoukeeping") {
-        tokens.push_back(unique_ptr<Token>(new WhyAreYouKeeping(line)));
-        continue;
-      }
-
-      // Optimization Options
-      if (command == "optimizations") {
-        tokens.push_back(unique_ptr<Token>(new Optimizations(line)));
-        for (const auto& filter : lex_filter_list(config, &line)) {
-          tokens.push_back(unique_ptr<Token>(new Filter(line, filter)));
-        }
-        continue;
-      }
-      if (command == "assumenosideeffects") {
-        tokens.push_back(unique_ptr<Token>(new AssumeSideEffects(line)));
-        continue;
-      }
-      if (command == "allowaccessmodification") {
-        tokens.push_back(unique_ptr<Token>(new AllowAccessModification(line)));
-        continue;
-      }
-      if (command == "dontoptimize") {
-        tokens.push_back(unique_ptr<Token>(new DontOptimize(line)));
-        continue;
-      }
-      if (command == "optimizationpasses") {
-        tokens.push_back(unique_ptr<Token>(new OptimizationPasses(line)));
-        continue;
-      }
-      if (command == "mergeinterfacesaggressively") {
-        tokens.push_back(
-            unique_ptr<Token>(new MergeInterfacesAggressively(line)));
-        continue;
-      }
-
-      // Obfusication Options
-      if (command == "dontobfuscate") {
-        tokens.push_back(unique_ptr<Token>(new DontObfuscate(line)));
-        continue;
-      }
-      if (command == "repackageclasses") {
-        tokens.push_back(unique_ptr<Token>(new RepackageClasses(line)));
-        string package_name = parse_package_name(config, &line);
-        if (package_name != "") {
-          tokens.push_back(
-              unique_ptr<Token>(new Identifier(line, package_name)));
-        }
-        continue;
-      }
-      if (command == "keepattributes") {
-        tokens.push_back(unique_ptr<Token>(new KeepAttributes(line)));
-        for (const auto& filter : lex_filter_list(config, &line)) {
-          tokens.push_back(unique_ptr<Token>(new Filter(line, filter)));
-        }
-        continue;
-      }
-      if (command == "dontusemixedcaseclassnames") {
-        tokens.push_back(
-            unique_ptr<Token>(new DontUseMixedcaseClassNames(line)));
-        continue;
-      }
-      if (command == "dontskipnonpubliclibraryclasses") {
-        tokens.push_back(
-            unique_ptr<Token>(new DontSkipNonPublicLibraryClasses(line)));
-        continue;
-      }
-      if (command == "keeppackagenames") {
-        tokens.push_back(unique_ptr<Token>(new KeepPackageNames(line)));
-        continue;
-      }
-
-      // Preverification Options.
-      if (command == "dontpreverify") {
-        tokens.push_back(unique_ptr<Token>(new DontPreverify(line)));
-        continue;
-      }
-
-      // General Options
-      if (command == "dontwarn") {
-        tokens.push_back(unique_ptr<Token>(new DontWarn(line)));
-        for (const auto& filter : lex_filter_list(config, &line)) {
-          tokens.push_back(unique_ptr<Token>(new Filter(line, filter)));
-        }
-        continue;
-      }
-      if (command == "verbose") {
-        tokens.push_back(unique_ptr<Token>(new Verbose(line)));
-        continue;
-      }
-
-      // Some other command.
-      tokens.push_back(unique_ptr<Token>(new Command(line, command)));
-      continue;
-    }
-
-    string word;
-    word += ch;
     while (!is_deliminator(config.peek())) {
-      config >> ch;
-      word += ch;
-    }
-
-    if (word == "includedescriptorclasses") {
-      tokens.push_back(unique_ptr<Token>(new IncludeDescriptorClasses(line)));
-      continue;
-    }
-
-    if (word == "allowshrinking") {
-      tokens.push_back(unique_ptr<Token>(new AllowShrinking(line)));
-      continue;
-    }
-
-    if (word == "allowoptimization") {
-      tokens.push_back(unique_ptr<Token>(new AllowOptimization(line)));
-      continue;
-    }
-
-    if (word == "allowobfuscation") {
-      tokens.push_back(unique_ptr<Token>(new AllowObfuscation(line)));
-      continue;
-    }
-
-    if (word == "class") {
-      tokens.push_back(unique_ptr<Token>(new Class(line)));
-      continue;
-    }
-
-    if (word == "public") {
-      tokens.push_back(unique_ptr<Token>(new Public(line)));
-      continue;
-    }
-
-    if (word == "final") {
-      tokens.push_back(unique_ptr<Token>(new Final(line)));
-      continue;
-    }
-
-    if (word == "abstract") {
-      tokens.push_back(unique_ptr<Token>(new Abstract(line)));
-      continue;
+      config.get();
     }
+    auto word = config.since(start);
 
     if (word == "interface") {
       // If the previous symbol was a @ then this is really an annotation.
       if (!tokens.empty() &&
-          tokens.back()->type == token::annotation_application) {
-        tokens.pop_back();
-        tokens.push_back(unique_ptr<Token>(new Annotation(line)));
+          tokens.back().type == token::annotation_application) {
+        tokens.back() = Token(token::annotation, line);
       } else {
-        tokens.push_back(unique_ptr<Token>(new Interface(line)));
+        tokens.emplace_back(token::interface, line);
       }
       continue;
     }
 
-    if (word == "enum") {
-      tokens.push_back(unique_ptr<Token>(new Enum(line)));
-      continue;
-    }
-
-    if (word == "private") {
-      tokens.push_back(unique_ptr<Token>(new Private(line)));
-      continue;
-    }
-
-    if (word == "protected") {
-      tokens.push_back(unique_ptr<Token>(new Protected(line)));
-      continue;
-    }
-
-    if (word == "static") {
-      tokens.push_back(unique_ptr<Token>(new Static(line)));
-      continue;
-    }
-
-    if (word == "volatile") {
-      tokens.push_back(unique_ptr<Token>(new Volatile(line)));
-      continue;
-    }
-
-    if (word == "transient") {
-      tokens.push_back(unique_ptr<Token>(new Transient(line)));
-      continue;
-    }
-
-    if (word == "synchronized") {
-      tokens.push_back(unique_ptr<Token>(new Synchronized(line)));
-      continue;
-    }
-
-    if (word == "native") {
-      tokens.push_back(unique_ptr<Token>(new Native(line)));
-      continue;
-    }
-
-    if (word == "strictfp") {
-      tokens.push_back(unique_ptr<Token>(new Strictfp(line)));
-      continue;
-    }
-
-    if (word == "synthetic") {
-      tokens.push_back(unique_ptr<Token>(new Synthetic(line)));
-      continue;
-    }
-
-    if (word == "bridge") {
-      tokens.push_back(unique_ptr<Token>(new Bridge(line)));
-      continue;
-    }
-
-    if (word == "varargs") {
-      tokens.push_back(unique_ptr<Token>(new Varargs(line)));
-      continue;
-    }
-
-    if (word == "extends") {
-      tokens.push_back(unique_ptr<Token>(new Extends(line)));
-      continue;
-    }
-
-    if (word == "implements") {
-      tokens.push_back(unique_ptr<Token>(new Implements(line)));
+    auto keyword = std::find_if(
+        std::begin(s_keywords),
+        std::end(s_keywords),
+        [&](const KeywordSpec& spec) { return word == spec.name; });
+    if (keyword != std::end(s_keywords)) {
+      tokens.emplace_back(keyword->type, line);
       continue;
     }
 
     if (is_identifier(word)) {
-      tokens.push_back(unique_ptr<Token>(new Identifier(line, word)));
+      tokens.emplace_back(token::identifier, line, word);
       continue;
     }
 
     // This is an unrecognized token.
-    tokens.push_back(unique_ptr<Token>(new UnknownToken(word, line)));
+    tokens.emplace_back(token::unknownToken, line, word);
   }
-  tokens.push_back(unique_ptr<Token>(new EndOfFile(line)));
+  tokens.emplace_back(token::eof_token, line);
   return tokens;
 }
 
+string Token::str() const {
+  if (type != token::filepath) {
+    return data.to_string();
+  }
+  string path;
+  path.reserve(data.size());
+  std::remove_copy(data.begin(), data.end(), std::back_inserter(path), '"');
+  return path;
+}
+
+string Token::show() const {
+  switch (type) {
+  case token::openCurlyBracket:
+    return "{";
+  case token::closeCurlyBracket:
+    return "}";
+  case token::openBracket:
+    return "(";
+  case token::closeBracket:
+    return ")";
+  case token::semiColon:
+    return ";";
+  case token::colon:
+    return ":";
+  case token::notToken:
+    return "!";
+  case token::comma:
+    return ",";
+  case token::slash:
+    return "/";
+  case token::classToken:
+    return "class";
+  case token::publicToken:
+    return "public";
+  case token::final:
+    return "final";
+  case token::abstract:
+    return "abstract";
+  case token::interface:
+    return "interface";
+  case token::enumToken:
+    return "enum";
+  case token::extends:
+    return "extends";
+  case token::implements:
+    return "implements";
+  case token::privateToken:
+    return "private";
+  case token::protectedToken:
+    return "protected";
+  case token::staticToken:
+    return "static";
+  case token::volatileToken:
+    return "volatile";
+  case token::transient:
+    return "transient";
+  case token::annotation:
+    return "@interface";
+  case token::annotation_application:
+    return "@";
+  case token::synchronized:
+    return "synchronized";
+  case token::native:
+    return "native";
+  case token::strictfp:
+    return "strictfp";
+  case token::synthetic:
+    return "synthetic";
+  case token::bridge:
+    return "bridge";
+  case token::varargs:
+    return "varargs";
+  case token::command:
+    return "-" + str();
+  case token::identifier:
+    return "identifier: " + str();
+  case token::arrayType:
+    return "[]";
+  case token::filepath:
+    return "filepath " + str();
+  case token::target_version_token:
+    return str();
+  case token::filter_pattern:
+    return "filter: " + str();
+  case token::eof_token:
+    return "<EOF>";
+  case token::include:
+    return "-include";
+  case token::basedirectory:
+    return "-basedirectory";
+  case token::injars:
+    return "-injars ";
+  case token::outjars:
+    return "-outjars ";
+  case token::libraryjars:
+    return "-libraryjars ";
+  case token::keepdirectories:
+    return "-keepdirectories";
+  case token::target:
+    return "-target ";
+  case token::dontskipnonpubliclibraryclasses:
+    return "-dontskipnonpubliclibraryclasses";
+  case token::keep:
+    return "-keep";
+  case token::keepclassmembers:
+    return "-keepclassmembers";
+  case token::keepclasseswithmembers:
+    return "-keepclasseswithmembers";
+  case token::keepnames:
+    return "-keepnames";
+  case token::keepclassmembernames:
+    return "-keepclassmembernames";
+  case token::keepclasseswithmembernames:
+    return "-keepclasseswithmembernames";
+  case token::printseeds:
+    return "-printseeds ";
+  case token::includedescriptorclasses_token:
+    return "includedescriptorclasses";
+  case token::allowshrinking_token:
+    return "allowoptimization";
+  case token::allowoptimization_token:
+    return "allowshrinking";
+  case token::allowobfuscation_token:
+    return "allowobfuscation";
+  case token::dontshrink:
+    return "-dontshrink";
+  case token::printusage:
+    return "-printusage";
+  case token::whyareyoukeeping:
+    return "-whyareyoukeeping";
+  case token::dontoptimize:
+    return "-dontoptimize";
+  case token::optimizations:
+    return "-optimizations";
+  case token::optimizationpasses:
+    return "-optimizationpasses";
+  case token::assumenosideeffects:
+    return "-assumenosideeffects";
+  case token::mergeinterfacesaggressively:
+    return "-mergeinterfacesaggressively";
+  case token::allowaccessmodification_token:
+    return "-allowaccessmodification";
+  case token::dontobfuscate:
+    return "-dontobfuscate ";
+  case token::printmapping:
+    return "-printmapping ";
+  case token::repackageclasses:
+    return "-repackageclasses";
+  case token::keepattributes:
+    return "-keepattributes";
+  case token::dontusemixedcaseclassnames_token:
+    return "-dontusemixedcaseclassnames";
+  case token::keeppackagenames:
+    return "-keeppackagenames";
+  case token::dontpreverify_token:
+    return "-dontpreverify";
+  case token::printconfiguration:
+    return "-printconfiguration ";
+  case token::dontwarn:
+    return "-dontwarn";
+  case token::verbose_token:
+    return "-verbose";
+  case token::unknownToken:
+    return "unknown token at line " + to_string(line) + " : " + str();
+  }
+  not_reached();
+}
+
+bool Token::is_command() const {
+  switch (type) {
+  case token::command:
+  case token::include:
+  case token::basedirectory:
+  case token::injars:
+  case token::outjars:
+  case token::libraryjars:
+  case token::keepdirectories:
+  case token::target:
+  case token::dontskipnonpubliclibraryclasses:
+  case token::keep:
+  case token::keepclassmembers:
+  case token::keepclasseswithmembers:
+  case token::keepnames:
+  case token::keepclassmembernames:
+  case token::keepclasseswithmembernames:
+  case token::printseeds:
+  case token::dontshrink:
+  case token::printusage:
+  case token::whyareyoukeeping:
+  case token::dontoptimize:
+  case token::optimizations:
+  case token::optimizationpasses:
+  case token::assumenosideeffects:
+  case token::mergeinterfacesaggressively:
+  case token::allowaccessmodification_token:
+  case token::dontobfuscate:
+  case token::printmapping:
+  case token::repackageclasses:
+  case token::keepattributes:
+  case token::dontusemixedcaseclassnames_token:
+  case token::keeppackagenames:
+  case token::dontpreverify_token:
+  case token::printconfiguration:
+  case token::dontwarn:
+  case token::verbose_token:
+    return true;
+  default:
+    return false;
+  }
+}
+
 } // namespace proguard_parser
 } // namespace redex
@@ -9,20 +9,17 @@
 
 #include "ProguardMap.h"
 
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
+#include <iterator>
+
 #include "DexUtil.h"
 #include "Timer.h"
 #include "WorkQueue.h"
 
 namespace {
 
-std::string find_or_same(
-    const std::string& key,
-    const std::unordered_map<std::string, std::string>& map) {
-  auto it = map.find(key);
-  if (it == map.end()) return key;
-  return it->second;
-}
-
 std::string convert_scalar_type(std::string type) {
   static const std::unordered_map<std::string, std::string> prim_map =
     {{"void",    "V"},
@@ -119,80 +116,24 @@ bool literal(const char*& p, char s) {
   }
   return false;
 }
-}
-
-ProguardMap::ProguardMap(const std::string& filename) {
-  if (!filename.empty()) {
-    Timer t("Parsing proguard map");
-    std::ifstream fp(filename);
-    always_assert_log(fp, "Can't open proguard map: %s\n", filename.c_str());
-    parse_proguard_map(fp);
-  }
-}
-
-std::string ProguardMap::translate_class(const std::string& cls) const {
-  return find_or_same(cls, m_classMap);
-}
-
-std::string ProguardMap::translate_field(const std::string& field) const {
-  return find_or_same(field, m_fieldMap);
-}
-
-std::string ProguardMap::translate_method(const std::string& method) const {
-  return find_or_same(method, m_methodMap);
-}
-
-std::string ProguardMap::deobfuscate_class(const std::string& cls) const {
-  return find_or_same(cls, m_obfClassMap);
-}
-
-std::string ProguardMap::deobfuscate_field(const std::string& field) const {
-  return find_or_same(field, m_obfFieldMap);
-}
-
-std::string ProguardMap::deobfuscate_method(const std::string& method) const {
-  return find_or_same(method, m_obfMethodMap);
-}
-
-void ProguardMap::parse_proguard_map(std::istream& fp) {
-  std::string line;
-  while (std::getline(fp, line)) {
-    parse_class(line);
-  }
-  fp.clear();
-  fp.seekg(0);
-  assert_log(!fp.fail(), "Can't use ProguardMap with non-seekable stream");
-  while (std::getline(fp, line)) {
-    if (parse_class(line)) {
-      continue;
-    }
-    if (parse_field(line)) {
-      continue;
-    }
-    if (parse_method(line)) {
-      continue;
-    }
-    always_assert_log(false,
-                      "Bogus line encountered in proguard map: %s\n",
-                      line.c_str());
-  }
-}
 
-bool ProguardMap::parse_class(const std::string& line) {
-  std::string classname;
-  std::string newname;
+bool parse_class(const std::string& line,
+                 std::string* classname,
+                 std::string* newname) {
   auto p = line.c_str();
-  if (!id(p, classname)) return false;
+  if (!id(p, *classname)) return false;
   if (!literal(p, " -> ")) return false;
-  if (!id(p, newname)) return false;
-  m_currClass = convert_type(classname);
-  m_currNewClass = convert_type(newname);
-  m_classMap[m_currClass] = m_currNewClass;
-  m_obfClassMap[m_currNewClass] = m_currClass;
+  if (!id(p, *newname)) return false;
+  *classname = convert_type(*classname);
+  *newname = convert_type(*newname);
   return true;
 }
 
-bool ProguardMap::parse_field(const std::string& line) {
+bool parse_field(const std::string& line,
+                 const std::string& curr_class,
+                 const std::string& curr_new_class,
+                 const ProguardMap& pm,
+                 std::pair<std::string, std::string>* entry) {
   std::string type;
   std::string fieldname;
   std::string newname;
@@ -206,15 +147,17 @@ bool ProguardMap::parse_field(const std::string& line) {
   if (!id(p, newname)) return false;
 
   auto ctype = convert_type(type);
-  auto xtype = translate_type(ctype, *this);
-  auto pgnew = convert_field(m_currNewClass, xtype, newname);
-  auto pgold = convert_field(m_currClass, ctype, fieldname);
-  m_fieldMap[pgold] = pgnew;
-  m_obfFieldMap[pgnew] = pgold;
+  auto xtype = translate_type(ctype, pm);
+  entry->first = convert_field(curr_class, ctype, fieldname);
+  entry->second = convert_field(curr_new_class, xtype, newname);
   return true;
 }
 
-bool ProguardMap::parse_method(const std::string& line) {
+bool parse_method(const std::string& line,
+                  const std::string& curr_class,
+                  const std::string& curr_new_class,
+                  const ProguardMap& pm,
+                  std::pair<std::string, std::string>* entry) {
   std::string type;
   std::string methodname;
   std::string old_args;
@@ -239,7 +182,7 @@ bool ProguardMap::parse_method(const std::string& line) {
     if (literal(p, ')')) break;
     id(p, arg);
     auto old_arg = convert_type(arg);
-    auto new_arg = translate_type(old_arg, *this);
+    auto new_arg = translate_type(old_arg, pm);
     old_args += old_arg;
     new_args += new_arg;
     literal(p, ',');
@@ -254,14 +197,243 @@ bool ProguardMap::parse_method(const std::string& line) {
   if (!id(p, newname)) return false;
 
   auto old_rtype = convert_type(type);
-  auto new_rtype = translate_type(old_rtype, *this);
-  auto pgold = convert_method(m_currClass, old_rtype, methodname, old_args);
-  auto pgnew = convert_method(m_currNewClass, new_rtype, newname, new_args);
-  m_methodMap[pgold] = pgnew;
-  m_obfMethodMap[pgnew] = pgold;
+  auto new_rtype = translate_type(old_rtype, pm);
+  entry->first = convert_method(curr_class, old_rtype, methodname, old_args);
+  entry->second =
+      convert_method(curr_new_class, new_rtype, newname, new_args);
   return true;
 }
 
+/*
+ * Splits [begin, end) into about n runs of whole lines.
+ */
+std::vector<std::pair<const char*, const char*>> split_lines(const char* begin,
+                                                             const char* end,
+                                                             size_t n) {
+  std::vector<std::pair<const char*, const char*>> ranges;
+  size_t step = std::max<size_t>((end - begin) / n, 1);
+  while (begin < end) {
+    auto split = end;
+    if ((size_t)(end - begin) > step) {
+      auto eol = static_cast<const char*>(
+          memchr(begin + step, '\n', end - begin - step));
+      if (eol != nullptr) {
+        split = eol + 1;
+      }
+    }
+    ranges.emplace_back(begin, split);
+    begin = split;
+  }
+  return ranges;
+}
+
+/*
+ * Calls fn on each non-empty line in [begin, end), with its position. The
+ * line is copied into a reused string, since the parsers rely on lines being
+ * NUL-terminated.
+ */
+template <typename Fn>
+void for_each_line(const char* begin, const char* end, Fn fn) {
+  std::string line;
+  while (begin < end) {
+    auto eol = static_cast<const char*>(memchr(begin, '\n', end - begin));
+    if (eol == nullptr) {
+      eol = end;
+    }
+    if (eol != begin) {
+      line.assign(begin, eol);
+      fn(begin, line);
+    }
+    begin = eol + 1;
+  }
+}
+}
+
+ProguardMap::ProguardMap(const std::string& filename) {
+  if (!filename.empty()) {
+    Timer t("Parsing proguard map");
+    boost::system::error_code ec;
+    auto size = boost::filesystem::file_size(filename, ec);
+    always_assert_log(!ec, "Can't open proguard map: %s\n", filename.c_str());
+    if (size == 0) {
+      return;
+    }
+    boost::iostreams::mapped_file_source file;
+    try {
+      file.open(filename);
+    } catch (const std::exception&) {
+    }
+    always_assert_log(
+        file.is_open(), "Can't open proguard map: %s\n", filename.c_str());
+    parse_proguard_map(file.data(), file.data() + file.size());
+  }
+}
+
+ProguardMap::ProguardMap(std::istream& is) {
+  std::string contents((std::istreambuf_iterator<char>(is)),
+                       std::istreambuf_iterator<char>());
+  parse_proguard_map(contents.data(), contents.data() + contents.size());
+}
+
+std::string ProguardMap::find_or_same(const std::string& key,
+                                      const NameMap& map) {
+  auto it = map.find(NameRef{&key});
+  if (it == map.end()) return key;
+  return *it->second.str;
+}
+
+std::string ProguardMap::translate_class(const std::string& cls) const {
+  return find_or_same(cls, m_classMap);
+}
+
+std::string ProguardMap::translate_field(const std::string& field) const {
+  return find_or_same(field, m_fieldMap);
+}
+
+std::string ProguardMap::translate_method(const std::string& method) const {
+  return find_or_same(method, m_methodMap);
+}
+
+std::string ProguardMap::deobfuscate_class(const std::string& cls) const {
+  return find_or_same(cls, m_obfClassMap);
+}
+
+std::string ProguardMap::deobfuscate_field(const std::string& field) const {
+  return find_or_same(field, m_obfFieldMap);
+}
+
+std::string ProguardMap::deobfuscate_method(const std::string& method) const {
+  return find_or_same(method, m_obfMethodMap);
+}
+
+void ProguardMap::add(std::string old_name,
+                      std::string new_name,
+                      NameMap& map,
+                      NameMap& obf_map) {
+  m_names.push_back(std::move(old_name));
+  NameRef old_ref{&m_names.back()};
+  m_names.push_back(std::move(new_name));
+  NameRef new_ref{&m_names.back()};
+  map[old_ref] = new_ref;
+  obf_map[new_ref] = old_ref;
+}
+
+/*
+ * The classes are parsed first, since the types of the members are
+ * translated with the class map. Both passes run in parallel over runs of
+ * lines, and their results are then added to the maps in file order, so that
+ * later entries win as they would in a sequential parse.
+ */
+void ProguardMap::parse_proguard_map(const char* begin, const char* end) {
+  size_t num_tasks = default_workqueue_threads() * 4;
+
+  struct ClassLine {
+    const char* pos;
+    std::string name;
+    std::string new_name;
+  };
+  auto ranges = split_lines(begin, end, num_tasks);
+  std::vector<std::vector<ClassLine>> class_lines(ranges.size());
+  auto class_wq = workqueue_foreach<size_t>([&](size_t i) {
+    for_each_line(ranges[i].first,
+                  ranges[i].second,
+                  [&](const char* pos, const std::string& line) {
+                    ClassLine cl{pos};
+                    if (parse_class(line, &cl.name, &cl.new_name)) {
+                      class_lines[i].push_back(std::move(cl));
+                    }
+                  });
+  });
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    class_wq.add_item(i);
+  }
+  class_wq.run_all();
+
+  // The start of each class section, with the names of its class.
+  std::vector<const char*> class_pos;
+  std::vector<std::pair<const std::string*, const std::string*>> class_names;
+  for (auto& lines : class_lines) {
+    for (auto& cl : lines) {
+      add(std::move(cl.name), std::move(cl.new_name), m_classMap,
+          m_obfClassMap);
+      class_pos.push_back(cl.pos);
+      class_names.emplace_back(&m_names[m_names.size() - 2], &m_names.back());
+    }
+  }
+  class_lines.clear();
+
+  // Group the class sections into tasks of roughly equal size. The lines
+  // before the first class don't belong to any class.
+  struct MemberTask {
+    const char* begin;
+    const char* end;
+    size_t first_class;
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::vector<std::pair<std::string, std::string>> methods;
+    bool has_bogus_line{false};
+    std::string bogus_line;
+  };
+  std::vector<MemberTask> tasks;
+  size_t task_size = std::max<size_t>((end - begin) / num_tasks, 1);
+  const char* task_begin = begin;
+  size_t task_first_class = 0;
+  for (size_t i = 0; i <= class_pos.size(); ++i) {
+    auto pos = i < class_pos.size() ? class_pos[i] : end;
+    if (pos > task_begin && (pos - task_begin >= (ptrdiff_t)task_size ||
+                             i == class_pos.size())) {
+      tasks.push_back(MemberTask{task_begin, pos, task_first_class});
+      task_begin = pos;
+      task_first_class = i;
+    }
+  }
+
+  std::string no_class;
+  auto member_wq = workqueue_foreach<MemberTask*>([&](MemberTask* task) {
+    const std::string* curr_class = &no_class;
+    const std::string* curr_new_class = &no_class;
+    size_t next_class = task->first_class;
+    for_each_line(
+        task->begin,
+        task->end,
+        [&](const char* pos, const std::string& line) {
+          if (next_class < class_pos.size() && pos == class_pos[next_class]) {
+            curr_class = class_names[next_class].first;
+            curr_new_class = class_names[next_class].second;
+            ++next_class;
+            return;
+          }
+          std::pair<std::string, std::string> entry;
+          if (parse_field(line, *curr_class, *curr_new_class, *this, &entry)) {
+            task->fields.push_back(std::move(entry));
+          } else if (parse_method(
+                         line, *curr_class, *curr_new_class, *this, &entry)) {
+            task->methods.push_back(std::move(entry));
+          } else if (!task->has_bogus_line) {
+            task->has_bogus_line = true;
+            task->bogus_line = line;
+          }
+        });
+  });
+  for (auto& task : tasks) {
+    member_wq.add_item(&task);
+  }
+  member_wq.run_all();
+
+  for (auto& task : tasks) {
+    always_assert_log(!task.has_bogus_line,
+                      "Bogus line encountered in proguard map: %s\n",
+                      task.bogus_line.c_str());
+    for (auto& entry : task.fields) {
+      add(std::move(entry.first), std::move(entry.second), m_fieldMap,
+          m_obfFieldMap);
+    }
+    for (auto& entry : task.methods) {
+      add(std::move(entry.first), std::move(entry.second), m_methodMap,
+          m_obfMethodMap);
+    }
+  }
+}
+
 void apply_deobfuscated_names(const std::vector<DexClasses>& dexen,
                               const ProguardMap& pm) {
   std::function<void(DexClass*)> worker_empty_pg_map = [&](DexClass* cls) {
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <cstddef>
+#include <deque>
 #include <fstream>
 #include <unordered_map>
 #include <string>
@@ -37,6 +38,10 @@
  * For classes, this is the full descriptor.
  * For methods, it's <class descriptor>.<name>(<args descs>)<return desc> .
  * For fields,  it's <class descriptor>.<name>:<type desc> .
+ *
+ * Mapping files can be hundreds of MB, so the file is memory-mapped and
+ * parsed in parallel, one run of classes per task. Each name is stored once,
+ * and both directions of the mapping point to it.
  */
 struct ProguardMap {
   /**
@@ -47,9 +52,11 @@ struct ProguardMap {
   /**
    * Construct map from a given stream.
    */
-  explicit ProguardMap(std::istream& is) {
-    parse_proguard_map(is);
-  }
+  explicit ProguardMap(std::istream& is);
+
+  // The maps point into m_names, so they can't be copied along with it.
+  ProguardMap(const ProguardMap&) = delete;
+  ProguardMap& operator=(const ProguardMap&) = delete;
 
   /**
    * Translate un-obfuscated class name to obfuscated name.
@@ -85,25 +92,41 @@ struct ProguardMap {
                               m_methodMap.empty() ; }
 
  private:
-  void parse_proguard_map(std::istream& fp);
-
-  bool parse_class(const std::string& line);
-  bool parse_field(const std::string& line);
-  bool parse_method(const std::string& line);
+  // A name stored in m_names, hashed and compared by value, so that a map
+  // can be searched with any std::string without copying it.
+  struct NameRef {
+    const std::string* str;
+    bool operator==(const NameRef& other) const { return *str == *other.str; }
+  };
+  struct NameRefHash {
+    size_t operator()(const NameRef& ref) const {
+      return std::hash<std::string>()(*ref.str);
+    }
+  };
+  using NameMap = std::unordered_map<NameRef, NameRef, NameRefHash>;
+
+  void parse_proguard_map(const char* begin, const char* end);
+
+  void add(std::string old_name,
+           std::string new_name,
+           NameMap& map,
+           NameMap& obf_map);
+
+  static std::string find_or_same(const std::string& key, const NameMap& map);
 
  private:
+  // All the names in the maps. A deque never moves its elements.
+  std::deque<std::string> m_names;
+
   // Unobfuscated to obfuscated maps
-  std::unordered_map<std::string, std::string> m_classMap;
-  std::unordered_map<std::string, std::string> m_fieldMap;
-  std::unordered_map<std::string, std::string> m_methodMap;
+  NameMap m_classMap;
+  NameMap m_fieldMap;
+  NameMap m_methodMap;
 
   // Obfuscated to unobfuscated maps from proguard
-  std::unordered_map<std::string, std::string> m_obfClassMap;
-  std::unordered_map<std::string, std::string> m_obfFieldMap;
-  std::unordered_map<std::string, std::string> m_obfMethodMap;
-
-  std::string m_currClass;
-  std::string m_currNewClass;
+  NameMap m_obfClassMap;
+  NameMap m_obfFieldMap;
+  NameMap m_obfMethodMap;
 };
 
 /**
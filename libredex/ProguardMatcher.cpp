@@ -7,18 +7,22 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
 #include <boost/regex.hpp>
 #include <iostream>
+#include <mutex>
 #include <thread>
 
 #include "ClassHierarchy.h"
 #include "DexUtil.h"
 #include "IRCode.h"
+#include "ProguardCache.h"
 #include "ProguardMatcher.h"
 #include "ProguardPrintConfiguration.h"
 #include "ProguardRegex.h"
 #include "ProguardReporting.h"
 #include "ReachableClasses.h"
+#include "StringUtil.h"
 #include "Timer.h"
 #include "WorkQueue.h"
 
@@ -724,10 +728,108 @@ void build_extends_or_implements_hierarchy(const Scope& scope,
   }
 }
 
+/*
+ * The internal classes sorted by deobfuscated name. A class name pattern can
+ * only match names that start with the literal characters preceding its first
+ * wildcard, and those names form a contiguous range of the sorted array. This
+ * lets a keep rule be matched against the classes of its package only, rather
+ * than against the whole scope.
+ */
+class ClassNameIndex {
+ public:
+  using Entry = std::pair<std::string, DexClass*>;
+  using Iterator = std::vector<Entry>::const_iterator;
+
+  explicit ClassNameIndex(const Scope& classes) {
+    for (auto cls : classes) {
+      if (!cls->is_external()) {
+        m_classes.emplace_back(cls->get_deobfuscated_name(), cls);
+      }
+    }
+    std::sort(m_classes.begin(), m_classes.end());
+  }
+
+  /*
+   * The classes that the class name pattern may match.
+   */
+  std::pair<Iterator, Iterator> candidates(
+      const std::string& class_name) const {
+    auto prefix = literal_prefix(class_name);
+    auto begin = std::lower_bound(
+        m_classes.begin(),
+        m_classes.end(),
+        prefix,
+        [](const Entry& entry, const std::string& prefix) {
+          return entry.first < prefix;
+        });
+    auto end =
+        std::partition_point(begin, m_classes.end(), [&](const Entry& entry) {
+          return starts_with(entry.first.c_str(), prefix.c_str());
+        });
+    return std::make_pair(begin, end);
+  }
+
+ private:
+  /*
+   * The characters that form_type_regex() matches literally, up to the first
+   * wildcard or any other character it gives a meaning to.
+   */
+  static std::string literal_prefix(const std::string& class_name) {
+    if (class_name == "*" || class_name == "**") {
+      return "";
+    }
+    auto desc = proguard_parser::convert_wildcard_type(class_name);
+    std::string prefix;
+    for (char ch : desc) {
+      if (!isalnum(ch) && ch != '_' && ch != '$' && ch != '/') {
+        break;
+      }
+      prefix += ch;
+    }
+    return prefix;
+  }
+
+  std::vector<Entry> m_classes;
+};
+
+// Matching a keep rule against a range of candidate classes.
+struct KeepTask {
+  KeepSpec* keep_rule;
+  ClassNameIndex::Iterator begin;
+  ClassNameIndex::Iterator end;
+};
+
+void reset_counts(KeepSpec* keep_rule) {
+  keep_rule->count = 0;
+  for (auto& field_spec : keep_rule->class_spec.fieldSpecifications) {
+    field_spec.count = 0;
+  }
+  for (auto& method_spec : keep_rule->class_spec.methodSpecifications) {
+    method_spec.count = 0;
+  }
+}
+
+void add_counts(const KeepSpec& from, KeepSpec* to) {
+  auto& to_spec = to->class_spec;
+  to->count += from.count;
+  for (size_t i = 0; i < to_spec.fieldSpecifications.size(); ++i) {
+    to_spec.fieldSpecifications[i].count +=
+        from.class_spec.fieldSpecifications[i].count;
+  }
+  for (size_t i = 0; i < to_spec.methodSpecifications.size(); ++i) {
+    to_spec.methodSpecifications[i].count +=
+        from.class_spec.methodSpecifications[i].count;
+  }
+}
+
+// The number of classes per task, so that the rules that match large
+// packages are spread over several workers.
+constexpr size_t KEEP_TASK_SIZE = 1024;
+
 void process_keep(
     const ProguardMap& pg_map,
     std::vector<KeepSpec>& keep_rules,
-    const Scope& classes,
+    const ClassNameIndex& index,
     const Scope& external_classes,
     const ClassHierarchy& hierarchy,
     std::function<void(RegexMap&, KeepSpec&, DexClass*)> keep_processor,
@@ -747,15 +849,23 @@ void process_keep(
     }
   };
 
-  // We only parallelize if keep_rule needs to be applied to all classes.
-  auto wq = workqueue_foreach<KeepSpec*>(
-      [&process_single_keep, &classes](KeepSpec* keep_rule) {
+  // We only parallelize if keep_rule needs to be applied to many classes.
+  // Matching updates the rule (its count, and the conditional marks of
+  // -keepclasseswithmembers), and one rule may be split over several tasks,
+  // so each task works on its own copy and adds its counts back at the end.
+  std::mutex count_mutex;
+  auto wq = workqueue_foreach<KeepTask>(
+      [&process_single_keep, &count_mutex](const KeepTask& task) {
         RegexMap regex_map;
-        ClassMatcher class_match(*keep_rule);
+        KeepSpec keep_rule = *task.keep_rule;
+        reset_counts(&keep_rule);
+        ClassMatcher class_match(keep_rule);
 
-        for (const auto& cls : classes) {
-          process_single_keep(class_match, *keep_rule, cls, regex_map);
+        for (auto it = task.begin; it != task.end; ++it) {
+          process_single_keep(class_match, keep_rule, it->second, regex_map);
         }
+        std::lock_guard<std::mutex> lock(count_mutex);
+        add_counts(keep_rule, task.keep_rule);
       });
 
   for (auto& keep_rule : keep_rules) {
@@ -788,7 +898,12 @@ void process_keep(
     }
 
     // Otherwise, it might take a longer time. Add to the work queue.
-    wq.add_item(&keep_rule);
+    auto range = index.candidates(className);
+    for (auto it = range.first; it != range.second;) {
+      auto end = it + std::min<size_t>(KEEP_TASK_SIZE, range.second - it);
+      wq.add_item(KeepTask{&keep_rule, it, end});
+      it = end;
+    }
   }
 
   wq.run_all();
@@ -839,10 +954,21 @@ void filter_duplicate_rules(std::vector<KeepSpec>* keep_rules) {
 void process_proguard_rules(const ProguardMap& pg_map,
                             const Scope& classes,
                             const Scope& external_classes,
-                            ProguardConfiguration* pg_config) {
+                            ProguardConfiguration* pg_config,
+                            const std::string& cache_dir) {
   // Filter out duplicate rules to speed up processing.
   filter_duplicate_rules(&pg_config->keep_rules);
   filter_duplicate_rules(&pg_config->assumenosideeffects_rules);
+
+  std::string cache_key;
+  if (!cache_dir.empty()) {
+    cache_key = proguard_cache_key(classes, external_classes, *pg_config);
+    if (load_proguard_cache(cache_dir, cache_key, classes, pg_config)) {
+      TRACE(PGR, 1, "Reused the ProGuard matching results %s\n",
+            cache_key.c_str());
+      return;
+    }
+  }
   // Now process each of the different kinds of rules as well
   // as -assumenosideeffects and -whyareyoukeeping.
 
@@ -852,10 +978,11 @@ void process_proguard_rules(const ProguardMap& pg_map,
   // may, for instance, forbid renaming of all classes that inherit from a
   // given external class.
   build_extends_or_implements_hierarchy(external_classes, &hierarchy);
+  ClassNameIndex index(classes);
 
   process_keep(pg_map,
                pg_config->whyareyoukeeping_rules,
-               classes,
+               index,
                external_classes,
                hierarchy,
                process_whyareyoukeeping,
@@ -863,7 +990,7 @@ void process_proguard_rules(const ProguardMap& pg_map,
 
   process_keep(pg_map,
                pg_config->keep_rules,
-               classes,
+               index,
                external_classes,
                hierarchy,
                mark_class_and_members_for_keep,
@@ -871,7 +998,7 @@ void process_proguard_rules(const ProguardMap& pg_map,
 
   process_keep(pg_map,
                pg_config->assumenosideeffects_rules,
-               classes,
+               index,
                external_classes,
                hierarchy,
                process_assumenosideeffects,
@@ -892,6 +1019,10 @@ void process_proguard_rules(const ProguardMap& pg_map,
       cls->rstate.increment_keep_count();
     }
   }
+
+  if (!cache_dir.empty()) {
+    save_proguard_cache(cache_dir, cache_key, classes, *pg_config);
+  }
 }
 
 } // namespace redex
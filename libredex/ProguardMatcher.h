@@ -17,10 +17,16 @@ namespace redex {
 
 using Scope = std::vector<DexClass*>;
 
+/*
+ * Applies the keep rules to the classes. If cache_dir isn't empty, the
+ * outcome is cached there, and reused when neither the rules nor the classes
+ * have changed; see ProguardCache.h.
+ */
 void process_proguard_rules(const ProguardMap& pg_map,
                             const Scope& classes,
                             const Scope& external_classes,
-                            ProguardConfiguration* pg_config);
+                            ProguardConfiguration* pg_config,
+                            const std::string& cache_dir = "");
 }
 
 // namespace redex
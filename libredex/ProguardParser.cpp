@@ -7,8 +7,10 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
-#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <iostream>
+#include <iterator>
 
 #include "ProguardLexer.h"
 #include "ProguardMap.h"
@@ -18,11 +20,11 @@
 namespace redex {
 namespace proguard_parser {
 
-bool parse_boolean_command(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_boolean_command(std::vector<Token>::iterator* it,
                            token boolean_option,
                            bool* option,
                            bool value) {
-  if ((**it)->type != boolean_option) {
+  if ((*it)->type != boolean_option) {
     return false;
   }
   ++(*it);
@@ -30,38 +32,38 @@ bool parse_boolean_command(std::vector<unique_ptr<Token>>::iterator* it,
   return true;
 }
 
-void skip_to_next_command(std::vector<unique_ptr<Token>>::iterator* it) {
-  while (((**it)->type != token::eof_token) && (!(**it)->is_command())) {
+void skip_to_next_command(std::vector<Token>::iterator* it) {
+  while (((*it)->type != token::eof_token) && (!(*it)->is_command())) {
     ++(*it);
   }
 }
 
-bool parse_single_filepath_command(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_single_filepath_command(std::vector<Token>::iterator* it,
                                    token filepath_command_token,
                                    std::string* filepath) {
-  if ((**it)->type == filepath_command_token) {
-    unsigned int line_number = (**it)->line;
+  if ((*it)->type == filepath_command_token) {
+    unsigned int line_number = (*it)->line;
     ++(*it); // Consume the command token.
     // Fail without consumption if this is an end of file token.
-    if ((**it)->type == token::eof_token) {
+    if ((*it)->type == token::eof_token) {
       cerr << "Expecting at least one file as an argument but found end of "
               "file at line "
            << line_number << endl;
       return true;
     }
     // Fail without consumption if this is a command token.
-    if ((**it)->is_command()) {
+    if ((*it)->is_command()) {
       cerr << "Expecting a file path argument but got command "
-           << (**it)->show() << " at line  " << (**it)->line << endl;
+           << (*it)->show() << " at line  " << (*it)->line << endl;
       return true;
     }
     // Parse the filename.
-    if ((**it)->type != token::filepath) {
-      cerr << "Expected a filepath but got " << (**it)->show() << " at line "
-           << (**it)->line << endl;
+    if ((*it)->type != token::filepath) {
+      cerr << "Expected a filepath but got " << (*it)->show() << " at line "
+           << (*it)->line << endl;
       return true;
     }
-    *filepath = static_cast<Filepath*>((*it)->get())->path;
+    *filepath = (*it)->str();
     ++(*it); // Consume the filepath token
     return true;
   }
@@ -69,44 +71,44 @@ bool parse_single_filepath_command(std::vector<unique_ptr<Token>>::iterator* it,
 }
 
 std::vector<std::string> parse_filepaths(
-    std::vector<unique_ptr<Token>>::iterator* it) {
+    std::vector<Token>::iterator* it) {
   std::vector<std::string> filepaths;
-  if ((**it)->type != token::filepath) {
-    cerr << "Expected filepath but got " << (**it)->show() << " at line "
-         << (**it)->line << endl;
+  if ((*it)->type != token::filepath) {
+    cerr << "Expected filepath but got " << (*it)->show() << " at line "
+         << (*it)->line << endl;
     return filepaths;
   }
-  while ((**it)->type == token::filepath) {
-    filepaths.push_back(static_cast<Filepath*>((*it)->get())->path);
+  while ((*it)->type == token::filepath) {
+    filepaths.push_back((*it)->str());
     ++(*it);
   }
   return filepaths;
 }
 
-bool parse_filepath_command(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_filepath_command(std::vector<Token>::iterator* it,
                             token filepath_command_token,
                             const std::string& basedir,
                             std::vector<std::string>* filepaths) {
-  if ((**it)->type == filepath_command_token) {
-    unsigned int line_number = (**it)->line;
+  if ((*it)->type == filepath_command_token) {
+    unsigned int line_number = (*it)->line;
     ++(*it); // Consume the command token.
     // Fail without consumption if this is an end of file token.
-    if ((**it)->type == token::eof_token) {
+    if ((*it)->type == token::eof_token) {
       cerr << "Expecting at least one file as an argument but found end of "
               "file at line "
            << line_number << endl;
       return true;
     }
     // Fail without consumption if this is a command token.
-    if ((**it)->is_command()) {
+    if ((*it)->is_command()) {
       cerr << "Expecting a file path argument but got command "
-           << (**it)->show() << " at line  " << (**it)->line << endl;
+           << (*it)->show() << " at line  " << (*it)->line << endl;
       return true;
     }
     // Parse the filename.
-    if ((**it)->type != token::filepath) {
-      cerr << "Expected a filepath but got " << (**it)->show() << " at line "
-           << (**it)->line << endl;
+    if ((*it)->type != token::filepath) {
+      cerr << "Expected a filepath but got " << (*it)->show() << " at line "
+           << (*it)->line << endl;
       return true;
     }
     for (const auto& filepath : parse_filepaths(it)) {
@@ -118,30 +120,30 @@ bool parse_filepath_command(std::vector<unique_ptr<Token>>::iterator* it,
 }
 
 bool parse_optional_filepath_command(
-    std::vector<unique_ptr<Token>>::iterator* it,
+    std::vector<Token>::iterator* it,
     token filepath_command_token,
     std::vector<std::string>* filepaths) {
-  if ((**it)->type != filepath_command_token) {
+  if ((*it)->type != filepath_command_token) {
     return false;
   }
   ++(*it); // Consume the command token.
   // Parse an optional filepath argument.
-  if ((**it)->type == token::filepath) {
-    filepaths->push_back(static_cast<Filepath*>((*it)->get())->path);
+  if ((*it)->type == token::filepath) {
+    filepaths->push_back((*it)->str());
     ++(*it);
   }
   return true;
 }
 
-bool parse_jars(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_jars(std::vector<Token>::iterator* it,
                 token jar_token,
                 const std::string& basedir,
                 std::vector<std::string>* jars) {
-  if ((**it)->type == jar_token) {
-    unsigned int line_number = (**it)->line;
+  if ((*it)->type == jar_token) {
+    unsigned int line_number = (*it)->line;
     ++(*it); // Consume the jar token.
     // Fail without consumption if this is an end of file token.
-    if ((**it)->type == token::eof_token) {
+    if ((*it)->type == token::eof_token) {
       cerr << "Expecting at least one file as an argument but found end of "
               "file at line "
            << line_number << endl;
@@ -157,9 +159,9 @@ bool parse_jars(std::vector<unique_ptr<Token>>::iterator* it,
 }
 
 bool parse_dontusemixedcaseclassnames(
-    std::vector<unique_ptr<Token>>::iterator* it,
+    std::vector<Token>::iterator* it,
     bool* dontusemixedcaseclassnames) {
-  if ((**it)->type != token::dontusemixedcaseclassnames_token) {
+  if ((*it)->type != token::dontusemixedcaseclassnames_token) {
     return false;
   }
   *dontusemixedcaseclassnames = true;
@@ -167,9 +169,9 @@ bool parse_dontusemixedcaseclassnames(
   return true;
 }
 
-bool parse_dontpreverify(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_dontpreverify(std::vector<Token>::iterator* it,
                          bool* dontpreverify) {
-  if ((**it)->type != token::dontpreverify_token) {
+  if ((*it)->type != token::dontpreverify_token) {
     return false;
   }
   *dontpreverify = true;
@@ -177,9 +179,9 @@ bool parse_dontpreverify(std::vector<unique_ptr<Token>>::iterator* it,
   return true;
 }
 
-bool parse_verbose(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_verbose(std::vector<Token>::iterator* it,
                    bool* verbose) {
-  if ((**it)->type != token::verbose_token) {
+  if ((*it)->type != token::verbose_token) {
     return false;
   }
   *verbose = true;
@@ -187,11 +189,11 @@ bool parse_verbose(std::vector<unique_ptr<Token>>::iterator* it,
   return true;
 }
 
-bool parse_bool_command(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_bool_command(std::vector<Token>::iterator* it,
                         token bool_command_token,
                         bool new_value,
                         bool* bool_value) {
-  if ((**it)->type == bool_command_token) {
+  if ((*it)->type == bool_command_token) {
     ++(*it); // Consume the boolean command token.
     *bool_value = new_value;
     return true;
@@ -199,31 +201,31 @@ bool parse_bool_command(std::vector<unique_ptr<Token>>::iterator* it,
   return false;
 }
 
-bool parse_repackageclasses(std::vector<unique_ptr<Token>>::iterator* it) {
-  if ((**it)->type != token::repackageclasses) {
+bool parse_repackageclasses(std::vector<Token>::iterator* it) {
+  if ((*it)->type != token::repackageclasses) {
     return false;
   }
   // Ignore repackageclasses.
   ++(*it);
-  if ((**it)->type == token::identifier) {
+  if ((*it)->type == token::identifier) {
     cerr << "Ignoring -repackageclasses "
-         << static_cast<Identifier*>((*it)->get())->ident << endl;
+         << (*it)->str() << endl;
     ++(*it);
   }
   return true;
 }
 
-bool parse_target(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_target(std::vector<Token>::iterator* it,
                   std::string* target_version) {
-  if ((**it)->type == token::target) {
+  if ((*it)->type == token::target) {
     ++(*it); // Consume the target command token.
     // Check to make sure the next token is a version token.
-    if ((**it)->type != token::target_version_token) {
-      cerr << "Expected a target version but got " << (**it)->show()
-           << " at line " << (**it)->line << endl;
+    if ((*it)->type != token::target_version_token) {
+      cerr << "Expected a target version but got " << (*it)->show()
+           << " at line " << (*it)->line << endl;
       return true;
     }
-    *target_version = static_cast<TargetVersion*>((*it)->get())->target_version;
+    *target_version = (*it)->str();
     // Consume the target version token.
     ++(*it);
     return true;
@@ -231,9 +233,9 @@ bool parse_target(std::vector<unique_ptr<Token>>::iterator* it,
   return false;
 }
 
-bool parse_allowaccessmodification(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_allowaccessmodification(std::vector<Token>::iterator* it,
                                    bool* allowaccessmodification) {
-  if ((**it)->type != token::allowaccessmodification_token) {
+  if ((*it)->type != token::allowaccessmodification_token) {
     return false;
   }
   ++(*it);
@@ -241,23 +243,23 @@ bool parse_allowaccessmodification(std::vector<unique_ptr<Token>>::iterator* it,
   return true;
 }
 
-bool parse_filter_list_command(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_filter_list_command(std::vector<Token>::iterator* it,
                                token filter_command_token,
                                std::vector<std::string>* filters) {
-  if ((**it)->type != filter_command_token) {
+  if ((*it)->type != filter_command_token) {
     return false;
   }
   ++(*it);
-  while ((**it)->type == token::filter_pattern) {
-    filters->push_back(static_cast<Filter*>((*it)->get())->filter);
+  while ((*it)->type == token::filter_pattern) {
+    filters->push_back((*it)->str());
     ++(*it);
   }
   return true;
 }
 
 bool parse_optimizationpasses_command(
-    std::vector<unique_ptr<Token>>::iterator* it) {
-  if ((**it)->type != token::optimizationpasses) {
+    std::vector<Token>::iterator* it) {
+  if ((*it)->type != token::optimizationpasses) {
     return false;
   }
   ++(*it);
@@ -273,16 +275,16 @@ bool is_modifier(token tok) {
          tok == token::allowobfuscation_token;
 }
 
-bool parse_modifiers(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_modifiers(std::vector<Token>::iterator* it,
                      KeepSpec* keep) {
-  while ((**it)->type == token::comma) {
+  while ((*it)->type == token::comma) {
     ++(*it);
-    if (!is_modifier((**it)->type)) {
-      cerr << "Expected keep option modifier but found : " << (**it)->show()
-           << " at line number " << (**it)->line << endl;
+    if (!is_modifier((*it)->type)) {
+      cerr << "Expected keep option modifier but found : " << (*it)->show()
+           << " at line number " << (*it)->line << endl;
       return false;
     }
-    switch ((**it)->type) {
+    switch ((*it)->type) {
     case token::includedescriptorclasses_token:
       keep->includedescriptorclasses = true;
       break;
@@ -356,17 +358,17 @@ bool is_negation_or_class_access_modifier(token type) {
 }
 
 std::string parse_annotation_type(
-    std::vector<unique_ptr<Token>>::iterator* it) {
-  if ((**it)->type != token::annotation_application) {
+    std::vector<Token>::iterator* it) {
+  if ((*it)->type != token::annotation_application) {
     return "";
   }
   ++(*it);
-  if ((**it)->type != token::identifier) {
-    cerr << "Expecting a class identifier after @ but got " << (**it)->show()
-         << " at line " << (**it)->line << endl;
+  if ((*it)->type != token::identifier) {
+    cerr << "Expecting a class identifier after @ but got " << (*it)->show()
+         << " at line " << (*it)->line << endl;
     return "";
   }
-  auto typ = static_cast<Identifier*>((*it)->get())->ident;
+  auto typ = (*it)->str();
   ++(*it);
   return convert_wildcard_type(typ);
 }
@@ -382,25 +384,25 @@ void set_access_flag(DexAccessFlags& accessFlags,
   return;
 }
 
-bool parse_access_flags(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_access_flags(std::vector<Token>::iterator* it,
                         DexAccessFlags& setFlags_,
                         DexAccessFlags& unsetFlags_) {
   bool negated = false;
-  while (is_negation_or_class_access_modifier((**it)->type)) {
+  while (is_negation_or_class_access_modifier((*it)->type)) {
     // Consume the negation token if present.
-    if ((**it)->type == token::notToken) {
+    if ((*it)->type == token::notToken) {
       negated = true;
       ++(*it);
       continue;
     }
     bool ok;
-    DexAccessFlags access_flag = process_access_modifier((**it)->type, &ok);
+    DexAccessFlags access_flag = process_access_modifier((*it)->type, &ok);
     if (ok) {
       ++(*it);
       if (negated) {
         if (is_access_flag_set(setFlags_, access_flag)) {
-          cerr << "Access flag " << (**it)->show()
-               << " occurs with conflicting settings at line " << (**it)->line
+          cerr << "Access flag " << (*it)->show()
+               << " occurs with conflicting settings at line " << (*it)->line
                << endl;
           return false;
         }
@@ -408,8 +410,8 @@ bool parse_access_flags(std::vector<unique_ptr<Token>>::iterator* it,
         negated = false;
       } else {
         if (is_access_flag_set(unsetFlags_, access_flag)) {
-          cerr << "Access flag " << (**it)->show()
-               << " occurs with conflicting settings at line " << (**it)->line
+          cerr << "Access flag " << (*it)->show()
+               << " occurs with conflicting settings at line " << (*it)->line
                << endl;
           return false;
         }
@@ -426,10 +428,10 @@ bool parse_access_flags(std::vector<unique_ptr<Token>>::iterator* it,
 // Consume an expected token, indicating if that token was found.
 // If some other token is found, then it is not consumed and false
 // is returned.
-bool consume_token(std::vector<unique_ptr<Token>>::iterator* it,
+bool consume_token(std::vector<Token>::iterator* it,
                    const token& tok) {
-  if ((**it)->type != tok) {
-    cerr << "Unexpected token " << (**it)->show() << std::endl;
+  if ((*it)->type != tok) {
+    cerr << "Unexpected token " << (*it)->show() << std::endl;
     return false;
   }
   ++(*it);
@@ -437,26 +439,26 @@ bool consume_token(std::vector<unique_ptr<Token>>::iterator* it,
 }
 
 // Consume an expected semicolon, complaining if one was not found.
-void gobble_semicolon(std::vector<unique_ptr<Token>>::iterator* it, bool* ok) {
+void gobble_semicolon(std::vector<Token>::iterator* it, bool* ok) {
   *ok = consume_token(it, token::semiColon);
   if (!*ok) {
-    cerr << "Expecting a semicolon but found " << (**it)->show() << " at line "
-         << (**it)->line << std::endl;
+    cerr << "Expecting a semicolon but found " << (*it)->show() << " at line "
+         << (*it)->line << std::endl;
     return;
   }
 }
 
-void skip_to_semicolon(std::vector<unique_ptr<Token>>::iterator* it) {
-  while (((**it)->type != token::semiColon) &&
-         ((**it)->type != token::eof_token)) {
+void skip_to_semicolon(std::vector<Token>::iterator* it) {
+  while (((*it)->type != token::semiColon) &&
+         ((*it)->type != token::eof_token)) {
     ++(*it);
   }
-  if ((**it)->type == token::semiColon) {
+  if ((*it)->type == token::semiColon) {
     ++(*it);
   }
 }
 
-void parse_member_specification(std::vector<unique_ptr<Token>>::iterator* it,
+void parse_member_specification(std::vector<Token>::iterator* it,
                                 ClassSpecification* class_spec,
                                 bool* ok) {
   MemberSpecification member_specification;
@@ -473,14 +475,14 @@ void parse_member_specification(std::vector<unique_ptr<Token>>::iterator* it,
     return;
   }
   // The next token better be an identifier.
-  if ((**it)->type != token::identifier) {
-    cerr << "Expecting field or member specification but got " << (**it)->show()
-         << " at line " << (**it)->line << endl;
+  if ((*it)->type != token::identifier) {
+    cerr << "Expecting field or member specification but got " << (*it)->show()
+         << " at line " << (*it)->line << endl;
     *ok = false;
     skip_to_semicolon(it);
     return;
   }
-  std::string ident = static_cast<Identifier*>((*it)->get())->ident;
+  auto ident = (*it)->data;
   // Check for "*".
   if (ident == "*") {
     member_specification.name = "";
@@ -518,59 +520,59 @@ void parse_member_specification(std::vector<unique_ptr<Token>>::iterator* it,
     ++(*it);
   } else {
     // This token is the type for the member specification.
-    if ((**it)->type != token::identifier) {
-      cerr << "Expecting type identifier but got " << (**it)->show()
-           << " at line " << (**it)->line << endl;
+    if ((*it)->type != token::identifier) {
+      cerr << "Expecting type identifier but got " << (*it)->show()
+           << " at line " << (*it)->line << endl;
       *ok = false;
       skip_to_semicolon(it);
       return;
     }
-    std::string typ = static_cast<Identifier*>((*it)->get())->ident;
+    std::string typ = (*it)->str();
     ++(*it);
     member_specification.descriptor = convert_wildcard_type(typ);
-    if ((**it)->type != token::identifier) {
+    if ((*it)->type != token::identifier) {
       cerr << "Expecting identifier name for class member but got "
-           << (**it)->show() << " at line " << (**it)->line << endl;
+           << (*it)->show() << " at line " << (*it)->line << endl;
       *ok = false;
       skip_to_semicolon(it);
       return;
     }
-    member_specification.name = static_cast<Identifier*>((*it)->get())->ident;
+    member_specification.name = (*it)->str();
     ++(*it);
   }
   // Check to see if this is a method specification.
-  if ((**it)->type == token::openBracket) {
+  if ((*it)->type == token::openBracket) {
     consume_token(it, token::openBracket);
     std::string arg = "(";
     while (true) {
       // If there is a ")" next we are done.
-      if ((**it)->type == token::closeBracket) {
+      if ((*it)->type == token::closeBracket) {
         consume_token(it, token::closeBracket);
         break;
       }
-      if ((**it)->type != token::identifier) {
-        std::cerr << "Expecting type identifier but got " << (**it)->show()
-                  << " at line " << (**it)->line << std::endl;
+      if ((*it)->type != token::identifier) {
+        std::cerr << "Expecting type identifier but got " << (*it)->show()
+                  << " at line " << (*it)->line << std::endl;
         *ok = false;
         return;
       }
-      std::string typ = static_cast<Identifier*>((*it)->get())->ident;
+      std::string typ = (*it)->str();
       consume_token(it, token::identifier);
       arg += convert_wildcard_type(typ);
       // The next token better be a comma or a closing bracket.
-      if ((**it)->type != token::comma && (**it)->type != token::closeBracket) {
-        std::cerr << "Expecting comma or ) but got " << (**it)->show()
-                  << " at line " << (**it)->line << std::endl;
+      if ((*it)->type != token::comma && (*it)->type != token::closeBracket) {
+        std::cerr << "Expecting comma or ) but got " << (*it)->show()
+                  << " at line " << (*it)->line << std::endl;
         *ok = false;
         return;
       }
       // If the next token is a comma (rather than closing bracket) consume
       // it and check that it is followed by an identifier.
-      if ((**it)->type == token::comma) {
+      if ((*it)->type == token::comma) {
         consume_token(it, token::comma);
-        if ((**it)->type != token::identifier) {
+        if ((*it)->type != token::identifier) {
           std::cerr << "Expecting type identifier after comma but got "
-                    << (**it)->show() << " at line " << (**it)->line
+                    << (*it)->show() << " at line " << (*it)->line
                     << std::endl;
           *ok = false;
           return;
@@ -594,13 +596,13 @@ void parse_member_specification(std::vector<unique_ptr<Token>>::iterator* it,
   return;
 }
 
-void parse_member_specifications(std::vector<unique_ptr<Token>>::iterator* it,
+void parse_member_specifications(std::vector<Token>::iterator* it,
                                  ClassSpecification* class_spec,
                                  bool* ok) {
-  if ((**it)->type == token::openCurlyBracket) {
+  if ((*it)->type == token::openCurlyBracket) {
     ++(*it);
-    while (((**it)->type != token::closeCurlyBracket) &&
-           ((**it)->type != token::eof_token)) {
+    while (((*it)->type != token::closeCurlyBracket) &&
+           ((*it)->type != token::eof_token)) {
       parse_member_specification(it, class_spec, ok);
       if (!*ok) {
         // We failed to parse a member specification so skip to the next
@@ -608,7 +610,7 @@ void parse_member_specifications(std::vector<unique_ptr<Token>>::iterator* it,
         skip_to_semicolon(it);
       }
     }
-    if ((**it)->type == token::closeCurlyBracket) {
+    if ((*it)->type == token::closeCurlyBracket) {
       ++(*it);
     }
   }
@@ -620,7 +622,7 @@ bool member_comparison(const MemberSpecification& m1,
 }
 
 ClassSpecification parse_class_specification(
-    std::vector<unique_ptr<Token>>::iterator* it, bool* ok) {
+    std::vector<Token>::iterator* it, bool* ok) {
   ClassSpecification class_spec;
   *ok = true;
   class_spec.annotationType = parse_annotation_type(it);
@@ -636,7 +638,7 @@ ClassSpecification parse_class_specification(
   // a rule that
   // says !class or !interface or !enum. We choose to not implement this
   // feature.
-  if ((**it)->type == token::notToken) {
+  if ((*it)->type == token::notToken) {
     cerr << "Keep rules that match the negation of class, interface or enum "
             "are not supported.\n";
     *ok = false;
@@ -645,46 +647,46 @@ ClassSpecification parse_class_specification(
   bool match_annotation_class = is_annotation(class_spec.setAccessFlags);
   if (!match_annotation_class) {
     // Make sure the next keyword is interface, class, enum.
-    if (!(((**it)->type == token::interface) ||
-          ((**it)->type == token::classToken) ||
-          ((**it)->type == token::enumToken ||
-           ((**it)->type == token::annotation)))) {
-      cerr << "Expected interface, class or enum but got " << (**it)->show()
-           << " at line number " << (**it)->line << endl;
+    if (!(((*it)->type == token::interface) ||
+          ((*it)->type == token::classToken) ||
+          ((*it)->type == token::enumToken ||
+           ((*it)->type == token::annotation)))) {
+      cerr << "Expected interface, class or enum but got " << (*it)->show()
+           << " at line number " << (*it)->line << endl;
       *ok = false;
       return class_spec;
     }
     // Restrict matches to interface classes
-    if ((**it)->type == token::interface) {
+    if ((*it)->type == token::interface) {
       set_access_flag(class_spec.setAccessFlags, ACC_INTERFACE);
     }
     // Restrict matches to enum classes
-    if ((**it)->type == token::enumToken) {
+    if ((*it)->type == token::enumToken) {
       set_access_flag(class_spec.setAccessFlags, ACC_ENUM);
     }
     ++(*it);
   }
   // Parse the class name.
-  if ((**it)->type != token::identifier) {
-    cerr << "Expected class name but got " << (**it)->show() << " at line "
-         << (**it)->line << endl;
+  if ((*it)->type != token::identifier) {
+    cerr << "Expected class name but got " << (*it)->show() << " at line "
+         << (*it)->line << endl;
     *ok = false;
     return class_spec;
   }
-  class_spec.className = static_cast<Identifier*>((*it)->get())->ident;
+  class_spec.className = (*it)->str();
   ++(*it);
   // Parse extends/implements if present, treating implements like extends.
-  if (((**it)->type == token::extends) || ((**it)->type == token::implements)) {
+  if (((*it)->type == token::extends) || ((*it)->type == token::implements)) {
     ++(*it);
     class_spec.extendsAnnotationType = parse_annotation_type(it);
-    if ((**it)->type != token::identifier) {
+    if ((*it)->type != token::identifier) {
       cerr << "Expecting a class name after extends/implements but got "
-           << (**it)->show() << " at line " << (**it)->line << endl;
+           << (*it)->show() << " at line " << (*it)->line << endl;
       *ok = false;
       class_spec.extendsClassName = "";
     } else {
       class_spec.extendsClassName =
-          static_cast<Identifier*>((*it)->get())->ident;
+          (*it)->str();
     }
     ++(*it);
   }
@@ -699,7 +701,7 @@ ClassSpecification parse_class_specification(
   return class_spec;
 }
 
-bool parse_keep(std::vector<unique_ptr<Token>>::iterator* it,
+bool parse_keep(std::vector<Token>::iterator* it,
                 token keep_kind,
                 std::vector<KeepSpec>* spec,
                 bool mark_classes,
@@ -708,7 +710,7 @@ bool parse_keep(std::vector<unique_ptr<Token>>::iterator* it,
                 const std::string& filename,
                 uint32_t line,
                 bool* ok) {
-  if ((**it)->type == keep_kind) {
+  if ((*it)->type == keep_kind) {
     ++(*it); // Consume the keep token
     KeepSpec keep;
     keep.mark_classes = mark_classes;
@@ -728,8 +730,8 @@ bool parse_keep(std::vector<unique_ptr<Token>>::iterator* it,
 }
 
 bool ignore_class_specification_command(
-    std::vector<unique_ptr<Token>>::iterator* it, token classspec_command) {
-  if ((**it)->type != classspec_command) {
+    std::vector<Token>::iterator* it, token classspec_command) {
+  if ((*it)->type != classspec_command) {
     return false;
   }
   ++(*it);
@@ -738,8 +740,8 @@ bool ignore_class_specification_command(
   return true;
 }
 
-void parse(std::vector<unique_ptr<Token>>::iterator it,
-           std::vector<unique_ptr<Token>>::iterator tokens_end,
+void parse(std::vector<Token>::iterator it,
+           std::vector<Token>::iterator tokens_end,
            ProguardConfiguration* pg_config,
            unsigned int* parse_errors,
            const std::string& filename) {
@@ -747,13 +749,13 @@ void parse(std::vector<unique_ptr<Token>>::iterator it,
   bool ok;
   while (it != tokens_end) {
     // Break out if we are at the end of the token stream.
-    if ((*it)->type == token::eof_token) {
+    if (it->type == token::eof_token) {
       break;
     }
-    uint32_t line = (*it)->line;
-    if (!(*it)->is_command()) {
-      cerr << "Expecting command but found " << (*it)->show() << " at line "
-           << (*it)->line << endl;
+    uint32_t line = it->line;
+    if (!it->is_command()) {
+      cerr << "Expecting command but found " << it->show() << " at line "
+           << it->line << endl;
       ++it;
       skip_to_next_command(&it);
       continue;
@@ -780,7 +782,7 @@ void parse(std::vector<unique_ptr<Token>>::iterator it,
                    &pg_config->libraryjars))
       continue;
     // -skipnonpubliclibraryclasses not supported
-    if ((*it)->type == token::dontskipnonpubliclibraryclasses) {
+    if (it->type == token::dontskipnonpubliclibraryclasses) {
       // Silenty ignore the dontskipnonpubliclibraryclasses option.
       ++it;
       continue;
@@ -922,13 +924,13 @@ void parse(std::vector<unique_ptr<Token>>::iterator it,
       continue;
 
     // Obfuscation Options
-    if ((*it)->type == token::dontobfuscate) {
+    if (it->type == token::dontobfuscate) {
       pg_config->dontobfuscate = true;
       ++it;
       continue;
     }
     // Redex ignores -dontskipnonpubliclibraryclasses
-    if ((*it)->type == token::dontskipnonpubliclibraryclasses) {
+    if (it->type == token::dontskipnonpubliclibraryclasses) {
       ++it;
       continue;
     }
@@ -958,11 +960,11 @@ void parse(std::vector<unique_ptr<Token>>::iterator it,
       continue;
 
     // Skip unknown token.
-    if ((*it)->is_command()) {
-      cerr << "Unimplemented command (skipping): " << (*it)->show()
-           << " at line " << (*it)->line << endl;
+    if (it->is_command()) {
+      cerr << "Unimplemented command (skipping): " << it->show()
+           << " at line " << it->line << endl;
     } else {
-      cerr << "Unexpected token " << (*it)->show() << " at line " << (*it)->line
+      cerr << "Unexpected token " << it->show() << " at line " << it->line
            << endl;
       (*parse_errors)++;
     }
@@ -971,19 +973,17 @@ void parse(std::vector<unique_ptr<Token>>::iterator it,
   }
 }
 
-void parse(istream& config,
+void parse(boost::string_ref config,
            ProguardConfiguration* pg_config,
            const std::string& filename) {
-  std::vector<unique_ptr<Token>> tokens = lex(config);
+  std::vector<Token> tokens = lex(config);
   bool ok = true;
   // Check for bad tokens.
-  for (auto& tok : tokens) {
-    if (tok->type == token::unknownToken) {
-      std::string spelling =
-          static_cast<UnknownToken*>(tok.get())->token_string;
+  for (const auto& tok : tokens) {
+    if (tok.type == token::unknownToken) {
       ok = false;
     }
-    // std::cout << tok->show() << " at line " << tok->line << std::endl;
+    // std::cout << tok.show() << " at line " << tok.line << std::endl;
   }
   unsigned int parse_errors = 0;
   if (ok) {
@@ -998,20 +998,34 @@ void parse(istream& config,
   }
 }
 
+void parse(istream& config,
+           ProguardConfiguration* pg_config,
+           const std::string& filename) {
+  std::string text{std::istreambuf_iterator<char>(config),
+                   std::istreambuf_iterator<char>()};
+  parse(boost::string_ref(text), pg_config, filename);
+}
+
 void parse_file(const std::string& filename, ProguardConfiguration* pg_config) {
-  ifstream config(filename);
+  namespace fs = boost::filesystem;
+  std::string path = filename;
   // First try relative path.
-  if (!config.is_open()) {
+  if (!fs::is_regular_file(path)) {
     // Try with -basedirectory
-    config.open(pg_config->basedirectory + "/" + filename);
-    if (!config.is_open()) {
+    path = pg_config->basedirectory + "/" + filename;
+    if (!fs::is_regular_file(path)) {
       cerr << "ERROR: Failed to open ProGuard configuration file " << filename
            << endl;
       exit(1);
     }
   }
 
-  parse(config, pg_config, filename);
+  // The tokens point into the mapping; an empty file can't be mapped.
+  boost::iostreams::mapped_file_source config;
+  if (fs::file_size(path) > 0) {
+    config.open(path);
+  }
+  parse(boost::string_ref(config.data(), config.size()), pg_config, filename);
   // Parse the included files.
   for (const auto& included_filename : pg_config->includes) {
     if (pg_config->already_included.find(included_filename) !=
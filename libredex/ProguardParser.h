@@ -20,6 +20,10 @@ namespace redex {
 namespace proguard_parser {
 
 void parse_file(const std::string& filename, ProguardConfiguration* pg_config);
+// The text must outlive the parse; mapped files are parsed in place.
+void parse(boost::string_ref config,
+           ProguardConfiguration* pg_config,
+           const std::string& filename = "");
 void parse(istream& config,
            ProguardConfiguration* pg_config,
            const std::string& filename = "");
@@ -8,8 +8,12 @@
  */
 
 #include "ProguardReporting.h"
+
+#include <sstream>
+
 #include "DexClass.h"
 #include "ReachableClasses.h"
+#include "WorkQueue.h"
 
 std::string extract_suffix(std::string class_name) {
   auto i = class_name.find_last_of(".");
@@ -165,7 +169,7 @@ void redex::print_method(std::ostream& output,
         deobfuscate_type_descriptor(pg_map, return_type_desc);
     output << type_descriptor_to_java(deobfu_return_type) << " ";
   }
-  output << method_name << java_args(pg_map, args) << std::endl;
+  output << method_name << java_args(pg_map, args) << '\n';
 }
 
 template <class Container>
@@ -188,7 +192,7 @@ void redex::print_field(std::ostream& output,
       deobfuscate_type_descriptor(pg_map, field_type);
   output << class_name << ": " << type_descriptor_to_java(deobfu_field_type)
          << " " << extract_member_name(field->get_deobfuscated_name())
-         << std::endl;
+         << '\n';
 }
 
 template <class Container>
@@ -211,7 +215,7 @@ void redex::print_class(std::ostream& output,
     deob = cls->get_name()->c_str();
   }
   std::string name = redex::dexdump_name_to_dot_name(deob);
-  output << name << std::endl;
+  output << name << '\n';
   print_fields(output, pg_map, name, cls->get_ifields());
   print_fields(output, pg_map, name, cls->get_sfields());
   print_methods(output, pg_map, name, cls->get_dmethods());
@@ -221,9 +225,39 @@ void redex::print_class(std::ostream& output,
 void redex::print_classes(std::ostream& output,
                           const ProguardMap& pg_map,
                           const Scope& classes) {
-  for (const auto& cls : classes) {
-    if (!cls->is_external()) {
-      redex::print_class(output, pg_map, cls);
+  print_in_parallel(output, classes,
+                    [&](std::ostream& buffer, const DexClass* cls) {
+                      if (!cls->is_external()) {
+                        redex::print_class(buffer, pg_map, cls);
+                      }
+                    });
+}
+
+void redex::print_in_parallel(
+    std::ostream& output,
+    const Scope& classes,
+    const std::function<void(std::ostream&, const DexClass*)>& print_one) {
+  constexpr size_t kBatchSize = 64;
+  const size_t window = kBatchSize * 4 * default_workqueue_threads();
+  std::vector<std::string> buffers;
+  for (size_t begin = 0; begin < classes.size(); begin += window) {
+    size_t end = std::min(begin + window, classes.size());
+    buffers.assign((end - begin + kBatchSize - 1) / kBatchSize, "");
+    auto wq = workqueue_foreach<size_t>([&](size_t b) {
+      std::ostringstream buffer;
+      size_t first = begin + b * kBatchSize;
+      size_t last = std::min(first + kBatchSize, end);
+      for (size_t i = first; i < last; ++i) {
+        print_one(buffer, classes[i]);
+      }
+      buffers[b] = buffer.str();
+    });
+    for (size_t b = 0; b < buffers.size(); ++b) {
+      wq.add_item(b);
+    }
+    wq.run_all();
+    for (const auto& buffer : buffers) {
+      output.write(buffer.data(), buffer.size());
     }
   }
 }
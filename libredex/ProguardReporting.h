@@ -12,6 +12,7 @@
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "ProguardMap.h"
+#include <functional>
 #include <iostream>
 
 namespace redex {
@@ -47,4 +48,15 @@ void print_class(std::ostream& output,
 void print_classes(std::ostream& output,
                    const ProguardMap& pg_map,
                    const Scope& classes);
+
+/*
+ * Writes what print_one writes for each of the classes to output, in the
+ * order of the classes. Batches of classes are formatted in parallel into
+ * buffers of their own, which are then written out in order, a window of
+ * them at a time so that the whole report is never held in memory.
+ */
+void print_in_parallel(
+    std::ostream& output,
+    const Scope& classes,
+    const std::function<void(std::ostream&, const DexClass*)>& print_one);
 }
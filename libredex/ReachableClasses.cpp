@@ -9,14 +9,16 @@
 
 #include "ReachableClasses.h"
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <sstream>
 #include <string>
-#include <string>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "Walkers.h"
+#include "WorkQueue.h"
 #include "DexClass.h"
 #include "Match.h"
 #include "RedexResources.h"
@@ -114,77 +116,66 @@ void analyze_reflection(const Scope& scope) {
            }},
       };
 
-  walk::parallel::code(scope, [&refls](DexMethod* method, IRCode& code) {
-      std::unique_ptr<SimpleReflectionAnalysis> analysis = nullptr;
-      for (auto& mie : InstructionIterable(code)) {
-        IRInstruction* insn = mie.insn;
-        if (!is_invoke(insn->opcode())) {
-          continue;
-        }
-
-        // See if it matches something in refls
-        auto& method_name = insn->get_method()->get_name()->str();
-        auto& method_class_name = insn->get_method()->get_class()->get_name()->str();
-        auto method_map = refls.find(method_class_name);
-        if (method_map == refls.end()) {
-          continue;
-        }
-
-        auto refl_entry = method_map->second.find(method_name);
-        if (refl_entry == method_map->second.end()) {
-          continue;
-        }
-
-        ReflectionType refl_type = refl_entry->second;
-        int arg_cls_idx = 0;
-        int arg_str_idx = refl_type == ReflectionType::REF_UPDATER ? 2 : 1;
-
-        // Instantiating the analysis object also runs the reflection analysis
-        // on the method. So, we wait until we're sure we need it.
-        // We use a unique_ptr so that we'll still only have one per method.
-        if (!analysis) {
-          analysis = std::make_unique<SimpleReflectionAnalysis>(method);
-        }
-
-        auto arg_cls = analysis->get_abstract_object(insn->src(arg_cls_idx), insn);
-        auto arg_str = analysis->get_abstract_object(insn->src(arg_str_idx), insn);
-        if ((arg_cls && arg_cls->kind == AbstractObjectKind::CLASS) &&
-            (arg_str && arg_str->kind == AbstractObjectKind::STRING)) {
-          TRACE(PGR, 4, "SRA ANALYZE: %s: type:%d %s.%s cls: %d %s %s str: %d %s %s\n",
-                insn->get_method()->get_name()->str().c_str(),
-                refl_type,
-                method_class_name.c_str(),
-                method_name.c_str(),
-                arg_cls->kind, SHOW(arg_cls->dex_type), SHOW(arg_cls->dex_string),
-                arg_str->kind, SHOW(arg_str->dex_type), SHOW(arg_str->dex_string)
-                );
-        switch (refl_type) {
-          case GET_FIELD:
-            blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, true);
-            break;
-          case GET_DECLARED_FIELD:
-            blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, false);
-            break;
-          case GET_METHOD:
-            blacklist<DexMethod*>(arg_cls->dex_type, arg_str->dex_string, true);
-            break;
-          case GET_DECLARED_METHOD:
-            blacklist<DexMethod*>(arg_cls->dex_type, arg_str->dex_string, false);
-            break;
-          case INT_UPDATER:
-            blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, true);
-            break;
-          case LONG_UPDATER:
-            blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, true);
-            break;
-          case REF_UPDATER:
-            blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, true);
-            break;
-          }
+  ReflectionApis apis;
+  for (const auto& cls_entry : refls) {
+    for (const auto& method_entry : cls_entry.second) {
+      apis.emplace_back(cls_entry.first, method_entry.first);
+    }
+  }
+  // Only the methods that call one of the APIs above get analyzed.
+  auto sites = find_reflection_sites(scope, apis);
+
+  auto wq = workqueue_foreach<DexMethod*>([&](DexMethod* method) {
+    auto analysis = SimpleReflectionAnalysis::get_cached(method);
+    for (IRInstruction* insn : sites.at(method)) {
+      auto& method_name = insn->get_method()->get_name()->str();
+      auto& method_class_name = insn->get_method()->get_class()->get_name()->str();
+      ReflectionType refl_type = refls.at(method_class_name).at(method_name);
+      int arg_cls_idx = 0;
+      int arg_str_idx = refl_type == ReflectionType::REF_UPDATER ? 2 : 1;
+
+      auto arg_cls = analysis->get_abstract_object(insn->src(arg_cls_idx), insn);
+      auto arg_str = analysis->get_abstract_object(insn->src(arg_str_idx), insn);
+      if ((arg_cls && arg_cls->kind == AbstractObjectKind::CLASS) &&
+          (arg_str && arg_str->kind == AbstractObjectKind::STRING)) {
+        TRACE(PGR, 4, "SRA ANALYZE: %s: type:%d %s.%s cls: %d %s %s str: %d %s %s\n",
+              insn->get_method()->get_name()->str().c_str(),
+              refl_type,
+              method_class_name.c_str(),
+              method_name.c_str(),
+              arg_cls->kind, SHOW(arg_cls->dex_type), SHOW(arg_cls->dex_string),
+              arg_str->kind, SHOW(arg_str->dex_type), SHOW(arg_str->dex_string)
+              );
+      switch (refl_type) {
+        case GET_FIELD:
+          blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, true);
+          break;
+        case GET_DECLARED_FIELD:
+          blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, false);
+          break;
+        case GET_METHOD:
+          blacklist<DexMethod*>(arg_cls->dex_type, arg_str->dex_string, true);
+          break;
+        case GET_DECLARED_METHOD:
+          blacklist<DexMethod*>(arg_cls->dex_type, arg_str->dex_string, false);
+          break;
+        case INT_UPDATER:
+          blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, true);
+          break;
+        case LONG_UPDATER:
+          blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, true);
+          break;
+        case REF_UPDATER:
+          blacklist<DexField*>(arg_cls->dex_type, arg_str->dex_string, true);
+          break;
         }
       }
     }
-  );
+  });
+  for (const auto& entry : sites) {
+    wq.add_item(entry.first);
+  }
+  wq.run_all();
 }
 
 template<typename DexMember>
@@ -230,7 +221,8 @@ void mark_reachable_by_classname(DexType* dtype, bool from_code) {
   mark_reachable_by_classname(type_class_internal(dtype), from_code);
 }
 
-void mark_reachable_by_classname(std::string& classname, bool from_code) {
+void mark_reachable_by_classname(const std::string& classname,
+                                 bool from_code) {
   DexString* dstring =
       DexString::get_string(classname.c_str(), (uint32_t)classname.size());
   DexType* dtype = DexType::get_type(dstring);
@@ -255,74 +247,92 @@ bool anno_set_contains(
   return false;
 }
 
-void keep_annotated_classes(
-  const Scope& scope,
+void keep_annotated_members(
+  DexClass* cls,
   const std::unordered_set<DexType*>& keep_annotations
 ) {
-  for (auto const& cls : scope) {
-    if (anno_set_contains(cls, keep_annotations)) {
-      mark_only_reachable_directly(cls);
+  if (keep_annotations.empty()) return;
+  if (anno_set_contains(cls, keep_annotations)) {
+    mark_only_reachable_directly(cls);
+  }
+  for (auto const& m : cls->get_dmethods()) {
+    if (anno_set_contains(m, keep_annotations)) {
+      mark_only_reachable_directly(m);
     }
-    for (auto const& m : cls->get_dmethods()) {
-      if (anno_set_contains(m, keep_annotations)) {
-        mark_only_reachable_directly(m);
-      }
+  }
+  for (auto const& m : cls->get_vmethods()) {
+    if (anno_set_contains(m, keep_annotations)) {
+      mark_only_reachable_directly(m);
     }
-    for (auto const& m : cls->get_vmethods()) {
-      if (anno_set_contains(m, keep_annotations)) {
-        mark_only_reachable_directly(m);
-      }
+  }
+  for (auto const& m : cls->get_sfields()) {
+    if (anno_set_contains(m, keep_annotations)) {
+      mark_only_reachable_directly(m);
     }
-    for (auto const& m : cls->get_sfields()) {
-      if (anno_set_contains(m, keep_annotations)) {
-        mark_only_reachable_directly(m);
-      }
+  }
+  for (auto const& m : cls->get_ifields()) {
+    if (anno_set_contains(m, keep_annotations)) {
+      mark_only_reachable_directly(m);
     }
-    for (auto const& m : cls->get_ifields()) {
-      if (anno_set_contains(m, keep_annotations)) {
-        mark_only_reachable_directly(m);
-      }
+  }
+}
+
+/*
+ * The keep_class_members entries from the configuration file, e.g.
+ * "I Lcom/facebook/R$id;.feed_unit_cache_id", as the names of the members to
+ * keep by class name. Each class then only looks up its own name rather than
+ * searching every entry for it.
+ */
+using ClassMembersIndex =
+    std::unordered_map<std::string, std::unordered_set<std::string>>;
+
+ClassMembersIndex index_class_members(
+    const std::vector<std::string>& keep_class_mems) {
+  ClassMembersIndex index;
+  for (auto const& class_mem : keep_class_mems) {
+    auto end = class_mem.find_last_not_of(" \t");
+    auto start = end == std::string::npos
+                     ? std::string::npos
+                     : class_mem.find_last_of(" \t", end);
+    start = start == std::string::npos ? 0 : start + 1;
+    auto sep = class_mem.find(";.", start);
+    if (end == std::string::npos || sep == std::string::npos || sep > end) {
+      TRACE(PGR, 1, "Ignoring malformed keep_class_members entry: %s\n",
+            class_mem.c_str());
+      continue;
     }
+    index[class_mem.substr(start, sep + 1 - start)].emplace(
+        class_mem.substr(sep + 2, end - sep - 1));
   }
+  return index;
 }
 
 /*
  * This method handles the keep_class_members from the configuration file.
  */
-void keep_class_members(
-    const Scope& scope,
-    const std::vector<std::string>& keep_class_mems) {
-  for (auto const& cls : scope) {
-    std::string name = std::string(cls->get_type()->get_name()->c_str());
-    for (auto const& class_mem : keep_class_mems) {
-      std::string class_mem_str = std::string(class_mem.c_str());
-      std::size_t pos = class_mem_str.find(name);
-      if (pos != std::string::npos) {
-        std::string rem_str = class_mem_str.substr(pos+name.size());
-        for (auto const& f : cls->get_sfields()) {
-          if (rem_str.find(std::string(f->get_name()->c_str()))!=std::string::npos) {
-            mark_only_reachable_directly(f);
-            mark_only_reachable_directly(cls);
-          }
-        }
-        break;
-      }
+void keep_class_members(DexClass* cls, const ClassMembersIndex& index) {
+  if (index.empty()) return;
+  auto it = index.find(cls->get_type()->get_name()->str());
+  if (it == index.end()) return;
+  for (auto const& f : cls->get_sfields()) {
+    if (it->second.count(f->get_name()->str())) {
+      mark_only_reachable_directly(f);
+      mark_only_reachable_directly(cls);
     }
   }
 }
 
-void keep_methods(const Scope& scope, const std::vector<std::string>& ms) {
-  std::set<std::string> methods_to_keep(ms.begin(), ms.end());
-  for (auto const& cls : scope) {
-    for (auto& m : cls->get_dmethods()) {
-      if (methods_to_keep.count(m->get_name()->c_str())) {
-        m->rstate.ref_by_string(false);
-      }
+void keep_methods(DexClass* cls,
+                  const std::unordered_set<const DexString*>& names) {
+  if (names.empty()) return;
+  for (auto& m : cls->get_dmethods()) {
+    if (names.count(m->get_name())) {
+      m->rstate.ref_by_string(false);
     }
-    for (auto& m : cls->get_vmethods()) {
-      if (methods_to_keep.count(m->get_name()->c_str())) {
-        m->rstate.ref_by_string(false);
-      }
+  }
+  for (auto& m : cls->get_vmethods()) {
+    if (names.count(m->get_name())) {
+      m->rstate.ref_by_string(false);
     }
   }
 }
@@ -360,7 +370,8 @@ bool in_reflected_pkg(DexClass* dclass,
 void init_permanently_reachable_classes(
   const Scope& scope,
   const Json::Value& config,
-  const std::unordered_set<DexType*>& no_optimizations_anno
+  const std::unordered_set<DexType*>& no_optimizations_anno,
+  ResourceScanCache& resource_cache
 ) {
   PassConfig pc(config);
 
@@ -420,28 +431,38 @@ void init_permanently_reachable_classes(
     if (anno) annotation_types.insert(anno);
   }
 
-  keep_annotated_classes(scope, annotation_types);
-  keep_class_members(scope, class_members);
-  keep_methods(scope, methods);
+  auto class_members_index = index_class_members(class_members);
+  // Method names are interned, so a name that doesn't exist yet can't match.
+  std::unordered_set<const DexString*> method_names;
+  for (auto const& name : methods) {
+    auto dstring = DexString::get_string(name.c_str());
+    if (dstring) method_names.insert(dstring);
+  }
+  // One pass over the classes matches them against all of the above.
+  walk::parallel::classes(scope, [&](DexClass* cls) {
+    keep_annotated_members(cls, annotation_types);
+    keep_class_members(cls, class_members_index);
+    keep_methods(cls, method_names);
+  });
 
   if (apk_dir.size()) {
     if (legacy_xml_reachability) {
       // Classes present in manifest
-      std::string manifest = apk_dir + std::string("/AndroidManifest.xml");
-      for (std::string classname : get_manifest_classes(manifest)) {
+      for (const auto& classname :
+           resource_cache.get_manifest_classes(apk_dir)) {
         TRACE(PGR, 3, "manifest: %s\n", classname.c_str());
         mark_reachable_by_classname(classname, false);
       }
 
       // Classes present in XML layouts
-      for (std::string classname : get_layout_classes(apk_dir)) {
+      for (const auto& classname : resource_cache.get_layout_classes(apk_dir)) {
         TRACE(PGR, 3, "xml_layout: %s\n", classname.c_str());
         mark_reachable_by_classname(classname, false);
       }
     }
 
     // Classnames present in native libraries (lib/*/*.so)
-    for (std::string classname : get_native_classes(apk_dir)) {
+    for (const auto& classname : resource_cache.get_native_classes(apk_dir)) {
       auto type = DexType::get_type(classname.c_str());
       if (type == nullptr) continue;
       TRACE(PGR, 3, "native_lib: %s\n", classname.c_str());
@@ -487,25 +508,39 @@ void init_permanently_reachable_classes(
  * after each pass.
  */
 void recompute_classes_reachable_from_code(const Scope& scope) {
-  // Matches methods marked as native
-  walk::methods(scope,
-               [&](DexMethod* meth) {
-                 if (meth->get_access() & DexAccessFlags::ACC_NATIVE) {
-                   TRACE(PGR, 3, "native_method: %s\n", SHOW(meth->get_class()));
-                   mark_reachable_by_classname(meth->get_class(), true);
-                 }
-               });
+  // Matches classes with methods marked as native. Each class is marked once,
+  // however many native methods it has.
+  auto is_native = [](const DexMethod* meth) {
+    return (meth->get_access() & DexAccessFlags::ACC_NATIVE) != 0;
+  };
+  walk::parallel::classes(scope, [&is_native](DexClass* cls) {
+    auto const& dmethods = cls->get_dmethods();
+    auto const& vmethods = cls->get_vmethods();
+    if (std::any_of(dmethods.begin(), dmethods.end(), is_native) ||
+        std::any_of(vmethods.begin(), vmethods.end(), is_native)) {
+      TRACE(PGR, 3, "native_method: %s\n", SHOW(cls));
+      mark_reachable_by_classname(cls, true);
+    }
+  });
 }
 
 void init_reachable_classes(
     const Scope& scope,
     const Json::Value& config,
     const redex::ProguardConfiguration& pg_config,
-    const std::unordered_set<DexType*>& no_optimizations_anno) {
+    const std::unordered_set<DexType*>& no_optimizations_anno,
+    ResourceScanCache* resource_cache) {
   // Find classes that are reachable in such a way that none of the redex
   // passes will cause them to be no longer reachable.  For example, if a
   // class is referenced from the manifest.
-  init_permanently_reachable_classes(scope, config, no_optimizations_anno);
+  if (resource_cache != nullptr) {
+    init_permanently_reachable_classes(
+        scope, config, no_optimizations_anno, *resource_cache);
+  } else {
+    ResourceScanCache local_cache;
+    init_permanently_reachable_classes(
+        scope, config, no_optimizations_anno, local_cache);
+  }
 
   // Classes that are reachable in ways that could change as Redex runs. For
   // example, a class might be instantiated from a method, but if that method
@@ -515,15 +550,15 @@ void init_reachable_classes(
 
 std::string ReferencedState::str() const {
   std::stringstream s;
-  s << m_bytype;
-  s << m_bystring;
-  s << m_computed;
-  s << m_keep;
+  s << is_set(BY_TYPE);
+  s << is_set(BY_STRING);
+  s << !is_set(NOT_COMPUTED);
+  s << is_set(KEEP);
   s << allowshrinking();
   s << allowobfuscation();
-  s << m_assumenosideeffects;
-  s << m_blanket_keepnames;
-  s << m_whyareyoukeeping;
+  s << is_set(ASSUMENOSIDEEFFECTS);
+  s << is_set(BLANKET_KEEPNAMES);
+  s << is_set(WHYAREYOUKEEPING);
   s << ' ';
   s << m_keep_count;
   return s.str();
@@ -14,11 +14,17 @@
 #include "DexClass.h"
 #include "DexUtil.h"
 
+class ResourceScanCache;
+
+/*
+ * If no `resource_cache` is given, the APK's resources are scanned afresh.
+ */
 void init_reachable_classes(
     const Scope& scope,
     const Json::Value& config,
     const redex::ProguardConfiguration& pg_config,
-    const std::unordered_set<DexType*>& no_optimizations_anno);
+    const std::unordered_set<DexType*>& no_optimizations_anno,
+    ResourceScanCache* resource_cache = nullptr);
 void recompute_classes_reachable_from_code(const Scope& scope);
 
 // Note: The lack of convenience functions for DexType* is intentional. By doing
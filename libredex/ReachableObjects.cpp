@@ -9,10 +9,16 @@
 
 #include "ReachableObjects.h"
 
+#include <algorithm>
+#include <atomic>
+
+#include "ConcurrentContainers.h"
 #include "DexUtil.h"
+#include "IdContainers.h"
 #include "Pass.h"
 #include "ReachableClasses.h"
 #include "Resolver.h"
+#include "WorkQueue.h"
 
 using namespace reachable_objects;
 
@@ -30,6 +36,12 @@ using namespace reachable_objects;
  * retain (or not) implementations of interface methods. These elements are
  * placed in the cond_marked_* sets; care must be taken to promote
  * conditionally marked elements to fully marked.
+ *
+ * The search runs on a work queue: every newly marked element is a task,
+ * which visiting may spawn more tasks on the same worker, and idle workers
+ * steal them. The marked_* sets double as the concurrent visited sets. Each
+ * worker records the reachability graph on its own, and the graphs are
+ * merged at the end.
  */
 
 namespace {
@@ -144,6 +156,9 @@ bool implements_library_method(InheritanceGraph& graph,
   return false;
 }
 
+using MarkingQueue =
+    WorkQueue<ReachableObject, ReachableObjectEdges*, std::nullptr_t>;
+
 class Reachable {
   DexStoresVector& m_stores;
   const std::unordered_set<const DexType*>& m_ignore_string_literals;
@@ -151,16 +166,18 @@ class Reachable {
   std::unordered_set<const DexType*> m_ignore_system_annos;
   bool m_record_reachability;
   InheritanceGraph m_inheritance_graph;
-  int m_num_ignore_check_strings = 0;
-  std::unordered_set<const DexClass*> m_marked_classes;
-  std::unordered_set<const DexFieldRef*> m_marked_fields;
-  std::unordered_set<const DexMethodRef*> m_marked_methods;
-  std::unordered_set<const DexField*> m_cond_marked_fields;
-  std::unordered_set<const DexMethod*> m_cond_marked_methods;
-  std::vector<const DexClass*> m_class_stack;
-  std::vector<const DexFieldRef*> m_field_stack;
-  std::vector<const DexMethodRef*> m_method_stack;
-  ReachableObjectGraph m_retainers_of;
+  std::atomic<int> m_num_ignore_check_strings{0};
+  ConcurrentSet<const DexClass*> m_marked_classes;
+  // Nearly every member ends up in these, so a bit per id beats hashing.
+  ConcurrentIdSet<DexFieldRef> m_marked_fields;
+  ConcurrentIdSet<DexMethodRef> m_marked_methods;
+  ConcurrentIdSet<DexFieldRef> m_cond_marked_fields;
+  ConcurrentIdSet<DexMethodRef> m_cond_marked_methods;
+  std::unique_ptr<MarkingQueue> m_queue;
+  // The edges from the seeds, followed by the edges found by each worker.
+  std::vector<ReachableObjectEdges> m_retainers_of;
+  // The edges that the current thread records into.
+  static thread_local ReachableObjectEdges* t_retainers_of;
 
  public:
   Reachable(
@@ -182,19 +199,16 @@ class Reachable {
   }
 
  private:
-  void mark(const DexClass* cls) {
-    if (!cls) return;
-    m_marked_classes.emplace(cls);
-  }
+  /*
+   * Return whether the element wasn't marked yet, i.e. whether the caller is
+   * the one responsible for visiting it.
+   */
+  bool mark(const DexClass* cls) { return m_marked_classes.insert(cls); }
 
-  void mark(const DexFieldRef* field) {
-    if (!field) return;
-    m_marked_fields.emplace(field);
-  }
+  bool mark(const DexFieldRef* field) { return m_marked_fields.insert(field); }
 
-  void mark(const DexMethodRef* method) {
-    if (!method) return;
-    m_marked_methods.emplace(method);
+  bool mark(const DexMethodRef* method) {
+    return m_marked_methods.insert(method);
   }
 
   bool marked(const DexClass* cls) { return m_marked_classes.count(cls); }
@@ -217,75 +231,72 @@ class Reachable {
   }
 
   void push_seed(const DexClass* cls) {
-    if (!cls || marked(cls)) return;
+    if (!cls || !mark(cls)) return;
     record_is_seed(cls);
-    mark(cls);
-    m_class_stack.emplace_back(cls);
+    m_queue->add_item(ReachableObject(cls));
   }
 
   template <class Parent>
   void push(const Parent* parent, const DexClass* cls) {
     // FIXME: Bug! Even if cls is already marked, we need to record its
     // reachability from parent to cls.
-    if (!cls || marked(cls)) return;
+    if (!cls || !mark(cls)) return;
     record_reachability(parent, cls);
-    mark(cls);
-    m_class_stack.emplace_back(cls);
+    m_queue->add_item(ReachableObject(cls));
   }
 
   void push_seed(const DexField* field) {
-    if (!field || marked(field)) return;
+    if (!field || !mark(field)) return;
     record_is_seed(field);
-    mark(field);
-    m_field_stack.emplace_back(field);
+    m_queue->add_item(ReachableObject(field));
   }
 
+  /*
+   * The conditionally marked member is recorded *before* checking whether
+   * its class is marked, while the class is marked before it gets visited.
+   * So either the class visit finds the member, or we find the class marked
+   * (or both, which is harmless).
+   */
   void push_cond(const DexField* field) {
     if (!field || marked(field)) return;
     TRACE(REACH, 4, "Conditionally marking field: %s\n", SHOW(field));
     auto clazz = type_class(field->get_class());
-
+    m_cond_marked_fields.insert(field);
     if (marked(clazz)) {
       push(clazz, field);
-    } else {
-      m_cond_marked_fields.emplace(field);
     }
   }
 
   template <class Parent>
   void push(const Parent* parent, const DexFieldRef* field) {
-    if (!field || marked(field)) return;
+    if (!field || !mark(field)) return;
     if (field->is_def()) {
       gather_and_push(static_cast<const DexField*>(field));
     }
     record_reachability(parent, field);
-    mark(field);
-    m_field_stack.emplace_back(field);
+    m_queue->add_item(ReachableObject(field));
   }
 
   void push_seed(const DexMethod* method) {
-    if (!method || marked(method)) return;
+    if (!method || !mark(method)) return;
     record_is_seed(method);
-    mark(method);
-    m_method_stack.emplace_back(method);
+    m_queue->add_item(ReachableObject(method));
   }
 
   template <class Parent>
   void push(const Parent* parent, const DexMethodRef* method) {
-    if (!method || marked(method)) return;
+    if (!method || !mark(method)) return;
     record_reachability(parent, method);
-    mark(method);
-    m_method_stack.emplace_back(method);
+    m_queue->add_item(ReachableObject(method));
   }
 
   void push_cond(const DexMethod* method) {
     if (!method || marked(method)) return;
     TRACE(REACH, 4, "Conditionally marking method: %s\n", SHOW(method));
     auto clazz = type_class(method->get_class());
+    m_cond_marked_methods.insert(method);
     if (marked(clazz)) {
       push(clazz, method);
-    } else {
-      m_cond_marked_methods.emplace(method);
     }
   }
 
@@ -340,6 +351,24 @@ class Reachable {
     }
   }
 
+  void visit(const ReachableObject& obj) {
+    switch (obj.type) {
+    case ReachableObjectType::CLASS:
+      visit(obj.cls);
+      break;
+    case ReachableObjectType::FIELD:
+      visit(const_cast<DexFieldRef*>(obj.field));
+      break;
+    case ReachableObjectType::METHOD:
+      visit(const_cast<DexMethodRef*>(obj.method));
+      break;
+    case ReachableObjectType::ANNO:
+    case ReachableObjectType::SEED:
+      always_assert_log(false, "Unexpected marking task: %s",
+                        obj.type_str().c_str());
+    }
+  }
+
   void visit(const DexClass* cls) {
     TRACE(REACH, 4, "Visiting class: %s\n", SHOW(cls));
     for (auto& m : cls->get_dmethods()) {
@@ -459,7 +488,7 @@ class Reachable {
   void record_is_seed(Seed* seed) {
     if (m_record_reachability) {
       assert(seed != nullptr);
-      m_retainers_of[ReachableObject(seed)].emplace(SEED_SINGLETON);
+      t_retainers_of->emplace_back(ReachableObject(seed), SEED_SINGLETON);
     }
   }
 
@@ -467,9 +496,10 @@ class Reachable {
   struct RecordImpl {
     static void record_reachability(const Parent* parent,
                                     const Object* object,
-                                    ReachableObjectGraph& retainers_of) {
+                                    ReachableObjectEdges& retainers_of) {
       assert(parent != nullptr && object != nullptr);
-      retainers_of[ReachableObject(object)].emplace(parent);
+      retainers_of.emplace_back(ReachableObject(object),
+                                ReachableObject(parent));
     }
   };
 
@@ -477,12 +507,26 @@ class Reachable {
   void record_reachability(Parent* parent, Object* object) {
     if (m_record_reachability) {
       RecordImpl<Parent, Object>::record_reachability(
-          parent, object, m_retainers_of);
+          parent, object, *t_retainers_of);
     }
   }
 
  public:
   ReachableObjects mark(int* num_ignore_check_strings) {
+    auto num_threads = default_workqueue_threads();
+    m_retainers_of.resize(num_threads + 1);
+    m_queue = std::make_unique<MarkingQueue>(
+        [this](ReachableObjectEdges*& retainers_of, ReachableObject obj) {
+          t_retainers_of = retainers_of;
+          visit(obj);
+          return nullptr;
+        },
+        [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+        [this](unsigned int thread_idx) {
+          return &m_retainers_of[thread_idx + 1];
+        },
+        num_threads);
+    t_retainers_of = &m_retainers_of[0];
     for (auto const& dex : DexStoreClassesIterator(m_stores)) {
       for (auto const& cls : dex) {
         if (root(cls) || is_canary(cls)) {
@@ -516,58 +560,45 @@ class Reachable {
         }
       }
     }
-    while (true) {
-      if (!m_class_stack.empty()) {
-        auto cls = m_class_stack.back();
-        m_class_stack.pop_back();
-        visit(cls);
-        continue;
-      }
-      if (!m_field_stack.empty()) {
-        auto field = m_field_stack.back();
-        m_field_stack.pop_back();
-        visit(const_cast<DexFieldRef*>(field));
-        continue;
-      }
-      if (!m_method_stack.empty()) {
-        auto method = m_method_stack.back();
-        m_method_stack.pop_back();
-        visit(const_cast<DexMethodRef*>(method));
-        continue;
-      }
-      break;
-    }
+    m_queue->run_all();
 
     if (num_ignore_check_strings) {
       *num_ignore_check_strings = m_num_ignore_check_strings;
     }
 
     ReachableObjects ret;
-    ret.marked_fields = std::move(m_marked_fields);
-    ret.marked_classes = std::move(m_marked_classes);
-    ret.marked_methods = std::move(m_marked_methods);
-    ret.retainers_of = std::move(m_retainers_of);
+    for (auto cls : m_marked_classes) {
+      ret.marked_classes.emplace(cls);
+    }
+    m_marked_fields.for_each(
+        [&](const DexFieldRef* field) { ret.marked_fields.emplace(field); });
+    m_marked_methods.for_each([&](const DexMethodRef* method) {
+      ret.marked_methods.emplace(method);
+    });
+    ret.retainers_of = ReachableObjectGraph(std::move(m_retainers_of));
     return ret;
   }
 };
 
+thread_local ReachableObjectEdges* Reachable::t_retainers_of{nullptr};
+
 void print_reachable_stack_h(const ReachableObject& obj,
-                             ReachableObjectGraph& retainers_of,
+                             const ReachableObjectGraph& retainers_of,
                              const std::string& dump_tag) {
   TRACE(REACH_DUMP, 5, "%s    %s\n", dump_tag.c_str(), obj.str().c_str());
   if (obj.type == ReachableObjectType::SEED) {
     return;
   }
-  auto const& retainer_set = retainers_of[obj];
-  if (retainer_set.empty()) {
+  auto retainers = retainers_of.retainers(obj);
+  if (retainers.empty()) {
     return; // Shouldn't happen, but...
   }
-  print_reachable_stack_h(*retainer_set.cbegin(), retainers_of, dump_tag);
+  print_reachable_stack_h(retainers.front(), retainers_of, dump_tag);
 }
 
 template <class Reachable>
 void print_reachable_stack(Reachable* r,
-                           ReachableObjectGraph& retainers_of,
+                           const ReachableObjectGraph& retainers_of,
                            const std::string& dump_tag) {
   ReachableObject obj(r);
   TRACE(REACH_DUMP,
@@ -575,20 +606,20 @@ void print_reachable_stack(Reachable* r,
         "%s %s is reachable via\n",
         dump_tag.c_str(),
         obj.str().c_str());
-  auto const& retainer_set = retainers_of[obj];
-  if (retainer_set.empty()) {
+  auto retainers = retainers_of.retainers(obj);
+  if (retainers.empty()) {
     return; // Shouldn't happen, but...
   }
-  print_reachable_stack_h(*retainer_set.cbegin(), retainers_of, dump_tag);
+  print_reachable_stack_h(retainers.front(), retainers_of, dump_tag);
 }
 
 template <class Reachable>
 void print_reachable_reason(Reachable* reachable,
-                            ReachableObjectGraph& retainers_of,
+                            const ReachableObjectGraph& retainers_of,
                             const std::string& dump_tag) {
   ReachableObject obj(reachable);
   bool any_added = false;
-  auto retainer_set = retainers_of[obj];
+  auto retainer_set = retainers_of.retainers(obj);
   std::string reason = obj.str() + " is reachable via " +
                        std::to_string(retainer_set.size()) + " [";
   for (auto& item : retainer_set) {
@@ -604,29 +635,38 @@ void print_reachable_reason(Reachable* reachable,
 }
 
 void print_graph_edges(const DexClass* cls,
-                       ReachableObjectGraph& retainers_of,
+                       const ReachableObjectGraph& retainers_of,
                        const std::string& dump_tag,
                        std::ostream& os) {
+  // The chain of retainers from cls up to its seed, printed the other way
+  // round.
   ReachableObject obj(cls);
-  std::string s;
-  s = "\"[" + obj.type_str() + "] " + obj.str() + "\"";
+  std::vector<std::string> chain;
+  chain.push_back("\"[" + obj.type_str() + "] " + obj.str() + "\"");
   while (true) {
-    const auto& set = retainers_of[obj];
-    if (set.empty()) {
+    auto retainers = retainers_of.retainers(obj);
+    if (retainers.empty()) {
       break;
     }
-    s = "\t" + s;
     ReachableObject prev = obj;
     // NOTE: We only read the first item, but it seems fine. I didn't observe
-    // any case of more than one item in set.
-    assert(set.size() == 1);
-    obj = *begin(set);
+    // any case of more than one retainer.
+    assert(retainers.size() == 1);
+    obj = retainers.front();
     if (obj.type == ReachableObjectType::SEED) {
-      s = "\"[SEED] " + prev.str() + " " + prev.state_str() + "\"" + s;
+      chain.push_back("\"[SEED] " + prev.str() + " " + prev.state_str() +
+                      "\"");
       break;
     } else {
-      s = "\"[" + obj.type_str() + "] " + obj.str() + "\"" + s;
+      chain.push_back("\"[" + obj.type_str() + "] " + obj.str() + "\"");
+    }
+  }
+  std::string s;
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    if (it != chain.rbegin()) {
+      s += "\t";
     }
+    s += *it;
   }
 
   os << cls->get_deobfuscated_name() << "\t" << s << std::endl;
@@ -639,6 +679,95 @@ void print_graph_edges(const DexClass* cls,
 }
 } // namespace
 
+namespace reachable_objects {
+
+ReachableObjectGraph::ReachableObjectGraph(
+    std::vector<ReachableObjectEdges> edges) {
+  size_t num_edges = 0;
+  for (const auto& list : edges) {
+    num_edges += list.size();
+    for (const auto& edge : list) {
+      m_objects.push_back(edge.first);
+      m_objects.push_back(edge.second);
+    }
+  }
+  std::sort(m_objects.begin(), m_objects.end(), ReachableObjectLess());
+  m_objects.erase(
+      std::unique(m_objects.begin(), m_objects.end(), ReachableObjectEq()),
+      m_objects.end());
+  m_objects.shrink_to_fit();
+
+  // Number the ends of the edges, and count the retainers of each object.
+  std::vector<std::pair<NodeId, NodeId>> ids;
+  ids.reserve(num_edges);
+  m_offsets.assign(m_objects.size() + 1, 0);
+  for (auto& list : edges) {
+    for (const auto& edge : list) {
+      NodeId object, retainer;
+      find(edge.first, &object);
+      find(edge.second, &retainer);
+      ids.emplace_back(object, retainer);
+      ++m_offsets[object + 1];
+    }
+    ReachableObjectEdges().swap(list);
+  }
+  for (size_t i = 1; i < m_offsets.size(); ++i) {
+    m_offsets[i] += m_offsets[i - 1];
+  }
+  m_retainers.resize(num_edges);
+  std::vector<NodeId> next(m_offsets.begin(), m_offsets.end() - 1);
+  for (const auto& id : ids) {
+    m_retainers[next[id.first]++] = id.second;
+  }
+
+  // The workers may have recorded the same edge more than once; keep only
+  // one of each.
+  NodeId out = 0;
+  for (size_t i = 0; i < m_objects.size(); ++i) {
+    auto begin = m_retainers.begin() + m_offsets[i];
+    auto end = m_retainers.begin() + m_offsets[i + 1];
+    std::sort(begin, end);
+    m_offsets[i] = out;
+    for (auto it = begin; it != end; ++it) {
+      if (it == begin || *it != *(it - 1)) {
+        m_retainers[out++] = *it;
+      }
+    }
+  }
+  m_offsets.back() = out;
+  m_retainers.resize(out);
+  m_retainers.shrink_to_fit();
+}
+
+bool ReachableObjectGraph::find(const ReachableObject& obj, NodeId* id) const {
+  auto it = std::lower_bound(
+      m_objects.begin(), m_objects.end(), obj, ReachableObjectLess());
+  if (it == m_objects.end() || !ReachableObjectEq()(*it, obj)) {
+    return false;
+  }
+  *id = it - m_objects.begin();
+  return true;
+}
+
+bool ReachableObjectGraph::contains(const ReachableObject& obj) const {
+  NodeId id;
+  return find(obj, &id) && m_offsets[id] != m_offsets[id + 1];
+}
+
+std::vector<ReachableObject> ReachableObjectGraph::retainers(
+    const ReachableObject& obj) const {
+  std::vector<ReachableObject> result;
+  NodeId id;
+  if (find(obj, &id)) {
+    for (auto i = m_offsets[id]; i < m_offsets[id + 1]; ++i) {
+      result.push_back(m_objects[m_retainers[i]]);
+    }
+  }
+  return result;
+}
+
+} // namespace reachable_objects
+
 ReachableObjects compute_reachable_objects(
     DexStoresVector& stores,
     const std::unordered_set<const DexType*>& ignore_string_literals,
@@ -655,7 +784,7 @@ ReachableObjects compute_reachable_objects(
 }
 
 void dump_reachability(DexStoresVector& stores,
-                       ReachableObjectGraph& retainers_of,
+                       const ReachableObjectGraph& retainers_of,
                        const std::string& dump_tag) {
   for (const auto& dex : DexStoreClassesIterator(stores)) {
     for (const auto& cls : dex) {
@@ -666,7 +795,7 @@ void dump_reachability(DexStoresVector& stores,
 }
 
 void dump_reachability_graph(DexStoresVector& stores,
-                             ReachableObjectGraph& retainers_of,
+                             const ReachableObjectGraph& retainers_of,
                              const std::string& dump_tag,
                              std::ostream& os) {
   for (const auto& dex : DexStoreClassesIterator(stores)) {
@@ -11,6 +11,8 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "DexClass.h"
 #include "Pass.h"
@@ -34,10 +36,14 @@ enum class ReachableObjectType {
  */
 struct ReachableObject {
   ReachableObjectType type;
-  const DexAnnotation* anno{nullptr};
-  const DexClass* cls{nullptr};
-  const DexFieldRef* field{nullptr};
-  const DexMethodRef* method{nullptr};
+  // Only the member that matches the type is set.
+  union {
+    const DexAnnotation* anno;
+    const DexClass* cls;
+    const DexFieldRef* field;
+    const DexMethodRef* method;
+    const void* ptr;
+  };
 
   explicit ReachableObject(const DexAnnotation* anno)
       : type{ReachableObjectType::ANNO}, anno{anno} {}
@@ -47,7 +53,7 @@ struct ReachableObject {
       : type{ReachableObjectType::METHOD}, method{method} {}
   explicit ReachableObject(const DexFieldRef* field)
       : type{ReachableObjectType::FIELD}, field{field} {}
-  explicit ReachableObject() : type{ReachableObjectType::SEED} {}
+  explicit ReachableObject() : type{ReachableObjectType::SEED}, ptr{nullptr} {}
 
   std::string str() const {
     switch (type) {
@@ -105,48 +111,69 @@ struct ReachableObject {
 
 struct ReachableObjectHash {
   std::size_t operator()(const ReachableObject& obj) const {
-    switch (obj.type) {
-    case ReachableObjectType::ANNO:
-      return std::hash<const DexAnnotation*>{}(obj.anno);
-    case ReachableObjectType::CLASS:
-      return std::hash<const DexClass*>{}(obj.cls);
-    case ReachableObjectType::FIELD:
-      return std::hash<const DexFieldRef*>{}(obj.field);
-    case ReachableObjectType::METHOD:
-      return std::hash<const DexMethodRef*>{}(obj.method);
-    case ReachableObjectType::SEED:
-      return 0;
-    }
+    return std::hash<const void*>{}(obj.ptr);
   }
 };
 
 struct ReachableObjectEq {
+  bool operator()(const ReachableObject& lhs,
+                  const ReachableObject& rhs) const {
+    return lhs.type == rhs.type && lhs.ptr == rhs.ptr;
+  }
+};
+
+struct ReachableObjectLess {
   bool operator()(const ReachableObject& lhs,
                   const ReachableObject& rhs) const {
     if (lhs.type != rhs.type) {
-      return false;
-    }
-    switch (lhs.type) {
-    case ReachableObjectType::ANNO:
-      return lhs.anno == rhs.anno;
-    case ReachableObjectType::CLASS:
-      return lhs.cls == rhs.cls;
-    case ReachableObjectType::FIELD:
-      return lhs.field == rhs.field;
-    case ReachableObjectType::METHOD:
-      return lhs.method == rhs.method;
-    case ReachableObjectType::SEED:
-      return true;
+      return lhs.type < rhs.type;
     }
+    return std::less<const void*>()(lhs.ptr, rhs.ptr);
   }
 };
 
-using ReachableObjectSet =
-    std::unordered_set<ReachableObject, ReachableObjectHash, ReachableObjectEq>;
-using ReachableObjectGraph = std::unordered_map<ReachableObject,
-                                                ReachableObjectSet,
-                                                ReachableObjectHash,
-                                                ReachableObjectEq>;
+// (object, retainer) pairs, in no particular order.
+using ReachableObjectEdges =
+    std::vector<std::pair<ReachableObject, ReachableObject>>;
+
+/**
+ * The graph of the objects that retain each reachable object.
+ *
+ * It's meant to be cheap enough to always be recorded. The objects are
+ * numbered by their position in a sorted array, and the retainers of all the
+ * objects are stored as numbers in one array, in compressed sparse row form:
+ * the retainers of object i are m_retainers[m_offsets[i]..m_offsets[i + 1]).
+ */
+class ReachableObjectGraph {
+ public:
+  using NodeId = uint32_t;
+
+  ReachableObjectGraph() = default;
+
+  /*
+   * Build the graph from lists of edges, which are consumed.
+   */
+  explicit ReachableObjectGraph(std::vector<ReachableObjectEdges> edges);
+
+  bool contains(const ReachableObject& obj) const;
+
+  /*
+   * The retainers of an object, in no particular order. It's empty if the
+   * object isn't part of the graph.
+   */
+  std::vector<ReachableObject> retainers(const ReachableObject& obj) const;
+
+  size_t num_objects() const { return m_objects.size(); }
+
+  size_t num_edges() const { return m_retainers.size(); }
+
+ private:
+  bool find(const ReachableObject& obj, NodeId* id) const;
+
+  std::vector<ReachableObject> m_objects;
+  std::vector<NodeId> m_offsets;
+  std::vector<NodeId> m_retainers;
+};
 
 } // namespace
 
@@ -166,12 +193,13 @@ ReachableObjects compute_reachable_objects(
     bool record_reachability = false);
 
 // Dump reachability information to TRACE(REACH_DUMP, 5).
-void dump_reachability(DexStoresVector& stores,
-                       reachable_objects::ReachableObjectGraph& retainers_of,
-                       const std::string& dump_tag);
+void dump_reachability(
+    DexStoresVector& stores,
+    const reachable_objects::ReachableObjectGraph& retainers_of,
+    const std::string& dump_tag);
 
 void dump_reachability_graph(
     DexStoresVector& stores,
-    reachable_objects::ReachableObjectGraph& retainers_of,
+    const reachable_objects::ReachableObjectGraph& retainers_of,
     const std::string& dump_tag,
     std::ostream& os);
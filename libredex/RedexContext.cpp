@@ -9,21 +9,32 @@
 
 #include "RedexContext.h"
 
+#include <algorithm>
 #include <exception>
 #include <mutex>
 #include <unordered_set>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
 
 #include "Debug.h"
 #include "DexClass.h"
+#include "Resolver.h"
+#include "VirtualScope.h"
+#include "WorkQueue.h"
 
 RedexContext* g_redex;
 
 RedexContext::RedexContext() {}
 
 RedexContext::~RedexContext() {
-  // Delete DexStrings.
+  // The shared caches are keyed by the refs about to be deleted.
+  invalidate_resolution_caches();
+  invalidate_class_scopes();
+  // Destroy DexStrings. They, DexTypes, DexTypeLists and DexProtos live in
+  // m_arena, which releases their memory after this destructor has run.
   for (auto const& p : s_string_map) {
-    delete p.second;
+    p.second->~DexString();
   }
   // Delete DexTypes.  NB: This table intentionally contains aliases (multiple
   // DexStrings map to the same DexType), so we have to dedup the set of types
@@ -33,21 +44,19 @@ RedexContext::~RedexContext() {
     delete_types.emplace(p.second);
   }
   for (auto const& t : delete_types) {
-    delete t;
+    t->~DexType();
   }
   // Delete DexFields.
   for (auto const& it : s_field_map) {
     delete static_cast<DexField*>(it.second);
   }
-  // Delete DexTypeLists.
+  // Destroy DexTypeLists.
   for (auto const& p : s_typelist_map) {
-    delete p.second;
+    p.second->~DexTypeList();
   }
-  // Delete DexProtos.
-  for (auto const& p1 : s_proto_map) {
-    for (auto const& p2 : p1.second) {
-      delete p2.second;
-    }
+  // Destroy DexProtos.
+  for (auto const& p : s_proto_map) {
+    p.second->~DexProto();
   }
   // Delete DexMethods.
   for (auto const& it : s_method_map) {
@@ -55,88 +64,212 @@ RedexContext::~RedexContext() {
   }
 }
 
+RedexContext::StringKey::StringKey(const char* str) : str(str), hash(0) {
+  // FNV-1a
+  size_t h = 14695981039346656037ULL;
+  for (auto p = reinterpret_cast<const unsigned char*>(str); *p; ++p) {
+    h = (h ^ *p) * 1099511628211ULL;
+  }
+  hash = h;
+}
+
 DexString* RedexContext::make_string(const char* nstr, uint32_t utfsize) {
   always_assert(nstr != nullptr);
-  std::lock_guard<std::mutex> lock(s_string_lock);
-  auto it = s_string_map.find(nstr);
-  if (it == s_string_map.end()) {
+  return s_string_map.get_or_insert(StringKey(nstr), [&]() {
     // note DexStrings are keyed by the c_str() of the underlying std::string
     // The c_str is valid until a the string is destroyed, or until a non-const
     // function is called on the string (but note the std::string itself is
     // const)
-    auto rv = new DexString(nstr, utfsize);
-    s_string_map.emplace(rv->c_str(), rv);
-    return rv;
-  } else {
-    return it->second;
+    auto rv = new (m_arena.allocate<DexString>()) DexString(nstr, utfsize);
+    rv->m_id = m_string_ids.add(rv);
+    return std::make_pair(StringKey(rv->c_str()), rv);
+  });
+}
+
+namespace {
+
+// The indices of the keys, grouped by the slot of `Map` they belong to.
+template <typename Map, typename Key>
+std::vector<std::vector<uint32_t>> group_by_slot(const std::vector<Key>& keys) {
+  std::vector<std::vector<uint32_t>> groups(Map::num_slots());
+  for (uint32_t i = 0; i < keys.size(); i++) {
+    groups[Map::slot(keys[i])].push_back(i);
   }
+  return groups;
+}
+
+// Runs `fn(slot, indices)` for each non-empty group, in parallel.
+template <typename Fn>
+void for_each_slot(const std::vector<std::vector<uint32_t>>& groups,
+                   const Fn& fn) {
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t slot) { fn(slot, groups[slot]); });
+  for (size_t slot = 0; slot < groups.size(); slot++) {
+    if (!groups[slot].empty()) {
+      wq.add_item(slot);
+    }
+  }
+  wq.run_all();
+}
+
+constexpr size_t STRING_HASH_BATCH = 4096;
+
+} // namespace
+
+std::vector<DexString*> RedexContext::make_strings(
+    const std::vector<std::pair<const char*, uint32_t>>& strs) {
+  std::vector<StringKey> keys(strs.size());
+  {
+    auto wq = workqueue_foreach<size_t>([&](size_t begin) {
+      auto end = std::min(begin + STRING_HASH_BATCH, strs.size());
+      for (size_t i = begin; i < end; i++) {
+        always_assert(strs[i].first != nullptr);
+        keys[i] = StringKey(strs[i].first);
+      }
+    });
+    for (size_t begin = 0; begin < strs.size(); begin += STRING_HASH_BATCH) {
+      wq.add_item(begin);
+    }
+    wq.run_all();
+  }
+
+  std::vector<DexString*> result(strs.size());
+  for_each_slot(
+      group_by_slot<decltype(s_string_map)>(keys),
+      [&](size_t slot, const std::vector<uint32_t>& indices) {
+        s_string_map.with_slot(slot, [&](auto& map) {
+          for (auto i : indices) {
+            auto it = map.find(keys[i]);
+            if (it == map.end()) {
+              // As in make_string(), the stored key points into the
+              // DexString.
+              auto rv = new (m_arena.allocate<DexString>())
+                  DexString(strs[i].first, strs[i].second);
+              rv->m_id = m_string_ids.add(rv);
+              it = map.emplace(StringKey(rv->c_str()), rv).first;
+            }
+            result[i] = it->second;
+          }
+        });
+      });
+  return result;
+}
+
+std::vector<DexType*> RedexContext::make_types(
+    const std::vector<DexString*>& names) {
+  std::vector<DexType*> result(names.size());
+  for_each_slot(
+      group_by_slot<decltype(s_type_map)>(names),
+      [&](size_t slot, const std::vector<uint32_t>& indices) {
+        s_type_map.with_slot(slot, [&](auto& map) {
+          for (auto i : indices) {
+            always_assert(names[i] != nullptr);
+            auto it = map.find(names[i]);
+            if (it == map.end()) {
+              auto rv = new (m_arena.allocate<DexType>()) DexType(names[i]);
+              rv->m_id = m_type_ids.add(rv);
+              it = map.emplace(names[i], rv).first;
+            }
+            result[i] = it->second;
+          }
+        });
+      });
+  return result;
+}
+
+std::vector<DexMethodRef*> RedexContext::make_methods(
+    const std::vector<DexMethodSpec>& specs) {
+  std::vector<DexMethodRef*> result(specs.size());
+  for_each_slot(
+      group_by_slot<decltype(s_method_map)>(specs),
+      [&](size_t slot, const std::vector<uint32_t>& indices) {
+        s_method_map.with_slot(slot, [&](auto& map) {
+          for (auto i : indices) {
+            const auto& r = specs[i];
+            always_assert(r.cls != nullptr && r.name != nullptr &&
+                          r.proto != nullptr);
+            auto it = map.find(r);
+            if (it == map.end()) {
+              DexMethodRef* rv = new DexMethod(r.cls, r.name, r.proto);
+              rv->m_id = m_method_ids.add(rv);
+              it = map.emplace(r, rv).first;
+            }
+            result[i] = it->second;
+          }
+        });
+      });
+  return result;
 }
 
 DexString* RedexContext::get_string(const char* nstr, uint32_t utfsize) {
   if (nstr == nullptr) {
     return nullptr;
   }
-  // We need to use the lock to prevent undefined behavior if this method is
-  // called while the map is being modified.
-  std::lock_guard<std::mutex> lock(s_string_lock);
-  auto find = s_string_map.find(nstr);
-  auto result = find != s_string_map.end() ? find->second : nullptr;
-  return result;
+  return s_string_map.get(StringKey(nstr), nullptr);
 }
 
 DexType* RedexContext::make_type(DexString* dstring) {
   always_assert(dstring != nullptr);
-  std::lock_guard<std::mutex> lock(s_type_lock);
-  auto it = s_type_map.find(dstring);
-  if (it == s_type_map.end()) {
-    auto rv = new DexType(dstring);
-    s_type_map.emplace(dstring, rv);
-    return rv;
-  } else {
-    return it->second;
-  }
+  return s_type_map.get_or_insert(dstring, [&]() {
+    auto rv = new (m_arena.allocate<DexType>()) DexType(dstring);
+    rv->m_id = m_type_ids.add(rv);
+    return std::make_pair(dstring, rv);
+  });
 }
 
 DexType* RedexContext::get_type(DexString* dstring) {
   if (dstring == nullptr) {
     return nullptr;
   }
-  // We need to use the lock to prevent undefined behavior if this method is
-  // called while the map is being modified.
-  std::lock_guard<std::mutex> lock(s_type_lock);
-  auto find = s_type_map.find(dstring);
-  auto result = find != s_type_map.end() ? find->second : nullptr;
-  return result;
+  return s_type_map.get(dstring, nullptr);
 }
 
 void RedexContext::alias_type_name(DexType* type, DexString* new_name) {
-  std::lock_guard<std::mutex> lock(s_type_lock);
   always_assert_log(
-      !s_type_map.count(new_name),
+      s_type_map.insert({new_name, type}),
       "Bailing, attempting to alias a symbol that already exists! '%s'\n",
       new_name->c_str());
   type->m_name = new_name;
-  s_type_map.emplace(new_name, type);
+}
+
+void RedexContext::alias_type_names(
+    const std::vector<std::pair<DexType*, DexString*>>& aliases) {
+  std::vector<DexString*> names;
+  names.reserve(aliases.size());
+  for (const auto& pair : aliases) {
+    names.push_back(pair.second);
+  }
+  for_each_slot(
+      group_by_slot<decltype(s_type_map)>(names),
+      [&](size_t slot, const std::vector<uint32_t>& indices) {
+        s_type_map.with_slot(slot, [&](auto& map) {
+          for (auto i : indices) {
+            DexType* type = aliases[i].first;
+            DexString* new_name = aliases[i].second;
+            always_assert_log(map.emplace(new_name, type).second,
+                              "Bailing, attempting to alias a symbol that "
+                              "already exists! '%s'\n",
+                              new_name->c_str());
+            type->m_name = new_name;
+          }
+        });
+      });
 }
 
 DexFieldRef* RedexContext::make_field(const DexType* container,
                                       const DexString* name,
                                       const DexType* type) {
   always_assert(container != nullptr && name != nullptr && type != nullptr);
-  std::lock_guard<std::mutex> lock(s_field_lock);
   DexFieldSpec r(const_cast<DexType*>(container),
                 const_cast<DexString*>(name),
                 const_cast<DexType*>(type));
-  auto it = s_field_map.find(r);
-  if (it == s_field_map.end()) {
-    auto rv = new DexField(const_cast<DexType*>(container),
-                           const_cast<DexString*>(name),
-                           const_cast<DexType*>(type));
-    s_field_map.emplace(r, rv);
-    return rv;
-  } else {
-    return it->second;
-  }
+  return s_field_map.get_or_insert(r, [&]() {
+    DexFieldRef* rv = new DexField(const_cast<DexType*>(container),
+                                   const_cast<DexString*>(name),
+                                   const_cast<DexType*>(type));
+    rv->m_id = m_field_ids.add(rv);
+    return std::make_pair(r, rv);
+  });
 }
 
 DexFieldRef* RedexContext::get_field(const DexType* container,
@@ -148,85 +281,94 @@ DexFieldRef* RedexContext::get_field(const DexType* container,
   DexFieldSpec r(const_cast<DexType*>(container),
                 const_cast<DexString*>(name),
                 const_cast<DexType*>(type));
-  // Still need to perform the locking in case a make_method call on another
-  // thread is modifying the map.
-  std::lock_guard<std::mutex> lock(s_field_lock);
-  auto it = s_field_map.find(r);
-  if (it == s_field_map.end()) {
-    return nullptr;
-  } else {
-    return it->second;
-  }
+  return s_field_map.get(r, nullptr);
 }
 
 void RedexContext::mutate_field(
     DexFieldRef* field, const DexFieldSpec& ref, bool rename_on_collision) {
-  std::lock_guard<std::mutex> lock(s_field_lock);
   DexFieldSpec& r = field->m_spec;
   s_field_map.erase(r);
   r.cls = ref.cls != nullptr ? ref.cls : field->m_spec.cls;
   r.name = ref.name != nullptr ? ref.name : field->m_spec.name;
   r.type = ref.type != nullptr ? ref.type : field->m_spec.type;
-  field->m_spec = r;
 
-  if (rename_on_collision && s_field_map.find(r) != s_field_map.end()) {
+  bool inserted = s_field_map.insert({r, field});
+  if (!inserted && rename_on_collision) {
     uint32_t i = 0;
-    while (true) {
+    do {
       r.name = DexString::make_string(
           ("f$" + std::to_string(i++)).c_str());
-      if (s_field_map.find(r) == s_field_map.end()) {
-        break;
-      }
-    }
+    } while (!s_field_map.insert({r, field}));
+    inserted = true;
   }
-  always_assert_log(s_field_map.find(r) == s_field_map.end(),
+  always_assert_log(inserted,
                     "Another field with the same signature already exists");
-  s_field_map.emplace(r, field);
 }
 
-DexTypeList* RedexContext::make_type_list(std::deque<DexType*>&& p) {
-  std::lock_guard<std::mutex> lock(s_typelist_lock);
-  auto it = s_typelist_map.find(p);
-  if (it == s_typelist_map.end()) {
-    auto rv = new DexTypeList(std::move(p));
-    s_typelist_map[rv->m_list] = rv;
-    return rv;
-  } else {
-    return it->second;
+RedexContext::TypeListKey::TypeListKey(DexType* const* types, uint32_t size)
+    : types(types), size(size), hash(0) {
+  size_t h = size;
+  for (uint32_t i = 0; i < size; ++i) {
+    boost::hash_combine(h, types[i]);
+  }
+  hash = h;
+}
+
+namespace {
+
+constexpr size_t SMALL_TYPE_LIST = 16;
+
+// Calls fn with a contiguous copy of the types, which only needs an
+// allocation for long lists.
+template <typename Fn>
+DexTypeList* with_contiguous_types(const std::deque<DexType*>& p,
+                                   const Fn& fn) {
+  if (p.size() <= SMALL_TYPE_LIST) {
+    DexType* types[SMALL_TYPE_LIST];
+    std::copy(p.begin(), p.end(), types);
+    return fn(types, p.size());
   }
+  std::vector<DexType*> types(p.begin(), p.end());
+  return fn(types.data(), types.size());
+}
+
+} // namespace
+
+DexTypeList* RedexContext::make_type_list(std::deque<DexType*>&& p) {
+  return with_contiguous_types(p, [&](DexType* const* types, uint32_t size) {
+    TypeListKey key(types, size);
+    return s_typelist_map.get_or_insert(key, [&]() {
+      auto rv = new (m_arena.allocate(sizeof(DexTypeList) +
+                                      size * sizeof(DexType*)))
+          DexTypeList(types, size, key.hash);
+      return std::make_pair(TypeListKey(rv->storage(), size), rv);
+    });
+  });
 }
 
 DexTypeList* RedexContext::get_type_list(std::deque<DexType*>&& p) {
-  // We need to use the lock to prevent undefined behavior if this method is
-  // called while the map is being modified.
-  std::lock_guard<std::mutex> lock(s_typelist_lock);
-  auto find = s_typelist_map.find(p);
-  auto result = find != s_typelist_map.end() ? find->second : nullptr;
-  return result;
+  return with_contiguous_types(p, [&](DexType* const* types, uint32_t size) {
+    return s_typelist_map.get(TypeListKey(types, size), nullptr);
+  });
 }
 
 DexProto* RedexContext::make_proto(DexType* rtype,
                                    DexTypeList* args,
                                    DexString* shorty) {
   always_assert(rtype != nullptr && args != nullptr && shorty != nullptr);
-  std::lock_guard<std::mutex> lock(s_proto_lock);
-  if (s_proto_map[rtype].count(args) == 0) {
-    auto rv = new DexProto(rtype, args, shorty);
-    s_proto_map[rtype][args] = rv;
-    return rv;
-  }
-  return s_proto_map[rtype][args];
+  ProtoKey key(rtype, args);
+  return s_proto_map.get_or_insert(key, [&]() {
+    return std::make_pair(
+        key,
+        new (m_arena.allocate<DexProto>()) DexProto(rtype, args, shorty));
+  });
 }
 
 DexProto* RedexContext::get_proto(DexType* rtype, DexTypeList* args) {
   if (rtype == nullptr || args == nullptr) {
     return nullptr;
   }
-  std::lock_guard<std::mutex> lock(s_proto_lock);
-  if (s_proto_map[rtype].count(args) == 0) {
-    return nullptr;
-  }
-  return s_proto_map[rtype][args];
+  return s_proto_map.get(ProtoKey(rtype, args), nullptr);
 }
 
 DexMethodRef* RedexContext::make_method(DexType* type,
@@ -234,15 +376,11 @@ DexMethodRef* RedexContext::make_method(DexType* type,
                                         DexProto* proto) {
   always_assert(type != nullptr && name != nullptr && proto != nullptr);
   DexMethodSpec r(type, name, proto);
-  std::lock_guard<std::mutex> lock(s_method_lock);
-  auto it = s_method_map.find(r);
-  if (it == s_method_map.end()) {
-    auto rv = new DexMethod(type, name, proto);
-    s_method_map.emplace(r, rv);
-    return rv;
-  } else {
-    return it->second;
-  }
+  return s_method_map.get_or_insert(r, [&]() {
+    DexMethodRef* rv = new DexMethod(type, name, proto);
+    rv->m_id = m_method_ids.add(rv);
+    return std::make_pair(r, rv);
+  });
 }
 
 DexMethodRef* RedexContext::get_method(DexType* type,
@@ -252,46 +390,34 @@ DexMethodRef* RedexContext::get_method(DexType* type,
     return nullptr;
   }
   DexMethodSpec r(type, name, proto);
-  // Still need to perform the locking in case a make_method call on another
-  // thread is modifying the map.
-  std::lock_guard<std::mutex> lock(s_method_lock);
-  auto it = s_method_map.find(r);
-  if (it == s_method_map.end()) {
-    return nullptr;
-  } else {
-    return it->second;
-  }
+  return s_method_map.get(r, nullptr);
 }
 
 void RedexContext::erase_method(DexMethodRef* method) {
-  std::lock_guard<std::mutex> lock(s_method_lock);
   s_method_map.erase(method->m_spec);
 }
 
 void RedexContext::mutate_method(DexMethodRef* method,
                                  const DexMethodSpec& ref,
                                  bool rename_on_collision /* = false */) {
-  std::lock_guard<std::mutex> lock(s_method_lock);
   DexMethodSpec& r = method->m_spec;
   s_method_map.erase(r);
 
   r.cls = ref.cls != nullptr ? ref.cls : method->m_spec.cls;
   r.name = ref.name != nullptr ? ref.name : method->m_spec.name;
   r.proto = ref.proto != nullptr ? ref.proto : method->m_spec.proto;
-  if (s_method_map.find(r) != s_method_map.end() && rename_on_collision) {
-    std::string original_name(r.name->c_str());
+
+  bool inserted = s_method_map.insert({r, method});
+  if (!inserted && rename_on_collision) {
     uint32_t i = 0;
-    while (true) {
+    do {
       r.name = DexString::make_string(
           ("r$" + std::to_string(i++)).c_str());
-      if (s_method_map.find(r) == s_method_map.end()) {
-        break;
-      }
-    }
+    } while (!s_method_map.insert({r, method}));
+    inserted = true;
   }
-  always_assert_log(s_method_map.find(r) == s_method_map.end(),
+  always_assert_log(inserted,
                     "Another method of the same signature already exists");
-  s_method_map.emplace(r, method);
 }
 
 void RedexContext::publish_class(DexClass* cls) {
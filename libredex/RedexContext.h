@@ -20,7 +20,10 @@
 #include <unordered_map>
 #include <vector>
 
+#include "Arena.h"
+#include "ConcurrentContainers.h"
 #include "DexMemberRefs.h"
+#include "IdTable.h"
 
 class DexDebugInstruction;
 class DexString;
@@ -46,7 +49,19 @@ struct RedexContext {
 
   DexType* make_type(DexString* dstring);
   DexType* get_type(DexString* dstring);
+
+  // Interns a whole table of strings or types at once. The result is what
+  // calling make_string() or make_type() on each entry would return, but
+  // the entries are hashed in parallel and every shard of the table is
+  // locked once for all of its entries instead of once per entry.
+  std::vector<DexString*> make_strings(
+      const std::vector<std::pair<const char*, uint32_t>>& strs);
+  std::vector<DexType*> make_types(const std::vector<DexString*>& names);
   void alias_type_name(DexType* type, DexString* new_name);
+  // Like calling alias_type_name() on each pair, but locking every shard of
+  // the type table once for all the names that go into it.
+  void alias_type_names(
+      const std::vector<std::pair<DexType*, DexString*>>& aliases);
 
   DexFieldRef* make_field(const DexType* container,
                           const DexString* name,
@@ -72,6 +87,9 @@ struct RedexContext {
   DexMethodRef* get_method(DexType* type,
                         DexString* name,
                         DexProto* proto);
+  // Like make_strings() and make_types(), for method references.
+  std::vector<DexMethodRef*> make_methods(
+      const std::vector<DexMethodSpec>& specs);
   void erase_method(DexMethodRef*);
   void mutate_method(DexMethodRef* method,
                      const DexMethodSpec& ref,
@@ -80,6 +98,11 @@ struct RedexContext {
   DexDebugEntry* make_dbg_entry(DexDebugInstruction* opcode);
   DexDebugEntry* make_dbg_entry(DexPosition* pos);
 
+  // The dense ids of the interned strings, types, field and method
+  // references, by which IdSet and IdMap (see IdContainers.h) key them.
+  template <class T>
+  const IdTable<T>& ids() const;
+
   void publish_class(DexClass*);
   DexClass* type_class(const DexType* t);
   template <class TypeClassWalkerFn = void(const DexType*, const DexClass*)>
@@ -98,37 +121,98 @@ struct RedexContext {
     g_redex->m_next_release_gate = v;
   }
 
+  /*
+   * How the debug info of the dexes being loaded is read in:
+   *  - Decode: into DexDebugEntries, right away.
+   *  - Defer: kept encoded, and only decoded for the methods that get
+   *    ballooned. The others are written back out from the encoded bytes.
+   *  - Drop: not at all, as if every method had none.
+   */
+  enum class DebugInfoLoading { Decode, Defer, Drop };
+  static DebugInfoLoading debug_info_loading() {
+    return g_redex->m_debug_info_loading;
+  }
+  static void set_debug_info_loading(DebugInfoLoading v) {
+    g_redex->m_debug_info_loading = v;
+  }
+
  private:
-  struct carray_cmp {
-    bool operator()(const char* a, const char* b) const {
-      return (strcmp(a, b) < 0);
+  /*
+   * The interning tables below are sharded: each is a ConcurrentMap, whose
+   * slots are locked independently, so that threads interning different
+   * entities (e.g. while loading dexes in parallel) rarely contend.
+   */
+
+  // Storage for the interned entities that are never destroyed before the
+  // context itself: DexStrings, DexTypes, DexTypeLists and DexProtos.
+  Arena m_arena;
+
+  // DexString. Strings are keyed by their contents, with the hash computed
+  // once up front; the stored key points into the DexString itself.
+  struct StringKey {
+    const char* str;
+    size_t hash;
+
+    StringKey() : str(nullptr), hash(0) {}
+    explicit StringKey(const char* str);
+  };
+
+  struct StringKeyHash {
+    size_t operator()(const StringKey& key) const { return key.hash; }
+  };
+
+  struct StringKeyEqual {
+    bool operator()(const StringKey& a, const StringKey& b) const {
+      return a.hash == b.hash && strcmp(a.str, b.str) == 0;
     }
   };
 
-  // DexString
-  std::map<const char*, DexString*, carray_cmp> s_string_map;
-  std::mutex s_string_lock;
+  ConcurrentMap<StringKey, DexString*, 1031, StringKeyHash, StringKeyEqual>
+      s_string_map;
 
   // DexType
-  std::unordered_map<DexString*, DexType*> s_type_map;
-  std::mutex s_type_lock;
+  ConcurrentMap<DexString*, DexType*, 251> s_type_map;
 
   // DexFieldRef
-  std::unordered_map<DexFieldSpec, DexFieldRef*> s_field_map;
-  std::mutex s_field_lock;
+  ConcurrentMap<DexFieldSpec, DexFieldRef*, 251> s_field_map;
+
+  // DexTypeList. Lists are keyed by their types, with the hash computed once
+  // up front; the stored key points into the DexTypeList itself.
+  struct TypeListKey {
+    DexType* const* types;
+    uint32_t size;
+    size_t hash;
 
-  // DexTypeList
-  std::map<std::deque<DexType*>, DexTypeList*> s_typelist_map;
-  std::mutex s_typelist_lock;
+    TypeListKey() : types(nullptr), size(0), hash(0) {}
+    TypeListKey(DexType* const* types, uint32_t size);
+  };
+
+  struct TypeListKeyHash {
+    size_t operator()(const TypeListKey& key) const { return key.hash; }
+  };
+
+  struct TypeListKeyEqual {
+    bool operator()(const TypeListKey& a, const TypeListKey& b) const {
+      return a.hash == b.hash && a.size == b.size &&
+             std::equal(a.types, a.types + a.size, b.types);
+    }
+  };
+
+  ConcurrentMap<TypeListKey, DexTypeList*, 127, TypeListKeyHash,
+                TypeListKeyEqual>
+      s_typelist_map;
 
   // DexProto
-  std::unordered_map<DexType*, std::unordered_map<DexTypeList*, DexProto*>>
-      s_proto_map;
-  std::mutex s_proto_lock;
+  using ProtoKey = std::pair<DexType*, DexTypeList*>;
+  ConcurrentMap<ProtoKey, DexProto*, 127, boost::hash<ProtoKey>> s_proto_map;
 
   // DexMethod
-  std::unordered_map<DexMethodSpec, DexMethodRef*> s_method_map;
-  std::mutex s_method_lock;
+  ConcurrentMap<DexMethodSpec, DexMethodRef*, 251> s_method_map;
+
+  IdTable<DexString> m_string_ids;
+  IdTable<DexType> m_type_ids;
+  IdTable<DexFieldRef> m_field_ids;
+  IdTable<DexMethodRef> m_method_ids;
 
   // Type-to-class map and class hierarchy
   std::mutex m_type_system_mutex;
@@ -137,8 +221,29 @@ struct RedexContext {
   const std::vector<const DexType*> m_empty_types;
 
   bool m_next_release_gate{false};
+  DebugInfoLoading m_debug_info_loading{DebugInfoLoading::Decode};
 };
 
+template <>
+inline const IdTable<DexString>& RedexContext::ids<DexString>() const {
+  return m_string_ids;
+}
+
+template <>
+inline const IdTable<DexType>& RedexContext::ids<DexType>() const {
+  return m_type_ids;
+}
+
+template <>
+inline const IdTable<DexFieldRef>& RedexContext::ids<DexFieldRef>() const {
+  return m_field_ids;
+}
+
+template <>
+inline const IdTable<DexMethodRef>& RedexContext::ids<DexMethodRef>() const {
+  return m_method_ids;
+}
+
 class malformed_dex : public std::exception {
  public:
   malformed_dex(const std::string& class_name,
@@ -9,14 +9,40 @@
 
 #pragma once
 
+#include <functional>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "androidfw/ResourceTypes.h"
 
 std::string read_entire_file(const std::string& filename);
 void write_entire_file(const std::string& filename, const std::string& contents);
+
+/*
+ * Maps a file into memory for the lifetime of the object, instead of copying
+ * it into a buffer. A writable mapping is shared with the file, so changes
+ * made through data() end up in the file without writing it back. A file
+ * that can't be opened, or is empty, maps to an empty range.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename, bool writable = false);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  char* data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+ private:
+  int m_fd{-1};
+  char* m_data{nullptr};
+  size_t m_size{0};
+};
 void* map_file(
     const char* path,
     int& file_descriptor,
@@ -43,6 +69,43 @@ std::unordered_set<std::string> get_layout_classes(
     const std::string& apk_directory);
 std::unordered_set<std::string> get_xml_files(
     const std::string& directory);
+
+/*
+ * Memoizes the class names found in the manifest, the layouts and the native
+ * libraries of an unpacked APK, so that everything that needs them shares a
+ * single scan. Each result is tied to a fingerprint of the size and
+ * modification time of the files it was read from, and is rescanned when
+ * that changes. With a cache file, the results are also saved there and
+ * reused by later runs.
+ */
+class ResourceScanCache {
+ public:
+  explicit ResourceScanCache(const std::string& cache_file = "");
+
+  const std::unordered_set<std::string>& get_manifest_classes(
+      const std::string& apk_directory);
+  const std::unordered_set<std::string>& get_layout_classes(
+      const std::string& apk_directory);
+  const std::unordered_set<std::string>& get_native_classes(
+      const std::string& apk_directory);
+
+ private:
+  struct Entry {
+    std::string fingerprint;
+    std::unordered_set<std::string> classes;
+  };
+
+  const std::unordered_set<std::string>& get(
+      const std::string& key,
+      const std::vector<std::string>& files,
+      const std::function<std::unordered_set<std::string>()>& scan);
+  void load();
+  void save() const;
+
+  std::string m_cache_file;
+  bool m_loaded{false};
+  std::map<std::string, Entry> m_entries;
+};
 std::unordered_set<uint32_t> get_xml_reference_attributes(
     const std::string& filename);
 int inline_xml_reference_attributes(
@@ -52,6 +115,24 @@ void remap_xml_reference_attributes(
     const std::string& filename,
     const std::map<uint32_t, uint32_t>& kept_to_remapped_ids);
 
+/*
+ * Runs `process` on each of the files, in parallel. The files are
+ * independent, so one of them failing doesn't stop the others: whatever they
+ * throw is collected and rethrown as one aggregate_exception after all the
+ * files have been processed.
+ */
+void process_files_in_parallel(
+    const std::vector<std::string>& files,
+    const std::function<void(const std::string&)>& process);
+
+// The same as the single file versions above, over many files in parallel.
+int inline_xml_reference_attributes(
+    const std::vector<std::string>& files,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value);
+void remap_xml_reference_attributes(
+    const std::vector<std::string>& files,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids);
+
 // Given the bytes of a binary XML file, replace the entries (if any) in the
 // ResStringPool. Writes result to the given Vector output param.
 // Returns android::NO_ERROR (0) on success, or one of the corresponding
@@ -85,8 +166,43 @@ void walk_references_for_resource(
 
 std::unordered_set<uint32_t> get_js_resources_by_parsing(
    const std::string& directory,
-   std::map<std::string, std::vector<uint32_t>> name_to_ids);
+   const std::map<std::string, std::vector<uint32_t>>& name_to_ids);
 
 std::unordered_set<uint32_t> get_resources_by_name_prefix(
-   std::vector<std::string> prefixes,
-   std::map<std::string, std::vector<uint32_t>> name_to_ids);
+   const std::vector<std::string>& prefixes,
+   const std::map<std::string, std::vector<uint32_t>>& name_to_ids);
+
+/*
+ * The ids and names of the entries of a parsed resources.arsc, gathered in
+ * one pass over the table. ResTable resolves names by walking its type and
+ * entry chunks on every call, which passes that look up every resource end
+ * up paying for once per lookup.
+ */
+class ResourceTableIndex {
+ public:
+  explicit ResourceTableIndex(const android::ResTable& table);
+
+  // Every resource id in the table, in ascending order.
+  const std::vector<uint32_t>& ids() const { return m_ids; }
+
+  // The entry name of the resource, or nullptr if the table doesn't have it.
+  const std::string* get_name(uint32_t id) const;
+
+  // The resources with the given entry name; a name can be used by one
+  // resource of each type.
+  const std::vector<uint32_t>& get_ids(const std::string& name) const;
+
+  // The resources whose entry name starts with any of the prefixes.
+  std::unordered_set<uint32_t> get_ids_by_name_prefix(
+      const std::vector<std::string>& prefixes) const;
+
+  // Names sort in a map, so looking up a prefix is a range scan.
+  const std::map<std::string, std::vector<uint32_t>>& name_to_ids() const {
+    return m_name_to_ids;
+  }
+
+ private:
+  std::vector<uint32_t> m_ids;
+  std::unordered_map<uint32_t, std::string> m_id_to_name;
+  std::map<std::string, std::vector<uint32_t>> m_name_to_ids;
+};
@@ -10,69 +10,72 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <string>
 
 class ReferencedState {
  private:
-  bool m_bytype{false};
-  bool m_bystring{false};
-  // m_computed is a "clear-only" flag; If one of the reflects is non-computed,
-  // all subsequents should be non-computed. Reflect marking which is computed
-  // from code means that it can/should be recomputed periodically when doing
-  // optimizations. For instance, deleting a method with a reflection target
-  // will then allow that reflection target to be re-evaluated.
-  bool m_computed{true};
-
-  // ProGuard keep settings
-  //
-  // Specify classes and class members that are entry-points.
-  bool m_keep{false};
-  // assumenosideeffects allows certain methods to be removed.
-  bool m_assumenosideeffects{false};
-  // Does this class have a blanket "-keepnames class *" applied to it?
-  // "-keepnames" is synonym with "-keep,allowshrinking".
-  bool m_blanket_keepnames{false};
-  // If m_whyareyoukeeping is true then report debugging information
-  // about why this class or member is being kept.
-  bool m_whyareyoukeeping{false};
-
-  // For keep modifiers: -keep,allowshrinking and -keep,allowobfuscation.
-  //
-  // Instead of m_allowshrinking and m_allowobfuscation, we need to have
-  // set/unset pairs for easier parallelization. The unset has a high priority.
-  // See the comments in apply_keep_modifiers.
-  bool m_set_allowshrinking{false};
-  bool m_unset_allowshrinking{false};
-  bool m_set_allowobfuscation{false};
-  bool m_unset_allowobfuscation{false};
-
-  bool m_keep_name{false};
+  // All the flags are packed into one word that is updated atomically, so
+  // that they can be set concurrently, e.g. by the parallel ProGuard rule
+  // matching or by the parallel walks of init_reachable_classes().
+  enum Flag : uint16_t {
+    BY_TYPE = 1 << 0,
+    BY_STRING = 1 << 1,
+    // NOT_COMPUTED is a "set-only" flag; If one of the reflects is
+    // non-computed, all subsequents should be non-computed. Reflect marking
+    // which is computed from code means that it can/should be recomputed
+    // periodically when doing optimizations. For instance, deleting a method
+    // with a reflection target will then allow that reflection target to be
+    // re-evaluated.
+    NOT_COMPUTED = 1 << 2,
+
+    // ProGuard keep settings
+    //
+    // Specify classes and class members that are entry-points.
+    KEEP = 1 << 3,
+    // assumenosideeffects allows certain methods to be removed.
+    ASSUMENOSIDEEFFECTS = 1 << 4,
+    // Does this class have a blanket "-keepnames class *" applied to it?
+    // "-keepnames" is synonym with "-keep,allowshrinking".
+    BLANKET_KEEPNAMES = 1 << 5,
+    // If WHYAREYOUKEEPING is set then report debugging information
+    // about why this class or member is being kept.
+    WHYAREYOUKEEPING = 1 << 6,
+
+    // For keep modifiers: -keep,allowshrinking and -keep,allowobfuscation.
+    //
+    // Instead of allowshrinking and allowobfuscation flags, we need to have
+    // set/unset pairs for easier parallelization. The unset has a high
+    // priority. See the comments in apply_keep_modifiers.
+    SET_ALLOWSHRINKING = 1 << 7,
+    UNSET_ALLOWSHRINKING = 1 << 8,
+    SET_ALLOWOBFUSCATION = 1 << 9,
+    UNSET_ALLOWOBFUSCATION = 1 << 10,
+
+    KEEP_NAME = 1 << 11,
+  };
+
+  // The flags that the ProGuard keep rules set.
+  static constexpr uint16_t PROGUARD_FLAGS =
+      KEEP | ASSUMENOSIDEEFFECTS | BLANKET_KEEPNAMES | WHYAREYOUKEEPING |
+      SET_ALLOWSHRINKING | UNSET_ALLOWSHRINKING | SET_ALLOWOBFUSCATION |
+      UNSET_ALLOWOBFUSCATION;
+
+  std::atomic<uint16_t> m_flags{0};
 
   // The number of keep rules that touch this class.
   std::atomic<unsigned int> m_keep_count{0};
 
+  bool is_set(uint16_t flags) const { return (m_flags.load() & flags) != 0; }
+  void set(uint16_t flags) { m_flags.fetch_or(flags); }
+
  public:
   ReferencedState() = default;
 
   // std::atomic requires an explicitly user-defined assignment operator.
   ReferencedState& operator=(const ReferencedState& other) {
     if (this != &other) {
-      this->m_bytype = other.m_bytype;
-      this->m_bystring = other.m_bystring;
-      this->m_computed = other.m_computed;
-      
-      this->m_keep = other.m_keep;
-      this->m_assumenosideeffects = other.m_assumenosideeffects;
-      this->m_blanket_keepnames = other.m_blanket_keepnames;
-      this->m_whyareyoukeeping = other.m_whyareyoukeeping;
-      
-      this->m_set_allowshrinking = other.m_set_allowshrinking;
-      this->m_unset_allowshrinking = other.m_unset_allowshrinking;
-      this->m_set_allowobfuscation = other.m_set_allowobfuscation;
-      this->m_unset_allowobfuscation = other.m_unset_allowobfuscation;
-      
-      this->m_keep_name = other.m_keep_name;
-      
+      this->m_flags = other.m_flags.load();
       this->m_keep_count = other.m_keep_count.load();
     }
     return *this;
@@ -80,29 +83,34 @@ class ReferencedState {
 
   std::string str() const;
 
-  bool can_delete() const { return !m_bytype && (!m_keep || allowshrinking()); }
+  bool can_delete() const {
+    return !is_set(BY_TYPE) && (!is_set(KEEP) || allowshrinking());
+  }
   bool can_rename() const {
-    return !m_keep_name && !m_bystring && (!m_keep || allowobfuscation()) &&
-           !allowshrinking();
+    return !is_set(KEEP_NAME | BY_STRING) &&
+           (!is_set(KEEP) || allowobfuscation()) && !allowshrinking();
   }
 
   // ProGuard keep options
-  bool keep() const { return m_keep; }
+  bool keep() const { return is_set(KEEP); }
 
   // ProGaurd keep option modifiers
   bool allowshrinking() const {
-    return !m_unset_allowshrinking && m_set_allowshrinking;
+    return (m_flags.load() & (SET_ALLOWSHRINKING | UNSET_ALLOWSHRINKING)) ==
+           SET_ALLOWSHRINKING;
   }
   bool allowobfuscation() const {
-    return !m_unset_allowobfuscation && m_set_allowobfuscation;
+    return (m_flags.load() &
+            (SET_ALLOWOBFUSCATION | UNSET_ALLOWOBFUSCATION)) ==
+           SET_ALLOWOBFUSCATION;
   }
-  bool assumenosideeffects() const { return m_assumenosideeffects; }
+  bool assumenosideeffects() const { return is_set(ASSUMENOSIDEEFFECTS); }
 
   bool is_blanket_names_kept() const {
-    return m_blanket_keepnames && m_keep_count == 1;
+    return is_set(BLANKET_KEEPNAMES) && m_keep_count == 1;
   }
 
-  bool report_whyareyoukeeping() const { return m_whyareyoukeeping; }
+  bool report_whyareyoukeeping() const { return is_set(WHYAREYOUKEEPING); }
 
   // For example, a classname in a layout, e.g. <com.facebook.MyCustomView />
   // is a ref_by_string with from_code = false
@@ -110,38 +118,50 @@ class ReferencedState {
   // Class c = Class.forName("com.facebook.FooBar");
   // is a ref_by_string with from_code = true
   void ref_by_string(bool from_code) {
-    m_bytype = m_bystring = true;
-    m_computed = m_computed && from_code;
+    set(BY_TYPE | BY_STRING | (from_code ? 0 : NOT_COMPUTED));
   }
-  bool is_referenced_by_string() const { return m_bystring; }
+  bool is_referenced_by_string() const { return is_set(BY_STRING); }
 
   // A direct reference from code (not reflection)
-  void ref_by_type() { m_bytype = true; }
-  bool is_referenced_by_type() const { return m_bytype; }
+  void ref_by_type() { set(BY_TYPE); }
+  bool is_referenced_by_type() const { return is_set(BY_TYPE); }
 
   // Called before recompute
   void clear_if_compute() {
-    if (m_computed) {
-      m_bytype = m_bystring = false;
+    uint16_t flags = m_flags.load();
+    while (!(flags & NOT_COMPUTED) &&
+           !m_flags.compare_exchange_weak(flags,
+                                          flags & ~(BY_TYPE | BY_STRING))) {
     }
   }
 
   // ProGuard keep information.
-  void set_keep() { m_keep = true; }
+  void set_keep() { set(KEEP); }
 
-  void set_keep_name() { m_keep_name = true; }
+  void set_keep_name() { set(KEEP_NAME); }
 
-  void set_allowshrinking() { m_set_allowshrinking = true; }
-  void unset_allowshrinking() { m_unset_allowshrinking = true; }
+  void set_allowshrinking() { set(SET_ALLOWSHRINKING); }
+  void unset_allowshrinking() { set(UNSET_ALLOWSHRINKING); }
 
-  void set_allowobfuscation() { m_set_allowobfuscation = true; }
-  void unset_allowobfuscation() { m_unset_allowobfuscation = true; }
+  void set_allowobfuscation() { set(SET_ALLOWOBFUSCATION); }
+  void unset_allowobfuscation() { set(UNSET_ALLOWOBFUSCATION); }
 
-  void set_assumenosideeffects() { m_assumenosideeffects = true; }
+  void set_assumenosideeffects() { set(ASSUMENOSIDEEFFECTS); }
 
-  void set_blanket_keepnames() { m_blanket_keepnames = true; }
+  void set_blanket_keepnames() { set(BLANKET_KEEPNAMES); }
 
   void increment_keep_count() { m_keep_count++; }
 
-  void set_whyareyoukeeping() { m_whyareyoukeeping = true; }
+  void set_whyareyoukeeping() { set(WHYAREYOUKEEPING); }
+
+  // The state set by the ProGuard keep rules, packed into one word so that
+  // the outcome of matching the rules can be cached across runs.
+  uint64_t proguard_state() const {
+    return (uint64_t(m_keep_count.load()) << 16) |
+           (m_flags.load() & PROGUARD_FLAGS);
+  }
+  void restore_proguard_state(uint64_t state) {
+    set(state & PROGUARD_FLAGS);
+    m_keep_count = state >> 16;
+  }
 };
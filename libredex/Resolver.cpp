@@ -8,8 +8,11 @@
  */
 
 #include "Resolver.h"
+#include "ConcurrentContainers.h"
 #include "DexUtil.h"
 
+#include <atomic>
+
 namespace {
 
 inline bool match(const DexString* name,
@@ -160,3 +163,85 @@ DexMethod* find_top_intf_impl(
   }
   return top_impl;
 }
+
+namespace {
+
+std::atomic<size_t> s_resolution_epoch{1};
+
+/*
+ * A resolved definition, tagged with the epoch in which it was computed.
+ * Default-constructed entries belong to no epoch.
+ */
+template <typename Def>
+struct CachedResolution {
+  Def* def{nullptr};
+  size_t epoch{0};
+};
+
+template <typename Ref, typename Search>
+struct ResolutionKeyHash {
+  size_t operator()(const std::pair<Ref*, Search>& key) const {
+    return reinterpret_cast<uintptr_t>(key.first) * 7 +
+           static_cast<size_t>(key.second);
+  }
+};
+
+template <typename Ref, typename Def, typename Search, typename Resolve>
+Def* resolve_cached(
+    ReadMostlyConcurrentMap<std::pair<Ref*, Search>,
+                            CachedResolution<Def>,
+                            31,
+                            ResolutionKeyHash<Ref, Search>>& cache,
+    Ref* ref,
+    Search search,
+    const Resolve& resolve) {
+  auto epoch = s_resolution_epoch.load();
+  auto key = std::make_pair(ref, search);
+  auto cached = cache.get(key, CachedResolution<Def>());
+  if (cached.epoch == epoch) {
+    return cached.def;
+  }
+  Def* def = resolve(ref, search);
+  cache.update(key,
+               [&](const std::pair<Ref*, Search>&,
+                   CachedResolution<Def>& entry,
+                   bool) {
+                 entry.def = def;
+                 entry.epoch = epoch;
+               });
+  return def;
+}
+
+}
+
+DexMethod* resolve_method_cached(DexMethodRef* method, MethodSearch search) {
+  if (method->is_def()) return static_cast<DexMethod*>(method);
+  // Intentionally leaked, so that the cache can be used during static
+  // destruction.
+  static auto* s_cache =
+      new ReadMostlyConcurrentMap<std::pair<DexMethodRef*, MethodSearch>,
+                                  CachedResolution<DexMethod>,
+                                  31,
+                                  ResolutionKeyHash<DexMethodRef, MethodSearch>>();
+  return resolve_cached<DexMethodRef, DexMethod>(
+      *s_cache, method, search, [](DexMethodRef* ref, MethodSearch search) {
+        return resolve_method(ref, search);
+      });
+}
+
+DexField* resolve_field_cached(DexFieldRef* field, FieldSearch search) {
+  if (field->is_def()) return static_cast<DexField*>(field);
+  static auto* s_cache =
+      new ReadMostlyConcurrentMap<std::pair<DexFieldRef*, FieldSearch>,
+                                  CachedResolution<DexField>,
+                                  31,
+                                  ResolutionKeyHash<DexFieldRef, FieldSearch>>();
+  return resolve_cached<DexFieldRef, DexField>(
+      *s_cache, field, search, [](DexFieldRef* ref, FieldSearch search) {
+        return resolve_field(ref, search);
+      });
+}
+
+void invalidate_resolution_caches() { ++s_resolution_epoch; }
+
+size_t resolution_epoch() { return s_resolution_epoch.load(); }
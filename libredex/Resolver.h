@@ -16,7 +16,6 @@
 #include <unordered_map>
 #include <unordered_set>
 
-
 using MethodRefCache = std::unordered_map<DexMethodRef*, DexMethod*>;
 using MethodSet = std::unordered_set<DexMethod*>;
 
@@ -202,3 +201,33 @@ inline DexField* resolve_field(
   return resolve_field(
       field->get_class(), field->get_name(), field->get_type(), search);
 }
+
+/**
+ * Resolve a method through a process-wide cache shared by all threads.
+ * The cache is keyed by the reference and the search rule, and it remembers
+ * failed resolutions as well.
+ * Entries are only valid for the current resolution epoch, which is advanced
+ * by invalidate_resolution_caches() whenever the class hierarchy or the
+ * members of classes may have changed. The PassManager does it before every
+ * pass; a pass that mutates the hierarchy while resolving through the cache
+ * has to do it itself.
+ */
+DexMethod* resolve_method_cached(DexMethodRef* method, MethodSearch search);
+
+/**
+ * Resolve a field through the process-wide cache shared by all threads.
+ * See resolve_method_cached() for how the cache is invalidated.
+ */
+DexField* resolve_field_cached(
+    DexFieldRef* field, FieldSearch search = FieldSearch::Any);
+
+/**
+ * Invalidate all the entries of the shared resolution caches.
+ * This is cheap: stale entries are recomputed lazily on their next lookup.
+ */
+void invalidate_resolution_caches();
+
+/**
+ * The current resolution epoch.
+ */
+size_t resolution_epoch();
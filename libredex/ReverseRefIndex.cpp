@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ReverseRefIndex.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "IRCode.h"
+#include "Walkers.h"
+
+namespace {
+
+using MethodInsns = std::pair<DexMethod*, std::vector<IRInstruction*>>;
+
+// The instructions of the code that have a method, field or type operand
+std::vector<IRInstruction*> ref_insns(IRCode& code) {
+  std::vector<IRInstruction*> insns;
+  for (const MethodItemEntry& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    if (insn->has_method() || insn->has_field() || insn->has_type()) {
+      insns.push_back(insn);
+    }
+  }
+  return insns;
+}
+
+template <typename Ref>
+void erase_occurrences(std::vector<Ref>& keys,
+                       const DexMethod* method,
+                       ReverseRefIndex::RefMap<Ref>* refs) {
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  for (auto key : keys) {
+    auto it = refs->find(key);
+    if (it == refs->end()) {
+      continue;
+    }
+    auto& occurrences = it->second;
+    occurrences.erase(
+        std::remove_if(occurrences.begin(),
+                       occurrences.end(),
+                       [method](const ReverseRefIndex::Occurrence& occ) {
+                         return occ.method == method;
+                       }),
+        occurrences.end());
+    if (occurrences.empty()) {
+      refs->erase(it);
+    }
+  }
+}
+
+const ReverseRefIndex::Occurrences s_no_occurrences;
+
+template <typename Ref>
+const ReverseRefIndex::Occurrences& find_occurrences(
+    const ReverseRefIndex::RefMap<Ref>& refs, const Ref& key) {
+  auto it = refs.find(key);
+  return it == refs.end() ? s_no_occurrences : it->second;
+}
+
+} // namespace
+
+ReverseRefIndex::ReverseRefIndex(const Scope& scope) {
+  using Scan = std::vector<MethodInsns>;
+  auto scan = walk::parallel::reduce_code<Scan>(
+      scope,
+      [](DexMethod*) { return true; },
+      [](Scan& acc, DexMethod* method, IRCode& code) {
+        auto insns = ref_insns(code);
+        if (!insns.empty()) {
+          acc.emplace_back(method, std::move(insns));
+        }
+      },
+      [](Scan a, Scan b) {
+        a.insert(a.end(),
+                 std::make_move_iterator(b.begin()),
+                 std::make_move_iterator(b.end()));
+        return a;
+      });
+  // Filling the maps in walk order keeps the occurrence lists deterministic.
+  for (const auto& method_insns : scan) {
+    add(method_insns.first, method_insns.second);
+  }
+}
+
+void ReverseRefIndex::add(DexMethod* method,
+                          const std::vector<IRInstruction*>& insns) {
+  auto& keys = m_keys[method];
+  for (auto insn : insns) {
+    Occurrence occ{method, insn};
+    if (insn->has_method()) {
+      m_method_refs[insn->get_method()].push_back(occ);
+      keys.methods.push_back(insn->get_method());
+    } else if (insn->has_field()) {
+      m_field_refs[insn->get_field()].push_back(occ);
+      keys.fields.push_back(insn->get_field());
+    } else {
+      m_type_refs[insn->get_type()].push_back(occ);
+      keys.types.push_back(insn->get_type());
+    }
+  }
+}
+
+const ReverseRefIndex::Occurrences& ReverseRefIndex::method_refs(
+    const DexMethodRef* ref) const {
+  return find_occurrences(m_method_refs, const_cast<DexMethodRef*>(ref));
+}
+
+const ReverseRefIndex::Occurrences& ReverseRefIndex::field_refs(
+    const DexFieldRef* ref) const {
+  return find_occurrences(m_field_refs, const_cast<DexFieldRef*>(ref));
+}
+
+const ReverseRefIndex::Occurrences& ReverseRefIndex::type_refs(
+    const DexType* type) const {
+  return find_occurrences(m_type_refs, const_cast<DexType*>(type));
+}
+
+void ReverseRefIndex::remove(DexMethod* method) {
+  auto it = m_keys.find(method);
+  if (it == m_keys.end()) {
+    return;
+  }
+  auto& keys = it->second;
+  erase_occurrences(keys.methods, method, &m_method_refs);
+  erase_occurrences(keys.fields, method, &m_field_refs);
+  erase_occurrences(keys.types, method, &m_type_refs);
+  m_keys.erase(it);
+}
+
+void ReverseRefIndex::update(DexMethod* method) {
+  remove(method);
+  auto code = method->get_code();
+  if (code == nullptr) {
+    return;
+  }
+  auto insns = ref_insns(*code);
+  if (!insns.empty()) {
+    add(method, insns);
+  }
+}
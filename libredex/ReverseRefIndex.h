@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRInstruction.h"
+
+/*
+ * An index of the instructions that reference each method, field and type,
+ * built with a single parallel walk over the code. It answers "which
+ * instructions refer to X" with a lookup instead of a scan of the whole
+ * program. The AnalysisManager caches it as ReverseRefsAnalysis.
+ *
+ * The keys are the references held by the instructions, as they appear in the
+ * code: a lookup of a method definition doesn't return the invokes that name
+ * it through a ref of another class, even if they resolve to it.
+ *
+ * Passes that edit the code of a method and want to keep the index current
+ * call update() on that method when they're done with it, and remove() before
+ * deleting a method.
+ */
+class ReverseRefIndex final {
+ public:
+  struct Occurrence {
+    DexMethod* method;
+    IRInstruction* insn;
+  };
+  using Occurrences = std::vector<Occurrence>;
+
+  template <typename Ref>
+  using RefMap = std::unordered_map<Ref, Occurrences>;
+
+  explicit ReverseRefIndex(const Scope& scope);
+
+  /*
+   * The instructions that reference the given method, field or type, grouped
+   * by method in the order walk::code visits them.
+   */
+  const Occurrences& method_refs(const DexMethodRef* ref) const;
+  const Occurrences& field_refs(const DexFieldRef* ref) const;
+  const Occurrences& type_refs(const DexType* type) const;
+
+  /*
+   * All the references of the code, in no particular order.
+   */
+  const RefMap<DexMethodRef*>& all_method_refs() const {
+    return m_method_refs;
+  }
+  const RefMap<DexFieldRef*>& all_field_refs() const { return m_field_refs; }
+  const RefMap<DexType*>& all_type_refs() const { return m_type_refs; }
+
+  /*
+   * Replace the occurrences of the method with the references its code has
+   * now. Its occurrences are moved to the end of the lists.
+   */
+  void update(DexMethod* method);
+
+  /*
+   * Drop the occurrences of the method.
+   */
+  void remove(DexMethod* method);
+
+ private:
+  // The references of the code of a method, as last indexed
+  struct MethodKeys {
+    std::vector<DexMethodRef*> methods;
+    std::vector<DexFieldRef*> fields;
+    std::vector<DexType*> types;
+  };
+
+  void add(DexMethod* method, const std::vector<IRInstruction*>& insns);
+
+  RefMap<DexMethodRef*> m_method_refs;
+  RefMap<DexFieldRef*> m_field_refs;
+  RefMap<DexType*> m_type_refs;
+  std::unordered_map<DexMethod*, MethodKeys> m_keys;
+};
@@ -0,0 +1,293 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "SSA.h"
+
+#include <algorithm>
+
+namespace ssa {
+
+namespace {
+
+// The last instruction of `block` if the block has throw edges. That
+// instruction is the one that may throw, so its handlers don't see what it
+// writes.
+IRInstruction* throwing_terminator(Block* block) {
+  bool has_throw_edge = false;
+  for (const auto& e : block->succs()) {
+    has_throw_edge |= e->type() == EDGE_THROW;
+  }
+  if (!has_throw_edge) {
+    return nullptr;
+  }
+  for (auto it = block->rbegin(); it != block->rend(); ++it) {
+    if (it->type == MFLOW_OPCODE) {
+      return it->insn;
+    }
+  }
+  return nullptr;
+}
+
+// The number of registers covered by an operand.
+size_t width(bool is_wide) { return is_wide ? 2 : 1; }
+
+} // namespace
+
+SSAForm::SSAForm(const ControlFlowGraph& cfg) {
+  const auto& dom = cfg.dominators();
+  auto blocks = cfg.blocks();
+  m_phis.resize(blocks.size());
+  std::vector<IRInstruction*> terminators(blocks.size(), nullptr);
+  for (Block* block : blocks) {
+    if (!dom.is_reachable(block)) {
+      continue;
+    }
+    terminators[block->id()] = throwing_terminator(block);
+    for (auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      m_insn_offsets.emplace(insn, m_insn_values.size());
+      m_insn_values.resize(m_insn_values.size() + 1 + insn->srcs_size(),
+                           NO_VALUE);
+      if (insn->dests_size()) {
+        m_num_regs = std::max(m_num_regs,
+                              insn->dest() + width(insn->dest_is_wide()));
+      }
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        m_num_regs =
+            std::max(m_num_regs, insn->src(i) + width(insn->src_is_wide(i)));
+      }
+    }
+  }
+  place_phis(blocks, dom, terminators);
+  rename(dom, terminators);
+}
+
+ValueId SSAForm::new_value(Def::Kind kind,
+                           uint16_t reg,
+                           Block* block,
+                           IRInstruction* insn) {
+  m_defs.push_back(Def{kind, reg, block, insn, {}});
+  m_uses.emplace_back();
+  return m_defs.size() - 1;
+}
+
+void SSAForm::place_phis(const std::vector<Block*>& blocks,
+                         const cfg::DominatorTree& dom,
+                         const std::vector<IRInstruction*>& terminators) {
+  // For each register, the blocks that define it, the blocks that define it
+  // before their end, and the blocks that read it before defining it.
+  std::vector<std::vector<Block*>> def_blocks(m_num_regs);
+  std::vector<std::vector<Block*>> kill_blocks(m_num_regs);
+  std::vector<std::vector<Block*>> use_blocks(m_num_regs);
+  {
+    // The last block in which each register was seen, to avoid duplicates.
+    const size_t NONE = std::numeric_limits<size_t>::max();
+    std::vector<size_t> defined_in(m_num_regs, NONE);
+    std::vector<size_t> killed_in(m_num_regs, NONE);
+    std::vector<size_t> used_in(m_num_regs, NONE);
+    for (Block* block : blocks) {
+      if (!dom.is_reachable(block)) {
+        continue;
+      }
+      auto id = block->id();
+      for (auto& mie : InstructionIterable(block)) {
+        auto insn = mie.insn;
+        for (size_t i = 0; i < insn->srcs_size(); ++i) {
+          for (size_t k = 0; k < width(insn->src_is_wide(i)); ++k) {
+            auto reg = insn->src(i) + k;
+            if (killed_in[reg] != id && used_in[reg] != id) {
+              used_in[reg] = id;
+              use_blocks[reg].push_back(block);
+            }
+          }
+        }
+        if (!insn->dests_size()) {
+          continue;
+        }
+        for (size_t k = 0; k < width(insn->dest_is_wide()); ++k) {
+          auto reg = insn->dest() + k;
+          if (defined_in[reg] != id) {
+            defined_in[reg] = id;
+            def_blocks[reg].push_back(block);
+          }
+          if (insn != terminators[id] && killed_in[reg] != id) {
+            killed_in[reg] = id;
+            kill_blocks[reg].push_back(block);
+          }
+        }
+      }
+    }
+  }
+
+  // Each register gets its own stamp in these, so they never need clearing.
+  std::vector<size_t> killed(blocks.size(), 0);
+  std::vector<size_t> live_in(blocks.size(), 0);
+  std::vector<size_t> in_frontier(blocks.size(), 0);
+  std::vector<size_t> queued(blocks.size(), 0);
+  std::vector<Block*> worklist;
+  for (size_t reg = 0; reg < m_num_regs; ++reg) {
+    auto stamp = reg + 1;
+    for (Block* block : kill_blocks[reg]) {
+      killed[block->id()] = stamp;
+    }
+    // Find the blocks where the register is live on entry, going backwards
+    // from its uses until its definitions.
+    worklist = use_blocks[reg];
+    for (Block* block : worklist) {
+      live_in[block->id()] = stamp;
+    }
+    while (!worklist.empty()) {
+      Block* block = worklist.back();
+      worklist.pop_back();
+      for (const auto& e : block->preds()) {
+        auto pred = e->src();
+        auto id = pred->id();
+        if (!dom.is_reachable(pred) || live_in[id] == stamp ||
+            killed[id] == stamp) {
+          continue;
+        }
+        live_in[id] = stamp;
+        worklist.push_back(pred);
+      }
+    }
+
+    // Place phis at the iterated dominance frontier of the definitions,
+    // wherever the register is live.
+    worklist = def_blocks[reg];
+    for (Block* block : worklist) {
+      queued[block->id()] = stamp;
+    }
+    while (!worklist.empty()) {
+      Block* block = worklist.back();
+      worklist.pop_back();
+      for (Block* frontier : dom.frontier(block)) {
+        auto id = frontier->id();
+        if (in_frontier[id] == stamp) {
+          continue;
+        }
+        in_frontier[id] = stamp;
+        if (live_in[id] == stamp) {
+          auto phi = new_value(Def::Kind::Phi, reg, frontier, nullptr);
+          m_defs[phi].phi_operands.assign(frontier->preds().size(), NO_VALUE);
+          m_phis[id].push_back(phi);
+        }
+        if (queued[id] != stamp) {
+          queued[id] = stamp;
+          worklist.push_back(frontier);
+        }
+      }
+    }
+  }
+}
+
+void SSAForm::rename(const cfg::DominatorTree& dom,
+                     const std::vector<IRInstruction*>& terminators) {
+  // The values of each register along the current path of the dominator tree,
+  // innermost last, and a log of the pushes to undo when leaving a block.
+  std::vector<std::vector<ValueId>> stacks(m_num_regs);
+  std::vector<uint16_t> pushed;
+  std::vector<ValueId> entry_values(m_num_regs, NO_VALUE);
+
+  auto current = [&](uint16_t reg) {
+    if (!stacks[reg].empty()) {
+      return stacks[reg].back();
+    }
+    if (entry_values[reg] == NO_VALUE) {
+      entry_values[reg] =
+          new_value(Def::Kind::Entry, reg, dom.root(), nullptr);
+    }
+    return entry_values[reg];
+  };
+  auto define = [&](uint16_t reg, ValueId value) {
+    stacks[reg].push_back(value);
+    pushed.push_back(reg);
+  };
+
+  struct Frame {
+    Block* block;
+    size_t next_child;
+    size_t pushed_mark;
+  };
+  std::vector<Frame> frames;
+
+  auto enter = [&](Block* block) {
+    frames.push_back(Frame{block, 0, pushed.size()});
+    for (auto phi : m_phis[block->id()]) {
+      define(m_defs[phi].reg, phi);
+    }
+
+    // What the handlers see of the registers the terminator writes.
+    auto terminator = terminators[block->id()];
+    uint16_t saved_regs[2];
+    ValueId saved_values[2];
+    size_t num_saved = 0;
+
+    for (auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      auto offset = m_insn_offsets.at(insn);
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        auto value = current(insn->src(i));
+        m_insn_values[offset + 1 + i] = value;
+        m_uses[value].push_back(Use{insn, NO_VALUE, uint32_t(i)});
+      }
+      if (!insn->dests_size()) {
+        continue;
+      }
+      auto value = new_value(Def::Kind::Instruction, insn->dest(), block, insn);
+      m_insn_values[offset] = value;
+      for (size_t k = 0; k < width(insn->dest_is_wide()); ++k) {
+        uint16_t reg = insn->dest() + k;
+        if (insn == terminator) {
+          saved_regs[num_saved] = reg;
+          saved_values[num_saved++] = current(reg);
+        }
+        define(reg, value);
+      }
+    }
+
+    for (const auto& e : block->succs()) {
+      auto succ = e->target();
+      const auto& preds = succ->preds();
+      uint32_t index = std::find(preds.begin(), preds.end(), e) - preds.begin();
+      for (auto phi : m_phis[succ->id()]) {
+        auto reg = m_defs[phi].reg;
+        auto value = NO_VALUE;
+        if (e->type() == EDGE_THROW) {
+          for (size_t k = 0; k < num_saved; ++k) {
+            if (saved_regs[k] == reg) {
+              value = saved_values[k];
+            }
+          }
+        }
+        if (value == NO_VALUE) {
+          value = current(reg);
+        }
+        m_defs[phi].phi_operands[index] = value;
+        m_uses[value].push_back(Use{nullptr, phi, index});
+      }
+    }
+  };
+
+  enter(dom.root());
+  while (!frames.empty()) {
+    auto& frame = frames.back();
+    const auto& children = dom.children(frame.block);
+    if (frame.next_child < children.size()) {
+      enter(children[frame.next_child++]);
+      continue;
+    }
+    while (pushed.size() > frame.pushed_mark) {
+      stacks[pushed.back()].pop_back();
+      pushed.pop_back();
+    }
+    frames.pop_back();
+  }
+}
+
+} // namespace ssa
@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "ControlFlow.h"
+
+/*
+ * A read-only static single assignment view of the registers of a CFG.
+ *
+ * The code itself is left untouched. Instead, every definition of a register
+ * gets a value id, and every register operand of an instruction is mapped to
+ * the value it reads. Where several definitions of a register meet, the view
+ * has a phi, which is itself a value. Each value knows its uses, so analyses
+ * can follow def-use chains and only revisit the instructions that read a
+ * value that changed, instead of carrying an environment of all the registers
+ * through every instruction.
+ *
+ * The form is pruned: phis are only placed where the register is live. They
+ * are placed at the iterated dominance frontiers of the definitions, and the
+ * registers are renamed by a walk of the dominator tree (Cytron et al.,
+ * Efficiently Computing Static Single Assignment Form and the Control
+ * Dependence Graph).
+ *
+ * Some conventions:
+ *  - A wide definition of vN defines both vN and vN+1 with the same value. A
+ *    wide operand vN reads the value of vN.
+ *  - A register that is read before any definition reaches it has an Entry
+ *    value, defined at the entry block.
+ *  - When the last instruction of a block may throw, the values that flow
+ *    along the block's throw edges are the ones from before that instruction.
+ *  - Unreachable blocks are ignored. The phi operands for edges coming from
+ *    them are NO_VALUE.
+ *
+ * Like the dominator tree it is built with, the view must not be used after
+ * the CFG or its instructions change.
+ */
+namespace ssa {
+
+using ValueId = uint32_t;
+constexpr ValueId NO_VALUE = std::numeric_limits<ValueId>::max();
+
+struct Def {
+  enum class Kind { Entry, Instruction, Phi };
+
+  Kind kind;
+  uint16_t reg;
+  Block* block;
+  // The defining instruction, for Instruction values.
+  IRInstruction* insn;
+  // For phis: one operand per predecessor edge of the block, in the order of
+  // `block->preds()`.
+  std::vector<ValueId> phi_operands;
+};
+
+struct Use {
+  // The instruction that reads the value, or nullptr if it's a phi.
+  IRInstruction* insn;
+  // The phi that reads the value, if `insn` is nullptr.
+  ValueId phi;
+  // The index of the source operand, or of the phi operand.
+  uint32_t index;
+};
+
+class SSAForm final {
+ public:
+  explicit SSAForm(const ControlFlowGraph& cfg);
+
+  SSAForm(const SSAForm&) = delete;
+  SSAForm& operator=(const SSAForm&) = delete;
+
+  // The number of values. Value ids range from 0 to size() - 1.
+  size_t size() const { return m_defs.size(); }
+
+  const Def& def(ValueId value) const { return m_defs.at(value); }
+
+  const std::vector<Use>& uses(ValueId value) const {
+    return m_uses.at(value);
+  }
+
+  // The phis at the start of `block`.
+  const std::vector<ValueId>& phis(const Block* block) const {
+    return m_phis.at(block->id());
+  }
+
+  // The value read by the i-th source operand of `insn`.
+  ValueId src_value(const IRInstruction* insn, size_t i) const {
+    return m_insn_values[m_insn_offsets.at(insn) + 1 + i];
+  }
+
+  // The value defined by `insn`, or NO_VALUE if it has no destination.
+  ValueId dest_value(const IRInstruction* insn) const {
+    return m_insn_values[m_insn_offsets.at(insn)];
+  }
+
+ private:
+  ValueId new_value(Def::Kind kind,
+                    uint16_t reg,
+                    Block* block,
+                    IRInstruction* insn);
+
+  // `terminators` holds, for each block id, the last instruction of the block
+  // if it may throw to a handler, and nullptr otherwise.
+  void place_phis(const std::vector<Block*>& blocks,
+                  const cfg::DominatorTree& dom,
+                  const std::vector<IRInstruction*>& terminators);
+
+  void rename(const cfg::DominatorTree& dom,
+              const std::vector<IRInstruction*>& terminators);
+
+  std::vector<Def> m_defs;
+  std::vector<std::vector<Use>> m_uses;
+  // Indexed by block id.
+  std::vector<std::vector<ValueId>> m_phis;
+  // For each instruction, its destination value followed by the values of its
+  // sources, starting at the instruction's offset.
+  std::unordered_map<const IRInstruction*, uint32_t> m_insn_offsets;
+  std::vector<ValueId> m_insn_values;
+  size_t m_num_regs{0};
+};
+
+} // namespace ssa
@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/*
+ * A per-thread bump-pointer arena for the temporaries of a single unit of
+ * work, like the worklists and maps a pass builds while it processes one
+ * method and then throws away.
+ *
+ * Memory is handed out from chunks that the arena keeps across units of work,
+ * so that a busy worker thread stops going to the global allocator once its
+ * chunks are big enough. A unit of work opens a ScratchArena::Scope, and
+ * everything allocated while the scope is open is released at once when it
+ * closes. Scopes nest: a worker that runs a task of a nested work queue while
+ * inside a scope only releases what the nested task allocated. The arena
+ * never runs destructors, and individual deallocations are no-ops.
+ *
+ * walk::parallel::reduce_methods() opens a scope around every method, so the
+ * walkers it calls can allocate from the arena, e.g. through ScratchAllocator.
+ * Nothing allocated there may outlive the walker call.
+ *
+ * The arena of a thread must only be used by that thread.
+ */
+class ScratchArena {
+ public:
+  static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+
+  explicit ScratchArena(size_t chunk_size = 64 * 1024)
+      : m_chunk_size(chunk_size) {}
+
+  ScratchArena(const ScratchArena&) = delete;
+  ScratchArena& operator=(const ScratchArena&) = delete;
+
+  /*
+   * The arena of the calling thread.
+   */
+  static ScratchArena& get() {
+    static thread_local ScratchArena s_arena;
+    return s_arena;
+  }
+
+  /*
+   * Releases everything allocated from `arena` between its construction and
+   * its destruction. Scopes must be closed in the reverse order in which they
+   * were opened.
+   */
+  class Scope {
+   public:
+    explicit Scope(ScratchArena& arena = ScratchArena::get())
+        : m_arena(arena),
+          m_chunk_idx(arena.m_chunk_idx),
+          m_offset(arena.m_offset) {
+      ++m_arena.m_depth;
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+      --m_arena.m_depth;
+      m_arena.m_chunk_idx = m_chunk_idx;
+      m_arena.m_offset = m_offset;
+    }
+
+   private:
+    ScratchArena& m_arena;
+    const size_t m_chunk_idx;
+    const size_t m_offset;
+  };
+
+  /*
+   * Returns uninitialized storage for `size` bytes, aligned to ALIGNMENT,
+   * which stays valid until the innermost open scope closes.
+   */
+  void* allocate(size_t size) {
+    assert(m_depth > 0 && "Scratch memory must be allocated within a Scope");
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (m_chunk_idx < m_chunks.size() &&
+        m_offset + size <= m_chunks[m_chunk_idx].size) {
+      auto ptr = m_chunks[m_chunk_idx].data.get() + m_offset;
+      m_offset += size;
+      return ptr;
+    }
+    // Move on to the next chunk, or put a big enough one in its place. The
+    // chunks past the current one are only there to be reused.
+    size_t next = m_chunks.empty() ? 0 : m_chunk_idx + 1;
+    if (next == m_chunks.size()) {
+      m_chunks.emplace_back(std::max(m_chunk_size, size));
+    } else if (m_chunks[next].size < size) {
+      m_chunks.emplace(m_chunks.begin() + next, std::max(m_chunk_size, size));
+    }
+    m_chunk_idx = next;
+    m_offset = size;
+    return m_chunks[next].data.get();
+  }
+
+  /*
+   * Total number of bytes reserved from the system allocator.
+   */
+  size_t reserved_bytes() const {
+    size_t total = 0;
+    for (const auto& chunk : m_chunks) {
+      total += chunk.size;
+    }
+    return total;
+  }
+
+ private:
+  struct Chunk {
+    explicit Chunk(size_t size) : data(new char[size]), size(size) {}
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  const size_t m_chunk_size;
+  std::vector<Chunk> m_chunks;
+  // The allocation point is at m_offset in m_chunks[m_chunk_idx].
+  size_t m_chunk_idx{0};
+  size_t m_offset{0};
+  size_t m_depth{0};
+};
+
+/*
+ * An STL allocator that allocates from the scratch arena of the thread that
+ * constructed it, e.g.
+ *
+ *   std::vector<IRInstruction*, ScratchAllocator<IRInstruction*>> worklist;
+ *
+ * The container must be destroyed before the enclosing ScratchArena::Scope
+ * closes. Memory that a container gives back, e.g. when it grows, is only
+ * reclaimed when the scope closes.
+ */
+template <class T>
+class ScratchAllocator {
+ public:
+  using value_type = T;
+
+  ScratchAllocator() : m_arena(&ScratchArena::get()) {}
+
+  explicit ScratchAllocator(ScratchArena& arena) : m_arena(&arena) {}
+
+  template <class U>
+  ScratchAllocator(const ScratchAllocator<U>& other)
+      : m_arena(other.arena()) {}
+
+  T* allocate(size_t n) {
+    static_assert(alignof(T) <= ScratchArena::ALIGNMENT,
+                  "ScratchArena alignment is too small");
+    return static_cast<T*>(m_arena->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T*, size_t) {}
+
+  ScratchArena* arena() const { return m_arena; }
+
+  template <class U>
+  bool operator==(const ScratchAllocator<U>& other) const {
+    return m_arena == other.arena();
+  }
+
+  template <class U>
+  bool operator!=(const ScratchAllocator<U>& other) const {
+    return m_arena != other.arena();
+  }
+
+ private:
+  ScratchArena* m_arena;
+};
@@ -525,9 +525,35 @@ std::string show_opcode(const DexInstruction* insn) {
   }
 }
 
-std::string show_insn(const IRInstruction* insn, bool deobfuscated) {
-  if (!insn) return "";
-  std::ostringstream ss;
+/*
+ * Formats x with show_to() into a string. Each thread keeps a stream whose
+ * buffer is reused from one call to the next; a show_to() that calls back
+ * into show() gets a stream of its own.
+ */
+thread_local std::ostringstream t_show_stream;
+thread_local bool t_show_stream_in_use{false};
+
+template <typename T>
+std::string show_via_stream(const T& x) {
+  if (t_show_stream_in_use) {
+    std::ostringstream ss;
+    show_to(ss, x);
+    return ss.str();
+  }
+  struct InUse {
+    InUse() { t_show_stream_in_use = true; }
+    ~InUse() { t_show_stream_in_use = false; }
+  } in_use;
+  t_show_stream.str(std::string());
+  t_show_stream.clear();
+  show_to(t_show_stream, x);
+  return t_show_stream.str();
+}
+
+void show_insn_to(std::ostream& ss,
+                  const IRInstruction* insn,
+                  bool deobfuscated) {
+  if (!insn) return;
   ss << show(insn->opcode()) << " ";
   bool first = true;
   if (insn->dests_size()) {
@@ -549,20 +575,20 @@ std::string show_insn(const IRInstruction* insn, bool deobfuscated) {
       ss << boost::io::quoted(show(insn->get_string()));
       break;
     case opcode::Ref::Type:
-      ss << show(insn->get_type());
+      show_to(ss, insn->get_type());
       break;
     case opcode::Ref::Field:
       if (deobfuscated) {
         ss << show_deobfuscated(insn->get_field());
       } else {
-        ss << show(insn->get_field());
+        show_to(ss, insn->get_field());
       }
       break;
     case opcode::Ref::Method:
       if (deobfuscated) {
         ss << show_deobfuscated(insn->get_method());
       } else {
-        ss << show(insn->get_method());
+        show_to(ss, insn->get_method());
       }
       break;
     case opcode::Ref::Literal:
@@ -572,6 +598,12 @@ std::string show_insn(const IRInstruction* insn, bool deobfuscated) {
       ss << "<data>"; // TODO: print something more informative
       break;
   }
+}
+
+std::string show_insn(const IRInstruction* insn, bool deobfuscated) {
+  if (!insn) return "";
+  std::ostringstream ss;
+  show_insn_to(ss, insn, deobfuscated);
   return ss.str();
 }
 
@@ -592,6 +624,49 @@ std::string show_helper(const DexAnnotation* anno, bool deobfuscated) {
 
 } // namespace
 
+void show_to(std::ostream& os, const DexString* p) {
+  if (!p) return;
+  os << p->c_str();
+}
+
+void show_to(std::ostream& os, const DexType* p) {
+  if (!p) return;
+  show_to(os, p->get_name());
+}
+
+void show_to(std::ostream& os, const DexFieldRef* p) {
+  if (!p) return;
+  show_to(os, p->get_class());
+  os << ".";
+  show_to(os, p->get_name());
+  os << ":";
+  show_to(os, p->get_type());
+}
+
+void show_to(std::ostream& os, const DexTypeList* p) {
+  if (!p) return;
+  for (auto const type : p->get_type_list()) {
+    show_to(os, type);
+  }
+}
+
+void show_to(std::ostream& os, const DexProto* p) {
+  if (!p) return;
+  os << "(";
+  show_to(os, p->get_args());
+  os << ")";
+  show_to(os, p->get_rtype());
+}
+
+void show_to(std::ostream& os, const DexMethodRef* p) {
+  if (!p) return;
+  show_to(os, p->get_class());
+  os << ".";
+  show_to(os, p->get_name());
+  os << ":";
+  show_to(os, p->get_proto());
+}
+
 std::string show(const DexString* p) {
   if (!p) return "";
   return std::string(p->c_str());
@@ -603,11 +678,7 @@ std::string show(const DexType* p) {
 }
 
 std::string show(const DexFieldRef* p) {
-  if (!p) return "";
-  std::stringstream ss;
-  ss << show(p->get_class()) << "." << show(p->get_name()) << ":"
-      << show(p->get_type());
-  return ss.str();
+  return show_via_stream(p);
 }
 
 std::string vshow(const DexField* p) {
@@ -647,19 +718,11 @@ std::string vshow(const DexProto* p, bool include_ret_type = true) {
 }
 
 std::string show(const DexTypeList* p) {
-  if (!p) return "";
-  std::stringstream ss;
-  for (auto const type : p->get_type_list()) {
-    ss << show(type);
-  }
-  return ss.str();
+  return show_via_stream(p);
 }
 
 std::string show(const DexProto* p) {
-  if (!p) return "";
-  std::stringstream ss;
-  ss << "(" << show(p->get_args()) << ")" << show(p->get_rtype());
-  return ss.str();
+  return show_via_stream(p);
 }
 
 std::string show(const DexCode* code) {
@@ -677,11 +740,7 @@ std::string show(const DexCode* code) {
 }
 
 std::string show(const DexMethodRef* p) {
-  if (!p) return "";
-  std::stringstream ss;
-  ss << show(p->get_class()) << "." << show(p->get_name())
-      << ":" << show(p->get_proto());
-  return ss.str();
+  return show_via_stream(p);
 }
 
 std::string vshow(uint32_t acc) {
@@ -862,8 +921,12 @@ std::string show(const DexInstruction* insn) {
   return ss.str();
 }
 
+void show_to(std::ostream& os, const IRInstruction* insn) {
+  show_insn_to(os, insn, false);
+}
+
 std::string show(const IRInstruction* insn) {
-  return show_insn(insn, false);
+  return show_via_stream(insn);
 }
 
 std::string show(const DexDebugInstruction* insn) {
@@ -918,10 +981,13 @@ std::string show(const DexDebugInstruction* insn) {
   return ss.str();
 }
 
+void show_to(std::ostream& os, const DexPosition* pos) {
+  show_to(os, pos->file);
+  os << ":" << pos->line;
+}
+
 std::string show(const DexPosition* pos) {
-  std::stringstream ss;
-  ss << show(pos->file) << ":" << pos->line;
-  return ss.str();
+  return show_via_stream(pos);
 }
 
 std::string show(const DexDebugEntry* entry) {
@@ -955,16 +1021,20 @@ std::string show(const SwitchIndices& si) {
   return ss.str();
 }
 
-std::string show(const MethodItemEntry& mei) {
-  std::stringstream ss;
+void show_to(std::ostream& ss, const MethodItemEntry& mei) {
+  if (mei.type == MFLOW_FALLTHROUGH) {
+    ss << "FALLTHROUGH";
+    return;
+  }
   ss << "[" << &mei << "] ";
   switch (mei.type) {
   case MFLOW_OPCODE:
-    ss << "OPCODE: " << show(mei.insn);
-    return ss.str();
+    ss << "OPCODE: ";
+    show_to(ss, mei.insn);
+    break;
   case MFLOW_DEX_OPCODE:
     ss << "DEX_OPCODE: " << show(mei.dex_insn);
-    return ss.str();
+    break;
   case MFLOW_TARGET:
     if (mei.target->type == BRANCH_MULTI) {
       ss << "TARGET: MULTI " << mei.target->index << " ";
@@ -972,36 +1042,43 @@ std::string show(const MethodItemEntry& mei) {
       ss << "TARGET: SIMPLE ";
     }
     ss << mei.target->src;
-    return ss.str();
+    break;
   case MFLOW_TRY:
     ss << "TRY: " << show(mei.tentry->type) << " " << mei.tentry->catch_start;
-    return ss.str();
+    break;
   case MFLOW_CATCH:
-    ss << "CATCH: " << show(mei.centry->catch_type);
-    return ss.str();
+    ss << "CATCH: ";
+    show_to(ss, mei.centry->catch_type);
+    break;
   case MFLOW_DEBUG:
     ss << "DEBUG: " << show(mei.dbgop);
-    return ss.str();
+    break;
   case MFLOW_POSITION:
-    ss << "POSITION: " << show(mei.pos);
-    return ss.str();
+    ss << "POSITION: ";
+    show_to(ss, mei.pos.get());
+    break;
   case MFLOW_FALLTHROUGH:
-    return "FALLTHROUGH";
+    break;
   }
 }
 
-std::string show(const IRList* ir) {
-  std::string ret;
+std::string show(const MethodItemEntry& mei) {
+  return show_via_stream(mei);
+}
+
+void show_to(std::ostream& os, const IRList* ir) {
   for (auto const& mei : *ir) {
-    ret += show(mei);
-    ret += "\n";
+    show_to(os, mei);
+    os << "\n";
   }
-  return ret;
 }
 
-std::string show(const ControlFlowGraph& cfg) {
+std::string show(const IRList* ir) {
+  return show_via_stream(ir);
+}
+
+void show_to(std::ostream& ss, const ControlFlowGraph& cfg) {
   const auto& blocks = cfg.blocks();
-  std::stringstream ss;
   ss << "CFG:\n";
   for (auto& b : blocks) {
     ss << "B" << b->id() << " succs:";
@@ -1017,10 +1094,15 @@ std::string show(const ControlFlowGraph& cfg) {
   for (auto const& b : blocks) {
     ss << "  Block B" << b->id() << ":\n";
     for (auto const& mei : *b) {
-      ss << "    " << show(mei) << "\n";
+      ss << "    ";
+      show_to(ss, mei);
+      ss << "\n";
     }
   }
-  return ss.str();
+}
+
+std::string show(const ControlFlowGraph& cfg) {
+  return show_via_stream(cfg);
 }
 
 std::string show(const MethodCreator* mc) {
@@ -1060,27 +1142,34 @@ std::string show(DexIdx* p) {
      << "fields\n"
      << "----------------------------------------\n";
   for (uint32_t i = 0; i < p->m_field_ids_size; i++) {
-    ss << show(p->m_field_cache[i]) << "\n";
+    ss << show(p->m_field_cache[i].load()) << "\n";
   }
   ss << "----------------------------------------\n"
      << "methods\n"
      << "----------------------------------------\n";
   for (uint32_t i = 0; i < p->m_method_ids_size; i++) {
-    ss << show(p->m_method_cache[i]) << "\n";
+    ss << show(p->m_method_cache[i].load()) << "\n";
   }
   return ss.str();
 }
 
+void show_to(std::ostream& os, const IRCode* mt) {
+  show_to(os, mt->m_ir_list);
+}
+
 std::string show(const IRCode* mt) {
-  return show(mt->m_ir_list);
+  return show_via_stream(mt);
 }
 
-std::string show(const InstructionIterable& it) {
-  std::stringstream ss;
+void show_to(std::ostream& os, const InstructionIterable& it) {
   for (auto& mei : it) {
-    ss << show(mei.insn) << "\n";
+    show_to(os, mei.insn);
+    os << "\n";
   }
-  return ss.str();
+}
+
+std::string show(const InstructionIterable& it) {
+  return show_via_stream(it);
 }
 
 std::string show_context(IRCode const* code, IRInstruction const* insn) {
@@ -1094,7 +1183,8 @@ std::string show_context(IRCode const* code, IRInstruction const* insn) {
     iter--;
   }
   for (int i = 0; i < 11 && iter != code->end(); i++) {
-    ss << SHOW(*iter++) << std::endl;
+    show_to(ss, *iter++);
+    ss << std::endl;
   }
   return ss.str();
 }
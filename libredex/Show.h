@@ -78,6 +78,25 @@ std::string show_deobfuscated(const DexMethodRef*);
 std::string show_deobfuscated(const IRInstruction*);
 std::string show_deobfuscated(const DexEncodedValue*);
 
+/*
+ * Streaming variants of show(), for dumps of large methods and graphs: they
+ * write to os instead of building a string for each part of what they show.
+ * The show() of these types formats through them, into a buffer reused by
+ * each thread.
+ */
+void show_to(std::ostream& os, const DexString*);
+void show_to(std::ostream& os, const DexType*);
+void show_to(std::ostream& os, const DexFieldRef*);
+void show_to(std::ostream& os, const DexTypeList*);
+void show_to(std::ostream& os, const DexProto*);
+void show_to(std::ostream& os, const DexMethodRef*);
+void show_to(std::ostream& os, const DexPosition*);
+void show_to(std::ostream& os, const IRInstruction*);
+void show_to(std::ostream& os, const IRCode*);
+void show_to(std::ostream& os, const MethodItemEntry&);
+void show_to(std::ostream& os, const ControlFlowGraph&);
+void show_to(std::ostream& os, const InstructionIterable&);
+
 template <typename T>
 std::string show(const std::unique_ptr<T>& ptr) {
   return show(ptr.get());
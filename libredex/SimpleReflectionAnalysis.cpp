@@ -11,9 +11,11 @@
 
 #include <iomanip>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <boost/optional.hpp>
 
+#include "ConcurrentContainers.h"
 #include "ConstantAbstractDomain.h"
 #include "ControlFlow.h"
 #include "DexUtil.h"
@@ -23,6 +25,7 @@
 #include "IROpcode.h"
 #include "PatriciaTreeMapAbstractEnvironment.h"
 #include "Show.h"
+#include "Walkers.h"
 
 namespace sra {
 
@@ -349,4 +352,100 @@ boost::optional<AbstractObject> SimpleReflectionAnalysis::get_abstract_object(
   return m_analyzer->get_abstract_object(reg, insn);
 }
 
+namespace {
+
+/*
+ * An analysis, tagged with the epoch of the code it was run on.
+ */
+struct CachedAnalysis {
+  std::shared_ptr<const SimpleReflectionAnalysis> analysis;
+  size_t epoch{0};
+};
+
+ConcurrentMap<DexMethod*, CachedAnalysis>& analysis_cache() {
+  // Intentionally leaked, like the resolution caches.
+  static auto* s_cache = new ConcurrentMap<DexMethod*, CachedAnalysis>();
+  return *s_cache;
+}
+
+} // namespace
+
+std::shared_ptr<const SimpleReflectionAnalysis>
+SimpleReflectionAnalysis::get_cached(DexMethod* dex_method) {
+  IRCode* code = dex_method->get_code();
+  if (code == nullptr) {
+    return std::make_shared<SimpleReflectionAnalysis>(dex_method);
+  }
+  // Folds the edits of an editable CFG, if any, back into the code first,
+  // which bumps its epoch. The analysis would do it anyway.
+  code->build_cfg();
+  auto epoch = code->epoch();
+  auto& cache = analysis_cache();
+  auto cached = cache.get(dex_method, CachedAnalysis());
+  if (cached.analysis != nullptr && cached.epoch == epoch) {
+    return cached.analysis;
+  }
+  std::shared_ptr<const SimpleReflectionAnalysis> analysis =
+      std::make_shared<SimpleReflectionAnalysis>(dex_method);
+  cache.update(dex_method,
+               [&](DexMethod*, CachedAnalysis& entry, bool) {
+                 entry.analysis = analysis;
+                 entry.epoch = epoch;
+               });
+  return analysis;
+}
+
+void SimpleReflectionAnalysis::clear_cache() { analysis_cache().clear(); }
+
+ReflectionSites find_reflection_sites(const Scope& scope,
+                                      const ReflectionApis& apis) {
+  // Names that were never interned can't be invoked.
+  std::unordered_map<const DexType*, std::unordered_set<const DexString*>>
+      names_by_class;
+  for (const auto& api : apis) {
+    auto type = DexType::get_type(api.first.c_str());
+    auto name = DexString::get_string(api.second.c_str());
+    if (type != nullptr && name != nullptr) {
+      names_by_class[type].insert(name);
+    }
+  }
+  if (names_by_class.empty()) {
+    return ReflectionSites();
+  }
+
+  using Data = std::nullptr_t;
+  return walk::parallel::reduce_methods<Data, ReflectionSites>(
+      scope,
+      [&names_by_class](Data&, DexMethod* method) {
+        ReflectionSites sites;
+        auto code = method->get_code();
+        if (code == nullptr) {
+          return sites;
+        }
+        for (auto& mie : InstructionIterable(code)) {
+          IRInstruction* insn = mie.insn;
+          if (!is_invoke(insn->opcode())) {
+            continue;
+          }
+          auto callee = insn->get_method();
+          auto it = names_by_class.find(callee->get_class());
+          if (it != names_by_class.end() &&
+              it->second.count(callee->get_name())) {
+            sites[method].push_back(insn);
+          }
+        }
+        return sites;
+      },
+      [](ReflectionSites a, ReflectionSites b) {
+        if (a.size() < b.size()) {
+          std::swap(a, b);
+        }
+        for (auto& entry : b) {
+          a.emplace(entry.first, std::move(entry.second));
+        }
+        return a;
+      },
+      [](int) { return nullptr; });
+}
+
 } // namespace sra
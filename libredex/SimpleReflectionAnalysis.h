@@ -11,6 +11,10 @@
 
 #include <memory>
 #include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <boost/optional.hpp>
 
@@ -103,8 +107,44 @@ class SimpleReflectionAnalysis final {
   boost::optional<AbstractObject> get_abstract_object(
       size_t reg, IRInstruction* insn) const;
 
+  /*
+   * Returns the analysis of the given method from a cache shared by all
+   * threads and passes, only running it again when the method's code has
+   * changed since (see IRCode::epoch). Like the constructor, it leaves a
+   * non-editable CFG built for the code. Instructions edited in place don't
+   * change the epoch, so code edited that way must be analyzed directly.
+   * Like the constructor, it must not run on the same method from several
+   * threads at once.
+   */
+  static std::shared_ptr<const SimpleReflectionAnalysis> get_cached(
+      DexMethod* dex_method);
+
+  /*
+   * Drops all the cached analyses, e.g. to free their memory.
+   */
+  static void clear_cache();
+
  private:
   std::unique_ptr<impl::Analyzer> m_analyzer;
 };
 
+/*
+ * Reflection APIs, as pairs of a class and a method name, e.g.
+ * {"Ljava/lang/Class;", "getField"}.
+ */
+using ReflectionApis = std::vector<std::pair<std::string, std::string>>;
+
+/*
+ * The methods of the scope that invoke any of the given APIs, with those
+ * invokes in code order. Most methods use no reflection at all, so clients
+ * look up the invokes here and only analyze the methods that have some.
+ * Invokes are matched by their interned class and name, without hashing
+ * strings.
+ */
+using ReflectionSites =
+    std::unordered_map<DexMethod*, std::vector<IRInstruction*>>;
+
+ReflectionSites find_reflection_sites(const Scope& scope,
+                                      const ReflectionApis& apis);
+
 } // namespace sra
@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+/*
+ * A fixed-size object pool for types that are allocated and freed in huge
+ * numbers, like IRInstruction and MethodItemEntry. It is meant to back a
+ * class-specific operator new / operator delete:
+ *
+ *   static void* operator new(size_t size) {
+ *     return SlabPool<Foo>::allocate(size);
+ *   }
+ *   static void operator delete(void* ptr, size_t size) {
+ *     SlabPool<Foo>::deallocate(ptr, size);
+ *   }
+ *
+ * Objects are carved out of slabs of kObjectsPerSlab objects, which avoids
+ * the per-allocation header of the system allocator and keeps objects that
+ * are created together close in memory. Freed objects go onto a free list
+ * owned by the freeing thread, so neither path ever takes a lock. Objects
+ * routinely move between methods (e.g. when inlining), so there is no notion
+ * of a pool per method: any thread may free any object.
+ *
+ * Slabs are never returned to the system.
+ */
+template <class T, size_t kObjectsPerSlab = 512>
+class SlabPool {
+ public:
+  static void* allocate(size_t size) {
+    if (size != sizeof(T)) {
+      return ::operator new(size);
+    }
+    auto& cache = thread_cache();
+    if (cache.free_list != nullptr) {
+      auto node = cache.free_list;
+      cache.free_list = node->next;
+      return node;
+    }
+    if (cache.slab_pos == cache.slab_end) {
+      auto slab =
+          static_cast<char*>(::operator new(kSlotSize * kObjectsPerSlab));
+      cache.slab_pos = slab;
+      cache.slab_end = slab + kSlotSize * kObjectsPerSlab;
+    }
+    void* ptr = cache.slab_pos;
+    cache.slab_pos += kSlotSize;
+    return ptr;
+  }
+
+  static void deallocate(void* ptr, size_t size) {
+    if (ptr == nullptr) {
+      return;
+    }
+    if (size != sizeof(T)) {
+      ::operator delete(ptr);
+      return;
+    }
+    auto& cache = thread_cache();
+    auto node = static_cast<FreeNode*>(ptr);
+    node->next = cache.free_list;
+    cache.free_list = node;
+  }
+
+ private:
+  struct FreeNode {
+    FreeNode* next;
+  };
+
+  static constexpr size_t kAlign =
+      alignof(T) > alignof(FreeNode) ? alignof(T) : alignof(FreeNode);
+  static constexpr size_t kSize =
+      sizeof(T) > sizeof(FreeNode) ? sizeof(T) : sizeof(FreeNode);
+  static constexpr size_t kSlotSize = (kSize + kAlign - 1) / kAlign * kAlign;
+
+  struct ThreadCache {
+    FreeNode* free_list{nullptr};
+    char* slab_pos{nullptr};
+    char* slab_end{nullptr};
+  };
+
+  static ThreadCache& thread_cache() {
+    static thread_local ThreadCache s_cache;
+    return s_cache;
+  }
+};
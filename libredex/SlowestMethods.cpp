@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "SlowestMethods.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "DexClass.h"
+#include "Show.h"
+
+namespace {
+
+using Entry = std::pair<double, std::string>;
+
+std::mutex s_lock;
+size_t s_count{0};
+// A min-heap on the seconds, so the fastest visit kept is the one to go.
+std::vector<Entry> s_heap;
+// Once the heap is full, visits that aren't slower than this can't get in,
+// which is known without taking the lock.
+std::atomic<double> s_threshold{0};
+
+bool slower(const Entry& a, const Entry& b) { return a.first > b.first; }
+
+} // namespace
+
+std::atomic<bool> SlowestMethods::s_enabled{false};
+
+void SlowestMethods::start(size_t count) {
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_count = count;
+  s_heap.clear();
+  s_threshold.store(0, std::memory_order_relaxed);
+  s_enabled.store(count > 0, std::memory_order_relaxed);
+}
+
+SlowestMethods::Entries SlowestMethods::stop() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_enabled.store(false, std::memory_order_relaxed);
+  std::sort_heap(s_heap.begin(), s_heap.end(), slower);
+  Entries entries;
+  for (auto& entry : s_heap) {
+    entries.emplace_back(std::move(entry.second), entry.first);
+  }
+  s_heap.clear();
+  return entries;
+}
+
+void SlowestMethods::truncate(Entries& entries, size_t count) {
+  std::stable_sort(entries.begin(),
+                   entries.end(),
+                   [](const std::pair<std::string, double>& a,
+                      const std::pair<std::string, double>& b) {
+                     return a.second > b.second;
+                   });
+  if (entries.size() > count) {
+    entries.resize(count);
+  }
+}
+
+void SlowestMethods::record(const DexMethod* method, double secs) {
+  if (secs <= s_threshold.load(std::memory_order_relaxed)) {
+    return;
+  }
+  auto name = show_deobfuscated(method);
+  std::lock_guard<std::mutex> guard(s_lock);
+  if (!enabled()) {
+    return;
+  }
+  if (s_heap.size() == s_count) {
+    if (secs <= s_heap.front().first) {
+      return;
+    }
+    std::pop_heap(s_heap.begin(), s_heap.end(), slower);
+    s_heap.pop_back();
+  }
+  s_heap.emplace_back(secs, std::move(name));
+  std::push_heap(s_heap.begin(), s_heap.end(), slower);
+  if (s_heap.size() == s_count) {
+    s_threshold.store(s_heap.front().first, std::memory_order_relaxed);
+  }
+}
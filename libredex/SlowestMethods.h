@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+class DexMethod;
+
+/*
+ * Keeps the slowest method visits of a pass, to tell a pass that got slower
+ * everywhere from one that chokes on a single method. The walkers time each
+ * call of their callback on a method with a Scope.
+ *
+ * Recording is off until start() is called; a Scope created while it's off
+ * costs one relaxed atomic load. Once on, a visit costs two clock reads, and
+ * only visits slow enough to make the list take a lock. A method that is
+ * visited several times, e.g. by several walks, may be listed more than once.
+ */
+class SlowestMethods {
+ public:
+  using Entries = std::vector<std::pair<std::string, double>>;
+
+  /*
+   * Starts keeping the `count` slowest visits, dropping any kept so far.
+   */
+  static void start(size_t count);
+
+  /*
+   * Stops recording and returns the visits kept, slowest first, as the
+   * method's deobfuscated name and the seconds its visit took.
+   */
+  static Entries stop();
+
+  static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+  /*
+   * Keeps the `count` slowest of `entries`, slowest first.
+   */
+  static void truncate(Entries& entries, size_t count);
+
+  class Scope {
+   public:
+    explicit Scope(const DexMethod* method) {
+      if (enabled()) {
+        m_method = method;
+        m_start = std::chrono::steady_clock::now();
+      }
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+      if (m_method != nullptr) {
+        record(m_method,
+               std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - m_start)
+                   .count());
+      }
+    }
+
+   private:
+    const DexMethod* m_method{nullptr};
+    std::chrono::steady_clock::time_point m_start;
+  };
+
+ private:
+  static void record(const DexMethod* method, double secs);
+
+  static std::atomic<bool> s_enabled;
+};
@@ -0,0 +1,254 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <boost/container/small_vector.hpp>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+
+#include "Debug.h"
+#include "PowersetAbstractDomain.h"
+
+template <typename Element, size_t InlineSize, typename Compare>
+class SmallSortedSetAbstractDomain;
+
+namespace sssad_impl {
+
+/*
+ * A set kept as a sorted vector whose first InlineSize elements are stored
+ * inline. Lookups are binary searches, and unions and intersections are
+ * linear merges, which beats hashing for the handful of elements most sets in
+ * a fixpoint iteration hold. Iteration follows the order of Compare.
+ */
+template <typename Element, size_t InlineSize, typename Compare>
+class SmallSortedSet {
+ public:
+  using Elements = boost::container::small_vector<Element, InlineSize>;
+  using const_iterator = typename Elements::const_iterator;
+  using iterator = const_iterator;
+  using value_type = Element;
+
+  SmallSortedSet() = default;
+
+  template <typename InputIterator>
+  SmallSortedSet(InputIterator first, InputIterator last)
+      : m_elements(first, last) {
+    std::sort(m_elements.begin(), m_elements.end(), Compare());
+    m_elements.erase(
+        std::unique(m_elements.begin(), m_elements.end(), equivalent),
+        m_elements.end());
+  }
+
+  const_iterator begin() const { return m_elements.begin(); }
+
+  const_iterator end() const { return m_elements.end(); }
+
+  size_t size() const { return m_elements.size(); }
+
+  bool empty() const { return m_elements.empty(); }
+
+  size_t count(const Element& e) const {
+    return std::binary_search(begin(), end(), e, Compare()) ? 1 : 0;
+  }
+
+  bool insert(const Element& e) {
+    auto it = std::lower_bound(m_elements.begin(), m_elements.end(), e,
+                               Compare());
+    if (it != m_elements.end() && equivalent(*it, e)) {
+      return false;
+    }
+    m_elements.insert(it, e);
+    return true;
+  }
+
+  size_t erase(const Element& e) {
+    auto it = std::lower_bound(m_elements.begin(), m_elements.end(), e,
+                               Compare());
+    if (it == m_elements.end() || !equivalent(*it, e)) {
+      return 0;
+    }
+    m_elements.erase(it);
+    return 1;
+  }
+
+  void clear() { m_elements.clear(); }
+
+  bool includes(const SmallSortedSet& other) const {
+    return other.size() <= size() &&
+           std::includes(begin(), end(), other.begin(), other.end(),
+                         Compare());
+  }
+
+  bool operator==(const SmallSortedSet& other) const {
+    return size() == other.size() &&
+           std::equal(begin(), end(), other.begin(), equivalent);
+  }
+
+  void union_with(const SmallSortedSet& other) {
+    if (other.empty() || includes(other)) {
+      return;
+    }
+    Elements merged;
+    merged.reserve(size() + other.size());
+    std::set_union(begin(), end(), other.begin(), other.end(),
+                   std::back_inserter(merged), Compare());
+    m_elements = std::move(merged);
+  }
+
+  void intersection_with(const SmallSortedSet& other) {
+    // Both are sorted, so the kept elements can be compacted in place.
+    auto out = m_elements.begin();
+    auto it = other.begin();
+    Compare less;
+    for (auto& e : m_elements) {
+      while (it != other.end() && less(*it, e)) {
+        ++it;
+      }
+      if (it == other.end()) {
+        break;
+      }
+      if (!less(e, *it)) {
+        if (&*out != &e) {
+          *out = std::move(e);
+        }
+        ++out;
+      }
+    }
+    m_elements.erase(out, m_elements.end());
+  }
+
+ private:
+  static bool equivalent(const Element& a, const Element& b) {
+    Compare less;
+    return !less(a, b) && !less(b, a);
+  }
+
+  Elements m_elements;
+};
+
+/*
+ * An abstract value from a powerset is implemented as a small sorted set.
+ */
+template <typename Element, size_t InlineSize, typename Compare>
+class SetValue final
+    : public PowersetImplementation<
+          Element,
+          const SmallSortedSet<Element, InlineSize, Compare>&,
+          SetValue<Element, InlineSize, Compare>> {
+ public:
+  using Kind =
+      typename AbstractValue<SetValue<Element, InlineSize, Compare>>::Kind;
+  using Set = SmallSortedSet<Element, InlineSize, Compare>;
+
+  SetValue() = default;
+
+  SetValue(const Element& e) { m_set.insert(e); }
+
+  SetValue(std::initializer_list<Element> l) : m_set(l.begin(), l.end()) {}
+
+  const Set& elements() const override { return m_set; }
+
+  size_t size() const override { return m_set.size(); }
+
+  bool contains(const Element& e) const override { return m_set.count(e) > 0; }
+
+  void add(const Element& e) override { m_set.insert(e); }
+
+  void remove(const Element& e) override { m_set.erase(e); }
+
+  void clear() override { m_set.clear(); }
+
+  Kind kind() const override { return Kind::Value; }
+
+  bool leq(const SetValue& other) const override {
+    return other.m_set.includes(m_set);
+  }
+
+  bool equals(const SetValue& other) const override {
+    return m_set == other.m_set;
+  }
+
+  Kind join_with(const SetValue& other) override {
+    m_set.union_with(other.m_set);
+    return Kind::Value;
+  }
+
+  Kind meet_with(const SetValue& other) override {
+    m_set.intersection_with(other.m_set);
+    return Kind::Value;
+  }
+
+ private:
+  Set m_set;
+
+  template <typename T1, size_t T2, typename T3>
+  friend class ::SmallSortedSetAbstractDomain;
+};
+
+} // namespace sssad_impl
+
+/*
+ * An implementation of powerset abstract domains using sorted vectors with
+ * inline storage for the first InlineSize elements. It is meant for the
+ * small sets that most powerset analyses deal with, where it saves the node
+ * allocated per element by HashedSetAbstractDomain, and makes copies, joins
+ * and meets linear scans of contiguous memory. Large sets are better off in
+ * a HashedSetAbstractDomain or a PatriciaTreeSetAbstractDomain, since an
+ * insertion moves all the elements after it.
+ *
+ * Elements must be ordered by Compare. elements() supports iteration and
+ * count(), so code written against HashedSetAbstractDomain usually only
+ * needs its typedef changed.
+ */
+template <typename Element,
+          size_t InlineSize = 4,
+          typename Compare = std::less<Element>>
+class SmallSortedSetAbstractDomain final
+    : public PowersetAbstractDomain<
+          Element,
+          sssad_impl::SetValue<Element, InlineSize, Compare>,
+          const sssad_impl::SmallSortedSet<Element, InlineSize, Compare>&,
+          SmallSortedSetAbstractDomain<Element, InlineSize, Compare>> {
+ public:
+  using Value = sssad_impl::SetValue<Element, InlineSize, Compare>;
+
+  using AbstractValueKind = typename Value::Kind;
+
+  SmallSortedSetAbstractDomain()
+      : PowersetAbstractDomain<Element,
+                               Value,
+                               const typename Value::Set&,
+                               SmallSortedSetAbstractDomain>() {}
+
+  SmallSortedSetAbstractDomain(AbstractValueKind kind)
+      : PowersetAbstractDomain<Element,
+                               Value,
+                               const typename Value::Set&,
+                               SmallSortedSetAbstractDomain>(kind) {}
+
+  explicit SmallSortedSetAbstractDomain(const Element& e) {
+    this->set_to_value(Value(e));
+  }
+
+  explicit SmallSortedSetAbstractDomain(std::initializer_list<Element> l) {
+    this->set_to_value(Value(l));
+  }
+
+  static SmallSortedSetAbstractDomain bottom() {
+    return SmallSortedSetAbstractDomain(AbstractValueKind::Bottom);
+  }
+
+  static SmallSortedSetAbstractDomain top() {
+    return SmallSortedSetAbstractDomain(AbstractValueKind::Top);
+  }
+};
@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "StaticRefIndex.h"
+
+#include <iterator>
+
+#include "DexInstruction.h"
+#include "IRCode.h"
+#include "Walkers.h"
+
+StaticRefIndex::StaticRefIndex(const Scope& scope) {
+  using Refs = std::vector<MethodRefs>;
+  m_methods = walk::parallel::reduce_code<Refs>(
+      scope,
+      [](DexMethod*) { return true; },
+      [](Refs& acc, DexMethod* method, IRCode& code) {
+        MethodRefs refs;
+        refs.method = method;
+        auto ii = InstructionIterable(code);
+        for (auto it = ii.begin(); it != ii.end(); ++it) {
+          auto insn = it->insn;
+          auto op = insn->opcode();
+          if (is_sget(op) || is_sput(op)) {
+            refs.field_refs.push_back(it.unwrap());
+          } else if (op == OPCODE_INVOKE_STATIC ||
+                     op == OPCODE_INVOKE_DIRECT) {
+            refs.method_refs.push_back(it.unwrap());
+          } else if (insn->has_type()) {
+            refs.type_refs.push_back(it.unwrap());
+          }
+        }
+        code.gather_catch_types(refs.catch_types);
+        if (!refs.field_refs.empty() || !refs.method_refs.empty() ||
+            !refs.type_refs.empty() || !refs.catch_types.empty()) {
+          acc.push_back(std::move(refs));
+        }
+      },
+      [](Refs a, Refs b) {
+        a.insert(a.end(),
+                 std::make_move_iterator(b.begin()),
+                 std::make_move_iterator(b.end()));
+        return a;
+      });
+}
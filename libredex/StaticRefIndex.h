@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRList.h"
+
+/*
+ * An index of the instructions that reference static fields, static or direct
+ * methods, and types, built with a single parallel walk over the code. Passes
+ * that pick their candidates from these references and then rewrite some of
+ * them (FinalInline, StaticRelo) use it for both steps instead of walking all
+ * the code twice. The AnalysisManager caches it as StaticRefsAnalysis.
+ *
+ * The index holds iterators into the code, so it's only valid as long as none
+ * of the instructions it refers to is removed.
+ */
+class StaticRefIndex final {
+ public:
+  struct MethodRefs {
+    DexMethod* method;
+    // The sget-* and sput-* instructions
+    std::vector<IRList::iterator> field_refs;
+    // The invoke-static and invoke-direct instructions
+    std::vector<IRList::iterator> method_refs;
+    // The instructions with a type operand
+    std::vector<IRList::iterator> type_refs;
+    // The types caught by the try blocks of the method
+    std::vector<DexType*> catch_types;
+  };
+
+  explicit StaticRefIndex(const Scope& scope);
+
+  /*
+   * The methods that have any of the references above, in the order walk::code
+   * visits them.
+   */
+  const std::vector<MethodRefs>& methods() const { return m_methods; }
+
+ private:
+  std::vector<MethodRefs> m_methods;
+};
@@ -0,0 +1,254 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "Debug.h"
+#include "Timer.h"
+
+namespace {
+
+// The number of CPUs of the last pin_to_cpus(), or 0.
+std::atomic<unsigned int> s_num_pinned_cpus{0};
+
+const std::vector<int>& env_cpus() {
+  static const std::vector<int> s_cpus = [] {
+    auto list = getenv("REDEX_CPUS");
+    return list != nullptr && *list != '\0'
+               ? ThreadPool::parse_cpu_list(list)
+               : std::vector<int>();
+  }();
+  return s_cpus;
+}
+
+#ifdef __linux__
+// The CPUs the process was allowed to run on before any pinning.
+const cpu_set_t& process_cpus() {
+  static const cpu_set_t s_cpus = [] {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+      CPU_ZERO(&cpus);
+    }
+    return cpus;
+  }();
+  return s_cpus;
+}
+
+// Pins `thread` to `cpu`, or lets it run on all of process_cpus() if `cpu`
+// is negative.
+void set_affinity(pthread_t thread, int cpu) {
+  cpu_set_t cpus;
+  if (cpu < 0) {
+    cpus = process_cpus();
+    if (CPU_COUNT(&cpus) == 0) {
+      return;
+    }
+  } else {
+    always_assert_log(cpu < CPU_SETSIZE, "CPU %d is out of range", cpu);
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+  }
+  auto err = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+  always_assert_log(err == 0, "Failed to pin a thread to CPU %d: %s", cpu,
+                    strerror(err));
+}
+#endif
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t num_threads) { ensure_size(num_threads); }
+
+ThreadPool::~ThreadPool() { join_workers(); }
+
+ThreadPool& ThreadPool::get() {
+  static ThreadPool s_pool(num_cpus());
+  static bool s_pinned = [] {
+    if (!env_cpus().empty()) {
+      s_pool.pin_to_cpus(env_cpus());
+    }
+    return true;
+  }();
+  (void)s_pinned;
+  return s_pool;
+}
+
+unsigned int ThreadPool::num_cpus() {
+  auto pinned = s_num_pinned_cpus.load();
+  if (pinned != 0) {
+    return pinned;
+  }
+  if (!env_cpus().empty()) {
+    return env_cpus().size();
+  }
+#ifdef __linux__
+  auto count = CPU_COUNT(&process_cpus());
+  if (count > 0) {
+    return count;
+  }
+#endif
+  return std::max(1u, boost::thread::hardware_concurrency());
+}
+
+unsigned int ThreadPool::configured_threads() {
+  static const unsigned int s_threads = [] {
+    auto threads = getenv("REDEX_THREADS");
+    return threads != nullptr ? static_cast<unsigned int>(atoi(threads)) : 0;
+  }();
+  return s_threads;
+}
+
+std::vector<int> ThreadPool::parse_cpu_list(const std::string& list) {
+  std::vector<int> cpus;
+  size_t pos = 0;
+  auto number = [&]() {
+    auto start = pos;
+    while (pos < list.size() && isdigit(list[pos])) {
+      ++pos;
+    }
+    always_assert_log(pos > start, "Malformed CPU list \"%s\"", list.c_str());
+    return std::stoi(list.substr(start, pos - start));
+  };
+  while (true) {
+    auto first = number();
+    auto last = first;
+    if (pos < list.size() && list[pos] == '-') {
+      ++pos;
+      last = number();
+      always_assert_log(first <= last, "Malformed CPU list \"%s\"",
+                        list.c_str());
+    }
+    for (auto cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+    if (pos == list.size()) {
+      return cpus;
+    }
+    always_assert_log(list[pos] == ',', "Malformed CPU list \"%s\"",
+                      list.c_str());
+    ++pos;
+  }
+}
+
+void ThreadPool::pin_to_cpus(std::vector<int> cpus) {
+#ifdef __linux__
+  boost::lock_guard<boost::mutex> guard(m_mtx);
+  m_cpus = std::move(cpus);
+  s_num_pinned_cpus = m_cpus.size();
+  set_affinity(pthread_self(), m_cpus.empty() ? -1 : m_cpus[0]);
+  for (size_t idx = 0; idx < m_threads.size(); ++idx) {
+    pin_worker(idx, m_threads[idx]);
+  }
+#endif
+}
+
+void ThreadPool::pin_worker(size_t idx, boost::thread& thread) {
+#ifdef __linux__
+  // The calling thread of a batch takes the first CPU.
+  set_affinity(thread.native_handle(),
+               m_cpus.empty() ? -1 : m_cpus[(idx + 1) % m_cpus.size()]);
+#endif
+}
+
+void ThreadPool::ensure_size(size_t num_threads) {
+  boost::lock_guard<boost::mutex> guard(m_mtx);
+  while (m_threads.size() < num_threads) {
+    boost::thread::attributes attrs;
+    attrs.set_stack_size(STACK_SIZE);
+    auto idx = m_threads.size();
+    m_threads.emplace_back(attrs, [this, idx] { worker_loop(idx); });
+    if (!m_cpus.empty()) {
+      pin_worker(idx, m_threads.back());
+    }
+  }
+}
+
+size_t ThreadPool::size() {
+  boost::lock_guard<boost::mutex> guard(m_mtx);
+  return m_threads.size();
+}
+
+void ThreadPool::join_workers() {
+  {
+    boost::lock_guard<boost::mutex> guard(m_mtx);
+    m_shutdown = true;
+  }
+  m_cv.notify_all();
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+  boost::lock_guard<boost::mutex> guard(m_mtx);
+  m_threads.clear();
+  m_shutdown = false;
+}
+
+void ThreadPool::Batch::drain() {
+  size_t idx;
+  while ((idx = next.fetch_add(1)) < n) {
+    fn(idx);
+    if (done.fetch_add(1) + 1 == n) {
+      boost::lock_guard<boost::mutex> guard(mtx);
+      cv.notify_all();
+    }
+  }
+}
+
+void ThreadPool::run(size_t n, const std::function<void(size_t)>& fn) {
+  if (n == 0) {
+    return;
+  }
+  auto batch = std::make_shared<Batch>(n, fn);
+  if (n > 1) {
+    {
+      boost::lock_guard<boost::mutex> guard(m_mtx);
+      always_assert(!m_shutdown);
+      for (size_t i = 1; i < n; ++i) {
+        m_tickets.push_back(batch);
+      }
+    }
+    if (n == 2) {
+      m_cv.notify_one();
+    } else {
+      m_cv.notify_all();
+    }
+  }
+  batch->drain();
+  // Every index has been claimed by now, so we are only waiting for threads
+  // that are actively running one.
+  boost::unique_lock<boost::mutex> lock(batch->mtx);
+  batch->cv.wait(lock, [&] { return batch->done.load() == n; });
+}
+
+void ThreadPool::worker_loop(size_t idx) {
+  Timeline::set_thread_name("pool worker " + std::to_string(idx));
+  while (true) {
+    std::shared_ptr<Batch> batch;
+    {
+      boost::unique_lock<boost::mutex> lock(m_mtx);
+      m_cv.wait(lock, [this] { return m_shutdown || !m_tickets.empty(); });
+      if (m_tickets.empty()) {
+        return;
+      }
+      batch = std::move(m_tickets.front());
+      m_tickets.pop_front();
+    }
+    // Tickets of a finished batch are harmless: drain() finds every index
+    // already claimed and returns immediately.
+    batch->drain();
+  }
+}
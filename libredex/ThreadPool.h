@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * A process-wide pool of worker threads that stay alive for the whole run, so
+ * that the many short parallel phases of a redex run (every WorkQueue, and so
+ * every walk::parallel call) don't each pay for creating and joining threads.
+ *
+ * Work is handed out in batches: run(n, fn) calls fn(0) ... fn(n - 1), each
+ * exactly once, and blocks until all of them have returned. The calling thread
+ * takes part in the batch, and only waits on indices that some thread has
+ * actually started. That makes nested batches (a pooled task that itself
+ * calls run()) safe even when every pool thread is busy: in the worst case the
+ * caller simply runs the whole batch by itself.
+ *
+ * `n` is also the concurrency limit of the batch: it never occupies more
+ * than n threads, including the caller.
+ *
+ * The workers can be pinned to a set of CPUs, each to one of them, so that a
+ * worker keeps its caches and stays on the socket of the memory it touched
+ * first instead of migrating across sockets. The REDEX_CPUS environment
+ * variable, a list like "0-15,32-47", sets the CPUs at startup, and
+ * REDEX_THREADS sets the default number of threads of parallel work.
+ */
+class ThreadPool {
+ public:
+  static constexpr size_t STACK_SIZE = 8 * 1024 * 1024;
+
+  explicit ThreadPool(size_t num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /*
+   * The shared instance. It is created on first use with one thread per CPU
+   * it may use, and joined at process exit.
+   */
+  static ThreadPool& get();
+
+  /*
+   * The number of CPUs work may run on: those of pin_to_cpus() if any, else
+   * those this process may run on, which can be fewer than the machine has,
+   * e.g. under taskset or in a container.
+   */
+  static unsigned int num_cpus();
+
+  /*
+   * The number of threads REDEX_THREADS asks for, or 0.
+   */
+  static unsigned int configured_threads();
+
+  /*
+   * Parses a CPU list like "0-3,8,10-11". Asserts that it is well formed.
+   */
+  static std::vector<int> parse_cpu_list(const std::string& list);
+
+  /*
+   * Pins the calling thread to the first of `cpus` and the workers, current
+   * and future, to the others in turn, wrapping around. An empty list lifts
+   * the pinning. Only supported on Linux; elsewhere this does nothing.
+   */
+  void pin_to_cpus(std::vector<int> cpus);
+
+  void run(size_t n, const std::function<void(size_t)>& fn);
+
+  /*
+   * Make sure that the pool has at least `num_threads` workers. The pool never
+   * shrinks.
+   */
+  void ensure_size(size_t num_threads);
+
+  size_t size();
+
+  /*
+   * Joins the workers, leaving an empty pool that the next ensure_size()
+   * grows again. fork() only carries the calling thread over to the child,
+   * so a process that forks workers of its own calls this first.
+   */
+  void join_workers();
+
+ private:
+  struct Batch {
+    Batch(size_t n, const std::function<void(size_t)>& fn) : n(n), fn(fn) {}
+
+    // Claim and run indices until there are none left.
+    void drain();
+
+    const size_t n;
+    const std::function<void(size_t)>& fn;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    boost::mutex mtx;
+    boost::condition_variable cv;
+  };
+
+  void worker_loop(size_t idx);
+
+  // Must hold m_mtx.
+  void pin_worker(size_t idx, boost::thread& thread);
+
+  boost::mutex m_mtx;
+  boost::condition_variable m_cv;
+  std::deque<std::shared_ptr<Batch>> m_tickets;
+  std::vector<boost::thread> m_threads;
+  bool m_shutdown{false};
+  std::vector<int> m_cpus;
+};
@@ -0,0 +1,48 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "TimeBudget.h"
+
+#include "PassManager.h"
+#include "Trace.h"
+
+BudgetTracker::BudgetTracker(const TimeBudget& budget)
+    : m_budget(budget),
+      m_pass_deadline(Clock::now() +
+                      std::chrono::milliseconds(budget.pass_ms)) {}
+
+BudgetTracker::MethodClock BudgetTracker::start_method() const {
+  return MethodClock(*this,
+                     m_budget.method_ms != 0,
+                     Clock::now() +
+                         std::chrono::milliseconds(m_budget.method_ms));
+}
+
+void BudgetTracker::record_fallback(const std::string& kind, size_t count) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  m_fallbacks[kind] += count;
+}
+
+size_t BudgetTracker::fallbacks(const std::string& kind) const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto it = m_fallbacks.find(kind);
+  return it == m_fallbacks.end() ? 0 : it->second;
+}
+
+void BudgetTracker::report(PassManager& mgr) const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  for (const auto& pair : m_fallbacks) {
+    TRACE(PM,
+          1,
+          "Time budget ran out: %lu %s\n",
+          pair.second,
+          pair.first.c_str());
+    mgr.incr_metric("time_budget." + pair.first, pair.second);
+  }
+}
@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+class PassManager;
+
+/*
+ * How long a pass, and each method it handles, may take before the pass
+ * falls back to something cheaper -- or leaves the rest alone. Zero means
+ * no limit. Passes read theirs from their config with
+ * PassConfig::get_time_budget().
+ *
+ * Whether a budget runs out depends on the machine and on its load, so the
+ * output of a pass with a budget may vary from build to build. That is the
+ * trade: a build time that a single pathological input can't blow up.
+ */
+struct TimeBudget {
+  uint64_t pass_ms{0};
+  uint64_t method_ms{0};
+
+  bool is_limited() const { return pass_ms != 0 || method_ms != 0; }
+};
+
+/*
+ * Keeps the time of a run of a pass against its budget, and counts the
+ * fallbacks the pass made because of it. The pass clock starts on
+ * construction; each method gets its own clock from start_method(). All the
+ * methods are thread-safe.
+ */
+class BudgetTracker {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit BudgetTracker(const TimeBudget& budget);
+
+  bool pass_exhausted() const {
+    return m_budget.pass_ms != 0 && Clock::now() >= m_pass_deadline;
+  }
+
+  class MethodClock {
+   public:
+    /*
+     * Also true once the pass budget is spent, so that checking the method
+     * clock is enough in the inner loops of a pass.
+     */
+    bool exhausted() const {
+      auto now = Clock::now();
+      return (m_limited && now >= m_deadline) ||
+             (m_tracker.m_budget.pass_ms != 0 &&
+              now >= m_tracker.m_pass_deadline);
+    }
+
+   private:
+    friend class BudgetTracker;
+    MethodClock(const BudgetTracker& tracker,
+                bool limited,
+                Clock::time_point deadline)
+        : m_tracker(tracker), m_limited(limited), m_deadline(deadline) {}
+
+    const BudgetTracker& m_tracker;
+    bool m_limited;
+    Clock::time_point m_deadline;
+  };
+
+  MethodClock start_method() const;
+
+  /*
+   * Counts a fallback of the given kind, e.g. "methods_skipped".
+   */
+  void record_fallback(const std::string& kind, size_t count = 1);
+
+  size_t fallbacks(const std::string& kind) const;
+
+  /*
+   * Adds a "time_budget.<kind>" metric to the current pass for each kind of
+   * fallback recorded, and traces them.
+   */
+  void report(PassManager& mgr) const;
+
+ private:
+  TimeBudget m_budget;
+  Clock::time_point m_pass_deadline;
+  mutable std::mutex m_lock;
+  std::map<std::string, size_t> m_fallbacks;
+};
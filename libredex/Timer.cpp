@@ -9,15 +9,115 @@
 
 #include "Timer.h"
 
+#include <fstream>
+#include <memory>
+
+#include <json/json.h>
+
 #include "Trace.h"
 
+namespace {
+
+struct TimelineEvent {
+  std::string name;
+  int64_t start_us;
+  int64_t duration_us;
+  std::vector<std::pair<const char*, int64_t>> args;
+};
+
+struct ThreadTimeline {
+  uint32_t tid;
+  std::string name;
+  std::vector<TimelineEvent> events;
+};
+
+// Every thread's buffer, kept alive here so threads may exit before write().
+std::mutex s_timelines_lock;
+std::vector<std::shared_ptr<ThreadTimeline>> s_timelines;
+
+ThreadTimeline& this_thread_timeline() {
+  static thread_local ThreadTimeline* s_timeline = [] {
+    auto timeline = std::make_shared<ThreadTimeline>();
+    std::lock_guard<std::mutex> guard(s_timelines_lock);
+    timeline->tid = s_timelines.size();
+    s_timelines.push_back(timeline);
+    return timeline.get();
+  }();
+  return *s_timeline;
+}
+
+int64_t now_us() {
+  static const auto s_epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - s_epoch)
+      .count();
+}
+
+} // namespace
+
+std::atomic<bool> Timeline::s_enabled{false};
+
+void Timeline::set_thread_name(const std::string& name) {
+  if (enabled()) {
+    this_thread_timeline().name = name;
+  }
+}
+
+void Timeline::Span::begin(std::string name) {
+  m_active = true;
+  m_name = std::move(name);
+  m_start_us = now_us();
+}
+
+void Timeline::Span::end() {
+  auto end_us = now_us();
+  this_thread_timeline().events.push_back(
+      {std::move(m_name), m_start_us, end_us - m_start_us, std::move(m_args)});
+}
+
+bool Timeline::write(const std::string& path) {
+  Json::Value events(Json::arrayValue);
+  std::lock_guard<std::mutex> guard(s_timelines_lock);
+  for (const auto& timeline : s_timelines) {
+    if (!timeline->name.empty()) {
+      Json::Value meta;
+      meta["ph"] = "M";
+      meta["name"] = "thread_name";
+      meta["pid"] = 0;
+      meta["tid"] = timeline->tid;
+      meta["args"]["name"] = timeline->name;
+      events.append(meta);
+    }
+    for (const auto& event : timeline->events) {
+      Json::Value value;
+      value["ph"] = "X";
+      value["name"] = event.name;
+      value["pid"] = 0;
+      value["tid"] = timeline->tid;
+      value["ts"] = Json::Int64(event.start_us);
+      value["dur"] = Json::Int64(event.duration_us);
+      for (const auto& arg : event.args) {
+        value["args"][arg.first] = Json::Int64(arg.second);
+      }
+      events.append(value);
+    }
+  }
+  Json::Value trace;
+  trace["traceEvents"] = events;
+  std::ofstream out(path);
+  Json::FastWriter writer;
+  out << writer.write(trace);
+  return out.good();
+}
+
 unsigned Timer::s_indent = 0;
 std::mutex Timer::s_lock;
 Timer::times_t Timer::s_times;
 
 Timer::Timer(const std::string& msg)
   : m_msg(msg),
-    m_start(std::chrono::high_resolution_clock::now())
+    m_start(std::chrono::high_resolution_clock::now()),
+    m_span(msg)
 {
   ++s_indent;
 }
@@ -9,12 +9,81 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
 
+/*
+ * A timeline of nested spans with the thread each ran on, exported in the
+ * Chrome trace event format so it can be opened in chrome://tracing or
+ * ui.perfetto.dev. Recording is off until enable() is called; a span created
+ * while it's off costs one relaxed atomic load.
+ *
+ * Each thread appends to its own buffer, so recording doesn't contend on a
+ * lock. write() must only be called while no spans are open.
+ */
+class Timeline {
+ public:
+  static void enable() { s_enabled.store(true, std::memory_order_relaxed); }
+  static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+  /*
+   * Names the current thread in the exported timeline.
+   */
+  static void set_thread_name(const std::string& name);
+
+  static bool write(const std::string& path);
+
+  class Span {
+   public:
+    explicit Span(const char* name) {
+      if (enabled()) {
+        begin(name);
+      }
+    }
+
+    explicit Span(const std::string& name) {
+      if (enabled()) {
+        begin(name);
+      }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    ~Span() {
+      if (m_active) {
+        end();
+      }
+    }
+
+    /*
+     * Attaches a value to the span, shown when the span is selected.
+     */
+    void set_arg(const char* key, int64_t value) {
+      if (m_active) {
+        m_args.emplace_back(key, value);
+      }
+    }
+
+   private:
+    void begin(std::string name);
+    void end();
+
+    bool m_active{false};
+    std::string m_name;
+    int64_t m_start_us{0};
+    std::vector<std::pair<const char*, int64_t>> m_args;
+  };
+
+ private:
+  static std::atomic<bool> s_enabled;
+};
+
 struct Timer {
   Timer(const std::string& msg);
   ~Timer();
@@ -31,4 +100,5 @@ struct Timer {
   static unsigned s_indent;
   std::string m_msg;
   std::chrono::high_resolution_clock::time_point m_start;
+  Timeline::Span m_span;
 };
@@ -9,6 +9,7 @@
 
 #include "Trace.h"
 
+#include <algorithm>
 #include <array>
 #include <cstdarg>
 #include <cstdio>
@@ -21,8 +22,54 @@
 #include <unordered_map>
 #include <utility>
 
+namespace trace_impl {
+int g_module_levels[N_TRACE_MODULES];
+bool g_method_filter{false};
+} // namespace trace_impl
+
 namespace {
 
+/*
+ * Output is collected per thread and handed to stdio one complete line at a
+ * time, so lines from different threads never interleave and tracing threads
+ * don't queue up behind each other while formatting.
+ */
+struct TraceBuffer {
+  std::string pending;
+  FILE* file{nullptr};
+
+  void append(FILE* out, const char* fmt, va_list ap) {
+    file = out;
+    va_list copy;
+    va_copy(copy, ap);
+    auto len = vsnprintf(nullptr, 0, fmt, copy);
+    va_end(copy);
+    if (len <= 0) {
+      return;
+    }
+    auto old_size = pending.size();
+    pending.resize(old_size + len + 1);
+    vsnprintf(&pending[old_size], len + 1, fmt, ap);
+    pending.resize(old_size + len);
+    auto last_newline = pending.rfind('\n');
+    if (last_newline != std::string::npos) {
+      flush(last_newline + 1);
+    }
+  }
+
+  void flush(size_t len) {
+    fwrite(pending.data(), 1, len, file);
+    fflush(file);
+    pending.erase(0, len);
+  }
+
+  ~TraceBuffer() {
+    if (!pending.empty()) {
+      flush(pending.size());
+    }
+  }
+};
+
 struct Tracer {
 
   bool m_show_timestamps{false};
@@ -55,6 +102,10 @@ struct Tracer {
 
     init_trace_modules(traceenv);
     init_trace_file(envfile);
+    for (int i = 0; i < N_TRACE_MODULES; ++i) {
+      trace_impl::g_module_levels[i] = std::max(m_level, m_traces[i]);
+    }
+    trace_impl::g_method_filter = m_method_filter != nullptr;
 
     if (show_timestamps) {
       m_show_timestamps = true;
@@ -74,10 +125,6 @@ struct Tracer {
     }
   }
 
-  bool traceEnabled(TraceModule module, int level) {
-    return level <= m_level || level <= m_traces[module];
-  }
-
   void trace(TraceModule module, int level, const char* fmt, va_list ap) {
     if (m_method_filter && !TraceContext::s_current_method.empty()) {
       if (strstr(TraceContext::s_current_method.c_str(), m_method_filter) ==
@@ -85,7 +132,7 @@ struct Tracer {
         return;
       }
     }
-    std::lock_guard<std::mutex> guard(TraceContext::s_trace_mutex);
+    static thread_local TraceBuffer s_buffer;
     if (m_show_timestamps) {
       auto t = std::time(nullptr);
       struct tm local_tm;
@@ -96,19 +143,28 @@ struct Tracer {
 #endif
       std::array<char, 40> buf;
       std::strftime(buf.data(), sizeof(buf), "%c", &local_tm);
-      fprintf(m_file, "[%s]", buf.data());
+      append(s_buffer, "[%s]", buf.data());
       if (!m_show_tracemodule) {
-        fprintf(m_file, " ");
+        append(s_buffer, " ");
       }
     }
     if (m_show_tracemodule) {
-      fprintf(m_file, "[%s:%d] ", m_module_id_name_map[module].c_str(), level);
+      append(s_buffer,
+             "[%s:%d] ",
+             m_module_id_name_map.at(module).c_str(),
+             level);
     }
-    vfprintf(m_file, fmt, ap);
-    fflush(m_file);
+    s_buffer.append(m_file, fmt, ap);
   }
 
  private:
+  void append(TraceBuffer& buffer, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    buffer.append(m_file, fmt, ap);
+    va_end(ap);
+  }
+
   void init_trace_modules(const char* traceenv) {
     std::unordered_map<std::string, int> module_id_map;
 #define TM(x) module_id_map[ #x ] = x;
@@ -161,23 +217,13 @@ struct Tracer {
 
  private:
   FILE* m_file{nullptr};
-  long m_level{0};
-  std::array<long, N_TRACE_MODULES> m_traces;
+  int m_level{0};
+  std::array<int, N_TRACE_MODULES> m_traces{};
 };
 
 static Tracer tracer;
 }
 
-#ifdef NDEBUG
-bool traceEnabled(TraceModule, int) {
-  return false;
-}
-#else
-bool traceEnabled(TraceModule module, int level) {
-  return tracer.traceEnabled(module, level);
-}
-#endif
-
 void trace(TraceModule module, int level, const char* fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
@@ -186,4 +232,3 @@ void trace(TraceModule module, int level, const char* fmt, ...) {
 }
 
 thread_local std::string TraceContext::s_current_method;
-std::mutex TraceContext::s_trace_mutex;
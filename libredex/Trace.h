@@ -34,6 +34,7 @@
   TM(DC)                 \
   TM(DCE)                \
   TM(DEDUP_BLOCKS)       \
+  TM(DEDUP_METHODS)      \
   TM(DEDUP_RES)          \
   TM(DELINIT)            \
   TM(DELMET)             \
@@ -97,10 +98,21 @@ TMS
   N_TRACE_MODULES,
 };
 
-bool traceEnabled(TraceModule module, int level);
+namespace trace_impl {
+// The level each module is traced at: the larger of the global TRACE level
+// and the module's own. Filled in once, before main() runs.
+extern int g_module_levels[N_TRACE_MODULES];
+// Whether TRACE_METHOD_FILTER is set, i.e. whether TraceContext is needed.
+extern bool g_method_filter;
+} // namespace trace_impl
+
 #ifdef NDEBUG
+inline bool traceEnabled(TraceModule, int) { return false; }
 #define TRACE(...)
 #else
+inline bool traceEnabled(TraceModule module, int level) {
+  return level <= trace_impl::g_module_levels[module];
+}
 void trace(TraceModule module, int level, const char* fmt, ...);
 #define TRACE(module, level, fmt, ...)          \
   do {                                          \
@@ -110,12 +122,41 @@ void trace(TraceModule module, int level, const char* fmt, ...);
   } while (0)
 #endif // NDEBUG
 
+/*
+ * Names the method the current thread is working on, for
+ * TRACE_METHOD_FILTER. Without a filter this does nothing; the pointer
+ * overload doesn't even build the name.
+ */
 struct TraceContext {
   explicit TraceContext(const std::string& current_method) {
-    s_current_method = current_method;
+    if (trace_impl::g_method_filter) {
+      set(current_method);
+    }
+  }
+
+  explicit TraceContext(const char* current_method)
+      : TraceContext(std::string(current_method)) {}
+
+  template <class Named>
+  explicit TraceContext(const Named* named) {
+    if (trace_impl::g_method_filter) {
+      set(named->get_deobfuscated_name());
+    }
+  }
+
+  ~TraceContext() {
+    if (m_active) {
+      s_current_method.clear();
+    }
   }
-  ~TraceContext() { s_current_method.clear(); }
 
   thread_local static std::string s_current_method;
-  static std::mutex s_trace_mutex;
+
+ private:
+  void set(const std::string& current_method) {
+    m_active = true;
+    s_current_method = current_method;
+  }
+
+  bool m_active{false};
 };
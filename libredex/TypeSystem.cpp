@@ -15,11 +15,19 @@
 
 namespace {
 
+/**
+ * Build the parent chains of the types under `type`, and number them in
+ * preorder so that the children of a type are the ones within its interval.
+ */
 void make_instanceof_table(
     InstanceOfTable& instance_of_table,
+    SubtypeIntervals& intervals,
+    TypeVector& preorder,
     const ClassHierarchy& hierarchy,
     const DexType* type,
     size_t depth = 1) {
+  auto begin = static_cast<uint32_t>(preorder.size());
+  preorder.emplace_back(type);
   auto& parent_chain = instance_of_table[type];
   const auto cls = type_class(type);
   if (cls != nullptr) {
@@ -36,10 +44,13 @@ void make_instanceof_table(
   always_assert(parent_chain.size() == depth);
 
   const auto& children = hierarchy.find(type);
-  if (children == hierarchy.end()) return;
-  for (const auto& child : children->second) {
-    make_instanceof_table(instance_of_table, hierarchy, child, depth + 1);
+  if (children != hierarchy.end()) {
+    for (const auto& child : children->second) {
+      make_instanceof_table(instance_of_table, intervals, preorder, hierarchy,
+                            child, depth + 1);
+    }
   }
+  intervals[type] = {begin, static_cast<uint32_t>(preorder.size())};
 }
 
 void load_interface_children(ClassHierarchy& children, const DexClass* intf) {
@@ -73,7 +84,8 @@ void load_interface_children(const Scope& scope, ClassHierarchy& children) {
 const TypeSet TypeSystem::empty_set = TypeSet();
 const TypeVector TypeSystem::empty_vec = TypeVector();
 
-TypeSystem::TypeSystem(const Scope& scope) : m_class_scopes(scope) {
+TypeSystem::TypeSystem(const Scope& scope)
+    : m_class_scopes(::get_class_scopes(scope)) {
   load_interface_children(scope, m_intf_children);
   make_instanceof_interfaces_table();
 }
@@ -125,7 +137,7 @@ const VirtualScope* TypeSystem::find_virtual_scope(
   auto type = meth->get_class();
   while (type != nullptr) {
     TRACE(VIRT, 1, "check... %s\n", SHOW(type));
-    for (const auto& scope : m_class_scopes.get(type)) {
+    for (const auto& scope : m_class_scopes->get(type)) {
       TRACE(VIRT, 1, "check... %s\n", SHOW(scope->methods[0].first));
       if (match(scope->methods[0].first, meth)) {
         TRACE(VIRT, 1, "return scope\n");
@@ -170,7 +182,7 @@ std::vector<const DexMethod*> TypeSystem::select_from(
 
 void TypeSystem::make_instanceof_interfaces_table() {
   TypeVector no_parents;
-  const auto& hierarchy = m_class_scopes.get_class_hierarchy();
+  const auto& hierarchy = m_class_scopes->get_class_hierarchy();
   for (const auto& children_it : hierarchy) {
     const auto parent = children_it.first;
     const auto parent_cls = type_class(parent);
@@ -179,7 +191,8 @@ void TypeSystem::make_instanceof_interfaces_table() {
   }
   no_parents.emplace_back(get_object_type());
   for (const auto& root : no_parents) {
-    make_instanceof_table(m_instanceof_table, hierarchy, root);
+    make_instanceof_table(m_instanceof_table, m_subtype_intervals,
+                          m_preorder, hierarchy, root);
   }
   for (const auto& root : no_parents) {
     make_interfaces_table(root);
@@ -203,7 +216,7 @@ void TypeSystem::make_interfaces_table(const DexType* type) {
     }
   }
 
-  const auto& hierarchy = m_class_scopes.get_class_hierarchy();
+  const auto& hierarchy = m_class_scopes->get_class_hierarchy();
   const auto& children = hierarchy.find(type);
   if (children == hierarchy.end()) return;
   for (const auto& child : children->second) {
@@ -13,12 +13,24 @@
 #include "ClassHierarchy.h"
 #include "VirtualScope.h"
 
+#include <memory>
 #include <unordered_map>
 
 using TypeVector = std::vector<const DexType*>;
 using InstanceOfTable = std::unordered_map<const DexType*, TypeVector>;
 using TypeToTypeSet = std::unordered_map<const DexType*, TypeSet>;
 
+/**
+ * The range of positions of a type and of all its children in a preorder
+ * walk of the class hierarchy: the type is at `begin` and its children fill
+ * the positions up to `end` (excluded).
+ */
+struct SubtypeInterval {
+  uint32_t begin;
+  uint32_t end;
+};
+using SubtypeIntervals = std::unordered_map<const DexType*, SubtypeInterval>;
+
 /**
  * TypeSystem
  * A class that computes information and caches on the current known state
@@ -33,10 +45,12 @@ class TypeSystem {
   static const TypeSet empty_set;
   static const TypeVector empty_vec;
 
-  ClassScopes m_class_scopes;
+  std::shared_ptr<const ClassScopes> m_class_scopes;
   ClassHierarchy m_intf_parents;
   ClassHierarchy m_intf_children;
   InstanceOfTable m_instanceof_table;
+  SubtypeIntervals m_subtype_intervals;
+  TypeVector m_preorder;
   TypeToTypeSet m_interfaces;
 
  public:
@@ -47,8 +61,8 @@ class TypeSystem {
    * The type must be a class (not an interface).
    */
   const TypeSet& get_children(const DexType* type) const {
-    const auto& children = m_class_scopes.get_class_hierarchy().find(type);
-    return children != m_class_scopes.get_class_hierarchy().end()
+    const auto& children = m_class_scopes->get_class_hierarchy().find(type);
+    return children != m_class_scopes->get_class_hierarchy().end()
         ? children->second : empty_set;
   }
 
@@ -57,8 +71,13 @@ class TypeSystem {
    * The type must be a class (not an interface).
    */
   void get_all_children(const DexType* type, TypeSet& children) const {
-    return ::get_all_children(
-        m_class_scopes.get_class_hierarchy(), type, children);
+    const auto& interval = m_subtype_intervals.find(type);
+    if (interval == m_subtype_intervals.end()) {
+      return ::get_all_children(
+          m_class_scopes->get_class_hierarchy(), type, children);
+    }
+    children.insert(m_preorder.begin() + interval->second.begin + 1,
+                    m_preorder.begin() + interval->second.end);
   }
 
   /**
@@ -105,16 +124,14 @@ class TypeSystem {
    * The type must be a class (not an interface).
    */
   bool is_subtype(const DexType* parent, const DexType* child) const {
-    const auto& parent_it = m_instanceof_table.find(parent);
-    const auto& child_it = m_instanceof_table.find(child);
-    if (parent_it == m_instanceof_table.end() ||
-        child_it == m_instanceof_table.end()) {
+    const auto& parent_it = m_subtype_intervals.find(parent);
+    const auto& child_it = m_subtype_intervals.find(child);
+    if (parent_it == m_subtype_intervals.end() ||
+        child_it == m_subtype_intervals.end()) {
       return false;
     }
-    const auto& p_chain = parent_it->second;
-    const auto& c_chain = child_it->second;
-    if (p_chain.size() > c_chain.size()) return false;
-    return c_chain.at(p_chain.size() - 1) == parent;
+    return parent_it->second.begin <= child_it->second.begin &&
+        child_it->second.end <= parent_it->second.end;
   }
 
   /**
@@ -123,8 +140,8 @@ class TypeSystem {
    * or an interface DAG.
    */
   bool implements(const DexType* cls, const DexType* intf) const {
-    const auto& implementors = m_class_scopes.get_interface_map().find(intf);
-    if (implementors == m_class_scopes.get_interface_map().end()) return false;
+    const auto& implementors = m_class_scopes->get_interface_map().find(intf);
+    if (implementors == m_class_scopes->get_interface_map().end()) return false;
     return implementors->second.count(cls) > 0;
   }
 
@@ -136,8 +153,8 @@ class TypeSystem {
    * interface will be included in the returning set.
    */
   const TypeSet& get_implementors(const DexType* intf) const {
-    const auto& implementors = m_class_scopes.get_interface_map().find(intf);
-    if (implementors == m_class_scopes.get_interface_map().end()) {
+    const auto& implementors = m_class_scopes->get_interface_map().find(intf);
+    if (implementors == m_class_scopes->get_interface_map().end()) {
       return empty_set;
     }
     return implementors->second;
@@ -180,7 +197,7 @@ class TypeSystem {
    * such it should not exceed it.
    */
   const ClassScopes& get_class_scopes() const {
-    return m_class_scopes;
+    return *m_class_scopes;
   }
 
   /**
@@ -188,7 +205,7 @@ class TypeSystem {
    */
   const VirtualScope* find_virtual_scope(const DexMethod* meth) const;
   InterfaceScope find_interface_scope(const DexMethod* meth) const {
-    return m_class_scopes.find_interface_scope(meth);
+    return m_class_scopes->find_interface_scope(meth);
   }
 
   /**
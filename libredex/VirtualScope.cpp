@@ -14,8 +14,10 @@
 #include "ReachableClasses.h"
 #include "Timer.h"
 #include "Trace.h"
+#include "WorkQueue.h"
 
 #include <map>
+#include <mutex>
 #include <set>
 
 namespace {
@@ -261,7 +263,7 @@ void mark_methods(const DexType* type,
         TRACE(VIRT, 6, "FINAL %s\n", SHOW(first_scope.methods[0].first));
         first_scope.methods[0].second |= FINAL;
       } else {
-        for (auto& meth = ++scopes[0].methods.begin();
+        for (auto meth = ++scopes[0].methods.begin();
              meth != first_scope.methods.end();
              meth++) {
           TRACE(VIRT, 6, "OVERRIDE %s\n", SHOW((*meth).first));
@@ -271,7 +273,7 @@ void mark_methods(const DexType* type,
       // all others must be interfaces but we have a definition
       // in base so they must all be override
       if (scopes.size() > 1) {
-        for (auto& scope = ++scopes.begin(); scope != scopes.end(); scope++) {
+        for (auto scope = ++scopes.begin(); scope != scopes.end(); scope++) {
           always_assert((*scope).methods.size() > 0);
           TRACE(VIRT, 6, "OVERRIDE %s\n", SHOW((*scope).methods[0].first));
           (*scope).methods[0].second |= OVERRIDE;
@@ -476,7 +478,7 @@ DexMethod* make_miranda(const DexType* type,
   return static_cast<DexMethod*>(miranda);
 }
 
-bool load_interfaces_methods(const std::deque<DexType*>&, BaseIntfSigs&);
+bool load_interfaces_methods(const DexTypeList::Types&, BaseIntfSigs&);
 
 /**
  * Load methods for a given interface and its super interfaces.
@@ -502,7 +504,7 @@ bool load_interface_methods(const DexClass* intf_cls,
  * Load methods for a list of interfaces.
  * If any interface escapes (no DexClass*) return true.
  */
-bool load_interfaces_methods(const std::deque<DexType*>& interfaces,
+bool load_interfaces_methods(const DexTypeList::Types& interfaces,
                              BaseIntfSigs& intf_methods) {
   bool escaped = false;
   for (const auto& intf : interfaces) {
@@ -648,7 +650,8 @@ void load_methods(const DexType* type, SignatureMap& sig_map) {
  */
 bool build_signature_map(const ClassHierarchy& hierarchy,
                          const DexType* type,
-                         SignatureMap& sig_map) {
+                         SignatureMap& sig_map,
+                         bool parallel = false) {
   always_assert_log(sig_map.size() == 0,
                     "intf_methods and children_methods are out params");
   const TypeSet& children = hierarchy.at(type);
@@ -664,16 +667,38 @@ bool build_signature_map(const ClassHierarchy& hierarchy,
   // recurse through every child to collect all methods
   // and interface methods under type
   bool escape_up = false;
-  for (const auto& child : children) {
-    SignatureMap child_sig_map;
-    escape_up =
-        build_signature_map(hierarchy, child, child_sig_map) || escape_up;
-    TRACE(VIRT,
-          3,
-          "* Merging sig map of %s with child %s\n",
-          SHOW(type),
-          SHOW(child));
-    merge(base_sigs, intf_sig_map, sig_map, child_sig_map);
+  if (parallel && children.size() > 1) {
+    // The sig maps of the children don't depend on each other, so they are
+    // built concurrently. They are still merged in order, which keeps the
+    // result deterministic.
+    std::vector<const DexType*> ordered(children.begin(), children.end());
+    std::vector<SignatureMap> child_sig_maps(ordered.size());
+    std::vector<char> child_escapes(ordered.size(), false);
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      child_escapes[i] =
+          build_signature_map(hierarchy, ordered[i], child_sig_maps[i]);
+    });
+    for (size_t i = 0; i < ordered.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+    for (size_t i = 0; i < ordered.size(); ++i) {
+      escape_up = child_escapes[i] || escape_up;
+      merge(base_sigs, intf_sig_map, sig_map, child_sig_maps[i]);
+      SignatureMap().swap(child_sig_maps[i]);
+    }
+  } else {
+    for (const auto& child : children) {
+      SignatureMap child_sig_map;
+      escape_up =
+          build_signature_map(hierarchy, child, child_sig_map) || escape_up;
+      TRACE(VIRT,
+            3,
+            "* Merging sig map of %s with child %s\n",
+            SHOW(type),
+            SHOW(child));
+      merge(base_sigs, intf_sig_map, sig_map, child_sig_map);
+    }
   }
 
   TRACE(VIRT, 3, "* Marking methods at %s\n", SHOW(type));
@@ -789,7 +814,10 @@ void get_root_scopes(const SignatureMap& sig_map,
 
 SignatureMap build_signature_map(const ClassHierarchy& class_hierarchy) {
   SignatureMap signature_map;
-  build_signature_map(class_hierarchy, get_object_type(), signature_map);
+  build_signature_map(class_hierarchy,
+                      get_object_type(),
+                      signature_map,
+                      /* parallel */ true);
   return signature_map;
 }
 
@@ -921,3 +949,60 @@ InterfaceScope ClassScopes::find_interface_scope(const DexMethod* meth) const {
   }
   return intf_scope;
 }
+
+namespace {
+
+/**
+ * Everything a ClassScopes depends on: the classes in scope, their
+ * hierarchy and their virtual methods. Access flags don't matter, except
+ * for telling interfaces apart.
+ */
+std::vector<const void*> class_scopes_key(const Scope& scope) {
+  std::vector<const void*> key;
+  for (const auto& cls : scope) {
+    key.push_back(cls);
+    key.push_back(cls->get_super_class());
+    key.push_back(cls->get_interfaces());
+    key.push_back(reinterpret_cast<const void*>(
+        static_cast<uintptr_t>(is_interface(cls))));
+    const auto& vmethods = cls->get_vmethods();
+    key.push_back(reinterpret_cast<const void*>(vmethods.size()));
+    for (const auto& vmeth : vmethods) {
+      key.push_back(vmeth);
+      key.push_back(vmeth->get_name());
+      key.push_back(vmeth->get_proto());
+    }
+  }
+  return key;
+}
+
+struct SharedClassScopes {
+  std::mutex lock;
+  std::vector<const void*> key;
+  std::shared_ptr<const ClassScopes> class_scopes;
+};
+
+SharedClassScopes& shared_class_scopes() {
+  static SharedClassScopes s_shared;
+  return s_shared;
+}
+
+}
+
+std::shared_ptr<const ClassScopes> get_class_scopes(const Scope& scope) {
+  auto& shared = shared_class_scopes();
+  std::lock_guard<std::mutex> guard(shared.lock);
+  auto key = class_scopes_key(scope);
+  if (shared.class_scopes == nullptr || key != shared.key) {
+    shared.class_scopes = std::make_shared<const ClassScopes>(scope);
+    shared.key = std::move(key);
+  }
+  return shared.class_scopes;
+}
+
+void invalidate_class_scopes() {
+  auto& shared = shared_class_scopes();
+  std::lock_guard<std::mutex> guard(shared.lock);
+  shared.key.clear();
+  shared.class_scopes = nullptr;
+}
@@ -15,6 +15,7 @@
 #include "Timer.h"
 #include <vector>
 #include <map>
+#include <memory>
 #include <unordered_map>
 
 
@@ -420,6 +421,22 @@ class ClassScopes {
   void build_interface_scopes();
 };
 
+/**
+ * Return the ClassScopes for the given scope.
+ * The ClassScopes is shared by all callers for as long as the classes in
+ * scope, their hierarchy and their virtual methods stay the same, so that
+ * passes don't build it again when nothing relevant has changed. Checking
+ * that is linear in the number of virtual methods, which is much cheaper
+ * than building the scopes.
+ */
+std::shared_ptr<const ClassScopes> get_class_scopes(const Scope& scope);
+
+/**
+ * Drop the shared ClassScopes, e.g. because the types it refers to are
+ * about to be deleted.
+ */
+void invalidate_class_scopes();
+
 //
 // Helpers
 //
@@ -458,16 +475,16 @@ inline std::vector<DexMethod*> devirtualize(const SignatureMap& sig_map) {
 inline std::vector<DexMethod*> devirtualize(
     const std::vector<DexClass*>& scope) {
   Timer timer("Devirtualizer");
-  ClassHierarchy class_hierarchy = build_type_hierarchy(scope);
-  auto signature_map = build_signature_map(class_hierarchy);
-  return devirtualize(signature_map);
+  return devirtualize(get_class_scopes(scope)->get_signature_map());
 }
 
-inline bool can_devirtualize(SignatureMap& sig_map, DexMethod* meth) {
+inline bool can_devirtualize(const SignatureMap& sig_map, DexMethod* meth) {
   always_assert(meth->is_virtual());
-  auto& proto_map = sig_map[meth->get_name()];
-  auto& scopes = proto_map[meth->get_proto()];
-  for (const auto& scope : scopes) {
+  const auto& proto_map = sig_map.find(meth->get_name());
+  if (proto_map == sig_map.end()) return false;
+  const auto& scopes = proto_map->second.find(meth->get_proto());
+  if (scopes == proto_map->second.end()) return false;
+  for (const auto& scope : scopes->second) {
     if (scope.type != meth->get_class()) {
       continue;
     }
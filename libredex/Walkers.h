@@ -19,6 +19,8 @@
 #include "DexClass.h"
 #include "IRCode.h"
 #include "Match.h"
+#include "ScratchArena.h"
+#include "SlowestMethods.h"
 #include "WorkQueue.h"
 
 /**
@@ -176,8 +178,9 @@ class walk {
   static void matching_opcodes(const Classes& classes,
                                const Predicate& predicate,
                                const Walker& walker) {
+    auto required = m::required_opcode_classes(predicate);
     for (const auto& cls : classes) {
-      iterate_matching(cls, predicate, walker);
+      iterate_matching(cls, predicate, required, walker);
     }
   }
 
@@ -194,8 +197,9 @@ class walk {
   static void matching_opcodes_in_block(const Classes& classes,
                                         const Predicate& predicate,
                                         const Walker& walker) {
+    auto required = m::required_opcode_classes(predicate);
     for (const auto& cls : classes) {
-      iterate_matching_block(cls, predicate, walker);
+      iterate_matching_block(cls, predicate, required, walker);
     }
   }
 
@@ -207,11 +211,13 @@ class walk {
 
   static void iterate_methods(const DexClass* cls, MethodWalkerFn walker) {
     for (auto dmethod : cls->get_dmethods()) {
-      TraceContext context(dmethod->get_deobfuscated_name());
+      TraceContext context(dmethod);
+      SlowestMethods::Scope timed(dmethod);
       walker(dmethod);
     }
     for (auto vmethod : cls->get_vmethods()) {
-      TraceContext context(vmethod->get_deobfuscated_name());
+      TraceContext context(vmethod);
+      SlowestMethods::Scope timed(vmethod);
       walker(vmethod);
     }
   }
@@ -280,11 +286,18 @@ class walk {
             size_t N = std::tuple_size<Predicate>::value,
             typename Walker = void(DexMethod*,
                                    const std::vector<IRInstruction*>&)>
-  static void iterate_matching(DexClass* cls,
-                               const Predicate& predicate,
-                               const Walker& walker) {
+  static void iterate_matching(
+      DexClass* cls,
+      const Predicate& predicate,
+      const std::vector<opcode::OpcodeClasses>& required,
+      const Walker& walker) {
     iterate_code(
-        cls, all_methods, [&predicate, &walker](DexMethod* m, IRCode& ir_code) {
+        cls,
+        all_methods,
+        [&predicate, &required, &walker](DexMethod* m, IRCode& ir_code) {
+          if (!m::may_contain(ir_code, required)) {
+            return;
+          }
           std::vector<IRInstruction*> insns;
           for (auto& mie : InstructionIterable(ir_code)) {
             insns.emplace_back(mie.insn);
@@ -302,11 +315,19 @@ class walk {
             size_t N = std::tuple_size<Predicate>::value,
             typename Walker = void(DexMethod*,
                                    const std::vector<IRInstruction*>&)>
-  static void iterate_matching_block(DexClass* cls,
-                                     const Predicate& predicate,
-                                     const Walker& walker) {
+  static void iterate_matching_block(
+      DexClass* cls,
+      const Predicate& predicate,
+      const std::vector<opcode::OpcodeClasses>& required,
+      const Walker& walker) {
     iterate_code(
-        cls, all_methods, [&predicate, &walker](DexMethod* m, IRCode& ir_code) {
+        cls,
+        all_methods,
+        [&predicate, &required, &walker](DexMethod* m, IRCode& ir_code) {
+          // Skips building the CFG of the methods that cannot match.
+          if (!m::may_contain(ir_code, required)) {
+            return;
+          }
           std::vector<std::vector<IRInstruction*>> method_matches;
           ir_code.build_cfg();
           for (Block* block : ir_code.cfg().blocks()) {
@@ -345,6 +366,7 @@ class walk {
     static void classes(Classes const& classes,
                         ClassWalkerFn walker,
                         size_t num_threads = default_num_threads()) {
+      Timeline::Span span("walk::parallel::classes");
       auto wq = workqueue_foreach<DexClass*>( // over-parallelized maybe
           [&walker](DexClass* cls) { walker(cls); },
           num_threads);
@@ -358,6 +380,7 @@ class walk {
     static void methods(const Classes& classes,
                         MethodWalkerFn walker,
                         size_t num_threads = default_num_threads()) {
+      Timeline::Span span("walk::parallel::methods");
       auto wq = workqueue_foreach<DexClass*>(
           [&walker](DexClass* cls) { walk::iterate_methods(cls, walker); },
           num_threads);
@@ -368,6 +391,9 @@ class walk {
      * Call `walker` on all methods in `classes` in parallel. Then combine the
      * Output with `reducer` function. Make sure all global information needed
      * is copied locally per thread using DataInitializerFn.
+     *
+     * This is a wrapper around reduce_method_list(); see there for how the
+     * methods get scheduled.
      */
     template <class Data,
               class Output,
@@ -381,27 +407,71 @@ class walk {
                                  DataInitializerFn data_initializer,
                                  const Output& init = Output(),
                                  size_t num_threads = default_num_threads()) {
-      auto wq = WorkQueue<DexClass*, Data, Output>(
-          [&](Data& data, DexClass* cls) {
-            Output out = init;
-            for (auto dmethod : cls->get_dmethods()) {
-              TraceContext context(dmethod->get_deobfuscated_name());
-              out = reducer(out, walker(data, dmethod));
-            }
-            for (auto vmethod : cls->get_vmethods()) {
-              TraceContext context(vmethod->get_deobfuscated_name());
-              out = reducer(out, walker(data, vmethod));
-            }
-            return out;
+      std::vector<DexMethod*> methods;
+      for (const auto& cls : classes) {
+        auto& dmethods = cls->get_dmethods();
+        auto& vmethods = cls->get_vmethods();
+        methods.insert(methods.end(), dmethods.begin(), dmethods.end());
+        methods.insert(methods.end(), vmethods.begin(), vmethods.end());
+      }
+      return reduce_method_list<Data, Output>(
+          methods, walker, reducer, data_initializer, init, num_threads);
+    }
+
+    /**
+     * Like reduce_methods(), but over an explicit list of methods.
+     *
+     * Every method is its own task, and tasks are handed out longest-first by
+     * instruction count, so that a single huge method (think giant switches
+     * in generated code) starts early instead of serializing the tail of the
+     * walk. Methods are added in increasing size: each worker pops from the
+     * back of its own deque and so sees its largest methods first, while idle
+     * workers steal the small ones from the front.
+     *
+     * Each walker call runs in its own ScratchArena::Scope, so the walker can
+     * put its temporaries in the scratch arena of its thread. Like every
+     * walk over methods, each call is timed for SlowestMethods.
+     */
+    template <class Data,
+              class Output,
+              class MethodWalkerFn = Output(Data&, DexMethod*),
+              class OutputReducerFn = Output(Output, Output),
+              class DataInitializerFn = Data(int)>
+    Output static reduce_method_list(
+        const std::vector<DexMethod*>& methods,
+        MethodWalkerFn walker,
+        OutputReducerFn reducer,
+        DataInitializerFn data_initializer,
+        const Output& init = Output(),
+        size_t num_threads = default_num_threads()) {
+      Timeline::Span span("walk::parallel::reduce_method_list");
+      auto wq = WorkQueue<DexMethod*, Data, Output>(
+          [&](Data& data, DexMethod* method) {
+            TraceContext context(method);
+            SlowestMethods::Scope timed(method);
+            ScratchArena::Scope scratch;
+            return walker(data, method);
           },
           reducer,
           data_initializer,
           num_threads);
 
-      for (const auto& cls : classes) {
-        wq.add_item(cls);
-      };
-      return wq.run_all();
+      std::vector<std::pair<size_t, DexMethod*>> sized;
+      sized.reserve(methods.size());
+      for (auto method : methods) {
+        auto code = method->get_code();
+        sized.emplace_back(code ? code->count_opcodes() : 0, method);
+      }
+      std::stable_sort(sized.begin(),
+                       sized.end(),
+                       [](const std::pair<size_t, DexMethod*>& a,
+                          const std::pair<size_t, DexMethod*>& b) {
+                         return a.first < b.first;
+                       });
+      for (const auto& p : sized) {
+        wq.add_item(p.second);
+      }
+      return wq.run_all(init);
     }
 
     /**
@@ -411,6 +481,7 @@ class walk {
     static void fields(const Classes& classes,
                        FieldWalkerFn walker,
                        size_t num_threads = default_num_threads()) {
+      Timeline::Span span("walk::parallel::fields");
       auto wq = workqueue_foreach<DexClass*>(
           [&walker](DexClass* cls) { walk::iterate_fields(cls, walker); },
           num_threads);
@@ -426,6 +497,7 @@ class walk {
                      MethodFilterFn filter,
                      CodeWalkerFn walker,
                      size_t num_threads = default_num_threads()) {
+      Timeline::Span span("walk::parallel::code");
       auto wq = workqueue_foreach<DexClass*>(
           [&filter, &walker](DexClass* cls) {
             walk::iterate_code(cls, filter, walker);
@@ -453,6 +525,7 @@ class walk {
                         MethodFilterFn filter,
                         InsnWalkerFn walker,
                         size_t num_threads = default_num_threads()) {
+      Timeline::Span span("walk::parallel::opcodes");
       auto wq = workqueue_foreach<DexClass*>(
           [&filter, &walker](DexClass* cls) {
             walk::iterate_opcodes(cls, filter, walker);
@@ -471,6 +544,79 @@ class walk {
       walk::parallel::opcodes(classes, all_methods, walker, num_threads);
     }
 
+    /**
+     * Call `walker` on the code of every method in `classes` that is approved
+     * by `filter`, in parallel. The walker accumulates into an Output that is
+     * private to the class being visited, so it needs no locking. The
+     * per-class Outputs are then combined with `reducer` in the order of
+     * `classes`, which makes the result deterministic even when `reducer`
+     * isn't commutative. As with reduce_methods(), `init` should be an
+     * identity of `reducer`.
+     *
+     * This is meant for the read-only gather phases of passes: anything the
+     * walker doesn't write into its accumulator must be safe to read
+     * concurrently.
+     */
+    template <class Output, class Classes>
+    static Output reduce_code(
+        const Classes& classes,
+        MethodFilterFn filter,
+        const std::function<void(Output&, DexMethod*, IRCode&)>& walker,
+        const std::function<Output(Output, Output)>& reducer,
+        const Output& init = Output(),
+        size_t num_threads = default_num_threads()) {
+      Timeline::Span span("walk::parallel::reduce_code");
+      std::vector<DexClass*> class_list;
+      for (const auto& cls : classes) {
+        class_list.push_back(cls);
+      }
+      std::vector<Output> results(class_list.size(), init);
+      auto wq = workqueue_foreach<size_t>(
+          [&](size_t idx) {
+            auto& acc = results[idx];
+            walk::iterate_code(class_list[idx],
+                               filter,
+                               [&acc, &walker](DexMethod* m, IRCode& code) {
+                                 walker(acc, m, code);
+                               });
+          },
+          num_threads);
+      for (size_t idx = 0; idx < class_list.size(); ++idx) {
+        wq.add_item(idx);
+      }
+      wq.run_all();
+
+      Output out = init;
+      for (auto& result : results) {
+        out = reducer(std::move(out), std::move(result));
+      }
+      return out;
+    }
+
+    /**
+     * Same as reduce_code(), but `walker` is called on every instruction.
+     */
+    template <class Output, class Classes>
+    static Output reduce_opcodes(
+        const Classes& classes,
+        MethodFilterFn filter,
+        const std::function<void(Output&, DexMethod*, IRInstruction*)>& walker,
+        const std::function<Output(Output, Output)>& reducer,
+        const Output& init = Output(),
+        size_t num_threads = default_num_threads()) {
+      return reduce_code<Output>(
+          classes,
+          filter,
+          [&walker](Output& acc, DexMethod* m, IRCode& code) {
+            for (const MethodItemEntry& mie : InstructionIterable(code)) {
+              walker(acc, m, mie.insn);
+            }
+          },
+          reducer,
+          init,
+          num_threads);
+    }
+
     /**
      * Call `walker` on all annotations in `classes` in parallel.
      */
@@ -498,9 +644,10 @@ class walk {
                                  const Predicate& predicate,
                                  const Walker& walker,
                                  size_t num_threads = default_num_threads()) {
+      auto required = m::required_opcode_classes(predicate);
       auto wq = workqueue_foreach<DexClass*>(
-          [&predicate, &walker](DexClass* cls) {
-            walk::iterate_matching(cls, predicate, walker);
+          [&predicate, &required, &walker](DexClass* cls) {
+            walk::iterate_matching(cls, predicate, required, walker);
           },
           num_threads);
       run_all(wq, classes);
@@ -521,9 +668,10 @@ class walk {
         const Predicate& predicate,
         const Walker& walker,
         size_t num_threads = default_num_threads()) {
+      auto required = m::required_opcode_classes(predicate);
       auto wq = workqueue_foreach<DexClass*>(
-          [&predicate, &walker](DexClass* cls) {
-            walk::iterate_matching_block(cls, predicate, walker);
+          [&predicate, &required, &walker](DexClass* cls) {
+            walk::iterate_matching_block(cls, predicate, required, walker);
           },
           num_threads);
       run_all(wq, classes);
@@ -533,10 +681,14 @@ class walk {
      * This code usually runs on a processor with Hyperthreading, where the
      * number of physical cores is half the number of logical cores. Setting
      * num_threads to that number often gets us good results, so that's the
-     * default.
+     * default, unless set_num_threads_override() says otherwise.
      */
     static unsigned int default_num_threads() {
-      unsigned int threads = std::thread::hardware_concurrency() / 2;
+      auto override = num_threads_override();
+      if (override != 0) {
+        return override;
+      }
+      unsigned int threads = ThreadPool::num_cpus() / 2;
       return std::max(1u, threads);
     }
 
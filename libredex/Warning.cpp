@@ -9,6 +9,7 @@
 
 #include "Warning.h"
 
+#include <atomic>
 #include <cstdarg>
 #include <cstdio>
 
@@ -20,14 +21,11 @@ const char* s_warning_text[] = {
 #undef OPT_WARN
 };
 
-size_t s_warning_counts[] = {
-#define OPT_WARN(...) 0,
-    OPT_WARNINGS
-#undef OPT_WARN
-};
-
 constexpr size_t kNumWarnings =
-    sizeof(s_warning_counts) / sizeof(s_warning_counts[0]);
+    sizeof(s_warning_text) / sizeof(s_warning_text[0]);
+
+// Warnings can be raised from worker threads, e.g. while encoding code items.
+std::atomic<size_t> s_warning_counts[kNumWarnings];
 
 void opt_warn(OptWarning warn, const char* fmt, ...) {
   ++s_warning_counts[warn];
@@ -191,8 +191,7 @@ class WeakTopologicalOrdering final {
       const NodeId& root,
       std::function<std::vector<NodeId>(const NodeId&)> successors)
       : m_successors(successors), m_free_position(0), m_num(0) {
-    int32_t partition = -1;
-    visit(root, &partition, 0);
+    build(root);
   }
 
   iterator begin() const {
@@ -205,33 +204,96 @@ class WeakTopologicalOrdering final {
   }
 
  private:
+  /*
+   * Bourdoncle's algorithm is naturally expressed with two mutually recursive
+   * functions, visit() and component(), whose recursion depth is the length
+   * of the longest path explored in the graph. Instead of recursing, we keep
+   * their activation records in an explicit stack of frames, so that huge
+   * graphs don't overflow the stack of the thread.
+   */
+  struct Frame {
+    enum class Kind { Visit, Component };
+
+    Frame(Kind kind,
+          const NodeId& vertex,
+          std::vector<NodeId> successors,
+          size_t partition_frame)
+        : kind(kind),
+          vertex(vertex),
+          successors(std::move(successors)),
+          partition_frame(partition_frame) {}
+
+    Kind kind;
+    NodeId vertex;
+    std::vector<NodeId> successors;
+    size_t next_successor{0};
+    // The frame that holds the partition that a visit updates. This is the
+    // enclosing component frame, or the bottom frame for the root.
+    size_t partition_frame;
+    // Component frames only: the partition of the component being built.
+    int32_t partition{-1};
+    // Visit frames only.
+    uint32_t head{0};
+    bool loop{false};
+    // Set once the subcomponents of an SCC have been built.
+    bool built_component{false};
+  };
 
   // We keep the notations used by Bourdoncle in the paper to describe the
   // algorithm.
-  NO_SANITIZE_ADDRESS // because of deep recursion. ASAN uses too much memory.
-  uint32_t visit(const NodeId& vertex, int32_t* partition, size_t depth) {
-    m_stack.push(vertex);
-    uint32_t head = set_dfn(vertex, ++m_num);
-    bool loop = false;
-    for (const NodeId& succ : m_successors(vertex)) {
-      uint32_t succ_dfn = get_dfn(succ);
-      uint32_t min;
-      if (succ_dfn == 0) {
-        min = visit(succ, partition, depth + 1);
-      } else {
-        min = succ_dfn;
-      };
-      if (min <= head) {
-        head = min;
-        loop = true;
+  void build(const NodeId& root) {
+    // The bottom frame only holds the partition of the visit of the root.
+    m_frames.emplace_back(
+        Frame::Kind::Component, root, std::vector<NodeId>(), 0);
+    start_visit(root, 0);
+    while (m_frames.size() > 1) {
+      auto& frame = m_frames.back();
+      if (frame.next_successor < frame.successors.size()) {
+        NodeId succ = frame.successors[frame.next_successor++];
+        uint32_t succ_dfn = get_dfn(succ);
+        if (frame.kind == Frame::Kind::Component) {
+          if (succ_dfn == 0) {
+            start_visit(succ, m_frames.size() - 1);
+          }
+        } else if (succ_dfn == 0) {
+          start_visit(succ, frame.partition_frame);
+        } else if (succ_dfn <= frame.head) {
+          frame.head = succ_dfn;
+          frame.loop = true;
+        }
+        continue;
+      }
+      if (frame.kind == Frame::Kind::Component) {
+        m_frames.pop_back();
+        continue;
       }
+      finish_visit();
     }
-    if (head == get_dfn(vertex)) {
+    m_frames.clear();
+  }
+
+  void start_visit(const NodeId& vertex, size_t partition_frame) {
+    m_stack.push(vertex);
+    uint32_t head = set_dfn(vertex, ++m_num);
+    m_frames.emplace_back(
+        Frame::Kind::Visit, vertex, m_successors(vertex), partition_frame);
+    m_frames.back().head = head;
+  }
+
+  // Called once all the successors of the vertex of the top frame have been
+  // visited, and again once its component has been built if it's the head of
+  // an SCC.
+  void finish_visit() {
+    auto& frame = m_frames.back();
+    const NodeId vertex = frame.vertex;
+    if (frame.built_component) {
+      add_component(frame, WtoComponent<NodeId>::Kind::Scc);
+    } else if (frame.head == get_dfn(vertex)) {
       // We encode the special value +oo used in the paper with UINT32_MAX.
       set_dfn(vertex, std::numeric_limits<uint32_t>::max());
       NodeId element = m_stack.top();
       m_stack.pop();
-      if (loop) {
+      if (frame.loop) {
         // Nodes are required to be comparable using `operator==()`. We don't
         // assume `operator!=()` to be defined on nodes.
         while (!(element == vertex)) {
@@ -239,22 +301,33 @@ class WeakTopologicalOrdering final {
           element = m_stack.top();
           m_stack.pop();
         }
-        push_component(vertex, *partition, depth);
+        // Build the subcomponents of the SCC, and come back here afterwards.
+        frame.built_component = true;
+        int32_t partition = m_frames[frame.partition_frame].partition;
+        m_frames.emplace_back(Frame::Kind::Component,
+                              vertex,
+                              m_successors(vertex),
+                              m_frames.size() - 1);
+        m_frames.back().partition = partition;
+        return;
       }
-      auto kind = loop ? WtoComponent<NodeId>::Kind::Scc
-                       : WtoComponent<NodeId>::Kind::Vertex;
-      m_wto_space.emplace_back(vertex, kind, m_free_position, *partition);
-      *partition = m_free_position++;
+      add_component(frame, WtoComponent<NodeId>::Kind::Vertex);
+    }
+    // Return the head to the caller, if it was a visit.
+    uint32_t head = frame.head;
+    m_frames.pop_back();
+    auto& caller = m_frames.back();
+    if (caller.kind == Frame::Kind::Visit && head <= caller.head) {
+      caller.head = head;
+      caller.loop = true;
     }
-    return head;
   }
 
-  void push_component(const NodeId& vertex, int32_t partition, size_t depth) {
-    for (const NodeId& succ : m_successors(vertex)) {
-      if (get_dfn(succ) == 0) {
-        visit(succ, &partition, depth + 1);
-      }
-    }
+  void add_component(const Frame& frame,
+                     typename WtoComponent<NodeId>::Kind kind) {
+    auto& partition = m_frames[frame.partition_frame].partition;
+    m_wto_space.emplace_back(frame.vertex, kind, m_free_position, partition);
+    partition = m_free_position++;
   }
 
   uint32_t get_dfn(const NodeId& node) {
@@ -286,6 +359,8 @@ class WeakTopologicalOrdering final {
   std::unordered_map<NodeId, uint32_t, NodeHash> m_dfn;
   std::stack<NodeId> m_stack;
   uint32_t m_num;
+  // The explicit call stack of the algorithm, only used during construction.
+  std::vector<Frame> m_frames;
 };
 
 template <typename NodeId>
@@ -9,12 +9,17 @@
 
 #pragma once
 
+#include "CacheLine.h"
 #include "Debug.h"
+#include "ThreadPool.h"
+#include "Timer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 #include <chrono>
+#include <memory>
 #include <numeric>
 #include <queue>
 #include <random>
@@ -39,32 +44,298 @@ inline std::vector<int> create_permutation(int num, unsigned int thread_idx) {
   return attempts;
 }
 
+/**
+ * Identifies the work queue (and the worker within it) that the current thread
+ * is running tasks for, if any. This lets add_item() push tasks spawned by a
+ * running task onto the spawning worker's own deque.
+ */
+struct CurrentWorker {
+  const void* queue{nullptr};
+  size_t idx{0};
+};
+
+inline CurrentWorker& current_worker() {
+  static thread_local CurrentWorker s_current;
+  return s_current;
+}
+
+/**
+ * A work-stealing deque, as described in "Dynamic Circular Work-Stealing
+ * Deque" (Chase & Lev, SPAA'05), using the C11 memory orderings from "Correct
+ * and Efficient Work-Stealing for Weak Memory Models" (Le et al., PPoPP'13).
+ *
+ * Only the owning thread may call push() and take(); any thread may call
+ * steal(). The owner works LIFO at the bottom, thieves take from the top.
+ *
+ * Elements are heap-allocated so that the circular buffer only ever holds
+ * pointers, which can be read racily by thieves without tearing. Buffers that
+ * have been outgrown are retired but kept alive until the deque is destroyed,
+ * since a thief may still be reading from them.
+ */
+template <class T>
+class ChaseLevDeque {
+ public:
+  explicit ChaseLevDeque(size_t log_capacity = 6)
+      : m_array(new Array(log_capacity)) {
+    m_retired.emplace_back(m_array.load(std::memory_order_relaxed));
+  }
+
+  ChaseLevDeque(const ChaseLevDeque&) = delete;
+  ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+  ~ChaseLevDeque() {
+    T* item;
+    while ((item = take()) != nullptr) {
+      delete item;
+    }
+  }
+
+  void push(T* item) {
+    auto b = m_bottom.load(std::memory_order_relaxed);
+    auto t = m_top.load(std::memory_order_acquire);
+    auto a = m_array.load(std::memory_order_relaxed);
+    if (b - t > static_cast<int64_t>(a->capacity()) - 1) {
+      a = grow(a, t, b);
+    }
+    a->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  /*
+   * Returns nullptr if the deque is empty.
+   */
+  T* take() {
+    auto b = m_bottom.load(std::memory_order_relaxed) - 1;
+    auto a = m_array.load(std::memory_order_relaxed);
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = m_top.load(std::memory_order_relaxed);
+    if (t > b) {
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T* item = a->get(b);
+    if (t == b) {
+      // Last element: race against thieves for it.
+      if (!m_top.compare_exchange_strong(t,
+                                         t + 1,
+                                         std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  /*
+   * Returns nullptr if the deque is empty or if we lost a race against
+   * another thief or the owner.
+   */
+  T* steal() {
+    auto t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    auto a = m_array.load(std::memory_order_acquire);
+    T* item = a->get(t);
+    if (!m_top.compare_exchange_strong(t,
+                                       t + 1,
+                                       std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+ private:
+  class Array {
+   public:
+    explicit Array(size_t log_capacity)
+        : m_mask((size_t(1) << log_capacity) - 1),
+          m_log_capacity(log_capacity),
+          m_slots(new std::atomic<T*>[size_t(1) << log_capacity]) {}
+
+    size_t capacity() const { return m_mask + 1; }
+    size_t log_capacity() const { return m_log_capacity; }
+
+    T* get(int64_t i) const {
+      return m_slots[i & m_mask].load(std::memory_order_relaxed);
+    }
+
+    void put(int64_t i, T* item) {
+      m_slots[i & m_mask].store(item, std::memory_order_relaxed);
+    }
+
+   private:
+    size_t m_mask;
+    size_t m_log_capacity;
+    std::unique_ptr<std::atomic<T*>[]> m_slots;
+  };
+
+  Array* grow(Array* a, int64_t t, int64_t b) {
+    auto bigger = new Array(a->log_capacity() + 1);
+    for (auto i = t; i < b; ++i) {
+      bigger->put(i, a->get(i));
+    }
+    m_retired.emplace_back(bigger);
+    m_array.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  // Thieves write the top and the owner the bottom, so they live on separate
+  // cache lines.
+  std::atomic<int64_t> m_top{0};
+  CacheLinePadding m_top_padding;
+  std::atomic<int64_t> m_bottom{0};
+  std::atomic<Array*> m_array;
+  // Only touched by the owner, in push().
+  std::vector<std::unique_ptr<Array>> m_retired;
+};
+
+inline std::atomic<unsigned int>& num_threads_override() {
+  static std::atomic<unsigned int> s_override{0};
+  return s_override;
+}
+
+struct AtomicRunStats {
+  std::atomic<int64_t> runs{0};
+  std::atomic<int64_t> tasks{0};
+  std::atomic<int64_t> busiest_worker_tasks{0};
+  std::atomic<int64_t> steal_attempts{0};
+  std::atomic<int64_t> steals{0};
+  std::atomic<int64_t> busy_us{0};
+  std::atomic<int64_t> idle_us{0};
+  std::atomic<int64_t> tail_us{0};
+};
+
+inline AtomicRunStats& run_stats() {
+  static AtomicRunStats s_stats;
+  return s_stats;
+}
+
 } // namespace workqueue_impl
 
+/*
+ * How well the work of WorkQueue runs was spread over their workers, summed
+ * over every run since the program started. Take a snapshot before and after
+ * a stretch of work and subtract them to get its share.
+ *
+ * A worker is idle from when it first fails to find a task until it finds
+ * one again or retires, and busy the rest of the time it runs. The tail of a
+ * run is how long its last worker kept going after its first one retired,
+ * i.e. how long stragglers held up the join. Comparing the tasks of the
+ * busiest worker with the average tells how unevenly tasks were spread.
+ */
+struct WorkQueueStats {
+  int64_t runs{0};
+  int64_t tasks{0};
+  // Summed over the runs.
+  int64_t busiest_worker_tasks{0};
+  int64_t steal_attempts{0};
+  int64_t steals{0};
+  int64_t busy_us{0};
+  int64_t idle_us{0};
+  int64_t tail_us{0};
+
+  static WorkQueueStats snapshot() {
+    const auto& stats = workqueue_impl::run_stats();
+    WorkQueueStats snapshot;
+    snapshot.runs = stats.runs.load();
+    snapshot.tasks = stats.tasks.load();
+    snapshot.busiest_worker_tasks = stats.busiest_worker_tasks.load();
+    snapshot.steal_attempts = stats.steal_attempts.load();
+    snapshot.steals = stats.steals.load();
+    snapshot.busy_us = stats.busy_us.load();
+    snapshot.idle_us = stats.idle_us.load();
+    snapshot.tail_us = stats.tail_us.load();
+    return snapshot;
+  }
+
+  WorkQueueStats operator-(const WorkQueueStats& that) const {
+    WorkQueueStats diff;
+    diff.runs = runs - that.runs;
+    diff.tasks = tasks - that.tasks;
+    diff.busiest_worker_tasks =
+        busiest_worker_tasks - that.busiest_worker_tasks;
+    diff.steal_attempts = steal_attempts - that.steal_attempts;
+    diff.steals = steals - that.steals;
+    diff.busy_us = busy_us - that.busy_us;
+    diff.idle_us = idle_us - that.idle_us;
+    diff.tail_us = tail_us - that.tail_us;
+    return diff;
+  }
+};
+
+/*
+ * Makes every work queue and parallel walk that doesn't ask for a specific
+ * number of threads use `num_threads` instead of its default. Zero restores
+ * the defaults, or what REDEX_THREADS asks for. Meant for benchmarking how
+ * work scales with threads, and for sharing a machine.
+ */
+inline void set_num_threads_override(unsigned int num_threads) {
+  workqueue_impl::num_threads_override().store(num_threads);
+}
+
+inline unsigned int num_threads_override() {
+  auto override =
+      workqueue_impl::num_threads_override().load(std::memory_order_relaxed);
+  return override != 0 ? override : ThreadPool::configured_threads();
+}
+
+/*
+ * The number of threads a work queue uses unless told otherwise: one per CPU
+ * it may run on.
+ */
+inline unsigned int default_workqueue_threads() {
+  auto override = num_threads_override();
+  return override != 0 ? override : ThreadPool::num_cpus();
+}
+
 template <class Input, class Data, class Output>
 struct WorkerState {
-  std::queue<Input> queue;
-  boost::mutex queue_mtx;
+  workqueue_impl::ChaseLevDeque<Input> queue;
   Data data;
   Output result;
+  // The states are allocated one after the other, and each worker keeps
+  // updating its result; this keeps them off each other's cache lines.
+  CacheLinePadding padding;
 
   WorkerState(const Data& initial) : data(initial) {}
 
-  bool pop_task(Input& task) {
-    boost::lock_guard<boost::mutex> guard(queue_mtx);
-    if (!queue.empty()) {
-      task = std::move(queue.front());
-      queue.pop();
-      return true;
+  /*
+   * Must only be called by the thread that owns this state.
+   */
+  void push_task(Input task) { queue.push(new Input(std::move(task))); }
+
+  /*
+   * Must only be called by the thread that owns this state.
+   */
+  bool pop_task(Input& task) { return unwrap(queue.take(), task); }
+
+  /*
+   * May be called by any thread.
+   */
+  bool steal_task(Input& task) { return unwrap(queue.steal(), task); }
+
+ private:
+  static bool unwrap(Input* item, Input& task) {
+    if (item == nullptr) {
+      return false;
     }
-    return false;
+    task = std::move(*item);
+    delete item;
+    return true;
   }
 };
 
 template <class Input, class Data, class Output>
 class WorkQueue {
  private:
-  bool m_currently_running{false};
+  std::atomic<bool> m_currently_running{false};
   std::function<Output(Data&, Input)> m_mapper;
   std::function<Output(Output, Output)> m_reducer;
 
@@ -73,8 +344,29 @@ class WorkQueue {
   const size_t m_num_threads{1};
   size_t m_insert_idx{0};
 
+  // Number of tasks that have been added but whose mapper hasn't returned yet.
+  // A worker only retires once this drops to zero, since a task that is still
+  // running may spawn more work.
+  std::atomic<size_t> m_num_pending{0};
+
+  // Tasks added while running by threads that aren't workers of this queue.
+  // The deques only accept pushes from their owner, so those go here instead.
+  std::queue<Input> m_external_tasks;
+  boost::mutex m_external_mtx;
+
   void consume(WorkerState<Input, Data, Output>* state, Input task) {
     state->result = m_reducer(state->result, m_mapper(state->data, task));
+    m_num_pending.fetch_sub(1, std::memory_order_acq_rel);
+  }
+
+  bool pop_external_task(Input& task) {
+    boost::lock_guard<boost::mutex> guard(m_external_mtx);
+    if (m_external_tasks.empty()) {
+      return false;
+    }
+    task = std::move(m_external_tasks.front());
+    m_external_tasks.pop();
+    return true;
   }
 
  public:
@@ -84,6 +376,25 @@ class WorkQueue {
       std::function<Data(unsigned int /* thread index*/)> data_initializer,
       unsigned int num_threads);
 
+  /*
+   * Work queues may only be moved while they aren't running.
+   */
+  WorkQueue(WorkQueue&& other)
+      : m_mapper(std::move(other.m_mapper)),
+        m_reducer(std::move(other.m_reducer)),
+        m_states(std::move(other.m_states)),
+        m_num_threads(other.m_num_threads),
+        m_insert_idx(other.m_insert_idx),
+        m_num_pending(other.m_num_pending.load()),
+        m_external_tasks(std::move(other.m_external_tasks)) {
+    always_assert(!other.m_currently_running.load());
+  }
+
+  /**
+   * Items may be added both before and during run_all(). A running task that
+   * adds an item pushes it onto its own worker's deque, from where idle
+   * workers can steal it.
+   */
   void add_item(Input task);
 
   void set_mapper(std::function<Output(Data&, Input)> mapper) {
@@ -95,7 +406,9 @@ class WorkQueue {
   }
 
   /**
-   * Spawn threads and evaluate function.  This method blocks.
+   * Evaluate the mapper on the items, using up to num_threads threads of the
+   * shared ThreadPool. This method blocks until all items, including those
+   * added by running tasks, have been processed.
    */
   Output run_all(const Output& init_output = Output());
 };
@@ -121,8 +434,7 @@ WorkQueue<Input, Data, Output>::WorkQueue(
 template <class Input>
 WorkQueue<Input, std::nullptr_t /*Data*/, std::nullptr_t /*Output*/>
 workqueue_foreach(const std::function<void(Input)>& func,
-                  unsigned int num_threads =
-                      std::max(1u, boost::thread::hardware_concurrency())) {
+                  unsigned int num_threads = default_workqueue_threads()) {
   using Data = std::nullptr_t;
   using Output = std::nullptr_t;
   return WorkQueue<Input, Data, Output>(
@@ -143,8 +455,7 @@ template <class Input, class Output>
 WorkQueue<Input, std::nullptr_t /*Data*/, Output> workqueue_mapreduce(
     const std::function<Output(Input)>& mapper,
     const std::function<Output(Output, Output)>& reducer,
-    unsigned int num_threads =
-        std::max(1u, boost::thread::hardware_concurrency())) {
+    unsigned int num_threads = default_workqueue_threads()) {
   using Data = std::nullptr_t;
   return WorkQueue<Input, Data, Output>(
       [mapper](Data&, Input a) -> Output { return mapper(a); },
@@ -153,62 +464,200 @@ WorkQueue<Input, std::nullptr_t /*Data*/, Output> workqueue_mapreduce(
       num_threads);
 }
 
+/**
+ * Sorts [begin, end) with `cmp`, like std::sort. The range is cut into one
+ * run per thread, the runs are sorted in parallel, and adjacent runs are then
+ * merged pairwise, also in parallel, until a single run is left. Small ranges
+ * are sorted on the calling thread.
+ */
+template <class RandomIt, class Compare>
+void sort_in_parallel(RandomIt begin,
+                      RandomIt end,
+                      Compare cmp,
+                      unsigned int num_threads = default_workqueue_threads()) {
+  // Below this many items per run, the merges cost more than they save.
+  constexpr size_t MIN_RUN_SIZE = 4096;
+  const size_t size = end - begin;
+  const size_t num_runs = std::min<size_t>(num_threads, size / MIN_RUN_SIZE);
+  if (num_runs <= 1) {
+    std::sort(begin, end, cmp);
+    return;
+  }
+  // Run i spans [bounds[i], bounds[i + 1]).
+  std::vector<size_t> bounds;
+  for (size_t i = 0; i <= num_runs; ++i) {
+    bounds.push_back(size * i / num_runs);
+  }
+  auto sort_wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        std::sort(begin + bounds[i], begin + bounds[i + 1], cmp);
+      },
+      num_threads);
+  for (size_t i = 0; i < num_runs; ++i) {
+    sort_wq.add_item(i);
+  }
+  sort_wq.run_all();
+  while (bounds.size() > 2) {
+    auto merge_wq = workqueue_foreach<size_t>(
+        [&](size_t i) {
+          std::inplace_merge(begin + bounds[i],
+                             begin + bounds[i + 1],
+                             begin + bounds[i + 2],
+                             cmp);
+        },
+        num_threads);
+    std::vector<size_t> merged_bounds;
+    for (size_t i = 0; i + 2 < bounds.size(); i += 2) {
+      merge_wq.add_item(i);
+    }
+    merge_wq.run_all();
+    for (size_t i = 0; i < bounds.size(); i += 2) {
+      merged_bounds.push_back(bounds[i]);
+    }
+    if (merged_bounds.back() != size) {
+      merged_bounds.push_back(size);
+    }
+    bounds = std::move(merged_bounds);
+  }
+}
+
 template <class Input, class Data, class Output>
 void WorkQueue<Input, Data, Output>::add_item(Input task) {
-  if (m_currently_running) {
-    auto insert_idx = rand() % m_num_threads;
-    boost::lock_guard<boost::mutex> guard(m_states[insert_idx]->queue_mtx);
-    m_states[insert_idx]->queue.push(task);
+  m_num_pending.fetch_add(1, std::memory_order_acq_rel);
+  if (m_currently_running.load(std::memory_order_acquire)) {
+    const auto& current = workqueue_impl::current_worker();
+    if (current.queue == this) {
+      m_states[current.idx]->push_task(std::move(task));
+    } else {
+      boost::lock_guard<boost::mutex> guard(m_external_mtx);
+      m_external_tasks.push(std::move(task));
+    }
   } else {
+    // No worker is running yet, so we may act as the owner of every deque.
     m_insert_idx = (m_insert_idx + 1) % m_num_threads;
-    m_states[m_insert_idx]->queue.push(task);
+    m_states[m_insert_idx]->push_task(std::move(task));
   }
 }
 
 /*
- * Each worker thread pulls from its own queue first, and then once finished
- * looks randomly at other queues to try and steal work.
+ * Each worker thread pulls from its own deque first, and then once finished
+ * looks randomly at other deques to try and steal work. A worker that can't
+ * find anything keeps polling until no task is pending anywhere, so that work
+ * spawned late by another worker still gets spread across all threads.
  */
 template <class Input, class Data, class Output>
 Output WorkQueue<Input, Data, Output>::run_all(const Output& init_output) {
-  m_currently_running = true;
-  std::vector<boost::thread> all_threads;
+  using Clock = std::chrono::steady_clock;
+  auto us_between = [](Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from)
+        .count();
+  };
+  // What each worker did, for WorkQueueStats. The clock is only read when a
+  // worker starts, retires, or goes idle and back, never per task.
+  struct WorkerTimes {
+    int64_t tasks{0};
+    int64_t steal_attempts{0};
+    int64_t steals{0};
+    int64_t busy_us{0};
+    int64_t idle_us{0};
+    Clock::time_point done;
+  };
+  std::vector<WorkerTimes> times(m_num_threads);
+
+  m_currently_running.store(true, std::memory_order_release);
   auto worker = [&](WorkerState<Input, Data, Output>* state, size_t state_idx) {
+    auto& current = workqueue_impl::current_worker();
+    auto saved = current;
+    current.queue = this;
+    current.idx = state_idx;
     state->result = init_output;
+    // One span per worker rather than per task, which is enough to show how
+    // evenly the work was spread without flooding the timeline.
+    Timeline::Span span("WorkQueue worker");
+    auto& my_times = times[state_idx];
+    auto start = Clock::now();
+    Clock::time_point idle_since;
+    bool idle = false;
     auto attempts =
         workqueue_impl::create_permutation(m_num_threads, state_idx);
     while (true) {
+      Input task;
+      if (state->pop_task(task)) {
+        consume(state, std::move(task));
+        ++my_times.tasks;
+        continue;
+      }
       auto have_task = false;
       for (auto idx : attempts) {
-        auto other_state = m_states[idx].get();
-        Input task;
-        have_task = other_state->pop_task(task);
-        if (have_task) {
-          consume(state, task);
-          break;
+        if (idx != static_cast<int>(state_idx)) {
+          ++my_times.steal_attempts;
+          if (m_states[idx]->steal_task(task)) {
+            have_task = true;
+            ++my_times.steals;
+            break;
+          }
         }
       }
       if (!have_task) {
-        return;
+        have_task = pop_external_task(task);
+      }
+      if (have_task) {
+        if (idle) {
+          idle = false;
+          my_times.idle_us += us_between(idle_since, Clock::now());
+        }
+        consume(state, std::move(task));
+        ++my_times.tasks;
+      } else if (m_num_pending.load(std::memory_order_acquire) == 0) {
+        break;
+      } else {
+        if (!idle) {
+          idle = true;
+          idle_since = Clock::now();
+        }
+        boost::this_thread::yield();
       }
     }
+    my_times.done = Clock::now();
+    if (idle) {
+      my_times.idle_us += us_between(idle_since, my_times.done);
+    }
+    my_times.busy_us = us_between(start, my_times.done) - my_times.idle_us;
+    span.set_arg("tasks", my_times.tasks);
+    span.set_arg("stolen", my_times.steals);
+    span.set_arg("steal_attempts", my_times.steal_attempts);
+    span.set_arg("idle_us", my_times.idle_us);
+    current = saved;
   };
 
-  for (size_t i = 0; i < m_num_threads; ++i) {
-    boost::thread::attributes attrs;
-    attrs.set_stack_size(8 * 1024 * 1024);
-    all_threads.emplace_back(attrs,
-                             boost::bind<void>(worker, m_states[i].get(), i));
-  }
-
-  for (auto& thread : all_threads) {
-    thread.join();
-  }
+  // Workers run on the shared pool; the calling thread runs one of them.
+  auto& pool = ThreadPool::get();
+  pool.ensure_size(m_num_threads - 1);
+  pool.run(m_num_threads,
+           [&](size_t i) { worker(m_states[i].get(), i); });
 
   Output result = init_output;
   for (auto& thread_state : m_states) {
     result = m_reducer(result, thread_state->result);
   }
-  m_currently_running = false;
+  m_currently_running.store(false, std::memory_order_release);
+
+  auto& stats = workqueue_impl::run_stats();
+  auto first_done = times[0].done;
+  auto last_done = times[0].done;
+  int64_t busiest_worker_tasks = 0;
+  for (const auto& worker_times : times) {
+    stats.tasks += worker_times.tasks;
+    stats.steal_attempts += worker_times.steal_attempts;
+    stats.steals += worker_times.steals;
+    stats.busy_us += worker_times.busy_us;
+    stats.idle_us += worker_times.idle_us;
+    first_done = std::min(first_done, worker_times.done);
+    last_done = std::max(last_done, worker_times.done);
+    busiest_worker_tasks = std::max(busiest_worker_tasks, worker_times.tasks);
+  }
+  stats.runs += 1;
+  stats.busiest_worker_tasks += busiest_worker_tasks;
+  stats.tail_us += us_between(first_done, last_done);
   return result;
 }
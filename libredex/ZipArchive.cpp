@@ -0,0 +1,304 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ZipArchive.h"
+
+#include <cstring>
+#include <ctime>
+#include <zlib.h>
+
+#include "Debug.h"
+#include "ZipFormat.h"
+
+namespace zip {
+
+namespace {
+
+const uint16_t kFlagDataDescriptor = 1 << 3;
+const uint16_t kVersion = 20;
+const uint32_t kPageAlignment = 4096;
+const uint32_t kAlignment = 4;
+// The end of central directory record is followed by a comment of up to 64k.
+const size_t kMaxCommentSize = 0xffff;
+
+bool ends_with(const std::string& s, const char* suffix) {
+  auto len = strlen(suffix);
+  return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+void dos_time(time_t mtime, uint16_t* mod_time, uint16_t* mod_date) {
+  struct tm tm;
+  localtime_r(&mtime, &tm);
+  if (tm.tm_year < 80) {
+    // DOS time starts in 1980.
+    *mod_time = 0;
+    *mod_date = (1 << 5) | 1;
+    return;
+  }
+  *mod_time = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+  *mod_date = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+}
+
+} // namespace
+
+Reader::Reader(const std::string& path) : m_path(path) {
+  m_file.open(path, boost::iostreams::mapped_file::readonly);
+  always_assert_log(m_file.is_open(), "Can't open zip archive %s\n",
+                    path.c_str());
+  m_base = reinterpret_cast<const uint8_t*>(m_file.const_data());
+  read_central_directory(m_base, m_file.size());
+}
+
+Reader::Reader(const uint8_t* data, size_t size, const std::string& name)
+    : m_path(name), m_base(data) {
+  read_central_directory(data, size);
+}
+
+void Reader::read_central_directory(const uint8_t* base, size_t size) {
+  const auto& path = m_path;
+  always_assert_log(size >= sizeof(pk_cdir_end), "%s is not a zip archive\n",
+                    path.c_str());
+
+  const uint8_t* cdir_end = nullptr;
+  size_t lowest = size > sizeof(pk_cdir_end) + kMaxCommentSize
+                      ? size - sizeof(pk_cdir_end) - kMaxCommentSize
+                      : 0;
+  for (size_t off = size - sizeof(pk_cdir_end) + 1; off-- > lowest;) {
+    if (memcmp(base + off, kCDirEnd, kSignatureSize) == 0) {
+      cdir_end = base + off;
+      break;
+    }
+  }
+  always_assert_log(cdir_end != nullptr,
+                    "End of central directory record not found in %s\n",
+                    path.c_str());
+  pk_cdir_end pce;
+  memcpy(&pce, cdir_end, sizeof(pce));
+  always_assert_log(pce.cd_diskno == pce.diskno && pce.cd_diskno == 0 &&
+                        pce.cd_entries == pce.cd_disk_entries,
+                    "Disk spanning is not supported in %s\n", path.c_str());
+  always_assert_log(pce.cd_disk_offset + pce.cd_size <= size,
+                    "Central directory overflow in %s\n", path.c_str());
+
+  const uint8_t* cd = base + pce.cd_disk_offset;
+  const uint8_t* cd_end = cd + pce.cd_size;
+  m_entries.reserve(pce.cd_entries);
+  for (uint16_t i = 0; i < pce.cd_entries; ++i) {
+    pk_cd_file cdf;
+    always_assert_log(cd + sizeof(cdf) <= cd_end &&
+                          memcmp(cd, kCDFile, kSignatureSize) == 0,
+                      "Invalid central directory entry in %s\n", path.c_str());
+    memcpy(&cdf, cd, sizeof(cdf));
+    Entry entry;
+    entry.name.assign(reinterpret_cast<const char*>(cd + sizeof(cdf)),
+                      cdf.fname_len);
+    cd += sizeof(cdf) + cdf.fname_len + cdf.extra_len + cdf.comment_len;
+    always_assert_log(cdf.comp_method == kCompMethodStore ||
+                          cdf.comp_method == kCompMethodDeflate,
+                      "Unknown compression method %d for %s in %s\n",
+                      cdf.comp_method, entry.name.c_str(), path.c_str());
+    entry.flags = cdf.flags & ~kFlagDataDescriptor;
+    entry.method = cdf.comp_method;
+    entry.mod_time = cdf.mod_time;
+    entry.mod_date = cdf.mod_date;
+    entry.crc32 = cdf.crc32;
+    entry.comp_size = cdf.comp_size;
+    entry.ucomp_size = cdf.ucomp_size;
+    entry.external_attr = cdf.external_attr;
+
+    pk_lfile pkf;
+    always_assert_log(cdf.disk_offset + sizeof(pkf) <= size &&
+                          memcmp(base + cdf.disk_offset, kLFile,
+                                 kSignatureSize) == 0,
+                      "Invalid local file entry for %s in %s\n",
+                      entry.name.c_str(), path.c_str());
+    memcpy(&pkf, base + cdf.disk_offset, sizeof(pkf));
+    size_t data_offset =
+        cdf.disk_offset + sizeof(pkf) + pkf.fname_len + pkf.extra_len;
+    always_assert_log(data_offset + entry.comp_size <= size,
+                      "Truncated entry %s in %s\n", entry.name.c_str(),
+                      path.c_str());
+    entry.data = base + data_offset;
+    m_entries.push_back(std::move(entry));
+  }
+}
+
+void Reader::extract(const Entry& entry, uint8_t* out) const {
+  if (entry.method == kCompMethodStore) {
+    always_assert_log(entry.comp_size == entry.ucomp_size,
+                      "Stored entry %s in %s has mismatched sizes\n",
+                      entry.name.c_str(), m_path.c_str());
+    memcpy(out, entry.data, entry.ucomp_size);
+    return;
+  }
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  stream.next_in = const_cast<Bytef*>(entry.data);
+  stream.avail_in = entry.comp_size;
+  stream.next_out = out;
+  stream.avail_out = entry.ucomp_size;
+  always_assert(inflateInit2(&stream, -MAX_WBITS) == Z_OK);
+  auto err = inflate(&stream, Z_FINISH);
+  inflateEnd(&stream);
+  always_assert_log(err == Z_STREAM_END && stream.total_out == entry.ucomp_size,
+                    "Cannot inflate %s in %s\n", entry.name.c_str(),
+                    m_path.c_str());
+}
+
+Entry compress(const std::string& name,
+               const uint8_t* data,
+               size_t size,
+               uint16_t method,
+               time_t mtime,
+               std::vector<uint8_t>* storage) {
+  Entry entry;
+  entry.name = name;
+  entry.flags = 0;
+  entry.method = method;
+  dos_time(mtime, &entry.mod_time, &entry.mod_date);
+  entry.crc32 = crc32(crc32(0L, Z_NULL, 0), data, size);
+  entry.ucomp_size = size;
+  entry.external_attr = 0100644 << 16;
+  if (method == kCompMethodStore) {
+    storage->assign(data, data + size);
+  } else {
+    always_assert(method == kCompMethodDeflate);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    always_assert(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                               -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    storage->resize(deflateBound(&stream, size));
+    stream.next_in = const_cast<Bytef*>(data);
+    stream.avail_in = size;
+    stream.next_out = storage->data();
+    stream.avail_out = storage->size();
+    always_assert_log(deflate(&stream, Z_FINISH) == Z_STREAM_END,
+                      "Cannot deflate %s\n", name.c_str());
+    storage->resize(stream.total_out);
+    deflateEnd(&stream);
+  }
+  entry.comp_size = storage->size();
+  entry.data = storage->data();
+  return entry;
+}
+
+bool is_root_dex(const std::string& name) {
+  return name.compare(0, 7, "classes") == 0 && ends_with(name, ".dex") &&
+         name.find('/') == std::string::npos;
+}
+
+Writer::Writer(const std::string& path, bool page_align, bool page_align_dexes)
+    : m_path(path),
+      m_page_align(page_align),
+      m_page_align_dexes(page_align_dexes) {
+  m_fd = fopen(path.c_str(), "wb");
+  always_assert_log(m_fd, "Can't open %s for writing: %s\n", path.c_str(),
+                    strerror(errno));
+}
+
+uint32_t Writer::alignment(const Entry& entry) const {
+  if (entry.method != kCompMethodStore) {
+    return 1;
+  }
+  if ((m_page_align && ends_with(entry.name, ".so")) ||
+      (m_page_align_dexes && is_root_dex(entry.name))) {
+    return kPageAlignment;
+  }
+  return kAlignment;
+}
+
+void Writer::add(const Entry& entry) {
+  pk_lfile pkf;
+  pkf.signature = *reinterpret_cast<const uint32_t*>(kLFile);
+  pkf.vextract = kVersion;
+  pkf.flags = entry.flags;
+  pkf.comp_method = entry.method;
+  pkf.mod_time = entry.mod_time;
+  pkf.mod_date = entry.mod_date;
+  pkf.crc32 = entry.crc32;
+  pkf.comp_size = entry.comp_size;
+  pkf.ucomp_size = entry.ucomp_size;
+  pkf.fname_len = entry.name.size();
+  // Like zipalign, pad the extra field so the data starts aligned.
+  auto align = alignment(entry);
+  uint32_t data_offset = m_offset + sizeof(pkf) + entry.name.size();
+  pkf.extra_len = (align - data_offset % align) % align;
+
+  static const char padding[kPageAlignment] = {};
+  fwrite(&pkf, sizeof(pkf), 1, m_fd);
+  fwrite(entry.name.data(), 1, entry.name.size(), m_fd);
+  fwrite(padding, 1, pkf.extra_len, m_fd);
+  fwrite(entry.data, 1, entry.comp_size, m_fd);
+  always_assert_log(!ferror(m_fd), "Failed writing %s\n", m_path.c_str());
+
+  Entry written = entry;
+  written.data = nullptr;
+  m_written.emplace_back(std::move(written), m_offset);
+  m_offset = data_offset + pkf.extra_len + entry.comp_size;
+}
+
+void Writer::finish() {
+  uint32_t cd_offset = m_offset;
+  for (const auto& it : m_written) {
+    const auto& entry = it.first;
+    pk_cd_file cdf;
+    memset(&cdf, 0, sizeof(cdf));
+    cdf.signature = *reinterpret_cast<const uint32_t*>(kCDFile);
+    cdf.vmade = kVersion;
+    cdf.vextract = kVersion;
+    cdf.flags = entry.flags;
+    cdf.comp_method = entry.method;
+    cdf.mod_time = entry.mod_time;
+    cdf.mod_date = entry.mod_date;
+    cdf.crc32 = entry.crc32;
+    cdf.comp_size = entry.comp_size;
+    cdf.ucomp_size = entry.ucomp_size;
+    cdf.fname_len = entry.name.size();
+    cdf.external_attr = entry.external_attr;
+    cdf.disk_offset = it.second;
+    fwrite(&cdf, sizeof(cdf), 1, m_fd);
+    fwrite(entry.name.data(), 1, entry.name.size(), m_fd);
+    m_offset += sizeof(cdf) + entry.name.size();
+  }
+  always_assert_log(m_written.size() <= 0xffff,
+                    "%s has too many entries for a zip archive without zip64\n",
+                    m_path.c_str());
+  pk_cdir_end pce;
+  memset(&pce, 0, sizeof(pce));
+  pce.signature = *reinterpret_cast<const uint32_t*>(kCDirEnd);
+  pce.cd_disk_entries = m_written.size();
+  pce.cd_entries = m_written.size();
+  pce.cd_size = m_offset - cd_offset;
+  pce.cd_disk_offset = cd_offset;
+  fwrite(&pce, sizeof(pce), 1, m_fd);
+  always_assert_log(!ferror(m_fd) && fclose(m_fd) == 0, "Failed writing %s\n",
+                    m_path.c_str());
+  m_fd = nullptr;
+}
+
+bool report_dex_alignment(const Reader& reader, FILE* out) {
+  bool all_mappable = true;
+  for (const auto& entry : reader.entries()) {
+    if (!is_root_dex(entry.name)) {
+      continue;
+    }
+    auto offset = reader.data_offset(entry);
+    bool mappable =
+        entry.method == kCompMethodStore && offset % kPageAlignment == 0;
+    fprintf(out, "%s\tsize %u\toffset %zu\t%s\n", entry.name.c_str(),
+            entry.ucomp_size, offset,
+            mappable ? "mappable"
+                     : entry.method == kCompMethodStore ? "misaligned"
+                                                         : "compressed");
+    all_mappable = all_mappable && mappable;
+  }
+  return all_mappable;
+}
+
+} // namespace zip
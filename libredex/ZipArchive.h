@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Reading and writing the zip archives APKs are, for unpacking an APK
+ * without a python zipfile round trip and repacking it without recompressing
+ * the entries redex didn't touch. Errors are fatal.
+ */
+namespace zip {
+
+struct Entry {
+  std::string name;
+  // General purpose flags, minus the data descriptor bit: sizes and crc are
+  // always in the local header of the entries written.
+  uint16_t flags;
+  uint16_t method;
+  uint16_t mod_time;
+  uint16_t mod_date;
+  uint32_t crc32;
+  uint32_t comp_size;
+  uint32_t ucomp_size;
+  uint32_t external_attr;
+  // The compressed bytes, in the archive's mapping.
+  const uint8_t* data;
+};
+
+class Reader {
+ public:
+  explicit Reader(const std::string& path);
+
+  // Reads an archive that is already in memory, e.g. one of the jars of an
+  // XZS blob. The data must outlive the reader; name is for error messages.
+  Reader(const uint8_t* data, size_t size, const std::string& name);
+
+  // In central directory order.
+  const std::vector<Entry>& entries() const { return m_entries; }
+
+  // Inflates (or copies) the entry into out, which must hold ucomp_size
+  // bytes.
+  void extract(const Entry& entry, uint8_t* out) const;
+
+  // Where the entry's compressed bytes start in the archive.
+  size_t data_offset(const Entry& entry) const { return entry.data - m_base; }
+
+ private:
+  void read_central_directory(const uint8_t* base, size_t size);
+
+  std::string m_path;
+  boost::iostreams::mapped_file m_file;
+  const uint8_t* m_base;
+  std::vector<Entry> m_entries;
+};
+
+/*
+ * Describes data as an entry compressed with method (stored or deflated),
+ * keeping the compressed bytes in storage.
+ */
+Entry compress(const std::string& name,
+               const uint8_t* data,
+               size_t size,
+               uint16_t method,
+               time_t mtime,
+               std::vector<uint8_t>* storage);
+
+/*
+ * Whether the entry is one of the dexes at the root of an APK (classes.dex,
+ * classes2.dex, ...), the ones the runtime loads.
+ */
+bool is_root_dex(const std::string& name);
+
+/*
+ * Writes entries front to back, aligning the data of stored entries the way
+ * zipalign does (to 4 bytes, or to 4k for shared libraries when page_align
+ * is set), so the result needs no zipalign pass. With page_align_dexes, the
+ * stored root dexes go on a page of their own too, so the runtime can mmap
+ * them straight out of the APK instead of extracting them.
+ */
+class Writer {
+ public:
+  Writer(const std::string& path,
+         bool page_align,
+         bool page_align_dexes = false);
+
+  // Copies the entry's compressed bytes, so entries of another archive go in
+  // without being recompressed.
+  void add(const Entry& entry);
+
+  // Writes the central directory and closes the file.
+  void finish();
+
+ private:
+  uint32_t alignment(const Entry& entry) const;
+
+  std::string m_path;
+  FILE* m_fd;
+  bool m_page_align;
+  bool m_page_align_dexes;
+  uint32_t m_offset{0};
+  // The entries written, with the offsets of their local headers.
+  std::vector<std::pair<Entry, uint32_t>> m_written;
+};
+
+/*
+ * Writes a line per root dex of the archive to out, with its size, the
+ * offset of its data and whether it can be mapped from there, i.e. is
+ * stored on a page boundary. Returns whether all of them can.
+ */
+bool report_dex_alignment(const Reader& reader, FILE* out);
+
+} // namespace zip
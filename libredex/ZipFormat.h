@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "Util.h"
+
+/*
+ * The on-disk structures of a zip archive, as far as jars and APKs use them:
+ * no disk spanning, no zip64, no encryption.
+ */
+
+static const int kSignatureSize = 4;
+
+/* CDFile
+ * Central directory file header entry structures.
+ */
+static const uint16_t kCompMethodStore (0);
+static const uint16_t kCompMethodDeflate (8);
+static const uint8_t kCDFile[] = {'P', 'K', 0x01, 0x02};
+
+PACKED(struct pk_cd_file {
+  uint32_t signature;
+  uint16_t vmade;
+  uint16_t vextract;
+  uint16_t flags;
+  uint16_t comp_method;
+  uint16_t mod_time;
+  uint16_t mod_date;
+  uint32_t crc32;
+  uint32_t comp_size;
+  uint32_t ucomp_size;
+  uint16_t fname_len;
+  uint16_t extra_len;
+  uint16_t comment_len;
+  uint16_t diskno;
+  uint16_t interal_attr;
+  uint32_t external_attr;
+  uint32_t disk_offset;
+});
+
+/* CDirEnd:
+ * End of central directory record structures.
+ */
+static const int kMaxCDirEndSearch = 100;
+static const uint8_t kCDirEnd[] = {'P', 'K', 0x05, 0x06};
+
+PACKED(struct pk_cdir_end {
+  uint32_t signature;
+  uint16_t diskno;
+  uint16_t cd_diskno;
+  uint16_t cd_disk_entries;
+  uint16_t cd_entries;
+  uint32_t cd_size;
+  uint32_t cd_disk_offset;
+  uint16_t comment_len;
+});
+
+/* LFile:
+ * Local file header structures.
+ * (Yes, this made more sense in the world of floppies and tapes.)
+ */
+static const uint8_t kLFile[] = {'P', 'K', 0x03, 0x04};
+
+PACKED(struct pk_lfile {
+  uint32_t signature;
+  uint16_t vextract;
+  uint16_t flags;
+  uint16_t comp_method;
+  uint16_t mod_time;
+  uint16_t mod_date;
+  uint32_t crc32;
+  uint32_t comp_size;
+  uint32_t ucomp_size;
+  uint16_t fname_len;
+  uint16_t extra_len;
+});
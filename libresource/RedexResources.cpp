@@ -7,14 +7,18 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
 #include <cstdio>
 #include <cstdlib>
 #include <fcntl.h>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <boost/regex.hpp>
 #include <sstream>
 #include <string>
@@ -27,6 +31,10 @@
 #include "CompatWindows.h"
 #endif
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #include "androidfw/ResourceTypes.h"
 #include "utils/ByteOrder.h"
 #include "utils/Errors.h"
@@ -36,7 +44,10 @@
 #include "utils/Serialize.h"
 #include "utils/TypeHelpers.h"
 
+#include "RedexContext.h"
+#include "RedexResources.h"
 #include "StringUtil.h"
+#include "WorkQueue.h"
 
 constexpr size_t MIN_CLASSNAME_LENGTH = 10;
 constexpr size_t MAX_CLASSNAME_LENGTH = 500;
@@ -174,10 +185,10 @@ std::unordered_set<std::string> extract_js_resources(const std::string& file_con
 }
 
 std::unordered_set<uint32_t> extract_xml_reference_attributes(
-    const std::string& file_contents,
+    const MappedFile& file,
     const std::string& filename) {
   android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
+  parser.setTo(file.data(), file.size());
   std::unordered_set<uint32_t> result;
   if (parser.getError() != android::NO_ERROR) {
     throw std::runtime_error("Unable to read file: " + filename);
@@ -260,7 +271,8 @@ void walk_references_for_resource(
  * Parse AndroidManifest from buffer, return a list of class names that are
  * referenced
  */
-std::unordered_set<std::string> extract_classes_from_manifest(const std::string& manifest_contents) {
+std::unordered_set<std::string> extract_classes_from_manifest(
+    const MappedFile& manifest) {
 
   // Tags
   android::String16 activity("activity");
@@ -277,7 +289,7 @@ std::unordered_set<std::string> extract_classes_from_manifest(const std::string&
   android::String16 target_activity("targetActivity");
 
   android::ResXMLTree parser;
-  parser.setTo(manifest_contents.data(), manifest_contents.size());
+  parser.setTo(manifest.data(), manifest.size());
 
   std::unordered_set<std::string> result;
 
@@ -329,10 +341,11 @@ std::unordered_set<std::string> extract_classes_from_manifest(const std::string&
   return result;
 }
 
-std::unordered_set<std::string> extract_classes_from_layout(const std::string& layout_contents) {
+std::unordered_set<std::string> extract_classes_from_layout(
+    const MappedFile& layout) {
 
   android::ResXMLTree parser;
-  parser.setTo(layout_contents.data(), layout_contents.size());
+  parser.setTo(layout.data(), layout.size());
 
   std::unordered_set<std::string> result;
 
@@ -369,77 +382,249 @@ std::unordered_set<std::string> extract_classes_from_layout(const std::string& l
   return result;
 }
 
+namespace {
+
+inline bool is_classname_start(char c) {
+  return (c >= 'a' && c <= 'z') || c == 'L';
+}
+
+inline bool is_classname_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '/' || c == '_' || c == '$';
+}
+
 /*
- * Returns all strings that look like java class names from a native library.
- *
- * Return values will be formatted the way that the dex spec formats class names:
- *
- *   "Ljava/lang/String;"
- *
+ * Returns the first position in [p, end) where a class name could start, or
+ * end. Native libraries are mostly bytes that can't, so they are skipped a
+ * whole vector at a time. A byte c is in ['a', 'z'] iff c + (0x80 - 'a') is,
+ * as a signed byte, below -128 + 26.
  */
-std::unordered_set<std::string> extract_classes_from_native_lib(const std::string& lib_contents) {
-  std::unordered_set<std::string> classes;
-  char buffer[MAX_CLASSNAME_LENGTH + 2]; // +2 for the trailing ";\0"
-  const char* inptr = lib_contents.data();
-  char* outptr = buffer;
-  const char* end = inptr + lib_contents.size();
+const char* find_classname_start(const char* p, const char* end) {
+#if defined(__AVX2__)
+  {
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80 - 'a'));
+    const __m256i limit = _mm256_set1_epi8(static_cast<char>(-128 + 26));
+    const __m256i ell = _mm256_set1_epi8('L');
+    for (; end - p >= 32; p += 32) {
+      auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+      auto lower = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, bias));
+      auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+          _mm256_or_si256(lower, _mm256_cmpeq_epi8(v, ell))));
+      if (mask != 0) {
+        return p + __builtin_ctz(mask);
+      }
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80 - 'a'));
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(-128 + 26));
+    const __m128i ell = _mm_set1_epi8('L');
+    for (; end - p >= 16; p += 16) {
+      auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      auto lower = _mm_cmplt_epi8(_mm_add_epi8(v, bias), limit);
+      auto mask = static_cast<uint32_t>(
+          _mm_movemask_epi8(_mm_or_si128(lower, _mm_cmpeq_epi8(v, ell))));
+      if (mask != 0) {
+        return p + __builtin_ctz(mask);
+      }
+    }
+  }
+#endif
+  while (p < end && !is_classname_start(*p)) {
+    ++p;
+  }
+  return p;
+}
 
-  size_t length = 0;
+/*
+ * Adds the class names that start in [begin, end) to `classes`. The last one
+ * may run on past `end`, up to `limit`.
+ */
+void extract_classes_from_native_lib(
+    const char* begin,
+    const char* end,
+    const char* limit,
+    std::unordered_set<std::string>& classes) {
+  char buffer[MAX_CLASSNAME_LENGTH + 2]; // +2 for the trailing ";\0"
+  const char* inptr = begin;
 
-  while (inptr < end) {
-    outptr = buffer;
-    length = 0;
+  while ((inptr = find_classname_start(inptr, end)) < end) {
+    char* outptr = buffer;
+    size_t length = 0;
     // All classnames start with a package, which starts with a lowercase
     // letter. Some of them are preceded by an 'L' and followed by a ';' in
     // native libraries while others are not.
-    if ((*inptr >= 'a' && *inptr <= 'z') || *inptr == 'L') {
+    if (*inptr != 'L') {
+      *outptr++ = 'L';
+      length++;
+    }
 
-      if (*inptr != 'L') {
-        *outptr++ = 'L';
-        length++;
-      }
+    while (inptr < limit && is_classname_char(*inptr) &&
+           length < MAX_CLASSNAME_LENGTH) {
+      *outptr++ = *inptr++;
+      length++;
+    }
+    if (length >= MIN_CLASSNAME_LENGTH) {
+      *outptr++ = ';';
+      *outptr = '\0';
+      classes.insert(std::string(buffer));
+    }
+    inptr++;
+  }
+}
 
-      while (( // This loop is safe since lib_contents.data() ends with a \0
-                 (*inptr >= 'a' && *inptr <= 'z') ||
-                 (*inptr >= 'A' && *inptr <= 'Z') ||
-                 (*inptr >= '0' && *inptr <= '9') ||
-                 *inptr == '/' || *inptr == '_' || *inptr == '$')
-             && length < MAX_CLASSNAME_LENGTH) {
+using ClassNames = std::unordered_set<std::string>;
 
-        *outptr++ = *inptr++;
-        length++;
-      }
-      if (length >= MIN_CLASSNAME_LENGTH) {
-        *outptr++ = ';';
-        *outptr = '\0';
-        classes.insert(std::string(buffer));
-      }
+ClassNames union_class_names(ClassNames a, ClassNames b) {
+  if (a.size() < b.size()) {
+    std::swap(a, b);
+  }
+  a.insert(b.begin(), b.end());
+  return a;
+}
+
+constexpr size_t NATIVE_LIB_CHUNK_SIZE = 1 << 20;
+
+struct NativeLibChunk {
+  const char* begin;
+  const char* end;
+  const char* limit;
+};
+
+/*
+ * Splits a library into chunks that can be scanned independently. A chunk
+ * may only begin right after a byte that can't be part of a class name: the
+ * scanner never is in the middle of a name there, so the chunks find exactly
+ * the names that one scan of the whole library would.
+ */
+void split_native_lib(const char* data,
+                      size_t size,
+                      std::vector<NativeLibChunk>& chunks) {
+  const char* limit = data + size;
+  const char* begin = data;
+  while (static_cast<size_t>(limit - begin) > NATIVE_LIB_CHUNK_SIZE) {
+    const char* end = begin + NATIVE_LIB_CHUNK_SIZE;
+    while (end < limit && is_classname_char(end[-1])) {
+      ++end;
     }
-    inptr++;
+    chunks.push_back(NativeLibChunk{begin, end, limit});
+    begin = end;
   }
+  if (begin < limit) {
+    chunks.push_back(NativeLibChunk{begin, limit, limit});
+  }
+}
+
+} // namespace
+
+/*
+ * Returns all strings that look like java class names from a native library.
+ *
+ * Return values will be formatted the way that the dex spec formats class names:
+ *
+ *   "Ljava/lang/String;"
+ *
+ */
+std::unordered_set<std::string> extract_classes_from_native_lib(const std::string& lib_contents) {
+  std::unordered_set<std::string> classes;
+  const char* begin = lib_contents.data();
+  const char* end = begin + lib_contents.size();
+  extract_classes_from_native_lib(begin, end, end, classes);
   return classes;
 }
 
+/*
+ * Maps the libraries instead of reading them, and scans them in chunks in
+ * parallel, since a few big libraries tend to dominate.
+ */
+std::unordered_set<std::string> extract_classes_from_native_libs(
+    const std::vector<std::string>& files) {
+  std::vector<std::unique_ptr<MappedFile>> mapped;
+  std::vector<NativeLibChunk> chunks;
+  for (const auto& file : files) {
+    mapped.emplace_back(new MappedFile(file));
+    split_native_lib(mapped.back()->data(), mapped.back()->size(), chunks);
+  }
+
+  auto wq = workqueue_mapreduce<const NativeLibChunk*, ClassNames>(
+      [](const NativeLibChunk* chunk) {
+        ClassNames classes;
+        extract_classes_from_native_lib(
+            chunk->begin, chunk->end, chunk->limit, classes);
+        return classes;
+      },
+      union_class_names);
+  for (const auto& chunk : chunks) {
+    wq.add_item(&chunk);
+  }
+  return wq.run_all();
+}
+
 /*
  * Reads an entire file into a std::string. Returns an empty string if
  * anything went wrong (e.g. file not found).
  */
 std::string read_entire_file(const std::string& filename) {
-  std::ifstream in(filename, std::ios::in | std::ios::binary);
-  std::stringstream sstr;
-  sstr << in.rdbuf();
-  return sstr.str();
+  std::ifstream in(filename, std::ios::in | std::ios::binary | std::ios::ate);
+  if (!in) {
+    return std::string();
+  }
+  auto size = in.tellg();
+  if (size <= 0) {
+    return std::string();
+  }
+  // Read straight into the result instead of copying through a stream.
+  std::string contents(static_cast<size_t>(size), '\0');
+  in.seekg(0);
+  if (!in.read(&contents[0], size)) {
+    return std::string();
+  }
+  return contents;
 }
 
 void write_entire_file(
     const std::string& filename,
     const std::string& contents) {
   std::ofstream out(filename, std::ofstream::binary);
-  out << contents;
+  out.write(contents.data(), contents.size());
+}
+
+MappedFile::MappedFile(const std::string& filename, bool writable) {
+  m_fd = open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+  if (m_fd < 0) {
+    return;
+  }
+  struct stat st = {};
+  if (fstat(m_fd, &st) == -1 || st.st_size == 0) {
+    return;
+  }
+  auto size = static_cast<size_t>(st.st_size);
+  auto data = mmap(nullptr,
+                   size,
+                   writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   writable ? MAP_SHARED : MAP_PRIVATE,
+                   m_fd,
+                   0);
+  if (data == MAP_FAILED) {
+    return;
+  }
+  m_data = static_cast<char*>(data);
+  m_size = size;
+}
+
+MappedFile::~MappedFile() {
+  if (m_data != nullptr) {
+    munmap(m_data, m_size);
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
 }
 
 std::unordered_set<std::string> get_manifest_classes(const std::string& filename) {
-  std::string manifest = read_entire_file(filename);
+  MappedFile manifest(filename);
   std::unordered_set<std::string> classes;
   if (manifest.size()) {
     classes = extract_classes_from_manifest(manifest);
@@ -501,7 +686,7 @@ std::unordered_set<std::string> get_candidate_js_resources(
 // Parses the content of all .js files and extracts all resources referenced.
 std::unordered_set<uint32_t> get_js_resources_by_parsing(
     const std::string& directory,
-    std::map<std::string, std::vector<uint32_t>> name_to_ids) {
+    const std::map<std::string, std::vector<uint32_t>>& name_to_ids) {
   std::unordered_set<std::string> js_candidate_resources;
   std::unordered_set<uint32_t> js_resources;
 
@@ -523,8 +708,9 @@ std::unordered_set<uint32_t> get_js_resources_by_parsing(
     }
   } else {
     for (auto& name : js_candidate_resources) {
-      if (name_to_ids.find(name) != name_to_ids.end()) {
-        js_resources.insert(name_to_ids[name].begin(), name_to_ids[name].end());
+      auto it = name_to_ids.find(name);
+      if (it != name_to_ids.end()) {
+        js_resources.insert(it->second.begin(), it->second.end());
       }
     }
   }
@@ -533,25 +719,65 @@ std::unordered_set<uint32_t> get_js_resources_by_parsing(
 }
 
 std::unordered_set<uint32_t> get_resources_by_name_prefix(
-    std::vector<std::string> prefixes,
-    std::map<std::string, std::vector<uint32_t>> name_to_ids) {
+    const std::vector<std::string>& prefixes,
+    const std::map<std::string, std::vector<uint32_t>>& name_to_ids) {
   std::unordered_set<uint32_t> found_resources;
 
-  for (auto& pair : name_to_ids) {
-    for (auto& prefix : prefixes) {
-      if (boost::algorithm::starts_with(pair.first, prefix)) {
-        found_resources.insert(pair.second.begin(), pair.second.end());
-      }
+  // The names that start with a prefix are all together in the map, right
+  // from where the prefix itself would go.
+  for (auto& prefix : prefixes) {
+    for (auto it = name_to_ids.lower_bound(prefix);
+         it != name_to_ids.end() &&
+         boost::algorithm::starts_with(it->first, prefix);
+         ++it) {
+      found_resources.insert(it->second.begin(), it->second.end());
     }
   }
 
   return found_resources;
 }
 
+ResourceTableIndex::ResourceTableIndex(const android::ResTable& table) {
+  android::SortedVector<uint32_t> ids;
+  table.getResourceIds(&ids);
+  m_ids.reserve(ids.size());
+  m_id_to_name.reserve(ids.size());
+  for (size_t i = 0; i < ids.size(); i++) {
+    uint32_t id = ids[i];
+    android::ResTable::resource_name name;
+    if (!table.getResourceName(id, true, &name)) {
+      continue;
+    }
+    std::string entry_name = name.name8
+        ? std::string(name.name8, name.nameLen)
+        : std::string(android::String8(name.name, name.nameLen).string());
+    m_ids.push_back(id);
+    m_name_to_ids[entry_name].push_back(id);
+    m_id_to_name.emplace(id, std::move(entry_name));
+  }
+}
+
+const std::string* ResourceTableIndex::get_name(uint32_t id) const {
+  auto it = m_id_to_name.find(id);
+  return it == m_id_to_name.end() ? nullptr : &it->second;
+}
+
+const std::vector<uint32_t>& ResourceTableIndex::get_ids(
+    const std::string& name) const {
+  static const std::vector<uint32_t> s_none;
+  auto it = m_name_to_ids.find(name);
+  return it == m_name_to_ids.end() ? s_none : it->second;
+}
+
+std::unordered_set<uint32_t> ResourceTableIndex::get_ids_by_name_prefix(
+    const std::vector<std::string>& prefixes) const {
+  return get_resources_by_name_prefix(prefixes, m_name_to_ids);
+}
+
 void ensure_file_contents(
-    const std::string& file_contents,
+    const MappedFile& file,
     const std::string& filename) {
-  if (!file_contents.size()) {
+  if (!file.size()) {
     fprintf(stderr, "Unable to read file: %s\n", filename.data());
     throw std::runtime_error("Unable to read file: " + filename);
   }
@@ -559,9 +785,9 @@ void ensure_file_contents(
 
 std::unordered_set<uint32_t> get_xml_reference_attributes(
     const std::string& filename) {
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  return extract_xml_reference_attributes(file_contents, filename);
+  MappedFile file(filename);
+  ensure_file_contents(file, filename);
+  return extract_xml_reference_attributes(file, filename);
 }
 
 bool is_drawable_attribute(
@@ -592,12 +818,13 @@ int inline_xml_reference_attributes(
     const std::string& filename,
     const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
   int num_values_inlined = 0;
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  bool made_change = false;
+  // The parser edits the attributes where they are, which with a shared
+  // mapping is in the file itself.
+  MappedFile file(filename, true);
+  ensure_file_contents(file, filename);
 
   android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
+  parser.setTo(file.data(), file.size());
   if (parser.getError() != android::NO_ERROR) {
     throw std::runtime_error("Unable to read file: " + filename);
   }
@@ -626,7 +853,6 @@ int inline_xml_reference_attributes(
             android::Res_value new_value = p->second;
             parser.setAttribute(i, new_value);
             ++num_values_inlined;
-            made_change = true;
           }
         }
       }
@@ -634,22 +860,19 @@ int inline_xml_reference_attributes(
   } while (type != android::ResXMLParser::BAD_DOCUMENT &&
            type != android::ResXMLParser::END_DOCUMENT);
 
-  if (made_change) {
-    write_entire_file(filename, file_contents);
-  }
-
   return num_values_inlined;
 }
 
 void remap_xml_reference_attributes(
     const std::string& filename,
     const std::map<uint32_t, uint32_t>& kept_to_remapped_ids) {
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  bool made_change = false;
+  // As in inline_xml_reference_attributes(), the edits go straight to the
+  // file.
+  MappedFile file(filename, true);
+  ensure_file_contents(file, filename);
 
   android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
+  parser.setTo(file.data(), file.size());
   if (parser.getError() != android::NO_ERROR) {
     throw std::runtime_error("Unable to read file: " + filename);
   }
@@ -661,7 +884,6 @@ void remap_xml_reference_attributes(
     auto id_search = kept_to_remapped_ids.find(resourceIds[i]);
     if (id_search != kept_to_remapped_ids.end()) {
       resourceIds[i] = id_search->second;
-      made_change = true;
     }
   }
 
@@ -680,7 +902,6 @@ void remap_xml_reference_attributes(
             uint32_t new_value = kept_to_remapped_ids.at(outValue.data);
             if (new_value != outValue.data) {
               parser.setAttributeData(i, new_value);
-              made_change = true;
             }
           }
         }
@@ -688,12 +909,71 @@ void remap_xml_reference_attributes(
     }
   } while (type != android::ResXMLParser::BAD_DOCUMENT &&
            type != android::ResXMLParser::END_DOCUMENT);
+}
 
-  if (made_change) {
-    write_entire_file(filename, file_contents);
+void process_files_in_parallel(
+    const std::vector<std::string>& files,
+    const std::function<void(const std::string&)>& process) {
+  using Exceptions = std::vector<std::exception_ptr>;
+  auto wq = workqueue_mapreduce<const std::string*, Exceptions>(
+      [&process](const std::string* file) -> Exceptions {
+        try {
+          process(*file);
+          return {};
+        } catch (const std::exception&) {
+          return {std::current_exception()};
+        }
+      },
+      [](Exceptions a, Exceptions b) {
+        a.insert(a.end(), b.begin(), b.end());
+        return a;
+      });
+  for (const auto& file : files) {
+    wq.add_item(&file);
+  }
+  auto exceptions = wq.run_all();
+  if (!exceptions.empty()) {
+    throw aggregate_exception(exceptions);
   }
 }
 
+int inline_xml_reference_attributes(
+    const std::vector<std::string>& files,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
+  std::atomic<int> num_values_inlined{0};
+  process_files_in_parallel(files, [&](const std::string& file) {
+    num_values_inlined +=
+        inline_xml_reference_attributes(file, id_to_inline_value);
+  });
+  return num_values_inlined;
+}
+
+void remap_xml_reference_attributes(
+    const std::vector<std::string>& files,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids) {
+  process_files_in_parallel(files, [&](const std::string& file) {
+    remap_xml_reference_attributes(file, kept_to_remapped_ids);
+  });
+}
+
+/*
+ * Maps the files and extracts the class names from them in parallel, since
+ * apps tend to have thousands of layouts.
+ */
+std::unordered_set<std::string> extract_classes_from_files(
+    const std::vector<std::string>& files,
+    std::unordered_set<std::string> (*extract)(const MappedFile&)) {
+  auto wq = workqueue_mapreduce<const std::string*, ClassNames>(
+      [extract](const std::string* file) {
+        return extract(MappedFile(*file));
+      },
+      union_class_names);
+  for (const auto& file : files) {
+    wq.add_item(&file);
+  }
+  return wq.run_all();
+}
+
 std::vector<std::string> find_layout_files(const std::string& apk_directory) {
 
   std::vector<std::string> layout_files;
@@ -722,14 +1002,8 @@ std::vector<std::string> find_layout_files(const std::string& apk_directory) {
 }
 
 std::unordered_set<std::string> get_layout_classes(const std::string& apk_directory) {
-  std::vector<std::string> tmp = find_layout_files(apk_directory);
-  std::unordered_set<std::string> all_classes;
-  for (auto layout_file : tmp) {
-    std::string contents = read_entire_file(layout_file);
-    std::unordered_set<std::string> classes_from_layout = extract_classes_from_layout(contents);
-    all_classes.insert(classes_from_layout.begin(), classes_from_layout.end());
-  }
-  return all_classes;
+  return extract_classes_from_files(find_layout_files(apk_directory),
+                                    extract_classes_from_layout);
 }
 
 /**
@@ -760,14 +1034,134 @@ std::vector<std::string> find_native_library_files(const std::string& apk_direct
  * Return all potential java class names located in native libraries.
  */
 std::unordered_set<std::string> get_native_classes(const std::string& apk_directory) {
-  std::vector<std::string> native_libs = find_native_library_files(apk_directory);
-  std::unordered_set<std::string> all_classes;
-  for (auto native_lib : native_libs) {
-    std::string contents = read_entire_file(native_lib);
-    std::unordered_set<std::string> classes_from_layout = extract_classes_from_native_lib(contents);
-    all_classes.insert(classes_from_layout.begin(), classes_from_layout.end());
-  }
-  return all_classes;
+  return extract_classes_from_native_libs(
+      find_native_library_files(apk_directory));
+}
+
+namespace {
+
+constexpr const char* RESOURCE_SCAN_CACHE_HEADER = "redex-resource-scan 1";
+
+std::string fingerprint_files(const std::vector<std::string>& files) {
+  std::vector<std::string> sorted(files);
+  std::sort(sorted.begin(), sorted.end());
+  size_t seed = sorted.size();
+  for (const auto& file : sorted) {
+    struct stat st = {};
+    bool found = stat(file.c_str(), &st) == 0;
+    boost::hash_combine(seed, file);
+    boost::hash_combine(seed, found ? st.st_size : -1);
+#ifdef __APPLE__
+    const auto& mtime = st.st_mtimespec;
+#else
+    const auto& mtime = st.st_mtim;
+#endif
+    boost::hash_combine(seed, found ? mtime.tv_sec : 0);
+    boost::hash_combine(seed, found ? mtime.tv_nsec : 0);
+  }
+  std::ostringstream ss;
+  ss << std::hex << seed;
+  return ss.str();
+}
+
+} // namespace
+
+ResourceScanCache::ResourceScanCache(const std::string& cache_file)
+    : m_cache_file(cache_file) {}
+
+const std::unordered_set<std::string>& ResourceScanCache::get_manifest_classes(
+    const std::string& apk_directory) {
+  auto manifest = apk_directory + "/AndroidManifest.xml";
+  return get("manifest:" + apk_directory, {manifest}, [&]() {
+    return ::get_manifest_classes(manifest);
+  });
+}
+
+const std::unordered_set<std::string>& ResourceScanCache::get_layout_classes(
+    const std::string& apk_directory) {
+  auto files = find_layout_files(apk_directory);
+  return get("layouts:" + apk_directory, files, [&]() {
+    return extract_classes_from_files(files, extract_classes_from_layout);
+  });
+}
+
+const std::unordered_set<std::string>& ResourceScanCache::get_native_classes(
+    const std::string& apk_directory) {
+  auto files = find_native_library_files(apk_directory);
+  return get("native:" + apk_directory, files, [&]() {
+    return extract_classes_from_native_libs(files);
+  });
+}
+
+const std::unordered_set<std::string>& ResourceScanCache::get(
+    const std::string& key,
+    const std::vector<std::string>& files,
+    const std::function<std::unordered_set<std::string>()>& scan) {
+  if (!m_loaded) {
+    load();
+  }
+  auto fingerprint = fingerprint_files(files);
+  auto& entry = m_entries[key];
+  if (entry.fingerprint != fingerprint) {
+    entry.classes = scan();
+    entry.fingerprint = fingerprint;
+    save();
+  }
+  return entry.classes;
+}
+
+/*
+ * The cache file is a header line followed by, for each entry, a line with
+ * its tab-separated key, fingerprint and number of classes, and then the
+ * classes one per line. A file that doesn't parse is ignored and overwritten
+ * by the next save.
+ */
+void ResourceScanCache::load() {
+  m_loaded = true;
+  if (m_cache_file.empty()) {
+    return;
+  }
+  std::ifstream in(m_cache_file);
+  std::string line;
+  if (!std::getline(in, line) || line != RESOURCE_SCAN_CACHE_HEADER) {
+    return;
+  }
+  std::map<std::string, Entry> entries;
+  while (std::getline(in, line)) {
+    std::vector<std::string> fields;
+    boost::split(fields, line, boost::is_any_of("\t"));
+    if (fields.size() != 3 || fields[2].empty() ||
+        fields[2].find_first_not_of("0123456789") != std::string::npos) {
+      return;
+    }
+    auto& entry = entries[fields[0]];
+    entry.fingerprint = fields[1];
+    auto count = std::stoul(fields[2]);
+    for (size_t i = 0; i < count; ++i) {
+      if (!std::getline(in, line)) {
+        return;
+      }
+      entry.classes.emplace(line);
+    }
+  }
+  m_entries = std::move(entries);
+}
+
+void ResourceScanCache::save() const {
+  if (m_cache_file.empty()) {
+    return;
+  }
+  std::ostringstream out;
+  out << RESOURCE_SCAN_CACHE_HEADER << "\n";
+  for (const auto& pair : m_entries) {
+    const auto& entry = pair.second;
+    out << pair.first << "\t" << entry.fingerprint << "\t"
+        << entry.classes.size() << "\n";
+    for (const auto& cls : entry.classes) {
+      out << cls << "\n";
+    }
+  }
+  write_entire_file(m_cache_file, out.str());
 }
 
 void* map_file(
@@ -11,6 +11,7 @@
 
 #include <unordered_map>
 
+#include "Analyses.h"
 #include "ClassHierarchy.h"
 #include "DexUtil.h"
 #include "IRCode.h"
@@ -80,7 +81,7 @@ std::vector<DexMethod*> direct_methods(const std::vector<DexClass*>& scope) {
 }
 
 std::unordered_set<DexMethod*> find_private_methods(
-    const std::vector<DexClass*>& scope, const std::vector<DexMethod*>& cv) {
+    const ReverseRefIndex& refs, const std::vector<DexMethod*>& cv) {
   std::unordered_set<DexMethod*> candidates;
   for (auto m : cv) {
     TRACE(ACCESS, 3, "Considering for privatization: %s\n", SHOW(m));
@@ -88,17 +89,17 @@ std::unordered_set<DexMethod*> find_private_methods(
       candidates.emplace(m);
     }
   }
-  walk::opcodes(
-      scope,
-      [](DexMethod*) { return true; },
-      [&](DexMethod* caller, IRInstruction* inst) {
-        if (!inst->has_method()) return;
-        auto callee = resolve_method(inst->get_method(), MethodSearch::Any);
-        if (callee == nullptr || callee->get_class() == caller->get_class()) {
-          return;
-        }
+  // Each distinct method ref only needs to be resolved once.
+  for (const auto& p : refs.all_method_refs()) {
+    auto callee = resolve_method(p.first, MethodSearch::Any);
+    if (callee == nullptr || !candidates.count(callee)) continue;
+    for (const auto& occ : p.second) {
+      if (occ.method->get_class() != callee->get_class()) {
         candidates.erase(callee);
-      });
+        break;
+      }
+    }
+  }
   return candidates;
 }
 
@@ -136,8 +137,9 @@ void AccessMarkingPass::run_pass(DexStoresVector& stores,
                                  ConfigFiles& cfg,
                                  PassManager& pm) {
   auto scope = build_class_scope(stores);
-  ClassHierarchy ch = build_type_hierarchy(scope);
-  SignatureMap sm = build_signature_map(ch);
+  auto class_scopes = get_class_scopes(scope);
+  const auto& ch = class_scopes->get_class_hierarchy();
+  const auto& sm = class_scopes->get_signature_map();
   if (m_finalize_classes) {
     auto n_classes_final = mark_classes_final(scope, ch);
     pm.incr_metric("finalized_classes", n_classes_final);
@@ -152,7 +154,8 @@ void AccessMarkingPass::run_pass(DexStoresVector& stores,
   auto dmethods = direct_methods(scope);
   candidates.insert(candidates.end(), dmethods.begin(), dmethods.end());
   if (m_privatize_methods) {
-    auto privates = find_private_methods(scope, candidates);
+    const auto& refs = pm.analyses().get<ReverseRefsAnalysis>(stores);
+    auto privates = find_private_methods(refs, candidates);
     fix_call_sites_private(scope, privates);
     mark_methods_private(privates);
     pm.incr_metric("privatized_methods", privates.size());
@@ -136,11 +136,9 @@ CreateReferenceGraphPass::exception_ref_builder(
   });
 }
 
-CreateReferenceGraphPass::InstructionWalkerFn
-CreateReferenceGraphPass::instruction_ref_builder(
-    const Scope& scope,
-    refs_t& class_refs) {
-  return ([this, &class_refs](const DexMethod* meth, IRInstruction* insn) {
+CreateReferenceGraphPass::InstructionRefBuilderFn
+CreateReferenceGraphPass::instruction_ref_builder(const Scope& scope) {
+  return ([this](refs_t& class_refs, DexMethod* meth, IRInstruction* insn) {
     const auto* enclosing_class = type_class(meth->get_class());
 
     if (insn->has_type()) {
@@ -177,6 +175,12 @@ CreateReferenceGraphPass::instruction_ref_builder(
   });
 }
 
+void CreateReferenceGraphPass::merge_refs(const refs_t& from, refs_t& into) {
+  for (const auto& entry : from) {
+    into[entry.first].insert(entry.second.begin(), entry.second.end());
+  }
+}
+
 void CreateReferenceGraphPass::gather_all(const Scope& scope, refs_t& class_refs) {
   for (const auto* cls : scope) {
     std::vector<DexType*> types;
@@ -203,11 +207,16 @@ void CreateReferenceGraphPass::build_refs(const Scope& scope, refs_t& class_refs
     }
     if (CreateReferenceGraphPass::config.refs_in_code) {
       walk::methods(scope, exception_ref_builder(scope, class_refs));
-      walk::opcodes(
+      auto code_refs = walk::parallel::reduce_opcodes<refs_t>(
         scope,
         [](const DexMethod*) { return true; },
-        instruction_ref_builder(scope, class_refs)
+        instruction_ref_builder(scope),
+        [](refs_t a, refs_t b) {
+          merge_refs(b, a);
+          return a;
+        }
       );
+      merge_refs(code_refs, class_refs);
     }
   }
 }
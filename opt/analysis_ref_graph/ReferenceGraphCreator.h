@@ -57,7 +57,10 @@ class CreateReferenceGraphPass : public Pass {
   using MethodWalkerFn = std::function<void(DexMethod*)>;
   using FieldWalkerFn = std::function<void(DexField*)>;
   using AnnotationWalkerFn = std::function<void(DexAnnotation*)>;
-  using InstructionWalkerFn = std::function<void(DexMethod*, IRInstruction*)>;
+  // Instruction references are gathered in parallel, so the builder adds to
+  // whichever graph it is handed rather than to a shared one.
+  using InstructionRefBuilderFn =
+      std::function<void(refs_t&, DexMethod*, IRInstruction*)>;
 
   void build_super_and_interface_refs(
       const Scope& scope,
@@ -93,9 +96,9 @@ class CreateReferenceGraphPass : public Pass {
       const Scope& scope,
       refs_t& class_refs);
 
-  InstructionWalkerFn instruction_ref_builder(
-      const Scope& scope,
-      refs_t& class_refs);
+  InstructionRefBuilderFn instruction_ref_builder(const Scope& scope);
+
+  static void merge_refs(const refs_t& from, refs_t& into);
 
   void gather_all(const Scope& scope, refs_t& class_refs);
 
@@ -17,6 +17,7 @@
 #include "DexUtil.h"
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 constexpr const char* METRIC_ANNO_KILLED = "num_anno_killed";
 constexpr const char* METRIC_ANNO_TOTAL = "num_anno_total";
@@ -107,196 +108,226 @@ AnnoKill::AnnoKill(Scope& scope,
   }
 }
 
-AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
-  AnnoKill::AnnoSet all_annos;
+namespace {
 
-  // all used annotations
-  auto annos_in_aset = [&](DexAnnotationSet* aset) {
-    if (!aset) {
-      return;
-    }
-    for (const auto& anno : aset->get_annotations()) {
-      all_annos.insert(anno->type());
-    }
-  };
-
-  for (const auto& cls : m_scope) {
-    // all annotations referenced in classes
-    annos_in_aset(cls->get_anno_set());
-
-    // all classes marked as annotation
-    if (is_annotation(cls)) {
-      all_annos.insert(cls->get_type());
-    }
+// Runs fn on the index of every class of the scope, in parallel.
+void for_each_class_index(const Scope& scope,
+                          const std::function<void(size_t)>& fn) {
+  auto wq = workqueue_foreach<size_t>(fn);
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
   }
+  wq.run_all();
+}
 
-  // all annotations in methods
-  walk::methods(m_scope, [&](DexMethod* method) {
-    annos_in_aset(method->get_anno_set());
-    auto param_annos = method->get_param_anno();
-    if (!param_annos) {
-      return;
-    }
-    for (auto pa : *param_annos) {
-      annos_in_aset(pa.second);
-    }
-  });
-  // all annotations in fields
-  walk::fields(m_scope,
-              [&](DexField* field) { annos_in_aset(field->get_anno_set()); });
+} // namespace
 
-  AnnoKill::AnnoSet referenced_annos;
+AnnoKill::AnnotatedMembers AnnoKill::gather_annotated_members() {
+  std::vector<AnnotatedMembers> class_members(m_scope.size());
+  for_each_class_index(m_scope, [&](size_t i) {
+    auto cls = m_scope[i];
+    auto& members = class_members[i];
+    Scope cls_scope{cls};
 
-  // mark an annotation as "unremovable" if a field is typed with that
-  // annotation
-  walk::fields(m_scope, [&](DexField* field) {
-    // don't look at fields defined on the annotation itself
-    const auto field_cls_type = field->get_class();
-    if (all_annos.count(field_cls_type) > 0) {
-      return;
-    }
+    auto annos_in_aset = [&](DexAnnotationSet* aset) {
+      for (const auto& anno : aset->get_annotations()) {
+        members.anno_types.insert(anno->type());
+      }
+    };
 
-    const auto field_cls = type_class(field_cls_type);
-    if (field_cls != nullptr && is_annotation(field_cls)) {
-      return;
+    // all annotations referenced in classes
+    if (cls->get_anno_set()) {
+      annos_in_aset(cls->get_anno_set());
+      members.classes.push_back(cls);
     }
 
-    auto ftype = field->get_type();
-    if (all_annos.count(ftype) > 0) {
-      TRACE(ANNO,
-            3,
-            "Field typed with an annotation type %s.%s:%s\n",
-            SHOW(field->get_class()),
-            SHOW(field->get_name()),
-            SHOW(ftype));
-      referenced_annos.insert(ftype);
+    // all classes marked as annotation
+    if (is_annotation(cls)) {
+      members.anno_types.insert(cls->get_type());
     }
+
+    // all annotations in methods
+    walk::methods(cls_scope, [&](DexMethod* method) {
+      auto aset = method->get_anno_set();
+      auto param_annos = method->get_param_anno();
+      if (!aset && !param_annos) {
+        return;
+      }
+      if (aset) {
+        annos_in_aset(aset);
+      }
+      if (param_annos) {
+        for (auto pa : *param_annos) {
+          annos_in_aset(pa.second);
+        }
+      }
+      members.methods.push_back(method);
+    });
+
+    // all annotations in fields
+    walk::fields(cls_scope, [&](DexField* field) {
+      auto aset = field->get_anno_set();
+      if (aset) {
+        annos_in_aset(aset);
+        members.fields.push_back(field);
+      }
+    });
   });
 
-  // mark an annotation as "unremovable" if a method signature contains a type
-  // with that annotation
-  walk::methods(m_scope, [&](DexMethod* meth) {
-    // don't look at methods defined on the annotation itself
-    const auto meth_cls_type = meth->get_class();
-    if (all_annos.count(meth_cls_type) > 0) {
-      return;
-    }
+  AnnotatedMembers all_members;
+  for (const auto& members : class_members) {
+    all_members.anno_types.insert(members.anno_types.begin(),
+                                  members.anno_types.end());
+    all_members.classes.insert(all_members.classes.end(),
+                               members.classes.begin(),
+                               members.classes.end());
+    all_members.methods.insert(all_members.methods.end(),
+                               members.methods.begin(),
+                               members.methods.end());
+    all_members.fields.insert(all_members.fields.end(),
+                              members.fields.begin(),
+                              members.fields.end());
+  }
+  return all_members;
+}
+
+AnnoKill::AnnoSet AnnoKill::get_referenced_annos(
+    const AnnoKill::AnnoSet& all_annos) {
+  std::vector<AnnoKill::AnnoSet> class_refs(m_scope.size());
+  for_each_class_index(m_scope, [&](size_t i) {
+    auto cls = m_scope[i];
+    auto& referenced_annos = class_refs[i];
 
-    const auto meth_cls = type_class(meth_cls_type);
-    if (meth_cls != nullptr && is_annotation(meth_cls)) {
+    // don't look at members defined on the annotation itself
+    if (all_annos.count(cls->get_type()) > 0 || is_annotation(cls)) {
       return;
     }
+    Scope cls_scope{cls};
 
-    const auto& has_anno = [&](DexType* type) {
-      if (all_annos.count(type) > 0) {
+    // mark an annotation as "unremovable" if a field is typed with that
+    // annotation
+    walk::fields(cls_scope, [&](DexField* field) {
+      auto ftype = field->get_type();
+      if (all_annos.count(ftype) > 0) {
         TRACE(ANNO,
               3,
-              "Method contains annotation type in signature %s.%s:%s\n",
-              SHOW(meth->get_class()),
-              SHOW(meth->get_name()),
-              SHOW(meth->get_proto()));
-        referenced_annos.insert(type);
+              "Field typed with an annotation type %s.%s:%s\n",
+              SHOW(field->get_class()),
+              SHOW(field->get_name()),
+              SHOW(ftype));
+        referenced_annos.insert(ftype);
       }
-    };
-
-    const auto proto = meth->get_proto();
-    has_anno(proto->get_rtype());
-    for (const auto& arg : proto->get_args()->get_type_list()) {
-      has_anno(arg);
-    }
-  });
-
-  // mark an annotation as "unremovable" if any opcode references the annotation
-  // type
-  walk::opcodes(
-      m_scope,
-      [](DexMethod*) { return true; },
-      [&](DexMethod* meth, IRInstruction* insn) {
-        // don't look at methods defined on the annotation itself
-        const auto meth_cls_type = meth->get_class();
-        if (all_annos.count(meth_cls_type) > 0) {
-          return;
-        }
-        const auto meth_cls = type_class(meth_cls_type);
-        if (meth_cls != nullptr && is_annotation(meth_cls)) {
-          return;
+    });
+
+    // mark an annotation as "unremovable" if a method signature contains a
+    // type with that annotation
+    walk::methods(cls_scope, [&](DexMethod* meth) {
+      const auto& has_anno = [&](DexType* type) {
+        if (all_annos.count(type) > 0) {
+          TRACE(ANNO,
+                3,
+                "Method contains annotation type in signature %s.%s:%s\n",
+                SHOW(meth->get_class()),
+                SHOW(meth->get_name()),
+                SHOW(meth->get_proto()));
+          referenced_annos.insert(type);
         }
+      };
 
-        if (insn->has_type()) {
-          auto type = insn->get_type();
-          if (all_annos.count(type) > 0) {
-            referenced_annos.insert(type);
-            TRACE(ANNO,
-                  3,
-                  "Annotation referenced in type opcode\n\t%s.%s:%s - %s\n",
-                  SHOW(meth->get_class()),
-                  SHOW(meth->get_name()),
-                  SHOW(meth->get_proto()),
-                  SHOW(insn));
-          }
-        } else if (insn->has_field()) {
-          auto field = insn->get_field();
-          auto fdef = resolve_field(field,
-                                    is_sfield_op(insn->opcode())
-                                        ? FieldSearch::Static
-                                        : FieldSearch::Instance);
-          if (fdef != nullptr) field = fdef;
-
-          bool referenced = false;
-          auto owner = field->get_class();
-          if (all_annos.count(owner) > 0) {
-            referenced = true;
-            referenced_annos.insert(owner);
-          }
-          auto type = field->get_type();
-          if (all_annos.count(type) > 0) {
-            referenced = true;
-            referenced_annos.insert(type);
-          }
-          if (referenced) {
-            TRACE(ANNO,
-                  3,
-                  "Annotation referenced in field opcode\n\t%s.%s:%s - %s\n",
-                  SHOW(meth->get_class()),
-                  SHOW(meth->get_name()),
-                  SHOW(meth->get_proto()),
-                  SHOW(insn));
-          }
-        } else if (insn->has_method()) {
-          auto method = insn->get_method();
-          DexMethod* methdef = resolve_method(method, opcode_to_search(insn));
-          if (methdef != nullptr) method = methdef;
-
-          bool referenced = false;
-          auto owner = method->get_class();
-          if (all_annos.count(owner) > 0) {
-            referenced = true;
-            referenced_annos.insert(owner);
-          }
-          auto proto = method->get_proto();
-          auto rtype = proto->get_rtype();
-          if (all_annos.count(rtype) > 0) {
-            referenced = true;
-            referenced_annos.insert(rtype);
-          }
-          auto arg_list = proto->get_args();
-          for (const auto& arg : arg_list->get_type_list()) {
-            if (all_annos.count(arg) > 0) {
+      const auto proto = meth->get_proto();
+      has_anno(proto->get_rtype());
+      for (const auto& arg : proto->get_args()->get_type_list()) {
+        has_anno(arg);
+      }
+    });
+
+    // mark an annotation as "unremovable" if any opcode references the
+    // annotation type
+    walk::opcodes(
+        cls_scope,
+        [](DexMethod*) { return true; },
+        [&](DexMethod* meth, IRInstruction* insn) {
+          if (insn->has_type()) {
+            auto type = insn->get_type();
+            if (all_annos.count(type) > 0) {
+              referenced_annos.insert(type);
+              TRACE(ANNO,
+                    3,
+                    "Annotation referenced in type opcode\n\t%s.%s:%s - %s\n",
+                    SHOW(meth->get_class()),
+                    SHOW(meth->get_name()),
+                    SHOW(meth->get_proto()),
+                    SHOW(insn));
+            }
+          } else if (insn->has_field()) {
+            auto field = insn->get_field();
+            auto fdef = resolve_field(field,
+                                      is_sfield_op(insn->opcode())
+                                          ? FieldSearch::Static
+                                          : FieldSearch::Instance);
+            if (fdef != nullptr) field = fdef;
+
+            bool referenced = false;
+            auto owner = field->get_class();
+            if (all_annos.count(owner) > 0) {
               referenced = true;
-              referenced_annos.insert(arg);
+              referenced_annos.insert(owner);
+            }
+            auto type = field->get_type();
+            if (all_annos.count(type) > 0) {
+              referenced = true;
+              referenced_annos.insert(type);
+            }
+            if (referenced) {
+              TRACE(ANNO,
+                    3,
+                    "Annotation referenced in field opcode\n\t%s.%s:%s - %s\n",
+                    SHOW(meth->get_class()),
+                    SHOW(meth->get_name()),
+                    SHOW(meth->get_proto()),
+                    SHOW(insn));
+            }
+          } else if (insn->has_method()) {
+            auto method = insn->get_method();
+            DexMethod* methdef = resolve_method(method, opcode_to_search(insn));
+            if (methdef != nullptr) method = methdef;
+
+            bool referenced = false;
+            auto owner = method->get_class();
+            if (all_annos.count(owner) > 0) {
+              referenced = true;
+              referenced_annos.insert(owner);
+            }
+            auto proto = method->get_proto();
+            auto rtype = proto->get_rtype();
+            if (all_annos.count(rtype) > 0) {
+              referenced = true;
+              referenced_annos.insert(rtype);
+            }
+            auto arg_list = proto->get_args();
+            for (const auto& arg : arg_list->get_type_list()) {
+              if (all_annos.count(arg) > 0) {
+                referenced = true;
+                referenced_annos.insert(arg);
+              }
+            }
+            if (referenced) {
+              TRACE(ANNO,
+                    3,
+                    "Annotation referenced in method opcode\n\t%s.%s:%s - %s\n",
+                    SHOW(meth->get_class()),
+                    SHOW(meth->get_name()),
+                    SHOW(meth->get_proto()),
+                    SHOW(insn));
             }
           }
-          if (referenced) {
-            TRACE(ANNO,
-                  3,
-                  "Annotation referenced in method opcode\n\t%s.%s:%s - %s\n",
-                  SHOW(meth->get_class()),
-                  SHOW(meth->get_name()),
-                  SHOW(meth->get_proto()),
-                  SHOW(insn));
-          }
-        }
-      });
+        });
+  });
+
+  AnnoKill::AnnoSet referenced_annos;
+  for (const auto& refs : class_refs) {
+    referenced_annos.insert(refs.begin(), refs.end());
+  }
   return referenced_annos;
 }
 
@@ -497,16 +528,14 @@ std::unordered_set<const DexType*> AnnoKill::build_anno_keep(DexAnnotationSet* a
 }
 
 bool AnnoKill::kill_annotations() {
-  const auto& referenced_annos = get_referenced_annos();
+  const auto& members = gather_annotated_members();
+  const auto& referenced_annos = get_referenced_annos(members.anno_types);
   if (!m_only_force_kill) {
     m_kill = get_removable_annotation_instances();
   }
 
-  for (auto clazz : m_scope) {
+  for (auto clazz : members.classes) {
     DexAnnotationSet* aset = clazz->get_anno_set();
-    if (!aset) {
-      continue;
-    }
     auto keep_list = build_anno_keep(aset);
     auto& class_hier_keep_list = m_anno_class_hierarchy_keep[clazz->get_type()];
     keep_list.insert(class_hier_keep_list.begin(), class_hier_keep_list.end());
@@ -523,7 +552,7 @@ bool AnnoKill::kill_annotations() {
     }
   }
 
-  walk::methods(m_scope, [&](DexMethod* method) {
+  for (auto method : members.methods) {
     // Method annotations
     auto method_aset = method->get_anno_set();
     if (method_aset) {
@@ -573,13 +602,10 @@ bool AnnoKill::kill_annotations() {
         param_annos->clear();
       }
     }
-  });
+  }
 
-  walk::fields(m_scope, [&](DexField* field) {
+  for (auto field : members.fields) {
     DexAnnotationSet* aset = field->get_anno_set();
-    if (!aset) {
-      return;
-    }
     m_stats.field_asets++;
     auto keep_list = build_anno_keep(aset);
     cleanup_aset(aset, referenced_annos, keep_list);
@@ -593,7 +619,7 @@ bool AnnoKill::kill_annotations() {
       field->clear_annotations();
       m_stats.field_asets_cleared++;
     }
-  });
+  }
 
   bool classes_removed = false;
   // We're done removing annotation instances, go ahead and remove annotation
@@ -56,10 +56,25 @@ class AnnoKill {
   AnnoKillStats get_stats() const { return m_stats; }
 
  private:
+  // The members of the scope that carry annotations, with the types of all
+  // the annotations they carry and of all the annotation classes.
+  struct AnnotatedMembers {
+    AnnoSet anno_types;
+    std::vector<DexClass*> classes;
+    // Methods with method or parameter annotations
+    std::vector<DexMethod*> methods;
+    std::vector<DexField*> fields;
+  };
+
+  // Gathers the AnnotatedMembers of the scope, with one parallel walk over
+  // the classes. The members are listed in the order of walk::methods and
+  // walk::fields.
+  AnnotatedMembers gather_annotated_members();
+
   // Gets the set of all annotations referenced in code
   // either by the use of SomeClass.class, as a parameter of a method
   // call or if the annotation is a field of a class.
-  AnnoSet get_referenced_annos();
+  AnnoSet get_referenced_annos(const AnnoSet& all_annos);
 
   // Retrieves the list of annotation instances that match the given set
   // of annotation types to be removed.
@@ -18,6 +18,7 @@
 
 #include <boost/functional/hash.hpp>
 
+#include "Analyses.h"
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexLoader.h"
@@ -158,6 +159,7 @@ class BridgeRemover {
 
   const std::vector<DexClass*>* m_scope;
   ClassHierarchy m_ch;
+  const ReverseRefIndex& m_refs;
   PassManager& m_mgr;
   std::unordered_map<DexMethod*, DexMethod*> m_bridges_to_bridgees;
   std::unordered_multimap<MethodRef, DexMethod*, MethodRefHash>
@@ -255,27 +257,30 @@ class BridgeRemover {
     }
   }
 
-  void exclude_referenced_bridgee(DexMethod* code_method, IRCode& code) {
-    for (auto& mie : InstructionIterable(&code)) {
-      auto inst = mie.insn;
-      if (!is_invoke(inst->opcode())) continue;
-      auto method = inst->get_method();
-      auto range = m_potential_bridgee_refs.equal_range(
-          MethodRef(method->get_class(), method->get_name(),
-              method->get_proto()));
-      for (auto it = range.first; it != range.second; ++it) {
-        auto referenced_bridge = it->second;
+  void exclude_code_referenced_bridgees() {
+    for (const auto& p : m_potential_bridgee_refs) {
+      auto ref =
+          DexMethod::get_method(const_cast<DexType*>(std::get<0>(p.first)),
+                                std::get<1>(p.first),
+                                std::get<2>(p.first));
+      if (ref == nullptr) continue;
+      auto referenced_bridge = p.second;
+      for (const auto& occ : m_refs.method_refs(ref)) {
         // Don't count the bridge itself
-        if (referenced_bridge == code_method) continue;
+        if (occ.method == referenced_bridge ||
+            !is_invoke(occ.insn->opcode())) {
+          continue;
+        }
         TRACE(BRIDGE,
               5,
               "Rejecting, reference `%s.%s.%s' in `%s' blocks `%s'\n",
-              SHOW(method->get_class()),
-              SHOW(method->get_name()),
-              SHOW(method->get_proto()),
-              SHOW(code_method),
+              SHOW(ref->get_class()),
+              SHOW(ref->get_name()),
+              SHOW(ref->get_proto()),
+              SHOW(occ.method),
               SHOW(referenced_bridge));
         m_bridges_to_bridgees.erase(referenced_bridge);
+        break;
       }
     }
   }
@@ -326,11 +331,7 @@ class BridgeRemover {
       m_bridges_to_bridgees.erase(kill);
     }
 
-    walk::code(*m_scope,
-              [](DexMethod*) { return true; },
-              [&](DexMethod* m, IRCode& code) {
-                exclude_referenced_bridgee(m, code);
-              });
+    exclude_code_referenced_bridgees();
   }
 
   void inline_bridges() {
@@ -360,8 +361,10 @@ class BridgeRemover {
   }
 
  public:
-  BridgeRemover(const std::vector<DexClass*>& scope, PassManager& mgr)
-      : m_scope(&scope), m_mgr(mgr) {
+  BridgeRemover(const std::vector<DexClass*>& scope,
+                const ReverseRefIndex& refs,
+                PassManager& mgr)
+      : m_scope(&scope), m_refs(refs), m_mgr(mgr) {
     m_ch = build_type_hierarchy(scope);
   }
 
@@ -388,7 +391,8 @@ void BridgePass::run_pass(DexStoresVector& stores, ConfigFiles& cfg, PassManager
     return;
   }
   Scope scope = build_class_scope(stores);
-  BridgeRemover(scope, mgr).run();
+  const auto& refs = mgr.analyses().get<ReverseRefsAnalysis>(stores);
+  BridgeRemover(scope, refs, mgr).run();
 }
 
 static BridgePass s_pass;
@@ -10,14 +10,17 @@
 #include "CheckBreadcrumbs.h"
 
 #include <algorithm>
+#include <memory>
 #include <unordered_set>
 #include <sstream>
 
 #include "Walkers.h"
 #include "DexClass.h"
 #include "DexUtil.h"
+#include "IRCode.h"
 #include "IRInstruction.h"
 #include "Resolver.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -77,18 +80,29 @@ size_t illegal_elements(const MethodInsns& method_to_insns,
   return num_illegal_cross_store_refs;
 }
 
+template <class Map>
+void merge_method_insns(Map& into, Map& from) {
+  for (auto& pair : from) {
+    auto& method_to_insns = into[pair.first];
+    for (auto& insns : pair.second) {
+      auto& to = method_to_insns[insns.first];
+      to.insert(to.end(), insns.second.begin(), insns.second.end());
+    }
+  }
+}
+
+template <class Map>
+void merge_lists(Map& into, Map& from) {
+  for (auto& pair : from) {
+    auto& to = into[pair.first];
+    to.insert(to.end(), pair.second.begin(), pair.second.end());
+  }
+}
+
 /**
- * Performs 2 kind of verifications:
- * 1- no references should be to a DexClass that is "internal"
- * but not in scope (effectively deleted)
- * 2- if a field or method reference is a def the field or method
- * must exist on the class it is defined on
- * Those are 2 relatively common problems we introduce: leave references
- * to deleted types, methods or fields.
+ * What the checks find, for the whole scope or for a single class.
  */
-class Breadcrumbs {
-  const Scope& scope;
-  std::unordered_set<const DexClass*> classes;
+struct Findings {
   std::map<const DexType*, Fields, dextypes_comparator> bad_fields;
   std::map<const DexType*, Methods, dextypes_comparator> bad_methods;
   std::map<const DexType*, MethodInsns, dextypes_comparator> bad_type_insns;
@@ -99,6 +113,49 @@ class Breadcrumbs {
   MethodInsns illegal_field_type;
   MethodInsns illegal_field_cls;
   MethodInsns illegal_method_call;
+
+  bool empty() const {
+    return bad_fields.empty() && bad_methods.empty() &&
+           bad_type_insns.empty() && bad_field_insns.empty() &&
+           bad_meth_insns.empty() && illegal_field.empty() &&
+           illegal_type.empty() && illegal_field_type.empty() &&
+           illegal_field_cls.empty() && illegal_method_call.empty();
+  }
+
+  // Appends what `other` found after what was found so far, so merging the
+  // findings of each class in scope order gives the same lists as checking
+  // the classes one after the other.
+  void merge(Findings& other) {
+    merge_lists(bad_fields, other.bad_fields);
+    merge_lists(bad_methods, other.bad_methods);
+    merge_method_insns(bad_type_insns, other.bad_type_insns);
+    merge_method_insns(bad_field_insns, other.bad_field_insns);
+    merge_method_insns(bad_meth_insns, other.bad_meth_insns);
+    merge_lists(illegal_field, other.illegal_field);
+    merge_lists(illegal_type, other.illegal_type);
+    merge_lists(illegal_field_type, other.illegal_field_type);
+    merge_lists(illegal_field_cls, other.illegal_field_cls);
+    merge_lists(illegal_method_call, other.illegal_method_call);
+  }
+};
+
+/**
+ * Performs 2 kind of verifications:
+ * 1- no references should be to a DexClass that is "internal"
+ * but not in scope (effectively deleted)
+ * 2- if a field or method reference is a def the field or method
+ * must exist on the class it is defined on
+ * Those are 2 relatively common problems we introduce: leave references
+ * to deleted types, methods or fields.
+ *
+ * The classes are checked in parallel, each into its own Findings, which are
+ * then merged in scope order so that the reports don't depend on the
+ * scheduling.
+ */
+class Breadcrumbs {
+  const Scope& scope;
+  std::unordered_set<const DexClass*> classes;
+  Findings found;
   XStoreRefs xstores;
   bool multiple_root_store_dexes;
 
@@ -112,9 +169,24 @@ class Breadcrumbs {
   }
 
   void check_breadcrumbs() {
-    check_fields();
-    check_methods();
-    check_opcodes();
+    // Most classes are clean, so only those with findings keep them around.
+    std::vector<std::unique_ptr<Findings>> class_findings(scope.size());
+    auto wq = workqueue_foreach<size_t>([&](size_t idx) {
+      Findings out;
+      check_class(scope[idx], out);
+      if (!out.empty()) {
+        class_findings[idx].reset(new Findings(std::move(out)));
+      }
+    });
+    for (size_t idx = 0; idx < scope.size(); ++idx) {
+      wq.add_item(idx);
+    }
+    wq.run_all();
+    for (auto& findings : class_findings) {
+      if (findings) {
+        found.merge(*findings);
+      }
+    }
   }
 
   void report_deleted_types(bool report_only, PassManager& mgr) {
@@ -123,13 +195,13 @@ class Breadcrumbs {
     size_t bad_type_insns_count = 0;
     size_t bad_field_insns_count = 0;
     size_t bad_meths_insns_count = 0;
-    if (bad_fields.size() > 0 ||
-        bad_methods.size() > 0 ||
-        bad_type_insns.size() > 0 ||
-        bad_field_insns.size() > 0 ||
-        bad_meth_insns.size() > 0) {
+    if (found.bad_fields.size() > 0 ||
+        found.bad_methods.size() > 0 ||
+        found.bad_type_insns.size() > 0 ||
+        found.bad_field_insns.size() > 0 ||
+        found.bad_meth_insns.size() > 0) {
       std::stringstream ss;
-      for (const auto& bad_field : bad_fields) {
+      for (const auto& bad_field : found.bad_fields) {
         for (const auto& field : bad_field.second) {
           bad_fields_count++;
           ss << "Reference to deleted type " <<
@@ -137,7 +209,7 @@ class Breadcrumbs {
               SHOW(field) << std::endl;
         }
       }
-      for (const auto& bad_meth : bad_methods) {
+      for (const auto& bad_meth : found.bad_methods) {
         for (const auto& meth : bad_meth.second) {
           bad_methods_count++;
           ss << "Reference to deleted type " <<
@@ -145,7 +217,7 @@ class Breadcrumbs {
               SHOW(meth) << std::endl;
         }
       }
-      for (const auto& bad_insns : bad_type_insns) {
+      for (const auto& bad_insns : found.bad_type_insns) {
         for (const auto& insns : bad_insns.second) {
           for (const auto& insn : insns.second) {
             bad_type_insns_count++;
@@ -155,7 +227,7 @@ class Breadcrumbs {
           }
         }
       }
-      for (const auto& bad_insns : bad_field_insns) {
+      for (const auto& bad_insns : found.bad_field_insns) {
         for (const auto& insns : bad_insns.second) {
           for (const auto& insn : insns.second) {
             bad_field_insns_count++;
@@ -165,7 +237,7 @@ class Breadcrumbs {
           }
         }
       }
-      for (const auto& bad_insns : bad_meth_insns) {
+      for (const auto& bad_insns : found.bad_meth_insns) {
         for (const auto& insns : bad_insns.second) {
           for (const auto& insn : insns.second) {
             bad_meths_insns_count++;
@@ -204,7 +276,7 @@ class Breadcrumbs {
   void report_illegal_refs(bool fail_if_illegal_refs, PassManager& mgr) {
     size_t num_illegal_fields = 0;
     std::stringstream ss;
-    for (const auto& pair : illegal_field) {
+    for (const auto& pair : found.illegal_field) {
       const auto type = pair.first;
       const auto& fields = pair.second;
       num_illegal_fields += fields.size();
@@ -218,13 +290,13 @@ class Breadcrumbs {
     }
 
     size_t num_illegal_type_refs =
-      illegal_elements(illegal_type, "type refs", ss);
+      illegal_elements(found.illegal_type, "type refs", ss);
     size_t num_illegal_field_type_refs =
-      illegal_elements(illegal_field_type, "field type refs", ss);
+      illegal_elements(found.illegal_field_type, "field type refs", ss);
     size_t num_illegal_field_cls =
-      illegal_elements(illegal_field_cls, "field class refs", ss);
+      illegal_elements(found.illegal_field_cls, "field class refs", ss);
     size_t num_illegal_method_calls =
-      illegal_elements(illegal_method_call, "method call", ss);
+      illegal_elements(found.illegal_method_call, "method call", ss);
 
     size_t num_illegal_cross_store_refs =
       num_illegal_fields + num_illegal_type_refs +
@@ -300,72 +372,90 @@ class Breadcrumbs {
   void bad_type(
       const DexType* type,
       const DexMethod* method,
-      const IRInstruction* insn) {
-    bad_type_insns[type][method].emplace_back(insn);
+      const IRInstruction* insn,
+      Findings& out) {
+    out.bad_type_insns[type][method].emplace_back(insn);
+  }
+
+  void check_class(const DexClass* cls, Findings& out) {
+    for (auto field : cls->get_ifields()) {
+      check_field(field, out);
+    }
+    for (auto field : cls->get_sfields()) {
+      check_field(field, out);
+    }
+    for (auto methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      for (auto method : *methods) {
+        check_method_def(method, out);
+      }
+    }
+    for (auto methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      for (auto method : *methods) {
+        check_opcodes(method, out);
+      }
+    }
   }
 
   // verify that all field definitions are of a type not deleted
-  void check_fields() {
-    walk::fields(scope,
-        [&](DexField* field) {
-          const auto& type = check_type(field->get_type());
-          if (type == nullptr) {
-            const auto cls = field->get_class();
-            const auto field_type = field->get_type();
-            if (is_illegal_cross_store(cls, field_type)) {
-              illegal_field[cls].emplace_back(field);
-            }
-            return;
-          }
-          bad_fields[type].emplace_back(field);
-        });
+  void check_field(const DexField* field, Findings& out) {
+    const auto& type = check_type(field->get_type());
+    if (type == nullptr) {
+      const auto cls = field->get_class();
+      const auto field_type = field->get_type();
+      if (is_illegal_cross_store(cls, field_type)) {
+        out.illegal_field[cls].emplace_back(field);
+      }
+      return;
+    }
+    out.bad_fields[type].emplace_back(field);
   }
 
   // verify that all method definitions use not deleted types in their sig
-  void check_methods() {
-    walk::methods(scope,
-        [&](DexMethod* method) {
-          const auto& type = check_method(method);
-          if (type == nullptr) return;
-          bad_methods[type].emplace_back(method);
-        });
+  void check_method_def(const DexMethod* method, Findings& out) {
+    const auto& type = check_method(method);
+    if (type == nullptr) return;
+    out.bad_methods[type].emplace_back(method);
   }
 
   // verify that all opcodes are to non deleted references
-  void check_type_opcode(const DexMethod* method, IRInstruction* insn) {
+  void check_type_opcode(const DexMethod* method,
+                         IRInstruction* insn,
+                         Findings& out) {
     const DexType* type = insn->get_type();
     type = check_type(type);
     if (type != nullptr) {
-      bad_type(type, method, insn);
+      bad_type(type, method, insn, out);
     } else {
       const auto cls = method->get_class();
       if (is_illegal_cross_store(cls, insn->get_type())) {
-        illegal_type[method].emplace_back(insn);
+        out.illegal_type[method].emplace_back(insn);
       }
     }
   }
 
-  void check_field_opcode(const DexMethod* method, IRInstruction* insn) {
+  void check_field_opcode(const DexMethod* method,
+                          IRInstruction* insn,
+                          Findings& out) {
     auto field = insn->get_field();
     const DexType* type = check_type(field->get_class());
     if (type != nullptr) {
-      bad_type(type, method, insn);
+      bad_type(type, method, insn, out);
       return;
     }
 
     auto cls = method->get_class();
     if (is_illegal_cross_store(cls, field->get_class())) {
-      illegal_field_type[method].emplace_back(insn);
+      out.illegal_field_type[method].emplace_back(insn);
     }
 
     type = check_type(field->get_type());
     if (type != nullptr) {
-      bad_type(type, method, insn);
+      bad_type(type, method, insn, out);
       return;
     }
 
     if (is_illegal_cross_store(cls, field->get_type())) {
-      illegal_field_cls[method].emplace_back(insn);
+      out.illegal_field_cls[method].emplace_back(insn);
     }
 
     auto res_field = resolve_field(field);
@@ -374,7 +464,7 @@ class Breadcrumbs {
       if (field != res_field) {
         type = check_type(field->get_class());
         if (type != nullptr) {
-          bad_type(type, method, insn);
+          bad_type(type, method, insn, out);
           return;
         }
       }
@@ -382,22 +472,24 @@ class Breadcrumbs {
       // the class of the field is around but the field may have
       // been deleted so let's verify the field exists on the class
       if (field->is_def() && !class_contains(static_cast<DexField*>(field))) {
-        bad_field_insns[static_cast<DexField*>(field)][method].
+        out.bad_field_insns[static_cast<DexField*>(field)][method].
             emplace_back(insn);
         return;
       }
     }
   }
 
-  void check_method_opcode(const DexMethod* method, IRInstruction* insn) {
+  void check_method_opcode(const DexMethod* method,
+                           IRInstruction* insn,
+                           Findings& out) {
     const auto& meth = insn->get_method();
     const DexType* type = check_method(meth);
     if (type != nullptr) {
-      bad_type(type, method, insn);
+      bad_type(type, method, insn, out);
       return;
     }
     if (is_illegal_cross_store(method->get_class(), meth->get_class())) {
-      illegal_method_call[method].emplace_back(insn);
+      out.illegal_method_call[method].emplace_back(insn);
     }
 
     DexMethod* res_meth = resolve_method(meth, opcode_to_search(insn));
@@ -406,7 +498,7 @@ class Breadcrumbs {
       if (res_meth != meth) {
         type = check_type(res_meth->get_class());
         if (type != nullptr) {
-          bad_type(type, method, insn);
+          bad_type(type, method, insn, out);
           return;
         }
       }
@@ -416,29 +508,32 @@ class Breadcrumbs {
       if (meth->is_def()) {
         const auto meth_def = static_cast<DexMethod*>(meth);
         if (!class_contains(meth_def)) {
-          bad_meth_insns[meth_def][method].emplace_back(insn);
+          out.bad_meth_insns[meth_def][method].emplace_back(insn);
           return;
         }
       }
     }
   }
 
-  void check_opcodes() {
-    walk::opcodes(scope,
-      [](DexMethod*) { return true; },
-      [&](DexMethod* method, IRInstruction* insn) {
-        if (insn->has_type()) {
-          check_type_opcode(method, insn);
-          return;
-        }
-        if (insn->has_field()) {
-          check_field_opcode(method, insn);
-          return;
-        }
-        if (insn->has_method()) {
-          check_method_opcode(method, insn);
-        }
-      });
+  void check_opcodes(const DexMethod* method, Findings& out) {
+    auto code = method->get_code();
+    if (code == nullptr) {
+      return;
+    }
+    for (const auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      if (insn->has_type()) {
+        check_type_opcode(method, insn, out);
+        continue;
+      }
+      if (insn->has_field()) {
+        check_field_opcode(method, insn, out);
+        continue;
+      }
+      if (insn->has_method()) {
+        check_method_opcode(method, insn, out);
+      }
+    }
   }
 };
 
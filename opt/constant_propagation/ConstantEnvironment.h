@@ -11,6 +11,7 @@
 
 #include <limits>
 
+#include "AdaptiveAbstractEnvironment.h"
 #include "ConstantAbstractDomain.h"
 #include "ControlFlow.h"
 #include "FixpointIterators.h"
@@ -35,17 +36,19 @@ class SignedConstantDomain
 
   explicit SignedConstantDomain(int64_t v)
       : SignedConstantDomain(
-            std::make_tuple(sign_domain::Domain::top(), ConstantDomain(v))) {}
+            std::make_tuple(sign_domain::from_int(v), ConstantDomain(v))) {}
 
   explicit SignedConstantDomain(sign_domain::Interval interval)
-      : SignedConstantDomain(std::make_tuple(sign_domain::Domain(interval),
-                                             ConstantDomain::top())) {}
+      : SignedConstantDomain(std::make_tuple(
+            sign_domain::from_interval(interval), ConstantDomain::top())) {}
 
+  // The reduction is performed after every operation, so it only compares
+  // encodings and never decodes the interval.
   static void reduce_product(
       std::tuple<sign_domain::Domain, ConstantDomain>& domains) {
     auto& sdom = std::get<0>(domains);
     auto& cdom = std::get<1>(domains);
-    if (sdom.element() == sign_domain::Interval::EQZ) {
+    if (sdom.equals(sign_domain::from_interval(sign_domain::Interval::EQZ))) {
       cdom.meet_with(ConstantDomain(0));
       return;
     }
@@ -53,29 +56,39 @@ class SignedConstantDomain
     if (!cst) {
       return;
     }
-    if (!sign_domain::contains(sdom.element(), *cst)) {
-      sdom.set_to_bottom();
-      return;
-    }
+    // If the constant is not in the interval, the meet is Bottom, and so is the
+    // whole product.
     sdom.meet_with(sign_domain::from_int(*cst));
   }
 
   sign_domain::Domain interval_domain() const { return get<0>(); }
 
-  sign_domain::Interval interval() const { return interval_domain().element(); }
+  sign_domain::Interval interval() const {
+    return sign_domain::to_interval(get<0>());
+  }
 
   ConstantDomain constant_domain() const { return get<1>(); }
 
+  /*
+   * Top and Bottom are by far the most common values, so we only build them
+   * once.
+   */
   static SignedConstantDomain top() {
-    SignedConstantDomain scd;
-    scd.set_to_top();
-    return scd;
+    static const SignedConstantDomain s_top = [] {
+      SignedConstantDomain scd;
+      scd.set_to_top();
+      return scd;
+    }();
+    return s_top;
   }
 
   static SignedConstantDomain bottom() {
-    SignedConstantDomain scd;
-    scd.set_to_bottom();
-    return scd;
+    static const SignedConstantDomain s_bottom = [] {
+      SignedConstantDomain scd;
+      scd.set_to_bottom();
+      return scd;
+    }();
+    return s_bottom;
   }
 
   /* Return the largest element within the interval. */
@@ -99,8 +112,10 @@ using reg_t = uint32_t;
 
 constexpr reg_t RESULT_REGISTER = std::numeric_limits<reg_t>::max();
 
+// Most methods only hold constants in a handful of registers at a time, and
+// the environment is copied on every edge of the CFG.
 using ConstantEnvironment =
-    PatriciaTreeMapAbstractEnvironment<reg_t, SignedConstantDomain>;
+    AdaptiveAbstractEnvironment<reg_t, SignedConstantDomain>;
 
 using ConstantStaticFieldEnvironment =
     PatriciaTreeMapAbstractEnvironment<DexField*, SignedConstantDomain>;
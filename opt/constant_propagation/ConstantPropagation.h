@@ -23,6 +23,8 @@ class ConstantPropagationPass : public Pass {
                         ConfigFiles& cfg,
                         PassManager& mgr) override;
 
+  virtual bool is_method_local() const override { return true; }
+
  private:
   ConstPropConfig m_config;
 };
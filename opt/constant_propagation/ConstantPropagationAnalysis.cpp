@@ -324,7 +324,7 @@ static void analyze_if(const IRInstruction* insn,
 }
 
 ConstantEnvironment FixpointIterator::analyze_edge(
-    const std::shared_ptr<cfg::Edge>& edge,
+    const EdgeId& edge,
     const ConstantEnvironment& exit_state_at_source) const {
   auto env = exit_state_at_source;
   auto last_insn_it = transform::find_last_instruction(edge->src());
@@ -30,12 +30,14 @@ class FixpointIterator final
                             const ConstPropConfig& config,
                             ConstantStaticFieldEnvironment field_env =
                                 ConstantStaticFieldEnvironment())
-      : MonotonicFixpointIterator(cfg),
+      : MonotonicFixpointIterator(cfg,
+                                  cfg.blocks().size(),
+                                  FixpointIterationStrategy::Worklist),
         m_config(config),
         m_field_env(field_env) {}
 
   ConstantEnvironment analyze_edge(
-      const std::shared_ptr<cfg::Edge>&,
+      const EdgeId&,
       const ConstantEnvironment& exit_state_at_source) const override;
 
   void analyze_instruction(const IRInstruction* insn,
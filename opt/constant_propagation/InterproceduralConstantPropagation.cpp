@@ -9,6 +9,7 @@
 
 #include "InterproceduralConstantPropagation.h"
 
+#include "Analyses.h"
 #include "ConstantEnvironment.h"
 #include "ConstantPropagationAnalysis.h"
 #include "ConstantPropagationTransform.h"
@@ -76,7 +77,7 @@ void simplify_constant_fields(const Scope& scope,
       if (!insn->has_field()) {
         continue;
       }
-      auto* field = resolve_field(insn->get_field());
+      auto* field = resolve_field_cached(insn->get_field());
       if (!field_env.get(field).constant_domain().is_value()) {
         continue;
       }
@@ -113,20 +114,59 @@ namespace constant_propagation {
 
 namespace interprocedural {
 
-void FixpointIterator::analyze_node(DexMethod* const& method,
-                                    Domain* current_state) const {
-  // The entry node has no associated method.
-  if (method == nullptr) {
-    return;
+IntraproceduralCache::IntraproceduralCache(const Scope& scope,
+                                           const ConstPropConfig& config)
+    : m_config(config) {
+  walk::code(scope, [&](DexMethod* method, IRCode& code) {
+    auto& entry = m_entries[method];
+    for (auto& mie : InstructionIterable(&code)) {
+      auto insn = mie.insn;
+      if (is_sget(insn->opcode())) {
+        entry.fields_read.push_back(resolve_field(insn->get_field()));
+      }
+    }
+  });
+}
+
+template <typename Result>
+bool IntraproceduralCache::is_fresh(
+    const Memo<Result>& memo,
+    const IRCode& code,
+    const ArgumentDomain& args,
+    const std::vector<SignedConstantDomain>& fields) {
+  if (!memo.valid || memo.epoch != code.epoch() || !memo.args.equals(args)) {
+    return false;
   }
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (!memo.fields[i].equals(fields[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const IntraproceduralCache::CallSites& IntraproceduralCache::get_call_sites(
+    const DexMethod* method,
+    const ArgumentDomain& args,
+    const ConstantStaticFieldEnvironment& field_env) {
   auto code = method->get_code();
-  if (code == nullptr) {
-    return;
+  auto& entry = m_entries.at(method);
+  std::vector<SignedConstantDomain> fields;
+  fields.reserve(entry.fields_read.size());
+  for (auto field : entry.fields_read) {
+    fields.push_back(field_env.get(field));
   }
-  auto& cfg = code->cfg();
-  intraprocedural::FixpointIterator intra_cp(cfg, m_config, m_field_env);
-  intra_cp.run(env_with_params(code, current_state->get(INPUT_ARGS)));
+  auto& memo = entry.call_sites;
+  if (is_fresh(memo, *code, args, fields)) {
+    ++m_reused;
+    return memo.result;
+  }
+  ++m_analyses;
 
+  auto& cfg = code->cfg();
+  intraprocedural::FixpointIterator intra_cp(cfg, m_config, field_env);
+  intra_cp.run(env_with_params(code, args));
+  memo.result.clear();
   for (auto* block : cfg.blocks()) {
     auto state = intra_cp.get_entry_state_at(block);
     for (auto& mie : InstructionIterable(block)) {
@@ -136,22 +176,83 @@ void FixpointIterator::analyze_node(DexMethod* const& method,
         for (size_t i = 0; i < insn->srcs_size(); ++i) {
           out_args.set(i, state.get(insn->src(i)));
         }
-        current_state->set(insn, out_args);
+        memo.result.emplace_back(insn, out_args);
+      }
+      intra_cp.analyze_instruction(insn, &state);
+    }
+  }
+  memo.valid = true;
+  memo.epoch = code->epoch();
+  memo.args = args;
+  memo.fields = std::move(fields);
+  return memo.result;
+}
+
+const IntraproceduralCache::FieldWrites&
+IntraproceduralCache::get_field_writes(const DexMethod* method,
+                                       const ArgumentDomain& args) {
+  auto code = method->get_code();
+  auto& memo = m_entries.at(method).field_writes;
+  if (is_fresh(memo, *code, args, {})) {
+    ++m_reused;
+    return memo.result;
+  }
+  ++m_analyses;
+
+  auto& cfg = code->cfg();
+  intraprocedural::FixpointIterator intra_cp(cfg, m_config);
+  intra_cp.run(env_with_params(code, args));
+  std::unordered_map<DexField*, size_t> index_of;
+  memo.result.clear();
+  for (Block* b : cfg.blocks()) {
+    auto state = intra_cp.get_entry_state_at(b);
+    for (auto& mie : InstructionIterable(b)) {
+      auto* insn = mie.insn;
+      if (is_sput(insn->opcode())) {
+        auto value = state.get(insn->src(0));
+        auto field = resolve_field_cached(insn->get_field());
+        if (field != nullptr) {
+          auto it = index_of.emplace(field, memo.result.size());
+          if (it.second) {
+            memo.result.emplace_back(field, value);
+          } else {
+            memo.result[it.first->second].second.join_with(value);
+          }
+        }
       }
       intra_cp.analyze_instruction(insn, &state);
     }
   }
+  memo.valid = true;
+  memo.epoch = code->epoch();
+  memo.args = args;
+  return memo.result;
+}
+
+void FixpointIterator::analyze_node(DexMethod* const& method,
+                                    Domain* current_state) const {
+  // The entry node has no associated method.
+  if (method == nullptr) {
+    return;
+  }
+  if (method->get_code() == nullptr) {
+    return;
+  }
+  const auto& call_sites = m_cache->get_call_sites(
+      method, current_state->get(INPUT_ARGS), m_field_env);
+  for (const auto& call_site : call_sites) {
+    current_state->set(call_site.first, call_site.second);
+  }
 }
 
 Domain FixpointIterator::analyze_edge(
-    const std::shared_ptr<call_graph::Edge>& edge,
+    const call_graph::EdgeId& edge,
     const Domain& exit_state_at_source) const {
   Domain entry_state_at_dest;
-  auto it = edge->invoke_iterator();
-  if (it == IRList::iterator()) {
+  auto insn = edge->invoke_insn();
+  if (insn == nullptr) {
     entry_state_at_dest.set(INPUT_ARGS, ConstantEnvironment::top());
   } else {
-    auto insn = it->insn;
     entry_state_at_dest.set(INPUT_ARGS, exit_state_at_source.get(insn));
   }
   return entry_state_at_dest;
@@ -265,10 +366,15 @@ class Propagator {
  public:
   explicit Propagator(const Scope& scope,
                       const ConstPropConfig& config,
-                      DexMethodRef* dynamic_check_fail_handler)
+                      DexMethodRef* dynamic_check_fail_handler,
+                      const call_graph::Graph* call_graph,
+                      BudgetTracker* budget)
       : m_scope(scope),
         m_config(config),
-        m_dynamic_check_fail_handler(dynamic_check_fail_handler) {}
+        m_dynamic_check_fail_handler(dynamic_check_fail_handler),
+        m_call_graph(call_graph),
+        m_budget(budget),
+        m_cache(m_scope, m_config) {}
 
   /*
    * We start off by assuming no knowledge of any field values, i.e. we just
@@ -278,18 +384,27 @@ class Propagator {
    * If any such fields were found, we repeat the propagation step.
    */
   std::unique_ptr<FixpointIterator> analyze() {
-    call_graph::Graph cg(m_scope, m_config.include_virtuals);
+    std::unique_ptr<call_graph::Graph> own_cg;
+    if (m_call_graph == nullptr) {
+      own_cg.reset(new call_graph::Graph(m_scope, m_config.include_virtuals));
+    }
+    const auto& cg = m_call_graph ? *m_call_graph : *own_cg;
     // Rebuild all CFGs here -- this should be more efficient than doing them
     // within FixpointIterator::analyze_node(), since that can get called
     // multiple times for a given method
     walk::parallel::code(m_scope,
                          [](DexMethod*, IRCode& code) { code.build_cfg(); });
-    auto fp_iter = std::make_unique<FixpointIterator>(cg, m_config);
+    auto fp_iter = std::make_unique<FixpointIterator>(cg, m_config, &m_cache);
     fp_iter->run({{INPUT_ARGS, ArgumentDomain()}});
 
     ConstantStaticFieldEnvironment field_env;
     set_fields_with_encoded_values(m_scope, &field_env);
     for (size_t i = 0; i < m_config.max_heap_analysis_iterations; ++i) {
+      // Stopping early is sound: it is as if fewer iterations were allowed.
+      if (m_budget != nullptr && m_budget->pass_exhausted()) {
+        m_budget->record_fallback("heap_analysis_cut_short");
+        break;
+      }
       join_all_field_values(*fp_iter, &field_env);
       if (field_env.equals(fp_iter->get_field_environment())) {
         break;
@@ -299,6 +414,8 @@ class Propagator {
     }
 
     m_stats.constant_fields = field_env.is_value() ? field_env.size() : 0;
+    m_stats.intraprocedural_analyses = m_cache.analyses();
+    m_stats.intraprocedural_analyses_reused = m_cache.reused();
     return fp_iter;
   }
 
@@ -358,38 +475,47 @@ class Propagator {
    */
   void join_all_field_values(const FixpointIterator& fp_iter,
                              ConstantStaticFieldEnvironment* field_env) {
-    walk::methods(m_scope, [&](DexMethod* method) {
-      IRCode* code = method->get_code();
-      if (code == nullptr) {
-        return;
-      }
-      auto& cfg = code->cfg();
-      auto args = fp_iter.get_entry_state_at(method);
-      // If the callgraph isn't complete, reachable methods may appear
-      // unreachable
-      if (args.is_bottom()) {
-        args.set_to_top();
+    // The methods are analyzed in parallel. Each one only records the join of
+    // the values it writes; a field that is absent hasn't been written (unlike
+    // in an environment, where an absent binding means Top).
+    using FieldValues = std::unordered_map<DexField*, SignedConstantDomain>;
+    auto join_into = [](FieldValues& values,
+                        DexField* field,
+                        const SignedConstantDomain& value) {
+      auto it = values.find(field);
+      if (it == values.end()) {
+        values.emplace(field, value);
+      } else {
+        it->second.join_with(value);
       }
-      intraprocedural::FixpointIterator intra_cp(code->cfg(), m_config);
-      intra_cp.run(env_with_params(code, args.get(nullptr)));
-      for (Block* b : cfg.blocks()) {
-        auto state = intra_cp.get_entry_state_at(b);
-        for (auto& mie : InstructionIterable(b)) {
-          auto* insn = mie.insn;
-          auto op = insn->opcode();
-          if (is_sput(op)) {
-            auto value = state.get(insn->src(0));
-            auto field = resolve_field(insn->get_field());
-            if (field != nullptr) {
-              field_env->update(field, [&value](auto current_value) {
-                return current_value.join(value);
-              });
-            }
+    };
+    auto written = walk::parallel::reduce_code<FieldValues>(
+        m_scope,
+        [](DexMethod*) { return true; },
+        [&](FieldValues& values, DexMethod* method, IRCode&) {
+          auto args = fp_iter.get_entry_state_at(method);
+          // If the callgraph isn't complete, reachable methods may appear
+          // unreachable
+          if (args.is_bottom()) {
+            args.set_to_top();
           }
-          intra_cp.analyze_instruction(insn, &state);
-        }
-      }
-    });
+          for (const auto& write :
+               m_cache.get_field_writes(method, args.get(INPUT_ARGS))) {
+            join_into(values, write.first, write.second);
+          }
+        },
+        [&](FieldValues a, FieldValues b) {
+          for (const auto& entry : b) {
+            join_into(a, entry.first, entry.second);
+          }
+          return a;
+        });
+    for (const auto& entry : written) {
+      const auto& value = entry.second;
+      field_env->update(entry.first, [&value](auto current_value) {
+        return current_value.join(value);
+      });
+    }
   }
 
   const Stats& get_stats() const { return m_stats; }
@@ -399,12 +525,17 @@ class Propagator {
   Scope m_scope;
   ConstPropConfig m_config;
   DexMethodRef* m_dynamic_check_fail_handler;
+  const call_graph::Graph* m_call_graph;
+  BudgetTracker* m_budget;
+  IntraproceduralCache m_cache;
 };
 
 } // namespace
 
-Stats InterproceduralConstantPropagationPass::run(Scope& scope) {
-  Propagator propagator(scope, m_config, m_dynamic_check_fail_handler);
+Stats InterproceduralConstantPropagationPass::run(
+    Scope& scope, const call_graph::Graph* call_graph, BudgetTracker* budget) {
+  Propagator propagator(scope, m_config, m_dynamic_check_fail_handler,
+                        call_graph, budget);
   auto fp_iter = propagator.analyze();
   propagator.optimize(*fp_iter);
   return propagator.get_stats();
@@ -424,11 +555,20 @@ void InterproceduralConstantPropagationPass::run_pass(DexStoresVector& stores,
   }
 
   auto scope = build_class_scope(stores);
-  const auto& stats = run(scope);
+  const auto& call_graph =
+      m_config.include_virtuals
+          ? mgr.analyses().get<CallGraphAnalysis<true>>(stores)
+          : mgr.analyses().get<CallGraphAnalysis<false>>(stores);
+  BudgetTracker budget(m_time_budget);
+  const auto& stats = run(scope, &call_graph, &budget);
   mgr.incr_metric("branches_removed", stats.transform_stats.branches_removed);
   mgr.incr_metric("materialized_consts",
                   stats.transform_stats.materialized_consts);
   mgr.incr_metric("constant_fields", stats.constant_fields);
+  mgr.incr_metric("intraprocedural_analyses", stats.intraprocedural_analyses);
+  mgr.incr_metric("intraprocedural_analyses_reused",
+                  stats.intraprocedural_analyses_reused);
+  budget.report(mgr);
 }
 
 static InterproceduralConstantPropagationPass s_pass;
@@ -10,12 +10,16 @@
 #pragma once
 
 #include <atomic>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "CallGraph.h"
 #include "ConstPropConfig.h"
 #include "ConstantEnvironment.h"
 #include "ConstantPropagationTransform.h"
 #include "HashedAbstractPartition.h"
+#include "ParallelFixpointIterator.h"
 #include "Pass.h"
 
 namespace constant_propagation {
@@ -23,6 +27,8 @@ namespace constant_propagation {
 struct Stats {
   Transform::Stats transform_stats;
   size_t constant_fields{0};
+  size_t intraprocedural_analyses{0};
+  size_t intraprocedural_analyses_reused{0};
 };
 
 namespace interprocedural {
@@ -49,21 +55,97 @@ using Domain = HashedAbstractPartition<const IRInstruction*, ArgumentDomain>;
 
 constexpr IRInstruction* INPUT_ARGS = nullptr;
 
+/*
+ * The global analysis reruns the intraprocedural analysis of a method every
+ * time the method is visited: once per visit within an SCC, and once more per
+ * round of the heap analysis. Most of these runs see the same inputs as the
+ * previous one and compute the same results.
+ *
+ * This cache remembers, for each method, the results of its last analysis
+ * together with what they depend on: the epoch of the code, the arguments the
+ * method was analyzed with and the values of the static fields it reads. A
+ * method is only analyzed again when one of those changed. Only the inputs of
+ * the last analysis are kept. That is enough for the methods outside of
+ * recursive cycles, which are visited once per round with their final
+ * arguments.
+ *
+ * The entries are created up front, so that the methods can be looked up
+ * concurrently; each method must be queried by a single thread at a time,
+ * which both the global fixpoint iterator and the parallel walkers guarantee.
+ */
+class IntraproceduralCache {
+ public:
+  // The arguments passed at each invoke instruction of the method.
+  using CallSites =
+      std::vector<std::pair<const IRInstruction*, ArgumentDomain>>;
+  // The join of the values the method writes to each static field.
+  using FieldWrites = std::vector<std::pair<DexField*, SignedConstantDomain>>;
+
+  IntraproceduralCache(const Scope& scope, const ConstPropConfig& config);
+
+  const CallSites& get_call_sites(
+      const DexMethod* method,
+      const ArgumentDomain& args,
+      const ConstantStaticFieldEnvironment& field_env);
+
+  // Field writes are computed without assuming anything about the values of
+  // the fields, so they don't depend on the field environment.
+  const FieldWrites& get_field_writes(const DexMethod* method,
+                                      const ArgumentDomain& args);
+
+  size_t analyses() const { return m_analyses; }
+  size_t reused() const { return m_reused; }
+
+ private:
+  template <typename Result>
+  struct Memo {
+    bool valid{false};
+    size_t epoch{0};
+    ArgumentDomain args;
+    std::vector<SignedConstantDomain> fields;
+    Result result;
+  };
+
+  struct Entry {
+    // The static fields read by the method, in the order of the sgets.
+    std::vector<DexField*> fields_read;
+    Memo<CallSites> call_sites;
+    Memo<FieldWrites> field_writes;
+  };
+
+  template <typename Result>
+  bool is_fresh(const Memo<Result>& memo,
+                const IRCode& code,
+                const ArgumentDomain& args,
+                const std::vector<SignedConstantDomain>& fields);
+
+  const ConstPropConfig& m_config;
+  std::unordered_map<const DexMethod*, Entry> m_entries;
+  std::atomic<size_t> m_analyses{0};
+  std::atomic<size_t> m_reused{0};
+};
+
 /*
  * Performs interprocedural constant propagation of stack / register values.
+ *
+ * The methods are analyzed top-down over the SCCs of the call graph, and the
+ * methods of independent SCCs are analyzed in parallel.
  */
 class FixpointIterator
-    : public MonotonicFixpointIterator<call_graph::GraphInterface, Domain> {
+    : public ParallelMonotonicFixpointIterator<call_graph::GraphInterface,
+                                               Domain> {
  public:
   FixpointIterator(const call_graph::Graph& call_graph,
-                   const ConstPropConfig& config)
-      : MonotonicFixpointIterator(call_graph),
-        m_config(config) {}
+                   const ConstPropConfig& config,
+                   IntraproceduralCache* cache)
+      : ParallelMonotonicFixpointIterator(call_graph, SccOrder::TopDown),
+        m_config(config),
+        m_cache(cache) {}
 
   void analyze_node(DexMethod* const& method,
                     Domain* current_state) const override;
 
-  Domain analyze_edge(const std::shared_ptr<call_graph::Edge>& edge,
+  Domain analyze_edge(const call_graph::EdgeId& edge,
                       const Domain& exit_state_at_source) const override;
 
   ConstantStaticFieldEnvironment get_field_environment() const {
@@ -76,6 +158,7 @@ class FixpointIterator
 
  private:
   ConstPropConfig m_config;
+  IntraproceduralCache* m_cache;
   ConstantStaticFieldEnvironment m_field_env;
 };
 
@@ -106,11 +189,17 @@ class InterproceduralConstantPropagationPass : public Pass {
     always_assert(max_heap_analysis_iterations >= 0);
     m_config.max_heap_analysis_iterations =
         static_cast<size_t>(max_heap_analysis_iterations);
+    m_time_budget = pc.get_time_budget();
   }
 
   // run() is exposed for testing purposes -- run_pass takes a PassManager
-  // object, making it awkward to call in unit tests.
-  constant_propagation::Stats run(Scope&);
+  // object, making it awkward to call in unit tests. Without a call graph,
+  // it builds its own. Once the budget is spent, no further rounds of the
+  // heap analysis are run.
+  constant_propagation::Stats run(
+      Scope&,
+      const call_graph::Graph* call_graph = nullptr,
+      BudgetTracker* budget = nullptr);
 
   void run_pass(DexStoresVector& stores,
                 ConfigFiles& cfg,
@@ -118,5 +207,6 @@ class InterproceduralConstantPropagationPass : public Pass {
 
  private:
   ConstPropConfig m_config;
+  TimeBudget m_time_budget;
   DexMethodRef* m_dynamic_check_fail_handler;
 };
@@ -9,6 +9,8 @@
 
 #include "SignDomain.h"
 
+#include <array>
+
 namespace sign_domain {
 
 /*
@@ -71,13 +73,45 @@ std::ostream& operator<<(std::ostream& os, Domain domain) {
   return os;
 }
 
-Domain from_int(int64_t v) {
+namespace {
+
+using DomainTable = std::array<Domain, static_cast<size_t>(Interval::SIZE)>;
+
+const DomainTable& domains() {
+  static const DomainTable table = [] {
+    DomainTable t;
+    for (size_t i = 0; i < t.size(); ++i) {
+      t[i] = Domain(static_cast<Interval>(i));
+    }
+    return t;
+  }();
+  return table;
+}
+
+} // namespace
+
+const Domain& from_interval(Interval interval) {
+  always_assert(interval != Interval::SIZE);
+  return domains()[static_cast<size_t>(interval)];
+}
+
+Interval to_interval(const Domain& domain) {
+  const auto& table = domains();
+  for (size_t i = 0; i < table.size(); ++i) {
+    if (table[i].equals(domain)) {
+      return static_cast<Interval>(i);
+    }
+  }
+  not_reached();
+}
+
+const Domain& from_int(int64_t v) {
   if (v == 0) {
-    return Domain(Interval::EQZ);
+    return from_interval(Interval::EQZ);
   } else if (v > 0) {
-    return Domain(Interval::GTZ);
+    return from_interval(Interval::GTZ);
   } else /* v < 0 */ {
-    return Domain(Interval::LTZ);
+    return from_interval(Interval::LTZ);
   }
 }
 
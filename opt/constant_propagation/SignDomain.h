@@ -46,7 +46,17 @@ std::ostream& operator<<(std::ostream&, Interval);
 
 std::ostream& operator<<(std::ostream&, Domain);
 
-Domain from_int(int64_t);
+/*
+ * Constructing a Domain from an Interval and retrieving the Interval of a
+ * Domain both go through the hashtables of the lattice. The Domain of each
+ * Interval is computed only once here, which is much cheaper on the hot paths
+ * of constant propagation.
+ */
+const Domain& from_interval(Interval);
+
+Interval to_interval(const Domain&);
+
+const Domain& from_int(int64_t);
 
 bool contains(Interval, int64_t);
 
@@ -10,42 +10,25 @@
 #include "AliasedRegisters.h"
 
 #include <algorithm>
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wshadow"
-#endif
-#include <boost/graph/adjacency_list.hpp>
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
-#include <boost/optional.hpp>
-#include <boost/range/iterator_range.hpp>
-#include <limits>
-#include <numeric>
-#include <unordered_set>
 
-// Implemented by an undirected graph where nodes are Registers and edges are an
-// alias between them.
-//
-// An alias group is a fully connected clique of nodes.
-// Every node in a group is aliased to every other node.
-//
-// Data structure invariant: The graph is a forest of cliques
-// Corollary: There are no edges that are not part of a clique.
+// Implemented as a partition of Values into alias groups. Every value in a
+// group is aliased to every other value in the group.
 //
 // The aliasing relation is an equivalence relation. An alias group is an
 // equivalence class of this relation.
-//   Reflexive : a node is trivially equivalent to itself
-//   Symmetric : edges in the graph are undirected
-//   Transitive: `AliasedRegisters::move` adds an edge to every node in the
-//               group, creating a clique
+//   Reflexive : a value is trivially equivalent to itself
+//   Symmetric : group membership doesn't depend on the order of the pair
+//   Transitive: `AliasedRegisters::move` adds `moving` to the whole group
+//
+// Seen as a graph where values are vertices and an edge means they are
+// aliased, each group is a clique and the graph is a forest of cliques. The
+// lattice operations below are described in terms of that graph.
 
 namespace aliased_registers {
 
 // Move `moving` into the alias group of `group`
 //
-// Create an edge from `moving` to every vertex in the alias group of
-// `group`.
+// `moving` becomes aliased to every value in the alias group of `group`.
 //
 // We want alias groups to be fully connected cliques.
 // Here's an example to show why:
@@ -54,85 +37,51 @@ namespace aliased_registers {
 //   move v0, v1 # (call `AliasedRegisters::move(v0, v1)` here)
 //   const v1, 0
 //
-// At this point, v0 and v2 still hold the same value, but if we had just
-// added an edge from v0 to v1, then we would have lost this information.
+// At this point, v0 and v2 still hold the same value, but if we had only
+// aliased v0 to v1, then we would have lost this information.
 void AliasedRegisters::move(const Value& moving, const Value& group) {
   // Only need to do something if they're not already in same group
   if (!are_aliases(moving, group)) {
     // remove from the old group
     break_alias(moving);
-    vertex_t v_moving = find_or_create(moving);
-    vertex_t v_group = find_or_create(group);
 
-    const auto& grp = vertices_in_group(v_group);
-    track_insert_order(moving, v_moving, group, v_group, grp);
-
-    // add edge to every node in new group
-    for (vertex_t v : grp) {
-      boost::add_edge(v_moving, v, m_graph);
+    // `moving` is the newest member of the group, so it goes last
+    size_t index;
+    if (find(group, &index)) {
+      m_groups[index].push_back(moving);
+    } else {
+      // We're creating a new group from a solitary value. The group value is
+      // the oldest, followed by moving.
+      m_groups.emplace_back(Group{group, moving});
     }
   }
 }
 
-// Set the insertion number of `v_moving` to 1 + the max of `group`.
-// `v_moving` is the newest member of `group` so it should have the highest
-// insertion number.
-//
-// If this call creates a new clique (of size two), also set the insertion
-// number of v_group
-void AliasedRegisters::track_insert_order(const Value& moving,
-                                          vertex_t v_moving,
-                                          const Value& group,
-                                          vertex_t v_group,
-                                          const std::vector<vertex_t>& grp) {
-  always_assert(!grp.empty());
-  if (grp.size() == 1 && group.is_register()) {
-    // We're creating a new clique from a solitary vertex. The group
-    // register is the oldest, followed by moving.
-    m_insert_order[v_group] = 0;
-  }
-
-  if (moving.is_register()) {
-    m_insert_order[v_moving] =
-        1 + std::accumulate(
-                grp.begin(), grp.end(), 0, [this](size_t acc, vertex_t v) {
-                  // use operator[] to ignore non-register group members
-                  return std::max(acc, m_insert_order[v]);
-                });
-  }
-}
-
 // Remove r from its alias group
 void AliasedRegisters::break_alias(const Value& r) {
-  const auto& v = find(r);
-  const auto& end = boost::vertices(m_graph).second;
-  if (v != end) {
-    // clear removes all edges incident to r
-    boost::clear_vertex(*v, m_graph);
-
-    if (r.is_register()) {
-      // v is not in a clique any more so it has no insert order
-      clear_insert_number(*v);
+  size_t index;
+  size_t pos;
+  if (find(r, &index, &pos)) {
+    auto& grp = m_groups[index];
+    grp.erase(grp.begin() + pos);
+    if (grp.size() < 2) {
+      // the last member is not aliased to anything any more
+      erase_group(index);
     }
   }
 }
 
-// Call this when `v` should no longer have an insertion number (because it does
-// not belong to a clique).
-void AliasedRegisters::clear_insert_number(vertex_t v) {
-  m_insert_order.erase(v);
-}
-
-// if there is an edge between r1 to r2, then they are aliases.
-// We only need to check for single edge paths because `move` adds an edge to
-// every node in the alias group, thus maintaining transitive closure of the
-// graph
 bool AliasedRegisters::are_aliases(const Value& r1, const Value& r2) const {
   if (r1 == r2) {
     return true;
   }
 
-  return has_edge_between(r1, r2);
+  size_t index;
+  if (!find(r1, &index)) {
+    return false;
+  }
+  const auto& grp = m_groups[index];
+  return std::find(grp.begin(), grp.end(), r2) != grp.end();
 }
 
 // Return a representative for this register.
@@ -154,123 +103,60 @@ Register AliasedRegisters::get_representative(
     const Value& orig, const boost::optional<Register>& max_addressable) const {
   always_assert(orig.is_register());
 
-  // if r is not in the graph, then it has no representative
-  const auto& v = find(orig);
-  const auto& end = boost::vertices(m_graph).second;
-  if (v == end) {
+  // if r is not in a group, then it has no representative
+  size_t index;
+  if (!find(orig, &index)) {
     return orig.reg();
   }
 
-  // intentionally copy the vector so we can safely remove from it
-  std::vector<vertex_t> group = vertices_in_group(*v);
-  // filter out non registers and other ineligible registers
-  group.erase(std::remove_if(group.begin(),
-                             group.end(),
-                             [this, &max_addressable](vertex_t elem) {
-                               // return true to remove it
-                               const Value& val = m_graph[elem];
-                               if (!val.is_register()) {
-                                 return true;
-                               }
-                               return max_addressable &&
-                                      val.reg() > *max_addressable;
-                             }),
-              group.end());
-
-  if (group.empty()) {
-    return orig.reg();
-  }
-
-  // We want the oldest element. It has the lowest insertion number
-  const Value& representative = m_graph[*std::min_element(
-      group.begin(), group.end(), [this](vertex_t a, vertex_t b) {
-        return m_insert_order.at(a) < m_insert_order.at(b);
-      })];
-  return representative.reg();
-}
-
-// if `r` is in the graph, return the vertex holding it.
-// if not, return the `end` iterator of the vertices
-const boost::range_detail::integer_iterator<AliasedRegisters::vertex_t>
-AliasedRegisters::find(const Value& r) const {
-  const auto& iters = boost::vertices(m_graph);
-  const auto& begin = iters.first;
-  const auto& end = iters.second;
-  for (auto it = begin; it != end; ++it) {
-    if (m_graph[*it] == r) {
-      return it;
+  // We want the oldest eligible register. Groups are ordered oldest first.
+  for (const Value& val : m_groups[index]) {
+    if (val.is_register() &&
+        (!max_addressable || val.reg() <= *max_addressable)) {
+      return val.reg();
     }
   }
-  return end;
-}
-
-// returns the vertex holding `r` or creates a new (unconnected)
-// vertex if `r` is not in m_graph
-AliasedRegisters::vertex_t AliasedRegisters::find_or_create(const Value& r) {
-  const auto& it = find(r);
-  const auto& end = boost::vertices(m_graph).second;
-  if (it != end) {
-    return *it;
-  } else {
-    return boost::add_vertex(r, m_graph);
-  }
+  return orig.reg();
 }
 
-// return true if there is a path of length exactly 1 from r1 to r2
-bool AliasedRegisters::has_edge_between(const Value& r1,
-                                        const Value& r2) const {
-  // make sure we have both vertices
-  const auto& search1 = find(r1);
-  const auto& search2 = find(r2);
-  const auto& end = boost::vertices(m_graph).second;
-  if (search1 == end || search2 == end) {
-    return false;
+bool AliasedRegisters::find(const Value& r, size_t* group, size_t* pos) const {
+  for (size_t i = 0; i < m_groups.size(); ++i) {
+    const auto& grp = m_groups[i];
+    auto it = std::find(grp.begin(), grp.end(), r);
+    if (it != grp.end()) {
+      *group = i;
+      if (pos != nullptr) {
+        *pos = it - grp.begin();
+      }
+      return true;
+    }
   }
-
-  return are_adjacent(*search1, *search2);
+  return false;
 }
 
-bool AliasedRegisters::are_adjacent(vertex_t v1, vertex_t v2) const {
-  // and check that they have an edge between them
-  const auto& adj = boost::adjacent_vertices(v1, m_graph);
-  const auto& adj_begin = adj.first;
-  const auto& adj_end = adj.second;
-  const auto& edge_search = std::find(adj_begin, adj_end, v2);
-  return edge_search != adj_end;
-}
-
-// return a vector of v and all of it's neighbors (in no particular order)
-std::vector<AliasedRegisters::vertex_t> AliasedRegisters::vertices_in_group(
-    vertex_t v) const {
-  std::vector<vertex_t> result;
-  result.push_back(v);
-  const auto& adj = boost::adjacent_vertices(v, m_graph);
-  const auto& adj_begin = adj.first;
-  const auto& adj_end = adj.second;
-  for (auto it = adj_begin; it != adj_end; ++it) {
-    result.push_back(*it);
+void AliasedRegisters::erase_group(size_t index) {
+  if (index != m_groups.size() - 1) {
+    m_groups[index] = std::move(m_groups.back());
   }
-  return result;
+  m_groups.pop_back();
 }
 
-// return true if v has any neighboring vertices
-bool AliasedRegisters::has_neighbors(vertex_t v) {
-  const auto& adj = boost::adjacent_vertices(v, m_graph);
-  const auto& begin = adj.first;
-  const auto& end = adj.second;
-  return begin != end;
+void AliasedRegisters::sort_group(
+    Group* group,
+    const std::function<bool(const Value&, const Value&)>& less_than) {
+  auto registers_end =
+      std::stable_partition(group->begin(), group->end(),
+                            [](const Value& v) { return v.is_register(); });
+  std::stable_sort(group->begin(), registers_end, less_than);
 }
 
 // ---- extends AbstractValue ----
 
-void AliasedRegisters::clear() {
-  m_graph.clear();
-  m_insert_order.clear();
-}
+void AliasedRegisters::clear() { m_groups.clear(); }
 
 AliasedRegisters::Kind AliasedRegisters::kind() const {
-  return (boost::num_edges(m_graph) > 0) ? AliasedRegisters::Kind::Value
-                                         : AliasedRegisters::Kind::Top;
+  return m_groups.empty() ? AliasedRegisters::Kind::Top
+                          : AliasedRegisters::Kind::Value;
 }
 
 // The lattice looks like this:
@@ -283,32 +169,28 @@ AliasedRegisters::Kind AliasedRegisters::kind() const {
 //            ...
 //            _|_
 //
-// So, leq is the superset relation on the edge set
+// So, leq is the superset relation on the edge set: every group of other must
+// be inside one group of this.
 bool AliasedRegisters::leq(const AliasedRegisters& other) const {
-  if (boost::num_edges(m_graph) < boost::num_edges(other.m_graph)) {
-    // this cannot be a superset of other if this has fewer edges
-    return false;
-  }
-
-  // for all edges in other (the potential subset), make sure this contains that
-  // edge.
-  const auto& iters = boost::edges(other.m_graph);
-  const auto& begin = iters.first;
-  const auto& end = iters.second;
-  for (auto it = begin; it != end; ++it) {
-    const Value& r1 = other.m_graph[boost::source(*it, other.m_graph)];
-    const Value& r2 = other.m_graph[boost::target(*it, other.m_graph)];
-    if (!has_edge_between(r1, r2)) {
+  for (const auto& other_grp : other.m_groups) {
+    size_t index;
+    if (!find(other_grp[0], &index)) {
       return false;
     }
+    const auto& grp = m_groups[index];
+    for (const Value& val : other_grp) {
+      if (std::find(grp.begin(), grp.end(), val) == grp.end()) {
+        return false;
+      }
+    }
   }
   return true;
 }
 
 // returns true iff they have exactly the same edges between the same Values
 bool AliasedRegisters::equals(const AliasedRegisters& other) const {
-  return boost::num_edges(m_graph) == boost::num_edges(other.m_graph) &&
-         leq(other);
+  return m_groups.size() == other.m_groups.size() && leq(other) &&
+         other.leq(*this);
 }
 
 AliasedRegisters::Kind AliasedRegisters::narrow_with(
@@ -324,179 +206,129 @@ AliasedRegisters::Kind AliasedRegisters::widen_with(
 // alias group union
 AliasedRegisters::Kind AliasedRegisters::meet_with(
     const AliasedRegisters& other) {
-
-  const auto& iters = boost::edges(other.m_graph);
-  const auto& begin = iters.first;
-  const auto& end = iters.second;
-  for (auto it = begin; it != end; ++it) {
-    const Value& r1 = other.m_graph[boost::source(*it, other.m_graph)];
-    const Value& r2 = other.m_graph[boost::target(*it, other.m_graph)];
-    if (!this->are_aliases(r1, r2)) {
-      this->merge_groups_of(r1, r2, other);
+  for (const auto& other_grp : other.m_groups) {
+    for (size_t i = 1; i < other_grp.size(); ++i) {
+      if (!this->are_aliases(other_grp[0], other_grp[i])) {
+        this->merge_groups_of(other_grp[0], other_grp[i], other);
+      }
     }
   }
   return AliasedRegisters::Kind::Value;
 }
 
+// Merge the ordering of other into the merged group.
+//
+// When both know the two registers are aliased (and they don't agree about
+// insertion order), use register number.
+// When only one knows about the alias, use insertion order from that one.
+// When neither knows about the alias, use register number.
 void AliasedRegisters::merge_groups_of(const Value& r1,
                                        const Value& r2,
                                        const AliasedRegisters& other) {
-  vertex_t v1 = find_or_create(r1);
-  vertex_t v2 = find_or_create(r2);
-
-  const auto& group1 = vertices_in_group(v1);
-  const auto& group2 = vertices_in_group(v2);
-  std::vector<vertex_t> union_group;
-  union_group.reserve(group1.size() + group2.size());
-  union_group.insert(union_group.begin(), group1.begin(), group1.end());
-  union_group.insert(union_group.begin(), group2.begin(), group2.end());
-
-  handle_insert_order_at_merge(union_group, other);
-  for (vertex_t g1 : group1) {
-    for (vertex_t g2 : group2) {
-      boost::add_edge(g1, g2, m_graph);
-    }
+  size_t index1;
+  size_t index2;
+  bool found1 = find(r1, &index1);
+  bool found2 = find(r2, &index2);
+  Group group1 = found1 ? m_groups[index1] : Group{r1};
+  Group group2 = found2 ? m_groups[index2] : Group{r2};
+  // Erase the higher index first so the lower one stays valid.
+  if (found1 && found2 && index1 < index2) {
+    std::swap(index1, index2);
   }
-}
-
-// edge intersection
-AliasedRegisters::Kind AliasedRegisters::join_with(
-    const AliasedRegisters& other) {
-
-  // fill `deletes` with edges that aren't in `other`
-  std::vector<std::pair<vertex_t, vertex_t>> deletes;
-  const auto& iters = boost::edges(this->m_graph);
-  const auto& begin = iters.first;
-  const auto& end = iters.second;
-  for (auto it = begin; it != end; ++it) {
-    vertex_t v1 = boost::source(*it, this->m_graph);
-    vertex_t v2 = boost::target(*it, this->m_graph);
-    const Value& r1 = this->m_graph[v1];
-    const Value& r2 = this->m_graph[v2];
-    if (!other.has_edge_between(r1, r2)) {
-      deletes.emplace_back(v1, v2);
-    }
+  if (found1 || found2) {
+    erase_group(found1 ? index1 : index2);
   }
-
-  // This maintains a forest of cliques because any subset of nodes of a clique
-  // is also a clique
-  for (const auto& edge : deletes) {
-    boost::remove_edge(edge.first, edge.second, this->m_graph);
+  if (found1 && found2) {
+    erase_group(index2);
   }
 
-  handle_edge_intersection_insert_order(other);
-  return AliasedRegisters::Kind::Value;
-}
-
-void AliasedRegisters::handle_edge_intersection_insert_order(
-    const AliasedRegisters& other) {
-  // Clear out stale values in m_insert_order for vertices removed from cliques.
-  const auto& iters = boost::vertices(this->m_graph);
-  const auto& begin = iters.first;
-  const auto& end = iters.second;
-  for (auto it = begin; it != end; ++it) {
-    if (!has_neighbors(*it)) {
-      clear_insert_number(*it);
-    }
-  }
-
-  // Assign new insertion numbers while taking into account both insertion maps.
-  for (auto& group : all_groups()) {
-    handle_insert_order_at_merge(group, other);
-  }
-}
-
-// Merge the ordering in other.m_insert_order into this->m_insert_order.
-//
-// When both graphs know about an edge (and they don't agree about insertion
-// order), use register number.
-// When only one graph knows about an edge, use insertion order from that graph.
-// When neither graph knows about the edge, use register number.
-// This function can be used (carefully) for both union and intersection.
-void AliasedRegisters::handle_insert_order_at_merge(
-    const std::vector<vertex_t>& group, const AliasedRegisters& other) {
-  renumber_insert_order(group, [this, &other](vertex_t a, vertex_t b) {
+  Group union_group(group1);
+  union_group.insert(union_group.end(), group2.begin(), group2.end());
+  sort_group(&union_group, [&](const Value& a, const Value& b) {
     // return true if a occurs before b.
     // return false if they compare equal or if b occurs before a.
-
-    // `a` and `b` only index into this, not other.
-    const Value& val_a = this->m_graph[a];
-    const Value& val_b = this->m_graph[b];
-    auto other_a = other.find(val_a);
-    auto other_b = other.find(val_b);
-
-    bool this_has_edge = this->are_adjacent(a, b);
-    bool other_has_edge = other.are_aliases(val_a, val_b);
-
-    if (this_has_edge && other_has_edge) {
-      // Intersection case should always come here
+    const Group* this_grp = nullptr;
+    for (const auto* grp : {&group1, &group2}) {
+      if (std::find(grp->begin(), grp->end(), a) != grp->end() &&
+          std::find(grp->begin(), grp->end(), b) != grp->end()) {
+        this_grp = grp;
+      }
+    }
+    size_t other_a;
+    size_t other_b;
+    size_t other_pos_a;
+    size_t other_pos_b;
+    bool other_has_edge = other.find(a, &other_a, &other_pos_a) &&
+                          other.find(b, &other_b, &other_pos_b) &&
+                          other_a == other_b;
+
+    if (this_grp != nullptr) {
       bool this_less_than =
-          this->m_insert_order.at(a) < this->m_insert_order.at(b);
-
-      bool other_less_than =
-          other.m_insert_order.at(*other_a) < other.m_insert_order.at(*other_b);
-
-      if (this_less_than == other_less_than) {
-        // The graphs agree on the order of these two vertices.
-        // Preserve that order.
+          std::find(this_grp->begin(), this_grp->end(), a) <
+          std::find(this_grp->begin(), this_grp->end(), b);
+      if (!other_has_edge || this_less_than == (other_pos_a < other_pos_b)) {
         return this_less_than;
-      } else {
-        // The graphs do not agree. Choose a deterministic order
-        return val_a.reg() < val_b.reg();
       }
-    } else if (this_has_edge) {
-      return this->m_insert_order.at(a) < this->m_insert_order.at(b);
+      // They do not agree. Choose a deterministic order
+      return a.reg() < b.reg();
     } else if (other_has_edge) {
-      return other.m_insert_order.at(*other_a) <
-             other.m_insert_order.at(*other_b);
+      return other_pos_a < other_pos_b;
     } else {
-      return val_a.reg() < val_b.reg();
+      return a.reg() < b.reg();
     }
   });
+  m_groups.push_back(std::move(union_group));
 }
 
-// Rewrite the insertion number of all registers in `group` in an order defined
-// by less_than
-void AliasedRegisters::renumber_insert_order(
-    std::vector<vertex_t> group,
-    const std::function<bool(vertex_t, vertex_t)>& less_than) {
-
-  // Filter out non registers.
-  group.erase(
-      std::remove_if(group.begin(),
-                     group.end(),
-                     [this](vertex_t v) { return !m_graph[v].is_register(); }),
-      group.end());
-
-  // Assign new insertion numbers based on sorting.
-  std::sort(group.begin(), group.end(), less_than);
-  size_t i = 0;
-  for (vertex_t v : group) {
-    this->m_insert_order[v] = i;
-    ++i;
-  }
-}
-
-// return all groups (not including singletons)
-std::vector<std::vector<AliasedRegisters::vertex_t>>
-AliasedRegisters::all_groups() {
-  std::vector<std::vector<vertex_t>> result;
-  std::unordered_set<vertex_t> visited;
-
-  const auto& iters = boost::vertices(this->m_graph);
-  const auto& begin = iters.first;
-  const auto& end = iters.second;
-  for (auto it = begin; it != end; ++it) {
-    if (visited.count(*it) == 0) {
-      const auto& group = vertices_in_group(*it);
-      for (vertex_t v : group) {
-        visited.insert(v);
+// edge intersection
+//
+// Each group of this splits into its intersections with the groups of other.
+// This maintains a forest of cliques because any subset of nodes of a clique
+// is also a clique.
+AliasedRegisters::Kind AliasedRegisters::join_with(
+    const AliasedRegisters& other) {
+  std::vector<Group> result;
+  for (const auto& grp : m_groups) {
+    // The parts of grp, keyed by their group in other
+    std::vector<std::pair<size_t, Group>> parts;
+    for (const Value& val : grp) {
+      size_t other_index;
+      if (!other.find(val, &other_index)) {
+        continue;
       }
-      if (group.size() > 1) {
-        result.emplace_back(std::move(group));
+      auto part = std::find_if(
+          parts.begin(), parts.end(),
+          [other_index](const std::pair<size_t, Group>& p) {
+            return p.first == other_index;
+          });
+      if (part == parts.end()) {
+        parts.emplace_back(other_index, Group{val});
+      } else {
+        part->second.push_back(val);
       }
     }
+    for (auto& part : parts) {
+      if (part.second.size() < 2) {
+        continue;
+      }
+      const auto& other_grp = other.m_groups[part.first];
+      sort_group(&part.second, [&](const Value& a, const Value& b) {
+        // Both know about every alias left, so keep the order they agree on
+        bool this_less_than = std::find(grp.begin(), grp.end(), a) <
+                              std::find(grp.begin(), grp.end(), b);
+        bool other_less_than =
+            std::find(other_grp.begin(), other_grp.end(), a) <
+            std::find(other_grp.begin(), other_grp.end(), b);
+        if (this_less_than == other_less_than) {
+          return this_less_than;
+        }
+        // They do not agree. Choose a deterministic order
+        return a.reg() < b.reg();
+      });
+      result.push_back(std::move(part.second));
+    }
   }
-  return result;
+  m_groups = std::move(result);
+  return AliasedRegisters::Kind::Value;
 }
 } // namespace aliased_registers
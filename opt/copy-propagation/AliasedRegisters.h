@@ -9,17 +9,11 @@
 
 #pragma once
 
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wshadow"
-#endif
-#include <boost/graph/adjacency_list.hpp>
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
+#include <boost/container/small_vector.hpp>
 #include <boost/optional.hpp>
-#include <boost/range/iterator_range.hpp>
+#include <functional>
 #include <limits>
+#include <vector>
 
 #include "AbstractDomain.h"
 #include "DexClass.h"
@@ -181,63 +175,34 @@ class AliasedRegisters final : public AbstractValue<AliasedRegisters> {
   Kind narrow_with(const AliasedRegisters& other) override;
 
  private:
-  // An undirected graph where register values are vertices
-  // and an edge means they are aliased.
-  // Using a set for the edge container makes sure we can't have parallel edges
-  using Graph = boost::adjacency_list<boost::setS, // out edge container
-                                      boost::vecS, // vertex container
-                                      boost::undirectedS, // undirected graph
-                                      Value>; // node property
-  using vertex_t = boost::graph_traits<Graph>::vertex_descriptor;
-  Graph m_graph;
-
-  // For keeping track of the oldest representative.
+  // An alias group, oldest member first. Groups are small, so they usually
+  // live inline and copying the domain is a couple of allocations.
   //
-  // When adding a vertex to a group, it gets 1 + the max insertion number of
-  // the group. When choosing a representative, we prefer lower insertion
-  // numbers. Vertices in a group are guaranteed to have an entry in this map.
-  // Do not query this map if the vertex is not in a group.
-  //
-  // We only track the insertion for registers because they're the only type
-  // that could be chosen as a representative.
-  using InsertionOrder = std::unordered_map<vertex_t, size_t>;
-  InsertionOrder m_insert_order;
-
-  const boost::range_detail::integer_iterator<vertex_t> find(
-      const Value& r) const;
+  // There is no insertion number to keep: when a value joins a group it goes
+  // at the back, and the oldest register is the first one in the group.
+  using Group = boost::container::small_vector<Value, 4>;
 
-  vertex_t find_or_create(const Value& r);
+  // The alias groups with at least two members, in no particular order. A
+  // value is in at most one of them; values in none are only aliased to
+  // themselves.
+  std::vector<Group> m_groups;
 
-  bool has_edge_between(const Value& r1, const Value& r2) const;
-  bool are_adjacent(vertex_t v1, vertex_t v2) const;
+  // Find the group holding `r`. Returns false if `r` is not in any group.
+  bool find(const Value& r, size_t* group, size_t* pos = nullptr) const;
 
-  // return a vector of all vertices in v's alias group (including v itself)
-  std::vector<vertex_t> vertices_in_group(vertex_t v) const;
+  // Remove the group at `index`, moving the last group into its place
+  void erase_group(size_t index);
 
   // merge r1's group with r2. This operation is symmetric
   void merge_groups_of(const Value& r1,
                        const Value& r2,
                        const AliasedRegisters& other);
 
-  // return all groups (not including singletons)
-  std::vector<std::vector<vertex_t>> all_groups();
-
-  void track_insert_order(const Value& moving,
-                          vertex_t v_moving,
-                          const Value& group,
-                          vertex_t v_group,
-                          const std::vector<vertex_t>& grp);
-  void clear_insert_number(vertex_t v);
-  void handle_edge_intersection_insert_order(const AliasedRegisters& other);
-  void handle_insert_order_at_merge(const std::vector<vertex_t>& group,
-                                    const AliasedRegisters& other);
-
-  void renumber_insert_order(
-      std::vector<vertex_t> group,
-      const std::function<bool(vertex_t, vertex_t)>& less_than);
-
-  // return true if v has any neighboring vertices
-  bool has_neighbors(vertex_t v);
+  // Put the registers of `group` first, in the order defined by less_than.
+  // Only registers can be representatives, so the others stay unordered.
+  static void sort_group(
+      Group* group,
+      const std::function<bool(const Value&, const Value&)>& less_than);
 };
 
 class AliasDomain
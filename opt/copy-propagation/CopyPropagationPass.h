@@ -17,6 +17,8 @@ class CopyPropagationPass : public Pass {
 
   virtual void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  virtual bool is_method_local() const override { return true; }
+
   virtual void configure_pass(const PassConfig& pc) override {
 
     // This option can only be safely enabled in verify-none. `run_pass` will
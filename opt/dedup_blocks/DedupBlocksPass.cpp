@@ -10,6 +10,7 @@
 #include "DedupBlocksPass.h"
 
 #include <atomic>
+#include <boost/functional/hash.hpp>
 #include <boost/optional.hpp>
 #include <iterator>
 #include <mutex>
@@ -64,11 +65,11 @@ struct BlockAsKey {
     if (b1_succs.size() != b2_succs.size()) {
       return false;
     }
-    for (const std::shared_ptr<cfg::Edge>& b1_succ : b1_succs) {
+    for (const cfg::Edge* b1_succ : b1_succs) {
       const auto& in_b2 =
           std::find_if(b2_succs.begin(),
                        b2_succs.end(),
-                       [&](const std::shared_ptr<cfg::Edge>& e) {
+                       [&](const cfg::Edge* e) {
                          return e->target() == b1_succ->target() &&
                                 e->type() == b1_succ->type();
                        });
@@ -92,8 +93,18 @@ struct BlockHasher {
   hash_t operator()(const BlockAsKey& key) const {
     hash_t result = 0;
     for (auto& mie : InstructionIterable(key.block)) {
-      result ^= mie.insn->hash();
+      boost::hash_combine(result, mie.insn->hash());
     }
+    // same_successors doesn't care about the order of the successors, so
+    // neither may their hash.
+    hash_t succs = 0;
+    for (const cfg::Edge* succ : key.block->succs()) {
+      hash_t edge = 0;
+      boost::hash_combine(edge, succ->target()->id());
+      boost::hash_combine(edge, static_cast<int>(succ->type()));
+      succs += edge;
+    }
+    boost::hash_combine(result, succs);
     return result;
   }
 };
@@ -103,19 +114,31 @@ class DedupBlocksImpl {
   DedupBlocksImpl(const std::vector<DexClass*>& scope,
                   PassManager& mgr,
                   const DedupBlocksPass::Config& config)
-      : m_scope(scope), m_mgr(mgr), m_config(config) {}
+      : m_scope(scope),
+        m_mgr(mgr),
+        m_config(config),
+        m_budget(config.time_budget) {}
 
   void run() {
     walk::parallel::code(m_scope, [this](DexMethod* method, IRCode& code) {
       if (m_config.method_black_list.count(method) != 0) {
         return;
       }
+      if (m_budget.pass_exhausted()) {
+        m_budget.record_fallback("methods_skipped");
+        return;
+      }
       code.build_cfg();
 
-      duplicates_t dups = collect_duplicates(&code);
-      if (dups.size() > 0) {
-        record_stats(dups);
-        deduplicate(dups, method);
+      auto clock = m_budget.start_method();
+      boost::optional<duplicates_t> dups = collect_duplicates(&code, clock);
+      if (!dups) {
+        m_budget.record_fallback("methods_given_up");
+        return;
+      }
+      if (dups->size() > 0) {
+        record_stats(*dups);
+        deduplicate(*dups, method);
       }
     });
     report_stats();
@@ -129,6 +152,7 @@ class DedupBlocksImpl {
   const std::vector<DexClass*>& m_scope;
   PassManager& m_mgr;
   const DedupBlocksPass::Config& m_config;
+  BudgetTracker m_budget;
 
   // Stats
   std::mutex lock;
@@ -137,12 +161,18 @@ class DedupBlocksImpl {
   // map from block size to number of blocks with that size
   std::unordered_map<size_t, size_t> m_dup_sizes;
 
-  // Find blocks with the same exact code
-  duplicates_t collect_duplicates(IRCode* code) {
+  // Find blocks with the same exact code. Gives up if that takes longer than
+  // the method budget: a method with many blocks of the same hash makes for
+  // quadratically many comparisons.
+  boost::optional<duplicates_t> collect_duplicates(
+      IRCode* code, const BudgetTracker::MethodClock& clock) {
     const auto& blocks = code->cfg().blocks();
     duplicates_t duplicates;
 
     for (Block* block : blocks) {
+      if (clock.exhausted()) {
+        return boost::none;
+      }
       if (should_remove(code->cfg(), block)) {
         duplicates[BlockAsKey{code, block}].insert(block);
         ++m_num_eligible_blocks;
@@ -247,13 +277,13 @@ class DedupBlocksImpl {
         return false;
       }
 
-      if (is_fallthrough(pred.get())) {
+      if (is_fallthrough(pred)) {
         return false;
       }
     }
 
     for (auto& succ : block->succs()) {
-      if (is_fallthrough(succ.get())) {
+      if (is_fallthrough(succ)) {
         return false;
       }
     }
@@ -302,6 +332,7 @@ class DedupBlocksImpl {
     int removed = m_num_blocks_removed.load();
     m_mgr.incr_metric(METRIC_ELIGIBLE_BLOCKS, eligible_blocks);
     m_mgr.incr_metric(METRIC_BLOCKS_REMOVED, removed);
+    m_budget.report(m_mgr);
     TRACE(DEDUP_BLOCKS, 2, "%d eligible_blocks\n", eligible_blocks);
 
     for (const auto& entry : m_dup_sizes) {
@@ -25,9 +25,13 @@ class DedupBlocksPass : public Pass {
       if (meth == nullptr || !meth->is_def()) continue;
       m_config.method_black_list.emplace(static_cast<DexMethod*>(meth));
     }
+    m_config.time_budget = pc.get_time_budget();
   }
 
   struct Config {
     std::unordered_set<DexMethod*> method_black_list;
+    // Methods are left alone once the pass budget is spent, and so are the
+    // ones whose duplicates take longer than the method budget to find.
+    TimeBudget time_budget;
   } m_config;
 };
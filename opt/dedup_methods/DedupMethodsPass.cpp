@@ -0,0 +1,326 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "DedupMethodsPass.h"
+
+#include <atomic>
+#include <boost/functional/hash.hpp>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+
+#include "DexClass.h"
+#include "DexStore.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "Resolver.h"
+#include "Walkers.h"
+#include "WorkQueue.h"
+
+/*
+ * This pass folds methods that have the same code into one of them.
+ *
+ * Generated code (lambdas, accessors, factories) is full of static methods
+ * that are identical but for the class they live in. We hash the bodies of
+ * the candidate methods in parallel, compare the ones whose hashes and
+ * protos match, and point the calls to all the methods of a group of
+ * identical ones to the first of them. The others are then unreferenced and
+ * left for RemoveUnreachablePass to delete.
+ *
+ * Only methods that are called with invoke-static and invoke-direct are
+ * folded, so there are no overrides to worry about. An instance method is
+ * only folded with the methods of its own class, since `this` has the type
+ * of the class. Groups don't span stores, so rewriting a call never makes it
+ * refer to a store it couldn't refer to before.
+ */
+
+namespace {
+
+using hash_t = std::size_t;
+
+/*
+ * The entries that make a method body what it is, in order, and the
+ * position of each of them, so that the branches, try regions and catches
+ * of two bodies can be compared by where they point to.
+ *
+ * Positions and debug info are left out: the folded methods lose theirs,
+ * stack traces through them show the representative.
+ */
+struct CanonicalBody {
+  std::vector<MethodItemEntry*> entries;
+  std::unordered_map<const MethodItemEntry*, size_t> index_of;
+  uint16_t registers_size;
+  hash_t hash{0};
+
+  explicit CanonicalBody(IRCode* code)
+      : registers_size(code->get_registers_size()) {
+    for (auto& mie : *code) {
+      if (mie.type == MFLOW_DEBUG || mie.type == MFLOW_POSITION ||
+          mie.type == MFLOW_FALLTHROUGH) {
+        continue;
+      }
+      index_of.emplace(&mie, entries.size());
+      entries.push_back(&mie);
+    }
+    boost::hash_combine(hash, registers_size);
+    for (auto mie : entries) {
+      boost::hash_combine(hash, static_cast<int>(mie->type));
+      switch (mie->type) {
+      case MFLOW_OPCODE:
+        boost::hash_combine(hash, mie->insn->hash());
+        break;
+      case MFLOW_TARGET:
+        boost::hash_combine(hash, index(mie->target->src));
+        break;
+      case MFLOW_TRY:
+        boost::hash_combine(hash, static_cast<int>(mie->tentry->type));
+        boost::hash_combine(hash, index(mie->tentry->catch_start));
+        break;
+      case MFLOW_CATCH:
+        boost::hash_combine(hash, mie->centry->catch_type);
+        boost::hash_combine(hash, index(mie->centry->next));
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  // Where an entry sits in the body; a missing one (the end of a catch
+  // chain) sits past the end.
+  size_t index(const MethodItemEntry* mie) const {
+    return mie == nullptr ? entries.size() : index_of.at(mie);
+  }
+
+  bool operator==(const CanonicalBody& other) const {
+    if (hash != other.hash || registers_size != other.registers_size ||
+        entries.size() != other.entries.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+      auto a = entries[i];
+      auto b = other.entries[i];
+      if (a->type != b->type) {
+        return false;
+      }
+      switch (a->type) {
+      case MFLOW_OPCODE:
+        if (*a->insn != *b->insn) {
+          return false;
+        }
+        break;
+      case MFLOW_TARGET:
+        if (a->target->type != b->target->type ||
+            (a->target->type == BRANCH_MULTI &&
+             a->target->index != b->target->index) ||
+            index(a->target->src) != other.index(b->target->src)) {
+          return false;
+        }
+        break;
+      case MFLOW_TRY:
+        if (a->tentry->type != b->tentry->type ||
+            index(a->tentry->catch_start) !=
+                other.index(b->tentry->catch_start)) {
+          return false;
+        }
+        break;
+      case MFLOW_CATCH:
+        if (a->centry->catch_type != b->centry->catch_type ||
+            index(a->centry->next) != other.index(b->centry->next)) {
+          return false;
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    return true;
+  }
+};
+
+// Methods may only be folded with the ones that have the same key.
+using GroupKey = std::tuple<size_t, const DexProto*, const DexType*, hash_t>;
+
+struct GroupKeyHash {
+  size_t operator()(const GroupKey& key) const {
+    size_t result = 0;
+    boost::hash_combine(result, std::get<0>(key));
+    boost::hash_combine(result, std::get<1>(key));
+    boost::hash_combine(result, std::get<2>(key));
+    boost::hash_combine(result, std::get<3>(key));
+    return result;
+  }
+};
+
+class DedupMethodsImpl {
+ public:
+  DedupMethodsImpl(DexStoresVector& stores,
+                   const Scope& scope,
+                   PassManager& mgr,
+                   const DedupMethodsPass::Config& config)
+      : m_xstores(stores), m_scope(scope), m_mgr(mgr), m_config(config) {}
+
+  void run() {
+    collect_candidates();
+    hash_bodies();
+    fold_groups();
+    rewrite_calls();
+
+    m_mgr.incr_metric("candidates", m_candidates.size());
+    m_mgr.incr_metric("methods_folded", m_representative_of.size());
+    m_mgr.incr_metric("call_sites_rewritten", m_call_sites_rewritten);
+    m_mgr.incr_metric("visibility_changes", m_visibility_changes);
+    TRACE(DEDUP_METHODS,
+          1,
+          "[dedup methods] folded %lu of %lu candidates, rewrote %lu calls\n",
+          m_representative_of.size(),
+          m_candidates.size(),
+          m_call_sites_rewritten.load());
+  }
+
+ private:
+  bool is_candidate(const DexClass* cls, DexMethod* method) const {
+    if (method->get_code() == nullptr || is_any_init(method) ||
+        is_declared_synchronized(method) || !method->rstate.can_delete() ||
+        !method->rstate.can_rename() ||
+        m_config.method_black_list.count(method)) {
+      return false;
+    }
+    // Interface statics can't be called from other classes on every API
+    // level we target.
+    return is_static(method) ? !is_interface(cls) : is_private(method);
+  }
+
+  void collect_candidates() {
+    for (auto cls : m_scope) {
+      if (cls->is_external()) {
+        continue;
+      }
+      for (auto method : cls->get_dmethods()) {
+        if (is_candidate(cls, method)) {
+          m_candidates.push_back(method);
+        }
+      }
+    }
+  }
+
+  void hash_bodies() {
+    m_bodies.resize(m_candidates.size());
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      m_bodies[i] = std::make_unique<CanonicalBody>(
+          m_candidates[i]->get_code());
+    });
+    for (size_t i = 0; i < m_candidates.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  }
+
+  void fold_groups() {
+    // Groups list the candidates in scope order, so the representatives and
+    // the visibility changes don't depend on the hashes.
+    std::unordered_map<GroupKey, std::vector<size_t>, GroupKeyHash> groups;
+    std::vector<GroupKey> keys;
+    for (size_t i = 0; i < m_candidates.size(); ++i) {
+      auto method = m_candidates[i];
+      GroupKey key(m_xstores.get_store_idx(method->get_class()),
+                   method->get_proto(),
+                   is_static(method) ? nullptr : method->get_class(),
+                   m_bodies[i]->hash);
+      auto& group = groups[key];
+      if (group.empty()) {
+        keys.push_back(key);
+      }
+      group.push_back(i);
+    }
+
+    for (const auto& key : keys) {
+      const auto& group = groups.at(key);
+      // Hashes may collide, so a group can hold several sets of identical
+      // methods; each one is folded into its first method.
+      std::vector<size_t> representatives;
+      for (auto i : group) {
+        auto it = std::find_if(
+            representatives.begin(), representatives.end(),
+            [&](size_t rep) { return *m_bodies[rep] == *m_bodies[i]; });
+        if (it == representatives.end()) {
+          representatives.push_back(i);
+          continue;
+        }
+        auto rep = m_candidates[*it];
+        auto method = m_candidates[i];
+        if (rep->get_class() != method->get_class()) {
+          make_visible(rep);
+        }
+        m_representative_of.emplace(method, rep);
+        TRACE(DEDUP_METHODS, 3, "[dedup methods] %s -> %s\n", SHOW(method),
+              SHOW(rep));
+      }
+    }
+  }
+
+  void make_visible(DexMethod* rep) {
+    if (!is_public(rep)) {
+      set_public(rep);
+      ++m_visibility_changes;
+    }
+    auto cls = type_class(rep->get_class());
+    if (!is_public(cls)) {
+      set_public(cls);
+      ++m_visibility_changes;
+    }
+  }
+
+  void rewrite_calls() {
+    if (m_representative_of.empty()) {
+      return;
+    }
+    walk::parallel::code(m_scope, [&](DexMethod*, IRCode& code) {
+      for (auto& mie : InstructionIterable(&code)) {
+        auto insn = mie.insn;
+        auto op = insn->opcode();
+        if (!is_invoke_static(op) && !is_invoke_direct(op)) {
+          continue;
+        }
+        auto callee = resolve_method(insn->get_method(),
+                                     opcode_to_search(insn));
+        if (callee == nullptr) {
+          continue;
+        }
+        auto it = m_representative_of.find(callee);
+        if (it != m_representative_of.end()) {
+          insn->set_method(it->second);
+          ++m_call_sites_rewritten;
+        }
+      }
+    });
+  }
+
+  XStoreRefs m_xstores;
+  const Scope& m_scope;
+  PassManager& m_mgr;
+  const DedupMethodsPass::Config& m_config;
+  std::vector<DexMethod*> m_candidates;
+  std::vector<std::unique_ptr<CanonicalBody>> m_bodies;
+  std::unordered_map<const DexMethod*, DexMethod*> m_representative_of;
+  std::atomic<size_t> m_call_sites_rewritten{0};
+  size_t m_visibility_changes{0};
+};
+
+} // namespace
+
+void DedupMethodsPass::run_pass(DexStoresVector& stores,
+                                ConfigFiles& /* unused */,
+                                PassManager& mgr) {
+  auto scope = build_class_scope(stores);
+  DedupMethodsImpl impl(stores, scope, mgr, m_config);
+  impl.run();
+}
+
+static DedupMethodsPass s_pass;
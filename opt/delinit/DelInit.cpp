@@ -132,12 +132,13 @@ void find_referenced_classes(const Scope& scope) {
       }
     });
 
-  walk::code(
+  // The code is scanned in parallel, each class into a list of its own.
+  using ClassRefs = std::vector<const DexClass*>;
+  auto code_refs = walk::parallel::reduce_code<ClassRefs>(
     scope,
     [](DexMethod*) { return true; },
-    [&](DexMethod* meth, IRCode& code) {
-      for (const auto& mie :
-           InstructionIterable(meth->get_code())) {
+    [](ClassRefs& refs, DexMethod* meth, IRCode& code) {
+      for (const auto& mie : InstructionIterable(code)) {
         auto opcode = mie.insn;
         // Matches any stringref that name-aliases a type.
         if (opcode->has_string()) {
@@ -146,14 +147,19 @@ void find_referenced_classes(const Scope& scope) {
             get_dextype_from_dotname(dsclzref->c_str());
           if (dtexclude == nullptr) continue;
           TRACE(PGR, 3, "string_ref: %s\n", SHOW(dtexclude));
-          referenced_classes.insert(type_class(dtexclude));
+          refs.push_back(type_class(dtexclude));
         }
         if (opcode->has_type()) {
           TRACE(PGR, 3, "type_ref: %s\n", SHOW(opcode->get_type()));
-          referenced_classes.insert(type_class(opcode->get_type()));
+          refs.push_back(type_class(opcode->get_type()));
         }
       }
+    },
+    [](ClassRefs a, ClassRefs b) {
+      a.insert(a.end(), b.begin(), b.end());
+      return a;
     });
+  referenced_classes.insert(code_refs.begin(), code_refs.end());
 }
 
 bool can_remove(const DexClass* cls) {
@@ -284,6 +290,9 @@ int DeadRefs::find_new_unreachable(Scope& scope) {
   int init_called = 0;
   int init_cant_delete = 0;
   int init_class_cant_delete = 0;
+  // Only inits that are called keep others alive in can_remove_init(), so
+  // the dead ones can all be removed at the end.
+  std::vector<DexMethod*> dead_inits;
   for (auto init : initmethods) {
     if (called.count(init) > 0) {
       init_called++;
@@ -293,12 +302,13 @@ int DeadRefs::find_new_unreachable(Scope& scope) {
       init_cant_delete++;
       continue;
     }
-    auto clazz = type_class(init->get_class());
-    clazz->remove_method(init);
+    dead_inits.push_back(init);
     TRACE(DELINIT, 5, "Delete init %s.%s %s\n", SHOW(init->get_class()),
         SHOW(init->get_name()), SHOW(init->get_proto()));
     init_deleted++;
   }
+  DEBUG_ONLY auto removed_inits = remove_methods(dead_inits);
+  assert(removed_inits == dead_inits.size());
   TRACE(DELINIT, 2, "Removed %d <init> methods\n", init_deleted);
   TRACE(DELINIT, 3, "%d <init> methods called\n", init_called);
   TRACE(DELINIT, 3, "%d <init> methods do not delete\n", init_cant_delete);
@@ -389,17 +399,20 @@ void DeadRefs::collect_dmethods(Scope& scope) {
  */
 void DeadRefs::track_callers(Scope& scope) {
   called.clear();
-  walk::opcodes(scope,
+  // The opcodes are scanned in parallel, each class into lists of its own;
+  // only the fields that may be removed are worth listing.
+  struct Refs {
+    std::vector<DexMethod*> callees;
+    std::vector<DexField*> fields;
+  };
+  auto all_refs = walk::parallel::reduce_opcodes<Refs>(scope,
       [](DexMethod*) { return true; },
-      [&](DexMethod* m, IRInstruction* insn) {
+      [&](Refs& refs, DexMethod* m, IRInstruction* insn) {
         if (insn->has_method()) {
           auto callee =
               resolve_method(insn->get_method(), opcode_to_search(insn));
           if (callee == nullptr || !callee->is_concrete()) return;
-          if (vmethods.count(callee) > 0) {
-            vmethods.erase(callee);
-          }
-          called.insert(callee);
+          refs.callees.push_back(callee);
           return;
         }
         if (insn->has_field()) {
@@ -410,11 +423,23 @@ void DeadRefs::track_callers(Scope& scope) {
                       FieldSearch::Static : FieldSearch::Any);
           if (field == nullptr || !field->is_concrete()) return;
           if (ifields.count(field) > 0) {
-            ifields.erase(field);
+            refs.fields.push_back(field);
           }
           return;
         }
+      },
+      [](Refs a, Refs b) {
+        a.callees.insert(a.callees.end(), b.callees.begin(), b.callees.end());
+        a.fields.insert(a.fields.end(), b.fields.begin(), b.fields.end());
+        return a;
       });
+  for (auto callee : all_refs.callees) {
+    vmethods.erase(callee);
+    called.insert(callee);
+  }
+  for (auto field : all_refs.fields) {
+    ifields.erase(field);
+  }
   TRACE(DELINIT, 3,
       "Unreachable (not called) %ld vmethods and %ld ifields\n",
       vmethods.size(), ifields.size());
@@ -427,40 +452,35 @@ int DeadRefs::remove_unreachable() {
   int vmethodcnt = 0;
   int dmethodcnt = 0;
   int ifieldcnt = 0;
+  // The members are removed in batches, so that classes losing many members
+  // are compacted once rather than once per member.
+  std::vector<DexMethod*> dead_vmethods;
   for (const auto& meth : vmethods) {
     assert(meth->is_virtual());
-    auto cls = type_class(meth->get_class());
-    auto& methods = cls->get_vmethods();
-    auto meth_it = std::find(methods.begin(), methods.end(), meth);
-    if (meth_it == methods.end()) continue;
-
-    methods.erase(meth_it);
-    vmethodcnt++;
+    dead_vmethods.push_back(meth);
     TRACE(DELINIT, 6, "Delete vmethod: %s.%s %s\n",
         SHOW(meth->get_class()), SHOW(meth->get_name()),
         SHOW(meth->get_proto()));
   }
+  vmethodcnt = remove_methods(dead_vmethods);
   del_init_res.deleted_vmeths += vmethodcnt;
   TRACE(DELINIT, 2, "Removed %d vmethods\n", vmethodcnt);
 
+  std::vector<DexField*> dead_ifields;
   for (const auto& field : ifields) {
     assert(!is_static(field));
-    auto cls = type_class(field->get_class());
-    auto& fields = cls->get_ifields();
-    auto field_it = std::find(fields.begin(), fields.end(), field);
-    if (field_it == fields.end()) continue;
-
-    fields.erase(field_it);
-    ifieldcnt++;
+    dead_ifields.push_back(field);
     TRACE(DELINIT, 6, "Delete ifield: %s.%s %s\n",
       SHOW(field->get_class()), SHOW(field->get_name()),
       SHOW(field->get_type()));
   }
+  ifieldcnt = remove_fields(dead_ifields);
   del_init_res.deleted_ifields += ifieldcnt;
   TRACE(DELINIT, 2, "Removed %d ifields\n", ifieldcnt);
 
   int called_dmeths = 0;
   int dont_delete_dmeths = 0;
+  std::vector<DexMethod*> dead_dmethods;
   for (const auto& meth : dmethods) {
     assert(!meth->is_virtual());
     if (called.count(meth) > 0) {
@@ -471,13 +491,14 @@ int DeadRefs::remove_unreachable() {
       dont_delete_dmeths++;
       continue;
     }
-    auto clazz = type_class(meth->get_class());
-    clazz->remove_method(meth);
+    dead_dmethods.push_back(meth);
     dmethodcnt++;
     TRACE(DELINIT, 6, "Delete dmethod: %s.%s %s\n",
         SHOW(meth->get_class()), SHOW(meth->get_name()),
         SHOW(meth->get_proto()));
   }
+  DEBUG_ONLY auto removed_dmethods = remove_methods(dead_dmethods);
+  assert(removed_dmethods == dead_dmethods.size());
   del_init_res.deleted_dmeths += dmethodcnt;
   TRACE(DELINIT, 2, "Removed %d dmethods\n", dmethodcnt);
   TRACE(DELINIT, 3, "%d called dmethods\n", called_dmeths);
@@ -15,6 +15,7 @@
 #include <unordered_set>
 #include <vector>
 
+#include "Analyses.h"
 #include "Debug.h"
 #include "DexAccess.h"
 #include "DexClass.h"
@@ -25,7 +26,9 @@
 #include "IRCode.h"
 #include "ReachableClasses.h"
 #include "Resolver.h"
+#include "StaticRefIndex.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -51,10 +54,22 @@ class FinalInlineImpl {
     return false;
   }
 
-  std::unordered_set<DexField*> get_called_field_defs(const Scope& scope) {
-    std::vector<DexFieldRef*> field_refs;
-    walk::methods(scope,
-                 [&](DexMethod* method) { method->gather_fields(field_refs); });
+  /*
+   * The definitions of the fields referenced by the given sget/sput refs or by
+   * the annotations of the methods.
+   */
+  std::unordered_set<DexField*> get_called_field_defs(
+      const Scope& scope, std::vector<DexFieldRef*> field_refs) {
+    walk::methods(scope, [&](DexMethod* method) {
+      auto anno_set = method->get_anno_set();
+      if (anno_set) anno_set->gather_fields(field_refs);
+      auto param_anno = method->get_param_anno();
+      if (param_anno) {
+        for (auto pair : *param_anno) {
+          pair.second->gather_fields(field_refs);
+        }
+      }
+    });
     sort_unique(field_refs);
     /* Okay, now we have a complete list of field refs
      * for this particular dex.  Map to the def actually invoked.
@@ -69,8 +84,11 @@ class FinalInlineImpl {
   }
 
   std::unordered_set<DexField*> get_field_target(
-      const Scope& scope, const std::vector<DexField*>& fields) {
-    std::unordered_set<DexField*> field_defs = get_called_field_defs(scope);
+      const Scope& scope,
+      const std::vector<DexField*>& fields,
+      const std::vector<DexFieldRef*>& code_field_refs) {
+    std::unordered_set<DexField*> field_defs =
+        get_called_field_defs(scope, code_field_refs);
     std::unordered_set<DexField*> ftarget;
     for (auto field : fields) {
       if (field_defs.count(field) > 0) {
@@ -90,8 +108,9 @@ class FinalInlineImpl {
     return false;
   }
 
-  // returns the number of fields removed
-  size_t remove_unused_fields() {
+  // returns the number of fields removed. code_field_refs are the field refs
+  // of the sgets and sputs left in the code, see inline_field_values().
+  size_t remove_unused_fields(const std::vector<DexFieldRef*>& code_field_refs) {
     std::vector<DexField*> moveable_fields;
     std::vector<DexClass*> smallscope;
     uint32_t aflags = ACC_STATIC | ACC_FINAL;
@@ -128,7 +147,7 @@ class FinalInlineImpl {
     sort_unique(smallscope);
 
     std::unordered_set<DexField*> field_target =
-        get_field_target(m_full_scope, moveable_fields);
+        get_field_target(m_full_scope, moveable_fields, code_field_refs);
     std::unordered_set<DexField*> dead_fields;
     for (auto field : moveable_fields) {
       if (field_target.count(field) == 0) {
@@ -216,8 +235,11 @@ class FinalInlineImpl {
     }
   }
 
-  // returns the total number of inlines
-  size_t inline_field_values() {
+  // returns the total number of inlines. The field refs of the sgets and sputs
+  // that are left are added to remaining_field_refs, if given.
+  size_t inline_field_values(
+      const StaticRefIndex& index,
+      std::vector<DexFieldRef*>* remaining_field_refs = nullptr) {
     std::unordered_set<DexField*> inline_field;
     uint32_t aflags = ACC_STATIC | ACC_FINAL;
     for (auto clazz : m_full_scope) {
@@ -243,45 +265,60 @@ class FinalInlineImpl {
       }
     }
 
-    return walk::parallel::reduce_methods<std::nullptr_t, size_t, Scope>(
-        m_full_scope,
-        [&inline_field, this](std::nullptr_t, DexMethod* m) -> size_t {
-          auto* code = m->get_code();
-          if (!code) {
-            return 0;
+    struct MethodResult {
+      size_t inlined{0};
+      std::vector<DexFieldRef*> remaining;
+    };
+    const auto& methods = index.methods();
+    std::vector<MethodResult> results(methods.size());
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      const auto& refs = methods[i];
+      auto m = refs.method;
+      auto* code = m->get_code();
+      std::vector<IRList::iterator> rewrites;
+      for (auto it : refs.field_refs) {
+        auto* insn = it->insn;
+        if (is_sget(insn->opcode())) {
+          auto field = resolve_field(insn->get_field(), FieldSearch::Static);
+          if (field != nullptr && field->is_concrete() &&
+              inline_field.count(field) != 0 && validate_sget(m, insn)) {
+            rewrites.push_back(it);
+            continue;
           }
-          std::vector<IRList::iterator> rewrites;
-          auto ii = InstructionIterable(code);
-          for (auto it = ii.begin(); it != ii.end(); ++it) {
-            auto* insn = it->insn;
-            if (!is_sget(insn->opcode())) {
-              continue;
-            }
-            auto field = resolve_field(insn->get_field(), FieldSearch::Static);
-            if (field == nullptr || !field->is_concrete()) continue;
-            if (inline_field.count(field) == 0) continue;
-            if (!validate_sget(m, insn)) continue;
-            rewrites.push_back(it.unwrap());
-          }
-          for (auto it : rewrites) {
-            auto* insn = it->insn;
-            auto dest = move_result_pseudo_of(it)->dest();
-            auto field = resolve_field(insn->get_field(), FieldSearch::Static);
-            auto value = field->get_static_value();
-            auto opcode = value->is_wide() ? OPCODE_CONST_WIDE : OPCODE_CONST;
-            uint64_t v =
-                value != nullptr ? static_cast<uint64_t>(value->value()) : 0;
-            auto newopcode =
-                (new IRInstruction(opcode))->set_dest(dest)->set_literal(v);
-
-            code->insert_before(it, newopcode);
-            code->remove_opcode(it);
-          }
-          return rewrites.size();
-        },
-        [](size_t a, size_t b) { return a + b; }, // output reducer
-        [](int) { return nullptr; } // data initializer. not needed
-    );
+        }
+        results[i].remaining.push_back(insn->get_field());
+      }
+      for (auto it : rewrites) {
+        auto* insn = it->insn;
+        auto dest = move_result_pseudo_of(it)->dest();
+        auto field = resolve_field(insn->get_field(), FieldSearch::Static);
+        auto value = field->get_static_value();
+        auto opcode = value->is_wide() ? OPCODE_CONST_WIDE : OPCODE_CONST;
+        uint64_t v =
+            value != nullptr ? static_cast<uint64_t>(value->value()) : 0;
+        auto newopcode =
+            (new IRInstruction(opcode))->set_dest(dest)->set_literal(v);
+
+        code->insert_before(it, newopcode);
+        code->remove_opcode(it);
+      }
+      results[i].inlined = rewrites.size();
+    });
+    for (size_t i = 0; i < methods.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+
+    size_t inlined = 0;
+    for (const auto& result : results) {
+      inlined += result.inlined;
+      if (remaining_field_refs != nullptr) {
+        remaining_field_refs->insert(remaining_field_refs->end(),
+                                     result.remaining.begin(),
+                                     result.remaining.end());
+      }
+    }
+    return inlined;
   }
 
   /*
@@ -644,14 +681,17 @@ void FinalInlinePass::run_pass(DexStoresVector& stores,
   auto scope = build_class_scope(stores);
 
   FinalInlineImpl impl(scope, m_config);
+  bool code_changed = false;
   if (m_config.replace_encodable_clinits) {
     auto nreplaced = impl.replace_encodable_clinits();
     mgr.incr_metric("encodable_clinits_replaced", nreplaced);
+    code_changed |= nreplaced > 0;
   }
 
   if (m_config.propagate_static_finals) {
     auto nresolved = impl.propagate_constants();
     mgr.incr_metric("static_finals_resolved", nresolved);
+    code_changed |= nresolved > 0;
   }
 
   // Constprop may resolve statics that were initialized via clinit. This opens
@@ -659,10 +699,19 @@ void FinalInlinePass::run_pass(DexStoresVector& stores,
   if (m_config.replace_encodable_clinits) {
     auto nreplaced = impl.replace_encodable_clinits();
     mgr.incr_metric("encodable_clinits_replaced", nreplaced);
+    code_changed |= nreplaced > 0;
   }
 
-  size_t num_finals_inlined = impl.inline_field_values();
-  size_t num_removed_fields = impl.remove_unused_fields();
+  // The index is shared with the other passes through the analysis manager,
+  // but the clinit rewrites above may have removed instructions from it.
+  if (code_changed) {
+    mgr.analyses().invalidate<StaticRefsAnalysis>();
+  }
+  const auto& index = mgr.analyses().get<StaticRefsAnalysis>(stores);
+  std::vector<DexFieldRef*> remaining_field_refs;
+  size_t num_finals_inlined =
+      impl.inline_field_values(index, &remaining_field_refs);
+  size_t num_removed_fields = impl.remove_unused_fields(remaining_field_refs);
 
   mgr.incr_metric("num_finals_inlined", num_finals_inlined);
   mgr.incr_metric("num_removed_fields", num_removed_fields);
@@ -672,14 +721,15 @@ void FinalInlinePass::inline_fields(const Scope& scope) {
   FinalInlinePass::Config config{};
 
   FinalInlineImpl impl(scope, config);
-  impl.inline_field_values();
-  impl.remove_unused_fields();
+  std::vector<DexFieldRef*> remaining_field_refs;
+  impl.inline_field_values(StaticRefIndex(scope), &remaining_field_refs);
+  impl.remove_unused_fields(remaining_field_refs);
 }
 
 void FinalInlinePass::inline_fields(const Scope& scope,
                                     FinalInlinePass::Config& config) {
   FinalInlineImpl impl(scope, config);
-  impl.inline_field_values();
+  impl.inline_field_values(StaticRefIndex(scope));
 }
 
 const std::unordered_map<DexField*, std::vector<FieldDependency>>
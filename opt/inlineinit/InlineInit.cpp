@@ -58,6 +58,10 @@ void InlineInitPass::run_pass(DexStoresVector& stores,
   auto& primary_dex = stores[0].get_dexen()[0];
 
   auto resolver = [&](DexMethodRef* method, MethodSearch search) {
+    // The local cache can't be shared between threads.
+    if (m_inliner_config.parallel) {
+      return resolve_method_cached(method, search);
+    }
     return resolve_method(method, search, m_resolved_refs);
   };
 
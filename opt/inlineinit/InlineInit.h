@@ -30,6 +30,7 @@ class InlineInitPass : public Pass {
       m_inliner_config.caller_black_list.emplace(
           DexType::make_type(type_s.c_str()));
     }
+    pc.get("parallel", false, m_inliner_config.parallel);
   }
 
   virtual void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
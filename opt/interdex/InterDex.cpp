@@ -9,11 +9,14 @@
 
 #include "InterDex.h"
 
+#include <algorithm>
+#include <queue>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
-#include <vector>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "ConfigFiles.h"
 #include "Creators.h"
@@ -27,12 +30,10 @@
 #include "ReachableClasses.h"
 #include "StringUtil.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
-typedef std::unordered_set<DexMethodRef*> mrefs_t;
-typedef std::unordered_set<DexFieldRef*> frefs_t;
-
 size_t global_dmeth_cnt;
 size_t global_smeth_cnt;
 size_t global_vmeth_cnt;
@@ -46,36 +47,172 @@ size_t cold_start_set_dex_count = 1000;
 bool emit_canaries = false;
 int64_t linear_alloc_limit;
 
-void gather_refs(InterDexPass* pass,
-                 const DexClass* cls,
-                 mrefs_t* mrefs,
-                 frefs_t* frefs) {
-  std::vector<DexMethodRef*> method_refs;
-  std::vector<DexFieldRef*> field_refs;
-  cls->gather_methods(method_refs);
-  cls->gather_fields(field_refs);
-  for (const auto& plugin : pass->m_plugins) {
-    plugin->gather_mrefs(cls, method_refs, field_refs);
+/*
+ * Assigns dense ids to refs, in the order in which they are first seen.
+ */
+template <typename Ref>
+class RefIds {
+ public:
+  uint32_t get(Ref* ref) {
+    auto result = m_ids.emplace(ref, m_refs.size());
+    if (result.second) {
+      m_refs.push_back(ref);
+    }
+    return result.first->second;
   }
-  mrefs->insert(method_refs.begin(), method_refs.end());
-  frefs->insert(field_refs.begin(), field_refs.end());
-}
+
+  Ref* ref(uint32_t id) const { return m_refs.at(id); }
+
+  size_t size() const { return m_refs.size(); }
+
+ private:
+  std::unordered_map<Ref*, uint32_t> m_ids;
+  std::vector<Ref*> m_refs;
+};
 
 /*
- * Removes the elements of b from a. Runs in O(size(a)), so it works best if
- * size(a) << size(b).
+ * The ids of the distinct method and field refs a class needs in its dex.
  */
-template <typename T>
-std::unordered_set<T> set_difference(const std::unordered_set<T>& a,
-                                     const std::unordered_set<T>& b) {
-  std::unordered_set<T> result;
-  for (auto& v : a) {
-    if (!b.count(v)) {
-      result.emplace(v);
+struct ClassRefs {
+  std::vector<uint32_t> mrefs;
+  std::vector<uint32_t> frefs;
+};
+
+/*
+ * The refs of all the classes, gathered once. The classes of the input are
+ * summarized up front and in parallel; classes that show up later, like the
+ * canaries and the ones created by plugins, when they are first looked up.
+ */
+class RefsIndex {
+ public:
+  void add_classes(const Scope& scope) {
+    std::vector<std::vector<DexMethodRef*>> mrefs(scope.size());
+    std::vector<std::vector<DexFieldRef*>> frefs(scope.size());
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      gather(scope[i], &mrefs[i], &frefs[i]);
+    });
+    for (size_t i = 0; i < scope.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+    // Ids are assigned serially and in scope order, so they are deterministic.
+    for (size_t i = 0; i < scope.size(); ++i) {
+      m_classes.emplace(scope[i], make_refs(mrefs[i], frefs[i]));
     }
   }
-  return result;
-}
+
+  const ClassRefs& get(const DexClass* cls) {
+    auto it = m_classes.find(cls);
+    if (it == m_classes.end()) {
+      std::vector<DexMethodRef*> mrefs;
+      std::vector<DexFieldRef*> frefs;
+      gather(cls, &mrefs, &frefs);
+      it = m_classes.emplace(cls, make_refs(mrefs, frefs)).first;
+    }
+    return it->second;
+  }
+
+  // The refs :clazz needs, including the ones the plugins add for it.
+  ClassRefs get_with_plugins(InterDexPass* pass, const DexClass* clazz) {
+    const auto& own = get(clazz);
+    if (pass->m_plugins.empty()) {
+      return own;
+    }
+    std::vector<DexMethodRef*> method_refs;
+    std::vector<DexFieldRef*> field_refs;
+    for (auto id : own.mrefs) {
+      method_refs.push_back(methods.ref(id));
+    }
+    for (auto id : own.frefs) {
+      field_refs.push_back(fields.ref(id));
+    }
+    for (const auto& plugin : pass->m_plugins) {
+      plugin->gather_mrefs(clazz, method_refs, field_refs);
+    }
+    uniquify(method_refs);
+    uniquify(field_refs);
+    return make_refs(method_refs, field_refs);
+  }
+
+  RefIds<DexMethodRef> methods;
+  RefIds<DexFieldRef> fields;
+
+ private:
+  template <typename Ref>
+  static void uniquify(std::vector<Ref*>& refs) {
+    std::sort(refs.begin(), refs.end());
+    refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+  }
+
+  static void gather(const DexClass* cls,
+                     std::vector<DexMethodRef*>* mrefs,
+                     std::vector<DexFieldRef*>* frefs) {
+    cls->gather_methods(*mrefs);
+    cls->gather_fields(*frefs);
+    uniquify(*mrefs);
+    uniquify(*frefs);
+  }
+
+  // The refs must be distinct.
+  ClassRefs make_refs(const std::vector<DexMethodRef*>& mrefs,
+                      const std::vector<DexFieldRef*>& frefs) {
+    ClassRefs refs;
+    refs.mrefs.reserve(mrefs.size());
+    for (auto* mref : mrefs) {
+      refs.mrefs.push_back(methods.get(mref));
+    }
+    refs.frefs.reserve(frefs.size());
+    for (auto* fref : frefs) {
+      refs.frefs.push_back(fields.get(fref));
+    }
+    return refs;
+  }
+
+  std::unordered_map<const DexClass*, ClassRefs> m_classes;
+};
+
+/*
+ * A set of ref ids, as a bitmap.
+ */
+class RefSet {
+ public:
+  bool contains(uint32_t id) const {
+    return id < m_bits.size() && m_bits[id];
+  }
+
+  // Returns true if :id wasn't in the set yet.
+  bool insert(uint32_t id) {
+    if (id >= m_bits.size()) {
+      m_bits.resize(std::max<size_t>(id + 1, m_bits.size() * 2));
+    }
+    if (m_bits[id]) {
+      return false;
+    }
+    m_bits[id] = true;
+    m_ids.push_back(id);
+    return true;
+  }
+
+  // The number of the distinct :ids that are not in the set yet.
+  size_t count_missing(const std::vector<uint32_t>& ids) const {
+    return std::count_if(ids.begin(), ids.end(), [this](uint32_t id) {
+      return !contains(id);
+    });
+  }
+
+  size_t size() const { return m_ids.size(); }
+
+  void clear() {
+    for (auto id : m_ids) {
+      m_bits[id] = false;
+    }
+    m_ids.clear();
+  }
+
+ private:
+  std::vector<bool> m_bits;
+  std::vector<uint32_t> m_ids;
+};
 
 constexpr int kMaxMethodRefs = ((64 * 1024) - 1);
 constexpr int kMaxFieldRefs = 64 * 1024 - 1;
@@ -85,9 +222,12 @@ constexpr size_t kCanaryClassBufsize = sizeof(kCanaryClassFormat);
 constexpr int kMaxDexNum = 99;
 
 struct dex_emit_tracker {
+  explicit dex_emit_tracker(RefsIndex& refs) : refs(refs) {}
+
+  RefsIndex& refs;
   unsigned la_size{0};
-  mrefs_t mrefs;
-  frefs_t frefs;
+  RefSet mrefs;
+  RefSet frefs;
   std::vector<DexClass*> outs;
   std::unordered_set<DexClass*> emitted;
   std::unordered_map<std::string, DexClass*> clookup;
@@ -119,36 +259,41 @@ void update_class_stats(DexClass* clazz) {
 }
 
 /*
- * Sanity check: did gather_refs return all the refs that ultimately ended up
- * in the dex?
+ * Sanity check: did we predict all the refs that ultimately ended up in the
+ * dex?
  */
-void check_refs_count(const dex_emit_tracker& det, const DexClasses& dc) {
-  std::vector<DexMethodRef*> mrefs;
+void check_refs_count(dex_emit_tracker& det, const DexClasses& dc) {
+  RefSet mrefs_set;
+  RefSet frefs_set;
   for (DexClass* cls : dc) {
-    cls->gather_methods(mrefs);
+    const auto& refs = det.refs.get(cls);
+    for (auto id : refs.mrefs) {
+      mrefs_set.insert(id);
+    }
+    for (auto id : refs.frefs) {
+      frefs_set.insert(id);
+    }
   }
-  std::unordered_set<DexMethodRef*> mrefs_set(mrefs.begin(), mrefs.end());
+  // The dex only has refs we didn't predict if it has more of them.
   if (mrefs_set.size() > det.mrefs.size()) {
-    for (DexMethodRef* mr : mrefs_set) {
-      if (!det.mrefs.count(mr)) {
-        TRACE(IDEX, 1,
-              "WARNING: Could not find %s in predicted mrefs set\n",
-              SHOW(mr));
+    for (DexClass* cls : dc) {
+      for (auto id : det.refs.get(cls).mrefs) {
+        if (!det.mrefs.contains(id)) {
+          TRACE(IDEX, 1,
+                "WARNING: Could not find %s in predicted mrefs set\n",
+                SHOW(det.refs.methods.ref(id)));
+        }
       }
     }
   }
-
-  std::vector<DexFieldRef*> frefs;
-  for (DexClass* cls : dc) {
-    cls->gather_fields(frefs);
-  }
-  std::unordered_set<DexFieldRef*> frefs_set(frefs.begin(), frefs.end());
   if (frefs_set.size() > det.frefs.size()) {
-    for (auto* fr : frefs_set) {
-      if (!det.frefs.count(fr)) {
-        TRACE(IDEX, 1,
-              "WARNING: Could not find %s in predicted frefs set\n",
-              SHOW(fr));
+    for (DexClass* cls : dc) {
+      for (auto id : det.refs.get(cls).frefs) {
+        if (!det.frefs.contains(id)) {
+          TRACE(IDEX, 1,
+                "WARNING: Could not find %s in predicted frefs set\n",
+                SHOW(det.refs.fields.ref(id)));
+        }
       }
     }
   }
@@ -327,32 +472,34 @@ void emit_class(InterDexPass* pass,
 
   // Calculate the extra method and field refs that we would need to add to
   // the current dex if we defined :clazz in it.
-  mrefs_t clazz_mrefs;
-  frefs_t clazz_frefs;
-  gather_refs(pass, clazz, &clazz_mrefs, &clazz_frefs);
-  auto extra_mrefs = set_difference(clazz_mrefs, det.mrefs);
-  auto extra_frefs = set_difference(clazz_frefs, det.frefs);
+  auto clazz_refs = det.refs.get_with_plugins(pass, clazz);
+  auto extra_mrefs = det.mrefs.count_missing(clazz_refs.mrefs);
+  auto extra_frefs = det.frefs.count_missing(clazz_refs.frefs);
 
   // If those extra refs would cause use to overflow, start a new dex.
   if ((det.la_size + laclazz) > linear_alloc_limit ||
       // XXX(jezng): shouldn't this >= be > instead?
-      det.mrefs.size() + extra_mrefs.size() >= kMaxMethodRefs ||
-      det.frefs.size() + extra_frefs.size() >= kMaxFieldRefs) {
+      det.mrefs.size() + extra_mrefs >= kMaxMethodRefs ||
+      det.frefs.size() + extra_frefs >= kMaxFieldRefs) {
     // Emit out list
     always_assert_log(!is_primary,
                       "would have to do an early flush on the primary dex\n"
                       "la %d:%d , mrefs %lu:%d frefs %lu:%d\n",
                       det.la_size + laclazz,
                       linear_alloc_limit,
-                      det.mrefs.size() + extra_mrefs.size(),
+                      det.mrefs.size() + extra_mrefs,
                       kMaxMethodRefs,
-                      det.frefs.size() + extra_frefs.size(),
+                      det.frefs.size() + extra_frefs,
                       kMaxFieldRefs);
     flush_out_secondary(pass, det, outdex);
   }
 
-  det.mrefs.insert(clazz_mrefs.begin(), clazz_mrefs.end());
-  det.frefs.insert(clazz_frefs.begin(), clazz_frefs.end());
+  for (auto id : clazz_refs.mrefs) {
+    det.mrefs.insert(id);
+  }
+  for (auto id : clazz_refs.frefs) {
+    det.frefs.insert(id);
+  }
   det.la_size += laclazz;
   det.outs.push_back(clazz);
   det.emitted.insert(clazz);
@@ -366,6 +513,143 @@ void emit_class(InterDexPass* pass,
   emit_class(pass, det, outdex, clazz, false);
 }
 
+// Refs shared by more classes than this, like the constructor of Object, end
+// up in almost every dex anyway, so they don't say which classes belong
+// together.
+constexpr size_t kMaxClusteringRefFanout = 1000;
+
+/*
+ * Emits :classes so that classes sharing refs end up in the same dex. The
+ * next class is always the one sharing the most method, field, type and
+ * string refs with the dex being filled (the earliest one on ties), and a new
+ * dex is seeded with the earliest class that is left. Fewer refs are then
+ * duplicated across dexes, so the dexes are fewer and their id tables
+ * smaller.
+ */
+void emit_clustered_classes(InterDexPass* pass,
+                            dex_emit_tracker& det,
+                            DexClassesVector& outdex,
+                            const std::vector<DexClass*>& scope) {
+  std::vector<DexClass*> classes;
+  for (auto* clazz : scope) {
+    if (det.emitted.count(clazz) != 0 || is_canary(clazz)) {
+      continue;
+    }
+    if (should_skip_class(pass, clazz)) {
+      TRACE(IDEX, 3, "IDEX: Skipping class :: %s\n", SHOW(clazz));
+      continue;
+    }
+    classes.push_back(clazz);
+  }
+
+  std::vector<std::vector<const void*>> gathered(classes.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto* clazz = classes[i];
+    std::vector<DexMethodRef*> mrefs;
+    std::vector<DexFieldRef*> frefs;
+    std::vector<DexType*> types;
+    std::vector<DexString*> strings;
+    clazz->gather_methods(mrefs);
+    clazz->gather_fields(frefs);
+    clazz->gather_types(types);
+    clazz->gather_strings(strings);
+    auto& refs = gathered[i];
+    refs.insert(refs.end(), mrefs.begin(), mrefs.end());
+    refs.insert(refs.end(), frefs.begin(), frefs.end());
+    refs.insert(refs.end(), types.begin(), types.end());
+    refs.insert(refs.end(), strings.begin(), strings.end());
+    std::sort(refs.begin(), refs.end());
+    refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+  });
+  for (size_t i = 0; i < classes.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  // The classes that have each ref.
+  std::unordered_map<const void*, uint32_t> ref_ids;
+  std::vector<std::vector<uint32_t>> ref_classes;
+  std::vector<std::vector<uint32_t>> class_refs(classes.size());
+  for (uint32_t i = 0; i < classes.size(); ++i) {
+    for (auto* ref : gathered[i]) {
+      auto result = ref_ids.emplace(ref, ref_classes.size());
+      if (result.second) {
+        ref_classes.emplace_back();
+      }
+      auto id = result.first->second;
+      ref_classes[id].push_back(i);
+      class_refs[i].push_back(id);
+    }
+    std::vector<const void*>().swap(gathered[i]);
+  }
+
+  // The number of refs each class shares with the current dex. The queue may
+  // hold stale entries; an entry is only valid if it matches the score.
+  std::vector<uint32_t> scores(classes.size(), 0);
+  std::vector<uint32_t> scored;
+  std::vector<bool> ref_in_dex(ref_classes.size(), false);
+  std::vector<uint32_t> refs_in_dex;
+  std::vector<bool> done(classes.size(), false);
+  using Entry = std::pair<uint32_t, int64_t>; // score, -index
+  std::priority_queue<Entry> queue;
+  size_t next_seed = 0;
+
+  for (size_t emitted = 0; emitted < classes.size(); ++emitted) {
+    int64_t next = -1;
+    while (!queue.empty()) {
+      auto entry = queue.top();
+      queue.pop();
+      auto i = -entry.second;
+      if (!done[i] && scores[i] == entry.first) {
+        next = i;
+        break;
+      }
+    }
+    if (next == -1) {
+      while (done[next_seed]) {
+        ++next_seed;
+      }
+      next = next_seed;
+    }
+
+    auto dexes = outdex.size();
+    emit_class(pass, det, outdex, classes[next], false, false);
+    done[next] = true;
+    if (outdex.size() != dexes) {
+      // The class was put in a new dex.
+      for (auto i : scored) {
+        scores[i] = 0;
+      }
+      scored.clear();
+      for (auto id : refs_in_dex) {
+        ref_in_dex[id] = false;
+      }
+      refs_in_dex.clear();
+      queue = std::priority_queue<Entry>();
+    }
+
+    for (auto id : class_refs[next]) {
+      if (ref_in_dex[id]) {
+        continue;
+      }
+      ref_in_dex[id] = true;
+      refs_in_dex.push_back(id);
+      if (ref_classes[id].size() > kMaxClusteringRefFanout) {
+        continue;
+      }
+      for (auto i : ref_classes[id]) {
+        if (done[i]) {
+          continue;
+        }
+        if (scores[i] == 0) {
+          scored.push_back(i);
+        }
+        queue.emplace(++scores[i], -static_cast<int64_t>(i));
+      }
+    }
+  }
+}
+
 std::unordered_set<const DexClass*> find_unrefenced_coldstart_classes(
     const Scope& scope,
     dex_emit_tracker& det,
@@ -392,31 +676,34 @@ std::unordered_set<const DexClass*> find_unrefenced_coldstart_classes(
   while (old_no_ref != new_no_ref) {
     old_no_ref = new_no_ref;
     new_no_ref = 0;
-    cold_cold_references.clear();
-    walk::code(
-      input_scope,
-      [&](DexMethod* meth) {
-        return coldstart_classes.count(type_class(meth->get_class())) > 0;
-      },
-      [&](DexMethod* meth, const IRCode& code) {
-        auto base_cls = type_class(meth->get_class());
-        for (auto& mie : InstructionIterable(meth->get_code())) {
-          auto inst = mie.insn;
-          DexClass* called_cls = nullptr;
-          if (inst->has_method()) {
-            called_cls = type_class(inst->get_method()->get_class());
-          } else if (inst->has_field()) {
-            called_cls = type_class(inst->get_field()->get_class());
-          } else if (inst->has_type()) {
-            called_cls = type_class(inst->get_type());
+    using ClassSet = std::unordered_set<const DexClass*>;
+    cold_cold_references = walk::parallel::reduce_code<ClassSet>(
+        input_scope,
+        [&](DexMethod* meth) {
+          return coldstart_classes.count(type_class(meth->get_class())) > 0;
+        },
+        [&](ClassSet& refs, DexMethod* meth, IRCode& code) {
+          auto base_cls = type_class(meth->get_class());
+          for (auto& mie : InstructionIterable(code)) {
+            auto inst = mie.insn;
+            DexClass* called_cls = nullptr;
+            if (inst->has_method()) {
+              called_cls = type_class(inst->get_method()->get_class());
+            } else if (inst->has_field()) {
+              called_cls = type_class(inst->get_field()->get_class());
+            } else if (inst->has_type()) {
+              called_cls = type_class(inst->get_type());
+            }
+            if (called_cls != nullptr && base_cls != called_cls &&
+                coldstart_classes.count(called_cls) > 0) {
+              refs.insert(called_cls);
+            }
           }
-          if (called_cls != nullptr && base_cls != called_cls &&
-              coldstart_classes.count(called_cls) > 0) {
-            cold_cold_references.insert(called_cls);
-          }
-        }
-      }
-    );
+        },
+        [](ClassSet a, ClassSet b) {
+          a.insert(b.begin(), b.end());
+          return a;
+        });
     for (const auto& cls: scope) {
       // make sure we don't drop classes which might be called from native code
       if (!can_rename(cls)) {
@@ -456,7 +743,8 @@ DexClassesVector run_interdex(InterDexPass* pass,
                               ConfigFiles& cfg,
                               bool allow_cutting_off_dex,
                               bool static_prune_classes,
-                              bool normal_primary_dex) {
+                              bool normal_primary_dex,
+                              bool minimize_cross_dex_refs) {
 
   global_dmeth_cnt = 0;
   global_smeth_cnt = 0;
@@ -469,7 +757,8 @@ DexClassesVector run_interdex(InterDexPass* pass,
   cls_skipped_in_secondary = 0;
 
   auto interdexorder = cfg.get_coldstart_classes();
-  dex_emit_tracker det;
+  RefsIndex refs;
+  dex_emit_tracker det(refs);
   for (auto const& dex : dexen) {
     for (auto const& clazz : dex) {
       std::string clzname(clazz->get_type()->get_name()->c_str());
@@ -478,6 +767,7 @@ DexClassesVector run_interdex(InterDexPass* pass,
   }
 
   auto scope = build_class_scope(dexen);
+  refs.add_classes(scope);
 
   auto unreferenced_classes = find_unrefenced_coldstart_classes(
       scope,
@@ -492,7 +782,7 @@ DexClassesVector run_interdex(InterDexPass* pass,
   if (!normal_primary_dex) {
     // build a separate lookup table for the primary dex, since we have to make
     // sure we keep all classes in the same dex
-    dex_emit_tracker primary_det;
+    dex_emit_tracker primary_det(refs);
     auto const& primary_dex = dexen[0];
     for (auto const& clazz : primary_dex) {
       std::string clzname(clazz->get_type()->get_name()->c_str());
@@ -577,8 +867,12 @@ DexClassesVector run_interdex(InterDexPass* pass,
   }
 
   // Now emit the classes that weren't specified in the head or primary list.
-  for (auto clazz : scope) {
-    emit_class(pass, det, outdex, clazz);
+  if (minimize_cross_dex_refs) {
+    emit_clustered_classes(pass, det, outdex, scope);
+  } else {
+    for (auto clazz : scope) {
+      emit_class(pass, det, outdex, clazz);
+    }
   }
   for (const auto& plugin : pass->m_plugins) {
     auto add_classes = plugin->leftover_classes();
@@ -634,8 +928,13 @@ void InterDexPass::run_pass(DexClassesVector& dexen,
   }
   emit_canaries = m_emit_canaries;
   linear_alloc_limit = m_linear_alloc_limit;
-  dexen = run_interdex(
-      this, dexen, cfg, true, m_static_prune, m_normal_primary_dex);
+  dexen = run_interdex(this,
+                       dexen,
+                       cfg,
+                       true,
+                       m_static_prune,
+                       m_normal_primary_dex,
+                       m_minimize_cross_dex_refs);
   for (const auto& plugin : m_plugins) {
     plugin->cleanup(original_scope);
   }
@@ -66,6 +66,7 @@ class InterDexPass : public Pass {
     pc.get("emit_canaries", true, m_emit_canaries);
     pc.get("normal_primary_dex", false, m_normal_primary_dex);
     pc.get("linear_alloc_limit", 11600 * 1024, m_linear_alloc_limit);
+    pc.get("minimize_cross_dex_refs", false, m_minimize_cross_dex_refs);
   }
 
   virtual void run_pass(DexClassesVector&, Scope&, ConfigFiles&, PassManager&);
@@ -78,4 +79,5 @@ class InterDexPass : public Pass {
   bool m_emit_canaries;
   bool m_normal_primary_dex;
   int64_t m_linear_alloc_limit;
+  bool m_minimize_cross_dex_refs;
 };
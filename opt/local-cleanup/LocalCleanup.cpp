@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "LocalCleanup.h"
+
+#include <memory>
+
+#include "DexClass.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "RemoveGotos.h"
+#include "Walkers.h"
+
+namespace {
+
+constexpr const char* METRIC_GOTO_REMOVED = "num_goto_removed";
+constexpr const char* METRIC_DEAD_INSTRUCTIONS = "num_dead_instructions";
+constexpr const char* METRIC_UNREACHABLE_INSTRUCTIONS =
+    "num_unreachable_instructions";
+
+} // namespace
+
+LocalCleanupPass::Stats LocalCleanupPass::run(DexMethod* method,
+                                              LocalDce* dce) {
+  Stats stats;
+  stats.gotos_removed = RemoveGotosPass::run(method);
+  if (dce == nullptr) {
+    return stats;
+  }
+  // Removing dead code may leave blocks to merge, and merging blocks may
+  // leave unreachable code behind.
+  while (true) {
+    auto before = dce->get_stats();
+    dce->dce(method);
+    auto after = dce->get_stats();
+    auto dead = after.dead_instruction_count - before.dead_instruction_count;
+    auto unreachable = after.unreachable_instruction_count -
+                       before.unreachable_instruction_count;
+    stats.dce.dead_instruction_count += dead;
+    stats.dce.unreachable_instruction_count += unreachable;
+    if (dead == 0 && unreachable == 0) {
+      break;
+    }
+    auto gotos_removed = RemoveGotosPass::run(method);
+    if (gotos_removed == 0) {
+      break;
+    }
+    stats.gotos_removed += gotos_removed;
+  }
+  return stats;
+}
+
+void LocalCleanupPass::run_pass(DexStoresVector& stores,
+                                ConfigFiles& /* unused */,
+                                PassManager& mgr) {
+  bool run_dce = !mgr.no_proguard_rules();
+  if (!run_dce) {
+    TRACE(DCE, 1,
+          "LocalCleanupPass only removes gotos because no ProGuard "
+          "configuration was provided.\n");
+  }
+  auto scope = build_class_scope(stores);
+  // One LocalDce per thread, as building one resolves its pure methods.
+  using Data = std::shared_ptr<LocalDce>;
+  auto stats = walk::parallel::reduce_methods<Data, Stats>(
+      scope,
+      [](Data& dce, DexMethod* m) {
+        if (m->get_code() == nullptr) {
+          return Stats();
+        }
+        return run(m, dce.get());
+      },
+      [](Stats a, Stats b) {
+        a.gotos_removed += b.gotos_removed;
+        a.dce.dead_instruction_count += b.dce.dead_instruction_count;
+        a.dce.unreachable_instruction_count +=
+            b.dce.unreachable_instruction_count;
+        return a;
+      },
+      [run_dce](int) {
+        return run_dce ? std::make_shared<LocalDce>() : nullptr;
+      });
+  mgr.incr_metric(METRIC_GOTO_REMOVED, stats.gotos_removed);
+  mgr.incr_metric(METRIC_DEAD_INSTRUCTIONS, stats.dce.dead_instruction_count);
+  mgr.incr_metric(METRIC_UNREACHABLE_INSTRUCTIONS,
+                  stats.dce.unreachable_instruction_count);
+}
+
+static LocalCleanupPass s_pass;
@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include "LocalDce.h"
+#include "Pass.h"
+
+/*
+ * Runs RemoveGotosPass and LocalDcePass together on each method, alternating
+ * them until neither finds anything more to do, in place of running them
+ * back to back. Each of them leaves the code's CFG built and up to date when
+ * it has nothing to change, so the other reuses it instead of building its
+ * own, and a method takes a single walk over the scope rather than one per
+ * pass. Like LocalDcePass, the dead code elimination is skipped when there
+ * are no ProGuard rules.
+ */
+class LocalCleanupPass : public Pass {
+ public:
+  LocalCleanupPass() : Pass("LocalCleanupPass") {}
+
+  struct Stats {
+    size_t gotos_removed{0};
+    LocalDce::Stats dce;
+  };
+
+  /*
+   * Cleans up the method with `dce`, or only removes its gotos if `dce` is
+   * null. Returns what was removed.
+   */
+  static Stats run(DexMethod* method, LocalDce* dce);
+
+  virtual void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  virtual bool is_method_local() const override { return true; }
+};
@@ -121,6 +121,7 @@ void remove_empty_try_regions(IRCode* code) {
         try_start->type = MFLOW_FALLTHROUGH;
         try_start = nullptr;
         mie.type = MFLOW_FALLTHROUGH;
+        code->mark_modified();
       }
     } else if (mie.type == MFLOW_OPCODE) {
       auto op = mie.insn->opcode();
@@ -165,7 +166,7 @@ void LocalDce::dce(DexMethod* method) {
   auto code = method->get_code();
   code->build_cfg();
   auto& cfg = code->cfg();
-  auto blocks = postorder_sort(cfg.blocks());
+  const auto& blocks = cfg.postorder();
   auto regs = method->get_code()->get_registers_size();
   std::vector<boost::dynamic_bitset<>> liveness(
       cfg.blocks().size(), boost::dynamic_bitset<>(regs + 1));
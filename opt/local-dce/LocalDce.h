@@ -78,4 +78,6 @@ class LocalDcePass : public Pass {
   static void run(DexMethod* method);
 
   virtual void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  virtual bool is_method_local() const override { return true; }
 };
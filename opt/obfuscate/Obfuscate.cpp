@@ -9,7 +9,9 @@
 
 #include <list>
 
+#include "Analyses.h"
 #include "ClassHierarchy.h"
+#include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRCode.h"
@@ -21,6 +23,7 @@
 #include "Trace.h"
 #include "VirtualRenamer.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -76,25 +79,19 @@ void debug_logging(std::vector<DexClass*>& classes) {
 
 template<typename DexMember, typename DexMemberRef, typename DexMemberSpec, typename K>
 DexMember* find_renamable_ref(DexMemberRef* ref,
-    std::unordered_map<DexMemberRef*, DexMember*>& ref_def_cache,
+    ConcurrentMap<DexMemberRef*, DexMember*>& ref_def_cache,
     DexElemManager<DexMember*, DexMemberRef*, DexMemberSpec, K>& name_mapping) {
   TRACE(OBFUSCATE, 4, "Found a ref opcode\n");
-  DexMember* def = nullptr;
-  auto member_itr = ref_def_cache.find(ref);
-  if (member_itr != ref_def_cache.end()) {
-    def = member_itr->second;
-  } else {
-    def = name_mapping.def_of_ref(ref);
-  }
-  ref_def_cache[ref] = def;
-  return def;
+  return ref_def_cache.get_or_insert(ref, [&]() {
+    return std::make_pair(ref, name_mapping.def_of_ref(ref));
+  });
 }
 
 void update_refs(Scope& scope, DexFieldManager& field_name_mapping,
     DexMethodManager& method_name_mapping) {
-  std::unordered_map<DexFieldRef*, DexField*> f_ref_def_cache;
-  std::unordered_map<DexMethodRef*, DexMethod*> m_ref_def_cache;
-  walk::opcodes(scope,
+  ConcurrentMap<DexFieldRef*, DexField*> f_ref_def_cache;
+  ConcurrentMap<DexMethodRef*, DexMethod*> m_ref_def_cache;
+  walk::parallel::opcodes(scope,
     [](DexMethod*) { return true; },
     [&](DexMethod*, IRInstruction* instr) {
       if (instr->has_field()) {
@@ -129,109 +126,176 @@ void get_totals(Scope& scope, RenameStats& stats) {
   }
 }
 
-} // end namespace
-
-void obfuscate(Scope& scope, RenameStats& stats) {
-  get_totals(scope, stats);
-  ClassHierarchy ch = build_type_hierarchy(scope);
+/*
+ * Picks the new names of the fields and direct methods of a class. This only
+ * looks at the wrappers of the class itself, its superclasses and its
+ * subclasses.
+ */
+void rename_members(DexClass* cls,
+                    DexFieldManager& field_name_manager,
+                    DexMethodManager& method_name_manager,
+                    const ClassHierarchy& ch) {
+  always_assert_log(!cls->is_external(),
+      "Shouldn't rename members of external classes. %s", SHOW(cls));
+  // Checks to short-circuit expensive name-gathering logic (code is still
+  // correct w/o this, but does unnecessary work)
+  bool operate_on_ifields =
+      contains_renamable_elem(cls->get_ifields(), field_name_manager);
+  bool operate_on_sfields =
+      contains_renamable_elem(cls->get_sfields(), field_name_manager);
+  bool operate_on_dmethods =
+      contains_renamable_elem(cls->get_dmethods(), method_name_manager);
+  if (operate_on_ifields || operate_on_sfields) {
+    FieldObfuscationState f_ob_state;
+    SimpleNameGenerator<DexField*> simple_name_generator(
+        f_ob_state.ids_to_avoid, f_ob_state.used_ids);
+    StaticFieldNameGenerator static_name_generator(
+        f_ob_state.ids_to_avoid, f_ob_state.used_ids);
+
+    TRACE(OBFUSCATE, 3, "Renaming the fields of class %s\n",
+        SHOW(cls->get_name()));
+
+    f_ob_state.populate_ids_to_avoid(cls, field_name_manager, true, ch);
+
+    // Keep this for all public ids in the class (they shouldn't conflict)
+    if (operate_on_ifields) {
+      obfuscate_elems(
+          FieldRenamingContext(cls->get_ifields(),
+              f_ob_state.ids_to_avoid,
+              simple_name_generator, false),
+          field_name_manager);
+    }
+    if (operate_on_sfields) {
+      obfuscate_elems(
+          FieldRenamingContext(cls->get_sfields(),
+              f_ob_state.ids_to_avoid,
+              static_name_generator, false),
+          field_name_manager);
+    }
 
-  DexFieldManager field_name_manager(new_dex_field_manager());
-  DexMethodManager method_name_manager = new_dex_method_manager();
+    // Obfu private fields
+    f_ob_state.populate_ids_to_avoid(cls, field_name_manager, false, ch);
 
-  for (DexClass* cls : scope) {
-    always_assert_log(!cls->is_external(),
-        "Shouldn't rename members of external classes. %s", SHOW(cls));
-    // Checks to short-circuit expensive name-gathering logic (code is still
-    // correct w/o this, but does unnecessary work)
-    bool operate_on_ifields =
-        contains_renamable_elem(cls->get_ifields(), field_name_manager);
-    bool operate_on_sfields =
-        contains_renamable_elem(cls->get_sfields(), field_name_manager);
-    bool operate_on_dmethods =
-        contains_renamable_elem(cls->get_dmethods(), method_name_manager);
-    if (operate_on_ifields || operate_on_sfields) {
-      FieldObfuscationState f_ob_state;
-      SimpleNameGenerator<DexField*> simple_name_generator(
-          f_ob_state.ids_to_avoid, f_ob_state.used_ids);
-      StaticFieldNameGenerator static_name_generator(
-          f_ob_state.ids_to_avoid, f_ob_state.used_ids);
-
-      TRACE(OBFUSCATE, 3, "Renaming the fields of class %s\n",
-          SHOW(cls->get_name()));
-
-      f_ob_state.populate_ids_to_avoid(cls, field_name_manager, true, ch);
-
-      // Keep this for all public ids in the class (they shouldn't conflict)
-      if (operate_on_ifields) {
-        obfuscate_elems(
-            FieldRenamingContext(cls->get_ifields(),
-                f_ob_state.ids_to_avoid,
-                simple_name_generator, false),
-            field_name_manager);
-      }
-      if (operate_on_sfields) {
-        obfuscate_elems(
-            FieldRenamingContext(cls->get_sfields(),
-                f_ob_state.ids_to_avoid,
-                static_name_generator, false),
-            field_name_manager);
-      }
+    // Keep this for all public ids in the class (they shouldn't conflict)
+    if (operate_on_ifields) {
+      obfuscate_elems(
+          FieldRenamingContext(cls->get_ifields(),
+          f_ob_state.ids_to_avoid,
+          simple_name_generator, true),
+      field_name_manager);
+    }
+    if (operate_on_sfields) {
+      obfuscate_elems(
+          FieldRenamingContext(cls->get_sfields(),
+              f_ob_state.ids_to_avoid,
+              static_name_generator, true),
+          field_name_manager);
+    }
 
-      // Obfu private fields
-      f_ob_state.populate_ids_to_avoid(cls, field_name_manager, false, ch);
+    // Make sure to bind the new names otherwise not all generators will
+    // assign names to the members
+    static_name_generator.bind_names();
+  }
 
-      // Keep this for all public ids in the class (they shouldn't conflict)
-      if (operate_on_ifields) {
-        obfuscate_elems(
-            FieldRenamingContext(cls->get_ifields(),
-            f_ob_state.ids_to_avoid,
-            simple_name_generator, true),
-        field_name_manager);
-      }
-      if (operate_on_sfields) {
-        obfuscate_elems(
-            FieldRenamingContext(cls->get_sfields(),
-                f_ob_state.ids_to_avoid,
-                static_name_generator, true),
-            field_name_manager);
-      }
+  // =========== Obfuscate Methods Below ==========
+  if (operate_on_dmethods) {
+    MethodObfuscationState m_ob_state;
+    MethodNameGenerator simple_name_gen(m_ob_state.ids_to_avoid,
+        m_ob_state.used_ids);
+
+    TRACE(OBFUSCATE, 3, "Renaming the methods of class %s\n",
+              SHOW(cls->get_name()));
+    m_ob_state.populate_ids_to_avoid(cls, method_name_manager, true, ch);
+
+    // Keep this for all public ids in the class (they shouldn't conflict)
+    obfuscate_elems(
+        MethodRenamingContext(cls->get_dmethods(),
+            m_ob_state.ids_to_avoid,
+            simple_name_gen,
+            method_name_manager,
+            false),
+        method_name_manager);
+
+    // Obfu private methods
+    m_ob_state.populate_ids_to_avoid(cls, method_name_manager, false, ch);
+
+    obfuscate_elems(
+        MethodRenamingContext(cls->get_dmethods(),
+            m_ob_state.ids_to_avoid,
+            simple_name_gen,
+            method_name_manager,
+            true),
+        method_name_manager);
+  }
+}
 
-      // Make sure to bind the new names otherwise not all generators will
-      // assign names to the members
-      static_name_generator.bind_names();
+/*
+ * Creates the wrappers of all the members rename_members() is going to look
+ * at, so that the managers have no more entries to add by the time the
+ * classes are processed in parallel.
+ */
+void prepare_wrappers(const Scope& scope,
+                      DexFieldManager& field_name_manager,
+                      DexMethodManager& method_name_manager) {
+  std::unordered_set<const DexClass*> visited;
+  for (DexClass* cls : scope) {
+    for (auto clazz = cls; clazz != nullptr && visited.insert(clazz).second;
+         clazz = clazz->get_super_class() == nullptr
+                     ? nullptr
+                     : type_class(clazz->get_super_class())) {
+      for (auto f : clazz->get_ifields()) field_name_manager[f];
+      for (auto f : clazz->get_sfields()) field_name_manager[f];
+      for (auto m : clazz->get_dmethods()) method_name_manager[m];
+      for (auto m : clazz->get_vmethods()) method_name_manager[m];
     }
+  }
+}
 
-    // =========== Obfuscate Methods Below ==========
-    if (operate_on_dmethods) {
-      MethodObfuscationState m_ob_state;
-      MethodNameGenerator simple_name_gen(m_ob_state.ids_to_avoid,
-          m_ob_state.used_ids);
+/*
+ * Groups the classes by the root of their hierarchy within the scope, keeping
+ * the scope order within each group. Names are only ever compared along
+ * superclass and subclass edges, so different groups can be renamed
+ * independently of each other.
+ */
+std::vector<std::vector<DexClass*>> partition_by_hierarchy(const Scope& scope) {
+  std::unordered_map<const DexClass*, size_t> root_index;
+  std::vector<std::vector<DexClass*>> hierarchies;
+  for (DexClass* cls : scope) {
+    const DexClass* root = cls;
+    while (root->get_super_class() != nullptr) {
+      auto super = type_class(root->get_super_class());
+      if (super == nullptr || super->is_external()) break;
+      root = super;
+    }
+    auto it = root_index.emplace(root, hierarchies.size()).first;
+    if (it->second == hierarchies.size()) {
+      hierarchies.emplace_back();
+    }
+    hierarchies[it->second].push_back(cls);
+  }
+  return hierarchies;
+}
 
-      TRACE(OBFUSCATE, 3, "Renaming the methods of class %s\n",
-                SHOW(cls->get_name()));
-      m_ob_state.populate_ids_to_avoid(cls, method_name_manager, true, ch);
+} // end namespace
 
-      // Keep this for all public ids in the class (they shouldn't conflict)
-      obfuscate_elems(
-          MethodRenamingContext(cls->get_dmethods(),
-              m_ob_state.ids_to_avoid,
-              simple_name_gen,
-              method_name_manager,
-              false),
-          method_name_manager);
+void obfuscate(Scope& scope, const ClassHierarchy& ch, RenameStats& stats) {
+  get_totals(scope, stats);
 
-      // Obfu private methods
-      m_ob_state.populate_ids_to_avoid(cls, method_name_manager, false, ch);
+  DexFieldManager field_name_manager(new_dex_field_manager());
+  DexMethodManager method_name_manager = new_dex_method_manager();
 
-      obfuscate_elems(
-          MethodRenamingContext(cls->get_dmethods(),
-              m_ob_state.ids_to_avoid,
-              simple_name_gen,
-              method_name_manager,
-              true),
-          method_name_manager);
+  prepare_wrappers(scope, field_name_manager, method_name_manager);
+  auto hierarchies = partition_by_hierarchy(scope);
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    for (DexClass* cls : hierarchies[i]) {
+      rename_members(cls, field_name_manager, method_name_manager, ch);
     }
+  });
+  for (size_t i = 0; i < hierarchies.size(); ++i) {
+    wq.add_item(i);
   }
+  wq.run_all();
+
   field_name_manager.print_elements();
   method_name_manager.print_elements();
 
@@ -274,7 +338,8 @@ void ObfuscatePass::run_pass(DexStoresVector& stores,
   }
   auto scope = build_class_scope(stores);
   RenameStats stats;
-  obfuscate(scope, stats);
+  obfuscate(
+      scope, mgr.analyses().get<ClassHierarchyAnalysis>(stores), stats);
   mgr.incr_metric(
       METRIC_FIELD_TOTAL, static_cast<int>(stats.fields_total));
   mgr.incr_metric(
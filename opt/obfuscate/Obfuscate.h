@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include "ClassHierarchy.h"
 #include "PassManager.h"
 
 class ObfuscatePass : public Pass {
@@ -27,4 +28,4 @@ struct RenameStats {
   size_t vmethods_renamed = 0;
 };
 
-void obfuscate(Scope& classes, RenameStats& stats);
+void obfuscate(Scope& classes, const ClassHierarchy& ch, RenameStats& stats);
@@ -13,6 +13,61 @@
 #include "Walkers.h"
 #include "DexClass.h"
 
+namespace {
+
+char ident_char(obfuscated_id_t digit) {
+  return digit < 26 ? 'A' + digit : 'a' + (digit - 26);
+}
+
+std::string spell_obfuscated_id(obfuscated_id_t id) {
+  std::string name;
+  while (id > 0) {
+    name += ident_char(id % kMaxIdentChar);
+    id /= kMaxIdentChar;
+  }
+  return name;
+}
+
+// The names of all the ids of up to two characters, by id.
+const std::vector<std::string>& short_obfuscated_names() {
+  static const std::vector<std::string> names = [] {
+    std::vector<std::string> names;
+    names.reserve(kMaxIdentChar * kMaxIdentChar);
+    for (obfuscated_id_t id = 0; id < kMaxIdentChar * kMaxIdentChar; ++id) {
+      names.emplace_back(spell_obfuscated_id(id));
+    }
+    return names;
+  }();
+  return names;
+}
+
+} // namespace
+
+std::string obfuscated_name(obfuscated_id_t id) {
+  const auto& names = short_obfuscated_names();
+  return id < names.size() ? names[id] : spell_obfuscated_id(id);
+}
+
+boost::optional<obfuscated_id_t> obfuscated_id(const char* name, size_t len) {
+  if (len == 0 || len > kMaxObfuscatedNameLength || name[len - 1] == 'A') {
+    return boost::none;
+  }
+  obfuscated_id_t id = 0;
+  for (size_t i = len; i-- > 0;) {
+    char c = name[i];
+    obfuscated_id_t digit;
+    if (c >= 'A' && c <= 'Z') {
+      digit = c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+      digit = 26 + (c - 'a');
+    } else {
+      return boost::none;
+    }
+    id = id * kMaxIdentChar + digit;
+  }
+  return id;
+}
+
 DexFieldManager new_dex_field_manager() {
   return DexFieldManager(
       [](DexField*& f) -> FieldNameWrapper* { return new FieldNameWrapper(f); },
@@ -14,10 +14,52 @@
 #include "DexAccess.h"
 #include "ReachableClasses.h"
 #include "ClassHierarchy.h"
+#include <boost/optional.hpp>
+#include <cstring>
 #include <list>
 
 constexpr int kMaxIdentChar (52);
 
+/*
+ * The generated names spell their id in base kMaxIdentChar, least significant
+ * digit first, with the digits A-Z then a-z. Ids start at 1, so no name ends
+ * with an A.
+ */
+using obfuscated_id_t = uint32_t;
+
+// Names longer than this would take more ids than any app has members.
+constexpr size_t kMaxObfuscatedNameLength = 5;
+
+// The name of an id. The names of up to two characters come from a table.
+std::string obfuscated_name(obfuscated_id_t id);
+
+// The id whose name this is, if the generators could have made it up.
+boost::optional<obfuscated_id_t> obfuscated_id(const char* name, size_t len);
+
+/*
+ * A set of names, kept as the ids that spell them, for the generators to
+ * check their candidates against without making a string of each. Names that
+ * no id spells can't collide with a generated one, so they're left out.
+ */
+class ObfuscatedIdSet {
+ public:
+  void insert(const char* name) { insert(name, strlen(name)); }
+  void insert(const std::string& name) { insert(name.c_str(), name.size()); }
+  void insert_id(obfuscated_id_t id) { m_ids.insert(id); }
+  bool contains_id(obfuscated_id_t id) const { return m_ids.count(id) != 0; }
+  size_t size() const { return m_ids.size(); }
+
+ private:
+  void insert(const char* name, size_t len) {
+    auto id = obfuscated_id(name, len);
+    if (id) {
+      m_ids.insert(*id);
+    }
+  }
+
+  std::unordered_set<obfuscated_id_t> m_ids;
+};
+
 // Type for the map of descriptor -> [newname -> oldname]
 // This map is used for reverse lookup to find naming collisions
 typedef std::unordered_map<std::string,
@@ -239,42 +281,26 @@ public:
 template <class T>
 class NameGenerator {
 protected:
-  int ctr{1};
-  inline char get_ident(int num) {
-    if (num < 26) {
-      return 'A' + num;
-    } else {//if (num >= 26 && num < 52){
-      return 'a' + num - 26;
-    }
-  }
+  obfuscated_id_t ctr{1};
 
   // Set of ids to avoid (these ids were marked as do not rename and we cannot
   // conflict with)
-  const std::unordered_set<std::string>& ids_to_avoid;
+  const ObfuscatedIdSet& ids_to_avoid;
   // Set of ids we used while assigning names
-  std::unordered_set<std::string>& used_ids;
-  // Gets the next name that is not in the used_ids set
-  std::string next_name() {
-    std::string res = "";
-    int max_ident = 26 + 26;
-    do {
-      int ctr_cpy = ctr;
-      res.clear();
-      while (ctr_cpy > 0) {
-        res += get_ident(ctr_cpy % max_ident);
-        ctr_cpy /= max_ident;
-        max_ident = kMaxIdentChar;
-      }
-      ctr += 1;
-      TRACE(OBFUSCATE, 4, "NameGenerator looking for a name, trying: %s\n",
-          res.c_str());
-    } while (ids_to_avoid.count(res) > 0 || used_ids.count(res) > 0);
-    return res;
+  ObfuscatedIdSet& used_ids;
+  // Gets the next id that is in neither set. The candidates are only counted
+  // up, not spelled out, until one is free.
+  obfuscated_id_t next_id() {
+    while (ids_to_avoid.contains_id(ctr) || used_ids.contains_id(ctr)) {
+      TRACE(OBFUSCATE, 4, "NameGenerator skipping id %u\n", ctr);
+      ++ctr;
+    }
+    return ctr++;
   }
 
 public:
-  NameGenerator(const std::unordered_set<std::string>& ids_to_avoid,
-      std::unordered_set<std::string>& used_ids) :
+  NameGenerator(const ObfuscatedIdSet& ids_to_avoid,
+      ObfuscatedIdSet& used_ids) :
       ids_to_avoid(ids_to_avoid), used_ids(used_ids) {}
   virtual ~NameGenerator() = default;
 
@@ -297,15 +323,16 @@ public:
 template <class T>
 class SimpleNameGenerator : public NameGenerator<T> {
 public:
-  SimpleNameGenerator(const std::unordered_set<std::string>& ids_to_avoid,
-      std::unordered_set<std::string>& used_ids) :
+  SimpleNameGenerator(const ObfuscatedIdSet& ids_to_avoid,
+      ObfuscatedIdSet& used_ids) :
     NameGenerator<T>(ids_to_avoid, used_ids) {}
 
   void find_new_name(DexNameWrapper<T>* wrap) override {
     if (wrap->is_modified()) return;
-    std::string new_name(this->next_name());
+    auto id = this->next_id();
+    std::string new_name(obfuscated_name(id));
     wrap->set_name(new_name);
-    this->used_ids.insert(new_name);
+    this->used_ids.insert_id(id);
     T elem = wrap->get();
     TRACE(OBFUSCATE,
           2,
@@ -317,28 +344,36 @@ public:
   }
 
   static SimpleNameGenerator<T>* new_name_gen(
-      const std::unordered_set<std::string>& ids_to_avoid,
-      std::unordered_set<std::string>& used_ids) {
+      const ObfuscatedIdSet& ids_to_avoid,
+      ObfuscatedIdSet& used_ids) {
     return new SimpleNameGenerator<T>(ids_to_avoid, used_ids);
   }
 };
 
 class MethodNameGenerator : public SimpleNameGenerator<DexMethod*> {
 public:
-  MethodNameGenerator(const std::unordered_set<std::string>& ids_to_avoid,
-      std::unordered_set<std::string>& used_ids) :
+  MethodNameGenerator(const ObfuscatedIdSet& ids_to_avoid,
+      ObfuscatedIdSet& used_ids) :
     SimpleNameGenerator<DexMethod*>(ids_to_avoid, used_ids) { }
 
   void find_new_name(DexMethodWrapper* wrap) override {
     if (wrap->is_modified()) return;
-    do {
-      std::string new_name(this->next_name());
-      wrap->set_name(new_name);
-      this->used_ids.insert(new_name);
-    } while (DexMethod::get_method(
-        wrap->get()->get_class(),
-        DexString::make_string(wrap->get_name()),
-        wrap->get()->get_proto()) != nullptr);
+    while (true) {
+      auto id = this->next_id();
+      this->used_ids.insert_id(id);
+      std::string new_name(obfuscated_name(id));
+      // A name that isn't interned yet can't be the name of a method, so
+      // there's no need to intern the candidates.
+      auto name = DexString::get_string(new_name.c_str(), new_name.size());
+      bool taken = name != nullptr &&
+                   DexMethod::get_method(wrap->get()->get_class(),
+                                         name,
+                                         wrap->get()->get_proto()) != nullptr;
+      if (!taken) {
+        wrap->set_name(new_name);
+        break;
+      }
+    }
     TRACE(OBFUSCATE,
           2,
           "\tIntending to rename method %s (%s) to %s ids to avoid %d\n",
@@ -360,8 +395,8 @@ class StaticFieldNameGenerator : public NameGenerator<DexField*> {
   std::map<DexField*, DexFieldWrapper*, dexfields_comparator>
       static_final_null_fields;
  public:
-  StaticFieldNameGenerator(const std::unordered_set<std::string>& ids_to_avoid,
-      std::unordered_set<std::string>& used_ids) :
+  StaticFieldNameGenerator(const ObfuscatedIdSet& ids_to_avoid,
+      ObfuscatedIdSet& used_ids) :
     NameGenerator(ids_to_avoid, used_ids) {}
 
   void find_new_name(DexFieldWrapper* wrap) override {
@@ -376,17 +411,17 @@ class StaticFieldNameGenerator : public NameGenerator<DexField*> {
   void bind_names() override {
     // Otherwise we have to make sure that all the names are assigned in order
     // such that the static final null fields are at the end
-    std::vector<std::string> names;
+    std::vector<obfuscated_id_t> ids;
     for (unsigned int i = 0;
         i < fields.size() + static_final_null_fields.size(); ++i)
-      names.emplace_back(this->next_name());
+      ids.emplace_back(this->next_id());
     TRACE(OBFUSCATE, 3, "Static Generator\n");
     unsigned int i = 0;
     for (auto& pair : fields) {
       DexFieldWrapper* wrap = pair.second;
-      const std::string& new_name(names[i++]);
+      std::string new_name(obfuscated_name(ids[i]));
       wrap->set_name(new_name);
-      this->used_ids.insert(new_name);
+      this->used_ids.insert_id(ids[i++]);
       DexField* field = wrap->get();
       TRACE(OBFUSCATE, 3, "\tIntending to rename field (%s) %s:%s to %s\n",
           SHOW(field->get_type()), SHOW(field->get_class()),
@@ -394,9 +429,9 @@ class StaticFieldNameGenerator : public NameGenerator<DexField*> {
     }
     for (auto& pair : static_final_null_fields) {
       DexFieldWrapper* wrap = pair.second;
-      const std::string& new_name(names[i++]);
+      std::string new_name(obfuscated_name(ids[i]));
       wrap->set_name(new_name);
-      this->used_ids.insert(new_name);
+      this->used_ids.insert_id(ids[i++]);
       DexField* field = wrap->get();
       TRACE(OBFUSCATE, 3,
           "\tIntending to rename static null field (%s) %s:%s to %s\n",
@@ -447,11 +482,22 @@ public:
   //void lock_elements() { mark_all_unrenamable = true; }
   //void unlock_elements() { mark_all_unrenamable = false; }
 
+  // Lookups never insert, so once every wrapper that will be needed exists
+  // they can run concurrently with each other.
+  inline DexNameWrapper<T>* find_elem(
+      DexType* cls, K sig, DexString* name) const {
+    auto cls_itr = elements.find(cls);
+    if (cls_itr == elements.end()) return nullptr;
+    auto sig_itr = cls_itr->second.find(sig);
+    if (sig_itr == cls_itr->second.end()) return nullptr;
+    auto name_itr = sig_itr->second.find(name);
+    if (name_itr == sig_itr->second.end()) return nullptr;
+    return name_itr->second.get();
+  }
+
   inline bool contains_elem(
-      DexType* cls, K sig, DexString* name) {
-    return elements.count(cls) > 0 &&
-      elements[cls].count(sig) > 0 &&
-      elements[cls][sig].count(name) > 0;
+      DexType* cls, K sig, DexString* name) const {
+    return find_elem(cls, sig, name) != nullptr;
   }
 
   inline bool contains_elem(R elem) {
@@ -472,9 +518,9 @@ public:
   // Mirrors the map get operator, but ensures we create correct wrappers
   // if they don't exist
   inline DexNameWrapper<T>* operator[](T elem) {
-    return contains_elem(elem) ?
-      elements[elem->get_class()]
-        [sig_getter_fn(elem)][elem->get_name()].get() : emplace(elem);
+    auto wrap =
+        find_elem(elem->get_class(), sig_getter_fn(elem), elem->get_name());
+    return wrap != nullptr ? wrap : emplace(elem);
   }
 
   // Commits all the renamings in elements to the dex by modifying the
@@ -519,12 +565,10 @@ private:
   // Returns the def for that class and ref if it exists, nullptr otherwise
   T find_def(R ref, DexType* cls) {
     if (cls == nullptr) return nullptr;
-    if (contains_elem(cls, sig_getter_fn(ref), ref->get_name())) {
-      DexNameWrapper<T>* wrap =
-        elements[cls][sig_getter_fn(ref)][ref->get_name()].get();
-      if (wrap->is_modified())
-        return wrap->get();
-    }
+    DexNameWrapper<T>* wrap =
+        find_elem(cls, sig_getter_fn(ref), ref->get_name());
+    if (wrap != nullptr && wrap->is_modified())
+      return wrap->get();
     return nullptr;
   }
 
@@ -600,12 +644,12 @@ template <class T>
 class RenamingContext {
 public:
   const std::vector<T>& elems;
-  const std::unordered_set<std::string>& ids_to_avoid;
+  const ObfuscatedIdSet& ids_to_avoid;
   const bool operate_on_privates;
   NameGenerator<T>& name_gen;
 
   RenamingContext(std::vector<T>& elems,
-                  std::unordered_set<std::string>& ids_to_avoid,
+                  ObfuscatedIdSet& ids_to_avoid,
                   NameGenerator<T>& name_gen,
                   bool operate_on_privates)
       : elems(elems),
@@ -631,7 +675,7 @@ class MethodRenamingContext : public RenamingContext<DexMethod*> {
   DexMethodManager& name_mapping;
 public:
  MethodRenamingContext(std::vector<DexMethod*>& elems,
-                       std::unordered_set<std::string>& ids_to_avoid,
+                       ObfuscatedIdSet& ids_to_avoid,
                        NameGenerator<DexMethod*>& name_gen,
                        DexMethodManager& name_mapping,
                        bool operate_on_privates)
@@ -652,9 +696,9 @@ template <class T, class R, class S, class K>
 class ObfuscationState {
 public:
   // Ids that we've used in renaming
-  std::unordered_set<std::string> used_ids;
+  ObfuscatedIdSet used_ids;
   // Ids to avoid in renaming
-  std::unordered_set<std::string> ids_to_avoid;
+  ObfuscatedIdSet ids_to_avoid;
 
   virtual ~ObfuscationState() = default;
 
@@ -742,7 +786,7 @@ public:
         [&](DexMethod* m) {
           auto wrap(name_manager[m]);
           if (wrap->name_has_changed())
-            ids_to_avoid.insert(SHOW(wrap->get()->get_name()));
+            ids_to_avoid.insert(wrap->get()->get_name()->c_str());
           ids_to_avoid.insert(wrap->get_name()); };
     walk_hierarchy(
         base, visit_member, false, HierarchyDirection::VisitSuperClasses, ch);
@@ -396,34 +396,42 @@ int VirtualRenamer::rename_virtual_scopes(
  * Collect all method refs to concrete methods (definitions).
  */
 void collect_refs(Scope& scope, RefsMap& def_refs) {
-  walk::opcodes(scope, [](DexMethod*) { return true; },
-    [&](DexMethod*, IRInstruction* insn) {
-      if (!insn->has_method()) return;
-      auto callee = insn->get_method();
-      if (callee->is_concrete()) return;
-      auto cls = type_class(callee->get_class());
-      if (cls == nullptr || cls->is_external()) return;
-      DexMethod* top = nullptr;
-      if (is_interface(cls)) {
-        top = resolve_method(callee, MethodSearch::Interface);
-      } else {
-        top = find_top_impl(cls, callee->get_name(), callee->get_proto());
-        if (top == nullptr) {
-          TRACE(OBFUSCATE, 2, "Possible top miranda: %s\n", SHOW(callee));
-          // see if it's a virtual call to an interface miranda method
-          top = find_top_intf_impl(
-              cls, callee->get_name(), callee->get_proto());
-          if (top != nullptr) {
-            TRACE(OBFUSCATE, 2, "Top miranda: %s\n", SHOW(top));
+  def_refs = walk::parallel::reduce_opcodes<RefsMap>(
+      scope,
+      [](DexMethod*) { return true; },
+      [](RefsMap& refs, DexMethod*, IRInstruction* insn) {
+        if (!insn->has_method()) return;
+        auto callee = insn->get_method();
+        if (callee->is_concrete()) return;
+        auto cls = type_class(callee->get_class());
+        if (cls == nullptr || cls->is_external()) return;
+        DexMethod* top = nullptr;
+        if (is_interface(cls)) {
+          top = resolve_method(callee, MethodSearch::Interface);
+        } else {
+          top = find_top_impl(cls, callee->get_name(), callee->get_proto());
+          if (top == nullptr) {
+            TRACE(OBFUSCATE, 2, "Possible top miranda: %s\n", SHOW(callee));
+            // see if it's a virtual call to an interface miranda method
+            top = find_top_intf_impl(
+                cls, callee->get_name(), callee->get_proto());
+            if (top != nullptr) {
+              TRACE(OBFUSCATE, 2, "Top miranda: %s\n", SHOW(top));
+            }
           }
         }
-      }
-      if (top == nullptr || top == callee) return;
-      assert(type_class(top->get_class()) != nullptr);
-      if (type_class(top->get_class())->is_external()) return;
-      // it's a top definition on an internal class, save it
-      def_refs[top].insert(callee);
-    });
+        if (top == nullptr || top == callee) return;
+        assert(type_class(top->get_class()) != nullptr);
+        if (type_class(top->get_class())->is_external()) return;
+        // it's a top definition on an internal class, save it
+        refs[top].insert(callee);
+      },
+      [](RefsMap left, RefsMap right) {
+        for (auto& pair : right) {
+          left[pair.first].insert(pair.second.begin(), pair.second.end());
+        }
+        return left;
+      });
 }
 
 }
@@ -433,7 +441,8 @@ void collect_refs(Scope& scope, RefsMap& def_refs) {
  */
 size_t rename_virtuals(Scope& classes) {
   // build a ClassScope a RefsMap and a VirtualRenamer
-  ClassScopes class_scopes(classes);
+  auto shared_class_scopes = get_class_scopes(classes);
+  const auto& class_scopes = *shared_class_scopes;
   scope_info(class_scopes);
   RefsMap def_refs;
   collect_refs(classes, def_refs);
@@ -9,7 +9,9 @@
 
 #include "DexUtil.h"
 #include "OriginalNamePass.h"
+#include "Analyses.h"
 #include "ClassHierarchy.h"
+#include "PassManager.h"
 
 #define METRIC_MISSING_ORIGINAL_NAME_ROOT "num_missing_original_name_root"
 #define METRIC_ORIGINAL_NAME_COUNT "num_original_name"
@@ -54,7 +56,7 @@ void OriginalNamePass::run_pass(DexStoresVector& stores,
                                 ConfigFiles&,
                                 PassManager& mgr) {
   auto scope = build_class_scope(stores);
-  ClassHierarchy ch = build_type_hierarchy(scope);
+  const auto& ch = mgr.analyses().get<ClassHierarchyAnalysis>(stores);
   std::unordered_map<const DexType*, std::string> to_annotate;
   build_hierarchies(mgr, ch, scope, &to_annotate);
   DexString* field_name = DexString::make_string(redex_field_name);
@@ -84,3 +86,9 @@ void OriginalNamePass::run_pass(DexStoresVector& stores,
                     1);
   }
 }
+
+void OriginalNamePass::preserved_analyses(PreservedAnalyses& preserved) const {
+  // Only static fields are added.
+  preserved.preserve<ClassHierarchyAnalysis>();
+  preserved.preserve<TypeSystemAnalysis>();
+}
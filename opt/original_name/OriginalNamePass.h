@@ -24,6 +24,8 @@ class OriginalNamePass : public Pass {
                         ConfigFiles& cfg,
                         PassManager& mgr) override;
 
+  virtual void preserved_analyses(PreservedAnalyses&) const override;
+
  private:
   void build_hierarchies(
       PassManager& mgr,
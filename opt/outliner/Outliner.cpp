@@ -222,4 +222,12 @@ void Outliner::run_pass(DexStoresVector& stores,
   if (outlined_throws.size() > 0) {
     build_dispatcher(stores, outlined_throws);
   }
+
+  if (m_outline_sequences) {
+    auto stats = outliner::outline_sequences(
+        stores[0].get_dexen(), m_outline_primary_dex ? 0 : 1, m_sequence_config);
+    mgr.incr_metric("outlined_sequences", stats.methods);
+    mgr.incr_metric("outlined_sequence_sites", stats.sites);
+    mgr.incr_metric("outlined_code_units_saved", stats.code_units_saved);
+  }
 }
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "Pass.h"
+#include "SequenceOutliner.h"
 
 class Outliner : public Pass {
  public:
@@ -20,6 +21,20 @@ class Outliner : public Pass {
     // we need to allow this to happen in some scenarios, e.g.
     // instrumentation tests, since they are single-dex affairs.
     pc.get("outline_primary_dex", false, m_outline_primary_dex);
+    // Off by default: outlined code shows up in stack traces as calls to
+    // the synthesized methods.
+    pc.get("outline_sequences", false, m_outline_sequences);
+    int64_t min_length;
+    int64_t max_length;
+    int64_t max_methods;
+    pc.get("sequence_min_length", 3, min_length);
+    pc.get("sequence_max_length", 32, max_length);
+    pc.get("sequence_max_methods_per_dex", 2048, max_methods);
+    always_assert(min_length >= 2 && max_length >= min_length);
+    always_assert(max_methods >= 0);
+    m_sequence_config.min_length = static_cast<size_t>(min_length);
+    m_sequence_config.max_length = static_cast<size_t>(max_length);
+    m_sequence_config.max_methods_per_dex = static_cast<size_t>(max_methods);
   }
 
   virtual void run_pass(DexStoresVector& stores,
@@ -28,4 +43,6 @@ class Outliner : public Pass {
 
  private:
   bool m_outline_primary_dex;
+  bool m_outline_sequences;
+  outliner::SequenceOutlinerConfig m_sequence_config;
 };
@@ -0,0 +1,993 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "SequenceOutliner.h"
+
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ControlFlow.h"
+#include "Creators.h"
+#include "DexAccess.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "Liveness.h"
+#include "Resolver.h"
+#include "Trace.h"
+#include "WorkQueue.h"
+
+namespace outliner {
+
+namespace {
+
+constexpr const char* OUTLINED_CLASS_PREFIX =
+    "Lcom/facebook/redex/OutlinedSequences";
+
+// Roughly what a method costs besides its instructions: the code item
+// header, the method id, the encoded method and the name.
+constexpr size_t kMethodOverheadBytes = 40;
+
+// Keeping the outlined code within 16 registers means every instruction can
+// still be encoded, whatever registers it gets.
+constexpr size_t kMaxRegisters = 16;
+
+// The most arguments a call can take without needing a /range invoke.
+constexpr size_t kMaxParams = 5;
+
+// Symbols at or above this mark the positions that can't be outlined. Each
+// such position gets its own symbol, so no repeat extends over it.
+constexpr uint32_t kFirstSeparator = 1u << 31;
+
+using LivenessDomain = regalloc::LivenessDomain;
+using LivenessFixpointIterator = regalloc::LivenessFixpointIterator;
+
+bool is_accessible(const DexType* type) {
+  auto elem = get_array_type_or_self(type);
+  if (is_primitive(elem)) {
+    return true;
+  }
+  auto cls = type_class(elem);
+  return cls != nullptr && is_public(cls);
+}
+
+bool is_outlinable_field(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  auto ref = insn->get_field();
+  auto field = resolve_field(
+      ref, is_sfield_op(op) ? FieldSearch::Static : FieldSearch::Instance);
+  if (field == nullptr || !is_public(field)) {
+    return false;
+  }
+  // Final fields can only be written by their own class.
+  if ((is_iput(op) || is_sput(op)) && is_final(field)) {
+    return false;
+  }
+  return is_accessible(ref->get_class()) &&
+         is_accessible(field->get_class()) && is_accessible(ref->get_type());
+}
+
+bool is_outlinable_method(IRInstruction* insn) {
+  auto op = insn->opcode();
+  if (op != OPCODE_INVOKE_STATIC && op != OPCODE_INVOKE_VIRTUAL &&
+      op != OPCODE_INVOKE_INTERFACE) {
+    return false;
+  }
+  auto ref = insn->get_method();
+  auto method = resolve_method(ref, opcode_to_search(insn));
+  if (method == nullptr || !is_public(method)) {
+    return false;
+  }
+  if (!is_accessible(ref->get_class()) ||
+      !is_accessible(method->get_class())) {
+    return false;
+  }
+  auto proto = ref->get_proto();
+  if (!is_accessible(proto->get_rtype())) {
+    return false;
+  }
+  for (auto arg : proto->get_args()->get_type_list()) {
+    if (!is_accessible(arg)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * The types of the destination and sources of an arithmetic instruction, in
+ * that order, encoded as in type descriptors. '?' marks a result whose type
+ * depends on the operands: the verifier treats bitwise operations on
+ * booleans as booleans.
+ */
+const char* arith_signature(IROpcode op) {
+  switch (op) {
+  case OPCODE_NEG_INT:
+  case OPCODE_NOT_INT:
+    return "II";
+  case OPCODE_NEG_LONG:
+  case OPCODE_NOT_LONG:
+    return "JJ";
+  case OPCODE_NEG_FLOAT:
+    return "FF";
+  case OPCODE_NEG_DOUBLE:
+    return "DD";
+  case OPCODE_INT_TO_LONG:
+    return "JI";
+  case OPCODE_INT_TO_FLOAT:
+    return "FI";
+  case OPCODE_INT_TO_DOUBLE:
+    return "DI";
+  case OPCODE_LONG_TO_INT:
+    return "IJ";
+  case OPCODE_LONG_TO_FLOAT:
+    return "FJ";
+  case OPCODE_LONG_TO_DOUBLE:
+    return "DJ";
+  case OPCODE_FLOAT_TO_INT:
+    return "IF";
+  case OPCODE_FLOAT_TO_LONG:
+    return "JF";
+  case OPCODE_FLOAT_TO_DOUBLE:
+    return "DF";
+  case OPCODE_DOUBLE_TO_INT:
+    return "ID";
+  case OPCODE_DOUBLE_TO_LONG:
+    return "JD";
+  case OPCODE_DOUBLE_TO_FLOAT:
+    return "FD";
+  case OPCODE_INT_TO_BYTE:
+    return "BI";
+  case OPCODE_INT_TO_CHAR:
+    return "CI";
+  case OPCODE_INT_TO_SHORT:
+    return "SI";
+  case OPCODE_ADD_INT:
+  case OPCODE_SUB_INT:
+  case OPCODE_MUL_INT:
+  case OPCODE_DIV_INT:
+  case OPCODE_REM_INT:
+  case OPCODE_SHL_INT:
+  case OPCODE_SHR_INT:
+  case OPCODE_USHR_INT:
+    return "III";
+  case OPCODE_AND_INT:
+  case OPCODE_OR_INT:
+  case OPCODE_XOR_INT:
+    return "?II";
+  case OPCODE_ADD_LONG:
+  case OPCODE_SUB_LONG:
+  case OPCODE_MUL_LONG:
+  case OPCODE_DIV_LONG:
+  case OPCODE_REM_LONG:
+  case OPCODE_AND_LONG:
+  case OPCODE_OR_LONG:
+  case OPCODE_XOR_LONG:
+    return "JJJ";
+  case OPCODE_SHL_LONG:
+  case OPCODE_SHR_LONG:
+  case OPCODE_USHR_LONG:
+    return "JJI";
+  case OPCODE_ADD_FLOAT:
+  case OPCODE_SUB_FLOAT:
+  case OPCODE_MUL_FLOAT:
+  case OPCODE_DIV_FLOAT:
+  case OPCODE_REM_FLOAT:
+    return "FFF";
+  case OPCODE_ADD_DOUBLE:
+  case OPCODE_SUB_DOUBLE:
+  case OPCODE_MUL_DOUBLE:
+  case OPCODE_DIV_DOUBLE:
+  case OPCODE_REM_DOUBLE:
+    return "DDD";
+  case OPCODE_CMPL_FLOAT:
+  case OPCODE_CMPG_FLOAT:
+    return "IFF";
+  case OPCODE_CMPL_DOUBLE:
+  case OPCODE_CMPG_DOUBLE:
+    return "IDD";
+  case OPCODE_CMP_LONG:
+    return "IJJ";
+  case OPCODE_ADD_INT_LIT16:
+  case OPCODE_RSUB_INT:
+  case OPCODE_MUL_INT_LIT16:
+  case OPCODE_DIV_INT_LIT16:
+  case OPCODE_REM_INT_LIT16:
+  case OPCODE_ADD_INT_LIT8:
+  case OPCODE_RSUB_INT_LIT8:
+  case OPCODE_MUL_INT_LIT8:
+  case OPCODE_DIV_INT_LIT8:
+  case OPCODE_REM_INT_LIT8:
+  case OPCODE_SHL_INT_LIT8:
+  case OPCODE_SHR_INT_LIT8:
+  case OPCODE_USHR_INT_LIT8:
+    return "II";
+  case OPCODE_AND_INT_LIT16:
+  case OPCODE_OR_INT_LIT16:
+  case OPCODE_XOR_INT_LIT16:
+  case OPCODE_AND_INT_LIT8:
+  case OPCODE_OR_INT_LIT8:
+  case OPCODE_XOR_INT_LIT8:
+    return "?I";
+  default:
+    return nullptr;
+  }
+}
+
+DexType* descriptor_type(char c) {
+  switch (c) {
+  case 'I':
+    return get_int_type();
+  case 'J':
+    return get_long_type();
+  case 'F':
+    return get_float_type();
+  case 'D':
+    return get_double_type();
+  case 'B':
+    return get_byte_type();
+  case 'C':
+    return get_char_type();
+  case 'S':
+    return get_short_type();
+  default:
+    return nullptr;
+  }
+}
+
+bool is_outlinable(IRInstruction* insn) {
+  auto op = insn->opcode();
+  if (arith_signature(op) != nullptr) {
+    return true;
+  }
+  if (is_ifield_op(op) || is_sfield_op(op)) {
+    return is_outlinable_field(insn);
+  }
+  if (is_invoke(op)) {
+    return is_outlinable_method(insn);
+  }
+  switch (op) {
+  case OPCODE_CONST:
+  case OPCODE_CONST_WIDE:
+  case OPCODE_CONST_STRING:
+  case OPCODE_MOVE_RESULT:
+  case OPCODE_MOVE_RESULT_WIDE:
+  case OPCODE_MOVE_RESULT_OBJECT:
+  case IOPCODE_MOVE_RESULT_PSEUDO:
+  case IOPCODE_MOVE_RESULT_PSEUDO_WIDE:
+  case IOPCODE_MOVE_RESULT_PSEUDO_OBJECT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// The type the instruction reads its i-th source as.
+DexType* src_type(const IRInstruction* insn, size_t i) {
+  auto op = insn->opcode();
+  if (auto sig = arith_signature(op)) {
+    return descriptor_type(sig[i + 1]);
+  }
+  if (is_iget(op)) {
+    return insn->get_field()->get_class();
+  }
+  if (is_iput(op)) {
+    return i == 0 ? insn->get_field()->get_type()
+                  : insn->get_field()->get_class();
+  }
+  if (is_sput(op)) {
+    return insn->get_field()->get_type();
+  }
+  if (is_invoke(op)) {
+    auto method = insn->get_method();
+    if (op != OPCODE_INVOKE_STATIC) {
+      if (i == 0) {
+        return method->get_class();
+      }
+      --i;
+    }
+    return method->get_proto()->get_args()->get_type_list().at(i);
+  }
+  return nullptr;
+}
+
+// The type the instruction writes to its destination, if it can be told.
+// :prev is the instruction before it, for the move-results.
+DexType* dest_type(const IRInstruction* insn, const IRInstruction* prev) {
+  auto op = insn->opcode();
+  if (auto sig = arith_signature(op)) {
+    return descriptor_type(sig[0]);
+  }
+  if (is_move_result(op)) {
+    return prev != nullptr && is_invoke(prev->opcode())
+               ? prev->get_method()->get_proto()->get_rtype()
+               : nullptr;
+  }
+  if (opcode::is_move_result_pseudo(op) && prev != nullptr) {
+    if (prev->opcode() == OPCODE_CONST_STRING) {
+      return get_string_type();
+    }
+    if (is_iget(prev->opcode()) || is_sget(prev->opcode())) {
+      return prev->get_field()->get_type();
+    }
+  }
+  return nullptr;
+}
+
+bool is_any_move_result(IROpcode op) {
+  return is_move_result(op) || opcode::is_move_result_pseudo(op);
+}
+
+/*
+ * What an instruction is, regardless of its registers.
+ */
+struct InsnKey {
+  uint16_t opcode;
+  uint16_t srcs;
+  int64_t literal;
+  const void* ref;
+
+  bool operator==(const InsnKey& other) const {
+    return opcode == other.opcode && srcs == other.srcs &&
+           literal == other.literal && ref == other.ref;
+  }
+};
+
+struct InsnKeyHash {
+  size_t operator()(const InsnKey& key) const {
+    size_t seed = 0;
+    boost::hash_combine(seed, key.opcode);
+    boost::hash_combine(seed, key.srcs);
+    boost::hash_combine(seed, key.literal);
+    boost::hash_combine(seed, key.ref);
+    return seed;
+  }
+};
+
+InsnKey make_key(const IRInstruction* insn) {
+  InsnKey key{static_cast<uint16_t>(insn->opcode()),
+              static_cast<uint16_t>(insn->srcs_size()), 0, nullptr};
+  if (insn->has_literal()) {
+    key.literal = insn->get_literal();
+  }
+  if (insn->has_string()) {
+    key.ref = insn->get_string();
+  } else if (insn->has_field()) {
+    key.ref = insn->get_field();
+  } else if (insn->has_method()) {
+    key.ref = insn->get_method();
+  }
+  return key;
+}
+
+struct MethodInfo {
+  DexMethod* method;
+  IRCode* code;
+  // Built on demand for the methods that have candidate occurrences.
+  std::unique_ptr<LivenessFixpointIterator> liveness;
+  std::unordered_map<const IRInstruction*, Block*> blocks;
+  bool modified{false};
+};
+
+/*
+ * The instructions of all the methods of a dex, as one string of symbols.
+ */
+struct Stream {
+  std::vector<uint32_t> symbols;
+  // For each position, the instruction (or end() for separators), the
+  // method it is in and its size in code units.
+  std::vector<IRList::iterator> items;
+  std::vector<uint32_t> methods;
+  std::vector<uint32_t> size_prefix{0};
+  std::vector<MethodInfo> infos;
+  uint32_t next_separator{kFirstSeparator};
+
+  IRInstruction* insn(size_t pos) const { return items[pos]->insn; }
+
+  bool is_separator(size_t pos) const {
+    return symbols[pos] >= kFirstSeparator;
+  }
+
+  size_t code_units(size_t pos, size_t len) const {
+    return size_prefix[pos + len] - size_prefix[pos];
+  }
+};
+
+void add_separator(Stream* stream, IRList::iterator end) {
+  if (!stream->symbols.empty() &&
+      stream->symbols.back() >= kFirstSeparator) {
+    return;
+  }
+  stream->symbols.push_back(stream->next_separator++);
+  stream->items.push_back(end);
+  stream->methods.push_back(stream->infos.size());
+  stream->size_prefix.push_back(stream->size_prefix.back());
+}
+
+Stream build_stream(const DexClasses& classes) {
+  Stream stream;
+  std::unordered_map<InsnKey, uint32_t, InsnKeyHash> symbols;
+  auto add_method = [&](DexMethod* method) {
+    auto code = method->get_code();
+    // Until the super constructor has been called, `this` can't be passed to
+    // an outlined method.
+    if (code == nullptr || is_init(method)) {
+      return;
+    }
+    stream.infos.push_back(MethodInfo{method, code});
+    auto method_index = stream.infos.size() - 1;
+    size_t try_depth = 0;
+    for (auto it = code->begin(); it != code->end(); ++it) {
+      if (it->type == MFLOW_TRY) {
+        try_depth += it->tentry->type == TRY_START ? 1 : -1;
+      }
+      if (it->type != MFLOW_OPCODE || try_depth > 0 ||
+          !is_outlinable(it->insn)) {
+        add_separator(&stream, code->end());
+        continue;
+      }
+      auto result = symbols.emplace(make_key(it->insn), symbols.size() + 1);
+      stream.symbols.push_back(result.first->second);
+      stream.items.push_back(it);
+      stream.methods.push_back(method_index);
+      stream.size_prefix.push_back(stream.size_prefix.back() +
+                                   it->insn->size());
+    }
+    add_separator(&stream, code->end());
+  };
+  for (auto cls : classes) {
+    for (auto method : cls->get_dmethods()) {
+      add_method(method);
+    }
+    for (auto method : cls->get_vmethods()) {
+      add_method(method);
+    }
+  }
+  return stream;
+}
+
+/*
+ * Sorts the suffixes of :symbols by their first max_len symbols, by prefix
+ * doubling. Suffixes that agree on that many symbols end up in no particular
+ * order among themselves, which is all the repeat search needs.
+ */
+std::vector<uint32_t> build_suffix_array(const std::vector<uint32_t>& symbols,
+                                         size_t max_len) {
+  auto n = symbols.size();
+  std::vector<uint32_t> sa(n);
+  std::iota(sa.begin(), sa.end(), 0);
+  std::vector<uint32_t> rank(symbols);
+  std::vector<uint32_t> next_rank(n);
+  for (size_t k = 1; n > 1; k <<= 1) {
+    auto key = [&](uint32_t i) {
+      return std::make_pair(rank[i], i + k < n ? uint64_t(rank[i + k]) + 1 : 0);
+    };
+    std::sort(sa.begin(), sa.end(), [&](uint32_t a, uint32_t b) {
+      return key(a) < key(b);
+    });
+    next_rank[sa[0]] = 0;
+    for (size_t j = 1; j < n; ++j) {
+      next_rank[sa[j]] = next_rank[sa[j - 1]] + (key(sa[j - 1]) < key(sa[j]));
+    }
+    rank.swap(next_rank);
+    // The suffixes are now sorted by their first 2k symbols.
+    if (rank[sa[n - 1]] == n - 1 || 2 * k >= max_len) {
+      break;
+    }
+  }
+  return sa;
+}
+
+struct Candidate {
+  uint32_t len;
+  uint32_t lb;
+  uint32_t rb;
+  int64_t benefit;
+};
+
+int64_t estimate_benefit(size_t count, size_t code_units, size_t call_units) {
+  if (code_units <= call_units) {
+    return 0;
+  }
+  return int64_t(count * (code_units - call_units) * 2) -
+         int64_t(kMethodOverheadBytes + (code_units + 1) * 2);
+}
+
+/*
+ * Walks the intervals of the LCP array, i.e. the internal nodes of the suffix
+ * tree. Each one is a sequence of its LCP's length, occurring at the
+ * positions its suffixes start at.
+ */
+std::vector<Candidate> find_candidates(const Stream& stream,
+                                       const std::vector<uint32_t>& sa,
+                                       const SequenceOutlinerConfig& config) {
+  auto n = sa.size();
+  auto& symbols = stream.symbols;
+  std::vector<uint32_t> lcp(n + 1, 0);
+  for (size_t j = 1; j < n; ++j) {
+    size_t a = sa[j - 1];
+    size_t b = sa[j];
+    size_t l = 0;
+    while (l < config.max_length && a + l < n && b + l < n &&
+           symbols[a + l] == symbols[b + l] && !stream.is_separator(a + l)) {
+      ++l;
+    }
+    lcp[j] = l;
+  }
+
+  std::vector<Candidate> candidates;
+  struct Open {
+    uint32_t lcp;
+    uint32_t lb;
+  };
+  std::vector<Open> stack{{0, 0}};
+  for (size_t j = 1; j <= n; ++j) {
+    uint32_t lb = j - 1;
+    while (lcp[j] < stack.back().lcp) {
+      auto top = stack.back();
+      stack.pop_back();
+      lb = top.lb;
+      if (top.lcp >= config.min_length) {
+        auto count = j - top.lb;
+        auto benefit = estimate_benefit(
+            count, stream.code_units(sa[top.lb], top.lcp), 4);
+        if (benefit > 0) {
+          candidates.push_back(Candidate{top.lcp, top.lb, uint32_t(j - 1),
+                                         benefit});
+        }
+      }
+    }
+    if (lcp[j] > stack.back().lcp) {
+      stack.push_back(Open{lcp[j], lb});
+    }
+  }
+  std::stable_sort(candidates.begin(),
+                   candidates.end(),
+                   [](const Candidate& a, const Candidate& b) {
+                     return a.benefit > b.benefit;
+                   });
+  return candidates;
+}
+
+/*
+ * How an occurrence uses its registers. Registers are numbered in the order
+ * in which the sequence first mentions them, so the occurrences that can
+ * share an outlined method have equal shapes.
+ */
+struct Shape {
+  std::vector<uint16_t> regs;
+  std::vector<uint16_t> params;
+  int32_t result{-1};
+
+  bool operator==(const Shape& other) const {
+    return regs == other.regs && params == other.params &&
+           result == other.result;
+  }
+};
+
+struct ShapeHash {
+  size_t operator()(const Shape& shape) const {
+    size_t seed = 0;
+    boost::hash_range(seed, shape.regs.begin(), shape.regs.end());
+    boost::hash_range(seed, shape.params.begin(), shape.params.end());
+    boost::hash_combine(seed, shape.result);
+    return seed;
+  }
+};
+
+struct Occurrence {
+  uint32_t pos;
+  // The original register of each numbered register.
+  std::vector<uint16_t> orig;
+};
+
+struct Analysis {
+  Shape shape;
+  std::vector<uint16_t> orig;
+  std::vector<uint8_t> widths;
+  std::vector<DexType*> param_types;
+  DexType* result_type{nullptr};
+};
+
+LivenessDomain live_after(MethodInfo* info, IRInstruction* insn) {
+  if (info->liveness == nullptr) {
+    info->code->build_cfg();
+    auto& cfg = info->code->cfg();
+    cfg.calculate_exit_block();
+    info->liveness = std::make_unique<LivenessFixpointIterator>(cfg);
+    info->liveness->run(LivenessDomain(info->code->get_registers_size()));
+    for (auto block : cfg.blocks()) {
+      for (auto it = block->begin(); it != block->end(); ++it) {
+        if (it->type == MFLOW_OPCODE) {
+          info->blocks.emplace(it->insn, block);
+        }
+      }
+    }
+  }
+  auto block = info->blocks.at(insn);
+  auto live = info->liveness->get_live_out_vars_at(block);
+  for (auto it = block->rbegin(); it != block->rend(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    if (it->insn == insn) {
+      break;
+    }
+    info->liveness->analyze_instruction(it->insn, &live);
+  }
+  return live;
+}
+
+bool analyze(Stream* stream, size_t pos, size_t len, Analysis* analysis) {
+  auto& shape = analysis->shape;
+  auto& orig = analysis->orig;
+  auto& widths = analysis->widths;
+  std::unordered_map<uint16_t, uint16_t> ids;
+  std::vector<bool> written;
+  std::vector<DexType*> read_types;
+  auto id_of = [&](uint16_t reg, uint8_t width) -> int {
+    auto result = ids.emplace(reg, orig.size());
+    if (result.second) {
+      orig.push_back(reg);
+      widths.push_back(width);
+      written.push_back(false);
+      read_types.push_back(nullptr);
+    } else if (widths[result.first->second] != width) {
+      return -1;
+    }
+    return result.first->second;
+  };
+
+  // The instructions that last wrote each register, with their predecessor.
+  std::vector<std::pair<IRInstruction*, IRInstruction*>> last_defs;
+  IRInstruction* prev = nullptr;
+  for (size_t p = pos; p < pos + len; ++p) {
+    auto insn = stream->insn(p);
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      auto id = id_of(insn->src(i), insn->src_is_wide(i) ? 2 : 1);
+      if (id < 0) {
+        return false;
+      }
+      shape.regs.push_back(id);
+      if (written[id]) {
+        continue;
+      }
+      auto type = src_type(insn, i);
+      if (type == nullptr) {
+        return false;
+      }
+      if (read_types[id] == nullptr) {
+        read_types[id] = type;
+        shape.params.push_back(id);
+      } else if (read_types[id] != type) {
+        return false;
+      }
+    }
+    if (insn->dests_size() > 0) {
+      auto id = id_of(insn->dest(), insn->dest_is_wide() ? 2 : 1);
+      if (id < 0) {
+        return false;
+      }
+      shape.regs.push_back(id);
+      written[id] = true;
+      last_defs.resize(orig.size());
+      last_defs[id] = std::make_pair(insn, prev);
+    }
+    prev = insn;
+  }
+
+  // A wide register must not overlap any other register.
+  std::vector<std::pair<uint16_t, uint8_t>> ranges;
+  size_t num_regs = 0;
+  for (size_t id = 0; id < orig.size(); ++id) {
+    ranges.emplace_back(orig[id], widths[id]);
+    num_regs += widths[id];
+  }
+  std::sort(ranges.begin(), ranges.end());
+  for (size_t i = 1; i < ranges.size(); ++i) {
+    if (ranges[i - 1].first + ranges[i - 1].second > ranges[i].first) {
+      return false;
+    }
+  }
+  if (num_regs > kMaxRegisters || shape.params.size() > kMaxParams) {
+    return false;
+  }
+  for (auto id : shape.params) {
+    // The caller passes the registers to a non-range invoke.
+    if (orig[id] > 15 || !is_accessible(read_types[id])) {
+      return false;
+    }
+    analysis->param_types.push_back(read_types[id]);
+  }
+
+  auto& info = stream->infos[stream->methods[pos]];
+  auto live = live_after(&info, stream->insn(pos + len - 1));
+  for (size_t id = 0; id < orig.size(); ++id) {
+    if (!written[id] || !live.contains(orig[id])) {
+      continue;
+    }
+    if (shape.result >= 0) {
+      return false;
+    }
+    shape.result = id;
+    auto def = last_defs[id];
+    analysis->result_type = dest_type(def.first, def.second);
+    if (analysis->result_type == nullptr ||
+        !is_accessible(analysis->result_type) || orig[id] > 255) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Plan {
+  Analysis analysis;
+  uint32_t len;
+  std::vector<Occurrence> occurrences;
+};
+
+bool overlaps_taken(const std::vector<bool>& taken, size_t pos, size_t len) {
+  for (size_t p = pos; p < pos + len; ++p) {
+    if (taken[p]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<Plan> plan_outlining(Stream* stream,
+                                 const SequenceOutlinerConfig& config) {
+  auto sa = build_suffix_array(stream->symbols, config.max_length);
+  auto candidates = find_candidates(*stream, sa, config);
+  TRACE(OUTLINE, 2, "%lu positions, %lu candidate sequences\n",
+        stream->symbols.size(), candidates.size());
+
+  std::vector<Plan> plans;
+  std::vector<bool> taken(stream->symbols.size(), false);
+  for (const auto& candidate : candidates) {
+    if (plans.size() >= config.max_methods_per_dex) {
+      break;
+    }
+    // A move-result can't be split from the instruction it belongs to. All
+    // the occurrences have the same instructions, so look at the first.
+    auto first = sa[candidate.lb];
+    size_t start = 0;
+    size_t end = candidate.len;
+    while (start < end && is_any_move_result(stream->insn(first + start)->opcode())) {
+      ++start;
+    }
+    while (end > start) {
+      auto last = stream->insn(first + end - 1);
+      if (!is_invoke(last->opcode()) && !last->has_move_result_pseudo()) {
+        break;
+      }
+      --end;
+    }
+    auto len = end - start;
+    if (len < config.min_length) {
+      continue;
+    }
+
+    std::vector<uint32_t> positions;
+    for (auto j = candidate.lb; j <= candidate.rb; ++j) {
+      positions.push_back(sa[j] + start);
+    }
+    std::sort(positions.begin(), positions.end());
+    std::unordered_map<Shape, Plan, ShapeHash> groups;
+    std::vector<const Shape*> group_order;
+    size_t last_end = 0;
+    for (auto pos : positions) {
+      if (pos < last_end || overlaps_taken(taken, pos, len)) {
+        continue;
+      }
+      Analysis analysis;
+      if (!analyze(stream, pos, len, &analysis)) {
+        continue;
+      }
+      last_end = pos + len;
+      auto it = groups.find(analysis.shape);
+      if (it == groups.end()) {
+        Shape shape = analysis.shape;
+        it = groups.emplace(std::move(shape), Plan{}).first;
+        it->second.len = len;
+        it->second.analysis = std::move(analysis);
+        group_order.push_back(&it->first);
+        it->second.occurrences.push_back(
+            Occurrence{pos, it->second.analysis.orig});
+      } else {
+        it->second.occurrences.push_back(
+            Occurrence{pos, std::move(analysis.orig)});
+      }
+    }
+
+    for (auto shape : group_order) {
+      auto& plan = groups.at(*shape);
+      auto call_units = 3 + (shape->result >= 0 ? 1 : 0);
+      auto code_units = stream->code_units(plan.occurrences[0].pos, len);
+      if (plan.occurrences.size() < 2 ||
+          estimate_benefit(plan.occurrences.size(), code_units, call_units) <=
+              0 ||
+          plans.size() >= config.max_methods_per_dex) {
+        continue;
+      }
+      for (const auto& occurrence : plan.occurrences) {
+        for (size_t p = occurrence.pos; p < occurrence.pos + len; ++p) {
+          taken[p] = true;
+        }
+      }
+      plans.push_back(std::move(plan));
+    }
+  }
+  return plans;
+}
+
+DexMethod* make_outlined_method(const Stream& stream,
+                                const Plan& plan,
+                                DexType* cls,
+                                size_t index) {
+  const auto& analysis = plan.analysis;
+  const auto& shape = analysis.shape;
+  auto rtype = shape.result >= 0 ? analysis.result_type : get_void_type();
+  std::deque<DexType*> args(analysis.param_types.begin(),
+                            analysis.param_types.end());
+  auto proto =
+      DexProto::make_proto(rtype, DexTypeList::make_type_list(std::move(args)));
+  auto method = static_cast<DexMethod*>(DexMethod::make_method(
+      cls, DexString::make_string("$outlined$" + std::to_string(index)),
+      proto));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+
+  // The parameters are loaded into the last registers, so number the other
+  // registers first.
+  std::vector<bool> is_param(analysis.orig.size(), false);
+  for (auto id : shape.params) {
+    is_param[id] = true;
+  }
+  std::vector<uint16_t> regs(analysis.orig.size());
+  uint16_t next = 0;
+  for (size_t id = 0; id < analysis.orig.size(); ++id) {
+    if (!is_param[id]) {
+      regs[id] = next;
+      next += analysis.widths[id];
+    }
+  }
+  auto temps = next;
+  for (auto id : shape.params) {
+    regs[id] = next;
+    next += analysis.widths[id];
+  }
+
+  auto code = std::make_unique<IRCode>(method, temps);
+  auto reg = shape.regs.begin();
+  auto pos = plan.occurrences[0].pos;
+  for (size_t p = pos; p < pos + plan.len; ++p) {
+    auto copy = new IRInstruction(*stream.insn(p));
+    for (size_t i = 0; i < copy->srcs_size(); ++i) {
+      copy->set_src(i, regs[*reg++]);
+    }
+    if (copy->dests_size() > 0) {
+      copy->set_dest(regs[*reg++]);
+    }
+    code->push_back(copy);
+  }
+  if (shape.result >= 0) {
+    auto op = is_wide_type(rtype)
+                  ? OPCODE_RETURN_WIDE
+                  : is_primitive(rtype) ? OPCODE_RETURN : OPCODE_RETURN_OBJECT;
+    auto ret = new IRInstruction(op);
+    ret->set_src(0, regs[shape.result]);
+    code->push_back(ret);
+  } else {
+    code->push_back(new IRInstruction(OPCODE_RETURN_VOID));
+  }
+  method->set_code(std::move(code));
+  return method;
+}
+
+void replace_occurrence(Stream* stream,
+                        const Plan& plan,
+                        const Occurrence& occurrence,
+                        DexMethod* outlined) {
+  const auto& shape = plan.analysis.shape;
+  auto& info = stream->infos[stream->methods[occurrence.pos]];
+  auto code = info.code;
+  auto first = stream->items[occurrence.pos];
+
+  auto invoke = new IRInstruction(OPCODE_INVOKE_STATIC);
+  invoke->set_method(outlined)->set_arg_word_count(shape.params.size());
+  for (size_t i = 0; i < shape.params.size(); ++i) {
+    invoke->set_src(i, occurrence.orig[shape.params[i]]);
+  }
+  code->insert_before(first, invoke);
+  if (shape.result >= 0) {
+    auto rtype = plan.analysis.result_type;
+    auto op = is_wide_type(rtype)
+                  ? OPCODE_MOVE_RESULT_WIDE
+                  : is_primitive(rtype) ? OPCODE_MOVE_RESULT
+                                        : OPCODE_MOVE_RESULT_OBJECT;
+    auto move_result = new IRInstruction(op);
+    move_result->set_dest(occurrence.orig[shape.result]);
+    code->insert_before(first, move_result);
+  }
+  for (size_t p = occurrence.pos; p < occurrence.pos + plan.len; ++p) {
+    // Removing an instruction removes its move-result-pseudo too.
+    if (!opcode::is_move_result_pseudo(stream->insn(p)->opcode())) {
+      code->remove_opcode(stream->items[p]);
+    }
+  }
+  info.modified = true;
+}
+
+} // namespace
+
+SequenceOutlinerStats outline_sequences(DexClassesVector& dexen,
+                                        size_t first_dex,
+                                        const SequenceOutlinerConfig& config) {
+  std::vector<Stream> streams(dexen.size());
+  std::vector<std::vector<Plan>> plans(dexen.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    streams[i] = build_stream(dexen[i]);
+    plans[i] = plan_outlining(&streams[i], config);
+  });
+  for (size_t i = first_dex; i < dexen.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  // Creating the methods and classes touches global state, so the rest is
+  // done one dex at a time.
+  SequenceOutlinerStats stats;
+  for (size_t i = first_dex; i < dexen.size(); ++i) {
+    if (plans[i].empty()) {
+      continue;
+    }
+    auto& stream = streams[i];
+    auto type = DexType::make_type(
+        (OUTLINED_CLASS_PREFIX + std::to_string(i) + ";").c_str());
+    always_assert(!type_class(type));
+    ClassCreator creator(type);
+    creator.set_super(get_object_type());
+    creator.set_access(ACC_PUBLIC | ACC_FINAL);
+
+    std::vector<DexMethod*> methods;
+    for (size_t j = 0; j < plans[i].size(); ++j) {
+      methods.push_back(make_outlined_method(stream, plans[i][j], type, j));
+      creator.add_method(methods.back());
+    }
+    for (size_t j = 0; j < plans[i].size(); ++j) {
+      const auto& plan = plans[i][j];
+      for (const auto& occurrence : plan.occurrences) {
+        replace_occurrence(&stream, plan, occurrence, methods[j]);
+      }
+      auto code_units = stream.code_units(plan.occurrences[0].pos, plan.len);
+      auto call_units = 3 + (plan.analysis.shape.result >= 0 ? 1 : 0);
+      stats.code_units_saved +=
+          plan.occurrences.size() * (code_units - call_units) -
+          (code_units + 1);
+      stats.sites += plan.occurrences.size();
+      TRACE(OUTLINE, 3, "Outlined %u instructions at %lu sites into %s\n",
+            plan.len, plan.occurrences.size(), SHOW(methods[j]));
+    }
+    stats.methods += methods.size();
+    for (auto& info : stream.infos) {
+      if (info.modified) {
+        info.code->clear_cfg();
+      }
+    }
+    dexen[i].push_back(creator.create());
+  }
+  return stats;
+}
+
+} // namespace outliner
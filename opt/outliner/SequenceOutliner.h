@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include "DexClass.h"
+
+namespace outliner {
+
+struct SequenceOutlinerConfig {
+  // Bounds on the number of instructions of an outlined sequence.
+  size_t min_length{3};
+  size_t max_length{32};
+  // Every outlined method adds a method ref to its dex.
+  size_t max_methods_per_dex{2048};
+};
+
+struct SequenceOutlinerStats {
+  size_t methods{0};
+  size_t sites{0};
+  size_t code_units_saved{0};
+};
+
+/*
+ * Moves instruction sequences that occur more than once in a dex into static
+ * methods of a new class in that dex, and replaces every occurrence with a
+ * call, when that makes the dex smaller.
+ *
+ * The repeats are found with a suffix array over the instructions of all the
+ * methods of the dex, where instructions that only differ in their registers
+ * compare equal. An occurrence is only outlined along with the others that
+ * use their registers in the same way, read at most five registers and leave
+ * at most one register that is still read afterwards. Only straight-line
+ * code outside of try regions is considered, and only instructions whose
+ * types and accessibility can be told from the instructions themselves:
+ * constants, arithmetic, and accesses to public fields and methods of public
+ * classes.
+ *
+ * The dexes in [first_dex, dexen.size()) are processed, in parallel.
+ */
+SequenceOutlinerStats outline_sequences(DexClassesVector& dexen,
+                                        size_t first_dex,
+                                        const SequenceOutlinerConfig& config);
+
+} // namespace outliner
@@ -21,6 +21,7 @@
 #include "IRInstruction.h"
 #include "PassManager.h"
 #include "RedundantCheckCastRemover.h"
+#include "ScratchArena.h"
 #include "Walkers.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1384,14 +1385,80 @@ bool contains(const std::vector<T>& vec, const T& value) {
   return std::find(vec.begin(), vec.end(), value) != vec.end();
 }
 
+// A match of one pattern, found while traversing a block but not applied yet.
+struct PendingMatch {
+  size_t matcher;
+  std::vector<IRInstruction*> matched_instructions;
+  std::vector<IRInstruction*> replacements;
+};
+
 class PeepholeOptimizer {
  private:
   std::vector<Matcher> m_matchers;
+  // For each opcode, the matchers whose first pattern instruction may match it,
+  // in pattern order. An idle matcher ignores all the other opcodes.
+  std::unordered_map<uint16_t, std::vector<size_t>> m_matchers_by_opcode;
   std::vector<size_t> m_stats;
   PassManager& m_mgr;
   int m_stats_removed = 0;
   int m_stats_inserted = 0;
 
+  // Runs all the matchers over the block in a single traversal. Each matcher
+  // sees the same sequence of instructions it would see on its own, but only
+  // the matchers that are in the middle of a match, or that can start one on
+  // the current opcode, are actually tried.
+  std::vector<PendingMatch> find_matches(Block* block) {
+    std::vector<PendingMatch> matches;
+    std::vector<size_t> active;
+    std::vector<size_t> next_active;
+    std::vector<bool> tried(m_matchers.size(), false);
+
+    auto try_matcher = [&](size_t i, IRInstruction* insn) {
+      auto& matcher = m_matchers[i];
+      tried[i] = true;
+      if (matcher.try_match(insn)) {
+        TRACE(PEEPHOLE, 7, "PATTERN %s MATCHED!\n",
+              matcher.pattern.name.c_str());
+        matches.push_back(PendingMatch{
+            i, matcher.matched_instructions, matcher.get_replacements()});
+        matcher.reset();
+      } else if (matcher.match_index > 0) {
+        next_active.push_back(i);
+      }
+    };
+
+    for (auto& mei : InstructionIterable(block)) {
+      auto insn = mei.insn;
+      for (auto i : active) {
+        try_matcher(i, insn);
+      }
+      auto it = m_matchers_by_opcode.find(insn->opcode());
+      if (it != m_matchers_by_opcode.end()) {
+        for (auto i : it->second) {
+          if (!tried[i]) {
+            try_matcher(i, insn);
+          }
+        }
+      }
+      for (auto i : active) {
+        tried[i] = false;
+      }
+      if (it != m_matchers_by_opcode.end()) {
+        for (auto i : it->second) {
+          tried[i] = false;
+        }
+      }
+      std::swap(active, next_active);
+      next_active.clear();
+    }
+    // Currently, all patterns do not span over multiple basic blocks. So
+    // reset all matching states at the end of every basic block.
+    for (auto i : active) {
+      m_matchers[i].reset();
+    }
+    return matches;
+  }
+
  public:
   explicit PeepholeOptimizer(
       PassManager& mgr, const std::vector<std::string>& disabled_peepholes)
@@ -1408,6 +1475,11 @@ class PeepholeOptimizer {
         }
       }
     }
+    for (size_t i = 0; i < m_matchers.size(); ++i) {
+      for (auto opcode : m_matchers[i].pattern.match.at(0).opcodes) {
+        m_matchers_by_opcode[opcode].push_back(i);
+      }
+    }
     m_stats.resize(m_matchers.size(), 0);
   }
 
@@ -1418,53 +1490,63 @@ class PeepholeOptimizer {
     auto code = method->get_code();
     code->build_cfg();
 
-    // do optimizations one at a time
-    // so they can match on the same pattern without interfering
-    for (size_t i = 0; i < m_matchers.size(); ++i) {
-      auto& matcher = m_matchers[i];
-      std::vector<IRInstruction*> deletes;
-      std::vector<std::pair<IRInstruction*, std::vector<IRInstruction*>>>
-          inserts;
-      const auto& blocks = code->cfg().blocks();
-      for (const auto& block : blocks) {
-        // Currently, all patterns do not span over multiple basic blocks. So
-        // reset all matching states on visiting every basic block.
-        matcher.reset();
-
-        for (auto& mei : InstructionIterable(block)) {
-          if (!matcher.try_match(mei.insn)) {
-            continue;
+    // The method runs within a scratch arena scope of reduce_methods().
+    std::vector<IRInstruction*, ScratchAllocator<IRInstruction*>> deletes;
+    using Insert = std::pair<IRInstruction*, std::vector<IRInstruction*>>;
+    std::vector<Insert, ScratchAllocator<Insert>> inserts;
+    for (const auto& block : code->cfg().blocks()) {
+      auto matches = find_matches(block);
+      // Overlapping matches are resolved in pattern order: a match is applied
+      // only if none of its instructions were taken by an earlier pattern, as
+      // if the patterns were applied one at a time. The matches of a single
+      // pattern never overlap.
+      std::stable_sort(matches.begin(),
+                       matches.end(),
+                       [](const PendingMatch& a, const PendingMatch& b) {
+                         return a.matcher < b.matcher;
+                       });
+      std::unordered_set<IRInstruction*,
+                         std::hash<IRInstruction*>,
+                         std::equal_to<IRInstruction*>,
+                         ScratchAllocator<IRInstruction*>>
+          taken;
+      for (auto& match : matches) {
+        bool overlaps = std::any_of(
+            match.matched_instructions.begin(),
+            match.matched_instructions.end(),
+            [&](IRInstruction* insn) { return taken.count(insn) != 0; });
+        if (overlaps) {
+          for (auto insn : match.replacements) {
+            delete insn;
           }
-          m_stats.at(i)++;
-          TRACE(PEEPHOLE, 7, "PATTERN %s MATCHED!\n",
-                matcher.pattern.name.c_str());
-          for (auto insn : matcher.matched_instructions) {
-            if (opcode::is_move_result_pseudo(insn->opcode())) {
-              continue;
-            }
-            deletes.push_back(insn);
-          }
-
-          auto replace = matcher.get_replacements();
-          for (const auto& r : replace) {
-            TRACE(PEEPHOLE, 8, "-- %s\n", SHOW(r));
+          continue;
+        }
+        m_stats.at(match.matcher)++;
+        for (auto insn : match.matched_instructions) {
+          taken.insert(insn);
+          if (opcode::is_move_result_pseudo(insn->opcode())) {
+            continue;
           }
+          deletes.push_back(insn);
+        }
+        for (const auto& r : match.replacements) {
+          TRACE(PEEPHOLE, 8, "-- %s\n", SHOW(r));
+        }
 
-          m_stats_inserted += replace.size();
-          m_stats_removed += matcher.match_index;
+        m_stats_inserted += match.replacements.size();
+        m_stats_removed += match.matched_instructions.size();
 
-          inserts.emplace_back(mei.insn, replace);
-          matcher.reset();
-        }
+        inserts.emplace_back(match.matched_instructions.back(),
+                             std::move(match.replacements));
       }
+    }
 
-      for (auto& pair : inserts) {
-        std::vector<IRInstruction*> vec{begin(pair.second), end(pair.second)};
-        code->insert_after(pair.first, vec);
-      }
-      for (auto& insn : deletes) {
-        code->remove_opcode(insn);
-      }
+    for (auto& pair : inserts) {
+      std::vector<IRInstruction*> vec{begin(pair.second), end(pair.second)};
+      code->insert_after(pair.first, vec);
+    }
+    for (auto& insn : deletes) {
+      code->remove_opcode(insn);
     }
   }
 
@@ -18,6 +18,8 @@ class PeepholePass : public Pass {
 
   virtual void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  virtual bool is_method_local() const override { return true; }
+
   virtual void configure_pass(const PassConfig& pc) override {
     pc.get("disabled_peepholes", {}, config.disabled_peepholes);
   }
@@ -9,55 +9,86 @@
 
 #include "RedundantCheckCastRemover.h"
 
-#include <unordered_map>
+#include <atomic>
 
 #include "DexUtil.h"
 #include "IRCode.h"
-#include "Match.h"
+#include "IRTypeChecker.h"
 #include "Walkers.h"
 
+/*
+ * A check-cast is redundant when the reference it checks is already known to
+ * have a subtype of the type it casts to. Rather than matching the patterns
+ * that produce such references, we ask the type inference of IRTypeChecker for
+ * the Dex type of the operand. That covers the results of invocations, field
+ * reads, parameters, allocations and earlier check-casts alike, through moves
+ * and across blocks.
+ */
+
 RedundantCheckCastRemover::RedundantCheckCastRemover(
     PassManager& mgr, const std::vector<DexClass*>& scope)
     : m_mgr(mgr), m_scope(scope) {}
 
 void RedundantCheckCastRemover::run() {
-  auto match = std::make_tuple(m::invoke(),
-                               m::is_opcode(OPCODE_MOVE_RESULT_OBJECT),
-                               m::is_opcode(OPCODE_CHECK_CAST),
-                               m::is_opcode(IOPCODE_MOVE_RESULT_PSEUDO_OBJECT));
-
-  std::unordered_map<DexMethod*, std::vector<IRInstruction*>> to_remove;
-
-  std::atomic<uint32_t> num_check_casts_removed;
-  walk::parallel::matching_opcodes_in_block(
-      m_scope,
-      match,
-      [](DexMethod* method, const std::vector<IRInstruction*>& insns) {
-        if (RedundantCheckCastRemover::can_remove_check_cast(insns)) {
-          IRInstruction* check_cast = insns[2];
-          method->get_code()->remove_opcode(check_cast);
-
-          TRACE(PEEPHOLE, 8, "redundant check cast in %s\n", SHOW(method));
-          for (IRInstruction* insn : insns) {
-            TRACE(PEEPHOLE, 8, "  %s\n", SHOW(insn));
-          }
-        }
-      });
+  std::atomic<size_t> num_check_casts_removed{0};
+  walk::parallel::methods(m_scope, [&](DexMethod* method) {
+    if (method->get_code() == nullptr) {
+      return;
+    }
+    num_check_casts_removed += remove_redundant_check_casts(method);
+  });
 
   m_mgr.incr_metric("redundant_check_casts_removed", num_check_casts_removed);
 }
 
-bool RedundantCheckCastRemover::can_remove_check_cast(
-    const std::vector<IRInstruction*>& insns) {
-  always_assert(insns.size() == 4);
-  IRInstruction* invoke_op = insns[0];
-  IRInstruction* move_result_op = insns[1];
-  IRInstruction* check_cast_op = insns[2];
-  IRInstruction* move_result_pseudo = insns[3];
-
-  auto invoke_return = invoke_op->get_method()->get_proto()->get_rtype();
-  auto check_type = check_cast_op->get_type();
-  return move_result_op->dest() == check_cast_op->src(0) &&
-         move_result_pseudo->dest() == check_cast_op->src(0) &&
-         check_cast(invoke_return, check_type);
+size_t RedundantCheckCastRemover::remove_redundant_check_casts(
+    DexMethod* method) {
+  auto code = method->get_code();
+  auto ii = InstructionIterable(code);
+  if (std::none_of(ii.begin(), ii.end(), [](const MethodItemEntry& mie) {
+        return mie.insn->opcode() == OPCODE_CHECK_CAST;
+      })) {
+    // Don't pay for the type inference when there is nothing to remove.
+    return 0;
+  }
+
+  IRTypeChecker checker(method);
+  // We only read the inferred types, there is no need to be stricter than
+  // the Android verifier is.
+  checker.enable_polymorphic_constants();
+  checker.infer_dex_types();
+  checker.run();
+  if (checker.fail()) {
+    TRACE(PEEPHOLE, 2, "not removing check casts in ill-typed %s: %s\n",
+          SHOW(method), checker.what().c_str());
+    return 0;
+  }
+
+  std::vector<IRList::iterator> redundant;
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type != MFLOW_OPCODE || it->insn->opcode() != OPCODE_CHECK_CAST) {
+      continue;
+    }
+    auto insn = it->insn;
+    auto type = checker.get_dex_type(insn, insn->src(0));
+    if (type != nullptr && check_cast(type, insn->get_type())) {
+      redundant.push_back(it);
+    }
+  }
+
+  for (const auto& it : redundant) {
+    auto insn = it->insn;
+    auto src = insn->src(0);
+    auto dest = std::next(it)->insn->dest();
+    TRACE(PEEPHOLE, 8, "redundant check cast in %s: %s\n", SHOW(method),
+          SHOW(insn));
+    if (src != dest) {
+      // The cast still copies the reference to its destination.
+      auto move = new IRInstruction(OPCODE_MOVE_OBJECT);
+      move->set_dest(dest)->set_src(0, src);
+      code->insert_before(it, move);
+    }
+    code->remove_opcode(it);
+  }
+  return redundant.size();
 }
@@ -24,8 +24,13 @@ class RedundantCheckCastRemover {
                                      const std::vector<DexClass*>& scope);
   void run();
 
+  /*
+   * Removes the check-casts of the method whose operand is already known to
+   * have a subtype of the type cast to, and returns how many were removed.
+   */
+  static size_t remove_redundant_check_casts(DexMethod* method);
+
  private:
-  static bool can_remove_check_cast(const std::vector<IRInstruction*>&);
 
   PassManager& m_mgr;
   const std::vector<DexClass*>& m_scope;
@@ -13,9 +13,12 @@
 #include <string>
 #include <vector>
 
+#include "Analyses.h"
+#include "ConcurrentContainers.h"
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexUtil.h"
+#include "IRCode.h"
 #include "IRInstruction.h"
 #include "PassManager.h"
 #include "Resolver.h"
@@ -118,55 +121,41 @@ DexMethod* bind_to_visible_ancestor(
   return top_impl;
 }
 
+/*
+ * The rewriting is method-local, so the methods are visited in parallel. Each
+ * class gets its own stats, merged at the end, and the classes that have to
+ * become public are only made so after the walk. The visibility that
+ * bind_to_visible_ancestor() checks is thus the one from before the pass,
+ * independently of the order the methods are visited in.
+ */
 struct Rebinder {
   Rebinder(Scope& scope, PassManager& mgr) : m_scope(scope), m_pass_mgr(mgr) {}
 
   void rewrite_refs() {
-    walk::opcodes(
-      m_scope,
-      [](DexMethod*) { return true; },
-      [&](DexMethod* m, IRInstruction* insn) {
-        bool top_ancestor = false;
-        switch (insn->opcode()) {
-          case OPCODE_INVOKE_VIRTUAL:
-            top_ancestor = true;
-            // fallthrough
-          case OPCODE_INVOKE_SUPER:
-          case OPCODE_INVOKE_INTERFACE:
-          case OPCODE_INVOKE_STATIC:
-            rebind_method(insn, opcode_to_search(insn), top_ancestor);
-            break;
-          case OPCODE_SGET:
-          case OPCODE_SGET_WIDE:
-          case OPCODE_SGET_OBJECT:
-          case OPCODE_SGET_BOOLEAN:
-          case OPCODE_SGET_BYTE:
-          case OPCODE_SGET_CHAR:
-          case OPCODE_SGET_SHORT:
-            rebind_field(insn, FieldSearch::Static);
-            break;
-          case OPCODE_IGET:
-          case OPCODE_IGET_WIDE:
-          case OPCODE_IGET_OBJECT:
-          case OPCODE_IGET_BOOLEAN:
-          case OPCODE_IGET_BYTE:
-          case OPCODE_IGET_CHAR:
-          case OPCODE_IGET_SHORT:
-            rebind_field(insn, FieldSearch::Instance);
-            break;
-          default:
-            break;
-        }
-      });
+    m_stats = walk::parallel::reduce_code<Stats>(
+        m_scope,
+        [](DexMethod*) { return true; },
+        [&](Stats& stats, DexMethod*, IRCode& code) {
+          for (const MethodItemEntry& mie : InstructionIterable(code)) {
+            rewrite_ref(stats, mie.insn);
+          }
+        },
+        [](Stats a, Stats b) {
+          a.merge(b);
+          return a;
+        });
+    for (auto cls : m_stats.publicized) {
+      set_public(cls);
+    }
   }
 
   void print_stats() {
-    m_frefs.print("field_refs", &m_pass_mgr);
-    m_mrefs.print("method_refs", &m_pass_mgr);
-    m_array_clone_refs.print("array_clone", nullptr);
-    m_equals_refs.print("equals", nullptr);
-    m_hashCode_refs.print("hashCode", nullptr);
-    m_getClass_refs.print("getClass", nullptr);
+    m_stats.frefs.print("field_refs", &m_pass_mgr);
+    m_stats.mrefs.print("method_refs", &m_pass_mgr);
+    m_stats.array_clone_refs.print("array_clone", nullptr);
+    m_stats.equals_refs.print("equals", nullptr);
+    m_stats.hashCode_refs.print("hashCode", nullptr);
+    m_stats.getClass_refs.print("getClass", nullptr);
   }
 
  private:
@@ -186,6 +175,12 @@ struct Rebinder {
       insert(tin, T());
     }
 
+    void merge(const RefStats& other) {
+      count += other.count;
+      in.insert(other.in.begin(), other.in.end());
+      out.insert(other.out.begin(), other.out.end());
+    }
+
     void print(const char* tag, PassManager* mgr) {
       TRACE(BIND, 1,
               "%11s [call sites: %6d, old refs: %6lu, new refs: %6lu]\n",
@@ -205,34 +200,138 @@ struct Rebinder {
     }
   };
 
-  void rebind_method(
-      IRInstruction* mop, MethodSearch search, bool top_ancestor) {
+  struct Stats {
+    RefStats<DexFieldRef*> frefs;
+    RefStats<DexMethodRef*> mrefs;
+    RefStats<DexMethodRef*> array_clone_refs;
+    RefStats<DexMethodRef*> equals_refs;
+    RefStats<DexMethodRef*> hashCode_refs;
+    RefStats<DexMethodRef*> getClass_refs;
+    // The classes of the new refs that have to be made public
+    std::unordered_set<DexClass*> publicized;
+
+    void merge(const Stats& other) {
+      frefs.merge(other.frefs);
+      mrefs.merge(other.mrefs);
+      array_clone_refs.merge(other.array_clone_refs);
+      equals_refs.merge(other.equals_refs);
+      hashCode_refs.merge(other.hashCode_refs);
+      getClass_refs.merge(other.getClass_refs);
+      publicized.insert(other.publicized.begin(), other.publicized.end());
+    }
+  };
+
+  // How the ref of an invoke-virtual is rebound
+  enum class VirtualBinding {
+    STRING,
+    ARRAY_CLONE,
+    EQUALS,
+    HASHCODE,
+    GETCLASS,
+    ANCESTOR,
+  };
+
+  struct Binding {
+    VirtualBinding kind;
+    DexMethodRef* target;
+  };
+
+  void rewrite_ref(Stats& stats, IRInstruction* insn) {
+    bool top_ancestor = false;
+    switch (insn->opcode()) {
+      case OPCODE_INVOKE_VIRTUAL:
+        top_ancestor = true;
+        // fallthrough
+      case OPCODE_INVOKE_SUPER:
+      case OPCODE_INVOKE_INTERFACE:
+      case OPCODE_INVOKE_STATIC:
+        rebind_method(stats, insn, opcode_to_search(insn), top_ancestor);
+        break;
+      case OPCODE_SGET:
+      case OPCODE_SGET_WIDE:
+      case OPCODE_SGET_OBJECT:
+      case OPCODE_SGET_BOOLEAN:
+      case OPCODE_SGET_BYTE:
+      case OPCODE_SGET_CHAR:
+      case OPCODE_SGET_SHORT:
+        rebind_field(stats, insn, FieldSearch::Static);
+        break;
+      case OPCODE_IGET:
+      case OPCODE_IGET_WIDE:
+      case OPCODE_IGET_OBJECT:
+      case OPCODE_IGET_BOOLEAN:
+      case OPCODE_IGET_BYTE:
+      case OPCODE_IGET_CHAR:
+      case OPCODE_IGET_SHORT:
+        rebind_field(stats, insn, FieldSearch::Instance);
+        break;
+      default:
+        break;
+    }
+  }
+
+  void rebind_method(Stats& stats,
+                     IRInstruction* mop,
+                     MethodSearch search,
+                     bool top_ancestor) {
     const auto mref = mop->get_method();
     if (search == MethodSearch::Virtual && top_ancestor) {
-      auto mtype = mref->get_class();
-      if (is_array_clone(mref, mtype)) {
-        rebind_method_opcode(mop, mref, rebind_array_clone(mref));
-        return;
-      }
-      // leave java.lang.String alone not to interfere with OP_EXECUTE_INLINE
-      // and possibly any smart handling of String
-      static auto str = DexType::make_type("Ljava/lang/String;");
-      if (mtype == str) return;
-      auto real_ref = rebind_object_methods(mref);
-      if (real_ref) {
-        rebind_method_opcode(mop, mref, real_ref);
-        return;
+      // The binding only depends on the ref, so it's computed once per ref
+      // and shared by all the threads.
+      auto binding = m_virtual_bindings.get_or_insert(mref, [&]() {
+        return std::make_pair(mref, bind_virtual(mref));
+      });
+      switch (binding.kind) {
+        case VirtualBinding::STRING:
+          return;
+        case VirtualBinding::ARRAY_CLONE:
+          stats.array_clone_refs.insert(mref, binding.target);
+          break;
+        case VirtualBinding::EQUALS:
+          stats.equals_refs.insert(mref);
+          break;
+        case VirtualBinding::HASHCODE:
+          stats.hashCode_refs.insert(mref);
+          break;
+        case VirtualBinding::GETCLASS:
+          stats.getClass_refs.insert(mref);
+          break;
+        case VirtualBinding::ANCESTOR:
+          break;
       }
-      auto cls = type_class(mtype);
-      real_ref = bind_to_visible_ancestor(
-          cls, mref->get_name(), mref->get_proto());
-      rebind_method_opcode(mop, mref, real_ref);
+      rebind_method_opcode(stats, mop, mref, binding.target);
       return;
     }
-    rebind_method_opcode(mop, mref, resolve_method(mref, search));
+    rebind_method_opcode(
+        stats, mop, mref, resolve_method_cached(mref, search));
+  }
+
+  Binding bind_virtual(DexMethodRef* mref) {
+    auto mtype = mref->get_class();
+    if (is_array_clone(mref, mtype)) {
+      return {VirtualBinding::ARRAY_CLONE, object_array_clone()};
+    }
+    // leave java.lang.String alone not to interfere with OP_EXECUTE_INLINE
+    // and possibly any smart handling of String
+    static auto str = DexType::make_type("Ljava/lang/String;");
+    if (mtype == str) {
+      return {VirtualBinding::STRING, nullptr};
+    }
+    if (is_object_equals(mref)) {
+      return {VirtualBinding::EQUALS, object_equals()};
+    } else if (is_object_hashCode(mref)) {
+      return {VirtualBinding::HASHCODE, object_hashCode()};
+    } else if (is_object_getClass(mref)) {
+      return {VirtualBinding::GETCLASS, object_getClass()};
+    }
+    auto cls = type_class(mtype);
+    return {VirtualBinding::ANCESTOR,
+            bind_to_visible_ancestor(
+                cls, mref->get_name(), mref->get_proto())};
   }
 
   void rebind_method_opcode(
+      Stats& stats,
       IRInstruction* mop,
       DexMethodRef* mref,
       DexMethodRef* real_ref) {
@@ -240,11 +339,11 @@ struct Rebinder {
       return;
     }
     TRACE(BIND, 2, "Rebinding %s\n\t=>%s\n", SHOW(mref), SHOW(real_ref));
-    m_mrefs.insert(mref, real_ref);
+    stats.mrefs.insert(mref, real_ref);
     mop->set_method(real_ref);
     auto cls = type_class(real_ref->get_class());
     if (cls != nullptr && !is_public(cls)) {
-      set_public(cls);
+      stats.publicized.insert(cls);
     }
   }
 
@@ -255,35 +354,17 @@ struct Rebinder {
         !is_primitive(get_array_type(mtype));
   }
 
-  DexMethodRef* rebind_array_clone(DexMethodRef* mref) {
-   DexMethodRef* real_ref = object_array_clone();
-   m_array_clone_refs.insert(mref, real_ref);
-   return real_ref;
-  }
-
-  DexMethodRef* rebind_object_methods(DexMethodRef* mref) {
-    if (is_object_equals(mref)) {
-      m_equals_refs.insert(mref);
-      return object_equals();
-    } else if (is_object_hashCode(mref)) {
-      m_hashCode_refs.insert(mref);
-      return object_hashCode();
-    } else if (is_object_getClass(mref)) {
-      m_getClass_refs.insert(mref);
-      return object_getClass();
-    }
-    return nullptr;
-  }
-
-  void rebind_field(IRInstruction* insn, FieldSearch field_search) {
+  void rebind_field(Stats& stats,
+                    IRInstruction* insn,
+                    FieldSearch field_search) {
     const auto fref = insn->get_field();
-    const auto real_ref = resolve_field(fref, field_search);
+    const auto real_ref = resolve_field_cached(fref, field_search);
     if (real_ref && real_ref != fref) {
       auto cls = type_class(real_ref->get_class());
       always_assert(cls != nullptr);
       if (!is_public(cls)) {
         if (cls->is_external()) return;
-        set_public(cls);
+        stats.publicized.insert(cls);
       }
       TRACE(BIND,
             2,
@@ -291,19 +372,15 @@ struct Rebinder {
             SHOW(fref),
             SHOW(real_ref));
       insn->set_field(real_ref);
-      m_frefs.insert(fref, real_ref);
+      stats.frefs.insert(fref, real_ref);
     }
   }
 
   Scope& m_scope;
   PassManager& m_pass_mgr;
 
-  RefStats<DexFieldRef*> m_frefs;
-  RefStats<DexMethodRef*> m_mrefs;
-  RefStats<DexMethodRef*> m_array_clone_refs;
-  RefStats<DexMethodRef*> m_equals_refs;
-  RefStats<DexMethodRef*> m_hashCode_refs;
-  RefStats<DexMethodRef*> m_getClass_refs;
+  Stats m_stats;
+  ConcurrentMap<DexMethodRef*, Binding> m_virtual_bindings;
 };
 
 }
@@ -316,4 +393,10 @@ void ReBindRefsPass::run_pass(
   rb.print_stats();
 }
 
+void ReBindRefsPass::preserved_analyses(PreservedAnalyses& preserved) const {
+  // Only the refs in the code and the visibility of classes change.
+  preserved.preserve<ClassHierarchyAnalysis>();
+  preserved.preserve<TypeSystemAnalysis>();
+}
+
 static ReBindRefsPass s_pass;
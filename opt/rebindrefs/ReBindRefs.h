@@ -17,4 +17,5 @@ class ReBindRefsPass : public Pass {
 
   virtual void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  virtual void preserved_analyses(PreservedAnalyses&) const override;
 };
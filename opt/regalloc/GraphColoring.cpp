@@ -80,7 +80,7 @@ static size_t sum_src_sizes(const IRInstruction* insn) {
     // Account for the implicit `this` parameter
     ++size;
   }
-  auto& types = insn->get_method()->get_proto()->get_args()->get_type_list();
+  const auto& types = insn->get_method()->get_proto()->get_args()->get_type_list();
   for (auto* type : types) {
     size += is_wide_type(type) ? 2 : 1;
   }
@@ -633,8 +633,9 @@ void Allocator::select_ranges(const IRCode* code,
       vreg_files.emplace(src, vreg_file);
     }
 
+    std::vector<reg_t> range_regs(insn->srcs().begin(), insn->srcs().end());
     reg_t range_base = find_best_range_fit(ig,
-                                           insn->srcs(),
+                                           range_regs,
                                            0,
                                            reg_transform->size,
                                            vreg_files,
@@ -861,7 +862,7 @@ std::unordered_map<reg_t, IRList::iterator> Allocator::find_param_splits(
 
   auto& cfg = code->cfg();
   Block* start_block = cfg.entry_block();
-  auto postorder_dominator = cfg.immediate_dominators();
+  const auto& dominators = cfg.dominators();
   for (auto param : params) {
     auto block_uses = find_first_uses(param, start_block);
     // Since this function only gets called for param regs that need to be
@@ -873,7 +874,7 @@ std::unordered_map<reg_t, IRList::iterator> Allocator::find_param_splits(
       // insert a load at its end.
       Block* idom = block_uses[0];
       for (size_t index = 1; index < block_uses.size(); ++index) {
-        idom = cfg.idom_intersect(postorder_dominator, idom, block_uses[index]);
+        idom = dominators.common_dominator(idom, block_uses[index]);
       }
       TRACE(REG, 5, "Inserting param load of v%u in B%u\n", param, idom->id());
       // We need to check insn before end of block to make sure we didn't
@@ -1045,6 +1046,11 @@ void Allocator::allocate(IRCode* code) {
   // in the allocation loop below.
   auto range_set = init_range_set(code);
 
+  // Coalescing rewrites the registers of the whole method, so the graph of
+  // the first round is built from scratch and not kept. The graphs of the
+  // following rounds only differ by the spill and split code inserted in
+  // between, so they're updated incrementally.
+  interference::IncrementalGraphBuilder ig_builder;
   bool first{true};
   while (true) {
     SplitCosts split_costs;
@@ -1058,8 +1064,10 @@ void Allocator::allocate(IRCode* code) {
     fixpoint_iter.run(LivenessDomain(code->get_registers_size()));
 
     TRACE(REG, 5, "Allocating:\n%s\n", SHOW(code->cfg()));
-    auto ig =
-        interference::build_graph(fixpoint_iter, code, initial_regs, range_set);
+    auto ig = first ? interference::build_graph(
+                          fixpoint_iter, code, initial_regs, range_set)
+                    : ig_builder.build(
+                          fixpoint_iter, code, initial_regs, range_set);
     TRACE(REG, 7, "IG:\n%s", SHOW(ig));
     if (first) {
       coalesce(&ig, code);
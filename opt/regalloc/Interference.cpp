@@ -9,6 +9,8 @@
 
 #include "Interference.h"
 
+#include <algorithm>
+
 #include "ControlFlow.h"
 #include "DexUtil.h"
 #include "FixpointIterators.h"
@@ -73,6 +75,7 @@ void Graph::add_edge(reg_t u, reg_t v, bool can_coalesce) {
     return;
   }
   if (!is_adjacent(u, v)) {
+    m_adj_matrix.set(u, v);
     auto& u_node = m_nodes.at(u);
     auto& v_node = m_nodes.at(v);
     u_node.m_adjacent.push_back(v);
@@ -89,7 +92,9 @@ void Graph::add_edge(reg_t u, reg_t v, bool can_coalesce) {
   //
   // then the final state of the edge between s0 and s1 must be
   // non-coalesceable.
-  m_adj_matrix[Edge(u, v)] = m_adj_matrix[Edge(u, v)] || !can_coalesce;
+  if (!can_coalesce) {
+    m_not_coalesceable.set(u, v);
+  }
 }
 
 uint32_t Node::colorable_limit() const {
@@ -166,10 +171,12 @@ size_t src_bit_width(IROpcode op, int i) {
 
 void GraphBuilder::update_node_constraints(IRList::iterator it,
                                            const RangeSet& range_set,
+                                           const AffectedRegs* affected,
                                            Graph* graph) {
   auto insn = it->insn;
   auto op = insn->opcode();
-  if (insn->dests_size()) {
+  if (insn->dests_size() &&
+      (affected == nullptr || affected->contains(insn->dest()))) {
     auto dest = insn->dest();
     auto& node = graph->m_nodes[dest];
     if (opcode::is_load_param(op)) {
@@ -186,6 +193,9 @@ void GraphBuilder::update_node_constraints(IRList::iterator it,
 
   for (size_t i = 0; i < insn->srcs_size(); ++i) {
     auto src = insn->src(i);
+    if (affected != nullptr && !affected->contains(src)) {
+      continue;
+    }
     auto& node = graph->m_nodes[src];
     auto type = src_reg_type(insn, i);
     node.m_type_domain.meet_with(RegisterTypeDomain(type));
@@ -264,8 +274,39 @@ Graph GraphBuilder::build(const LivenessFixpointIterator& fixpoint_iter,
   Graph graph;
   auto ii = InstructionIterable(code);
   for (auto it = ii.begin(); it != ii.end(); ++it) {
-    GraphBuilder::update_node_constraints(it.unwrap(), range_set, &graph);
+    GraphBuilder::update_node_constraints(
+        it.unwrap(), range_set, nullptr, &graph);
   }
+  add_edges(fixpoint_iter, code, nullptr, &graph);
+  check_nodes(code, initial_regs, nullptr, &graph);
+  return graph;
+}
+
+/*
+ * Add the edges that involve an affected register (or all the edges if
+ * `affected` is null), and record the liveness at the instructions that may
+ * take the range form.
+ */
+void GraphBuilder::add_edges(const LivenessFixpointIterator& fixpoint_iter,
+                             IRCode* code,
+                             const AffectedRegs* affected,
+                             Graph* graph) {
+  // Call f on the registers of `live` that may have a new edge with u, i.e.
+  // on all of them if u is affected and on the affected ones otherwise.
+  auto for_each_live = [affected](
+                           reg_t u, const LivenessDomain& live, auto&& f) {
+    if (affected == nullptr || affected->contains(u)) {
+      for (auto reg : live.elements()) {
+        f(reg);
+      }
+    } else {
+      for (auto reg : affected->regs) {
+        if (live.contains(reg)) {
+          f(reg);
+        }
+      }
+    }
+  };
 
   auto& cfg = code->cfg();
   for (Block* block : cfg.blocks()) {
@@ -277,15 +318,16 @@ Graph GraphBuilder::build(const LivenessFixpointIterator& fixpoint_iter,
       auto insn = it->insn;
       auto op = insn->opcode();
       if (opcode::has_range_form(op)) {
-        graph.m_range_liveness.emplace(insn, live_out);
+        graph->m_range_liveness.emplace(insn, live_out);
       }
       if (insn->dests_size()) {
-        for (auto reg : live_out.elements()) {
+        auto dest = insn->dest();
+        for_each_live(dest, live_out, [&](reg_t reg) {
           if (is_move(op) && reg == insn->src(0)) {
-            continue;
+            return;
           }
-          graph.add_edge(insn->dest(), reg);
-        }
+          graph->add_edge(dest, reg);
+        });
         // We add interference edges between the wide src and dest operands of
         // an instruction even if the srcs are not live-out. This avoids
         // allocations like `xor-long v1, v0, v9`, where v1 and v0 overlap --
@@ -298,37 +340,50 @@ Graph GraphBuilder::build(const LivenessFixpointIterator& fixpoint_iter,
         // coloring respects.
         if (insn->dest_is_wide()) {
           for (size_t i = 0; i < insn->srcs_size(); ++i) {
-            if (insn->src_is_wide(i)) {
-              graph.add_coalesceable_edge(insn->dest(), insn->src(i));
+            if (insn->src_is_wide(i) &&
+                (affected == nullptr || affected->contains(dest) ||
+                 affected->contains(insn->src(i)))) {
+              graph->add_coalesceable_edge(dest, insn->src(i));
             }
           }
         }
       }
       if (op == OPCODE_CHECK_CAST) {
         auto move_result_pseudo = std::prev(it)->insn;
-        for (auto reg : live_out.elements()) {
-          graph.add_edge(move_result_pseudo->dest(), reg);
-        }
+        auto dest = move_result_pseudo->dest();
+        for_each_live(
+            dest, live_out, [&](reg_t reg) { graph->add_edge(dest, reg); });
       }
       // adding containment edge between liverange defined in insn and elements
       // in live-out set of insn
       if (insn->dests_size()) {
-        for (auto reg : live_out.elements()) {
-          graph.add_containment_edge(insn->dest(), reg);
-        }
+        auto dest = insn->dest();
+        for_each_live(dest, live_out, [&](reg_t reg) {
+          graph->add_containment_edge(dest, reg);
+        });
       }
       fixpoint_iter.analyze_instruction(it->insn, &live_out);
       // adding containment edge between liverange used in insn and elements
       // in live-in set of insn
       for (size_t i = 0; i < insn->srcs_size(); ++i) {
-        for (auto reg : live_out.elements()) {
-          graph.add_containment_edge(insn->src(i), reg);
-        }
+        auto src = insn->src(i);
+        for_each_live(src, live_out, [&](reg_t reg) {
+          graph->add_containment_edge(src, reg);
+        });
       }
     }
   }
-  for (auto& pair : graph.nodes()) {
+}
+
+void GraphBuilder::check_nodes(IRCode* code,
+                               reg_t initial_regs,
+                               const AffectedRegs* affected,
+                               Graph* graph) {
+  for (auto& pair : graph->nodes()) {
     auto reg = pair.first;
+    if (affected != nullptr && !affected->contains(reg)) {
+      continue;
+    }
     auto& node = pair.second;
     if (reg >= initial_regs) {
       node.m_props.set(Node::SPILL);
@@ -338,9 +393,158 @@ Graph GraphBuilder::build(const LivenessFixpointIterator& fixpoint_iter,
                reg,
                SHOW(code));
   }
+}
+
+Graph GraphBuilder::update(const Graph& prev,
+                           const AffectedRegs& affected,
+                           const LivenessFixpointIterator& fixpoint_iter,
+                           IRCode* code,
+                           reg_t initial_regs,
+                           const RangeSet& range_set) {
+  Graph graph(prev);
+  graph.m_range_liveness.clear();
+  // Drop everything we know about the affected registers.
+  for (auto reg : affected.regs) {
+    auto it = graph.m_nodes.find(reg);
+    if (it == graph.m_nodes.end()) {
+      continue;
+    }
+    for (auto adj : it->second.adjacent()) {
+      graph.m_adj_matrix.reset(reg, adj);
+      graph.m_not_coalesceable.reset(reg, adj);
+    }
+    for (const auto& pair : prev.m_nodes) {
+      graph.m_containment_graph.reset(reg, pair.first);
+      graph.m_containment_graph.reset(pair.first, reg);
+    }
+    graph.m_nodes.erase(it);
+  }
+  for (auto& pair : graph.m_nodes) {
+    auto& adjacent = pair.second.m_adjacent;
+    adjacent.erase(std::remove_if(adjacent.begin(),
+                                  adjacent.end(),
+                                  [&affected](reg_t adj) {
+                                    return affected.contains(adj);
+                                  }),
+                   adjacent.end());
+  }
+
+  auto ii = InstructionIterable(code);
+  for (auto it = ii.begin(); it != ii.end(); ++it) {
+    GraphBuilder::update_node_constraints(
+        it.unwrap(), range_set, &affected, &graph);
+  }
+  add_edges(fixpoint_iter, code, &affected, &graph);
+  check_nodes(code, initial_regs, &affected, &graph);
+
+  // The weights of the edges depend on the constraints of both of their
+  // nodes, which may have changed for the affected ones.
+  for (auto& pair : graph.m_nodes) {
+    auto& node = pair.second;
+    node.m_weight = 0;
+    for (auto adj : node.adjacent()) {
+      node.m_weight += graph.edge_weight(node, graph.m_nodes.at(adj));
+    }
+  }
+  return graph;
+}
+
+Graph IncrementalGraphBuilder::build(
+    const LivenessFixpointIterator& fixpoint_iter,
+    IRCode* code,
+    reg_t initial_regs,
+    const RangeSet& range_set) {
+  auto graph =
+      m_graph == nullptr
+          ? GraphBuilder::build(fixpoint_iter, code, initial_regs, range_set)
+          : GraphBuilder::update(*m_graph,
+                                 find_affected(code, range_set),
+                                 fixpoint_iter,
+                                 code,
+                                 initial_regs,
+                                 range_set);
+  m_graph.reset(new Graph(graph));
+  record(code, range_set);
   return graph;
 }
 
+void IncrementalGraphBuilder::record(IRCode* code, const RangeSet& range_set) {
+  m_operands.clear();
+  m_regs.clear();
+  for (const auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    Operands operands{m_operands.size(),
+                      static_cast<uint32_t>(m_regs.size()),
+                      static_cast<uint16_t>(insn->srcs_size()),
+                      insn->dests_size() > 0};
+    if (operands.has_dest) {
+      m_regs.push_back(insn->dest());
+    }
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      m_regs.push_back(insn->src(i));
+    }
+    m_operands.emplace(insn, operands);
+  }
+  m_range_set_size = range_set.size();
+}
+
+AffectedRegs IncrementalGraphBuilder::find_affected(
+    IRCode* code, const RangeSet& range_set) const {
+  AffectedRegs affected;
+  auto insert_regs = [&affected](const IRInstruction* insn) {
+    if (insn->dests_size()) {
+      affected.insert(insn->dest());
+    }
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      affected.insert(insn->src(i));
+    }
+  };
+  auto insert_recorded_regs = [&](const Operands& operands) {
+    auto end = operands.begin + operands.has_dest + operands.srcs_size;
+    for (auto i = operands.begin; i < end; ++i) {
+      affected.insert(m_regs[i]);
+    }
+  };
+
+  std::vector<bool> seen(m_operands.size());
+  for (const auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    auto it = m_operands.find(insn);
+    if (it == m_operands.end()) {
+      insert_regs(insn);
+      continue;
+    }
+    const auto& operands = it->second;
+    seen[operands.index] = true;
+    bool same = operands.has_dest == (insn->dests_size() > 0) &&
+                operands.srcs_size == insn->srcs_size();
+    auto reg = m_regs.begin() + operands.begin;
+    if (same && operands.has_dest) {
+      same = *reg++ == insn->dest();
+    }
+    for (size_t i = 0; same && i < insn->srcs_size(); ++i) {
+      same = *reg++ == insn->src(i);
+    }
+    if (!same) {
+      insert_recorded_regs(operands);
+      insert_regs(insn);
+    }
+  }
+  // The allocation loop doesn't remove instructions, but be safe.
+  for (const auto& pair : m_operands) {
+    if (!seen[pair.second.index]) {
+      insert_recorded_regs(pair.second);
+    }
+  }
+  // The srcs of the instructions that were added to the range set have new
+  // constraints.
+  for (auto it = range_set.begin() + m_range_set_size; it != range_set.end();
+       ++it) {
+    insert_regs(*it);
+  }
+  return affected;
+}
+
 std::ostream& Graph::write_dot_format(std::ostream& o) const {
   o << "graph {\n";
   for (const auto& pair : nodes()) {
@@ -357,10 +561,14 @@ std::ostream& Graph::write_dot_format(std::ostream& o) const {
   o << "}\n";
 
   o << "containment graph {\n";
-  for (const auto& pair : m_containment_graph) {
-    auto reg1 = pair.first;
-    auto reg2 = pair.second;
-    o << reg1 << " -- " << reg2 << "\n";
+  for (const auto& pair1 : nodes()) {
+    for (const auto& pair2 : nodes()) {
+      auto reg1 = pair1.first;
+      auto reg2 = pair2.first;
+      if (has_containment_edge(reg1, reg2)) {
+        o << reg1 << " -- " << reg2 << "\n";
+      }
+    }
   }
   o << "}\n";
   return o;
@@ -9,8 +9,8 @@
 
 #pragma once
 
-#include <boost/functional/hash.hpp>
 #include <boost/range/adaptor/filtered.hpp>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -64,26 +64,84 @@ namespace impl {
 
 class GraphBuilder;
 
-template <typename T>
-struct OrderedPair {
-  T first;
-  T second;
-
-  OrderedPair(T u, T v)
-      : first(std::min(u, v)), second(std::max(u, v)) {}
+/*
+ * The registers whose nodes and edges have to be (re)computed when building a
+ * graph. A null pointer to it stands for all the registers.
+ */
+struct AffectedRegs {
+  std::vector<bool> bits;
+  std::vector<reg_t> regs;
 
-  bool operator==(const OrderedPair& that) const {
-    return first == that.first && second == that.second;
+  void insert(reg_t r) {
+    if (r >= bits.size()) {
+      bits.resize(r + 1, false);
+    }
+    if (!bits[r]) {
+      bits[r] = true;
+      regs.push_back(r);
+    }
   }
+
+  bool contains(reg_t r) const { return r < bits.size() && bits[r]; }
 };
 
-template <typename T>
-inline size_t hash_value(const OrderedPair<T>& pair) {
-  size_t seed{0};
-  boost::hash_combine(seed, pair.first);
-  boost::hash_combine(seed, pair.second);
-  return seed;
-}
+/*
+ * A growable matrix of bits indexed by pairs of registers, stored in one flat
+ * bit vector. Entries are laid out in increasing order of max(u, v), so
+ * making room for a higher-numbered register only appends bits.
+ *
+ * If Symmetric is true, (u, v) and (v, u) share a bit and the diagonal isn't
+ * stored, which halves the footprint.
+ */
+template <bool Symmetric>
+class PairBitMatrix {
+ public:
+  bool get(reg_t u, reg_t v) const {
+    if (Symmetric && u == v) {
+      return false;
+    }
+    auto i = index(u, v);
+    return i / BITS_PER_WORD < m_words.size() &&
+           (m_words[i / BITS_PER_WORD] >> (i % BITS_PER_WORD)) & 1;
+  }
+
+  void set(reg_t u, reg_t v) {
+    always_assert(!Symmetric || u != v);
+    auto i = index(u, v);
+    if (i / BITS_PER_WORD >= m_words.size()) {
+      m_words.resize(i / BITS_PER_WORD + 1, 0);
+    }
+    m_words[i / BITS_PER_WORD] |= uint64_t(1) << (i % BITS_PER_WORD);
+  }
+
+  void reset(reg_t u, reg_t v) {
+    if (Symmetric && u == v) {
+      return;
+    }
+    auto i = index(u, v);
+    if (i / BITS_PER_WORD < m_words.size()) {
+      m_words[i / BITS_PER_WORD] &= ~(uint64_t(1) << (i % BITS_PER_WORD));
+    }
+  }
+
+ private:
+  static constexpr size_t BITS_PER_WORD = 64;
+
+  static size_t index(size_t u, size_t v) {
+    if (Symmetric) {
+      // Lower triangle without the diagonal: row u holds columns [0, u).
+      if (u < v) {
+        std::swap(u, v);
+      }
+      return u * (u - 1) / 2 + v;
+    }
+    // Shell m = max(u, v) holds (m, 0..m) followed by (0..m-1, m).
+    size_t m = std::max(u, v);
+    return m * m + (u == m ? v : m + 1 + u);
+  }
+
+  std::vector<uint64_t> m_words;
+};
 
 } // namespace impl
 
@@ -193,17 +251,14 @@ class Graph {
     return boost::adaptors::filter(m_nodes, ActiveFilter());
   }
 
-  bool is_adjacent(reg_t u, reg_t v) const {
-    return m_adj_matrix.find(Edge(u, v)) != m_adj_matrix.end();
-  }
+  bool is_adjacent(reg_t u, reg_t v) const { return m_adj_matrix.get(u, v); }
 
   bool is_coalesceable(reg_t u, reg_t v) const {
-    return !is_adjacent(u, v) || !m_adj_matrix.at(Edge(u, v));
+    return !m_not_coalesceable.get(u, v);
   }
 
   bool has_containment_edge(reg_t u, reg_t v) const {
-    return m_containment_graph.find(ContainmentEdge(u, v)) !=
-           m_containment_graph.end();
+    return m_containment_graph.get(u, v);
   }
 
   /*
@@ -230,7 +285,6 @@ class Graph {
  private:
   uint32_t edge_weight(const Node&, const Node&) const;
 
-  using ContainmentEdge = std::pair<reg_t, reg_t>;
   Graph() = default;
   void add_edge(reg_t, reg_t, bool can_coalesce = false);
   void add_coalesceable_edge(reg_t u, reg_t v) { add_edge(u, v, true); }
@@ -238,18 +292,18 @@ class Graph {
     if (u == v) {
       return;
     }
-    m_containment_graph.emplace(ContainmentEdge(u, v));
+    m_containment_graph.set(u, v);
   }
 
   // Boolean of whether we should separate symregs requiring less than 16 bits
   // from those without this constraint,
   bool m_separate_node{false};
   std::unordered_map<reg_t, Node> m_nodes;
-  using Edge = impl::OrderedPair<reg_t>;
-  std::unordered_map<Edge, bool /* not_coalesceable */, boost::hash<Edge>>
-      m_adj_matrix;
-  std::unordered_set<ContainmentEdge, boost::hash<ContainmentEdge>>
-      m_containment_graph;
+  // The edges are also kept in each Node's adjacency list; the matrices give
+  // constant-time lookups without hashing.
+  impl::PairBitMatrix</* Symmetric */ true> m_adj_matrix;
+  impl::PairBitMatrix</* Symmetric */ true> m_not_coalesceable;
+  impl::PairBitMatrix</* Symmetric */ false> m_containment_graph;
   // This map contains the LivenessDomains for all instructions which could
   // potentialy take on the /range format.
   std::unordered_map<IRInstruction*, LivenessDomain> m_range_liveness;
@@ -283,14 +337,40 @@ inline uint32_t div_ceil(uint32_t a, uint32_t b) { return (a + b - 1) / b; }
 class GraphBuilder {
   static void update_node_constraints(IRList::iterator,
                                       const RangeSet&,
+                                      const AffectedRegs*,
                                       Graph*);
 
+  static void add_edges(const LivenessFixpointIterator&,
+                        IRCode*,
+                        const AffectedRegs*,
+                        Graph*);
+
+  static void check_nodes(IRCode*,
+                          reg_t initial_regs,
+                          const AffectedRegs*,
+                          Graph*);
+
  public:
   static Graph build(const LivenessFixpointIterator&,
                      IRCode*,
                      reg_t initial_regs,
                      const RangeSet&);
 
+  /*
+   * Build the graph of the code from the graph `prev` of an earlier version
+   * of it, only recomputing the nodes and edges of the affected registers.
+   * The other registers must not occur in any instruction that was inserted
+   * or edited since `prev` was built, and the range set may only have grown.
+   * Their liveness at the instructions that were already there is then
+   * unchanged, and so are their constraints and the edges between them.
+   */
+  static Graph update(const Graph& prev,
+                      const AffectedRegs& affected,
+                      const LivenessFixpointIterator&,
+                      IRCode*,
+                      reg_t initial_regs,
+                      const RangeSet&);
+
   // For unit tests
   static Graph create_empty() { return Graph(); }
   static void make_node(Graph*, reg_t, RegisterType, reg_t max_vreg);
@@ -309,6 +389,41 @@ inline Graph build_graph(const LivenessFixpointIterator& fixpoint_iter,
       fixpoint_iter, code, initial_regs, range_set);
 }
 
+/*
+ * Builds the interference graphs of the successive rounds of the allocation
+ * loop. The spill and split code that a round inserts only mentions the
+ * spilled and split registers and the new temps, so the next graph is
+ * computed by updating a copy of the previous one for the registers that
+ * occur in an instruction that was inserted or edited since. The operands of
+ * the code are recorded along with each graph to find these instructions.
+ *
+ * The graphs are the same as the ones build_graph() would return.
+ */
+class IncrementalGraphBuilder {
+ public:
+  Graph build(const LivenessFixpointIterator& fixpoint_iter,
+              IRCode* code,
+              reg_t initial_regs,
+              const RangeSet& range_set);
+
+ private:
+  struct Operands {
+    size_t index;
+    uint32_t begin;
+    uint16_t srcs_size;
+    bool has_dest;
+  };
+
+  void record(IRCode*, const RangeSet&);
+
+  impl::AffectedRegs find_affected(IRCode*, const RangeSet&) const;
+
+  std::unique_ptr<Graph> m_graph;
+  std::unordered_map<const IRInstruction*, Operands> m_operands;
+  std::vector<reg_t> m_regs;
+  size_t m_range_set_size{0};
+};
+
 } // interference
 
 } // namespace regalloc
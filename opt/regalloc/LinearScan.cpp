@@ -0,0 +1,525 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "LinearScan.h"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <unordered_set>
+
+#include "ControlFlow.h"
+#include "Debug.h"
+#include "DexUtil.h"
+#include "GraphColoring.h"
+#include "Interference.h"
+#include "Liveness.h"
+#include "RegisterType.h"
+#include "Trace.h"
+#include "VirtualRegistersFile.h"
+
+namespace regalloc {
+
+namespace linear_scan {
+
+namespace {
+
+// A param that doesn't fit at least this many of its operands is copied to an
+// interval instead of being moved to a scratch vreg at each of them.
+constexpr size_t PARAM_SPLIT_THRESHOLD = 2;
+
+constexpr uint32_t NO_POS = std::numeric_limits<uint32_t>::max();
+
+const reg_t MAX_VREG = max_unsigned_value(16);
+
+/*
+ * What we know about a symreg. The uses of the i-th instruction are at
+ * position 2i and its def at position 2i+1, so the dest of an instruction can
+ * get the vreg of a src that dies there. The interval [start, end] covers all
+ * the positions at which the symreg is live.
+ */
+struct SymReg {
+  uint32_t start{NO_POS};
+  uint32_t end{0};
+  uint8_t width{1};
+  bool is_param{false};
+  RegisterTypeDomain type{RegisterType::UNKNOWN};
+
+  bool occurs() const { return start != NO_POS; }
+
+  void extend(uint32_t pos) {
+    start = std::min(start, pos);
+    end = std::max(end, pos);
+  }
+};
+
+bool is_movable(RegisterType type) {
+  switch (type) {
+  case RegisterType::ZERO:
+  case RegisterType::NORMAL:
+  case RegisterType::WIDE:
+  case RegisterType::OBJECT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/*
+ * A symreg that is live at some point of a block is either live-in or defined
+ * earlier in the block, and either live-out or used later in the block. So
+ * extending the interval to the block boundaries for its live-in and live-out
+ * symregs, and to the positions of the operands, covers every point where it
+ * is live. The blocks can be visited in any order.
+ */
+std::vector<SymReg> build_intervals(
+    const LivenessFixpointIterator& fixpoint_iter, IRCode* code) {
+  std::vector<SymReg> symregs(code->get_registers_size());
+  uint32_t index{0};
+  for (Block* block : code->cfg().blocks()) {
+    auto block_start = index;
+    for (const auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      auto op = insn->opcode();
+      uint32_t use = 2 * index;
+      uint32_t def = use + 1;
+      if (opcode::is_move_result_pseudo(op) && index > block_start) {
+        // The dest of a move-result-pseudo is written by its primary
+        // instruction. This matters for check-cast, which gets lowered to a
+        // move to its dest followed by a check-cast of that dest: the dest
+        // must not clobber anything that is live-out of the check-cast.
+        def = use - 1;
+      }
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        auto& symreg = symregs.at(insn->src(i));
+        symreg.extend(use);
+        symreg.type.meet_with(RegisterTypeDomain(src_reg_type(insn, i)));
+        if (insn->src_is_wide(i)) {
+          symreg.width = 2;
+        }
+      }
+      if (insn->dests_size()) {
+        auto& symreg = symregs.at(insn->dest());
+        symreg.extend(def);
+        symreg.type.meet_with(RegisterTypeDomain(dest_reg_type(insn)));
+        if (insn->dest_is_wide()) {
+          symreg.width = 2;
+          // Keep the wide srcs from overlapping a wide dest. See the comment
+          // about `xor-long` in GraphBuilder::add_edges().
+          for (size_t i = 0; i < insn->srcs_size(); ++i) {
+            if (insn->src_is_wide(i)) {
+              symregs.at(insn->src(i)).extend(def);
+            }
+          }
+        }
+        if (opcode::is_load_param(op)) {
+          symreg.is_param = true;
+        }
+      }
+      ++index;
+    }
+    if (index == block_start) {
+      continue;
+    }
+    uint32_t first = 2 * block_start;
+    uint32_t last = 2 * (index - 1) + 1;
+    auto live_in = fixpoint_iter.get_live_in_vars_at(block);
+    for (auto reg : live_in.elements()) {
+      symregs.at(reg).extend(first);
+    }
+    auto live_out = fixpoint_iter.get_live_out_vars_at(block);
+    for (auto reg : live_out.elements()) {
+      symregs.at(reg).extend(last);
+    }
+  }
+  return symregs;
+}
+
+/*
+ * Give each interval that isn't a param the lowest vreg that is free over
+ * all of it. Returns the vregs, and sets :size to the number of vregs used.
+ */
+std::vector<reg_t> scan(const std::vector<SymReg>& symregs, reg_t* size) {
+  std::vector<reg_t> order;
+  for (reg_t reg = 0; reg < symregs.size(); ++reg) {
+    if (symregs[reg].occurs() && !symregs[reg].is_param) {
+      order.push_back(reg);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&](reg_t a, reg_t b) {
+    return symregs[a].start != symregs[b].start
+               ? symregs[a].start < symregs[b].start
+               : a < b;
+  });
+
+  // The active intervals, by increasing end
+  using Active = std::pair<uint32_t, reg_t>;
+  std::priority_queue<Active, std::vector<Active>, std::greater<Active>> active;
+  VirtualRegistersFile vreg_file;
+  std::vector<reg_t> vregs(symregs.size());
+  for (auto reg : order) {
+    const auto& symreg = symregs[reg];
+    while (!active.empty() && active.top().first < symreg.start) {
+      auto expired = active.top().second;
+      vreg_file.free(vregs[expired], symregs[expired].width);
+      active.pop();
+    }
+    vregs[reg] = vreg_file.alloc(symreg.width);
+    active.emplace(symreg.end, reg);
+  }
+  *size = vreg_file.size();
+  return vregs;
+}
+
+/*
+ * The same constraints as in GraphBuilder::update_node_constraints(), for
+ * instructions that aren't in the range set.
+ */
+reg_t max_src_vreg(const IRInstruction* insn, size_t i) {
+  auto op = insn->opcode();
+  if (opcode::has_range_form(op) && insn->srcs_size() == 1) {
+    return MAX_VREG;
+  }
+  reg_t max_vreg = max_unsigned_value(interference::src_bit_width(op, i));
+  if (is_invoke(op) && insn->src_is_wide(i)) {
+    // Leave room for the upper half of the pair after denormalization.
+    --max_vreg;
+  }
+  return max_vreg;
+}
+
+reg_t max_dest_vreg(IRList::iterator it) {
+  return max_unsigned_value(interference::dest_bit_width(it));
+}
+
+/*
+ * The number of scratch vregs that any non-range instruction may need, i.e.
+ * the largest number of vregs taken by the constrained operands of one.
+ */
+reg_t scratch_size_bound(IRCode* code, const RangeSet& range_set) {
+  reg_t bound{0};
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type != MFLOW_OPCODE || range_set.contains(it->insn)) {
+      continue;
+    }
+    auto insn = it->insn;
+    reg_t words{0};
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      if (max_src_vreg(insn, i) < MAX_VREG) {
+        words += insn->src_is_wide(i) ? 2 : 1;
+      }
+    }
+    if (insn->dests_size() && max_dest_vreg(it) < MAX_VREG) {
+      words += insn->dest_is_wide() ? 2 : 1;
+    }
+    bound = std::max(bound, words);
+  }
+  return bound;
+}
+
+struct Layout {
+  // The vreg of each symreg
+  std::vector<reg_t> vregs;
+  reg_t scratch_size{0};
+  reg_t range_base{0};
+  reg_t size{0};
+  // The range instructions whose srcs have to be moved to the range area
+  std::unordered_set<const IRInstruction*> moved_ranges;
+};
+
+/*
+ * Whether the srcs of a range instruction already sit next to each other.
+ * Only srcs that are all params or all intervals are considered, so that the
+ * answer doesn't depend on where the range area and the params go.
+ */
+bool has_contiguous_vregs(const IRInstruction* insn,
+                          const std::vector<SymReg>& symregs,
+                          const std::vector<reg_t>& vregs) {
+  for (size_t i = 1; i < insn->srcs_size(); ++i) {
+    const auto& prev = symregs[insn->src(i - 1)];
+    if (symregs[insn->src(i)].is_param != prev.is_param ||
+        vregs[insn->src(i)] != vregs[insn->src(i - 1)] + prev.width) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool fits(IRCode* code,
+          const RangeSet& range_set,
+          const std::vector<reg_t>& vregs) {
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type != MFLOW_OPCODE || range_set.contains(it->insn)) {
+      continue;
+    }
+    auto insn = it->insn;
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      if (vregs[insn->src(i)] > max_src_vreg(insn, i)) {
+        return false;
+      }
+    }
+    if (insn->dests_size() && vregs[insn->dest()] > max_dest_vreg(it)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Lay out the frame, reserving scratch vregs only if some operand doesn't fit
+ * without them.
+ */
+Layout make_layout(IRCode* code,
+                   const RangeSet& range_set,
+                   const std::vector<SymReg>& symregs) {
+  Layout layout;
+  reg_t intervals_size;
+  auto relative_vregs = scan(symregs, &intervals_size);
+
+  // The params are numbered from 0 here too, until we know where they go.
+  reg_t params_size{0};
+  for (const auto& mie : InstructionIterable(code->get_param_instructions())) {
+    auto dest = mie.insn->dest();
+    relative_vregs[dest] = params_size;
+    params_size += symregs[dest].width;
+  }
+
+  reg_t range_size{0};
+  for (auto insn : range_set) {
+    if (!has_contiguous_vregs(insn, symregs, relative_vregs)) {
+      layout.moved_ranges.emplace(insn);
+      reg_t words{0};
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        words += symregs[insn->src(i)].width;
+      }
+      range_size = std::max(range_size, words);
+    }
+  }
+
+  auto place = [&](reg_t scratch_size) {
+    layout.scratch_size = scratch_size;
+    layout.range_base = scratch_size + intervals_size;
+    reg_t params_base = layout.range_base + range_size;
+    layout.vregs.resize(symregs.size());
+    for (reg_t reg = 0; reg < symregs.size(); ++reg) {
+      layout.vregs[reg] =
+          relative_vregs[reg] +
+          (symregs[reg].is_param ? params_base : scratch_size);
+    }
+    always_assert(params_base + params_size <= MAX_VREG);
+    layout.size = params_base + params_size;
+  };
+  place(0);
+  if (!fits(code, range_set, layout.vregs)) {
+    place(scratch_size_bound(code, range_set));
+  }
+  return layout;
+}
+
+struct Move {
+  IRList::iterator it;
+  bool after;
+  // The symreg whose value is moved
+  reg_t reg;
+  reg_t dest;
+  reg_t src;
+};
+
+// An operand that doesn't get the vreg of its symreg. A src_index of -1
+// stands for the dest.
+struct Operand {
+  IRInstruction* insn;
+  int src_index;
+  reg_t vreg;
+};
+
+struct Rewrite {
+  std::vector<Move> moves;
+  std::vector<Operand> operands;
+  // The number of operands of each param that need a scratch vreg
+  std::unordered_map<reg_t, size_t> param_misfits;
+};
+
+Rewrite plan_rewrite(IRCode* code,
+                     const RangeSet& range_set,
+                     const std::vector<SymReg>& symregs,
+                     const Layout& layout) {
+  Rewrite rewrite;
+  const auto& vregs = layout.vregs;
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto insn = it->insn;
+    if (range_set.contains(insn)) {
+      if (layout.moved_ranges.count(insn)) {
+        auto vreg = layout.range_base;
+        for (size_t i = 0; i < insn->srcs_size(); ++i) {
+          auto src = insn->src(i);
+          rewrite.moves.push_back(Move{it, false, src, vreg, vregs[src]});
+          rewrite.operands.push_back(Operand{insn, static_cast<int>(i), vreg});
+          vreg += symregs[src].width;
+        }
+      }
+      continue;
+    }
+    // The scratch vregs are only live around this instruction. A symreg
+    // that occurs as several srcs gets a single one.
+    reg_t next_scratch{0};
+    std::vector<std::pair<reg_t, reg_t>> scratch_srcs;
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      auto src = insn->src(i);
+      if (vregs[src] <= max_src_vreg(insn, i)) {
+        continue;
+      }
+      auto found = std::find_if(
+          scratch_srcs.begin(),
+          scratch_srcs.end(),
+          [src](const std::pair<reg_t, reg_t>& p) { return p.first == src; });
+      reg_t scratch;
+      if (found != scratch_srcs.end()) {
+        scratch = found->second;
+      } else {
+        scratch = next_scratch;
+        next_scratch += symregs[src].width;
+        scratch_srcs.emplace_back(src, scratch);
+        rewrite.moves.push_back(Move{it, false, src, scratch, vregs[src]});
+      }
+      rewrite.operands.push_back(Operand{insn, static_cast<int>(i), scratch});
+      if (symregs[src].is_param) {
+        ++rewrite.param_misfits[src];
+      }
+    }
+    if (insn->dests_size() && vregs[insn->dest()] > max_dest_vreg(it)) {
+      auto dest = insn->dest();
+      // Distinct from the scratch srcs, so a wide dest doesn't overlap them.
+      auto scratch = next_scratch;
+      next_scratch += symregs[dest].width;
+      rewrite.moves.push_back(Move{it, true, dest, vregs[dest], scratch});
+      rewrite.operands.push_back(Operand{insn, -1, scratch});
+    }
+    always_assert(next_scratch <= layout.scratch_size);
+  }
+  return rewrite;
+}
+
+} // namespace
+
+void Allocator::Stats::accumulate(const Allocator::Stats& that) {
+  scratch_moves += that.scratch_moves;
+  range_moves += that.range_moves;
+  param_moves += that.param_moves;
+}
+
+bool Allocator::allocate(IRCode* code) {
+  auto range_set = init_range_set(code);
+  bool params_split{false};
+  while (true) {
+    auto& cfg = code->cfg();
+    cfg.calculate_exit_block();
+    LivenessFixpointIterator fixpoint_iter(cfg);
+    fixpoint_iter.run(LivenessDomain(code->get_registers_size()));
+
+    auto symregs = build_intervals(fixpoint_iter, code);
+    auto layout = make_layout(code, range_set, symregs);
+    auto rewrite = plan_rewrite(code, range_set, symregs, layout);
+    TRACE(REG,
+          5,
+          "Linear scan: %u scratch, range area at %u, frame size %u\n",
+          layout.scratch_size,
+          layout.range_base,
+          layout.size);
+
+    if (!params_split) {
+      // Copy the params that would take several scratch moves, and lay out
+      // the frame again. This happens at most once.
+      params_split = true;
+      std::unordered_set<reg_t> to_split;
+      for (const auto& pair : rewrite.param_misfits) {
+        if (pair.second >= PARAM_SPLIT_THRESHOLD &&
+            is_movable(symregs[pair.first].type.element())) {
+          to_split.emplace(pair.first);
+        }
+      }
+      if (!to_split.empty()) {
+        auto param_insns = code->get_param_instructions();
+        std::vector<IRInstruction*> copies;
+        for (auto& mie : InstructionIterable(param_insns)) {
+          auto dest = mie.insn->dest();
+          if (to_split.count(dest)) {
+            auto temp = code->allocate_temp();
+            mie.insn->set_dest(temp);
+            copies.push_back(
+                gen_move(symregs[dest].type.element(), dest, temp));
+          }
+        }
+        auto pos = param_insns.end();
+        for (auto copy : copies) {
+          code->insert_before(pos, copy);
+        }
+        m_stats.param_moves += copies.size();
+        code->build_cfg();
+        continue;
+      }
+    }
+
+    for (const auto& move : rewrite.moves) {
+      if (!is_movable(symregs[move.reg].type.element())) {
+        TRACE(REG, 3, "Linear scan can't move v%u\n", move.reg);
+        return false;
+      }
+    }
+
+    const auto& vregs = layout.vregs;
+    for (auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        insn->set_src(i, vregs[insn->src(i)]);
+      }
+      if (insn->dests_size()) {
+        insn->set_dest(vregs[insn->dest()]);
+      }
+    }
+    for (const auto& operand : rewrite.operands) {
+      if (operand.src_index < 0) {
+        operand.insn->set_dest(operand.vreg);
+      } else {
+        operand.insn->set_src(operand.src_index, operand.vreg);
+      }
+    }
+    for (const auto& move : rewrite.moves) {
+      auto insn =
+          gen_move(symregs[move.reg].type.element(), move.dest, move.src);
+      if (move.after) {
+        code->insert_after(move.it, insn);
+      } else {
+        code->insert_before(move.it, insn);
+      }
+      if (range_set.contains(move.it->insn)) {
+        ++m_stats.range_moves;
+      } else {
+        ++m_stats.scratch_moves;
+      }
+    }
+    code->set_registers_size(layout.size);
+    // The moves may have been inserted across block boundaries.
+    code->build_cfg();
+    break;
+  }
+
+  TRACE(REG, 3, "Linear scan moves: %lu\n", m_stats.moves_inserted());
+  TRACE(REG, 3, "  Scratch moves: %lu\n", m_stats.scratch_moves);
+  TRACE(REG, 3, "  Range moves: %lu\n", m_stats.range_moves);
+  TRACE(REG, 3, "  Param moves: %lu\n", m_stats.param_moves);
+  return true;
+}
+
+} // namespace linear_scan
+
+} // namespace regalloc
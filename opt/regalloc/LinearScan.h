@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "IRCode.h"
+
+namespace regalloc {
+
+namespace linear_scan {
+
+/*
+ * A linear-scan register allocator, meant for methods that are too big or too
+ * cold to be worth the time of the graph coloring allocator.
+ *
+ * The live range of each symreg is approximated by a single interval over a
+ * linear order of the instructions, and the intervals are given the lowest
+ * free vregs in order of their start. Unlike the graph coloring allocator,
+ * it doesn't iterate until every operand fits its encoding. Instead, the
+ * frame is laid out as
+ *
+ *   [scratch vregs][intervals][range area][params]
+ *
+ * and a single rewrite fixes up the operands that don't fit:
+ *
+ *   * An operand whose vreg is too large for its instruction is moved to or
+ *     from one of the scratch vregs around that instruction. There are at
+ *     most a handful of them, so they're all addressable with 4 bits.
+ *   * The srcs of a range instruction that aren't already contiguous are
+ *     moved to the range area just before it.
+ *   * The params are loaded at the end of the frame. A param that would need
+ *     several scratch moves is copied to an interval right after the
+ *     load-param opcodes instead, the way the graph coloring allocator splits
+ *     params.
+ *
+ * The time taken is linear in the size of the code, plus the liveness
+ * analysis and a sort of the intervals. The frames are usually a bit larger
+ * and there are more moves than with graph coloring.
+ *
+ * Relevant sources consulted when implementing this:
+ *
+ *  [Poletto99] Massimiliano Poletto and Vivek Sarkar. Linear Scan Register
+ *    Allocation. ACM TOPLAS, 1999.
+ */
+class Allocator {
+ public:
+  struct Stats {
+    size_t scratch_moves{0};
+    size_t range_moves{0};
+    size_t param_moves{0};
+    size_t moves_inserted() const {
+      return scratch_moves + range_moves + param_moves;
+    }
+    void accumulate(const Stats&);
+  };
+
+  /*
+   * Expects the code to have a CFG and its registers renumbered by live
+   * range. Returns false if it can't allocate the code, e.g. because it would
+   * have to move a register it can't infer the type of. The code is then left
+   * for the graph coloring allocator, possibly with some params split.
+   */
+  bool allocate(IRCode*);
+
+  const Stats& get_stats() const { return m_stats; }
+
+ private:
+  Stats m_stats;
+};
+
+} // namespace linear_scan
+
+} // namespace regalloc
@@ -11,12 +11,12 @@
 
 #include "ControlFlow.h"
 #include "FixpointIterators.h"
-#include "SparseSetAbstractDomain.h"
+#include "DenseSetAbstractDomain.h"
 
 namespace regalloc {
 
 using namespace std::placeholders;
-using LivenessDomain = SparseSetAbstractDomain;
+using LivenessDomain = DenseSetAbstractDomain;
 
 class LivenessFixpointIterator final
     : public MonotonicFixpointIterator<
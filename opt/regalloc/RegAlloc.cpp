@@ -16,22 +16,68 @@
 #include "GraphColoring.h"
 #include "IRCode.h"
 #include "IRInstruction.h"
+#include "LinearScan.h"
 #include "LiveRange.h"
 #include "Transform.h"
 #include "Walkers.h"
 
 using namespace regalloc;
 
+namespace {
+
+struct Stats {
+  graph_coloring::Allocator::Stats graph_coloring;
+  linear_scan::Allocator::Stats linear_scan;
+  size_t linear_scan_methods{0};
+  size_t linear_scan_fallbacks{0};
+
+  void accumulate(const Stats& that) {
+    graph_coloring.accumulate(that.graph_coloring);
+    linear_scan.accumulate(that.linear_scan);
+    linear_scan_methods += that.linear_scan_methods;
+    linear_scan_fallbacks += that.linear_scan_fallbacks;
+  }
+};
+
+} // namespace
+
 void RegAllocPass::run_pass(DexStoresVector& stores,
-                            ConfigFiles&,
+                            ConfigFiles& cfg,
                             PassManager& mgr) {
   using Data = std::nullptr_t;
-  using Output = graph_coloring::Allocator::Stats;
+  using Output = Stats;
+
+  // The methods of the profile, by deobfuscated name as in DexOutput. The
+  // ones that aren't in it are cold.
+  std::unordered_set<std::string> profiled_methods;
+  if (m_linear_scan_unprofiled) {
+    auto& pg_map = cfg.get_proguard_map();
+    for (const auto& method : cfg.get_coldstart_methods()) {
+      profiled_methods.emplace(pg_map.deobfuscate_method(method));
+    }
+  }
+  BudgetTracker budget(m_time_budget);
+  auto use_linear_scan = [&](DexMethod* m, IRCode& code) {
+    if (m_linear_scan_min_insns > 0 &&
+        code.count_opcodes() >= static_cast<size_t>(m_linear_scan_min_insns)) {
+      return true;
+    }
+    if (!profiled_methods.empty() &&
+        profiled_methods.count(m->get_deobfuscated_name()) == 0) {
+      return true;
+    }
+    if (budget.pass_exhausted()) {
+      budget.record_fallback("linear_scan_methods");
+      return true;
+    }
+    return false;
+  };
+
   auto scope = build_class_scope(stores);
   auto stats = walk::parallel::reduce_methods<Data, Output>(
       scope,
-      [this](Data&, DexMethod* m) { // mapper
-        graph_coloring::Allocator::Stats stats;
+      [&](Data&, DexMethod* m) { // mapper
+        Stats stats;
         if (m->get_code() == nullptr) {
           return stats;
         }
@@ -52,9 +98,22 @@ void RegAllocPass::run_pass(DexStoresVector& stores,
           // get confused.
           transform::remove_unreachable_blocks(&code);
           live_range::renumber_registers(&code);
-          graph_coloring::Allocator allocator(m_allocator_config);
-          allocator.allocate(&code);
-          stats.accumulate(allocator.get_stats());
+          bool allocated{false};
+          if (use_linear_scan(m, code)) {
+            linear_scan::Allocator allocator;
+            allocated = allocator.allocate(&code);
+            stats.linear_scan.accumulate(allocator.get_stats());
+            if (allocated) {
+              ++stats.linear_scan_methods;
+            } else {
+              ++stats.linear_scan_fallbacks;
+            }
+          }
+          if (!allocated) {
+            graph_coloring::Allocator allocator(m_allocator_config);
+            allocator.allocate(&code);
+            stats.graph_coloring.accumulate(allocator.get_stats());
+          }
 
           TRACE(REG,
                 5,
@@ -76,21 +135,38 @@ void RegAllocPass::run_pass(DexStoresVector& stores,
         return nullptr;
       });
 
-  TRACE(REG, 1, "Total reiteration count: %lu\n", stats.reiteration_count);
-  TRACE(REG, 1, "Total Params spilled early: %lu\n", stats.params_spill_early);
-  TRACE(REG, 1, "Total spill count: %lu\n", stats.moves_inserted());
-  TRACE(REG, 1, "  Total param spills: %lu\n", stats.param_spill_moves);
-  TRACE(REG, 1, "  Total range spills: %lu\n", stats.range_spill_moves);
-  TRACE(REG, 1, "  Total global spills: %lu\n", stats.global_spill_moves);
-  TRACE(REG, 1, "  Total splits: %lu\n", stats.split_moves);
-  TRACE(REG, 1, "Total coalesce count: %lu\n", stats.moves_coalesced);
-  TRACE(REG, 1, "Total net moves: %ld\n", stats.net_moves());
-
-  mgr.incr_metric("param spilled too early", stats.params_spill_early);
-  mgr.incr_metric("reiteration_count", stats.reiteration_count);
-  mgr.incr_metric("spill_count", stats.moves_inserted());
-  mgr.incr_metric("coalesce_count", stats.moves_coalesced);
-  mgr.incr_metric("net_moves", stats.net_moves());
+  const auto& gc_stats = stats.graph_coloring;
+  TRACE(REG, 1, "Total reiteration count: %lu\n", gc_stats.reiteration_count);
+  TRACE(REG,
+        1,
+        "Total Params spilled early: %lu\n",
+        gc_stats.params_spill_early);
+  TRACE(REG, 1, "Total spill count: %lu\n", gc_stats.moves_inserted());
+  TRACE(REG, 1, "  Total param spills: %lu\n", gc_stats.param_spill_moves);
+  TRACE(REG, 1, "  Total range spills: %lu\n", gc_stats.range_spill_moves);
+  TRACE(REG, 1, "  Total global spills: %lu\n", gc_stats.global_spill_moves);
+  TRACE(REG, 1, "  Total splits: %lu\n", gc_stats.split_moves);
+  TRACE(REG, 1, "Total coalesce count: %lu\n", gc_stats.moves_coalesced);
+  TRACE(REG, 1, "Total net moves: %ld\n", gc_stats.net_moves());
+  TRACE(REG,
+        1,
+        "Linear scan methods: %lu (%lu fell back to graph coloring)\n",
+        stats.linear_scan_methods,
+        stats.linear_scan_fallbacks);
+  TRACE(REG,
+        1,
+        "  Linear scan moves: %lu\n",
+        stats.linear_scan.moves_inserted());
+
+  mgr.incr_metric("param spilled too early", gc_stats.params_spill_early);
+  mgr.incr_metric("reiteration_count", gc_stats.reiteration_count);
+  mgr.incr_metric("spill_count", gc_stats.moves_inserted());
+  mgr.incr_metric("coalesce_count", gc_stats.moves_coalesced);
+  mgr.incr_metric("net_moves", gc_stats.net_moves());
+  mgr.incr_metric("linear_scan_methods", stats.linear_scan_methods);
+  mgr.incr_metric("linear_scan_fallbacks", stats.linear_scan_fallbacks);
+  mgr.incr_metric("linear_scan_moves", stats.linear_scan.moves_inserted());
+  budget.report(mgr);
 
   mgr.record_running_regalloc();
 }
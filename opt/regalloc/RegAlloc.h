@@ -20,9 +20,23 @@ class RegAllocPass : public Pass {
   virtual void configure_pass(const PassConfig& pc) override {
     pc.get("live_range_splitting", false, m_allocator_config.use_splitting);
     pc.get("use_spill_costs", false, m_allocator_config.use_spill_costs);
+    pc.get("linear_scan_min_insns", 0, m_linear_scan_min_insns);
+    pc.get("linear_scan_unprofiled_methods", false, m_linear_scan_unprofiled);
+    m_time_budget = pc.get_time_budget();
   }
   virtual void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  virtual bool is_method_local() const override { return true; }
+
  private:
   regalloc::graph_coloring::Allocator::Config m_allocator_config;
+  // Methods with at least this many instructions are allocated by linear
+  // scan instead of graph coloring. Zero disables it.
+  int64_t m_linear_scan_min_insns{0};
+  // Whether the methods missing from a non-empty method profile are
+  // allocated by linear scan.
+  bool m_linear_scan_unprofiled{false};
+  // Once the pass budget is spent, the remaining methods are allocated by
+  // linear scan too.
+  TimeBudget m_time_budget;
 };
@@ -21,6 +21,10 @@ reg_t VirtualRegistersFile::alloc(size_t width) {
 outer:
   while (next_free != boost::dynamic_bitset<>::npos) {
     for (reg_t i = 1; i < width; ++i) {
+      // A free slot that runs past the end of the file can just grow it.
+      if (next_free + i >= m_free.size()) {
+        break;
+      }
       if (!m_free[next_free + i]) {
         next_free = m_free.find_next(next_free + i);
         goto outer;
@@ -12,12 +12,14 @@
 #include <boost/regex.hpp>
 #include <tuple>
 
+#include "ConcurrentContainers.h"
 #include "Dataflow.h"
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "RemoveBuildersHelper.h"
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -49,7 +51,7 @@ bool this_arg_escapes(DexMethod* method, bool enable_buildee_constr_change) {
   auto regs_size = code->get_registers_size();
   auto this_cls = method->get_class();
   code->build_cfg();
-  auto blocks = postorder_sort(code->cfg().blocks());
+  auto blocks = code->cfg().postorder();
   std::reverse(blocks.begin(), blocks.end());
   std::function<void(IRList::iterator, TaintedRegs*)> trans =
       [&](IRList::iterator it, TaintedRegs* tregs) {
@@ -217,7 +219,7 @@ bool RemoveBuildersPass::escapes_stack(DexType* builder, DexMethod* method) {
 
   auto code = method->get_code();
   code->build_cfg();
-  auto blocks = postorder_sort(code->cfg().blocks());
+  auto blocks = code->cfg().postorder();
   std::reverse(blocks.begin(), blocks.end());
   auto regs_size = method->get_code()->get_registers_size();
   auto taint_map = get_tainted_regs(regs_size, blocks, builder);
@@ -249,24 +251,39 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
     }
   }
 
-  std::unordered_set<DexType*> escaped_builders;
-  walk::methods(scope, [&](DexMethod* m) {
-    auto builders = created_builders(m);
-    for (DexType* builder : builders) {
+  // Find the builders each method creates and whether any of them escapes
+  // there, for all the methods in parallel. Each method is analyzed once per
+  // builder it creates, however many instances it creates.
+  std::vector<DexMethod*> methods;
+  walk::methods(scope, [&](DexMethod* m) { methods.push_back(m); });
+  std::vector<std::vector<DexType*>> method_builders(methods.size());
+  ConcurrentSet<DexType*> escaped_builders;
+  auto escapes_wq = workqueue_foreach<size_t>([&](size_t i) {
+    DexMethod* m = methods[i];
+    method_builders[i] = created_builders(m);
+    std::unordered_set<DexType*> analyzed;
+    for (DexType* builder : method_builders[i]) {
+      if (!analyzed.insert(builder).second) {
+        continue;
+      }
       if (escapes_stack(builder, m)) {
         TRACE(BUILDERS,
               3,
               "%s escapes in %s\n",
               SHOW(builder),
               m->get_deobfuscated_name().c_str());
-        escaped_builders.emplace(builder);
+        escaped_builders.insert(builder);
       }
     }
   });
+  for (size_t i = 0; i < methods.size(); ++i) {
+    escapes_wq.add_item(i);
+  }
+  escapes_wq.run_all();
 
   std::unordered_set<DexType*> stack_only_builders;
   for (DexType* builder : m_builders) {
-    if (escaped_builders.find(builder) == escaped_builders.end()) {
+    if (!escaped_builders.count(builder)) {
       stack_only_builders.emplace(builder);
     }
   }
@@ -331,11 +348,13 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
   PassConfig pc(mgr.get_config());
   BuilderTransform b_transform(pc, scope, stores, false);
 
-  // Inline non init methods.
-  walk::methods(scope, [&](DexMethod* method) {
-    auto builders = created_builders(method);
-
-    for (DexType* builder : builders) {
+  // Inline non init methods. This only changes the code of the method it
+  // inlines into, so the builders found above are still the ones each method
+  // creates. Whether a builder is kept depends on the methods handled before,
+  // so they are handled in order.
+  for (size_t i = 0; i < methods.size(); ++i) {
+    DexMethod* method = methods[i];
+    for (DexType* builder : method_builders[i]) {
       if (method->get_class() == builder) {
         continue;
       }
@@ -370,7 +389,7 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
         DexMethod::erase_method(method_copy);
       }
     }
-  });
+  }
 
   // No need to remove the builders here, since `RemoveUnreachable` will
   // take care of it.
@@ -418,7 +418,7 @@ bool remove_builder(DexMethod* method, DexClass* builder) {
   }
 
   code->build_cfg();
-  auto blocks = postorder_sort(code->cfg().blocks());
+  auto blocks = code->cfg().postorder();
   std::reverse(blocks.begin(), blocks.end());
 
   auto fields_in = fields_setters(blocks, builder);
@@ -628,7 +628,7 @@ bool params_change_regs(DexMethod* method) {
 
   auto code = method->get_code();
   code->build_cfg();
-  auto blocks = postorder_sort(code->cfg().blocks());
+  auto blocks = code->cfg().postorder();
   std::reverse(blocks.begin(), blocks.end());
   uint16_t regs_size = code->get_registers_size();
   const auto& param_insns = InstructionIterable(code->get_param_instructions());
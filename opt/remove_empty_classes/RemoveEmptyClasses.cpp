@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <unordered_set>
+#include <vector>
 
 #include "Walkers.h"
 #include "ReachableClasses.h"
@@ -62,33 +63,34 @@ DexType* array_base_type(DexType* type) {
   return type;
 }
 
-void process_proto(std::unordered_set<const DexType*>* class_references,
-                   DexMethodRef* meth) {
+// The types the code of a class refers to, in no particular order and with
+// duplicates; a list is much more compact than a set.
+using TypeRefs = std::vector<const DexType*>;
+
+void process_proto(TypeRefs* class_references, DexMethodRef* meth) {
   // Types referenced in protos.
   auto const& proto = meth->get_proto();
-  class_references->insert(array_base_type(proto->get_rtype()));
+  class_references->push_back(array_base_type(proto->get_rtype()));
   for (auto const& ptype : proto->get_args()->get_type_list()) {
-    class_references->insert(array_base_type(ptype));
+    class_references->push_back(array_base_type(ptype));
   }
 }
 
-void process_code(std::unordered_set<const DexType*>* class_references,
-                  DexMethod* meth,
-                  IRCode& code) {
+void process_code(TypeRefs* class_references, DexMethod* meth, IRCode& code) {
   process_proto(class_references, meth);
   // Types referenced in code.
-  for (auto const& mie : InstructionIterable(meth->get_code())) {
+  for (auto const& mie : InstructionIterable(code)) {
     auto opcode = mie.insn;
     if (opcode->has_type()) {
       auto typ = array_base_type(opcode->get_type());
       TRACE(EMPTY, 4, "Adding type from code to keep list: %s\n",
             typ->get_name()->c_str());
-      class_references->insert(typ);
+      class_references->push_back(typ);
     }
     if (opcode->has_field()) {
       auto const& field = opcode->get_field();
-      class_references->insert(array_base_type(field->get_class()));
-      class_references->insert(array_base_type(field->get_type()));
+      class_references->push_back(array_base_type(field->get_class()));
+      class_references->push_back(array_base_type(field->get_type()));
     }
     if (opcode->has_method()) {
       auto const& m = opcode->get_method();
@@ -99,7 +101,7 @@ void process_code(std::unordered_set<const DexType*>* class_references,
   std::vector<DexType*> catch_types;
   code.gather_catch_types(catch_types);
   for (auto& caught_type : catch_types) {
-    class_references->insert(caught_type);
+    class_references->push_back(caught_type);
   }
 }
 
@@ -112,10 +114,17 @@ size_t remove_empty_classes(Scope& classes) {
   walk::annotations(classes, [&](DexAnnotation* annotation)
     { process_annotation(&class_references, annotation); });
 
-  walk::code(classes,
-            [](DexMethod*) { return true; },
-            [&](DexMethod* meth, IRCode& code)
-               { process_code(&class_references, meth, code); });
+  auto code_references = walk::parallel::reduce_code<TypeRefs>(
+      classes,
+      [](DexMethod*) { return true; },
+      [](TypeRefs& refs, DexMethod* meth, IRCode& code) {
+        process_code(&refs, meth, code);
+      },
+      [](TypeRefs a, TypeRefs b) {
+        a.insert(a.end(), b.begin(), b.end());
+        return a;
+      });
+  class_references.insert(code_references.begin(), code_references.end());
 
   size_t classes_before_size = classes.size();
 
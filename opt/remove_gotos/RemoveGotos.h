@@ -17,5 +17,5 @@ class RemoveGotosPass : public Pass {
 
   virtual void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
-  size_t run(DexMethod*);
+  static size_t run(DexMethod*);
 };
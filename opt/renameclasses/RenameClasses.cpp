@@ -17,6 +17,7 @@
 #include <unordered_map>
 
 #include "Walkers.h"
+#include "Analyses.h"
 #include "DexClass.h"
 #include "IRInstruction.h"
 #include "DexUtil.h"
@@ -250,7 +251,7 @@ void rename_classes(
 void RenameClassesPass::run_pass(
     DexStoresVector& stores, ConfigFiles& cfg, PassManager& mgr) {
   auto scope = build_class_scope(stores);
-  ClassHierarchy ch = build_type_hierarchy(scope);
+  const auto& ch = mgr.analyses().get<ClassHierarchyAnalysis>(stores);
   std::unordered_set<const DexType*> untouchables;
   for (const auto& base : m_untouchable_hierarchies) {
     auto base_type = DexType::get_type(base.c_str());
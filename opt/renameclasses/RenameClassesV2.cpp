@@ -10,12 +10,14 @@
 #include "RenameClassesV2.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <string>
 #include <vector>
 #include <unordered_set>
 #include <unordered_map>
 
+#include "Analyses.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRInstruction.h"
@@ -173,18 +175,20 @@ ssize_t find_matching_package(
 std::unordered_set<std::string>
 RenameClassesPassV2::build_dont_rename_resources(
   PassManager& mgr,
+  ConfigFiles& cfg,
   std::unordered_map<const DexType*, std::string>& force_rename_classes) {
   std::unordered_set<std::string> dont_rename_resources;
   if (m_apk_dir.size()) {
+    auto& resource_cache = cfg.get_resource_scan_cache();
     // Classes present in manifest
-    std::string manifest = m_apk_dir + std::string("/AndroidManifest.xml");
-    for (std::string classname : get_manifest_classes(manifest)) {
+    for (const auto& classname :
+         resource_cache.get_manifest_classes(m_apk_dir)) {
       TRACE(RENAME, 4, "manifest: %s\n", classname.c_str());
       dont_rename_resources.insert(classname);
     }
 
     // Classes present in XML layouts
-    for (const auto& classname : get_layout_classes(m_apk_dir)) {
+    for (const auto& classname : resource_cache.get_layout_classes(m_apk_dir)) {
       const auto matching_pkg = find_matching_package(
         classname,
         m_force_layout_rename_packages);
@@ -203,7 +207,8 @@ RenameClassesPassV2::build_dont_rename_resources(
     }
 
     // Classnames present in native libraries (lib/*/*.so)
-    for (std::string classname : get_native_classes(m_apk_dir)) {
+    for (const auto& classname :
+         resource_cache.get_native_classes(m_apk_dir)) {
       auto type = DexType::get_type(classname.c_str());
       if (type == nullptr) continue;
       TRACE(RENAME, 4, "native_lib: %s\n", classname.c_str());
@@ -258,21 +263,28 @@ RenameClassesPassV2::build_dont_rename_for_types_with_reflection(
     }
   }
 
-  walk::opcodes(scope,
-      [](DexMethod*) { return true; },
-      [&](DexMethod* m, IRInstruction* insn) {
-        if (insn->has_method()) {
-          auto callee = insn->get_method();
-          if (callee == nullptr || !callee->is_concrete()) return;
-          auto callee_method_cls = callee->get_class();
-          if (refl_map.count(callee_method_cls) == 0) return;
-          std::string classname(m->get_class()->get_name()->c_str());
-          TRACE(RENAME, 4,
-            "Found %s with known reflection usage. marking reachable\n",
-            classname.c_str());
-          dont_rename_class_for_types_with_reflection.insert(classname);
-        }
-  });
+  using NameSet = std::unordered_set<std::string>;
+  dont_rename_class_for_types_with_reflection =
+      walk::parallel::reduce_opcodes<NameSet>(
+          scope,
+          [](DexMethod*) { return true; },
+          [&](NameSet& names, DexMethod* m, IRInstruction* insn) {
+            if (insn->has_method()) {
+              auto callee = insn->get_method();
+              if (callee == nullptr || !callee->is_concrete()) return;
+              auto callee_method_cls = callee->get_class();
+              if (refl_map.count(callee_method_cls) == 0) return;
+              std::string classname(m->get_class()->get_name()->c_str());
+              TRACE(RENAME, 4,
+                "Found %s with known reflection usage. marking reachable\n",
+                classname.c_str());
+              names.insert(classname);
+            }
+          },
+          [](NameSet a, NameSet b) {
+            a.insert(b.begin(), b.end());
+            return a;
+          });
   return dont_rename_class_for_types_with_reflection;
 }
 
@@ -481,22 +493,25 @@ RenameClassesPassV2::build_dont_rename_annotated() {
 class AliasMap {
   std::map<DexString*, DexString*, dexstrings_comparator> m_class_name_map;
   std::map<DexString*, DexString*, dexstrings_comparator> m_extras_map;
+  // Both of the above, for the lookups of the rewrites. A class name takes
+  // precedence over an extra alias of the same string.
+  std::unordered_map<DexString*, DexString*> m_lookup;
  public:
   void add_class_alias(DexClass* cls, DexString* alias) {
-    m_class_name_map.emplace(cls->get_name(), alias);
+    if (m_class_name_map.emplace(cls->get_name(), alias).second) {
+      m_lookup[cls->get_name()] = alias;
+    }
   }
   void add_alias(DexString* original, DexString* alias) {
-    m_extras_map.emplace(original, alias);
+    if (m_extras_map.emplace(original, alias).second) {
+      m_lookup.emplace(original, alias);
+    }
   }
   bool has(DexString* key) const {
-    return m_class_name_map.count(key) || m_extras_map.count(key);
+    return m_lookup.count(key);
   }
   DexString* at(DexString* key) const {
-    auto it = m_class_name_map.find(key);
-    if (it != m_class_name_map.end()) {
-      return it->second;
-    }
-    return m_extras_map.at(key);
+    return m_lookup.at(key);
   }
   const std::map<DexString*, DexString*, dexstrings_comparator>& get_class_map()
       const {
@@ -544,7 +559,7 @@ void RenameClassesPassV2::eval_classes(
 
   auto dont_rename_serde_relationships = build_dont_rename_serde_relationships(scope);
   auto dont_rename_resources =
-    build_dont_rename_resources(mgr, force_rename_hierarchies);
+    build_dont_rename_resources(mgr, cfg, force_rename_hierarchies);
   auto dont_rename_class_name_literals = build_dont_rename_class_name_literals(scope);
   auto dont_rename_class_for_types_with_reflection =
       build_dont_rename_for_types_with_reflection(scope,
@@ -718,7 +733,8 @@ void RenameClassesPassV2::eval_pass(DexStoresVector& stores,
   PassConfig pc(config);
   pc.get("apk_dir", "", m_apk_dir);
   auto scope = build_class_scope(stores);
-  ClassHierarchy class_hierarchy = build_type_hierarchy(scope);
+  const auto& class_hierarchy =
+      mgr.analyses().get<ClassHierarchyAnalysis>(stores);
   eval_classes(scope, class_hierarchy, cfg, m_rename_annotations, mgr);
 }
 
@@ -731,6 +747,8 @@ void RenameClassesPassV2::rename_classes(
   unpackage_private(scope);
 
   AliasMap aliases;
+  // The types to rename, all at once after the loop.
+  std::vector<std::pair<DexType*, DexString*>> type_aliases;
   for(auto clazz: scope) {
     auto dtype = clazz->get_type();
     auto oldname = dtype->get_name();
@@ -778,7 +796,7 @@ void RenameClassesPassV2::rename_classes(
 
     auto dstring = DexString::make_string(descriptor);
     aliases.add_class_alias(clazz, dstring);
-    dtype->assign_name_alias(dstring);
+    type_aliases.emplace_back(dtype, dstring);
     std::string old_str(oldname->c_str());
     std::string new_str(descriptor);
 //    proguard_map.update_class_mapping(old_str, new_str);
@@ -802,9 +820,10 @@ void RenameClassesPassV2::rename_classes(
       dstring = DexString::make_string(newarraytype.c_str());
 
       aliases.add_alias(oldname, dstring);
-      arraytype->assign_name_alias(dstring);
+      type_aliases.emplace_back(arraytype, dstring);
     }
   }
+  g_redex->alias_type_names(type_aliases);
 
 
   /* Now rewrite all const-string strings for force renamed classes. */
@@ -812,7 +831,8 @@ void RenameClassesPassV2::rename_classes(
     m::const_string()
   );
 
-  walk::matching_opcodes(scope, match,
+  std::atomic<size_t> rewritten_const_strings{0};
+  walk::parallel::matching_opcodes(scope, match,
       [&](const DexMethod*, const std::vector<IRInstruction*>& insns){
         IRInstruction* insn = insns[0];
         DexString* str = insn->get_string();
@@ -842,13 +862,14 @@ void RenameClassesPassV2::rename_classes(
           DexType* alias_from_type = DexType::get_type(alias_from);
           DexClass* alias_from_cls = type_class(alias_from_type);
           if (m_force_rename_classes.count(alias_from_cls)) {
-            mgr.incr_metric(METRIC_REWRITTEN_CONST_STRINGS, 1);
+            ++rewritten_const_strings;
             insn->set_string(alias_to);
             TRACE(RENAME, 3, "Rewrote const-string \"%s\" to \"%s\"\n",
                 str->c_str(), alias_to->c_str());
           }
         }
       });
+  mgr.incr_metric(METRIC_REWRITTEN_CONST_STRINGS, rewritten_const_strings);
 
   /* Now we need to re-write the Signature annotations.  They use
    * Strings rather than Type's, so they have to be explicitly
@@ -879,7 +900,7 @@ void RenameClassesPassV2::rename_classes(
   }
   static DexType *dalviksig =
     DexType::get_type("Ldalvik/annotation/Signature;");
-  walk::annotations(scope, [&](DexAnnotation* anno) {
+  walk::parallel::annotations(scope, [&](DexAnnotation* anno) {
     if (anno->type() != dalviksig) return;
     auto elems = anno->anno_elems();
     for (auto elem : elems) {
@@ -918,30 +939,33 @@ void RenameClassesPassV2::rename_classes_in_layouts(
       JavaNameUtil::internal_to_external(apair.first->str()),
       JavaNameUtil::internal_to_external(apair.second->str()));
   }
-  ssize_t layout_bytes_delta = 0;
-  size_t num_layout_renamed = 0;
+  std::atomic<ssize_t> layout_bytes_delta{0};
+  std::atomic<size_t> num_layout_renamed{0};
   auto xml_files = get_xml_files(m_apk_dir + "/res");
-  for (const auto& path : xml_files) {
-    size_t num_renamed;
-    ssize_t out_delta;
-    TRACE(RENAME, 5, "Begin rename Views in layout %s\n", path.c_str());
-    rename_classes_in_layout(path, aliases_for_layouts, &num_renamed, &out_delta);
-    TRACE(
-      RENAME,
-      3,
-      "Renamed %zu ResStringPool entries in layout %s\n",
-      num_renamed,
-      path.c_str());
-    layout_bytes_delta += out_delta;
-    num_layout_renamed += num_renamed;
-  }
+  process_files_in_parallel(
+    std::vector<std::string>(xml_files.begin(), xml_files.end()),
+    [&](const std::string& path) {
+      size_t num_renamed = 0;
+      ssize_t out_delta = 0;
+      TRACE(RENAME, 5, "Begin rename Views in layout %s\n", path.c_str());
+      rename_classes_in_layout(
+        path, aliases_for_layouts, &num_renamed, &out_delta);
+      TRACE(
+        RENAME,
+        3,
+        "Renamed %zu ResStringPool entries in layout %s\n",
+        num_renamed,
+        path.c_str());
+      layout_bytes_delta += out_delta;
+      num_layout_renamed += num_renamed;
+    });
   mgr.incr_metric("layout_bytes_delta", layout_bytes_delta);
   TRACE(
     RENAME,
     2,
     "Renamed %zu ResStringPool entries, delta %zi bytes\n",
-    num_layout_renamed,
-    layout_bytes_delta);
+    num_layout_renamed.load(),
+    layout_bytes_delta.load());
 }
 
 void RenameClassesPassV2::run_pass(DexStoresVector& stores,
@@ -954,7 +978,8 @@ void RenameClassesPassV2::run_pass(DexStoresVector& stores,
     return;
   }
   auto scope = build_class_scope(stores);
-  ClassHierarchy class_hierarchy = build_type_hierarchy(scope);
+  const auto& class_hierarchy =
+      mgr.analyses().get<ClassHierarchyAnalysis>(stores);
   eval_classes_post(scope, class_hierarchy, mgr);
   int total_classes = scope.size();
 
@@ -84,10 +84,27 @@ void SimpleInlinePass::run_pass(DexStoresVector& stores, ConfigFiles& cfg, PassM
   auto scope = build_class_scope(stores);
   // gather all inlinable candidates
   auto methods = gather_non_virtual_methods(scope, no_inline, force_inline);
-  select_inlinable(
-      scope, methods, resolved_refs, &inlinable, m_multiple_callers);
+  auto& hot_methods = m_inliner_config.hot_methods;
+  if (m_profile_guided) {
+    for (const auto& it : cfg.get_coldstart_method_ranks()) {
+      if (it.first->is_def()) {
+        hot_methods.insert(static_cast<const DexMethod*>(it.first));
+      }
+    }
+    TRACE(SINL, 1, "%ld hot methods in the profile\n", hot_methods.size());
+  }
+  select_inlinable(scope,
+                   methods,
+                   resolved_refs,
+                   &inlinable,
+                   m_multiple_callers,
+                   hot_methods.empty() ? nullptr : &hot_methods);
 
   auto resolver = [&](DexMethodRef* method, MethodSearch search) {
+    // The local cache can't be shared between threads.
+    if (m_inliner_config.parallel) {
+      return resolve_method_cached(method, search);
+    }
     return resolve_method(method, search, resolved_refs);
   };
 
@@ -101,29 +118,41 @@ void SimpleInlinePass::run_pass(DexStoresVector& stores, ConfigFiles& cfg, PassM
   size_t inlined_count = inlined.size();
   size_t deleted = delete_methods(scope, inlined, resolver);
 
-  TRACE(SINL, 3, "recursive %ld\n", inliner.get_info().recursive);
-  TRACE(SINL, 3, "blacklisted meths %ld\n", inliner.get_info().blacklisted);
-  TRACE(SINL, 3, "virtualizing methods %ld\n", inliner.get_info().need_vmethod);
-  TRACE(SINL, 3, "invoke super %ld\n", inliner.get_info().invoke_super);
-  TRACE(SINL, 3, "override inputs %ld\n", inliner.get_info().write_over_ins);
-  TRACE(SINL, 3, "escaped virtual %ld\n", inliner.get_info().escaped_virtual);
+  const auto& info = inliner.get_info();
+  TRACE(SINL, 3, "recursive %ld\n", info.recursive.load());
+  TRACE(SINL, 3, "blacklisted meths %ld\n", info.blacklisted.load());
+  TRACE(SINL, 3, "virtualizing methods %ld\n", info.need_vmethod.load());
+  TRACE(SINL, 3, "invoke super %ld\n", info.invoke_super.load());
+  TRACE(SINL, 3, "override inputs %ld\n", info.write_over_ins.load());
+  TRACE(SINL, 3, "escaped virtual %ld\n", info.escaped_virtual.load());
   TRACE(SINL, 3, "known non public virtual %ld\n",
-      inliner.get_info().non_pub_virtual);
-  TRACE(SINL, 3, "non public ctor %ld\n", inliner.get_info().non_pub_ctor);
-  TRACE(SINL, 3, "unknown field %ld\n", inliner.get_info().escaped_field);
-  TRACE(SINL, 3, "non public field %ld\n", inliner.get_info().non_pub_field);
-  TRACE(SINL, 3, "throws %ld\n", inliner.get_info().throws);
-  TRACE(SINL, 3, "multiple returns %ld\n", inliner.get_info().multi_ret);
+      info.non_pub_virtual.load());
+  TRACE(SINL, 3, "non public ctor %ld\n", info.non_pub_ctor.load());
+  TRACE(SINL, 3, "unknown field %ld\n", info.escaped_field.load());
+  TRACE(SINL, 3, "non public field %ld\n", info.non_pub_field.load());
+  TRACE(SINL, 3, "throws %ld\n", info.throws.load());
+  TRACE(SINL, 3, "multiple returns %ld\n", info.multi_ret.load());
   TRACE(SINL, 3, "references cross stores %ld\n",
-      inliner.get_info().cross_store);
-  TRACE(SINL, 3, "not found %ld\n", inliner.get_info().not_found);
-  TRACE(SINL, 3, "caller too large %ld\n", inliner.get_info().caller_too_large);
+      info.cross_store.load());
+  TRACE(SINL, 3, "not found %ld\n", info.not_found.load());
+  TRACE(SINL, 3, "caller too large %ld\n", info.caller_too_large.load());
+  TRACE(SINL, 3, "cold caller %ld\n", info.cold_caller.load());
   TRACE(SINL, 1,
       "%ld inlined calls over %ld methods and %ld methods removed\n",
-      inliner.get_info().calls_inlined, inlined_count, deleted);
+      info.calls_inlined.load(), inlined_count, deleted);
 
-  mgr.incr_metric("calls_inlined", inliner.get_info().calls_inlined);
+  mgr.incr_metric("calls_inlined", info.calls_inlined);
   mgr.incr_metric("methods_removed", deleted);
+  if (!hot_methods.empty()) {
+    // The trade-off: the calls saved at startup against the code added by
+    // inlining, before the inlined methods are deleted.
+    TRACE(SINL, 1,
+          "%ld calls inlined into hot methods, %ld code units inlined\n",
+          info.hot_calls_inlined.load(), info.code_units_inlined.load());
+    mgr.incr_metric("hot_calls_inlined", info.hot_calls_inlined);
+    mgr.incr_metric("cold_callers_not_grown", info.cold_caller);
+    mgr.incr_metric("code_units_inlined", info.code_units_inlined);
+  }
 }
 
 /**
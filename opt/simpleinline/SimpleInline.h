@@ -31,6 +31,8 @@ class SimpleInlinePass : public Pass {
     pc.get("no_inline_annos", {}, m_no_inline_annos);
     pc.get("force_inline_annos", {}, m_force_inline_annos);
     pc.get("multiple_callers", false, m_multiple_callers);
+    pc.get("parallel", false, m_inliner_config.parallel);
+    pc.get("profile_guided", false, m_profile_guided);
 
     std::vector<std::string> black_list;
     pc.get("black_list", {}, black_list);
@@ -62,6 +64,9 @@ class SimpleInlinePass : public Pass {
   bool m_virtual_inline;
   // inline methods with multiple callers
   bool m_multiple_callers;
+  // inline into the methods of the coldstart method list rather than by size
+  // alone
+  bool m_profile_guided;
 
   MultiMethodInliner::Config m_inliner_config;
 
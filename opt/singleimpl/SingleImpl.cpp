@@ -16,6 +16,7 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "Analyses.h"
 #include "Debug.h"
 #include "DexLoader.h"
 #include "DexOutput.h"
@@ -46,7 +47,7 @@ constexpr const char* METRIC_INVOKE_INT_TO_VIRT = "num_invoke_intf_to_virt";
  * we will only have one entry { A => C }
  * keep that in mind when using this map
  */
-void map_interfaces(const std::deque<DexType*>& intf_list,
+void map_interfaces(const DexTypeList::Types& intf_list,
                     DexClass* cls,
                     TypeToTypes& intfs_to_classes) {
   for (auto& intf : intf_list) {
@@ -101,7 +102,7 @@ const int MAX_PASSES = 8;
 
 void SingleImplPass::run_pass(DexStoresVector& stores, ConfigFiles& cfg, PassManager& mgr) {
   auto scope = build_class_scope(stores);
-  ClassHierarchy ch = build_type_hierarchy(scope);
+  const auto& ch = mgr.analyses().get<ClassHierarchyAnalysis>(stores);
   int max_steps = 0;
   size_t previous_invoke_intf_count = s_invoke_intf_count;
   removed_count = 0;
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <memory>
 #include <string>
+#include <tuple>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -26,6 +27,27 @@
 #include "Resolver.h"
 #include "Trace.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
+
+namespace {
+
+/**
+ * What the scans of a class found, in the order they found it. The scans run
+ * in parallel and only read the analysis; the findings of all classes are
+ * then applied in scope order, which gives the same data as scanning serially.
+ */
+struct Findings {
+  std::vector<std::pair<DexType*, EscapeReason>> escapes;
+  std::vector<std::pair<DexType*, DexField*>> fielddefs;
+  std::vector<std::pair<DexType*, DexMethod*>> methoddefs;
+  std::vector<std::pair<DexType*, IRInstruction*>> typerefs;
+  std::vector<std::tuple<DexType*, DexFieldRef*, IRInstruction*>> fieldrefs;
+  std::vector<std::tuple<DexType*, DexMethodRef*, IRInstruction*>>
+      intf_methodrefs;
+  std::vector<std::tuple<DexType*, DexMethodRef*, IRInstruction*>> methodrefs;
+};
+
+} // namespace
 
 struct AnalysisImpl : SingleImplAnalysis {
   AnalysisImpl(const Scope& scope, const DexStoresVector& stores)
@@ -35,14 +57,18 @@ struct AnalysisImpl : SingleImplAnalysis {
   void create_single_impl(const TypeMap& single_impl,
                           const TypeSet& intfs,
                           const SingleImplConfig& config);
-  void collect_field_defs();
-  void collect_method_defs();
-  void analyze_opcodes();
+  void scan();
   void escape_cross_stores();
   void remove_escaped();
 
  private:
+  DexType* find_single_impl(DexType* type, bool* is_array) const;
   DexType* get_and_check_single_impl(DexType* type);
+  DexType* get_and_check_single_impl(DexType* type, Findings* findings) const;
+  void collect_field_defs(const DexClass* cls, Findings* findings) const;
+  void collect_method_defs(const DexClass* cls, Findings* findings) const;
+  void analyze_opcodes(const DexClass* cls, Findings* findings) const;
+  void apply(const Findings& findings);
   void collect_children(const TypeSet& intfs);
   void check_impl_hierarchy();
   void escape_with_clinit();
@@ -58,23 +84,50 @@ struct AnalysisImpl : SingleImplAnalysis {
 
 /**
  * Get the single impl if the type is a single impl or an array of it.
- * When an array mark the single impl as having an array type.
  * Return nullptr otherwise.
  */
-DexType* AnalysisImpl::get_and_check_single_impl(DexType* type) {
+DexType* AnalysisImpl::find_single_impl(DexType* type, bool* is_array) const {
+  *is_array = false;
   if (exists(single_impls, type)) return type;
-  if (is_array(type)) {
+  if (::is_array(type)) {
     auto array_type = get_array_type(type);
     assert(array_type);
     const auto sit = single_impls.find(array_type);
     if (sit != single_impls.end()) {
-      escape_interface(sit->first, HAS_ARRAY_TYPE);
+      *is_array = true;
       return sit->first;
     }
   }
   return nullptr;
 }
 
+/**
+ * Get the single impl if the type is a single impl or an array of it.
+ * When an array mark the single impl as having an array type.
+ * Return nullptr otherwise.
+ */
+DexType* AnalysisImpl::get_and_check_single_impl(DexType* type) {
+  bool is_array;
+  auto intf = find_single_impl(type, &is_array);
+  if (is_array) {
+    escape_interface(intf, HAS_ARRAY_TYPE);
+  }
+  return intf;
+}
+
+/**
+ * Same as above, but the escape is recorded in the findings of a scan.
+ */
+DexType* AnalysisImpl::get_and_check_single_impl(DexType* type,
+                                                 Findings* findings) const {
+  bool is_array;
+  auto intf = find_single_impl(type, &is_array);
+  if (is_array) {
+    findings->escapes.emplace_back(intf, HAS_ARRAY_TYPE);
+  }
+  return intf;
+}
+
 /**
  * Find all single implemented interfaces.
  */
@@ -252,15 +305,21 @@ void AnalysisImpl::remove_escaped() {
 /**
  * Find all fields typed with the single impl interface.
  */
-void AnalysisImpl::collect_field_defs() {
-  walk::fields(scope,
-              [&](DexField* field) {
-                auto type = field->get_type();
-                auto intf = get_and_check_single_impl(type);
-                if (intf) {
-                  single_impls[intf].fielddefs.push_back(field);
-                }
-              });
+void AnalysisImpl::collect_field_defs(const DexClass* cls,
+                                      Findings* findings) const {
+  auto check_field = [&](DexField* field) {
+    auto type = field->get_type();
+    auto intf = get_and_check_single_impl(type, findings);
+    if (intf) {
+      findings->fielddefs.emplace_back(intf, field);
+    }
+  };
+  for (auto field : cls->get_ifields()) {
+    check_field(field);
+  }
+  for (auto field : cls->get_sfields()) {
+    check_field(field);
+  }
 }
 
 /**
@@ -268,42 +327,49 @@ void AnalysisImpl::collect_field_defs() {
  * Also if a method with the interface in the signature is native mark the
  * interface as "escaped".
  */
-void AnalysisImpl::collect_method_defs() {
+void AnalysisImpl::collect_method_defs(const DexClass* cls,
+                                       Findings* findings) const {
 
   auto check_method_arg = [&](DexType* type, DexMethod* method, bool native) {
-    auto intf = get_and_check_single_impl(type);
+    auto intf = get_and_check_single_impl(type, findings);
     if (!intf) return;
     if (native) {
-      escape_interface(intf, NATIVE_METHOD);
+      findings->escapes.emplace_back(intf, NATIVE_METHOD);
     }
     if (method->get_class() == intf) {
-      escape_interface(intf, SELF_REFERENCE);
+      findings->escapes.emplace_back(intf, SELF_REFERENCE);
     }
-    single_impls[intf].methoddefs.insert(method);
+    findings->methoddefs.emplace_back(intf, method);
   };
 
-  walk::methods(scope,
-    [&](DexMethod* method) {
-      auto proto = method->get_proto();
-      bool native = is_native(method);
-      check_method_arg(proto->get_rtype(), method, native);
-      auto args = proto->get_args();
-      for (const auto it : args->get_type_list()) {
-        check_method_arg(it, method, native);
-      }
-    });
+  auto check_method = [&](DexMethod* method) {
+    auto proto = method->get_proto();
+    bool native = is_native(method);
+    check_method_arg(proto->get_rtype(), method, native);
+    auto args = proto->get_args();
+    for (const auto it : args->get_type_list()) {
+      check_method_arg(it, method, native);
+    }
+  };
+  for (auto method : cls->get_dmethods()) {
+    check_method(method);
+  }
+  for (auto method : cls->get_vmethods()) {
+    check_method(method);
+  }
 }
 
 /**
  * Find all opcodes that reference a single implemented interface in a typeref,
  * fieldref or methodref.
  */
-void AnalysisImpl::analyze_opcodes() {
+void AnalysisImpl::analyze_opcodes(const DexClass* cls,
+                                   Findings* findings) const {
 
   auto check_arg = [&](DexType* type, DexMethodRef* meth, IRInstruction* insn) {
-    auto intf = get_and_check_single_impl(type);
+    auto intf = get_and_check_single_impl(type, findings);
     if (intf) {
-      single_impls[intf].methodrefs[meth].insert(insn);
+      findings->methodrefs.emplace_back(intf, meth, insn);
     }
   };
 
@@ -319,110 +385,168 @@ void AnalysisImpl::analyze_opcodes() {
 
   auto check_field = [&](DexFieldRef* field, IRInstruction* insn) {
     auto cls = field->get_class();
-    cls = get_and_check_single_impl(cls);
+    cls = get_and_check_single_impl(cls, findings);
     if (cls) {
-      escape_interface(cls, HAS_FIELD_REF);
+      findings->escapes.emplace_back(cls, HAS_FIELD_REF);
     }
     const auto type = field->get_type();
-    auto intf = get_and_check_single_impl(type);
+    auto intf = get_and_check_single_impl(type, findings);
     if (intf) {
-      single_impls[intf].fieldrefs[field].push_back(insn);
+      findings->fieldrefs.emplace_back(intf, field, insn);
+    }
+  };
+
+  auto analyze_insn = [&](IRInstruction* insn) {
+    auto op = insn->opcode();
+    switch (op) {
+    // type ref
+    case OPCODE_CONST_CLASS: {
+      // const_class is problematic because DI can use it as a key to mark
+      // different instances to retrieve, so we simply drop all single impl
+      // that are used with const_class
+      const auto typeref = insn->get_type();
+      auto intf = get_and_check_single_impl(typeref, findings);
+      if (intf) {
+        findings->escapes.emplace_back(intf, CONST_CLASS);
+      }
+      return;
+    }
+    case OPCODE_CHECK_CAST:
+    case OPCODE_INSTANCE_OF:
+    case OPCODE_NEW_INSTANCE:
+    case OPCODE_NEW_ARRAY:
+    case OPCODE_FILLED_NEW_ARRAY: {
+      auto intf = get_and_check_single_impl(insn->get_type(), findings);
+      if (intf) {
+        findings->typerefs.emplace_back(intf, insn);
+      }
+      return;
+    }
+    // field ref
+    case OPCODE_IGET:
+    case OPCODE_IGET_WIDE:
+    case OPCODE_IGET_OBJECT:
+    case OPCODE_IPUT:
+    case OPCODE_IPUT_WIDE:
+    case OPCODE_IPUT_OBJECT: {
+      DexFieldRef* field =
+          resolve_field(insn->get_field(), FieldSearch::Instance);
+      if (field == nullptr) {
+        field = insn->get_field();
+      }
+      check_field(field, insn);
+      return;
+    }
+    case OPCODE_SGET:
+    case OPCODE_SGET_WIDE:
+    case OPCODE_SGET_OBJECT:
+    case OPCODE_SPUT:
+    case OPCODE_SPUT_WIDE:
+    case OPCODE_SPUT_OBJECT: {
+      DexFieldRef* field =
+          resolve_field(insn->get_field(), FieldSearch::Static);
+      if (field == nullptr) {
+        field = insn->get_field();
+      }
+      check_field(field, insn);
+      return;
+    }
+    // method ref
+    case OPCODE_INVOKE_INTERFACE: {
+      // if it is an invoke on the interface method, collect it as such
+      const auto meth = insn->get_method();
+      const auto owner = meth->get_class();
+      const auto intf = get_and_check_single_impl(owner, findings);
+      if (intf) {
+        // if the method ref is not defined on the interface itself
+        // drop the optimization
+        const auto& meths = type_class(intf)->get_vmethods();
+        if (std::find(meths.begin(), meths.end(), meth) == meths.end()) {
+          findings->escapes.emplace_back(intf, UNKNOWN_MREF);
+        } else {
+          findings->intf_methodrefs.emplace_back(intf, meth, insn);
+        }
+      }
+      check_sig(meth, insn);
+      return;
+    }
+
+    case OPCODE_INVOKE_DIRECT:
+    case OPCODE_INVOKE_STATIC:
+    case OPCODE_INVOKE_VIRTUAL:
+    case OPCODE_INVOKE_SUPER: {
+      const auto meth = insn->get_method();
+      check_sig(meth, insn);
+      return;
+    }
+    default:
+      return;
     }
   };
 
-  walk::opcodes(scope,
-               [](DexMethod* method) { return true; },
-               [&](DexMethod* method, IRInstruction* insn) {
-                 auto op = insn->opcode();
-                 switch (op) {
-                 // type ref
-                 case OPCODE_CONST_CLASS: {
-                   // const_class is problematic because DI can use it as a key
-                   // to mark
-                   // different instances to retrieve, so we simply drop all
-                   // single impl
-                   // that are used with const_class
-                   const auto typeref = insn->get_type();
-                   auto intf = get_and_check_single_impl(typeref);
-                   if (intf) {
-                     escape_interface(intf, CONST_CLASS);
-                   }
-                   return;
-                 }
-                 case OPCODE_CHECK_CAST:
-                 case OPCODE_INSTANCE_OF:
-                 case OPCODE_NEW_INSTANCE:
-                 case OPCODE_NEW_ARRAY:
-                 case OPCODE_FILLED_NEW_ARRAY: {
-                   auto intf = get_and_check_single_impl(insn->get_type());
-                   if (intf) {
-                     single_impls[intf].typerefs.push_back(insn);
-                   }
-                   return;
-                 }
-                 // field ref
-                 case OPCODE_IGET:
-                 case OPCODE_IGET_WIDE:
-                 case OPCODE_IGET_OBJECT:
-                 case OPCODE_IPUT:
-                 case OPCODE_IPUT_WIDE:
-                 case OPCODE_IPUT_OBJECT: {
-                   DexFieldRef* field =
-                       resolve_field(insn->get_field(), FieldSearch::Instance);
-                   if (field == nullptr) {
-                     field = insn->get_field();
-                   }
-                   check_field(field, insn);
-                   return;
-                 }
-                 case OPCODE_SGET:
-                 case OPCODE_SGET_WIDE:
-                 case OPCODE_SGET_OBJECT:
-                 case OPCODE_SPUT:
-                 case OPCODE_SPUT_WIDE:
-                 case OPCODE_SPUT_OBJECT: {
-                   DexFieldRef* field =
-                       resolve_field(insn->get_field(), FieldSearch::Static);
-                   if (field == nullptr) {
-                     field = insn->get_field();
-                   }
-                   check_field(field, insn);
-                   return;
-                 }
-                 // method ref
-                 case OPCODE_INVOKE_INTERFACE: {
-                   // if it is an invoke on the interface method, collect it as
-                   // such
-                   const auto meth = insn->get_method();
-                   const auto owner = meth->get_class();
-                   const auto intf = get_and_check_single_impl(owner);
-                   if (intf) {
-                     // if the method ref is not defined on the interface itself
-                     // drop the optimization
-                     const auto& meths = type_class(intf)->get_vmethods();
-                     if (std::find(meths.begin(), meths.end(), meth) ==
-                         meths.end()) {
-                       escape_interface(intf, UNKNOWN_MREF);
-                     } else {
-                       single_impls[intf].intf_methodrefs[meth].insert(insn);
-                     }
-                   }
-                   check_sig(meth, insn);
-                   return;
-                 }
-
-                 case OPCODE_INVOKE_DIRECT:
-                 case OPCODE_INVOKE_STATIC:
-                 case OPCODE_INVOKE_VIRTUAL:
-                 case OPCODE_INVOKE_SUPER: {
-                   const auto meth = insn->get_method();
-                   check_sig(meth, insn);
-                   return;
-                 }
-                 default:
-                   return;
-                 }
-               });
+  auto analyze_method = [&](DexMethod* method) {
+    auto code = method->get_code();
+    if (code == nullptr) return;
+    for (const auto& mie : InstructionIterable(code)) {
+      analyze_insn(mie.insn);
+    }
+  };
+  for (auto method : cls->get_dmethods()) {
+    analyze_method(method);
+  }
+  for (auto method : cls->get_vmethods()) {
+    analyze_method(method);
+  }
+}
+
+/**
+ * Record what a scan found into the single impl data.
+ */
+void AnalysisImpl::apply(const Findings& findings) {
+  for (const auto& escape : findings.escapes) {
+    escape_interface(escape.first, escape.second);
+  }
+  for (const auto& def : findings.fielddefs) {
+    single_impls[def.first].fielddefs.push_back(def.second);
+  }
+  for (const auto& def : findings.methoddefs) {
+    single_impls[def.first].methoddefs.insert(def.second);
+  }
+  for (const auto& ref : findings.typerefs) {
+    single_impls[ref.first].typerefs.push_back(ref.second);
+  }
+  for (const auto& ref : findings.fieldrefs) {
+    single_impls[std::get<0>(ref)].fieldrefs[std::get<1>(ref)].push_back(
+        std::get<2>(ref));
+  }
+  for (const auto& ref : findings.intf_methodrefs) {
+    single_impls[std::get<0>(ref)].intf_methodrefs[std::get<1>(ref)].insert(
+        std::get<2>(ref));
+  }
+  for (const auto& ref : findings.methodrefs) {
+    single_impls[std::get<0>(ref)].methodrefs[std::get<1>(ref)].insert(
+        std::get<2>(ref));
+  }
+}
+
+/**
+ * Scan the fields, method signatures and code of all classes for uses of the
+ * single impl interfaces. Classes are scanned in parallel.
+ */
+void AnalysisImpl::scan() {
+  std::vector<Findings> findings(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    collect_field_defs(scope[i], &findings[i]);
+    collect_method_defs(scope[i], &findings[i]);
+    analyze_opcodes(scope[i], &findings[i]);
+  });
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  for (const auto& class_findings : findings) {
+    apply(class_findings);
+  }
 }
 
 /**
@@ -435,9 +559,7 @@ std::unique_ptr<SingleImplAnalysis> SingleImplAnalysis::analyze(
   std::unique_ptr<AnalysisImpl> single_impls(
       new AnalysisImpl(scope, stores));
   single_impls->create_single_impl(single_impl, intfs, config);
-  single_impls->collect_field_defs();
-  single_impls->collect_method_defs();
-  single_impls->analyze_opcodes();
+  single_impls->scan();
   single_impls->escape_cross_stores();
   single_impls->remove_escaped();
   return std::move(single_impls);
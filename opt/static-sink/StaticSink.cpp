@@ -23,7 +23,6 @@
 #include "ConfigFiles.h"
 #include "ReachableClasses.h"
 #include "Walkers.h"
-#include "Warning.h"
 #include "ClassHierarchy.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -31,109 +30,40 @@
 namespace {
 
 /*
- * Parse a string representing a type list.  Assumes the same format used by dexdump, e.g.,
- * "[[ILjava/lang/String;B" would become (int[][], String, boolean)
+ * The methods of the coldstart list that are defined.
  */
-DexTypeList* parse_type_list_string(const char* str) {
-  std::deque<DexType*> type_list;
-  const char* p = str;
-  while (*p != '\0') {
-    if (*p == 'L') {
-      auto end = strchr(p, ';');
-      type_list.push_back(
-        DexType::get_type(std::string(p, end - p + 1).c_str()));
-      p = end + 1;
-    } else if (*p == '[') {
-      auto end = p + 1;
-      while (*end == '[') {
-        end++;
-      }
-      if (*end == 'L') {
-        auto clsend = strchr(end, ';');
-        type_list.push_back(
-          DexType::get_type(std::string(p, clsend - p + 1).c_str()));
-        p = clsend + 1;
-      } else {
-        type_list.push_back(
-          DexType::get_type(std::string(p, end - p + 1).c_str()));
-        p = end + 1;
-      }
-    } else {
-      type_list.push_back(DexType::get_type(std::string(p, 1).c_str()));
-      p++;
-    }
-    // check if any get_type generated a nullptr
-    if (type_list.back() == nullptr) {
-      return nullptr;
-    }
-  }
-  return DexTypeList::make_type_list(std::move(type_list));
-}
-
-/*
- * Parse a vector of strings into the corresponding DexMethods.
- */
-std::unordered_set<DexMethod*> strings_to_dexmethods(
-  std::vector<std::string> method_list
-) {
+std::unordered_set<DexMethod*> get_coldstart_methods(ConfigFiles& cfg) {
   std::unordered_set<DexMethod*> methods;
-  for (auto const& mstr : method_list) {
-    // Format: class.method(arglist)rtype
-    auto dot = mstr.find('.');
-    auto lparen = mstr.find('(');
-    auto rparen = mstr.find(')');
-
-    if (dot == std::string::npos ||
-        lparen == std::string::npos ||
-        rparen == std::string::npos) {
-      opt_warn(COLDSTART_STATIC, "%s\n", mstr.c_str());
-      continue;
-    }
-    auto classpart = mstr.substr(0, dot);
-    auto methodpart = mstr.substr(dot + 1, lparen - dot - 1);
-    auto arglistpart = mstr.substr(lparen + 1, rparen - lparen - 1);
-    auto rtypepart = mstr.substr(rparen + 1, mstr.length() - rparen - 1);
-
-    auto classtype = DexType::get_type(classpart.c_str());
-    auto methodname = DexString::get_string(methodpart.c_str());
-    auto arglist = parse_type_list_string(arglistpart.c_str());
-    auto rtype = DexType::get_type(rtypepart.c_str());
-
-    if (!classtype || !methodname || !arglist || !rtype) {
-      opt_warn(COLDSTART_STATIC, "%s\n", mstr.c_str());
-      continue;
+  for (auto const& it : cfg.get_coldstart_method_ranks()) {
+    auto method = const_cast<DexMethodRef*>(it.first);
+    if (method->is_def()) {
+      methods.insert(static_cast<DexMethod*>(method));
     }
-    auto proto = DexProto::get_proto(rtype, arglist);
-    if (!proto) {
-      opt_warn(COLDSTART_STATIC, "%s\n", mstr.c_str());
-      continue;
-    }
-    auto method = DexMethod::get_method(classtype, methodname, proto);
-    if (!method || !method->is_def()) {
-      opt_warn(COLDSTART_STATIC, "%s\n", mstr.c_str());
-      continue;
-    }
-    methods.insert(static_cast<DexMethod*>(method));
   }
   return methods;
 }
 
+/*
+ * The classes of `dexen` that are in the coldstart list, in its order.
+ */
 std::vector<DexClass*> get_coldstart_classes(
   const DexClassesVector& dexen,
   ConfigFiles& cfg
 ) {
-  auto interdex_list = cfg.get_coldstart_classes();
-  std::unordered_map<std::string, DexClass*> class_string_map;
-  std::vector<DexClass*> coldstart_classes;
+  auto const& ranks = cfg.get_coldstart_class_ranks();
+  std::vector<std::pair<size_t, DexClass*>> ranked_classes;
   for (auto const& dex : dexen) {
     for (auto const& cls : dex) {
-      class_string_map[std::string(cls->get_type()->get_name()->c_str())] = cls;
+      auto it = ranks.find(cls->get_type());
+      if (it != ranks.end()) {
+        ranked_classes.emplace_back(it->second, cls);
+      }
     }
   }
-  for (auto const& class_string : interdex_list) {
-    if (class_string_map.count(class_string)) {
-      coldstart_classes.push_back(class_string_map[class_string]);
-    }
+  std::sort(ranked_classes.begin(), ranked_classes.end());
+  std::vector<DexClass*> coldstart_classes;
+  for (auto const& it : ranked_classes) {
+    coldstart_classes.push_back(it.second);
   }
   return coldstart_classes;
 }
@@ -166,18 +96,22 @@ std::vector<DexMethod*> get_noncoldstart_statics(
 void remove_primary_dex_refs(
     const DexClasses& primary_dex,
     std::vector<DexMethod*>& statics) {
-  std::unordered_set<DexMethod*> ref_set;
-  walk::opcodes(
+  using MethodSet = std::unordered_set<DexMethod*>;
+  auto ref_set = walk::parallel::reduce_opcodes<MethodSet>(
     primary_dex,
     [](DexMethod*) { return true; },
-    [&](DexMethod*, IRInstruction* insn) {
+    [](MethodSet& refs, DexMethod*, IRInstruction* insn) {
       if (insn->has_method()) {
         auto callee =
             resolve_method(insn->get_method(), opcode_to_search(insn));
         if (callee != nullptr) {
-          ref_set.insert(callee);
+          refs.insert(callee);
         }
       }
+    },
+    [](MethodSet a, MethodSet b) {
+      a.insert(b.begin(), b.end());
+      return a;
     }
   );
   statics.erase(
@@ -326,21 +260,25 @@ DexClass* move_statics_out(
   return holder;
 }
 
+/*
+ * Each static with a call site outside of the coldstart classes, with the
+ * class of that call site, the last one in scope order when there are several.
+ */
 std::unordered_map<DexMethod*, DexClass*> get_sink_map(
     DexStoresVector& stores,
     const std::vector<DexClass*>& classes,
     const std::vector<DexMethod*>& statics) {
-  std::unordered_map<DexMethod*, DexClass*> statics_to_callers;
+  using SinkMap = std::unordered_map<DexMethod*, DexClass*>;
   std::unordered_set<DexClass*> class_set(classes.begin(), classes.end());
   std::unordered_set<DexMethod*> static_set(statics.begin(), statics.end());
   auto scope = build_class_scope(stores);
-  walk::opcodes(
+  return walk::parallel::reduce_opcodes<SinkMap>(
     scope,
     [&](DexMethod* m) {
       auto cls = type_class(m->get_class());
       return class_set.count(cls) == 0 && is_public(cls);
     },
-    [&](DexMethod* m, IRInstruction* insn) {
+    [&](SinkMap& statics_to_callers, DexMethod* m, IRInstruction* insn) {
       if (insn->has_method()) {
         auto callee =
             resolve_method(insn->get_method(), opcode_to_search(insn));
@@ -348,9 +286,16 @@ std::unordered_map<DexMethod*, DexClass*> get_sink_map(
           statics_to_callers[callee] = type_class(m->get_class());
         }
       }
+    },
+    // The per-class maps are combined in scope order, later call sites
+    // winning.
+    [](SinkMap a, SinkMap b) {
+      for (auto& it : b) {
+        a[it.first] = it.second;
+      }
+      return a;
     }
   );
-  return statics_to_callers;
 }
 
 void count_coldstart_statics(const std::vector<DexClass*>& classes) {
@@ -380,8 +325,7 @@ void StaticSinkPass::run_pass(DexStoresVector& stores, ConfigFiles& cfg, PassMan
   }
   ClassHierarchy ch = build_type_hierarchy(build_class_scope(stores));
   DexClassesVector& root_store = stores[0].get_dexen();
-  auto method_list = cfg.get_coldstart_methods();
-  auto methods = strings_to_dexmethods(method_list);
+  auto methods = get_coldstart_methods(cfg);
   TRACE(SINK, 1, "methods used in coldstart: %lu\n", methods.size());
   auto coldstart_classes = get_coldstart_classes(root_store, cfg);
   count_coldstart_statics(coldstart_classes);
@@ -20,6 +20,7 @@
 #include <unordered_set>
 #include <unordered_map>
 
+#include "Analyses.h"
 #include "DexClass.h"
 #include "DexDebugInstruction.h"
 #include "IRInstruction.h"
@@ -27,6 +28,8 @@
 #include "Resolver.h"
 #include "Match.h"
 #include "ConfigFiles.h"
+#include "PassManager.h"
+#include "StaticRefIndex.h"
 #include "Walkers.h"
 
 namespace {
@@ -69,26 +72,6 @@ void visit_classes(
   }
 }
 
-/**
- * Helper to visit all opcodes which match the given criteria.
- *
- * @param scope all classes we're processing
- * @param p A match_t<IRInstruction, ...> built up by m::* routines
- * @param v Visitor function
- */
-template<typename P, typename V = void(DexMethod*, IRInstruction*)>
-void visit_opcodes(
-  const Scope& scope, const m::match_t<IRInstruction, P>& p, const V& v) {
-  walk::opcodes(
-    scope,
-    [](const DexMethod*) { return true; },
-    [&](const DexMethod* m, IRInstruction* insn) {
-      if (p.matches(insn)) {
-        v(m, insn);
-      }
-    });
-}
-
 /**
  * Helper to build a map of DexClass* -> dex index
  *
@@ -117,27 +100,24 @@ std::unordered_map<const DexClass*, size_t> build_class_to_dex_map(
 std::unordered_map<const DexClass*, size_t> build_class_to_pgo_order_map(
   const DexClassesVector& dexen,
   ConfigFiles& cfg) {
-  auto interdex_list = cfg.get_coldstart_classes();
-  std::unordered_map<std::string, DexClass*> class_string_map;
+  auto const& ranks = cfg.get_coldstart_class_ranks();
   std::unordered_map<const DexClass*, size_t> coldstart_classes;
   for (auto const& dex : dexen) {
     for (auto const& cls : dex) {
-      class_string_map[std::string(cls->get_type()->get_name()->c_str())] = cls;
-    }
-  }
-  int rank = 0;
-  for (auto const& class_string : interdex_list) {
-    if (class_string_map.count(class_string)) {
-      coldstart_classes[class_string_map[class_string]] = rank++;
+      auto it = ranks.find(cls->get_type());
+      if (it != ranks.end()) {
+        coldstart_classes.emplace(cls, it->second);
+      }
     }
   }
   return coldstart_classes;
 }
 
 /**
- * Helper function that scans all the bytecode in the application and
+ * Helper function that goes through the refs of the bytecode in the scope and
  * builds up two maps. Map goes from method/class to vector of its refs.
  *
+ * @param index the refs of all the bytecode in the application
  * @param scope all classes we're processing
  * @param dmethod_refs [out] all refs to dmethods in the application
  * @param class_refs [out] all refs to classes in the application
@@ -145,35 +125,31 @@ std::unordered_map<const DexClass*, size_t> build_class_to_pgo_order_map(
  *
  */
 void build_refs(
+    const StaticRefIndex& index,
     const Scope& scope,
     refs_t<DexMethodRef>& dmethod_refs,
     refs_t<DexClass>& class_refs,
     std::unordered_set<DexClass*>& referenced_types) {
-  // Looking for direct/static invokes or class refs
-  auto match =
-    m::invoke_static()
-    || m::invoke_direct()
-    || m::has_type();
-  visit_opcodes(scope, match, [&](const DexMethod* meth, IRInstruction* insn){
-    if (insn->has_type()) {
-      const auto tref = type_class(insn->get_type());
-      if (tref) class_refs[tref].push_back(std::make_pair(meth, insn));
-    } else {
-      const auto mref = insn->get_method();
-      dmethod_refs[mref].push_back(std::make_pair(meth, insn));
+  std::unordered_set<const DexClass*> in_scope(scope.begin(), scope.end());
+  for (const auto& refs : index.methods()) {
+    const DexMethod* meth = refs.method;
+    if (in_scope.count(type_class(meth->get_class())) == 0) continue;
+    // Looking for direct/static invokes or class refs
+    for (const auto& it : refs.type_refs) {
+      const auto tref = type_class(it->insn->get_type());
+      if (tref) class_refs[tref].push_back(std::make_pair(meth, it->insn));
     }
-  });
-  // collect all exceptions and add to the set of references for the app
-  walk::code(scope,
-      [&](DexMethod* method, IRCode& code) {
-        std::vector<DexType*> exceptions;
-        code.gather_catch_types(exceptions);
-        for (const auto& exception : exceptions) {
-          auto cls = type_class(exception);
-          if (cls == nullptr || cls->is_external()) continue;
-          referenced_types.insert(cls);
-        }
-      });
+    for (const auto& it : refs.method_refs) {
+      const auto mref = it->insn->get_method();
+      dmethod_refs[mref].push_back(std::make_pair(meth, it->insn));
+    }
+    // collect all exceptions and add to the set of references for the app
+    for (const auto& exception : refs.catch_types) {
+      auto cls = type_class(exception);
+      if (cls == nullptr || cls->is_external()) continue;
+      referenced_types.insert(cls);
+    }
+  }
 }
 
 /**
@@ -633,6 +609,11 @@ void StaticReloPass::run_pass(DexStoresVector& stores, ConfigFiles& cfg, PassMan
   s_single_ref_total_count = 0;
   s_single_ref_moved_count = 0;
 
+  // The refs of all the stores are found with one pass through all code. The
+  // mutations below don't remove any instructions, so the index stays valid
+  // from one store to the next.
+  const auto& index = mgr.analyses().get<StaticRefsAnalysis>(stores);
+
   //relocate statics on a per-dex store basis
   for (auto& store : stores) {
     DexClassesVector& dexen = store.get_dexen();
@@ -642,14 +623,13 @@ void StaticReloPass::run_pass(DexStoresVector& stores, ConfigFiles& cfg, PassMan
     auto dont_optimize_annos = get_dont_optimize_annos(
       m_dont_optimize_annos, cfg);
 
-    // Make one pass through all code to find dmethod refs and class refs,
-    // needed later on for refining eligibility as well as performing the
-    // actual rebinding
+    // Find the dmethod refs and class refs of this store, needed later on for
+    // refining eligibility as well as performing the actual rebinding
     refs_t<DexMethodRef> dmethod_refs;
     refs_t<DexClass> class_refs;
     std::unordered_set<DexClass*> referenced_types;
 
-    build_refs(scope, dmethod_refs, class_refs, referenced_types);
+    build_refs(index, scope, dmethod_refs, class_refs, referenced_types);
 
     // Find candidates
     candidates_t candidates = build_candidates(
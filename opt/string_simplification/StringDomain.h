@@ -15,8 +15,8 @@
 #include <tuple>
 
 #include "AbstractDomain.h"
+#include "AdaptiveAbstractEnvironment.h"
 #include "HashedSetAbstractDomain.h"
-#include "PatriciaTreeMapAbstractEnvironment.h"
 #include "ReducedProductAbstractDomain.h"
 #include "SimpleValueAbstractDomain.h"
 
@@ -171,10 +171,10 @@ inline std::ostream& operator<<(std::ostream& o, const StringyDomain& sd) {
 using PointerDomain = SimpleValueAbstractDomain<pointer_reference_t>;
 
 using PointerReferenceEnvironment =
-    PatriciaTreeMapAbstractEnvironment<string_register_t, PointerDomain>;
+    AdaptiveAbstractEnvironment<string_register_t, PointerDomain>;
 
 using StringConstantEnvironment =
-    PatriciaTreeMapAbstractEnvironment<pointer_reference_t, StringyDomain>;
+    AdaptiveAbstractEnvironment<pointer_reference_t, StringyDomain>;
 
 // We need a layer of indirection to be able to solve the pointer analysis
 // during the string concatenation because multiple registers can point to the
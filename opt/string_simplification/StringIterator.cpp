@@ -56,6 +56,33 @@ bool eq(const PointerDomain& a, const PointerDomain& b) {
   }
 }
 
+StringBuilderRefs::StringBuilderRefs()
+    : string_type(DexType::make_type(STRING_DEF)),
+      builder_type(DexType::make_type(STRINGBUILDER_DEF)),
+      empty_init_method(
+          DexMethod::make_method(STRINGBUILDER_DEF, "<init>", "V", {})),
+      string_init_method(DexMethod::make_method(
+          STRINGBUILDER_DEF, "<init>", "V", {STRING_DEF})),
+      append_method(DexMethod::make_method(
+          STRINGBUILDER_DEF, "append", STRINGBUILDER_DEF, {STRING_DEF})),
+      to_string_method(DexMethod::make_method(
+          STRINGBUILDER_DEF, "toString", STRING_DEF, {})) {}
+
+bool StringIterator::has_to_string_call(IRCode* code,
+                                        const StringBuilderRefs& refs) {
+  if (!code->has_opcode_class(opcode::OpcodeClass::INVOKE)) {
+    return false;
+  }
+  for (const auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    if (insn->opcode() == OPCODE_INVOKE_VIRTUAL &&
+        insn->get_method() == refs.to_string_method) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void StringIterator::analyze_instruction(const NodeId blk,
                                          IRList::iterator& it,
                                          Environment* env) const {
@@ -243,7 +270,7 @@ void StringIterator::remove_stringbuilder_instructions_in_block(
         eq(env.get_id(back_iter->insn->dest()), id)) {
       if (back_iter->insn->opcode() == OPCODE_NEW_INSTANCE) {
         TRACE(STR_SIMPLE, 5, "new instance.\n");
-        always_assert(back_iter->insn->get_type() == m_builder_type);
+        always_assert(back_iter->insn->get_type() == m_refs.builder_type);
         back_iter = m_code->erase(back_iter);
         ++m_instructions_removed;
         break;
@@ -293,46 +320,41 @@ bool StringIterator::is_const_string(IRList::iterator it) const {
 bool StringIterator::is_sb_new_instance(IRList::iterator it) const {
   auto insn = it->insn;
   return insn->opcode() == OPCODE_NEW_INSTANCE &&
-         insn->get_type() == m_builder_type;
+         insn->get_type() == m_refs.builder_type;
 }
 
 bool StringIterator::is_sb_empty_init(IRList::iterator it) const {
   auto insn = it->insn;
   return insn->opcode() == OPCODE_INVOKE_DIRECT &&
-         insn->get_method() ==
-             DexMethod::make_method(STRINGBUILDER_DEF, "<init>", "V", {});
+         insn->get_method() == m_refs.empty_init_method;
 }
 
 bool StringIterator::is_sb_string_init(IRList::iterator it) const {
   auto insn = it->insn;
   return insn->opcode() == OPCODE_INVOKE_DIRECT &&
-         insn->get_method() ==
-             DexMethod::make_method(
-                 STRINGBUILDER_DEF, "<init>", "V", {STRING_DEF});
+         insn->get_method() == m_refs.string_init_method;
 }
 
 bool StringIterator::is_sb_append_string(IRList::iterator it) const {
   auto insn = it->insn;
   return insn->opcode() == OPCODE_INVOKE_VIRTUAL &&
-         insn->get_method() == m_append_method;
+         insn->get_method() == m_refs.append_method;
 }
 
 bool StringIterator::is_sb_to_string(IRList::iterator it) const {
   return it->insn->opcode() == OPCODE_INVOKE_VIRTUAL &&
-         it->insn->get_method() == m_to_string_method;
+         it->insn->get_method() == m_refs.to_string_method;
 }
 
 void StringIterator::insert_sb_init(IRList::iterator& it, uint16_t vreg) {
   using namespace dex_asm;
   m_code->insert_before(it,
                         dasm(OPCODE_NEW_INSTANCE,
-                             DexType::make_type(STRINGBUILDER_DEF),
+                             m_refs.builder_type,
                              {{VREG, vreg}}));
   m_code->insert_before(
       it,
-      dasm(OPCODE_INVOKE_DIRECT,
-           DexMethod::make_method(STRINGBUILDER_DEF, "<init>", "V", {}),
-           {{VREG, vreg}}));
+      dasm(OPCODE_INVOKE_DIRECT, m_refs.empty_init_method, {{VREG, vreg}}));
   m_instructions_added += 2;
 }
 
@@ -342,7 +364,7 @@ void StringIterator::insert_sb_append(IRList::iterator& it,
   using namespace dex_asm;
   m_code->insert_before(it,
                         dasm(OPCODE_INVOKE_VIRTUAL,
-                             m_append_method,
+                             m_refs.append_method,
                              {{VREG, sb_vreg}, {VREG, str_vreg}}));
   ++m_instructions_added;
 }
@@ -362,7 +384,7 @@ void StringIterator::insert_sb_to_string(IRList::iterator& it,
                                          uint16_t dest_vreg) {
   using namespace dex_asm;
   m_code->insert_before(
-      it, dasm(OPCODE_INVOKE_VIRTUAL, m_to_string_method, {{VREG, sb_vreg}}));
+      it, dasm(OPCODE_INVOKE_VIRTUAL, m_refs.to_string_method, {{VREG, sb_vreg}}));
   m_code->insert_before(it,
                         dasm(OPCODE_MOVE_RESULT_OBJECT, {{VREG, dest_vreg}}));
   m_instructions_added += 2;
@@ -20,31 +20,51 @@
 constexpr const char* STRING_DEF = "Ljava/lang/String;";
 constexpr const char* STRINGBUILDER_DEF = "Ljava/lang/StringBuilder;";
 
+// The types and methods the simplification looks for. Interning them is
+// relatively expensive, so a pass makes them once and shares them between all
+// the methods it runs on.
+struct StringBuilderRefs {
+  StringBuilderRefs();
+
+  DexType* string_type;
+  DexType* builder_type;
+  DexMethodRef* empty_init_method;
+  DexMethodRef* string_init_method;
+  DexMethodRef* append_method;
+  DexMethodRef* to_string_method;
+};
+
 class StringIterator : public MonotonicFixpointIterator<cfg::GraphInterface,
                                                         StringProdEnvironment> {
   using NodeId = Block*;
   using Environment = StringProdEnvironment;
 
  public:
-  StringIterator(IRCode* code, NodeId start_block)
-      : MonotonicFixpointIterator(code->cfg()),
+  // simplify() queries each entry state once, so it's cheaper to recompute
+  // them than to keep a copy of every environment during the iteration.
+  StringIterator(IRCode* code,
+                 NodeId start_block,
+                 const StringBuilderRefs& refs = StringBuilderRefs())
+      : MonotonicFixpointIterator(code->cfg(),
+                                  code->cfg().blocks().size(),
+                                  FixpointIterationStrategy::Worklist,
+                                  /* store_entry_states */ false),
         m_code(code),
-        m_string_type(DexType::make_type(STRING_DEF)),
-        m_builder_type(DexType::make_type(STRINGBUILDER_DEF)),
-        m_append_method(DexMethod::make_method(
-            STRINGBUILDER_DEF, "append", STRINGBUILDER_DEF, {STRING_DEF})),
-        m_to_string_method(DexMethod::make_method(
-            STRINGBUILDER_DEF, "toString", STRING_DEF, {})),
+        m_refs(refs),
         m_strings_added(0),
         m_instructions_added(0),
         m_instructions_removed(0) {}
 
+  // Only calls to StringBuilder.toString() get simplified, so there's no need
+  // to build the CFG and run the analysis on code without any.
+  static bool has_to_string_call(IRCode* code, const StringBuilderRefs& refs);
+
   size_t get_strings_added() const { return m_strings_added; }
   size_t get_instructions_added() const { return m_instructions_added; }
   size_t get_instructions_removed() const { return m_instructions_removed; }
 
   Environment analyze_edge(
-      const std::shared_ptr<cfg::Edge>&,
+      const EdgeId&,
       const Environment& exit_state_at_source) const override {
     return exit_state_at_source;
   }
@@ -122,10 +142,7 @@ class StringIterator : public MonotonicFixpointIterator<cfg::GraphInterface,
                            string_register_t dest);
 
   IRCode* m_code;
-  const DexType* m_string_type;
-  const DexType* m_builder_type;
-  DexMethodRef* m_append_method;
-  DexMethodRef* m_to_string_method;
+  StringBuilderRefs m_refs;
 
   size_t m_strings_added;
   size_t m_instructions_added;
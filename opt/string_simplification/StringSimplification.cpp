@@ -17,20 +17,50 @@ constexpr const char* NUM_CONST_STRINGS_ADDED = "num_const_strings_added";
 constexpr const char* NUM_INSTRUCTIONS_ADDED = "num_instructions_added";
 constexpr const char* NUM_INSTRUCTIONS_REMOVED = "num_instructions_removed";
 
+namespace {
+
+struct Stats {
+  size_t strings_added{0};
+  size_t instructions_added{0};
+  size_t instructions_removed{0};
+};
+
+} // namespace
+
 void StringSimplificationPass::run_pass(DexStoresVector& stores,
                                         ConfigFiles& /* cfg */,
                                         PassManager& mgr) {
   auto scope = build_class_scope(stores);
-  walk::code(scope, [&](DexMethod* m, IRCode& code) {
-    TRACE(STR_SIMPLE, 8, "Method: %s\n", SHOW(m));
-    code.build_cfg();
-    StringIterator iter(&code, code.cfg().entry_block());
-    iter.run(StringProdEnvironment());
-    iter.simplify();
-    mgr.incr_metric(NUM_CONST_STRINGS_ADDED, iter.get_strings_added());
-    mgr.incr_metric(NUM_INSTRUCTIONS_ADDED, iter.get_instructions_added());
-    mgr.incr_metric(NUM_INSTRUCTIONS_REMOVED, iter.get_instructions_removed());
-  });
+  const StringBuilderRefs refs;
+  auto stats = walk::parallel::reduce_methods<StringBuilderRefs, Stats>(
+      scope,
+      [](const StringBuilderRefs& refs, DexMethod* m) {
+        Stats stats;
+        auto code = m->get_code();
+        if (code == nullptr ||
+            !StringIterator::has_to_string_call(code, refs)) {
+          return stats;
+        }
+        TRACE(STR_SIMPLE, 8, "Method: %s\n", SHOW(m));
+        code->build_cfg();
+        StringIterator iter(code, code->cfg().entry_block(), refs);
+        iter.run(StringProdEnvironment());
+        iter.simplify();
+        stats.strings_added = iter.get_strings_added();
+        stats.instructions_added = iter.get_instructions_added();
+        stats.instructions_removed = iter.get_instructions_removed();
+        return stats;
+      },
+      [](Stats a, Stats b) {
+        a.strings_added += b.strings_added;
+        a.instructions_added += b.instructions_added;
+        a.instructions_removed += b.instructions_removed;
+        return a;
+      },
+      [&refs](int) { return refs; });
+  mgr.incr_metric(NUM_CONST_STRINGS_ADDED, stats.strings_added);
+  mgr.incr_metric(NUM_INSTRUCTIONS_ADDED, stats.instructions_added);
+  mgr.incr_metric(NUM_INSTRUCTIONS_REMOVED, stats.instructions_removed);
 }
 
 static StringSimplificationPass s_pass;
@@ -479,7 +479,7 @@ bool can_update_wrappee(
     return false;
   }
   DexProto* old_proto = wrappee->get_proto();
-  auto new_args = old_proto->get_args()->get_type_list();
+  std::deque<DexType*> new_args = old_proto->get_args()->get_type_list();
   new_args.push_front(wrappee->get_class());
   DexProto* new_proto = DexProto::make_proto(
     old_proto->get_rtype(),
@@ -733,6 +733,8 @@ void remove_dead_methods(
   size_t synth_removed = 0;
   size_t other_removed = 0;
   size_t pub_meth = 0;
+  // Removed all at once at the end, so that each class is compacted once.
+  std::vector<DexMethod*> dead_methods;
   auto remove_meth = [&](DexMethod* meth) {
     assert(meth->is_concrete());
     if (!can_remove(meth, synthConfig)) {
@@ -749,8 +751,7 @@ void remove_dead_methods(
 
     TRACE(SYNT, 2, "Removing method: %s\n", SHOW(meth));
     if (is_public(meth)) pub_meth++;
-    auto cls = type_class(meth->get_class());
-    cls->remove_method(meth);
+    dead_methods.push_back(meth);
     is_synthetic(meth) ? synth_removed++ : other_removed++;
   };
 
@@ -808,6 +809,9 @@ void remove_dead_methods(
 
   metrics.ctors_removed_count += (synth_removed + pub_meth);
 
+  DEBUG_ONLY auto removed = remove_methods(dead_methods);
+  assert(removed == dead_methods.size());
+
   assert(other_removed == 0);
   ssms.next_pass = ssms.next_pass && any_remove;
 }
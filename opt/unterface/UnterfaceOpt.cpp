@@ -13,6 +13,7 @@
 #include "DexUtil.h"
 #include "Creators.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -86,7 +87,7 @@ DexString* get_name(DexString* base) {
   return DexString::make_string((name + "__untf__;").c_str());
 }
 
-bool find_impl(DexType* type, Unterface& unterface) {
+bool find_impl(const DexType* type, const Unterface& unterface) {
   return std::find_if(unterface.impls.begin(), unterface.impls.end(),
       [&](const DexClass* impl) {
         return impl->get_type() == type;
@@ -99,7 +100,7 @@ bool find_impl(DexType* type, Unterface& unterface) {
  * TODO: this needs a serious rationalization around MEthodCreator and
  * IRCode usage. It works for now given the simplicity of the scenario.
  */
-void do_update_method(DexMethod* meth, Unterface& unterface) {
+void do_update_method(DexMethod* meth, const Unterface& unterface) {
   auto code = meth->get_code();
   code->set_registers_size(code->get_registers_size() + 1);
   IRInstruction* last = nullptr;
@@ -167,46 +168,92 @@ void do_update_method(DexMethod* meth, Unterface& unterface) {
 }
 
 /**
- * Remove references to the implementors and change them to the unterface
- * reference.
- * Particularly take care of the constructor which have to be changed to
- * construct the unterface and pass the extra "switch type" argument.
- *
- * TODO: this is just an initial example and there is a ton more to do
+ * The methods that reference the implementors of each unterface, indexed like
+ * `unterfaces` and in the order of `scope`, found in a single parallel walk
+ * over the code. Implementors don't count as referencing their own unterface.
  */
-void update_impl_refereces(Scope& scope, Unterface& unterface) {
-  std::vector<DexMethod*> to_change;
-  walk::code(scope,
-      [&](DexMethod* meth) {
-        return !find_impl(meth->get_class(), unterface);
-      },
-      [&](DexMethod* meth, IRCode& code) {
+std::vector<std::vector<DexMethod*>> find_impl_references(
+    const Scope& scope, const std::vector<Unterface>& unterfaces) {
+  std::unordered_map<const DexType*, std::vector<size_t>> impl_to_untfs;
+  for (size_t i = 0; i < unterfaces.size(); i++) {
+    for (auto impl : unterfaces[i].impls) {
+      impl_to_untfs[impl->get_type()].push_back(i);
+    }
+  }
+  using References = std::vector<std::vector<DexMethod*>>;
+  return walk::parallel::reduce_code<References>(
+      scope,
+      [](DexMethod*) { return true; },
+      [&](References& refs, DexMethod* meth, IRCode& code) {
+        std::vector<size_t> referenced;
         for (auto& mie : InstructionIterable(&code)) {
           auto insn = mie.insn;
-          auto op = insn->opcode();
-          switch (op) {
+          const DexType* type;
+          switch (insn->opcode()) {
           case OPCODE_NEW_INSTANCE:
-            if (find_impl(insn->get_type(), unterface)) {
-              to_change.push_back(meth);
-              return;
-            }
+            type = insn->get_type();
             break;
           case OPCODE_INVOKE_DIRECT:
-            if (find_impl(insn->get_method()->get_class(), unterface)) {
-              to_change.push_back(meth);
-              return;
-            }
+            type = insn->get_method()->get_class();
             break;
           default:
             // TODO the other infinite number of cases...
-            break;
+            continue;
           }
+          auto it = impl_to_untfs.find(type);
+          if (it == impl_to_untfs.end()) {
+            continue;
+          }
+          for (auto i : it->second) {
+            if (!find_impl(meth->get_class(), unterfaces[i])) {
+              referenced.push_back(i);
+            }
+          }
+        }
+        std::sort(referenced.begin(), referenced.end());
+        referenced.erase(std::unique(referenced.begin(), referenced.end()),
+                         referenced.end());
+        for (auto i : referenced) {
+          refs[i].push_back(meth);
         }
-      });
+      },
+      [](References a, References b) {
+        for (size_t i = 0; i < a.size(); i++) {
+          a[i].insert(a[i].end(), b[i].begin(), b[i].end());
+        }
+        return a;
+      },
+      References(unterfaces.size()));
+}
 
-  for (auto meth : to_change) {
-    do_update_method(meth, unterface);
+/**
+ * Remove references to the implementors and change them to the unterface
+ * reference.
+ * Particularly take care of the constructor which have to be changed to
+ * construct the unterface and pass the extra "switch type" argument.
+ * Methods are rewritten in parallel; one that references the implementors of
+ * several unterfaces is rewritten for each of them in turn.
+ *
+ * TODO: this is just an initial example and there is a ton more to do
+ */
+void update_impl_refereces(const Scope& scope,
+                           const std::vector<Unterface>& unterfaces) {
+  auto refs = find_impl_references(scope, unterfaces);
+  std::unordered_map<DexMethod*, std::vector<size_t>> untfs_of;
+  for (size_t i = 0; i < refs.size(); i++) {
+    for (auto meth : refs[i]) {
+      untfs_of[meth].push_back(i);
+    }
+  }
+  auto wq = workqueue_foreach<DexMethod*>([&](DexMethod* meth) {
+    for (auto i : untfs_of.at(meth)) {
+      do_update_method(meth, unterfaces[i]);
+    }
+  });
+  for (const auto& it : untfs_of) {
+    wq.add_item(it.first);
   }
+  wq.run_all();
 }
 
 /**
@@ -473,7 +520,7 @@ void make_unterface_class(Unterface& unterface) {
   unterface.ctor = ctor;
 }
 
-void optimize_interface(Scope& scope, Unterface& unterface) {
+void optimize_interface(Unterface& unterface) {
   TRACE(UNTF, 5, "Optimizing %s\n", SHOW(unterface.intf->get_type()));
   for (auto cls : unterface.impls) {
     TRACE(UNTF, 5, "Implementor %s\n", SHOW(cls->get_type()));
@@ -483,19 +530,24 @@ void optimize_interface(Scope& scope, Unterface& unterface) {
   make_unterface_class(unterface);
   move_methods(unterface);
   build_invoke(unterface);
-  update_impl_refereces(scope, unterface);
 }
 
 }
 
 void optimize(Scope& scope, TypeRelationship& candidates,
     std::vector<DexClass*>& untfs, std::unordered_set<DexClass*>& removed) {
+  std::vector<Unterface> unterfaces;
   for (auto& cand_it : candidates) {
-    Unterface unterface(cand_it.first, cand_it.second);
-    optimize_interface(scope, unterface);
+    unterfaces.emplace_back(cand_it.first, cand_it.second);
+    optimize_interface(unterfaces.back());
+  }
+  // The references are the same whichever unterfaces are done already, so
+  // they are all found and rewritten at once.
+  update_impl_refereces(scope, unterfaces);
+  for (auto& unterface : unterfaces) {
     auto cls = unterface.untf->create();
     untfs.push_back(cls);
-    for (auto rem : cand_it.second) {
+    for (auto rem : unterface.impls) {
       removed.insert(rem);
     }
   }
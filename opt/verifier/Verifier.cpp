@@ -24,28 +24,29 @@
 
 namespace {
 
-using refs_t = std::unordered_map<const DexClass*,
-                                  std::set<DexClass*, dexclasses_comparator>>;
+// Ordered, so that the references are reported in the same order every run.
+using refs_t = std::map<const DexClass*,
+                        std::set<DexClass*, dexclasses_comparator>,
+                        dexclasses_comparator>;
 using class_to_store_map_t = std::unordered_map<const DexClass*, DexStore*>;
 using allowed_store_map_t = std::unordered_map<std::string, std::set<std::string>>;
 
 /**
  * Helper function that scans all the opcodes in the application and produces a map of references
  * from the class containing the opcode to the class referenced by the opcode.
+ * The classes are scanned in parallel, each into its own map, and the maps
+ * are merged afterwards.
  *
  * @param scope all classes we're processing
- * @param dmethod_refs [out] all refs to dmethods in the application
- * @param class_refs [out] all refs to classes in the application
+ * @return all refs to classes in the application
  *
  */
-void build_refs(
-    const Scope& scope,
-    refs_t& class_refs) {
+refs_t build_refs(const Scope& scope) {
   // TODO: walk through annotations
-  walk::opcodes(
+  return walk::parallel::reduce_opcodes<refs_t>(
     scope,
-    [](const DexMethod*) { return true; },
-    [&](const DexMethod* meth, IRInstruction* insn) {
+    [](DexMethod*) { return true; },
+    [](refs_t& class_refs, DexMethod* meth, IRInstruction* insn) {
       if (insn->has_type()) {
         const auto tref = type_class(insn->get_type());
         if (tref) class_refs[tref].emplace(type_class(meth->get_class()));
@@ -73,6 +74,12 @@ void build_refs(
 
         return;
       }
+    },
+    [](refs_t left, refs_t right) {
+      for (auto& ref : right) {
+        left[ref.first].insert(ref.second.begin(), ref.second.end());
+      }
+      return left;
     });
 }
 
@@ -85,7 +92,7 @@ DexStore& findStore(std::string& name, DexStoresVector& stores) {
   return stores[0];
 }
 
-const std::set<std::string> getAllowedStores(DexStoresVector& stores, DexStore& store, allowed_store_map_t store_map) {
+const std::set<std::string> getAllowedStores(DexStoresVector& stores, DexStore& store, allowed_store_map_t& store_map) {
   auto search = store_map.find(store.get_name());
   if (search != store_map.end()) {
     return search->second;
@@ -101,10 +108,10 @@ const std::set<std::string> getAllowedStores(DexStoresVector& stores, DexStore&
   return store_map[store.get_name()];
 }
 
-void verifyStore(DexStoresVector& stores, DexStore& store, class_to_store_map_t map, allowed_store_map_t store_map, FILE* fd) {
-  refs_t class_refs;
+void verifyStore(DexStoresVector& stores, DexStore& store, const class_to_store_map_t& map, allowed_store_map_t& store_map, FILE* fd) {
   auto scope = build_class_scope(store.get_dexen());
-  build_refs(scope, class_refs);
+  auto class_refs = build_refs(scope);
+  const auto allowed_stores = getAllowedStores(stores, store, store_map);
   for (auto& ref : class_refs) {
     const auto target = ref.first;
     for (const auto& source : ref.second) {
@@ -115,7 +122,6 @@ void verifyStore(DexStoresVector& stores, DexStore& store, class_to_store_map_t
       } else {
         target_store_name = "external";
       }
-      std::set<std::string> allowed_stores = getAllowedStores(stores, store, store_map);
       if (allowed_stores.find(target_store_name) == allowed_stores.end()) {
         TRACE(
           VERIFY,
@@ -16,7 +16,7 @@ import zipfile
 
 from os.path import basename, dirname, getsize, isdir, isfile, join
 
-from pyredex.utils import abs_glob
+from pyredex.utils import abs_glob, find_apk_repack
 from pyredex.logger import log
 
 class ApplicationModule(object):
@@ -357,11 +357,6 @@ class XZSDexMode(BaseDexMode):
         # Move secondary dexen
         shutil.move(src, dest)
 
-        # concat_jar is a bunch of .dex.jar files concatenated together.
-        concat_jar = join(dex_dir, self._xzs_filename[:-4])
-        cmd = 'cat {} | xz -d --threads 6 > {}'.format(dest, concat_jar)
-        subprocess.check_call(cmd, shell=True)
-
         dex_order = []
         with open(join(extracted_apk_dir, self._xzs_dir, 'metadata.txt')) as dex_metadata:
             for line in dex_metadata.read().splitlines():
@@ -374,7 +369,6 @@ class XZSDexMode(BaseDexMode):
                     dex_order.append(int(match.group(1)))
 
         # Sizes of the concatenated .dex.jar files are stored in .meta files.
-        # Read the sizes of each .dex.jar file and un-concatenate them.
         jar_size_regex = 'jar:(\d+)'
         secondary_dir = join(extracted_apk_dir, self._xzs_dir)
         jar_sizes = {}
@@ -390,6 +384,24 @@ class XZSDexMode(BaseDexMode):
             else:
                 break
 
+        apk_repack = find_apk_repack()
+        if apk_repack is not None:
+            # Decompresses the archive and splits it into jars in memory,
+            # writing out only the dexen.
+            subprocess.check_call(
+                [apk_repack, 'xzs-unpack', dest, dex_dir] +
+                ['%s-%d.dex.jar:%d' % (self._store_name, i, jar_sizes[i])
+                 for i in dex_order])
+            os.remove(dest)
+            BaseDexMode.unpackage(self, extracted_apk_dir, dex_dir)
+            return
+
+        # concat_jar is a bunch of .dex.jar files concatenated together.
+        concat_jar = join(dex_dir, self._xzs_filename[:-4])
+        cmd = 'cat {} | xz -d --threads 6 > {}'.format(dest, concat_jar)
+        subprocess.check_call(cmd, shell=True)
+
+        # Un-concatenate the .dex.jar files.
         with open(concat_jar, 'rb') as cj:
             for i in dex_order:
                 jarpath = join(dex_dir, self._store_name + '-%d.dex.jar' % i)
@@ -431,47 +443,65 @@ class XZSDexMode(BaseDexMode):
                                    dependencies=self._dependencies,
                                    locator_store_id=locator_store_id)
 
-        with open(concat_jar_path, 'wb') as concat_jar:
-            for i in itertools.count(1):
-                oldpath = join(dex_dir, self._dex_prefix + '%d.dex' % (i + 1))
-                if not isfile(oldpath):
-                    break
-                dexpath = join(dex_dir, self._store_name + '-%d.dex' % i)
-
-                # Package each dex into a jar
-                shutil.move(oldpath, dexpath)
-                jarpath = dexpath + '.jar'
-                create_dex_jar(jarpath, dexpath)
-                dex_sizes[jarpath] = getsize(dexpath)
-                jar_sizes[jarpath] = getsize(jarpath)
-
-                # Concatenate the jar files and create corresponding metadata files
-                with open(jarpath + '.xzs.tmp~.meta', 'w') as metadata:
-                    sizes = 'jar:{} dex:{}'.format(
-                        jar_sizes[jarpath], dex_sizes[jarpath])
-                    metadata.write(sizes)
-
-                with open(jarpath, 'rb') as jar:
-                    contents = jar.read()
+        dexpaths = []
+        for i in itertools.count(1):
+            oldpath = join(dex_dir, self._dex_prefix + '%d.dex' % (i + 1))
+            if not isfile(oldpath):
+                break
+            dexpath = join(dex_dir, self._store_name + '-%d.dex' % i)
+            shutil.move(oldpath, dexpath)
+            dexpaths.append(dexpath)
+
+        compression_level = 0 if fast_repackage else 9
+        apk_repack = find_apk_repack()
+        if apk_repack is not None:
+            # Packages each dex into a jar, concatenates the jars and
+            # XZ-compresses the result without writing out the concatenation.
+            subprocess.check_call(
+                [apk_repack, 'xzs-repack', '-%d' % compression_level,
+                 concat_jar_path + '.xz'] + dexpaths)
+            concat_jar = None
+        else:
+            for dexpath in dexpaths:
+                create_dex_jar(dexpath + '.jar', dexpath)
+            concat_jar = open(concat_jar_path, 'wb')
+
+        for i, dexpath in enumerate(dexpaths, 1):
+            jarpath = dexpath + '.jar'
+            dex_sizes[jarpath] = getsize(dexpath)
+            jar_sizes[jarpath] = getsize(jarpath)
+
+            # Create the metadata files, concatenating the jar files if
+            # apk-repack didn't
+            with open(jarpath + '.xzs.tmp~.meta', 'w') as metadata:
+                sizes = 'jar:{} dex:{}'.format(
+                    jar_sizes[jarpath], dex_sizes[jarpath])
+                metadata.write(sizes)
+
+            with open(jarpath, 'rb') as jar:
+                contents = jar.read()
+                if concat_jar is not None:
                     concat_jar.write(contents)
-                    sha1hash = hashlib.sha1(contents).hexdigest()
+                sha1hash = hashlib.sha1(contents).hexdigest()
 
-                dex_metadata.add_dex(jarpath + '.xzs.tmp~',
-                                     BaseDexMode.get_canary(self, i),
-                                     hash=sha1hash)
+            dex_metadata.add_dex(jarpath + '.xzs.tmp~',
+                                 BaseDexMode.get_canary(self, i),
+                                 hash=sha1hash)
 
         dex_metadata.write(concat_jar_meta)
-        assert getsize(concat_jar_path) == sum(getsize(x)
-                for x in abs_glob(dex_dir, self._store_name + '-*.dex.jar'))
 
-        # XZ-compress the result
-        compression_level = 0 if fast_repackage else 9
-        subprocess.check_call(
-            [
-                'xz', '-z%d' % compression_level, '--check=crc32',
-                '--threads=6', concat_jar_path
-            ]
-        )
+        if concat_jar is not None:
+            concat_jar.close()
+            assert getsize(concat_jar_path) == sum(getsize(x)
+                    for x in abs_glob(dex_dir, self._store_name + '-*.dex.jar'))
+
+            # XZ-compress the result
+            subprocess.check_call(
+                [
+                    'xz', '-z%d' % compression_level, '--check=crc32',
+                    '--threads=6', concat_jar_path
+                ]
+            )
 
         # Copy all the archive and metadata back to the apk directory
         secondary_dex_dir = join(extracted_apk_dir, self._xzs_dir)
@@ -6,12 +6,13 @@
 # of patent rights can be found in the PATENTS file in the same directory.
 
 import glob
+import os
 import shutil
 import subprocess
 import sys
 import tempfile
 
-from os.path import join
+from os.path import abspath, dirname, isdir, isfile, join
 
 temp_dirs = []
 
@@ -25,6 +26,26 @@ def abs_glob(directory, pattern='*'):
         yield join(directory, result)
 
 
+def find_apk_repack():
+    """
+    The native unpack/repack tool, built alongside redex-all, or None when it
+    isn't around and the zipfile fallback has to do.
+    """
+    try:
+        return subprocess.check_output(['which', 'apk-repack']
+                                       ).rstrip().decode('ascii')
+    except subprocess.CalledProcessError:
+        pass
+    # The tool sits next to the redex script, which this module is part of.
+    dir_name = dirname(dirname(abspath(__file__)))
+    while not isdir(dir_name):
+        dir_name = dirname(dir_name)
+    path = join(dir_name, 'apk-repack')
+    if isfile(path) and os.access(path, os.X_OK):
+        return path
+    return None
+
+
 def make_temp_dir(name='', debug=False):
     """ Make a temporary directory which will be automatically deleted """
     global temp_dirs
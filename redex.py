@@ -32,7 +32,8 @@ from os.path import abspath, basename, dirname, isdir, isfile, join
 
 import pyredex.logger as logger
 import pyredex.unpacker as unpacker
-from pyredex.utils import abs_glob, make_temp_dir, remove_temp_dirs, sign_apk
+from pyredex.utils import abs_glob, find_apk_repack, make_temp_dir, \
+    remove_temp_dirs, sign_apk
 from pyredex.logger import log
 
 
@@ -228,6 +229,11 @@ def move_dexen_to_directories(root, dexpaths):
 
 
 def unzip_apk(apk, destination_directory):
+    apk_repack = find_apk_repack()
+    if apk_repack is not None:
+        subprocess.check_call(
+            [apk_repack, 'unpack', apk, destination_directory])
+        return
     with zipfile.ZipFile(apk) as z:
         for info in z.infolist():
             per_file_compression[info.filename] = info.compress_type
@@ -254,8 +260,55 @@ def zipalign(unaligned_apk_path, output_apk_path, ignore_zipalign, page_align):
     os.remove(unaligned_apk_path)
 
 
-def create_output_apk(extracted_apk_dir, output_apk_path, sign, keystore,
-        key_alias, key_password, ignore_zipalign, page_align):
+def is_root_dex(archivepath):
+    return re.match(r'^classes\d*\.dex$', archivepath) is not None
+
+
+def zip_directory(extracted_apk_dir, apk_path, store_dexes):
+    with zipfile.ZipFile(apk_path, 'w') as apk:
+        for dirpath, _dirnames, filenames in os.walk(extracted_apk_dir):
+            for filename in filenames:
+                filepath = join(dirpath, filename)
+                archivepath = filepath[len(extracted_apk_dir) + 1:]
+                if store_dexes and is_root_dex(archivepath):
+                    compress = zipfile.ZIP_STORED
+                else:
+                    try:
+                        compress = per_file_compression[archivepath]
+                    except KeyError:
+                        compress = zipfile.ZIP_DEFLATED
+                apk.write(filepath, archivepath, compress_type=compress)
+
+
+def write_dex_alignment_report(apk_path, report_path):
+    # The runtime can mmap a dex straight from the APK only if it is stored
+    # with its data on a page boundary. Returns whether all of them are.
+    all_mappable = True
+    with zipfile.ZipFile(apk_path) as apk, open(apk_path, 'rb') as f, \
+            open(report_path, 'w') as report:
+        for info in apk.infolist():
+            if not is_root_dex(info.filename):
+                continue
+            # The local header's name and extra field may differ from the
+            # central directory's.
+            f.seek(info.header_offset + 26)
+            name_len, extra_len = struct.unpack('<HH', f.read(4))
+            offset = info.header_offset + 30 + name_len + extra_len
+            if info.compress_type != zipfile.ZIP_STORED:
+                status = 'compressed'
+            elif offset % 4096 != 0:
+                status = 'misaligned'
+            else:
+                status = 'mappable'
+            all_mappable = all_mappable and status == 'mappable'
+            report.write('{}\tsize {}\toffset {}\t{}\n'.format(
+                info.filename, info.file_size, offset, status))
+    return all_mappable
+
+
+def create_output_apk(input_apk_path, extracted_apk_dir, output_apk_path,
+        sign, keystore, key_alias, key_password, ignore_zipalign, page_align,
+        store_dexes):
 
     # Remove old signature files
     for f in abs_glob(extracted_apk_dir, 'META-INF/*'):
@@ -263,24 +316,33 @@ def create_output_apk(extracted_apk_dir, output_apk_path, sign, keystore,
         if isfile(cert_path):
             os.remove(cert_path)
 
+    apk_repack = find_apk_repack()
+    if apk_repack is not None and not sign:
+        # Entries redex didn't change are copied over still compressed, and
+        # alignment happens while writing.
+        if isfile(output_apk_path):
+            os.remove(output_apk_path)
+        subprocess.check_call([apk_repack, 'repack'] +
+            (['--page-align'] if page_align else []) +
+            (['--store-dexes'] if store_dexes else []) +
+            [input_apk_path, extracted_apk_dir, output_apk_path])
+        return
+
     directory = make_temp_dir('.redex_unaligned', False)
     unaligned_apk_path = join(directory, 'redex-unaligned.apk')
 
     if isfile(unaligned_apk_path):
         os.remove(unaligned_apk_path)
 
-    # Create new zip file
-    with zipfile.ZipFile(unaligned_apk_path, 'w') as unaligned_apk:
-        for dirpath, _dirnames, filenames in os.walk(extracted_apk_dir):
-            for filename in filenames:
-                filepath = join(dirpath, filename)
-                archivepath = filepath[len(extracted_apk_dir) + 1:]
-                try:
-                    compress = per_file_compression[archivepath]
-                except KeyError:
-                    compress = zipfile.ZIP_DEFLATED
-                unaligned_apk.write(filepath, archivepath,
-                        compress_type=compress)
+    # Create new zip file. Signing rewrites it, so it still needs zipalign
+    # afterwards, which only page-aligns shared libraries: stored dexes end up
+    # merely 4-aligned.
+    if apk_repack is not None:
+        subprocess.check_call([apk_repack, 'repack'] +
+            (['--store-dexes'] if store_dexes else []) +
+            [input_apk_path, extracted_apk_dir, unaligned_apk_path])
+    else:
+        zip_directory(extracted_apk_dir, unaligned_apk_path, store_dexes)
 
     # Add new signature
     if sign:
@@ -306,49 +368,15 @@ def merge_proguard_maps(
     redex_pg_file = "redex-class-rename-map.txt"
     output_dir = os.path.dirname(apk_output_path)
     output_file = join(output_dir, redex_pg_file)
-    # If -dontobfuscate is set, proguard won't produce a mapping file, but
-    # buck will create an empty mapping.txt. Check for this case.
+    # redex-all has already merged the redex class rename map into the
+    # proguard map, if there was one. If -dontobfuscate is set, proguard
+    # won't produce a mapping file, but buck will create an empty mapping.txt.
     if pg_file and os.path.getsize(pg_file) > 0:
-        update_proguard_mapping_file(
-                pg_file,
-                redex_rename_map_path,
-                output_file)
-        log('merging proguard map with redex class rename map')
-        log('pg mapping file input is ' + str(pg_file))
-        log('wrote redex pg format mapping file to ' + str(output_file))
+        log('proguard map was merged with redex class rename map')
     else:
         log('no proguard map file found')
-        shutil.move(redex_rename_map_path, output_file)
-
-
-def update_proguard_mapping_file(pg_map, redex_map, output_file):
-    with open(pg_map, 'r') as pg_map,\
-            open(redex_map, 'r') as redex_map,\
-            open(output_file, 'w') as output:
-        cls_regex = re.compile(r'^(.*) -> (.*):')
-        redex_dict = {}
-        for line in redex_map:
-            match_obj = cls_regex.match(line)
-            if match_obj:
-                unmangled = match_obj.group(1)
-                mangled = match_obj.group(2)
-                redex_dict[unmangled] = mangled
-        for line in pg_map:
-            match_obj = cls_regex.match(line)
-            if match_obj:
-                unmangled = match_obj.group(1)
-                mangled = match_obj.group(2)
-                new_mapping = line.rstrip()
-                if unmangled in redex_dict:
-                    out_mangled = redex_dict.pop(unmangled)
-                    new_mapping = unmangled + ' -> ' + out_mangled + ':'
-                    print(new_mapping, file=output)
-                else:
-                    print(line.rstrip(), file=output)
-            else:
-                print(line.rstrip(), file=output)
-        for unmangled, mangled in redex_dict.items():
-            print('%s -> %s:' % (unmangled, mangled), file=output)
+    log('wrote redex pg format mapping file to ' + str(output_file))
+    shutil.move(redex_rename_map_path, output_file)
 
 
 def overwrite_proguard_maps(
@@ -462,6 +490,9 @@ Given an APK, produce a better APK!
     parser.add_argument('--verify-none-mode', action='store_true', help='Enable verify-none mode on redex')
     parser.add_argument('--page-align-libs', action='store_true',
            help='Preserve 4k page alignment for uncompressed libs')
+    parser.add_argument('--store-dexes', action='store_true',
+           help='Store the dexes uncompressed and 4k aligned, for the runtime '
+                'to mmap them from the APK, and write redex-dex-alignment.txt')
 
     return parser
 
@@ -629,10 +660,19 @@ def run_redex(args):
         locator_store_id = locator_store_id + 1
 
     log('Creating output apk')
-    create_output_apk(extracted_apk_dir, args.out, args.sign, args.keystore,
-            args.keyalias, args.keypass, args.ignore_zipalign, args.page_align_libs)
+    create_output_apk(args.input_apk, extracted_apk_dir, args.out, args.sign,
+            args.keystore, args.keyalias, args.keypass, args.ignore_zipalign,
+            args.page_align_libs, args.store_dexes)
     log('Creating output APK finished in {:.2f} seconds'.format(
             timer() - repack_start_time))
+    if args.store_dexes:
+        report_path = join(dirname(abspath(args.out)),
+                           'redex-dex-alignment.txt')
+        if write_dex_alignment_report(args.out, report_path):
+            log('All dexes can be mapped from the APK, see ' + report_path)
+        else:
+            log('Warning: some dexes can\'t be mapped from the APK, see ' +
+                report_path)
     copy_file_to_out_dir(dex_dir, args.out, 'redex-line-number-map', 'line number map', 'redex-line-number-map')
     copy_file_to_out_dir(dex_dir, args.out, 'redex-line-number-map-v2', 'line number map v2', 'redex-line-number-map-v2')
     copy_file_to_out_dir(dex_dir, args.out, 'stats.txt', 'stats', 'redex-stats.txt')
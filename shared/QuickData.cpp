@@ -8,3 +8,176 @@
  */
 
 #include "QuickData.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr uint32_t MappedQuickData::MAGIC;
+constexpr uint32_t MappedQuickData::VERSION;
+
+namespace {
+
+bool write_words(FILE* fd, const std::vector<uint32_t>& words) {
+  return fwrite(words.data(), sizeof(uint32_t), words.size(), fd) ==
+         words.size();
+}
+
+} // namespace
+
+bool QuickData::serialize_binary(FILE* fd) const {
+  // The dexes come sorted by name out of the map, and so do their entries
+  // by idx.
+  uint32_t num_dexes = dex_to_idx_to_offset.size();
+  uint32_t entries_offset = (3 + 4 * num_dexes) * sizeof(uint32_t);
+  uint32_t names_offset = entries_offset;
+  for (const auto& dex_to_map : dex_to_idx_to_offset) {
+    names_offset += dex_to_map.second.size() * 2 * sizeof(uint32_t);
+  }
+
+  std::vector<uint32_t> header{MappedQuickData::MAGIC,
+                               MappedQuickData::VERSION, num_dexes};
+  for (const auto& dex_to_map : dex_to_idx_to_offset) {
+    header.push_back(names_offset);
+    header.push_back(dex_to_map.first.size());
+    header.push_back(entries_offset);
+    header.push_back(dex_to_map.second.size());
+    names_offset += dex_to_map.first.size();
+    entries_offset += dex_to_map.second.size() * 2 * sizeof(uint32_t);
+  }
+  if (!write_words(fd, header)) {
+    return false;
+  }
+  for (const auto& dex_to_map : dex_to_idx_to_offset) {
+    std::vector<uint32_t> entries;
+    entries.reserve(dex_to_map.second.size() * 2);
+    for (const auto& idx_to_offset : dex_to_map.second) {
+      entries.push_back(idx_to_offset.first);
+      entries.push_back(idx_to_offset.second);
+    }
+    if (!write_words(fd, entries)) {
+      return false;
+    }
+  }
+  for (const auto& dex_to_map : dex_to_idx_to_offset) {
+    const auto& name = dex_to_map.first;
+    if (fwrite(name.data(), 1, name.size(), fd) != name.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool convert_quick_data(const std::string& text_path,
+                        const std::string& binary_path) {
+  std::ifstream istream(text_path);
+  if (!istream) {
+    return false;
+  }
+  QuickData quick_data;
+  quick_data.read_text(istream);
+  FILE* fd = fopen(binary_path.c_str(), "wb");
+  if (fd == nullptr) {
+    return false;
+  }
+  bool written = quick_data.serialize_binary(fd);
+  return fclose(fd) == 0 && written;
+}
+
+MappedQuickData::MappedQuickData(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    void* map =
+        mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      m_data = static_cast<const char*>(map);
+      m_size = file_stat.st_size;
+    }
+  }
+  close(fd);
+  if (m_data != nullptr && !validate()) {
+    munmap(const_cast<char*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+  }
+}
+
+MappedQuickData::~MappedQuickData() {
+  if (m_data != nullptr) {
+    munmap(const_cast<char*>(m_data), m_size);
+  }
+}
+
+// Checks the header and that the dex table and everything it points to lie
+// within the file, so that lookups need no checks of their own.
+bool MappedQuickData::validate() const {
+  auto words = reinterpret_cast<const uint32_t*>(m_data);
+  if (m_size < 3 * sizeof(uint32_t) || words[0] != MAGIC ||
+      words[1] != VERSION) {
+    return false;
+  }
+  uint64_t table_end =
+      3 * sizeof(uint32_t) + uint64_t(num_dexes()) * sizeof(DexEntry);
+  if (table_end > m_size) {
+    return false;
+  }
+  for (uint32_t i = 0; i < num_dexes(); ++i) {
+    const auto& entry = dex_entries()[i];
+    if (uint64_t(entry.name_offset) + entry.name_size > m_size ||
+        entry.entries_offset % sizeof(uint32_t) != 0 ||
+        uint64_t(entry.entries_offset) +
+                uint64_t(entry.num_entries) * sizeof(IdxOffset) >
+            m_size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<std::string> MappedQuickData::dexes() const {
+  std::vector<std::string> ret;
+  if (m_data == nullptr) {
+    return ret;
+  }
+  for (uint32_t i = 0; i < num_dexes(); ++i) {
+    ret.push_back(name(dex_entries()[i]));
+  }
+  return ret;
+}
+
+bool MappedQuickData::get_offset(const std::string& dex,
+                                 uint32_t idx,
+                                 uint32_t* offset) const {
+  if (m_data == nullptr) {
+    return false;
+  }
+  auto begin = dex_entries();
+  auto end = begin + num_dexes();
+  auto compare_name = [&](const DexEntry& entry, const std::string& name) {
+    auto size = std::min<size_t>(entry.name_size, name.size());
+    int cmp = memcmp(m_data + entry.name_offset, name.data(), size);
+    return cmp < 0 || (cmp == 0 && entry.name_size < name.size());
+  };
+  auto dex_it = std::lower_bound(begin, end, dex, compare_name);
+  if (dex_it == end || name(*dex_it) != dex) {
+    return false;
+  }
+  auto entries =
+      reinterpret_cast<const IdxOffset*>(m_data + dex_it->entries_offset);
+  auto entries_end = entries + dex_it->num_entries;
+  auto it = std::lower_bound(
+      entries, entries_end, idx,
+      [](const IdxOffset& entry, uint32_t idx) { return entry.idx < idx; });
+  if (it == entries_end || it->idx != idx) {
+    return false;
+  }
+  *offset = it->offset;
+  return true;
+}
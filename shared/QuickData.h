@@ -7,11 +7,16 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <string>
+#include <vector>
 
 struct QuickData {
   std::map<std::string, std::map<uint32_t, uint32_t>> dex_to_idx_to_offset;
@@ -39,20 +44,23 @@ struct QuickData {
     }
   }
 
-  void deserialize(std::ifstream& istream) {
+  // Reads the text format written by serialize().
+  void read_text(std::istream& istream) {
     std::string line;
-    std::string classes;
+    std::map<uint32_t, uint32_t>* dex_map = nullptr;
     while (std::getline(istream, line)) {
       size_t found = line.find(":");
       if (found == std::string::npos) {
-        std::map<uint32_t, uint32_t> dex_map;
-        dex_to_idx_to_offset[line] = std::move(dex_map);
-        classes = line;
-      } else {
-        dex_to_idx_to_offset[classes][std::stoul(line.substr(0, found))] =
-            std::stoul(line.substr(found + 1));
+        dex_map = &dex_to_idx_to_offset[line];
+      } else if (dex_map != nullptr) {
+        (*dex_map)[strtoul(line.c_str(), nullptr, 10)] =
+            strtoul(line.c_str() + found + 1, nullptr, 10);
       }
     }
+  }
+
+  void deserialize(std::ifstream& istream) {
+    read_text(istream);
     for (auto dex_to_map = dex_to_idx_to_offset.begin();
          dex_to_map != dex_to_idx_to_offset.end();
          ++dex_to_map) {
@@ -64,4 +72,81 @@ struct QuickData {
       }
     }
   }
+
+  // Writes the binary format that MappedQuickData reads. Returns false if
+  // writing failed.
+  bool serialize_binary(FILE* fd) const;
+};
+
+/*
+ * Converts quickening data from the text format of QuickData::serialize() to
+ * the binary one. Returns false if either file can't be used.
+ */
+bool convert_quick_data(const std::string& text_path,
+                        const std::string& binary_path);
+
+/*
+ * Quickening data in the binary format, mapped rather than read, so that
+ * opening it costs nothing and looking up an index only touches the pages on
+ * the way to it.
+ *
+ * The format is made of little-endian 32-bit words:
+ *
+ *   magic, version, number of dexes
+ *   for each dex, sorted by name:
+ *     name offset, name size, entries offset, number of entries
+ *   for each dex, its entries as (idx, offset) pairs sorted by idx
+ *   the names
+ *
+ * with offsets counted in bytes from the start of the file.
+ */
+class MappedQuickData {
+ public:
+  static constexpr uint32_t MAGIC = 0x444b4351; // "QCKD"
+  static constexpr uint32_t VERSION = 1;
+
+  // Check is_valid() to see if the file could be mapped and is well formed.
+  explicit MappedQuickData(const std::string& path);
+  ~MappedQuickData();
+  MappedQuickData(const MappedQuickData&) = delete;
+  MappedQuickData& operator=(const MappedQuickData&) = delete;
+
+  bool is_valid() const { return m_data != nullptr; }
+
+  // The dexes that have data, sorted.
+  std::vector<std::string> dexes() const;
+
+  // Sets *offset to the offset of idx in the dex, and returns whether there
+  // is one.
+  bool get_offset(const std::string& dex, uint32_t idx, uint32_t* offset) const;
+
+ private:
+  struct DexEntry {
+    uint32_t name_offset;
+    uint32_t name_size;
+    uint32_t entries_offset;
+    uint32_t num_entries;
+  };
+
+  struct IdxOffset {
+    uint32_t idx;
+    uint32_t offset;
+  };
+
+  const DexEntry* dex_entries() const {
+    return reinterpret_cast<const DexEntry*>(m_data + 3 * sizeof(uint32_t));
+  }
+
+  uint32_t num_dexes() const {
+    return reinterpret_cast<const uint32_t*>(m_data)[2];
+  }
+
+  std::string name(const DexEntry& entry) const {
+    return std::string(m_data + entry.name_offset, entry.name_size);
+  }
+
+  bool validate() const;
+
+  const char* m_data{nullptr};
+  size_t m_size{0};
 };
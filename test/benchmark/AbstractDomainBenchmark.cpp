@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "HashedAbstractEnvironment.h"
+#include "HashedSetAbstractDomain.h"
+#include "PatriciaTreeMapAbstractEnvironment.h"
+#include "PatriciaTreeSet.h"
+#include "PatriciaTreeSetAbstractDomain.h"
+
+namespace {
+
+using pt_set = PatriciaTreeSet<uint32_t>;
+using SetDomain = PatriciaTreeSetAbstractDomain<uint32_t>;
+using PatriciaEnvironment = PatriciaTreeMapAbstractEnvironment<uint32_t, SetDomain>;
+using HashedEnvironment = HashedAbstractEnvironment<uint32_t, SetDomain>;
+
+/*
+ * Two sets of `size` elements drawn from a range of 2 * size, so that about
+ * half the elements are shared, as between the states of neighbouring
+ * blocks.
+ */
+std::pair<pt_set, pt_set> make_overlapping_sets(size_t size) {
+  std::mt19937 gen(size);
+  std::uniform_int_distribution<uint32_t> dist(0, 2 * size);
+  pt_set a, b;
+  for (size_t i = 0; i < size; ++i) {
+    a.insert(dist(gen));
+    b.insert(dist(gen));
+  }
+  return {a, b};
+}
+
+template <class Environment>
+std::pair<Environment, Environment> make_overlapping_environments(
+    size_t size) {
+  std::mt19937 gen(size);
+  std::uniform_int_distribution<uint32_t> dist(0, 2 * size);
+  Environment a, b;
+  for (size_t i = 0; i < size; ++i) {
+    a.set(dist(gen), SetDomain({dist(gen), dist(gen)}));
+    b.set(dist(gen), SetDomain({dist(gen), dist(gen)}));
+  }
+  return {a, b};
+}
+
+void BM_PatriciaTreeSetUnion(benchmark::State& state) {
+  auto sets = make_overlapping_sets(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sets.first.get_union_with(sets.second));
+  }
+}
+BENCHMARK(BM_PatriciaTreeSetUnion)->Range(16, 16 << 10);
+
+void BM_PatriciaTreeSetIntersection(benchmark::State& state) {
+  auto sets = make_overlapping_sets(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sets.first.get_intersection_with(sets.second));
+  }
+}
+BENCHMARK(BM_PatriciaTreeSetIntersection)->Range(16, 16 << 10);
+
+template <class Environment>
+void BM_EnvironmentJoin(benchmark::State& state) {
+  auto envs = make_overlapping_environments<Environment>(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(envs.first.join(envs.second));
+  }
+}
+BENCHMARK_TEMPLATE(BM_EnvironmentJoin, PatriciaEnvironment)
+    ->Range(16, 4 << 10);
+BENCHMARK_TEMPLATE(BM_EnvironmentJoin, HashedEnvironment)->Range(16, 4 << 10);
+
+template <class Environment>
+void BM_EnvironmentMeet(benchmark::State& state) {
+  auto envs = make_overlapping_environments<Environment>(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(envs.first.meet(envs.second));
+  }
+}
+BENCHMARK_TEMPLATE(BM_EnvironmentMeet, PatriciaEnvironment)
+    ->Range(16, 4 << 10);
+BENCHMARK_TEMPLATE(BM_EnvironmentMeet, HashedEnvironment)->Range(16, 4 << 10);
+
+// Copying a state is what every transfer function starts with.
+template <class Environment>
+void BM_EnvironmentCopyAndSet(benchmark::State& state) {
+  auto envs = make_overlapping_environments<Environment>(state.range(0));
+  uint32_t key = 0;
+  for (auto _ : state) {
+    auto copy = envs.first;
+    copy.set(key++ % state.range(0), SetDomain(key));
+    benchmark::DoNotOptimize(copy);
+  }
+}
+BENCHMARK_TEMPLATE(BM_EnvironmentCopyAndSet, PatriciaEnvironment)
+    ->Range(16, 4 << 10);
+BENCHMARK_TEMPLATE(BM_EnvironmentCopyAndSet, HashedEnvironment)
+    ->Range(16, 4 << 10);
+
+} // namespace
@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+
+#include "ConcurrentContainers.h"
+
+namespace {
+
+constexpr uint32_t kInsertsPerIteration = 1 << 12;
+
+/*
+ * Every thread inserts into the same map. With `distinct` keys the threads
+ * only contend on the slot locks; otherwise they also race to insert the same
+ * keys, as when several workers intern the same entity.
+ */
+void insert_under_contention(benchmark::State& state, bool distinct) {
+  static ConcurrentMap<uint32_t, uint32_t>* s_map;
+  if (state.thread_index() == 0) {
+    s_map = new ConcurrentMap<uint32_t, uint32_t>();
+  }
+  uint32_t base = distinct ? state.thread_index() * kInsertsPerIteration : 0;
+  uint32_t round = 0;
+  for (auto _ : state) {
+    auto offset = base + round++ * state.threads() * kInsertsPerIteration;
+    for (uint32_t i = 0; i < kInsertsPerIteration; ++i) {
+      s_map->insert({offset + i, i});
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kInsertsPerIteration);
+  if (state.thread_index() == 0) {
+    delete s_map;
+  }
+}
+
+void BM_ConcurrentMapInsertDistinct(benchmark::State& state) {
+  insert_under_contention(state, true);
+}
+BENCHMARK(BM_ConcurrentMapInsertDistinct)->ThreadRange(1, 32)->UseRealTime();
+
+void BM_ConcurrentMapInsertShared(benchmark::State& state) {
+  insert_under_contention(state, false);
+}
+BENCHMARK(BM_ConcurrentMapInsertShared)->ThreadRange(1, 32)->UseRealTime();
+
+} // namespace
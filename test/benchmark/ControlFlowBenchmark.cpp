@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "ControlFlow.h"
+#include "FixpointIterators.h"
+#include "IRCode.h"
+#include "PatriciaTreeSetAbstractDomain.h"
+#include "SyntheticCode.h"
+
+namespace {
+
+void BM_BuildCFG(benchmark::State& state) {
+  auto code = benchmark_util::make_synthetic_code(state.range(0));
+  for (auto _ : state) {
+    code->build_cfg();
+    benchmark::DoNotOptimize(code->cfg().blocks().size());
+    code->clear_cfg();
+  }
+}
+BENCHMARK(BM_BuildCFG)->Range(16, 16 << 10);
+
+void BM_BuildEditableCFG(benchmark::State& state) {
+  auto code = benchmark_util::make_synthetic_code(state.range(0));
+  for (auto _ : state) {
+    code->build_cfg(/* editable */ true);
+    benchmark::DoNotOptimize(code->cfg().blocks().size());
+    code->clear_cfg();
+  }
+}
+BENCHMARK(BM_BuildEditableCFG)->Range(16, 16 << 10);
+
+using RegisterSet = PatriciaTreeSetAbstractDomain<uint16_t>;
+
+/*
+ * A forward analysis that collects the registers written on some path to
+ * each block; cheap transfer functions, so the iterator itself dominates.
+ */
+class WrittenRegisters final
+    : public MonotonicFixpointIterator<cfg::GraphInterface, RegisterSet> {
+ public:
+  explicit WrittenRegisters(const ControlFlowGraph& cfg)
+      : MonotonicFixpointIterator(cfg, cfg.blocks().size()) {}
+
+  void analyze_node(const NodeId& block,
+                    RegisterSet* current_state) const override {
+    for (const auto& mie : InstructionIterable(block)) {
+      if (mie.insn->dests_size()) {
+        current_state->add(mie.insn->dest());
+      }
+    }
+  }
+
+  RegisterSet analyze_edge(const EdgeId&,
+                           const RegisterSet& exit_state) const override {
+    return exit_state;
+  }
+};
+
+void BM_MonotonicFixpointIterator(benchmark::State& state) {
+  auto code = benchmark_util::make_synthetic_code(state.range(0));
+  code->build_cfg();
+  for (auto _ : state) {
+    WrittenRegisters analysis(code->cfg());
+    analysis.run(RegisterSet());
+    benchmark::DoNotOptimize(
+        analysis.get_exit_state_at(code->cfg().entry_block()));
+  }
+}
+BENCHMARK(BM_MonotonicFixpointIterator)->Range(16, 4 << 10);
+
+} // namespace
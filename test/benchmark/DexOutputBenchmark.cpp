@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexClass.h"
+#include "DexInstruction.h"
+#include "DexOutput.h"
+#include "DexStore.h"
+#include "DexUtil.h"
+#include "InstructionLowering.h"
+#include "RedexContext.h"
+#include "SyntheticCode.h"
+
+namespace {
+
+/*
+ * A store of `num_classes` classes with a few methods each, lowered and
+ * ready to be written.
+ */
+DexStoresVector make_store(size_t num_classes) {
+  auto proto = DexProto::make_proto(get_int_type(),
+                                    DexTypeList::make_type_list({}));
+  DexClasses classes;
+  for (size_t i = 0; i < num_classes; ++i) {
+    auto type = DexType::make_type(
+        ("Lcom/example/Bench" + std::to_string(i) + ";").c_str());
+    ClassCreator creator(type);
+    creator.set_super(get_object_type());
+    for (size_t j = 0; j < 8; ++j) {
+      auto method = static_cast<DexMethod*>(DexMethod::make_method(
+          type, DexString::make_string("m" + std::to_string(j)), proto));
+      method->make_concrete(ACC_PUBLIC | ACC_STATIC,
+                            benchmark_util::make_synthetic_code(4 + j * 4),
+                            false);
+      creator.add_method(method);
+    }
+    classes.push_back(creator.create());
+  }
+  DexStore store("classes");
+  store.add_classes(std::move(classes));
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  instruction_lowering::run(stores);
+  return stores;
+}
+
+void BM_WriteClassesToDex(benchmark::State& state) {
+  delete g_redex;
+  g_redex = new RedexContext();
+  auto stores = make_store(state.range(0));
+  Json::Value json(Json::objectValue);
+  ConfigFiles cfg(json);
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make("", ""));
+  auto filename = (boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("bench-%%%%%%%%.dex"))
+                      .string();
+  for (auto _ : state) {
+    auto stats = write_classes_to_dex(filename,
+                                      &stores[0].get_dexen()[0],
+                                      nullptr /* LocatorIndex* */,
+                                      0,
+                                      cfg,
+                                      json,
+                                      pos_mapper.get());
+    state.counters["bytes"] = stats.num_bytes;
+  }
+  std::remove(filename.c_str());
+}
+BENCHMARK(BM_WriteClassesToDex)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+
+/*
+ * A method body of `num_groups` repetitions of a load, a field read, a call,
+ * some arithmetic and a branch, drawing on `num_refs` distinct strings, types,
+ * fields and methods, like typical code. `dodx` gets an index for each of
+ * them.
+ */
+std::unique_ptr<DexCode> make_dex_code(size_t num_groups,
+                                       size_t num_refs,
+                                       std::unique_ptr<DexOutputIdx>* dodx) {
+  auto strings = new dexstring_to_idx();
+  auto types = new dextype_to_idx();
+  auto fields = new dexfield_to_idx();
+  auto methods = new dexmethod_to_idx();
+  std::vector<DexString*> string_refs;
+  std::vector<DexType*> type_refs;
+  std::vector<DexFieldRef*> field_refs;
+  std::vector<DexMethodRef*> method_refs;
+  for (size_t i = 0; i < num_refs; ++i) {
+    auto suffix = std::to_string(i);
+    auto str = DexString::make_string("string" + suffix);
+    auto type = DexType::make_type(("Lcom/example/T" + suffix + ";").c_str());
+    auto field = DexField::make_field(type, str, type);
+    auto method = DexMethod::make_method(
+        type, str, DexProto::make_proto(type, DexTypeList::make_type_list({})));
+    strings->emplace(str, i);
+    types->emplace(type, i);
+    fields->emplace(field, i);
+    methods->emplace(method, i);
+    string_refs.push_back(str);
+    type_refs.push_back(type);
+    field_refs.push_back(field);
+    method_refs.push_back(method);
+  }
+  dodx->reset(new DexOutputIdx(
+      strings, types, new dexproto_to_idx(), fields, methods, nullptr));
+
+  auto code = std::make_unique<DexCode>();
+  code->set_registers_size(4);
+  auto& insns = code->reset_instructions();
+  for (size_t i = 0; i < num_groups; ++i) {
+    auto ref = (i * 7919) % num_refs;
+    insns.push_back(
+        (new DexOpcodeString(DOPCODE_CONST_STRING, string_refs[ref]))
+            ->set_dest(0));
+    insns.push_back((new DexOpcodeType(DOPCODE_NEW_INSTANCE, type_refs[ref]))
+                        ->set_dest(1));
+    insns.push_back((new DexOpcodeField(DOPCODE_IGET_OBJECT, field_refs[ref]))
+                        ->set_dest(2)
+                        ->set_src(0, 1));
+    insns.push_back(
+        (new DexOpcodeMethod(DOPCODE_INVOKE_VIRTUAL, method_refs[ref]))
+            ->set_arg_word_count(2)
+            ->set_src(0, 1)
+            ->set_src(1, 0));
+    insns.push_back((new DexInstruction(DOPCODE_MOVE_RESULT))->set_dest(3));
+    insns.push_back((new DexInstruction(DOPCODE_ADD_INT))
+                        ->set_dest(3)
+                        ->set_src(0, 3)
+                        ->set_src(1, 2));
+    insns.push_back(
+        (new DexInstruction(DOPCODE_IF_EQZ))->set_src(0, 3)->set_offset(2));
+  }
+  insns.push_back(new DexInstruction(DOPCODE_RETURN_VOID));
+  return code;
+}
+
+void BM_EncodeDexCode(benchmark::State& state) {
+  delete g_redex;
+  g_redex = new RedexContext();
+  std::unique_ptr<DexOutputIdx> dodx;
+  auto code = make_dex_code(state.range(0), 1000, &dodx);
+  std::vector<uint32_t> output(code->size() + sizeof(dex_code_item));
+  for (auto _ : state) {
+    auto size = code->encode(dodx.get(), output.data());
+    benchmark::DoNotOptimize(size);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          code->get_instructions().size());
+  state.SetBytesProcessed(state.iterations() * code->size() *
+                          sizeof(uint16_t));
+}
+BENCHMARK(BM_EncodeDexCode)->Arg(10)->Arg(1000)->Arg(10000);
+
+} // namespace
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "SyntheticCode.h"
+
+namespace {
+
+IRInstruction* make_add(uint16_t reg) {
+  auto insn = new IRInstruction(OPCODE_ADD_INT);
+  insn->set_dest(reg);
+  insn->set_src(0, reg);
+  insn->set_src(1, reg);
+  return insn;
+}
+
+void BM_IRListPushBack(benchmark::State& state) {
+  for (auto _ : state) {
+    IRCode code;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+      code.push_back(make_add(i % 16));
+    }
+    benchmark::DoNotOptimize(code.count_opcodes());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IRListPushBack)->Range(64, 64 << 10);
+
+// Inserting a new instruction in front of every existing one, the pattern
+// of instrumentation and lowering passes.
+void BM_IRListInsertBefore(benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto code = benchmark_util::make_synthetic_code(state.range(0));
+    state.ResumeTiming();
+    for (auto it = code->begin(); it != code->end(); ++it) {
+      if (it->type == MFLOW_OPCODE) {
+        code->insert_before(it, make_add(0));
+      }
+    }
+    benchmark::DoNotOptimize(code->count_opcodes());
+  }
+}
+BENCHMARK(BM_IRListInsertBefore)->Range(16, 16 << 10);
+
+// Removing every other arithmetic instruction, as in dead code elimination.
+void BM_IRListRemove(benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto code = benchmark_util::make_synthetic_code(state.range(0));
+    state.ResumeTiming();
+    bool remove = false;
+    for (auto it = code->begin(); it != code->end();) {
+      auto cur = it++;
+      if (cur->type == MFLOW_OPCODE &&
+          cur->insn->opcode() == OPCODE_ADD_INT && (remove = !remove)) {
+        code->remove_opcode(cur);
+      }
+    }
+    benchmark::DoNotOptimize(code->count_opcodes());
+  }
+}
+BENCHMARK(BM_IRListRemove)->Range(16, 16 << 10);
+
+} // namespace
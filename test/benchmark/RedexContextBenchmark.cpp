@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "DexClass.h"
+#include "RedexContext.h"
+
+namespace {
+
+constexpr size_t kNumNames = 1 << 14;
+
+std::vector<std::string> make_type_names() {
+  std::vector<std::string> names;
+  for (size_t i = 0; i < kNumNames; ++i) {
+    names.push_back("Lcom/example/pkg" + std::to_string(i % 64) + "/Class" +
+                    std::to_string(i) + ";");
+  }
+  return names;
+}
+
+/*
+ * Interning names the context hasn't seen yet, as when loading dexes.
+ */
+void BM_InternNew(benchmark::State& state) {
+  static std::vector<std::string> s_names = make_type_names();
+  for (auto _ : state) {
+    state.PauseTiming();
+    delete g_redex;
+    g_redex = new RedexContext();
+    state.ResumeTiming();
+    for (const auto& name : s_names) {
+      benchmark::DoNotOptimize(DexType::make_type(name.c_str()));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * s_names.size());
+}
+BENCHMARK(BM_InternNew);
+
+/*
+ * Looking up names that are already interned, which is what passes mostly do.
+ */
+void BM_InternExisting(benchmark::State& state) {
+  static std::vector<std::string> s_names = make_type_names();
+  if (state.thread_index() == 0) {
+    delete g_redex;
+    g_redex = new RedexContext();
+    for (const auto& name : s_names) {
+      DexType::make_type(name.c_str());
+    }
+  }
+  for (auto _ : state) {
+    for (const auto& name : s_names) {
+      benchmark::DoNotOptimize(DexType::get_type(name.c_str()));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * s_names.size());
+}
+BENCHMARK(BM_InternExisting)->ThreadRange(1, 16)->UseRealTime();
+
+} // namespace
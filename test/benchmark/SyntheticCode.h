@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "IRAssembler.h"
+#include "IRCode.h"
+
+namespace benchmark_util {
+
+/*
+ * Builds a method body of `num_blocks` basic blocks, each doing a little
+ * arithmetic and then branching to a pseudo-randomly chosen block, so the
+ * resulting CFG has loops and merge points like real code. The same
+ * arguments always produce the same code.
+ */
+inline std::unique_ptr<IRCode> make_synthetic_code(size_t num_blocks) {
+  std::ostringstream ss;
+  ss << "((const v0 0) (const v1 1) (const v2 2)";
+  for (size_t i = 0; i < num_blocks; ++i) {
+    auto reg = 3 + i % 8;
+    ss << " :L" << i << " (add-int v" << reg << " v" << (i % 3) << " v"
+       << ((i + 1) % 3) << ")"
+       << " (mul-int v0 v0 v" << reg << ")"
+       << " (if-eqz v" << reg << " :L" << (i * 7919 + 3) % num_blocks << ")";
+  }
+  ss << " (return v0))";
+  return assembler::ircode_from_string(ss.str());
+}
+
+} // namespace benchmark_util
@@ -9,6 +9,9 @@ import argparse
 import json
 import subprocess
 
+# This reruns all of redex for each try. To only rerun the passes after the
+# first N, set "bisect": {"prefix": N, "command": ...} in the config instead
+# (see PassManager::bisect_passes).
 
 SPECIAL_PASSES = [
     'ReBindRefsPass',
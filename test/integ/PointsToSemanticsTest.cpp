@@ -9,6 +9,7 @@
 
 #include "PointsToSemantics.h"
 
+#include <boost/filesystem.hpp>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <set>
@@ -329,5 +330,20 @@ TEST(PointsToSemanticsTest, semanticActionGeneration) {
   }
   EXPECT_THAT(deserialization, ::testing::ContainerEq(method_semantics));
 
+  // Testing the binary cache. None of the code has changed, so all the
+  // points-to actions come from the cache.
+  auto cache_file = boost::filesystem::temp_directory_path() /
+                    boost::filesystem::unique_path("pts-cache-%%%%%%%%");
+  pt_semantics.write_cache(cache_file.string());
+  PointsToSemantics cached_semantics(scope, cache_file.string());
+  boost::filesystem::remove(cache_file);
+  std::set<std::string> cached_output;
+  for (const auto& pt_entry : cached_semantics) {
+    std::ostringstream out;
+    out << pt_entry.second;
+    cached_output.insert(out.str());
+  }
+  EXPECT_THAT(cached_output, ::testing::ContainerEq(method_semantics));
+
   delete g_redex;
 }
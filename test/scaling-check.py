@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+"""
+Runs redex-all over each APK of a corpus with 1, 2, 4, ... threads, checks
+that every thread count writes byte-for-byte the same dexes as the first one,
+and writes a scaling report with the pass and Timer timings of each run:
+
+  test/scaling-check.py --redex-all path/to/redex-all -c config.json \\
+      -p proguard.pro --threads 1,2,4,8 --report scaling.json a.apk b.apk
+
+The APK that test/equivalence generates, whose tests exercise the passes,
+makes a good member of the corpus. Like compare_bits.sh, this only compares
+the dexes. It exits with 1 if any of them differ, and keeps the outputs of
+those runs for diffing.
+"""
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import argparse
+import hashlib
+import json
+import multiprocessing
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import timeit
+import zipfile
+
+from os.path import basename, join
+
+
+def default_thread_counts():
+    counts = [1]
+    while counts[-1] * 2 <= multiprocessing.cpu_count():
+        counts.append(counts[-1] * 2)
+    if counts[-1] != multiprocessing.cpu_count():
+        counts.append(multiprocessing.cpu_count())
+    return counts
+
+
+def dex_digests(apk_path):
+    digests = {}
+    with zipfile.ZipFile(apk_path) as apk:
+        for name in apk.namelist():
+            if re.match(r'^classes\d*\.dex$', name):
+                digests[name] = hashlib.sha1(apk.read(name)).hexdigest()
+    return digests
+
+
+def load_json(path, default):
+    if not os.path.isfile(path):
+        return default
+    with open(path) as f:
+        return json.load(f)
+
+
+def run_redex(args, apk, threads, out_dir):
+    os.makedirs(out_dir)
+    out_apk = join(out_dir, 'out.apk')
+    cmd = [args.redex_all,
+           '--config', args.config,
+           '--outdir', out_dir,
+           '--output-apk', out_apk,
+           '-Sstats_output=stats.json',
+           '-Spass_stats_output=pass-stats.json']
+    for pg_config in args.proguard_configs:
+        cmd += ['--proguard-config', pg_config]
+    for jar in args.jarpaths:
+        cmd += ['--jarpath', jar]
+    cmd += args.redex_args + [apk]
+    env = dict(os.environ, REDEX_THREADS=str(threads))
+    start = timeit.default_timer()
+    with open(join(out_dir, 'redex.log'), 'w') as log:
+        subprocess.check_call(cmd, env=env, stdout=log, stderr=log)
+    wall_secs = timeit.default_timer() - start
+
+    stats = load_json(join(out_dir, 'stats.json'), {})
+    timers = {}
+    for timer in stats.get('output_stats', {}).get('time_stats', []):
+        timers.update(timer)
+    passes = [{'name': p['name'],
+               'wall_secs': p['wall_secs'],
+               'cpu_secs': p['cpu_secs']}
+              for p in load_json(join(out_dir, 'pass-stats.json'), [])]
+    return {
+        'threads': threads,
+        'wall_secs': wall_secs,
+        'passes': passes,
+        'timers': timers,
+        'dexes': dex_digests(out_apk),
+    }
+
+
+def check_apk(args, apk, work_dir):
+    runs = []
+    for threads in args.threads:
+        out_dir = join(work_dir, 'threads-{}'.format(threads))
+        print('{}: {} threads'.format(apk, threads))
+        runs.append(run_redex(args, apk, threads, out_dir))
+
+    baseline = runs[0]
+    for run in runs:
+        names = set(baseline['dexes']) | set(run['dexes'])
+        run['differing_dexes'] = sorted(
+            name for name in names
+            if baseline['dexes'].get(name) != run['dexes'].get(name))
+        run['identical'] = not run['differing_dexes']
+        run['speedup'] = baseline['wall_secs'] / run['wall_secs']
+        # The passes line up as long as the output does.
+        if len(run['passes']) == len(baseline['passes']):
+            for p, base in zip(run['passes'], baseline['passes']):
+                p['speedup'] = (base['wall_secs'] / p['wall_secs']
+                                if p['wall_secs'] > 0 else None)
+    for run in runs:
+        del run['dexes']
+    return {'apk': apk, 'runs': runs}
+
+
+def print_table(result):
+    runs = result['runs']
+    print(result['apk'])
+    print('  {:<40}'.format('threads') +
+          ''.join('{:>10}'.format(r['threads']) for r in runs))
+    print('  {:<40}'.format('total (s)') +
+          ''.join('{:>10.1f}'.format(r['wall_secs']) for r in runs))
+    if all(len(r['passes']) == len(runs[0]['passes']) for r in runs):
+        for i, p in enumerate(runs[0]['passes']):
+            print('  {:<40}'.format(p['name'][:40]) +
+                  ''.join('{:>10.2f}'.format(r['passes'][i]['wall_secs'])
+                          for r in runs))
+    for r in runs:
+        if not r['identical']:
+            print('  {} threads: {} differ from {} threads'.format(
+                r['threads'], ', '.join(r['differing_dexes']),
+                runs[0]['threads']))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('apks', nargs='+', help='The APKs of the corpus')
+    parser.add_argument('--redex-all', required=True,
+                        help='Path to the redex-all binary')
+    parser.add_argument('-c', '--config', required=True,
+                        help='Redex config file')
+    parser.add_argument('-p', '--proguard-config', dest='proguard_configs',
+                        action='append', default=[],
+                        help='ProGuard config file')
+    parser.add_argument('-j', '--jarpath', dest='jarpaths', action='append',
+                        default=[], help='Library jar')
+    parser.add_argument('--threads',
+                        type=lambda s: [int(n) for n in s.split(',')],
+                        default=default_thread_counts(),
+                        help='Comma-separated thread counts, the first one '
+                             'being the baseline (default: 1, 2, 4, ... '
+                             'up to the number of CPUs)')
+    parser.add_argument('--report', default='redex-scaling.json',
+                        help='Where to write the scaling report')
+    parser.add_argument('--redex-arg', dest='redex_args', action='append',
+                        default=[], help='Extra argument for redex-all')
+    args = parser.parse_args()
+
+    work_dir = tempfile.mkdtemp(prefix='redex_scaling_')
+    results = []
+    all_identical = True
+    for i, apk in enumerate(args.apks):
+        apk_dir = join(work_dir, '{}-{}'.format(i, basename(apk)))
+        result = check_apk(args, apk, apk_dir)
+        results.append(result)
+        print_table(result)
+        if all(r['identical'] for r in result['runs']):
+            shutil.rmtree(apk_dir)
+        else:
+            all_identical = False
+            print('  outputs kept in ' + apk_dir)
+
+    with open(args.report, 'w') as report:
+        json.dump({'deterministic': all_identical, 'apks': results}, report,
+                  indent=2, sort_keys=True)
+    print('Scaling report written to ' + args.report)
+    if all_identical:
+        shutil.rmtree(work_dir, ignore_errors=True)
+    sys.exit(0 if all_identical else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <cstdint>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+
+#include "AdaptiveAbstractEnvironment.h"
+#include "HashedAbstractEnvironment.h"
+#include "HashedSetAbstractDomain.h"
+
+using Domain = HashedSetAbstractDomain<std::string>;
+// A small inline capacity, so that the tests exercise the promotion to a
+// Patricia tree.
+using Environment = AdaptiveAbstractEnvironment<uint32_t, Domain, 4>;
+using ReferenceEnvironment = HashedAbstractEnvironment<uint32_t, Domain>;
+
+class AdaptiveAbstractEnvironmentTest : public ::testing::Test {
+ protected:
+  AdaptiveAbstractEnvironmentTest()
+      : m_generator(42), m_size_dist(0, 8), m_elem_dist(0, 10) {}
+
+  // The variables and elements are drawn from small ranges, so that the
+  // environments have many bindings in common.
+  Environment generate_random_environment() {
+    Environment env;
+    size_t size = m_size_dist(m_generator);
+    for (size_t i = 0; i < size; ++i) {
+      auto rnd = m_elem_dist(m_generator);
+      env.set(rnd,
+              Domain({std::to_string(m_elem_dist(m_generator)),
+                      std::to_string(m_elem_dist(m_generator))}));
+    }
+    return env;
+  }
+
+  std::mt19937 m_generator;
+  std::uniform_int_distribution<uint32_t> m_size_dist;
+  std::uniform_int_distribution<uint32_t> m_elem_dist;
+};
+
+ReferenceEnvironment reference_from_aae(const Environment& env) {
+  ReferenceEnvironment ref;
+  if (env.is_value()) {
+    for (const auto& pair : env.bindings()) {
+      ref.set(pair.first, pair.second);
+    }
+  } else if (env.is_top()) {
+    ref.set_to_top();
+  } else {
+    ref.set_to_bottom();
+  }
+  return ref;
+}
+
+TEST_F(AdaptiveAbstractEnvironmentTest, latticeOperations) {
+  Environment e1({{1, Domain({"a", "b"})},
+                  {2, Domain("c")},
+                  {3, Domain({"d", "e", "f"})},
+                  {4, Domain({"a", "f"})}});
+  Environment e2({{0, Domain({"c", "f"})},
+                  {2, Domain({"c", "d"})},
+                  {3, Domain({"d", "e", "g", "h"})}});
+
+  EXPECT_EQ(4, e1.size());
+  EXPECT_EQ(3, e2.size());
+  EXPECT_FALSE(e1.is_promoted());
+
+  EXPECT_TRUE(Environment::bottom().leq(e1));
+  EXPECT_FALSE(e1.leq(Environment::bottom()));
+  EXPECT_FALSE(Environment::top().leq(e1));
+  EXPECT_TRUE(e1.leq(Environment::top()));
+  EXPECT_FALSE(e1.leq(e2));
+  EXPECT_FALSE(e2.leq(e1));
+
+  EXPECT_TRUE(e1.equals(e1));
+  EXPECT_FALSE(e1.equals(e2));
+
+  Environment join = e1.join(e2);
+  EXPECT_EQ(2, join.size());
+  EXPECT_THAT(join.get(2).elements(),
+              ::testing::UnorderedElementsAre("c", "d"));
+  EXPECT_THAT(join.get(3).elements(),
+              ::testing::UnorderedElementsAre("d", "e", "f", "g", "h"));
+  EXPECT_TRUE(join.equals(e1.widening(e2)));
+
+  // The union of the bindings doesn't fit in the inline array anymore.
+  Environment meet = e1.meet(e2);
+  EXPECT_TRUE(meet.is_promoted());
+  EXPECT_EQ(5, meet.size());
+  EXPECT_THAT(meet.get(0).elements(),
+              ::testing::UnorderedElementsAre("c", "f"));
+  EXPECT_THAT(meet.get(2).elements(), ::testing::ElementsAre("c"));
+  EXPECT_THAT(meet.get(3).elements(),
+              ::testing::UnorderedElementsAre("d", "e"));
+  EXPECT_TRUE(meet.leq(e1));
+  EXPECT_TRUE(meet.leq(e2));
+  EXPECT_TRUE(meet.equals(e1.narrowing(e2)));
+
+  // A join with a small environment is small.
+  Environment small_join = meet.join(e2);
+  EXPECT_FALSE(small_join.is_promoted());
+  EXPECT_TRUE(small_join.equals(e2));
+
+  EXPECT_TRUE(e1.join(Environment::top()).is_top());
+  EXPECT_TRUE(e1.meet(Environment::bottom()).is_bottom());
+  EXPECT_TRUE(e1.meet(Environment::top()).equals(e1));
+}
+
+TEST_F(AdaptiveAbstractEnvironmentTest, destructiveOperations) {
+  Environment e;
+  for (uint32_t i = 0; i < 4; ++i) {
+    e.set(10 - i, Domain(std::to_string(i)));
+  }
+  EXPECT_FALSE(e.is_promoted());
+  e.set(8, Domain::top());
+  EXPECT_EQ(3, e.size());
+  EXPECT_TRUE(e.get(8).is_top());
+  e.set(8, Domain("x")).set(0, Domain("y"));
+  EXPECT_TRUE(e.is_promoted());
+  EXPECT_EQ(5, e.size());
+  EXPECT_THAT(e.get(0).elements(), ::testing::ElementsAre("y"));
+  EXPECT_THAT(e.get(8).elements(), ::testing::ElementsAre("x"));
+  EXPECT_THAT(e.get(10).elements(), ::testing::ElementsAre("0"));
+
+  auto add_z = [](const Domain& s) {
+    auto copy = s;
+    copy.add("z");
+    return copy;
+  };
+  e.update(0, add_z).update(1, add_z);
+  EXPECT_EQ(5, e.size());
+  EXPECT_THAT(e.get(0).elements(), ::testing::UnorderedElementsAre("y", "z"));
+  EXPECT_TRUE(e.get(1).is_top());
+
+  e.update(0, [](const Domain&) { return Domain::bottom(); });
+  EXPECT_TRUE(e.is_bottom());
+  e.set(1, Domain("a"));
+  EXPECT_TRUE(e.is_bottom());
+}
+
+TEST_F(AdaptiveAbstractEnvironmentTest, agreesWithHashedEnvironment) {
+  for (size_t k = 0; k < 200; ++k) {
+    Environment e1 = this->generate_random_environment();
+    Environment e2 = this->generate_random_environment();
+    auto ref1 = reference_from_aae(e1);
+    auto ref2 = reference_from_aae(e2);
+
+    EXPECT_EQ(ref1.leq(ref2), e1.leq(e2));
+    EXPECT_EQ(ref1.equals(ref2), e1.equals(e2));
+    EXPECT_TRUE(e1.equals(e1)) << e1;
+
+    auto join = e1.join(e2);
+    EXPECT_TRUE(reference_from_aae(join).equals(ref1.join(ref2)))
+        << e1 << " and " << e2;
+    EXPECT_TRUE(e1.leq(join));
+    EXPECT_TRUE(e2.leq(join));
+
+    auto meet = e1.meet(e2);
+    EXPECT_TRUE(reference_from_aae(meet).equals(ref1.meet(ref2)))
+        << e1 << " and " << e2;
+    EXPECT_TRUE(meet.leq(e1));
+    EXPECT_TRUE(meet.leq(e2));
+  }
+}
+
+TEST_F(AdaptiveAbstractEnvironmentTest, prettyPrinting) {
+  Environment e({{1, Domain("a")}, {2, Domain("b")}});
+  EXPECT_EQ("[#2]{1 -> [#1]{a}, 2 -> [#1]{b}}", e.str());
+  EXPECT_EQ("_|_", Environment::bottom().str());
+  EXPECT_EQ("T", Environment::top().str());
+}
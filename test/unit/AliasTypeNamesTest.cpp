@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "DexClass.h"
+#include "RedexContext.h"
+
+TEST(AliasTypeNamesTest, renamesAllTheTypesAtOnce) {
+  g_redex = new RedexContext();
+  std::vector<std::pair<DexType*, DexString*>> aliases;
+  for (size_t i = 0; i < 1000; ++i) {
+    auto type =
+        DexType::make_type(("Lcom/foo/C" + std::to_string(i) + ";").c_str());
+    aliases.emplace_back(
+        type, DexString::make_string("LX/" + std::to_string(i) + ";"));
+  }
+  g_redex->alias_type_names(aliases);
+
+  for (size_t i = 0; i < 1000; ++i) {
+    auto type = aliases[i].first;
+    EXPECT_EQ(type->get_name(), aliases[i].second);
+    EXPECT_EQ(DexType::get_type(aliases[i].second), type);
+    // The old names still lead to the types, as with assign_name_alias().
+    EXPECT_EQ(
+        DexType::get_type(("Lcom/foo/C" + std::to_string(i) + ";").c_str()),
+        type);
+  }
+
+  // Aliasing to a name that already exists is a bug.
+  auto other = DexType::make_type("Lcom/foo/Other;");
+  EXPECT_ANY_THROW(g_redex->alias_type_names(
+      {{other, DexString::make_string("LX/0;")}}));
+
+  delete g_redex;
+}
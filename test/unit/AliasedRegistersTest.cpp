@@ -374,3 +374,24 @@ TEST(AliasedRegistersTest, AbstractValueJoin) {
   EXPECT_FALSE(a.are_aliases(four, two));
   EXPECT_FALSE(a.are_aliases(four, three));
 }
+
+TEST(AliasedRegistersTest, getRepresentativeAfterJoin) {
+  AliasedRegisters a;
+  AliasedRegisters b;
+
+  a.move(one, zero);
+  a.move(two, zero);
+  a.move(three, zero);
+
+  b.move(three, zero);
+  b.move(two, zero);
+  b.move(one, zero);
+
+  a.join_with(b);
+
+  // Both agree zero is the oldest; they disagree about the others.
+  EXPECT_EQ(0, a.get_representative(three));
+  a.break_alias(zero);
+  EXPECT_EQ(1, a.get_representative(three));
+  EXPECT_TRUE(a.are_aliases(one, three));
+}
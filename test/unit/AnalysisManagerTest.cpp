@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "AnalysisManager.h"
+#include "Creators.h"
+#include "DexUtil.h"
+#include "PassManager.h"
+#include "RedexContext.h"
+
+/*
+ * An analysis that counts how many times it has been computed.
+ */
+struct CountingAnalysis {
+  using Result = size_t;
+  static size_t s_runs;
+  static Result run(DexStoresVector& stores) {
+    ++s_runs;
+    return build_class_scope(stores).size();
+  }
+};
+
+size_t CountingAnalysis::s_runs = 0;
+
+struct OtherAnalysis {
+  using Result = std::string;
+  static Result run(DexStoresVector&) { return "other"; }
+};
+
+class RequestingPass : public Pass {
+ public:
+  RequestingPass(const std::string& name, bool preserves)
+      : Pass(name), m_preserves(preserves) {}
+
+  void run_pass(DexStoresVector& stores,
+                ConfigFiles&,
+                PassManager& mgr) override {
+    m_result = mgr.analyses().get<CountingAnalysis>(stores);
+  }
+
+  void preserved_analyses(PreservedAnalyses& preserved) const override {
+    if (m_preserves) {
+      preserved.preserve<CountingAnalysis>();
+    }
+  }
+
+  size_t m_result{0};
+
+ private:
+  bool m_preserves;
+};
+
+DexStoresVector make_stores() {
+  auto type = DexType::make_type("LFoo;");
+  ClassCreator creator(type);
+  creator.set_super(get_object_type());
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes({creator.create()});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  return stores;
+}
+
+TEST(AnalysisManagerTest, cacheAndInvalidate) {
+  g_redex = new RedexContext();
+  auto stores = make_stores();
+  CountingAnalysis::s_runs = 0;
+
+  AnalysisManager am;
+  EXPECT_FALSE(am.is_cached<CountingAnalysis>());
+  EXPECT_EQ(1, am.get<CountingAnalysis>(stores));
+  EXPECT_EQ(1, am.get<CountingAnalysis>(stores));
+  EXPECT_EQ(1, CountingAnalysis::s_runs);
+  EXPECT_EQ("other", am.get<OtherAnalysis>(stores));
+
+  PreservedAnalyses preserved;
+  preserved.preserve<CountingAnalysis>();
+  EXPECT_TRUE(preserved.preserves<CountingAnalysis>());
+  EXPECT_FALSE(preserved.preserves<OtherAnalysis>());
+  am.invalidate(preserved);
+  EXPECT_TRUE(am.is_cached<CountingAnalysis>());
+  EXPECT_FALSE(am.is_cached<OtherAnalysis>());
+
+  am.invalidate(PreservedAnalyses());
+  EXPECT_FALSE(am.is_cached<CountingAnalysis>());
+  am.get<CountingAnalysis>(stores);
+  EXPECT_EQ(2, CountingAnalysis::s_runs);
+
+  PreservedAnalyses all;
+  all.preserve_all();
+  am.invalidate(all);
+  EXPECT_TRUE(am.is_cached<CountingAnalysis>());
+  am.invalidate<CountingAnalysis>();
+  EXPECT_FALSE(am.is_cached<CountingAnalysis>());
+
+  delete g_redex;
+}
+
+TEST(AnalysisManagerTest, passesShareAnalyses) {
+  g_redex = new RedexContext();
+  auto stores = make_stores();
+  CountingAnalysis::s_runs = 0;
+
+  RequestingPass preserving("PreservingPass", true);
+  RequestingPass plain("PlainPass", false);
+  RequestingPass last("LastPass", false);
+  std::vector<Pass*> passes = {&preserving, &plain, &last};
+  PassManager manager(passes);
+  manager.set_testing_mode();
+  Scope external_classes;
+  Json::Value conf_obj = Json::nullValue;
+  ConfigFiles dummy_config(conf_obj);
+  manager.run_passes(stores, external_classes, dummy_config);
+
+  // The second pass reuses the result of the first one, but the last one
+  // has to compute it again.
+  EXPECT_EQ(1, preserving.m_result);
+  EXPECT_EQ(1, plain.m_result);
+  EXPECT_EQ(1, last.m_result);
+  EXPECT_EQ(2, CountingAnalysis::s_runs);
+  EXPECT_FALSE(manager.analyses().is_cached<CountingAnalysis>());
+
+  delete g_redex;
+}
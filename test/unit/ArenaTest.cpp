@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "Arena.h"
+#include "ScratchArena.h"
+#include "SlabPool.h"
+
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+#include <unordered_set>
+#include <vector>
+
+TEST(ArenaTest, allocationsAreAlignedAndDisjoint) {
+  Arena arena(256);
+  constexpr size_t kThreads = 8;
+  constexpr size_t kAllocs = 1000;
+  std::vector<std::vector<std::pair<char*, size_t>>> allocs(kThreads);
+  std::vector<boost::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&arena, &allocs, t]() {
+      for (size_t i = 0; i < kAllocs; ++i) {
+        size_t size = 1 + (i * 7 + t) % 100;
+        auto p = static_cast<char*>(arena.allocate(size));
+        std::fill(p, p + size, static_cast<char>(t));
+        allocs[t].emplace_back(p, size);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::vector<std::pair<char*, size_t>> all;
+  for (size_t t = 0; t < kThreads; ++t) {
+    for (const auto& a : allocs[t]) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(a.first) % Arena::ALIGNMENT);
+      EXPECT_TRUE(std::all_of(a.first, a.first + a.second, [t](char c) {
+        return c == static_cast<char>(t);
+      }));
+      all.push_back(a);
+    }
+  }
+  std::sort(all.begin(), all.end());
+  for (size_t i = 1; i < all.size(); ++i) {
+    EXPECT_LE(all[i - 1].first + all[i - 1].second, all[i].first);
+  }
+}
+
+TEST(ArenaTest, oversizedAllocation) {
+  Arena arena(64);
+  auto p = static_cast<char*>(arena.allocate(1000));
+  std::fill(p, p + 1000, 'x');
+  EXPECT_GE(arena.reserved_bytes(), 1064);
+}
+
+namespace {
+
+struct Pooled {
+  uint64_t payload[3];
+  static void* operator new(size_t size) {
+    return SlabPool<Pooled>::allocate(size);
+  }
+  static void operator delete(void* ptr, size_t size) {
+    SlabPool<Pooled>::deallocate(ptr, size);
+  }
+};
+
+} // namespace
+
+TEST(ArenaTest, slabPoolReusesFreedObjects) {
+  auto a = new Pooled();
+  delete a;
+  auto b = new Pooled();
+  EXPECT_EQ(a, b);
+
+  std::vector<Pooled*> objs;
+  for (int i = 0; i < 2000; ++i) {
+    objs.push_back(new Pooled());
+    objs.back()->payload[0] = i;
+  }
+  for (int i = 0; i < 2000; ++i) {
+    EXPECT_EQ(i, objs[i]->payload[0]);
+    delete objs[i];
+  }
+  delete b;
+}
+
+TEST(ArenaTest, scratchScopesRewind) {
+  ScratchArena arena(256);
+  char* outer_first;
+  {
+    ScratchArena::Scope outer(arena);
+    outer_first = static_cast<char*>(arena.allocate(100));
+    std::fill(outer_first, outer_first + 100, 'o');
+    char* inner_first;
+    {
+      ScratchArena::Scope inner(arena);
+      inner_first = static_cast<char*>(arena.allocate(100));
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(inner_first) %
+                       ScratchArena::ALIGNMENT);
+      // Spills over into new chunks, including an oversized one.
+      for (int i = 0; i < 10; ++i) {
+        auto p = static_cast<char*>(arena.allocate(i == 5 ? 1000 : 200));
+        std::fill(p, p + 200, 'i');
+      }
+    }
+    // The inner allocations are released, the outer ones are kept.
+    EXPECT_EQ(inner_first, arena.allocate(100));
+    EXPECT_TRUE(std::all_of(
+        outer_first, outer_first + 100, [](char c) { return c == 'o'; }));
+  }
+  auto reserved = arena.reserved_bytes();
+  {
+    ScratchArena::Scope again(arena);
+    EXPECT_EQ(outer_first, arena.allocate(100));
+    for (int i = 0; i < 10; ++i) {
+      arena.allocate(i == 5 ? 1000 : 200);
+    }
+  }
+  // The chunks are reused rather than allocated anew.
+  EXPECT_EQ(reserved, arena.reserved_bytes());
+}
+
+TEST(ArenaTest, scratchAllocator) {
+  ScratchArena::Scope scope;
+  std::vector<int, ScratchAllocator<int>> vec;
+  std::unordered_set<int,
+                     std::hash<int>,
+                     std::equal_to<int>,
+                     ScratchAllocator<int>>
+      set;
+  for (int i = 0; i < 10000; ++i) {
+    vec.push_back(i);
+    set.insert(i % 100);
+  }
+  for (int i = 0; i < 10000; ++i) {
+    EXPECT_EQ(i, vec[i]);
+  }
+  EXPECT_EQ(100, set.size());
+  EXPECT_EQ(ScratchAllocator<int>(), vec.get_allocator());
+}
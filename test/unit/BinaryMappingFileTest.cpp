@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <sstream>
+
+#include "BinaryMappingFile.h"
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexOutput.h"
+#include "DexPosition.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "InstructionLowering.h"
+#include "RedexContext.h"
+
+using namespace binary_mapping;
+
+namespace {
+
+struct TempDir {
+  TempDir()
+      : path(boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path("binmap-%%%%%%%%")) {
+    boost::filesystem::create_directories(path);
+  }
+  ~TempDir() { boost::filesystem::remove_all(path); }
+  std::string file(const std::string& name) const {
+    return (path / name).string();
+  }
+  boost::filesystem::path path;
+};
+
+std::string read_file(const std::string& filename) {
+  std::ifstream in(filename);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+std::string to_text(const std::string& filename) {
+  Reader reader(filename);
+  char* buf = nullptr;
+  size_t size = 0;
+  FILE* fd = open_memstream(&buf, &size);
+  reader.write_text(fd);
+  fclose(fd);
+  std::string ret(buf, size);
+  free(buf);
+  return ret;
+}
+
+} // namespace
+
+TEST(BinaryMappingFileTest, lookupAcrossSegments) {
+  TempDir dir;
+  auto filename = dir.file("methods.bin");
+  {
+    Writer writer(Kind::METHOD_MAPPING, 0x1234);
+    writer.add(1, "b", "LFoo;");
+    writer.add(0, "a", "LFoo;");
+    writer.append_to(filename);
+  }
+  {
+    Writer writer(Kind::METHOD_MAPPING, 0x5678);
+    writer.add(0, "c", "LBar;");
+    writer.append_to(filename);
+  }
+  Reader reader(filename);
+  ASSERT_EQ(reader.segments().size(), 2);
+  Record record;
+  ASSERT_TRUE(reader.find(Kind::METHOD_MAPPING, 0x1234, 1, &record));
+  EXPECT_STREQ(record.str0, "b");
+  EXPECT_STREQ(record.str1, "LFoo;");
+  ASSERT_TRUE(reader.find(Kind::METHOD_MAPPING, 0x5678, 0, &record));
+  EXPECT_STREQ(record.str0, "c");
+  EXPECT_FALSE(reader.find(Kind::METHOD_MAPPING, 0x5678, 1, &record));
+  EXPECT_FALSE(reader.find(Kind::CLASS_MAPPING, 0x1234, 0, &record));
+  // The text keeps the order the records were added in.
+  EXPECT_EQ(to_text(filename),
+            "1 4660 b LFoo;\n0 4660 a LFoo;\n0 22136 c LBar;\n");
+}
+
+TEST(BinaryMappingFileTest, lookupByName) {
+  TempDir dir;
+  auto filename = dir.file("offsets.bin");
+  Writer writer(Kind::BYTECODE_OFFSETS, 0);
+  writer.add(30, "LFoo;.c:()V");
+  writer.add(10, "LFoo;.a:()V");
+  writer.add(20, "LFoo;.b:()V");
+  writer.append_to(filename);
+  Reader reader(filename);
+  Record record;
+  ASSERT_TRUE(reader.find(Kind::BYTECODE_OFFSETS, "LFoo;.b:()V", &record));
+  EXPECT_EQ(record.num, 20);
+  EXPECT_FALSE(reader.find(Kind::BYTECODE_OFFSETS, "LFoo;.d:()V", &record));
+}
+
+TEST(BinaryMappingFileTest, matchesTextSymbolFiles) {
+  g_redex = new RedexContext();
+  DexClasses classes;
+  for (auto name : {"LA;", "LB;"}) {
+    ClassCreator creator(DexType::make_type(name));
+    creator.set_super(get_object_type());
+    auto method = static_cast<DexMethod*>(
+        DexMethod::make_method(name, "m", "V", {}));
+    method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+    method->set_code(assembler::ircode_from_string("((return-void))"));
+    method->set_deobfuscated_name(show(method));
+    creator.add_method(method);
+    auto cls = creator.create();
+    cls->set_deobfuscated_name(show(cls));
+    classes.push_back(cls);
+  }
+  DexStore store("classes");
+  store.add_classes(std::move(classes));
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  instruction_lowering::run(stores);
+
+  TempDir dir;
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make("", ""));
+  auto write = [&](const std::string& format) {
+    Json::Value json(Json::objectValue);
+    json["method_mapping"] = format + "-method_mapping";
+    json["class_mapping"] = format + "-class_mapping";
+    json["proguard_map_output"] = format + "-pg_mapping";
+    json["bytecode_offset_map"] = format + "-bytecode_offset_map";
+    json["symbol_file_format"] = format;
+    ConfigFiles cfg(json);
+    cfg.outdir = dir.path.string();
+    write_classes_to_dex(dir.file(format + ".dex"),
+                         &stores[0].get_dexen()[0], nullptr, 0, cfg, json,
+                         pos_mapper.get());
+  };
+  write("text");
+  write("binary");
+
+  for (auto file :
+       {"method_mapping", "class_mapping", "pg_mapping", "bytecode_offset_map"}) {
+    auto text = read_file(dir.file(std::string("text-") + file));
+    EXPECT_FALSE(text.empty()) << file;
+    EXPECT_EQ(text, to_text(dir.file(std::string("binary-") + file))) << file;
+  }
+
+  Reader reader(dir.file("binary-pg_mapping"));
+  Record record;
+  ASSERT_TRUE(reader.find(Kind::PG_MAPPING, "LB;.m:()V", &record));
+  EXPECT_STREQ(record.str1, "    void m() -> m");
+
+  delete g_redex;
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <unistd.h>
+
+#include "ConfigFiles.h"
+#include "Pass.h"
+#include "PassManager.h"
+#include "RedexContext.h"
+
+namespace {
+
+// Breaks the output, as far as the bisection command is concerned, by
+// leaving a file behind.
+class MarkerPass : public Pass {
+ public:
+  MarkerPass(const std::string& name, const std::string& marker)
+      : Pass(name), m_marker(marker) {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override {
+    if (!m_marker.empty()) {
+      std::ofstream(m_marker) << "broken";
+    }
+  }
+
+ private:
+  std::string m_marker;
+};
+
+} // namespace
+
+TEST(BisectPassesTest, findsTheFirstFailingPass) {
+  g_redex = new RedexContext();
+  auto marker = (boost::filesystem::temp_directory_path() /
+                 boost::filesystem::unique_path("bisect-%%%%%%%%"))
+                    .string();
+  MarkerPass prefix("PrefixPass", "");
+  MarkerPass good("GoodPass", "");
+  MarkerPass bad("BadPass", marker);
+  MarkerPass other("OtherPass", "");
+
+  Json::Value config(Json::objectValue);
+  config["bisect"]["prefix"] = 1;
+  config["bisect"]["command"] =
+      "test ! -e " + marker + " || { rm " + marker + "; exit 1; }";
+  PassManager manager({&prefix, &good, &bad, &other}, config);
+  manager.set_testing_mode();
+  std::vector<DexStore> stores;
+  DexMetadata dm;
+  dm.set_id("classes");
+  stores.emplace_back(dm);
+  Scope external_classes;
+  Json::Value conf_obj = Json::nullValue;
+  ConfigFiles dummy_config(conf_obj);
+  manager.run_passes(stores, external_classes, dummy_config);
+  if (manager.is_bisection_trial()) {
+    // This is where redex-all would write the output.
+    _exit(0);
+  }
+
+  EXPECT_EQ(manager.get_bisected_pass(), "BadPass#1");
+  // All the passes ran here afterwards.
+  EXPECT_TRUE(boost::filesystem::exists(marker));
+  boost::filesystem::remove(marker);
+  delete g_redex;
+}
@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "BitVectorDataflow.h"
+#include "IRAssembler.h"
+
+using namespace bitvector_dataflow;
+
+namespace {
+
+BitVector bits(size_t size, std::initializer_list<size_t> set) {
+  BitVector result(size);
+  for (auto bit : set) {
+    result.set(bit);
+  }
+  return result;
+}
+
+} // namespace
+
+TEST(BitVectorDataflow, forwardsMeets) {
+  //           +---+
+  //       +-> | 1 | --+
+  //  +---+    +---+   |    +---+
+  //  | 0 |            +--> | 3 |
+  //  +---+    +---+   |    +---+
+  //       +-> | 2 | --+
+  //           +---+
+  ControlFlowGraph cfg;
+  auto b0 = cfg.create_block();
+  auto b1 = cfg.create_block();
+  auto b2 = cfg.create_block();
+  auto b3 = cfg.create_block();
+  cfg.set_entry_block(b0);
+  cfg.add_edge(b0, b1, EDGE_GOTO);
+  cfg.add_edge(b0, b2, EDGE_BRANCH);
+  cfg.add_edge(b1, b3, EDGE_GOTO);
+  cfg.add_edge(b2, b3, EDGE_GOTO);
+
+  for (auto meet : {Meet::Union, Meet::Intersection}) {
+    GenKillAnalysis analysis(cfg, 4, Direction::Forwards, meet);
+    analysis.gen(b0) = bits(4, {0});
+    analysis.gen(b1) = bits(4, {1, 2});
+    analysis.kill(b1) = bits(4, {0});
+    analysis.gen(b2) = bits(4, {2, 3});
+    analysis.run(bits(4, {}));
+
+    EXPECT_EQ(analysis.get_entry_state_at(b0), bits(4, {}));
+    EXPECT_EQ(analysis.get_exit_state_at(b0), bits(4, {0}));
+    EXPECT_EQ(analysis.get_exit_state_at(b1), bits(4, {1, 2}));
+    EXPECT_EQ(analysis.get_exit_state_at(b2), bits(4, {0, 2, 3}));
+    if (meet == Meet::Union) {
+      EXPECT_EQ(analysis.get_entry_state_at(b3), bits(4, {0, 1, 2, 3}));
+    } else {
+      EXPECT_EQ(analysis.get_entry_state_at(b3), bits(4, {2}));
+    }
+  }
+}
+
+TEST(BitVectorDataflow, liveness) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (const v1 0)
+     (const-wide v2 0)
+     :loop
+     (add-int v1 v1 v0)
+     (if-nez v1 :loop)
+     (return-wide v2)
+    )
+)");
+  code->build_cfg();
+  auto& cfg = code->cfg();
+  RegisterLiveness liveness(cfg, 4);
+
+  Block* entry = nullptr;
+  Block* loop = nullptr;
+  Block* exit = nullptr;
+  for (Block* block : cfg.blocks()) {
+    for (auto& mie : InstructionIterable(block)) {
+      switch (mie.insn->opcode()) {
+      case IOPCODE_LOAD_PARAM:
+        entry = block;
+        break;
+      case OPCODE_ADD_INT:
+        loop = block;
+        break;
+      case OPCODE_RETURN_WIDE:
+        exit = block;
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  ASSERT_NE(entry, nullptr);
+  ASSERT_NE(loop, nullptr);
+  ASSERT_NE(exit, nullptr);
+
+  EXPECT_EQ(liveness.live_in(entry), bits(4, {}));
+  EXPECT_EQ(liveness.live_out(entry), bits(4, {0, 1, 2, 3}));
+  EXPECT_EQ(liveness.live_in(loop), bits(4, {0, 1, 2, 3}));
+  EXPECT_EQ(liveness.live_out(loop), bits(4, {0, 1, 2, 3}));
+  EXPECT_EQ(liveness.live_in(exit), bits(4, {2, 3}));
+  EXPECT_EQ(liveness.live_out(exit), bits(4, {}));
+
+  // Stepping back over the add from the end of the loop.
+  auto live = liveness.live_out(loop);
+  live.reset(1);
+  for (auto& mie : InstructionIterable(loop)) {
+    if (mie.insn->opcode() == OPCODE_ADD_INT) {
+      RegisterLiveness::transfer(mie.insn, &live);
+    }
+  }
+  EXPECT_EQ(live, bits(4, {0, 1, 2, 3}));
+}
@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "CallGraph.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexContext.h"
+#include "ScopeHelper.h"
+
+namespace {
+
+DexClass* make_class(const char* name,
+                     DexType* super,
+                     const std::vector<const char*>& methods) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(super);
+  for (auto method : methods) {
+    creator.add_method(assembler::method_from_string(method));
+  }
+  return creator.create();
+}
+
+std::vector<DexMethod*> callees(const call_graph::Graph& graph,
+                                const DexMethod* method) {
+  std::vector<DexMethod*> ret;
+  for (auto edge : graph.callees(graph.id(method))) {
+    ret.push_back(graph.method(edge->callee()));
+  }
+  return ret;
+}
+
+std::vector<DexMethod*> callers(const call_graph::Graph& graph,
+                                const DexMethod* method) {
+  std::vector<DexMethod*> ret;
+  for (auto edge : graph.callers(graph.id(method))) {
+    ret.push_back(graph.method(edge->caller()));
+  }
+  return ret;
+}
+
+DexMethod* method(const char* name) {
+  return static_cast<DexMethod*>(DexMethod::get_method(name));
+}
+
+struct CallGraphTest : public testing::Test {
+  Scope scope;
+
+  CallGraphTest() {
+    g_redex = new RedexContext();
+    scope = create_empty_scope();
+    auto base = make_class("LBase;", get_object_type(), {R"(
+      (method (public) "LBase;.foo:()V"
+       ((return-void))
+      )
+    )"});
+    auto derived = make_class("LDerived;", base->get_type(), {R"(
+      (method (public) "LDerived;.foo:()V"
+       ((return-void))
+      )
+    )"});
+    auto caller = make_class("LCaller;", get_object_type(), {R"(
+      (method (public static) "LCaller;.dispatch:(LBase;)V"
+       (
+        (load-param v0)
+        (invoke-virtual (v0) "LBase;.foo:()V")
+        (invoke-static () "LCaller;.helper:()V")
+        (return-void)
+       )
+      )
+    )", R"(
+      (method (public static) "LCaller;.helper:()V"
+       (
+        (invoke-static () "LCaller;.leaf:()V")
+        (return-void)
+       )
+      )
+    )", R"(
+      (method (public static) "LCaller;.other:()V"
+       (
+        (invoke-static () "LCaller;.leaf:()V")
+        (return-void)
+       )
+      )
+    )", R"(
+      (method (public static) "LCaller;.leaf:()V"
+       ((return-void))
+      )
+    )"});
+    scope.insert(scope.end(), {base, derived, caller});
+  }
+
+  ~CallGraphTest() { delete g_redex; }
+};
+
+} // namespace
+
+TEST_F(CallGraphTest, exactCallees) {
+  call_graph::Graph graph(scope);
+  auto dispatch = method("LCaller;.dispatch:(LBase;)V");
+  auto helper = method("LCaller;.helper:()V");
+  auto other = method("LCaller;.other:()V");
+  auto leaf = method("LCaller;.leaf:()V");
+
+  // The virtual call may go to either foo(), so it has no edge.
+  EXPECT_EQ(callees(graph, dispatch), std::vector<DexMethod*>{helper});
+  EXPECT_EQ(callees(graph, helper), std::vector<DexMethod*>{leaf});
+  EXPECT_EQ(callers(graph, leaf), (std::vector<DexMethod*>{helper, other}));
+  EXPECT_FALSE(graph.has_node(method("LBase;.foo:()V")));
+  // The edges of a call site point at its invoke.
+  auto edges = graph.callees(graph.id(helper));
+  ASSERT_EQ(edges.size(), 1);
+  EXPECT_EQ(edges[0]->invoke_insn()->opcode(), OPCODE_INVOKE_STATIC);
+  EXPECT_EQ(edges[0]->invoke_insn()->get_method(), leaf);
+}
+
+TEST_F(CallGraphTest, virtualDispatchExpansion) {
+  call_graph::Graph graph(scope, /* include_virtuals */ false,
+                          /* expand_virtual_dispatch */ true);
+  auto dispatch = method("LCaller;.dispatch:(LBase;)V");
+  auto base_foo = method("LBase;.foo:()V");
+  auto derived_foo = method("LDerived;.foo:()V");
+
+  EXPECT_EQ(callees(graph, dispatch),
+            (std::vector<DexMethod*>{base_foo, derived_foo,
+                                     method("LCaller;.helper:()V")}));
+  // Both overrides are called from dispatch(), and, being virtual, from the
+  // entry node, which sorts first.
+  EXPECT_EQ(callers(graph, derived_foo),
+            (std::vector<DexMethod*>{nullptr, dispatch}));
+  auto entry_callees = graph.callees(call_graph::Graph::kEntry);
+  EXPECT_EQ(entry_callees.size(), 2);
+  for (auto edge : entry_callees) {
+    EXPECT_EQ(edge->invoke_insn(), nullptr);
+  }
+}
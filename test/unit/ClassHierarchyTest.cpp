@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "ClassHierarchy.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "ScopeHelper.h"
+#include "WorkQueue.h"
+
+namespace {
+
+/*
+ * interface I {}
+ * interface J extends I {}
+ * class C0 ... C49 {}
+ * class Ci extends C(i % 50), for i up to 3000, where every seventh class
+ * implements I and every eleventh one implements J. That is enough classes
+ * for the hierarchy and the interface map to be built by several shards.
+ */
+Scope make_scope() {
+  auto intf_flag = ACC_PUBLIC | ACC_INTERFACE;
+  Scope scope = create_empty_scope();
+  auto obj_t = get_object_type();
+  auto i_t = DexType::make_type("LI;");
+  scope.push_back(create_internal_class(i_t, obj_t, {}, intf_flag));
+  auto j_t = DexType::make_type("LJ;");
+  scope.push_back(create_internal_class(j_t, obj_t, {i_t}, intf_flag));
+  std::vector<DexType*> types;
+  for (size_t i = 0; i < 3000; ++i) {
+    auto type = DexType::make_type(("LC" + std::to_string(i) + ";").c_str());
+    auto super = i < 50 ? obj_t : types[i % 50];
+    std::vector<DexType*> intfs;
+    if (i % 7 == 0) intfs.push_back(i_t);
+    if (i % 11 == 0) intfs.push_back(j_t);
+    scope.push_back(create_internal_class(type, super, intfs));
+    types.push_back(type);
+  }
+  return scope;
+}
+
+} // namespace
+
+TEST(ClassHierarchyTest, shardedBuildMatchesSerialOne) {
+  g_redex = new RedexContext();
+  auto scope = make_scope();
+
+  set_num_threads_override(1);
+  auto hierarchy = build_type_hierarchy(scope);
+  auto interfaces = build_interface_map(hierarchy);
+  set_num_threads_override(4);
+  auto sharded_hierarchy = build_type_hierarchy(scope);
+  auto sharded_interfaces = build_interface_map(sharded_hierarchy);
+  set_num_threads_override(0);
+
+  EXPECT_EQ(sharded_hierarchy, hierarchy);
+  EXPECT_EQ(sharded_interfaces, interfaces);
+
+  auto c3_t = DexType::get_type("LC3;");
+  // C53, C103, ... C2953.
+  EXPECT_EQ(get_children(hierarchy, c3_t).size(), 59);
+  EXPECT_EQ(get_children(hierarchy, get_object_type()).size(), 50);
+  // C0 implements both, and all the classes below it then do too.
+  auto c0_t = DexType::get_type("LC0;");
+  auto j_t = DexType::get_type("LJ;");
+  auto i_t = DexType::get_type("LI;");
+  EXPECT_TRUE(implements(interfaces, c0_t, i_t));
+  EXPECT_TRUE(implements(interfaces, DexType::get_type("LC50;"), j_t));
+  EXPECT_FALSE(implements(interfaces, DexType::get_type("LC1;"), i_t));
+  // C22 implements J, hence I.
+  EXPECT_TRUE(implements(interfaces, DexType::get_type("LC22;"), i_t));
+
+  delete g_redex;
+}
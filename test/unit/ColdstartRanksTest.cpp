@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexUtil.h"
+#include "RedexContext.h"
+
+TEST(ColdstartRanksTest, ranksTheEntriesThatExist) {
+  g_redex = new RedexContext();
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path("coldstart-%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  auto classes_file = (dir / "classes.txt").string();
+  auto methods_file = (dir / "methods.txt").string();
+  std::ofstream(classes_file)
+      << "com/foo/B.class\ncom/foo/Missing.class\ncom/foo/A.class\n"
+      << "com/foo/B.class\n";
+  std::ofstream(methods_file) << "Lcom/foo/A;.run:()V\n"
+                              << "garbage\n"
+                              << "Lcom/foo/B;.get(I)I\n"
+                              << "Lcom/foo/B;.missing:()V\n";
+
+  auto a_t = DexType::make_type("Lcom/foo/A;");
+  auto b_t = DexType::make_type("Lcom/foo/B;");
+  auto other_t = DexType::make_type("Lcom/foo/Other;");
+  ClassCreator a_creator(a_t);
+  a_creator.set_super(get_object_type());
+  auto a = a_creator.create();
+  ClassCreator other_creator(other_t);
+  other_creator.set_super(get_object_type());
+  auto other = other_creator.create();
+  auto run = DexMethod::make_method("Lcom/foo/A;.run:()V");
+  auto get = DexMethod::make_method("Lcom/foo/B;.get:(I)I");
+
+  Json::Value json(Json::objectValue);
+  json["coldstart_classes"] = classes_file;
+  json["coldstart_methods"] = methods_file;
+  ConfigFiles cfg(json);
+
+  auto const& class_ranks = cfg.get_coldstart_class_ranks();
+  EXPECT_EQ(class_ranks.size(), 2);
+  EXPECT_EQ(class_ranks.at(b_t), 0);
+  EXPECT_EQ(class_ranks.at(a_t), 2);
+  EXPECT_TRUE(cfg.is_coldstart(a));
+  EXPECT_FALSE(cfg.is_coldstart(other));
+
+  auto const& method_ranks = cfg.get_coldstart_method_ranks();
+  EXPECT_EQ(method_ranks.size(), 2);
+  EXPECT_EQ(method_ranks.at(run), 0);
+  EXPECT_EQ(method_ranks.at(get), 2);
+
+  // Renaming doesn't change what's in the tables.
+  a_t->assign_name_alias(DexString::make_string("Lcom/foo/Renamed;"));
+  EXPECT_TRUE(cfg.is_coldstart(a));
+
+  boost::filesystem::remove_all(dir);
+  delete g_redex;
+}
@@ -11,6 +11,7 @@
 #include "ConcurrentContainers.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <gtest/gtest.h>
@@ -163,3 +164,116 @@ TEST_F(ConcurrentContainersTest, concurrentMapTest) {
   map.clear();
   EXPECT_EQ(0, map.size());
 }
+
+TEST_F(ConcurrentContainersTest, concurrentMapGetOrInsertTest) {
+  ConcurrentMap<uint32_t, std::string*> map;
+  std::atomic<size_t> creations{0};
+
+  auto intern = [&map, &creations](uint32_t x) {
+    return map.get_or_insert(x, [x, &creations]() {
+      ++creations;
+      return std::make_pair(x, new std::string(std::to_string(x)));
+    });
+  };
+  run_on_samples([&](const std::vector<uint32_t>& sample) {
+    for (size_t i = 0; i < sample.size(); ++i) {
+      auto* s = intern(sample[i]);
+      EXPECT_EQ(std::to_string(sample[i]), *s);
+    }
+  });
+  // Interning again from other threads must hand back the same objects.
+  run_on_samples([&](const std::vector<uint32_t>& sample) {
+    for (size_t i = 0; i < sample.size(); ++i) {
+      EXPECT_EQ(map.get(sample[i], nullptr), intern(sample[i]));
+    }
+  });
+  EXPECT_EQ(m_data_set.size(), creations.load());
+  EXPECT_EQ(m_data_set.size(), map.size());
+  EXPECT_EQ(nullptr, map.get(1000000001, nullptr));
+  for (auto& entry : map) {
+    delete entry.second;
+  }
+}
+
+TEST_F(ConcurrentContainersTest, concurrentMapWithSlotTest) {
+  using Map = ConcurrentMap<uint32_t, uint32_t>;
+  Map map;
+  std::vector<std::vector<uint32_t>> groups(Map::num_slots());
+  for (uint32_t x : m_data) {
+    groups[Map::slot(x)].push_back(x);
+  }
+  std::vector<boost::thread> threads;
+  for (size_t slot = 0; slot < groups.size(); ++slot) {
+    threads.emplace_back([&map, &groups, slot]() {
+      map.with_slot(slot, [&](std::unordered_map<uint32_t, uint32_t>& m) {
+        for (uint32_t x : groups[slot]) {
+          m.emplace(x, x + 1);
+        }
+      });
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(m_data_set.size(), map.size());
+  for (uint32_t x : m_data_set) {
+    EXPECT_EQ(x + 1, map.get(x, 0));
+  }
+}
+
+TEST_F(ConcurrentContainersTest, readMostlyConcurrentMapTest) {
+  ReadMostlyConcurrentMap<uint32_t, std::string> map;
+
+  // Every thread reads back what it inserts while the others keep inserting,
+  // which makes the slots grow under the readers.
+  run_on_samples([&map](const std::vector<uint32_t>& sample) {
+    for (size_t i = 0; i < sample.size(); ++i) {
+      map.insert({sample[i], std::to_string(sample[i])});
+      auto value = map.find(sample[i]);
+      ASSERT_NE(nullptr, value);
+      EXPECT_EQ(std::to_string(sample[i]), *value);
+      for (size_t j = 0; j < i; ++j) {
+        EXPECT_EQ(1, map.count(sample[j]));
+      }
+    }
+  });
+  EXPECT_EQ(m_data_set.size(), map.size());
+  EXPECT_EQ(nullptr, map.find(1000000001));
+  EXPECT_EQ("none", map.get(1000000001, "none"));
+  EXPECT_FALSE(map.insert({m_data[0], "other"}));
+  EXPECT_EQ(std::to_string(m_data[0]), map.get(m_data[0], ""));
+
+  std::unordered_map<uint32_t, size_t> occurrences;
+  for (uint32_t x : m_data) {
+    ++occurrences[x];
+  }
+  run_on_samples([&map](const std::vector<uint32_t>& sample) {
+    for (size_t i = 0; i < sample.size(); ++i) {
+      map.update(sample[i],
+                 [](const uint32_t&, std::string& value, bool key_exists) {
+                   EXPECT_TRUE(key_exists);
+                   value += "+";
+                 });
+    }
+  });
+  size_t visited = 0;
+  map.for_each([&](const uint32_t& key, const std::string& value) {
+    EXPECT_EQ(std::to_string(key) + std::string(occurrences[key], '+'),
+              value);
+    ++visited;
+  });
+  EXPECT_EQ(m_data_set.size(), visited);
+
+  map.update(1000000001,
+             [](const uint32_t&, std::string& value, bool key_exists) {
+               EXPECT_FALSE(key_exists);
+               EXPECT_EQ("", value);
+               value = "new";
+             });
+  EXPECT_EQ("new", map.get_or_insert(1000000001, []() { return "unused"; }));
+  EXPECT_EQ("made", map.get_or_insert(1000000002, []() { return "made"; }));
+  EXPECT_EQ(m_data_set.size() + 2, map.size());
+  map.clear();
+  EXPECT_EQ(0, map.size());
+  EXPECT_EQ(nullptr, map.find(m_data[0]));
+}
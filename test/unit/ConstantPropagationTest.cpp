@@ -464,6 +464,20 @@ TEST(ConstantPropagation, SignedConstantDomainOperations) {
   EXPECT_TRUE(minus_one.meet(positive).is_bottom());
   EXPECT_EQ(min_val.meet(negative), min_val);
   EXPECT_TRUE(min_val.meet(positive).is_bottom());
+
+  for (auto interval : {Interval::EMPTY,
+                        Interval::LTZ,
+                        Interval::GTZ,
+                        Interval::EQZ,
+                        Interval::GEZ,
+                        Interval::LEZ,
+                        Interval::ALL}) {
+    EXPECT_EQ(to_interval(from_interval(interval)), interval);
+    EXPECT_TRUE(from_interval(interval).equals(Domain(interval)));
+  }
+  EXPECT_TRUE(SignedConstantDomain::top().is_top());
+  EXPECT_TRUE(SignedConstantDomain::bottom().is_bottom());
+  EXPECT_TRUE(SignedConstantDomain::top().meet(negative).equals(negative));
 }
 
 TEST(ConstantPropagation, WhiteBox1) {
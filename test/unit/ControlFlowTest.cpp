@@ -229,13 +229,13 @@ TEST(ControlFlow, findImmediateDominator) {
     cfg.add_edge(b4, b3, EDGE_GOTO);
     cfg.add_edge(b4, b5, EDGE_GOTO);
     cfg.add_edge(b2, b5, EDGE_GOTO);
-    auto idom = cfg.immediate_dominators();
-    EXPECT_EQ(idom[b0].dom, b0);
-    EXPECT_EQ(idom[b1].dom, b0);
-    EXPECT_EQ(idom[b3].dom, b0);
-    EXPECT_EQ(idom[b2].dom, b1);
-    EXPECT_EQ(idom[b4].dom, b3);
-    EXPECT_EQ(idom[b5].dom, b0);
+    const auto& dom = cfg.dominators();
+    EXPECT_EQ(dom.idom(b0), b0);
+    EXPECT_EQ(dom.idom(b1), b0);
+    EXPECT_EQ(dom.idom(b3), b0);
+    EXPECT_EQ(dom.idom(b2), b1);
+    EXPECT_EQ(dom.idom(b4), b3);
+    EXPECT_EQ(dom.idom(b5), b0);
   }
   {
     //                 +---------+
@@ -266,12 +266,112 @@ TEST(ControlFlow, findImmediateDominator) {
     cfg.add_edge(b4, b3, EDGE_GOTO);
     cfg.add_edge(b4, b5, EDGE_GOTO);
     cfg.add_edge(b2, b5, EDGE_GOTO);
-    auto idom = cfg.immediate_dominators();
-    EXPECT_EQ(idom[b0].dom, b0);
-    EXPECT_EQ(idom[b1].dom, b0);
-    EXPECT_EQ(idom[b3].dom, b1);
-    EXPECT_EQ(idom[b2].dom, b1);
-    EXPECT_EQ(idom[b4].dom, b3);
-    EXPECT_EQ(idom[b5].dom, b1);
+    const auto& dom = cfg.dominators();
+    EXPECT_EQ(dom.idom(b0), b0);
+    EXPECT_EQ(dom.idom(b1), b0);
+    EXPECT_EQ(dom.idom(b3), b1);
+    EXPECT_EQ(dom.idom(b2), b1);
+    EXPECT_EQ(dom.idom(b4), b3);
+    EXPECT_EQ(dom.idom(b5), b1);
   }
 }
+
+TEST(ControlFlow, dominatorTree) {
+  //                 +---------+
+  //                 v         |
+  //     +---+     +---+     +---+     +---+
+  //  +- | 0 | --> | 1 | --> | 2 | --> | 5 |
+  //  |  +---+     +---+     +---+     +---+
+  //  |                                  ^
+  //  |    +---------+                   |
+  //  |    v         |                   |
+  //  |  +---+     +---+                 |
+  //  +> | 3 | --> | 4 | ----------------+
+  //     +---+     +---+
+  using ::testing::UnorderedElementsAre;
+  ControlFlowGraph cfg;
+  auto b0 = cfg.create_block();
+  auto b1 = cfg.create_block();
+  auto b2 = cfg.create_block();
+  auto b3 = cfg.create_block();
+  auto b4 = cfg.create_block();
+  auto b5 = cfg.create_block();
+  cfg.set_entry_block(b0);
+  cfg.add_edge(b0, b1, EDGE_GOTO);
+  cfg.add_edge(b1, b2, EDGE_GOTO);
+  cfg.add_edge(b2, b1, EDGE_GOTO);
+  cfg.add_edge(b0, b3, EDGE_GOTO);
+  cfg.add_edge(b3, b4, EDGE_GOTO);
+  cfg.add_edge(b4, b3, EDGE_GOTO);
+  cfg.add_edge(b4, b5, EDGE_GOTO);
+  cfg.add_edge(b2, b5, EDGE_GOTO);
+  cfg.calculate_exit_block();
+  EXPECT_EQ(cfg.exit_block(), b5);
+
+  const auto& dom = cfg.dominators();
+  EXPECT_EQ(&dom, &cfg.dominators());
+  EXPECT_EQ(dom.root(), b0);
+  EXPECT_THAT(dom.children(b0), UnorderedElementsAre(b1, b3, b5));
+  EXPECT_TRUE(dom.dominates(b0, b5));
+  EXPECT_TRUE(dom.dominates(b1, b2));
+  EXPECT_TRUE(dom.dominates(b2, b2));
+  EXPECT_FALSE(dom.dominates(b2, b1));
+  EXPECT_FALSE(dom.dominates(b3, b5));
+  EXPECT_EQ(dom.common_dominator(b2, b4), b0);
+  EXPECT_EQ(dom.common_dominator(b2, b1), b1);
+
+  EXPECT_THAT(dom.frontier(b0), UnorderedElementsAre());
+  EXPECT_THAT(dom.frontier(b1), UnorderedElementsAre(b1, b5));
+  EXPECT_THAT(dom.frontier(b2), UnorderedElementsAre(b1, b5));
+  EXPECT_THAT(dom.frontier(b3), UnorderedElementsAre(b3, b5));
+  EXPECT_THAT(dom.frontier(b4), UnorderedElementsAre(b3, b5));
+  EXPECT_THAT(dom.frontier(b5), UnorderedElementsAre());
+
+  const auto& pdom = cfg.post_dominators();
+  EXPECT_EQ(pdom.root(), b5);
+  EXPECT_EQ(pdom.idom(b0), b5);
+  EXPECT_EQ(pdom.idom(b1), b2);
+  EXPECT_EQ(pdom.idom(b2), b5);
+  EXPECT_EQ(pdom.idom(b3), b4);
+  EXPECT_EQ(pdom.idom(b4), b5);
+  EXPECT_TRUE(pdom.dominates(b2, b1));
+  EXPECT_FALSE(pdom.dominates(b1, b0));
+
+  // Changing the graph invalidates the cached trees.
+  auto b6 = cfg.create_block();
+  cfg.add_edge(b2, b6, EDGE_GOTO);
+  EXPECT_TRUE(cfg.dominators().is_reachable(b6));
+  EXPECT_EQ(cfg.dominators().idom(b6), b2);
+  EXPECT_FALSE(cfg.post_dominators().is_reachable(b6));
+}
+
+TEST(ControlFlow, blocksAndEdgesSurviveGrowth) {
+  ControlFlowGraph cfg;
+  auto b0 = cfg.create_block();
+  auto b1 = cfg.create_block();
+  cfg.set_entry_block(b0);
+  cfg.add_edge(b0, b1, EDGE_GOTO);
+  const cfg::Edge* first = b0->succs().at(0);
+
+  // Enough blocks and edges to force the underlying storage to grow.
+  std::vector<Block*> added{b0, b1};
+  for (size_t i = 0; i < 1000; ++i) {
+    auto b = cfg.create_block();
+    cfg.add_edge(added.back(), b, EDGE_GOTO);
+    added.push_back(b);
+  }
+
+  EXPECT_EQ(cfg.blocks(), added);
+  for (size_t i = 0; i < added.size(); ++i) {
+    EXPECT_EQ(added[i]->id(), i);
+  }
+  EXPECT_EQ(b0->succs().at(0), first);
+  EXPECT_EQ(first->src(), b0);
+  EXPECT_EQ(first->target(), b1);
+  EXPECT_EQ(b1->preds().at(0), first);
+
+  cfg.remove_succ_edges(b0);
+  EXPECT_TRUE(b0->succs().empty());
+  EXPECT_TRUE(b1->preds().empty());
+  EXPECT_EQ(b1->succs().size(), 1);
+}
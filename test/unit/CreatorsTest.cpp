@@ -12,6 +12,8 @@
 #include "Creators.h"
 #include "DexAsm.h"
 #include "DexClass.h"
+#include "InstructionLowering.h"
+#include "WorkQueue.h"
 
 using namespace dex_asm;
 
@@ -125,3 +127,89 @@ TEST(MakeSwitch, MultiIndices) {
 
   delete g_redex;
 }
+
+TEST(MakeSwitch, LargeSparseRoundTrip) {
+  g_redex = new RedexContext();
+  auto mc = make_method_creator();
+  auto param_loc = mc.get_local(1);
+  auto mb = mc.get_main_block();
+
+  // Keys with gaps, several of them sharing a case block.
+  std::map<SwitchIndices, MethodBlock*> cases;
+  std::set<int> keys;
+  for (int i = 0; i < 3000; ++i) {
+    SwitchIndices indices = {i * 3};
+    if (i % 5 == 0) {
+      indices.insert(i * 3 + 1);
+    }
+    keys.insert(indices.begin(), indices.end());
+    cases[indices] = nullptr;
+  }
+  mb->switch_op(param_loc, cases);
+  for (auto& it : cases) {
+    it.second->binop_lit16(
+        OPCODE_ADD_INT_LIT16, param_loc, param_loc, *it.first.begin());
+  }
+  auto method = mc.create();
+
+  instruction_lowering::lower(method);
+  method->sync();
+  const DexOpcodeData* payload = nullptr;
+  for (auto insn : method->get_dex_code()->get_instructions()) {
+    if (insn->opcode() == FOPCODE_SPARSE_SWITCH) {
+      payload = static_cast<DexOpcodeData*>(insn);
+    }
+  }
+  ASSERT_NE(payload, nullptr);
+  const uint16_t* data = payload->data();
+  ASSERT_EQ(*data, keys.size());
+  auto spkeys = (const int32_t*)&data[1];
+  EXPECT_TRUE(std::equal(keys.begin(), keys.end(), spkeys));
+
+  // Loading it back gives one target per key.
+  method->balloon();
+  std::set<int> loaded;
+  for (const auto& mie : *method->get_code()) {
+    if (mie.type == MFLOW_TARGET && mie.target->type == BRANCH_MULTI) {
+      EXPECT_TRUE(loaded.insert(mie.target->index).second);
+    }
+  }
+  EXPECT_EQ(loaded, keys);
+
+  delete g_redex;
+}
+
+TEST(CreatorsTest, MethodRefBatch) {
+  g_redex = new RedexContext();
+  auto foo = DexType::make_type("Lfoo;");
+  auto existing = DexMethod::make_method("Lfoo;.bar:(IJ)V");
+
+  std::vector<std::vector<DexMethodRef*>> batches(4);
+  auto wq = workqueue_foreach<size_t>([&](size_t b) {
+    MethodRefBatch batch;
+    EXPECT_EQ(batch.add(foo, "bar", get_void_type(),
+                        {get_int_type(), get_long_type()}),
+              0);
+    for (size_t i = 0; i < 100; ++i) {
+      batch.add(foo, "stub$" + std::to_string(i), get_int_type(), {foo});
+    }
+    EXPECT_EQ(batch.size(), 101);
+    batches[b] = batch.create();
+    EXPECT_EQ(batch.size(), 0);
+  });
+  for (size_t b = 0; b < batches.size(); ++b) {
+    wq.add_item(b);
+  }
+  wq.run_all();
+
+  for (const auto& refs : batches) {
+    EXPECT_EQ(refs, batches[0]);
+  }
+  const auto& refs = batches[0];
+  ASSERT_EQ(refs.size(), 101);
+  EXPECT_EQ(refs[0], existing);
+  EXPECT_EQ(refs[42], DexMethod::get_method("Lfoo;.stub$41:(Lfoo;)I"));
+  EXPECT_EQ(refs[42]->get_proto(), refs[43]->get_proto());
+
+  delete g_redex;
+}
@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "Creators.h"
+#include "DedupMethodsPass.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "PassManager.h"
+#include "RedexContext.h"
+
+namespace {
+
+DexClass* make_class(const char* name,
+                     const std::vector<const char*>& methods) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(get_object_type());
+  for (auto method : methods) {
+    creator.add_method(assembler::method_from_string(method));
+  }
+  return creator.create();
+}
+
+void run_pass(const std::vector<DexClass*>& classes) {
+  std::vector<DexStore> stores;
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes(classes);
+  stores.emplace_back(std::move(store));
+  DedupMethodsPass pass;
+  PassManager manager({&pass});
+  manager.set_testing_mode();
+
+  Scope external_classes;
+  Json::Value conf_obj = Json::nullValue;
+  ConfigFiles dummy_config(conf_obj);
+  manager.run_passes(stores, external_classes, dummy_config);
+}
+
+std::vector<DexMethodRef*> callees(DexMethod* method) {
+  std::vector<DexMethodRef*> ret;
+  for (const auto& mie : InstructionIterable(method->get_code())) {
+    if (is_invoke(mie.insn->opcode())) {
+      ret.push_back(mie.insn->get_method());
+    }
+  }
+  return ret;
+}
+
+} // namespace
+
+TEST(DedupMethodsTest, foldsIdenticalStaticMethodsAcrossClasses) {
+  g_redex = new RedexContext();
+  auto a = make_class("LA;", {R"(
+    (method (private static) "LA;.inc:(I)I"
+     ((load-param v0) (add-int/lit8 v0 v0 1) (return v0)))
+  )"});
+  auto b = make_class("LB;", {R"(
+    (method (private static) "LB;.inc:(I)I"
+     ((load-param v0) (add-int/lit8 v0 v0 1) (return v0)))
+  )", R"(
+    (method (private static) "LB;.dec:(I)I"
+     ((load-param v0) (add-int/lit8 v0 v0 -1) (return v0)))
+  )", R"(
+    (method (public static) "LB;.use:(I)I"
+     (
+      (load-param v0)
+      (invoke-static (v0) "LB;.inc:(I)I")
+      (move-result v0)
+      (invoke-static (v0) "LB;.dec:(I)I")
+      (move-result v0)
+      (return v0)
+     )
+    )
+  )"});
+  run_pass({a, b});
+
+  auto a_inc = static_cast<DexMethod*>(DexMethod::get_method("LA;.inc:(I)I"));
+  auto b_dec = DexMethod::get_method("LB;.dec:(I)I");
+  auto use = static_cast<DexMethod*>(DexMethod::get_method("LB;.use:(I)I"));
+  EXPECT_EQ(callees(use), std::vector<DexMethodRef*>({a_inc, b_dec}));
+  // LB; calls it now.
+  EXPECT_TRUE(is_public(a_inc));
+  delete g_redex;
+}
+
+TEST(DedupMethodsTest, leavesInstanceMethodsOfOtherClassesAlone) {
+  g_redex = new RedexContext();
+  auto a = make_class("LA;", {R"(
+    (method (private) "LA;.get:()I"
+     ((load-param-object v0) (const v1 1) (return v1)))
+  )", R"(
+    (method (private) "LA;.get2:()I"
+     ((load-param-object v0) (const v1 1) (return v1)))
+  )", R"(
+    (method (public) "LA;.use:()I"
+     (
+      (load-param-object v0)
+      (invoke-direct (v0) "LA;.get2:()I")
+      (move-result v0)
+      (return v0)
+     )
+    )
+  )"});
+  auto b = make_class("LB;", {R"(
+    (method (private) "LB;.get:()I"
+     ((load-param-object v0) (const v1 1) (return v1)))
+  )", R"(
+    (method (public) "LB;.use:()I"
+     (
+      (load-param-object v0)
+      (invoke-direct (v0) "LB;.get:()I")
+      (move-result v0)
+      (return v0)
+     )
+    )
+  )"});
+  run_pass({a, b});
+
+  auto a_use = static_cast<DexMethod*>(DexMethod::get_method("LA;.use:()I"));
+  auto b_use = static_cast<DexMethod*>(DexMethod::get_method("LB;.use:()I"));
+  EXPECT_EQ(callees(a_use),
+            std::vector<DexMethodRef*>({DexMethod::get_method("LA;.get:()I")}));
+  EXPECT_EQ(callees(b_use),
+            std::vector<DexMethodRef*>({DexMethod::get_method("LB;.get:()I")}));
+  delete g_redex;
+}
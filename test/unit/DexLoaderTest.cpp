@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexLoader.h"
+#include "DexOutput.h"
+#include "DexPosition.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "InstructionLowering.h"
+#include "RedexContext.h"
+
+namespace {
+
+// Writes a dex with a class LFoo; holding a method returning 42, at line 7 of
+// Foo.java.
+std::vector<uint8_t> make_dex(bool release_memory = false) {
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  auto method =
+      static_cast<DexMethod*>(DexMethod::make_method("LFoo;", "bar", "I", {}));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  method->set_code(assembler::ircode_from_string(R"(
+    (
+     (const v0 42)
+     (return v0)
+    )
+)"));
+  auto code = method->get_code();
+  code->set_debug_item(std::make_unique<DexDebugItem>());
+  auto pos = std::make_unique<DexPosition>(7);
+  pos->bind(method, DexString::make_string("Foo.java"));
+  code->insert_before(code->begin(), std::move(pos));
+  method->set_deobfuscated_name(show(method));
+  creator.add_method(method);
+  auto cls = creator.create();
+  cls->set_deobfuscated_name(show(cls));
+
+  DexStore store("classes");
+  store.add_classes({cls});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  instruction_lowering::run(stores);
+
+  auto outdir = boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path("dexloader-%%%%%%%%");
+  boost::filesystem::create_directories(outdir);
+  Json::Value json(Json::objectValue);
+  json["release_memory_after_output"] = release_memory;
+  ConfigFiles cfg(json);
+  cfg.outdir = outdir.string();
+  auto line_map = (outdir / "line_map").string();
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(line_map, ""));
+  std::vector<uint8_t> contents;
+  write_classes_to_dexes(
+      {{(outdir / "classes.dex").string(), &stores[0].get_dexen()[0], 0,
+        &contents}},
+      nullptr, cfg, json, pos_mapper.get());
+  if (release_memory) {
+    EXPECT_EQ(method->get_dex_code(), nullptr);
+    EXPECT_EQ(method->get_code(), nullptr);
+  }
+  // The line map refers to the position whether or not its code is gone.
+  pos_mapper->write_map();
+  EXPECT_GT(boost::filesystem::file_size(line_map), 0);
+  boost::filesystem::remove_all(outdir);
+  return contents;
+}
+
+} // namespace
+
+TEST(DexLoaderTest, loadsFromMemory) {
+  g_redex = new RedexContext();
+  auto contents = make_dex();
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  dex_stats_t stats;
+  auto classes = load_classes_from_dex(contents.data(), contents.size(),
+                                       "memory.dex", &stats);
+  // Nothing refers back to the buffer once the classes are loaded.
+  contents.clear();
+  contents.shrink_to_fit();
+
+  ASSERT_EQ(classes.size(), 1);
+  auto cls = classes[0];
+  EXPECT_EQ(cls->get_name()->str(), "LFoo;");
+  EXPECT_EQ(cls->get_dex_location(), "memory.dex");
+  EXPECT_EQ(stats.num_classes, 1);
+  ASSERT_EQ(cls->get_dmethods().size(), 1);
+  auto method = cls->get_dmethods()[0];
+  EXPECT_EQ(method->get_name()->str(), "bar");
+  auto code = method->get_code();
+  ASSERT_NE(code, nullptr);
+  bool returns_42 = false;
+  for (auto& mie : InstructionIterable(code)) {
+    returns_42 |= mie.insn->opcode() == OPCODE_CONST &&
+                  mie.insn->get_literal() == 42;
+  }
+  EXPECT_TRUE(returns_42);
+
+  delete g_redex;
+}
+
+TEST(DexLoaderTest, releasesMemoryAfterOutput) {
+  g_redex = new RedexContext();
+  auto contents = make_dex();
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  EXPECT_EQ(make_dex(/* release_memory */ true), contents);
+  delete g_redex;
+}
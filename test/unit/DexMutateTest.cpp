@@ -11,6 +11,7 @@
 
 #include "Creators.h"
 #include "DexClass.h"
+#include "DexUtil.h"
 #include "RedexContext.h"
 
 DexFieldRef* make_field_ref(DexType* cls, const char* name, DexType* type) {
@@ -65,3 +66,63 @@ TEST(RenameMembers, rename) {
   std::string name_after = field->get_name()->c_str();
   ASSERT_EQ("numbat", name_after);
 }
+
+TEST(RemoveMembers, batch) {
+  g_redex = new RedexContext();
+  auto obj_t = DexType::make_type("Ljava/lang/Object;");
+  auto int_t = DexType::make_type("I");
+  auto a = DexType::make_type("LA;");
+  std::vector<DexField*> fields;
+  for (int i = 0; i < 10; ++i) {
+    auto name = "f" + std::to_string(i);
+    fields.push_back(make_field_def(
+        a, name.c_str(), int_t, i % 2 ? ACC_PUBLIC : ACC_PUBLIC | ACC_STATIC));
+  }
+  auto cls = create_class(a, obj_t, fields);
+  std::vector<DexMethod*> methods;
+  for (int i = 0; i < 10; ++i) {
+    auto name = "m" + std::to_string(i);
+    auto method = static_cast<DexMethod*>(
+        DexMethod::make_method("LA;", name.c_str(), "V", {}));
+    method->make_concrete(ACC_PUBLIC, i % 2 == 1);
+    cls->add_method(method);
+    methods.push_back(method);
+  }
+
+  // Every third member goes, from both lists of each kind.
+  std::vector<DexMethod*> dead_methods;
+  std::vector<DexField*> dead_fields;
+  for (int i = 0; i < 10; i += 3) {
+    dead_methods.push_back(methods[i]);
+    dead_fields.push_back(fields[i]);
+  }
+  EXPECT_EQ(dead_methods.size(), remove_methods(dead_methods));
+  EXPECT_EQ(dead_fields.size(), remove_fields(dead_fields));
+  // Already removed members are skipped.
+  EXPECT_EQ(0, remove_methods(dead_methods));
+
+  std::vector<DexMethod*> left_methods(cls->get_dmethods());
+  left_methods.insert(left_methods.end(),
+                      cls->get_vmethods().begin(),
+                      cls->get_vmethods().end());
+  std::vector<DexField*> left_fields(cls->get_sfields());
+  left_fields.insert(left_fields.end(),
+                     cls->get_ifields().begin(),
+                     cls->get_ifields().end());
+  EXPECT_EQ(6, left_methods.size());
+  EXPECT_EQ(6, left_fields.size());
+  for (int i = 0; i < 10; ++i) {
+    bool dead = i % 3 == 0;
+    EXPECT_NE(dead, std::count(left_methods.begin(),
+                               left_methods.end(),
+                               methods[i]) == 1);
+    EXPECT_NE(dead,
+              std::count(left_fields.begin(), left_fields.end(), fields[i]) ==
+                  1);
+  }
+  EXPECT_TRUE(std::is_sorted(cls->get_vmethods().begin(),
+                             cls->get_vmethods().end(),
+                             compare_dexmethods));
+
+  delete g_redex;
+}
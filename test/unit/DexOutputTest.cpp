@@ -0,0 +1,340 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexLoader.h"
+#include "DexOutput.h"
+#include "DexPosition.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "InstructionLowering.h"
+#include "RedexContext.h"
+
+DexMethod* make_method(ClassCreator& creator,
+                       const std::string& cls,
+                       const std::string& name,
+                       const std::string& str) {
+  auto method = static_cast<DexMethod*>(
+      DexMethod::make_method(cls.c_str(), name.c_str(), "V", {}));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  method->set_code(assembler::ircode_from_string(
+      "((const-string \"" + str +
+      "\") (move-result-pseudo-object v0) (return-void))"));
+  method->set_deobfuscated_name(show(method));
+  creator.add_method(method);
+  return method;
+}
+
+TEST(DexOutputTest, methodProfileOrder) {
+  g_redex = new RedexContext();
+  ClassCreator a_creator(DexType::make_type("LA;"));
+  a_creator.set_super(get_object_type());
+  auto a1 = make_method(a_creator, "LA;", "a1", "a1_str");
+  auto a2 = make_method(a_creator, "LA;", "a2", "a2_str");
+  ClassCreator b_creator(DexType::make_type("LB;"));
+  b_creator.set_super(get_object_type());
+  auto b1 = make_method(b_creator, "LB;", "b1", "b1_str");
+  auto b2 = make_method(b_creator, "LB;", "b2", "b2_str");
+  DexClasses classes{a_creator.create(), b_creator.create()};
+
+  GatheredTypes gtypes(&classes);
+  MethodProfileOrder profile;
+  profile[show(b2)] = 0;
+  profile[show(a2)] = 1;
+  profile["LC;.unknown:()V"] = 2;
+  gtypes.set_method_profile(profile);
+
+  std::vector<DexMethod*> lmeth{a1, a2, b1, b2};
+  gtypes.sort_dexmethod_emitlist_profile_order(lmeth);
+  EXPECT_EQ((std::vector<DexMethod*>{b2, a2, a1, b1}), lmeth);
+
+  auto cls_order = gtypes.get_profile_order_class_emitlist();
+  EXPECT_EQ(classes[1], cls_order[0]);
+  EXPECT_EQ(classes[0], cls_order[1]);
+
+  auto strings = gtypes.get_profile_order_dexstring_emitlist();
+  ASSERT_GE(strings.size(), 2);
+  EXPECT_EQ(DexString::get_string("b2_str"), strings[0]);
+  EXPECT_EQ(DexString::get_string("a2_str"), strings[1]);
+
+  delete g_redex;
+}
+
+TEST(DexOutputTest, coldstartStringOrder) {
+  g_redex = new RedexContext();
+  ClassCreator a_creator(DexType::make_type("LA;"));
+  a_creator.set_super(get_object_type());
+  make_method(a_creator, "LA;", "a", "a_str");
+  ClassCreator b_creator(DexType::make_type("LB;"));
+  b_creator.set_super(get_object_type());
+  make_method(b_creator, "LB;", "b", "b_str");
+  DexClasses classes{a_creator.create(), b_creator.create()};
+  for (auto cls : classes) {
+    cls->set_deobfuscated_name(show(cls));
+  }
+
+  GatheredTypes gtypes(&classes);
+  ColdstartClassOrder coldstart_classes;
+  coldstart_classes["LB;"] = 0;
+  gtypes.set_coldstart_classes(coldstart_classes);
+
+  auto strings = gtypes.get_coldstart_order_dexstring_emitlist();
+  auto end = strings.begin() + gtypes.num_coldstart_strings();
+  auto is_hot = [&](const char* str) {
+    return std::find(strings.begin(), end, DexString::get_string(str)) != end;
+  };
+  EXPECT_TRUE(is_hot("LB;"));
+  EXPECT_TRUE(is_hot("b_str"));
+  EXPECT_FALSE(is_hot("LA;"));
+  EXPECT_FALSE(is_hot("a_str"));
+
+  delete g_redex;
+}
+
+TEST(DexOutputTest, gatherClassRefs) {
+  g_redex = new RedexContext();
+  ClassCreator a_creator(DexType::make_type("LA;"));
+  a_creator.set_super(get_object_type());
+  auto a = make_method(a_creator, "LA;", "a", "shared_str");
+  ClassCreator b_creator(DexType::make_type("LB;"));
+  b_creator.set_super(get_object_type());
+  make_method(b_creator, "LB;", "b", "shared_str");
+  DexClasses classes{a_creator.create(), b_creator.create()};
+
+  ClassRefs a_refs(classes[0]);
+  EXPECT_TRUE(std::is_sorted(a_refs.strings.begin(), a_refs.strings.end()));
+  EXPECT_EQ(std::vector<DexMethodRef*>{a}, a_refs.methods);
+  for (auto str : {"LA;", "a", "shared_str", "Ljava/lang/Object;"}) {
+    EXPECT_EQ(1,
+              std::count(a_refs.strings.begin(),
+                         a_refs.strings.end(),
+                         DexString::get_string(str)))
+        << str;
+  }
+
+  // The merged lists don't depend on where the summaries come from, and hold
+  // no duplicates.
+  auto class_refs = gather_class_refs(classes);
+  GatheredTypes gtypes(&classes);
+  GatheredTypes precomputed_gtypes(&classes, &class_refs);
+  auto strings = gtypes.get_dexstring_emitlist();
+  EXPECT_EQ(strings, precomputed_gtypes.get_dexstring_emitlist());
+  EXPECT_EQ(1,
+            std::count(strings.begin(),
+                       strings.end(),
+                       DexString::get_string("shared_str")));
+  EXPECT_EQ(1,
+            std::count(strings.begin(), strings.end(), DexString::get_string("")));
+  EXPECT_EQ(gtypes.index_type_names(), precomputed_gtypes.index_type_names());
+
+  delete g_redex;
+}
+
+TEST(DexOutputTest, locatorIndex) {
+  g_redex = new RedexContext();
+  auto make_class = [](const char* name) {
+    ClassCreator creator(DexType::make_type(name));
+    creator.set_super(get_object_type());
+    return creator.create();
+  };
+  DexStoresVector stores;
+  stores.emplace_back("classes");
+  stores[0].add_classes({make_class("LA;"), make_class("LB;")});
+  stores[0].add_classes({make_class("LC;")});
+  stores.emplace_back("other");
+  stores[1].add_classes({make_class("LD;")});
+
+  LocatorIndex index(stores);
+  EXPECT_EQ(4, index.size());
+  auto expect_locator = [&](const char* name,
+                            uint32_t strnr,
+                            uint32_t dexnr,
+                            uint32_t clsnr) {
+    auto locator = index.find(DexString::get_string(name));
+    ASSERT_NE(nullptr, locator) << name;
+    EXPECT_EQ(strnr, locator->strnr) << name;
+    EXPECT_EQ(dexnr, locator->dexnr) << name;
+    EXPECT_EQ(clsnr, locator->clsnr) << name;
+  };
+  expect_locator("LA;", 0, 1, 0);
+  expect_locator("LB;", 0, 1, 1);
+  expect_locator("LC;", 0, 2, 0);
+  expect_locator("LD;", 1, 1, 0);
+  EXPECT_EQ(nullptr, index.find(DexString::make_string("LE;")));
+
+  delete g_redex;
+}
+
+TEST(DexOutputTest, stringIndexOrder) {
+  g_redex = new RedexContext();
+  ClassCreator creator(DexType::make_type("LA;"));
+  creator.set_super(get_object_type());
+  auto method = make_method(creator, "LA;", "a", "a");
+  // Enough strings to sort in parallel, plus some that share their first
+  // eight bytes, aren't ASCII, or hold an encoded U+0000.
+  std::vector<std::string> strs{"abcdefgh",
+                                "abcdefghi",
+                                "abcdefgh\xc0\x80",
+                                "abcdefg\xc0\x80",
+                                "a\xc0\x80",
+                                "a\xc0\x80\x01",
+                                "a\x01",
+                                "caf\xc3\xa9",
+                                "cafe",
+                                "caf\xe2\x82\xac",
+                                "\xed\xa0\x80\xed\xb0\x80"};
+  for (int i = 0; i < 10000; ++i) {
+    strs.push_back("s" + std::to_string(i * 7919 % 10000));
+  }
+  auto code = method->get_code();
+  for (const auto& str : strs) {
+    auto insn = new IRInstruction(OPCODE_CONST_STRING);
+    insn->set_string(DexString::make_string(str));
+    code->push_back(insn);
+  }
+  DexClasses classes{creator.create()};
+
+  GatheredTypes gtypes(&classes);
+  auto expected = gtypes.get_dexstring_emitlist();
+  std::unique_ptr<DexOutputIdx> dodx(gtypes.get_dodx(nullptr));
+  for (uint32_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(i, dodx->stringidx(expected[i])) << expected[i]->c_str();
+  }
+
+  delete g_redex;
+}
+
+TEST(DexOutputTest, identicalDebugItemsAreShared) {
+  g_redex = new RedexContext();
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  // Two methods at the same line of the same file, and one elsewhere.
+  for (auto pair : {std::make_pair("a", 7), std::make_pair("b", 7),
+                    std::make_pair("c", 8)}) {
+    auto method = make_method(creator, "LFoo;", pair.first, "str");
+    auto code = method->get_code();
+    code->set_debug_item(std::make_unique<DexDebugItem>());
+    auto pos = std::make_unique<DexPosition>(pair.second);
+    pos->bind(method, DexString::make_string("Foo.java"));
+    code->insert_before(code->begin(), std::move(pos));
+  }
+  auto cls = creator.create();
+  cls->set_deobfuscated_name(show(cls));
+  DexStore store("classes");
+  store.add_classes({cls});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  instruction_lowering::run(stores);
+
+  auto outdir = boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path("dexoutput-%%%%%%%%");
+  boost::filesystem::create_directories(outdir);
+  Json::Value json(Json::objectValue);
+  ConfigFiles cfg(json);
+  cfg.outdir = outdir.string();
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make("", ""));
+  std::vector<uint8_t> contents;
+  write_classes_to_dexes(
+      {{(outdir / "classes.dex").string(), &stores[0].get_dexen()[0], 0,
+        &contents}},
+      nullptr, cfg, json, pos_mapper.get());
+  boost::filesystem::remove_all(outdir);
+
+  auto hdr = reinterpret_cast<const dex_header*>(contents.data());
+  auto map_size =
+      *reinterpret_cast<const uint32_t*>(contents.data() + hdr->map_off);
+  auto map = reinterpret_cast<const dex_map_item*>(contents.data() +
+                                                   hdr->map_off + 4);
+  uint32_t num_debug_items = 0;
+  for (uint32_t i = 0; i < map_size; ++i) {
+    if (map[i].type == TYPE_DEBUG_INFO_ITEM) {
+      num_debug_items = map[i].size;
+    }
+  }
+  EXPECT_EQ(num_debug_items, 2);
+  delete g_redex;
+
+  // Both methods still find their line.
+  g_redex = new RedexContext();
+  dex_stats_t stats;
+  auto classes = load_classes_from_dex(contents.data(), contents.size(),
+                                       "memory.dex", &stats);
+  ASSERT_EQ(classes.size(), 1);
+  std::vector<uint32_t> lines;
+  for (auto method : classes[0]->get_dmethods()) {
+    for (const auto& mie : *method->get_code()) {
+      if (mie.type == MFLOW_POSITION) {
+        lines.push_back(mie.pos->line);
+      }
+    }
+  }
+  EXPECT_EQ(lines, std::vector<uint32_t>({7, 7, 8}));
+  delete g_redex;
+}
+
+TEST(DexOutputTest, coldstartClassDataFirst) {
+  g_redex = new RedexContext();
+  DexClasses classes;
+  for (auto name : {"A", "B", "C"}) {
+    auto type = std::string("L") + name + ";";
+    ClassCreator creator(DexType::make_type(type.c_str()));
+    creator.set_super(get_object_type());
+    make_method(creator, type, "m", name);
+    auto field = static_cast<DexField*>(
+        DexField::make_field((type + ".f:I").c_str()));
+    auto value = DexEncodedValue::zero_for_type(get_int_type());
+    value->value(name[0]);
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC, value);
+    creator.add_field(field);
+    auto cls = creator.create();
+    cls->set_deobfuscated_name(show(cls));
+    classes.push_back(cls);
+  }
+  DexStore store("classes");
+  store.add_classes(classes);
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  instruction_lowering::run(stores);
+
+  auto outdir = boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path("dexoutput-%%%%%%%%");
+  boost::filesystem::create_directories(outdir);
+  auto coldstart_path = (outdir / "coldstart.txt").string();
+  std::ofstream(coldstart_path) << "C.class\nB.class\n";
+  Json::Value json(Json::objectValue);
+  json["coldstart_classes"] = coldstart_path;
+  json["coldstart_class_data_first"] = true;
+  ConfigFiles cfg(json);
+  cfg.outdir = outdir.string();
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make("", ""));
+  std::vector<uint8_t> contents;
+  auto stats = write_classes_to_dexes(
+      {{(outdir / "classes.dex").string(), &stores[0].get_dexen()[0], 0,
+        &contents}},
+      nullptr, cfg, json, pos_mapper.get());
+  boost::filesystem::remove_all(outdir);
+  EXPECT_EQ(stats[0].num_hot_class_data_pages, 1);
+
+  // The class defs keep their order, the data they point to doesn't.
+  auto hdr = reinterpret_cast<const dex_header*>(contents.data());
+  ASSERT_EQ(hdr->class_defs_size, 3);
+  auto cdefs = reinterpret_cast<const dex_class_def*>(contents.data() +
+                                                      hdr->class_defs_off);
+  EXPECT_LT(cdefs[2].class_data_offset, cdefs[1].class_data_offset);
+  EXPECT_LT(cdefs[1].class_data_offset, cdefs[0].class_data_offset);
+  EXPECT_LT(cdefs[2].static_values_off, cdefs[1].static_values_off);
+  EXPECT_LT(cdefs[1].static_values_off, cdefs[0].static_values_off);
+  delete g_redex;
+}
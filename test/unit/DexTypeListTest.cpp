@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "RedexContext.h"
+
+TEST(DexTypeListTest, interning) {
+  g_redex = new RedexContext();
+  auto a = DexType::make_type("LA;");
+  auto b = DexType::make_type("LB;");
+
+  EXPECT_EQ(DexTypeList::get_type_list({a, b}), nullptr);
+  auto ab = DexTypeList::make_type_list({a, b});
+  EXPECT_EQ(DexTypeList::make_type_list({a, b}), ab);
+  EXPECT_EQ(DexTypeList::get_type_list({a, b}), ab);
+  EXPECT_NE(DexTypeList::make_type_list({b, a}), ab);
+  EXPECT_NE(DexTypeList::make_type_list({a}), ab);
+
+  auto empty = DexTypeList::make_type_list({});
+  EXPECT_EQ(DexTypeList::make_type_list({}), empty);
+  EXPECT_EQ(empty->size(), 0);
+  EXPECT_TRUE(empty->get_type_list().empty());
+
+  // Long lists don't fit the stack buffer used for lookups.
+  std::deque<DexType*> long_list(40, a);
+  long_list.push_back(b);
+  auto long_tl = DexTypeList::make_type_list(std::deque<DexType*>(long_list));
+  EXPECT_EQ(DexTypeList::get_type_list(std::deque<DexType*>(long_list)),
+            long_tl);
+  EXPECT_EQ(long_tl->size(), 41);
+  EXPECT_EQ(long_tl->get_type_list().back(), b);
+
+  delete g_redex;
+}
+
+TEST(DexTypeListTest, types) {
+  g_redex = new RedexContext();
+  auto a = DexType::make_type("LA;");
+  auto b = DexType::make_type("LB;");
+  auto c = DexType::make_type("LC;");
+  auto tl = DexTypeList::make_type_list({a, b, c});
+
+  auto types = tl->get_type_list();
+  EXPECT_EQ(types.size(), 3);
+  EXPECT_EQ(types.front(), a);
+  EXPECT_EQ(types[1], b);
+  EXPECT_EQ(types.at(2), c);
+  EXPECT_EQ(std::vector<DexType*>(types.rbegin(), types.rend()),
+            (std::vector<DexType*>{c, b, a}));
+  EXPECT_EQ(types, tl->get_type_list());
+
+  // Converting to a deque makes an editable copy.
+  std::deque<DexType*> copy = types;
+  copy.push_front(c);
+  EXPECT_EQ(DexTypeList::make_type_list(std::move(copy))->size(), 4);
+  EXPECT_EQ(tl->size(), 3);
+
+  EXPECT_TRUE(*DexTypeList::make_type_list({a, b}) < *tl);
+  EXPECT_FALSE(*tl < *tl);
+
+  delete g_redex;
+}
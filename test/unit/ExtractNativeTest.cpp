@@ -20,3 +20,18 @@ TEST(ExtractNativeTest, empty) {
   auto overset = extract_classes_from_native_lib(over);
   EXPECT_EQ(overset.size(), 2);
 }
+
+TEST(ExtractNativeTest, namesBetweenBinaryData) {
+  // Long runs of bytes that can't start a name, with names at offsets that
+  // don't line up with any vector width.
+  std::string lib(37, '\x01');
+  lib += "com/foo/Bar";
+  lib += std::string(70, '\xff');
+  lib += "Lcom/foo/Baz$Inner;";
+  lib += std::string(3, 'A');
+  lib += "short";
+  auto classes = extract_classes_from_native_lib(lib);
+  EXPECT_EQ(classes,
+            (std::unordered_set<std::string>{"Lcom/foo/Bar;",
+                                             "Lcom/foo/Baz$Inner;"}));
+}
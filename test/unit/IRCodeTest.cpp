@@ -9,7 +9,9 @@
 
 #include <gtest/gtest.h>
 
+#include "ControlFlow.h"
 #include "DexAsm.h"
+#include "IRAssembler.h"
 #include "IRCode.h"
 
 std::ostream& operator<<(std::ostream& os, const IRInstruction& to_show) {
@@ -51,3 +53,182 @@ TEST(IRCode, LoadParamInstructionsVirtual) {
 
   delete g_redex;
 }
+
+TEST(IRCode, BuildCfgReusesGraphUntilModified) {
+  g_redex = new RedexContext();
+
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (if-eqz v0 :if-true-label)
+     (return-void)
+     :if-true-label
+     (return-void)
+    )
+)");
+
+  code->build_cfg();
+  auto* cfg = &code->cfg();
+  const auto* postorder = &cfg->postorder();
+  EXPECT_EQ(cfg->blocks().size(), 3);
+  code->build_cfg();
+  EXPECT_EQ(&code->cfg(), cfg);
+  EXPECT_EQ(&code->cfg().postorder(), postorder);
+
+  // Changing the code invalidates the graph.
+  code->push_back(dex_asm::dasm(OPCODE_RETURN_VOID));
+  code->build_cfg();
+  EXPECT_EQ(code->cfg().blocks().size(), 4);
+
+  // So does changing the graph itself: the ghost exit block joining the two
+  // returns is gone once the graph is rebuilt.
+  code->cfg().calculate_exit_block();
+  EXPECT_EQ(code->cfg().blocks().size(), 5);
+  code->build_cfg();
+  EXPECT_EQ(code->cfg().blocks().size(), 4);
+
+  delete g_redex;
+}
+
+TEST(IRCode, OpcodeClassesFollowChanges) {
+  using opcode::OpcodeClass;
+  g_redex = new RedexContext();
+
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const-string "foo")
+     (move-result-pseudo-object v0)
+     (sget-object "LFoo;.bar:LFoo;")
+     (move-result-pseudo-object v1)
+     (return-void)
+    )
+)");
+  EXPECT_TRUE(code->has_opcode_class(OpcodeClass::CONST_STRING));
+  EXPECT_TRUE(code->has_opcode_class(OpcodeClass::SGET));
+  EXPECT_FALSE(code->has_opcode_class(OpcodeClass::INVOKE));
+
+  auto it = code->begin();
+  while (it->type != MFLOW_OPCODE || it->insn->opcode() != OPCODE_SGET_OBJECT) {
+    ++it;
+  }
+  code->remove_opcode(it);
+  EXPECT_FALSE(code->has_opcode_class(OpcodeClass::SGET));
+
+  code->push_back(dex_asm::dasm(
+      OPCODE_INVOKE_STATIC, DexMethod::make_method("LFoo;.baz:()V"), {}));
+  EXPECT_TRUE(code->has_opcode_class(OpcodeClass::INVOKE));
+
+  // A summary taken while the code is in an editable CFG is not kept.
+  code->build_cfg(/* editable */ true);
+  EXPECT_TRUE(code->has_opcode_class(OpcodeClass::INVOKE));
+  code->clear_cfg();
+  EXPECT_TRUE(code->has_opcode_class(OpcodeClass::INVOKE));
+  EXPECT_TRUE(code->has_opcode_class(OpcodeClass::CONST_STRING));
+
+  delete g_redex;
+}
+
+TEST(IRCode, InstructionSnapshotFollowsChanges) {
+  g_redex = new RedexContext();
+
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (if-eqz v0 :skip)
+     (const v0 1)
+     :skip
+     (return-void)
+    )
+)");
+  std::vector<IRInstruction*> insns;
+  for (auto& mie : InstructionIterable(code.get())) {
+    insns.push_back(mie.insn);
+  }
+  const auto& snapshot = code->instruction_snapshot();
+  ASSERT_EQ(snapshot.size(), 4);
+  EXPECT_EQ(snapshot.instructions(), insns);
+  EXPECT_EQ(snapshot.opcode(1), OPCODE_IF_EQZ);
+  EXPECT_EQ(snapshot.opcode(3), OPCODE_RETURN_VOID);
+  // Kept while the code doesn't change.
+  EXPECT_EQ(&code->instruction_snapshot(), &snapshot);
+  EXPECT_EQ(code->instruction_snapshot().size(), 4);
+
+  code->remove_opcode(insns[2]);
+  EXPECT_EQ(code->instruction_snapshot().size(), 3);
+  EXPECT_EQ(code->instruction_snapshot().opcode(2), OPCODE_RETURN_VOID);
+
+  // Taken from the blocks while the code is in an editable CFG.
+  code->build_cfg(/* editable */ true);
+  EXPECT_EQ(code->instruction_snapshot().size(), 3);
+  code->clear_cfg();
+  EXPECT_EQ(code->instruction_snapshot().size(), 3);
+
+  delete g_redex;
+}
+
+TEST(IRCode, EpochChangesWithCode) {
+  g_redex = new RedexContext();
+
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (return-void)
+    )
+)");
+  auto other = assembler::ircode_from_string("((return-void))");
+  EXPECT_NE(code->epoch(), other->epoch());
+
+  // Analyzing the code doesn't change it.
+  auto epoch = code->epoch();
+  code->build_cfg();
+  code->clear_cfg();
+  EXPECT_EQ(code->epoch(), epoch);
+
+  code->push_back(dex_asm::dasm(OPCODE_RETURN_VOID));
+  EXPECT_NE(code->epoch(), epoch);
+  epoch = code->epoch();
+
+  code->build_cfg(/* editable */ true);
+  code->clear_cfg();
+  EXPECT_NE(code->epoch(), epoch);
+  epoch = code->epoch();
+
+  IRCode copy(*code);
+  EXPECT_NE(copy.epoch(), epoch);
+
+  delete g_redex;
+}
+
+TEST(IRCode, EditableCfgIsKeptUntilCleared) {
+  g_redex = new RedexContext();
+
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (if-eqz v0 :end)
+     (const v1 1)
+     :end
+     (return-void)
+    )
+)");
+  auto expected = assembler::to_s_expr(code.get());
+  EXPECT_FALSE(code->editable_cfg_built());
+
+  code->build_cfg(/* editable */ true);
+  auto* cfg = &code->cfg();
+  auto* entry = cfg->entry_block();
+  EXPECT_TRUE(code->editable_cfg_built());
+  // A later CFG-based pass asking for it again gets the same graph, without
+  // a linearize and rebuild in between.
+  code->build_cfg(/* editable */ true);
+  EXPECT_EQ(&code->cfg(), cfg);
+  EXPECT_EQ(code->cfg().entry_block(), entry);
+
+  // Asking for a non editable CFG linearizes it first.
+  code->build_cfg();
+  EXPECT_FALSE(code->editable_cfg_built());
+  code->clear_cfg();
+  EXPECT_EQ(assembler::to_s_expr(code.get()), expected);
+
+  delete g_redex;
+}
@@ -367,3 +367,60 @@ TEST(IRInstruction, InvokeSourceIsWideComplex2) {
 
   delete g_redex;
 }
+
+TEST(IRInstruction, SrcsSpillToHeap) {
+  IRInstruction insn(OPCODE_FILLED_NEW_ARRAY);
+  insn.set_arg_word_count(3);
+  for (size_t i = 0; i < 3; ++i) {
+    insn.set_src(i, i + 1);
+  }
+
+  // Growing past the inline capacity keeps the existing sources.
+  insn.set_arg_word_count(20);
+  EXPECT_EQ(insn.srcs_size(), 20);
+  for (size_t i = 0; i < 20; ++i) {
+    EXPECT_EQ(insn.src(i), i < 3 ? i + 1 : 0);
+    insn.set_src(i, 100 + i);
+  }
+
+  IRInstruction copy(insn);
+  EXPECT_EQ(copy, insn);
+  copy.set_src(19, 0);
+  EXPECT_NE(copy, insn);
+  EXPECT_EQ(insn.src(19), 119);
+
+  // Shrinking back moves the remaining sources inline.
+  insn.set_arg_word_count(2);
+  EXPECT_EQ(insn.srcs_size(), 2);
+  EXPECT_EQ(insn.src(0), 100);
+  EXPECT_EQ(insn.src(1), 101);
+  insn.set_arg_word_count(4);
+  EXPECT_EQ(insn.src(2), 0);
+  EXPECT_EQ(insn.src(3), 0);
+
+  copy = insn;
+  EXPECT_EQ(copy, insn);
+  std::vector<uint16_t> srcs(copy.srcs().begin(), copy.srcs().end());
+  EXPECT_EQ(srcs, std::vector<uint16_t>({100, 101, 0, 0}));
+}
+
+TEST(IRInstruction, HashIsOrderSensitive) {
+  IRInstruction add(OPCODE_ADD_INT);
+  add.set_dest(0);
+  add.set_src(0, 1);
+  add.set_src(1, 2);
+  IRInstruction swapped(add);
+  EXPECT_EQ(swapped.hash(), add.hash());
+  swapped.set_src(0, 2);
+  swapped.set_src(1, 1);
+  EXPECT_NE(swapped.hash(), add.hash());
+
+  // Equal fields used to cancel out.
+  IRInstruction move(OPCODE_MOVE);
+  move.set_dest(1);
+  move.set_src(0, 1);
+  IRInstruction other_move(OPCODE_MOVE);
+  other_move.set_dest(2);
+  other_move.set_src(0, 2);
+  EXPECT_NE(move.hash(), other_move.hash());
+}
@@ -0,0 +1,278 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <unordered_map>
+
+#include "Creators.h"
+#include "DexAnnotation.h"
+#include "IRAssembler.h"
+#include "IRSerialization.h"
+#include "RedexContext.h"
+
+namespace {
+
+/*
+ * Code with a bit of everything: references of each kind, branches, a
+ * try region with its handler, a fill-array-data payload, debug instructions
+ * and an inlined position.
+ */
+std::unique_ptr<IRCode> make_code() {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (const-wide v1 -1234567890123)
+     (const-string "hello")
+     (move-result-pseudo-object v3)
+     (sget-object "LFoo;.bar:LBar;")
+     (move-result-pseudo-object v4)
+     (if-eqz v0 :skip)
+     (invoke-static (v3 v0) "LFoo;.qux:(Ljava/lang/String;I)V")
+     :skip
+     (new-array v0 "[I")
+     (move-result-pseudo-object v4)
+     (return-void)
+    )
+)");
+  auto dbg = std::make_unique<DexDebugItem>();
+  dbg->get_param_names().push_back(DexString::make_string("count"));
+  code->set_debug_item(std::move(dbg));
+
+  auto caller = static_cast<DexMethod*>(
+      DexMethod::make_method("LFoo;.caller:(I)V"));
+  auto callee = static_cast<DexMethod*>(
+      DexMethod::make_method("LFoo;.qux:(Ljava/lang/String;I)V"));
+  auto file = DexString::make_string("Foo.java");
+  auto outer = std::make_unique<DexPosition>(10);
+  outer->bind(caller, file);
+  auto inner = std::make_unique<DexPosition>(20);
+  inner->bind(callee, file);
+  inner->parent = outer.get();
+
+  MethodItemEntry* catch_start = nullptr;
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto op = it->insn->opcode();
+    if (op == OPCODE_CONST_WIDE) {
+      code->insert_before(it, std::move(outer));
+      code->insert_before(
+          it,
+          std::make_unique<DexDebugOpcodeStartLocal>(
+              1, DexString::make_string("x"), DexType::make_type("J")));
+      code->insert_before(
+          it, std::make_unique<DexDebugInstruction>(DBG_ADVANCE_LINE, -3));
+    } else if (op == OPCODE_INVOKE_STATIC) {
+      code->insert_before(it, std::move(inner));
+      catch_start = new MethodItemEntry(DexType::make_type("LBoom;"));
+      code->insert_before(it, *new MethodItemEntry(TRY_START, catch_start));
+      code->insert_after(it, *new MethodItemEntry(TRY_END, catch_start));
+    } else if (op == OPCODE_RETURN_VOID) {
+      uint16_t payload[] = {FOPCODE_FILLED_ARRAY, 4, 2, 0, 7, 0xffff};
+      auto fill = new IRInstruction(OPCODE_FILL_ARRAY_DATA);
+      fill->set_arg_word_count(1);
+      fill->set_src(0, 4);
+      fill->set_data(new DexOpcodeData(payload, 5));
+      code->insert_before(it, fill);
+    }
+  }
+  code->push_back(*catch_start);
+  code->push_back(*new MethodItemEntry(new IRInstruction(OPCODE_RETURN_VOID)));
+  return code;
+}
+
+std::vector<uint8_t> serialize(const IRCode& code) {
+  std::vector<uint8_t> bytes;
+  ir_serialization::serialize(code, &bytes);
+  return bytes;
+}
+
+// Entries that point at other entries must point at the same positions.
+void expect_same_code(const IRCode& expected, const IRCode& actual) {
+  std::unordered_map<const MethodItemEntry*, size_t> expected_ids;
+  std::unordered_map<const MethodItemEntry*, size_t> actual_ids;
+  for (const auto& mie : expected) {
+    expected_ids.emplace(&mie, expected_ids.size());
+  }
+  for (const auto& mie : actual) {
+    actual_ids.emplace(&mie, actual_ids.size());
+  }
+  ASSERT_EQ(actual_ids.size(), expected_ids.size());
+  EXPECT_EQ(actual.get_registers_size(), expected.get_registers_size());
+
+  auto it = expected.begin();
+  auto actual_it = actual.begin();
+  for (; it != expected.end(); ++it, ++actual_it) {
+    ASSERT_EQ(actual_it->type, it->type);
+    switch (it->type) {
+    case MFLOW_OPCODE:
+      if (!it->insn->has_data()) {
+        EXPECT_EQ(*actual_it->insn, *it->insn) << show(it->insn);
+      } else {
+        // Each copy has a payload of its own.
+        EXPECT_EQ(actual_it->insn->opcode(), it->insn->opcode());
+        EXPECT_EQ(actual_it->insn->src(0), it->insn->src(0));
+        auto data = it->insn->get_data();
+        auto actual_data = actual_it->insn->get_data();
+        EXPECT_EQ(actual_data->opcode(), data->opcode());
+        ASSERT_EQ(actual_data->data_size(), data->data_size());
+        EXPECT_TRUE(std::equal(data->data(),
+                               data->data() + data->data_size(),
+                               actual_data->data()));
+      }
+      break;
+    case MFLOW_TARGET:
+      EXPECT_EQ(actual_it->target->type, it->target->type);
+      EXPECT_EQ(actual_ids.at(actual_it->target->src),
+                expected_ids.at(it->target->src));
+      break;
+    case MFLOW_TRY:
+      EXPECT_EQ(actual_it->tentry->type, it->tentry->type);
+      EXPECT_EQ(actual_ids.at(actual_it->tentry->catch_start),
+                expected_ids.at(it->tentry->catch_start));
+      break;
+    case MFLOW_CATCH:
+      EXPECT_EQ(actual_it->centry->catch_type, it->centry->catch_type);
+      EXPECT_EQ(actual_it->centry->next == nullptr,
+                it->centry->next == nullptr);
+      break;
+    case MFLOW_DEBUG:
+      EXPECT_EQ(actual_it->dbgop->opcode(), it->dbgop->opcode());
+      EXPECT_EQ(actual_it->dbgop->uvalue(), it->dbgop->uvalue());
+      break;
+    case MFLOW_POSITION:
+      // Also compares the parents.
+      EXPECT_EQ(*actual_it->pos, *it->pos);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+} // namespace
+
+TEST(IRSerializationTest, roundTrips) {
+  g_redex = new RedexContext();
+  auto code = make_code();
+  auto bytes = serialize(*code);
+  auto copy = ir_serialization::deserialize(bytes.data(), bytes.size());
+
+  expect_same_code(*code, *copy);
+  ASSERT_NE(copy->get_debug_item(), nullptr);
+  EXPECT_EQ(copy->get_debug_item()->get_param_names(),
+            code->get_debug_item()->get_param_names());
+  EXPECT_EQ(serialize(*copy), bytes);
+
+  delete g_redex;
+}
+
+TEST(IRSerializationTest, refersToMembersByName) {
+  g_redex = new RedexContext();
+  auto bytes = serialize(*make_code());
+  delete g_redex;
+
+  // A fresh context stands in for another process: nothing in it exists
+  // until the record is read.
+  g_redex = new RedexContext();
+  EXPECT_EQ(DexMethod::get_method("LFoo;.qux:(Ljava/lang/String;I)V"),
+            nullptr);
+  auto code = ir_serialization::deserialize(bytes.data(), bytes.size());
+  expect_same_code(*make_code(), *code);
+  EXPECT_EQ(serialize(*code), bytes);
+
+  delete g_redex;
+}
+
+TEST(IRSerializationTest, classRoundTrips) {
+  g_redex = new RedexContext();
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.set_access(ACC_PUBLIC | ACC_FINAL);
+  creator.add_interface(DexType::make_type("LBar;"));
+  auto count = static_cast<DexField*>(
+      DexField::make_field("LFoo;.COUNT:I"));
+  auto count_value = DexEncodedValue::zero_for_type(get_int_type());
+  count_value->value(-7);
+  count->make_concrete(ACC_PUBLIC | ACC_STATIC, count_value);
+  creator.add_field(count);
+  auto name = static_cast<DexField*>(
+      DexField::make_field("LFoo;.NAME:Ljava/lang/String;"));
+  name->make_concrete(ACC_STATIC,
+                      new DexEncodedValueString(DexString::make_string("x")));
+  creator.add_field(name);
+  auto next = static_cast<DexField*>(DexField::make_field("LFoo;.next:LFoo;"));
+  next->make_concrete(ACC_PRIVATE);
+  next->set_deobfuscated_name("LFoo;.mNext:LFoo;");
+  creator.add_field(next);
+  auto caller = static_cast<DexMethod*>(
+      DexMethod::make_method("LFoo;.caller:(I)V"));
+  caller->make_concrete(ACC_PUBLIC | ACC_STATIC, make_code(), false);
+  creator.add_method(caller);
+  auto run = static_cast<DexMethod*>(DexMethod::make_method("LFoo;.run:()V"));
+  run->make_concrete(ACC_PUBLIC | ACC_ABSTRACT, true);
+  creator.add_method(run);
+  auto cls = creator.create();
+  cls->set_source_file(DexString::make_string("Foo.java"));
+  std::vector<uint8_t> bytes;
+  ir_serialization::serialize(*cls, &bytes);
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  EXPECT_EQ(type_class(DexType::get_type("LFoo;")), nullptr);
+  auto copy = ir_serialization::deserialize_class(bytes.data(), bytes.size());
+  EXPECT_EQ(type_class(DexType::get_type("LFoo;")), copy);
+  EXPECT_EQ(copy->get_access(), ACC_PUBLIC | ACC_FINAL);
+  EXPECT_EQ(copy->get_super_class(), get_object_type());
+  ASSERT_EQ(copy->get_interfaces()->size(), 1);
+  EXPECT_EQ(copy->get_interfaces()->get_type_list()[0],
+            DexType::get_type("LBar;"));
+  EXPECT_EQ(copy->get_source_file()->str(), "Foo.java");
+
+  ASSERT_EQ(copy->get_sfields().size(), 2);
+  auto count_copy = copy->get_sfields()[0];
+  EXPECT_EQ(count_copy, DexField::get_field("LFoo;.COUNT:I"));
+  EXPECT_EQ(count_copy->get_access(), ACC_PUBLIC | ACC_STATIC);
+  EXPECT_EQ(count_copy->get_static_value()->evtype(), DEVT_INT);
+  EXPECT_EQ(static_cast<int64_t>(count_copy->get_static_value()->value()), -7);
+  auto name_value = copy->get_sfields()[1]->get_static_value();
+  ASSERT_EQ(name_value->evtype(), DEVT_STRING);
+  EXPECT_EQ(static_cast<DexEncodedValueString*>(name_value)->string()->str(),
+            "x");
+  ASSERT_EQ(copy->get_ifields().size(), 1);
+  EXPECT_EQ(copy->get_ifields()[0]->get_deobfuscated_name(),
+            "LFoo;.mNext:LFoo;");
+
+  ASSERT_EQ(copy->get_dmethods().size(), 1);
+  auto caller_copy = copy->get_dmethods()[0];
+  EXPECT_EQ(caller_copy, DexMethod::get_method("LFoo;.caller:(I)V"));
+  ASSERT_NE(caller_copy->get_code(), nullptr);
+  expect_same_code(*make_code(), *caller_copy->get_code());
+  ASSERT_EQ(copy->get_vmethods().size(), 1);
+  EXPECT_TRUE(copy->get_vmethods()[0]->is_virtual());
+  EXPECT_EQ(copy->get_vmethods()[0]->get_code(), nullptr);
+
+  std::vector<uint8_t> again;
+  ir_serialization::serialize(*copy, &again);
+  EXPECT_EQ(again, bytes);
+
+  // A record of code isn't one of a class.
+  EXPECT_ANY_THROW(ir_serialization::deserialize(bytes.data(), bytes.size()));
+  delete g_redex;
+}
+
+TEST(IRSerializationTest, rejectsTruncatedRecords) {
+  g_redex = new RedexContext();
+  auto bytes = serialize(*make_code());
+  bytes.pop_back();
+  EXPECT_ANY_THROW(ir_serialization::deserialize(bytes.data(), bytes.size()));
+  delete g_redex;
+}
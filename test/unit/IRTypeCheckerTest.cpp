@@ -524,3 +524,39 @@ TEST_F(IRTypeCheckerTest, polymorphicConstants3) {
       "v0' for register v0: expected type INT, but found REFERENCE instead",
       regular_checker.what());
 }
+
+TEST_F(IRTypeCheckerTest, dexTypes) {
+  using namespace dex_asm;
+  auto foo = DexType::make_type("LFoo;");
+  auto bar = DexType::make_type("LBar;");
+  auto target = new BranchTarget();
+  auto if_mie = new MethodItemEntry(dasm(OPCODE_IF_EQZ, {9_v}));
+  target->type = BRANCH_SIMPLE;
+  target->src = if_mie;
+  auto cast = dasm(OPCODE_CHECK_CAST, foo, {14_v});
+  auto move = dasm(OPCODE_MOVE_OBJECT, {1_v, 0_v});
+  auto null = dasm(OPCODE_CONST, {0_v, 0_L});
+  auto ret = dasm(OPCODE_RETURN, {9_v});
+  IRCode* code = m_method->get_code();
+  code->push_back(cast);
+  code->push_back(dasm(IOPCODE_MOVE_RESULT_PSEUDO_OBJECT, {0_v}));
+  code->push_back(move);
+  code->push_back(*if_mie); // branch to target
+  code->push_back(dasm(OPCODE_NEW_INSTANCE, bar, {}));
+  code->push_back(dasm(IOPCODE_MOVE_RESULT_PSEUDO_OBJECT, {1_v}));
+  code->push_back(null);
+  code->push_back(target);
+  code->push_back(ret);
+  IRTypeChecker checker(m_method);
+  checker.infer_dex_types();
+  checker.run();
+  EXPECT_TRUE(checker.good()) << checker.what();
+  EXPECT_EQ(get_object_type(), checker.get_dex_type(cast, 14));
+  EXPECT_EQ(foo, checker.get_dex_type(move, 0));
+  EXPECT_EQ(foo, checker.get_dex_type(if_mie->insn, 1));
+  EXPECT_EQ(bar, checker.get_dex_type(null, 1));
+  // Null has no Dex type, and LFoo; and LBar; meet at the return.
+  EXPECT_EQ(nullptr, checker.get_dex_type(ret, 0));
+  EXPECT_EQ(nullptr, checker.get_dex_type(ret, 1));
+  EXPECT_EQ(REFERENCE, checker.get_type(ret, 1));
+}
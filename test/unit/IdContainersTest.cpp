@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+#include "DexClass.h"
+#include "IdContainers.h"
+#include "RedexContext.h"
+
+namespace {
+
+std::vector<DexType*> make_types(size_t n) {
+  std::vector<DexType*> types;
+  for (size_t i = 0; i < n; ++i) {
+    types.push_back(
+        DexType::make_type(("Lcom/foo/C" + std::to_string(i) + ";").c_str()));
+  }
+  return types;
+}
+
+} // namespace
+
+TEST(IdContainersTest, idsAreDenseAndFindTheirEntities) {
+  g_redex = new RedexContext();
+  auto types = make_types(100);
+  // Batch interning hands out ids too.
+  auto more = g_redex->make_types(
+      {DexString::make_string("LA;"), DexString::make_string("LB;")});
+  types.insert(types.end(), more.begin(), more.end());
+
+  const auto& ids = g_redex->ids<DexType>();
+  EXPECT_EQ(ids.size(), types.size());
+  std::unordered_set<uint32_t> seen;
+  for (auto type : types) {
+    EXPECT_LT(type->id(), ids.size());
+    EXPECT_EQ(ids.get(type->id()), type);
+    EXPECT_TRUE(seen.insert(type->id()).second);
+  }
+  // Looking up an existing type doesn't make a new id.
+  DexType::make_type("Lcom/foo/C0;");
+  EXPECT_EQ(ids.size(), types.size());
+  delete g_redex;
+}
+
+TEST(IdContainersTest, idSetAndIdMap) {
+  g_redex = new RedexContext();
+  auto types = make_types(200);
+
+  IdSet<DexType> set;
+  EXPECT_TRUE(set.insert(types[150]));
+  EXPECT_TRUE(set.insert(types[3]));
+  EXPECT_FALSE(set.insert(types[3]));
+  EXPECT_EQ(set.size(), 2);
+  EXPECT_EQ(set.count(types[150]), 1);
+  EXPECT_EQ(set.count(types[4]), 0);
+  std::vector<DexType*> elements;
+  set.for_each([&](DexType* type) { elements.push_back(type); });
+  EXPECT_EQ(elements.size(), 2);
+
+  IdSet<DexType> other;
+  other.insert(types[3]);
+  EXPECT_FALSE(set == other);
+  EXPECT_EQ(set.erase(types[150]), 1);
+  EXPECT_EQ(set.erase(types[150]), 0);
+  EXPECT_TRUE(set == other);
+
+  IdMap<DexType, int> map;
+  map[types[7]] = 7;
+  map[types[190]] += 2;
+  EXPECT_EQ(map.size(), 2);
+  EXPECT_EQ(*map.find(types[7]), 7);
+  EXPECT_EQ(*map.find(types[190]), 2);
+  EXPECT_EQ(map.find(types[8]), nullptr);
+  EXPECT_EQ(map.erase(types[7]), 1);
+  EXPECT_EQ(map.count(types[7]), 0);
+  int sum = 0;
+  map.for_each([&](DexType*, int value) { sum += value; });
+  EXPECT_EQ(sum, 2);
+  delete g_redex;
+}
+
+TEST(IdContainersTest, concurrentIdSetInsertsOnce) {
+  g_redex = new RedexContext();
+  auto types = make_types(1000);
+
+  ConcurrentIdSet<DexType> set;
+  std::atomic<size_t> inserted{0};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      for (auto type : types) {
+        if (set.insert(type)) {
+          ++inserted;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(inserted, types.size());
+
+  // Entities created after the set still fit in it.
+  auto late = DexType::make_type("Lcom/foo/Late;");
+  EXPECT_EQ(set.count(late), 0);
+  EXPECT_TRUE(set.insert(late));
+  size_t n = 0;
+  set.for_each([&](DexType*) { ++n; });
+  EXPECT_EQ(n, types.size() + 1);
+  delete g_redex;
+}
@@ -267,7 +267,8 @@ TEST(InterproceduralConstantPropagation, unreachableInvoke) {
     code.build_cfg();
   });
   ConstPropConfig config;
-  FixpointIterator fp_iter(cg, config);
+  IntraproceduralCache cache(scope, config);
+  FixpointIterator fp_iter(cg, config, &cache);
   fp_iter.run({{INPUT_ARGS, ArgumentDomain()}});
 
   // Check m2 is reachable, despite m3 being unreachable
@@ -555,3 +556,76 @@ TEST(InterproceduralConstantPropagation, constantValueField) {
 
   delete g_redex;
 }
+
+TEST(InterproceduralConstantPropagation, reuseIntraproceduralAnalyses) {
+  g_redex = new RedexContext();
+
+  auto cls_ty = DexType::make_type("LFoo;");
+  ClassCreator creator(cls_ty);
+  creator.set_super(get_object_type());
+
+  auto field = static_cast<DexField*>(DexField::make_field("LFoo;.qux:I"));
+  field->make_concrete(ACC_PUBLIC | ACC_STATIC,
+                       new DexEncodedValueBit(DEVT_INT, 1));
+  creator.add_field(field);
+
+  auto m1 = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+     (
+      (const v0 1) ; the same as the encoded value of Foo.qux
+      (sput v0 "LFoo;.qux:I")
+      (invoke-static (v0) "LFoo;.baz:(I)V")
+      (return-void)
+     )
+    )
+  )");
+  m1->rstate.set_keep(); // Make this an entry point
+  creator.add_method(m1);
+
+  auto m2 = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.baz:(I)V"
+     (
+      (load-param v1)
+      (sget "LFoo;.qux:I")
+      (move-result-pseudo v0)
+      (if-nez v0 :label)
+      (const v0 0)
+      :label
+      (return-void)
+     )
+    )
+  )");
+  creator.add_method(m2);
+
+  Scope scope{creator.create()};
+  walk::code(scope, [](DexMethod*, IRCode& code) { code.build_cfg(); });
+
+  ConstPropConfig config;
+  config.max_heap_analysis_iterations = 2;
+  auto stats = InterproceduralConstantPropagationPass(config).run(scope);
+
+  // The first round analyzes both methods, without knowing the value of the
+  // field, and so does the computation of the values written to the field.
+  // Once the field is known, the second round only needs to analyze baz(),
+  // which reads it. As the field keeps its value, the arguments don't change
+  // and the values written are those of the first round.
+  EXPECT_EQ(stats.constant_fields, 1);
+  EXPECT_EQ(stats.intraprocedural_analyses, 5);
+  EXPECT_EQ(stats.intraprocedural_analyses_reused, 3);
+
+  auto expected_code2 = assembler::ircode_from_string(R"(
+    (
+     (load-param v1)
+     (const v0 1)
+     (goto :label)
+     (const v0 0)
+     :label
+     (return-void)
+    )
+  )");
+
+  EXPECT_EQ(assembler::to_s_expr(m2->get_code()),
+            assembler::to_s_expr(expected_code2.get()));
+
+  delete g_redex;
+}
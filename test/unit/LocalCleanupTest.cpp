@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "LocalCleanup.h"
+#include "RedexContext.h"
+
+struct LocalCleanupTest : testing::Test {
+  DexMethod* m_method;
+
+  LocalCleanupTest() {
+    g_redex = new RedexContext();
+    m_method = static_cast<DexMethod*>(
+        DexMethod::make_method("LFoo;.bar:(I)V"));
+    m_method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  }
+
+  ~LocalCleanupTest() { delete g_redex; }
+};
+
+// Removing the dead instructions between the gotos leaves blocks to merge,
+// and merging them leaves the unreachable code behind.
+TEST_F(LocalCleanupTest, reachesJointFixpoint) {
+  m_method->set_code(assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (const v1 1)
+     (goto :a)
+     :b
+     (const v2 2)
+     (return-void)
+     :a
+     (const v3 3)
+     (goto :b)
+    )
+  )"));
+
+  LocalDce dce;
+  auto stats = LocalCleanupPass::run(m_method, &dce);
+  auto code = m_method->get_code();
+  code->clear_cfg();
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (return-void)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(code), assembler::to_s_expr(expected.get()));
+  EXPECT_EQ(stats.gotos_removed, 2);
+  EXPECT_EQ(stats.dce.dead_instruction_count, 3);
+}
+
+TEST_F(LocalCleanupTest, onlyRemovesGotosWithoutDce) {
+  m_method->set_code(assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (const v1 1)
+     (goto :a)
+     :b
+     (return-void)
+     :a
+     (goto :b)
+    )
+  )"));
+
+  auto stats = LocalCleanupPass::run(m_method, nullptr);
+  auto code = m_method->get_code();
+  code->clear_cfg();
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (const v1 1)
+     (return-void)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(code), assembler::to_s_expr(expected.get()));
+  EXPECT_EQ(stats.gotos_removed, 2);
+  EXPECT_EQ(stats.dce.dead_instruction_count, 0);
+}
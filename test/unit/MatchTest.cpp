@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "Match.h"
+#include "RedexContext.h"
+
+TEST(MatchTest, opcodeSets) {
+  auto invoke = m::invoke();
+  EXPECT_EQ(5, invoke.opcodes.count());
+  EXPECT_TRUE(invoke.opcodes.test(OPCODE_INVOKE_INTERFACE));
+  EXPECT_FALSE(invoke.opcodes.test(OPCODE_CONST_STRING));
+
+  EXPECT_TRUE(m::any<IRInstruction>().opcodes.all());
+  EXPECT_TRUE((!m::const_string()).opcodes.all());
+
+  auto either = m::const_string() || m::throwex();
+  EXPECT_EQ(2, either.opcodes.count());
+  EXPECT_TRUE(either.opcodes.test(OPCODE_THROW));
+
+  auto both = m::invoke_static() && m::has_n_args(1);
+  EXPECT_EQ(1, both.opcodes.count());
+  EXPECT_TRUE(both.opcodes.test(OPCODE_INVOKE_STATIC));
+  EXPECT_TRUE((m::invoke_static() && m::throwex()).opcodes.none());
+}
+
+TEST(MatchTest, findMatches) {
+  g_redex = new RedexContext();
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const-string "foo")
+     (move-result-pseudo-object v0)
+     (const v1 0)
+     (const-string "bar")
+     (move-result-pseudo-object v2)
+     (return-void)
+    )
+)");
+  std::vector<IRInstruction*> insns;
+  for (auto& mie : InstructionIterable(code.get())) {
+    insns.push_back(mie.insn);
+  }
+
+  std::vector<std::vector<IRInstruction*>> matches;
+  m::find_matches(
+      insns, std::make_tuple(m::const_string(), m::move_result_pseudo()),
+      matches);
+  ASSERT_EQ(2, matches.size());
+  EXPECT_EQ(insns[0], matches[0][0]);
+  EXPECT_EQ(insns[4], matches[1][1]);
+
+  matches.clear();
+  m::find_matches(
+      insns, std::make_tuple(m::any<IRInstruction>(), m::const_string()),
+      matches);
+  ASSERT_EQ(1, matches.size());
+  EXPECT_EQ(insns[2], matches[0][0]);
+
+  delete g_redex;
+}
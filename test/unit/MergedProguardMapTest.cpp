@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <sstream>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexOutput.h"
+#include "DexPosition.h"
+#include "DexUtil.h"
+#include "RedexContext.h"
+
+namespace {
+
+struct MergedProguardMapTest : public testing::Test {
+  boost::filesystem::path dir;
+  DexStoresVector stores;
+
+  MergedProguardMapTest()
+      : dir(boost::filesystem::temp_directory_path() /
+            boost::filesystem::unique_path("pgmap-%%%%%%%%")) {
+    boost::filesystem::create_directories(dir);
+    g_redex = new RedexContext();
+    DexClasses classes;
+    // A class that ProGuard renamed to x and redex then renamed to A, and one
+    // that redex created.
+    for (auto names : {std::make_pair("LA;", "Lcom/foo/Original;"),
+                       std::make_pair("LB;", "LB;")}) {
+      ClassCreator creator(DexType::make_type(names.first));
+      creator.set_super(get_object_type());
+      auto cls = creator.create();
+      cls->set_deobfuscated_name(names.second);
+      classes.push_back(cls);
+    }
+    DexStore store("classes");
+    store.add_classes(std::move(classes));
+    stores.emplace_back(std::move(store));
+  }
+
+  ~MergedProguardMapTest() {
+    delete g_redex;
+    boost::filesystem::remove_all(dir);
+  }
+
+  std::string file(const std::string& name) const {
+    return (dir / name).string();
+  }
+
+  std::string read_file(const std::string& name) const {
+    std::ifstream in(file(name));
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+  }
+
+  void write(const std::string& pg_map) {
+    std::ofstream(file("mapping.txt")) << pg_map;
+    Json::Value json(Json::objectValue);
+    json["proguard_map"] = file("mapping.txt");
+    json["proguard_map_output"] = "redex-class-rename-map.txt";
+    ConfigFiles cfg(json);
+    cfg.outdir = dir.string();
+    std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make("", ""));
+    write_classes_to_dex(file("classes.dex"),
+                         &stores[0].get_dexen()[0],
+                         nullptr,
+                         0,
+                         cfg,
+                         json,
+                         pos_mapper.get());
+    write_merged_pg_mapping(stores, cfg, json);
+  }
+};
+
+} // namespace
+
+TEST_F(MergedProguardMapTest, renamesTheClassLinesOfTheInputMap) {
+  write(
+      "com.foo.Original -> x:\n"
+      "    int count -> a\r\n"
+      "    1:2:void run() -> b\n"
+      "com.foo.Gone -> y:\n"
+      "    void stop() -> c\n");
+  EXPECT_EQ(read_file("redex-class-rename-map.txt"),
+            "com.foo.Original -> A:\n"
+            "    int count -> a\n"
+            "    1:2:void run() -> b\n"
+            "com.foo.Gone -> y:\n"
+            "    void stop() -> c\n"
+            "B -> B:\n");
+}
+
+TEST_F(MergedProguardMapTest, keepsTheDexMapsWithoutAnInputMap) {
+  write("");
+  EXPECT_EQ(read_file("redex-class-rename-map.txt"),
+            "com.foo.Original -> A:\n"
+            "B -> B:\n");
+}
@@ -152,11 +152,16 @@ class FixpointIterator final
           LivenessDomain,
           boost::hash<ControlPoint>> {
  public:
-  explicit FixpointIterator(const Program& program)
-      : MonotonicFixpointIterator(program), m_program(program) {}
+  explicit FixpointIterator(
+      const Program& program,
+      FixpointIterationStrategy strategy = FixpointIterationStrategy::Recursive,
+      bool store_entry_states = true)
+      : MonotonicFixpointIterator(program, 4, strategy, store_entry_states),
+        m_program(program) {}
 
   void analyze_node(const ControlPoint& node,
                     LivenessDomain* current_state) const override {
+    ++m_analyzed_nodes;
     const Statement& stmt = m_program.statement_at(node);
     // This is the standard semantic definition of liveness.
     current_state->remove(stmt.def.begin(), stmt.def.end());
@@ -183,8 +188,11 @@ class FixpointIterator final
     return get_entry_state_at(ControlPoint(node));
   }
 
+  size_t get_analyzed_nodes() const { return m_analyzed_nodes; }
+
  private:
   const Program& m_program;
+  mutable size_t m_analyzed_nodes{0};
 };
 
 class MonotonicFixpointIteratorTest : public ::testing::Test {
@@ -359,3 +367,25 @@ TEST_F(MonotonicFixpointIteratorTest, program2) {
   ASSERT_TRUE(fp.get_live_in_vars_at("7").is_bottom());
   ASSERT_TRUE(fp.get_live_out_vars_at("7").is_bottom());
 }
+
+TEST_F(MonotonicFixpointIteratorTest, worklistStrategy) {
+  for (bool store_entry_states : {true, false}) {
+    for (Program* program : {&this->m_program1, &this->m_program2}) {
+      FixpointIterator recursive(*program);
+      recursive.run(LivenessDomain());
+      FixpointIterator worklist(
+          *program, FixpointIterationStrategy::Worklist, store_entry_states);
+      worklist.run(LivenessDomain());
+      for (const auto& label : {"1", "2", "3", "4", "5", "6", "7"}) {
+        EXPECT_TRUE(recursive.get_live_in_vars_at(label).equals(
+            worklist.get_live_in_vars_at(label)))
+            << "live in at " << label;
+        EXPECT_TRUE(recursive.get_live_out_vars_at(label).equals(
+            worklist.get_live_out_vars_at(label)))
+            << "live out at " << label;
+      }
+      // Nodes are only reanalyzed when their inputs change.
+      EXPECT_LE(worklist.get_analyzed_nodes(), recursive.get_analyzed_nodes());
+    }
+  }
+}
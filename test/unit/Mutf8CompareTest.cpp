@@ -8,6 +8,7 @@
  */
 
 #include <memory>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include "DexClass.h"
@@ -20,3 +21,62 @@ TEST(Mutf8CompareTest, empty) {
   EXPECT_FALSE(compare_dexstrings(s2, s1));
   delete g_redex;
 }
+
+namespace {
+
+// Code point by code point, as the dex format orders strings.
+std::vector<uint32_t> code_points(const char* s) {
+  std::vector<uint32_t> cps;
+  while (*s != '\0') {
+    cps.push_back(mutf8_next_code_point(s));
+  }
+  return cps;
+}
+
+} // namespace
+
+TEST(Mutf8CompareTest, matchesCodePointOrder) {
+  g_redex = new RedexContext();
+  std::vector<const char*> strs = {
+      "",
+      "a",
+      "abcdefgh",
+      "abcdefghi",
+      "abcdefghij",
+      "abcdefgh\300\200",
+      "abcdefgh\001",
+      "abcdefgh\303\251",
+      "abcdefgh\303\250z",
+      "abcdefgh\342\202\254",
+      "abcdefgh\355\240\200\355\260\200",
+      "abcdefgh\357\277\277",
+      "Lcom/facebook/Foo;",
+      "Lcom/facebook/Foo$\303\251;",
+      "Lcom/facebook/Fo\303\251;",
+      "\300\200",
+      "\303\251",
+  };
+  std::vector<DexString*> dstrs;
+  for (auto str : strs) {
+    dstrs.push_back(DexString::make_string(str));
+  }
+  for (auto a : dstrs) {
+    for (auto b : dstrs) {
+      EXPECT_EQ(compare_dexstrings(a, b),
+                code_points(a->c_str()) < code_points(b->c_str()))
+          << a->c_str() << " vs " << b->c_str();
+    }
+  }
+  delete g_redex;
+}
+
+TEST(Mutf8CompareTest, length) {
+  EXPECT_EQ(length_of_utf8_string(nullptr), 0);
+  EXPECT_EQ(length_of_utf8_string(""), 0);
+  EXPECT_EQ(length_of_utf8_string("Lcom/facebook/Foo;"), 18);
+  EXPECT_EQ(length_of_utf8_string("Lcom/facebook/\303\251\342\202\254;"), 17);
+  EXPECT_EQ(length_of_utf8_string("\300\200abcdefghij"), 11);
+  EXPECT_EQ(ascii_prefix_length("abcdefghij\303\251", 12), 10);
+  EXPECT_EQ(mismatch_index("abcdefghij", "abcdefghiJ", 10), 9);
+  EXPECT_EQ(mismatch_index("abcdefghij", "abcdefghij", 10), 10);
+}
@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ObfuscateUtils.h"
+
+namespace {
+
+struct TestNameGenerator : public NameGenerator<DexField*> {
+  TestNameGenerator(const ObfuscatedIdSet& ids_to_avoid,
+                    ObfuscatedIdSet& used_ids)
+      : NameGenerator<DexField*>(ids_to_avoid, used_ids) {}
+
+  void find_new_name(DexNameWrapper<DexField*>*) override {}
+
+  std::string next_name() {
+    auto id = next_id();
+    used_ids.insert_id(id);
+    return obfuscated_name(id);
+  }
+};
+
+} // namespace
+
+TEST(ObfuscateNameTest, namesSpellTheirIds) {
+  EXPECT_EQ(obfuscated_name(1), "B");
+  EXPECT_EQ(obfuscated_name(25), "Z");
+  EXPECT_EQ(obfuscated_name(26), "a");
+  EXPECT_EQ(obfuscated_name(51), "z");
+  EXPECT_EQ(obfuscated_name(52), "AB");
+  EXPECT_EQ(obfuscated_name(53), "BB");
+  EXPECT_EQ(obfuscated_name(52 * 52), "AAB");
+
+  for (obfuscated_id_t id : {1u, 51u, 52u, 2703u, 2704u, 140607u, 140608u}) {
+    auto name = obfuscated_name(id);
+    auto back = obfuscated_id(name.c_str(), name.size());
+    ASSERT_TRUE(back);
+    EXPECT_EQ(*back, id);
+  }
+}
+
+TEST(ObfuscateNameTest, idSetLeavesOutNamesNoIdSpells) {
+  ObfuscatedIdSet ids;
+  ids.insert("a");
+  ids.insert(std::string("BB"));
+  ids.insert("A");
+  ids.insert("BA");
+  ids.insert("<init>");
+  ids.insert("getFoo");
+  ids.insert("");
+  EXPECT_EQ(ids.size(), 2);
+  EXPECT_TRUE(ids.contains_id(26));
+  EXPECT_TRUE(ids.contains_id(53));
+}
+
+TEST(ObfuscateNameTest, generatorSkipsTheIdsToAvoid) {
+  ObfuscatedIdSet ids_to_avoid;
+  ObfuscatedIdSet used_ids;
+  ids_to_avoid.insert("B");
+  ids_to_avoid.insert("D");
+  TestNameGenerator gen(ids_to_avoid, used_ids);
+  EXPECT_EQ(gen.next_name(), "C");
+  EXPECT_EQ(gen.next_name(), "E");
+
+  // Another generator sharing the used ids doesn't hand them out again.
+  TestNameGenerator other(ids_to_avoid, used_ids);
+  EXPECT_EQ(other.next_name(), "F");
+  gen.reset();
+  EXPECT_EQ(gen.next_name(), "G");
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ControlFlow.h"
+#include "DexPosition.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "ObjectCensus.h"
+#include "RedexContext.h"
+
+namespace {
+
+int64_t live(census::Kind kind) { return census::sample()[kind]; }
+
+} // namespace
+
+TEST(ObjectCensusTest, countsObjectsFreedOnOtherThreads) {
+  auto before = live(census::IR_INSTRUCTION);
+  std::vector<std::unique_ptr<IRInstruction>> insns(1000);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&insns, t] {
+      for (size_t i = t; i < insns.size(); i += 4) {
+        insns[i] = std::make_unique<IRInstruction>(OPCODE_NOP);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(live(census::IR_INSTRUCTION), before + 1000);
+
+  auto copy = std::make_unique<IRInstruction>(*insns[0]);
+  EXPECT_EQ(live(census::IR_INSTRUCTION), before + 1001);
+  // Assigning doesn't make another one.
+  *copy = *insns[1];
+  EXPECT_EQ(live(census::IR_INSTRUCTION), before + 1001);
+  copy.reset();
+
+  // The threads that made them are gone; this one takes its counter below
+  // zero.
+  insns.clear();
+  EXPECT_EQ(live(census::IR_INSTRUCTION), before);
+}
+
+TEST(ObjectCensusTest, countsTheIRAndTheContext) {
+  g_redex = new RedexContext();
+  auto strings = live(census::DEX_STRING);
+  auto types = live(census::DEX_TYPE);
+  DexType::make_type("LCensus;");
+  DexType::make_type("LCensus;");
+  EXPECT_EQ(live(census::DEX_STRING), strings + 1);
+  EXPECT_EQ(live(census::DEX_TYPE), types + 1);
+
+  auto before = census::sample();
+  {
+    auto code = assembler::ircode_from_string(R"(
+      (
+       (load-param v0)
+       (if-eqz v0 :skip)
+       (const v0 1)
+       :skip
+       (return v0)
+      )
+    )");
+    code->push_back(std::make_unique<DexPosition>(1));
+    auto during = census::sample();
+    EXPECT_EQ(during[census::IR_INSTRUCTION] - before[census::IR_INSTRUCTION],
+              4);
+    // The instructions, the branch target and the position.
+    EXPECT_EQ(during[census::METHOD_ITEM_ENTRY] -
+                  before[census::METHOD_ITEM_ENTRY],
+              6);
+    EXPECT_EQ(during[census::DEX_POSITION] - before[census::DEX_POSITION], 1);
+
+    code->build_cfg();
+    EXPECT_GT(live(census::CFG_BLOCK), before[census::CFG_BLOCK]);
+    EXPECT_GT(live(census::CFG_EDGE), before[census::CFG_EDGE]);
+    code->clear_cfg();
+    EXPECT_EQ(live(census::CFG_BLOCK), before[census::CFG_BLOCK]);
+    EXPECT_EQ(live(census::CFG_EDGE), before[census::CFG_EDGE]);
+  }
+  // IRCode doesn't own its instructions, which outlive it; everything else
+  // went with it.
+  auto after = census::sample();
+  EXPECT_EQ(after[census::IR_INSTRUCTION] - before[census::IR_INSTRUCTION], 4);
+  after[census::IR_INSTRUCTION] = before[census::IR_INSTRUCTION];
+  EXPECT_EQ(after, before);
+
+  delete g_redex;
+  EXPECT_EQ(live(census::DEX_TYPE), types);
+  EXPECT_EQ(live(census::DEX_STRING), strings);
+}
@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "PageAccounting.h"
+
+TEST(PageAccounting, countsTouchedPagesPerSection) {
+  PageAccounter accounter(0x100);
+  // Added out of order; the second section shares its first page with the
+  // end of the first.
+  accounter.add_section("code", 0x280, 0x300);
+  accounter.add_section("strings", 0x0, 0x280);
+
+  // Within one page, twice.
+  accounter.touch(0x10, 0x10);
+  accounter.touch(0x20, 0x10);
+  // Straddles both sections and the page they share.
+  accounter.touch(0x270, 0x20);
+  // Runs past the end of every section.
+  accounter.touch(0x500, 0x1000);
+
+  auto report = accounter.report();
+  ASSERT_EQ(report.size(), 2);
+  EXPECT_EQ(report[0].name, "strings");
+  EXPECT_EQ(report[0].pages, 3);
+  EXPECT_EQ(report[0].touched_pages, 2);
+  EXPECT_EQ(report[1].name, "code");
+  EXPECT_EQ(report[1].pages, 4);
+  EXPECT_EQ(report[1].touched_pages, 2);
+}
+
+TEST(PageAccounting, dexSectionsExtendToTheNextItem) {
+  dex_map_item maps[] = {
+      {TYPE_CODE_ITEM, 0, 10, 0x3000},
+      {TYPE_HEADER_ITEM, 0, 1, 0x0},
+      {TYPE_STRING_ID_ITEM, 0, 4, 0x70},
+  };
+  PageAccounter accounter;
+  add_dex_sections(accounter, maps, 3, 0x5001);
+  accounter.touch(0x4ff0, 0x20);
+
+  auto report = accounter.report();
+  ASSERT_EQ(report.size(), 3);
+  EXPECT_EQ(report[0].name, "header_item");
+  EXPECT_EQ(report[0].size, 0x70);
+  EXPECT_EQ(report[1].name, "string_id_item");
+  EXPECT_EQ(report[1].size, 0x3000 - 0x70);
+  EXPECT_EQ(report[2].name, "code_item");
+  EXPECT_EQ(report[2].pages, 3);
+  EXPECT_EQ(report[2].touched_pages, 2);
+}
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "FixpointIterators.h"
+#include "HashedSetAbstractDomain.h"
+#include "ParallelFixpointIterator.h"
+
+/*
+ * A directed graph over the integers 0..n-1 whose root is 0.
+ */
+struct Graph {
+  explicit Graph(size_t n) : succs(n), preds(n) {}
+
+  void add_edge(uint32_t source, uint32_t target) {
+    succs[source].emplace_back(source, target);
+    preds[target].emplace_back(source, target);
+  }
+
+  using Edge = std::pair<uint32_t, uint32_t>;
+  std::vector<std::vector<Edge>> succs;
+  std::vector<std::vector<Edge>> preds;
+};
+
+class GraphInterface : public FixpointIteratorGraphSpec<GraphInterface> {
+ public:
+  using Graph = ::Graph;
+  using NodeId = uint32_t;
+  using EdgeId = Graph::Edge;
+
+  static NodeId entry(const Graph&) { return 0; }
+  static std::vector<EdgeId> predecessors(const Graph& graph,
+                                          const NodeId& node) {
+    return graph.preds[node];
+  }
+  static std::vector<EdgeId> successors(const Graph& graph,
+                                        const NodeId& node) {
+    return graph.succs[node];
+  }
+  static NodeId source(const Graph&, const EdgeId& e) { return e.first; }
+  static NodeId target(const Graph&, const EdgeId& e) { return e.second; }
+};
+
+/*
+ * Collects the nodes on the paths that lead to a node, i.e., its ancestors in
+ * the top-down order and its descendants in the bottom-up order.
+ */
+using PathDomain = HashedSetAbstractDomain<uint32_t>;
+
+class ParallelPathAnalyzer final
+    : public ParallelMonotonicFixpointIterator<GraphInterface, PathDomain> {
+ public:
+  ParallelPathAnalyzer(const Graph& graph, SccOrder order, size_t num_threads)
+      : ParallelMonotonicFixpointIterator(graph, order, num_threads) {}
+
+  void analyze_node(const uint32_t& node,
+                    PathDomain* current_state) const override {
+    current_state->add(node);
+  }
+
+  PathDomain analyze_edge(const Graph::Edge&,
+                          const PathDomain& exit_state) const override {
+    return exit_state;
+  }
+};
+
+class PathAnalyzer final
+    : public MonotonicFixpointIterator<GraphInterface, PathDomain> {
+ public:
+  explicit PathAnalyzer(const Graph& graph)
+      : MonotonicFixpointIterator(graph) {}
+
+  void analyze_node(const uint32_t& node,
+                    PathDomain* current_state) const override {
+    current_state->add(node);
+  }
+
+  PathDomain analyze_edge(const Graph::Edge&,
+                          const PathDomain& exit_state) const override {
+    return exit_state;
+  }
+};
+
+/*
+ *   0 --> 1 <--> 2
+ *   |     |
+ *   v     v
+ *   4 --> 3 <-- 5
+ */
+Graph make_small_graph() {
+  Graph graph(6);
+  graph.add_edge(0, 1);
+  graph.add_edge(1, 2);
+  graph.add_edge(2, 1);
+  graph.add_edge(1, 3);
+  graph.add_edge(0, 4);
+  graph.add_edge(4, 3);
+  graph.add_edge(5, 3);
+  return graph;
+}
+
+TEST(ParallelFixpointIteratorTest, topDown) {
+  auto graph = make_small_graph();
+  ParallelPathAnalyzer analyzer(graph, SccOrder::TopDown, 4);
+  // Node 5 is unreachable, and 1 and 2 form a single SCC.
+  EXPECT_EQ(4, analyzer.num_sccs());
+  analyzer.run(PathDomain());
+
+  EXPECT_TRUE(analyzer.get_entry_state_at(0).elements().empty());
+  EXPECT_THAT(analyzer.get_entry_state_at(1).elements(),
+              ::testing::UnorderedElementsAre(0, 1, 2));
+  EXPECT_THAT(analyzer.get_entry_state_at(3).elements(),
+              ::testing::UnorderedElementsAre(0, 1, 2, 4));
+  EXPECT_THAT(analyzer.get_exit_state_at(3).elements(),
+              ::testing::UnorderedElementsAre(0, 1, 2, 3, 4));
+  EXPECT_TRUE(analyzer.get_entry_state_at(5).is_bottom());
+  EXPECT_TRUE(analyzer.get_exit_state_at(5).is_bottom());
+}
+
+TEST(ParallelFixpointIteratorTest, bottomUp) {
+  auto graph = make_small_graph();
+  ParallelPathAnalyzer analyzer(graph, SccOrder::BottomUp, 4);
+  analyzer.run(PathDomain());
+
+  EXPECT_THAT(analyzer.get_exit_state_at(0).elements(),
+              ::testing::UnorderedElementsAre(0, 1, 2, 3, 4));
+  EXPECT_THAT(analyzer.get_exit_state_at(1).elements(),
+              ::testing::UnorderedElementsAre(1, 2, 3));
+  EXPECT_THAT(analyzer.get_exit_state_at(4).elements(),
+              ::testing::UnorderedElementsAre(3, 4));
+  EXPECT_TRUE(analyzer.get_entry_state_at(3).elements().empty());
+  EXPECT_TRUE(analyzer.get_exit_state_at(5).is_bottom());
+}
+
+TEST(ParallelFixpointIteratorTest, agreesWithSequentialIterator) {
+  const size_t n = 500;
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<uint32_t> node(0, n - 1);
+  Graph graph(n);
+  for (size_t i = 0; i < 3 * n; ++i) {
+    auto source = node(rng);
+    auto target = node(rng);
+    // Mostly forward edges, so that there are many SCCs.
+    if (source > target && i % 8 != 0) {
+      std::swap(source, target);
+    }
+    graph.add_edge(source, target);
+  }
+
+  PathAnalyzer sequential(graph);
+  sequential.run(PathDomain());
+  for (size_t num_threads : {1, 8}) {
+    ParallelPathAnalyzer parallel(graph, SccOrder::TopDown, num_threads);
+    parallel.run(PathDomain());
+    for (uint32_t i = 0; i < n; ++i) {
+      EXPECT_TRUE(sequential.get_entry_state_at(i).equals(
+          parallel.get_entry_state_at(i)))
+          << "at node " << i;
+      EXPECT_TRUE(sequential.get_exit_state_at(i).equals(
+          parallel.get_exit_state_at(i)))
+          << "at node " << i;
+    }
+  }
+}
@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "RedexContext.h"
+
+namespace {
+
+class NopPass : public Pass {
+ public:
+  NopPass() : Pass("NopPass") {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override {}
+};
+
+/*
+ * Makes the argument of the neg-int read an undefined register, editing the
+ * instruction in place.
+ */
+class BreakingPass : public Pass {
+ public:
+  BreakingPass() : Pass("BreakingPass") {}
+
+  void run_pass(DexStoresVector& stores, ConfigFiles&, PassManager&) override {
+    for (auto cls : build_class_scope(stores)) {
+      for (auto method : cls->get_dmethods()) {
+        for (auto& mie : InstructionIterable(method->get_code())) {
+          if (mie.insn->opcode() == OPCODE_NEG_INT) {
+            mie.insn->set_src(0, 2);
+          }
+        }
+      }
+    }
+  }
+};
+
+DexStoresVector make_stores() {
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+     (
+      (const v0 1)
+      (neg-int v1 v0)
+      (return-void)
+     )
+    )
+  )"));
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes({creator.create()});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  return stores;
+}
+
+void run_passes(const std::vector<Pass*>& passes) {
+  g_redex = new RedexContext();
+  auto stores = make_stores();
+  Json::Value config;
+  config["ir_type_checker"]["run_after_each_pass"] = true;
+  PassManager manager(passes, config);
+  manager.set_testing_mode();
+  Scope external_classes;
+  Json::Value conf_obj = Json::nullValue;
+  ConfigFiles dummy_config(conf_obj);
+  manager.run_passes(stores, external_classes, dummy_config);
+  delete g_redex;
+}
+
+} // namespace
+
+TEST(PassManagerTypeCheckerTest, recheckMethodsEditedInPlace) {
+  // The type checker runs on worker threads.
+  ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+  NopPass nop;
+  BreakingPass breaking;
+  run_passes({&nop});
+  // The method passes the checker after the first pass, and has to be checked
+  // again after the second one although its code was only edited in place.
+  EXPECT_EXIT(run_passes({&nop, &breaking}),
+              ::testing::ExitedWithCode(EXIT_FAILURE),
+              "Inconsistency found in Dex code");
+}
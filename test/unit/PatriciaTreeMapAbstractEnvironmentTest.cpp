@@ -257,6 +257,34 @@ TEST_F(PatriciaTreeMapAbstractEnvironmentTest, whiteBox) {
   EXPECT_TRUE(e.bindings().reference_equals(before));
 }
 
+TEST_F(PatriciaTreeMapAbstractEnvironmentTest, hashConsing) {
+  set_patricia_tree_hash_consing(true);
+  for (size_t k = 0; k < 10; ++k) {
+    Environment e1 = this->generate_random_environment();
+    Environment e2 = this->generate_random_environment();
+    if (!e1.is_value()) {
+      continue;
+    }
+    // Environments that are built independently are unified.
+    Environment copy;
+    for (const auto& pair : e1.bindings()) {
+      copy.set(pair.first, pair.second);
+    }
+    EXPECT_TRUE(copy.bindings().reference_equals(e1.bindings()));
+
+    auto ref_join = hae_from_ptae(e1);
+    ref_join.join_with(hae_from_ptae(e2));
+    auto ref_meet = hae_from_ptae(e1);
+    ref_meet.meet_with(hae_from_ptae(e2));
+    // The second round is served by the operation cache.
+    for (size_t round = 0; round < 2; ++round) {
+      EXPECT_EQ(hae_from_ptae(e1.join(e2)), ref_join);
+      EXPECT_EQ(hae_from_ptae(e1.meet(e2)), ref_meet);
+    }
+  }
+  set_patricia_tree_hash_consing(false);
+}
+
 TEST_F(PatriciaTreeMapAbstractEnvironmentTest, prettyPrinting) {
   using StringEnvironment =
       PatriciaTreeMapAbstractEnvironment<std::string*, Domain>;
@@ -262,6 +262,43 @@ TEST_F(PatriciaTreeSetTest, whiteBox) {
   }
 }
 
+TEST_F(PatriciaTreeSetTest, hashConsing) {
+  set_patricia_tree_hash_consing(true);
+  for (size_t k = 0; k < 10; ++k) {
+    pt_set s = this->generate_random_set();
+    std::vector<uint32_t> elems(s.begin(), s.end());
+    // Sets that are built independently are unified.
+    pt_set s1(elems.begin(), elems.end());
+    pt_set s2(elems.rbegin(), elems.rend());
+    EXPECT_TRUE(s1.reference_equals(s2));
+    EXPECT_TRUE(s1.equals(s2));
+
+    pt_set t = this->generate_random_set();
+    std::vector<uint32_t> elems_t(t.begin(), t.end());
+    std::vector<uint32_t> ref_u = get_union(elems, elems_t);
+    std::vector<uint32_t> ref_i = get_intersection(elems, elems_t);
+    // The second round is served by the operation cache.
+    for (size_t round = 0; round < 2; ++round) {
+      pt_set u = s1.get_union_with(t);
+      pt_set i = s1.get_intersection_with(t);
+      EXPECT_THAT(std::vector<uint32_t>(u.begin(), u.end()),
+                  ::testing::UnorderedElementsAreArray(ref_u));
+      EXPECT_THAT(std::vector<uint32_t>(i.begin(), i.end()),
+                  ::testing::UnorderedElementsAreArray(ref_i));
+      EXPECT_TRUE(u.reference_equals(pt_set(ref_u.begin(), ref_u.end())));
+      EXPECT_TRUE(i.reference_equals(pt_set(ref_i.begin(), ref_i.end())));
+    }
+  }
+  set_patricia_tree_hash_consing(false);
+  // Trees built before and after hash-consing was disabled can be mixed.
+  pt_set s{1, 2, 3};
+  set_patricia_tree_hash_consing(true);
+  pt_set t{1, 2, 3};
+  set_patricia_tree_hash_consing(false);
+  EXPECT_FALSE(s.reference_equals(t));
+  EXPECT_TRUE(s.equals(t));
+}
+
 using string_set = PatriciaTreeSet<std::string*>;
 
 std::vector<std::string> string_set_to_vector(const string_set& s) {
@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "PassManager.h"
+#include "Peephole.h"
+#include "RedexContext.h"
+
+// The patterns are created once and refer to the methods of the context that
+// was current at that time, so all the tests share a single context.
+class PeepholeTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() { g_redex = new RedexContext(); }
+
+  static void TearDownTestCase() { delete g_redex; }
+};
+
+void run_peephole(const std::string& class_name,
+                  const std::string& code_str,
+                  const std::string& expected_str) {
+  ClassCreator creator(DexType::make_type(class_name.c_str()));
+  creator.set_super(get_object_type());
+  auto method = static_cast<DexMethod*>(DexMethod::make_method(
+      class_name.c_str(), "bar", "V", {"Ljava/lang/StringBuilder;"}));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  method->set_code(assembler::ircode_from_string(code_str));
+  creator.add_method(method);
+
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes({creator.create()});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+
+  PeepholePass peephole_pass;
+  PassManager manager({&peephole_pass});
+  manager.set_testing_mode();
+  ConfigFiles config(Json::nullValue);
+  Scope external_classes;
+  manager.run_passes(stores, external_classes, config);
+
+  method->get_code()->clear_cfg();
+  auto expected = assembler::ircode_from_string(expected_str);
+  EXPECT_EQ(assembler::to_s_expr(method->get_code()),
+            assembler::to_s_expr(expected.get()));
+}
+
+TEST_F(PeepholeTest, patternsOfDifferentKindsInOnePass) {
+  run_peephole("LArith;", R"(
+    (
+     (const v1 7)
+     (add-int/lit8 v2 v1 0)
+     (move v3 v3)
+     (mul-int/lit8 v4 v2 1)
+     (return-void)
+    )
+)",
+               R"(
+    (
+     (const v1 7)
+     (move v2 v1)
+     (move v4 v2)
+     (return-void)
+    )
+)");
+}
+
+TEST_F(PeepholeTest, overlappingMatchesFollowPatternOrder) {
+  // Both Coalesce_AppendString_AppendString and its WithoutMoveResult
+  // variant match here. The former comes first and wins.
+  run_peephole("LStrings;", R"(
+    (
+     (load-param-object v0)
+     (const-string "foo")
+     (move-result-pseudo-object v1)
+     (invoke-virtual (v0 v1) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+     (move-result-object v2)
+     (const-string "bar")
+     (move-result-pseudo-object v3)
+     (invoke-virtual (v2 v3) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+     (move-result-object v4)
+     (return-void)
+    )
+)",
+               R"(
+    (
+     (load-param-object v0)
+     (const-string "foobar")
+     (move-result-pseudo-object v1)
+     (invoke-virtual (v0 v1) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+     (const-string "foo")
+     (move-result-pseudo-object v1)
+     (move-object v2 v0)
+     (const-string "bar")
+     (move-result-pseudo-object v3)
+     (move-object v4 v2)
+     (return-void)
+    )
+)");
+}
+
+TEST_F(PeepholeTest, redundantCheckCastsFollowInferredTypes) {
+  // The parameter is a StringBuilder on both paths, while the string isn't.
+  run_peephole("LCasts;", R"(
+    (
+     (load-param-object v0)
+     (move-object v1 v0)
+     (if-eqz v1 :skip)
+     (move-object v1 v0)
+     :skip
+     (check-cast v1 "Ljava/lang/StringBuilder;")
+     (move-result-pseudo-object v1)
+     (check-cast v0 "Ljava/lang/StringBuilder;")
+     (move-result-pseudo-object v2)
+     (const-string "foo")
+     (move-result-pseudo-object v3)
+     (check-cast v3 "Ljava/lang/StringBuilder;")
+     (move-result-pseudo-object v3)
+     (return-void)
+    )
+)",
+               R"(
+    (
+     (load-param-object v0)
+     (move-object v1 v0)
+     (if-eqz v1 :skip)
+     (move-object v1 v0)
+     :skip
+     (move-object v2 v0)
+     (const-string "foo")
+     (move-result-pseudo-object v3)
+     (check-cast v3 "Ljava/lang/StringBuilder;")
+     (move-result-pseudo-object v3)
+     (return-void)
+    )
+)");
+}
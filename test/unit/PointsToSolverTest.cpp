@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "PointsToSolver.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexContext.h"
+#include "ScopeHelper.h"
+
+namespace {
+
+DexClass* make_class(const char* name,
+                     DexType* super,
+                     const std::vector<const char*>& methods) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(super);
+  for (auto method : methods) {
+    creator.add_method(assembler::method_from_string(method));
+  }
+  return creator.create();
+}
+
+DexMethodRef* method(const char* name) { return DexMethod::get_method(name); }
+
+// The index of the first action of the method with the given kind
+size_t find_action(PointsToSemantics& semantics,
+                   DexMethodRef* dex_method,
+                   PointsToOperationKind kind) {
+  const auto& actions =
+      (*semantics.get_method_semantics(dex_method))->get_points_to_actions();
+  for (size_t i = 0; i < actions.size(); ++i) {
+    if (actions[i].operation().kind == kind) {
+      return i;
+    }
+  }
+  return actions.size();
+}
+
+} // namespace
+
+TEST(PointsToSolverTest, virtualDispatchThroughStaticField) {
+  g_redex = new RedexContext();
+  Scope scope = create_empty_scope();
+  auto base = make_class("LBase;", get_object_type(), {R"(
+    (method (public) "LBase;.get:()Ljava/lang/String;"
+     (
+      (const-string "base")
+      (move-result-pseudo-object v0)
+      (return-object v0)
+     )
+    )
+  )"});
+  auto bar = make_class("LBar;", base->get_type(), {R"(
+    (method (public) "LBar;.get:()Ljava/lang/String;"
+     (
+      (const-string "bar")
+      (move-result-pseudo-object v0)
+      (return-object v0)
+     )
+    )
+  )"});
+  ClassCreator holder_creator(DexType::make_type("LHolder;"));
+  holder_creator.set_super(get_object_type());
+  auto field = static_cast<DexField*>(
+      DexField::make_field("LHolder;.instance:LBase;"));
+  field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+  holder_creator.add_field(field);
+  holder_creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LHolder;.run:()Ljava/lang/String;"
+     (
+      (new-instance "LBar;")
+      (move-result-pseudo-object v0)
+      (sput-object v0 "LHolder;.instance:LBase;")
+      (sget-object "LHolder;.instance:LBase;")
+      (move-result-pseudo-object v1)
+      (invoke-virtual (v1) "LBase;.get:()Ljava/lang/String;")
+      (move-result-object v2)
+      (return-object v2)
+     )
+    )
+  )"));
+  auto holder = holder_creator.create();
+  scope.push_back(base);
+  scope.push_back(bar);
+  scope.push_back(holder);
+
+  PointsToSemantics semantics(scope);
+  PointsToSolver solver(semantics);
+
+  auto run = method("LHolder;.run:()Ljava/lang/String;");
+  auto invoke = find_action(semantics, run, PTS_INVOKE_VIRTUAL);
+  EXPECT_EQ(solver.get_callees(run, invoke),
+            std::vector<DexMethodRef*>{
+                method("LBar;.get:()Ljava/lang/String;")});
+
+  auto ret = find_action(semantics, run, PTS_RETURN);
+  const auto& action =
+      (*semantics.get_method_semantics(run))->get_points_to_actions()[ret];
+  auto result = solver.get_points_to_set(run, action.src());
+  ASSERT_EQ(result.size(), 1);
+  EXPECT_EQ(result[0]->kind, PointsToObject::STRING);
+  EXPECT_EQ(result[0]->string, DexString::get_string("bar"));
+
+  // The receiver of LBar;.get is the object allocated in LHolder;.run.
+  auto receiver = solver.get_points_to_set(
+      method("LBar;.get:()Ljava/lang/String;"),
+      PointsToVariable::this_variable());
+  ASSERT_EQ(receiver.size(), 1);
+  EXPECT_EQ(receiver[0]->kind, PointsToObject::ALLOCATION);
+  EXPECT_EQ(receiver[0]->type, bar->get_type());
+  EXPECT_EQ(receiver[0]->method, run);
+
+  // No object dispatches to LBase;.get.
+  EXPECT_TRUE(solver
+                  .get_points_to_set(method("LBase;.get:()Ljava/lang/String;"),
+                                     PointsToVariable::this_variable())
+                  .empty());
+
+  delete g_redex;
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+
+#include "DexClass.h"
+#include "DexPosition.h"
+#include "RedexContext.h"
+#include "Show.h"
+
+namespace {
+
+std::vector<uint32_t> read_words(std::ifstream& ifs, size_t n) {
+  std::vector<uint32_t> words(n);
+  ifs.read((char*)words.data(), n * sizeof(uint32_t));
+  return words;
+}
+
+std::vector<std::string> read_string_pool(std::ifstream& ifs) {
+  std::vector<std::string> pool;
+  auto size = read_words(ifs, 1)[0];
+  for (uint32_t i = 0; i < size; ++i) {
+    std::string s(read_words(ifs, 1)[0], '\0');
+    ifs.read(&s[0], s.size());
+    pool.push_back(s);
+  }
+  return pool;
+}
+
+} // namespace
+
+TEST(PositionMapperTest, writesTheStringPoolAndThePositions) {
+  g_redex = new RedexContext();
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path("posmap-%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  auto v1 = (dir / "map_v1").string();
+  auto v2 = (dir / "map_v2").string();
+
+  auto make_method = [](const char* cls, const char* name) {
+    auto method = static_cast<DexMethod*>(
+        DexMethod::make_method(cls, name, "V", {}));
+    method->set_deobfuscated_name(show(method));
+    return method;
+  };
+  auto foo = make_method("Lcom/Foo;", "foo");
+  auto bar = make_method("Lcom/Bar;", "bar");
+  auto foo_java = DexString::make_string("Foo.java");
+  auto bar_java = DexString::make_string("Bar.java");
+
+  std::vector<std::unique_ptr<DexPosition>> positions;
+  auto make_position = [&](DexMethod* method, DexString* file,
+                           uint32_t line, DexPosition* parent) {
+    positions.push_back(std::make_unique<DexPosition>(line));
+    positions.back()->bind(method, file);
+    positions.back()->parent = parent;
+    return positions.back().get();
+  };
+  auto call = make_position(foo, foo_java, 10, nullptr);
+  auto inlined = make_position(bar, bar_java, 20, call);
+  auto unemitted = make_position(foo, foo_java, 11, nullptr);
+
+  RealPositionMapper mapper(v1, v2);
+  mapper.register_position(unemitted);
+  EXPECT_EQ(mapper.position_to_line(call), 1);
+  EXPECT_EQ(mapper.position_to_line(inlined), 2);
+  mapper.write_map();
+
+  {
+    std::ifstream ifs(v1, std::ios::binary);
+    EXPECT_EQ(read_words(ifs, 2), std::vector<uint32_t>({0xfaceb000, 1}));
+    EXPECT_EQ(read_string_pool(ifs),
+              std::vector<std::string>({"Foo.java", "Bar.java"}));
+    EXPECT_EQ(read_words(ifs, 1)[0], 3);
+    // The registered but unemitted position comes last.
+    EXPECT_EQ(read_words(ifs, 9),
+              std::vector<uint32_t>({0, 10, 0, 1, 20, 1, 0, 11, 0}));
+  }
+  {
+    std::ifstream ifs(v2, std::ios::binary);
+    EXPECT_EQ(read_words(ifs, 2), std::vector<uint32_t>({0xfaceb000, 2}));
+    EXPECT_EQ(read_string_pool(ifs),
+              std::vector<std::string>(
+                  {"com.Foo", "foo", "Foo.java", "com.Bar", "bar", "Bar.java"}));
+    EXPECT_EQ(read_words(ifs, 1)[0], 3);
+    EXPECT_EQ(read_words(ifs, 15),
+              std::vector<uint32_t>(
+                  {0, 1, 2, 10, 0, 3, 4, 5, 20, 1, 0, 1, 2, 11, 0}));
+    EXPECT_EQ(ifs.peek(), std::ifstream::traits_type::eof());
+  }
+
+  boost::filesystem::remove_all(dir);
+  delete g_redex;
+}
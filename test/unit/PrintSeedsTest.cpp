@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "PrintSeeds.h"
+#include "ProguardMap.h"
+#include "ProguardReporting.h"
+#include "ReachableClasses.h"
+#include "RedexContext.h"
+
+namespace {
+
+Scope make_classes(size_t count) {
+  Scope classes;
+  for (size_t i = 0; i < count; ++i) {
+    auto name = "Lcom/Foo" + std::to_string(i) + ";";
+    ClassCreator creator(DexType::make_type(name.c_str()));
+    creator.set_super(get_object_type());
+    auto field = static_cast<DexField*>(
+        DexField::make_field(creator.get_type(),
+                             DexString::make_string("f"),
+                             get_int_type()));
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+    field->set_deobfuscated_name(show(field));
+    creator.add_field(field);
+    auto cls = creator.create();
+    cls->set_deobfuscated_name(name);
+    if (i % 3 == 0) {
+      cls->rstate.set_keep();
+      field->rstate.set_keep();
+    }
+    classes.push_back(cls);
+  }
+  return classes;
+}
+
+} // namespace
+
+TEST(PrintSeedsTest, writesTheClassesInOrder) {
+  g_redex = new RedexContext();
+  // Enough classes for several windows of batches.
+  auto classes = make_classes(20000);
+  std::istringstream empty_map;
+  ProguardMap pg_map(empty_map);
+
+  std::ostringstream expected_classes;
+  std::ostringstream expected_seeds;
+  for (auto cls : classes) {
+    redex::print_class(expected_classes, pg_map, cls);
+    if (keep(cls)) {
+      auto name =
+          redex::dexdump_name_to_dot_name(cls->get_deobfuscated_name());
+      expected_seeds << name << "\n" << name << ": int f\n";
+    }
+  }
+
+  std::ostringstream actual_classes;
+  redex::print_classes(actual_classes, pg_map, classes);
+  EXPECT_EQ(actual_classes.str(), expected_classes.str());
+  std::ostringstream actual_seeds;
+  redex::print_seeds(actual_seeds, pg_map, classes);
+  EXPECT_EQ(actual_seeds.str(), expected_seeds.str());
+  delete g_redex;
+}
@@ -9,24 +9,23 @@
 
 #include <gtest/gtest.h>
 
-#include <istream>
+#include <string>
 #include <vector>
 
 #include "ProguardLexer.h"
 
 // Make sure we can parse an empty string
 TEST(ProguardLexerTest, empty) {
-  std::istringstream ss("");
-  std::vector<std::unique_ptr<redex::proguard_parser::Token>> tokens = redex::proguard_parser::lex(ss);
+  std::vector<redex::proguard_parser::Token> tokens = redex::proguard_parser::lex("");
   ASSERT_EQ(tokens.size(), 1);
-  ASSERT_EQ(tokens[0]->type, redex::proguard_parser::token::eof_token);
+  ASSERT_EQ(tokens[0].type, redex::proguard_parser::token::eof_token);
 }
 
 // Parse a few tokens.
 TEST(ProguardLexerTest, assortment) {
-  // The ss stream below should result in the vector of tokens in the expected variable
+  // The ss string below should result in the vector of tokens in the expected variable
   // that occurs below this. Please keep ss and expected in sync.
-  std::stringstream ss("{ } ( ) ; : ! , / class public final abstract interface\n"
+  std::string ss("{ } ( ) ; : ! , / class public final abstract interface\n"
                        "enum extends implements private protected static\n"
                        "volatile @ transient @interface synchronized native\n"
                        "strictfp synthetic bridge varargs wombat <init> <fields>\n"
@@ -137,11 +136,49 @@ TEST(ProguardLexerTest, assortment) {
          {21, redex::proguard_parser::token::semiColon},
          {22, redex::proguard_parser::token::eof_token},
   };
-  std::vector<std::unique_ptr<redex::proguard_parser::Token>> tokens = redex::proguard_parser::lex(ss);
+  std::vector<redex::proguard_parser::Token> tokens = redex::proguard_parser::lex(ss);
   ASSERT_EQ(tokens.size(), expected.size());
   for (auto i = 0; i < expected.size(); i++) {
     std::cerr << "Performing test " << i << std::endl;
-    ASSERT_EQ(expected[i].first, tokens[i]->line);
-    ASSERT_EQ(expected[i].second, tokens[i]->type);
+    ASSERT_EQ(expected[i].first, tokens[i].line);
+    ASSERT_EQ(expected[i].second, tokens[i].type);
   }
 }
+
+// Spellings are views of the lexed text.
+TEST(ProguardLexerTest, spellings) {
+  using namespace redex::proguard_parser;
+  std::string text(
+      "-injars \"a.jar\":b.jar # comment\n"
+      "-dontwarn com.foo.**,bar\n"
+      "-frobnicate\n"
+      "-keep class com.Foo");
+  std::vector<Token> tokens = lex(text);
+  std::vector<std::pair<token, std::string>> expected = {
+      {token::injars, ""},
+      {token::filepath, "a.jar"},
+      {token::filepath, "b.jar"},
+      {token::dontwarn, ""},
+      {token::filter_pattern, "com.foo.**"},
+      {token::filter_pattern, "bar"},
+      {token::command, "frobnicate"},
+      {token::keep, ""},
+      {token::classToken, ""},
+      {token::identifier, "com.Foo"},
+      {token::eof_token, ""},
+  };
+  ASSERT_EQ(tokens.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(tokens[i].type, expected[i].first);
+    EXPECT_EQ(tokens[i].str(), expected[i].second);
+    if (!tokens[i].data.empty()) {
+      EXPECT_GE(tokens[i].data.data(), text.data());
+      EXPECT_LE(tokens[i].data.data() + tokens[i].data.size(),
+                text.data() + text.size());
+    }
+  }
+  EXPECT_EQ(tokens[1].data, "\"a.jar\"");
+  EXPECT_EQ(tokens[6].show(), "-frobnicate");
+  EXPECT_TRUE(tokens[6].is_command());
+  EXPECT_EQ(tokens[10].line, 4);
+}
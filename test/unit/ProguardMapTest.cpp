@@ -7,8 +7,10 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <boost/filesystem.hpp>
 #include <gtest/gtest.h>
 
+#include <fstream>
 #include <sstream>
 
 #include "ProguardMap.h"
@@ -41,3 +43,33 @@ TEST(ProguardMapTest, empty) {
   EXPECT_EQ("Landroid/support/v4/app/Fragment;.x:(LA;LA;)LA;", pm.translate_method("Landroid/support/v4/app/Fragment;.stuff:(Lcom/foo/bar;Lcom/foo/bar;)Lcom/foo/bar;"));
   EXPECT_EQ("Lcom/instagram/react/IgNetworkingModule;.translateHeaders:([Lcom/instagram/common/j/a/f;)Lcom/facebook/react/bridge/e;", pm.translate_method("Lcom/instagram/react/IgNetworkingModule;.translateHeaders:([Lcom/instagram/common/api/base/Header;)Lcom/facebook/react/bridge/WritableMap;"));
 }
+
+TEST(ProguardMapTest, largeMapFromFile) {
+  // Large enough to be split over many parsing tasks.
+  const size_t n = 5000;
+  auto path = boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path("proguard_map_%%%%%%%%.txt");
+  {
+    std::ofstream out(path.string());
+    for (size_t i = 0; i < n; ++i) {
+      auto c = std::to_string(i);
+      out << "com.foo.C" << c << " -> X" << c << ":\n";
+      out << "    com.foo.C" << (i + 1) % n << " next -> a\n";
+      out << "    1:2:void run(com.foo.C" << c << ",int) -> b\n";
+    }
+  }
+  ProguardMap pm(path.string());
+  boost::filesystem::remove(path);
+
+  for (size_t i = 0; i < n; ++i) {
+    auto c = std::to_string(i);
+    auto next = std::to_string((i + 1) % n);
+    EXPECT_EQ("LX" + c + ";", pm.translate_class("Lcom/foo/C" + c + ";"));
+    EXPECT_EQ("Lcom/foo/C" + c + ";", pm.deobfuscate_class("LX" + c + ";"));
+    EXPECT_EQ("LX" + c + ";.a:LX" + next + ";",
+              pm.translate_field("Lcom/foo/C" + c + ";.next:Lcom/foo/C" +
+                                 next + ";"));
+    EXPECT_EQ("Lcom/foo/C" + c + ";.run:(Lcom/foo/C" + c + ";I)V",
+              pm.deobfuscate_method("LX" + c + ";.b:(LX" + c + ";I)V"));
+  }
+}
@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "ProguardCache.h"
+#include "ProguardMatcher.h"
+#include "ProguardParser.h"
+#include "RedexContext.h"
+
+DexClass* make_class(const std::string& name) {
+  ClassCreator creator(DexType::make_type(name.c_str()));
+  creator.set_super(get_object_type());
+  auto cls = creator.create();
+  cls->set_deobfuscated_name(name);
+  return cls;
+}
+
+TEST(ProguardMatcherTest, wildcardClassNames) {
+  g_redex = new RedexContext();
+  Scope scope;
+  for (const auto& name : {"Lcom/foo/A;",
+                           "Lcom/foo/B;",
+                           "Lcom/foo/bar/C;",
+                           "Lcom/foobar/D;",
+                           "Lcom/other/MyFragment;",
+                           "Lcom/other/MyView;",
+                           "LTopLevel;"}) {
+    scope.push_back(make_class(name));
+  }
+
+  redex::ProguardConfiguration pg_config;
+  std::istringstream config(
+      "-keep class com.foo.*\n"
+      "-keepnames class com.foo.bar.**\n"
+      "-keep class com.other.*Fragment\n"
+      "-keep class **View\n");
+  redex::proguard_parser::parse(config, &pg_config);
+  ASSERT_TRUE(pg_config.ok);
+  std::istringstream empty_map;
+  ProguardMap pg_map(empty_map);
+  redex::process_proguard_rules(pg_map, scope, Scope(), &pg_config);
+
+  auto kept = [&](const char* name) {
+    return type_class(DexType::get_type(name))->rstate.keep();
+  };
+  EXPECT_TRUE(kept("Lcom/foo/A;"));
+  EXPECT_TRUE(kept("Lcom/foo/B;"));
+  EXPECT_TRUE(kept("Lcom/foo/bar/C;"));
+  EXPECT_TRUE(
+      type_class(DexType::get_type("Lcom/foo/bar/C;"))->rstate.allowshrinking());
+  EXPECT_FALSE(kept("Lcom/foobar/D;"));
+  EXPECT_TRUE(kept("Lcom/other/MyFragment;"));
+  EXPECT_TRUE(kept("Lcom/other/MyView;"));
+  EXPECT_FALSE(kept("LTopLevel;"));
+
+  delete g_redex;
+}
+
+Scope make_cache_test_classes() {
+  Scope scope;
+  for (const auto& name : {"Lcom/foo/A;", "Lcom/foo/B;", "Lcom/bar/C;"}) {
+    scope.push_back(make_class(name));
+  }
+  return scope;
+}
+
+void parse_cache_test_config(redex::ProguardConfiguration* pg_config) {
+  std::istringstream config(
+      "-keep class com.foo.*\n"
+      "-keepnames class com.bar.*\n");
+  redex::proguard_parser::parse(config, pg_config);
+}
+
+TEST(ProguardMatcherTest, cachedResults) {
+  auto cache_dir =
+      boost::filesystem::temp_directory_path() /
+      boost::filesystem::unique_path("proguard_cache_test_%%%%%%%%");
+  std::istringstream empty_map;
+  ProguardMap pg_map(empty_map);
+
+  g_redex = new RedexContext();
+  auto scope = make_cache_test_classes();
+  redex::ProguardConfiguration pg_config;
+  parse_cache_test_config(&pg_config);
+  auto key = redex::proguard_cache_key(scope, Scope(), pg_config);
+  EXPECT_FALSE(redex::load_proguard_cache(
+      cache_dir.string(), key, scope, &pg_config));
+  redex::process_proguard_rules(
+      pg_map, scope, Scope(), &pg_config, cache_dir.string());
+  std::vector<std::string> states;
+  for (auto cls : scope) {
+    states.push_back(cls->rstate.str());
+  }
+  delete g_redex;
+
+  // The same classes and rules, in a fresh context.
+  g_redex = new RedexContext();
+  auto same_scope = make_cache_test_classes();
+  redex::ProguardConfiguration same_config;
+  parse_cache_test_config(&same_config);
+  EXPECT_EQ(key, redex::proguard_cache_key(same_scope, Scope(), same_config));
+  EXPECT_TRUE(redex::load_proguard_cache(
+      cache_dir.string(), key, same_scope, &same_config));
+  for (size_t i = 0; i < same_scope.size(); ++i) {
+    EXPECT_EQ(states[i], same_scope[i]->rstate.str());
+  }
+  EXPECT_TRUE(same_scope[0]->rstate.keep());
+  EXPECT_TRUE(same_scope[2]->rstate.allowshrinking());
+  EXPECT_EQ(2, same_config.keep_rules[0].count);
+  EXPECT_EQ(1, same_config.keep_rules[1].count);
+
+  // Any change to the classes changes the key.
+  same_scope[1]->set_access(same_scope[1]->get_access() | ACC_FINAL);
+  EXPECT_NE(key, redex::proguard_cache_key(same_scope, Scope(), same_config));
+  delete g_redex;
+
+  boost::filesystem::remove_all(cache_dir);
+}
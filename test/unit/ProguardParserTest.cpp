@@ -7,6 +7,8 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <gtest/gtest.h>
 
 #include <istream>
@@ -631,3 +633,31 @@ TEST(ProguardParserTest, keep_annotation_classes) {
     ASSERT_EQ(config.keep_rules[0].class_spec.setAccessFlags, ACC_ANNOTATION);
   }
 }
+
+// Files are mapped and parsed in place, includes and all.
+TEST(ProguardParserTest, parse_file) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path("pgparse-%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  auto main_file = (dir / "main.pro").string();
+  auto included = (dir / "included.pro").string();
+  auto empty = (dir / "empty.pro").string();
+  std::ofstream(main_file) << "-include " << included << "\n"
+                           << "-include " << empty << "\n"
+                           << "-keep class com.Foo { *; }\n";
+  std::ofstream(included) << "-dontwarn com.bar.**";
+  std::ofstream{empty};
+
+  ProguardConfiguration config;
+  proguard_parser::parse_file(main_file, &config);
+  EXPECT_TRUE(config.ok);
+  ASSERT_EQ(config.keep_rules.size(), 1);
+  EXPECT_EQ(config.keep_rules[0].class_spec.className, "com.Foo");
+  EXPECT_EQ(config.keep_rules[0].source_filename, main_file);
+  EXPECT_EQ(config.keep_rules[0].source_line, 3);
+  ASSERT_EQ(config.dontwarn.size(), 1);
+  EXPECT_EQ(config.dontwarn[0], "com.bar.**");
+  EXPECT_EQ(config.already_included.size(), 2);
+
+  boost::filesystem::remove_all(dir);
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "QuickData.h"
+
+TEST(QuickDataTest, binaryFormatFindsTheTextFormatsOffsets) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path("quickdata-%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  auto text = (dir / "quick.txt").string();
+  auto binary = (dir / "quick.bin").string();
+
+  QuickData quick_data;
+  quick_data.add_idx_offset("classes2.dex", 7, 700);
+  quick_data.add_idx_offset("classes.dex", 3, 30);
+  quick_data.add_idx_offset("classes.dex", 1, 10);
+  quick_data.add_idx_offset("classes.dex", 200, 2000);
+  FILE* fd = fopen(text.c_str(), "w");
+  quick_data.serialize(fd);
+  fclose(fd);
+
+  ASSERT_TRUE(convert_quick_data(text, binary));
+  MappedQuickData mapped(binary);
+  ASSERT_TRUE(mapped.is_valid());
+  EXPECT_EQ(mapped.dexes(),
+            std::vector<std::string>({"classes.dex", "classes2.dex"}));
+  for (const auto& dex_to_map : quick_data.dex_to_idx_to_offset) {
+    for (const auto& idx_to_offset : dex_to_map.second) {
+      uint32_t offset = 0;
+      EXPECT_TRUE(
+          mapped.get_offset(dex_to_map.first, idx_to_offset.first, &offset));
+      EXPECT_EQ(offset, idx_to_offset.second);
+    }
+  }
+  uint32_t offset = 0;
+  EXPECT_FALSE(mapped.get_offset("classes.dex", 2, &offset));
+  EXPECT_FALSE(mapped.get_offset("classes.dex", 201, &offset));
+  EXPECT_FALSE(mapped.get_offset("classes3.dex", 1, &offset));
+
+  // Text isn't taken for the binary format.
+  MappedQuickData not_binary(text);
+  EXPECT_FALSE(not_binary.is_valid());
+  EXPECT_FALSE(not_binary.get_offset("classes.dex", 1, &offset));
+
+  boost::filesystem::remove_all(dir);
+}
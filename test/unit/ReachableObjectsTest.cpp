@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "ReachableObjects.h"
+#include "RedexContext.h"
+#include "WorkQueue.h"
+
+/*
+ * Class Ci extends C(i/2) and has a field of type C((7i+3) % n), which is
+ * kept, so it's retained iff Ci is. Every fifth class is kept, as well as
+ * the fields of a few unreachable classes.
+ */
+std::vector<DexClass*> make_classes(size_t n) {
+  std::vector<DexType*> types;
+  for (size_t i = 0; i < n; ++i) {
+    types.push_back(DexType::make_type(
+        DexString::make_string("LC" + std::to_string(i) + ";")));
+  }
+  std::vector<DexClass*> classes;
+  for (size_t i = 0; i < n; ++i) {
+    ClassCreator creator(types[i]);
+    creator.set_super(i == 0 ? get_object_type() : types[i / 2]);
+    auto field = static_cast<DexField*>(
+        DexField::make_field(types[i],
+                             DexString::make_string("f"),
+                             types[(7 * i + 3) % n]));
+    field->make_concrete(ACC_PUBLIC);
+    field->rstate.set_keep();
+    creator.add_field(field);
+    auto cls = creator.create();
+    if (i % 5 == 0) {
+      cls->rstate.set_keep();
+    }
+    classes.push_back(cls);
+  }
+  return classes;
+}
+
+ReachableObjects compute(DexStoresVector& stores) {
+  return compute_reachable_objects(stores, {}, {}, {}, nullptr, true);
+}
+
+TEST(ReachableObjectsTest, parallelMarkingAgreesWithSequential) {
+  g_redex = new RedexContext();
+  const size_t n = 400;
+  auto classes = make_classes(n);
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes(classes);
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+
+  set_num_threads_override(1);
+  auto sequential = compute(stores);
+  set_num_threads_override(8);
+  auto parallel = compute(stores);
+  set_num_threads_override(0);
+
+  EXPECT_EQ(sequential.marked_classes, parallel.marked_classes);
+  EXPECT_EQ(sequential.marked_fields, parallel.marked_fields);
+  EXPECT_EQ(sequential.marked_methods, parallel.marked_methods);
+
+  for (size_t i = 0; i < n; ++i) {
+    auto cls = classes[i];
+    auto field = cls->get_ifields()[0];
+    bool reachable = parallel.marked_classes.count(cls) > 0;
+    if (i % 5 == 0) {
+      EXPECT_TRUE(reachable);
+    }
+    if (reachable) {
+      // Its super and the type of its field are retained too.
+      EXPECT_TRUE(i == 0 || parallel.marked_classes.count(classes[i / 2]));
+      EXPECT_TRUE(parallel.marked_classes.count(classes[(7 * i + 3) % n]));
+    }
+    // Kept members are only retained along with their class.
+    EXPECT_EQ(reachable, parallel.marked_fields.count(field) > 0);
+    EXPECT_EQ(reachable,
+              parallel.retainers_of.contains(reachable_objects::ReachableObject(
+                  static_cast<const DexClass*>(cls))));
+  }
+  EXPECT_LT(parallel.marked_classes.size(), n);
+
+  delete g_redex;
+}
+
+TEST(ReachableObjectsTest, retainerGraph) {
+  using namespace reachable_objects;
+  g_redex = new RedexContext();
+  auto classes = make_classes(4);
+  ReachableObject seed;
+  ReachableObject c0(static_cast<const DexClass*>(classes[0]));
+  ReachableObject c1(static_cast<const DexClass*>(classes[1]));
+  ReachableObject c2(static_cast<const DexClass*>(classes[2]));
+  ReachableObject f0(
+      static_cast<const DexFieldRef*>(classes[0]->get_ifields()[0]));
+
+  // The same edge may be found by several workers.
+  std::vector<ReachableObjectEdges> edges(3);
+  edges[0] = {{c0, seed}, {f0, c0}};
+  edges[1] = {{c1, c0}, {c2, c1}, {c2, f0}};
+  edges[2] = {{c1, c0}, {c2, c1}};
+  ReachableObjectGraph graph(std::move(edges));
+
+  EXPECT_EQ(5, graph.num_objects());
+  EXPECT_EQ(5, graph.num_edges());
+  EXPECT_TRUE(graph.contains(c0));
+  EXPECT_FALSE(graph.contains(seed));
+  EXPECT_FALSE(graph.contains(
+      ReachableObject(static_cast<const DexClass*>(classes[3]))));
+
+  auto retainers = graph.retainers(c1);
+  ASSERT_EQ(1, retainers.size());
+  EXPECT_EQ(ReachableObjectType::CLASS, retainers[0].type);
+  EXPECT_EQ(classes[0], retainers[0].cls);
+  EXPECT_EQ(2, graph.retainers(c2).size());
+  EXPECT_EQ(ReachableObjectType::SEED, graph.retainers(c0)[0].type);
+  EXPECT_TRUE(graph.retainers(seed).empty());
+
+  delete g_redex;
+}
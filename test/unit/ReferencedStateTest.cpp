@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ReferencedState.h"
+#include "WorkQueue.h"
+
+TEST(ReferencedStateTest, keepModifiers) {
+  ReferencedState state;
+  EXPECT_TRUE(state.can_delete());
+  EXPECT_TRUE(state.can_rename());
+
+  state.set_keep();
+  state.set_allowshrinking();
+  EXPECT_TRUE(state.keep());
+  EXPECT_TRUE(state.allowshrinking());
+  EXPECT_TRUE(state.can_delete());
+
+  // The unset has a higher priority, whatever the order.
+  state.unset_allowshrinking();
+  state.set_allowshrinking();
+  EXPECT_FALSE(state.allowshrinking());
+  EXPECT_FALSE(state.can_delete());
+  EXPECT_FALSE(state.can_rename());
+
+  state.set_allowobfuscation();
+  EXPECT_TRUE(state.can_rename());
+  state.set_keep_name();
+  EXPECT_FALSE(state.can_rename());
+
+  ReferencedState copy;
+  copy = state;
+  EXPECT_EQ(state.str(), copy.str());
+}
+
+TEST(ReferencedStateTest, clearIfCompute) {
+  ReferencedState computed;
+  computed.ref_by_string(/* from_code */ true);
+  EXPECT_TRUE(computed.is_referenced_by_string());
+  EXPECT_TRUE(computed.is_referenced_by_type());
+  computed.clear_if_compute();
+  EXPECT_FALSE(computed.is_referenced_by_string());
+  EXPECT_FALSE(computed.is_referenced_by_type());
+
+  ReferencedState permanent;
+  permanent.ref_by_string(/* from_code */ true);
+  permanent.ref_by_string(/* from_code */ false);
+  permanent.clear_if_compute();
+  EXPECT_TRUE(permanent.is_referenced_by_string());
+  EXPECT_FALSE(permanent.can_delete());
+}
+
+TEST(ReferencedStateTest, concurrentUpdates) {
+  const size_t n = 1000;
+  std::vector<ReferencedState> states(n);
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto& state = states[i / 4];
+    switch (i % 4) {
+    case 0:
+      state.set_keep();
+      break;
+    case 1:
+      state.set_allowobfuscation();
+      break;
+    case 2:
+      state.ref_by_type();
+      break;
+    case 3:
+      state.increment_keep_count();
+      state.set_blanket_keepnames();
+      break;
+    }
+  }, 8);
+  for (size_t i = 0; i < 4 * n; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  for (const auto& state : states) {
+    EXPECT_TRUE(state.keep());
+    EXPECT_TRUE(state.allowobfuscation());
+    EXPECT_TRUE(state.is_referenced_by_type());
+    EXPECT_TRUE(state.is_blanket_names_kept());
+  }
+}
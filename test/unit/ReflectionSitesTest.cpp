@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "SimpleReflectionAnalysis.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexContext.h"
+#include "ScopeHelper.h"
+
+using namespace sra;
+
+namespace {
+
+DexMethod* method(const char* name) {
+  return static_cast<DexMethod*>(DexMethod::get_method(name));
+}
+
+struct ReflectionSitesTest : public testing::Test {
+  Scope scope;
+
+  ReflectionSitesTest() {
+    g_redex = new RedexContext();
+    scope = create_empty_scope();
+    ClassCreator creator(DexType::make_type("LFoo;"));
+    creator.set_super(get_object_type());
+    creator.add_method(assembler::method_from_string(R"(
+      (method (public static) "LFoo;.reflect:()V"
+       (
+        (const-class "LFoo;")
+        (move-result-pseudo-object v0)
+        (const-string "bar")
+        (move-result-pseudo-object v1)
+        (invoke-virtual (v0 v1) "Ljava/lang/Class;.getField:(Ljava/lang/String;)Ljava/lang/reflect/Field;")
+        (return-void)
+       )
+      )
+    )"));
+    creator.add_method(assembler::method_from_string(R"(
+      (method (public static) "LFoo;.plain:()V"
+       (
+        (const-class "LFoo;")
+        (move-result-pseudo-object v0)
+        (invoke-virtual (v0) "Ljava/lang/Class;.getName:()Ljava/lang/String;")
+        (return-void)
+       )
+      )
+    )"));
+    scope.push_back(creator.create());
+  }
+
+  ~ReflectionSitesTest() {
+    SimpleReflectionAnalysis::clear_cache();
+    delete g_redex;
+  }
+};
+
+} // namespace
+
+TEST_F(ReflectionSitesTest, findsOnlyTheInvokesOfTheApis) {
+  auto sites = find_reflection_sites(
+      scope,
+      {{"Ljava/lang/Class;", "getField"},
+       {"Ljava/lang/Class;", "getMethod"},
+       {"Ljava/lang/Undefined;", "getField"}});
+  ASSERT_EQ(sites.size(), 1);
+  auto reflect = method("LFoo;.reflect:()V");
+  ASSERT_EQ(sites.count(reflect), 1);
+  ASSERT_EQ(sites.at(reflect).size(), 1);
+  auto insn = sites.at(reflect)[0];
+  EXPECT_EQ(insn->get_method()->get_name()->str(), "getField");
+
+  auto analysis = SimpleReflectionAnalysis::get_cached(reflect);
+  auto cls = analysis->get_abstract_object(insn->src(0), insn);
+  ASSERT_TRUE(cls);
+  EXPECT_EQ(*cls, AbstractObject(CLASS, DexType::get_type("LFoo;")));
+  auto name = analysis->get_abstract_object(insn->src(1), insn);
+  ASSERT_TRUE(name);
+  EXPECT_EQ(*name, AbstractObject(DexString::get_string("bar")));
+
+  EXPECT_TRUE(find_reflection_sites(scope, {}).empty());
+}
+
+TEST_F(ReflectionSitesTest, cachedAnalysisFollowsTheCode) {
+  auto reflect = method("LFoo;.reflect:()V");
+  auto analysis = SimpleReflectionAnalysis::get_cached(reflect);
+  EXPECT_EQ(SimpleReflectionAnalysis::get_cached(reflect), analysis);
+
+  auto code = reflect->get_code();
+  code->push_back(new IRInstruction(OPCODE_RETURN_VOID));
+  auto updated = SimpleReflectionAnalysis::get_cached(reflect);
+  EXPECT_NE(updated, analysis);
+  EXPECT_EQ(SimpleReflectionAnalysis::get_cached(reflect), updated);
+
+  // Replaced code gets analyzed anew too.
+  reflect->set_code(std::make_unique<IRCode>(*code));
+  EXPECT_NE(SimpleReflectionAnalysis::get_cached(reflect), updated);
+}
@@ -18,6 +18,7 @@
 #include "IRCode.h"
 #include "IRInstruction.h"
 #include "Interference.h"
+#include "LinearScan.h"
 #include "LiveRange.h"
 #include "Liveness.h"
 #include "OpcodeList.h"
@@ -848,3 +849,330 @@ TEST_F(RegAllocTest, ParamFirstUse) {
   EXPECT_EQ(assembler::to_s_expr(code.get()),
             assembler::to_s_expr(expected_code.get()));
 }
+
+namespace {
+
+void expect_same_graph(const interference::Graph& expected,
+                       const interference::Graph& actual,
+                       const IRCode* code) {
+  ASSERT_EQ(expected.nodes().size(), actual.nodes().size());
+  for (auto& pair : expected.nodes()) {
+    auto reg = pair.first;
+    auto& node = pair.second;
+    ASSERT_EQ(actual.nodes().count(reg), 1) << "v" << reg;
+    auto& other = actual.get_node(reg);
+    EXPECT_EQ(node.weight(), other.weight()) << "v" << reg;
+    EXPECT_EQ(node.max_vreg(), other.max_vreg()) << "v" << reg;
+    EXPECT_EQ(node.spill_cost(), other.spill_cost()) << "v" << reg;
+    EXPECT_EQ(node.width(), other.width()) << "v" << reg;
+    EXPECT_EQ(node.type(), other.type()) << "v" << reg;
+    EXPECT_EQ(node.is_param(), other.is_param()) << "v" << reg;
+    EXPECT_EQ(node.is_range(), other.is_range()) << "v" << reg;
+    EXPECT_EQ(node.is_spilt(), other.is_spilt()) << "v" << reg;
+    EXPECT_THAT(other.adjacent(),
+                ::testing::UnorderedElementsAreArray(node.adjacent()))
+        << "v" << reg;
+    for (auto& pair2 : expected.nodes()) {
+      auto reg2 = pair2.first;
+      EXPECT_EQ(expected.is_adjacent(reg, reg2),
+                actual.is_adjacent(reg, reg2));
+      EXPECT_EQ(expected.is_coalesceable(reg, reg2),
+                actual.is_coalesceable(reg, reg2));
+      EXPECT_EQ(expected.has_containment_edge(reg, reg2),
+                actual.has_containment_edge(reg, reg2));
+    }
+  }
+  for (const auto& mie : InstructionIterable(code)) {
+    if (opcode::has_range_form(mie.insn->opcode())) {
+      EXPECT_TRUE(expected.get_liveness(mie.insn).equals(
+          actual.get_liveness(mie.insn)));
+    }
+  }
+}
+
+/*
+ * Run the liveness analysis on the current code and check that updating the
+ * previous graph gives the same graph as building it from scratch.
+ */
+interference::Graph check_incremental_build(
+    interference::IncrementalGraphBuilder* builder,
+    IRCode* code,
+    reg_t initial_regs,
+    const RangeSet& range_set) {
+  code->build_cfg();
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  LivenessFixpointIterator fixpoint_iter(cfg);
+  fixpoint_iter.run(LivenessDomain(code->get_registers_size()));
+  auto ig = builder->build(fixpoint_iter, code, initial_regs, range_set);
+  auto expected =
+      interference::build_graph(fixpoint_iter, code, initial_regs, range_set);
+  expect_same_graph(expected, ig, code);
+  return ig;
+}
+
+} // namespace
+
+TEST_F(RegAllocTest, IncrementalGraphAfterSpill) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param-object v3)
+     (iget v3 "LFoo;.a:I")
+     (move-result-pseudo v0)
+     (iget v3 "LFoo;.b:I")
+     (move-result-pseudo v1)
+     (add-int v2 v0 v1)
+     (invoke-static (v0 v1 v2 v3) "LFoo;.bar:(IIILFoo;)V")
+     (return v2)
+    )
+)");
+  code->set_registers_size(4);
+  auto initial_regs = code->get_registers_size();
+  RangeSet range_set;
+  interference::IncrementalGraphBuilder builder;
+  auto ig = check_incremental_build(&builder, code.get(), initial_regs,
+                                    range_set);
+
+  graph_coloring::SpillPlan spill_plan;
+  spill_plan.global_spills = std::unordered_map<reg_t, reg_t>{
+      {0, 16},
+      {2, 256},
+  };
+  std::unordered_set<reg_t> new_temps;
+  graph_coloring::Allocator allocator;
+  allocator.spill(ig, spill_plan, range_set, code.get(), &new_temps);
+  ig = check_incremental_build(&builder, code.get(), initial_regs, range_set);
+
+  // Promoting the invoke to the range form changes the constraints of its
+  // srcs, even though the instruction is unchanged.
+  for (const auto& mie : InstructionIterable(code.get())) {
+    if (is_invoke(mie.insn->opcode())) {
+      range_set.emplace(mie.insn);
+    }
+  }
+  check_incremental_build(&builder, code.get(), initial_regs, range_set);
+}
+
+TEST_F(RegAllocTest, IncrementalGraphAfterSplit) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 1)
+     (const v1 1)
+     (move v2 v1)
+     (move v4 v1)
+     (move v3 v0)
+     (return v3)
+    )
+)");
+  code->set_registers_size(5);
+  auto initial_regs = code->get_registers_size();
+  RangeSet range_set;
+  interference::IncrementalGraphBuilder builder;
+  auto ig = check_incremental_build(&builder, code.get(), initial_regs,
+                                    range_set);
+  EXPECT_TRUE(ig.is_adjacent(0, 1));
+
+  code->build_cfg();
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  LivenessFixpointIterator fixpoint_iter(cfg);
+  fixpoint_iter.run(LivenessDomain(code->get_registers_size()));
+  SplitCosts split_costs;
+  SplitPlan split_plan;
+  split_plan.split_around =
+      std::unordered_map<reg_t, std::unordered_set<reg_t>>{
+          {1, std::unordered_set<reg_t>{0}}};
+  split(fixpoint_iter, split_plan, split_costs, ig, code.get());
+
+  ig = check_incremental_build(&builder, code.get(), initial_regs, range_set);
+  // v0 is no longer live across the live range of v1.
+  EXPECT_FALSE(ig.is_adjacent(0, 1));
+}
+
+TEST_F(RegAllocTest, LinearScan) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param v3)
+     (const v0 1)
+     (const v1 2)
+     (add-int v2 v0 v1)
+     (add-int v2 v2 v3)
+     (return v2)
+    )
+)");
+  code->set_registers_size(4);
+  code->build_cfg();
+  linear_scan::Allocator allocator;
+  EXPECT_TRUE(allocator.allocate(code.get()));
+
+  // The dest of an instruction can take the vreg of a src that dies there,
+  // and the params go at the end of the frame.
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (load-param v2)
+     (const v0 1)
+     (const v1 2)
+     (add-int v0 v0 v1)
+     (add-int v0 v0 v2)
+     (return v0)
+    )
+)");
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected_code.get()));
+  EXPECT_EQ(code->get_registers_size(), 3);
+  EXPECT_EQ(allocator.get_stats().moves_inserted(), 0);
+}
+
+TEST_F(RegAllocTest, LinearScanScratch) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (const v1 1)
+     (const v2 2)
+     (const v3 3)
+     (const v4 4)
+     (const v5 5)
+     (const v6 6)
+     (const v7 7)
+     (const v8 8)
+     (const v9 9)
+     (const v10 10)
+     (const v11 11)
+     (const v12 12)
+     (const v13 13)
+     (const v14 14)
+     (const v15 15)
+     (const v16 16)
+     (neg-int v17 v16)
+     (invoke-static (v0 v1 v2 v3 v4 v5 v6 v7 v8 v9 v10 v11 v12 v13 v14 v15 v16) "LFoo;.bar:(IIIIIIIIIIIIIIIII)V")
+     (return v17)
+    )
+)");
+  code->set_registers_size(18);
+  code->build_cfg();
+  linear_scan::Allocator allocator;
+  EXPECT_TRUE(allocator.allocate(code.get()));
+
+  // neg-int can only address 4-bit registers, so its operands go through
+  // the scratch vregs at the start of the frame. The srcs of the range
+  // invoke are already contiguous.
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (const v2 0)
+     (const v3 1)
+     (const v4 2)
+     (const v5 3)
+     (const v6 4)
+     (const v7 5)
+     (const v8 6)
+     (const v9 7)
+     (const v10 8)
+     (const v11 9)
+     (const v12 10)
+     (const v13 11)
+     (const v14 12)
+     (const v15 13)
+     (const v16 14)
+     (const v17 15)
+     (const v18 16)
+     (move v0 v18)
+     (neg-int v1 v0)
+     (move v19 v1)
+     (invoke-static (v2 v3 v4 v5 v6 v7 v8 v9 v10 v11 v12 v13 v14 v15 v16 v17 v18) "LFoo;.bar:(IIIIIIIIIIIIIIIII)V")
+     (return v19)
+    )
+)");
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected_code.get()));
+  EXPECT_EQ(code->get_registers_size(), 20);
+  EXPECT_EQ(allocator.get_stats().scratch_moves, 2);
+}
+
+TEST_F(RegAllocTest, LinearScanRange) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 1)
+     (const v1 2)
+     (const v2 3)
+     (const v3 4)
+     (const v4 5)
+     (invoke-static (v0 v1 v2 v3 v4 v0) "LFoo;.bar:(IIIIII)V")
+     (return-void)
+    )
+)");
+  code->set_registers_size(5);
+  code->build_cfg();
+  linear_scan::Allocator allocator;
+  EXPECT_TRUE(allocator.allocate(code.get()));
+
+  // v0 occurs twice, so the srcs are copied to the range area.
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (const v0 1)
+     (const v1 2)
+     (const v2 3)
+     (const v3 4)
+     (const v4 5)
+     (move v5 v0)
+     (move v6 v1)
+     (move v7 v2)
+     (move v8 v3)
+     (move v9 v4)
+     (move v10 v0)
+     (invoke-static (v5 v6 v7 v8 v9 v10) "LFoo;.bar:(IIIIII)V")
+     (return-void)
+    )
+)");
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected_code.get()));
+  EXPECT_EQ(code->get_registers_size(), 11);
+  EXPECT_EQ(allocator.get_stats().range_moves, 6);
+}
+
+TEST_F(RegAllocTest, LinearScanSplitParam) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param v17)
+     (const v0 0)
+     (const v1 1)
+     (const v2 2)
+     (const v3 3)
+     (const v4 4)
+     (const v5 5)
+     (const v6 6)
+     (const v7 7)
+     (const v8 8)
+     (const v9 9)
+     (const v10 10)
+     (const v11 11)
+     (const v12 12)
+     (const v13 13)
+     (const v14 14)
+     (const v15 15)
+     (const v16 16)
+     (neg-int v18 v17)
+     (neg-int v19 v17)
+     (add-int v18 v18 v19)
+     (invoke-static (v0 v1 v2 v3 v4 v5 v6 v7 v8 v9 v10 v11 v12 v13 v14 v15 v16) "LFoo;.bar:(IIIIIIIIIIIIIIIII)V")
+     (return v18)
+    )
+)");
+  code->set_registers_size(20);
+  code->build_cfg();
+  linear_scan::Allocator allocator;
+  EXPECT_TRUE(allocator.allocate(code.get()));
+
+  // The param would go through a scratch vreg at both neg-ints, so it gets
+  // copied to an interval first.
+  EXPECT_EQ(allocator.get_stats().param_moves, 1);
+  for (const auto& mie : InstructionIterable(code.get())) {
+    auto insn = mie.insn;
+    if (insn->opcode() == OPCODE_NEG_INT) {
+      EXPECT_LE(insn->src(0), 15);
+      EXPECT_LE(insn->dest(), 15);
+    }
+  }
+  auto param_insns = InstructionIterable(code->get_param_instructions());
+  EXPECT_EQ(param_insns.begin()->insn->dest(),
+            code->get_registers_size() - 1);
+}
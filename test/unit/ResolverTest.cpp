@@ -7,7 +7,10 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <atomic>
 #include <memory>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include "DexClass.h"
@@ -212,3 +215,46 @@ TEST(ResolveField, empty) {
 
   delete g_redex;
 }
+
+TEST(ResolveField, sharedCache) {
+  g_redex = new RedexContext();
+  create_scope();
+
+  auto fdef = DexField::get_field(DexType::get_type("B"),
+      DexString::get_string("f2"), DexType::get_type("Ljava/lang/String;"));
+  auto fref = make_field_ref(
+      DexType::get_type("C"), "f2", DexType::get_type("Ljava/lang/String;"));
+  EXPECT_FALSE(fref->is_def());
+
+  std::vector<std::thread> threads;
+  std::atomic<size_t> mismatches{0};
+  for (size_t i = 0; i < 8; ++i) {
+    threads.emplace_back([&]() {
+      for (size_t j = 0; j < 100; ++j) {
+        if (resolve_field_cached(fref) != fdef ||
+            resolve_field_cached(fref, FieldSearch::Instance) != nullptr) {
+          ++mismatches;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0, mismatches);
+
+  // The resolution is stale until the cache is invalidated.
+  auto cls_B = type_class(DexType::get_type("B"));
+  cls_B->remove_field(static_cast<DexField*>(fdef));
+  EXPECT_TRUE(resolve_field(fref) == nullptr);
+  EXPECT_EQ(fdef, resolve_field_cached(fref));
+  auto epoch = resolution_epoch();
+  invalidate_resolution_caches();
+  EXPECT_LT(epoch, resolution_epoch());
+  EXPECT_TRUE(resolve_field_cached(fref) == nullptr);
+  cls_B->add_field(static_cast<DexField*>(fdef));
+  invalidate_resolution_caches();
+  EXPECT_EQ(fdef, resolve_field_cached(fref));
+
+  delete g_redex;
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "RedexResources.h"
+
+namespace fs = boost::filesystem;
+
+TEST(ResourceScanCacheTest, nativeClassesAreCachedByFingerprint) {
+  auto apk_dir = fs::temp_directory_path() /
+                 fs::unique_path("resource_scan_cache_%%%%%%%%");
+  fs::create_directories(apk_dir / "lib" / "x86");
+  auto lib = (apk_dir / "lib" / "x86" / "libfoo.so").string();
+  auto cache_file = (apk_dir / "scan.cache").string();
+  write_entire_file(lib, std::string("\0Lcom/foo/Bar;\0", 15));
+
+  {
+    ResourceScanCache cache(cache_file);
+    const auto& classes = cache.get_native_classes(apk_dir.string());
+    EXPECT_EQ(1, classes.count("Lcom/foo/Bar;"));
+    // The same set is handed out again.
+    EXPECT_EQ(&classes, &cache.get_native_classes(apk_dir.string()));
+  }
+
+  // Doctor the saved result to tell a reused entry from a rescan.
+  auto saved = read_entire_file(cache_file);
+  boost::replace_all(saved, "Lcom/foo/Bar;", "Lcom/foo/Cached;");
+  write_entire_file(cache_file, saved);
+  {
+    ResourceScanCache cache(cache_file);
+    EXPECT_EQ(1,
+              cache.get_native_classes(apk_dir.string())
+                  .count("Lcom/foo/Cached;"));
+  }
+
+  // Changing the library invalidates the entry.
+  write_entire_file(lib, std::string("\0Lcom/foo/Bazz;\0", 16));
+  {
+    ResourceScanCache cache(cache_file);
+    const auto& classes = cache.get_native_classes(apk_dir.string());
+    EXPECT_EQ(1, classes.count("Lcom/foo/Bazz;"));
+    EXPECT_EQ(0, classes.count("Lcom/foo/Cached;"));
+  }
+
+  fs::remove_all(apk_dir);
+}
@@ -8,9 +8,11 @@
  */
 
 #include <array>
+#include <boost/filesystem.hpp>
 #include <gtest/gtest.h>
 
 #include "Debug.h"
+#include "RedexContext.h"
 #include "RedexResources.h"
 #include "androidfw/ResourceTypes.h"
 
@@ -193,6 +195,62 @@ TEST(ResStringPool, ReplaceStringsInXmlLayout) {
   unmap_and_close(file_descriptor, fp, length);
 }
 
+TEST(ResXMLTree, RemapReferenceAttributesInPlace) {
+  auto path = boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path("layout_%%%%%%%%.xml");
+  boost::filesystem::copy_file(std::getenv("test_layout_path"), path);
+  auto refs = get_xml_reference_attributes(path.string());
+  ASSERT_FALSE(refs.empty());
+  auto old_id = *refs.begin();
+  auto new_id = old_id + 0x100;
+  ASSERT_EQ(0, refs.count(new_id));
+
+  remap_xml_reference_attributes(path.string(), {{old_id, new_id}});
+
+  auto remapped = get_xml_reference_attributes(path.string());
+  EXPECT_EQ(refs.size(), remapped.size());
+  EXPECT_EQ(0, remapped.count(old_id));
+  EXPECT_EQ(1, remapped.count(new_id));
+  boost::filesystem::remove(path);
+}
+
+TEST(ResXMLTree, RemapReferenceAttributesInParallel) {
+  std::vector<std::string> paths;
+  for (int i = 0; i < 4; i++) {
+    auto path = boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path("layout_%%%%%%%%.xml");
+    boost::filesystem::copy_file(std::getenv("test_layout_path"), path);
+    paths.push_back(path.string());
+  }
+  auto refs = get_xml_reference_attributes(paths[0]);
+  ASSERT_FALSE(refs.empty());
+  auto old_id = *refs.begin();
+  auto new_id = old_id + 0x100;
+
+  remap_xml_reference_attributes(paths, {{old_id, new_id}});
+  for (const auto& path : paths) {
+    auto remapped = get_xml_reference_attributes(path);
+    EXPECT_EQ(0, remapped.count(old_id));
+    EXPECT_EQ(1, remapped.count(new_id));
+  }
+
+  // The files that can be read are still processed when others can't, and
+  // every failure is reported.
+  auto files = paths;
+  files.push_back(paths[0] + ".missing");
+  files.push_back(paths[1] + ".missing");
+  try {
+    remap_xml_reference_attributes(files, {{new_id, old_id}});
+    FAIL() << "Expected the missing files to be reported";
+  } catch (const aggregate_exception& ae) {
+    EXPECT_EQ(2, ae.m_exceptions.size());
+  }
+  for (const auto& path : paths) {
+    EXPECT_EQ(1, get_xml_reference_attributes(path).count(old_id));
+    boost::filesystem::remove(path);
+  }
+}
+
 void assert_serialized_data(void* original, size_t length, android::Vector<char>& serialized) {
   ASSERT_EQ(length, serialized.size());
   for (size_t i = 0; i < length; i++) {
@@ -288,3 +346,44 @@ TEST(ResTable, AppendNewType) {
 
   unmap_and_close(file_descriptor, fp, length);
 }
+
+TEST(ResTable, ResourceTableIndex) {
+  size_t length;
+  int file_descriptor;
+  auto fp = map_file(std::getenv("test_arsc_path"), file_descriptor, length);
+  android::ResTable table;
+  ASSERT_EQ(table.add(fp, length), 0);
+
+  ResourceTableIndex index(table);
+  android::SortedVector<uint32_t> ids;
+  table.getResourceIds(&ids);
+  ASSERT_EQ(ids.size(), index.ids().size());
+  ASSERT_FALSE(index.ids().empty());
+  for (size_t i = 0; i < ids.size(); i++) {
+    EXPECT_EQ(ids[i], index.ids()[i]);
+    android::ResTable::resource_name name;
+    ASSERT_TRUE(table.getResourceName(ids[i], true, &name));
+    auto indexed_name = index.get_name(ids[i]);
+    ASSERT_NE(nullptr, indexed_name);
+    EXPECT_EQ(std::string(name.name8, name.nameLen), *indexed_name);
+    auto& named = index.get_ids(*indexed_name);
+    EXPECT_NE(named.end(), std::find(named.begin(), named.end(), ids[i]));
+  }
+  EXPECT_EQ(nullptr, index.get_name(0x7f7f7f7f));
+  EXPECT_TRUE(index.get_ids("no_such_resource").empty());
+
+  // The prefix lookup agrees with matching every name against every prefix.
+  const auto& first_name = *index.get_name(index.ids()[0]);
+  std::vector<std::string> prefixes{first_name.substr(0, 1), "", "zzz"};
+  std::unordered_set<uint32_t> expected;
+  for (auto id : index.ids()) {
+    if (index.get_name(id)->compare(0, 1, prefixes[0]) == 0) {
+      expected.insert(id);
+    }
+  }
+  EXPECT_EQ(expected, index.get_ids_by_name_prefix({prefixes[0]}));
+  EXPECT_EQ(index.ids().size(), index.get_ids_by_name_prefix(prefixes).size());
+  EXPECT_TRUE(index.get_ids_by_name_prefix({"zzz"}).empty());
+
+  unmap_and_close(file_descriptor, fp, length);
+}
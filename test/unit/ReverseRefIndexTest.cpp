@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ReverseRefIndex.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexContext.h"
+
+TEST(ReverseRefIndexTest, indexesAndUpdatesRefs) {
+  g_redex = new RedexContext();
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  auto bar = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+     (
+      (sget "LFoo;.x:I")
+      (move-result-pseudo v0)
+      (sput v0 "LFoo;.x:I")
+      (invoke-static () "LFoo;.baz:()V")
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v1)
+      (return-void)
+     )
+    )
+  )");
+  auto baz = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.baz:()V"
+     (
+      (invoke-static () "LFoo;.baz:()V")
+      (return-void)
+     )
+    )
+  )");
+  creator.add_method(bar);
+  creator.add_method(baz);
+  Scope scope{creator.create()};
+
+  ReverseRefIndex index(scope);
+  auto x = DexField::get_field("LFoo;.x:I");
+  const auto& x_refs = index.field_refs(x);
+  ASSERT_EQ(x_refs.size(), 2);
+  EXPECT_EQ(x_refs[0].method, bar);
+  EXPECT_EQ(x_refs[0].insn->opcode(), OPCODE_SGET);
+  EXPECT_EQ(x_refs[1].insn->opcode(), OPCODE_SPUT);
+
+  const auto& baz_refs = index.method_refs(baz);
+  ASSERT_EQ(baz_refs.size(), 2);
+  EXPECT_EQ(baz_refs[0].method, bar);
+  EXPECT_EQ(baz_refs[1].method, baz);
+
+  ASSERT_EQ(index.type_refs(DexType::get_type("LFoo;")).size(), 1);
+  EXPECT_TRUE(index.method_refs(bar).empty());
+  EXPECT_EQ(index.all_method_refs().size(), 1);
+
+  // Drop the invoke and the field refs of bar.
+  auto code = bar->get_code();
+  for (auto it = code->begin(); it != code->end();) {
+    if (it->type == MFLOW_OPCODE &&
+        (it->insn->has_method() || it->insn->has_field())) {
+      it = code->erase_and_dispose(it);
+    } else {
+      ++it;
+    }
+  }
+  index.update(bar);
+  EXPECT_TRUE(index.field_refs(x).empty());
+  EXPECT_EQ(index.all_field_refs().size(), 0);
+  ASSERT_EQ(index.method_refs(baz).size(), 1);
+  EXPECT_EQ(index.method_refs(baz)[0].method, baz);
+  EXPECT_EQ(index.type_refs(DexType::get_type("LFoo;")).size(), 1);
+
+  index.remove(baz);
+  EXPECT_TRUE(index.method_refs(baz).empty());
+  EXPECT_EQ(index.all_method_refs().size(), 0);
+
+  delete g_redex;
+}
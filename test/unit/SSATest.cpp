@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "SSA.h"
+
+using namespace ssa;
+using ::testing::UnorderedElementsAre;
+
+namespace {
+
+IRInstruction* find_insn(IRCode* code, IROpcode op) {
+  for (auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == op) {
+      return mie.insn;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+TEST(SSA, phiAtJoin) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (const v1 0)
+     (if-eqz v0 :else)
+     (const v1 1)
+     :else
+     (return v1)
+    )
+)");
+  code->build_cfg();
+  SSAForm ssa(code->cfg());
+
+  auto param = find_insn(code.get(), IOPCODE_LOAD_PARAM);
+  auto branch = find_insn(code.get(), OPCODE_IF_EQZ);
+  auto param_value = ssa.dest_value(param);
+  EXPECT_EQ(ssa.src_value(branch, 0), param_value);
+  ASSERT_EQ(ssa.uses(param_value).size(), 1);
+  EXPECT_EQ(ssa.uses(param_value)[0].insn, branch);
+
+  auto ret = find_insn(code.get(), OPCODE_RETURN);
+  auto phi = ssa.src_value(ret, 0);
+  const auto& def = ssa.def(phi);
+  ASSERT_EQ(def.kind, Def::Kind::Phi);
+  EXPECT_EQ(def.reg, 1);
+  EXPECT_THAT(ssa.phis(def.block), UnorderedElementsAre(phi));
+  ASSERT_EQ(def.phi_operands.size(), 2);
+  std::vector<int64_t> literals;
+  for (auto operand : def.phi_operands) {
+    ASSERT_EQ(ssa.def(operand).kind, Def::Kind::Instruction);
+    literals.push_back(ssa.def(operand).insn->get_literal());
+    ASSERT_EQ(ssa.uses(operand).size(), 1);
+    EXPECT_EQ(ssa.uses(operand)[0].phi, phi);
+  }
+  EXPECT_THAT(literals, UnorderedElementsAre(0, 1));
+}
+
+TEST(SSA, loopIsPruned) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (const v1 0)
+     :loop
+     (const v1 2)
+     (add-int v0 v0 v1)
+     (if-nez v0 :loop)
+     (return v0)
+    )
+)");
+  code->build_cfg();
+  SSAForm ssa(code->cfg());
+
+  // v0 flows around the loop, so it gets a phi at its head. v1 is redefined
+  // before being read in each iteration, so it doesn't.
+  auto add = find_insn(code.get(), OPCODE_ADD_INT);
+  auto phi = ssa.src_value(add, 0);
+  const auto& def = ssa.def(phi);
+  ASSERT_EQ(def.kind, Def::Kind::Phi);
+  EXPECT_EQ(def.reg, 0);
+  EXPECT_EQ(ssa.phis(def.block).size(), 1);
+  EXPECT_THAT(def.phi_operands,
+              UnorderedElementsAre(ssa.dest_value(add),
+                                   ssa.dest_value(find_insn(code.get(),
+                                                            OPCODE_CONST))));
+  EXPECT_EQ(ssa.def(ssa.src_value(add, 1)).insn->get_literal(), 2);
+
+  auto ret = find_insn(code.get(), OPCODE_RETURN);
+  EXPECT_EQ(ssa.src_value(ret, 0), ssa.dest_value(add));
+  std::vector<IRInstruction*> users;
+  for (const auto& use : ssa.uses(ssa.dest_value(add))) {
+    users.push_back(use.insn);
+  }
+  EXPECT_THAT(users,
+              UnorderedElementsAre(find_insn(code.get(), OPCODE_IF_NEZ),
+                                   ret,
+                                   nullptr));
+}
+
+TEST(SSA, entryValues) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (if-eqz v0 :exit)
+     (const v0 1)
+     :exit
+     (return v0)
+    )
+)");
+  code->build_cfg();
+  SSAForm ssa(code->cfg());
+
+  auto branch = find_insn(code.get(), OPCODE_IF_EQZ);
+  auto entry = ssa.src_value(branch, 0);
+  EXPECT_EQ(ssa.def(entry).kind, Def::Kind::Entry);
+  EXPECT_EQ(ssa.def(entry).block, code->cfg().entry_block());
+
+  auto phi = ssa.src_value(find_insn(code.get(), OPCODE_RETURN), 0);
+  ASSERT_EQ(ssa.def(phi).kind, Def::Kind::Phi);
+  EXPECT_THAT(ssa.def(phi).phi_operands,
+              UnorderedElementsAre(
+                  entry, ssa.dest_value(find_insn(code.get(), OPCODE_CONST))));
+}
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexContext.h"
+#include "SequenceOutliner.h"
+
+namespace {
+
+const char* kRepeated = R"(
+     (add-int/lit8 v0 v2 3)
+     (mul-int/lit8 v0 v0 5)
+     (add-int/lit8 v0 v0 7)
+     (mul-int/lit8 v0 v0 11)
+     (add-int/lit8 v0 v0 13)
+     (mul-int/lit8 v0 v0 17)
+     (add-int/lit8 v0 v0 19)
+     (mul-int/lit8 v0 v0 23)
+)";
+
+DexMethod* make_method(ClassCreator& creator,
+                       const std::string& name,
+                       const std::string& body) {
+  auto method = static_cast<DexMethod*>(
+      DexMethod::make_method("LFoo;", name.c_str(), "I", {"I"}));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  method->set_code(assembler::ircode_from_string(body));
+  creator.add_method(method);
+  return method;
+}
+
+} // namespace
+
+TEST(SequenceOutlinerTest, outlineRepeatedArithmetic) {
+  g_redex = new RedexContext();
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.set_access(ACC_PUBLIC);
+  std::vector<DexMethod*> methods;
+  for (int i = 0; i < 4; ++i) {
+    methods.push_back(make_method(
+        creator,
+        "m" + std::to_string(i),
+        std::string("((load-param v2)") + kRepeated + "(return v0))"));
+  }
+  // Uses the result register differently, so has a shape of its own.
+  auto other = make_method(
+      creator,
+      "other",
+      std::string("((load-param v2)") + kRepeated + "(return v2))");
+  DexClassesVector dexen{{creator.create()}};
+
+  outliner::SequenceOutlinerConfig config;
+  auto stats = outliner::outline_sequences(dexen, 0, config);
+  EXPECT_EQ(1, stats.methods);
+  EXPECT_EQ(4, stats.sites);
+  EXPECT_GT(stats.code_units_saved, 0);
+
+  ASSERT_EQ(2, dexen[0].size());
+  auto outlined_cls = dexen[0][1];
+  EXPECT_EQ("Lcom/facebook/redex/OutlinedSequences0;", show(outlined_cls));
+  ASSERT_EQ(1, outlined_cls->get_dmethods().size());
+  auto outlined = outlined_cls->get_dmethods()[0];
+  EXPECT_TRUE(is_static(outlined));
+  EXPECT_EQ(assembler::to_s_expr(outlined->get_code()),
+            assembler::to_s_expr(
+                assembler::ircode_from_string(std::string(R"(
+    (
+     (load-param v1)
+     (add-int/lit8 v0 v1 3)
+     (mul-int/lit8 v0 v0 5)
+     (add-int/lit8 v0 v0 7)
+     (mul-int/lit8 v0 v0 11)
+     (add-int/lit8 v0 v0 13)
+     (mul-int/lit8 v0 v0 17)
+     (add-int/lit8 v0 v0 19)
+     (mul-int/lit8 v0 v0 23)
+     (return v0)
+    )
+)")).get()));
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+     (load-param v2)
+     (invoke-static (v2) "Lcom/facebook/redex/OutlinedSequences0;.$outlined$0:(I)I")
+     (move-result v0)
+     (return v0)
+    )
+)");
+  for (auto method : methods) {
+    EXPECT_EQ(assembler::to_s_expr(method->get_code()),
+              assembler::to_s_expr(expected.get()))
+        << show(method);
+  }
+  // The sequence of the other method leaves v0 dead, so it doesn't match.
+  EXPECT_EQ(9, other->get_code()->count_opcodes());
+
+  delete g_redex;
+}
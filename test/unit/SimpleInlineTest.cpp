@@ -9,8 +9,11 @@
 
 #include <gtest/gtest.h>
 
+#include "Creators.h"
 #include "DexAsm.h"
+#include "DexStore.h"
 #include "DexUtil.h"
+#include "IRAssembler.h"
 #include "Inliner.h"
 #include "IRCode.h"
 
@@ -71,3 +74,211 @@ TEST(SimpleInlineTest, insertMoves) {
   EXPECT_EQ(caller_code->get_registers_size(), 5);
   delete g_redex;
 }
+
+/*
+ * Inline a diamond of static methods, plus a call cycle, into `LFoo;.top`, and
+ * return the resulting code of `top`.
+ */
+std::string inline_into_top(bool parallel) {
+  g_redex = new RedexContext();
+
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  auto add_method = [&](const std::string& name,
+                        const std::vector<std::string>& callees) {
+    std::string body;
+    for (const auto& callee : callees) {
+      body += "(invoke-static () \"LFoo;." + callee + ":()V\")\n";
+    }
+    auto method = assembler::method_from_string(
+        "(method (public static) \"LFoo;." + name + ":()V\" (" + body +
+        "(const v0 " + std::to_string(name.size()) + ")\n(return-void)))");
+    creator.add_method(method);
+    return method;
+  };
+  auto top = add_method("top", {"left", "right", "cycle1"});
+  auto left = add_method("left", {"bottom"});
+  auto right = add_method("right", {"bottom"});
+  auto bottom = add_method("bottom", {});
+  auto cycle1 = add_method("cycle1", {"cycle2"});
+  auto cycle2 = add_method("cycle2", {"cycle1"});
+  top->rstate.set_keep();
+
+  Scope scope{creator.create()};
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes(scope);
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+
+  MultiMethodInliner::Config config;
+  config.throws_inline = false;
+  config.parallel = parallel;
+  std::unordered_set<DexMethod*> candidates{
+      left, right, bottom, cycle1, cycle2};
+  std::string result;
+  {
+    MultiMethodInliner inliner(
+        scope,
+        stores,
+        candidates,
+        [](DexMethodRef* method, MethodSearch search) {
+          return resolve_method(method, search);
+        },
+        config);
+    inliner.inline_methods();
+    EXPECT_EQ(inliner.get_inlined(), candidates);
+    EXPECT_EQ(inliner.get_info().recursive, 1);
+    for (auto method : {left, right}) {
+      for (auto& mie : InstructionIterable(method->get_code())) {
+        EXPECT_FALSE(is_invoke(mie.insn->opcode())) << SHOW(method);
+      }
+    }
+    result = assembler::to_string(top->get_code());
+  }
+
+  delete g_redex;
+  return result;
+}
+
+TEST(SimpleInlineTest, parallelInlining) {
+  auto sequential = inline_into_top(/* parallel */ false);
+  auto parallel = inline_into_top(/* parallel */ true);
+  EXPECT_EQ(sequential, parallel);
+  // Only the call that closes the cycle is left in `top`.
+  EXPECT_EQ(std::string::npos, parallel.find("LFoo;.bottom"));
+  EXPECT_NE(std::string::npos, parallel.find("LFoo;.cycle1"));
+}
+
+/*
+ * The analysis of a callee is shared by all its call sites, but the reasons
+ * for not inlining it are still counted once per call site.
+ */
+TEST(SimpleInlineTest, calleeSummaryIsShared) {
+  g_redex = new RedexContext();
+
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  auto callee = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.callee:()V"
+     (
+      (const v0 0)
+      (if-eqz v0 :label)
+      (return-void)
+      :label
+      (return-void)
+     )
+    )
+  )");
+  creator.add_method(callee);
+  for (auto name : {"a", "b", "c"}) {
+    creator.add_method(assembler::method_from_string(
+        std::string("(method (public static) \"LFoo;.") + name +
+        ":()V\" ((invoke-static () \"LFoo;.callee:()V\") (return-void)))"));
+  }
+
+  Scope scope{creator.create()};
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes(scope);
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+
+  MultiMethodInliner::Config config;
+  config.throws_inline = false;
+  {
+    MultiMethodInliner inliner(
+        scope,
+        stores,
+        {callee},
+        [](DexMethodRef* method, MethodSearch search) {
+          return resolve_method(method, search);
+        },
+        config);
+    inliner.inline_methods();
+    EXPECT_TRUE(inliner.get_inlined().empty());
+    EXPECT_EQ(inliner.get_info().multi_ret, 3);
+  }
+
+  delete g_redex;
+}
+
+/*
+ * In profile-guided mode, a callee with several call sites is inlined into the
+ * hot caller only.
+ */
+TEST(SimpleInlineTest, profileGuidedInlining) {
+  g_redex = new RedexContext();
+
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  auto callee = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.callee:()V"
+     (
+      (const v0 100000)
+      (const v1 200000)
+      (const v2 300000)
+      (return-void)
+     )
+    )
+  )");
+  creator.add_method(callee);
+  std::vector<DexMethod*> callers;
+  for (auto name : {"hot", "cold1", "cold2"}) {
+    auto caller = assembler::method_from_string(
+        std::string("(method (public static) \"LFoo;.") + name +
+        ":()V\" ((invoke-static () \"LFoo;.callee:()V\") (return-void)))");
+    creator.add_method(caller);
+    callers.push_back(caller);
+  }
+
+  Scope scope{creator.create()};
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes(scope);
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+
+  MultiMethodInliner::Config config;
+  config.throws_inline = false;
+  config.hot_methods.insert(callers[0]);
+  MethodRefCache resolved_refs;
+  std::unordered_set<DexMethod*> inlinable;
+  select_inlinable(scope, {callee}, resolved_refs, &inlinable);
+  EXPECT_TRUE(inlinable.empty());
+  select_inlinable(scope,
+                   {callee},
+                   resolved_refs,
+                   &inlinable,
+                   false,
+                   &config.hot_methods);
+  EXPECT_EQ(inlinable, std::unordered_set<DexMethod*>{callee});
+  {
+    MultiMethodInliner inliner(
+        scope,
+        stores,
+        inlinable,
+        [](DexMethodRef* method, MethodSearch search) {
+          return resolve_method(method, search);
+        },
+        config);
+    inliner.inline_methods();
+    const auto& info = inliner.get_info();
+    EXPECT_EQ(info.calls_inlined, 1);
+    EXPECT_EQ(info.hot_calls_inlined, 1);
+    EXPECT_EQ(info.cold_caller, 2);
+    EXPECT_EQ(info.code_units_inlined,
+              callee->get_code()->sum_opcode_sizes());
+  }
+  for (auto caller : callers) {
+    auto code = assembler::to_string(caller->get_code());
+    EXPECT_EQ(code.find("LFoo;.callee") == std::string::npos,
+              caller == callers[0])
+        << code;
+  }
+
+  delete g_redex;
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "RedexContext.h"
+#include "Show.h"
+#include "SlowestMethods.h"
+#include "Walkers.h"
+
+TEST(SlowestMethodsTest, keepsTheSlowestWalkerCalls) {
+  g_redex = new RedexContext();
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  std::vector<DexMethod*> methods;
+  for (int i = 0; i < 4; ++i) {
+    auto method = static_cast<DexMethod*>(DexMethod::make_method(
+        "LFoo;.m" + std::to_string(i) + ":()V"));
+    method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+    creator.add_method(method);
+    methods.push_back(method);
+  }
+  Scope scope{creator.create()};
+  auto sleep_ms = [&](DexMethod* method) {
+    // m1 is the slowest, then m3.
+    int ms[] = {1, 30, 1, 15};
+    auto i = std::find(methods.begin(), methods.end(), method) -
+             methods.begin();
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms[i]));
+  };
+
+  // Nothing is kept until recording starts.
+  walk::parallel::methods(scope, sleep_ms);
+  EXPECT_TRUE(SlowestMethods::stop().empty());
+
+  SlowestMethods::start(2);
+  EXPECT_TRUE(SlowestMethods::enabled());
+  walk::parallel::methods(scope, sleep_ms);
+  auto slowest = SlowestMethods::stop();
+  EXPECT_FALSE(SlowestMethods::enabled());
+  ASSERT_EQ(slowest.size(), 2);
+  EXPECT_EQ(slowest[0].first, show_deobfuscated(methods[1]));
+  EXPECT_EQ(slowest[1].first, show_deobfuscated(methods[3]));
+  EXPECT_GE(slowest[0].second, 0.03);
+  EXPECT_GE(slowest[1].second, 0.015);
+
+  SlowestMethods::truncate(slowest, 1);
+  ASSERT_EQ(slowest.size(), 1);
+  EXPECT_EQ(slowest[0].first, show_deobfuscated(methods[1]));
+
+  delete g_redex;
+}
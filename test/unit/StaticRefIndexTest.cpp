@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "StaticRefIndex.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexContext.h"
+
+TEST(StaticRefIndexTest, indexesStaticRefs) {
+  g_redex = new RedexContext();
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+     (
+      (sget "LFoo;.x:I")
+      (move-result-pseudo v0)
+      (sput v0 "LFoo;.y:I")
+      (iget v1 "LFoo;.z:I")
+      (move-result-pseudo v0)
+      (invoke-static () "LFoo;.baz:()V")
+      (invoke-virtual (v1) "LFoo;.qux:()V")
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v1)
+      (return-void)
+     )
+    )
+  )"));
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.baz:()V"
+     (
+      (const v0 0)
+      (return-void)
+     )
+    )
+  )"));
+  Scope scope{creator.create()};
+
+  StaticRefIndex index(scope);
+  // LFoo;.baz has no refs
+  ASSERT_EQ(index.methods().size(), 1);
+  const auto& refs = index.methods()[0];
+  EXPECT_EQ(refs.method, DexMethod::get_method("LFoo;.bar:()V"));
+  ASSERT_EQ(refs.field_refs.size(), 2);
+  EXPECT_EQ(refs.field_refs[0]->insn->opcode(), OPCODE_SGET);
+  EXPECT_EQ(refs.field_refs[1]->insn->opcode(), OPCODE_SPUT);
+  ASSERT_EQ(refs.method_refs.size(), 1);
+  EXPECT_EQ(refs.method_refs[0]->insn->get_method(),
+            DexMethod::get_method("LFoo;.baz:()V"));
+  ASSERT_EQ(refs.type_refs.size(), 1);
+  EXPECT_EQ(refs.type_refs[0]->insn->opcode(), OPCODE_NEW_INSTANCE);
+  EXPECT_TRUE(refs.catch_types.empty());
+
+  delete g_redex;
+}
@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexUtil.h"
+#include "Pass.h"
+#include "PassManager.h"
+#include "RedexContext.h"
+
+namespace {
+
+class CountClassesPass : public Pass {
+ public:
+  CountClassesPass() : Pass("CountClassesPass") {}
+
+  bool is_store_local() const override { return true; }
+
+  void run_pass(DexStoresVector& stores,
+                ConfigFiles&,
+                PassManager& mgr) override {
+    EXPECT_EQ(stores.size(), 1);
+    mgr.incr_metric("stores", 1);
+    mgr.incr_metric("classes", build_class_scope(stores).size());
+  }
+};
+
+class CountStoresPass : public Pass {
+ public:
+  CountStoresPass() : Pass("CountStoresPass") {}
+
+  void run_pass(DexStoresVector& stores,
+                ConfigFiles&,
+                PassManager& mgr) override {
+    mgr.incr_metric("stores", stores.size());
+  }
+};
+
+DexStore make_store(const std::string& name,
+                    const std::vector<std::string>& deps,
+                    size_t num_classes) {
+  DexMetadata dm;
+  dm.set_id(name);
+  dm.get_dependencies() = deps;
+  DexStore store(dm);
+  std::vector<DexClass*> classes;
+  for (size_t i = 0; i < num_classes; ++i) {
+    ClassCreator creator(DexType::make_type(
+        ("L" + name + "/C" + std::to_string(i) + ";").c_str()));
+    creator.set_super(get_object_type());
+    classes.push_back(creator.create());
+  }
+  store.add_classes(classes);
+  return store;
+}
+
+} // namespace
+
+TEST(StoreLocalPassesTest, runsOnEachStoreAndSumsTheMetrics) {
+  g_redex = new RedexContext();
+  std::vector<DexStore> stores;
+  stores.emplace_back(make_store("classes", {}, 3));
+  stores.emplace_back(make_store("a", {"classes"}, 2));
+  stores.emplace_back(make_store("b", {"a"}, 1));
+
+  CountClassesPass first;
+  CountClassesPass second;
+  CountStoresPass whole;
+  PassManager manager({&first, &second, &whole});
+  manager.set_testing_mode();
+  Scope external_classes;
+  Json::Value conf_obj = Json::nullValue;
+  ConfigFiles dummy_config(conf_obj);
+  manager.run_passes(stores, external_classes, dummy_config);
+
+  const auto& infos = manager.get_pass_info();
+  ASSERT_EQ(infos.size(), 3);
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_EQ(infos[i].metrics.at("stores"), 3);
+    EXPECT_EQ(infos[i].metrics.at("classes"), 6);
+  }
+  // The stores are back where they were for the passes that follow.
+  EXPECT_EQ(infos[2].metrics.at("stores"), 3);
+  ASSERT_EQ(stores.size(), 3);
+  EXPECT_EQ(stores[0].get_name(), "classes");
+  EXPECT_EQ(stores[2].get_name(), "b");
+  EXPECT_EQ(stores[2].get_dexen()[0].size(), 1);
+  delete g_redex;
+}
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ThreadPool.h"
+
+#include <gtest/gtest.h>
+#include <mutex>
+#include <set>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "WorkQueue.h"
+
+TEST(ThreadPoolTest, runsEveryIndexOnce) {
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> counts(100);
+  pool.run(counts.size(), [&](size_t i) { ++counts[i]; });
+  for (auto& c : counts) {
+    EXPECT_EQ(1, c.load());
+  }
+}
+
+TEST(ThreadPoolTest, threadsAreReused) {
+  ThreadPool pool(3);
+  std::mutex mtx;
+  std::set<boost::thread::id> ids;
+  for (int round = 0; round < 50; ++round) {
+    pool.run(4, [&](size_t) {
+      std::lock_guard<std::mutex> guard(mtx);
+      ids.insert(boost::this_thread::get_id());
+    });
+  }
+  // The three pool threads plus the caller.
+  EXPECT_LE(ids.size(), 4);
+  EXPECT_EQ(3, pool.size());
+}
+
+// Nested batches must not deadlock, even if they ask for more threads than
+// the pool has.
+TEST(ThreadPoolTest, nestedBatches) {
+  ThreadPool pool(2);
+  std::atomic<int> total{0};
+  pool.run(4, [&](size_t) {
+    pool.run(8, [&](size_t) { ++total; });
+  });
+  EXPECT_EQ(32, total.load());
+}
+
+TEST(ThreadPoolTest, nestedWorkQueues) {
+  auto outer = workqueue_mapreduce<int, int>(
+      [](int a) {
+        auto inner = workqueue_mapreduce<int, int>(
+            [](int b) { return b; }, [](int x, int y) { return x + y; }, 4);
+        for (int i = 0; i <= a; ++i) {
+          inner.add_item(i);
+        }
+        return inner.run_all();
+      },
+      [](int a, int b) { return a + b; },
+      4);
+  int expected = 0;
+  for (int i = 0; i < 100; ++i) {
+    outer.add_item(i);
+    expected += i * (i + 1) / 2;
+  }
+  EXPECT_EQ(expected, outer.run_all());
+}
+
+TEST(ThreadPoolTest, parseCpuList) {
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 8, 10, 11}),
+            ThreadPool::parse_cpu_list("0-3,8,10-11"));
+  EXPECT_EQ(std::vector<int>({5}), ThreadPool::parse_cpu_list("5"));
+  EXPECT_ANY_THROW(ThreadPool::parse_cpu_list("1,"));
+  EXPECT_ANY_THROW(ThreadPool::parse_cpu_list("3-1"));
+  EXPECT_ANY_THROW(ThreadPool::parse_cpu_list("a"));
+}
+
+#ifdef __linux__
+TEST(ThreadPoolTest, pinsWorkers) {
+  ThreadPool pool(3);
+  pool.pin_to_cpus({0});
+  EXPECT_EQ(1, ThreadPool::num_cpus());
+  std::atomic<int> elsewhere{0};
+  pool.run(4, [&](size_t) {
+    if (sched_getcpu() != 0) {
+      ++elsewhere;
+    }
+  });
+  EXPECT_EQ(0, elsewhere.load());
+  // Workers started later are pinned too.
+  pool.ensure_size(5);
+  pool.run(6, [&](size_t) {
+    if (sched_getcpu() != 0) {
+      ++elsewhere;
+    }
+  });
+  EXPECT_EQ(0, elsewhere.load());
+
+  pool.pin_to_cpus({});
+  EXPECT_GE(ThreadPool::num_cpus(), 1);
+}
+#endif
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <thread>
+
+#include "Pass.h"
+#include "TimeBudget.h"
+
+TEST(TimeBudgetTest, readsTheBudgetFromThePassConfig) {
+  Json::Value json(Json::objectValue);
+  EXPECT_FALSE(PassConfig(json).get_time_budget().is_limited());
+
+  json["time_budget_ms"] = 2000;
+  json["method_time_budget_ms"] = 50;
+  auto budget = PassConfig(json).get_time_budget();
+  EXPECT_TRUE(budget.is_limited());
+  EXPECT_EQ(budget.pass_ms, 2000);
+  EXPECT_EQ(budget.method_ms, 50);
+}
+
+TEST(TimeBudgetTest, unlimitedBudgetNeverRunsOut) {
+  BudgetTracker tracker{TimeBudget()};
+  auto clock = tracker.start_method();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_FALSE(tracker.pass_exhausted());
+  EXPECT_FALSE(clock.exhausted());
+}
+
+TEST(TimeBudgetTest, methodClocksRunOutOnTheirOwnAndWithThePass) {
+  TimeBudget budget;
+  budget.pass_ms = 200;
+  budget.method_ms = 1;
+  BudgetTracker tracker(budget);
+  auto clock = tracker.start_method();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_TRUE(clock.exhausted());
+  EXPECT_FALSE(tracker.pass_exhausted());
+  EXPECT_FALSE(tracker.start_method().exhausted());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  EXPECT_TRUE(tracker.pass_exhausted());
+  // A method started after the pass budget is spent has no time left.
+  EXPECT_TRUE(tracker.start_method().exhausted());
+}
+
+TEST(TimeBudgetTest, countsTheFallbacksByKind) {
+  BudgetTracker tracker{TimeBudget()};
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 4; ++i) {
+    threads.emplace_back([&tracker] {
+      for (size_t j = 0; j < 100; ++j) {
+        tracker.record_fallback("methods_skipped");
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  tracker.record_fallback("methods_given_up", 3);
+  EXPECT_EQ(tracker.fallbacks("methods_skipped"), 400);
+  EXPECT_EQ(tracker.fallbacks("methods_given_up"), 3);
+  EXPECT_EQ(tracker.fallbacks("other"), 0);
+}
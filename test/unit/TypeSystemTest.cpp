@@ -250,6 +250,9 @@ TEST(TypeSystem, empty) {
   EXPECT_FALSE(type_system.is_subtype(e_t, i_t));
   EXPECT_FALSE(type_system.is_subtype(odd2_t, a_t));
   EXPECT_FALSE(type_system.is_subtype(odd12_t, odd1_t));
+  EXPECT_FALSE(type_system.is_subtype(obj_t, odd_t));
+  EXPECT_FALSE(type_system.is_subtype(odd_t, b_t));
+  EXPECT_FALSE(type_system.is_subtype(a_t, i1_t));
 
   EXPECT_TRUE(type_system.implements(e_t, i2_t));
   EXPECT_TRUE(type_system.implements(f_t, i2_t));
@@ -373,3 +376,36 @@ TEST(TypeSystem, empty) {
 
   delete g_redex;
 }
+
+TEST(TypeSystem, sharedClassScopes) {
+  g_redex = new RedexContext();
+
+  Scope scope = create_empty_scope();
+  auto obj_t = get_object_type();
+  auto a_t = DexType::make_type("LA;");
+  auto a_cls = create_internal_class(a_t, obj_t, {});
+  scope.push_back(a_cls);
+  auto b_t = DexType::make_type("LB;");
+  auto b_cls = create_internal_class(b_t, a_t, {});
+  scope.push_back(b_cls);
+
+  TypeSystem ts1(scope);
+  TypeSystem ts2(scope);
+  EXPECT_EQ(&ts1.get_class_scopes(), &ts2.get_class_scopes());
+
+  // Access flags other than ACC_INTERFACE don't change the scopes.
+  b_cls->set_access(b_cls->get_access() | ACC_FINAL);
+  TypeSystem ts3(scope);
+  EXPECT_EQ(&ts1.get_class_scopes(), &ts3.get_class_scopes());
+
+  auto void_void = DexProto::make_proto(get_void_type(),
+                                        DexTypeList::make_type_list({}));
+  auto meth = create_empty_method(a_cls, "m", void_void);
+  EXPECT_TRUE(meth->is_virtual());
+  TypeSystem ts4(scope);
+  EXPECT_NE(&ts1.get_class_scopes(), &ts4.get_class_scopes());
+  EXPECT_EQ(1, ts4.get_class_scopes().get(a_t).size());
+  EXPECT_EQ(0, ts1.get_class_scopes().get(a_t).size());
+
+  delete g_redex;
+}
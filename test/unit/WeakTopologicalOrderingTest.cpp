@@ -233,3 +233,36 @@ TEST(WeakTopologicalOrderingTest, InvalidIteratorDeref) {
   EXPECT_ANY_THROW(wto.end()->head_node());
   EXPECT_ANY_THROW(wto.end()++);
 }
+
+TEST(WeakTopologicalOrderingTest, DeepGraph) {
+  // A path much longer than what a recursive construction can handle on a
+  // regular thread stack, closed into a loop:
+  //
+  //   0 --> 1 --> 2 --> ... --> n-1
+  //         ^                    |
+  //         +--------------------+
+  const int n = 1000000;
+  WeakTopologicalOrdering<int> wto(0, [n](const int& node) {
+    if (node == n - 1) {
+      return std::vector<int>{1};
+    }
+    return std::vector<int>{node + 1};
+  });
+
+  auto it = wto.begin();
+  ASSERT_TRUE(it != wto.end());
+  EXPECT_TRUE(it->is_vertex());
+  EXPECT_EQ(0, it->head_node());
+  ++it;
+  ASSERT_TRUE(it != wto.end());
+  EXPECT_TRUE(it->is_scc());
+  EXPECT_EQ(1, it->head_node());
+  int expected = 2;
+  for (const auto& component : *it) {
+    EXPECT_TRUE(component.is_vertex());
+    EXPECT_EQ(expected++, component.head_node());
+  }
+  EXPECT_EQ(n, expected);
+  ++it;
+  EXPECT_TRUE(it == wto.end());
+}
@@ -12,6 +12,8 @@
 #include <chrono>
 #include <random>
 
+#include "ConcurrentContainers.h"
+
 //==========
 // Test for performance
 //==========
@@ -81,9 +83,86 @@ void smallLengthTasks() {
   printf("speedup small length tasks: %f\n", speedup);
 }
 
+template <typename Fn>
+double time_ms(const Fn& fn) {
+  auto start = std::chrono::high_resolution_clock::now();
+  fn();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::vector<unsigned int> thread_counts() {
+  std::vector<unsigned int> counts;
+  for (unsigned int n = 1; n < boost::thread::hardware_concurrency(); n *= 2) {
+    counts.push_back(n);
+  }
+  counts.push_back(boost::thread::hardware_concurrency());
+  return counts;
+}
+
+/*
+ * Tasks that do next to nothing, so that the time goes into the workers
+ * updating their results and their deques, which neighbor each other.
+ */
+void contendedReduction() {
+  const int num_tasks = 1 << 22;
+  double base = 0;
+  for (auto num_threads : thread_counts()) {
+    auto wq = workqueue_mapreduce<int, int64_t>(
+        [](int a) { return a; },
+        [](int64_t a, int64_t b) { return a + b; },
+        num_threads);
+    for (int i = 0; i < num_tasks; ++i) {
+      wq.add_item(i);
+    }
+    int64_t sum = 0;
+    double ms = time_ms([&] { sum = wq.run_all(); });
+    always_assert(sum == int64_t(num_tasks) * (num_tasks - 1) / 2);
+    if (num_threads == 1) {
+      base = ms;
+    }
+    printf("contended reduction, %u threads: %.1f ms, speedup %.2f\n",
+           num_threads, ms, base / ms);
+  }
+}
+
+/*
+ * Every thread hammers keys of its own, which are spread over all the slots,
+ * so that the threads only contend for neighboring slots.
+ */
+void concurrentMapContention() {
+  const uint32_t ops_per_thread = 1 << 20;
+  double base = 0;
+  for (auto num_threads : thread_counts()) {
+    ConcurrentMap<uint32_t, uint32_t> map;
+    double ms = time_ms([&] {
+      std::vector<boost::thread> threads;
+      for (uint32_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&map, t]() {
+          for (uint32_t i = 0; i < ops_per_thread; ++i) {
+            uint32_t key = (i % 1024) * 64 + t;
+            map.update(key, [](uint32_t, uint32_t& value, bool) { ++value; });
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    });
+    // Weak scaling: each thread does the same amount of work.
+    if (num_threads == 1) {
+      base = ms;
+    }
+    printf("concurrent map, %u threads: %.1f ms, efficiency %.2f\n",
+           num_threads, ms, base / ms);
+  }
+}
+
 int main() {
   printf("Begin!\n");
   profileBusyLoop();
   variableLengthTasks();
   smallLengthTasks();
+  contendedReduction();
+  concurrentMapContention();
 }
@@ -12,6 +12,7 @@
 #include <chrono>
 #include <gtest/gtest.h>
 #include <random>
+#include <thread>
 
 constexpr unsigned int NUM_STRINGS = 100'000;
 constexpr unsigned int NUM_INTS = 1000;
@@ -103,3 +104,112 @@ TEST(WorkQueueTest, checkDynamicallyAddingTasks) {
   // 10 + 9 + ... + 1 + 0 = 55
   EXPECT_EQ(55, result);
 }
+
+// Check that tasks spawned by running tasks get spread out and all complete,
+// even when the queue starts out with a single item.
+TEST(WorkQueueTest, checkRecursiveFanOut) {
+  constexpr int DEPTH = 14;
+  std::atomic<int> leaves{0};
+  auto wq = workqueue_mapreduce<int, int>([](int a) { return a; },
+                                          [](int a, int b) { return a + b; },
+                                          4);
+  wq.set_mapper([&](std::nullptr_t&, int depth) {
+    if (depth == 0) {
+      ++leaves;
+      return 1;
+    }
+    wq.add_item(depth - 1);
+    wq.add_item(depth - 1);
+    return 1;
+  });
+  wq.add_item(DEPTH);
+  auto result = wq.run_all();
+
+  EXPECT_EQ(1 << DEPTH, leaves.load());
+  EXPECT_EQ((1 << (DEPTH + 1)) - 1, result);
+}
+
+// An odd number of runs leaves one unpaired at the end of the first merge.
+TEST(WorkQueueTest, sortInParallel) {
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int> dist(0, 1000);
+  for (unsigned int num_threads : {1, 2, 3, 4}) {
+    std::vector<int> items(NUM_STRINGS);
+    for (auto& item : items) {
+      item = dist(gen);
+    }
+    auto expected = items;
+    std::sort(expected.begin(), expected.end());
+    sort_in_parallel(items.begin(), items.end(), std::less<int>(), num_threads);
+    EXPECT_EQ(expected, items) << num_threads << " threads";
+  }
+}
+
+// One slow task on a worker keeps the other worker idle and retired early.
+TEST(WorkQueueTest, recordsRunStats) {
+  auto wq = workqueue_foreach<int>(
+      [](int ms) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+      },
+      2);
+  wq.add_item(50);
+  wq.add_item(0);
+  auto before = WorkQueueStats::snapshot();
+  wq.run_all();
+  auto stats = WorkQueueStats::snapshot() - before;
+
+  EXPECT_EQ(1, stats.runs);
+  EXPECT_EQ(2, stats.tasks);
+  EXPECT_GE(stats.busiest_worker_tasks, 1);
+  EXPECT_GE(stats.steal_attempts, stats.steals);
+  EXPECT_GE(stats.busy_us, 50'000);
+  // The idle worker only retires once the slow task is done, which is also
+  // when the other worker retires.
+  EXPECT_GE(stats.idle_us, 25'000);
+  EXPECT_LT(stats.tail_us, 25'000);
+}
+
+// The owner takes from the bottom while thieves take from the top; every
+// element must come out exactly once.
+TEST(WorkQueueTest, chaseLevDequeStress) {
+  constexpr int NUM_ITEMS = 100'000;
+  workqueue_impl::ChaseLevDeque<int> deque(1);
+  std::vector<std::atomic<int>> seen(NUM_ITEMS);
+  std::atomic<bool> done{false};
+
+  auto thief = [&]() {
+    while (!done.load()) {
+      int* item = deque.steal();
+      if (item != nullptr) {
+        ++seen[*item];
+        delete item;
+      }
+    }
+  };
+  std::vector<boost::thread> thieves;
+  for (int i = 0; i < 3; ++i) {
+    thieves.emplace_back(thief);
+  }
+  for (int i = 0; i < NUM_ITEMS; ++i) {
+    deque.push(new int(i));
+    if (i % 3 == 0) {
+      int* item = deque.take();
+      if (item != nullptr) {
+        ++seen[*item];
+        delete item;
+      }
+    }
+  }
+  int* item;
+  while ((item = deque.take()) != nullptr) {
+    ++seen[*item];
+    delete item;
+  }
+  done = true;
+  for (auto& t : thieves) {
+    t.join();
+  }
+  for (int i = 0; i < NUM_ITEMS; ++i) {
+    ASSERT_EQ(1, seen[i].load()) << "item " << i;
+  }
+}
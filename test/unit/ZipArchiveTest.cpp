@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+
+#include "ZipArchive.h"
+#include "ZipFormat.h"
+
+namespace {
+
+std::string contents_of(const zip::Reader& reader, const zip::Entry& entry) {
+  std::string ret(entry.ucomp_size, '\0');
+  reader.extract(entry, reinterpret_cast<uint8_t*>(&ret[0]));
+  return ret;
+}
+
+void write_archive(const std::string& path,
+                   const std::vector<zip::Entry>& entries,
+                   bool page_align) {
+  zip::Writer writer(path, page_align);
+  for (const auto& entry : entries) {
+    writer.add(entry);
+  }
+  writer.finish();
+}
+
+} // namespace
+
+TEST(ZipArchiveTest, roundTripCopiesEntriesVerbatim) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path("zip-%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  auto first = (dir / "first.apk").string();
+  auto second = (dir / "second.apk").string();
+
+  std::string dex(10000, 'd');
+  std::string lib = "not really an elf";
+  std::vector<std::vector<uint8_t>> storage(3);
+  write_archive(first,
+                {zip::compress("a", (const uint8_t*)"x", 1, kCompMethodStore,
+                               0, &storage[0]),
+                 zip::compress("classes.dex", (const uint8_t*)dex.data(),
+                               dex.size(), kCompMethodDeflate, 0, &storage[1]),
+                 zip::compress("lib/x86/libfoo.so", (const uint8_t*)lib.data(),
+                               lib.size(), kCompMethodStore, 0, &storage[2])},
+                true);
+
+  {
+    zip::Reader reader(first);
+    ASSERT_EQ(reader.entries().size(), 3);
+    const auto& dex_entry = reader.entries()[1];
+    EXPECT_EQ(dex_entry.name, "classes.dex");
+    EXPECT_EQ(dex_entry.method, kCompMethodDeflate);
+    EXPECT_LT(dex_entry.comp_size, dex.size());
+    EXPECT_EQ(contents_of(reader, dex_entry), dex);
+    // Stored entries start aligned, shared libraries on a page. The mapping
+    // itself is page aligned.
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(reader.entries()[0].data) % 4, 0);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(reader.entries()[2].data) % 4096, 0);
+    EXPECT_EQ(contents_of(reader, reader.entries()[2]), lib);
+
+    write_archive(second, reader.entries(), false);
+  }
+
+  zip::Reader first_reader(first);
+  zip::Reader second_reader(second);
+  ASSERT_EQ(second_reader.entries().size(), 3);
+  for (size_t i = 0; i < 3; ++i) {
+    const auto& a = first_reader.entries()[i];
+    const auto& b = second_reader.entries()[i];
+    EXPECT_EQ(a.name, b.name);
+    EXPECT_EQ(a.crc32, b.crc32);
+    ASSERT_EQ(a.comp_size, b.comp_size);
+    EXPECT_EQ(memcmp(a.data, b.data, a.comp_size), 0);
+  }
+  boost::filesystem::remove_all(dir);
+}
+
+TEST(ZipArchiveTest, storedDexesArePageAligned) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path("zip-%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  auto path = (dir / "out.apk").string();
+  auto report_path = (dir / "report.txt").string();
+
+  EXPECT_TRUE(zip::is_root_dex("classes.dex"));
+  EXPECT_TRUE(zip::is_root_dex("classes12.dex"));
+  EXPECT_FALSE(zip::is_root_dex("assets/secondary/classes.dex"));
+  EXPECT_FALSE(zip::is_root_dex("classes.jar"));
+
+  std::string dex(5000, 'd');
+  std::vector<std::vector<uint8_t>> storage(3);
+  auto small = zip::compress("AndroidManifest.xml", (const uint8_t*)"x", 1,
+                             kCompMethodStore, 0, &storage[0]);
+  auto stored = zip::compress("classes.dex", (const uint8_t*)dex.data(),
+                              dex.size(), kCompMethodStore, 0, &storage[1]);
+  auto deflated = zip::compress("classes2.dex", (const uint8_t*)dex.data(),
+                                dex.size(), kCompMethodDeflate, 0, &storage[2]);
+
+  zip::Writer writer(path, false, true);
+  writer.add(small);
+  writer.add(stored);
+  writer.add(deflated);
+  writer.finish();
+  {
+    zip::Reader reader(path);
+    ASSERT_EQ(reader.entries().size(), 3);
+    EXPECT_EQ(reader.data_offset(reader.entries()[0]) % 4, 0);
+    EXPECT_NE(reader.data_offset(reader.entries()[0]) % 4096, 0);
+    EXPECT_EQ(reader.data_offset(reader.entries()[1]), 4096);
+    EXPECT_EQ(contents_of(reader, reader.entries()[1]), dex);
+
+    FILE* report = fopen(report_path.c_str(), "w");
+    EXPECT_FALSE(zip::report_dex_alignment(reader, report));
+    fclose(report);
+  }
+  std::ifstream in(report_path);
+  std::string line;
+  std::getline(in, line);
+  EXPECT_EQ(line, "classes.dex\tsize 5000\toffset 4096\tmappable");
+  std::getline(in, line);
+  EXPECT_EQ(line.find("classes2.dex\tsize 5000\toffset "), 0) << line;
+  EXPECT_NE(line.find("\tcompressed"), std::string::npos) << line;
+
+  // Without the option, stored dexes are only aligned like other entries.
+  write_archive(path, {small, stored}, true);
+  zip::Reader reader(path);
+  EXPECT_NE(reader.data_offset(reader.entries()[1]) % 4096, 0);
+  FILE* report = fopen(report_path.c_str(), "w");
+  EXPECT_FALSE(zip::report_dex_alignment(reader, report));
+  fclose(report);
+  std::ifstream misaligned(report_path);
+  std::getline(misaligned, line);
+  EXPECT_NE(line.find("\tmisaligned"), std::string::npos) << line;
+  boost::filesystem::remove_all(dir);
+}
@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "Xz.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <lzma.h>
+
+#include "Debug.h"
+
+namespace xz {
+
+namespace {
+
+// What redex.py passed to xz. At -9, each thread buffers blocks of three
+// times the 64MiB dictionary, so more threads mostly cost memory.
+const uint32_t kMaxThreads = 6;
+
+uint32_t num_threads() {
+  return std::max(1u, std::min(lzma_cputhreads(), kMaxThreads));
+}
+
+} // namespace
+
+std::vector<uint8_t> decompress(const uint8_t* data, size_t size) {
+  lzma_stream stream = LZMA_STREAM_INIT;
+  lzma_mt options;
+  memset(&options, 0, sizeof(options));
+  options.threads = num_threads();
+  options.memlimit_threading = lzma_physmem() / 4;
+  options.memlimit_stop = UINT64_MAX;
+  auto ret = lzma_stream_decoder_mt(&stream, &options);
+  always_assert_log(ret == LZMA_OK, "Cannot initialize the xz decoder: %d\n",
+                    ret);
+
+  std::vector<uint8_t> out(std::max<size_t>(size * 4, 1 << 20));
+  stream.next_in = data;
+  stream.avail_in = size;
+  stream.next_out = out.data();
+  stream.avail_out = out.size();
+  while (true) {
+    ret = lzma_code(&stream, LZMA_FINISH);
+    if (ret == LZMA_STREAM_END) {
+      break;
+    }
+    always_assert_log(ret == LZMA_OK, "Cannot decompress xz data: %d\n", ret);
+    if (stream.avail_out == 0) {
+      auto used = out.size();
+      out.resize(used * 2);
+      stream.next_out = out.data() + used;
+      stream.avail_out = out.size() - used;
+    }
+  }
+  out.resize(stream.total_out);
+  lzma_end(&stream);
+  return out;
+}
+
+void compress(const std::vector<uint8_t>& data,
+              uint32_t preset,
+              const std::string& path) {
+  lzma_stream stream = LZMA_STREAM_INIT;
+  lzma_mt options;
+  memset(&options, 0, sizeof(options));
+  options.threads = num_threads();
+  options.preset = preset;
+  options.check = LZMA_CHECK_CRC32;
+  auto ret = lzma_stream_encoder_mt(&stream, &options);
+  always_assert_log(ret == LZMA_OK, "Cannot initialize the xz encoder: %d\n",
+                    ret);
+
+  FILE* fd = fopen(path.c_str(), "wb");
+  always_assert_log(fd, "Can't open %s for writing\n", path.c_str());
+  std::vector<uint8_t> buffer(1 << 20);
+  stream.next_in = data.data();
+  stream.avail_in = data.size();
+  do {
+    stream.next_out = buffer.data();
+    stream.avail_out = buffer.size();
+    ret = lzma_code(&stream, LZMA_FINISH);
+    always_assert_log(ret == LZMA_OK || ret == LZMA_STREAM_END,
+                      "Cannot compress %s: %d\n", path.c_str(), ret);
+    fwrite(buffer.data(), 1, buffer.size() - stream.avail_out, fd);
+  } while (ret != LZMA_STREAM_END);
+  lzma_end(&stream);
+  always_assert_log(!ferror(fd) && fclose(fd) == 0, "Failed writing %s\n",
+                    path.c_str());
+}
+
+} // namespace xz
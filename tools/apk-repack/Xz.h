@@ -0,0 +1,33 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * .xz compression with liblzma, for the XZS secondary dex format, in place of
+ * running the xz command line tool. Errors are fatal.
+ */
+namespace xz {
+
+// Decompresses a whole .xz stream. Streams made of several blocks, like the
+// ones compress() writes, are decoded on several threads.
+std::vector<uint8_t> decompress(const uint8_t* data, size_t size);
+
+// Compresses data into a .xz file with a CRC32 check, splitting it in blocks
+// that are compressed on several threads. Like `xz -z<preset> --check=crc32`.
+void compress(const std::vector<uint8_t>& data,
+              uint32_t preset,
+              const std::string& path);
+
+} // namespace xz
@@ -0,0 +1,333 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+/*
+ * The APK unpack and repack steps of redex.py, natively:
+ *
+ *   apk-repack unpack <apk> <dir>
+ *     extracts every entry of the APK into dir, inflating entries in
+ *     parallel.
+ *
+ *   apk-repack repack [--page-align] [--store-dexes] <original apk> <dir>
+ *                     <output apk>
+ *     packs dir back up. Files still identical to their entry in the
+ *     original APK are copied over compressed, as they were; changed ones are
+ *     recompressed the way their entry was, and new ones are deflated. Stored
+ *     entries are aligned while writing, so there is no zipalign pass. With
+ *     --store-dexes, the root dexes are stored on pages of their own instead,
+ *     for the runtime to mmap them from the APK.
+ *
+ *   apk-repack xzs-unpack <xzs> <dir> <jar name>:<jar size>...
+ *     decompresses an XZS secondary dex blob (jars concatenated together,
+ *     then xz-compressed) in memory, splits it into the given jars and
+ *     extracts the dex of each jar into dir, named after the jar minus
+ *     ".jar", without writing the jars out.
+ *
+ *   apk-repack xzs-repack [-<preset>] <xzs> <dex>...
+ *     packages each dex into <dex>.jar, in parallel, then concatenates the
+ *     jars and xz-compresses them into xzs with the given preset (9 by
+ *     default).
+ */
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <zlib.h>
+
+#include "Debug.h"
+#include "WorkQueue.h"
+#include "Xz.h"
+#include "ZipArchive.h"
+#include "ZipFormat.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+std::vector<uint8_t> read_file(const fs::path& path) {
+  std::ifstream in(path.string(), std::ios::binary);
+  always_assert_log(in, "Can't open %s\n", path.string().c_str());
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in),
+                              std::istreambuf_iterator<char>());
+}
+
+void write_file(const fs::path& path, const uint8_t* data, size_t size) {
+  FILE* fd = fopen(path.string().c_str(), "wb");
+  always_assert_log(fd, "Can't open %s for writing\n", path.string().c_str());
+  fwrite(data, 1, size, fd);
+  always_assert_log(!ferror(fd) && fclose(fd) == 0, "Failed writing %s\n",
+                    path.string().c_str());
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool is_directory_entry(const zip::Entry& entry) {
+  return !entry.name.empty() && entry.name.back() == '/';
+}
+
+// In the order the entries go into the output.
+std::vector<std::string> files_to_pack(const zip::Reader& original,
+                                       const fs::path& dir) {
+  std::unordered_map<std::string, bool> on_disk;
+  std::vector<std::string> added;
+  for (fs::recursive_directory_iterator it(dir), end; it != end; ++it) {
+    if (!fs::is_regular_file(it->status())) {
+      continue;
+    }
+    auto name = fs::relative(it->path(), dir).generic_string();
+    on_disk.emplace(name, false);
+  }
+  std::vector<std::string> ret;
+  for (const auto& entry : original.entries()) {
+    auto it = on_disk.find(entry.name);
+    if (it != on_disk.end() && !it->second) {
+      it->second = true;
+      ret.push_back(entry.name);
+    }
+  }
+  for (const auto& it : on_disk) {
+    if (!it.second) {
+      added.push_back(it.first);
+    }
+  }
+  std::sort(added.begin(), added.end());
+  ret.insert(ret.end(), added.begin(), added.end());
+  return ret;
+}
+
+int unpack(const std::string& apk, const std::string& dir) {
+  zip::Reader reader(apk);
+  const auto& entries = reader.entries();
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    const auto& entry = entries[i];
+    always_assert_log(entry.name.find("..") == std::string::npos &&
+                          entry.name[0] != '/',
+                      "Refusing to extract %s outside of %s\n",
+                      entry.name.c_str(), dir.c_str());
+    auto path = fs::path(dir) / entry.name;
+    if (is_directory_entry(entry)) {
+      fs::create_directories(path);
+      return;
+    }
+    fs::create_directories(path.parent_path());
+    std::vector<uint8_t> contents(entry.ucomp_size);
+    reader.extract(entry, contents.data());
+    write_file(path, contents.data(), contents.size());
+  });
+  for (size_t i = 0; i < entries.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  return 0;
+}
+
+int repack(const std::string& original_apk,
+           const std::string& dir,
+           const std::string& output_apk,
+           bool page_align,
+           bool store_dexes) {
+  zip::Reader original(original_apk);
+  std::unordered_map<std::string, const zip::Entry*> original_entries;
+  for (const auto& entry : original.entries()) {
+    original_entries.emplace(entry.name, &entry);
+  }
+
+  // Work out, in parallel, what each entry is: the original one verbatim, or
+  // freshly compressed contents.
+  auto names = files_to_pack(original, dir);
+  std::vector<zip::Entry> entries(names.size());
+  std::vector<std::vector<uint8_t>> storage(names.size());
+  std::atomic<size_t> copied{0};
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    const auto& name = names[i];
+    auto path = fs::path(dir) / name;
+    auto contents = read_file(path);
+    auto it = original_entries.find(name);
+    bool store = store_dexes && zip::is_root_dex(name);
+    uint16_t method = store ? kCompMethodStore : kCompMethodDeflate;
+    if (it != original_entries.end()) {
+      const auto& entry = *it->second;
+      if ((!store || entry.method == kCompMethodStore) &&
+          entry.ucomp_size == contents.size() &&
+          entry.crc32 ==
+              crc32(crc32(0L, Z_NULL, 0), contents.data(), contents.size())) {
+        entries[i] = entry;
+        ++copied;
+        return;
+      }
+      if (!store) {
+        method = entry.method;
+      }
+    }
+    entries[i] = zip::compress(name, contents.data(), contents.size(), method,
+                               fs::last_write_time(path), &storage[i]);
+    if (it != original_entries.end()) {
+      entries[i].external_attr = it->second->external_attr;
+    }
+  });
+  for (size_t i = 0; i < names.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  zip::Writer writer(output_apk, page_align, store_dexes);
+  for (const auto& entry : entries) {
+    writer.add(entry);
+  }
+  writer.finish();
+  fprintf(stderr, "Packed %zu entries, %zu of them unchanged\n",
+          entries.size(), copied.load());
+  return 0;
+}
+
+int xzs_unpack(const std::string& xzs,
+               const std::string& dir,
+               const std::vector<std::string>& jar_specs) {
+  std::vector<std::pair<std::string, size_t>> jars;
+  for (const auto& spec : jar_specs) {
+    auto colon = spec.rfind(':');
+    always_assert_log(
+        colon != std::string::npos && ends_with(spec.substr(0, colon), ".jar"),
+        "Expected <name>.jar:<size>, got %s\n", spec.c_str());
+    jars.emplace_back(spec.substr(0, colon),
+                      std::stoull(spec.substr(colon + 1)));
+  }
+
+  boost::iostreams::mapped_file_source file(xzs);
+  auto concat_jar = xz::decompress(
+      reinterpret_cast<const uint8_t*>(file.data()), file.size());
+  std::vector<size_t> offsets;
+  size_t total = 0;
+  for (const auto& jar : jars) {
+    offsets.push_back(total);
+    total += jar.second;
+  }
+  always_assert_log(total == concat_jar.size(),
+                    "The jars of %s add up to %zu bytes, not %zu\n",
+                    xzs.c_str(), total, concat_jar.size());
+
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    const auto& name = jars[i].first;
+    zip::Reader jar(concat_jar.data() + offsets[i], jars[i].second, name);
+    const zip::Entry* dex = nullptr;
+    for (const auto& entry : jar.entries()) {
+      if (ends_with(entry.name, "dex")) {
+        always_assert_log(dex == nullptr, "Expected a single dex in %s\n",
+                          name.c_str());
+        dex = &entry;
+      }
+    }
+    always_assert_log(dex != nullptr, "No dex in %s\n", name.c_str());
+    std::vector<uint8_t> contents(dex->ucomp_size);
+    jar.extract(*dex, contents.data());
+    auto dex_name = name.substr(0, name.size() - strlen(".jar"));
+    write_file(fs::path(dir) / dex_name, contents.data(), contents.size());
+  });
+  for (size_t i = 0; i < jars.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  return 0;
+}
+
+int xzs_repack(const std::string& xzs,
+               uint32_t preset,
+               const std::vector<std::string>& dexes) {
+  // The same jars as unpacker.py's create_dex_jar.
+  static const std::string manifest =
+      "Manifest-Version: 1.0\n"
+      "Dex-Location: classes.dex\n"
+      "Created-By: redex\n\n";
+  auto now = time(nullptr);
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto dex = read_file(dexes[i]);
+    std::vector<uint8_t> dex_storage;
+    std::vector<uint8_t> manifest_storage;
+    zip::Writer writer(dexes[i] + ".jar", /* page_align */ false);
+    writer.add(zip::compress("classes.dex", dex.data(), dex.size(),
+                             kCompMethodStore, now, &dex_storage));
+    writer.add(zip::compress(
+        "/META-INF/MANIFEST.MF",
+        reinterpret_cast<const uint8_t*>(manifest.data()), manifest.size(),
+        kCompMethodStore, now, &manifest_storage));
+    writer.finish();
+  });
+  for (size_t i = 0; i < dexes.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  std::vector<uint8_t> concat_jar;
+  for (const auto& dex : dexes) {
+    auto jar = read_file(dex + ".jar");
+    concat_jar.insert(concat_jar.end(), jar.begin(), jar.end());
+  }
+  xz::compress(concat_jar, preset, xzs);
+  return 0;
+}
+
+void print_usage() {
+  fprintf(stderr,
+          "Usage: apk-repack unpack <apk> <dir>\n"
+          "       apk-repack repack [--page-align] [--store-dexes] "
+          "<original apk> <dir> <output apk>\n"
+          "       apk-repack xzs-unpack <xzs> <dir> <jar name>:<jar size>...\n"
+          "       apk-repack xzs-repack [-<preset>] <xzs> <dex>...\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  if (args.size() == 3 && args[0] == "unpack") {
+    return unpack(args[1], args[2]);
+  }
+  if (!args.empty() && args[0] == "repack") {
+    bool page_align = false;
+    bool store_dexes = false;
+    while (args.size() > 1) {
+      if (args[1] == "--page-align") {
+        page_align = true;
+      } else if (args[1] == "--store-dexes") {
+        store_dexes = true;
+      } else {
+        break;
+      }
+      args.erase(args.begin() + 1);
+    }
+    if (args.size() == 4) {
+      return repack(args[1], args[2], args[3], page_align, store_dexes);
+    }
+  }
+  if (args.size() >= 3 && args[0] == "xzs-unpack") {
+    return xzs_unpack(args[1], args[2],
+                      std::vector<std::string>(args.begin() + 3, args.end()));
+  }
+  if (!args.empty() && args[0] == "xzs-repack") {
+    uint32_t preset = 9;
+    if (args.size() > 1 && args[1].size() == 2 && args[1][0] == '-' &&
+        isdigit(args[1][1])) {
+      preset = args[1][1] - '0';
+      args.erase(args.begin() + 1);
+    }
+    if (args.size() >= 2) {
+      return xzs_repack(args[1], preset,
+                        std::vector<std::string>(args.begin() + 2, args.end()));
+    }
+  }
+  print_usage();
+  return 1;
+}
@@ -63,6 +63,16 @@ void open_dex_file(const char* filename, ddump_data* rd) {
     fprintf(stderr, "Address space allocation failed for mmap, bailing\n");
     exit(1);
   }
+  open_dex_buffer(rd->dexmmap, rd->dex_size, filename, rd);
+}
+
+void open_dex_buffer(char* buffer,
+                     ssize_t size,
+                     const char* name,
+                     ddump_data* rd) {
+  rd->dex_filename = name;
+  rd->dex_size = size;
+  rd->dexmmap = buffer;
   rd->dexh = (dex_header*)rd->dexmmap;
   if (memcmp(rd->dexh->magic, dex_header_string, sizeof(rd->dexh->magic))) {
     fprintf(stderr, "Bad dex magic, bailing\n");
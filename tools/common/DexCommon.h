@@ -36,6 +36,12 @@ void get_dex_map_items(ddump_data* rd,
                        dex_map_item** _maps);
 dex_map_item* get_dex_map_item(ddump_data* rd, uint16_t type);
 void open_dex_file(const char* filename, ddump_data* rd);
+// Like open_dex_file, for a dex already in memory, e.g. inflated from an APK.
+// The buffer must outlive rd.
+void open_dex_buffer(char* buffer,
+                     ssize_t size,
+                     const char* name,
+                     ddump_data* rd);
 void get_type_extent(ddump_data* rd,
                      uint16_t type,
                      uint32_t& start,
@@ -7,13 +7,14 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
-#include <boost/scope_exit.hpp>
+#include <cstring>
 #include <fcntl.h>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "PositionMap.h"
 
@@ -30,18 +31,20 @@ std::unique_ptr<PositionMap> read_map(const char* filename) {
               << ") with error: " << strerror(errno) << std::endl;
     return nullptr;
   }
-  uint8_t* mapping = (uint8_t*)mmap(
+  void* base = mmap(
       nullptr, buf.st_size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
-  uint32_t magic = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  if (mapping == MAP_FAILED) {
+  close(fd);
+  if (base == MAP_FAILED) {
     std::cerr << "mmap failed for file (" << filename
               << ") with error: " << strerror(errno) << std::endl;
     return nullptr;
   }
-  BOOST_SCOPE_EXIT_ALL(=, &buf) {
-    munmap(mapping, buf.st_size);
-  };
+  std::unique_ptr<PositionMap> map(new PositionMap());
+  map->m_mapping = base;
+  map->m_mapping_size = buf.st_size;
+  const uint8_t* mapping = (const uint8_t*)base;
+  uint32_t magic = *(uint32_t*)mapping;
+  mapping += sizeof(uint32_t);
   if (magic != 0xfaceb000) {
     std::cerr << "Magic number mismatch\n";
     return nullptr;
@@ -53,10 +56,9 @@ std::unique_ptr<PositionMap> read_map(const char* filename) {
     return nullptr;
   }
 
-  std::unique_ptr<PositionMap> map(new PositionMap());
-  std::vector<std::string> string_pool;
   uint32_t spool_count = *(uint32_t*)mapping;
   mapping += sizeof(uint32_t);
+  map->string_pool.reserve(spool_count);
   for (uint32_t i = 0; i < spool_count; ++i) {
     uint32_t ssize = *(uint32_t*)mapping;
     mapping += sizeof(uint32_t);
@@ -65,12 +67,17 @@ std::unique_ptr<PositionMap> read_map(const char* filename) {
   }
   uint32_t pos_count = *(uint32_t*)mapping;
   mapping += sizeof(uint32_t);
-  map->positions.reset(new PositionItem[pos_count]);
+  map->positions = (const PositionItem*)mapping;
   map->positions_size = pos_count;
-  memcpy(map->positions.get(), mapping, pos_count * sizeof(PositionItem));
   return map;
 }
 
+PositionMap::~PositionMap() {
+  if (m_mapping != nullptr) {
+    munmap(m_mapping, m_mapping_size);
+  }
+}
+
 std::vector<Position> get_stack(const PositionMap& map, int64_t idx) {
   std::vector<Position> stack;
   while (idx >= 0 && (size_t)idx < map.positions_size) {
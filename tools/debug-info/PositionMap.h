@@ -31,10 +31,25 @@ struct Position {
       : cls(cls), method(method), filename(filename), line(line) {}
 };
 
+/*
+ * The positions point straight into the mapped file, which stays mapped for
+ * the life of the map, so a long-running symbolicator only pays for the
+ * string pool up front.
+ */
 struct PositionMap {
   std::vector<std::string> string_pool;
-  std::unique_ptr<PositionItem[]> positions;
-  size_t positions_size;
+  const PositionItem* positions{nullptr};
+  size_t positions_size{0};
+
+  PositionMap() = default;
+  PositionMap(const PositionMap&) = delete;
+  PositionMap& operator=(const PositionMap&) = delete;
+  ~PositionMap();
+
+ private:
+  friend std::unique_ptr<PositionMap> read_map(const char* filename);
+  void* m_mapping{nullptr};
+  size_t m_mapping_size{0};
 };
 
 std::unique_ptr<PositionMap> read_map(const char* filename);
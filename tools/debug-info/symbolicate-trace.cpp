@@ -7,31 +7,200 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <atomic>
 #include <boost/regex.hpp>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "PositionMap.h"
 
-boost::regex trace_regex(R"/((\s+at\s+[^(]*)\(:(\d+)\)\s?)/");
+const boost::regex trace_regex(R"/((\s+at\s+[^(]*)\(:(\d+)\)\s?)/");
 
-int main(int argc, char** argv) {
-  if (argc < 2) {
-    std::cerr << "Usage: cat trace | remap mapping_file\n";
-    abort();
+/*
+ * Appends the symbolicated form of one line of a trace to out. Only reads the
+ * map, so any number of traces can be symbolicated against it at once.
+ */
+void symbolicate_line(const PositionMap& map,
+                      const std::string& line,
+                      std::string& out) {
+  boost::smatch matches;
+  if (boost::regex_match(line, matches, trace_regex)) {
+    auto idx = std::stoll(matches[2]) - 1;
+    auto stack = get_stack(map, idx);
+    for (const auto& pos : stack) {
+      out += matches[1];
+      out += "(";
+      out += pos.filename;
+      out += ":";
+      out += std::to_string(pos.line);
+      out += ")\n";
+    }
+  } else {
+    out += line;
+    out += "\n";
   }
-  auto map = read_map(argv[1]);
-  for (std::string line; std::getline(std::cin, line);) {
-    boost::smatch matches;
-    if (boost::regex_match(line, matches, trace_regex)) {
-      auto idx = std::stoi(matches[2]) - 1;
-      auto stack = get_stack(*map, idx);
-      for (auto pos : stack) {
-        std::cout << matches[1] << "(" << pos.filename << ":" << pos.line
-                  << ")" << std::endl;
+}
+
+void symbolicate_stream(const PositionMap& map,
+                        std::istream& in,
+                        std::ostream& out) {
+  std::string buf;
+  for (std::string line; std::getline(in, line);) {
+    buf.clear();
+    symbolicate_line(map, line, buf);
+    out << buf;
+  }
+  out.flush();
+}
+
+/*
+ * Symbolicates each trace file into <file>.symbolicated, spreading the files
+ * over as many threads as there are cores.
+ */
+int symbolicate_files(const PositionMap& map,
+                      const std::vector<std::string>& files) {
+  std::atomic<size_t> next{0};
+  std::atomic<bool> ok{true};
+  auto worker = [&]() {
+    for (size_t i = next++; i < files.size(); i = next++) {
+      std::ifstream in(files[i]);
+      std::ofstream out(files[i] + ".symbolicated");
+      if (!in || !out) {
+        std::cerr << "Cannot symbolicate " << files[i] << "\n";
+        ok = false;
+        continue;
       }
-    } else {
-      std::cout << line << std::endl;
+      symbolicate_stream(map, in, out);
+    }
+  };
+  auto jobs = std::max(
+      1u, std::min<unsigned>(std::thread::hardware_concurrency(), files.size()));
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < jobs; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return ok ? 0 : 1;
+}
+
+bool write_all(int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    auto n = write(fd, data.data() + written, data.size() - written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+/*
+ * Symbolicates a trace sent over a connection, writing each frame back as
+ * soon as its line is complete, until the client shuts down its side.
+ */
+void serve_connection(const PositionMap& map, int fd) {
+  std::string pending;
+  std::string out;
+  char buf[64 * 1024];
+  while (true) {
+    auto n = read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    pending.append(buf, n);
+    out.clear();
+    size_t start = 0;
+    for (size_t nl; (nl = pending.find('\n', start)) != std::string::npos;
+         start = nl + 1) {
+      symbolicate_line(map, pending.substr(start, nl - start), out);
+    }
+    pending.erase(0, start);
+    if (!write_all(fd, out)) {
+      close(fd);
+      return;
     }
   }
+  if (!pending.empty()) {
+    out.clear();
+    symbolicate_line(map, pending, out);
+    write_all(fd, out);
+  }
+  close(fd);
+}
+
+/*
+ * Serves symbolication requests on a unix socket until killed, one thread
+ * per connection, against the one map loaded at startup.
+ */
+int serve(const PositionMap& map, const char* socket_path) {
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    std::cerr << "socket failed with error: " << strerror(errno) << "\n";
+    return 1;
+  }
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path too long: " << socket_path << "\n";
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+  unlink(socket_path);
+  if (bind(sock, (sockaddr*)&addr, sizeof(addr)) || listen(sock, 64)) {
+    std::cerr << "Cannot listen on " << socket_path
+              << " with error: " << strerror(errno) << "\n";
+    return 1;
+  }
+  while (true) {
+    int fd = accept(sock, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "accept failed with error: " << strerror(errno) << "\n";
+      return 1;
+    }
+    std::thread(serve_connection, std::cref(map), fd).detach();
+  }
+}
+
+void print_usage() {
+  std::cerr << "Usage: cat trace | remap mapping_file\n"
+            << "       remap mapping_file trace_file...\n"
+            << "       remap --socket=<path> mapping_file\n";
+}
+
+int main(int argc, char** argv) {
+  const char* socket_path = nullptr;
+  int argi = 1;
+  const char* socket_opt = "--socket=";
+  if (argi < argc && strncmp(argv[argi], socket_opt, strlen(socket_opt)) == 0) {
+    socket_path = argv[argi] + strlen(socket_opt);
+    ++argi;
+  }
+  if (argi >= argc) {
+    print_usage();
+    abort();
+  }
+  auto map = read_map(argv[argi++]);
+  if (!map) {
+    return 1;
+  }
+  if (socket_path != nullptr) {
+    return serve(*map, socket_path);
+  }
+  if (argi < argc) {
+    return symbolicate_files(*map,
+                             std::vector<std::string>(argv + argi, argv + argc));
+  }
+  symbolicate_stream(*map, std::cin, std::cout);
 }
@@ -11,29 +11,112 @@
 #include <cstring>
 #include <cstdlib>
 #include <getopt.h>
+#include <string>
+#include <thread>
+#include <unordered_set>
 
 #include "DexCommon.h"
+#include "DexIndex.h"
 
 void print_usage() {
   fprintf(stderr, "Usage: dexgrep <classname> <dexfile 1> <dexfile 2> ...\n");
+  fprintf(stderr,
+          "       dexgrep --build-index=<index> [--jobs=<n>] "
+          "<dex, apk or directory> ...\n");
+  fprintf(stderr,
+          "       dexgrep --index=<index> [--kind=class|method|string|type] "
+          "<pattern>\n");
+}
+
+static bool parse_kind(const char* name, IndexKind* kind) {
+  static const struct {
+    const char* name;
+    IndexKind kind;
+  } kinds[] = {
+    { "class", IndexKind::CLASS },
+    { "method", IndexKind::METHOD },
+    { "string", IndexKind::STRING },
+    { "type", IndexKind::TYPE },
+  };
+  for (const auto& k : kinds) {
+    if (strcmp(name, k.name) == 0) {
+      *kind = k.kind;
+      return true;
+    }
+  }
+  return false;
+}
+
+static int build_index(const char* index_file,
+                       unsigned jobs,
+                       int argc,
+                       char* argv[]) {
+  std::vector<std::string> paths(argv + optind, argv + argc);
+  auto index = DexIndex::build(paths, jobs);
+  index.save(index_file);
+  fprintf(stderr, "Indexed %zu dexes into %s\n", index.dex_count(),
+          index_file);
+  return 0;
+}
+
+static int query_index(const char* index_file,
+                       IndexKind kind,
+                       bool files_only,
+                       const char* search_str) {
+  auto index = DexIndex::load(index_file);
+  std::unordered_set<std::string> printed;
+  index.grep(kind, search_str,
+             [&](const std::string& dex, const std::string& key) {
+               if (!files_only) {
+                 printf("%s: %s\n", dex.c_str(), key.c_str());
+               } else if (printed.insert(dex).second) {
+                 printf("%s\n", dex.c_str());
+               }
+             });
+  return 0;
 }
 
 int main(int argc, char* argv[]) {
   bool files_only = false;
-  char c;
+  const char* build_index_file = nullptr;
+  const char* index_file = nullptr;
+  IndexKind kind = IndexKind::CLASS;
+  unsigned jobs = std::thread::hardware_concurrency();
+  int c;
   static const struct option options[] = {
     { "files-without-match", no_argument, nullptr, 'l' },
+    { "build-index", required_argument, nullptr, 'b' },
+    { "index", required_argument, nullptr, 'i' },
+    { "kind", required_argument, nullptr, 'k' },
+    { "jobs", required_argument, nullptr, 'j' },
+    { nullptr, 0, nullptr, 0 },
   };
   while ((c = getopt_long(
             argc,
             argv,
-            "hl",
+            "hlb:i:k:j:",
             &options[0],
             nullptr)) != -1) {
     switch (c) {
       case 'l':
         files_only = true;
         break;
+      case 'b':
+        build_index_file = optarg;
+        break;
+      case 'i':
+        index_file = optarg;
+        break;
+      case 'k':
+        if (!parse_kind(optarg, &kind)) {
+          fprintf(stderr, "%s: unknown kind %s\n", argv[0], optarg);
+          print_usage();
+          return 1;
+        }
+        break;
+      case 'j':
+        jobs = atoi(optarg);
+        break;
       case 'h':
         print_usage();
         return 0;
@@ -43,12 +126,25 @@ int main(int argc, char* argv[]) {
     }
   }
 
+  if (index_file != nullptr) {
+    if (optind + 1 != argc) {
+      fprintf(stderr, "%s: expected one pattern\n", argv[0]);
+      print_usage();
+      return 1;
+    }
+    return query_index(index_file, kind, files_only, argv[optind]);
+  }
+
   if (optind == argc) {
     fprintf(stderr, "%s: no dex files given\n", argv[0]);
     print_usage();
     return 1;
   }
 
+  if (build_index_file != nullptr) {
+    return build_index(build_index_file, jobs, argc, argv);
+  }
+
   const char* search_str = argv[optind];
 
   for (int i = optind + 1; i < argc; ++i) {
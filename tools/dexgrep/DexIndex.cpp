@@ -0,0 +1,504 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "DexIndex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <zlib.h>
+
+#include "DexCommon.h"
+
+namespace {
+
+const char kIndexMagic[8] = {'d', 'e', 'x', 'g', 'r', 'e', 'p', '1'};
+
+bool ends_with(const std::string& s, const char* suffix) {
+  auto len = strlen(suffix);
+  return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+/*
+ * A private, writable mapping of a whole file. open_dex_buffer wants a
+ * mutable buffer, and this way the inputs themselves may be read-only.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "Cannot open %s, bailing\n", filename.c_str());
+      exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+      fprintf(stderr, "Cannot fstat file %s, bailing\n", filename.c_str());
+      exit(1);
+    }
+    m_size = st.st_size;
+    if (m_size > 0) {
+      void* map = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                       fd, 0);
+      if (map == MAP_FAILED) {
+        fprintf(stderr, "Cannot mmap %s, bailing\n", filename.c_str());
+        exit(1);
+      }
+      m_data = (char*)map;
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (m_data != nullptr) {
+      munmap(m_data, m_size);
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  char* data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+ private:
+  char* m_data{nullptr};
+  size_t m_size{0};
+};
+
+void collect_files(const std::string& path, std::vector<std::string>& files) {
+  struct stat st;
+  if (stat(path.c_str(), &st)) {
+    fprintf(stderr, "Cannot stat %s, bailing\n", path.c_str());
+    exit(1);
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    files.push_back(path);
+    return;
+  }
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    fprintf(stderr, "Cannot open directory %s, bailing\n", path.c_str());
+    exit(1);
+  }
+  std::vector<std::string> children;
+  while (auto entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    children.push_back(path + "/" + name);
+  }
+  closedir(dir);
+  // Sorted, so that rebuilding an index over the same tree gives the same
+  // file.
+  std::sort(children.begin(), children.end());
+  for (const auto& child : children) {
+    if (stat(child.c_str(), &st) == 0 &&
+        (S_ISDIR(st.st_mode) || ends_with(child, ".dex") ||
+         ends_with(child, ".apk"))) {
+      collect_files(child, files);
+    }
+  }
+}
+
+/*
+ * Zip archive parsing, just enough to find the dexes at the root of an APK.
+ */
+const uint32_t kCDirEndSignature = 0x06054b50;
+const uint32_t kCDFileSignature = 0x02014b50;
+const uint32_t kLFileSignature = 0x04034b50;
+const size_t kCDirEndSize = 22;
+const size_t kCDFileSize = 46;
+const size_t kLFileSize = 30;
+const uint16_t kCompMethodStore = 0;
+const uint16_t kCompMethodDeflate = 8;
+
+uint16_t read_u16(const char* p) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint32_t read_u32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// classes.dex, classes2.dex, ...
+bool is_root_dex(const std::string& name) {
+  const char* prefix = "classes";
+  if (name.compare(0, strlen(prefix), prefix) != 0 ||
+      !ends_with(name, ".dex")) {
+    return false;
+  }
+  return std::all_of(name.begin() + strlen(prefix), name.end() - 4,
+                     [](char c) { return c >= '0' && c <= '9'; });
+}
+
+struct ApkDex {
+  std::string name;
+  // Set for deflated entries; stored ones point straight into the mapping.
+  std::unique_ptr<char[]> storage;
+  char* data;
+  size_t size;
+};
+
+bool inflate_raw(const char* src, size_t src_size, char* dest,
+                 size_t dest_size) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  stream.next_in = (Bytef*)src;
+  stream.avail_in = (uInt)src_size;
+  stream.next_out = (Bytef*)dest;
+  stream.avail_out = (uInt)dest_size;
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    return false;
+  }
+  auto err = inflate(&stream, Z_FINISH);
+  inflateEnd(&stream);
+  return err == Z_STREAM_END && stream.total_out == dest_size;
+}
+
+std::vector<ApkDex> extract_apk_dexes(const std::string& filename,
+                                      const MappedFile& apk) {
+  auto fail = [&](const char* why) {
+    fprintf(stderr, "%s: %s, bailing\n", filename.c_str(), why);
+    exit(1);
+  };
+  const char* base = apk.data();
+  size_t size = apk.size();
+  if (size < kCDirEndSize) {
+    fail("not a zip archive");
+  }
+  // The end of central directory record is followed by a comment of up to
+  // 64k.
+  const char* cdir_end = nullptr;
+  size_t lowest = size > kCDirEndSize + 0xffff ? size - kCDirEndSize - 0xffff
+                                               : 0;
+  for (size_t off = size - kCDirEndSize + 1; off-- > lowest;) {
+    if (read_u32(base + off) == kCDirEndSignature) {
+      cdir_end = base + off;
+      break;
+    }
+  }
+  if (cdir_end == nullptr) {
+    fail("end of central directory record not found");
+  }
+  uint16_t entries = read_u16(cdir_end + 10);
+  uint32_t cd_offset = read_u32(cdir_end + 16);
+  std::vector<ApkDex> dexes;
+  const char* cd = base + cd_offset;
+  for (uint16_t i = 0; i < entries; ++i) {
+    if ((size_t)(cd - base) + kCDFileSize > size ||
+        read_u32(cd) != kCDFileSignature) {
+      fail("invalid central directory entry");
+    }
+    uint16_t method = read_u16(cd + 10);
+    uint32_t comp_size = read_u32(cd + 20);
+    uint32_t ucomp_size = read_u32(cd + 24);
+    uint16_t fname_len = read_u16(cd + 28);
+    uint16_t extra_len = read_u16(cd + 30);
+    uint16_t comment_len = read_u16(cd + 32);
+    uint32_t lfile_offset = read_u32(cd + 42);
+    std::string name(cd + kCDFileSize, fname_len);
+    cd += kCDFileSize + fname_len + extra_len + comment_len;
+    if (!is_root_dex(name)) {
+      continue;
+    }
+    const char* lfile = base + lfile_offset;
+    if (lfile_offset + kLFileSize > size ||
+        read_u32(lfile) != kLFileSignature) {
+      fail("invalid local file header");
+    }
+    const char* contents =
+        lfile + kLFileSize + read_u16(lfile + 26) + read_u16(lfile + 28);
+    if ((size_t)(contents - base) + comp_size > size) {
+      fail("truncated entry");
+    }
+    ApkDex dex;
+    dex.name = filename + "!" + name;
+    dex.size = ucomp_size;
+    if (method == kCompMethodStore) {
+      dex.data = const_cast<char*>(contents);
+    } else if (method == kCompMethodDeflate) {
+      dex.storage.reset(new char[ucomp_size]);
+      dex.data = dex.storage.get();
+      if (!inflate_raw(contents, comp_size, dex.data, ucomp_size)) {
+        fail("cannot inflate dex");
+      }
+    } else {
+      fail("unknown compression method");
+    }
+    dexes.push_back(std::move(dex));
+  }
+  return dexes;
+}
+
+struct DexKeys {
+  std::string name;
+  std::vector<std::string> keys[kIndexKinds];
+};
+
+std::string method_key(ddump_data* rd, uint32_t idx) {
+  dex_method_id* method = rd->dex_method_ids + idx;
+  dex_proto_id* proto = rd->dex_proto_ids + method->protoidx;
+  std::string ret = dex_string_by_type_idx(rd, method->classidx);
+  ret += ".";
+  ret += dex_string_by_idx(rd, method->nameidx);
+  ret += ":(";
+  if (proto->param_off) {
+    uint32_t* tl = (uint32_t*)(rd->dexmmap + proto->param_off);
+    uint32_t count = *tl++;
+    uint16_t* types = (uint16_t*)tl;
+    for (uint32_t i = 0; i < count; i++) {
+      ret += dex_string_by_type_idx(rd, types[i]);
+    }
+  }
+  ret += ")";
+  ret += dex_string_by_type_idx(rd, proto->rtypeidx);
+  return ret;
+}
+
+// Each table of a dex is free of duplicates, so its keys need no uniquing.
+DexKeys index_dex(const std::string& name, char* data, size_t size) {
+  ddump_data rd;
+  open_dex_buffer(data, size, name.c_str(), &rd);
+  DexKeys dk;
+  dk.name = name;
+  auto& classes = dk.keys[(size_t)IndexKind::CLASS];
+  classes.reserve(rd.dexh->class_defs_size);
+  for (uint32_t i = 0; i < rd.dexh->class_defs_size; i++) {
+    classes.emplace_back(
+        dex_string_by_type_idx(&rd, rd.dex_class_defs[i].typeidx));
+  }
+  auto& methods = dk.keys[(size_t)IndexKind::METHOD];
+  methods.reserve(rd.dexh->method_ids_size);
+  for (uint32_t i = 0; i < rd.dexh->method_ids_size; i++) {
+    methods.push_back(method_key(&rd, i));
+  }
+  auto& strings = dk.keys[(size_t)IndexKind::STRING];
+  strings.reserve(rd.dexh->string_ids_size);
+  for (uint32_t i = 0; i < rd.dexh->string_ids_size; i++) {
+    strings.emplace_back(dex_string_by_idx(&rd, i));
+  }
+  auto& types = dk.keys[(size_t)IndexKind::TYPE];
+  types.reserve(rd.dexh->type_ids_size);
+  for (uint32_t i = 0; i < rd.dexh->type_ids_size; i++) {
+    types.emplace_back(dex_string_by_type_idx(&rd, i));
+  }
+  return dk;
+}
+
+std::vector<DexKeys> index_file(const std::string& filename) {
+  MappedFile file(filename);
+  std::vector<DexKeys> ret;
+  if (ends_with(filename, ".apk")) {
+    for (auto& dex : extract_apk_dexes(filename, file)) {
+      ret.push_back(index_dex(dex.name, dex.data, dex.size));
+    }
+  } else {
+    ret.push_back(index_dex(filename, file.data(), file.size()));
+  }
+  return ret;
+}
+
+/*
+ * Reads the index back, bailing out on anything that runs past its end.
+ */
+class IndexReader {
+ public:
+  IndexReader(const std::string& filename, const char* data, size_t size)
+      : m_filename(filename), m_cur(data), m_end(data + size) {}
+
+  uint32_t read_u32() {
+    need(sizeof(uint32_t));
+    auto ret = ::read_u32(m_cur);
+    m_cur += sizeof(uint32_t);
+    return ret;
+  }
+
+  std::string read_string() {
+    auto len = read_u32();
+    need(len);
+    std::string ret(m_cur, len);
+    m_cur += len;
+    return ret;
+  }
+
+  void read_magic() {
+    need(sizeof(kIndexMagic));
+    if (memcmp(m_cur, kIndexMagic, sizeof(kIndexMagic))) {
+      fprintf(stderr, "%s is not a dexgrep index, bailing\n",
+              m_filename.c_str());
+      exit(1);
+    }
+    m_cur += sizeof(kIndexMagic);
+  }
+
+ private:
+  void need(size_t bytes) {
+    if ((size_t)(m_end - m_cur) < bytes) {
+      fprintf(stderr, "Index %s is truncated, bailing\n", m_filename.c_str());
+      exit(1);
+    }
+  }
+
+  const std::string& m_filename;
+  const char* m_cur;
+  const char* m_end;
+};
+
+void write_u32(FILE* fd, uint32_t v) { fwrite(&v, sizeof(v), 1, fd); }
+
+void write_string(FILE* fd, const std::string& s) {
+  write_u32(fd, s.size());
+  fwrite(s.data(), 1, s.size(), fd);
+}
+
+} // namespace
+
+DexIndex DexIndex::build(const std::vector<std::string>& paths,
+                         unsigned jobs) {
+  std::vector<std::string> files;
+  for (const auto& path : paths) {
+    collect_files(path, files);
+  }
+
+  // Files are handed out one at a time, as APKs vary a lot in size. The
+  // results go into per-file slots so the dex order doesn't depend on the
+  // scheduling.
+  std::vector<std::vector<DexKeys>> results(files.size());
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < files.size(); i = next++) {
+      results[i] = index_file(files[i]);
+    }
+  };
+  std::vector<std::thread> threads;
+  jobs = std::max(1u, std::min<unsigned>(jobs, files.size()));
+  for (unsigned i = 0; i < jobs; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  DexIndex index;
+  std::unordered_map<std::string, std::vector<uint32_t>> merged[kIndexKinds];
+  for (auto& file_result : results) {
+    for (auto& dk : file_result) {
+      uint32_t id = index.m_dexes.size();
+      index.m_dexes.push_back(std::move(dk.name));
+      for (size_t kind = 0; kind < kIndexKinds; ++kind) {
+        for (auto& key : dk.keys[kind]) {
+          merged[kind][std::move(key)].push_back(id);
+        }
+      }
+    }
+    file_result.clear();
+  }
+  for (size_t kind = 0; kind < kIndexKinds; ++kind) {
+    auto& postings = index.m_postings[kind];
+    postings.reserve(merged[kind].size());
+    for (auto& entry : merged[kind]) {
+      postings.emplace_back(entry.first, std::move(entry.second));
+    }
+    merged[kind].clear();
+    std::sort(postings.begin(), postings.end(),
+              [](const Postings::value_type& a, const Postings::value_type& b) {
+                return a.first < b.first;
+              });
+  }
+  return index;
+}
+
+/*
+ * The index file is the dex names, then per kind the keys with their
+ * posting lists. Sizes and dex indices are 32-bit, strings are
+ * length-prefixed.
+ */
+void DexIndex::save(const std::string& filename) const {
+  FILE* fd = fopen(filename.c_str(), "wb");
+  if (fd == nullptr) {
+    fprintf(stderr, "Cannot write index %s, bailing\n", filename.c_str());
+    exit(1);
+  }
+  fwrite(kIndexMagic, 1, sizeof(kIndexMagic), fd);
+  write_u32(fd, m_dexes.size());
+  for (const auto& dex : m_dexes) {
+    write_string(fd, dex);
+  }
+  for (size_t kind = 0; kind < kIndexKinds; ++kind) {
+    write_u32(fd, m_postings[kind].size());
+    for (const auto& entry : m_postings[kind]) {
+      write_string(fd, entry.first);
+      write_u32(fd, entry.second.size());
+      fwrite(entry.second.data(), sizeof(uint32_t), entry.second.size(), fd);
+    }
+  }
+  if (ferror(fd) | fclose(fd)) {
+    fprintf(stderr, "Failed writing index %s, bailing\n", filename.c_str());
+    exit(1);
+  }
+}
+
+DexIndex DexIndex::load(const std::string& filename) {
+  MappedFile file(filename);
+  IndexReader reader(filename, file.data(), file.size());
+  reader.read_magic();
+  DexIndex index;
+  auto dex_count = reader.read_u32();
+  index.m_dexes.reserve(dex_count);
+  for (uint32_t i = 0; i < dex_count; ++i) {
+    index.m_dexes.push_back(reader.read_string());
+  }
+  for (size_t kind = 0; kind < kIndexKinds; ++kind) {
+    auto& postings = index.m_postings[kind];
+    postings.resize(reader.read_u32());
+    for (auto& entry : postings) {
+      entry.first = reader.read_string();
+      entry.second.resize(reader.read_u32());
+      for (auto& id : entry.second) {
+        id = reader.read_u32();
+        if (id >= dex_count) {
+          fprintf(stderr, "Index %s is corrupt, bailing\n", filename.c_str());
+          exit(1);
+        }
+      }
+    }
+  }
+  return index;
+}
+
+void DexIndex::grep(
+    IndexKind kind,
+    const char* pattern,
+    const std::function<void(const std::string&, const std::string&)>& fn)
+    const {
+  for (const auto& entry : m_postings[(size_t)kind]) {
+    if (strstr(entry.first.c_str(), pattern) == nullptr) {
+      continue;
+    }
+    for (auto id : entry.second) {
+      fn(m_dexes[id], entry.first);
+    }
+  }
+}
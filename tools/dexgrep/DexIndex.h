@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class IndexKind : uint8_t {
+  CLASS, // Classes defined by the dex
+  METHOD, // Methods defined or referenced, as Lcls;.name:(args)ret
+  STRING, // Every string in the string table
+  TYPE, // Every type the dex refers to
+};
+
+constexpr size_t kIndexKinds = 4;
+
+/*
+ * An inverted index from the classes, methods, strings and types of a set of
+ * dexes to the dexes containing them, so that a query scans the distinct keys
+ * once instead of rescanning every dex.
+ *
+ * Dexes are named by their path, or as path/to.apk!classes2.dex for the
+ * dexes at the root of an APK.
+ */
+class DexIndex {
+ public:
+  /*
+   * Indexes the given dexes and APKs, and every dex and APK below the given
+   * directories, spreading the files over `jobs` threads.
+   */
+  static DexIndex build(const std::vector<std::string>& paths, unsigned jobs);
+
+  static DexIndex load(const std::string& filename);
+  void save(const std::string& filename) const;
+
+  /*
+   * Calls fn(dex, key) for every dex holding a key of the given kind that
+   * contains pattern, in key order.
+   */
+  void grep(IndexKind kind,
+            const char* pattern,
+            const std::function<void(const std::string&, const std::string&)>&
+                fn) const;
+
+  size_t dex_count() const { return m_dexes.size(); }
+
+ private:
+  using Postings = std::vector<std::pair<std::string, std::vector<uint32_t>>>;
+
+  std::vector<std::string> m_dexes;
+  // Per kind, the keys in sorted order, each with the indices into m_dexes
+  // of the dexes containing it.
+  Postings m_postings[kIndexKinds];
+};
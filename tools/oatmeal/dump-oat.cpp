@@ -23,6 +23,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <numeric>
 #include <string>
 #include <vector>
 
@@ -808,10 +809,10 @@ struct OatDexFileRecord {
         dex_file_checksum(file_checksum),
         dex_file_offset(file_offset) {}
 
-  uint32_t location_size;
+  uint32_t location_size = 0;
   std::string location_data;
-  uint32_t dex_file_checksum;
-  uint32_t dex_file_offset;
+  uint32_t dex_file_checksum = 0;
+  uint32_t dex_file_offset = 0;
 
   static OatDexFileRecord build(const DexInput& dex, uint32_t& next_offset);
   static void write(FileHandle& oat_fh, const OatDexFileRecord& record);
@@ -1163,6 +1164,15 @@ class OatClasses_079 : public OatClasses {
       FileHandle& cksum_fh);
 
  protected:
+  // Reads the class listing of every dex file, all at once. The class names
+  // come from dex_buf, the rest from oat_buf.
+  static std::vector<DexClasses> read_classes(
+      const DexFileListing_079& dex_file_listing,
+      const DexFiles& dex_files,
+      ConstBuffer oat_buf,
+      ConstBuffer dex_buf,
+      bool only_uncompiled);
+
   std::vector<DexClasses> classes_;
 };
 
@@ -1179,39 +1189,9 @@ OatClasses_124::OatClasses_124(const DexFileListing_079& dex_file_listing,
                                const DexFiles& dex_files,
                                ConstBuffer oat_buf,
                                ConstBuffer dex_buf) {
-  foreach_pair(dex_file_listing.dex_files(),
-               dex_files.headers(),
-               [&](const DexFileListing_079::DexFile_079& listing,
-                   const DexFileHeader& header) {
-
-                 auto classes_offset = listing.classes_offset;
-
-                 DexClasses dex_classes;
-                 dex_classes.dex_file = listing.location;
-
-                 DexIdBufs id_bufs(dex_buf, listing.file_offset, header);
-
-                 // classes_offset points to an array of pointers (offsets) to
-                 // ClassInfo
-                 for (unsigned int i = 0; i < header.class_defs_size; i++) {
-
-                   ClassInfo info;
-                   uint32_t info_offset;
-                   cur_ma()->memcpyAndMark(
-                       &info_offset,
-                       oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
-                       sizeof(uint32_t));
-                   cur_ma()->memcpyAndMark(&info,
-                                           oat_buf.slice(info_offset).ptr,
-                                           sizeof(ClassInfo));
-
-                   // TODO: Handle compiled classes. Need to read method bitmap
-                   // size, and method bitmap.
-                   dex_classes.class_info.push_back(info);
-                   dex_classes.class_names.push_back(id_bufs.get_class_name(i));
-                 }
-                 classes_.push_back(dex_classes);
-               });
+  // TODO: Handle compiled classes. Need to read method bitmap size, and
+  // method bitmap.
+  classes_ = read_classes(dex_file_listing, dex_files, oat_buf, dex_buf, false);
 }
 
 class OatClasses_064 : public OatClasses {
@@ -1234,43 +1214,69 @@ class OatClasses_064 : public OatClasses {
 
 OatClasses_079::OatClasses_079(const DexFileListing_079& dex_file_listing,
                                const DexFiles& dex_files,
-                               ConstBuffer oat_buf) {
-  foreach_pair(
-      dex_file_listing.dex_files(),
-      dex_files.headers(),
-      [&](const DexFileListing_079::DexFile_079& listing,
-          const DexFileHeader& header) {
-
-        auto classes_offset = listing.classes_offset;
-
-        DexClasses dex_classes;
-        dex_classes.dex_file = listing.location;
-
-        DexIdBufs id_bufs(oat_buf, listing.file_offset, header);
-
-        // classes_offset points to an array of pointers (offsets) to
-        // ClassInfo
-        for (unsigned int i = 0; i < header.class_defs_size; i++) {
-
-          ClassInfo info;
-          uint32_t info_offset;
-          cur_ma()->memcpyAndMark(
-              &info_offset,
-              oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
-              sizeof(uint32_t));
-          cur_ma()->memcpyAndMark(
-              &info, oat_buf.slice(info_offset).ptr, sizeof(ClassInfo));
-
-          // TODO: Handle compiled classes. Need to read method bitmap size,
-          // and method bitmap.
-          CHECK(info.type == static_cast<uint16_t>(Type::kOatClassNoneCompiled),
-                "Parsing for compiled classes not implemented");
+                               ConstBuffer oat_buf)
+    : classes_(read_classes(
+          dex_file_listing, dex_files, oat_buf, oat_buf, true)) {}
+
+std::vector<OatClasses_079::DexClasses> OatClasses_079::read_classes(
+    const DexFileListing_079& dex_file_listing,
+    const DexFiles& dex_files,
+    ConstBuffer oat_buf,
+    ConstBuffer dex_buf,
+    bool only_uncompiled) {
+  const auto& listings = dex_file_listing.dex_files();
+  const auto& headers = dex_files.headers();
+  CHECK(listings.size() == headers.size());
+
+  struct Listing {
+    DexClasses classes;
+    std::vector<uint32_t> info_offsets;
+  };
+  std::vector<size_t> indices(listings.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  // The memory accounter isn't thread-safe, so the listings are read with
+  // plain copies and the bytes they span are marked consumed afterwards.
+  auto listings_read = map_in_parallel(indices, [&](size_t d) {
+    const auto& listing = listings[d];
+    const auto& header = headers[d];
+    Listing ret;
+    ret.classes.dex_file = listing.location;
+
+    DexIdBufs id_bufs(dex_buf, listing.file_offset, header);
+
+    // classes_offset points to an array of pointers (offsets) to ClassInfo
+    for (unsigned int i = 0; i < header.class_defs_size; i++) {
+      ClassInfo info;
+      uint32_t info_offset;
+      memcpy(&info_offset,
+             oat_buf.slice(listing.classes_offset + i * sizeof(uint32_t)).ptr,
+             sizeof(uint32_t));
+      memcpy(&info, oat_buf.slice(info_offset).ptr, sizeof(ClassInfo));
+
+      CHECK(!only_uncompiled ||
+                info.type ==
+                    static_cast<uint16_t>(Type::kOatClassNoneCompiled),
+            "Parsing for compiled classes not implemented");
+
+      ret.info_offsets.push_back(info_offset);
+      ret.classes.class_info.push_back(info);
+      ret.classes.class_names.push_back(id_bufs.get_class_name(i));
+    }
+    return ret;
+  });
 
-          dex_classes.class_info.push_back(info);
-          dex_classes.class_names.push_back(id_bufs.get_class_name(i));
-        }
-        classes_.push_back(dex_classes);
-      });
+  std::vector<DexClasses> classes;
+  for (size_t d = 0; d < listings.size(); d++) {
+    cur_ma()->markRangeConsumed(
+        oat_buf.slice(listings[d].classes_offset).ptr,
+        headers[d].class_defs_size * sizeof(uint32_t));
+    for (auto info_offset : listings_read[d].info_offsets) {
+      cur_ma()->markRangeConsumed(oat_buf.slice(info_offset).ptr,
+                                  sizeof(ClassInfo));
+    }
+    classes.push_back(std::move(listings_read[d].classes));
+  }
+  return classes;
 }
 
 void OatClasses_079::print() {
@@ -1426,34 +1432,34 @@ class LookupTables {
       const std::vector<DexInput>& dex_input_vec,
       const std::vector<DexFileListing_079::DexFile_079>& dex_files,
       FileHandle& cksum_fh) {
+    auto tables =
+        map_in_parallel(dex_input_vec, [](const DexInput& dex_input) {
+          return build_lookup_table(dex_input.filename);
+        });
     foreach_pair(
-        dex_input_vec,
+        tables,
         dex_files,
-        [&](const DexInput& dex_input,
+        [&](const std::vector<LookupTableEntry>& table,
             const DexFileListing_079::DexFile_079& dex_file) {
           CHECK(dex_file.lookup_table_offset == cksum_fh.bytes_written());
-          const auto num_classes = dex_file.num_classes;
-
-          const auto lookup_table_size = numEntries(num_classes);
-          const auto lookup_table_byte_size =
-              lookup_table_size * sizeof(LookupTableEntry);
-
-          auto lookup_table_buf =
-              build_lookup_table(dex_input.filename, lookup_table_size);
-          auto buf =
-              ConstBuffer{reinterpret_cast<const char*>(lookup_table_buf.get()),
-                          lookup_table_byte_size};
-          write_buf(cksum_fh, buf);
+          CHECK(table.size() == numEntries(dex_file.num_classes));
+          write_vec(cksum_fh, table);
         });
   }
 
  private:
-  static uint32_t hash_str(const std::string& str) {
+  // Hashes the string whose string_data_item starts at string_data, skipping
+  // the uleb128 length.
+  static uint32_t hash_str(ConstBuffer string_data) {
+    size_t i = 0;
+    while (string_data[i] & 0x80) {
+      i++;
+    }
+    i++;
     uint32_t hash = 0;
-    const char* chars = str.c_str();
-    while (*chars != '\0') {
-      hash = hash * 31 + *chars;
-      chars++;
+    while (string_data[i] != '\0') {
+      hash = hash * 31 + string_data[i];
+      i++;
     }
     return hash;
   }
@@ -1500,50 +1506,43 @@ class LookupTables {
     table[next_pos].next_pos_delta = 0;
   }
 
-  static std::unique_ptr<LookupTableEntry[]> build_lookup_table(
-      const std::string& filename, uint32_t lookup_table_size) {
-
-    std::unique_ptr<LookupTableEntry[]> table_buf(
-        new LookupTableEntry[lookup_table_size]);
-    memset(table_buf.get(), 0, lookup_table_size * sizeof(LookupTableEntry));
+  static std::vector<LookupTableEntry> build_lookup_table(
+      const std::string& filename) {
 
-    auto dex_fh = FileHandle(fopen(filename.c_str(), "r"));
+    MappedFile dex_file(filename);
+    auto dex_buf = dex_file.buffer();
 
     DexFileHeader header = {};
-    CHECK(dex_fh.fread(&header, sizeof(DexFileHeader), 1) == 1);
+    CHECK(dex_buf.len >= sizeof(DexFileHeader));
+    memcpy(&header, dex_buf.ptr, sizeof(DexFileHeader));
 
     const auto num_classes = header.class_defs_size;
+    const auto lookup_table_size = numEntries(num_classes);
     const auto mask = lookup_table_size - 1;
 
-    // TODO: This is probably the most memory hungry part of the whole building
-    // process, but total usage should still be <1MB for all the class strings.
-    // if this proves to be a problem we can build the lookup table with redex
-    // and ship it to the phone.
+    std::vector<LookupTableEntry> table(lookup_table_size);
 
-    // Read type ids array.
+    // The id arrays and the class defs are read in place from the mapping;
+    // the dex format keeps all of them 4-byte aligned.
     const auto num_type_ids = header.type_ids_size;
-    std::unique_ptr<uint32_t[]> typeid_buf(new uint32_t[num_type_ids]);
-    CHECK(dex_fh.seek_set(header.type_ids_off));
-    CHECK(dex_fh.fread(typeid_buf.get(), sizeof(uint32_t), num_type_ids) ==
-          num_type_ids);
+    auto typeids = reinterpret_cast<const uint32_t*>(
+        dex_buf
+            .slice(header.type_ids_off,
+                   header.type_ids_off + num_type_ids * sizeof(uint32_t))
+            .ptr);
 
-    // Read the string ids array.
     const auto num_string_ids = header.string_ids_size;
-    std::unique_ptr<uint32_t[]> stringid_buf(new uint32_t[num_string_ids]);
-    CHECK(dex_fh.seek_set(header.string_ids_off));
-    CHECK(dex_fh.fread(stringid_buf.get(), sizeof(uint32_t), num_string_ids) ==
-          num_string_ids);
-
-    CHECK(dex_fh.seek_set(header.class_defs_off));
-
-    std::unique_ptr<DexClassDef[]> class_defs_buf(new DexClassDef[num_classes]);
-    CHECK(dex_fh.fread(class_defs_buf.get(),
-                       sizeof(DexClassDef),
-                       num_classes) == num_classes);
-
-    constexpr int kClassNameBufSize = 256;
-
-    char class_name_buf[kClassNameBufSize] = {};
+    auto stringids = reinterpret_cast<const uint32_t*>(
+        dex_buf
+            .slice(header.string_ids_off,
+                   header.string_ids_off + num_string_ids * sizeof(uint32_t))
+            .ptr);
+
+    auto class_defs = reinterpret_cast<const DexClassDef*>(
+        dex_buf
+            .slice(header.class_defs_off,
+                   header.class_defs_off + num_classes * sizeof(DexClassDef))
+            .ptr);
 
     struct Retry {
       uint32_t string_offset;
@@ -1554,38 +1553,16 @@ class LookupTables {
     std::vector<Retry> retry_indices;
 
     for (unsigned int i = 0; i < num_classes; i++) {
-      const auto class_idx = class_defs_buf[i].class_idx;
+      const auto class_idx = class_defs[i].class_idx;
       CHECK(class_idx < num_type_ids);
-      const auto string_id = typeid_buf[class_idx];
+      const auto string_id = typeids[class_idx];
       CHECK(string_id < num_string_ids);
-      const auto string_offset = stringid_buf[string_id];
-
-      dex_fh.seek_set(string_offset);
-      auto read_size =
-          dex_fh.fread(class_name_buf, sizeof(char), kClassNameBufSize);
-      CHECK(read_size > 0);
-
-      auto ptr = class_name_buf;
-      const auto str_size = read_uleb128(&ptr) + 1;
-      const auto str_start = ptr - class_name_buf;
-
-      std::string class_name;
-
-      if (str_start + str_size >= kClassNameBufSize) {
-        std::unique_ptr<char[]> large_class_name_buf(new char[str_size]);
-        dex_fh.seek_set(string_offset + str_start);
-        CHECK(dex_fh.fread(large_class_name_buf.get(),
-                           sizeof(char),
-                           str_size) == str_size);
-        class_name = std::string(large_class_name_buf.get(), str_size);
-      } else {
-        class_name = std::string(ptr, str_size);
-      }
+      const auto string_offset = stringids[string_id];
 
-      const auto hash = hash_str(class_name);
+      const auto hash = hash_str(dex_buf.slice(string_offset));
       const auto data = make_lt_data(i, hash, mask);
 
-      if (!insert_no_probe(table_buf.get(),
+      if (!insert_no_probe(table.data(),
                            LookupTableEntry{string_offset, data, 0},
                            hash,
                            mask)) {
@@ -1594,13 +1571,13 @@ class LookupTables {
     }
 
     for (const auto& retry : retry_indices) {
-      insert(table_buf.get(),
+      insert(table.data(),
              LookupTableEntry{retry.string_offset, retry.data, 0},
              retry.hash,
              mask);
     }
 
-    return table_buf;
+    return table;
   }
 
   static bool supportedSize(uint32_t num_class_defs) {
@@ -2186,15 +2163,17 @@ class SamsungLookupTables {
       const std::vector<DexInput>& dex_input_vec,
       const std::vector<DexFileListing_064::DexFile_064>& dex_files,
       FileHandle& cksum_fh) {
+    auto tables =
+        map_in_parallel(dex_input_vec, [](const DexInput& dex_input) {
+          return build_lookup_table(dex_input.filename);
+        });
     foreach_pair(
-        dex_input_vec,
+        tables,
         dex_files,
-        [&](const DexInput& dex_input,
+        [&](const LookupTable& table,
             const DexFileListing_064::DexFile_064& dex_file) {
           CHECK(dex_file.lookup_table_offset == cksum_fh.bytes_written());
 
-          auto table = build_lookup_table(dex_input.filename);
-
           auto buf =
               ConstBuffer{reinterpret_cast<const char*>(table.data.get()),
                           table.byte_size()};
@@ -2229,22 +2208,30 @@ class SamsungLookupTables {
     fprintf(stderr, "Error: ran out of hash table space");
   }
 
-  static uint32_t hash_str(const std::string& str) {
+  // Hashes the string whose string_data_item starts at string_data, skipping
+  // the uleb128 length.
+  static uint32_t hash_str(ConstBuffer string_data) {
+    size_t i = 0;
+    while (string_data[i] & 0x80) {
+      i++;
+    }
+    i++;
     uint32_t hash = 1;
-    const char* chars = str.c_str();
-    while (*chars != '\0') {
-      hash = hash * 31 + *chars;
-      chars++;
+    while (string_data[i] != '\0') {
+      hash = hash * 31 + string_data[i];
+      i++;
     }
     return hash;
   }
 
   static LookupTable build_lookup_table(const std::string& filename) {
 
-    auto dex_fh = FileHandle(fopen(filename.c_str(), "r"));
+    MappedFile dex_file(filename);
+    auto dex_buf = dex_file.buffer();
 
     DexFileHeader header = {};
-    CHECK(dex_fh.fread(&header, sizeof(DexFileHeader), 1) == 1);
+    CHECK(dex_buf.len >= sizeof(DexFileHeader));
+    memcpy(&header, dex_buf.ptr, sizeof(DexFileHeader));
 
     const auto num_type_ids = header.type_ids_size;
 
@@ -2255,60 +2242,26 @@ class SamsungLookupTables {
 
     memset(table_buf.get(), 0, lookup_table_size * sizeof(LookupTableEntry));
 
-    // Read type ids array.
-    std::unique_ptr<uint32_t[]> typeid_buf(new uint32_t[num_type_ids]);
-    CHECK(dex_fh.seek_set(header.type_ids_off));
-    CHECK(dex_fh.fread(typeid_buf.get(), sizeof(uint32_t), num_type_ids) ==
-          num_type_ids);
+    auto typeids = reinterpret_cast<const uint32_t*>(
+        dex_buf
+            .slice(header.type_ids_off,
+                   header.type_ids_off + num_type_ids * sizeof(uint32_t))
+            .ptr);
 
-    // Read the string ids array.
     const auto num_string_ids = header.string_ids_size;
-    std::unique_ptr<uint32_t[]> stringid_buf(new uint32_t[num_string_ids]);
-    CHECK(dex_fh.seek_set(header.string_ids_off));
-    CHECK(dex_fh.fread(stringid_buf.get(), sizeof(uint32_t), num_string_ids) ==
-          num_string_ids);
-
-    constexpr int kTypeNameBufSize = 256;
-
-    char type_name_buf[kTypeNameBufSize] = {};
-
-    struct Retry {
-      uint32_t string_offset;
-      uint16_t data;
-      uint32_t hash;
-    };
-
-    std::vector<Retry> retry_indices;
+    auto stringids = reinterpret_cast<const uint32_t*>(
+        dex_buf
+            .slice(header.string_ids_off,
+                   header.string_ids_off + num_string_ids * sizeof(uint32_t))
+            .ptr);
 
     for (unsigned int i = 0; i < num_type_ids; i++) {
-      const auto string_id = typeid_buf[i];
+      const auto string_id = typeids[i];
       CHECK(string_id < num_string_ids);
 
-      const auto string_offset = stringid_buf[string_id];
-
-      dex_fh.seek_set(string_offset);
-      auto read_size =
-          dex_fh.fread(type_name_buf, sizeof(char), kTypeNameBufSize);
-      CHECK(read_size > 0);
-
-      auto ptr = type_name_buf;
-      const auto str_size = read_uleb128(&ptr) + 1;
-      const auto str_start = ptr - type_name_buf;
-
-      std::string type_name;
+      const auto string_offset = stringids[string_id];
 
-      if (str_start + str_size >= kTypeNameBufSize) {
-        std::unique_ptr<char[]> large_class_name_buf(new char[str_size]);
-        dex_fh.seek_set(string_offset + str_start);
-        CHECK(dex_fh.fread(large_class_name_buf.get(),
-                           sizeof(char),
-                           str_size) == str_size);
-        type_name = std::string(large_class_name_buf.get(), str_size);
-      } else {
-        type_name = std::string(ptr, str_size);
-      }
-
-      const auto hash = hash_str(type_name);
+      const auto hash = hash_str(dex_buf.slice(string_offset));
       insert(table_buf.get(), lookup_table_size, hash, string_offset, i);
     }
 
@@ -2399,8 +2352,11 @@ OatHeader build_header(OatVersion oat_version,
   header.common.magic = kOatMagicNum;
   header.common.version = static_cast<uint32_t>(oat_version);
 
-  // the checksum must be re-written after we've written
-  // the rest of the file, as we don't know the checksum until then.
+  // Note: So far, I can't replicate the checksum computation done by
+  // dex2oat. It appears that the file is written in a fairly arbitrary
+  // order, and the checksum is computed as those sections are written.
+  // Fortunately, art does not seem to verify the checksum at any point,
+  // so we write a placeholder up front and never come back to the header.
   header.common.adler32_checksum = 0xcdcdcdcd;
 
   header.instruction_set = isa;
@@ -2425,6 +2381,27 @@ OatHeader build_header(OatVersion oat_version,
   return header;
 }
 
+// The size and header of an input dex, which is all the layout needs.
+struct DexFileInfo {
+  size_t file_size;
+  DexFileHeader header;
+};
+
+// Reads every input dex's DexFileInfo, all at once.
+static std::vector<DexFileInfo> read_dex_file_infos(
+    const std::vector<DexInput>& dex_input) {
+  return map_in_parallel(dex_input, [](const DexInput& dex) {
+    auto dex_fh = FileHandle(fopen(dex.filename.c_str(), "r"));
+    CHECK(dex_fh.get() != nullptr);
+
+    DexFileInfo info = {};
+    info.file_size = get_filesize(dex_fh);
+    CHECK(info.file_size >= sizeof(DexFileHeader));
+    CHECK(dex_fh.fread(&info.header, sizeof(DexFileHeader), 1) == 1);
+    return info;
+  });
+}
+
 std::vector<DexFileListing_064::DexFile_064> DexFileListing_064::build(
     const std::vector<DexInput>& dex_input,
     uint32_t& next_offset,
@@ -2439,22 +2416,20 @@ std::vector<DexFileListing_064::DexFile_064> DexFileListing_064::build(
   std::vector<DexFileListing_064::DexFile_064> dex_files;
   dex_files.reserve(dex_input.size());
 
-  for (const auto& dex : dex_input) {
+  auto dex_infos = read_dex_file_infos(dex_input);
+  for (size_t i = 0; i < dex_input.size(); i++) {
+    const auto& dex = dex_input[i];
+    const auto& dex_info = dex_infos[i];
     auto dex_offset = next_offset + total_dex_size;
 
-    auto dex_fh = FileHandle(fopen(dex.filename.c_str(), "r"));
-    CHECK(dex_fh.get() != nullptr);
-
-    auto file_size = get_filesize(dex_fh);
+    const auto file_size = dex_info.file_size;
 
     // dex files are 4-byte aligned inside the oatfile.
     auto padded_size = align<4>(file_size);
 
-    CHECK(file_size >= sizeof(DexFileHeader));
 
-    // read the header to get the count of classes.
-    DexFileHeader header = {};
-    CHECK(dex_fh.fread(&header, sizeof(DexFileHeader), 1) == 1);
+    // the header has the count of classes.
+    const auto& header = dex_info.header;
 
     const auto num_classes = header.class_defs_size;
     const auto num_types = header.type_ids_size;
@@ -2527,23 +2502,21 @@ std::vector<DexFileListing_079::DexFile_079> DexFileListing_079::build(
   std::vector<DexFileListing_079::DexFile_079> dex_files;
   dex_files.reserve(dex_input.size());
 
-  for (const auto dex : dex_input) {
+  auto dex_infos = read_dex_file_infos(dex_input);
+  for (size_t i = 0; i < dex_input.size(); i++) {
+    const auto& dex = dex_input[i];
+    const auto& dex_info = dex_infos[i];
     auto dex_offset = next_offset + total_dex_size;
 
-    auto dex_fh = FileHandle(fopen(dex.filename.c_str(), "r"));
-    CHECK(dex_fh.get() != nullptr);
-
-    auto file_size = get_filesize(dex_fh);
+    const auto file_size = dex_info.file_size;
 
     // dex files are 4-byte aligned inside the oatfile.
     auto padded_size = align<4>(file_size);
     total_dex_size += padded_size;
 
-    CHECK(file_size >= sizeof(DexFileHeader));
 
-    // read the header to get the count of classes.
-    DexFileHeader header = {};
-    CHECK(dex_fh.fread(&header, sizeof(DexFileHeader), 1) == 1);
+    // the header has the count of classes.
+    const auto& header = dex_info.header;
 
     auto num_classes = header.class_defs_size;
     auto class_table_size =
@@ -2592,20 +2565,18 @@ std::vector<DexFileListing_124::DexFile_124> DexFileListing_124::build(
   std::vector<DexFileListing_124::DexFile_124> dex_files;
   dex_files.reserve(dex_input.size());
 
-  for (const auto dex : dex_input) {
+  auto dex_infos = read_dex_file_infos(dex_input);
+  for (size_t i = 0; i < dex_input.size(); i++) {
+    const auto& dex = dex_input[i];
+    const auto& dex_info = dex_infos[i];
     // We load the dex bytecode in the VDEX file after the header and
     // the checksum for the DEX right after.
     auto dex_offset = sizeof(VdexFileHeader) + sizeof(uint32_t);
 
-    auto dex_fh = FileHandle(fopen(dex.filename.c_str(), "r"));
-    CHECK(dex_fh.get() != nullptr);
+    const auto file_size = dex_info.file_size;
 
-    auto file_size = get_filesize(dex_fh);
-    CHECK(file_size >= sizeof(DexFileHeader));
-
-    // read the header to get the count of classes.
-    DexFileHeader header = {};
-    CHECK(dex_fh.fread(&header, sizeof(DexFileHeader), 1) == 1);
+    // the header has the count of classes.
+    const auto& header = dex_info.header;
 
     auto num_classes = header.class_defs_size;
     auto class_table_size =
@@ -2698,10 +2669,8 @@ static size_t fields_size(size_t num_elements) {
 static size_t compute_bss_size_079(const std::vector<DexInput>& dex_files) {
   size_t ret = 0;
 
-  for (const auto& e : dex_files) {
-    auto dex_fh = FileHandle(fopen(e.filename.c_str(), "r"));
-    DexFileHeader header = {};
-    CHECK(dex_fh.fread(&header, sizeof(DexFileHeader), 1) == 1);
+  for (const auto& dex_info : read_dex_file_infos(dex_files)) {
+    const auto& header = dex_info.header;
 
     auto meth_offset = align<pointer_size>(types_size(header.type_ids_size));
     auto strings_offset =
@@ -2791,59 +2760,40 @@ OatFile::Status build_oatfile(const std::string& oat_file_name,
     return OatFile::Status::BUILD_IO_ERROR;
   }
 
-  if (write_elf) {
-    write_padding(oat_fh, 0, 0x1000);
-    oat_fh.set_seek_reference_to_fpos();
-    oat_fh.reset_bytes_written();
-  }
-
-  header.write(oat_fh);
-
-  // Write key value store.
-  KeyValueStore::write(oat_fh, key_value);
+  auto write_oat = [&](FileHandle& oat_fh) {
+    header.write(oat_fh);
 
-  // write DexFileListing
-  DexFileListingType::write(oat_fh, dex_files, samsung_mode);
+    // Write key value store.
+    KeyValueStore::write(oat_fh, key_value);
 
-  // Write padding to align to 4 bytes.
-  auto padding = align<4>(oat_fh.bytes_written()) - oat_fh.bytes_written();
-  char buf[4] = {};
-  write_buf(oat_fh, ConstBuffer{buf, padding});
+    // write DexFileListing
+    DexFileListingType::write(oat_fh, dex_files, samsung_mode);
 
-  // Write lookup tables.
-  if (samsung_mode) {
-    SamsungLookupTablesType::write(dex_input, dex_files, oat_fh);
-  }
-
-  write_dex_files(dex_input, dex_files, oat_fh);
-  OatClassesType::write(dex_files, oat_fh);
+    // Write padding to align to 4 bytes.
+    auto padding = align<4>(oat_fh.bytes_written()) - oat_fh.bytes_written();
+    char buf[4] = {};
+    write_buf(oat_fh, ConstBuffer{buf, padding});
 
-  LookupTablesType::write(dex_input, dex_files, oat_fh);
-
-  // Pad with 0s up to oat_size
-  write_padding(oat_fh, 0, oat_size - oat_fh.bytes_written());
+    // Write lookup tables.
+    if (samsung_mode) {
+      SamsungLookupTablesType::write(dex_input, dex_files, oat_fh);
+    }
 
-  ////////// Update header with final checksum.
+    write_dex_files(dex_input, dex_files, oat_fh);
+    OatClassesType::write(dex_files, oat_fh);
 
-  CHECK(oat_fh.seek_begin());
+    LookupTablesType::write(dex_input, dex_files, oat_fh);
 
-  // Note: So far, I can't replicate the checksum computation done by
-  // dex2oat. It appears that the file is written in a fairly arbitrary
-  // order, and the checksum is computed as those sections are written.
-  // Fortunately, art does not seem to verify the checksum at any point.
-  // We don't even attempt to compute the checksum now, as it takes a few
-  // seconds to do so.
-  header.common.adler32_checksum = 0xcdcdcdcd;
-
-  write_obj(oat_fh, header.common);
+    // Pad with 0s up to oat_size
+    write_padding(oat_fh, 0, oat_size - oat_fh.bytes_written());
+  };
 
   if (write_elf) {
-    oat_fh.set_seek_reference(0);
-    oat_fh.seek_begin();
-
-    ElfWriter section_headers(oat_version);
-    section_headers.build(isa, oat_size, compute_bss_size_079(dex_input));
-    section_headers.write(oat_fh);
+    ElfWriter elf_writer(oat_version);
+    elf_writer.build(isa, oat_size, compute_bss_size_079(dex_input));
+    elf_writer.write(oat_fh, write_oat);
+  } else {
+    write_oat(oat_fh);
   }
 
   return OatFile::Status::BUILD_SUCCESS;
@@ -2915,41 +2865,12 @@ OatFile::Status build_vdex_odex_pairs(const std::string& oat_file_name,
 
   printf("Oat Size: %u\n", oat_size);
 
-  ////////// Write the file.
-
-  auto oat_fh = FileHandle(fopen(oat_file_name.c_str(), "w"));
-  if (oat_fh.get() == nullptr) {
-    return OatFile::Status::BUILD_IO_ERROR;
-  }
-
-  if (write_elf) {
-    write_padding(oat_fh, 0, 0x1000);
-    oat_fh.set_seek_reference_to_fpos();
-    oat_fh.reset_bytes_written();
-  }
-
   if (oat_version == OatVersion::V_131) {
     CHECK(oat_dex_files_offset != 0, "OatDexFiles offset can't be zero");
     header.oat_dex_files_offset = oat_dex_files_offset;
   }
 
-  header.write(oat_fh);
-
-  // Write key value store.
-  KeyValueStore::write(oat_fh, key_value);
-
-  // write DexFileListing
-  DexFileListing_124::write(oat_fh, dex_files, samsung_mode);
-
-  // Write padding to align to 4 bytes.
-  auto padding = align<4>(oat_fh.bytes_written()) - oat_fh.bytes_written();
-  char buf[4] = {};
-  write_buf(oat_fh, ConstBuffer{buf, padding});
-
-  // Write lookup tables.
-  if (samsung_mode) {
-    SamsungLookupTablesNil::write(single_dex_input, dex_files, oat_fh);
-  }
+  ////////// Write the VDEX file.
 
   CHECK(oat_file_name.substr(oat_file_name.size() - 5) == std::string(".odex"),
         "V124/V131 Oatmeal should generate .odex files");
@@ -2981,10 +2902,6 @@ OatFile::Status build_vdex_odex_pairs(const std::string& oat_file_name,
 
   stream_file(dex_fh, vdex_fh);
 
-  OatClasses_124::write(dex_files, oat_fh);
-
-  LookupTables::write(single_dex_input, dex_files, oat_fh);
-
   if (oat_version == OatVersion::V_131) {
     dex_file_record.dex_file_checksum = dex_checksum;
     // Advance past the VDEX header plus the DEX file checksum inside the .vdex
@@ -2992,29 +2909,45 @@ OatFile::Status build_vdex_odex_pairs(const std::string& oat_file_name,
     dex_file_record.dex_file_offset = sizeof(VdexFileHeader) + sizeof(uint32_t);
   }
 
-  OatDexFileRecord::write(oat_fh, dex_file_record);
+  ////////// Write the ODEX file.
 
-  ////////// Update header with final checksum.
-  CHECK(oat_fh.seek_begin());
+  auto oat_fh = FileHandle(fopen(oat_file_name.c_str(), "w"));
+  if (oat_fh.get() == nullptr) {
+    return OatFile::Status::BUILD_IO_ERROR;
+  }
 
-  // Note: So far, I can't replicate the checksum computation done by
-  // dex2oat. It appears that the file is written in a fairly arbitrary
-  // order, and the checksum is computed as those sections are written.
-  // Fortunately, art does not seem to verify the checksum at any point.
-  // We don't even attempt to compute the checksum now, as it takes a few
-  // seconds to do so.
-  header.common.adler32_checksum = 0xcdcdcdcd;
+  auto write_oat = [&](FileHandle& oat_fh) {
+    header.write(oat_fh);
 
-  write_obj(oat_fh, header.common);
+    // Write key value store.
+    KeyValueStore::write(oat_fh, key_value);
 
-  if (write_elf) {
-    oat_fh.set_seek_reference(0);
-    oat_fh.seek_begin();
+    // write DexFileListing
+    DexFileListing_124::write(oat_fh, dex_files, samsung_mode);
+
+    // Write padding to align to 4 bytes.
+    auto padding = align<4>(oat_fh.bytes_written()) - oat_fh.bytes_written();
+    char buf[4] = {};
+    write_buf(oat_fh, ConstBuffer{buf, padding});
+
+    // Write lookup tables.
+    if (samsung_mode) {
+      SamsungLookupTablesNil::write(single_dex_input, dex_files, oat_fh);
+    }
+
+    OatClasses_124::write(dex_files, oat_fh);
 
-    ElfWriter section_headers(oat_version);
-    section_headers.build(
-        isa, oat_size, compute_bss_size_079(single_dex_input));
-    section_headers.write(oat_fh);
+    LookupTables::write(single_dex_input, dex_files, oat_fh);
+
+    OatDexFileRecord::write(oat_fh, dex_file_record);
+  };
+
+  if (write_elf) {
+    ElfWriter elf_writer(oat_version);
+    elf_writer.build(isa, oat_size, compute_bss_size_079(single_dex_input));
+    elf_writer.write(oat_fh, write_oat);
+  } else {
+    write_oat(oat_fh);
   }
 
   return OatFile::Status::BUILD_SUCCESS;
@@ -3034,35 +2967,41 @@ OatFile::Status build_oatfile<DexFileListing_124,
     bool samsung_mode) {
   // Make sure the output is a directory where we will place ODEX and VDEX files
   CHECK(oat_file_name[oat_file_name.size() - 1] == '/');
-  OatFile::Status result = OatFile::Status::BUILD_SUCCESS;
+  CHECK(oat_version == OatVersion::V_124 || oat_version == OatVersion::V_131,
+        "must not build vdex/odex pairs for non-Oreo builds");
+
+  // Each dex gets its own pair of files, so they are all built at once.
+  auto partial_results =
+      map_in_parallel(dex_input, [&](const DexInput& dex) {
+        size_t found = dex.filename.find_last_of("/") + 1;
+        CHECK(found >= 0);
+        auto odex_file_name = dex.filename.substr(found);
+        odex_file_name.erase(odex_file_name.size() - 3);
+        odex_file_name = oat_file_name + odex_file_name + std::string("odex");
+
+        return build_vdex_odex_pairs(odex_file_name,
+                                     oat_version,
+                                     dex,
+                                     isa,
+                                     write_elf,
+                                     art_image_location,
+                                     samsung_mode);
+      });
 
-  for (const auto& dex : dex_input) {
-    size_t found = dex.filename.find_last_of("/") + 1;
-    CHECK(found >= 0);
-    auto odex_file_name = dex.filename.substr(found);
-    odex_file_name.erase(odex_file_name.size() - 3);
-    odex_file_name = oat_file_name + odex_file_name + std::string("odex");
-
-    CHECK(oat_version == OatVersion::V_124 || oat_version == OatVersion::V_131,
-          "must not build vdex/odex pairs for non-Oreo builds");
-
-    auto partial_result = build_vdex_odex_pairs(odex_file_name,
-                                                oat_version,
-                                                dex,
-                                                isa,
-                                                write_elf,
-                                                art_image_location,
-                                                samsung_mode);
-
-    if (partial_result != OatFile::Status::BUILD_SUCCESS) {
-      fprintf(stderr,
-              "Building V124/V131 ODEX/VDEX pair failed for DEX input: %s, "
-              "Result: %d\n",
-              dex.filename.c_str(),
-              static_cast<int>(partial_result));
-      result = partial_result;
-    }
-  }
+  OatFile::Status result = OatFile::Status::BUILD_SUCCESS;
+  foreach_pair(
+      dex_input,
+      partial_results,
+      [&](const DexInput& dex, OatFile::Status partial_result) {
+        if (partial_result != OatFile::Status::BUILD_SUCCESS) {
+          fprintf(stderr,
+                  "Building V124/V131 ODEX/VDEX pair failed for DEX input: %s, "
+                  "Result: %d\n",
+                  dex.filename.c_str(),
+                  static_cast<int>(partial_result));
+          result = partial_result;
+        }
+      });
   return result;
 }
 
@@ -10,6 +10,8 @@
 #include "elf-writer.h"
 #include "util.h"
 
+#include <algorithm>
+
 const std::string& ElfStringTable::at(int orig_idx) const {
   auto idx = orig_idx;
   for (const auto& str : strings_) {
@@ -139,19 +141,53 @@ void ElfWriter::build(InstructionSet isa,
   elf_header_.e_shentsize = sizeof(Elf32_Shdr);
   elf_header_.e_shnum = section_headers_.size();
   elf_header_.e_shstrndx = shstrtab_idx_;
+  // The section headers go at the end of the file.
+  elf_header_.e_shoff = align<4>(next_offset_);
+
+  build_program_headers();
 }
 
-void ElfWriter::write(FileHandle& fh) {
-  write_dynstr(fh);
-  write_dynsym(fh);
-  write_hash(fh);
-  write_dynamic(fh);
-  write_shstrtab(fh);
-  write_headers(fh);
-  write_program_headers(fh);
+void ElfWriter::write(FileHandle& fh,
+                      const std::function<void(FileHandle&)>& write_oat) {
+  CHECK(fh.bytes_written() == 0);
+  written_base_ = 0;
 
-  fh.seek_begin();
   write_obj(fh, elf_header_);
+  write_program_headers(fh);
+
+  // .dynsym must be written before .hash; their offsets keep them in that
+  // order in every version.
+  std::vector<std::pair<Elf32_Word, std::function<void()>>> sections = {
+      {section_headers_.at(dynstr_idx_).sh_offset, [&] { write_dynstr(fh); }},
+      {section_headers_.at(dynsym_idx_).sh_offset, [&] { write_dynsym(fh); }},
+      {section_headers_.at(hash_idx_).sh_offset, [&] { write_hash(fh); }},
+      {section_headers_.at(dynamic_idx_).sh_offset,
+       [&] { write_dynamic(fh); }},
+      {section_headers_.at(shstrtab_idx_).sh_offset,
+       [&] { write_shstrtab(fh); }},
+      {section_headers_.at(rodata_idx_).sh_offset,
+       [&] { write_rodata(fh, write_oat); }},
+  };
+  std::stable_sort(sections.begin(),
+                   sections.end(),
+                   [](const std::pair<Elf32_Word, std::function<void()>>& a,
+                      const std::pair<Elf32_Word, std::function<void()>>& b) {
+                     return a.first < b.first;
+                   });
+  for (const auto& section : sections) {
+    section.second();
+  }
+
+  write_headers(fh);
+}
+
+void ElfWriter::pad_to(FileHandle& fh, Elf32_Word offset) {
+  const auto cur_offset = written_base_ + fh.bytes_written();
+  CHECK(offset >= cur_offset,
+        "ELF sections out of order: at 0x%08zx, writing 0x%08x",
+        cur_offset,
+        offset);
+  write_padding(fh, 0, offset - cur_offset);
 }
 
 unsigned int ElfWriter::get_num_dynsymbols() const {
@@ -436,7 +472,7 @@ void ElfWriter::link_section(int src_idx, int dst_idx) {
 }
 
 void ElfWriter::write_dynstr(FileHandle& fh) {
-  fh.seek_set(section_headers_.at(dynstr_idx_).sh_offset);
+  pad_to(fh, section_headers_.at(dynstr_idx_).sh_offset);
   auto flat_dynstr = dynstr_table_.flatten();
   write_buf(fh, ConstBuffer{flat_dynstr.data(), flat_dynstr.size()});
 }
@@ -517,7 +553,7 @@ void ElfWriter::write_dynsym(FileHandle& fh) {
 
   CHECK(dynsyms_.size() == get_num_dynsymbols());
 
-  fh.seek_set(section_headers_.at(dynsym_idx_).sh_offset);
+  pad_to(fh, section_headers_.at(dynsym_idx_).sh_offset);
   write_vec(fh, dynsyms_);
 }
 
@@ -619,7 +655,7 @@ void ElfWriter::write_hash(FileHandle& fh) {
     break;
   }
 
-  fh.seek_set(section_headers_.at(hash_idx_).sh_offset);
+  pad_to(fh, section_headers_.at(hash_idx_).sh_offset);
   write_vec(fh, hash);
 }
 
@@ -644,27 +680,32 @@ void ElfWriter::write_dynamic(FileHandle& fh) {
 
   CHECK(dyns.size() == kNumDynamics);
 
-  fh.seek_set(section_headers_.at(dynamic_idx_).sh_offset);
+  pad_to(fh, section_headers_.at(dynamic_idx_).sh_offset);
   write_vec(fh, dyns);
 }
 
 void ElfWriter::write_shstrtab(FileHandle& fh) {
-  fh.seek_set(section_headers_.at(shstrtab_idx_).sh_offset);
+  pad_to(fh, section_headers_.at(shstrtab_idx_).sh_offset);
   auto flat_strtab = string_table_.flatten();
   write_buf(fh, ConstBuffer{flat_strtab.data(), flat_strtab.size()});
 }
 
-void ElfWriter::write_headers(FileHandle& fh) {
-  const auto prev_offset = next_offset_;
-  next_offset_ = align<4>(next_offset_);
-  const auto padding = next_offset_ - prev_offset;
+void ElfWriter::write_rodata(
+    FileHandle& fh, const std::function<void(FileHandle&)>& write_oat) {
+  const auto& rodata = section_headers_.at(rodata_idx_);
+  pad_to(fh, rodata.sh_offset);
 
-  fh.seek_set(prev_offset);
-  char buf[4] = {};
-  write_buf(fh, ConstBuffer{buf, padding});
+  // The oat writer addresses everything relative to the start of the oat.
+  fh.set_seek_reference_to_fpos();
+  fh.reset_bytes_written();
+  written_base_ = rodata.sh_offset;
 
-  elf_header_.e_shoff = next_offset_;
+  write_oat(fh);
+  CHECK(fh.bytes_written() <= rodata.sh_size);
+}
 
+void ElfWriter::write_headers(FileHandle& fh) {
+  pad_to(fh, elf_header_.e_shoff);
   write_vec(fh, section_headers_);
 }
 
@@ -690,14 +731,14 @@ unsigned int ElfWriter::get_num_program_headers() const {
   return 0;
 }
 
-// Write ELF program headers.
-void ElfWriter::write_program_headers(FileHandle& fh) {
+// Build ELF program headers.
+void ElfWriter::build_program_headers() {
   auto num_prog_headers = get_num_program_headers();
 
-  std::vector<Elf32_Phdr> prog_headers;
+  program_headers_.clear();
 
   // The bootstrapping program header
-  prog_headers.push_back(
+  program_headers_.push_back(
       Elf32_Phdr{PT_PHDR,
                  sizeof(Elf32_Ehdr),
                  sizeof(Elf32_Ehdr),
@@ -712,7 +753,7 @@ void ElfWriter::write_program_headers(FileHandle& fh) {
   const auto rodata_size = section_headers_.at(rodata_idx_).sh_size;
   const auto rodata_end = rodata_addr + rodata_size;
 
-  prog_headers.push_back(
+  program_headers_.push_back(
       Elf32_Phdr{PT_LOAD, 0, 0, 0, rodata_end, rodata_end, PF_R, 0x1000});
 
   switch (oat_version_) {
@@ -721,7 +762,7 @@ void ElfWriter::write_program_headers(FileHandle& fh) {
   case OatVersion::V_064:
   case OatVersion::V_067: {
     // LOAD text
-    prog_headers.push_back(Elf32_Phdr{PT_LOAD,
+    program_headers_.push_back(Elf32_Phdr{PT_LOAD,
                                       rodata_end,
                                       rodata_end,
                                       rodata_end,
@@ -734,7 +775,7 @@ void ElfWriter::write_program_headers(FileHandle& fh) {
   case OatVersion::V_079:
   case OatVersion::V_088: {
     // LOAD bss
-    prog_headers.push_back(Elf32_Phdr{PT_LOAD,
+    program_headers_.push_back(Elf32_Phdr{PT_LOAD,
                                       0,
                                       rodata_end,
                                       rodata_end,
@@ -751,7 +792,7 @@ void ElfWriter::write_program_headers(FileHandle& fh) {
     const auto dynstr_addr = section_headers_.at(dynstr_idx_).sh_addr;
     const auto hash_addr = section_headers_.at(hash_idx_).sh_addr;
     const auto hash_size = section_headers_.at(hash_idx_).sh_size;
-    prog_headers.push_back(Elf32_Phdr{PT_LOAD,
+    program_headers_.push_back(Elf32_Phdr{PT_LOAD,
                                       dynstr_offset,
                                       dynstr_addr,
                                       dynstr_addr,
@@ -769,7 +810,7 @@ void ElfWriter::write_program_headers(FileHandle& fh) {
   const auto dynamic_offset = section_headers_.at(dynamic_idx_).sh_offset;
   const auto dynamic_addr = section_headers_.at(dynamic_idx_).sh_addr;
   const auto dynamic_size = section_headers_.at(dynamic_idx_).sh_size;
-  prog_headers.push_back(Elf32_Phdr{PT_LOAD,
+  program_headers_.push_back(Elf32_Phdr{PT_LOAD,
                                     dynamic_offset,
                                     dynamic_addr,
                                     dynamic_addr,
@@ -777,7 +818,7 @@ void ElfWriter::write_program_headers(FileHandle& fh) {
                                     dynamic_size,
                                     PF_R | PF_W,
                                     0x1000});
-  prog_headers.push_back(Elf32_Phdr{PT_DYNAMIC,
+  program_headers_.push_back(Elf32_Phdr{PT_DYNAMIC,
                                     dynamic_offset,
                                     dynamic_addr,
                                     dynamic_addr,
@@ -787,12 +828,12 @@ void ElfWriter::write_program_headers(FileHandle& fh) {
                                     0x1000});
 
   elf_header_.e_phentsize = sizeof(Elf32_Phdr);
-  elf_header_.e_phnum = prog_headers.size();
+  elf_header_.e_phnum = program_headers_.size();
+}
 
-  fh.seek_set(sizeof(Elf32_Ehdr));
-  for (const auto& e : prog_headers) {
-    write_obj(fh, e);
-  }
+void ElfWriter::write_program_headers(FileHandle& fh) {
+  pad_to(fh, elf_header_.e_phoff);
+  write_vec(fh, program_headers_);
 }
 
 Elf32_Word ElfWriter::add_section_header(Elf32_Word str_idx,
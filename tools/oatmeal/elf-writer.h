@@ -14,6 +14,7 @@
 
 #include <native/museum/5.0.0/elf.h>
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -69,7 +70,10 @@ class ElfWriter {
 
   void build(InstructionSet isa, Elf32_Word oat_size, Elf32_Word bss_size);
 
-  void write(FileHandle& fh);
+  // Writes the file front to back, calling write_oat to emit the oat file
+  // where .rodata goes. Every offset is fixed by build(), so nothing is ever
+  // seeked over and the output can be streamed.
+  void write(FileHandle& fh, const std::function<void(FileHandle&)>& write_oat);
 
  private:
   void build_dynstr_table();
@@ -85,12 +89,18 @@ class ElfWriter {
   void add_shstrtab();
 
   void link_section(int src_idx, int dst_idx);
+  void build_program_headers();
+
+  // Zero-fills the output up to the given file offset.
+  void pad_to(FileHandle& fh, Elf32_Word offset);
 
   void write_dynstr(FileHandle& fh);
   void write_dynsym(FileHandle& fh);
   void write_hash(FileHandle& fh);
   void write_dynamic(FileHandle& fh);
   void write_shstrtab(FileHandle& fh);
+  void write_rodata(FileHandle& fh,
+                    const std::function<void(FileHandle&)>& write_oat);
   void write_headers(FileHandle& fh);
   void write_program_headers(FileHandle& fh);
 
@@ -144,5 +154,10 @@ class ElfWriter {
   int shstrtab_idx_ = 0;
 
   std::vector<Elf32_Shdr> section_headers_;
+  std::vector<Elf32_Phdr> program_headers_;
   std::vector<Elf32_Sym> dynsyms_;
+
+  // The file offset that fh.bytes_written() counts from; the oat writer
+  // resets the count at the start of .rodata.
+  Elf32_Word written_base_ = 0;
 };
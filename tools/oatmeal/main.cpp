@@ -235,22 +235,15 @@ int dump(const Arguments& args) {
     return 1;
   }
 
-  auto oat_file_size = get_filesize(oat_file);
-
-  // We don't run dumping during install on device, so it is allowed to consume
-  // lots of memory.
-  auto oat_file_contents = std::make_unique<char[]>(oat_file_size);
-  auto oatFileBytesRead =
-      fread(oat_file_contents.get(), 1, oat_file_size, oat_file.get());
-  if (oatFileBytesRead != oat_file_size) {
-    fprintf(stderr,
-            "Failed to read file %s (%zd)\n",
-            std::strerror(errno),
-            oatFileBytesRead);
+  if (get_filesize(oat_file) == 0) {
+    fprintf(stderr, "Cannot open .oat file %s\n", oat_file_name.c_str());
     return 1;
   }
 
-  ConstBuffer oatfile_buffer{oat_file_contents.get(), oat_file_size};
+  // The parsed file points into the mapping, so only the pages it looks at
+  // are ever read in.
+  MappedFile oat_file_map(oat_file_name);
+  ConstBuffer oatfile_buffer = oat_file_map.buffer();
   auto ma_scope = MemoryAccounter::NewScope(oatfile_buffer);
 
   auto oatfile =
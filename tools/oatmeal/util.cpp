@@ -10,7 +10,10 @@
 #include "util.h"
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 size_t FileHandle::fwrite_impl(const void* p, size_t size, size_t count) {
   auto ret = ::fwrite(p, size, count, fh_);
@@ -47,6 +50,26 @@ void FileHandle::set_seek_reference_to_fpos() {
 
 void FileHandle::set_seek_reference(long offset) { seek_ref_ = offset; }
 
+MappedFile::MappedFile(const std::string& filename) {
+  auto fd = open(filename.c_str(), O_RDONLY);
+  CHECK(fd >= 0,
+        "open %s failed: %s",
+        filename.c_str(),
+        std::strerror(errno));
+  struct stat file_stat;
+  CHECK(fstat(fd, &file_stat) == 0, "fstat failed: %s", std::strerror(errno));
+  len_ = file_stat.st_size;
+  CHECK(len_ > 0, "%s is empty", filename.c_str());
+  auto map = mmap(nullptr, len_, PROT_READ, MAP_PRIVATE, fd, 0);
+  CHECK(map != MAP_FAILED, "mmap failed: %s", std::strerror(errno));
+  close(fd);
+  ptr_ = static_cast<const char*>(map);
+}
+
+MappedFile::~MappedFile() {
+  munmap(const_cast<char*>(ptr_), len_);
+}
+
 void write_word(FileHandle& fh, uint32_t value) {
   auto bytes_written = fh.fwrite(&value, sizeof(value), 1) * sizeof(value);
   if (bytes_written != sizeof(value)) {
@@ -11,6 +11,7 @@
 
 #include <cassert>
 #include <cstdio>
+#include <future>
 #include <memory>
 #include <string>
 #include <utility>
@@ -43,6 +44,26 @@ static void foreach_pair(const T1& t1, const T2& t2, const L& fn) {
   }
 }
 
+// Runs fn on every element of items, each on its own thread, and returns the
+// results in the order of items.
+template <typename T, typename L>
+static auto map_in_parallel(const std::vector<T>& items, const L& fn)
+    -> std::vector<decltype(fn(items.front()))> {
+  using Result = decltype(fn(items.front()));
+  std::vector<std::future<Result>> futures;
+  futures.reserve(items.size());
+  for (const auto& item : items) {
+    futures.emplace_back(
+        std::async(std::launch::async, [&fn, &item] { return fn(item); }));
+  }
+  std::vector<Result> results;
+  results.reserve(items.size());
+  for (auto& future : futures) {
+    results.emplace_back(future.get());
+  }
+  return results;
+}
+
 template <uint32_t Width>
 uint32_t align(uint32_t in) {
   return (in + (Width - 1)) & -Width;
@@ -173,6 +194,20 @@ class FileHandle {
   FILE* fh_;
 };
 
+// A read-only mapping of a whole file.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename);
+  UNCOPYABLE(MappedFile);
+  ~MappedFile();
+
+  ConstBuffer buffer() const { return ConstBuffer{ptr_, len_}; }
+
+ private:
+  const char* ptr_;
+  size_t len_;
+};
+
 void write_word(FileHandle& fh, uint32_t value);
 
 void write_buf(FileHandle& fh, ConstBuffer buf);
@@ -7,13 +7,18 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <ctime>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <memory>
 #include <set>
 #include <streambuf>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <signal.h>
@@ -23,6 +28,11 @@
 #ifdef _MSC_VER
 #include <io.h>
 #else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #endif
 
@@ -51,8 +61,13 @@
 #include "ProguardParser.h" // New ProGuard Parser
 #include "ReachableClasses.h"
 #include "RedexContext.h"
+#include "Sha1.h"
+#include "ThreadPool.h"
 #include "Timer.h"
 #include "Warning.h"
+#include "WorkQueue.h"
+#include "ZipArchive.h"
+#include "ZipFormat.h"
 
 namespace {
 const std::string k_usage_header = "usage: redex-all [options...] dex-files...";
@@ -68,7 +83,12 @@ struct Arguments {
   std::vector<std::string> proguard_config_paths;
   std::string out_dir;
   std::vector<std::string> dex_files;
+  std::string output_apk;
+  bool page_align_libs{false};
+  bool store_dexes{false};
   bool verify_none_mode{false};
+  std::string serve_socket;
+  std::string connect_socket;
 };
 
 UNUSED void dump_args(const Arguments& args) {
@@ -231,6 +251,28 @@ Arguments parse_args(int argc, char* argv[]) {
       "    \te.g. -JMyPass.config=[1, 2, 3]\n"
       "Note: Be careful to properly escape JSON parameters, e.g., strings must "
       "be quoted.");
+  od.add_options()("output-apk",
+                   po::value<std::vector<std::string>>(),
+                   "write the optimized dexes straight into a copy of the APK "
+                   "given as input, at this path");
+  od.add_options()(
+      "page-align-libs",
+      po::bool_switch(&args.page_align_libs)->default_value(false),
+      "align stored .so files of --output-apk to 4k");
+  od.add_options()(
+      "store-dexes",
+      po::bool_switch(&args.store_dexes)->default_value(false),
+      "store the dexes of --output-apk uncompressed and 4k aligned, for the "
+      "runtime to mmap them from the APK, and write dex-alignment.txt");
+  od.add_options()("serve",
+                   po::value<std::vector<std::string>>(),
+                   "run as a daemon listening on this local socket, with the "
+                   "ProGuard configuration and library jars given here "
+                   "parsed once for all the jobs sent to it");
+  od.add_options()("connect",
+                   po::value<std::vector<std::string>>(),
+                   "run the rest of the command line as a job of the daemon "
+                   "listening on this local socket");
   od.add_options()("show-passes", "show registered passes");
   od.add_options()(
       "dex-files", po::value<std::vector<std::string>>(), "dex files");
@@ -265,9 +307,21 @@ Arguments parse_args(int argc, char* argv[]) {
     exit(EXIT_SUCCESS);
   }
 
+  auto take_last = [](const auto& value) {
+    return value.template as<std::vector<std::string>>().back();
+  };
+
+  if (vm.count("serve")) {
+    args.serve_socket = take_last(vm["serve"]);
+  }
+
+  if (vm.count("connect")) {
+    args.connect_socket = take_last(vm["connect"]);
+  }
+
   if (vm.count("dex-files")) {
     args.dex_files = vm["dex-files"].as<std::vector<std::string>>();
-  } else {
+  } else if (args.serve_socket.empty()) {
     std::cerr << "error: no input dex files" << std::endl << std::endl;
     print_usage();
     exit(EXIT_SUCCESS);
@@ -284,10 +338,6 @@ Arguments parse_args(int argc, char* argv[]) {
     g_warning_level = OptWarningLevel(warns.back());
   }
 
-  auto take_last = [](const auto& value) {
-    return value.template as<std::vector<std::string>>().back();
-  };
-
   if (vm.count("config")) {
     args.config = parse_config(take_last(vm["config"]));
   }
@@ -296,6 +346,10 @@ Arguments parse_args(int argc, char* argv[]) {
     args.out_dir = take_last(vm["outdir"]);
   }
 
+  if (vm.count("output-apk")) {
+    args.output_apk = take_last(vm["output-apk"]);
+  }
+
   if (vm.count("proguard-config")) {
     args.proguard_config_paths =
         vm["proguard-config"].as<std::vector<std::string>>();
@@ -367,6 +421,9 @@ Json::Value get_stats(const dex_stats_t& stats) {
   val["num_annotations"] = stats.num_annotations;
   val["num_bytes"] = stats.num_bytes;
   val["num_instructions"] = stats.num_instructions;
+  val["num_hot_string_pages"] = stats.num_hot_string_pages;
+  val["num_hot_class_data_pages"] = stats.num_hot_class_data_pages;
+  val["num_shared_debug_items"] = stats.num_shared_debug_items;
   return val;
 }
 
@@ -432,6 +489,170 @@ Json::Value get_output_stats(
   return d;
 }
 
+/*
+ * Incremental runs: when "incremental_cache_dir" is set, the outputs of a run
+ * are kept in that directory, keyed by a fingerprint of everything that went
+ * into it. A later run with the same fingerprint copies the outputs back
+ * instead of optimizing again.
+ *
+ * The passes are whole-program, so any change to any input can change any
+ * output; the fingerprint therefore covers the redex binary itself, the
+ * config (including every file it names), the ProGuard configuration files,
+ * the library jars and all input dexes.
+ */
+class RunFingerprint {
+ public:
+  RunFingerprint() { sha1_init(&m_context); }
+
+  void add_string(const std::string& str) {
+    uint64_t len = str.size();
+    sha1_update(&m_context, reinterpret_cast<const uint8_t*>(&len),
+                sizeof(len));
+    sha1_update(&m_context, reinterpret_cast<const uint8_t*>(str.data()),
+                str.size());
+  }
+
+  bool add_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      return false;
+    }
+    add_string(path);
+    char buf[1 << 16];
+    while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+      sha1_update(&m_context, reinterpret_cast<const uint8_t*>(buf),
+                  in.gcount());
+    }
+    return true;
+  }
+
+  // Adds the files that config values refer to, so editing e.g. the
+  // coldstart class list invalidates the cache.
+  void add_config_files(const Json::Value& value) {
+    if (value.isString()) {
+      auto str = value.asString();
+      boost::system::error_code ec;
+      if (!str.empty() && boost::filesystem::is_regular_file(str, ec)) {
+        add_file(str);
+      }
+    } else if (value.isArray() || value.isObject()) {
+      for (const auto& child : value) {
+        add_config_files(child);
+      }
+    }
+  }
+
+  std::string hex() {
+    unsigned char digest[20];
+    sha1_final(digest, &m_context);
+    std::ostringstream ss;
+    for (auto byte : digest) {
+      ss << std::hex << std::setw(2) << std::setfill('0') << (int)byte;
+    }
+    return ss.str();
+  }
+
+ private:
+  Sha1Context m_context;
+};
+
+std::string fingerprint_run(const char* argv0,
+                            const Arguments& args,
+                            const redex::ProguardConfiguration& pg_config,
+                            const std::set<std::string>& library_jars) {
+  RunFingerprint fp;
+  if (!fp.add_file("/proc/self/exe")) {
+    fp.add_file(argv0);
+  }
+  Json::FastWriter writer;
+  fp.add_string(writer.write(args.config));
+  fp.add_config_files(args.config);
+  fp.add_string(args.verify_none_mode ? "verify-none" : "");
+  for (const auto& path : args.proguard_config_paths) {
+    fp.add_file(path);
+  }
+  for (const auto& path : pg_config.already_included) {
+    fp.add_file(path);
+  }
+  for (const auto& jar : library_jars) {
+    if (!fp.add_file(jar)) {
+      fp.add_file(pg_config.basedirectory + "/" + jar);
+    }
+  }
+  for (const auto& filename : args.dex_files) {
+    fp.add_file(filename);
+    if (filename.size() < 5 ||
+        filename.compare(filename.size() - 4, 4, ".dex") != 0) {
+      DexMetadata store_metadata;
+      store_metadata.parse(filename);
+      for (const auto& file_path : store_metadata.get_files()) {
+        fp.add_file(file_path);
+      }
+    }
+  }
+  return fp.hex();
+}
+
+/*
+ * Copies every regular file under `from` that was written at or after
+ * `since` into `to`, keeping relative paths.
+ */
+bool copy_tree(const boost::filesystem::path& from,
+               const boost::filesystem::path& to,
+               std::time_t since = 0) {
+  namespace fs = boost::filesystem;
+  boost::system::error_code ec;
+  for (fs::recursive_directory_iterator it(from, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (!fs::is_regular_file(it->path()) ||
+        fs::last_write_time(it->path()) < since) {
+      continue;
+    }
+    auto relative = it->path().string().substr(from.string().size());
+    relative.erase(0, relative.find_first_not_of('/'));
+    auto dest = to / relative;
+    fs::create_directories(dest.parent_path(), ec);
+    fs::copy_file(it->path(), dest, fs::copy_option::overwrite_if_exists, ec);
+    if (ec) {
+      return false;
+    }
+  }
+  return !ec;
+}
+
+bool restore_cached_run(const std::string& cache_dir,
+                        const std::string& fingerprint,
+                        const std::string& out_dir) {
+  auto entry = boost::filesystem::path(cache_dir) / fingerprint;
+  if (!boost::filesystem::is_directory(entry)) {
+    return false;
+  }
+  return copy_tree(entry, out_dir);
+}
+
+void save_cached_run(const std::string& cache_dir,
+                     const std::string& fingerprint,
+                     const std::string& out_dir,
+                     std::time_t run_start) {
+  namespace fs = boost::filesystem;
+  boost::system::error_code ec;
+  auto entry = fs::path(cache_dir) / fingerprint;
+  // Populate a private directory and rename it into place, so a cache entry
+  // is either complete or absent.
+  auto tmp = fs::path(cache_dir) / fs::unique_path(fingerprint + ".%%%%%%%%");
+  fs::create_directories(tmp, ec);
+  if (ec || !copy_tree(out_dir, tmp, run_start)) {
+    std::cerr << "warning: cannot save run to " << cache_dir << std::endl;
+    fs::remove_all(tmp, ec);
+    return;
+  }
+  fs::rename(tmp, entry, ec);
+  if (ec) {
+    // Most likely a concurrent run saved the same entry first.
+    fs::remove_all(tmp, ec);
+  }
+}
+
 void output_moved_methods_map(const char* path, ConfigFiles& cfg) {
   // print out moved methods map
   if (cfg.save_move_map() && strcmp(path, "")) {
@@ -466,33 +687,220 @@ void output_moved_methods_map(const char* path, ConfigFiles& cfg) {
     TRACE(MAIN, 1, "No method move map data structure!\n");
   }
 }
-} // namespace
+bool ends_with(const std::string& s, const char* suffix) {
+  auto len = strlen(suffix);
+  return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
 
-int main(int argc, char* argv[]) {
-  signal(SIGSEGV, crash_backtrace_handler);
-  signal(SIGABRT, crash_backtrace_handler);
-#ifndef _MSC_VER
-  signal(SIGBUS, crash_backtrace_handler);
-#endif
+// The number of a classes<N>.dex at the root of an APK (1 for classes.dex),
+// or 0 for any other entry.
+size_t root_dex_number(const std::string& name) {
+  if (name.compare(0, 7, "classes") != 0 || !ends_with(name, ".dex")) {
+    return 0;
+  }
+  auto num = name.substr(7, name.size() - 7 - 4);
+  if (num.empty()) {
+    return 1;
+  }
+  if (num.find_first_not_of("0123456789") != std::string::npos) {
+    return 0;
+  }
+  return std::stoul(num);
+}
 
+// The dexes of the APK, as locations for load_classes_from_dexes.
+std::vector<std::string> apk_dex_locations(const std::string& apk) {
+  std::vector<std::pair<size_t, std::string>> dexes;
+  zip::Reader reader(apk);
+  for (const auto& entry : reader.entries()) {
+    auto num = root_dex_number(entry.name);
+    if (num != 0) {
+      dexes.emplace_back(num, entry.name);
+    }
+  }
+  std::sort(dexes.begin(), dexes.end());
+  std::vector<std::string> ret;
+  for (const auto& dex : dexes) {
+    ret.push_back(apk + "!" + dex.second);
+  }
+  return ret;
+}
+
+/*
+ * Copies the input APK, with the new dexes in place of its old ones and
+ * without its signature, whose files are gone. The other entries are copied
+ * still compressed, and the dexes are compressed in parallel, so everything
+ * but the central directories is only ever in memory once. With store_dexes
+ * the dexes are stored page-aligned instead, and the alignment report goes
+ * to report_path.
+ */
+void write_output_apk(const std::string& input_apk,
+                      const std::string& output_apk,
+                      bool page_align_libs,
+                      bool store_dexes,
+                      const std::string& report_path,
+                      const std::vector<DexOutputJob>& jobs) {
+  std::vector<zip::Entry> dexes(jobs.size());
+  std::vector<std::vector<uint8_t>> storage(jobs.size());
+  auto now = time(nullptr);
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    const auto& contents = *jobs[i].contents;
+    auto name = boost::filesystem::path(jobs[i].filename).filename().string();
+    dexes[i] = zip::compress(name, contents.data(), contents.size(),
+                             store_dexes ? kCompMethodStore
+                                         : kCompMethodDeflate,
+                             now, &storage[i]);
+  });
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  zip::Reader reader(input_apk);
+  zip::Writer writer(output_apk, page_align_libs, store_dexes);
+  bool wrote_dexes = false;
+  auto add_dexes = [&] {
+    for (const auto& dex : dexes) {
+      writer.add(dex);
+    }
+    wrote_dexes = true;
+  };
+  for (const auto& entry : reader.entries()) {
+    if (root_dex_number(entry.name) != 0) {
+      // The new dexes go where the first of the old ones was.
+      if (!wrote_dexes) {
+        add_dexes();
+      }
+      continue;
+    }
+    if (entry.name.compare(0, 9, "META-INF/") == 0 &&
+        entry.name.back() != '/') {
+      continue;
+    }
+    writer.add(entry);
+  }
+  if (!wrote_dexes) {
+    add_dexes();
+  }
+  writer.finish();
+
+  if (store_dexes) {
+    // Check what actually went into the file.
+    FILE* report = fopen(report_path.c_str(), "w");
+    always_assert_log(report, "Can't open %s for writing\n",
+                      report_path.c_str());
+    bool mappable = zip::report_dex_alignment(zip::Reader(output_apk), report);
+    fclose(report);
+    always_assert_log(mappable, "Dexes of %s can't be mapped, see %s\n",
+                      output_apk.c_str(), report_path.c_str());
+  }
+}
+/*
+ * What a run needs besides the app itself: the ProGuard configuration and
+ * the library jars, which a daemon parses once for all of its jobs.
+ */
+struct LibraryInputs {
+  redex::ProguardConfiguration pg_config;
+  std::set<std::string> library_jars;
+
+  struct Jar {
+    std::unique_ptr<ParsedJar> parsed;
+    // Whether its classes go into the external classes handed to the passes,
+    // which only those found at their own path do.
+    bool external_scope;
+  };
+  // Filled in by a daemon only, in the order of library_jars.
+  std::vector<Jar> parsed_jars;
+};
+
+void read_library_inputs(Arguments& args, LibraryInputs* libs) {
+  // Currently there are two sources that specify the library jars:
+  // 1. The jar_path argument, which may specify one library jar.
+  // 2. The library_jars vector, which lists the library jars specified in
+  //    the ProGuard configuration.
+  // If -jarpath specified a library jar it is appended to the
+  // library_jars vector so this vector can be used to iterate over
+  // all the library jars regardless of whether they were specified
+  // on the command line or ProGuard file.
+  // TODO: Make the command line -jarpath option like a colon separated
+  //       list of library JARS.
+  for (const auto pg_config_path : args.proguard_config_paths) {
+    Timer time_pg_parsing("Parsed ProGuard config file");
+    redex::proguard_parser::parse_file(pg_config_path, &libs->pg_config);
+  }
+
+  const auto& pg_libs = libs->pg_config.libraryjars;
+  args.jar_paths.insert(pg_libs.begin(), pg_libs.end());
+
+  for (const auto jar_path : args.jar_paths) {
+    std::stringstream jar_stream(jar_path);
+    std::string dependent_jar_path;
+    while (std::getline(jar_stream, dependent_jar_path, ':')) {
+      TRACE(MAIN,
+            2,
+            "Dependent JAR specified on command-line: %s\n",
+            dependent_jar_path.c_str());
+      libs->library_jars.emplace(dependent_jar_path);
+    }
+  }
+}
+
+void load_library_jars(const Arguments& args,
+                       LibraryInputs& libs,
+                       Scope* external_classes) {
+  if (!libs.parsed_jars.empty()) {
+    for (auto& jar : libs.parsed_jars) {
+      if (!jar.parsed->load(jar.external_scope ? external_classes : nullptr)) {
+        exit(EXIT_FAILURE);
+      }
+    }
+    return;
+  }
+  auto jar_cache_dir = args.config.get("library_jar_cache_dir", "").asString();
+  auto load_library_jar = [&](const std::string& path, Scope* classes) {
+    if (jar_cache_dir.empty()) {
+      return load_jar_file(path.c_str(), classes);
+    }
+    return load_jar_file_cached(path.c_str(), jar_cache_dir, classes);
+  };
+  for (const auto& library_jar : libs.library_jars) {
+    TRACE(MAIN, 1, "LIBRARY JAR: %s\n", library_jar.c_str());
+    if (!load_library_jar(library_jar, external_classes)) {
+      // Try again with the basedir
+      std::string basedir_path =
+          libs.pg_config.basedirectory + "/" + library_jar.c_str();
+      if (!load_library_jar(basedir_path, nullptr)) {
+        std::cerr << "error: library jar could not be loaded: " << library_jar
+                  << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+}
+
+/*
+ * Runs redex on the inputs in `args`. `resident` holds the library inputs
+ * when a daemon has read them already; otherwise they are read here.
+ */
+int run_redex(const char* argv0, Arguments& args, LibraryInputs* resident) {
   std::string stats_output_path;
   Json::Value stats;
+  std::time_t run_start = std::time(nullptr);
+  std::string incremental_cache_dir;
+  std::string run_fingerprint;
+  std::string out_dir;
+  std::string timeline_output_path;
   {
     Timer redex_all_main_timer("redex-all main()");
 
     g_redex = new RedexContext();
 
-    // Currently there are two sources that specify the library jars:
-    // 1. The jar_path argument, which may specify one library jar.
-    // 2. The library_jars vector, which lists the library jars specified in
-    //    the ProGuard configuration.
-    // If -jarpath specified a library jar it is appended to the
-    // library_jars vector so this vector can be used to iterate over
-    // all the library jars regardless of whether they were specified
-    // on the command line or ProGuard file.
-    // TODO: Make the command line -jarpath option like a colon separated
-    //       list of library JARS.
-    Arguments args = parse_args(argc, argv);
+    auto timeline_file = args.config.get("timeline_output", "").asString();
+    if (!timeline_file.empty()) {
+      timeline_output_path = args.out_dir + "/" + timeline_file;
+      Timeline::enable();
+      Timeline::set_thread_name("main");
+    }
 
     if (!dir_is_writable(args.out_dir)) {
       std::cerr << "error: outdir is not a writable directory: " << args.out_dir
@@ -502,26 +910,40 @@ int main(int argc, char* argv[]) {
 
     RedexContext::set_next_release_gate(
         args.config.get("next_release_gate", false).asBool());
+    auto debug_info_loading =
+        args.config.get("debug_info_loading", "decode").asString();
+    if (debug_info_loading == "defer") {
+      RedexContext::set_debug_info_loading(
+          RedexContext::DebugInfoLoading::Defer);
+    } else if (debug_info_loading == "drop") {
+      RedexContext::set_debug_info_loading(
+          RedexContext::DebugInfoLoading::Drop);
+    } else {
+      always_assert_log(debug_info_loading == "decode",
+                        "Unknown debug_info_loading: %s\n",
+                        debug_info_loading.c_str());
+    }
+
+    LibraryInputs cold_libs;
+    if (resident == nullptr) {
+      read_library_inputs(args, &cold_libs);
+    }
+    LibraryInputs& libs = resident != nullptr ? *resident : cold_libs;
+    const auto& pg_config = libs.pg_config;
+    const auto& library_jars = libs.library_jars;
 
-    redex::ProguardConfiguration pg_config;
-    for (const auto pg_config_path : args.proguard_config_paths) {
-      Timer time_pg_parsing("Parsed ProGuard config file");
-      redex::proguard_parser::parse_file(pg_config_path, &pg_config);
-    }
-
-    const auto& pg_libs = pg_config.libraryjars;
-    args.jar_paths.insert(pg_libs.begin(), pg_libs.end());
-
-    std::set<std::string> library_jars;
-    for (const auto jar_path : args.jar_paths) {
-      std::stringstream jar_stream(jar_path);
-      std::string dependent_jar_path;
-      while (std::getline(jar_stream, dependent_jar_path, ':')) {
-        TRACE(MAIN,
-              2,
-              "Dependent JAR specified on command-line: %s\n",
-              dependent_jar_path.c_str());
-        library_jars.emplace(dependent_jar_path);
+    incremental_cache_dir =
+        args.config.get("incremental_cache_dir", "").asString();
+    if (!incremental_cache_dir.empty()) {
+      Timer t("Fingerprinting inputs");
+      run_fingerprint =
+          fingerprint_run(argv0, args, pg_config, library_jars);
+      out_dir = args.out_dir;
+      if (restore_cached_run(incremental_cache_dir, run_fingerprint, out_dir)) {
+        TRACE(MAIN, 1, "Inputs unchanged, reused outputs of run %s\n",
+              run_fingerprint.c_str());
+        delete g_redex;
+        return 0;
       }
     }
 
@@ -531,51 +953,50 @@ int main(int argc, char* argv[]) {
 
     dex_stats_t input_totals;
     std::vector<dex_stats_t> input_dexes_stats;
+    std::string input_apk;
 
     {
       Timer t("Load classes from dexes");
+      // Which store each dex goes into, in the order they were given.
+      std::vector<std::string> dex_paths;
+      std::vector<size_t> dex_stores;
       for (const auto& filename : args.dex_files) {
         if (filename.size() >= 5 &&
             filename.compare(filename.size() - 4, 4, ".dex") == 0) {
-          dex_stats_t dex_stats;
-          DexClasses classes =
-              load_classes_from_dex(filename.c_str(), &dex_stats);
-          input_totals += dex_stats;
-          input_dexes_stats.push_back(dex_stats);
-          stores[0].add_classes(std::move(classes));
+          dex_paths.push_back(filename);
+          dex_stores.push_back(0);
+        } else if (ends_with(filename, ".apk")) {
+          // Read straight out of the APK, without extracting it.
+          if (!input_apk.empty()) {
+            std::cerr << "error: more than one input APK" << std::endl;
+            exit(EXIT_FAILURE);
+          }
+          input_apk = filename;
+          for (const auto& location : apk_dex_locations(filename)) {
+            dex_paths.push_back(location);
+            dex_stores.push_back(0);
+          }
         } else {
           DexMetadata store_metadata;
           store_metadata.parse(filename);
-          DexStore store(store_metadata);
-          for (auto file_path : store_metadata.get_files()) {
-            dex_stats_t dex_stats;
-            DexClasses classes =
-                load_classes_from_dex(file_path.c_str(), &dex_stats);
-            input_totals += dex_stats;
-            input_dexes_stats.push_back(dex_stats);
-            store.add_classes(std::move(classes));
+          for (const auto& file_path : store_metadata.get_files()) {
+            dex_paths.push_back(file_path);
+            dex_stores.push_back(stores.size());
           }
-          stores.emplace_back(std::move(store));
+          stores.emplace_back(DexStore(store_metadata));
         }
       }
+      auto dexen = load_classes_from_dexes(dex_paths, &input_dexes_stats);
+      for (size_t i = 0; i < dexen.size(); i++) {
+        input_totals += input_dexes_stats[i];
+        stores[dex_stores[i]].add_classes(std::move(dexen[i]));
+      }
     }
 
     Scope external_classes;
     if (!library_jars.empty()) {
       Timer t("Load library jars");
-      for (const auto& library_jar : library_jars) {
-        TRACE(MAIN, 1, "LIBRARY JAR: %s\n", library_jar.c_str());
-        if (!load_jar_file(library_jar.c_str(), &external_classes)) {
-          // Try again with the basedir
-          std::string basedir_path =
-              pg_config.basedirectory + "/" + library_jar.c_str();
-          if (!load_jar_file(basedir_path.c_str())) {
-            std::cerr << "error: library jar could not be loaded: "
-                      << library_jar << std::endl;
-            exit(EXIT_FAILURE);
-          }
-        }
-      }
+      load_library_jars(args, libs, &external_classes);
     }
 
     ConfigFiles cfg(args.config);
@@ -598,12 +1019,12 @@ int main(int argc, char* argv[]) {
 
     TRACE(MAIN, 1, "Writing out new DexClasses...\n");
 
-    LocatorIndex* locator_index = nullptr;
+    std::unique_ptr<LocatorIndex> locator_index;
     if (args.config.get("emit_locator_strings", false).asBool()) {
       TRACE(LOC,
             1,
             "Will emit class-locator strings for classloader optimization\n");
-      locator_index = new LocatorIndex(make_locator_index(stores));
+      locator_index = std::make_unique<LocatorIndex>(stores);
     }
 
     dex_stats_t output_totals;
@@ -615,8 +1036,8 @@ int main(int argc, char* argv[]) {
         cfg.metafile(args.config.get("line_number_map_v2", "").asString());
     std::unique_ptr<PositionMapper> pos_mapper(
         PositionMapper::make(pos_output, pos_output_v2));
+    std::vector<DexOutputJob> output_jobs;
     for (auto& store : stores) {
-      Timer t("Writing optimized dexes");
       for (size_t i = 0; i < store.get_dexen().size(); i++) {
         std::stringstream ss;
         ss << args.out_dir << "/" << store.get_name();
@@ -632,17 +1053,56 @@ int main(int argc, char* argv[]) {
           ss << (i + 2);
         }
         ss << ".dex";
-        auto this_dex_stats = write_classes_to_dex(ss.str(),
-                                                   &store.get_dexen()[i],
-                                                   locator_index,
-                                                   i,
-                                                   cfg,
-                                                   args.config,
-                                                   pos_mapper.get());
-        output_totals += this_dex_stats;
-        output_dexes_stats.push_back(this_dex_stats);
+        output_jobs.push_back({ss.str(), &store.get_dexen()[i], i});
       }
     }
+    // The contents of the dexes going into the output APK.
+    std::vector<std::vector<uint8_t>> dex_contents;
+    if (!args.output_apk.empty()) {
+      if (input_apk.empty() || stores.size() > 1) {
+        std::cerr << "error: --output-apk needs an APK as the only input"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      dex_contents.resize(output_jobs.size());
+      for (size_t i = 0; i < output_jobs.size(); i++) {
+        output_jobs[i].contents = &dex_contents[i];
+      }
+    }
+    {
+      Timer t("Writing optimized dexes");
+      if (args.config.get("concurrent_dex_output", false).asBool() ||
+          !args.output_apk.empty()) {
+        output_dexes_stats = write_classes_to_dexes(output_jobs,
+                                                    locator_index.get(),
+                                                    cfg,
+                                                    args.config,
+                                                    pos_mapper.get());
+      } else {
+        for (auto& job : output_jobs) {
+          output_dexes_stats.push_back(write_classes_to_dex(job.filename,
+                                                            job.classes,
+                                                            locator_index.get(),
+                                                            job.dex_number,
+                                                            cfg,
+                                                            args.config,
+                                                            pos_mapper.get()));
+        }
+      }
+    }
+    write_merged_pg_mapping(stores, cfg, args.config);
+    for (auto& this_dex_stats : output_dexes_stats) {
+      output_totals += this_dex_stats;
+    }
+    if (!args.output_apk.empty()) {
+      Timer t("Writing output APK");
+      write_output_apk(input_apk,
+                       args.output_apk,
+                       args.page_align_libs,
+                       args.store_dexes,
+                       cfg.metafile("dex-alignment.txt"),
+                       output_jobs);
+    }
 
     {
       Timer t("Writing stats");
@@ -673,6 +1133,368 @@ int main(int argc, char* argv[]) {
     std::ofstream out(stats_output_path);
     writer.write(out, stats);
   }
+  if (!timeline_output_path.empty() &&
+      !Timeline::write(timeline_output_path)) {
+    std::cerr << "warning: cannot write timeline to " << timeline_output_path
+              << std::endl;
+  }
+
+  if (!incremental_cache_dir.empty()) {
+    save_cached_run(incremental_cache_dir, run_fingerprint, out_dir,
+                    run_start);
+  }
 
   return 0;
 }
+
+#ifndef _MSC_VER
+/*
+ * Daemon mode. `redex-all --serve <socket> -p ... -j ...` reads the ProGuard
+ * configuration and parses the library jars once, then waits for jobs on a
+ * local socket. `redex-all --connect <socket> <options> <dex files>` sends
+ * the rest of its command line as a job, and exits with the job's status.
+ *
+ * Each job runs in a child forked from the daemon, so it starts out with the
+ * resident inputs and a fresh RedexContext, and whatever it changes goes
+ * away with it. A job has to name the same ProGuard configuration and
+ * library jars as the daemon. Their classes are still made after the app's
+ * dexes are loaded, as in any other run, so that app classes keep
+ * precedence over library classes of the same name.
+ *
+ * A request is a 32-bit length, sent along with the client's stdout and
+ * stderr, then that many bytes of NUL-terminated strings: the client's
+ * working directory and its arguments. The reply is the job's exit status
+ * as a 32-bit int, or 128 plus the signal that killed it.
+ */
+
+bool write_all(int fd, const void* data, size_t size) {
+  auto p = static_cast<const char*>(data);
+  while (size > 0) {
+    auto n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool read_all(int fd, void* data, size_t size) {
+  auto p = static_cast<char*>(data);
+  while (size > 0) {
+    auto n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool socket_address(const std::string& path, sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr->sun_path)) {
+    std::cerr << "error: socket path is too long: " << path << std::endl;
+    return false;
+  }
+  strcpy(addr->sun_path, path.c_str());
+  return true;
+}
+
+// Makes the ProGuard configuration and library jar paths absolute, so that
+// the daemon and its clients can tell whether they name the same files.
+void make_library_paths_absolute(Arguments& args) {
+  namespace fs = boost::filesystem;
+  auto absolute = [](const std::string& path) {
+    boost::system::error_code ec;
+    auto canonical = fs::canonical(path, ec);
+    return ec ? fs::absolute(path).string() : canonical.string();
+  };
+  for (auto& path : args.proguard_config_paths) {
+    path = absolute(path);
+  }
+  std::set<std::string> jar_paths;
+  for (const auto& jar_path : args.jar_paths) {
+    std::stringstream jar_stream(jar_path);
+    std::string path;
+    std::string absolute_paths;
+    while (std::getline(jar_stream, path, ':')) {
+      if (!absolute_paths.empty()) {
+        absolute_paths += ':';
+      }
+      absolute_paths += absolute(path);
+    }
+    jar_paths.emplace(absolute_paths);
+  }
+  args.jar_paths = std::move(jar_paths);
+}
+
+int run_client(const std::string& socket_path, int argc, char* argv[]) {
+  sockaddr_un addr;
+  if (!socket_address(socket_path, &addr)) {
+    return EXIT_FAILURE;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    std::cerr << "error: cannot connect to " << socket_path << ": "
+              << strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string payload = boost::filesystem::current_path().string();
+  payload += '\0';
+  for (int i = 1; i < argc; ++i) {
+    payload += argv[i];
+    payload += '\0';
+  }
+  uint32_t size = payload.size();
+  iovec iov = {&size, sizeof(size)};
+  int fds[] = {STDOUT_FILENO, STDERR_FILENO};
+  char control[CMSG_SPACE(sizeof(fds))] = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  auto cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  int32_t status;
+  if (sendmsg(fd, &msg, 0) != sizeof(size) ||
+      !write_all(fd, payload.data(), payload.size()) ||
+      !read_all(fd, &status, sizeof(status))) {
+    std::cerr << "error: lost the connection to " << socket_path << std::endl;
+    close(fd);
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  return status;
+}
+
+/*
+ * Runs the job sent over `conn`, in a child of the daemon. `daemon_args` are
+ * the arguments the daemon was started with.
+ */
+int run_job(int conn,
+            const char* argv0,
+            const Arguments& daemon_args,
+            LibraryInputs& libs) {
+  uint32_t size;
+  iovec iov = {&size, sizeof(size)};
+  int fds[2];
+  char control[CMSG_SPACE(sizeof(fds))];
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (recvmsg(conn, &msg, 0) != sizeof(size)) {
+    return EXIT_FAILURE;
+  }
+  auto cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+    return EXIT_FAILURE;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  std::string payload(size, '\0');
+  bool received = read_all(conn, &payload[0], size);
+  close(conn);
+  // From here on, the job writes to the client's stdout and stderr.
+  dup2(fds[0], STDOUT_FILENO);
+  dup2(fds[1], STDERR_FILENO);
+  close(fds[0]);
+  close(fds[1]);
+  if (!received || payload.empty() || payload.back() != '\0') {
+    std::cerr << "error: malformed job" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<char*> job_argv{const_cast<char*>(argv0)};
+  for (size_t pos = payload.find('\0') + 1; pos < payload.size();
+       pos = payload.find('\0', pos) + 1) {
+    job_argv.push_back(&payload[pos]);
+  }
+  if (chdir(payload.c_str()) != 0) {
+    std::cerr << "error: cannot change to " << payload.c_str() << std::endl;
+    return EXIT_FAILURE;
+  }
+  Arguments args = parse_args(job_argv.size(), job_argv.data());
+  if (!args.serve_socket.empty()) {
+    std::cerr << "error: a job cannot start a daemon" << std::endl;
+    return EXIT_FAILURE;
+  }
+  make_library_paths_absolute(args);
+  if (args.proguard_config_paths != daemon_args.proguard_config_paths ||
+      args.jar_paths != daemon_args.jar_paths) {
+    std::cerr << "error: the job's ProGuard configuration and library jars "
+                 "differ from those of the daemon"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  return run_redex(argv0, args, &libs);
+}
+
+int s_child_exited_pipe[2];
+
+void child_exited_handler(int) {
+  auto saved_errno = errno;
+  char byte = 0;
+  UNUSED auto n = write(s_child_exited_pipe[1], &byte, 1);
+  errno = saved_errno;
+}
+
+int serve(const char* argv0, Arguments& args) {
+  make_library_paths_absolute(args);
+  // Kept as given on the command line, for comparison with the jobs'.
+  Arguments daemon_args = args;
+  LibraryInputs libs;
+  read_library_inputs(args, &libs);
+  {
+    Timer t("Parse library jars");
+    auto jar_cache_dir =
+        args.config.get("library_jar_cache_dir", "").asString();
+    for (const auto& library_jar : libs.library_jars) {
+      TRACE(MAIN, 1, "LIBRARY JAR: %s\n", library_jar.c_str());
+      auto parsed = ParsedJar::parse(library_jar.c_str(), jar_cache_dir);
+      bool external_scope = true;
+      if (parsed == nullptr) {
+        // Try again with the basedir
+        std::string basedir_path =
+            libs.pg_config.basedirectory + "/" + library_jar.c_str();
+        parsed = ParsedJar::parse(basedir_path.c_str(), jar_cache_dir);
+        external_scope = false;
+      }
+      if (parsed == nullptr) {
+        std::cerr << "error: library jar could not be loaded: " << library_jar
+                  << std::endl;
+        return EXIT_FAILURE;
+      }
+      libs.parsed_jars.push_back({std::move(parsed), external_scope});
+    }
+  }
+  // Jobs are forked from this thread, and only it survives a fork().
+  ThreadPool::get().join_workers();
+
+  sockaddr_un addr;
+  if (!socket_address(args.serve_socket, &addr)) {
+    return EXIT_FAILURE;
+  }
+  // Replace the socket of an earlier daemon.
+  unlink(args.serve_socket.c_str());
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0 || bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(listen_fd, SOMAXCONN) != 0) {
+    std::cerr << "error: cannot listen on " << args.serve_socket << ": "
+              << strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (pipe(s_child_exited_pipe) != 0) {
+    perror("pipe");
+    return EXIT_FAILURE;
+  }
+  fcntl(s_child_exited_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(s_child_exited_pipe[1], F_SETFL, O_NONBLOCK);
+  signal(SIGCHLD, child_exited_handler);
+  // A client that goes away before its job is done must not take the daemon
+  // with it.
+  signal(SIGPIPE, SIG_IGN);
+  TRACE(MAIN, 1, "Serving on %s\n", args.serve_socket.c_str());
+
+  // The client connection of each running job.
+  std::unordered_map<pid_t, int> jobs;
+  while (true) {
+    pollfd fds[] = {{listen_fd, POLLIN, 0},
+                    {s_child_exited_pipe[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      return EXIT_FAILURE;
+    }
+    if (fds[1].revents & POLLIN) {
+      char buf[64];
+      while (read(s_child_exited_pipe[0], buf, sizeof(buf)) > 0) {
+      }
+      int status;
+      pid_t pid;
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        auto it = jobs.find(pid);
+        if (it == jobs.end()) {
+          continue;
+        }
+        int32_t code = WIFEXITED(status) ? WEXITSTATUS(status)
+                                         : 128 + WTERMSIG(status);
+        write_all(it->second, &code, sizeof(code));
+        close(it->second);
+        jobs.erase(it);
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      int conn = accept(listen_fd, nullptr, nullptr);
+      if (conn < 0) {
+        continue;
+      }
+      pid_t pid = fork();
+      if (pid == 0) {
+        close(listen_fd);
+        close(s_child_exited_pipe[0]);
+        close(s_child_exited_pipe[1]);
+        for (const auto& job : jobs) {
+          close(job.second);
+        }
+        signal(SIGCHLD, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        exit(run_job(conn, argv0, daemon_args, libs));
+      }
+      if (pid < 0) {
+        perror("fork");
+        close(conn);
+        continue;
+      }
+      jobs.emplace(pid, conn);
+    }
+  }
+}
+#else
+int run_client(const std::string&, int, char*[]) {
+  std::cerr << "error: --connect is not supported on this platform"
+            << std::endl;
+  return EXIT_FAILURE;
+}
+
+int serve(const char*, Arguments&) {
+  std::cerr << "error: --serve is not supported on this platform" << std::endl;
+  return EXIT_FAILURE;
+}
+#endif
+} // namespace
+
+int main(int argc, char* argv[]) {
+  signal(SIGSEGV, crash_backtrace_handler);
+  signal(SIGABRT, crash_backtrace_handler);
+#ifndef _MSC_VER
+  signal(SIGBUS, crash_backtrace_handler);
+#endif
+
+  Arguments args = parse_args(argc, argv);
+  if (!args.connect_socket.empty()) {
+    return run_client(args.connect_socket, argc, argv);
+  }
+  if (!args.serve_socket.empty()) {
+    return serve(argv[0], args);
+  }
+  return run_redex(argv[0], args, nullptr);
+}
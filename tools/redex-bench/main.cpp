@@ -0,0 +1,281 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+/*
+ * Runs passes one at a time over a fixed set of dexes and reports how long
+ * each takes, and how that changes with the number of threads:
+ *
+ *   redex-bench -c config.json -p proguard.pro --threads 1,2,4,8 \
+ *     --pass InlinePass --pass RegAllocPass classes*.dex
+ *
+ * Every run starts from the same IR: the dexes are reloaded into a fresh
+ * RedexContext before each one, so a pass never sees the output of an earlier
+ * run. Only run_pass is timed; loading, ProGuard rule matching and the type
+ * checker that follows are not.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "DexClass.h"
+#include "DexLoader.h"
+#include "DexUtil.h"
+#include "JarLoader.h"
+#include "Pass.h"
+#include "PassManager.h"
+#include "PassRegistry.h"
+#include "ProguardConfiguration.h"
+#include "ProguardParser.h"
+#include "RedexContext.h"
+#include "Timer.h"
+#include "Walkers.h"
+#include "WorkQueue.h"
+
+namespace {
+
+struct Arguments {
+  Json::Value config{Json::objectValue};
+  std::vector<std::string> proguard_config_paths;
+  std::vector<std::string> jar_paths;
+  std::vector<std::string> pass_names;
+  std::vector<unsigned int> thread_counts;
+  size_t repeat{3};
+  std::string json_output;
+  std::vector<std::string> dex_files;
+};
+
+std::vector<unsigned int> parse_thread_counts(const std::string& list) {
+  std::vector<unsigned int> counts;
+  std::stringstream ss(list);
+  std::string count;
+  while (std::getline(ss, count, ',')) {
+    counts.push_back(std::max(1, std::stoi(count)));
+  }
+  return counts;
+}
+
+Arguments parse_args(int argc, char* argv[]) {
+  namespace po = boost::program_options;
+  po::options_description od(
+      "usage: redex-bench [options...] dex-files...");
+  od.add_options()("help,h", "print this help message");
+  od.add_options()("config,c",
+                   po::value<std::string>(),
+                   "JSON-formatted config file; pass settings come from here");
+  od.add_options()("proguard-config,p",
+                   po::value<std::vector<std::string>>(),
+                   "ProGuard config file");
+  od.add_options()("jarpath,j",
+                   po::value<std::vector<std::string>>(),
+                   "classpath jar");
+  od.add_options()("pass",
+                   po::value<std::vector<std::string>>(),
+                   "pass to benchmark (default: the config's pass list)");
+  od.add_options()("threads",
+                   po::value<std::string>()->default_value("1,2,4,8"),
+                   "comma-separated thread counts to run each pass with");
+  od.add_options()("repeat",
+                   po::value<size_t>()->default_value(3),
+                   "runs per pass and thread count");
+  od.add_options()("json",
+                   po::value<std::string>(),
+                   "also write the results to this file as JSON");
+  od.add_options()("dex-files",
+                   po::value<std::vector<std::string>>(),
+                   "dex files to load");
+  po::positional_options_description pod;
+  pod.add("dex-files", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(
+        po::command_line_parser(argc, argv).options(od).positional(pod).run(),
+        vm);
+    po::notify(vm);
+  } catch (const po::error& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl << od << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (vm.count("help") || !vm.count("dex-files")) {
+    std::cout << od << std::endl;
+    exit(vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  Arguments args;
+  if (vm.count("config")) {
+    std::ifstream config_stream(vm["config"].as<std::string>());
+    if (!config_stream) {
+      std::cerr << "error: cannot open config file: "
+                << vm["config"].as<std::string>() << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    config_stream >> args.config;
+  }
+  if (vm.count("proguard-config")) {
+    args.proguard_config_paths =
+        vm["proguard-config"].as<std::vector<std::string>>();
+  }
+  if (vm.count("jarpath")) {
+    args.jar_paths = vm["jarpath"].as<std::vector<std::string>>();
+  }
+  if (vm.count("pass")) {
+    args.pass_names = vm["pass"].as<std::vector<std::string>>();
+  } else {
+    for (const auto& pass : args.config["redex"]["passes"]) {
+      args.pass_names.push_back(pass.asString());
+    }
+  }
+  if (args.pass_names.empty()) {
+    std::cerr << "error: no passes given, and none in the config" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  args.thread_counts = parse_thread_counts(vm["threads"].as<std::string>());
+  args.repeat = std::max<size_t>(1, vm["repeat"].as<size_t>());
+  if (vm.count("json")) {
+    args.json_output = vm["json"].as<std::string>();
+  }
+  args.dex_files = vm["dex-files"].as<std::vector<std::string>>();
+  return args;
+}
+
+struct RunResult {
+  double seconds;
+  size_t num_methods;
+};
+
+/*
+ * Loads the inputs into a fresh context, runs `pass_name` alone over them and
+ * returns how long its run_pass took.
+ */
+RunResult run_pass_once(const Arguments& args,
+                        const redex::ProguardConfiguration& pg_config,
+                        const std::string& pass_name,
+                        const std::string& out_dir) {
+  g_redex = new RedexContext();
+
+  DexStore root_store("classes");
+  for (const auto& filename : args.dex_files) {
+    root_store.add_classes(load_classes_from_dex(filename.c_str()));
+  }
+  DexStoresVector stores;
+  stores.emplace_back(std::move(root_store));
+
+  Scope external_classes;
+  for (const auto& jar : args.jar_paths) {
+    if (!load_jar_file(jar.c_str(), &external_classes)) {
+      std::cerr << "error: cannot load jar: " << jar << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  size_t num_methods = 0;
+  walk::methods(build_class_scope(stores),
+                [&](DexMethod*) { ++num_methods; });
+
+  Json::Value config = args.config;
+  config["redex"]["passes"] = Json::Value(Json::arrayValue);
+  config["redex"]["passes"].append(pass_name);
+  ConfigFiles cfg(config);
+  cfg.outdir = out_dir;
+  PassManager manager(PassRegistry::get().get_passes(), pg_config, config);
+  if (pg_config.keep_rules.empty()) {
+    manager.set_testing_mode();
+  }
+  manager.run_passes(stores, external_classes, cfg);
+
+  // The pass's run is the last "<name> (run)" Timer to have finished.
+  const auto& times = Timer::get_times();
+  auto run_label = pass_name.substr(0, pass_name.find('#')) + " (run)";
+  auto it = std::find_if(times.rbegin(), times.rend(), [&](const auto& t) {
+    return t.first == run_label;
+  });
+  always_assert(it != times.rend());
+
+  delete g_redex;
+  g_redex = nullptr;
+  return {it->second, num_methods};
+}
+
+double median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  auto mid = values.size() / 2;
+  return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto args = parse_args(argc, argv);
+
+  redex::ProguardConfiguration pg_config;
+  for (const auto& path : args.proguard_config_paths) {
+    redex::proguard_parser::parse_file(path, &pg_config);
+  }
+
+  auto out_dir = boost::filesystem::temp_directory_path() /
+                 boost::filesystem::unique_path("redex-bench-%%%%%%%%");
+  boost::filesystem::create_directories(out_dir);
+
+  Json::Value results(Json::arrayValue);
+  printf("%-40s %8s %10s %14s %8s\n", "pass", "threads", "median s",
+         "methods/s", "speedup");
+  for (const auto& pass_name : args.pass_names) {
+    double baseline = 0;
+    for (auto threads : args.thread_counts) {
+      set_num_threads_override(threads);
+      std::vector<double> seconds;
+      size_t num_methods = 0;
+      for (size_t i = 0; i < args.repeat; ++i) {
+        auto result =
+            run_pass_once(args, pg_config, pass_name, out_dir.string());
+        seconds.push_back(result.seconds);
+        num_methods = result.num_methods;
+      }
+      auto secs = median(seconds);
+      if (baseline == 0) {
+        baseline = secs;
+      }
+      auto throughput = secs > 0 ? num_methods / secs : 0;
+      auto speedup = secs > 0 ? baseline / secs : 0;
+      printf("%-40s %8u %10.3f %14.0f %8.2f\n", pass_name.c_str(), threads,
+             secs, throughput, speedup);
+
+      Json::Value result;
+      result["pass"] = pass_name;
+      result["threads"] = threads;
+      result["median_seconds"] = secs;
+      result["methods"] = Json::UInt64(num_methods);
+      result["methods_per_second"] = throughput;
+      result["speedup"] = speedup;
+      for (auto s : seconds) {
+        result["seconds"].append(s);
+      }
+      results.append(result);
+    }
+  }
+  set_num_threads_override(0);
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(out_dir, ec);
+
+  if (!args.json_output.empty()) {
+    std::ofstream out(args.json_output);
+    Json::StyledStreamWriter writer;
+    writer.write(out, results);
+  }
+  return 0;
+}
@@ -111,9 +111,9 @@ void walk_predecessors(
 
 /**
  * Collect all the blocks leading to a throw and contributing to the
- * throw only.
+ * throw only. Returns false if the throw blocks are reachable from a return.
  */
-void collect_throwing_blocks(
+bool collect_throwing_blocks(
     DexMethod* meth, LogicalBlock& throwing_blocks) {
   const auto& blocks = meth->get_code()->cfg().blocks();
   std::queue<Block*> blocks_to_visit;
@@ -145,8 +145,7 @@ void collect_throwing_blocks(
   if (blocks.size() == no_throw_blocks.size()) {
     // I beleive this happens if a method throws and catches within
     // the method, needs some investigation
-    fprintf(stderr, "throw blocks reachable from return in %s\n", SHOW(meth));
-    return;
+    return false;
   }
   // collect all remaining blocks
   std::unordered_set<Block*> left_blocks;
@@ -168,27 +167,32 @@ void collect_throwing_blocks(
     walk_predecessors(block, throw_code, left_blocks);
     throwing_blocks.push_back(std::move(throw_code));
   }
+  return true;
 }
 
+struct MethodThrows {
+  LogicalBlock throwing_blocks;
+  bool reachable_from_return{false};
+};
+
 /**
- * Find all blocks that are in a throwing path.
- * Effectively looks for blocks that terminate with a throw and
- * if one is found the function is analyzed to determine all blocks
- * that are part of the throing path only.
+ * Report all blocks that are in a throwing path.
+ * Each method was analyzed on its own, in parallel, for the blocks that
+ * terminate with a throw and the blocks that are part of the throwing path
+ * only; the results are reported in the order of the methods.
  */
-void find_throwing_block(const Scope& scope) {
+void find_throwing_block(
+    const std::vector<std::pair<DexMethod*, MethodThrows>>& method_throws) {
   LogicalBlock throwing_blocks;
-  walk::code(scope,
-      [&](DexMethod* meth, IRCode& code) {
-        code.build_cfg();
-        const auto& cfg = code.cfg();
-        for (const auto& block : cfg.blocks()) {
-          if (is_throw_block(meth, block)) {
-            // do the analysis to find the blocks contributing to the throw
-            collect_throwing_blocks(meth, throwing_blocks);
-          }
-        }
-      });
+  for (const auto& pair : method_throws) {
+    const auto& throws = pair.second;
+    if (throws.reachable_from_return) {
+      fprintf(stderr, "throw blocks reachable from return in %s\n",
+          SHOW(pair.first));
+    }
+    throwing_blocks.insert(throwing_blocks.end(),
+        throws.throwing_blocks.begin(), throws.throwing_blocks.end());
+  }
   fprintf(stderr, "throwing blocks %ld\n", throwing_blocks.size());
   print_blocks_by_size(throwing_blocks);
 }
@@ -209,7 +213,23 @@ class AnalyzeThrows : public Tool {
       options["apkdir"].as<std::string>(),
       options["dexendir"].as<std::string>());
     const auto& scope = build_class_scope(stores);
-    find_throwing_block(scope);
+    auto method_throws = map_methods<MethodThrows>(scope, [](DexMethod* meth) {
+      MethodThrows throws;
+      auto code = meth->get_code();
+      if (code == nullptr) {
+        return throws;
+      }
+      code->build_cfg();
+      for (const auto& block : code->cfg().blocks()) {
+        if (is_throw_block(meth, block) &&
+            // do the analysis to find the blocks contributing to the throw
+            !collect_throwing_blocks(meth, throws.throwing_blocks)) {
+          throws.reachable_from_return = true;
+        }
+      }
+      return throws;
+    });
+    find_throwing_block(method_throws);
   }
 
  private:
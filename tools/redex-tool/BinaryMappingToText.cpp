@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "BinaryMappingFile.h"
+#include "Tool.h"
+
+namespace {
+
+class BinaryMappingToText : public Tool {
+ public:
+  BinaryMappingToText()
+      : Tool("binary-mapping-to-text",
+             "convert a binary symbol file to the text redex would have "
+             "written") {}
+
+  void add_options(po::options_description& options) const override {
+    options.add_options()
+      ("input,i",
+       po::value<std::string>()->value_name("redex-method-id-map.bin"),
+       "binary symbol file written with symbol_file_format = binary")
+      ("output,o",
+       po::value<std::string>()->value_name("redex-method-id-map.txt"),
+       "path to text output (defaults to stdout)")
+    ;
+  }
+
+  void run(const po::variables_map& options) override {
+    if (!options.count("input")) {
+      fprintf(stderr, "No --input given; terminating\n");
+      exit(EXIT_FAILURE);
+    }
+    binary_mapping::Reader reader(options["input"].as<std::string>());
+    FILE* fdout = stdout;
+    if (options.count("output")) {
+      const auto& filename = options["output"].as<std::string>();
+      fdout = fopen(filename.c_str(), "w");
+      if (!fdout) {
+        fprintf(stderr,
+                "Could not open %s for writing; terminating\n",
+                filename.c_str());
+        exit(EXIT_FAILURE);
+      }
+    }
+    reader.write_text(fdout);
+    fclose(fdout);
+  }
+};
+
+static BinaryMappingToText s_tool;
+
+}
@@ -17,14 +17,16 @@ $ buck run  //native/redex:redex-tool -- dex-sql-dump  \
       --jars <ANDROID_JAR> --proguard-map <RENAME_MAP> \
       --output dex.sql
 $ sqlite3 dex.db < dex.sql
+   (or, faster to load, --format csv --output <CSV_DIR>, then
+    sqlite3 dex.db < <CSV_DIR>/load.sql)
 $ sqlite3 dex.db "SELECT COUNT(*) FROM dex;"   # verify sane-looking value
 $ ./native/redex/tools/redex-tool/DexSqlQuery.py dex.db
 <..enter queries..>
 
 */
 
-#include <boost/algorithm/string/replace.hpp>
 #include <queue>
+#include <sys/stat.h>
 #include <vector>
 #include <unordered_map>
 
@@ -36,136 +38,224 @@ $ ./native/redex/tools/redex-tool/DexSqlQuery.py dex.db
 #include "Show.h"
 #include "Tool.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
-static std::unordered_map<DexClass*, int> class_ids;
-static std::unordered_map<DexMethod*, int> method_ids;
-static std::unordered_map<DexField*, int> field_ids;
-static std::unordered_map<DexString*, int> string_ids;
+enum class DumpFormat {
+  // One script of INSERT statements.
+  SQL,
+  // One CSV file per table, and a script creating the schema and .import-ing
+  // them into sqlite3, which skips parsing an INSERT per row.
+  CSV,
+};
+
+enum Table {
+  CLASSES,
+  METHODS,
+  IS_A,
+  STRINGS,
+  FIELDS,
+  FIELD_STRING_REFS,
+  METHOD_CLASS_REFS,
+  METHOD_METHOD_REFS,
+  METHOD_FIELD_REFS,
+  METHOD_STRING_REFS,
+  NUM_TABLES,
+};
+
+const char* const table_names[NUM_TABLES] = {
+    "classes",           "methods",            "is_a",
+    "strings",           "fields",             "field_string_refs",
+    "method_class_refs", "method_method_refs", "method_field_refs",
+    "method_string_refs",
+};
+
+struct Column {
+  /* implicit */ Column(int64_t num) : text(nullptr), num(num) {}
+  /* implicit */ Column(const char* text) : text(text), num(0) {}
+  /* implicit */ Column(const std::string& text)
+      : text(text.c_str()), num(0) {}
+
+  bool is_text() const { return text != nullptr; }
+
+  const char* text;
+  int64_t num;
+};
+
+void append_quoted(std::string& out, const char* text, char quote) {
+  out += quote;
+  for (const char* c = text; *c; ++c) {
+    if (*c == quote) {
+      out += quote;
+    }
+    out += *c;
+  }
+  out += quote;
+}
+
+void append_row(std::string& out,
+                DumpFormat format,
+                const std::string& prefix,
+                Table table,
+                std::initializer_list<Column> cols) {
+  bool sql = format == DumpFormat::SQL;
+  if (sql) {
+    out += "INSERT INTO ";
+    out += prefix;
+    out += table_names[table];
+    out += " VALUES (";
+  }
+  bool first = true;
+  for (const auto& col : cols) {
+    if (!first) {
+      out += sql ? ", " : ",";
+    }
+    first = false;
+    if (col.is_text()) {
+      append_quoted(out, col.text, sql ? '\'' : '"');
+    } else {
+      out += std::to_string(col.num);
+    }
+  }
+  out += sql ? ");\n" : "\n";
+}
+
+// A deobfuscated name with its class prefix stripped.
+const char* member_name(const std::string& deobfuscated_name) {
+  auto name = strchr(deobfuscated_name.c_str(), ';');
+  return name ? name : "";
+}
+
+/*
+ * The ids of everything that gets a row, handed out in dex order before any
+ * row is formatted so the dexes can then be dumped independently.
+ */
+struct DumpIds {
+  std::unordered_map<DexClass*, int> class_ids;
+  std::unordered_map<DexMethod*, int> method_ids;
+  std::unordered_map<DexField*, int> field_ids;
+  // A string in several dexes gets a row per dex; refs go to the last one.
+  std::unordered_map<DexString*, int> string_ids;
+};
+
+struct DexToDump {
+  std::string id; // "<store>/<dex index>"
+  DexClasses* classes;
+  std::vector<std::pair<DexString*, int>> strings;
+  int first_class_id;
+};
+
+// A row of one of the ref tables, minus the row id, which is only known once
+// the rows of the preceding dexes have been counted.
+struct RefRow {
+  int from_id;
+  int ref_id;
+  int opcode;
+};
+
+struct DexRows {
+  // The classes, methods, fields and strings, formatted.
+  std::string items[NUM_TABLES];
+  std::vector<RefRow> refs[NUM_TABLES];
+};
 
-void dump_field_refs(FILE* fdout, const char* prefix, DexField* field, int field_id) {
-  static int next_string_ref = 0;
+template <typename T>
+int lookup_id(const std::unordered_map<T*, int>& ids, T* item) {
+  auto it = ids.find(item);
+  return it == ids.end() ? -1 : it->second;
+}
+
+void gather_field_refs(const DumpIds& ids,
+                       DexField* field,
+                       int field_id,
+                       DexRows& rows) {
   auto* static_value = field->get_static_value();
   if (!static_value || (static_value->evtype() != DEVT_STRING)) return;
   auto* static_string_value = static_cast<DexEncodedValueString*>(static_value);
-  auto string_id = string_ids[static_string_value->string()];
-  fprintf(
-    fdout,
-    "INSERT INTO %sfield_string_refs VALUES (%d, %d, %d);\n",
-    prefix,
-    next_string_ref++,
-    field_id,
-    string_id);
+  auto string_id = lookup_id(ids.string_ids, static_string_value->string());
+  if (string_id >= 0) {
+    rows.refs[FIELD_STRING_REFS].push_back({field_id, string_id, -1});
+  }
 }
 
-void dump_method_refs(FILE* fdout, const char* prefix, DexMethod* method, int method_id) {
+void gather_method_refs(const DumpIds& ids,
+                        DexMethod* method,
+                        int method_id,
+                        DexRows& rows) {
   auto code = method->get_code();
   if (!code) return;
 
-  static int next_string_ref = 0;
-  static int next_class_ref = 0;
-  static int next_field_ref = 0;
-  static int next_method_ref = 0;
-
   for (auto& mie : InstructionIterable(code)) {
     auto insn = mie.insn;
+    int op = insn->opcode();
     if (insn->has_string()) {
-      if (string_ids.count(insn->get_string())) {
-        auto string_id = string_ids[insn->get_string()];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_string_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_string_ref++,
-          method_id,
-          string_id,
-          insn->opcode());
+      auto string_id = lookup_id(ids.string_ids, insn->get_string());
+      if (string_id >= 0) {
+        rows.refs[METHOD_STRING_REFS].push_back({method_id, string_id, op});
       }
     }
     if (insn->has_type()) {
       auto cls = type_class(insn->get_type());
-      if (cls && class_ids.count(cls)) {
-        auto class_id = class_ids[cls];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_class_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_class_ref++,
-          method_id,
-          class_id,
-          insn->opcode());
+      auto class_id = cls ? lookup_id(ids.class_ids, cls) : -1;
+      if (class_id >= 0) {
+        rows.refs[METHOD_CLASS_REFS].push_back({method_id, class_id, op});
       }
     }
     if (insn->has_field()) {
       auto field = resolve_field(insn->get_field());
-      if (field != nullptr && field_ids.count(field)) {
-        auto field_id = field_ids[field];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_field_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_field_ref++,
-          method_id,
-          field_id,
-          insn->opcode());
+      auto field_id = field ? lookup_id(ids.field_ids, field) : -1;
+      if (field_id >= 0) {
+        rows.refs[METHOD_FIELD_REFS].push_back({method_id, field_id, op});
       }
     }
     if (insn->has_method()) {
       auto meth = resolve_method(insn->get_method(), opcode_to_search(insn));
-      if (meth != nullptr && method_ids.count(meth)) {
-        auto method_ref_id = method_ids[meth];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_method_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_method_ref++,
-          method_id,
-          method_ref_id,
-          insn->opcode());
+      auto method_ref_id = meth ? lookup_id(ids.method_ids, meth) : -1;
+      if (method_ref_id >= 0) {
+        rows.refs[METHOD_METHOD_REFS].push_back({method_id, method_ref_id, op});
       }
     }
   }
 }
 
-void dump_class(FILE* fdout, const char* prefix, const char* dex_id, DexClass* cls, int class_id) {
+void dump_class(DumpFormat format,
+                const std::string& prefix,
+                const char* dex_id,
+                DexClass* cls,
+                int class_id,
+                std::string& out) {
   // TODO: annotations?
   // TODO: inheritance?
   // TODO: string usage
   // TODO: size estimate
-  auto deobfuscated_name = cls->get_deobfuscated_name();
-  fprintf(
-    fdout,
-    "INSERT INTO %sclasses VALUES (%d,'%s','%s','%s',%u);\n",
-    prefix,
-    class_id,
-    dex_id,
-    deobfuscated_name.c_str(),
-    cls->get_name()->c_str(),
-    cls->get_access()
-  );
+  append_row(out, format, prefix, CLASSES,
+             {class_id, dex_id, cls->get_deobfuscated_name(),
+              cls->get_name()->c_str(), cls->get_access()});
 }
 
-void dump_field(FILE* fdout, const char* prefix, int class_id, DexField* field, int field_id) {
+void dump_field(DumpFormat format,
+                const std::string& prefix,
+                int class_id,
+                DexField* field,
+                int field_id,
+                std::string& out) {
   // TODO: more fixup here on this crapped up name/signature
   // TODO: break down signature
   // TODO: annotations?
   // TODO: string usage (encoded_value for static fields)
   auto deobfuscated_name = field->get_deobfuscated_name();
-  auto field_name = strchr(deobfuscated_name.c_str(), ';');
-  fprintf(
-    fdout,
-    "INSERT INTO %sfields VALUES(%d, %d, '%s', '%s', %u);\n",
-    prefix,
-    field_id,
-    class_id,
-    field_name,
-    field->get_name()->c_str(),
-    field->get_access()
-  );
+  append_row(out, format, prefix, FIELDS,
+             {field_id, class_id, member_name(deobfuscated_name),
+              field->get_name()->c_str(), field->get_access()});
 }
 
-void dump_method(FILE* fdout, const char* prefix, int class_id, DexMethod* method, int method_id) {
+void dump_method(DumpFormat format,
+                 const std::string& prefix,
+                 int class_id,
+                 DexMethod* method,
+                 int method_id,
+                 std::string& out) {
   // TODO: more fixup here on this crapped up name/signature
   // TODO: break down signature
   // TODO: throws?
@@ -173,25 +263,62 @@ void dump_method(FILE* fdout, const char* prefix, int class_id, DexMethod* metho
   // TODO: string usage
   // TODO: size estimate
   auto deobfuscated_name = method->get_deobfuscated_name();
-  auto method_name = strchr(deobfuscated_name.c_str(), ';');
-  fprintf(
-    fdout,
-    "INSERT INTO %smethods VALUES (%d,%d,'%s','%s',%d,%lu);\n",
-    prefix,
-    method_id,
-    class_id,
-    method_name,
-    method->get_name()->c_str(),
-    method->get_access(),
-    method->get_code() ? method->get_code()->sum_opcode_sizes() : 0
-  );
+  int64_t code_size =
+      method->get_code() ? method->get_code()->sum_opcode_sizes() : 0;
+  append_row(out, format, prefix, METHODS,
+             {method_id, class_id, member_name(deobfuscated_name),
+              method->get_name()->c_str(), method->get_access(), code_size});
 }
 
-void dump_sql(
-  FILE* fdout,
-  DexStoresVector& stores,
-  ProguardMap& pg_map,
-  const char* prefix) {
+DexRows dump_dex(DumpFormat format,
+                 const std::string& prefix,
+                 const DumpIds& ids,
+                 const DexToDump& dex) {
+  DexRows rows;
+  for (const auto& str : dex.strings) {
+    append_row(rows.items[STRINGS], format, prefix, STRINGS,
+               {str.second, str.first->c_str()});
+  }
+  int class_id = dex.first_class_id;
+  for (auto cls : *dex.classes) {
+    dump_class(format, prefix, dex.id.c_str(), cls, class_id,
+               rows.items[CLASSES]);
+    for (auto field : cls->get_ifields()) {
+      dump_field(format, prefix, class_id, field, ids.field_ids.at(field),
+                 rows.items[FIELDS]);
+    }
+    for (auto field : cls->get_sfields()) {
+      dump_field(format, prefix, class_id, field, ids.field_ids.at(field),
+                 rows.items[FIELDS]);
+    }
+    for (auto meth : cls->get_dmethods()) {
+      dump_method(format, prefix, class_id, meth, ids.method_ids.at(meth),
+                  rows.items[METHODS]);
+    }
+    for (auto meth : cls->get_vmethods()) {
+      dump_method(format, prefix, class_id, meth, ids.method_ids.at(meth),
+                  rows.items[METHODS]);
+    }
+    ++class_id;
+  }
+  for (auto cls : *dex.classes) {
+    for (auto meth : cls->get_dmethods()) {
+      gather_method_refs(ids, meth, ids.method_ids.at(meth), rows);
+    }
+    for (auto meth : cls->get_vmethods()) {
+      gather_method_refs(ids, meth, ids.method_ids.at(meth), rows);
+    }
+    for (auto field : cls->get_sfields()) {
+      gather_field_refs(ids, field, ids.field_ids.at(field), rows);
+    }
+    for (auto field : cls->get_ifields()) {
+      gather_field_refs(ids, field, ids.field_ids.at(field), rows);
+    }
+  }
+  return rows;
+}
+
+void print_schema(FILE* fdout, const char* prefix) {
   fprintf(
     fdout,
 R"___(
@@ -268,111 +395,191 @@ CREATE TABLE %1$smethod_string_refs (
 )___",
     prefix
   );
+}
+
+FILE* open_for_writing(const std::string& filename) {
+  FILE* fd = fopen(filename.c_str(), "w");
+  if (!fd) {
+    fprintf(stderr,
+            "Could not open %s for writing; terminating\n",
+            filename.c_str());
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+/*
+ * Sends each table's rows to the SQL script, or to the table's own CSV file.
+ */
+class DumpOutput {
+ public:
+  DumpOutput(DumpFormat format, FILE* script, const std::string& csv_dir)
+      : m_format(format), m_script(script) {
+    for (size_t t = 0; t < NUM_TABLES; ++t) {
+      if (format == DumpFormat::SQL) {
+        m_tables[t] = script;
+      } else {
+        auto filename = csv_dir + "/" + table_names[t] + ".csv";
+        m_tables[t] = open_for_writing(filename);
+        m_csv_files.push_back(filename);
+      }
+    }
+  }
+
+  ~DumpOutput() {
+    if (m_format == DumpFormat::CSV) {
+      for (auto fd : m_tables) {
+        fclose(fd);
+      }
+    }
+  }
+
+  void begin_transaction() {
+    if (m_format == DumpFormat::SQL) {
+      fprintf(m_script, "BEGIN TRANSACTION;\n");
+    }
+  }
+
+  void end_transaction() {
+    if (m_format == DumpFormat::SQL) {
+      fprintf(m_script, "END TRANSACTION;\n");
+    }
+  }
+
+  void write(Table table, const std::string& rows) {
+    fwrite(rows.data(), 1, rows.size(), m_tables[table]);
+  }
+
+  // The CSV files only hold rows; the script loads them into the schema.
+  void print_imports(const char* prefix) {
+    if (m_format == DumpFormat::CSV) {
+      fprintf(m_script, ".mode csv\n");
+      for (size_t t = 0; t < NUM_TABLES; ++t) {
+        fprintf(m_script, ".import \"%s\" %s%s\n", m_csv_files[t].c_str(),
+                prefix, table_names[t]);
+      }
+    }
+  }
+
+ private:
+  DumpFormat m_format;
+  FILE* m_script;
+  FILE* m_tables[NUM_TABLES];
+  std::vector<std::string> m_csv_files;
+};
+
+void dump_sql(
+  DumpOutput& out,
+  DumpFormat format,
+  DexStoresVector& stores,
+  ProguardMap& pg_map,
+  const std::string& prefix) {
+  // Hand out the ids, in the order the original row-by-row dump did.
+  DumpIds ids;
+  std::vector<DexToDump> dexes;
   int next_class_id = 0;
   int next_method_id = 0;
   int next_field_id = 0;
   int next_string_id = 0;
-
-  // Dump all dex items
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
   for (auto& store : stores) {
     auto store_name = store.get_name();
     auto& dexen = store.get_dexen();
     apply_deobfuscated_names(dexen, pg_map);
     for (size_t dex_idx = 0 ; dex_idx < dexen.size() ; ++dex_idx) {
       auto& dex = dexen[dex_idx];
+      DexToDump to_dump;
+      to_dump.id = store_name + "/" + std::to_string(dex_idx);
+      to_dump.classes = &dex;
+      to_dump.first_class_id = next_class_id;
       GatheredTypes gtypes(&dex);
-      auto strings = gtypes.get_cls_order_dexstring_emitlist();
-      for (auto dexstr : strings) {
+      for (auto dexstr : gtypes.get_cls_order_dexstring_emitlist()) {
         int id = next_string_id++;
-        string_ids[dexstr] = id;
-        // Escape string before inserting. ' -> ''
-        std::string esc(dexstr->c_str());
-        boost::replace_all(esc, "'", "''");
-        fprintf(fdout, "INSERT INTO %sstrings VALUES(%d, '%s');\n", prefix, id, esc.c_str());
+        ids.string_ids[dexstr] = id;
+        to_dump.strings.emplace_back(dexstr, id);
       }
-      std::string dex_id_str(store_name + "/" + std::to_string(dex_idx));
-      const char* dex_id = dex_id_str.c_str();
       for (const auto& cls : dex) {
-        int class_id = next_class_id++;
-        dump_class(fdout, prefix, dex_id, cls, class_id);
-        class_ids[cls] = class_id;
+        ids.class_ids[cls] = next_class_id++;
         for (auto field : cls->get_ifields()) {
-          int field_id = next_field_id++;
-          field_ids[field] = field_id;
-          dump_field(fdout, prefix, class_id, field, field_id);
+          ids.field_ids[field] = next_field_id++;
         }
         for (auto field : cls->get_sfields()) {
-          int field_id = next_field_id++;
-          field_ids[field] = field_id;
-          dump_field(fdout, prefix, class_id, field, field_id);
+          ids.field_ids[field] = next_field_id++;
         }
         for (const auto& meth : cls->get_dmethods()) {
-          int meth_id = next_method_id++;
-          method_ids[meth] = meth_id;
-          dump_method(fdout, prefix, class_id, meth, meth_id);
+          ids.method_ids[meth] = next_method_id++;
         }
         for (auto& meth : cls->get_vmethods()) {
-          int meth_id = next_method_id++;
-          method_ids[meth] = meth_id;
-          dump_method(fdout, prefix, class_id, meth, meth_id);
+          ids.method_ids[meth] = next_method_id++;
         }
       }
+      dexes.push_back(std::move(to_dump));
     }
   }
-  fprintf(fdout, "END TRANSACTION;\n");
+
+  // Format each dex's rows and gather its refs on its own.
+  std::vector<DexRows> rows(dexes.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    rows[i] = dump_dex(format, prefix, ids, dexes[i]);
+  });
+  for (size_t i = 0; i < dexes.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  // Dump all dex items
+  out.begin_transaction();
+  for (auto& dex_rows : rows) {
+    for (auto table : {STRINGS, CLASSES, FIELDS, METHODS}) {
+      out.write(table, dex_rows.items[table]);
+      std::string().swap(dex_rows.items[table]);
+    }
+  }
+  out.end_transaction();
 
   // Dump references
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
-  for (auto& store : stores) {
-    auto& dexen = store.get_dexen();
-    for (size_t dex_idx = 0 ; dex_idx < dexen.size() ; ++dex_idx) {
-      auto& dex = dexen[dex_idx];
-      for (const auto& cls : dex) {
-        for (const auto& meth : cls->get_dmethods()) {
-          int meth_id = method_ids[meth];
-          dump_method_refs(fdout, prefix, meth, meth_id);
-        }
-        for (auto& meth : cls->get_vmethods()) {
-          int meth_id = method_ids[meth];
-          dump_method_refs(fdout, prefix, meth, meth_id);
-        }
-        for (const auto& field : cls->get_sfields()) {
-          int field_id = field_ids[field];
-          dump_field_refs(fdout, prefix, field, field_id);
-        }
-        for (const auto& field : cls->get_ifields()) {
-          int field_id = field_ids[field];
-          dump_field_refs(fdout, prefix, field, field_id);
+  out.begin_transaction();
+  int next_ref_ids[NUM_TABLES] = {};
+  std::string buf;
+  for (auto& dex_rows : rows) {
+    for (auto table : {METHOD_STRING_REFS, METHOD_CLASS_REFS,
+                       METHOD_FIELD_REFS, METHOD_METHOD_REFS,
+                       FIELD_STRING_REFS}) {
+      buf.clear();
+      for (const auto& ref : dex_rows.refs[table]) {
+        int id = next_ref_ids[table]++;
+        if (table == FIELD_STRING_REFS) {
+          append_row(buf, format, prefix, table,
+                     {id, ref.from_id, ref.ref_id});
+        } else {
+          append_row(buf, format, prefix, table,
+                     {id, ref.from_id, ref.ref_id, ref.opcode});
         }
       }
+      out.write(table, buf);
     }
   }
-  fprintf(fdout, "END TRANSACTION;\n");
+  out.end_transaction();
 
   // Dump hierarchy
   auto scope = build_class_scope(stores);
   ClassHierarchy ch = build_type_hierarchy(scope);
   int next_is_a_id = 0;
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
+  out.begin_transaction();
   for (auto& cls : scope) {
     TypeSet results;
     get_all_children_or_implementors(ch, scope, cls, results);
+    buf.clear();
     for(auto type : results) {
       auto type_cls = type_class(type);
       if (type_cls) {
-        fprintf(
-          fdout,
-          "INSERT INTO %sis_a VALUES(%d, %d, %d);\n",
-          prefix,
-          next_is_a_id++,
-          class_ids[type_cls],
-          class_ids[cls]
-        );
+        append_row(buf, format, prefix, IS_A,
+                   {next_is_a_id++, ids.class_ids[type_cls],
+                    ids.class_ids[cls]});
       }
     }
+    out.write(IS_A, buf);
   }
-  fprintf(fdout, "END TRANSACTION;\n");
+  out.end_transaction();
 }
 
 class DexSqlDump : public Tool {
@@ -391,29 +598,52 @@ class DexSqlDump : public Tool {
       ("table-prefix,t",
        po::value<std::string>()->value_name("pre_"),
        "prefix to use on all table names")
+      ("format,f",
+       po::value<std::string>()->value_name("sql|csv"),
+       "sql writes INSERT statements (the default); csv writes one file per "
+       "table into the --output directory, with a load.sql that imports "
+       "them into sqlite3")
     ;
   }
 
   void run(const po::variables_map& options) override {
+    auto format = DumpFormat::SQL;
+    if (options.count("format")) {
+      const auto& name = options["format"].as<std::string>();
+      if (name == "csv") {
+        format = DumpFormat::CSV;
+      } else if (name != "sql") {
+        fprintf(stderr, "Unknown format %s; terminating\n", name.c_str());
+        exit(EXIT_FAILURE);
+      }
+    }
+    if (format == DumpFormat::CSV && !options.count("output")) {
+      fprintf(stderr, "--format=csv needs an --output directory\n");
+      exit(EXIT_FAILURE);
+    }
     auto stores = init(
       options["jars"].as<std::string>(),
       options["apkdir"].as<std::string>(),
       options["dexendir"].as<std::string>());
     ProguardMap pgmap(options.count("proguard-map") ?
       options["proguard-map"].as<std::string>() : "/dev/null");
-    const std::string& filename = options["output"].as<std::string>();
-    FILE* fdout = options.count("output") ?
-      fopen(filename.c_str(), "w") : stdout;
     std::string prefix = options.count("table-prefix") ?
       options["table-prefix"].as<std::string>() : "";
-    if (!fdout) {
-      fprintf(stderr,
-              "Could not open %s for writing; terminating\n",
-              filename.c_str());
-      exit(EXIT_FAILURE);
+    std::string csv_dir;
+    FILE* fdout = stdout;
+    if (format == DumpFormat::CSV) {
+      csv_dir = options["output"].as<std::string>();
+      mkdir(csv_dir.c_str(), 0755);
+      fdout = open_for_writing(csv_dir + "/load.sql");
+    } else if (options.count("output")) {
+      fdout = open_for_writing(options["output"].as<std::string>());
+    }
+    print_schema(fdout, prefix.c_str());
+    {
+      DumpOutput out(format, fdout, csv_dir);
+      dump_sql(out, format, stores, pgmap, prefix);
+      out.print_imports(prefix.c_str());
     }
-    auto* pfx_cstr = prefix.c_str();
-    dump_sql(fdout, stores, pgmap, pfx_cstr);
     fclose(fdout);
   }
 };
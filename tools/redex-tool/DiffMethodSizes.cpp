@@ -27,7 +27,8 @@
 
 namespace {
 
-using JarMethodInfoMap = std::unordered_map<
+// Ordered, so that the output is the same from one run to the next.
+using JarMethodInfoMap = std::map<
     // Method as string
     std::string,
     // Fields of interest in "Code_attribute" from JVM class file.
@@ -132,8 +133,8 @@ void diff_in_out_jars_from_command_line(const std::string& command_line_path) {
 }
 
 using DexMethodInfoMap =
-    std::unordered_map<std::string, // Method as string
-                       std::tuple<int, int>>; // code size, register size
+    std::map<std::string, // Method as string
+             std::tuple<int, int>>; // code size, register size
 
 DexMethodInfoMap load_dex_method_info(const std::string& dir) {
   DexStore root_store("dex");
@@ -144,14 +145,20 @@ DexMethodInfoMap load_dex_method_info(const std::string& dir) {
   stores.emplace_back(std::move(root_store));
   DexMethodInfoMap result;
 
-  walk::methods(build_class_scope(stores), [&result](DexMethod* method) {
-    auto key = show(method);
-    always_assert(result.find(key) == end(result));
-    const auto* code = method->get_dex_code();
-    result.emplace(key,
-                   std::make_tuple((code ? code->size() : 0),
-                                   (code ? code->get_registers_size() : 0)));
-  });
+  // The methods are shown in parallel, which is most of the work.
+  using Info = std::pair<std::string, std::tuple<int, int>>;
+  auto infos = Tool::map_methods<Info>(
+      build_class_scope(stores), [](DexMethod* method) {
+        const auto* code = method->get_dex_code();
+        return Info(show(method),
+                    std::make_tuple((code ? code->size() : 0),
+                                    (code ? code->get_registers_size() : 0)));
+      });
+  for (auto& pair : infos) {
+    auto& info = pair.second;
+    always_assert(result.find(info.first) == end(result));
+    result.emplace(std::move(info.first), info.second);
+  }
 
   return result;
 }
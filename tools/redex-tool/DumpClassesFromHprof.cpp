@@ -0,0 +1,397 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Tool.h"
+
+/*
+ * A streaming reader for Android heap dumps that writes out the list of
+ * classes they contain, in the format of the coldstart class list that
+ * ConfigFiles loads. It does the same as tools/hprof/dump_classes_from_hprof.py
+ * without building the object graph: the dump is mmapped and read once,
+ * keeping only the strings, the load-class records and which classes have a
+ * class dump or instances. All the other records are skipped over.
+ *
+ * The classes are written in the order they were loaded, i.e. by the serial
+ * number of their load-class record.
+ */
+
+namespace {
+
+enum RecordTag : uint8_t {
+  STRING = 0x01,
+  LOAD_CLASS = 0x02,
+  HEAP_DUMP = 0x0c,
+  HEAP_DUMP_SEGMENT = 0x1c,
+  HEAP_DUMP_END = 0x2c,
+};
+
+enum HeapTag : uint8_t {
+  ROOT_JNI_GLOBAL = 0x01,
+  ROOT_JNI_LOCAL = 0x02,
+  ROOT_JAVA_FRAME = 0x03,
+  ROOT_NATIVE_STACK = 0x04,
+  ROOT_STICKY_CLASS = 0x05,
+  ROOT_THREAD_BLOCK = 0x06,
+  ROOT_MONITOR_USED = 0x07,
+  ROOT_THREAD_OBJECT = 0x08,
+  CLASS_DUMP = 0x20,
+  INSTANCE_DUMP = 0x21,
+  OBJECT_ARRAY_DUMP = 0x22,
+  PRIMITIVE_ARRAY_DUMP = 0x23,
+  // Android extensions
+  ROOT_INTERNED_STRING = 0x89,
+  ROOT_FINALIZING = 0x8a,
+  ROOT_DEBUGGER = 0x8b,
+  ROOT_REFERENCE_CLEANUP = 0x8c,
+  ROOT_VM_INTERNAL = 0x8d,
+  ROOT_JNI_MONITOR = 0x8e,
+  ROOT_UNREACHABLE = 0x90,
+  PRIMITIVE_ARRAY_NODATA_DUMP = 0xc3,
+  HEAP_DUMP_INFO = 0xfe,
+  ROOT_UNKNOWN = 0xff,
+};
+
+[[noreturn]] void fail(const char* msg) {
+  fprintf(stderr, "Malformed hprof: %s; terminating\n", msg);
+  exit(EXIT_FAILURE);
+}
+
+/*
+ * Reads the big-endian fields of a range of the dump.
+ */
+class Cursor {
+ public:
+  Cursor(const uint8_t* begin, const uint8_t* end, size_t id_size)
+      : m_pos(begin), m_end(end), m_id_size(id_size) {}
+
+  bool done() const { return m_pos == m_end; }
+  const uint8_t* pos() const { return m_pos; }
+  size_t id_size() const { return m_id_size; }
+
+  uint8_t u1() { return read(1); }
+  uint16_t u2() { return read(2); }
+  uint32_t u4() { return read(4); }
+  uint64_t id() { return read(m_id_size); }
+
+  void skip(uint64_t n) {
+    if (static_cast<uint64_t>(m_end - m_pos) < n) {
+      fail("record runs past the end of its container");
+    }
+    m_pos += n;
+  }
+
+ private:
+  uint64_t read(size_t n) {
+    if (static_cast<size_t>(m_end - m_pos) < n) {
+      fail("record runs past the end of its container");
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; ++i) {
+      value = (value << 8) | m_pos[i];
+    }
+    m_pos += n;
+    return value;
+  }
+
+  const uint8_t* m_pos;
+  const uint8_t* m_end;
+  size_t m_id_size;
+};
+
+// The size of a value of the given basic type
+size_t value_size(uint8_t type, size_t id_size) {
+  switch (type) {
+  case 2: // object
+    return id_size;
+  case 4: // boolean
+  case 8: // byte
+    return 1;
+  case 5: // char
+  case 9: // short
+    return 2;
+  case 6: // float
+  case 10: // int
+    return 4;
+  case 7: // double
+  case 11: // long
+    return 8;
+  default:
+    fail("unknown basic type");
+  }
+}
+
+struct LoadedClass {
+  uint32_t serial;
+  uint64_t name_id;
+};
+
+class HprofReader {
+ public:
+  explicit HprofReader(const std::string& filename) {
+    try {
+      m_file.open(filename, boost::iostreams::mapped_file::readonly);
+    } catch (const std::exception& e) {
+      fprintf(stderr,
+              "Could not open %s: %s; terminating\n",
+              filename.c_str(),
+              e.what());
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  void read() {
+    auto begin = reinterpret_cast<const uint8_t*>(m_file.const_data());
+    auto end = begin + m_file.size();
+    // The header is a null-terminated format name, the size of the ids and a
+    // timestamp.
+    auto format_end = std::find(begin, end, '\0');
+    if (format_end == end) {
+      fail("no header");
+    }
+    Cursor header(format_end + 1, end, 0);
+    size_t id_size = header.u4();
+    if (id_size != 4 && id_size != 8) {
+      fail("unsupported id size");
+    }
+    header.skip(8);
+
+    Cursor records(header.pos(), end, id_size);
+    while (!records.done()) {
+      auto tag = records.u1();
+      records.skip(4); // time offset
+      uint32_t length = records.u4();
+      auto body_begin = records.pos();
+      records.skip(length);
+      Cursor body(body_begin, records.pos(), id_size);
+      switch (tag) {
+      case STRING: {
+        auto string_id = body.id();
+        m_strings.emplace(
+            string_id,
+            std::string(reinterpret_cast<const char*>(body.pos()),
+                        length - id_size));
+        break;
+      }
+      case LOAD_CLASS: {
+        auto serial = body.u4();
+        auto object_id = body.id();
+        body.skip(4); // stack trace serial
+        auto name_id = body.id();
+        m_classes.emplace(object_id, LoadedClass{serial, name_id});
+        break;
+      }
+      case HEAP_DUMP:
+      case HEAP_DUMP_SEGMENT:
+        read_heap_dump(body);
+        break;
+      case HEAP_DUMP_END:
+        return;
+      default:
+        break;
+      }
+    }
+  }
+
+  /*
+   * The names of the classes with a class dump, in the coldstart list format.
+   * Array classes are left out, and so are the classes without instances if
+   * :instantiated_only is set.
+   */
+  std::vector<std::string> class_list(bool instantiated_only) const {
+    std::vector<const LoadedClass*> classes;
+    for (auto object_id : m_dumped) {
+      if (instantiated_only && !m_instantiated.count(object_id)) {
+        continue;
+      }
+      auto it = m_classes.find(object_id);
+      if (it == m_classes.end()) {
+        fail("class dump without a load-class record");
+      }
+      classes.push_back(&it->second);
+    }
+    std::sort(classes.begin(),
+              classes.end(),
+              [](const LoadedClass* a, const LoadedClass* b) {
+                return a->serial < b->serial;
+              });
+
+    std::vector<std::string> names;
+    std::unordered_set<std::string> seen;
+    for (auto cls : classes) {
+      auto it = m_strings.find(cls->name_id);
+      if (it == m_strings.end()) {
+        fail("class name is not a string record");
+      }
+      auto name = it->second;
+      if (name.size() >= 2 && name.compare(name.size() - 2, 2, "[]") == 0) {
+        continue;
+      }
+      // Several class loaders may have loaded the same class.
+      if (!seen.emplace(name).second) {
+        continue;
+      }
+      std::replace(name.begin(), name.end(), '.', '/');
+      names.push_back(name + ".class");
+    }
+    return names;
+  }
+
+ private:
+  void read_heap_dump(Cursor& cursor) {
+    auto id_size = cursor.id_size();
+    while (!cursor.done()) {
+      auto tag = cursor.u1();
+      switch (tag) {
+      case ROOT_UNKNOWN:
+      case ROOT_STICKY_CLASS:
+      case ROOT_MONITOR_USED:
+      case ROOT_INTERNED_STRING:
+      case ROOT_FINALIZING:
+      case ROOT_DEBUGGER:
+      case ROOT_REFERENCE_CLEANUP:
+      case ROOT_VM_INTERNAL:
+      case ROOT_UNREACHABLE:
+        cursor.skip(id_size);
+        break;
+      case ROOT_JNI_GLOBAL:
+        cursor.skip(2 * id_size);
+        break;
+      case ROOT_NATIVE_STACK:
+      case ROOT_THREAD_BLOCK:
+        cursor.skip(id_size + 4);
+        break;
+      case ROOT_JNI_LOCAL:
+      case ROOT_JAVA_FRAME:
+      case ROOT_THREAD_OBJECT:
+      case ROOT_JNI_MONITOR:
+        cursor.skip(id_size + 8);
+        break;
+      case HEAP_DUMP_INFO:
+        cursor.skip(4 + id_size);
+        break;
+      case CLASS_DUMP:
+        read_class_dump(cursor);
+        break;
+      case INSTANCE_DUMP: {
+        cursor.skip(id_size + 4); // object id, stack trace serial
+        m_instantiated.emplace(cursor.id());
+        cursor.skip(cursor.u4());
+        break;
+      }
+      case OBJECT_ARRAY_DUMP: {
+        cursor.skip(id_size + 4);
+        auto count = cursor.u4();
+        cursor.skip(id_size); // array class
+        cursor.skip(static_cast<uint64_t>(count) * id_size);
+        break;
+      }
+      case PRIMITIVE_ARRAY_DUMP: {
+        cursor.skip(id_size + 4);
+        auto count = cursor.u4();
+        auto type = cursor.u1();
+        cursor.skip(static_cast<uint64_t>(count) * value_size(type, id_size));
+        break;
+      }
+      case PRIMITIVE_ARRAY_NODATA_DUMP:
+        cursor.skip(id_size + 4 + 4 + 1);
+        break;
+      default:
+        fail("unknown heap dump record");
+      }
+    }
+  }
+
+  void read_class_dump(Cursor& cursor) {
+    auto id_size = cursor.id_size();
+    m_dumped.push_back(cursor.id());
+    // stack trace serial, then the super class, class loader, signers,
+    // protection domain and two reserved ids, then the instance size
+    cursor.skip(4 + 6 * id_size + 4);
+    auto const_pool_size = cursor.u2();
+    for (uint16_t i = 0; i < const_pool_size; ++i) {
+      cursor.skip(2);
+      cursor.skip(value_size(cursor.u1(), id_size));
+    }
+    auto static_fields = cursor.u2();
+    for (uint16_t i = 0; i < static_fields; ++i) {
+      cursor.skip(id_size);
+      cursor.skip(value_size(cursor.u1(), id_size));
+    }
+    auto instance_fields = cursor.u2();
+    cursor.skip(static_cast<uint64_t>(instance_fields) * (id_size + 1));
+  }
+
+  boost::iostreams::mapped_file m_file;
+  std::unordered_map<uint64_t, std::string> m_strings;
+  std::unordered_map<uint64_t, LoadedClass> m_classes;
+  // The object ids of the classes with a class dump, in dump order
+  std::vector<uint64_t> m_dumped;
+  std::unordered_set<uint64_t> m_instantiated;
+};
+
+class DumpClassesFromHprof : public Tool {
+ public:
+  DumpClassesFromHprof()
+      : Tool("dump-classes-from-hprof",
+             "list the classes loaded in a heap dump, for coldstart "
+             "ordering") {}
+
+  void add_options(po::options_description& options) const override {
+    options.add_options()
+      ("hprof,i",
+       po::value<std::string>()->value_name("dump.hprof"),
+       "heap dump to generate the class list from")
+      ("output,o",
+       po::value<std::string>()->value_name("classes.txt"),
+       "path to the class list (defaults to stdout)")
+      ("instantiated-only",
+       po::bool_switch(),
+       "only list the classes that have instances in the dump")
+    ;
+  }
+
+  void run(const po::variables_map& options) override {
+    if (!options.count("hprof")) {
+      fprintf(stderr, "No --hprof given; terminating\n");
+      exit(EXIT_FAILURE);
+    }
+    HprofReader reader(options["hprof"].as<std::string>());
+    reader.read();
+    FILE* fdout = stdout;
+    if (options.count("output")) {
+      const auto& filename = options["output"].as<std::string>();
+      fdout = fopen(filename.c_str(), "w");
+      if (!fdout) {
+        fprintf(stderr,
+                "Could not open %s for writing; terminating\n",
+                filename.c_str());
+        exit(EXIT_FAILURE);
+      }
+    }
+    for (const auto& name :
+         reader.class_list(options["instantiated-only"].as<bool>())) {
+      fprintf(fdout, "%s\n", name.c_str());
+    }
+    fclose(fdout);
+  }
+};
+
+static DumpClassesFromHprof s_tool;
+
+}
@@ -10,6 +10,7 @@
 #include "Tool.h"
 #include "Walkers.h"
 #include "DexClass.h"
+#include "IRCode.h"
 #include "IRInstruction.h"
 #include "DexUtil.h"
 #include "ReachableClasses.h"
@@ -22,8 +23,9 @@
 #include <unordered_set>
 #include <unordered_map>
 
-using refs_t = std::unordered_map<const DexClass*,
-                                  std::set<DexClass*, dexclasses_comparator>>;
+using refs_t = std::map<const DexClass*,
+                        std::set<DexClass*, dexclasses_comparator>,
+                        dexclasses_comparator>;
 using class_to_store_map_t = std::unordered_map<const DexClass*, DexStore*>;
 using allowed_store_map_t =
     std::unordered_map<std::string, std::set<std::string>>;
@@ -74,9 +76,9 @@ void build_allowed_stores(
 /**
  * Helper function that scans all the opcodes in the application and produces a map of references
  * from the class containing the opcode to the class referenced by the opcode.
+ * The methods are scanned in parallel.
  *
  * @param scope all classes we're processing
- * @param dmethod_refs [out] all refs to dmethods in the application
  * @param class_refs [out] all refs to classes in the application
  *
  */
@@ -84,38 +86,51 @@ void build_refs(
     const Scope& scope,
     refs_t& class_refs) {
   // TODO: walk through annotations
-  walk::opcodes(
-    scope,
-    [](const DexMethod*) { return true; },
-    [&](const DexMethod* meth, IRInstruction* insn) {
+  using Refs = std::vector<const DexClass*>;
+  auto method_refs = Tool::map_methods<Refs>(scope, [](DexMethod* meth) {
+    Refs refs;
+    auto code = meth->get_code();
+    if (code == nullptr) {
+      return refs;
+    }
+    for (const auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
       if (insn->has_type()) {
         const auto tref = type_class(insn->get_type());
-        if (tref) class_refs[tref].emplace(type_class(meth->get_class()));
-        return;
+        if (tref) refs.push_back(tref);
+        continue;
       }
       if (insn->has_field()) {
         const auto tref = type_class(insn->get_field()->get_class());
-        if (tref) class_refs[tref].emplace(type_class(meth->get_class()));
-        return;
+        if (tref) refs.push_back(tref);
+        continue;
       }
       if (insn->has_method()) {
         // log methods class type, for virtual methods, this may not actually exist and true
         // verification would require that the binding refers to a class that is valid.
         const auto mref = type_class(insn->get_method()->get_class());
-        if (mref) class_refs[mref].emplace(type_class(meth->get_class()));
+        if (mref) refs.push_back(mref);
 
         // don't log return type or types of parameters for now, but this is how you might do it.
         //const auto proto = insn->get_method()->get_proto();
         // const auto rref = type_class(proto->get_rtype());
-        // if (rref) class_refs[rref].emplace(type_class(meth->get_class()));
+        // if (rref) refs.push_back(rref);
         // for (const auto arg : proto->get_args()->get_type_list()) {
         //   const auto aref = type_class(arg);
-        //   if (aref) class_refs[aref].emplace(type_class(meth->get_class()));
+        //   if (aref) refs.push_back(aref);
         // }
 
-        return;
+        continue;
       }
-    });
+    }
+    return refs;
+  });
+  for (const auto& pair : method_refs) {
+    auto referer = type_class(pair.first->get_class());
+    for (auto ref : pair.second) {
+      class_refs[ref].emplace(referer);
+    }
+  }
 }
 
 void verify(DexStoresVector& stores) {
@@ -9,14 +9,17 @@
 
 #include "DexDebugInstruction.h"
 #include "Formatters.h"
+#include "PageAccounting.h"
 #include "PrintUtil.h"
 #include "RedexDump.h"
 #include "utils/Unicode.h"
 
+#include <fstream>
 #include <sstream>
 #include <vector>
 #include <string.h>
 #include <string>
+#include <unordered_set>
 
 /**
  * Return a proto string in the form
@@ -763,3 +766,101 @@ void dump_enarr(ddump_data* rd) {
     }
   }
 }
+
+/**
+ * Return a method in the form redex names it:
+ * class.name:(argTypes)returnType
+ */
+static std::string get_method_name(ddump_data* rd, uint32_t idx) {
+  dex_method_id* method = rd->dex_method_ids + idx;
+  std::string ret = dex_string_by_type_idx(rd, method->classidx);
+  ret += ".";
+  ret += dex_string_by_idx(rd, method->nameidx);
+  ret += ":";
+  ret += get_proto(rd, method->protoidx, false);
+  return ret;
+}
+
+void dump_page_report(ddump_data* rd, const char* trace_filename) {
+  // The trace holds one class or method per line, as class descriptors or
+  // interdex list entries (com/foo/Bar.class), and as class.name:proto.
+  std::ifstream trace(trace_filename);
+  if (!trace) {
+    fprintf(stderr, "Can't open access trace %s\n", trace_filename);
+    return;
+  }
+  std::unordered_set<std::string> classes;
+  std::unordered_set<std::string> methods;
+  const std::string class_tail = ".class";
+  std::string line;
+  while (std::getline(trace, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    if (line.size() > class_tail.size() &&
+        line.compare(line.size() - class_tail.size(), class_tail.size(),
+                     class_tail) == 0) {
+      classes.emplace("L" + line.substr(0, line.size() - class_tail.size()) +
+                      ";");
+    } else if (line.find(";.") != std::string::npos) {
+      methods.emplace(line);
+    } else {
+      classes.emplace(line);
+    }
+  }
+
+  unsigned count;
+  dex_map_item* maps;
+  get_dex_map_items(rd, &count, &maps);
+  PageAccounter accounter;
+  add_dex_sections(accounter, maps, count, rd->dex_size);
+
+  // A class that is listed, or that has a listed method, touches its class
+  // def and class data; a listed method touches its code item.
+  auto class_defs = (dex_class_def*)(rd->dexmmap + rd->dexh->class_defs_off);
+  for (uint32_t i = 0; i < rd->dexh->class_defs_size; i++) {
+    const dex_class_def* cls = class_defs + i;
+    bool touched = classes.count(dex_string_by_type_idx(rd, cls->typeidx));
+    uint32_t class_data_size = 0;
+    if (cls->class_data_offset) {
+      auto class_data_start =
+          (const uint8_t*)(rd->dexmmap + cls->class_data_offset);
+      auto class_data = class_data_start;
+      uint32_t sfield_count = read_uleb128(&class_data);
+      uint32_t ifield_count = read_uleb128(&class_data);
+      uint32_t dmethod_count = read_uleb128(&class_data);
+      uint32_t vmethod_count = read_uleb128(&class_data);
+      for (uint32_t j = 0; j < (sfield_count + ifield_count) * 2; j++) {
+        read_uleb128(&class_data);
+      }
+      auto touch_methods = [&](uint32_t method_count) {
+        uint32_t meth_idx = 0;
+        for (uint32_t j = 0; j < method_count; j++) {
+          meth_idx += read_uleb128(&class_data);
+          read_uleb128(&class_data); // access flags
+          auto code_off = read_uleb128(&class_data);
+          if (!methods.count(get_method_name(rd, meth_idx))) {
+            continue;
+          }
+          touched = true;
+          if (code_off) {
+            auto code_item = (dex_code_item*)(rd->dexmmap + code_off);
+            auto code_end = code_item;
+            get_code_item(&code_end);
+            accounter.touch(code_off, (char*)code_end - (char*)code_item);
+          }
+        }
+      };
+      touch_methods(dmethod_count);
+      touch_methods(vmethod_count);
+      class_data_size = class_data - class_data_start;
+    }
+    if (touched) {
+      accounter.touch(rd->dexh->class_defs_off + i * sizeof(dex_class_def),
+                      sizeof(dex_class_def));
+      accounter.touch(cls->class_data_offset, class_data_size);
+    }
+  }
+  accounter.print(redump_output(),
+                  std::string("\nPAGES TOUCHED BY ") + trace_filename);
+}
@@ -15,25 +15,31 @@ bool clean = false;
 bool raw = false;
 bool escape = false;
 
+static thread_local FILE* t_output = nullptr;
+
+FILE* redump_output() { return t_output != nullptr ? t_output : stdout; }
+
+void set_redump_output(FILE* fd) { t_output = fd; }
+
 void redump(const char* format, ...) {
   va_list va;
   va_start(va, format);
-  vprintf(format, va);
+  vfprintf(redump_output(), format, va);
   va_end(va);
 }
 
 void redump(uint32_t off, const char* format, ...) {
   va_list va;
   va_start(va, format);
-  if (!clean) printf("[0x%x] ", off);
-  vprintf(format, va);
+  if (!clean) fprintf(redump_output(), "[0x%x] ", off);
+  vfprintf(redump_output(), format, va);
   va_end(va);
 }
 
 void redump(uint32_t pos, uint32_t off, const char* format, ...) {
   va_list va;
   va_start(va, format);
-  if (!clean) printf("(0x%x) [0x%x] ", pos, off);
-  vprintf(format, va);
+  if (!clean) fprintf(redump_output(), "(0x%x) [0x%x] ", pos, off);
+  vfprintf(redump_output(), format, va);
   va_end(va);
 }
@@ -10,11 +10,19 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
 
 extern bool clean;
 extern bool raw;
 extern bool escape;
 
+/*
+ * Where redump() writes on the calling thread: stdout, unless the thread was
+ * given a buffer of its own, so several dumps can run at once.
+ */
+FILE* redump_output();
+void set_redump_output(FILE* fd);
+
 void redump(const char* format, ...);
 void redump(uint32_t off, const char* format, ...);
 void redump(uint32_t pos, uint32_t off, const char* format, ...);
@@ -8,13 +8,17 @@
  */
 
 #include "RedexDump.h"
+#include <functional>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
+#include <json/json.h>
+#include <sstream>
 
 #include "PrintUtil.h"
 #include "Formatters.h"
+#include "WorkQueue.h"
 
 static const char ddump_usage_string[] =
     "ReDex, DEX Dump tool\n"
@@ -43,13 +47,58 @@ static const char ddump_usage_string[] =
     "-A, --anno: print items in the annotation section\n"
     "-d, --debug: print debug info items in the data section\n"
     "-D, --ddebug=<addr>: disassemble debug info item at <addr>\n"
+    "-P, --pages=<trace>: count the pages of each section touched by the\n"
+    "    classes and methods listed in <trace>\n"
     "\n"
     "printing options:\n"
     "--clean: suppress indices and offsets\n"
     "--no-headers: suppress headers\n"
     "--raw: print all bytes, even control characters\n"
+    "--json: print a JSON array with an object per dex, holding the lines\n"
+    "    of each section\n"
+    "-j, --jobs=<n>: dump with n threads (one per core by default); the\n"
+    "    output doesn't depend on it\n"
   ;
 
+namespace {
+
+struct Section {
+  const char* name;
+  std::function<void(ddump_data*)> dump;
+};
+
+// Runs the dump with redump() writing into a buffer, and returns the buffer.
+std::string dump_to_string(const Section& section, ddump_data* rd) {
+  char* buf = nullptr;
+  size_t size = 0;
+  FILE* fd = open_memstream(&buf, &size);
+  set_redump_output(fd);
+  section.dump(rd);
+  set_redump_output(nullptr);
+  fclose(fd);
+  std::string ret(buf, size);
+  free(buf);
+  return ret;
+}
+
+Json::Value lines_of(const std::string& text) {
+  Json::Value lines(Json::arrayValue);
+  size_t start = 0;
+  while (start < text.size()) {
+    auto end = text.find('\n', start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    if (end > start) {
+      lines.append(text.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  return lines;
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
 
   bool all = false;
@@ -66,9 +115,11 @@ int main(int argc, char* argv[]) {
   bool anno = false;
   bool redexdump_debug = false;
   uint32_t ddebug_offset = 0;
+  const char* page_trace = nullptr;
   int no_headers = 0;
+  int json = 0;
 
-  char c;
+  int c;
   static const struct option options[] = {
     { "all", no_argument, nullptr, 'a' },
     { "string", no_argument, nullptr, 's' },
@@ -84,10 +135,13 @@ int main(int argc, char* argv[]) {
     { "anno", no_argument, nullptr, 'A' },
     { "debug", no_argument, nullptr, 'd' },
     { "ddebug", required_argument, nullptr, 'D' },
+    { "pages", required_argument, nullptr, 'P' },
     { "clean", no_argument, (int*)&clean, 1 },
     { "raw", no_argument, (int*)&raw, 1 },
     { "escape", no_argument, (int*)&escape, 1 },
     { "no-headers", no_argument, &no_headers, 1 },
+    { "json", no_argument, &json, 1 },
+    { "jobs", required_argument, nullptr, 'j' },
     { "help", no_argument, nullptr, 'h' },
     { nullptr, 0, nullptr, 0 },
   };
@@ -95,7 +149,7 @@ int main(int argc, char* argv[]) {
   while ((c = getopt_long(
             argc,
             argv,
-            "asStpfmcCxeAdDh",
+            "asStpfmcCxeAdDP:j:h",
             &options[0],
             nullptr)) != -1) {
     switch (c) {
@@ -141,6 +195,12 @@ int main(int argc, char* argv[]) {
       case 'D':
         sscanf(optarg, "%x", &ddebug_offset);
         break;
+      case 'P':
+        page_trace = optarg;
+        break;
+      case 'j':
+        set_num_threads_override(atoi(optarg));
+        break;
       case 'h':
         puts(ddump_usage_string);
         return 0;
@@ -159,55 +219,91 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  while (optind < argc) {
-    const char* dexfile = argv[optind++];
-    ddump_data rd;
-    open_dex_file(dexfile, &rd);
-    if (!no_headers) {
-      redump(format_map(&rd).c_str());
-    }
-    if (string || all) {
-      dump_strings(&rd, !no_headers);
-    }
-    if (stringdata || all) {
-      dump_stringdata(&rd, !no_headers);
-    }
-    if (type || all) {
-      dump_types(&rd);
+  bool headers = !no_headers;
+  std::vector<Section> sections;
+  auto add_section = [&](bool enabled, const char* name,
+                         std::function<void(ddump_data*)> dump) {
+    if (enabled) {
+      sections.push_back({name, dump});
     }
-    if (proto || all) {
-      dump_protos(&rd, !no_headers);
-    }
-    if (field || all) {
-      dump_fields(&rd, !no_headers);
-    }
-    if (meth || all) {
-      dump_methods(&rd, !no_headers);
-    }
-    if (clsdef || all) {
-      dump_clsdefs(&rd, !no_headers);
-    }
-    if (clsdata || all) {
-      dump_clsdata(&rd, !no_headers);
-    }
-    if (code || all) {
-      dump_code(&rd);
-    }
-    if (enarr || all) {
-      dump_enarr(&rd);
-    }
-    if (anno || all) {
-      dump_anno(&rd);
-    }
-    if (redexdump_debug || all) {
-      dump_debug(&rd);
+  };
+  add_section(headers, "header", [](ddump_data* rd) {
+    redump(format_map(rd).c_str());
+  });
+  add_section(string || all, "string", [=](ddump_data* rd) {
+    dump_strings(rd, headers);
+  });
+  add_section(stringdata || all, "stringdata", [=](ddump_data* rd) {
+    dump_stringdata(rd, headers);
+  });
+  add_section(type || all, "type", dump_types);
+  add_section(proto || all, "proto", [=](ddump_data* rd) {
+    dump_protos(rd, headers);
+  });
+  add_section(field || all, "field", [=](ddump_data* rd) {
+    dump_fields(rd, headers);
+  });
+  add_section(meth || all, "meth", [=](ddump_data* rd) {
+    dump_methods(rd, headers);
+  });
+  add_section(clsdef || all, "clsdef", [=](ddump_data* rd) {
+    dump_clsdefs(rd, headers);
+  });
+  add_section(clsdata || all, "clsdata", [=](ddump_data* rd) {
+    dump_clsdata(rd, headers);
+  });
+  add_section(code || all, "code", dump_code);
+  add_section(enarr || all, "enarr", dump_enarr);
+  add_section(anno || all, "anno", dump_anno);
+  add_section(redexdump_debug || all, "debug", dump_debug);
+  add_section(ddebug_offset != 0, "ddebug", [=](ddump_data* rd) {
+    disassemble_debug(rd, ddebug_offset);
+  });
+  add_section(page_trace != nullptr, "pages", [=](ddump_data* rd) {
+    dump_page_report(rd, page_trace);
+  });
+
+  // Every section of every dex is dumped on its own, into its own buffer,
+  // and the buffers are written out in the order of a sequential dump.
+  std::vector<const char*> dexfiles(argv + optind, argv + argc);
+  std::vector<ddump_data> dexes(dexfiles.size());
+  for (size_t i = 0; i < dexfiles.size(); ++i) {
+    open_dex_file(dexfiles[i], &dexes[i]);
+  }
+  std::vector<std::string> outputs(dexfiles.size() * sections.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    outputs[i] = dump_to_string(sections[i % sections.size()],
+                                &dexes[i / sections.size()]);
+  });
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  if (json) {
+    Json::Value root(Json::arrayValue);
+    for (size_t i = 0; i < dexfiles.size(); ++i) {
+      Json::Value dex(Json::objectValue);
+      dex["file"] = dexfiles[i];
+      for (size_t j = 0; j < sections.size(); ++j) {
+        dex[sections[j].name] = lines_of(outputs[i * sections.size() + j]);
+      }
+      root.append(dex);
     }
-    if (ddebug_offset != 0) {
-      disassemble_debug(&rd, ddebug_offset);
+    Json::StyledStreamWriter writer;
+    std::ostringstream out;
+    writer.write(out, root);
+    fputs(out.str().c_str(), stdout);
+    return 0;
+  }
+  for (size_t i = 0; i < dexfiles.size(); ++i) {
+    for (size_t j = 0; j < sections.size(); ++j) {
+      const auto& output = outputs[i * sections.size() + j];
+      fwrite(output.data(), 1, output.size(), stdout);
     }
     fprintf(stdout, "\n");
-    fflush(stdout);
   }
+  fflush(stdout);
 
   return 0;
 }
@@ -24,3 +24,4 @@ void dump_enarr(ddump_data* rd);
 void dump_anno(ddump_data* rd);
 void dump_debug(ddump_data* rd);
 void disassemble_debug(ddump_data* rd, uint32_t offset);
+void dump_page_report(ddump_data* rd, const char* trace_filename);
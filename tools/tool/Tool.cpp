@@ -21,16 +21,6 @@ namespace fs = boost::filesystem;
 
 namespace {
 
-void load_store_dexen(DexStore& store, const DexMetadata& store_metadata, bool verbose) {
-  for (const auto& file_path : store_metadata.get_files()) {
-    if (verbose) {
-      std::cout << "Loading " << file_path << std::endl;
-    }
-    DexClasses classes = load_classes_from_dex(file_path.c_str(), true);
-    store.add_classes(std::move(classes));
-  }
-}
-
 DexMetadata parse_store_metadata(const fs::path& metadata_path) {
   DexMetadata metadata;
   std::ifstream file(metadata_path.string(), std::ios::in);
@@ -138,10 +128,25 @@ DexStoresVector Tool::init(
   load_root_dexen(root_store, dexen_dir_str, /* balloon = */ true, m_verbose);
   stores.emplace_back(std::move(root_store));
 
-  // Load module dexen
-  for (const auto& metadata : find_stores(apk_dir_str, dexen_dir_str)) {
+  // Load module dexen, all of them together on one pool.
+  auto metadatas = find_stores(apk_dir_str, dexen_dir_str);
+  std::vector<std::string> locations;
+  for (const auto& metadata : metadatas) {
+    for (const auto& file_path : metadata.get_files()) {
+      if (m_verbose) {
+        std::cout << "Loading " << file_path << std::endl;
+      }
+      locations.push_back(file_path);
+    }
+  }
+  std::vector<dex_stats_t> stats;
+  auto dexen = load_classes_from_dexes(locations, &stats);
+  auto dex_it = dexen.begin();
+  for (const auto& metadata : metadatas) {
     DexStore store(metadata);
-    load_store_dexen(store, metadata, m_verbose);
+    for (size_t i = 0; i < metadata.get_files().size(); ++i) {
+      store.add_classes(std::move(*dex_it++));
+    }
     stores.emplace_back(std::move(store));
   }
 
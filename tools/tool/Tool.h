@@ -16,6 +16,8 @@
 
 #include "DexStore.h"
 #include "ToolRegistry.h"
+#include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace po = boost::program_options;
 
@@ -44,6 +46,27 @@ class Tool {
   const std::string& name() const { return m_name; }
   const std::string& desc() const { return m_desc; }
 
+  /*
+   * Calls fn on every method of scope in parallel, and returns what it
+   * returned for each of them in the order walk::methods() visits them, so
+   * that what a tool prints doesn't depend on how the methods were scheduled.
+   */
+  template <typename Result>
+  static std::vector<std::pair<DexMethod*, Result>> map_methods(
+      const Scope& scope, const std::function<Result(DexMethod*)>& fn) {
+    std::vector<std::pair<DexMethod*, Result>> results;
+    walk::methods(scope, [&](DexMethod* method) {
+      results.emplace_back(method, Result());
+    });
+    auto wq = workqueue_foreach<size_t>(
+        [&](size_t i) { results[i].second = fn(results[i].first); });
+    for (size_t i = 0; i < results.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+    return results;
+  }
+
  protected:
 
   DexStoresVector init(
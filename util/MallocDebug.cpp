@@ -30,6 +30,7 @@
 #include <dlfcn.h>
 #endif
 
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -160,10 +161,20 @@ class MallocDebug {
 
 thread_local MallocDebug malloc_debug;
 
+std::atomic<size_t> malloc_count{0};
+
 }
 
 extern "C" {
 
-void* malloc(size_t sz) { return malloc_debug.malloc(sz); }
+void* malloc(size_t sz) {
+  malloc_count.fetch_add(1, std::memory_order_relaxed);
+  return malloc_debug.malloc(sz);
+}
+
+// Picked up by PassManager to report allocations per pass.
+size_t redex_malloc_count() {
+  return malloc_count.load(std::memory_order_relaxed);
+}
 
 }
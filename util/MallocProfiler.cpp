@@ -0,0 +1,267 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+/**
+ * Sampling allocation profiler, for finding out where redex's memory goes. To
+ * use, build redex-all-malloc-prof, run it like redex-all, and turn the
+ * profile into a flame graph:
+ *
+ *   MALLOC_PROFILE=alloc.folded ./redex-all-malloc-prof --out out.apk in.apk
+ *   flamegraph.pl --countname=bytes alloc.folded > alloc.svg
+ *
+ * One in MALLOC_SAMPLE_RATE allocations (997 by default) records its size and
+ * the stack that made it. The samples are aggregated per stack and per pass:
+ * PassManager tells us which pass is running, and the pass is the root frame
+ * of the stacks recorded while it runs. At exit, every stack is written out in
+ * the folded format of flame graphs, weighted by an estimate of the bytes
+ * allocated through it (the bytes sampled times the sample rate).
+ *
+ * Nothing on the sampling path allocates: the stacks are aggregated into a
+ * fixed table in static storage, of which only the pages in use are ever
+ * touched. Allocations that aren't sampled only pay for a thread-local
+ * countdown. Only malloc is interposed, which covers operator new.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <string>
+#include <unordered_map>
+
+#ifdef __APPLE__
+typedef void* (*MallocFn)(size_t);
+static auto libc_malloc = reinterpret_cast<MallocFn>(dlsym(RTLD_NEXT, "malloc"));
+#endif
+
+#ifdef __linux__
+extern "C" {
+extern void *__libc_malloc(size_t size);
+}
+
+static auto libc_malloc = __libc_malloc;
+#endif
+
+namespace {
+
+// A prime, so that the samples don't fall into step with loops that make a
+// fixed number of allocations per iteration.
+constexpr size_t kDefaultSampleRate = 997;
+constexpr size_t kMaxDepth = 32;
+// The frames of the sampler and of malloc itself.
+constexpr size_t kSkippedFrames = 2;
+constexpr size_t kMaxStacks = 1 << 16;
+constexpr size_t kMaxPhases = 1024;
+constexpr size_t kMaxPhaseName = 128;
+
+struct Stack {
+  uint64_t hash;
+  uint32_t phase;
+  uint32_t depth;
+  void* frames[kMaxDepth];
+  uint64_t samples;
+  uint64_t bytes;
+};
+
+// All of these are zero-initialized before any code runs, so that malloc may
+// be called before the static constructors, and after the destructors.
+Stack s_stacks[kMaxStacks];
+size_t s_num_stacks;
+size_t s_dropped_samples;
+char s_phases[kMaxPhases][kMaxPhaseName];
+size_t s_num_phases;
+std::atomic<uint32_t> s_current_phase;
+std::atomic_flag s_lock = ATOMIC_FLAG_INIT;
+std::atomic<size_t> s_sample_rate;
+std::atomic<size_t> s_sampled_allocations;
+
+thread_local size_t t_countdown;
+thread_local bool t_in_profiler;
+
+class SpinLock {
+ public:
+  SpinLock() {
+    while (s_lock.test_and_set(std::memory_order_acquire)) {
+    }
+  }
+  ~SpinLock() { s_lock.clear(std::memory_order_release); }
+};
+
+size_t sample_rate() {
+  auto rate = s_sample_rate.load(std::memory_order_relaxed);
+  if (rate == 0) {
+    const char* rate_env = getenv("MALLOC_SAMPLE_RATE");
+    rate = rate_env != nullptr ? strtoul(rate_env, nullptr, 10) : 0;
+    if (rate == 0) {
+      rate = kDefaultSampleRate;
+    }
+    s_sample_rate.store(rate, std::memory_order_relaxed);
+  }
+  return rate;
+}
+
+uint64_t hash_stack(uint32_t phase, void* const* frames, size_t depth) {
+  // FNV-1a.
+  uint64_t hash = 14695981039346656037ull ^ phase;
+  for (size_t i = 0; i < depth; ++i) {
+    hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ull;
+  }
+  return hash;
+}
+
+__attribute__((noinline)) void record_sample(size_t size) {
+  void* frames[kMaxDepth + kSkippedFrames];
+  int depth = backtrace(frames, kMaxDepth + kSkippedFrames);
+  size_t skipped = std::min<size_t>(depth, kSkippedFrames);
+  depth -= skipped;
+  auto phase = s_current_phase.load(std::memory_order_relaxed);
+  auto hash = hash_stack(phase, frames + skipped, depth);
+  s_sampled_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  SpinLock guard;
+  // Open addressing with linear probing; the table is never shrunk.
+  for (size_t i = 0; i < kMaxStacks; ++i) {
+    auto& stack = s_stacks[(hash + i) % kMaxStacks];
+    if (stack.samples == 0) {
+      if (s_num_stacks >= kMaxStacks / 4 * 3) {
+        // Past this load, probing gets slow. The dump reports the loss.
+        break;
+      }
+      ++s_num_stacks;
+      stack.hash = hash;
+      stack.phase = phase;
+      stack.depth = depth;
+      memcpy(stack.frames, frames + skipped, depth * sizeof(void*));
+    } else if (stack.hash != hash || stack.phase != phase ||
+               stack.depth != static_cast<uint32_t>(depth) ||
+               memcmp(stack.frames, frames + skipped, depth * sizeof(void*))) {
+      continue;
+    }
+    ++stack.samples;
+    stack.bytes += size;
+    return;
+  }
+  ++s_dropped_samples;
+}
+
+std::string symbolize(void* address) {
+  Dl_info info;
+  if (dladdr(address, &info) == 0 || info.dli_sname == nullptr) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%p", address);
+    return buffer;
+  }
+  int status;
+  char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, 0, &status);
+  std::string name = status == 0 ? demangled : info.dli_sname;
+  free(demangled);
+  // Semicolons separate the frames of the folded format.
+  for (auto& c : name) {
+    if (c == ';') {
+      c = ':';
+    }
+  }
+  return name;
+}
+
+void dump_profile() {
+  t_in_profiler = true;
+  const char* path = getenv("MALLOC_PROFILE");
+  if (path == nullptr) {
+    path = "redex-malloc-profile.folded";
+  }
+  FILE* out = fopen(path, "w");
+  if (out == nullptr) {
+    fprintf(stderr, "Failed to write the allocation profile to %s\n", path);
+    return;
+  }
+  SpinLock guard;
+  auto rate = sample_rate();
+  std::unordered_map<void*, std::string> names;
+  for (const auto& stack : s_stacks) {
+    if (stack.samples == 0) {
+      continue;
+    }
+    fputs(stack.phase == 0 ? "(no pass)" : s_phases[stack.phase - 1], out);
+    // Folded stacks go from the root to the leaf.
+    for (size_t i = stack.depth; i-- > 0;) {
+      auto address = stack.frames[i];
+      auto it = names.find(address);
+      if (it == names.end()) {
+        it = names.emplace(address, symbolize(address)).first;
+      }
+      fputc(';', out);
+      fputs(it->second.c_str(), out);
+    }
+    fprintf(out, " %llu\n", (unsigned long long)(stack.bytes * rate));
+  }
+  fclose(out);
+  fprintf(stderr,
+          "Wrote the allocation profile of %zu stacks to %s, sampling one in "
+          "%zu allocations (%zu samples dropped)\n",
+          s_num_stacks, path, rate, s_dropped_samples);
+}
+
+struct Dumper {
+  ~Dumper() { dump_profile(); }
+} s_dumper;
+
+} // namespace
+
+extern "C" {
+
+void* malloc(size_t sz) {
+  if (t_countdown > 0) {
+    --t_countdown;
+    return libc_malloc(sz);
+  }
+  if (t_in_profiler) {
+    // backtrace() allocates the first time it's called.
+    return libc_malloc(sz);
+  }
+  t_in_profiler = true;
+  t_countdown = sample_rate() - 1;
+  record_sample(sz);
+  t_in_profiler = false;
+  return libc_malloc(sz);
+}
+
+// Picked up by PassManager to attribute the samples to the running pass. A
+// null name means that no pass is running.
+void redex_malloc_profile_phase(const char* name) {
+  t_in_profiler = true;
+  uint32_t phase = 0;
+  if (name != nullptr) {
+    SpinLock guard;
+    for (size_t i = 0; i < s_num_phases && phase == 0; ++i) {
+      if (strncmp(s_phases[i], name, kMaxPhaseName - 1) == 0) {
+        phase = i + 1;
+      }
+    }
+    if (phase == 0 && s_num_phases < kMaxPhases) {
+      strncpy(s_phases[s_num_phases], name, kMaxPhaseName - 1);
+      phase = ++s_num_phases;
+    }
+  }
+  s_current_phase.store(phase, std::memory_order_relaxed);
+  t_in_profiler = false;
+}
+
+// Picked up by PassManager to report allocations per pass. This is an
+// estimate, from the number of allocations sampled.
+size_t redex_malloc_count() {
+  return s_sampled_allocations.load(std::memory_order_relaxed) * sample_rate();
+}
+
+}